@@ -22,6 +22,8 @@
 
 #include <algorithm>
 
+#include "common/NioUtils.h"
+
 using namespace filament;
 using namespace utils;
 
@@ -234,6 +236,29 @@ Java_com_google_android_filament_LightManager_nSetPosition(JNIEnv*, jclass,
     lm->setPosition((LightManager::Instance) i, {x, y, z});
 }
 
+// Sets the positions of 'count' instances, given in an int buffer of instances and a float buffer
+// of packed xyz positions.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_LightManager_nSetPositions(JNIEnv* env, jclass,
+        jlong nativeLightManager, jobject instances_, jint instancesRemaining,
+        jobject positions_, jint positionsRemaining, jint count) {
+    LightManager *lm = (LightManager *) nativeLightManager;
+    AutoBuffer instances(env, instances_, count);
+    AutoBuffer positions(env, positions_, count * 3);
+    if (count * sizeof(jint) > (size_t(instancesRemaining) << instances.getShift()) ||
+            count * sizeof(filament::math::float3) >
+                    (size_t(positionsRemaining) << positions.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    auto const* li = static_cast<jint const*>(instances.getData());
+    auto const* values = static_cast<filament::math::float3 const*>(positions.getData());
+    for (jint i = 0; i < count; i++) {
+        lm->setPosition((LightManager::Instance) li[i], values[i]);
+    }
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_LightManager_nGetPosition(JNIEnv* env, jclass,
         jlong nativeLightManager, jint i, jfloatArray out_) {
@@ -282,6 +307,28 @@ Java_com_google_android_filament_LightManager_nSetIntensity__JIF(JNIEnv*, jclass
     lm->setIntensity((LightManager::Instance) i, intensity);
 }
 
+// Sets the intensities of 'count' instances, given in an int buffer of instances and a float
+// buffer of intensities in lux or lumen, depending on the type of the light.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_LightManager_nSetIntensities(JNIEnv* env, jclass,
+        jlong nativeLightManager, jobject instances_, jint instancesRemaining,
+        jobject intensities_, jint intensitiesRemaining, jint count) {
+    LightManager *lm = (LightManager *) nativeLightManager;
+    AutoBuffer instances(env, instances_, count);
+    AutoBuffer intensities(env, intensities_, count);
+    if (count * sizeof(jint) > (size_t(instancesRemaining) << instances.getShift()) ||
+            count * sizeof(jfloat) > (size_t(intensitiesRemaining) << intensities.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    auto const* li = static_cast<jint const*>(instances.getData());
+    auto const* values = static_cast<jfloat const*>(intensities.getData());
+    for (jint i = 0; i < count; i++) {
+        lm->setIntensity((LightManager::Instance) li[i], values[i]);
+    }
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_LightManager_nSetIntensity__JIFF(JNIEnv*, jclass,
         jlong nativeLightManager, jint i, jfloat watts, jfloat efficiency) {
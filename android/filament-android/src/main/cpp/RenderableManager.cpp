@@ -260,6 +260,46 @@ Java_com_google_android_filament_RenderableManager_nSetLayerMask(JNIEnv*, jclass
     rm->setLayerMask((RenderableManager::Instance) i, (uint8_t) select, (uint8_t) value);
 }
 
+// Changes the same layer mask bits of 'count' instances, given in an int buffer.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_RenderableManager_nSetLayerMasks(JNIEnv* env, jclass,
+        jlong nativeRenderableManager, jobject instances_, jint remaining, jint count,
+        jint select, jint value) {
+    RenderableManager *rm = (RenderableManager *) nativeRenderableManager;
+    AutoBuffer instances(env, instances_, count);
+    if (count * sizeof(jint) > (size_t(remaining) << instances.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    auto const* ci = static_cast<jint const*>(instances.getData());
+    for (jint i = 0; i < count; i++) {
+        rm->setLayerMask((RenderableManager::Instance) ci[i], (uint8_t) select, (uint8_t) value);
+    }
+    return 0;
+}
+
+// Sets the priorities of 'count' instances, given in an int buffer of instances and an int buffer
+// of priorities.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_RenderableManager_nSetPriorities(JNIEnv* env, jclass,
+        jlong nativeRenderableManager, jobject instances_, jint instancesRemaining,
+        jobject priorities_, jint prioritiesRemaining, jint count) {
+    RenderableManager *rm = (RenderableManager *) nativeRenderableManager;
+    AutoBuffer instances(env, instances_, count);
+    AutoBuffer priorities(env, priorities_, count);
+    if (count * sizeof(jint) > (size_t(instancesRemaining) << instances.getShift()) ||
+            count * sizeof(jint) > (size_t(prioritiesRemaining) << priorities.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    auto const* ci = static_cast<jint const*>(instances.getData());
+    auto const* values = static_cast<jint const*>(priorities.getData());
+    for (jint i = 0; i < count; i++) {
+        rm->setPriority((RenderableManager::Instance) ci[i], (uint8_t) values[i]);
+    }
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_RenderableManager_nSetPriority(JNIEnv*, jclass,
         jlong nativeRenderableManager, jint i, jint priority) {
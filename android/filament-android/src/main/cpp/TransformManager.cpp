@@ -23,6 +23,8 @@
 
 #include <math/mat4.h>
 
+#include "common/NioUtils.h"
+
 using namespace utils;
 using namespace filament;
 
@@ -97,6 +99,32 @@ Java_com_google_android_filament_TransformManager_nSetTransform(JNIEnv* env,
     env->ReleaseFloatArrayElements(localTransform_, localTransform, JNI_ABORT);
 }
 
+// Sets the local transforms of 'count' instances at once, from an int buffer of instances and a
+// float buffer of column-major matrices. The transforms are set within a local transform
+// transaction, which is committed before returning.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_TransformManager_nSetTransforms(JNIEnv* env,
+        jclass, jlong nativeTransformManager, jobject instances_, jint instancesRemaining,
+        jobject localTransforms_, jint localTransformsRemaining, jint count) {
+    TransformManager* tm = (TransformManager*) nativeTransformManager;
+    AutoBuffer instances(env, instances_, count);
+    AutoBuffer localTransforms(env, localTransforms_, count * 16);
+    if (count * sizeof(jint) > (size_t(instancesRemaining) << instances.getShift()) ||
+            count * sizeof(filament::math::mat4f) >
+                    (size_t(localTransformsRemaining) << localTransforms.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    auto const* ci = static_cast<jint const*>(instances.getData());
+    auto const* transforms = static_cast<filament::math::mat4f const*>(localTransforms.getData());
+    tm->openLocalTransformTransaction();
+    for (jint i = 0; i < count; i++) {
+        tm->setTransform((TransformManager::Instance) ci[i], transforms[i]);
+    }
+    tm->commitLocalTransformTransaction();
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_TransformManager_nGetTransform(JNIEnv* env,
         jclass, jlong nativeTransformManager, jint i,
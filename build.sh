@@ -199,6 +199,33 @@ function build_desktop {
     fi
 }
 
+# Builds a variant of filament-js in its own folder, since all the libraries need to be compiled
+# with its flags, and copies it next to the baseline module. Filament.init() picks the variant.
+function build_webgl_variant {
+    local lc_target=$(echo "$1" | tr '[:upper:]' '[:lower:]')
+    local build_type=$1
+    local variant=$2
+    shift 2
+
+    echo "Building WebGL ${lc_target} filament-${variant}..."
+    mkdir -p "../cmake-webgl-${lc_target}-${variant}"
+    (
+    cd "../cmake-webgl-${lc_target}-${variant}"
+    # shellcheck disable=SC1090
+    source "${EMSDK}/emsdk_env.sh"
+    cmake \
+        -G "${BUILD_GENERATOR}" \
+        -DIMPORT_EXECUTABLES_DIR=out \
+        -DCMAKE_TOOLCHAIN_FILE="${EMSDK}/upstream/emscripten/cmake/Modules/Platform/Emscripten.cmake" \
+        -DCMAKE_BUILD_TYPE="${build_type}" \
+        -DWEBGL=1 \
+        "$@" \
+        ../..
+    ${BUILD_COMMAND} filament-js
+    )
+    cp "../cmake-webgl-${lc_target}-${variant}/web/filament-js/filament-${variant}".* web/filament-js/
+}
+
 function build_webgl_with_target {
     local lc_target=$(echo "$1" | tr '[:upper:]' '[:lower:]')
 
@@ -230,6 +257,10 @@ function build_webgl_with_target {
 
     if [[ -d "web/filament-js" ]]; then
 
+        build_webgl_variant "$1" simd -DFILAMENT_WEBGL_SIMD=ON
+        build_webgl_variant "$1" mt-simd \
+                -DFILAMENT_WEBGL_PTHREADS=ON -DFILAMENT_WEBGL_SIMD=ON
+
         if [[ "${BUILD_JS_DOCS}" == "true" ]]; then
             echo "Generating JavaScript documentation..."
             local DOCS_FOLDER="web/docs"
@@ -249,6 +280,8 @@ function build_webgl_with_target {
                     filament-js/filament.js
             tar -rvf "../../filament-${lc_target}-web.tar" -s /^filament-js/dist/ \
                     filament-js/filament.wasm
+            tar -rvf "../../filament-${lc_target}-web.tar" -s /^filament-js/dist/ \
+                    filament-js/filament-*.js filament-js/filament-*.wasm
             cd -
             gzip -c "../filament-${lc_target}-web.tar" > "../filament-${lc_target}-web.tgz"
             rm "../filament-${lc_target}-web.tar"
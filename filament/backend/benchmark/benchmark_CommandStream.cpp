@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "noop/NoopDriver.h"
+
+#include "private/backend/CircularBuffer.h"
+#include "private/backend/CommandBufferQueue.h"
+#include "private/backend/CommandStream.h"
+
+#include <backend/DriverEnums.h>
+#include <backend/Handle.h>
+
+#include <utils/compiler.h>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <thread>
+
+#include <string.h>
+
+using namespace filament;
+using namespace filament::backend;
+
+namespace {
+
+// same sizes as the engine's defaults
+constexpr size_t REQUIRED_SIZE = 1 * 1024 * 1024;
+constexpr size_t BUFFER_SIZE = 3 * REQUIRED_SIZE;
+
+// commands recorded between two flushes, they always fit in REQUIRED_SIZE
+constexpr size_t COMMANDS_PER_FLUSH = 1024;
+
+// A CommandStream recording into a CommandBufferQueue, executed by the noop driver.
+class CommandStreamFixture {
+public:
+    CommandStreamFixture()
+            : mDriver(NoopDriver::create()),
+              mQueue(REQUIRED_SIZE, BUFFER_SIZE),
+              mStream(*mDriver, mQueue.getCircularBuffer()) {
+        mStream.debugThreading();
+    }
+
+    ~CommandStreamFixture() {
+        flush(false);
+        mDriver->terminate();
+        delete mDriver;
+    }
+
+    CommandStream& getStream() noexcept { return mStream; }
+    CommandBufferQueue& getQueue() noexcept { return mQueue; }
+
+    // flushes the recorded commands, and executes them if 'execute' is true
+    void flush(bool execute) {
+        if (mQueue.getCircularBuffer().empty()) {
+            // waitForCommands() would wait for commands that never come
+            return;
+        }
+        mQueue.flush();
+        for (auto const& slice : mQueue.waitForCommands()) {
+            if (execute) {
+                mStream.execute(slice.begin);
+            }
+            mQueue.releaseBuffer(slice);
+        }
+    }
+
+private:
+    Driver* mDriver;
+    CommandBufferQueue mQueue;
+    CommandStream mStream;
+};
+
+PipelineState makePipelineState() noexcept {
+    PipelineState pipeline;
+    pipeline.program = Handle<HwProgram>(1);
+    pipeline.rasterState.culling = CullingMode::BACK;
+    pipeline.rasterState.depthFunc = RasterState::DepthFunc::GE;
+    return pipeline;
+}
+
+// Measures the cost of writing a command into the stream. The commands are flushed, but not
+// executed, every COMMANDS_PER_FLUSH iterations, outside of the timed region.
+template<typename Encode>
+void encodeCommands(benchmark::State& state, Encode encode) {
+    CommandStreamFixture fixture;
+    CommandStream& driver = fixture.getStream();
+    size_t count = 0;
+    for (auto _ : state) {
+        encode(driver);
+        if (UTILS_UNLIKELY(++count == COMMANDS_PER_FLUSH)) {
+            state.PauseTiming();
+            fixture.flush(false);
+            state.ResumeTiming();
+            count = 0;
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+// Measures the cost of executing COMMANDS_PER_FLUSH commands through the dispatcher of the noop
+// driver, which does nothing with them except counting the draws.
+template<typename Encode>
+void dispatchCommands(benchmark::State& state, Encode encode) {
+    CommandStreamFixture fixture;
+    CommandStream& driver = fixture.getStream();
+    CommandBufferQueue& queue = fixture.getQueue();
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < COMMANDS_PER_FLUSH; i++) {
+            encode(driver);
+        }
+        queue.flush();
+        auto slices = queue.waitForCommands();
+        state.ResumeTiming();
+
+        for (auto const& slice : slices) {
+            driver.execute(slice.begin);
+        }
+
+        state.PauseTiming();
+        for (auto const& slice : slices) {
+            queue.releaseBuffer(slice);
+        }
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * COMMANDS_PER_FLUSH));
+}
+
+const auto encodeDraw = [pipeline = makePipelineState()](CommandStream& driver) {
+    driver.draw(pipeline, Handle<HwRenderPrimitive>(2), 1);
+};
+
+const auto encodeBindUniformBufferRange = [](CommandStream& driver) {
+    driver.bindUniformBufferRange(1, Handle<HwUniformBuffer>(3), 256, 64);
+};
+
+const auto encodeBindSamplers = [](CommandStream& driver) {
+    driver.bindSamplers(1, Handle<HwSamplerGroup>(4));
+};
+
+const auto encodeUpdateUniformBuffer = [](CommandStream& driver) {
+    void* const data = driver.allocate(64);
+    driver.updateUniformBuffer(Handle<HwUniformBuffer>(3), { data, 64 }, 256);
+};
+
+} // anonymous namespace
+
+static void BM_encode_draw(benchmark::State& state) {
+    encodeCommands(state, encodeDraw);
+}
+
+static void BM_encode_bindUniformBufferRange(benchmark::State& state) {
+    encodeCommands(state, encodeBindUniformBufferRange);
+}
+
+static void BM_encode_bindSamplers(benchmark::State& state) {
+    encodeCommands(state, encodeBindSamplers);
+}
+
+static void BM_encode_updateUniformBuffer(benchmark::State& state) {
+    encodeCommands(state, encodeUpdateUniformBuffer);
+}
+
+static void BM_dispatch_draw(benchmark::State& state) {
+    dispatchCommands(state, encodeDraw);
+}
+
+static void BM_dispatch_bindUniformBufferRange(benchmark::State& state) {
+    dispatchCommands(state, encodeBindUniformBufferRange);
+}
+
+static void BM_dispatch_bindSamplers(benchmark::State& state) {
+    dispatchCommands(state, encodeBindSamplers);
+}
+
+static void BM_dispatch_updateUniformBuffer(benchmark::State& state) {
+    dispatchCommands(state, encodeUpdateUniformBuffer);
+}
+
+// Measures the latency between flush() on the producer thread and the execution of the flushed
+// commands by a consumer thread, like the engine's driver thread. When the consumer is asleep,
+// this includes waking it up.
+static void BM_CommandBufferQueue_handoff(benchmark::State& state) {
+    CommandStreamFixture fixture;
+    CommandStream& driver = fixture.getStream();
+    CommandBufferQueue& queue = fixture.getQueue();
+
+    std::atomic<uint32_t> executedCount{ 0 };
+    std::thread consumer([&driver, &queue, &executedCount]() {
+        while (!queue.isExitRequested()) {
+            for (auto const& slice : queue.waitForCommands()) {
+                driver.execute(slice.begin);
+                queue.releaseBuffer(slice);
+                executedCount.fetch_add(1, std::memory_order_release);
+            }
+        }
+    });
+
+    uint32_t flushedCount = 0;
+    for (auto _ : state) {
+        encodeBindSamplers(driver);
+        queue.flush();
+        flushedCount++;
+        while (executedCount.load(std::memory_order_acquire) != flushedCount) {
+            std::this_thread::yield();
+        }
+    }
+
+    queue.requestExit();
+    consumer.join();
+    state.SetItemsProcessed(int64_t(state.iterations()));
+}
+
+// Measures writing allocations of state.range(0) bytes into a CircularBuffer, which wraps around
+// every BUFFER_SIZE bytes. With ashmem the buffer is mapped twice and wrapping is free, otherwise
+// the head goes back to the beginning of the buffer.
+static void BM_CircularBuffer_wrap(benchmark::State& state) {
+    const size_t size = size_t(state.range(0));
+    CircularBuffer buffer(BUFFER_SIZE);
+    size_t allocated = 0;
+    for (auto _ : state) {
+        void* const p = buffer.allocate(size);
+        memset(p, 0, size);
+        benchmark::DoNotOptimize(p);
+        allocated += size;
+        if (UTILS_UNLIKELY(allocated >= REQUIRED_SIZE)) {
+            buffer.circularize();
+            allocated = 0;
+        }
+    }
+    state.SetBytesProcessed(int64_t(state.iterations() * size));
+}
+
+BENCHMARK(BM_encode_draw);
+BENCHMARK(BM_encode_bindUniformBufferRange);
+BENCHMARK(BM_encode_bindSamplers);
+BENCHMARK(BM_encode_updateUniformBuffer);
+
+BENCHMARK(BM_dispatch_draw);
+BENCHMARK(BM_dispatch_bindUniformBufferRange);
+BENCHMARK(BM_dispatch_bindSamplers);
+BENCHMARK(BM_dispatch_updateUniformBuffer);
+
+BENCHMARK(BM_CommandBufferQueue_handoff)->UseRealTime();
+
+BENCHMARK(BM_CircularBuffer_wrap)->Arg(64)->Arg(4096)->Arg(64 * 1024);
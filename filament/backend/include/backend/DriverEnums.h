@@ -92,6 +92,19 @@ enum class TargetBufferFlags : uint8_t {
     ALL = COLOR_ALL | DEPTH | STENCIL       //!< Color, depth and stencil buffer selected.
 };
 
+/**
+ * Bitmask for selecting which accesses must observe the writes of previous dispatch() calls
+ */
+enum class MemoryBarrierFlags : uint8_t {
+    NONE = 0x0u,                            //!< No barrier.
+    STORAGE_BUFFER = 0x1u,                  //!< Storage buffer accesses.
+    STORAGE_IMAGE = 0x2u,                   //!< Storage image accesses.
+    TEXTURE_FETCH = 0x4u,                   //!< Texture sampling.
+    UNIFORM_BUFFER = 0x8u,                  //!< Uniform buffer reads.
+    INDIRECT_COMMAND = 0x10u,               //!< Arguments of drawIndirect() calls.
+    ALL = STORAGE_BUFFER | STORAGE_IMAGE | TEXTURE_FETCH | UNIFORM_BUFFER | INDIRECT_COMMAND
+};
+
 inline TargetBufferFlags getMRTColorFlag(size_t index) noexcept {
     assert(index < 4);
     return TargetBufferFlags(1u << index);
@@ -506,6 +519,8 @@ enum class TextureUsage : uint8_t {
     UPLOADABLE          = 0x8,                      //!< Data can be uploaded into this texture (default)
     SAMPLEABLE          = 0x10,                     //!< Texture can be sampled (default)
     SUBPASS_INPUT       = 0x20,                     //!< Texture can be used as a subpass input
+    STORAGE             = 0x40,                     //!< Texture can be bound as a storage image
+    TRANSIENT           = 0x80,                     //!< Attachment whose content doesn't outlive a render pass
     DEFAULT             = UPLOADABLE | SAMPLEABLE   //!< Default texture usage
 };
 
@@ -533,6 +548,39 @@ static constexpr bool isDepthFormat(TextureFormat format) noexcept {
     }
 }
 
+//! returns whether this format is a signed or unsigned integer format
+static constexpr bool isIntegerFormat(TextureFormat format) noexcept {
+    switch (format) {
+        case TextureFormat::R8UI:
+        case TextureFormat::R8I:
+        case TextureFormat::R16UI:
+        case TextureFormat::R16I:
+        case TextureFormat::RG8UI:
+        case TextureFormat::RG8I:
+        case TextureFormat::RGB8UI:
+        case TextureFormat::RGB8I:
+        case TextureFormat::R32UI:
+        case TextureFormat::R32I:
+        case TextureFormat::RG16UI:
+        case TextureFormat::RG16I:
+        case TextureFormat::RGBA8UI:
+        case TextureFormat::RGBA8I:
+        case TextureFormat::RGB16UI:
+        case TextureFormat::RGB16I:
+        case TextureFormat::RG32UI:
+        case TextureFormat::RG32I:
+        case TextureFormat::RGBA16UI:
+        case TextureFormat::RGBA16I:
+        case TextureFormat::RGB32UI:
+        case TextureFormat::RGB32I:
+        case TextureFormat::RGBA32UI:
+        case TextureFormat::RGBA32I:
+            return true;
+        default:
+            return false;
+    }
+}
+
 //! returns whether this format a compressed format
 static constexpr bool isCompressedFormat(TextureFormat format) noexcept {
     return format >= TextureFormat::EAC_R11;
@@ -715,6 +763,9 @@ enum class StreamType {
 //! Releases an ACQUIRED external texture, guaranteed to be called on the application thread.
 using StreamCallback = void(*)(void* image, void* user);
 
+//! Signals that programs are ready to be used, guaranteed to be called on the application thread.
+using CompileCallback = void(*)(void* user);
+
 //! Vertex attribute descriptor
 struct Attribute {
     //! attribute is normalized (remapped between 0 and 1)
@@ -849,6 +900,20 @@ struct RenderPassFlags {
     TargetBufferFlags discardEnd;
 };
 
+/**
+ * Describes how the shading rate decreases away from a focal point (foveated rendering). The pixel
+ * density at a point p of the render target, in normalized device coordinates, is:
+ *
+ *      1 / max(1, (gain.x * (p.x - focalPoint.x))^2 + (gain.y * (p.y - focalPoint.y))^2 - foveaArea)
+ *
+ * A gain of zero disables foveation.
+ */
+struct FoveationParams {
+    filament::math::float2 focalPoint = {}; //!< center of the fovea in NDC
+    filament::math::float2 gain = {};       //!< rate of the density falloff
+    float foveaArea = 0.0f;                 //!< size of the full-density region
+};
+
 /**
  * Parameters of a render pass.
  */
@@ -876,6 +941,12 @@ struct RenderPassParams {
      * attachment (see MRT::TARGET_COUNT).
      */
     uint32_t subpassMask = 0;
+
+    /**
+     * Foveation of this pass, ignored if the backend doesn't support foveated rendering, see
+     * Driver::isFoveatedRenderingSupported().
+     */
+    FoveationParams foveation{};
 };
 
 struct PolygonOffset {
@@ -883,6 +954,49 @@ struct PolygonOffset {
     float constant = 0;     // units in GL-speak
 };
 
+/**
+ * Arguments of one of the draws of DriverApi::drawIndirect(). This is the layout of GL's
+ * DrawElementsIndirectCommand, VkDrawIndexedIndirectCommand and Metal's
+ * MTLDrawIndexedPrimitivesIndirectArguments.
+ */
+struct DrawIndirectCommand {
+    uint32_t indexCount;        //!< number of indices, 0 skips the draw
+    uint32_t instanceCount;     //!< number of instances
+    uint32_t firstIndex;        //!< first index (not byte offset) in the index buffer
+    int32_t baseVertex;         //!< value added to the indices
+    uint32_t baseInstance;      //!< must be 0, it isn't supported everywhere
+};
+
+static_assert(sizeof(DrawIndirectCommand) == 20, "DrawIndirectCommand must be tightly packed");
+
+/**
+ * Counts of the commands executed by the driver for a frame, i.e. since the previous endFrame().
+ * A change is counted when a draw uses a different program or raster state than the draw
+ * before it.
+ *
+ * The redundant state counts are the work a backend skipped because the state was already set,
+ * they are 0 when the backend doesn't track it.
+ */
+struct FrameStatistics {
+    uint32_t drawCount = 0;                 //!< draws, including each draw of a drawIndirect()
+    uint32_t pipelineChangeCount = 0;       //!< changes of program or raster state
+    uint32_t programChangeCount = 0;        //!< changes of program
+    uint32_t renderPassCount = 0;           //!< render passes
+    uint32_t samplerGroupUpdateCount = 0;   //!< calls to updateSamplerGroup()
+    uint64_t uniformBufferBytes = 0;        //!< bytes uploaded to uniform buffers
+    uint32_t redundantPipelineCount = 0;    //!< draws with the whole pipeline of the draw before
+    uint32_t redundantUniformBindingCount = 0; //!< bindUniformBufferRange() of the bound range
+};
+
+/**
+ * Memory allocated by a backend, see Engine::getMemoryStatistics(). Each value is 0 when the
+ * backend doesn't know it.
+ */
+struct MemoryStatistics {
+    uint64_t allocatedBytes = 0;    //!< GPU memory the backend allocated, for all purposes
+    uint64_t stagingBytes = 0;      //!< memory the backend keeps to upload data
+};
+
 
 } // namespace backend
 } // namespace filament
@@ -891,5 +1005,7 @@ template<> struct utils::EnableBitMaskOperators<filament::backend::TargetBufferF
         : public std::true_type {};
 template<> struct utils::EnableBitMaskOperators<filament::backend::TextureUsage>
         : public std::true_type {};
+template<> struct utils::EnableBitMaskOperators<filament::backend::MemoryBarrierFlags>
+        : public std::true_type {};
 
 #endif // TNT_FILAMENT_DRIVER_DRIVERENUMS_H
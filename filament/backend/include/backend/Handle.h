@@ -20,6 +20,8 @@
 #include <utils/compiler.h>
 #include <utils/Log.h>
 
+#include <limits>
+
 #include <assert.h>
 
 namespace filament {
@@ -24,6 +24,8 @@
 
 #include <utils/compiler.h>
 
+#include <utility>
+
 #include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -70,6 +72,21 @@ public:
               format(format), type(type), alignment(alignment) {
     }
 
+    /**
+     * Creates a new PixelBufferDescriptor that takes over the memory of a BufferDescriptor,
+     * e.g. staging memory from Engine::allocateStaging()
+     *
+     * @param buffer    BufferDescriptor of the memory containing the image
+     * @param format    Format of the image pixels
+     * @param type      Type of the image pixels
+     * @param alignment Alignment in bytes of pixel rows
+     */
+    PixelBufferDescriptor(BufferDescriptor&& buffer,
+            PixelDataFormat format, PixelDataType type, uint8_t alignment = 1) noexcept
+            : BufferDescriptor(std::move(buffer)),
+              stride(0), format(format), type(type), alignment(alignment) {
+    }
+
     /**
      * Creates a new PixelBufferDescriptor referencing an image in main memory
      *
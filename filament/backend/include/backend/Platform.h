@@ -23,11 +23,38 @@
 
 #include <utils/compiler.h>
 
+#include <functional>
+
+#include <stddef.h>
+#include <stdint.h>
+
 namespace filament {
 namespace backend {
 
 class Driver;
 
+/**
+ * A Linux dma-buf, the external image of the Vulkan backend on Linux, see
+ * Texture::setExternalImage() and Stream::setAcquiredImage(). Filament imports it without copy
+ * and duplicates its file descriptor, the DmaBufImage itself must remain valid until the texture
+ * gets another image, or until the callback of the acquired image is called.
+ */
+struct DmaBufImage {
+    int fd = -1;                // the planes are all in this file
+    uint32_t fourcc = 0;        // DRM_FORMAT_NV12, DRM_FORMAT_ARGB8888, DRM_FORMAT_XRGB8888,
+                                // DRM_FORMAT_ABGR8888 or DRM_FORMAT_XBGR8888
+    uint64_t modifier = 0;      // DRM format modifier, 0 is DRM_FORMAT_MOD_LINEAR
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t planeCount = 1;
+    struct {
+        uint32_t offset;
+        uint32_t stride;
+    } planes[3] = {};
+    bool fullRange = false;     // YCbCr formats use the narrow range otherwise
+    bool bt709 = false;         // YCbCr formats use BT.601 otherwise
+};
+
 class UTILS_PUBLIC Platform {
 public:
     struct SwapChain {};
@@ -58,6 +85,13 @@ public:
      */
     virtual backend::Driver* createDriver(void* sharedContext) noexcept = 0;
 
+    /**
+     * Returns the context created by createDriver(), to pass as the sharedContext of another
+     * Platform so that both drivers share their resources, or nullptr if this is not supported.
+     * This is called from the main thread once the driver is created.
+     */
+    virtual void* getSharedContext() noexcept { return nullptr; }
+
     /**
      * Processes the platform's event queue when called from its primary event-handling thread.
      *
@@ -66,6 +100,48 @@ public:
      * thread, or if the platform does not need to perform any special processing.
      */
     virtual bool pumpEvents() noexcept { return false; }
+
+    /**
+     * Stores a blob of data in a persistent cache, under the given key. The value should be
+     * returned by later calls of RetrieveBlobFunc with the same key, including in later runs of
+     * the application. Both the key and the value are arbitrary binary data.
+     */
+    using InsertBlobFunc = std::function<
+            void(const void* key, size_t keySize, const void* value, size_t valueSize)>;
+
+    /**
+     * Retrieves a blob stored with InsertBlobFunc. Returns the size of the value, which is only
+     * copied into 'value' if valueSize is large enough, or 0 if there is no value for the key.
+     */
+    using RetrieveBlobFunc = std::function<
+            size_t(const void* key, size_t keySize, void* value, size_t valueSize)>;
+
+    /**
+     * Sets the functions the backend uses to persist caches across runs of the application,
+     * e.g. the pipeline cache of the Vulkan backend, the program binaries of the OpenGL backend
+     * or the binary archive of the Metal backend. The functions are called on the thread where
+     * the driver runs. This must be called before the driver is created.
+     */
+    void setBlobFunc(InsertBlobFunc&& insertBlob, RetrieveBlobFunc&& retrieveBlob) noexcept;
+
+    /**
+     * @return true if setBlobFunc() was called with both functions.
+     */
+    bool hasBlobFunc() const noexcept;
+
+    /**
+     * Calls the InsertBlobFunc set with setBlobFunc(), if any.
+     */
+    void insertBlob(const void* key, size_t keySize, const void* value, size_t valueSize);
+
+    /**
+     * Calls the RetrieveBlobFunc set with setBlobFunc(), or returns 0 if there is none.
+     */
+    size_t retrieveBlob(const void* key, size_t keySize, void* value, size_t valueSize);
+
+private:
+    InsertBlobFunc mInsertBlob;
+    RetrieveBlobFunc mRetrieveBlob;
 };
 
 
@@ -49,6 +49,10 @@ public:
         // for 3D textures
         uint16_t layer = 0;
     };
+    // number of consecutive layers, starting at 'layer', rendered by a single multiview pass.
+    // This requires a 2D array texture and Driver::isMultiviewSupported(). All the attachments
+    // of a render target must have the same count.
+    uint8_t viewCount = 1;
     TargetBufferInfo() noexcept { }
 };
 
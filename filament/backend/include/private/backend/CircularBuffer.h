@@ -38,6 +38,10 @@ public:
     //      to set it to 3*requiredSize to avoid blocking the render thread (usually the UI thread).
     explicit CircularBuffer(size_t bufferSize);
 
+    // Uses the 'bufferSize' bytes at 'data', which are not owned by this CircularBuffer. Such a
+    // buffer can only be written linearly, it can't be circularize()'d.
+    CircularBuffer(void* data, size_t bufferSize) noexcept;
+
     // can't be moved or copy-constructed
     CircularBuffer(CircularBuffer const& rhs) = delete;
     CircularBuffer(CircularBuffer&& rhs) noexcept = delete;
@@ -54,6 +58,9 @@ public:
         return cur;
     }
 
+    // Reallocates the buffer with a new size, the buffer must not be in use.
+    void resize(size_t bufferSize) noexcept;
+
     // Total size of circular buffer
     size_t size() const noexcept { return mSize; }
 
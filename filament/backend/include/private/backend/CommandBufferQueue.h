@@ -23,13 +23,19 @@
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 
+#include <array>
+#include <atomic>
 #include <vector>
 
 namespace filament {
 namespace backend {
 
 /*
- * A producer-consumer command queue that uses a CircularBuffer as main storage
+ * A producer-consumer command queue that uses a CircularBuffer as main storage.
+ *
+ * There is a single producer (the thread calling flush()) and a single consumer (the thread
+ * calling waitForCommands() and releaseBuffer()). Slices and free space are handed off with
+ * atomics, the lock is only taken when one side has to wait for the other, or to wake it up.
  */
 class CommandBufferQueue {
     struct Slice {
@@ -37,21 +43,40 @@ class CommandBufferQueue {
         void* end;
     };
 
-    const size_t mRequiredSize;
+    // maximum number of flushed slices not yet returned by waitForCommands()
+    static constexpr uint32_t MAX_PENDING_SLICES = 64;
+
+    size_t mRequiredSize;
 
     CircularBuffer mCircularBuffer;
 
+    // Slices are written by the producer at mWriteIndex and read by the consumer at mReadIndex.
+    // Indices are never wrapped, the slot is the index modulo MAX_PENDING_SLICES.
+    std::array<Slice, MAX_PENDING_SLICES> mSlices{};
+    std::atomic<uint32_t> mWriteIndex = { 0 };
+    std::atomic<uint32_t> mReadIndex = { 0 };
+
     // space available in the circular buffer
+    std::atomic<size_t> mFreeSpace = { 0 };
 
+    // only used to sleep, when a side has nothing to do
     mutable utils::Mutex mLock;
-    mutable utils::Condition mCondition;
-    mutable std::vector<Slice> mCommandBuffersToExecute;
-    size_t mFreeSpace = 0;
+    mutable utils::Condition mProducerCondition;
+    mutable utils::Condition mConsumerCondition;
+    mutable std::atomic<bool> mProducerWaiting = { false };
+    mutable std::atomic<bool> mConsumerWaiting = { false };
+
     size_t mHighWatermark = 0;
-    uint32_t mExitRequested = 0;
+    uint32_t mResizeCount = 0;
+    // set when a flush() had to wait for space
+    bool mTooSmall = false;
+    std::atomic<uint32_t> mExitRequested = { 0 };
 
     static constexpr uint32_t EXIT_REQUESTED = 0x31415926;
 
+    void wakeProducer() const noexcept;
+    void wakeConsumer() const noexcept;
+
 public:
     // requiredSize: guaranteed available space after flush()
     CommandBufferQueue(size_t requiredSize, size_t bufferSize);
@@ -59,10 +84,24 @@ public:
 
     CircularBuffer& getCircularBuffer() { return mCircularBuffer; }
 
+    // largest amount of the circular buffer that was used at once
     size_t getHighWatermark() const noexcept { return mHighWatermark; }
 
+    size_t getRequiredSize() const noexcept { return mRequiredSize; }
+
+    size_t getBufferSize() const noexcept { return mCircularBuffer.size(); }
+
+    uint32_t getResizeCount() const noexcept { return mResizeCount; }
+
+    // whether a flush() had to wait for space since the last resize()
+    bool isTooSmall() const noexcept { return mTooSmall; }
+
+    // Waits for all the commands to be executed and reallocates the circular buffer. Must be
+    // called by the producer after flush(), i.e. when the circular buffer is empty.
+    void resize(size_t requiredSize, size_t bufferSize);
+
     // wait for commands to be available and returns an array containing these commands
-    std::vector<Slice> waitForCommands() const;
+    std::vector<Slice> waitForCommands();
 
     // return the memory used by this command buffer to the circular buffer
     // WARNING: releaseBuffer() must be called in sequence of the Slices returned by
@@ -57,6 +57,8 @@ namespace backend {
 
 class Driver;
 class CommandBase;
+class CommandSubStream;
+class CommandSubStreamGroup;
 
 /*
  * Dispatcher is a data structure containing only function pointers.
@@ -169,6 +171,9 @@ struct CommandType<void (Driver::*)(ARGS...)> {
             self->~Command();
         }
 
+        // the arguments the method will be called with (e.g. to record them)
+        SavedParameters const& getArguments() const noexcept { return mArgs; }
+
         // A command can be moved
         inline Command(Command&& rhs) noexcept = default;
 
@@ -253,6 +258,9 @@ public:
     CommandStream() noexcept = default;
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // the commands are executed through 'dispatcher' instead of the driver's dispatcher
+    CommandStream(Driver& driver, CircularBuffer& buffer, Dispatcher& dispatcher) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -264,6 +272,9 @@ public:
 
     void execute(void* buffer);
 
+    // executes the commands of a sub-stream, this can be called from any thread
+    static void execute(Driver& driver, CommandSubStreamRange const& range) noexcept;
+
     /*
      * queueCommand() allows to queue a lambda function as a command.
      * This is much less efficient than using the Driver* API.
@@ -286,6 +297,9 @@ public:
             size_t count = 1, size_t alignment = alignof(PodType)) noexcept;
 
 private:
+    friend class CommandSubStream;
+    friend class CommandSubStreamGroup;
+
     // Dispatcher could be a value (instead of pointer), which saves a load when writing commands
     // at the expense of a larger CommandStream object (about ~400 bytes)
     Dispatcher* mDispatcher = nullptr;
@@ -327,6 +341,101 @@ PodType* CommandStream::allocatePod(size_t count, size_t alignment) noexcept {
     return static_cast<PodType*>(allocate(count * sizeof(PodType), alignment));
 }
 
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * CommandSubStream records commands into space reserved in a parent CommandStream, which allows
+ * recording from several threads at once: each thread records into its own sub-stream and the
+ * commands are executed in the order the sub-streams were created, as if they had been recorded
+ * directly into the parent stream at that point. There is no copy involved, each sub-stream ends
+ * with a jump to the commands that follow it.
+ *
+ * The space of a sub-stream is fixed when it's created, so it must be large enough for all the
+ * commands recorded into it (see COMMAND_TYPE() to compute the size of a command). finish() must
+ * be called before the parent stream is flushed.
+ */
+class CommandSubStream {
+public:
+    // reserves 'size' bytes at the current position of 'parent'
+    CommandSubStream(CommandStream& parent, size_t size) noexcept;
+
+    // reserves 'size' bytes at the current position of the parent of 'group', and adds this
+    // sub-stream to the group
+    CommandSubStream(CommandSubStreamGroup& group, size_t size) noexcept;
+
+    CommandSubStream(CommandSubStream const& rhs) = delete;
+    CommandSubStream& operator=(CommandSubStream const& rhs) = delete;
+
+    // returns the stream to record into, this must be called from the recording thread
+    CommandStream& getStream() noexcept {
+        mStream.debugThreading();
+        return mStream;
+    }
+
+    // terminates this sub-stream, the remaining space will be skipped
+    void finish() noexcept;
+
+private:
+    static constexpr size_t getReservedSize(size_t size) noexcept {
+        // room for the terminating jump
+        return CommandBase::align(size) + CommandBase::align(sizeof(NoopCommand));
+    }
+
+    CircularBuffer mBuffer;
+    CommandStream mStream;
+    // end of the reserved space, i.e. where the parent stream continues
+    void* mEnd;
+};
+
+// The commands of a sub-stream, from its first one to the one that follows its reserved space.
+struct CommandSubStreamRange {
+    void* begin;
+    void* end;
+};
+
+/*
+ * CommandSubStreamGroup tells the driver that the CommandSubStreams created with it, which must
+ * immediately follow it in the parent stream, are independent of each other: each one sets all
+ * the state it draws with, except the state set before the group. The driver can then execute
+ * them concurrently (see Driver::executeSubStreams()), otherwise they're executed in order.
+ */
+class CommandSubStreamGroup {
+public:
+    static constexpr size_t MAX_SUB_STREAM_COUNT = 16;
+
+    // records the group at the current position of 'parent'
+    explicit CommandSubStreamGroup(CommandStream& parent) noexcept;
+
+    CommandSubStreamGroup(CommandSubStreamGroup const& rhs) = delete;
+    CommandSubStreamGroup& operator=(CommandSubStreamGroup const& rhs) = delete;
+
+    // size of the commands a group of 'count' sub-streams records in its parent, in addition to
+    // the space reserved by the sub-streams
+    static constexpr size_t getOverheadSize(size_t count) noexcept;
+
+private:
+    friend class CommandSubStream;
+
+    class GroupCommand : public CommandBase {
+        static void execute(Driver& driver, CommandBase* base, intptr_t* next) noexcept;
+    public:
+        explicit GroupCommand(bool concurrent) noexcept
+                : CommandBase(execute), concurrent(concurrent) { }
+        bool concurrent;
+        uint32_t count = 0;
+        CommandSubStreamRange ranges[MAX_SUB_STREAM_COUNT];
+    };
+
+    CommandStream& mParent;
+    GroupCommand* mCommand;
+};
+
+constexpr size_t CommandSubStreamGroup::getOverheadSize(size_t count) noexcept {
+    // the group's command, and the terminating jump of each sub-stream
+    return CommandBase::align(sizeof(GroupCommand)) +
+            count * CommandBase::align(sizeof(NoopCommand));
+}
+
 } // namespace backend
 } // namespace filament
 
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
+#define TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
+
+#include "private/backend/CommandStream.h"
+
+#include <backend/Handle.h>
+
+#include <fstream>
+#include <unordered_map>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace backend {
+
+class Driver;
+
+/*
+ * CommandStreamCapture writes the commands executed by a driver to a file, with the content of
+ * their buffers, so that they can be replayed later against any backend by
+ * CommandStreamReplayer, e.g. to benchmark a backend without the rest of the engine.
+ *
+ * The commands are captured as they are executed, through a Dispatcher that records each command
+ * before forwarding it to the driver. A CommandStream must be created with getDispatcher() before
+ * any driver object is created, because the objects created before the capture can't be
+ * replayed. The capture ends after 'frameCount' calls to endFrame().
+ *
+ * Synchronous calls are not captured. Neither are the native objects given to the driver
+ * (windows, external images and streams) nor the callbacks: swap chains are replayed as headless
+ * swap chains, imported textures as regular textures, and the commands that use external images
+ * or streams are skipped.
+ *
+ * The file can only be replayed by a build of the same version of the driver API and the same
+ * architecture.
+ */
+class CommandStreamCapture {
+public:
+    CommandStreamCapture(Driver& driver, const char* path, uint32_t frameCount) noexcept;
+    ~CommandStreamCapture() noexcept;
+
+    CommandStreamCapture(CommandStreamCapture const& rhs) = delete;
+    CommandStreamCapture& operator=(CommandStreamCapture const& rhs) = delete;
+
+    // returns whether the file could be created
+    bool isOpen() const noexcept { return mOut.is_open(); }
+
+    // the dispatcher to create the CommandStream with
+    Dispatcher& getDispatcher() noexcept { return mDispatcher; }
+
+private:
+    using Execute = Dispatcher::Execute;
+
+    template<typename Cmd>
+    static void record(uint32_t command, Execute execute,
+            Driver& driver, CommandBase* base, intptr_t* next) noexcept;
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params) \
+    static void methodName(Driver& driver, CommandBase* base, intptr_t* next) noexcept;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) \
+    static void methodName(Driver& driver, CommandBase* base, intptr_t* next) noexcept;
+#include "private/backend/DriverAPI.inc"
+
+    // the dispatch functions have no context, there can be only one capture at a time
+    static CommandStreamCapture* sCapture;
+
+    Dispatcher mDispatcher;         // records, then forwards to mTarget
+    Dispatcher mTarget;             // the driver's dispatcher
+    std::ofstream mOut;
+    uint32_t mFrameCount;           // frames left to capture
+};
+
+/*
+ * CommandStreamReplayer records the commands of a file written by CommandStreamCapture into a
+ * CommandStream, one frame at a time. The driver objects are created again as they are replayed,
+ * the handles of the capture are mapped to the new ones.
+ */
+class CommandStreamReplayer {
+public:
+    explicit CommandStreamReplayer(const char* path) noexcept;
+    ~CommandStreamReplayer() noexcept;
+
+    CommandStreamReplayer(CommandStreamReplayer const& rhs) = delete;
+    CommandStreamReplayer& operator=(CommandStreamReplayer const& rhs) = delete;
+
+    // returns whether the file could be opened and was written by a compatible build
+    bool isOpen() const noexcept { return mIn.is_open(); }
+
+    // size of the headless swap chains that replace the swap chains of the capture
+    void setSwapChainSize(uint32_t width, uint32_t height) noexcept {
+        mSwapChainWidth = width;
+        mSwapChainHeight = height;
+    }
+
+    /*
+     * Records the commands of the next frame into 'stream', up to and including its endFrame().
+     * The first frame includes the commands recorded before it, typically the creation of most
+     * driver objects. Returns false once all the commands have been replayed.
+     * If 'query' is valid, it's begun after the frame's beginFrame() and ended before its first
+     * commit(), or its endFrame() if it has no commit(). 'timed' is set to whether the query
+     * was used, i.e. whether the frame had a beginFrame().
+     */
+    bool replayFrame(CommandStream& stream, TimerQueryHandle query = {}, bool* timed = nullptr);
+
+private:
+    void replayCommand(CommandStream& stream, uint32_t command);
+
+    std::ifstream mIn;
+    std::unordered_map<HandleBase::HandleId, HandleBase::HandleId> mHandles;
+    uint32_t mSwapChainWidth = 1920;
+    uint32_t mSwapChainHeight = 1080;
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDSTREAMCAPTURE_H
@@ -43,6 +43,7 @@ namespace backend {
 template<typename T>
 class ConcreteDispatcher;
 class Dispatcher;
+struct CommandSubStreamRange;
 
 class Driver {
 public:
@@ -64,6 +65,11 @@ public:
     // the default implementation simply calls fn
     virtual void execute(std::function<void(void)> fn) noexcept;
 
+    // called from CommandStream::execute on the render-thread for a group of sub-streams (see
+    // CommandSubStreamGroup), the driver can execute their commands concurrently and return true.
+    // The default implementation returns false, the sub-streams are then executed in order.
+    virtual bool executeSubStreams(CommandSubStreamRange const* ranges, size_t count) noexcept;
+
 #ifndef NDEBUG
     virtual void debugCommand(const char* methodName) {}
 #endif
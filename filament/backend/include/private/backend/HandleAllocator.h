@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+#define TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
+
+#include "backend/Handle.h"
+
+#include <utils/compiler.h>
+#include <utils/SpinLock.h>
+
+#include <array>
+#include <mutex>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace backend {
+
+/*
+ * Allocates the storage of the objects backing the handles of a driver.
+ *
+ * Objects are stored in fixed-size slots of 3 pools, picked by the size of the object. A pool is
+ * made of segments, allocated as the pool runs out of slots, so it grows instead of running out
+ * of memory. A handle id holds the pool, segment and slot of its object, so it resolves to the
+ * object's address in constant time, without taking a lock.
+ *
+ * Objects larger than the slots of the largest pool are allocated on the heap, and a slot of
+ * a 4th pool points to them.
+ *
+ * allocate() and deallocate() can be called from any thread. handle_cast() can be called from
+ * any thread that received the handle after it was allocated (e.g. through the CommandStream).
+ */
+class HandleAllocator {
+public:
+    static constexpr size_t POOL_COUNT = 4;
+
+    // maximum alignment of the objects
+    static constexpr size_t MAX_ALIGNMENT = 16;
+
+    struct PoolStatistics {
+        size_t slotSize;        // size in bytes of the slots of this pool
+        size_t capacity;        // number of slots of the allocated segments
+        size_t used;            // number of slots in use
+        size_t highWatermark;   // largest number of slots in use at once
+        size_t segmentCount;    // number of allocated segments
+    };
+
+    /*
+     * 'name' is used for logging. The first segments of the pools use 'size' bytes in total,
+     * split between the 3 pools whose slot sizes are given by 'sizes', in increasing order.
+     */
+    HandleAllocator(const char* name, size_t size, std::array<size_t, 3> const& sizes) noexcept;
+    ~HandleAllocator() noexcept;
+
+    HandleAllocator(HandleAllocator const& rhs) = delete;
+    HandleAllocator& operator=(HandleAllocator const& rhs) = delete;
+
+    // allocates (but doesn't construct) an object of type D
+    template<typename D>
+    HandleBase::HandleId allocate() noexcept {
+        static_assert(alignof(D) <= MAX_ALIGNMENT, "handle objects can't be over-aligned");
+        return allocateSlot(sizeof(D));
+    }
+
+    // frees the storage of an object of type D, which must have been destroyed already
+    template<typename D>
+    void deallocate(HandleBase::HandleId id, D const* p) noexcept {
+        deallocateSlot(id, const_cast<D*>(p));
+    }
+
+    // returns the address of the object of a handle
+    template<typename Dp>
+    Dp* handle_cast(HandleBase::HandleId id) noexcept {
+        return static_cast<Dp*>(getAddress(id));
+    }
+
+    PoolStatistics getPoolStatistics(size_t pool) const noexcept;
+
+private:
+    // a handle id is [ pool: 2 | segment: 6 | slot: 24 ]
+    static constexpr uint32_t SLOT_BITS = 24;
+    static constexpr uint32_t SEGMENT_BITS = 6;
+    static constexpr size_t MAX_SEGMENT_COUNT = 1u << SEGMENT_BITS;
+    // the highest slot is never used so that no id is HandleBase::nullid
+    static constexpr size_t MAX_SLOT_COUNT = (1u << SLOT_BITS) - 1u;
+    static constexpr size_t INDIRECT_POOL = POOL_COUNT - 1;
+
+    // free slots hold the next free slot and their own id
+    struct Node {
+        Node* next;
+        HandleBase::HandleId id;
+    };
+
+    struct Pool {
+        size_t slotSize = 0;
+        size_t slotCount = 0;               // number of slots of each segment
+        std::array<char*, MAX_SEGMENT_COUNT> segments{};
+        size_t segmentCount = 0;
+        Node* freeList = nullptr;
+        size_t used = 0;
+        size_t highWatermark = 0;
+    };
+
+    HandleBase::HandleId allocateSlot(size_t size) noexcept;
+    void deallocateSlot(HandleBase::HandleId id, void* p) noexcept;
+    bool grow(Pool& pool) noexcept;
+
+    static uint32_t getPoolIndex(HandleBase::HandleId id) noexcept {
+        return id >> (SLOT_BITS + SEGMENT_BITS);
+    }
+
+    void* getSlot(HandleBase::HandleId id) const noexcept {
+        Pool const& pool = mPools[getPoolIndex(id)];
+        const uint32_t segment = (id >> SLOT_BITS) & (MAX_SEGMENT_COUNT - 1u);
+        const uint32_t slot = id & ((1u << SLOT_BITS) - 1u);
+        assert(pool.segments[segment] && slot < pool.slotCount);
+        return pool.segments[segment] + slot * pool.slotSize;
+    }
+
+    void* getAddress(HandleBase::HandleId id) const noexcept {
+        void* const p = getSlot(id);
+        if (UTILS_UNLIKELY(getPoolIndex(id) == INDIRECT_POOL)) {
+            return *static_cast<void**>(p);
+        }
+        return p;
+    }
+
+    const char* mName;
+    std::array<Pool, POOL_COUNT> mPools;
+    mutable utils::SpinLock mLock;
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_HANDLEALLOCATOR_H
@@ -23,22 +23,28 @@
 
 #include <backend/DriverEnums.h>
 
+#include <math/vec3.h>
+
 #include <array>
+#include <variant>
 #include <vector>
 
+#include <stdint.h>
+
 namespace filament {
 namespace backend {
 
 class Program {
 public:
 
-    static constexpr size_t SHADER_TYPE_COUNT = 2;
+    static constexpr size_t SHADER_TYPE_COUNT = 3;
     static constexpr size_t UNIFORM_BINDING_COUNT = CONFIG_UNIFORM_BINDING_COUNT;
     static constexpr size_t SAMPLER_BINDING_COUNT = CONFIG_SAMPLER_BINDING_COUNT;
 
     enum class Shader : uint8_t {
         VERTEX = 0,
-        FRAGMENT = 1
+        FRAGMENT = 1,
+        COMPUTE = 2
     };
 
     struct Sampler {
@@ -46,8 +52,14 @@ public:
         size_t binding = 0;         // binding point of the sampler in the shader
     };
 
+    struct SpecializationConstant {
+        uint32_t id;                                // id of the constant in the shader
+        std::variant<int32_t, float, bool> value;   // value of the constant
+    };
+
     using SamplerGroupInfo = std::array<std::vector<Sampler>, SAMPLER_BINDING_COUNT>;
     using UniformBlockInfo = std::array<utils::CString, UNIFORM_BINDING_COUNT>;
+    using SpecializationConstantsInfo = std::vector<SpecializationConstant>;
 
     Program() noexcept;
     Program(const Program& rhs) = delete;
@@ -60,7 +72,17 @@ public:
     Program& diagnostics(utils::CString const& name, uint8_t variantKey = 0);
     Program& diagnostics(utils::CString&& name, uint8_t variantKey = 0) noexcept;
 
+    // sets an id that identifies the source of this program across runs of the application
+    // (e.g. a hash of the material package), together with the variant key set above. Backends
+    // can use it to cache compiled programs. 0 (the default) means the program isn't cached.
+    Program& cacheId(uint64_t id) noexcept;
+
+    // when true, backends which compile programs in the background can skip the draws that use
+    // this program until it's ready, instead of waiting for it.
+    Program& skipDrawsUntilReady(bool skip) noexcept;
+
     // sets one of the program's shader (e.g. vertex, fragment)
+    // a compute program has a compute shader only, and is used with DriverApi::dispatch()
     Program& shader(Shader shader, void const* data, size_t size) noexcept;
 
     // sets the 'bindingPoint' uniform block's name for this program.
@@ -77,6 +99,24 @@ public:
     // Or more precisely, what layout(binding=) is set to in GLSL.
     Program& setSamplerGroup(size_t bindingPoint, Sampler const* samplers, size_t count) noexcept;
 
+    // sets the size of the work groups of a compute program, it must match the local size
+    // declared in the compute shader.
+    //
+    // Note: This is only needed for the Metal backend, because the size of the work groups is
+    //       given when dispatching rather than declared in the shader.
+    //
+    Program& setWorkGroupSize(math::uint3 size) noexcept;
+
+    // sets the values of the specialization constants of the program's shaders, declared with
+    // layout(constant_id = id) in GLSL. This lets a single shader implement several variants of
+    // a feature, which are selected when the program is created. The constants a shader doesn't
+    // declare are ignored.
+    //
+    // Note: The OpenGL backend defines SPIRV_CROSS_CONSTANT_ID_<id> to the value of each
+    //       constant, which is how SPIRV-Cross and filamat declare them in GLSL.
+    //
+    Program& specializationConstants(SpecializationConstantsInfo specConstants) noexcept;
+
     Program& withVertexShader(void const* data, size_t size) {
         return shader(Shader::VERTEX, data, size);
     }
@@ -85,6 +125,10 @@ public:
         return shader(Shader::FRAGMENT, data, size);
     }
 
+    Program& withComputeShader(void const* data, size_t size) {
+        return shader(Shader::COMPUTE, data, size);
+    }
+
     std::array<std::vector<uint8_t>, SHADER_TYPE_COUNT> const& getShadersSource() const noexcept {
         return mShadersSource;
     }
@@ -93,10 +137,20 @@ public:
 
     SamplerGroupInfo const& getSamplerGroupInfo() const { return mSamplerGroups; }
 
+    math::uint3 getWorkGroupSize() const noexcept { return mWorkGroupSize; }
+
+    SpecializationConstantsInfo const& getSpecializationConstants() const noexcept {
+        return mSpecializationConstants;
+    }
+
     const utils::CString& getName() const noexcept { return mName; }
 
     uint8_t getVariant() const noexcept { return mVariant; }
 
+    uint64_t getCacheId() const noexcept { return mCacheId; }
+
+    bool skipsDrawsUntilReady() const noexcept { return mSkipDrawsUntilReady; }
+
     bool hasSamplers() const noexcept { return mHasSamplers; }
 
 private:
@@ -108,8 +162,12 @@ private:
     UniformBlockInfo mUniformBlocks = {};
     SamplerGroupInfo mSamplerGroups = {};
     std::array<std::vector<uint8_t>, SHADER_TYPE_COUNT> mShadersSource;
+    SpecializationConstantsInfo mSpecializationConstants;
     utils::CString mName;
+    math::uint3 mWorkGroupSize = { 1, 1, 1 };
+    uint64_t mCacheId = 0;
     bool mHasSamplers = false;
+    bool mSkipDrawsUntilReady = false;
     uint8_t mVariant;
 };
 
@@ -42,10 +42,26 @@ CircularBuffer::CircularBuffer(size_t size) {
     mHead = mData;
 }
 
+CircularBuffer::CircularBuffer(void* data, size_t size) noexcept {
+    // mData stays null, so that we don't free the memory
+    mSize = size;
+    mTail = data;
+    mHead = data;
+}
+
 CircularBuffer::~CircularBuffer() noexcept {
     dealloc();
 }
 
+void CircularBuffer::resize(size_t size) noexcept {
+    assert(mData);  // we don't own the memory otherwise
+    dealloc();
+    mData = alloc(size);
+    mSize = size;
+    mTail = mData;
+    mHead = mData;
+}
+
 // If the system support mmap(), use it for creating a "hard circular buffer" where two virtual
 // address ranges are mapped to the same physical pages.
 //
@@ -37,20 +37,39 @@ CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize)
 }
 
 CommandBufferQueue::~CommandBufferQueue() {
-    assert(mCommandBuffersToExecute.empty());
+    assert(mReadIndex.load() == mWriteIndex.load());
+}
+
+// The waiting side sets its flag and checks its condition again with the lock held, while the
+// other side updates the state and then checks the flag. Because all these accesses are
+// sequentially consistent, at least one of them sees the other's write: either the waiting side
+// doesn't go to sleep, or it gets notified. Taking the lock to notify guarantees the waiting
+// side is either not checking its condition yet, or already sleeping.
+
+void CommandBufferQueue::wakeProducer() const noexcept {
+    if (UTILS_UNLIKELY(mProducerWaiting.load())) {
+        std::lock_guard<utils::Mutex> lock(mLock);
+        mProducerCondition.notify_one();
+    }
+}
+
+void CommandBufferQueue::wakeConsumer() const noexcept {
+    if (UTILS_UNLIKELY(mConsumerWaiting.load())) {
+        std::lock_guard<utils::Mutex> lock(mLock);
+        mConsumerCondition.notify_one();
+    }
 }
 
 void CommandBufferQueue::requestExit() {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mExitRequested = EXIT_REQUESTED;
-    mCondition.notify_one();
+    mExitRequested.store(EXIT_REQUESTED);
+    wakeConsumer();
 }
 
 bool CommandBufferQueue::isExitRequested() const {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    ASSERT_PRECONDITION( mExitRequested == 0 || mExitRequested == EXIT_REQUESTED,
-            "mExitRequested is corrupted (value = 0x%08x)!", mExitRequested);
-    return (bool)mExitRequested;
+    const uint32_t exitRequested = mExitRequested.load();
+    ASSERT_PRECONDITION( exitRequested == 0 || exitRequested == EXIT_REQUESTED,
+            "mExitRequested is corrupted (value = 0x%08x)!", exitRequested);
+    return (bool)exitRequested;
 }
 
 
@@ -77,60 +96,112 @@ void CommandBufferQueue::flush() noexcept {
 
     circularBuffer.circularize();
 
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mCommandBuffersToExecute.push_back({ tail, head });
-
     // circular buffer is too small, we corrupted the stream
-    assert(used <= mFreeSpace);
+    assert(used <= mFreeSpace.load());
+
+    // we're the only writer of mWriteIndex
+    const uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    auto hasFreeSlot = [this, writeIndex]() -> bool {
+        return writeIndex - mReadIndex.load() < MAX_PENDING_SLICES;
+    };
+    if (UTILS_UNLIKELY(!hasFreeSlot())) {
+        // the consumer is very far behind, this should never happen in practice
+        SYSTRACE_NAME("waiting: CommandBufferQueue::flush() slot");
+        std::unique_lock<utils::Mutex> lock(mLock);
+        mProducerWaiting.store(true);
+        mProducerCondition.wait(lock, hasFreeSlot);
+        mProducerWaiting.store(false);
+    }
+
+    mSlices[writeIndex % MAX_PENDING_SLICES] = { tail, head };
+    const size_t freeSpace = mFreeSpace.fetch_sub(used) - used;
+    mWriteIndex.store(writeIndex + 1);
+    wakeConsumer();
 
-    // wait until there is enough space in the buffer
-    mFreeSpace -= used;
     const size_t requiredSize = mRequiredSize;
 
-#ifndef NDEBUG
-    size_t totalUsed = circularBuffer.size() - mFreeSpace;
+    size_t totalUsed = circularBuffer.size() - freeSpace;
     mHighWatermark = std::max(mHighWatermark, totalUsed);
+#ifndef NDEBUG
     if (UTILS_UNLIKELY(totalUsed > requiredSize)) {
         slog.d << "CommandStream used too much space: " << totalUsed
             << ", out of " << requiredSize << " (will block)" << io::endl;
     }
 #endif
 
-    if (UTILS_LIKELY(mFreeSpace >= requiredSize)) {
-        // ideally (and usually) we don't have to wait, this is the common case, so special case
-        // the unlock-before-notify, optimization.
-        lock.unlock();
-        mCondition.notify_one();
-    } else {
+    if (UTILS_UNLIKELY(freeSpace < requiredSize)) {
+        mTooSmall = true;
         // unfortunately, there is not enough space left, we'll have to wait.
-        mCondition.notify_one(); // too bad there isn't a notify-and-wait
         SYSTRACE_NAME("waiting: CircularBuffer::flush()");
-        mCondition.wait(lock, [this, requiredSize]() -> bool {
-            return mFreeSpace >= requiredSize;
+        std::unique_lock<utils::Mutex> lock(mLock);
+        mProducerWaiting.store(true);
+        mProducerCondition.wait(lock, [this, requiredSize]() -> bool {
+            return mFreeSpace.load() >= requiredSize;
+        });
+        mProducerWaiting.store(false);
+    }
+}
+
+void CommandBufferQueue::resize(size_t requiredSize, size_t bufferSize) {
+    SYSTRACE_CALL();
+    assert(mCircularBuffer.empty());
+
+    // wait for the consumer to release everything
+    const size_t size = mCircularBuffer.size();
+    if (mFreeSpace.load() != size) {
+        std::unique_lock<utils::Mutex> lock(mLock);
+        mProducerWaiting.store(true);
+        mProducerCondition.wait(lock, [this, size]() -> bool {
+            return mFreeSpace.load() == size;
         });
+        mProducerWaiting.store(false);
     }
+
+    // the consumer doesn't touch the circular buffer or mFreeSpace until the next flush()
+    mRequiredSize = (requiredSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK;
+    mCircularBuffer.resize(bufferSize);
+    assert(mCircularBuffer.size() > mRequiredSize);
+    mFreeSpace.store(mCircularBuffer.size());
+    mTooSmall = false;
+    mResizeCount++;
 }
 
-std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() const {
-    if (!UTILS_HAS_THREADING) {
-        return std::move(mCommandBuffersToExecute);
+std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() {
+    // we're the only writer of mReadIndex
+    const uint32_t readIndex = mReadIndex.load(std::memory_order_relaxed);
+    if (UTILS_HAS_THREADING) {
+        auto hasCommands = [this, readIndex]() -> bool {
+            return mWriteIndex.load() != readIndex || mExitRequested.load();
+        };
+        if (!hasCommands()) {
+            std::unique_lock<utils::Mutex> lock(mLock);
+            mConsumerWaiting.store(true);
+            mConsumerCondition.wait(lock, hasCommands);
+            mConsumerWaiting.store(false);
+        }
     }
-    std::unique_lock<utils::Mutex> lock(mLock);
-    while (mCommandBuffersToExecute.empty() && !mExitRequested) {
-        mCondition.wait(lock);
+
+    const uint32_t exitRequested = mExitRequested.load();
+    ASSERT_PRECONDITION( exitRequested == 0 || exitRequested == EXIT_REQUESTED,
+            "mExitRequested is corrupted (value = 0x%08x)!", exitRequested);
+
+    const uint32_t writeIndex = mWriteIndex.load();
+    std::vector<Slice> slices;
+    slices.reserve(writeIndex - readIndex);
+    for (uint32_t i = readIndex; i != writeIndex; i++) {
+        slices.push_back(mSlices[i % MAX_PENDING_SLICES]);
     }
 
-    ASSERT_PRECONDITION( mExitRequested == 0 || mExitRequested == EXIT_REQUESTED,
-            "mExitRequested is corrupted (value = 0x%08x)!", mExitRequested);
+    // the slots can be reused now
+    mReadIndex.store(writeIndex);
+    wakeProducer();
 
-    return std::move(mCommandBuffersToExecute);
+    return slices;
 }
 
 void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mFreeSpace += uintptr_t(buffer.end) - uintptr_t(buffer.begin);
-    lock.unlock();
-    mCondition.notify_one();
+    mFreeSpace.fetch_add(uintptr_t(buffer.end) - uintptr_t(buffer.begin));
+    wakeProducer();
 }
 
 } // namespace backend
@@ -57,7 +57,12 @@ static UTILS_NOINLINE UTILS_UNUSED std::string extractMethodName(std::string& co
 // ------------------------------------------------------------------------------------------------
 
 CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
-        : mDispatcher(&driver.getDispatcher()),
+        : CommandStream(driver, buffer, driver.getDispatcher()) {
+}
+
+CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer,
+        Dispatcher& dispatcher) noexcept
+        : mDispatcher(&dispatcher),
           mDriver(&driver),
           mCurrentBuffer(&buffer)
 #ifndef NDEBUG
@@ -71,6 +76,55 @@ CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
 #endif
 }
 
+CommandSubStream::CommandSubStream(CommandStream& parent, size_t size) noexcept
+        : mBuffer(parent.allocateCommand(getReservedSize(size)), CommandBase::align(size)) {
+    mStream.mDispatcher = parent.mDispatcher;
+    mStream.mDriver = parent.mDriver;
+    mStream.mCurrentBuffer = &mBuffer;
+    mEnd = (char*)mBuffer.getTail() + getReservedSize(size);
+}
+
+CommandSubStream::CommandSubStream(CommandSubStreamGroup& group, size_t size) noexcept
+        : CommandSubStream(group.mParent, size) {
+    CommandSubStreamGroup::GroupCommand& command = *group.mCommand;
+    assert(command.count < CommandSubStreamGroup::MAX_SUB_STREAM_COUNT);
+    command.ranges[command.count++] = { mBuffer.getTail(), mEnd };
+}
+
+void CommandSubStream::finish() noexcept {
+    // the space is reserved upfront, overflowing it corrupts the parent stream
+    assert(size_t(intptr_t(mBuffer.getHead()) - intptr_t(mBuffer.getTail())) <= mBuffer.size());
+    new(mBuffer.allocate(sizeof(NoopCommand))) NoopCommand(mEnd);
+}
+
+CommandSubStreamGroup::CommandSubStreamGroup(CommandStream& parent) noexcept
+        : mParent(parent),
+          // the commands of a stream that doesn't use the driver's dispatcher (e.g. a
+          // CommandStreamCapture) must be executed in order
+          mCommand(new(parent.allocateCommand(CommandBase::align(sizeof(GroupCommand))))
+                  GroupCommand(parent.mDispatcher == &parent.mDriver->getDispatcher())) {
+}
+
+void CommandSubStreamGroup::GroupCommand::execute(Driver& driver, CommandBase* base,
+        intptr_t* next) noexcept {
+    GroupCommand* const self = static_cast<GroupCommand*>(base);
+    if (self->count && self->concurrent && driver.executeSubStreams(self->ranges, self->count)) {
+        // skip the sub-streams, the driver executed them
+        *next = intptr_t(self->ranges[self->count - 1].end) - intptr_t(self);
+    } else {
+        // the first sub-stream follows this command
+        *next = CommandBase::align(sizeof(GroupCommand));
+    }
+    self->~GroupCommand();
+}
+
+void CommandStream::execute(Driver& driver, CommandSubStreamRange const& range) noexcept {
+    CommandBase* UTILS_RESTRICT base = static_cast<CommandBase*>(range.begin);
+    while (base != range.end) {
+        base = base->execute(driver);
+    }
+}
+
 void CommandStream::execute(void* buffer) {
     SYSTRACE_CALL();
 
@@ -0,0 +1,623 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/backend/CommandStreamCapture.h"
+
+#include "private/backend/Driver.h"
+
+#include <utils/CString.h>
+#include <utils/Log.h>
+
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace utils;
+
+namespace filament {
+namespace backend {
+
+namespace {
+
+// identifies the commands in the file, in the order of DriverAPI.inc
+enum class CommandId : uint32_t {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                 methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) methodName,
+#include "private/backend/DriverAPI.inc"
+    COUNT
+};
+
+// the number of commands and the size of pointers catch most incompatible builds
+struct FileHeader {
+    char magic[8] = { 'F', 'C', 'A', 'P', 'T', 'U', 'R', 'E' };
+    uint32_t version = 1;
+    uint32_t commandCount = uint32_t(CommandId::COUNT);
+    uint32_t pointerSize = sizeof(void*);
+};
+
+// the layout of a PixelBufferDescriptor, which follows its content
+struct PixelLayout {
+    uint32_t left;
+    uint32_t top;
+    uint32_t strideOrImageSize;
+    uint16_t format;            // PixelDataFormat or CompressedPixelDataType
+    uint8_t type;
+    uint8_t alignment;
+};
+
+// the types of the arguments of a Driver method, and of the ones that follow the handle of the
+// object created by a "R" method
+template<typename M>
+struct ArgumentsOf;
+template<typename... ARGS>
+struct ArgumentsOf<void (Driver::*)(ARGS...)> {
+    using type = std::tuple<std::decay_t<ARGS>...>;
+};
+template<typename M>
+using Arguments = typename ArgumentsOf<M>::type;
+
+template<typename M>
+struct ArgumentsAfterHandleOf;
+template<typename H, typename... ARGS>
+struct ArgumentsAfterHandleOf<void (Driver::*)(H, ARGS...)> {
+    using type = std::tuple<std::decay_t<ARGS>...>;
+};
+template<typename M>
+using ArgumentsAfterHandle = typename ArgumentsAfterHandleOf<M>::type;
+
+// ------------------------------------------------------------------------------------------------
+
+class Writer {
+public:
+    explicit Writer(std::ostream& out) noexcept : mOut(out) { }
+
+    void bytes(void const* data, size_t size) {
+        mOut.write(static_cast<const char*>(data), std::streamsize(size));
+    }
+
+    template<typename T>
+    void write(T const& value) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                "this type of command argument needs its own write() and read()");
+        bytes(&value, sizeof(T));
+    }
+
+    template<typename T>
+    void write(Handle<T> const& handle) {
+        write(handle.getId());
+    }
+
+    template<typename... T>
+    void write(std::tuple<T...> const& args) {
+        std::apply([this](auto const&... arg) { (write(arg), ...); }, args);
+    }
+
+    // native objects and callbacks can't be replayed
+    void write(void*) { }
+    void write(CompileCallback) { }
+    void write(FrameFinishedCallback) { }
+
+    void write(const char* string) {
+        const uint32_t length = string ? uint32_t(strlen(string)) : NULL_STRING;
+        write(length);
+        if (string) {
+            bytes(string, length);
+        }
+    }
+
+    void write(CString const& string) {
+        write(uint32_t(string.size()));
+        bytes(string.c_str(), string.size());
+    }
+
+    void write(std::vector<uint8_t> const& data) {
+        write(uint64_t(data.size()));
+        bytes(data.data(), data.size());
+    }
+
+    void write(BufferDescriptor const& buffer) {
+        const uint64_t size = buffer.buffer ? buffer.size : 0;
+        write(size);
+        bytes(buffer.buffer, size);
+    }
+
+    void write(PixelBufferDescriptor const& buffer) {
+        write(static_cast<BufferDescriptor const&>(buffer));
+        const bool compressed = buffer.type == PixelDataType::COMPRESSED;
+        write(PixelLayout{
+                .left = buffer.left,
+                .top = buffer.top,
+                .strideOrImageSize = compressed ? buffer.imageSize : buffer.stride,
+                .format = compressed ? uint16_t(buffer.compressedFormat) : uint16_t(buffer.format),
+                .type = uint8_t(buffer.type),
+                .alignment = uint8_t(buffer.alignment) });
+    }
+
+    void write(Program const& program) {
+        write(program.getName());
+        write(program.getVariant());
+        write(program.getCacheId());
+        write(program.skipsDrawsUntilReady());
+        write(program.getWorkGroupSize());
+        for (auto const& source : program.getShadersSource()) {
+            write(source);
+        }
+        for (CString const& name : program.getUniformBlockInfo()) {
+            write(name);
+        }
+        for (auto const& samplers : program.getSamplerGroupInfo()) {
+            write(uint32_t(samplers.size()));
+            for (Program::Sampler const& sampler : samplers) {
+                write(sampler.name);
+                write(uint64_t(sampler.binding));
+            }
+        }
+    }
+
+    void write(SamplerGroup const& group) {
+        write(uint32_t(group.getSize()));
+        for (size_t i = 0, c = group.getSize(); i < c; i++) {
+            write(group.getSamplers()[i].t);
+            write(group.getSamplers()[i].s);
+        }
+    }
+
+    void write(PipelineState const& state) {
+        write(state.program);
+        write(state.rasterState);
+        write(state.polygonOffset);
+        write(state.scissor);
+    }
+
+    void write(TargetBufferInfo const& info) {
+        write(info.handle);
+        write(info.level);
+        write(info.layer);
+    }
+
+    void write(FaceOffsets const& offsets) {
+        for (size_t i = 0; i < 6; i++) {
+            write(uint64_t(offsets[i]));
+        }
+    }
+
+    void write(MRT const& mrt) {
+        for (size_t i = 0; i < MRT::TARGET_COUNT; i++) {
+            write(mrt[i]);
+        }
+    }
+
+    static constexpr uint32_t NULL_STRING = 0xFFFFFFFFu;
+
+private:
+    std::ostream& mOut;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+class Reader {
+public:
+    using HandleMap = std::unordered_map<HandleBase::HandleId, HandleBase::HandleId>;
+
+    Reader(std::istream& in, CommandStream& stream, HandleMap const& handles) noexcept
+            : mIn(in), mStream(stream), mHandles(handles) { }
+
+    void bytes(void* data, size_t size) {
+        mIn.read(static_cast<char*>(data), std::streamsize(size));
+    }
+
+    template<typename T>
+    void read(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                "this type of command argument needs its own write() and read()");
+        bytes(&value, sizeof(T));
+    }
+
+    HandleBase::HandleId readId() {
+        HandleBase::HandleId id = HandleBase::nullid;
+        read(id);
+        return id;
+    }
+
+    // the handles of the capture are replaced by the ones of the objects created by the replay
+    template<typename T>
+    void read(Handle<T>& handle) {
+        auto const pos = mHandles.find(readId());
+        if (pos != mHandles.end() && pos->second != HandleBase::nullid) {
+            handle = Handle<T>(pos->second);
+        } else {
+            handle.clear();
+        }
+    }
+
+    template<typename... T>
+    void read(std::tuple<T...>& args) {
+        std::apply([this](auto&... arg) { (read(arg), ...); }, args);
+    }
+
+    void read(void*& p) { p = nullptr; }
+    void read(CompileCallback& callback) { callback = nullptr; }
+    void read(FrameFinishedCallback& callback) { callback = nullptr; }
+
+    void read(const char*& string) {
+        uint32_t length = 0;
+        read(length);
+        if (length == Writer::NULL_STRING) {
+            string = nullptr;
+            return;
+        }
+        // the string must live until the command is executed
+        char* const p = static_cast<char*>(mStream.allocate(length + 1, 1));
+        bytes(p, length);
+        p[length] = 0;
+        string = p;
+    }
+
+    void read(CString& string) {
+        uint32_t length = 0;
+        read(length);
+        std::string s(length, '\0');
+        bytes(&s[0], length);
+        string = CString(s.data(), length);
+    }
+
+    void read(std::vector<uint8_t>& data) {
+        uint64_t size = 0;
+        read(size);
+        data.resize(size);
+        bytes(data.data(), size);
+    }
+
+    void read(BufferDescriptor& buffer) {
+        size_t size = 0;
+        void* const data = readContent(size);
+        buffer = BufferDescriptor(data, size, &release);
+    }
+
+    void read(PixelBufferDescriptor& buffer) {
+        size_t size = 0;
+        void* const data = readContent(size);
+        PixelLayout layout{};
+        read(layout);
+        if (PixelDataType(layout.type) == PixelDataType::COMPRESSED) {
+            buffer = PixelBufferDescriptor(data, size,
+                    CompressedPixelDataType(layout.format), layout.strideOrImageSize, &release);
+            buffer.left = layout.left;
+            buffer.top = layout.top;
+        } else {
+            buffer = PixelBufferDescriptor(data, size,
+                    PixelDataFormat(layout.format), PixelDataType(layout.type), layout.alignment,
+                    layout.left, layout.top, layout.strideOrImageSize, &release);
+        }
+    }
+
+    void read(Program& program) {
+        CString name;
+        uint8_t variant = 0;
+        uint64_t cacheId = 0;
+        bool skipDrawsUntilReady = false;
+        math::uint3 workGroupSize{};
+        read(name);
+        read(variant);
+        read(cacheId);
+        read(skipDrawsUntilReady);
+        read(workGroupSize);
+        program.diagnostics(std::move(name), variant)
+                .cacheId(cacheId)
+                .skipDrawsUntilReady(skipDrawsUntilReady)
+                .setWorkGroupSize(workGroupSize);
+        for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+            std::vector<uint8_t> source;
+            read(source);
+            if (!source.empty()) {
+                program.shader(Program::Shader(i), source.data(), source.size());
+            }
+        }
+        for (size_t i = 0; i < Program::UNIFORM_BINDING_COUNT; i++) {
+            CString blockName;
+            read(blockName);
+            if (!blockName.empty()) {
+                program.setUniformBlock(i, std::move(blockName));
+            }
+        }
+        for (size_t i = 0; i < Program::SAMPLER_BINDING_COUNT; i++) {
+            uint32_t count = 0;
+            read(count);
+            std::vector<Program::Sampler> samplers(count);
+            for (Program::Sampler& sampler : samplers) {
+                uint64_t binding = 0;
+                read(sampler.name);
+                read(binding);
+                sampler.binding = size_t(binding);
+            }
+            if (count) {
+                program.setSamplerGroup(i, samplers.data(), count);
+            }
+        }
+    }
+
+    void read(SamplerGroup& group) {
+        uint32_t count = 0;
+        read(count);
+        group = SamplerGroup(count);
+        for (size_t i = 0; i < count; i++) {
+            SamplerGroup::Sampler sampler;
+            read(sampler.t);
+            read(sampler.s);
+            group.setSampler(i, sampler);
+        }
+    }
+
+    void read(PipelineState& state) {
+        read(state.program);
+        read(state.rasterState);
+        read(state.polygonOffset);
+        read(state.scissor);
+    }
+
+    void read(TargetBufferInfo& info) {
+        Handle<HwTexture> handle;
+        uint8_t level = 0;
+        uint16_t layer = 0;
+        read(handle);
+        read(level);
+        read(layer);
+        info = TargetBufferInfo(handle, level, layer);
+    }
+
+    void read(FaceOffsets& offsets) {
+        for (size_t i = 0; i < 6; i++) {
+            uint64_t offset = 0;
+            read(offset);
+            offsets[i] = FaceOffsets::size_type(offset);
+        }
+    }
+
+    void read(MRT& mrt) {
+        TargetBufferInfo infos[MRT::TARGET_COUNT];
+        for (TargetBufferInfo& info : infos) {
+            read(info);
+        }
+        mrt = MRT(infos[0], infos[1], infos[2], infos[3]);
+    }
+
+private:
+    static void release(void* buffer, size_t, void*) {
+        free(buffer);
+    }
+
+    // the content of a buffer, which is freed once the driver is done with it
+    void* readContent(size_t& size) {
+        uint64_t s = 0;
+        read(s);
+        size = size_t(s);
+        void* const data = size ? malloc(size) : nullptr;
+        bytes(data, size);
+        return data;
+    }
+
+    std::istream& mIn;
+    CommandStream& mStream;
+    HandleMap const& mHandles;
+};
+
+// reads the arguments of a command that isn't replayed
+template<typename M>
+void skip(Reader& reader) {
+    Arguments<M> args;
+    reader.read(args);
+}
+
+} // anonymous namespace
+
+// ------------------------------------------------------------------------------------------------
+
+CommandStreamCapture* CommandStreamCapture::sCapture = nullptr;
+
+CommandStreamCapture::CommandStreamCapture(Driver& driver, const char* path,
+        uint32_t frameCount) noexcept
+        : mTarget(driver.getDispatcher()),
+          mOut(path, std::ios::binary | std::ios::trunc),
+          mFrameCount(frameCount) {
+    assert(!sCapture);
+    sCapture = this;
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params) \
+    mDispatcher.methodName##_ = &CommandStreamCapture::methodName;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) \
+    mDispatcher.methodName##_ = &CommandStreamCapture::methodName;
+#include "private/backend/DriverAPI.inc"
+
+    if (!mOut) {
+        slog.e << "Couldn't create the command stream capture " << path << io::endl;
+        mFrameCount = 0;
+        return;
+    }
+    Writer(mOut).write(FileHeader{});
+    slog.i << "Capturing " << frameCount << " frames of commands to " << path << io::endl;
+}
+
+CommandStreamCapture::~CommandStreamCapture() noexcept {
+    sCapture = nullptr;
+}
+
+template<typename Cmd>
+void CommandStreamCapture::record(uint32_t command, Execute execute,
+        Driver& driver, CommandBase* base, intptr_t* next) noexcept {
+    CommandStreamCapture& capture = *sCapture;
+    if (capture.mFrameCount) {
+        // this must be done first, executing the command moves its arguments away
+        Writer writer(capture.mOut);
+        writer.write(command);
+        writer.write(static_cast<Cmd const*>(base)->getArguments());
+        if (command == uint32_t(CommandId::endFrame) && !--capture.mFrameCount) {
+            capture.mOut.close();
+            slog.i << "Command stream capture complete" << io::endl;
+        }
+    }
+    execute(driver, base, next);
+}
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+    void CommandStreamCapture::methodName(Driver& driver, CommandBase* base,                    \
+            intptr_t* next) noexcept {                                                          \
+        record<COMMAND_TYPE(methodName)>(uint32_t(CommandId::methodName),                      \
+                sCapture->mTarget.methodName##_, driver, base, next);                           \
+    }
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+    void CommandStreamCapture::methodName(Driver& driver, CommandBase* base,                    \
+            intptr_t* next) noexcept {                                                          \
+        record<COMMAND_TYPE(methodName##R)>(uint32_t(CommandId::methodName),                   \
+                sCapture->mTarget.methodName##_, driver, base, next);                           \
+    }
+#include "private/backend/DriverAPI.inc"
+
+// ------------------------------------------------------------------------------------------------
+
+CommandStreamReplayer::CommandStreamReplayer(const char* path) noexcept
+        : mIn(path, std::ios::binary) {
+    const FileHeader expected{};
+    FileHeader header{};
+    mIn.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!mIn || memcmp(&header, &expected, sizeof(FileHeader)) != 0) {
+        slog.e << path << " is not a command stream capture of this build" << io::endl;
+        mIn.close();
+    }
+}
+
+CommandStreamReplayer::~CommandStreamReplayer() noexcept = default;
+
+bool CommandStreamReplayer::replayFrame(CommandStream& stream, TimerQueryHandle query,
+        bool* timed) {
+    // the query must be used while the frame's swap chain is current, i.e. within the frame
+    enum class Query { NOT_STARTED, STARTED, ENDED };
+    Query state = Query::NOT_STARTED;
+    bool replayed = false;
+    uint32_t command = 0;
+    while (mIn.read(reinterpret_cast<char*>(&command), sizeof(command))) {
+        if (UTILS_UNLIKELY(command >= uint32_t(CommandId::COUNT))) {
+            slog.e << "Invalid command " << command << " in the command stream capture"
+                   << io::endl;
+            mIn.close();
+            break;
+        }
+        if (state == Query::STARTED && (command == uint32_t(CommandId::commit) ||
+                command == uint32_t(CommandId::endFrame))) {
+            stream.endTimerQuery(query);
+            state = Query::ENDED;
+        }
+        replayCommand(stream, command);
+        replayed = true;
+        if (query && state == Query::NOT_STARTED &&
+                command == uint32_t(CommandId::beginFrame)) {
+            stream.beginTimerQuery(query);
+            state = Query::STARTED;
+        }
+        if (command == uint32_t(CommandId::endFrame)) {
+            break;
+        }
+    }
+    if (state == Query::STARTED) {
+        // the capture ends in the middle of a frame
+        stream.endTimerQuery(query);
+    }
+    if (timed) {
+        *timed = state != Query::NOT_STARTED;
+    }
+    return replayed;
+}
+
+void CommandStreamReplayer::replayCommand(CommandStream& stream, uint32_t command) {
+    Reader reader(mIn, stream, mHandles);
+
+    // the native objects of the capture are replaced, or the commands that use them are skipped
+    switch (CommandId(command)) {
+        case CommandId::createSwapChain: {
+            const HandleBase::HandleId id = reader.readId();
+            ArgumentsAfterHandle<decltype(&Driver::createSwapChainR)> args;
+            reader.read(args);
+            mHandles[id] = stream.createSwapChainHeadless(
+                    mSwapChainWidth, mSwapChainHeight, std::get<1>(args)).getId();
+            return;
+        }
+        case CommandId::importTexture: {
+            const HandleBase::HandleId id = reader.readId();
+            ArgumentsAfterHandle<decltype(&Driver::importTextureR)> args;
+            reader.read(args);
+            mHandles[id] = stream.createTexture(std::get<1>(args), std::get<2>(args),
+                    std::get<3>(args), std::get<4>(args), std::get<5>(args), std::get<6>(args),
+                    std::get<7>(args), std::get<8>(args)).getId();
+            return;
+        }
+        case CommandId::createStreamFromTextureId:
+            skip<decltype(&Driver::createStreamFromTextureIdR)>(reader);
+            return;
+        case CommandId::setExternalImage:
+            skip<decltype(&Driver::setExternalImage)>(reader);
+            return;
+        case CommandId::setExternalImagePlane:
+            skip<decltype(&Driver::setExternalImagePlane)>(reader);
+            return;
+        case CommandId::setExternalStream:
+            skip<decltype(&Driver::setExternalStream)>(reader);
+            return;
+        case CommandId::destroyStream:
+            skip<decltype(&Driver::destroyStream)>(reader);
+            return;
+        case CommandId::readStreamPixels:
+            skip<decltype(&Driver::readStreamPixels)>(reader);
+            return;
+        case CommandId::compilePrograms:
+            // its callback isn't captured
+            skip<decltype(&Driver::compilePrograms)>(reader);
+            return;
+        default:
+            break;
+    }
+
+    switch (CommandId(command)) {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+        case CommandId::methodName: {                                                           \
+            Arguments<decltype(&Driver::methodName)> args;                                      \
+            reader.read(args);                                                                  \
+            apply(&CommandStream::methodName, stream, std::move(args));                         \
+            break;                                                                              \
+        }
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+        case CommandId::methodName: {                                                           \
+            const HandleBase::HandleId id = reader.readId();                                    \
+            ArgumentsAfterHandle<decltype(&Driver::methodName##R)> args;                        \
+            reader.read(args);                                                                  \
+            mHandles[id] = apply(&CommandStream::methodName, stream, std::move(args)).getId();  \
+            break;                                                                              \
+        }
+#include "private/backend/DriverAPI.inc"
+        case CommandId::COUNT:
+            break;
+    }
+}
+
+} // namespace backend
+} // namespace filament
@@ -20,6 +20,9 @@
 #include <stddef.h>
 
 #include <math/scalar.h>
+#include <math/simd.h>
+
+#include <type_traits>
 
 namespace filament {
 namespace backend {
@@ -37,6 +40,14 @@ public:
     template<typename componentType, size_t srcChannelCount, size_t dstChannelCount>
     static void reshape(void* dest, const void* src, size_t numSrcBytes) {
         const componentType maxValue = getMaxValue<componentType>();
+        if constexpr (srcChannelCount == 3 && dstChannelCount == 4 &&
+                (std::is_same_v<componentType, uint8_t> ||
+                 std::is_same_v<componentType, uint16_t>)) {
+            // vectorized, this is the common case of RGB8 and RGB16F textures
+            filament::math::simd::expand3to4((componentType*) dest, (const componentType*) src,
+                    maxValue, numSrcBytes / (3 * sizeof(componentType)));
+            return;
+        }
         const componentType* in = (const componentType*) src;
         componentType* out = (componentType*) dest;
         const size_t width = (numSrcBytes / sizeof(componentType)) / srcChannelCount;
@@ -28,6 +28,8 @@
 #include <backend/BufferDescriptor.h>
 #include <backend/PixelBufferDescriptor.h>
 
+#include <stdlib.h>
+
 using namespace utils;
 
 namespace filament {
@@ -44,13 +46,18 @@ DriverBase::~DriverBase() noexcept {
 void DriverBase::purge() noexcept {
     std::vector<BufferDescriptor> buffersToPurge;
     std::vector<AcquiredImage> imagesToPurge;
+    std::vector<std::pair<CompileCallback, void*>> callbacksToPurge;
     std::unique_lock<std::mutex> lock(mPurgeLock);
     std::swap(buffersToPurge, mBufferToPurge);
     std::swap(imagesToPurge, mImagesToPurge);
+    std::swap(callbacksToPurge, mCallbacksToPurge);
     lock.unlock(); // don't remove this, it ensures mBufferToPurge is destroyed without lock held
     for (auto& image : imagesToPurge) {
         image.callback(image.image, image.userData);
     }
+    for (auto& callback : callbacksToPurge) {
+        callback.first(callback.second);
+    }
     // When the BufferDescriptors go out of scope, their destructors invoke their callbacks.
 }
 
@@ -59,6 +66,12 @@ void DriverBase::scheduleDestroySlow(BufferDescriptor&& buffer) noexcept {
     mBufferToPurge.push_back(std::move(buffer));
 }
 
+BufferDescriptor DriverBase::allocateHeapStaging(size_t size) noexcept {
+    return BufferDescriptor(malloc(size), size, [](void* buffer, size_t, void*) {
+        free(buffer);
+    });
+}
+
 // This is called from an async driver method so it's in the GL thread, but purge is called
 // on the user thread. This is typically called 0 or 1 times per frame.
 void DriverBase::scheduleRelease(AcquiredImage&& image) noexcept {
@@ -66,6 +79,13 @@ void DriverBase::scheduleRelease(AcquiredImage&& image) noexcept {
     mImagesToPurge.push_back(std::move(image));
 }
 
+// Like scheduleRelease(), this is called in the driver thread, and the callback is called on the
+// user thread by purge().
+void DriverBase::scheduleCallback(CompileCallback callback, void* user) noexcept {
+    std::lock_guard<std::mutex> lock(mPurgeLock);
+    mCallbacksToPurge.emplace_back(callback, user);
+}
+
 // ------------------------------------------------------------------------------------------------
 
 Driver::~Driver() noexcept = default;
@@ -74,6 +94,10 @@ void Driver::execute(std::function<void(void)> fn) noexcept {
     fn();
 }
 
+bool Driver::executeSubStreams(CommandSubStreamRange const*, size_t) noexcept {
+    return false;
+}
+
 size_t Driver::getElementTypeSize(ElementType type) noexcept {
     switch (type) {
         case ElementType::BYTE:     return sizeof(int8_t);
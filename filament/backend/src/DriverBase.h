@@ -188,10 +188,16 @@ protected:
 
     void scheduleRelease(AcquiredImage&& image) noexcept;
 
+    void scheduleCallback(CompileCallback callback, void* user) noexcept;
+
+    // staging memory in the heap, for the backends that can't map GPU memory on the user thread
+    static BufferDescriptor allocateHeapStaging(size_t size) noexcept;
+
 private:
     std::mutex mPurgeLock;
     std::vector<BufferDescriptor> mBufferToPurge;
     std::vector<AcquiredImage> mImagesToPurge;
+    std::vector<std::pair<CompileCallback, void*>> mCallbacksToPurge;
 };
 
 
@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/backend/HandleAllocator.h"
+
+#include <utils/Log.h>
+#include <utils/memalign.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+
+using namespace utils;
+
+namespace filament {
+namespace backend {
+
+static_assert(sizeof(void*) <= HandleAllocator::MAX_ALIGNMENT,
+        "the slots of the indirect pool must hold a pointer");
+
+HandleAllocator::HandleAllocator(const char* name, size_t size,
+        std::array<size_t, 3> const& sizes) noexcept
+        : mName(name) {
+    assert(sizes[0] <= sizes[1] && sizes[1] <= sizes[2]);
+
+    // the first segments are split as 1/16, 5/16 and 10/16 of the size, and the indirect pool
+    // gets as many slots as the largest pool
+    auto roundUp = [](size_t s) {
+        return std::max(sizeof(Node), (s + MAX_ALIGNMENT - 1) & ~(MAX_ALIGNMENT - 1));
+    };
+    const size_t bytes[3] = { size / 16, (5 * size) / 16, (10 * size) / 16 };
+    for (size_t i = 0; i < 3; i++) {
+        mPools[i].slotSize = roundUp(sizes[i]);
+        mPools[i].slotCount = std::clamp(bytes[i] / mPools[i].slotSize,
+                size_t(1), MAX_SLOT_COUNT);
+    }
+    mPools[INDIRECT_POOL].slotSize = roundUp(sizeof(void*));
+    mPools[INDIRECT_POOL].slotCount = mPools[2].slotCount;
+
+    for (Pool& pool : mPools) {
+        grow(pool);
+    }
+}
+
+HandleAllocator::~HandleAllocator() noexcept {
+#ifndef NDEBUG
+    for (size_t i = 0; i < POOL_COUNT; i++) {
+        PoolStatistics const stats = getPoolStatistics(i);
+        slog.d << mName << " pool " << i << " (" << stats.slotSize << " bytes): "
+               << stats.highWatermark << " / " << stats.capacity << " slots used at most, "
+               << stats.segmentCount << " segments" << io::endl;
+        if (stats.used) {
+            slog.w << mName << " pool " << i << ": " << stats.used << " leaked handles"
+                   << io::endl;
+        }
+    }
+#endif
+    for (Pool& pool : mPools) {
+        for (size_t i = 0; i < pool.segmentCount; i++) {
+            utils::aligned_free(pool.segments[i]);
+        }
+    }
+}
+
+bool HandleAllocator::grow(Pool& pool) noexcept {
+    if (UTILS_UNLIKELY(pool.segmentCount == MAX_SEGMENT_COUNT)) {
+        return false;
+    }
+    char* const segment = (char*)utils::aligned_alloc(
+            pool.slotSize * pool.slotCount, MAX_ALIGNMENT);
+    if (UTILS_UNLIKELY(!segment)) {
+        return false;
+    }
+
+    // thread the slots of the new segment in front of the free list, in address order
+    const uint32_t poolIndex = uint32_t(&pool - mPools.data());
+    const HandleBase::HandleId base = HandleBase::HandleId(
+            (poolIndex << SEGMENT_BITS | pool.segmentCount) << SLOT_BITS);
+    Node* next = pool.freeList;
+    for (size_t i = pool.slotCount; i-- > 0;) {
+        Node* const node = reinterpret_cast<Node*>(segment + i * pool.slotSize);
+        node->next = next;
+        node->id = base | HandleBase::HandleId(i);
+        next = node;
+    }
+    pool.freeList = next;
+    pool.segments[pool.segmentCount++] = segment;
+    return true;
+}
+
+HandleBase::HandleId HandleAllocator::allocateSlot(size_t size) noexcept {
+    // objects that don't fit in the largest pool are allocated outside of the lock
+    void* indirect = nullptr;
+    size_t index = 0;
+    while (index < INDIRECT_POOL && size > mPools[index].slotSize) {
+        index++;
+    }
+    if (UTILS_UNLIKELY(index == INDIRECT_POOL)) {
+        indirect = utils::aligned_alloc(size, MAX_ALIGNMENT);
+        ASSERT_POSTCONDITION(indirect, "%s: out of memory allocating %u bytes",
+                mName, unsigned(size));
+    }
+
+    std::lock_guard<utils::SpinLock> guard(mLock);
+    Pool& pool = mPools[index];
+    if (UTILS_UNLIKELY(!pool.freeList)) {
+        ASSERT_POSTCONDITION(grow(pool), "%s: pool %u of %u bytes is full",
+                mName, unsigned(index), unsigned(pool.slotSize));
+#ifndef NDEBUG
+        slog.d << mName << " pool " << index << " grew to " << pool.segmentCount << " segments"
+               << io::endl;
+#endif
+    }
+    Node* const node = pool.freeList;
+    pool.freeList = node->next;
+    const HandleBase::HandleId id = node->id;
+    pool.used++;
+    pool.highWatermark = std::max(pool.highWatermark, pool.used);
+    if (UTILS_UNLIKELY(indirect)) {
+        *reinterpret_cast<void**>(node) = indirect;
+    }
+    return id;
+}
+
+void HandleAllocator::deallocateSlot(HandleBase::HandleId id, void* p) noexcept {
+    const uint32_t index = getPoolIndex(id);
+    assert(index < POOL_COUNT);
+    void* const slot = getSlot(id);
+    if (UTILS_UNLIKELY(index == INDIRECT_POOL)) {
+        assert(p == *static_cast<void**>(slot));
+        utils::aligned_free(p);
+    } else {
+        assert(p == slot);
+    }
+
+    std::lock_guard<utils::SpinLock> guard(mLock);
+    Pool& pool = mPools[index];
+    Node* const node = static_cast<Node*>(slot);
+    node->next = pool.freeList;
+    node->id = id;
+    pool.freeList = node;
+    pool.used--;
+}
+
+HandleAllocator::PoolStatistics HandleAllocator::getPoolStatistics(size_t index) const noexcept {
+    assert(index < POOL_COUNT);
+    std::lock_guard<utils::SpinLock> guard(mLock);
+    Pool const& pool = mPools[index];
+    return {
+            .slotSize = pool.slotSize,
+            .capacity = pool.slotCount * pool.segmentCount,
+            .used = pool.used,
+            .highWatermark = pool.highWatermark,
+            .segmentCount = pool.segmentCount
+    };
+}
+
+} // namespace backend
+} // namespace filament
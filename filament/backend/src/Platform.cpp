@@ -18,6 +18,8 @@
 
 #include <utils/Systrace.h>
 
+#include <utility>
+
 #if defined(ANDROID)
     #ifndef FILAMENT_USE_EXTERNAL_GLES3
         #include "opengl/PlatformEGLAndroid.h"
@@ -73,6 +75,28 @@ namespace backend {
 // this generates the vtable in this translation unit
 Platform::~Platform() noexcept = default;
 
+void Platform::setBlobFunc(InsertBlobFunc&& insertBlob, RetrieveBlobFunc&& retrieveBlob) noexcept {
+    mInsertBlob = std::move(insertBlob);
+    mRetrieveBlob = std::move(retrieveBlob);
+}
+
+bool Platform::hasBlobFunc() const noexcept {
+    return mInsertBlob && mRetrieveBlob;
+}
+
+void Platform::insertBlob(const void* key, size_t keySize, const void* value, size_t valueSize) {
+    if (mInsertBlob) {
+        mInsertBlob(key, keySize, value, valueSize);
+    }
+}
+
+size_t Platform::retrieveBlob(const void* key, size_t keySize, void* value, size_t valueSize) {
+    if (mRetrieveBlob) {
+        return mRetrieveBlob(key, keySize, value, valueSize);
+    }
+    return 0;
+}
+
 // Creates the platform-specific Platform object. The caller takes ownership and is
 // responsible for destroying it. Initialization of the backend API is deferred until
 // createDriver(). The passed-in backend hint is replaced with the resolved backend.
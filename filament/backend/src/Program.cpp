@@ -39,6 +39,16 @@ Program& Program::diagnostics(utils::CString&& name, uint8_t variant) noexcept {
     return *this;
 }
 
+Program& Program::cacheId(uint64_t id) noexcept {
+    mCacheId = id;
+    return *this;
+}
+
+Program& Program::skipDrawsUntilReady(bool skip) noexcept {
+    mSkipDrawsUntilReady = skip;
+    return *this;
+}
+
 Program& Program::shader(Program::Shader shader, void const* data, size_t size) noexcept {
     std::vector<uint8_t> blob(size);
     std::copy_n((const uint8_t *)data, size, blob.data());
@@ -60,6 +70,16 @@ Program& Program::setSamplerGroup(size_t bindingPoint,
     return *this;
 }
 
+Program& Program::setWorkGroupSize(math::uint3 size) noexcept {
+    mWorkGroupSize = size;
+    return *this;
+}
+
+Program& Program::specializationConstants(
+        SpecializationConstantsInfo specConstants) noexcept {
+    mSpecializationConstants = std::move(specConstants);
+    return *this;
+}
 
 #if !defined(NDEBUG)
 io::ostream& operator<<(io::ostream& out, const Program& builder) {
@@ -41,6 +41,15 @@ public:
      */
     bool needsReshaping() const noexcept { return mNeedsReshaping; }
 
+    /**
+     * Returns true if the given pixels need reshaping, i.e. if the TextureFormat requires it and
+     * the pixels were not given with 4 components already.
+     */
+    bool needsReshaping(PixelBufferDescriptor const& p) const noexcept {
+        return mNeedsReshaping && p.format != PixelDataFormat::RGBA &&
+                p.format != PixelDataFormat::RGBA_INTEGER;
+    }
+
     /**
      * Returns the graphics API-native TextureFormat that pixels will be reshaped into.
      * If the format does not need reshaping, the original requestedFormat is returned.
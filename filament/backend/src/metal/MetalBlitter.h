@@ -79,17 +79,29 @@ private:
     static void setupColorAttachment(const BlitArgs& args, MTLRenderPassDescriptor* descriptor);
     static void setupDepthAttachment(const BlitArgs& args, MTLRenderPassDescriptor* descriptor);
 
+    // type of the color components, which the blit shader must match
+    enum class ColorType : uint8_t {
+        FLOAT,
+        INT,
+        UINT
+    };
+
+    static ColorType getColorType(MTLPixelFormat format) noexcept;
+
     struct BlitFunctionKey {
         bool blitColor;
         bool blitDepth;
         bool msaaColorSource;
         bool msaaDepthSource;
+        ColorType colorType;
+        uint8_t padding[3];
 
         bool operator==(const BlitFunctionKey& rhs) const noexcept {
             return blitColor == rhs.blitColor &&
                    blitDepth == rhs.blitDepth &&
                    msaaColorSource == rhs.msaaColorSource &&
-                   msaaDepthSource == rhs.msaaDepthSource;
+                   msaaDepthSource == rhs.msaaDepthSource &&
+                   colorType == rhs.colorType;
         }
 
         BlitFunctionKey() {
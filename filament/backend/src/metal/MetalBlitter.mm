@@ -37,6 +37,11 @@ static const char* functionLibrary = R"(
 
 using namespace metal;
 
+// integer formats are blitted with integer textures and attachments
+#ifndef COLOR_TYPE
+#define COLOR_TYPE float
+#endif
+
 struct VertexOut
 {
     float4 vertexPosition [[position]];
@@ -46,7 +51,7 @@ struct VertexOut
 struct FragmentOut
 {
 #ifdef BLIT_COLOR
-    float4 color [[color(0)]];
+    vec<COLOR_TYPE, 4> color [[color(0)]];
 #endif
 
 #ifdef BLIT_DEPTH
@@ -70,9 +75,9 @@ blitterFrag(VertexOut in [[stage_in]],
 
 #ifdef BLIT_COLOR
 #ifdef MSAA_COLOR_SOURCE
-            texture2d_ms<float, access::read> sourceColor [[texture(0)]],
+            texture2d_ms<COLOR_TYPE, access::read> sourceColor [[texture(0)]],
 #else
-            texture2d<float, access::read> sourceColor [[texture(0)]],
+            texture2d<COLOR_TYPE, access::read> sourceColor [[texture(0)]],
 #endif
 #endif
 
@@ -89,7 +94,7 @@ blitterFrag(VertexOut in [[stage_in]],
     FragmentOut out = {};
 #ifdef BLIT_COLOR
 #ifdef MSAA_COLOR_SOURCE
-    out.color = float4(0.0);
+    out.color = vec<COLOR_TYPE, 4>(0);
     for (uint s = 0; s < sourceColor.get_num_samples(); s++) {
         out.color += sourceColor.read(static_cast<uint2>(in.uv), s);
     }
@@ -116,6 +121,34 @@ blitterFrag(VertexOut in [[stage_in]],
 
 MetalBlitter::MetalBlitter(MetalContext& context) noexcept : mContext(context) { }
 
+MetalBlitter::ColorType MetalBlitter::getColorType(MTLPixelFormat format) noexcept {
+    switch (format) {
+        case MTLPixelFormatR8Sint:
+        case MTLPixelFormatR16Sint:
+        case MTLPixelFormatR32Sint:
+        case MTLPixelFormatRG8Sint:
+        case MTLPixelFormatRG16Sint:
+        case MTLPixelFormatRG32Sint:
+        case MTLPixelFormatRGBA8Sint:
+        case MTLPixelFormatRGBA16Sint:
+        case MTLPixelFormatRGBA32Sint:
+            return ColorType::INT;
+        case MTLPixelFormatR8Uint:
+        case MTLPixelFormatR16Uint:
+        case MTLPixelFormatR32Uint:
+        case MTLPixelFormatRG8Uint:
+        case MTLPixelFormatRG16Uint:
+        case MTLPixelFormatRG32Uint:
+        case MTLPixelFormatRGBA8Uint:
+        case MTLPixelFormatRGBA16Uint:
+        case MTLPixelFormatRGBA32Uint:
+        case MTLPixelFormatRGB10A2Uint:
+            return ColorType::UINT;
+        default:
+            return ColorType::FLOAT;
+    }
+}
+
 #define MTLSizeEqual(a, b) (a.width == b.width && a.height == b.height && a.depth == b.depth)
 
 void MetalBlitter::blit(id<MTLCommandBuffer> cmdBuffer, const BlitArgs& args) {
@@ -155,6 +188,9 @@ void MetalBlitter::blit(id<MTLCommandBuffer> cmdBuffer, const BlitArgs& args) {
     key.blitDepth = blitDepth;
     key.msaaColorSource = args.source.color.textureType == MTLTextureType2DMultisample;
     key.msaaDepthSource = args.source.depth.textureType == MTLTextureType2DMultisample;
+    if (blitColor) {
+        key.colorType = getColorType(args.destination.color.pixelFormat);
+    }
     id<MTLFunction> fragmentFunction = getBlitFragmentFunction(key);
 
     PipelineState pipelineState {
@@ -341,6 +377,11 @@ id<MTLFunction> MetalBlitter::compileFragmentFunction(BlitFunctionKey key) {
     if (key.msaaDepthSource) {
         macros[@"MSAA_DEPTH_SOURCE"] = @"1";
     }
+    if (key.colorType == ColorType::INT) {
+        macros[@"COLOR_TYPE"] = @"int";
+    } else if (key.colorType == ColorType::UINT) {
+        macros[@"COLOR_TYPE"] = @"uint";
+    }
     options.preprocessorMacros = macros;
     NSString* objcSource = [NSString stringWithCString:functionLibrary
                                               encoding:NSUTF8StringEncoding];
@@ -38,10 +38,19 @@ public:
     size_t getSize() const noexcept { return mBufferSize; }
 
     /**
-     * Update the buffer with data inside src. Potentially allocates a new buffer allocation to hold
-     * the bytes which will be released when the current frame is finished.
+     * Update the buffer with data inside src, at byteOffset. Potentially allocates a new buffer
+     * allocation to hold the bytes which will be released when the current frame is finished.
+     * The content outside of the updated range is preserved by partial updates, which are written
+     * in place when the GPU isn't using the buffer.
      */
-    void copyIntoBuffer(void* src, size_t size);
+    void copyIntoBuffer(void* src, size_t size, size_t byteOffset);
+
+    /**
+     * Update the buffer with the content of a descriptor, at byteOffset. When the descriptor
+     * holds staging memory from MetalBufferPool::acquireStaging() for the whole buffer, that
+     * memory becomes the buffer's allocation instead of being copied.
+     */
+    void updateBuffer(BufferDescriptor& data, size_t byteOffset);
 
     /**
      * Denotes that this buffer is used for a draw call ensuring that its allocation remains valid
@@ -54,6 +63,12 @@ public:
 
     void* getCpuBuffer() const noexcept { return mCpuBuffer; }
 
+    /**
+     * Moves the content of a small buffer kept in CPU memory to a device allocation, e.g. so that
+     * shaders can write to it. Does nothing if the buffer already has a device allocation.
+     */
+    void makeGpuBuffer();
+
     enum Stage {
         VERTEX = 1,
         FRAGMENT = 2
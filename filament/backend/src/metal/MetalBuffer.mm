@@ -30,6 +30,11 @@ MetalBuffer::MetalBuffer(MetalContext& context, size_t size, bool forceGpuBuffer
     if (size <= 4 * 1024 && !forceGpuBuffer) {   // 4K
         mBufferPoolEntry = nullptr;
         mCpuBuffer = malloc(size);
+    } else {
+        // Start with an empty buffer, so that draws using it before any data has been loaded don't
+        // fail. It's acquired here rather than in getGpuBufferForDraw(), which can be called
+        // concurrently by the threads recording sub-streams.
+        mBufferPoolEntry = mContext.bufferPool->acquireBuffer(mBufferSize);
     }
 }
 
@@ -44,41 +49,78 @@ MetalBuffer::~MetalBuffer() {
     }
 }
 
-void MetalBuffer::copyIntoBuffer(void* src, size_t size) {
+void MetalBuffer::copyIntoBuffer(void* src, size_t size, size_t byteOffset) {
     if (size <= 0) {
         return;
     }
-    ASSERT_PRECONDITION(size <= mBufferSize, "Attempting to copy %d bytes into a buffer of size %d",
-            size, mBufferSize);
+    ASSERT_PRECONDITION(byteOffset + size <= mBufferSize,
+            "Attempting to copy %d bytes at offset %d into a buffer of size %d",
+            size, byteOffset, mBufferSize);
 
     // Either copy into the Metal buffer or into our cpu buffer.
     if (mCpuBuffer) {
-        memcpy(mCpuBuffer, src, size);
+        memcpy(static_cast<uint8_t*>(mCpuBuffer) + byteOffset, src, size);
+        return;
+    }
+
+    // A partial update of a buffer that isn't used by any command buffer in flight is written in
+    // place, without acquiring a new buffer.
+    const bool partial = byteOffset || size < mBufferSize;
+    if (partial && mBufferPoolEntry && !mContext.bufferPool->isShared(mBufferPoolEntry)) {
+        memcpy(static_cast<uint8_t*>(mBufferPoolEntry->buffer.contents) + byteOffset, src, size);
         return;
     }
 
     // We're about to acquire a new buffer to hold the new contents. If we previously had obtained a
     // buffer we release it, decrementing its reference count, as we no longer needs it.
-    if (mBufferPoolEntry) {
-        mContext.bufferPool->releaseBuffer(mBufferPoolEntry);
+    MetalBufferPoolEntry const* previous = mBufferPoolEntry;
+    mBufferPoolEntry = mContext.bufferPool->acquireBuffer(mBufferSize);
+    uint8_t* const contents = static_cast<uint8_t*>(mBufferPoolEntry->buffer.contents);
+    if (previous && partial) {
+        // a partial update must preserve the rest of the buffer
+        uint8_t const* const before = static_cast<uint8_t const*>(previous->buffer.contents);
+        const size_t end = byteOffset + size;
+        memcpy(contents, before, byteOffset);
+        memcpy(contents + end, before + end, mBufferSize - end);
+    }
+    memcpy(contents + byteOffset, src, size);
+
+    if (previous) {
+        mContext.bufferPool->releaseBuffer(previous);
     }
+}
 
+void MetalBuffer::makeGpuBuffer() {
+    if (!mCpuBuffer) {
+        return;
+    }
     mBufferPoolEntry = mContext.bufferPool->acquireBuffer(mBufferSize);
-    memcpy(static_cast<uint8_t*>(mBufferPoolEntry->buffer.contents), src, size);
+    memcpy(mBufferPoolEntry->buffer.contents, mCpuBuffer, mBufferSize);
+    free(mCpuBuffer);
+    mCpuBuffer = nullptr;
 }
 
-id<MTLBuffer> MetalBuffer::getGpuBufferForDraw(id<MTLCommandBuffer> cmdBuffer) noexcept {
-    if (!mBufferPoolEntry) {
-        // If there's a CPU buffer, then we return nil here, as the CPU-side buffer will be bound
-        // separately.
-        if (mCpuBuffer) {
-            return nil;
+void MetalBuffer::updateBuffer(BufferDescriptor& data, size_t byteOffset) {
+    if (!mCpuBuffer && byteOffset == 0 && data.size == mBufferSize) {
+        MetalBufferPoolEntry const* staging = mContext.bufferPool->adoptStaging(data);
+        if (staging) {
+            if (mBufferPoolEntry) {
+                mContext.bufferPool->releaseBuffer(mBufferPoolEntry);
+            }
+            mBufferPoolEntry = staging;
+            return;
         }
+    }
+    copyIntoBuffer(data.buffer, data.size, byteOffset);
+}
 
-        // If there isn't a CPU buffer, it means no data has been loaded into this buffer yet. To
-        // avoid an error, we'll allocate an empty buffer.
-        mBufferPoolEntry = mContext.bufferPool->acquireBuffer(mBufferSize);
+id<MTLBuffer> MetalBuffer::getGpuBufferForDraw(id<MTLCommandBuffer> cmdBuffer) noexcept {
+    // If there's a CPU buffer, then we return nil here, as the CPU-side buffer will be bound
+    // separately.
+    if (mCpuBuffer) {
+        return nil;
     }
+    assert(mBufferPoolEntry);
 
     // This buffer is being used in a draw call, so we retain it so it's not released back into the
     // buffer pool until the frame has finished.
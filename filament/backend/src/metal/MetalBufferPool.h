@@ -17,12 +17,17 @@
 #ifndef TNT_FILAMENT_DRIVER_METALSTAGEPOOL_H
 #define TNT_FILAMENT_DRIVER_METALSTAGEPOOL_H
 
+#include <backend/BufferDescriptor.h>
+
 #include <Metal/Metal.h>
 
+#include <atomic>
 #include <map>
 #include <mutex>
 #include <unordered_set>
 
+#include <stdint.h>
+
 namespace filament {
 namespace backend {
 namespace metal {
@@ -52,6 +57,18 @@ public:
     // the count is 0.
     void releaseBuffer(MetalBufferPoolEntry const *stage) noexcept;
 
+    // Returns true if the buffer has more than one reference, e.g. it's used by a command buffer
+    // in flight and can't be written to.
+    bool isShared(MetalBufferPoolEntry const *stage) noexcept;
+
+    // Acquires a buffer for the application to write directly, wrapped in a descriptor whose
+    // callback releases the buffer unless it's adopted.
+    BufferDescriptor acquireStaging(size_t numBytes);
+
+    // Takes over the buffer of a descriptor made by acquireStaging(), which must then be released
+    // with releaseBuffer(). Returns null for any other descriptor.
+    MetalBufferPoolEntry const* adoptStaging(BufferDescriptor& data) noexcept;
+
     // Evicts old unused buffers and bumps the current frame number.
     void gc() noexcept;
 
@@ -59,6 +76,14 @@ public:
     void reset() noexcept;
 
 private:
+    // Buffers handed out by acquireStaging(), until they're adopted.
+    struct Staging {
+        MetalBufferPool* pool;
+        MetalBufferPoolEntry const* entry;
+    };
+
+    static void releaseStaging(void* buffer, size_t size, void* user);
+
     MetalContext& mContext;
 
     // Synchronizes access to mFreeStages, mUsedStages, and mutable data inside MetalBufferPoolEntrys.
@@ -78,6 +103,37 @@ private:
     static constexpr uint32_t TIME_BEFORE_EVICTION = 10;
 };
 
+// A ring of shared CPU-GPU memory for transient uploads, like texture staging data. Allocations
+// are made on the driver thread, and reclaimed when the command buffer that uses them completes.
+// The two only synchronize through an atomic, as command buffers complete in submission order.
+class MetalRingBuffer {
+public:
+    MetalRingBuffer(id<MTLDevice> device, size_t capacity) noexcept;
+
+    MetalRingBuffer(MetalRingBuffer const& rhs) = delete;
+    MetalRingBuffer& operator=(MetalRingBuffer const& rhs) = delete;
+
+    struct Allocation {
+        id<MTLBuffer> buffer = nil;
+        size_t offset = 0;
+    };
+
+    // Returns 'size' bytes that stay valid until 'cmdBuffer' completes, or an allocation with a
+    // nil buffer if the ring doesn't have enough free space.
+    Allocation allocate(size_t size, id<MTLCommandBuffer> cmdBuffer) noexcept;
+
+private:
+    // satisfies the alignment of the sourceOffset of all blits
+    static constexpr size_t ALIGNMENT = 256;
+
+    id<MTLBuffer> mBuffer;
+    const size_t mCapacity;
+
+    // head and tail are byte counts that only ever grow, offsets are taken modulo the capacity
+    uint64_t mHead = 0;                     // only used on the driver thread
+    std::atomic<uint64_t> mTail = { 0 };    // advanced by command buffer completion handlers
+};
+
 } // namespace metal
 } // namespace backend
 } // namespace filament
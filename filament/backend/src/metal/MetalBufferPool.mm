@@ -61,6 +61,12 @@ void MetalBufferPool::retainBuffer(MetalBufferPoolEntry const *stage) noexcept {
     (stage->referenceCount)++;
 }
 
+bool MetalBufferPool::isShared(MetalBufferPoolEntry const *stage) noexcept {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return stage->referenceCount > 1;
+}
+
 void MetalBufferPool::releaseBuffer(MetalBufferPoolEntry const *stage) noexcept {
     std::lock_guard<std::mutex> lock(mMutex);
 
@@ -80,6 +86,29 @@ void MetalBufferPool::releaseBuffer(MetalBufferPoolEntry const *stage) noexcept
     mFreeStages.insert(std::make_pair(stage->capacity, stage));
 }
 
+BufferDescriptor MetalBufferPool::acquireStaging(size_t numBytes) {
+    MetalBufferPoolEntry const* entry = acquireBuffer(numBytes);
+    return BufferDescriptor(entry->buffer.contents, numBytes, releaseStaging,
+            new Staging{ this, entry });
+}
+
+void MetalBufferPool::releaseStaging(void* buffer, size_t size, void* user) {
+    Staging* staging = static_cast<Staging*>(user);
+    staging->pool->releaseBuffer(staging->entry);
+    delete staging;
+}
+
+MetalBufferPoolEntry const* MetalBufferPool::adoptStaging(BufferDescriptor& data) noexcept {
+    if (data.getCallback() != releaseStaging) {
+        return nullptr;
+    }
+    Staging* staging = static_cast<Staging*>(data.getUser());
+    MetalBufferPoolEntry const* entry = staging->entry;
+    delete staging;
+    data.setCallback(nullptr);
+    return entry;
+}
+
 void MetalBufferPool::gc() noexcept {
     // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
     if (++mCurrentFrame <= TIME_BEFORE_EVICTION) {
@@ -110,6 +139,44 @@ void MetalBufferPool::reset() noexcept {
     mFreeStages.clear();
 }
 
+MetalRingBuffer::MetalRingBuffer(id<MTLDevice> device, size_t capacity) noexcept
+        : mBuffer([device newBufferWithLength:capacity options:MTLResourceStorageModeShared]),
+          mCapacity(capacity) {
+    mBuffer.label = @"Filament upload ring";
+}
+
+MetalRingBuffer::Allocation MetalRingBuffer::allocate(size_t size,
+        id<MTLCommandBuffer> cmdBuffer) noexcept {
+    size = (size + ALIGNMENT - 1u) & ~(ALIGNMENT - 1u);
+    if (UTILS_UNLIKELY(!mBuffer || size > mCapacity)) {
+        return {};
+    }
+
+    // allocations don't wrap around, the end of the ring is skipped if needed
+    uint64_t start = mHead;
+    const uint64_t offset = start % mCapacity;
+    if (offset + size > mCapacity) {
+        start += mCapacity - offset;
+    }
+    const uint64_t end = start + size;
+    if (end - mTail.load(std::memory_order_acquire) > mCapacity) {
+        // the GPU isn't done with this part of the ring yet
+        return {};
+    }
+    mHead = end;
+
+    // The ring is guaranteed to outlive the completion handlers.
+    std::atomic<uint64_t>* const tail = &mTail;
+    [cmdBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+        uint64_t current = tail->load(std::memory_order_relaxed);
+        while (current < end &&
+                !tail->compare_exchange_weak(current, end, std::memory_order_release)) {
+        }
+    }];
+
+    return { mBuffer, size_t(start % mCapacity) };
+}
+
 } // namespace metal
 } // namespace backend
 } // namespace filament
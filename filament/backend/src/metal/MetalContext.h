@@ -30,6 +30,7 @@ namespace metal {
 
 class MetalBlitter;
 class MetalBufferPool;
+class MetalRingBuffer;
 class MetalRenderTarget;
 class MetalSwapChain;
 class TimerQueryInterface;
@@ -38,6 +39,20 @@ struct MetalIndexBuffer;
 struct MetalSamplerGroup;
 struct MetalVertexBuffer;
 
+// The encoder and state of a thread recording a sub-stream, into a sub-encoder of the parallel
+// encoder of the current render pass.
+struct SubStreamEncoder {
+    id<MTLRenderCommandEncoder> encoder = nil;
+
+    PipelineStateTracker pipelineState;
+    DepthStencilStateTracker depthStencilState;
+    UniformBufferState uniformState[VERTEX_BUFFER_START];
+    CullModeStateTracker cullModeState;
+    SamplerBindingStateTracker samplerBindingState;
+
+    MetalSamplerGroup* samplerBindings[SAMPLER_BINDING_COUNT] = {};
+};
+
 struct MetalContext {
     id<MTLDevice> device = nullptr;
     id<MTLCommandQueue> commandQueue = nullptr;
@@ -45,6 +60,13 @@ struct MetalContext {
     id<MTLCommandBuffer> pendingCommandBuffer = nullptr;
     id<MTLRenderCommandEncoder> currentRenderPassEncoder = nullptr;
 
+    // The encoder of a render pass is created by the first command that needs it, see
+    // getRenderPassEncoder(). Until then the render pass is pending, which lets a group of
+    // sub-streams record it with a parallel encoder instead, whose sub-encoders are then used.
+    MTLRenderPassDescriptor* pendingRenderPassDescriptor = nil;
+    id<MTLParallelRenderCommandEncoder> parallelRenderPassEncoder = nil;
+    MTLViewport currentViewport = {};
+
     // These two fields store a callback and user data to notify the client that a frame is ready
     // for presentation.
     // If frameFinishedCallback is nullptr, then the Metal backend automatically calls
@@ -65,6 +87,7 @@ struct MetalContext {
     DepthStencilStateTracker depthStencilState;
     UniformBufferState uniformState[VERTEX_BUFFER_START];
     CullModeStateTracker cullModeState;
+    SamplerBindingStateTracker samplerBindingState;
 
     // State caches.
     DepthStencilStateCache depthStencilStateCache;
@@ -73,8 +96,15 @@ struct MetalContext {
 
     MetalSamplerGroup* samplerBindings[SAMPLER_BINDING_COUNT] = {};
 
+    // Storage buffers and images, only used by compute programs.
+    Handle<HwUniformBuffer> storageBuffers[STORAGE_BINDING_COUNT] = {};
+    id<MTLTexture> images[STORAGE_BINDING_COUNT] = {};
+
     MetalBufferPool* bufferPool;
 
+    // Ring for transient uploads, the buffer pool is used when it's full.
+    MetalRingBuffer* uploadRing;
+
     // Surface-related properties.
     MetalSwapChain* currentSurface = nullptr;
     id<CAMetalDrawable> currentDrawable = nil;
@@ -90,6 +120,9 @@ struct MetalContext {
 
     MetalBlitter* blitter = nullptr;
 
+    // See DriverAPI::setMaxFramesInFlight(), it limits the number of drawables of swap chains.
+    uint32_t maxFramesInFlight = 2;
+
     // Fences, only supported on macOS 10.14 and iOS 12 and above.
     API_AVAILABLE(macos(10.14), ios(12.0))
     MTLSharedEventListener* eventListener = nil;
@@ -114,6 +147,15 @@ id<MTLTexture> getOrCreateEmptyTexture(MetalContext* context);
 
 bool isInRenderPass(MetalContext* context);
 
+// Returns the encoder of the current render pass, creating it if the render pass is pending or
+// if the sub-encoder used by the last commands was ended by a group of sub-streams. Returns nil
+// outside of a render pass.
+id<MTLRenderCommandEncoder> getRenderPassEncoder(MetalContext* context);
+
+// Creates a render command encoder for the current render pass, either a regular one or a
+// sub-encoder of its parallel encoder, with the winding and viewport of the render pass set.
+id<MTLRenderCommandEncoder> createRenderPassEncoder(MetalContext* context);
+
 } // namespace metal
 } // namespace backend
 } // namespace filament
@@ -159,7 +159,47 @@ id<MTLTexture> getOrCreateEmptyTexture(MetalContext* context) {
 }
 
 bool isInRenderPass(MetalContext* context) {
-    return context->currentRenderPassEncoder != nil;
+    return context->currentRenderPassEncoder != nil ||
+            context->pendingRenderPassDescriptor != nil ||
+            context->parallelRenderPassEncoder != nil;
+}
+
+id<MTLRenderCommandEncoder> createRenderPassEncoder(MetalContext* context) {
+    id<MTLRenderCommandEncoder> encoder = nil;
+    if (context->parallelRenderPassEncoder) {
+        // Sub-encoders are executed in the order they're created.
+        encoder = [context->parallelRenderPassEncoder renderCommandEncoder];
+    } else {
+        assert(context->pendingRenderPassDescriptor);
+        encoder = [getPendingCommandBuffer(context)
+                renderCommandEncoderWithDescriptor:context->pendingRenderPassDescriptor];
+        context->pendingRenderPassDescriptor = nil;
+    }
+
+    // Filament's default winding is counter clockwise.
+    [encoder setFrontFacingWinding:MTLWindingCounterClockwise];
+    [encoder setViewport:context->currentViewport];
+    return encoder;
+}
+
+id<MTLRenderCommandEncoder> getRenderPassEncoder(MetalContext* context) {
+    if (UTILS_LIKELY(context->currentRenderPassEncoder)) {
+        return context->currentRenderPassEncoder;
+    }
+    if (!context->pendingRenderPassDescriptor && !context->parallelRenderPassEncoder) {
+        return nil;
+    }
+
+    context->currentRenderPassEncoder = createRenderPassEncoder(context);
+
+    // Metal requires a new command encoder for each render pass, and they cannot be reused.
+    // We must bind certain states for each command encoder, so we dirty the states here to force a
+    // rebinding at the first the draw call of this encoder.
+    context->pipelineState.invalidate();
+    context->depthStencilState.invalidate();
+    context->cullModeState.invalidate();
+    context->samplerBindingState.invalidate();
+    return context->currentRenderPassEncoder;
 }
 
 } // namespace metal
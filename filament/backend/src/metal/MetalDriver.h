@@ -18,14 +18,15 @@
 #define TNT_FILAMENT_DRIVER_METALDRIVER_H
 
 #include "private/backend/Driver.h"
+#include "private/backend/HandleAllocator.h"
 #include "DriverBase.h"
 
 #include <utils/compiler.h>
+#include <utils/JobSystem.h>
 #include <utils/Log.h>
 
-#include <tsl/robin_map.h>
-
-#include <mutex>
+#include <memory>
+#include <vector>
 
 namespace filament {
 namespace backend {
@@ -37,6 +38,7 @@ namespace metal {
 struct MetalUniformBuffer;
 struct MetalContext;
 struct MetalProgram;
+struct SubStreamEncoder;
 struct UniformBufferState;
 
 class MetalDriver final : public DriverBase {
@@ -61,6 +63,18 @@ private:
     // Overrides the default implementation by wrapping the call to fn in an @autoreleasepool block.
     void execute(std::function<void(void)> fn) noexcept final;
 
+    bool executeSubStreams(CommandSubStreamRange const* ranges, size_t count) noexcept override;
+
+    // The sub-streams of a group are executed concurrently by jobs of mJobSystem, each encodes
+    // into its own sub-encoder of the render pass' parallel encoder, with its own state, see
+    // executeSubStreams().
+    static constexpr size_t SUB_STREAM_THREAD_COUNT = 3;
+    std::vector<std::unique_ptr<SubStreamEncoder>> mSubStreams;
+    std::unique_ptr<utils::JobSystem> mJobSystem;
+
+    // the encoder of the job currently executing a sub-stream on this thread, if any
+    static UTILS_DECLARE_TLS(SubStreamEncoder*) sSubStream;
+
     /*
      * Driver interface
      */
@@ -84,80 +98,70 @@ private:
      * Memory management
      */
 
-    // Copied from VulkanDriver.h
+    // Handles are stored in the same growable pools as the other backends, see HandleAllocator.
+    // The first segments of the pools only use HANDLE_ARENA_SIZE bytes.
+    static constexpr size_t HANDLE_ARENA_SIZE = 1024 * 1024;
+    HandleAllocator mHandleMap;
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = void*;
-    using HandleMap = tsl::robin_map<HandleBase::HandleId, Blob>;
-    std::mutex mHandleMapMutex;
-    HandleMap mHandleMap;
-    HandleBase::HandleId mNextId = 1;
+    // Size of the ring transient uploads (e.g. texture staging data) are sub-allocated from.
+    static constexpr size_t UPLOAD_RING_SIZE = 8 * 1024 * 1024;
 
     template<typename Dp, typename B>
     Handle<B> alloc_handle() {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        mHandleMap[mNextId] = malloc(sizeof(Dp));
-        return Handle<B>(mNextId++);
+        return Handle<B>(mHandleMap.allocate<Dp>());
     }
 
     template<typename Dp, typename B, typename ... ARGS>
     Handle<B> alloc_and_construct_handle(ARGS&& ... args) {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        Blob blob = mHandleMap[mNextId] = malloc(sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob);
+        const HandleBase::HandleId id = mHandleMap.allocate<Dp>();
+        Dp* addr = mHandleMap.handle_cast<Dp>(id);
         new(addr) Dp(std::forward<ARGS>(args)...);
-        return Handle<B>(mNextId++);
+        return Handle<B>(id);
     }
 
     template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B> handle) noexcept {
+    Dp* handle_cast(HandleAllocator& handleMap, Handle<B> handle) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter.value();
-        return reinterpret_cast<Dp*>(blob);
+        return handleMap.handle_cast<Dp>(handle.getId());
     }
 
     template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
+    const Dp* handle_const_cast(HandleAllocator& handleMap, const Handle<B>& handle) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter.value();
-        return reinterpret_cast<const Dp*>(blob);
+        return handleMap.handle_cast<Dp>(handle.getId());
     }
 
     template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
+    Dp* construct_handle(HandleAllocator& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter.value();
-        Dp* addr = reinterpret_cast<Dp*>(blob);
+        Dp* addr = handleMap.handle_cast<Dp>(handle.getId());
         new(addr) Dp(std::forward<ARGS>(args)...);
         return addr;
     }
 
     template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
+    void destruct_handle(HandleAllocator& handleMap, Handle<B>& handle) noexcept {
         assert(handle);
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter.value();
-        reinterpret_cast<Dp*>(blob)->~Dp();
-        free(blob);
-        handleMap.erase(handle.getId());
+        // Call the destructor and reclaim the storage and the id.
+        Dp* addr = handleMap.handle_cast<Dp>(handle.getId());
+        addr->~Dp();
+        handleMap.deallocate(handle.getId(), addr);
     }
 
+    // Shared by draw() and drawIndirect(), the arguments of the draws are read from 'indirect' if
+    // it's not null.
+    void drawPrimitive(backend::PipelineState const& ps, Handle<HwRenderPrimitive> rph,
+            uint32_t instanceCount, MetalUniformBuffer* indirect, uint32_t offset,
+            uint32_t drawCount);
+
+    // The binary archive of the pipeline states is persisted with the blob functions of the
+    // platform, on macOS 11 and iOS 14 and above.
+    void createBinaryArchive();
+    void saveBinaryArchive();
+
     void enumerateSamplerGroups(const MetalProgram* program,
             const std::function<void(const SamplerGroup::Sampler*, size_t)>& f);
     void enumerateBoundUniformBuffers(const std::function<void(const UniformBufferState&,
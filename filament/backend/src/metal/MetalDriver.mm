@@ -34,6 +34,10 @@
 #include <utils/Log.h>
 #include <utils/Panic.h>
 
+#include <algorithm>
+#include <string>
+#include <thread>
+
 namespace filament {
 namespace backend {
 
@@ -43,6 +47,8 @@ Driver* MetalDriverFactory::create(MetalPlatform* const platform) {
 
 namespace metal {
 
+UTILS_DEFINE_TLS(SubStreamEncoder*) MetalDriver::sSubStream;
+
 UTILS_NOINLINE
 Driver* MetalDriver::create(MetalPlatform* const platform) {
     assert(platform);
@@ -52,14 +58,18 @@ Driver* MetalDriver::create(MetalPlatform* const platform) {
 MetalDriver::MetalDriver(backend::MetalPlatform* platform) noexcept
         : DriverBase(new ConcreteDispatcher<MetalDriver>()),
         mPlatform(*platform),
-        mContext(new MetalContext) {
+        mContext(new MetalContext),
+        // objects larger than the largest pool, like render targets, are allocated on the heap
+        mHandleMap("Handles", HANDLE_ARENA_SIZE, { 32, 96, 256 }) {
     mContext->device = MTLCreateSystemDefaultDevice();
     mContext->commandQueue = [mContext->device newCommandQueue];
     mContext->commandQueue.label = @"Filament";
     mContext->pipelineStateCache.setDevice(mContext->device);
     mContext->depthStencilStateCache.setDevice(mContext->device);
     mContext->samplerStateCache.setDevice(mContext->device);
+    createBinaryArchive();
     mContext->bufferPool = new MetalBufferPool(*mContext);
+    mContext->uploadRing = new MetalRingBuffer(mContext->device, UPLOAD_RING_SIZE);
     mContext->blitter = new MetalBlitter(*mContext);
 
     if (@available(macOS 10.14, iOS 12, *)) {
@@ -83,6 +93,7 @@ MetalDriver::~MetalDriver() noexcept {
     mContext->emptyTexture = nil;
     CFRelease(mContext->textureCache);
     delete mContext->bufferPool;
+    delete mContext->uploadRing;
     delete mContext->blitter;
     delete mContext->timerQueryImpl;
     delete mContext;
@@ -117,6 +128,10 @@ void MetalDriver::execute(std::function<void(void)> fn) noexcept {
 void MetalDriver::setPresentationTime(int64_t monotonic_clock_ns) {
 }
 
+void MetalDriver::setMaxFramesInFlight(uint32_t count) {
+    mContext->maxFramesInFlight = count;
+}
+
 void MetalDriver::endFrame(uint32_t frameId) {
     // If we haven't committed the command buffer (if the frame was canceled), do it now. There may
     // be commands in it (like fence signaling) that need to execute.
@@ -281,6 +296,12 @@ void MetalDriver::createSyncR(Handle<HwSync> sh, int) {
 
 void MetalDriver::createSwapChainR(Handle<HwSwapChain> sch, void* nativeWindow, uint64_t flags) {
     auto* metalLayer = (__bridge CAMetalLayer*) nativeWindow;
+    if (@available(macOS 10.13.2, iOS 11.2, *)) {
+        // one more drawable than frames in flight, so one can be displayed meanwhile. The layer
+        // only supports 2 or 3 drawables.
+        metalLayer.maximumDrawableCount =
+                std::min(std::max(mContext->maxFramesInFlight + 1u, 2u), 3u);
+    }
     construct_handle<MetalSwapChain>(mHandleMap, sch, mContext->device, metalLayer, flags);
 }
 
@@ -419,6 +440,11 @@ void MetalDriver::destroyUniformBuffer(Handle<HwUniformBuffer> ubh) {
             thisUniform.bound = false;
         }
     }
+    for (auto& storageBuffer : mContext->storageBuffers) {
+        if (storageBuffer == ubh) {
+            storageBuffer.clear();
+        }
+    }
 }
 
 void MetalDriver::destroyTexture(Handle<HwTexture> th) {
@@ -478,10 +504,89 @@ void MetalDriver::terminate() {
     mContext->bufferPool->reset();
     mContext->commandQueue = nil;
 
+    saveBinaryArchive();
+
+    mSubStreams.clear();
+    if (mJobSystem) {
+        mJobSystem->emancipate();
+        mJobSystem.reset();
+    }
+
     MetalExternalImage::shutdown(*mContext);
     mContext->blitter->shutdown();
 }
 
+// The binary archive is stored with the blob functions of the platform under this key, followed by
+// the name of the device, since an archive only holds the binaries of the GPU it was created on.
+static constexpr const char BINARY_ARCHIVE_KEY[] = "filament.metal.binaryArchive.";
+
+static std::string getBinaryArchiveKey(id<MTLDevice> device) {
+    return std::string(BINARY_ARCHIVE_KEY) + device.name.UTF8String;
+}
+
+void MetalDriver::createBinaryArchive() {
+    if (!mPlatform.hasBlobFunc()) {
+        return;
+    }
+    if (@available(macOS 11, iOS 14, *)) {
+        MTLBinaryArchiveDescriptor* descriptor = [MTLBinaryArchiveDescriptor new];
+
+        // an archive can only be loaded from a file, the stored one is copied to a temporary file
+        const std::string key = getBinaryArchiveKey(mContext->device);
+        const size_t size = mPlatform.retrieveBlob(key.data(), key.size(), nullptr, 0);
+        if (size) {
+            NSMutableData* data = [NSMutableData dataWithLength:size];
+            NSString* name = [NSUUID UUID].UUIDString;
+            NSURL* url = [NSURL fileURLWithPath:
+                    [NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+            if (mPlatform.retrieveBlob(key.data(), key.size(), data.mutableBytes, size) == size &&
+                    [data writeToURL:url atomically:NO]) {
+                descriptor.url = url;
+            }
+        }
+
+        NSError* error = nil;
+        id<MTLBinaryArchive> archive = [mContext->device newBinaryArchiveWithDescriptor:descriptor
+                                                                                  error:&error];
+        if (!archive && descriptor.url) {
+            // the stored archive can be invalid, start from an empty one then
+            utils::slog.w << "Metal binary archive is invalid." << utils::io::endl;
+            descriptor.url = nil;
+            archive = [mContext->device newBinaryArchiveWithDescriptor:descriptor error:&error];
+        }
+        if (descriptor.url) {
+            [[NSFileManager defaultManager] removeItemAtURL:descriptor.url error:nil];
+        }
+        // pipeline states can be created without an archive
+        mContext->pipelineStateCache.getCreator().binaryArchive = archive;
+    }
+}
+
+void MetalDriver::saveBinaryArchive() {
+    if (@available(macOS 11, iOS 14, *)) {
+        auto& creator = mContext->pipelineStateCache.getCreator();
+        id<MTLBinaryArchive> archive = creator.binaryArchive;
+        creator.binaryArchive = nil;
+        if (!archive) {
+            return;
+        }
+        NSString* name = [NSUUID UUID].UUIDString;
+        NSURL* url = [NSURL fileURLWithPath:
+                [NSTemporaryDirectory() stringByAppendingPathComponent:name]];
+        NSError* error = nil;
+        if ([archive serializeToURL:url error:&error]) {
+            NSData* data = [NSData dataWithContentsOfURL:url];
+            if (data.length) {
+                const std::string key = getBinaryArchiveKey(mContext->device);
+                mPlatform.insertBlob(key.data(), key.size(), data.bytes, data.length);
+            }
+            [[NSFileManager defaultManager] removeItemAtURL:url error:nil];
+        } else {
+            utils::slog.w << "Could not serialize the Metal binary archive." << utils::io::endl;
+        }
+    }
+}
+
 ShaderModel MetalDriver::getShaderModel() const noexcept {
 #if defined(IOS)
     return ShaderModel::GL_ES_30;
@@ -579,12 +684,29 @@ bool MetalDriver::isTextureFormatMipmappable(TextureFormat format) {
     return isMipmappable(format) || isMipmappable(reshaper.getReshapedFormat());
 }
 
+bool MetalDriver::isTextureFormatReshaped(TextureFormat format) {
+    return TextureReshaper::canReshapeTextureFormat(format);
+}
+
 bool MetalDriver::isRenderTargetFormatSupported(TextureFormat format) {
     MTLPixelFormat mtlFormat = getMetalFormat(format);
     // RGB9E5 isn't supported on Mac as a color render target.
     return mtlFormat != MTLPixelFormatInvalid && mtlFormat != MTLPixelFormatRGB9E5Float;
 }
 
+bool MetalDriver::isComputeSupported() {
+    return true;
+}
+
+bool MetalDriver::isDrawIndirectSupported() {
+#if defined(IOS)
+    // Indirect draws need an A9 GPU or newer.
+    return [mContext->device supportsFeatureSet:MTLFeatureSet_iOS_GPUFamily3_v1];
+#else
+    return true;
+#endif
+}
+
 bool MetalDriver::isFrameBufferFetchSupported() {
 #if defined(IOS) && !defined(FILAMENT_IOS_SIMULATOR)
     return true;
@@ -601,16 +723,40 @@ bool MetalDriver::isFrameTimeSupported() {
     return false;
 }
 
+bool MetalDriver::isFoveatedRenderingSupported() {
+    // render passes don't have rasterization rate maps, the foveation parameters are ignored
+    return false;
+}
+
+bool MetalDriver::isMultiviewSupported() {
+    // pipelines don't use vertex amplification, so a draw only renders a single view
+    return false;
+}
+
+uint32_t MetalDriver::getUniformBufferOffsetAlignment() {
+#if defined(IOS)
+    // buffer offsets only need to be 4 bytes aligned on iOS, but keep the float4 alignment
+    return 16;
+#else
+    return 256;
+#endif
+}
+
 math::float2 MetalDriver::getClipSpaceParams() {
     // z-coordinate of clip-space is in [0,w]
     return math::float2{ -0.5f, 0.5f };
 }
 
+void MetalDriver::compilePrograms(CompileCallback callback, void* user) {
+    // shader functions are created with the programs, there is nothing left to compile
+    scheduleCallback(callback, user);
+}
+
 void MetalDriver::updateVertexBuffer(Handle<HwVertexBuffer> vbh, size_t index,
         BufferDescriptor&& data, uint32_t byteOffset) {
     assert(byteOffset == 0);    // TODO: handle byteOffset for vertex buffers
     auto* vb = handle_cast<MetalVertexBuffer>(mHandleMap, vbh);
-    vb->buffers[index]->copyIntoBuffer(data.buffer, data.size);
+    vb->buffers[index]->updateBuffer(data, 0);
     scheduleDestroy(std::move(data));
 }
 
@@ -618,7 +764,7 @@ void MetalDriver::updateIndexBuffer(Handle<HwIndexBuffer> ibh, BufferDescriptor&
         uint32_t byteOffset) {
     assert(byteOffset == 0);    // TODO: handle byteOffset for index buffers
     auto* ib = handle_cast<MetalIndexBuffer>(mHandleMap, ibh);
-    ib->buffer.copyIntoBuffer(data.buffer, data.size);
+    ib->buffer.updateBuffer(data, 0);
     scheduleDestroy(std::move(data));
 }
 
@@ -681,6 +827,19 @@ bool MetalDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapsed
     return mContext->timerQueryImpl->getQueryResult(tq, elapsedTime);
 }
 
+bool MetalDriver::getFrameStatistics(FrameStatistics* statistics) {
+    return false;
+}
+
+bool MetalDriver::getMemoryStatistics(MemoryStatistics* statistics) {
+    *statistics = {};
+    if (@available(macOS 10.13, iOS 11.0, *)) {
+        statistics->allocatedBytes = mContext->device.currentAllocatedSize;
+        return true;
+    }
+    return false;
+}
+
 SyncStatus MetalDriver::getSyncStatus(Handle<HwSync> sh) {
     auto* fence = handle_cast<MetalFence>(mHandleMap, sh);
     FenceStatus status = fence->wait(0);
@@ -692,6 +851,16 @@ SyncStatus MetalDriver::getSyncStatus(Handle<HwSync> sh) {
     return SyncStatus::ERROR;
 }
 
+BufferDescriptor MetalDriver::allocateStaging(size_t size) {
+    return mContext->bufferPool->acquireStaging(size);
+}
+
+intptr_t MetalDriver::getTextureNativeId(Handle<HwTexture> th) {
+    // importTexture() takes ownership of the id<MTLTexture>, so it's returned retained
+    auto tex = handle_cast<MetalTexture>(mHandleMap, th);
+    return tex->texture ? (intptr_t) CFBridgingRetain(tex->texture) : 0;
+}
+
 void MetalDriver::generateMipmaps(Handle<HwTexture> th) {
     ASSERT_PRECONDITION(!isInRenderPass(mContext),
                         "generateMipmaps must be called outside of a render pass.");
@@ -703,6 +872,12 @@ void MetalDriver::generateMipmaps(Handle<HwTexture> th) {
     tex->maxLod = tex->texture.mipmapLevelCount - 1;
 }
 
+void MetalDriver::setMinMaxLevels(Handle<HwTexture> th, uint32_t minLevel, uint32_t maxLevel) {
+    auto tex = handle_cast<MetalTexture>(mHandleMap, th);
+    tex->minLod = minLevel;
+    tex->maxLod = maxLevel;
+}
+
 bool MetalDriver::canGenerateMipmaps() {
     return true;
 }
@@ -715,7 +890,19 @@ void MetalDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh,
 
     auto uniform = handle_cast<MetalUniformBuffer>(mHandleMap, ubh);
 
-    uniform->buffer.copyIntoBuffer(data.buffer, data.size);
+    uniform->buffer.updateBuffer(data, 0);
+    scheduleDestroy(std::move(data));
+}
+
+void MetalDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh,
+        BufferDescriptor&& data, uint32_t byteOffset) {
+    if (data.size <= 0) {
+       return;
+    }
+
+    auto uniform = handle_cast<MetalUniformBuffer>(mHandleMap, ubh);
+
+    uniform->buffer.updateBuffer(data, byteOffset);
     scheduleDestroy(std::move(data));
 }
 
@@ -734,17 +921,14 @@ void MetalDriver::beginRenderPass(Handle<HwRenderTarget> rth,
     MTLRenderPassDescriptor* descriptor = [MTLRenderPassDescriptor renderPassDescriptor];
     renderTarget->setUpRenderPassAttachments(descriptor, params);
 
-    mContext->currentRenderPassEncoder =
-            [getPendingCommandBuffer(mContext) renderCommandEncoderWithDescriptor:descriptor];
-
-    // Filament's default winding is counter clockwise.
-    [mContext->currentRenderPassEncoder setFrontFacingWinding:MTLWindingCounterClockwise];
+    // The encoder is created by the first command of the render pass, see getRenderPassEncoder().
+    mContext->pendingRenderPassDescriptor = descriptor;
 
     // Flip the viewport, because Metal's screen space is vertically flipped that of Filament's.
     NSInteger renderTargetHeight =
             mContext->currentRenderTarget->isDefaultRenderTarget() ?
             mContext->currentSurface->getSurfaceHeight() : mContext->currentRenderTarget->height;
-    MTLViewport metalViewport {
+    mContext->currentViewport = MTLViewport {
             .originX = static_cast<double>(params.viewport.left),
             .originY = renderTargetHeight - static_cast<double>(params.viewport.bottom) -
                        static_cast<double>(params.viewport.height),
@@ -753,24 +937,99 @@ void MetalDriver::beginRenderPass(Handle<HwRenderTarget> rth,
             .znear = static_cast<double>(params.depthRange.near),
             .zfar = static_cast<double>(params.depthRange.far)
     };
-    [mContext->currentRenderPassEncoder setViewport:metalViewport];
-
-    // Metal requires a new command encoder for each render pass, and they cannot be reused.
-    // We must bind certain states for each command encoder, so we dirty the states here to force a
-    // rebinding at the first the draw call of this pass.
-    mContext->pipelineState.invalidate();
-    mContext->depthStencilState.invalidate();
-    mContext->cullModeState.invalidate();
 }
 
 void MetalDriver::nextSubpass(int dummy) {}
 
+bool MetalDriver::executeSubStreams(CommandSubStreamRange const* ranges, size_t count) noexcept {
+    // A parallel encoder can only be used if the render pass has no regular encoder yet, i.e. if
+    // the sub-streams come first in the render pass, or follow another group.
+    const size_t hardwareThreadCount = std::thread::hardware_concurrency();
+    if ((!mContext->pendingRenderPassDescriptor && !mContext->parallelRenderPassEncoder) ||
+            count < 2 || hardwareThreadCount < 2) {
+        return false;
+    }
+
+    if (mContext->pendingRenderPassDescriptor) {
+        mContext->parallelRenderPassEncoder = [getPendingCommandBuffer(mContext)
+                parallelRenderCommandEncoderWithDescriptor:mContext->pendingRenderPassDescriptor];
+        mContext->pendingRenderPassDescriptor = nil;
+    }
+
+    // The draws of the driver thread that precede the group are in their own sub-encoder, the
+    // ones that follow it get a new one, see getRenderPassEncoder().
+    [mContext->currentRenderPassEncoder endEncoding];
+    mContext->currentRenderPassEncoder = nil;
+
+    if (!mJobSystem) {
+        // the driver thread takes part in the recording, the job system only needs a few threads
+        const size_t threadCount = std::max(size_t(1),
+                std::min(SUB_STREAM_THREAD_COUNT, hardwareThreadCount / 2));
+        mJobSystem.reset(new utils::JobSystem(threadCount));
+        mJobSystem->adopt();
+    }
+    while (mSubStreams.size() < count) {
+        mSubStreams.emplace_back(new SubStreamEncoder());
+    }
+
+    // Created lazily by draws, this must not happen concurrently.
+    getOrCreateEmptyTexture(mContext);
+
+    // Sub-encoders are created in the order of the sub-streams, which is the order they're
+    // executed in, and each sub-stream starts with the bindings of the driver thread.
+    for (size_t i = 0; i < count; i++) {
+        SubStreamEncoder& e = *mSubStreams[i];
+        e.encoder = createRenderPassEncoder(mContext);
+        e.pipelineState.invalidate();
+        e.depthStencilState.invalidate();
+        e.cullModeState.invalidate();
+        e.samplerBindingState.invalidate();
+        std::copy(std::begin(mContext->uniformState), std::end(mContext->uniformState),
+                std::begin(e.uniformState));
+        std::copy(std::begin(mContext->samplerBindings), std::end(mContext->samplerBindings),
+                std::begin(e.samplerBindings));
+    }
+
+    utils::JobSystem& js = *mJobSystem;
+    utils::JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < count; i++) {
+        SubStreamEncoder& e = *mSubStreams[i];
+        CommandSubStreamRange const range = ranges[i];
+        js.run(js.createJob(parent, [this, &e, range](utils::JobSystem&, utils::JobSystem::Job*) {
+            @autoreleasepool {
+                sSubStream = &e;
+                CommandStream::execute(*this, range);
+                sSubStream = nullptr;
+            }
+        }));
+    }
+    js.runAndWait(parent);
+
+    for (size_t i = 0; i < count; i++) {
+        SubStreamEncoder& e = *mSubStreams[i];
+        [e.encoder endEncoding];
+        e.encoder = nil;
+        // Don't hold on to the textures of the last draw.
+        e.samplerBindingState = {};
+    }
+    return true;
+}
+
 void MetalDriver::endRenderPass(int dummy) {
+    // A render pass without draws still needs an encoder for its load and store actions.
+    if (mContext->pendingRenderPassDescriptor) {
+        getRenderPassEncoder(mContext);
+    }
     [mContext->currentRenderPassEncoder endEncoding];
+    [mContext->parallelRenderPassEncoder endEncoding];
 
-    // Command encoders are one time use. Set it to nil to release the encoder and ensure we don't
-    // accidentally use it again.
+    // Command encoders are one time use. Set them to nil to release the encoders and ensure we
+    // don't accidentally use them again.
     mContext->currentRenderPassEncoder = nil;
+    mContext->parallelRenderPassEncoder = nil;
+
+    // Don't hold on to the textures of the last draw.
+    mContext->samplerBindingState = {};
 }
 
 void MetalDriver::setRenderPrimitiveBuffer(Handle<HwRenderPrimitive> rph,
@@ -809,7 +1068,8 @@ void MetalDriver::commit(Handle<HwSwapChain> sch) {
 }
 
 void MetalDriver::bindUniformBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
-    mContext->uniformState[index] = UniformBufferState {
+    SubStreamEncoder* const subStream = sSubStream;
+    (subStream ? subStream->uniformState : mContext->uniformState)[index] = UniformBufferState {
         .bound = true,
         .ubh = ubh,
         .offset = 0
@@ -818,7 +1078,8 @@ void MetalDriver::bindUniformBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
 
 void MetalDriver::bindUniformBufferRange(size_t index, Handle<HwUniformBuffer> ubh,
         size_t offset, size_t size) {
-    mContext->uniformState[index] = UniformBufferState {
+    SubStreamEncoder* const subStream = sSubStream;
+    (subStream ? subStream->uniformState : mContext->uniformState)[index] = UniformBufferState {
         .bound = true,
         .ubh = ubh,
         .offset = offset
@@ -827,7 +1088,31 @@ void MetalDriver::bindUniformBufferRange(size_t index, Handle<HwUniformBuffer> u
 
 void MetalDriver::bindSamplers(size_t index, Handle<HwSamplerGroup> sbh) {
     auto sb = handle_cast<MetalSamplerGroup>(mHandleMap, sbh);
-    mContext->samplerBindings[index] = sb;
+    SubStreamEncoder* const subStream = sSubStream;
+    (subStream ? subStream->samplerBindings : mContext->samplerBindings)[index] = sb;
+}
+
+void MetalDriver::bindStorageBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
+    ASSERT_PRECONDITION(index < STORAGE_BINDING_COUNT, "Storage buffer index too large.");
+    if (ubh) {
+        // the writes of the shaders to a buffer in CPU memory would be lost
+        handle_cast<MetalUniformBuffer>(mHandleMap, ubh)->buffer.makeGpuBuffer();
+    }
+    mContext->storageBuffers[index] = ubh;
+}
+
+void MetalDriver::bindImage(size_t index, Handle<HwTexture> th, uint8_t level) {
+    ASSERT_PRECONDITION(index < STORAGE_BINDING_COUNT, "Image index too large.");
+    auto texture = handle_cast<MetalTexture>(mHandleMap, th);
+    assert(any(texture->usage & TextureUsage::STORAGE));
+    id<MTLTexture> image = texture->texture;
+    if (level > 0) {
+        image = [image newTextureViewWithPixelFormat:image.pixelFormat
+                                         textureType:image.textureType
+                                              levels:NSMakeRange(level, 1)
+                                              slices:NSMakeRange(0, image.arrayLength)];
+    }
+    mContext->images[index] = image;
 }
 
 void MetalDriver::insertEventMarker(const char* string, size_t len) {
@@ -1047,9 +1332,36 @@ void MetalDriver::blit(TargetBufferFlags buffers,
     mContext->blitter->blit(getPendingCommandBuffer(mContext), args);
 }
 
-void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph) {
-    ASSERT_PRECONDITION(mContext->currentRenderPassEncoder != nullptr,
-            "Attempted to draw without a valid command encoder.");
+void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
+    drawPrimitive(ps, rph, instanceCount, nullptr, 0, 0);
+}
+
+void MetalDriver::drawIndirect(backend::PipelineState ps, Handle<HwRenderPrimitive> rph,
+        Handle<HwUniformBuffer> indirect, uint32_t offset, uint32_t drawCount) {
+    auto uniform = handle_cast<MetalUniformBuffer>(mHandleMap, indirect);
+    assert(offset + drawCount * sizeof(DrawIndirectCommand) <= uniform->buffer.getSize());
+    if (UTILS_UNLIKELY(!drawCount)) {
+        return;
+    }
+    drawPrimitive(ps, rph, 0, uniform, offset, drawCount);
+}
+
+void MetalDriver::drawPrimitive(backend::PipelineState const& ps, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount, MetalUniformBuffer* indirect, uint32_t offset,
+        uint32_t drawCount) {
+    // The threads recording sub-streams each use their own encoder and state.
+    SubStreamEncoder* const subStream = sSubStream;
+    id<MTLRenderCommandEncoder> encoder =
+            subStream ? subStream->encoder : getRenderPassEncoder(mContext);
+    ASSERT_PRECONDITION(encoder != nil, "Attempted to draw without a valid command encoder.");
+    auto& pipelineStateTracker = subStream ? subStream->pipelineState : mContext->pipelineState;
+    auto& cullModeStateTracker = subStream ? subStream->cullModeState : mContext->cullModeState;
+    auto& depthStencilStateTracker =
+            subStream ? subStream->depthStencilState : mContext->depthStencilState;
+    auto& samplerBindingStateTracker =
+            subStream ? subStream->samplerBindingState : mContext->samplerBindingState;
+
     auto primitive = handle_cast<MetalRenderPrimitive>(mHandleMap, rph);
     auto program = handle_cast<MetalProgram>(mHandleMap, ps.program);
     const auto& rs = ps.rasterState;
@@ -1100,19 +1412,19 @@ void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph)
         },
         .colorWrite = rs.colorWrite
     };
-    mContext->pipelineState.updateState(pipelineState);
-    if (mContext->pipelineState.stateChanged()) {
+    pipelineStateTracker.updateState(pipelineState);
+    if (pipelineStateTracker.stateChanged()) {
         id<MTLRenderPipelineState> pipeline =
                 mContext->pipelineStateCache.getOrCreateState(pipelineState);
         assert(pipeline != nil);
-        [mContext->currentRenderPassEncoder setRenderPipelineState:pipeline];
+        [encoder setRenderPipelineState:pipeline];
     }
 
     // Cull mode
     MTLCullMode cullMode = getMetalCullMode(rs.culling);
-    mContext->cullModeState.updateState(cullMode);
-    if (mContext->cullModeState.stateChanged()) {
-        [mContext->currentRenderPassEncoder setCullMode:cullMode];
+    cullModeStateTracker.updateState(cullMode);
+    if (cullModeStateTracker.stateChanged()) {
+        [encoder setCullMode:cullMode];
     }
 
     // Set the depth-stencil state, if a state change is needed.
@@ -1120,18 +1432,18 @@ void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph)
         .compareFunction = getMetalCompareFunction(rs.depthFunc),
         .depthWriteEnabled = rs.depthWrite,
     };
-    mContext->depthStencilState.updateState(depthState);
-    if (mContext->depthStencilState.stateChanged()) {
+    depthStencilStateTracker.updateState(depthState);
+    if (depthStencilStateTracker.stateChanged()) {
         id<MTLDepthStencilState> state =
                 mContext->depthStencilStateCache.getOrCreateState(depthState);
         assert(state != nil);
-        [mContext->currentRenderPassEncoder setDepthStencilState:state];
+        [encoder setDepthStencilState:state];
     }
 
     if (ps.polygonOffset.constant != 0.0 || ps.polygonOffset.slope != 0.0) {
-        [mContext->currentRenderPassEncoder setDepthBias:ps.polygonOffset.constant
-                                              slopeScale:ps.polygonOffset.slope
-                                                   clamp:0.0];
+        [encoder setDepthBias:ps.polygonOffset.constant
+                   slopeScale:ps.polygonOffset.slope
+                        clamp:0.0];
     }
 
     // FIXME: implement take ps.scissor into account
@@ -1146,15 +1458,16 @@ void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph)
         uniformsToBind[index] = &uniform->buffer;
         offsets[index] = state.offset;
     });
-    MetalBuffer::bindBuffers(getPendingCommandBuffer(mContext), mContext->currentRenderPassEncoder,
+    MetalBuffer::bindBuffers(getPendingCommandBuffer(mContext), encoder,
             0, MetalBuffer::Stage::VERTEX | MetalBuffer::Stage::FRAGMENT, uniformsToBind, offsets,
             Program::UNIFORM_BINDING_COUNT);
 
     // Enumerate all the sampler buffers for the program and check which textures and samplers need
     // to be bound.
 
-    id<MTLTexture> texturesToBind[SAMPLER_BINDING_COUNT] = {};
-    id<MTLSamplerState> samplersToBind[SAMPLER_BINDING_COUNT] = {};
+    SamplerBindingState samplerBindings;
+    auto& texturesToBind = samplerBindings.textures;
+    auto& samplersToBind = samplerBindings.samplers;
 
     enumerateSamplerGroups(program, [this, &texturesToBind, &samplersToBind](
             const SamplerGroup::Sampler* sampler,
@@ -1195,38 +1508,84 @@ void MetalDriver::draw(backend::PipelineState ps, Handle<HwRenderPrimitive> rph)
     }
 
     // Similar to uniforms, we can't tell which stage will use the textures / samplers, so bind
-    // to both the vertex and fragment stages.
-
-    NSRange samplerRange = NSMakeRange(0, SAMPLER_BINDING_COUNT);
-    [mContext->currentRenderPassEncoder setFragmentTextures:texturesToBind
-                                                  withRange:samplerRange];
-    [mContext->currentRenderPassEncoder setVertexTextures:texturesToBind
-                                                withRange:samplerRange];
-    [mContext->currentRenderPassEncoder setFragmentSamplerStates:samplersToBind
-                                                       withRange:samplerRange];
-    [mContext->currentRenderPassEncoder setVertexSamplerStates:samplersToBind
-                                                     withRange:samplerRange];
+    // to both the vertex and fragment stages. Consecutive draws typically share most of their
+    // samplers (e.g. draws of the same material), so they're only bound when they change.
+
+    samplerBindingStateTracker.updateState(samplerBindings);
+    if (samplerBindingStateTracker.stateChanged()) {
+        NSRange samplerRange = NSMakeRange(0, SAMPLER_BINDING_COUNT);
+        [encoder setFragmentTextures:texturesToBind
+                           withRange:samplerRange];
+        [encoder setVertexTextures:texturesToBind
+                         withRange:samplerRange];
+        [encoder setFragmentSamplerStates:samplersToBind
+                                withRange:samplerRange];
+        [encoder setVertexSamplerStates:samplersToBind
+                              withRange:samplerRange];
+    }
 
     // Bind the vertex buffers.
-    MetalBuffer::bindBuffers(getPendingCommandBuffer(mContext), mContext->currentRenderPassEncoder,
+    MetalBuffer::bindBuffers(getPendingCommandBuffer(mContext), encoder,
             VERTEX_BUFFER_START, MetalBuffer::Stage::VERTEX, primitive->buffers.data(),
             primitive->offsets.data(), primitive->buffers.size());
 
     // Bind the zero buffer, used for missing vertex attributes.
     static const char bytes[16] = { 0 };
-    [mContext->currentRenderPassEncoder setVertexBytes:bytes
-                                                length:16
-                                               atIndex:(VERTEX_BUFFER_START + ZERO_VERTEX_BUFFER)];
+    [encoder setVertexBytes:bytes
+                     length:16
+                    atIndex:(VERTEX_BUFFER_START + ZERO_VERTEX_BUFFER)];
 
     MetalIndexBuffer* indexBuffer = primitive->indexBuffer;
 
     id<MTLCommandBuffer> cmdBuffer = getPendingCommandBuffer(mContext);
     id<MTLBuffer> metalIndexBuffer = indexBuffer->buffer.getGpuBufferForDraw(cmdBuffer);
-    [mContext->currentRenderPassEncoder drawIndexedPrimitives:getMetalPrimitiveType(primitive->type)
-                                                   indexCount:primitive->count
-                                                    indexType:getIndexType(indexBuffer->elementSize)
-                                                  indexBuffer:metalIndexBuffer
-                                            indexBufferOffset:primitive->offset];
+
+    if (indirect) {
+        // DrawIndirectCommand has the layout of MTLDrawIndexedPrimitivesIndirectArguments, and
+        // the index range of each draw is relative to the start of the index buffer.
+        static_assert(sizeof(DrawIndirectCommand) ==
+                sizeof(MTLDrawIndexedPrimitivesIndirectArguments),
+                "DrawIndirectCommand must match MTLDrawIndexedPrimitivesIndirectArguments");
+        const MTLPrimitiveType primitiveType = getMetalPrimitiveType(primitive->type);
+        const MTLIndexType indexType = getIndexType(indexBuffer->elementSize);
+        id<MTLBuffer> indirectBuffer = indirect->buffer.getGpuBufferForDraw(cmdBuffer);
+        if (!indirectBuffer) {
+            // Small buffers live in CPU memory, so the arguments can only have been loaded by the
+            // CPU, they're read here.
+            auto const* args = reinterpret_cast<DrawIndirectCommand const*>(
+                    static_cast<uint8_t const*>(indirect->buffer.getCpuBuffer()) + offset);
+            for (uint32_t i = 0; i < drawCount; i++) {
+                if (!args[i].indexCount || !args[i].instanceCount) {
+                    continue;
+                }
+                [encoder drawIndexedPrimitives:primitiveType
+                                    indexCount:args[i].indexCount
+                                     indexType:indexType
+                                   indexBuffer:metalIndexBuffer
+                             indexBufferOffset:args[i].firstIndex * indexBuffer->elementSize
+                                 instanceCount:args[i].instanceCount
+                                    baseVertex:args[i].baseVertex
+                                  baseInstance:args[i].baseInstance];
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < drawCount; i++) {
+            [encoder drawIndexedPrimitives:primitiveType
+                                 indexType:indexType
+                               indexBuffer:metalIndexBuffer
+                         indexBufferOffset:0
+                            indirectBuffer:indirectBuffer
+                      indirectBufferOffset:offset + i * sizeof(DrawIndirectCommand)];
+        }
+        return;
+    }
+
+    [encoder drawIndexedPrimitives:getMetalPrimitiveType(primitive->type)
+                        indexCount:primitive->count
+                         indexType:getIndexType(indexBuffer->elementSize)
+                       indexBuffer:metalIndexBuffer
+                 indexBufferOffset:primitive->offset
+                     instanceCount:instanceCount];
 }
 
 void MetalDriver::beginTimerQuery(Handle<HwTimerQuery> tqh) {
@@ -1246,12 +1605,14 @@ void MetalDriver::endTimerQuery(Handle<HwTimerQuery> tqh) {
 void MetalDriver::enumerateSamplerGroups(
         const MetalProgram* program,
         const std::function<void(const SamplerGroup::Sampler*, size_t)>& f) {
+    SubStreamEncoder* const subStream = sSubStream;
+    auto const& samplerBindings = subStream ? subStream->samplerBindings : mContext->samplerBindings;
     for (uint8_t samplerGroupIdx = 0; samplerGroupIdx < SAMPLER_GROUP_COUNT; samplerGroupIdx++) {
         const auto& samplerGroup = program->samplerGroupInfo[samplerGroupIdx];
         if (samplerGroup.empty()) {
             continue;
         }
-        const auto* metalSamplerGroup = mContext->samplerBindings[samplerGroupIdx];
+        const auto* metalSamplerGroup = samplerBindings[samplerGroupIdx];
         if (!metalSamplerGroup) {
             utils::slog.w << "Program has non-empty samplerGroup (index " << samplerGroupIdx <<
                     ") but has not bound any samplers." << utils::io::endl;
@@ -1274,10 +1635,73 @@ void MetalDriver::enumerateSamplerGroups(
     }
 }
 
+void MetalDriver::dispatch(Handle<HwProgram> ph, math::uint3 groupCount) {
+    ASSERT_PRECONDITION(!isInRenderPass(mContext),
+            "Dispatches can't occur within a render pass.");
+    auto program = handle_cast<MetalProgram>(mHandleMap, ph);
+    if (UTILS_UNLIKELY(!program->isValid || program->computeFunction == nil)) {
+        utils::slog.e << "Dispatching a program without compute shader: "
+                << program->name.c_str() << utils::io::endl;
+        return;
+    }
+
+    if (UTILS_UNLIKELY(program->computePipeline == nil)) {
+        NSError* error = nil;
+        program->computePipeline =
+                [mContext->device newComputePipelineStateWithFunction:program->computeFunction
+                                                                error:&error];
+        if (program->computePipeline == nil) {
+            if (error) {
+                auto description =
+                        [error.localizedDescription cStringUsingEncoding:NSUTF8StringEncoding];
+                utils::slog.e << description << utils::io::endl;
+            }
+            return;
+        }
+    }
+
+    id<MTLCommandBuffer> cmdBuffer = getPendingCommandBuffer(mContext);
+    id<MTLComputeCommandEncoder> encoder = [cmdBuffer computeCommandEncoder];
+    [encoder setComputePipelineState:program->computePipeline];
+
+    // storage buffers always have a device allocation, see bindStorageBuffer()
+    for (uint32_t i = 0; i < STORAGE_BINDING_COUNT; i++) {
+        if (mContext->storageBuffers[i]) {
+            auto* storage = handle_cast<MetalUniformBuffer>(mHandleMap, mContext->storageBuffers[i]);
+            id<MTLBuffer> gpuBuffer = storage->buffer.getGpuBufferForDraw(cmdBuffer);
+            assert(gpuBuffer);
+            [encoder setBuffer:gpuBuffer offset:0 atIndex:STORAGE_BUFFER_START + i];
+        }
+    }
+    [encoder setTextures:mContext->images withRange:NSMakeRange(0, STORAGE_BINDING_COUNT)];
+
+    const math::uint3 size = program->workGroupSize;
+    [encoder dispatchThreadgroups:MTLSizeMake(groupCount.x, groupCount.y, groupCount.z)
+            threadsPerThreadgroup:MTLSizeMake(size.x, size.y, size.z)];
+    [encoder endEncoding];
+}
+
+void MetalDriver::memoryBarrier(MemoryBarrierFlags flags) {
+    // Metal tracks the hazards between the encoders of a command buffer, and each dispatch has
+    // its own encoder, so there is nothing to do here.
+}
+
+void MetalDriver::beginAsyncCompute(int dummy) {
+    // The compute encoders are in the frame's command buffer, they're executed in order.
+}
+
+void MetalDriver::endAsyncCompute(int dummy) {
+}
+
+void MetalDriver::waitAsyncCompute(int dummy) {
+}
+
 void MetalDriver::enumerateBoundUniformBuffers(
         const std::function<void(const UniformBufferState&, MetalUniformBuffer*, uint32_t)>& f) {
+    SubStreamEncoder* const subStream = sSubStream;
+    auto const& uniformState = subStream ? subStream->uniformState : mContext->uniformState;
     for (uint32_t i = 0; i < Program::UNIFORM_BINDING_COUNT; i++) {
-        auto& thisUniform = mContext->uniformState[i];
+        auto& thisUniform = uniformState[i];
         if (!thisUniform.bound) {
             continue;
         }
@@ -114,6 +114,9 @@ struct MetalProgram : public HwProgram {
 
     id<MTLFunction> vertexFunction;
     id<MTLFunction> fragmentFunction;
+    id<MTLFunction> computeFunction;
+    id<MTLComputePipelineState> computePipeline = nil;  // created by the first dispatch()
+    math::uint3 workGroupSize;
     Program::SamplerGroupInfo samplerGroupInfo;
     bool isValid = false;
 };
@@ -25,6 +25,9 @@
 #include <utils/Panic.h>
 #include <utils/trap.h>
 
+#include <type_traits>
+#include <variant>
+
 #include <math.h>
 
 namespace filament {
@@ -42,6 +45,9 @@ static inline MTLTextureUsage getMetalTextureUsage(TextureUsage usage) {
     if (any(usage & TextureUsage::STENCIL_ATTACHMENT)) {
         u |= MTLTextureUsageRenderTarget;
     }
+    if (any(usage & TextureUsage::STORAGE)) {
+        u |= MTLTextureUsageShaderWrite;
+    }
 
     // All textures can be blitted from, so they must have the UsageShaderRead flag.
     u |= MTLTextureUsageShaderRead;
@@ -164,14 +170,30 @@ void MetalRenderPrimitive::setBuffers(MetalVertexBuffer* vertexBuffer, MetalInde
     };
 }
 
+static void setFunctionConstant(MTLFunctionConstantValues* constants,
+        Program::SpecializationConstant const& constant) noexcept {
+    std::visit([constants, index = constant.id](auto value) {
+        using T = decltype(value);
+        MTLDataType type = MTLDataTypeInt;
+        if constexpr (std::is_same_v<T, bool>) {
+            type = MTLDataTypeBool;
+        } else if constexpr (std::is_same_v<T, float>) {
+            type = MTLDataTypeFloat;
+        }
+        [constants setConstantValue:&value type:type atIndex:index];
+    }, constant.value);
+}
+
 MetalProgram::MetalProgram(id<MTLDevice> device, const Program& program) noexcept
-    : HwProgram(program.getName()), vertexFunction(nil), fragmentFunction(nil), samplerGroupInfo(),
+    : HwProgram(program.getName()), vertexFunction(nil), fragmentFunction(nil),
+        computeFunction(nil), workGroupSize(program.getWorkGroupSize()), samplerGroupInfo(),
         isValid(false) {
 
     using MetalFunctionPtr = __strong id<MTLFunction>*;
 
-    static_assert(Program::SHADER_TYPE_COUNT == 2, "Only vertex and fragment shaders expected.");
-    MetalFunctionPtr shaderFunctions[2] = { &vertexFunction, &fragmentFunction };
+    static_assert(Program::SHADER_TYPE_COUNT == 3,
+            "Only vertex, fragment and compute shaders expected.");
+    MetalFunctionPtr shaderFunctions[3] = { &vertexFunction, &fragmentFunction, &computeFunction };
 
     const auto& sources = program.getShadersSource();
     for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
@@ -200,7 +222,28 @@ MetalProgram::MetalProgram(id<MTLDevice> device, const Program& program) noexcep
             return;
         }
 
-        *shaderFunctions[i] = [library newFunctionWithName:@"main0"];
+        auto const& specConstants = program.getSpecializationConstants();
+        if (specConstants.empty()) {
+            *shaderFunctions[i] = [library newFunctionWithName:@"main0"];
+        } else {
+            // SPIRV-Cross turns the specialization constants into function constants
+            MTLFunctionConstantValues* constants = [MTLFunctionConstantValues new];
+            for (auto const& constant : specConstants) {
+                setFunctionConstant(constants, constant);
+            }
+            *shaderFunctions[i] = [library newFunctionWithName:@"main0"
+                                                constantValues:constants
+                                                         error:&error];
+            if (*shaderFunctions[i] == nil) {
+                if (error) {
+                    auto description =
+                            [error.localizedDescription cStringUsingEncoding:NSUTF8StringEncoding];
+                    utils::slog.w << description << utils::io::endl;
+                }
+                PANIC_LOG("Failed to specialize Metal program.");
+                return;
+            }
+        }
     }
 
     // All stages of the program have compiled successfuly, this is a valid program.
@@ -342,7 +385,7 @@ void MetalTexture::load2DImage(uint32_t level, uint32_t xoffset, uint32_t yoffse
         uint32_t height, PixelBufferDescriptor& p) noexcept {
     PixelBufferDescriptor* data = &p;
     PixelBufferDescriptor reshapedData;
-    if (UTILS_UNLIKELY(reshaper.needsReshaping())) {
+    if (UTILS_UNLIKELY(reshaper.needsReshaping(p))) {
         reshapedData = reshaper.reshape(p);
         data = &reshapedData;
     }
@@ -377,7 +420,7 @@ void MetalTexture::loadCubeImage(const FaceOffsets& faceOffsets, int miplevel,
         PixelBufferDescriptor& p) {
     PixelBufferDescriptor* data = &p;
     PixelBufferDescriptor reshapedData;
-    if (UTILS_UNLIKELY(reshaper.needsReshaping())) {
+    if (UTILS_UNLIKELY(reshaper.needsReshaping(p))) {
         reshapedData = reshaper.reshape(p);
         data = &reshapedData;
     }
@@ -434,12 +477,20 @@ void MetalTexture::loadSlice(uint32_t level, uint32_t xoffset, uint32_t yoffset,
         deviceMaxBufferLength = context.device.maxBufferLength;
     }
     if (UTILS_LIKELY(stagingBufferSize <= deviceMaxBufferLength)) {
-        auto entry = context.bufferPool->acquireBuffer(stagingBufferSize);
-        memcpy(entry->buffer.contents,
+        // Staging data is sub-allocated from the upload ring when there's room, otherwise it gets
+        // its own buffer from the pool.
+        MetalRingBuffer::Allocation staging =
+                context.uploadRing->allocate(stagingBufferSize, blitCommandBuffer);
+        MetalBufferPoolEntry const* entry = nullptr;
+        if (!staging.buffer) {
+            entry = context.bufferPool->acquireBuffer(stagingBufferSize);
+            staging = { entry->buffer, 0 };
+        }
+        memcpy(static_cast<uint8_t*>(staging.buffer.contents) + staging.offset,
                 static_cast<uint8_t*>(data.buffer) + sourceOffset,
                 stagingBufferSize);
-        [blitCommandEncoder copyFromBuffer:entry->buffer
-                              sourceOffset:0
+        [blitCommandEncoder copyFromBuffer:staging.buffer
+                              sourceOffset:staging.offset
                          sourceBytesPerRow:bytesPerRow
                        sourceBytesPerImage:bytesPerSlice
                                 sourceSize:MTLSizeMake(width, height, depth)
@@ -450,10 +501,12 @@ void MetalTexture::loadSlice(uint32_t level, uint32_t xoffset, uint32_t yoffset,
         // We must ensure we only capture a pointer to bufferPool, not "this", as this texture could
         // be deallocated before the completion handler runs. The MetalBufferPool is guaranteed to
         // outlive the completion handler.
-        MetalBufferPool* bufferPool = this->context.bufferPool;
-        [blitCommandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
-            bufferPool->releaseBuffer(entry);
-        }];
+        if (entry) {
+            MetalBufferPool* bufferPool = this->context.bufferPool;
+            [blitCommandBuffer addCompletedHandler:^(id<MTLCommandBuffer> cb) {
+                bufferPool->releaseBuffer(entry);
+            }];
+        }
     } else {
         // The texture is too large to fit into a single buffer, create a staging texture instead.
         MTLTextureDescriptor* descriptor =
@@ -25,6 +25,7 @@
 #include <backend/DriverEnums.h>
 
 #include <memory>
+#include <mutex>
 #include <tsl/robin_map.h>
 #include <utils/Hash.h>
 
@@ -42,6 +43,11 @@ static constexpr uint32_t SAMPLER_GROUP_COUNT = Program::UNIFORM_BINDING_COUNT;
 static constexpr uint32_t SAMPLER_BINDING_COUNT = backend::MAX_SAMPLER_COUNT;
 static constexpr uint32_t VERTEX_BUFFER_START = Program::UNIFORM_BINDING_COUNT;
 
+// Compute programs bind their storage buffers after the uniform buffers, and their storage images
+// at the index they're bound to.
+static constexpr uint32_t STORAGE_BINDING_COUNT = 8;
+static constexpr uint32_t STORAGE_BUFFER_START = Program::UNIFORM_BINDING_COUNT;
+
 // The "zero" buffer is a small buffer for missing attributes that resides in the vertex slot
 // immediately following any user-provided vertex buffers.
 static constexpr uint32_t ZERO_VERTEX_BUFFER = MAX_VERTEX_ATTRIBUTE_COUNT;
@@ -143,7 +149,12 @@ public:
 
     void setDevice(id<MTLDevice> device) noexcept { mDevice = device; }
 
+    StateCreator& getCreator() noexcept { return creator; }
+
+    // Can be called concurrently by the threads recording the sub-streams of a render pass.
     MetalType getOrCreateState(const StateType& state) noexcept {
+        std::lock_guard<std::mutex> lock(mMutex);
+
         // Check if a valid state already exists in the cache.
         auto iter = mStateCache.find(state);
         if (UTILS_LIKELY(iter != mStateCache.end())) {
@@ -169,6 +180,7 @@ private:
 
     using HashFn = utils::hash::MurmurHashFn<StateType>;
     tsl::robin_map<StateType, MetalType, HashFn> mStateCache;
+    std::mutex mMutex;
 
 };
 
@@ -249,6 +261,11 @@ static_assert(sizeof(PipelineState) == 656, "PipelineState unexpected size.");
 struct PipelineStateCreator {
     id<MTLRenderPipelineState> operator()(id<MTLDevice> device, const PipelineState& state)
             noexcept;
+
+    // When set, pipelines are looked up in this archive before being compiled, and the new ones
+    // are added to it. Only accessed under the lock of the PipelineStateCache.
+    API_AVAILABLE(macos(11.0), ios(14.0))
+    id<MTLBinaryArchive> binaryArchive = nil;
 };
 
 using PipelineStateTracker = StateTracker<PipelineState>;
@@ -336,6 +353,28 @@ struct SamplerStateCreator {
 
 using SamplerStateCache = StateCache<SamplerState, id<MTLSamplerState>, SamplerStateCreator>;
 
+// Textures and sampler states bound to the vertex and fragment stages of an encoder
+
+struct SamplerBindingState {
+    id<MTLTexture> textures[SAMPLER_BINDING_COUNT] = {};
+    id<MTLSamplerState> samplers[SAMPLER_BINDING_COUNT] = {};
+
+    bool operator==(const SamplerBindingState& rhs) const noexcept {
+        for (size_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
+            if (this->textures[i] != rhs.textures[i] || this->samplers[i] != rhs.samplers[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool operator!=(const SamplerBindingState& rhs) const noexcept {
+        return !operator==(rhs);
+    }
+};
+
+using SamplerBindingStateTracker = StateTracker<SamplerBindingState>;
+
 // Raster-related state
 
 using CullModeStateTracker = StateTracker<MTLCullMode>;
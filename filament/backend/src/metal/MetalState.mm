@@ -83,6 +83,12 @@ id<MTLRenderPipelineState> PipelineStateCreator::operator()(id<MTLDevice> device
     // MSAA
     descriptor.rasterSampleCount = state.sampleCount;
 
+    if (@available(macOS 11, iOS 14, *)) {
+        if (binaryArchive) {
+            descriptor.binaryArchives = @[binaryArchive];
+        }
+    }
+
     NSError* error = nullptr;
     id<MTLRenderPipelineState> pipeline = [device newRenderPipelineStateWithDescriptor:descriptor
                                                                                  error:&error];
@@ -92,6 +98,15 @@ id<MTLRenderPipelineState> PipelineStateCreator::operator()(id<MTLDevice> device
     }
     ASSERT_POSTCONDITION(error == nil, "Could not create Metal pipeline state.");
 
+    if (@available(macOS 11, iOS 14, *)) {
+        // this is a no-op for the pipelines found in the archive
+        if (binaryArchive && ![binaryArchive addRenderPipelineFunctionsWithDescriptor:descriptor
+                                                                                error:nil]) {
+            utils::slog.w << "Could not add a pipeline to the Metal binary archive."
+                    << utils::io::endl;
+        }
+    }
+
     return pipeline;
 }
 
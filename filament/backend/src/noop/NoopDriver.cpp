@@ -56,6 +56,12 @@ void NoopDriver::setPresentationTime(int64_t monotonic_clock_ns) {
 }
 
 void NoopDriver::endFrame(uint32_t frameId) {
+    std::lock_guard<std::mutex> lock(mLastFrameLock);
+    mLastFrameStatistics = mFrameStatistics;
+    mFrameStatistics = {};
+}
+
+void NoopDriver::setMaxFramesInFlight(uint32_t count) {
 }
 
 void NoopDriver::flush(int) {
@@ -139,6 +145,10 @@ bool NoopDriver::isTextureFormatMipmappable(backend::TextureFormat format) {
     return true;
 }
 
+bool NoopDriver::isTextureFormatReshaped(TextureFormat format) {
+    return false;
+}
+
 bool NoopDriver::isRenderTargetFormatSupported(TextureFormat format) {
     return true;
 }
@@ -147,14 +157,38 @@ bool NoopDriver::isFrameBufferFetchSupported() {
     return false;
 }
 
+bool NoopDriver::isComputeSupported() {
+    return true;
+}
+
+bool NoopDriver::isDrawIndirectSupported() {
+    return true;
+}
+
 bool NoopDriver::isFrameTimeSupported() {
     return true;
 }
 
+bool NoopDriver::isFoveatedRenderingSupported() {
+    return false;
+}
+
+bool NoopDriver::isMultiviewSupported() {
+    return false;
+}
+
+uint32_t NoopDriver::getUniformBufferOffsetAlignment() {
+    return 16;
+}
+
 math::float2 NoopDriver::getClipSpaceParams() {
     return math::float2{ -1.0f, 0.0f };
 }
 
+void NoopDriver::compilePrograms(CompileCallback callback, void* user) {
+    scheduleCallback(callback, user);
+}
+
 void NoopDriver::updateVertexBuffer(Handle<HwVertexBuffer> vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset) {
     scheduleDestroy(std::move(p));
@@ -193,10 +227,28 @@ bool NoopDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapsedT
     return false;
 }
 
+bool NoopDriver::getFrameStatistics(FrameStatistics* statistics) {
+    std::lock_guard<std::mutex> lock(mLastFrameLock);
+    *statistics = mLastFrameStatistics;
+    return true;
+}
+
+bool NoopDriver::getMemoryStatistics(MemoryStatistics* statistics) {
+    return false;
+}
+
 SyncStatus NoopDriver::getSyncStatus(Handle<HwSync> sh) {
     return SyncStatus::SIGNALED;
 }
 
+BufferDescriptor NoopDriver::allocateStaging(size_t size) {
+    return allocateHeapStaging(size);
+}
+
+intptr_t NoopDriver::getTextureNativeId(Handle<HwTexture> th) {
+    return 0;
+}
+
 void NoopDriver::setExternalImage(Handle<HwTexture> th, void* image) {
 }
 
@@ -208,19 +260,31 @@ void NoopDriver::setExternalStream(Handle<HwTexture> th, Handle<HwStream> sh) {
 
 void NoopDriver::generateMipmaps(Handle<HwTexture> th) { }
 
+void NoopDriver::setMinMaxLevels(Handle<HwTexture> th, uint32_t minLevel, uint32_t maxLevel) {
+}
+
 bool NoopDriver::canGenerateMipmaps() {
     return true;
 }
 
 void NoopDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data) {
+    mFrameStatistics.uniformBufferBytes += data.size;
+    scheduleDestroy(std::move(data));
+}
+
+void NoopDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data,
+        uint32_t byteOffset) {
+    mFrameStatistics.uniformBufferBytes += data.size;
     scheduleDestroy(std::move(data));
 }
 
 void NoopDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
         SamplerGroup&& samplerGroup) {
+    mFrameStatistics.samplerGroupUpdateCount++;
 }
 
 void NoopDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassParams& params) {
+    mFrameStatistics.renderPassCount++;
 }
 
 void NoopDriver::endRenderPass(int) {
@@ -255,6 +319,12 @@ void NoopDriver::bindUniformBufferRange(size_t index, Handle<HwUniformBuffer> ub
 void NoopDriver::bindSamplers(size_t index, Handle<HwSamplerGroup> sbh) {
 }
 
+void NoopDriver::bindStorageBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
+}
+
+void NoopDriver::bindImage(size_t index, Handle<HwTexture> th, uint8_t level) {
+}
+
 void NoopDriver::insertEventMarker(char const* string, size_t len) {
 }
 
@@ -287,7 +357,43 @@ void NoopDriver::blit(TargetBufferFlags buffers,
         SamplerMagFilter filter) {
 }
 
-void NoopDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> rph) {
+void NoopDriver::countDraw(PipelineState const& state, uint32_t drawCount) noexcept {
+    FrameStatistics& statistics = mFrameStatistics;
+    statistics.drawCount += drawCount;
+    if (state.program != mCurrentProgram) {
+        mCurrentProgram = state.program;
+        mCurrentRasterState = state.rasterState;
+        statistics.programChangeCount++;
+        statistics.pipelineChangeCount++;
+    } else if (state.rasterState != mCurrentRasterState) {
+        mCurrentRasterState = state.rasterState;
+        statistics.pipelineChangeCount++;
+    }
+}
+
+void NoopDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
+    countDraw(pipelineState, 1);
+}
+
+void NoopDriver::drawIndirect(PipelineState pipelineState, Handle<HwRenderPrimitive> rph,
+        Handle<HwUniformBuffer> indirect, uint32_t offset, uint32_t drawCount) {
+    countDraw(pipelineState, drawCount);
+}
+
+void NoopDriver::dispatch(Handle<HwProgram> ph, math::uint3 groupCount) {
+}
+
+void NoopDriver::memoryBarrier(MemoryBarrierFlags flags) {
+}
+
+void NoopDriver::beginAsyncCompute(int) {
+}
+
+void NoopDriver::endAsyncCompute(int) {
+}
+
+void NoopDriver::waitAsyncCompute(int) {
 }
 
 void NoopDriver::beginTimerQuery(Handle<HwTimerQuery> tqh) {
@@ -22,6 +22,9 @@
 
 #include <utils/compiler.h>
 
+#include <atomic>
+#include <mutex>
+
 namespace filament {
 
 class NoopDriver final : public backend::DriverBase {
@@ -34,6 +37,19 @@ public:
 private:
     backend::ShaderModel getShaderModel() const noexcept final;
 
+    // handles are never dereferenced, but they're distinct so they can be used as keys
+    std::atomic<backend::HandleBase::HandleId> mNextHandle{ 0xDEAD0000 };
+
+    // the commands are counted, so that benchmarks without a GPU can tell what they would cost
+    void countDraw(backend::PipelineState const& state, uint32_t drawCount) noexcept;
+    backend::FrameStatistics mFrameStatistics;
+    backend::Handle<backend::HwProgram> mCurrentProgram;
+    backend::RasterState mCurrentRasterState;
+
+    // the counts of the last frame, read by getFrameStatistics() from any thread
+    std::mutex mLastFrameLock;
+    backend::FrameStatistics mLastFrameStatistics;
+
     /*
      * Driver interface
      */
@@ -49,7 +65,7 @@ private:
 
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params) \
     RetType methodName##S() noexcept override { \
-        return RetType((RetType::HandleId)0xDEAD0000); } \
+        return RetType(mNextHandle.fetch_add(1, std::memory_order_relaxed)); } \
     UTILS_ALWAYS_INLINE void methodName##R(RetType, paramsDecl) { }
 
 #include "private/backend/DriverAPI.inc"
@@ -98,6 +98,8 @@ OpenGLContext::OpenGLContext() noexcept {
         }
         if (major == 3 && minor >= 1) {
             features.multisample_texture = true;
+            features.compute_shader = GLES31_HEADERS;
+            features.draw_indirect = GLES31_HEADERS;
         }
         initExtensionsGLES(major, minor, exts);
     } else if (GL41_HEADERS) {
@@ -106,10 +108,20 @@ OpenGLContext::OpenGLContext() noexcept {
         }
         initExtensionsGL(major, minor, exts);
         features.multisample_texture = true;
+        features.compute_shader = GL43_HEADERS && (major > 4 || minor >= 3);
+        features.draw_indirect = GL43_HEADERS && (major > 4 || minor >= 3);
     };
     assert(shaderModel != ShaderModel::UNKNOWN);
     mShaderModel = shaderModel;
 
+    // program binaries are core in GLES 3.0 and GL 4.1 (but not in WebGL), but drivers can
+    // support no formats
+#if !defined(__EMSCRIPTEN__)
+    GLint programBinaryFormatCount = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &programBinaryFormatCount);
+    features.program_binary = programBinaryFormatCount > 0;
+#endif
+
     /*
      * Set our default state
      */
@@ -218,6 +230,7 @@ void OpenGLContext::initExtensionsGLES(GLint major, GLint minor, ExtentionSet co
     ext.texture_filter_anisotropic = hasExtension(exts, "GL_EXT_texture_filter_anisotropic");
     ext.texture_compression_etc2 = true;
     ext.QCOM_tiled_rendering = hasExtension(exts, "GL_QCOM_tiled_rendering");
+    ext.QCOM_framebuffer_foveated = hasExtension(exts, "GL_QCOM_framebuffer_foveated");
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
@@ -231,6 +244,10 @@ void OpenGLContext::initExtensionsGLES(GLint major, GLint minor, ExtentionSet co
     ext.EXT_texture_compression_s3tc_srgb = hasExtension(exts, "GL_EXT_texture_compression_s3tc_srgb");
     ext.EXT_shader_framebuffer_fetch = hasExtension(exts, "GL_EXT_shader_framebuffer_fetch");
     ext.EXT_clip_control = hasExtension(exts, "GL_EXT_clip_control");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.EXT_buffer_storage = hasExtension(exts, "GL_EXT_buffer_storage");
+    ext.EXT_multi_draw_indirect = hasExtension(exts, "GL_EXT_multi_draw_indirect");
+    ext.OVR_multiview = hasExtension(exts, "GL_OVR_multiview");
     // ES 3.2 implies EXT_color_buffer_float
     if (major >= 3 && minor >= 2) {
         ext.EXT_color_buffer_float = true;
@@ -250,6 +267,12 @@ void OpenGLContext::initExtensionsGL(GLint major, GLint minor, ExtentionSet cons
     ext.EXT_texture_sRGB = hasExtension(exts, "GL_EXT_texture_sRGB");
     ext.EXT_shader_framebuffer_fetch = hasExtension(exts, "GL_EXT_shader_framebuffer_fetch");
     ext.EXT_clip_control = hasExtension(exts, "GL_ARB_clip_control") || (major == 4 && minor >= 5);
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile") ||
+            hasExtension(exts, "GL_ARB_parallel_shader_compile");
+    ext.EXT_buffer_storage = hasExtension(exts, "GL_ARB_buffer_storage") || (major == 4 && minor >= 4);
+    ext.EXT_multi_draw_indirect = hasExtension(exts, "GL_ARB_multi_draw_indirect") ||
+            (major == 4 && minor >= 3);
+    ext.OVR_multiview = hasExtension(exts, "GL_OVR_multiview");
 }
 
 void OpenGLContext::bindBuffer(GLenum target, GLuint buffer) noexcept {
@@ -345,6 +368,18 @@ void OpenGLContext::deleteBuffers(GLsizei n, const GLuint* buffers, GLenum targe
             genericBuffer = 0;
         }
     }
+#if defined(GL_DRAW_INDIRECT_BUFFER)
+    if (target == GL_UNIFORM_BUFFER) {
+        // uniform buffers can also be bound as the arguments of indirect draws
+        auto& indirectBuffer = state.buffers.genericBinding[
+                getIndexForBufferTarget(GL_DRAW_INDIRECT_BUFFER)];
+        for (GLsizei i = 0; i < n; ++i) {
+            if (indirectBuffer == buffers[i]) {
+                indirectBuffer = 0;
+            }
+        }
+    }
+#endif
     if (target == GL_UNIFORM_BUFFER || target == GL_TRANSFORM_FEEDBACK_BUFFER) {
         auto& indexedBuffer = state.buffers.targets[targetIndex];
         #pragma nounroll // clang generates >1 KiB of code!!
@@ -108,6 +108,9 @@ public:
     // features supported by this version of GL or GLES
     struct {
         bool multisample_texture = false;
+        bool compute_shader = false;    // compute shaders, storage buffers and images
+        bool program_binary = false;    // glGetProgramBinary() returns usable binaries
+        bool draw_indirect = false;     // glDrawElementsIndirect() and GL_DRAW_INDIRECT_BUFFER
     } features;
 
     // supported extensions detected at runtime
@@ -116,6 +119,7 @@ public:
         bool texture_compression_etc2 = false;
         bool texture_filter_anisotropic = false;
         bool QCOM_tiled_rendering = false;
+        bool QCOM_framebuffer_foveated = false;
         bool OES_EGL_image_external_essl3 = false;
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
@@ -129,6 +133,10 @@ public:
         bool EXT_disjoint_timer_query = false;
         bool EXT_shader_framebuffer_fetch = false;
         bool EXT_clip_control = false;
+        bool KHR_parallel_shader_compile = false;
+        bool EXT_buffer_storage = false;
+        bool EXT_multi_draw_indirect = false;
+        bool OVR_multiview = false;
     } ext;
 
     struct {
@@ -163,10 +171,14 @@ public:
     GLuint getDrawFbo() const noexcept { return state.draw_fbo; }
     vec4gli const& getViewport() const { return state.window.viewport; }
 
+    // changes whenever the texture or sampler bound to any unit changes
+    uint32_t getTextureBindingsGeneration() const noexcept { return state.textures.generation; }
+
     // function to handle state changes we don't control
     void updateTexImage(GLenum target, GLuint id) noexcept {
         const size_t index = getIndexForTextureTarget(target);
         state.textures.units[state.textures.active].targets[index].texture_id = id;
+        state.textures.generation++;
     }
     void resetProgram() noexcept { state.program.use = 0; }
 
@@ -220,11 +232,12 @@ private:
                     GLsizeiptr size = 0;
                 } buffers[MAX_BUFFER_BINDINGS];
             } targets[2];   // there are only 2 indexed buffer target (uniform and transform feedback)
-            GLuint genericBinding[8] = { 0 };
+            GLuint genericBinding[9] = { 0 };
         } buffers;
 
         struct {
             GLuint active = 0;      // zero-based
+            uint32_t generation = 0;
             struct {
                 GLuint sampler = 0;
                 struct {
@@ -327,7 +340,10 @@ constexpr size_t OpenGLContext::getIndexForBufferTarget(GLenum target) noexcept
         case GL_ELEMENT_ARRAY_BUFFER:       index = 5; break;
         case GL_PIXEL_PACK_BUFFER:          index = 6; break;
         case GL_PIXEL_UNPACK_BUFFER:        index = 7; break;
-        default: index = 8; break; // should never happen
+#if defined(GL_DRAW_INDIRECT_BUFFER)
+        case GL_DRAW_INDIRECT_BUFFER:       index = 8; break;
+#endif
+        default: index = 9; break; // should never happen
     }
     assert(index < sizeof(state.buffers.genericBinding)/sizeof(state.buffers.genericBinding[0])); // NOLINT(misc-redundant-expression)
     return index;
@@ -345,6 +361,7 @@ void OpenGLContext::activeTexture(GLuint unit) noexcept {
 void OpenGLContext::bindSampler(GLuint unit, GLuint sampler) noexcept {
     assert(unit < MAX_TEXTURE_UNIT_COUNT);
     update_state(state.textures.units[unit].sampler, sampler, [&]() {
+        state.textures.generation++;
         glBindSampler(unit, sampler);
     });
 }
@@ -431,6 +448,7 @@ void OpenGLContext::bindTexture(GLuint unit, GLuint target, GLuint texId, size_t
     assert(targetIndex == getIndexForTextureTarget(target));
     assert(targetIndex < TEXTURE_TARGET_COUNT);
     update_state(state.textures.units[unit].targets[targetIndex].texture_id, texId, [&]() {
+        state.textures.generation++;
         activeTexture(unit);
         glBindTexture(target, texId);
     }, (target == GL_TEXTURE_EXTERNAL_OES) && bugs.texture_external_needs_rebind);
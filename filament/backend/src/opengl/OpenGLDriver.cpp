@@ -27,10 +27,13 @@
 #include "OpenGLContext.h"
 
 #include <utils/compiler.h>
+#include <utils/Hash.h>
 #include <utils/Log.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
@@ -45,6 +48,20 @@
 #define HAS_MAPBUFFERS 1
 #endif
 
+// Persistently mapped buffers need OpenGL 4.4 or GL_EXT_buffer_storage
+#if HAS_MAPBUFFERS && (defined(GL_VERSION_4_4) || defined(GL_EXT_buffer_storage))
+#define HAS_BUFFER_STORAGE 1
+#else
+#define HAS_BUFFER_STORAGE 0
+#endif
+
+// Multiple indirect draws in one call need OpenGL 4.3 or GL_EXT_multi_draw_indirect
+#if GL43_HEADERS || (GLES31_HEADERS && defined(GL_EXT_multi_draw_indirect))
+#define HAS_MULTI_DRAW_INDIRECT 1
+#else
+#define HAS_MULTI_DRAW_INDIRECT 0
+#endif
+
 #define DEBUG_MARKER_NONE       0
 #define DEBUG_MARKER_OPENGL     1
 
@@ -131,7 +148,9 @@ OpenGLDriver::DebugMarker::~DebugMarker() noexcept {
 
 OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         : DriverBase(new ConcreteDispatcher<OpenGLDriver>()),
-          mHandleArena("Handles", FILAMENT_OPENGL_HANDLE_ARENA_SIZE_IN_MB * 1024U * 1024U), // TODO: set the amount in configuration
+          // the arena grows as needed, this is only the size of its first segments
+          mHandleArena("Handles", FILAMENT_OPENGL_HANDLE_ARENA_SIZE_IN_MB * 1024U * 1024U,
+                  { 16, 64, 208 }),
           mSamplerMap(32),
           mPlatform(*platform) {
   
@@ -169,6 +188,17 @@ OpenGLDriver::OpenGLDriver(OpenGLPlatform* platform) noexcept
         mTimerQueryImpl = new TimerQueryFallback();
         mFrameTimeSupported = false;
     }
+
+    // program binaries are cached only if the platform can store them, and are only valid for
+    // the driver which created them
+    if (mPlatform.hasBlobFunc() && mContext.features.program_binary) {
+        uint64_t id = utils::hash::fnv1a64(nullptr, 0);
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            char const* const s = (char const*)glGetString(name);
+            id = utils::hash::fnv1a64(s, s ? strlen(s) : 0, id);
+        }
+        mProgramBinaryDriverId = id ? id : 1;
+    }
 }
 
 OpenGLDriver::~OpenGLDriver() noexcept {
@@ -194,6 +224,14 @@ void OpenGLDriver::terminate() {
         glDeleteSamplers(1, &item.second);
     }
     mSamplerMap.clear();
+    for (PixelBuffer const& buffer : mUnpackBuffers) {
+        mContext.deleteBuffers(1, &buffer.id, GL_PIXEL_UNPACK_BUFFER);
+    }
+    mUnpackBuffers.clear();
+    for (PixelBuffer const& buffer : mPackBuffers) {
+        mContext.deleteBuffers(1, &buffer.id, GL_PIXEL_PACK_BUFFER);
+    }
+    mPackBuffers.clear();
     if (mOpenGLBlitter) {
         mOpenGLBlitter->terminate();
     }
@@ -216,6 +254,13 @@ void OpenGLDriver::bindTexture(GLuint unit, GLTexture const* t) noexcept {
     mContext.bindTexture(unit, t->gl.target, t->gl.id, t->gl.targetIndex);
 }
 
+void OpenGLDriver::resolveProgram(OpenGLProgram* p) noexcept {
+    auto& v = mPendingPrograms;
+    v.erase(std::find_if(v.begin(), v.end(),
+            [p](auto const& item) { return item.second == p; }));
+    p->resolve(this);
+}
+
 void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
     mContext.useProgram(p->gl.program);
     // set-up textures and samplers in the proper TMUs (as specified in setSamplers)
@@ -304,19 +349,12 @@ void OpenGLDriver::setRasterStateSlow(RasterState rs) noexcept {
 //    GLVertexBuffer            : 208       moderate
 //    GLStream                  : 120       few
 //    GLUniformBuffer           : 128       many
-// -- less than or equal to 208 bytes
-
+// -- less than or equal to 208 bytes, larger objects are allocated on the heap
 
-OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
-        : mPool0(area.begin(),
-                  pointermath::add(area.begin(), (1 * area.getSize()) / 16)),
-          mPool1( pointermath::add(area.begin(), (1 * area.getSize()) / 16),
-                  pointermath::add(area.begin(), (6 * area.getSize()) / 16)),
-          mPool2( pointermath::add(area.begin(), (6 * area.getSize()) / 16),
-                  area.end()) {
 
 #if 0
-    // this is useful for development, but too verbose even for debug builds
+// this is useful for development, but too verbose even for debug builds
+static void logHandleSizes() {
     slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
     slog.d << "HwSync: " << sizeof(HwSync) << io::endl;
     slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
@@ -328,39 +366,12 @@ OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
     slog.d << "GLVertexBuffer: " << sizeof(GLVertexBuffer) << io::endl;
     slog.d << "GLUniformBuffer: " << sizeof(GLUniformBuffer) << io::endl;
     slog.d << "GLStream: " << sizeof(GLStream) << io::endl;
-#endif
-}
-
-void* OpenGLDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
-    assert(size <= mPool2.getSize());
-    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
-    if (size <= mPool1.getSize()) return mPool1.alloc(size, 32, extra);
-    if (size <= mPool2.getSize()) return mPool2.alloc(size, 32, extra);
-    return nullptr;
-}
-
-void OpenGLDriver::HandleAllocator::free(void* p, size_t size) noexcept {
-    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
-    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
-    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
-}
-
-
-// This is "NOINLINE" because it ends-up generating more code than we'd like because of
-// the locking (unfortunately, mHandleArena is accessed from 2 threads)
-UTILS_NOINLINE
-HandleBase::HandleId OpenGLDriver::allocateHandle(size_t size) noexcept {
-    void* addr = mHandleArena.alloc(size);
-    assert(addr);
-    char* const base = (char *)mHandleArena.getArea().begin();
-    size_t offset = (char*)addr - base;
-    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
 }
+#endif
 
 template<typename D, typename ... ARGS>
 backend::Handle<D> OpenGLDriver::initHandle(ARGS&& ... args) noexcept {
-    static_assert(sizeof(D) <= 208, "Handle<> too large");
-    backend::Handle<D> h{ allocateHandle(sizeof(D)) };
+    backend::Handle<D> h{ mHandleArena.allocate<D>() };
     D* addr = handle_cast<D *>(h);
     new(addr) D(std::forward<ARGS>(args)...);
 #if !defined(NDEBUG) && UTILS_HAS_RTTI
@@ -400,7 +411,7 @@ void OpenGLDriver::destruct(Handle<B>& handle, D const* p) noexcept {
         const_cast<D *>(p)->typeId = "(deleted)";
 #endif
         p->~D();
-        mHandleArena.free(const_cast<D*>(p), sizeof(D));
+        mHandleArena.deallocate(handle.getId(), p);
     }
 }
 
@@ -535,7 +546,10 @@ void OpenGLDriver::createRenderPrimitiveR(Handle<HwRenderPrimitive> rph, int) {
 void OpenGLDriver::createProgramR(Handle<HwProgram> ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    OpenGLProgram* p = construct<OpenGLProgram>(ph, this, std::move(program));
+    if (UTILS_UNLIKELY(p->isPending())) {
+        mPendingPrograms.emplace_back(++mProgramSerial, p);
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -555,6 +569,23 @@ void OpenGLDriver::createUniformBufferR(
     GLUniformBuffer* ub = construct<GLUniformBuffer>(ubh, size, usage);
     glGenBuffers(1, &ub->gl.ubo.id);
     gl.bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo.id);
+#if HAS_BUFFER_STORAGE
+    if (usage == BufferUsage::STREAM && gl.ext.EXT_buffer_storage) {
+        // STREAM buffers are mapped once and for all, updates are a memcpy into a ring
+        // synchronized with fences (see updateBuffer())
+        const GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_UNIFORM_BUFFER, size, nullptr, access);
+        ub->gl.ubo.mapped = glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, access);
+        if (UTILS_LIKELY(ub->gl.ubo.mapped)) {
+            CHECK_GL_ERROR(utils::slog.e)
+            return;
+        }
+        // the storage of the buffer is immutable now, start over with a new one
+        gl.deleteBuffers(1, &ub->gl.ubo.id, GL_UNIFORM_BUFFER);
+        glGenBuffers(1, &ub->gl.ubo.id);
+        gl.bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo.id);
+    }
+#endif
     glBufferData(GL_UNIFORM_BUFFER, size, nullptr, getBufferUsage(usage));
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -615,7 +646,8 @@ void OpenGLDriver::createTextureR(Handle<HwTexture> th, SamplerType target, uint
 
     auto& gl = mContext;
     GLTexture* t = construct<GLTexture>(th, target, levels, samples, w, h, depth, format, usage);
-    if (UTILS_LIKELY(usage & TextureUsage::SAMPLEABLE)) {
+    // storage images can't be renderbuffers
+    if (UTILS_LIKELY(usage & (TextureUsage::SAMPLEABLE | TextureUsage::STORAGE))) {
         if (UTILS_UNLIKELY(t->target == SamplerType::SAMPLER_EXTERNAL)) {
             mPlatform.createExternalImageTexture(t);
         } else {
@@ -671,7 +703,8 @@ void OpenGLDriver::createTextureR(Handle<HwTexture> th, SamplerType target, uint
         t->gl.internalFormat = getInternalFormat(format);
         t->gl.target = GL_RENDERBUFFER;
         glGenRenderbuffers(1, &t->gl.id);
-        renderBufferStorage(t->gl.id, t->gl.internalFormat, w, h, samples);
+        renderBufferStorage(t->gl.id, t->gl.internalFormat, w, h, samples,
+                any(usage & TextureUsage::TRANSIENT));
     }
 
     CHECK_GL_ERROR(utils::slog.e)
@@ -773,6 +806,9 @@ void OpenGLDriver::framebufferTexture(backend::TargetBufferInfo const& binfo,
     assert(rt->width  <= valueForLevel(binfo.level, t->width) &&
            rt->height <= valueForLevel(binfo.level, t->height));
 
+    // multiview render targets can't be multi-sampled
+    assert(binfo.viewCount <= 1 || rt->gl.samples <= 1);
+
     GLRenderTarget::GL::RenderBuffer const* pRenderBuffer = nullptr;
     switch (attachment) {
         case GL_COLOR_ATTACHMENT0:
@@ -869,6 +905,16 @@ void OpenGLDriver::framebufferTexture(backend::TargetBufferInfo const& binfo,
                 }
                 break;
             case GL_TEXTURE_2D_ARRAY:
+#ifdef GL_OVR_multiview
+                if (binfo.viewCount > 1) {
+                    // all the views are rendered by the same draw calls, gl_ViewID_OVR
+                    // selects the layer in the shaders
+                    assert(gl.ext.OVR_multiview);
+                    glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, attachment,
+                            t->gl.id, binfo.level, binfo.layer, binfo.viewCount);
+                    break;
+                }
+#endif
                 // GL_TEXTURE_2D_MULTISAMPLE_ARRAY is not supported in GLES
                 glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment,
                         t->gl.id, binfo.level, binfo.layer);
@@ -959,13 +1005,24 @@ void OpenGLDriver::framebufferTexture(backend::TargetBufferInfo const& binfo,
 }
 
 void OpenGLDriver::renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-        uint32_t height, uint8_t samples) const noexcept {
+        uint32_t height, uint8_t samples, bool transient) const noexcept {
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
     if (samples > 1) {
-        // We don't support "implicit" (i.e. EXT_multisampled_render_to_texture) renderbuffer
-        // (in practice this means that a texture must be marked 'SAMPLEABLE' if 'implicit'
-        // resolves are desired.
-        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalformat, width, height);
+#ifdef GL_EXT_multisampled_render_to_texture
+        if (transient && mContext.ext.EXT_multisampled_render_to_texture) {
+            // The content of a transient renderbuffer doesn't outlive the render pass, so it can
+            // be an "implicit" (i.e. EXT_multisampled_render_to_texture) renderbuffer, whose
+            // samples only live in tile memory. Only a single-sample buffer is allocated.
+            glext::glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER,
+                    samples, internalformat, width, height);
+        } else
+#endif
+        {
+            // Other renderbuffers are never "implicit", a texture must be marked 'SAMPLEABLE'
+            // if 'implicit' resolves are desired.
+            glRenderbufferStorageMultisample(GL_RENDERBUFFER,
+                    samples, internalformat, width, height);
+        }
     } else {
         glRenderbufferStorage(GL_RENDERBUFFER, internalformat, width, height);
     }
@@ -1200,6 +1257,15 @@ void OpenGLDriver::destroyProgram(Handle<HwProgram> ph) {
     DEBUG_MARKER()
     if (ph) {
         OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+        if (UTILS_UNLIKELY(p->isPending())) {
+            auto& v = mPendingPrograms;
+            v.erase(std::find_if(v.begin(), v.end(),
+                    [p](auto const& item) { return item.second == p; }));
+        }
+        if (areSamplersBound(p)) {
+            // a new program could be constructed at the same address
+            invalidateBoundSamplers();
+        }
         destruct(ph, p);
     }
 }
@@ -1217,7 +1283,14 @@ void OpenGLDriver::destroyUniformBuffer(Handle<HwUniformBuffer> ubh) {
     if (ubh) {
         auto& gl = mContext;
         GLUniformBuffer* ub = handle_cast<GLUniformBuffer*>(ubh);
+        // deleting the buffer unmaps it
+        for (GLsync fence : ub->gl.ubo.fences) {
+            if (fence) {
+                glDeleteSync(fence);
+            }
+        }
         gl.deleteBuffers(1, &ub->gl.ubo.id, GL_UNIFORM_BUFFER);
+        invalidateUniformBufferBindings(ubh);
         destruct(ubh, ub);
     }
 }
@@ -1464,10 +1537,16 @@ bool OpenGLDriver::isTextureFormatMipmappable(TextureFormat format) {
         case TextureFormat::DEPTH32F_STENCIL8:
             return false;
         default:
-            return isRenderTargetFormatSupported(format);
+            // integer formats are color-renderable, but not filterable
+            return !isIntegerFormat(format) && isRenderTargetFormatSupported(format);
     }
 }
 
+bool OpenGLDriver::isTextureFormatReshaped(TextureFormat format) {
+    // OpenGL supports all the 3-component formats
+    return false;
+}
+
 bool OpenGLDriver::isRenderTargetFormatSupported(TextureFormat format) {
     // Supported formats per http://docs.gl/es3/glRenderbufferStorage, note that desktop OpenGL may
     // support more formats, but it requires querying GL_INTERNALFORMAT_SUPPORTED which is not
@@ -1542,10 +1621,35 @@ bool OpenGLDriver::isFrameBufferFetchSupported() {
     return gl.ext.EXT_shader_framebuffer_fetch;
 }
 
+bool OpenGLDriver::isComputeSupported() {
+    auto& gl = mContext;
+    return gl.features.compute_shader;
+}
+
+bool OpenGLDriver::isDrawIndirectSupported() {
+    auto& gl = mContext;
+    return gl.features.draw_indirect;
+}
+
 bool OpenGLDriver::isFrameTimeSupported() {
     return mFrameTimeSupported;
 }
 
+bool OpenGLDriver::isFoveatedRenderingSupported() {
+    auto& gl = mContext;
+    return gl.ext.QCOM_framebuffer_foveated;
+}
+
+bool OpenGLDriver::isMultiviewSupported() {
+    auto& gl = mContext;
+    return gl.ext.OVR_multiview;
+}
+
+uint32_t OpenGLDriver::getUniformBufferOffsetAlignment() {
+    auto& gl = mContext;
+    return uint32_t(gl.gets.uniform_buffer_offset_alignment);
+}
+
 math::float2 OpenGLDriver::getClipSpaceParams() {
     return mContext.ext.EXT_clip_control ?
             math::float2{ -0.5f, 0.5f } : math::float2{ -1.0f, 0.0f };
@@ -1575,6 +1679,33 @@ void OpenGLDriver::makeCurrent(Handle<HwSwapChain> schDraw, Handle<HwSwapChain>
 // Updating driver objects
 // ------------------------------------------------------------------------------------------------
 
+void OpenGLDriver::compilePrograms(CompileCallback callback, void* user) {
+    DEBUG_MARKER()
+
+    // only the programs created so far delay the callback, resolving them as they become ready
+    const uint64_t serial = mProgramSerial;
+    runEveryNowAndThen([this, serial, callback, user]() -> bool {
+        bool done = true;
+        auto& v = mPendingPrograms;
+        for (auto it = v.begin(); it != v.end();) {
+            if (it->first <= serial) {
+                OpenGLProgram* const p = it->second;
+                if (p->isReady()) {
+                    it = v.erase(it);
+                    p->resolve(this);
+                    continue;
+                }
+                done = false;
+            }
+            ++it;
+        }
+        if (done) {
+            scheduleCallback(callback, user);
+        }
+        return done;
+    });
+}
+
 void OpenGLDriver::updateVertexBuffer(Handle<HwVertexBuffer> vbh,
         size_t index, BufferDescriptor&& p, uint32_t byteOffset) {
     DEBUG_MARKER()
@@ -1614,10 +1745,34 @@ void OpenGLDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescript
 
     auto& gl = mContext;
     if (p.size > 0) {
+        // STREAM buffers are written at a new offset, their bound ranges move
         updateBuffer(GL_UNIFORM_BUFFER, &ub->gl.ubo, p,
                 (uint32_t)gl.gets.uniform_buffer_offset_alignment);
+        invalidateUniformBufferBindings(ubh);
+        mFrameStatistics.uniformBufferBytes += p.size;
+    }
+    scheduleDestroy(std::move(p));
+}
+
+void OpenGLDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& p,
+        uint32_t byteOffset) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    // STREAM buffers are updated at a new offset each time, so they can't be partially updated
+    assert(ub->gl.ubo.usage != BufferUsage::STREAM);
+    assert(byteOffset + p.size <= ub->gl.ubo.capacity);
+
+    auto& gl = mContext;
+    if (p.size > 0) {
+        gl.bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo.id);
+        glBufferSubData(GL_UNIFORM_BUFFER, byteOffset, p.size, p.buffer);
+        ub->gl.ubo.size = std::max(ub->gl.ubo.size, uint32_t(byteOffset + p.size));
+        mFrameStatistics.uniformBufferBytes += p.size;
     }
     scheduleDestroy(std::move(p));
+
+    CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::updateBuffer(GLenum target,
@@ -1626,17 +1781,31 @@ void OpenGLDriver::updateBuffer(GLenum target,
     assert(buffer->id);
 
     auto& gl = mContext;
+    if (buffer->mapped) {
+        // persistently mapped STREAM buffer, the data goes right after the previous update.
+        assert(buffer->usage == BufferUsage::STREAM);
+        uint32_t offset = buffer->base + buffer->size;
+        offset = (offset + (alignment - 1u)) & ~(alignment - 1u);
+        if (offset + p.size > buffer->capacity) {
+            offset = 0;
+        }
+        acquireStreamRange(buffer, offset, (uint32_t)p.size);
+        memcpy(static_cast<char*>(buffer->mapped) + offset, p.buffer, p.size);
+        buffer->base = offset;
+        buffer->size = (uint32_t)p.size;
+        return;
+    }
+
     gl.bindBuffer(target, buffer->id);
     if (buffer->usage == BufferUsage::STREAM) {
 
-        buffer->size = (uint32_t)p.size;
-
         // If MapBufferRange is supported, then attempt to use that instead of BufferSubData, which
         // can be quite inefficient on some platforms. Note that WebGL does not support
         // MapBufferRange, but we still allow STREAM semantics for the web platform.
         if (HAS_MAPBUFFERS) {
             uint32_t offset = buffer->base + buffer->size;
             offset = (offset + (alignment - 1u)) & ~(alignment - 1u);
+            buffer->size = (uint32_t)p.size;
 
             if (offset + p.size > buffer->capacity) {
                 // if we've reached the end of the buffer, we orphan it and allocate a new one.
@@ -1667,6 +1836,7 @@ void OpenGLDriver::updateBuffer(GLenum target,
             CHECK_GL_ERROR(utils::slog.e)
             return;
         }
+        buffer->size = (uint32_t)p.size;
     }
 
     if (p.size == buffer->capacity) {
@@ -1684,12 +1854,51 @@ void OpenGLDriver::updateBuffer(GLenum target,
 }
 
 
+void OpenGLDriver::acquireStreamRange(GLBuffer* buffer, uint32_t offset, uint32_t size) noexcept {
+    constexpr uint32_t count = GLBuffer::SEGMENT_COUNT;
+    auto segmentOf = [capacity = buffer->capacity](uint32_t offset) {
+        return uint32_t((uint64_t(offset) * count) / capacity);
+    };
+    const uint32_t first = segmentOf(offset);
+    const uint32_t last = segmentOf(offset + std::max(size, 1u) - 1u);
+
+    // Walk the ring up to the last segment of the range, all the way around if it wrapped. The
+    // segments we leave are fenced, they can't be written again until the GPU is done with the
+    // commands issued so far. The segments the range covers must have been released by the GPU.
+    const uint32_t current = buffer->segment;
+    const bool wrapped = offset < buffer->base + buffer->size;
+    uint32_t steps = wrapped ? (count - current + last) : (last - current);
+    for (uint32_t segment = current; steps--;) {
+        GLsync& leaving = buffer->fences[segment];
+        if (leaving) {
+            glDeleteSync(leaving);
+        }
+        leaving = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+        segment = (segment + 1u) % count;
+        GLsync& entering = buffer->fences[segment];
+        if (entering && segment >= first && segment <= last) {
+            SYSTRACE_NAME("acquireStreamRange: wait");
+            GLenum status;
+            do {
+                status = glClientWaitSync(entering, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000u);
+            } while (status == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(entering);
+            entering = nullptr;
+        }
+    }
+    buffer->segment = last;
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
         SamplerGroup&& samplerGroup) {
     DEBUG_MARKER()
 
     GLSamplerGroup* sb = handle_cast<GLSamplerGroup *>(sbh);
     *sb->sb = std::move(samplerGroup); // NOLINT(performance-move-const-arg)
+    invalidateBoundSamplers();
+    mFrameStatistics.samplerGroupUpdateCount++;
 }
 
 void OpenGLDriver::update2DImage(Handle<HwTexture> th,
@@ -1757,6 +1966,24 @@ void OpenGLDriver::generateMipmaps(Handle<HwTexture> th) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::setMinMaxLevels(Handle<HwTexture> th, uint32_t minLevel, uint32_t maxLevel) {
+    DEBUG_MARKER()
+
+    auto& gl = mContext;
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    bindTexture(OpenGLContext::MAX_TEXTURE_UNIT_COUNT - 1, t);
+    gl.activeTexture(OpenGLContext::MAX_TEXTURE_UNIT_COUNT - 1);
+
+    // uploading a level below minLevel later on lowers the base level again, see setTextureData()
+    t->gl.baseLevel = int8_t(minLevel);
+    t->gl.maxLevel = int8_t(maxLevel);
+
+    glTexParameteri(t->gl.target, GL_TEXTURE_BASE_LEVEL, t->gl.baseLevel);
+    glTexParameteri(t->gl.target, GL_TEXTURE_MAX_LEVEL, t->gl.maxLevel);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 bool OpenGLDriver::canGenerateMipmaps() {
     return true;
 }
@@ -1786,6 +2013,24 @@ void OpenGLDriver::setTextureData(GLTexture* t,
     gl.pixelStore(GL_UNPACK_SKIP_PIXELS, p.left);
     gl.pixelStore(GL_UNPACK_SKIP_ROWS, p.top);
 
+    // Large uploads are copied into a pixel unpack buffer first, so that glTexSubImage*() is
+    // a GPU copy instead of a synchronous copy (and often conversion) by the driver. The user
+    // buffer can be released as soon as it's copied.
+    uint8_t const* data = static_cast<uint8_t const*>(p.buffer);
+    PixelBuffer pbo{};
+    if (HAS_MAPBUFFERS && p.size >= UNPACK_BUFFER_MIN_SIZE) {
+        pbo = acquirePixelBuffer(GL_PIXEL_UNPACK_BUFFER, uint32_t(p.size));
+        void* vaddr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, p.size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (vaddr) {
+            memcpy(vaddr, p.buffer, p.size);
+        }
+        if (!vaddr || glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_FALSE) {
+            glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, p.size, p.buffer);
+        }
+        data = nullptr;
+    }
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -1798,7 +2043,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             assert(t->gl.target == GL_TEXTURE_2D);
             glTexSubImage2D(t->gl.target, GLint(level),
                     GLint(xoffset), GLint(yoffset),
-                    width, height, glFormat, glType, p.buffer);
+                    width, height, glFormat, glType, data);
             break;
         case SamplerType::SAMPLER_3D:
             assert(zoffset + depth <= std::max(1u, t->depth >> level));
@@ -1807,7 +2052,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             assert(t->gl.target == GL_TEXTURE_3D);
             glTexSubImage3D(t->gl.target, GLint(level),
                     GLint(xoffset), GLint(yoffset), GLint(zoffset),
-                    width, height, depth, glFormat, glType, p.buffer);
+                    width, height, depth, glFormat, glType, data);
             break;
         case SamplerType::SAMPLER_2D_ARRAY:
             assert(zoffset + depth <= t->depth);
@@ -1817,7 +2062,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             assert(t->gl.target == GL_TEXTURE_2D_ARRAY);
             glTexSubImage3D(t->gl.target, GLint(level),
                     GLint(xoffset), GLint(yoffset), GLint(zoffset),
-                    width, height, depth, glFormat, glType, p.buffer);
+                    width, height, depth, glFormat, glType, data);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(t->gl.target == GL_TEXTURE_CUBE_MAP);
@@ -1829,12 +2074,19 @@ void OpenGLDriver::setTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, glFormat, glType,
-                        static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        data + offsets[face]);
             }
             break;
         }
     }
 
+    if (pbo.id) {
+        gl.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        whenGpuCommandsComplete([this, pbo]() {
+            releasePixelBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        });
+    }
+
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -1852,6 +2104,51 @@ void OpenGLDriver::setTextureData(GLTexture* t,
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+OpenGLDriver::PixelBuffer OpenGLDriver::acquirePixelBuffer(GLenum target,
+        uint32_t size) noexcept {
+    auto& gl = mContext;
+    auto& v = getPixelBuffers(target);
+
+    // pick the smallest free buffer that's large enough, or grow the largest one
+    auto pos = std::min_element(v.begin(), v.end(),
+            [size](PixelBuffer const& lhs, PixelBuffer const& rhs) {
+                if ((lhs.capacity >= size) != (rhs.capacity >= size)) {
+                    return lhs.capacity >= size;
+                }
+                return lhs.capacity >= size ?
+                        lhs.capacity < rhs.capacity : lhs.capacity > rhs.capacity;
+            });
+
+    PixelBuffer buffer{};
+    if (pos != v.end()) {
+        buffer = *pos;
+        v.erase(pos);
+    } else {
+        glGenBuffers(1, &buffer.id);
+    }
+    gl.bindBuffer(target, buffer.id);
+    if (buffer.capacity < size) {
+        buffer.capacity = size;
+        glBufferData(target, size, nullptr,
+                target == GL_PIXEL_PACK_BUFFER ? GL_STREAM_READ : GL_STREAM_DRAW);
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+    return buffer;
+}
+
+void OpenGLDriver::releasePixelBuffer(GLenum target, PixelBuffer buffer) noexcept {
+    auto& v = getPixelBuffers(target);
+    size_t pooled = buffer.capacity;
+    for (PixelBuffer const& b : v) {
+        pooled += b.capacity;
+    }
+    if (pooled <= PIXEL_BUFFER_POOL_SIZE) {
+        v.push_back(buffer);
+    } else {
+        mContext.deleteBuffers(1, &buffer.id, target);
+    }
+}
+
 void OpenGLDriver::setCompressedTextureData(GLTexture* t,  uint32_t level,
         uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
         uint32_t width, uint32_t height, uint32_t depth,
@@ -2115,6 +2412,16 @@ bool OpenGLDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapse
     return true;
 }
 
+bool OpenGLDriver::getFrameStatistics(FrameStatistics* statistics) {
+    *statistics = mLastFrameStatistics;
+    return true;
+}
+
+bool OpenGLDriver::getMemoryStatistics(MemoryStatistics* statistics) {
+    // GL doesn't report the memory it allocates
+    return false;
+}
+
 SyncStatus OpenGLDriver::getSyncStatus(Handle<HwSync> sh) {
     GLSync* s = handle_cast<GLSync*>(sh);
     if (!s->result) {
@@ -2133,6 +2440,18 @@ SyncStatus OpenGLDriver::getSyncStatus(Handle<HwSync> sh) {
     }
 }
 
+BufferDescriptor OpenGLDriver::allocateStaging(size_t size) {
+    // The GL context is only current on the driver thread, so no buffer can be mapped here. The
+    // updates read this memory directly, there is no copy on the way.
+    return allocateHeapStaging(size);
+}
+
+intptr_t OpenGLDriver::getTextureNativeId(Handle<HwTexture> th) {
+    GLTexture const* t = handle_cast<const GLTexture*>(th);
+    // renderbuffers can't be imported, only textures
+    return t->gl.target != GL_RENDERBUFFER ? intptr_t(t->gl.id) : 0;
+}
+
 void OpenGLDriver::beginRenderPass(Handle<HwRenderTarget> rth,
         const RenderPassParams& params) {
     DEBUG_MARKER()
@@ -2140,6 +2459,8 @@ void OpenGLDriver::beginRenderPass(Handle<HwRenderTarget> rth,
 
     mRenderPassTarget = rth;
     mRenderPassParams = params;
+    mLastPipelineValid = false;
+    mFrameStatistics.renderPassCount++;
 
     GLRenderTarget* rt = handle_cast<GLRenderTarget*>(rth);
 
@@ -2149,6 +2470,25 @@ void OpenGLDriver::beginRenderPass(Handle<HwRenderTarget> rth,
     gl.bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
     CHECK_GL_FRAMEBUFFER_STATUS(utils::slog.e, GL_FRAMEBUFFER)
 
+#ifdef GL_QCOM_framebuffer_foveated
+    // Once configured, foveation stays enabled on the framebuffer, so we only update its
+    // parameters afterwards (a zero gain disables it).
+    FoveationParams const& foveation = params.foveation;
+    const bool foveated = any(notEqual(foveation.gain, math::float2{}));
+    if (gl.ext.QCOM_framebuffer_foveated && rt->gl.fbo && (foveated || rt->gl.foveated)) {
+        if (!rt->gl.foveated) {
+            GLuint providedFeatures = 0;
+            glFramebufferFoveationConfigQCOM(rt->gl.fbo, 1, 1,
+                    GL_FOVEATION_ENABLE_BIT_QCOM, &providedFeatures);
+            rt->gl.foveated = true;
+        }
+        glFramebufferFoveationParametersQCOM(rt->gl.fbo, 0, 0,
+                foveation.focalPoint.x, foveation.focalPoint.y,
+                foveation.gain.x, foveation.gain.y, foveation.foveaArea);
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+#endif
+
     // glInvalidateFramebuffer appeared on GLES 3.0 and GL4.3, for simplicity we just
     // ignore it on GL (rather than having to do a runtime check).
     if (GLES30_HEADERS) {
@@ -2202,6 +2542,7 @@ void OpenGLDriver::endRenderPass(int) {
     auto& gl = mContext;
 
     assert(mRenderPassTarget); // endRenderPass() called without beginRenderPass()?
+    mLastPipelineValid = false;
 
     GLRenderTarget const* const rt = handle_cast<GLRenderTarget*>(mRenderPassTarget);
 
@@ -2532,6 +2873,8 @@ void OpenGLDriver::updateStreamTexId(GLTexture* t, DriverApi* driver) noexcept {
                 }
                 t->gl.id = readTexture;
                 t->gl.fence = fence;
+                // the texture must be bound again, after waiting on the fence
+                invalidateBoundSamplers();
                 s->gl.externalTexture2DId = writeTexture;
             } else {
                 glDeleteSync(fence);
@@ -2627,6 +2970,7 @@ void OpenGLDriver::bindUniformBuffer(size_t index, Handle<HwUniformBuffer> ubh)
     GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
     assert(ub->gl.ubo.base == 0);
     gl.bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo.id, 0, ub->gl.ubo.capacity);
+    mUniformBufferBindings[index] = {};
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -2635,20 +2979,60 @@ void OpenGLDriver::bindUniformBufferRange(size_t index, Handle<HwUniformBuffer>
     DEBUG_MARKER()
     auto& gl = mContext;
 
+    // the per-renderable ranges are typically bound again for each draw
+    UniformBufferBinding& binding = mUniformBufferBindings[index];
+    if (binding.ubh == ubh && binding.offset == offset && binding.size == size) {
+        mFrameStatistics.redundantUniformBindingCount++;
+        return;
+    }
+
     GLUniformBuffer* ub = handle_cast<GLUniformBuffer*>(ubh);
     // TODO: Is this assert really needed? Note that size is only populated for STREAM buffers.
     assert(size <= ub->gl.ubo.size);
     assert(ub->gl.ubo.base + offset + size <= ub->gl.ubo.capacity);
     gl.bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo.id, ub->gl.ubo.base + offset, size);
+    binding = { ubh, offset, size };
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindStorageBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
+    DEBUG_MARKER()
+#if GLES31_HEADERS || GL43_HEADERS
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    assert(mContext.features.compute_shader);
+    assert(ub->gl.ubo.base == 0);
+    // GL buffers are untyped, a uniform buffer can be bound as a storage buffer. This binding
+    // is not tracked by OpenGLContext.
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, GLuint(index), ub->gl.ubo.id,
+            0, ub->gl.ubo.capacity);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
+void OpenGLDriver::bindImage(size_t index, Handle<HwTexture> th, uint8_t level) {
+    DEBUG_MARKER()
+#if GLES31_HEADERS || GL43_HEADERS
+    GLTexture const* t = handle_cast<const GLTexture*>(th);
+    assert(mContext.features.compute_shader);
+    assert(any(t->usage & TextureUsage::STORAGE));
+    assert(t->gl.target != GL_RENDERBUFFER);
+    // all layers of array, cubemap and 3D textures are bound
+    const GLboolean layered = t->gl.target == GL_TEXTURE_2D ? GL_FALSE : GL_TRUE;
+    glBindImageTexture(GLuint(index), t->gl.id, level, layered, 0, GL_READ_WRITE,
+            t->gl.internalFormat);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
 void OpenGLDriver::bindSamplers(size_t index, Handle<HwSamplerGroup> sbh) {
     DEBUG_MARKER()
 
     GLSamplerGroup* sb = handle_cast<GLSamplerGroup *>(sbh);
     assert(index < Program::SAMPLER_BINDING_COUNT);
-    mSamplerBindings[index] = sb;
+    if (mSamplerBindings[index] != sb) {
+        mSamplerBindings[index] = sb;
+        invalidateBoundSamplers();
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -2765,10 +3149,10 @@ void OpenGLDriver::readPixels(Handle<HwRenderTarget> src,
     GLRenderTarget const* s = handle_cast<GLRenderTarget const*>(src);
     gl.bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
 
-    GLuint pbo;
-    glGenBuffers(1, &pbo);
-    gl.bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
-    glBufferData(GL_PIXEL_PACK_BUFFER, p.size, nullptr, GL_STATIC_DRAW);
+    // The pixels are read into a pixel pack buffer, which is only mapped once the GPU is done,
+    // so the driver thread never waits for the read-back. The buffers are recycled, so reading
+    // back every frame doesn't allocate.
+    const PixelBuffer pbo = acquirePixelBuffer(GL_PIXEL_PACK_BUFFER, uint32_t(p.size));
     glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, nullptr);
     gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 
@@ -2778,7 +3162,7 @@ void OpenGLDriver::readPixels(Handle<HwRenderTarget> src,
     whenGpuCommandsComplete([this, width, height, pbo, pUserBuffer]() mutable {
         PixelBufferDescriptor& p = *pUserBuffer;
         auto& gl = mContext;
-        gl.bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        gl.bindBuffer(GL_PIXEL_PACK_BUFFER, pbo.id);
         void* vaddr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0,  p.size, GL_MAP_READ_BIT);
         if (vaddr) {
             // now we need to flip the buffer vertically to match our API
@@ -2797,7 +3181,7 @@ void OpenGLDriver::readPixels(Handle<HwRenderTarget> src,
             glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
         }
         gl.bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
-        glDeleteBuffers(1, &pbo);
+        releasePixelBuffer(GL_PIXEL_PACK_BUFFER, pbo);
         scheduleDestroy(std::move(p));
         delete pUserBuffer;
         CHECK_GL_ERROR(utils::slog.e)
@@ -2884,6 +3268,12 @@ void OpenGLDriver::endFrame(uint32_t frameId) {
     //SYSTRACE_NAME("glFinish");
     //glFinish();
     insertEventMarker("endFrame");
+    mLastFrameStatistics = mFrameStatistics;
+    mFrameStatistics = {};
+}
+
+void OpenGLDriver::setMaxFramesInFlight(uint32_t count) {
+    // the number of buffers of the swap chain is chosen by the platform's window system
 }
 
 void OpenGLDriver::flush(int) {
@@ -3033,22 +3423,37 @@ void OpenGLDriver::updateTextureLodRange(GLTexture* texture, int8_t targetLevel)
     }
 }
 
-void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
-    DEBUG_MARKER()
+bool OpenGLDriver::prepareDraw(PipelineState const& state, GLRenderPrimitive const* rp) noexcept {
     auto& gl = mContext;
 
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(state.program);
 
+    if (UTILS_LIKELY(mLastPipelineValid && isSamePipeline(state, mLastPipeline))) {
+        // the program was resolved by the last draw and is still in use, the samplers it reads
+        // and the vertex array are the only state that can differ
+        mFrameStatistics.redundantPipelineCount++;
+        p->use(this);
+        gl.bindVertexArray(&rp->gl);
+        return true;
+    }
+
+    if (UTILS_UNLIKELY(p->isPending())) {
+        if (p->skipsDrawsUntilReady() && !p->isReady()) {
+            // the program is still compiling, skipping the draw avoids stalling until it's done
+            return false;
+        }
+        resolveProgram(p);
+    }
+
     // If the material debugger is enabled, avoid fatal (or cascading) errors and that can occur
     // during the draw call when the program is invalid. The shader compile error has already been
     // dumped to the console at this point, so it's fine to simply return early.
     if (FILAMENT_ENABLE_MATDBG && UTILS_UNLIKELY(!p->isValid())) {
-        return;
+        return false;
     }
 
     useProgram(p);
 
-    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
     gl.bindVertexArray(&rp->gl);
 
     setRasterState(state.rasterState);
@@ -3057,10 +3462,131 @@ void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph) {
 
     setViewportScissor(state.scissor);
 
-    glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    FrameStatistics& statistics = mFrameStatistics;
+    if (state.program != mLastPipeline.program) {
+        statistics.programChangeCount++;
+        statistics.pipelineChangeCount++;
+    } else if (state.rasterState != mLastPipeline.rasterState) {
+        statistics.pipelineChangeCount++;
+    }
+    mLastPipeline = state;
+    mLastPipelineValid = true;
+    return true;
+}
+
+void OpenGLDriver::draw(PipelineState state, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
+    DEBUG_MARKER()
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    if (UTILS_UNLIKELY(!prepareDraw(state, rp))) {
+        return;
+    }
+    mFrameStatistics.drawCount++;
+
+    if (UTILS_LIKELY(instanceCount == 1)) {
+        glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+    } else {
+        glDrawElementsInstanced(GLenum(rp->type), rp->count,
+                rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset),
+                GLsizei(instanceCount));
+    }
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawIndirect(PipelineState state, Handle<HwRenderPrimitive> rph,
+        Handle<HwUniformBuffer> indirect, uint32_t offset, uint32_t drawCount) {
+    DEBUG_MARKER()
+#if GLES31_HEADERS || GL43_HEADERS
+    auto& gl = mContext;
+    assert(gl.features.draw_indirect);
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    GLUniformBuffer const* ib = handle_cast<const GLUniformBuffer *>(indirect);
+    assert(ib->gl.ubo.base == 0);
+    assert(offset + drawCount * sizeof(DrawIndirectCommand) <= ib->gl.ubo.capacity);
+    if (UTILS_UNLIKELY(!drawCount || !prepareDraw(state, rp))) {
+        return;
+    }
+    mFrameStatistics.drawCount += drawCount;
+
+    // GL buffers are untyped, the arguments are read from the uniform buffer directly
+    gl.bindBuffer(GL_DRAW_INDIRECT_BUFFER, ib->gl.ubo.id);
 
+#if HAS_MULTI_DRAW_INDIRECT
+    if (drawCount > 1 && gl.ext.EXT_multi_draw_indirect) {
+        glMultiDrawElementsIndirect(GLenum(rp->type), rp->gl.indicesType,
+                reinterpret_cast<const void*>(uintptr_t(offset)), GLsizei(drawCount), 0);
+        CHECK_GL_ERROR(utils::slog.e)
+        return;
+    }
+#endif
+
+    for (uint32_t i = 0; i < drawCount; i++) {
+        glDrawElementsIndirect(GLenum(rp->type), rp->gl.indicesType,
+                reinterpret_cast<const void*>(uintptr_t(offset + i * sizeof(DrawIndirectCommand))));
+    }
     CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
+void OpenGLDriver::dispatch(Handle<HwProgram> ph, math::uint3 groupCount) {
+    DEBUG_MARKER()
+#if GLES31_HEADERS || GL43_HEADERS
+    assert(mContext.features.compute_shader);
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+
+    if (UTILS_UNLIKELY(p->isPending())) {
+        resolveProgram(p);
+    }
+
+    // see draw()
+    if (FILAMENT_ENABLE_MATDBG && UTILS_UNLIKELY(!p->isValid())) {
+        return;
+    }
+
+    useProgram(p);
+    mLastPipelineValid = false;
+    glDispatchCompute(groupCount.x, groupCount.y, groupCount.z);
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
+void OpenGLDriver::memoryBarrier(MemoryBarrierFlags flags) {
+    DEBUG_MARKER()
+#if GLES31_HEADERS || GL43_HEADERS
+    assert(mContext.features.compute_shader);
+    GLbitfield barriers = 0;
+    if (any(flags & MemoryBarrierFlags::STORAGE_BUFFER)) {
+        barriers |= GL_SHADER_STORAGE_BARRIER_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::STORAGE_IMAGE)) {
+        barriers |= GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::TEXTURE_FETCH)) {
+        barriers |= GL_TEXTURE_FETCH_BARRIER_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::UNIFORM_BUFFER)) {
+        barriers |= GL_UNIFORM_BARRIER_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::INDIRECT_COMMAND)) {
+        barriers |= GL_COMMAND_BARRIER_BIT;
+    }
+    if (barriers) {
+        glMemoryBarrier(barriers);
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+#endif
+}
+
+void OpenGLDriver::beginAsyncCompute(int) {
+    // GL has a single queue, the compute commands are executed in order.
+}
+
+void OpenGLDriver::endAsyncCompute(int) {
+}
+
+void OpenGLDriver::waitAsyncCompute(int) {
 }
 
 // explicit instantiation of the Dispatcher
@@ -18,6 +18,7 @@
 #define TNT_FILAMENT_DRIVER_OPENGLDRIVER_H
 
 #include "private/backend/Driver.h"
+#include "private/backend/HandleAllocator.h"
 #include "DriverBase.h"
 #include "OpenGLContext.h"
 
@@ -28,12 +29,13 @@
 
 #include <tsl/robin_map.h>
 
+#include <array>
 #include <set>
 
 #include <assert.h>
 
 #ifndef FILAMENT_OPENGL_HANDLE_ARENA_SIZE_IN_MB
-#    define FILAMENT_OPENGL_HANDLE_ARENA_SIZE_IN_MB 2
+#    define FILAMENT_OPENGL_HANDLE_ARENA_SIZE_IN_MB 1
 #endif
 
 namespace filament {
@@ -64,11 +66,17 @@ public:
 
     // OpenGLDriver specific fields
     struct GLBuffer {
+        // STREAM buffers that are persistently mapped are split in this many segments, each
+        // guarded by a fence when the ring leaves it
+        static constexpr uint32_t SEGMENT_COUNT = 4;
         GLuint id = 0;
         uint32_t capacity = 0;
         uint32_t base = 0;
         uint32_t size = 0;
         backend::BufferUsage usage = {};
+        void* mapped = nullptr;         // persistent mapping, if any
+        uint32_t segment = 0;           // segment of the last update
+        std::array<GLsync, SEGMENT_COUNT> fences{};
     };
 
     struct GLVertexBuffer : public backend::HwVertexBuffer {
@@ -193,6 +201,7 @@ public:
             mutable GLuint fbo_read = 0;
             mutable backend::TargetBufferFlags resolve = backend::TargetBufferFlags::NONE; // attachments in fbo_draw to resolve
             uint8_t samples : 4;
+            bool foveated = false;  // foveation was configured on fbo
         } gl;
         backend::TargetBufferFlags targets = {};
     };
@@ -240,30 +249,8 @@ private:
 
     // Memory management...
 
-    class HandleAllocator {
-        utils::PoolAllocator< 16, 16>   mPool0;
-        utils::PoolAllocator< 64, 32>   mPool1;
-        utils::PoolAllocator<208, 32>   mPool2;
-    public:
-        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
-        explicit HandleAllocator(const utils::HeapArea& area);
-        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
-        void free(void* p, size_t size) noexcept;
-    };
-
-    // the arenas for handle allocation needs to be thread-safe
-#ifndef NDEBUG
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock,
-            utils::TrackingPolicy::Debug>;
-#else
-    using HandleArena = utils::Arena<HandleAllocator,
-            utils::LockingPolicy::SpinLock>;
-#endif
-
-    HandleArena mHandleArena;
-
-    backend::HandleBase::HandleId allocateHandle(size_t size) noexcept;
+    // the handle allocator is thread-safe, mHandleArena is accessed from 2 threads
+    backend::HandleAllocator mHandleArena;
 
     template<typename D, typename ... ARGS>
     backend::Handle<D> initHandle(ARGS&& ... args) noexcept;
@@ -291,11 +278,7 @@ private:
     handle_cast(backend::Handle<B>& handle) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        char* const base = (char *)mHandleArena.getArea().begin();
-        size_t offset = handle.getId() << HandleAllocator::MIN_ALIGNMENT_SHIFT;
-        // assert that this handle is even a valid one
-        assert(base + offset + sizeof(typename std::remove_pointer<Dp>::type) <= (char *)mHandleArena.getArea().end());
-        return static_cast<Dp>(static_cast<void *>(base + offset));
+        return mHandleArena.handle_cast<typename std::remove_pointer<Dp>::type>(handle.getId());
     }
 
     template<typename Dp, typename B>
@@ -341,8 +324,10 @@ private:
             uint32_t width, uint32_t height, uint32_t depth,
             backend::PixelBufferDescriptor&& data, backend::FaceOffsets const* faceOffsets);
 
+    // a transient multi-sampled renderbuffer may use an implicit resolve, its content is
+    // discarded at the end of the render pass anyway
     void renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-            uint32_t height, uint8_t samples) const noexcept;
+            uint32_t height, uint8_t samples, bool transient = false) const noexcept;
 
     void textureStorage(GLTexture* t,
             uint32_t width, uint32_t height, uint32_t depth) noexcept;
@@ -374,6 +359,23 @@ private:
         return mSamplerBindings;
     }
 
+    // whether the textures and samplers of 'program' are still bound to the texture units the
+    // way OpenGLProgram::updateSamplers() left them
+    bool areSamplersBound(OpenGLProgram const* program) const noexcept {
+        return mBoundSamplers.program == program &&
+                mBoundSamplers.generation == mContext.getTextureBindingsGeneration() &&
+                !mContext.bugs.texture_external_needs_rebind;
+    }
+
+    void setSamplersBound(OpenGLProgram const* program) noexcept {
+        mBoundSamplers = { program, mContext.getTextureBindingsGeneration() };
+    }
+
+    // called when the sampler groups bound, or their content, change
+    void invalidateBoundSamplers() noexcept {
+        mBoundSamplers.program = nullptr;
+    }
+
     static GLsizei getAttachments(std::array<GLenum, 6>& attachments,
             GLRenderTarget const* rt, backend::TargetBufferFlags buffers) noexcept;
 
@@ -390,9 +392,59 @@ private:
 
     void setViewportScissor(backend::Viewport const& viewportScissor) noexcept;
 
+    // sets up the program, vertex array and state of a draw, returns false if it must be skipped
+    inline bool prepareDraw(backend::PipelineState const& state,
+            GLRenderPrimitive const* rp) noexcept;
+
+    // The pipeline of the last draw. While mLastPipelineValid, its program, raster state,
+    // polygon offset and scissor are still set, so a draw with the same pipeline only needs its
+    // samplers and vertex array. It's invalidated at the boundaries of the render passes, outside
+    // of which other commands change these states.
+    backend::PipelineState mLastPipeline;
+    bool mLastPipelineValid = false;
+
+    static bool isSamePipeline(backend::PipelineState const& lhs,
+            backend::PipelineState const& rhs) noexcept {
+        return lhs.program == rhs.program &&
+               lhs.rasterState == rhs.rasterState &&
+               lhs.polygonOffset.slope == rhs.polygonOffset.slope &&
+               lhs.polygonOffset.constant == rhs.polygonOffset.constant &&
+               lhs.scissor.left == rhs.scissor.left &&
+               lhs.scissor.bottom == rhs.scissor.bottom &&
+               lhs.scissor.width == rhs.scissor.width &&
+               lhs.scissor.height == rhs.scissor.height;
+    }
+
+    // The range last bound to each uniform buffer binding point by bindUniformBufferRange(). An
+    // entry is cleared when its buffer can move (loadUniformBuffer) or is destroyed.
+    struct UniformBufferBinding {
+        backend::Handle<backend::HwUniformBuffer> ubh;
+        size_t offset = 0;
+        size_t size = 0;
+    };
+    std::array<UniformBufferBinding, OpenGLContext::MAX_BUFFER_BINDINGS> mUniformBufferBindings;
+
+    void invalidateUniformBufferBindings(backend::Handle<backend::HwUniformBuffer> ubh) noexcept {
+        for (UniformBufferBinding& binding : mUniformBufferBindings) {
+            if (binding.ubh == ubh) {
+                binding = {};
+            }
+        }
+    }
+
+    // statistics of the frame being recorded, and of the last frame, see getFrameStatistics()
+    backend::FrameStatistics mFrameStatistics;
+    backend::FrameStatistics mLastFrameStatistics;
+
     // sampler buffer binding points (nullptr if not used)
     std::array<backend::HwSamplerGroup*, backend::Program::SAMPLER_BINDING_COUNT> mSamplerBindings = {};   // 8 pointers
 
+    // the last program which bound its textures, and the texture units state at that time
+    struct {
+        OpenGLProgram const* program = nullptr;
+        uint32_t generation = 0;
+    } mBoundSamplers;
+
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
     mutable std::vector<GLTexture*> mExternalStreams;
 
@@ -402,14 +454,41 @@ private:
 
     backend::OpenGLPlatform& mPlatform;
 
+    // identifies the GL driver in the keys of the program binary cache, 0 if it's disabled
+    uint64_t mProgramBinaryDriverId = 0;
+
+    // programs compiling in the background (see OpenGLProgram::isPending()), with their serial
+    // number, which tells which ones compilePrograms() waits for
+    std::vector<std::pair<uint64_t, OpenGLProgram*>> mPendingPrograms;
+    uint64_t mProgramSerial = 0;
+    void resolveProgram(OpenGLProgram* p) noexcept;
+
     OpenGLBlitter* mOpenGLBlitter = nullptr;
     void updateStreamTexId(GLTexture* t, backend::DriverApi* driver) noexcept;
     void updateStreamAcquired(GLTexture* t, backend::DriverApi* driver) noexcept;
     void updateBuffer(GLenum target, GLBuffer* buffer, backend::BufferDescriptor const& p, uint32_t alignment = 16) noexcept;
+    void acquireStreamRange(GLBuffer* buffer, uint32_t offset, uint32_t size) noexcept;
     void updateTextureLodRange(GLTexture* texture, int8_t targetLevel) noexcept;
 
     void setExternalTexture(GLTexture* t, void* image);
 
+    // pixel unpack buffers that large texture uploads go through, and pixel pack buffers that
+    // read-backs go through, recycled once the GPU is done with them
+    static constexpr size_t UNPACK_BUFFER_MIN_SIZE = 64 * 1024;           // smaller uploads are direct
+    static constexpr size_t PIXEL_BUFFER_POOL_SIZE = 32 * 1024 * 1024;    // bytes kept for reuse
+    struct PixelBuffer {
+        GLuint id = 0;
+        uint32_t capacity = 0;
+    };
+    // target is GL_PIXEL_UNPACK_BUFFER or GL_PIXEL_PACK_BUFFER, the buffer is left bound to it
+    PixelBuffer acquirePixelBuffer(GLenum target, uint32_t size) noexcept;
+    void releasePixelBuffer(GLenum target, PixelBuffer buffer) noexcept;
+    std::vector<PixelBuffer>& getPixelBuffers(GLenum target) noexcept {
+        return target == GL_PIXEL_PACK_BUFFER ? mPackBuffers : mUnpackBuffers;
+    }
+    std::vector<PixelBuffer> mUnpackBuffers;
+    std::vector<PixelBuffer> mPackBuffers;
+
     // tasks executed on the main thread after the fence signaled
     void whenGpuCommandsComplete(std::function<void()> fn) noexcept;
     void executeGpuCommandsCompleteOps() noexcept;
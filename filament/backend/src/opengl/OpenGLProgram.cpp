@@ -18,6 +18,8 @@
 
 #include "OpenGLDriver.h"
 
+#include "private/backend/OpenGLPlatform.h"
+
 #include <utils/Log.h>
 #include <utils/compiler.h>
 #include <utils/Panic.h>
@@ -25,6 +27,13 @@
 #include <private/backend/BackendUtils.h>
 
 #include <cctype>
+#include <string>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
 
 namespace filament {
 
@@ -32,82 +41,131 @@ using namespace filament::math;
 using namespace utils;
 using namespace backend;
 
-OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) noexcept
-        :  HwProgram(programBuilder.getName()), mIsValid(false) {
-
-    using Shader = Program::Shader;
-
-    const auto& shadersSource = programBuilder.getShadersSource();
-
-    // build all shaders
-    #pragma nounroll
-    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
-        GLenum glShaderType;
-        Shader type = (Shader)i;
-        switch (type) {
-            case Shader::VERTEX:
-                glShaderType = GL_VERTEX_SHADER;
-                break;
-            case Shader::FRAGMENT:
-                glShaderType = GL_FRAGMENT_SHADER;
-                break;
+// key of a program binary in the platform's blob cache
+struct ProgramBinaryKey {
+    char prefix[16];        // keeps the keys apart from the ones of other users of the cache
+    uint64_t driverId;
+    uint64_t cacheId;
+    uint64_t variant;
+    uint64_t specializationConstants;   // hash of their values
+};
+
+// the 32-bit representation of a specialization constant, as in SPIR-V
+static uint32_t getSpecializationConstantBits(Program::SpecializationConstant const& constant) {
+    return std::visit([](auto value) {
+        uint32_t bits = 0;
+        if constexpr (std::is_same_v<decltype(value), bool>) {
+            bits = value ? 1u : 0u;
+        } else {
+            memcpy(&bits, &value, sizeof(bits));
         }
+        return bits;
+    }, constant.value);
+}
 
-        if (!shadersSource[i].empty()) {
-            GLint status;
-            auto shader = shadersSource[i];
-            GLint const length = (GLint)shader.size();
+static ProgramBinaryKey getProgramBinaryKey(uint64_t driverId, const Program& builder) noexcept {
+    ProgramBinaryKey key{};
+    memcpy(key.prefix, "filament.glprog", sizeof("filament.glprog"));
+    key.driverId = driverId;
+    key.cacheId = builder.getCacheId();
+    key.variant = builder.getVariant();
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (auto const& constant : builder.getSpecializationConstants()) {
+        for (uint32_t word : { constant.id, getSpecializationConstantBits(constant) }) {
+            hash = (hash ^ word) * 0x100000001b3ull;
+        }
+    }
+    key.specializationConstants = hash;
+    return key;
+}
 
-#ifndef NDEBUG
-            // If usages of the Google-style line directive are present, remove them, as some
-            // drivers don't allow the quotation marks.
-            if (requestsGoogleLineDirectivesExtension((const char*) shader.data(), length)) {
-                auto temp = shader;
-                removeGoogleLineDirectives((char*) temp.data(), length);    // length is unaffected
-                shader = std::move(temp);
+// Defines the specialization constants the way SPIRV-Cross declares them in GLSL, e.g.
+// "#define SPIRV_CROSS_CONSTANT_ID_0 true".
+static std::string getSpecializationConstantDefines(const Program& builder) {
+    std::string defines;
+    for (auto const& constant : builder.getSpecializationConstants()) {
+        char value[32];
+        std::visit([&value](auto v) {
+            using T = decltype(v);
+            if constexpr (std::is_same_v<T, bool>) {
+                snprintf(value, sizeof(value), "%s", v ? "true" : "false");
+            } else if constexpr (std::is_same_v<T, float>) {
+                // GLSL ES doesn't convert integer literals to float
+                int n = snprintf(value, sizeof(value), "%.9g", v);
+                if (!strpbrk(value, ".eni") && n + 2 < int(sizeof(value))) {
+                    strcat(value, ".0");
+                }
+            } else {
+                snprintf(value, sizeof(value), "%d", v);
             }
-#endif
+        }, constant.value);
+        defines += "#define SPIRV_CROSS_CONSTANT_ID_" + std::to_string(constant.id) + " " +
+                value + "\n";
+    }
+    return defines;
+}
 
-            const char * const source = (const char*)shader.data();
+OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, Program&& programBuilder) noexcept
+        :  HwProgram(programBuilder.getName()), mIsValid(false),
+           mSkipDrawsUntilReady(programBuilder.skipsDrawsUntilReady()) {
 
-            GLuint shaderId = glCreateShader(glShaderType);
-            glShaderSource(shaderId, 1, &source, &length);
-            glCompileShader(shaderId);
+    // programs are only cached if the material provided an id and the driver supports it
+    const bool cached = gl->mProgramBinaryDriverId && programBuilder.getCacheId();
 
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
-            this->gl.shaders[i] = shaderId;
-            mValidShaderSet |= 1U << i;
+    if (cached) {
+        this->gl.program = loadProgramBinary(gl, programBuilder);
+        if (this->gl.program) {
+            initialize(gl, programBuilder, false);
+            return;
         }
     }
 
-    // we need at least a vertex and fragment program
-    const uint8_t validShaderSet = mValidShaderSet;
-    const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
-        GLuint program = glCreateProgram();
-        for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
-            if (validShaderSet & (1U << i)) {
-                glAttachShader(program, this->gl.shaders[i]);
-            }
-        }
-        glLinkProgram(program);
+    this->gl.program = compileProgram(programBuilder, cached);
+
+    if (this->gl.program && gl->getContext().ext.KHR_parallel_shader_compile) {
+        // The driver compiles and links the program in the background, and querying its status
+        // would wait for it, so we only do that when the program is first used.
+        mPendingBuilder = std::make_unique<Program>(std::move(programBuilder));
+        mStoreBinary = cached;
+        return;
+    }
+
+    initialize(gl, programBuilder, cached);
+}
 
+bool OpenGLProgram::isReady() const noexcept {
+    if (!mPendingBuilder) {
+        return true;
+    }
+    GLint status = GL_FALSE;
+    glGetProgramiv(gl.program, GL_COMPLETION_STATUS_KHR, &status);
+    return status == GL_TRUE;
+}
+
+void OpenGLProgram::resolve(OpenGLDriver* gl) noexcept {
+    assert(mPendingBuilder);
+    initialize(gl, *mPendingBuilder, mStoreBinary);
+    mPendingBuilder.reset();
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl, const Program& programBuilder,
+        bool storeBinary) noexcept {
+    GLuint program = this->gl.program;
+    if (UTILS_LIKELY(program)) {
+        GLint status;
         glGetProgramiv(program, GL_LINK_STATUS, &status);
         if (UTILS_UNLIKELY(status != GL_TRUE)) {
-            char error[512];
-            glGetProgramInfoLog(program, sizeof(error), nullptr, error);
-
-            slog.e << "LINKING: " << error << io::endl;
+            logLinkingError(programBuilder);
             glDeleteProgram(program);
-            return;
+            this->gl.program = program = 0;
+        }
+    }
+
+    if (UTILS_LIKELY(program)) {
+        if (storeBinary) {
+            storeProgramBinary(gl, programBuilder, program);
         }
-        this->gl.program = program;
 
         // Associate each UniformBlock in the program to a known binding.
         auto const& uniformBlockInfo = programBuilder.getUniformBlockInfo();
@@ -167,12 +225,174 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
 
     // Failing to compile a program can't be fatal, because this will happen a lot in
     // the material tools. We need to have a better way to handle these errors and
-    // return to the editor. Also note the early "return" statements in this function.
+    // return to the editor.
     if (UTILS_UNLIKELY(!isValid())) {
         PANIC_LOG("Failed to compile GLSL program.");
     }
 }
 
+GLuint OpenGLProgram::compileProgram(const Program& programBuilder, bool retrievable) noexcept {
+    using Shader = Program::Shader;
+
+    const auto& shadersSource = programBuilder.getShadersSource();
+    const std::string specializationConstants = getSpecializationConstantDefines(programBuilder);
+
+    // build all shaders, their status is checked with the program's, see logLinkingError()
+    #pragma nounroll
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+        GLenum glShaderType;
+        Shader type = (Shader)i;
+        switch (type) {
+            case Shader::VERTEX:
+                glShaderType = GL_VERTEX_SHADER;
+                break;
+            case Shader::FRAGMENT:
+                glShaderType = GL_FRAGMENT_SHADER;
+                break;
+            case Shader::COMPUTE:
+#if GLES31_HEADERS || GL43_HEADERS
+                glShaderType = GL_COMPUTE_SHADER;
+                break;
+#else
+                // compute shaders can't be compiled without GLES 3.1 or GL 4.3 headers, the
+                // program will be invalid
+                continue;
+#endif
+        }
+
+        if (!shadersSource[i].empty()) {
+            auto shader = shadersSource[i];
+            GLint const length = (GLint)shader.size();
+
+#ifndef NDEBUG
+            // If usages of the Google-style line directive are present, remove them, as some
+            // drivers don't allow the quotation marks.
+            if (requestsGoogleLineDirectivesExtension((const char*) shader.data(), length)) {
+                auto temp = shader;
+                removeGoogleLineDirectives((char*) temp.data(), length);    // length is unaffected
+                shader = std::move(temp);
+            }
+#endif
+
+            const char * const source = (const char*)shader.data();
+
+            GLuint shaderId = glCreateShader(glShaderType);
+            if (specializationConstants.empty()) {
+                glShaderSource(shaderId, 1, &source, &length);
+            } else {
+                // the constants are defined after the #version directive, which must be first
+                const char* const eol = (const char*)memchr(source, '\n', size_t(length));
+                const GLint versionLength = eol ? GLint(eol - source + 1) : 0;
+                const char* const sources[3] = {
+                        source, specializationConstants.c_str(), source + versionLength };
+                const GLint lengths[3] = {
+                        versionLength, GLint(specializationConstants.size()),
+                        length - versionLength };
+                glShaderSource(shaderId, 3, sources, lengths);
+            }
+            glCompileShader(shaderId);
+
+            this->gl.shaders[i] = shaderId;
+            mValidShaderSet |= 1U << i;
+        }
+    }
+
+    // we need at least a vertex and fragment program, or only a compute program
+    const uint8_t validShaderSet = mValidShaderSet;
+    const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
+    if (UTILS_UNLIKELY((validShaderSet & mask) != mask && validShaderSet != COMPUTE_SHADER_BIT)) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+        if (validShaderSet & (1U << i)) {
+            glAttachShader(program, this->gl.shaders[i]);
+        }
+    }
+    if (retrievable) {
+        // some drivers only keep the binary of programs linked with this hint
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+    return program;
+}
+
+void OpenGLProgram::logLinkingError(const Program& programBuilder) const noexcept {
+    // report the shaders that failed to compile, if any, or the linking error
+    const auto& shadersSource = programBuilder.getShadersSource();
+    bool compilationFailed = false;
+    for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
+        if (mValidShaderSet & (1U << i)) {
+            GLint status;
+            glGetShaderiv(gl.shaders[i], GL_COMPILE_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                // the source isn't null-terminated
+                std::string source((const char*)shadersSource[i].data(), shadersSource[i].size());
+                logCompilationError(slog.e, gl.shaders[i], source.c_str());
+                compilationFailed = true;
+            }
+        }
+    }
+    if (!compilationFailed) {
+        char error[512];
+        glGetProgramInfoLog(gl.program, sizeof(error), nullptr, error);
+        slog.e << "LINKING: " << error << io::endl;
+    }
+}
+
+GLuint OpenGLProgram::loadProgramBinary(OpenGLDriver* gl, const Program& programBuilder) noexcept {
+    const ProgramBinaryKey key = getProgramBinaryKey(gl->mProgramBinaryDriverId, programBuilder);
+    OpenGLPlatform& platform = gl->mPlatform;
+
+    // the value is the binary format followed by the binary
+    const size_t size = platform.retrieveBlob(&key, sizeof(key), nullptr, 0);
+    if (size <= sizeof(GLenum)) {
+        return 0;
+    }
+    std::vector<uint8_t> blob(size);
+    if (platform.retrieveBlob(&key, sizeof(key), blob.data(), size) != size) {
+        return 0;
+    }
+    GLenum format;
+    memcpy(&format, blob.data(), sizeof(format));
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, blob.data() + sizeof(format), GLsizei(size - sizeof(format)));
+
+    // the driver can reject a binary at any time (e.g. after an update), then we just compile
+    // the program again, and its new binary replaces the old one
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        // consume the error glProgramBinary() may have generated
+        glGetError();
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void OpenGLProgram::storeProgramBinary(OpenGLDriver* gl, const Program& programBuilder,
+        GLuint program) noexcept {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    GLenum format = 0;
+    std::vector<uint8_t> blob(sizeof(format) + size_t(length));
+    glGetProgramBinary(program, length, &length, &format, blob.data() + sizeof(format));
+    if (length <= 0) {
+        return;
+    }
+    memcpy(blob.data(), &format, sizeof(format));
+
+    const ProgramBinaryKey key = getProgramBinaryKey(gl->mProgramBinaryDriverId, programBuilder);
+    gl->mPlatform.insertBlob(&key, sizeof(key), blob.data(), sizeof(format) + size_t(length));
+}
+
 OpenGLProgram::~OpenGLProgram() noexcept {
     const size_t validShaderSet = mValidShaderSet;
     const bool isValid = mIsValid;
@@ -26,6 +26,7 @@
 #include <utils/compiler.h>
 #include <utils/Log.h>
 
+#include <memory>
 #include <vector>
 
 #include <stddef.h>
@@ -38,33 +39,41 @@ class OpenGLProgram : public backend::HwProgram {
 public:
 
     OpenGLProgram() noexcept = default;
-    OpenGLProgram(OpenGLDriver* gl, const backend::Program& builder) noexcept;
+    OpenGLProgram(OpenGLDriver* gl, backend::Program&& builder) noexcept;
     ~OpenGLProgram() noexcept;
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // With KHR_parallel_shader_compile, a program is pending until resolve() is called. Until
+    // then its link status is unknown, and isReady() tells whether resolve() would wait for the
+    // compiler without that.
+    bool isPending() const noexcept { return bool(mPendingBuilder); }
+    bool isReady() const noexcept;
+    void resolve(OpenGLDriver* gl) noexcept;
+
+    // whether draws can be skipped while the program is pending and not ready
+    bool skipsDrawsUntilReady() const noexcept { return mSkipDrawsUntilReady; }
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
-            // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
-            // calls.
-
-            // we need to do this if:
+            // GL state tracking avoids unnecessary glBindTexture / glBindSampler calls, but
+            // walking our samplers isn't free either. We only need to do it if since the last
+            // time we used this program:
             // - the content of mSamplerBindings has changed
-            // - the content of any bound sampler buffer has changed
-            // ... since last time we used this program
-
-            // turns out the former might be relatively cheap to check, the later requires
-            // a bit less. Compared to what updateSamplers() actually does, which is
-            // pretty little, I'm not sure we'll get ahead.
-
-            updateSamplers(gl);
+            // - the content of any bound sampler group has changed
+            // - any texture unit was bound to something else
+            // the driver tracks all of this.
+            if (!gl->areSamplersBound(this)) {
+                updateSamplers(gl);
+                gl->setSamplersBound(this);
+            }
         }
     }
 
     struct {
         GLuint shaders[backend::Program::SHADER_TYPE_COUNT];
         GLuint program;
-    } gl; // 12 bytes
+    } gl; // 16 bytes
 
     static void logCompilationError(utils::io::ostream& out, GLuint shaderId, char const* source) noexcept;
 
@@ -72,6 +81,7 @@ private:
     static constexpr uint8_t TEXTURE_UNIT_COUNT = OpenGLContext::MAX_TEXTURE_UNIT_COUNT;
     static constexpr uint8_t VERTEX_SHADER_BIT   = uint8_t(1) << size_t(backend::Program::Shader::VERTEX);
     static constexpr uint8_t FRAGMENT_SHADER_BIT = uint8_t(1) << size_t(backend::Program::Shader::FRAGMENT);
+    static constexpr uint8_t COMPUTE_SHADER_BIT  = uint8_t(1) << size_t(backend::Program::Shader::COMPUTE);
 
     struct BlockInfo {
         uint8_t binding : 3;    // binding (i.e.: index in mSamplerBindings)
@@ -88,6 +98,11 @@ private:
     uint8_t mUsedBindingsCount = 0;
     uint8_t mValidShaderSet = 0;
     bool mIsValid = false;
+    bool mSkipDrawsUntilReady = false;
+    bool mStoreBinary = false;
+
+    // the program's description, kept until the program is resolved
+    std::unique_ptr<backend::Program> mPendingBuilder;
 
     // information about each USED sampler buffer (no gaps)
     std::array<BlockInfo, backend::Program::SAMPLER_BINDING_COUNT> mBlockInfos;   // 8 bytes
@@ -96,6 +111,22 @@ private:
     std::array<uint8_t, TEXTURE_UNIT_COUNT> mIndicesRuns;    // 16 bytes
 
     void updateSamplers(OpenGLDriver* gl) noexcept;
+
+    // checks the link status, then sets up uniform blocks and samplers
+    void initialize(OpenGLDriver* gl, const backend::Program& programBuilder,
+            bool storeBinary) noexcept;
+
+    // starts compiling and linking the program, returns 0 if it has no valid set of shaders
+    GLuint compileProgram(const backend::Program& programBuilder, bool retrievable) noexcept;
+
+    void logLinkingError(const backend::Program& programBuilder) const noexcept;
+
+    // program binaries are cached with the platform's blob functions, loadProgramBinary()
+    // returns 0 if there is no usable binary for this program
+    static GLuint loadProgramBinary(OpenGLDriver* gl,
+            const backend::Program& programBuilder) noexcept;
+    static void storeProgramBinary(OpenGLDriver* gl,
+            const backend::Program& programBuilder, GLuint program) noexcept;
 };
 
 
@@ -33,6 +33,7 @@ public:
     ~PlatformCocoaGL() noexcept final;
 
     backend::Driver* createDriver(void* sharedContext) noexcept override;
+    void* getSharedContext() noexcept final;
     void terminate() noexcept final;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final;
@@ -76,6 +76,10 @@ Driver* PlatformCocoaGL::createDriver(void* sharedContext) noexcept {
     return OpenGLDriverFactory::create(this, sharedContext);
 }
 
+void* PlatformCocoaGL::getSharedContext() noexcept {
+    return (__bridge void*) pImpl->mGLContext;
+}
+
 void PlatformCocoaGL::terminate() noexcept {
     pImpl->mGLContext = nil;
     bluegl::unbind();
@@ -33,6 +33,7 @@ public:
     ~PlatformCocoaTouchGL() noexcept final;
 
     backend::Driver* createDriver(void* sharedGLContext) noexcept override;
+    void* getSharedContext() noexcept final;
     void terminate() noexcept final;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final;
@@ -94,6 +94,11 @@ Driver* PlatformCocoaTouchGL::createDriver(void* const sharedGLContext) noexcept
     return OpenGLDriverFactory::create(this, sharedGLContext);
 }
 
+void* PlatformCocoaTouchGL::getSharedContext() noexcept {
+    // createDriver() takes the sharegroup of the context, not the context itself
+    return (__bridge void*) pImpl->mGLContext.sharegroup;
+}
+
 void PlatformCocoaTouchGL::terminate() noexcept {
     CFRelease(pImpl->mTextureCache);
     pImpl->mGLContext = nil;
@@ -34,6 +34,7 @@ public:
     PlatformEGL() noexcept;
 
     backend::Driver* createDriver(void* sharedContext) noexcept override;
+    void* getSharedContext() noexcept override { return mEGLContext; }
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept override;
@@ -34,6 +34,7 @@ class PlatformGLX final : public backend::OpenGLPlatform {
 public:
 
     backend::Driver* createDriver(void* const sharedGLContext) noexcept override;
+    void* getSharedContext() noexcept override { return mGLXContext; }
 
     void terminate() noexcept override;
 
@@ -26,6 +26,13 @@ namespace glext {
 PFNGLSTARTTILINGQCOMPROC glStartTilingQCOM;
 PFNGLENDTILINGQCOMPROC glEndTilingQCOM;
 #endif
+#ifdef GL_QCOM_framebuffer_foveated
+PFNGLFRAMEBUFFERFOVEATIONCONFIGQCOMPROC glFramebufferFoveationConfigQCOM;
+PFNGLFRAMEBUFFERFOVEATIONPARAMETERSQCOMPROC glFramebufferFoveationParametersQCOM;
+#endif
+#ifdef GL_OVR_multiview
+PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR;
+#endif
 #ifdef GL_OES_EGL_image
 PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 #endif
@@ -48,6 +55,12 @@ PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64v;
 #ifdef GL_EXT_clip_control
 PFNGLCLIPCONTROLEXTPROC glClipControl;
 #endif
+#ifdef GL_EXT_buffer_storage
+PFNGLBUFFERSTORAGEEXTPROC glBufferStorage;
+#endif
+#ifdef GL_EXT_multi_draw_indirect
+PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC glMultiDrawElementsIndirect;
+#endif
 
 static std::once_flag sGlExtInitialized;
 
@@ -63,6 +76,22 @@ void importGLESExtensionsEntryPoints() {
                         "glEndTilingQCOM");
 #endif
 
+#ifdef GL_QCOM_framebuffer_foveated
+        glFramebufferFoveationConfigQCOM =
+                (PFNGLFRAMEBUFFERFOVEATIONCONFIGQCOMPROC)eglGetProcAddress(
+                        "glFramebufferFoveationConfigQCOM");
+
+        glFramebufferFoveationParametersQCOM =
+                (PFNGLFRAMEBUFFERFOVEATIONPARAMETERSQCOMPROC)eglGetProcAddress(
+                        "glFramebufferFoveationParametersQCOM");
+#endif
+
+#ifdef GL_OVR_multiview
+        glFramebufferTextureMultiviewOVR =
+                (PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)eglGetProcAddress(
+                        "glFramebufferTextureMultiviewOVR");
+#endif
+
 #ifdef GL_OES_EGL_image
         glEGLImageTargetTexture2DOES =
                 (PFNGLEGLIMAGETARGETTEXTURE2DOESPROC)eglGetProcAddress(
@@ -102,6 +131,16 @@ void importGLESExtensionsEntryPoints() {
         glGetQueryObjectui64v =
                 (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
                         "glGetQueryObjectui64vEXT");
+#endif
+#ifdef GL_EXT_buffer_storage
+        glBufferStorage =
+                (PFNGLBUFFERSTORAGEEXTPROC)eglGetProcAddress(
+                        "glBufferStorageEXT");
+#endif
+#ifdef GL_EXT_multi_draw_indirect
+        glMultiDrawElementsIndirect =
+                (PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC)eglGetProcAddress(
+                        "glMultiDrawElementsIndirectEXT");
 #endif
     });
 #ifdef GL_EXT_clip_control
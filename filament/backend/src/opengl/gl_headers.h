@@ -32,6 +32,13 @@
         extern PFNGLSTARTTILINGQCOMPROC glStartTilingQCOM;
         extern PFNGLENDTILINGQCOMPROC glEndTilingQCOM;
 #endif
+#ifdef GL_QCOM_framebuffer_foveated
+        extern PFNGLFRAMEBUFFERFOVEATIONCONFIGQCOMPROC glFramebufferFoveationConfigQCOM;
+        extern PFNGLFRAMEBUFFERFOVEATIONPARAMETERSQCOMPROC glFramebufferFoveationParametersQCOM;
+#endif
+#ifdef GL_OVR_multiview
+        extern PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR;
+#endif
 #ifdef GL_OES_EGL_image
         extern PFNGLEGLIMAGETARGETTEXTURE2DOESPROC glEGLImageTargetTexture2DOES;
 #endif
@@ -60,6 +67,18 @@
         #ifndef GL_ZERO_TO_ONE
         #define GL_ZERO_TO_ONE GL_ZERO_TO_ONE_EXT
         #endif
+#endif
+#ifdef GL_EXT_buffer_storage
+        extern PFNGLBUFFERSTORAGEEXTPROC glBufferStorage;
+        #ifndef GL_MAP_PERSISTENT_BIT
+        #define GL_MAP_PERSISTENT_BIT GL_MAP_PERSISTENT_BIT_EXT
+        #endif
+        #ifndef GL_MAP_COHERENT_BIT
+        #define GL_MAP_COHERENT_BIT GL_MAP_COHERENT_BIT_EXT
+        #endif
+#endif
+#ifdef GL_EXT_multi_draw_indirect
+        extern PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC glMultiDrawElementsIndirect;
 #endif
     }
 
@@ -111,6 +130,11 @@
 #define GL_TEXTURE_EXTERNAL_OES           0x8D65
 #endif
 
+// We only need the enum of KHR_parallel_shader_compile (the same as ARB_parallel_shader_compile's)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR          0x91B1
+#endif
+
 #include "NullGLES.h"
 
 #if (!defined(GL_ES_VERSION_3_0) && !defined(GL_VERSION_4_1))
@@ -135,4 +159,10 @@
 #define GL41_HEADERS false
 #endif
 
+#if defined(GL_VERSION_4_3)
+#define GL43_HEADERS true
+#else
+#define GL43_HEADERS false
+#endif
+
 #endif // TNT_FILAMENT_DRIVER_GL_HEADERS_H
@@ -22,6 +22,7 @@
 
 #include <bluevk/BlueVK.h>
 
+#include <android/hardware_buffer.h>
 #include <android/native_window.h>
 
 namespace filament {
@@ -38,6 +39,7 @@ Driver* PlatformVkAndroid::createDriver(void* const sharedContext) noexcept {
         "VK_KHR_surface",
         "VK_KHR_android_surface",
         "VK_KHR_get_physical_device_properties2",
+        "VK_KHR_external_memory_capabilities",
 
 #if VK_ENABLE_VALIDATION
         "VK_EXT_debug_report",
@@ -60,4 +62,130 @@ void* PlatformVkAndroid::createVkSurfaceKHR(void* nativeWindow, void* vkinstance
     return (void*) surface;
 }
 
+const char* const* PlatformVkAndroid::getExternalImageExtensions(uint32_t* count) const noexcept {
+    static const char* extensions[] = {
+        "VK_ANDROID_external_memory_android_hardware_buffer",
+        "VK_KHR_sampler_ycbcr_conversion",
+        "VK_KHR_external_memory",
+        "VK_KHR_dedicated_allocation",
+        "VK_KHR_get_memory_requirements2",
+        "VK_KHR_bind_memory2",
+        "VK_KHR_maintenance1",
+        "VK_EXT_queue_family_foreign",
+    };
+    *count = sizeof(extensions) / sizeof(extensions[0]);
+    return extensions;
+}
+
+bool PlatformVkAndroid::importExternalImage(VkPhysicalDevice physicalDevice, VkDevice device,
+        void* image, ExternalImage* out) noexcept {
+    AHardwareBuffer* buffer = (AHardwareBuffer*) image;
+    AHardwareBuffer_Desc desc;
+    AHardwareBuffer_describe(buffer, &desc);
+
+    VkAndroidHardwareBufferFormatPropertiesANDROID formatProperties = {
+        .sType = VK_STRUCTURE_TYPE_ANDROID_HARDWARE_BUFFER_FORMAT_PROPERTIES_ANDROID
+    };
+    VkAndroidHardwareBufferPropertiesANDROID properties = {
+        .sType = VK_STRUCTURE_TYPE_ANDROID_HARDWARE_BUFFER_PROPERTIES_ANDROID,
+        .pNext = &formatProperties
+    };
+    if (vkGetAndroidHardwareBufferPropertiesANDROID(device, buffer, &properties) != VK_SUCCESS) {
+        return false;
+    }
+
+    // Camera and video buffers typically have a format only known to the driver, which can only
+    // be sampled through a YCbCr conversion.
+    const bool external = formatProperties.format == VK_FORMAT_UNDEFINED;
+    VkExternalFormatANDROID externalFormat = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_FORMAT_ANDROID,
+        .externalFormat = external ? formatProperties.externalFormat : 0
+    };
+    VkExternalMemoryImageCreateInfo externalInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+        .pNext = &externalFormat,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_ANDROID_HARDWARE_BUFFER_BIT_ANDROID
+    };
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &externalInfo,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = formatProperties.format,
+        .extent = { desc.width, desc.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VkImage vkimage;
+    if (vkCreateImage(device, &imageInfo, VKALLOC, &vkimage) != VK_SUCCESS) {
+        return false;
+    }
+
+    // The memory of the buffer is imported as a dedicated allocation, which holds a reference to
+    // the buffer until it is freed.
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    uint32_t memoryTypeIndex = 0;
+    while (memoryTypeIndex < memoryProperties.memoryTypeCount &&
+            !(properties.memoryTypeBits & (1u << memoryTypeIndex))) {
+        memoryTypeIndex++;
+    }
+    VkImportAndroidHardwareBufferInfoANDROID importInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_ANDROID_HARDWARE_BUFFER_INFO_ANDROID,
+        .buffer = buffer
+    };
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .pNext = &importInfo,
+        .image = vkimage
+    };
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &dedicatedInfo,
+        .allocationSize = properties.allocationSize,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    VkDeviceMemory memory;
+    if (memoryTypeIndex == memoryProperties.memoryTypeCount ||
+            vkAllocateMemory(device, &allocInfo, VKALLOC, &memory) != VK_SUCCESS) {
+        vkDestroyImage(device, vkimage, VKALLOC);
+        return false;
+    }
+    if (vkBindImageMemory(device, vkimage, memory, 0) != VK_SUCCESS) {
+        vkDestroyImage(device, vkimage, VKALLOC);
+        vkFreeMemory(device, memory, VKALLOC);
+        return false;
+    }
+
+    *out = {
+        .image = vkimage,
+        .memory = memory,
+        .format = formatProperties.format,
+        .externalFormat = externalFormat.externalFormat,
+        .features = formatProperties.formatFeatures,
+        .width = desc.width,
+        .height = desc.height,
+        .queueFamily = VK_QUEUE_FAMILY_FOREIGN_EXT,
+        .ycbcr = external || desc.format == AHARDWAREBUFFER_FORMAT_Y8Cb8Cr8_420,
+        .ycbcrModel = formatProperties.suggestedYcbcrModel,
+        .ycbcrRange = formatProperties.suggestedYcbcrRange,
+        .components = formatProperties.samplerYcbcrConversionComponents,
+        .xChromaOffset = formatProperties.suggestedXChromaOffset,
+        .yChromaOffset = formatProperties.suggestedYChromaOffset
+    };
+    return true;
+}
+
+void PlatformVkAndroid::retainExternalImage(void* image) noexcept {
+    AHardwareBuffer_acquire((AHardwareBuffer*) image);
+}
+
+void PlatformVkAndroid::releaseExternalImage(void* image) noexcept {
+    AHardwareBuffer_release((AHardwareBuffer*) image);
+}
+
 } // namespace filament
@@ -31,6 +31,13 @@ public:
 
     void* createVkSurfaceKHR(void* nativeWindow, void* instance, uint64_t flags) noexcept override;
 
+    // External images are AHardwareBuffers.
+    const char* const* getExternalImageExtensions(uint32_t* count) const noexcept override;
+    bool importExternalImage(VkPhysicalDevice physicalDevice, VkDevice device,
+            void* image, ExternalImage* out) noexcept override;
+    void retainExternalImage(void* image) noexcept override;
+    void releaseExternalImage(void* image) noexcept override;
+
     int getOSVersion() const noexcept override { return 0; }
 };
 
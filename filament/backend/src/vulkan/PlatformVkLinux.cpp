@@ -23,6 +23,7 @@
 #include <bluevk/BlueVK.h>
 
 #include <dlfcn.h>
+#include <unistd.h>
 
 namespace filament {
 
@@ -64,6 +65,7 @@ Driver* PlatformVkLinux::createDriver(void* const sharedContext) noexcept {
         "VK_KHR_xlib_surface",
 #endif
         "VK_KHR_get_physical_device_properties2",
+        "VK_KHR_external_memory_capabilities",
 #if VK_ENABLE_VALIDATION
         "VK_EXT_debug_utils",
 #endif
@@ -126,4 +128,149 @@ const bool windowIsXCB = true;
     return surface;
 }
 
+const char* const* PlatformVkLinux::getExternalImageExtensions(uint32_t* count) const noexcept {
+    static const char* extensions[] = {
+        "VK_KHR_external_memory",
+        "VK_KHR_external_memory_fd",
+        "VK_EXT_external_memory_dma_buf",
+        "VK_EXT_image_drm_format_modifier",
+        "VK_KHR_image_format_list",
+        "VK_KHR_sampler_ycbcr_conversion",
+        "VK_KHR_dedicated_allocation",
+        "VK_KHR_get_memory_requirements2",
+        "VK_KHR_bind_memory2",
+        "VK_KHR_maintenance1",
+    };
+    *count = sizeof(extensions) / sizeof(extensions[0]);
+    return extensions;
+}
+
+static constexpr uint32_t fourcc(char a, char b, char c, char d) {
+    return uint32_t(a) | (uint32_t(b) << 8) | (uint32_t(c) << 16) | (uint32_t(d) << 24);
+}
+
+static VkFormat getDmaBufFormat(uint32_t code) {
+    switch (code) {
+        case fourcc('N', 'V', '1', '2'): return VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+        case fourcc('A', 'R', '2', '4'): return VK_FORMAT_B8G8R8A8_UNORM;
+        case fourcc('X', 'R', '2', '4'): return VK_FORMAT_B8G8R8A8_UNORM;
+        case fourcc('A', 'B', '2', '4'): return VK_FORMAT_R8G8B8A8_UNORM;
+        case fourcc('X', 'B', '2', '4'): return VK_FORMAT_R8G8B8A8_UNORM;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+bool PlatformVkLinux::importExternalImage(VkPhysicalDevice physicalDevice, VkDevice device,
+        void* image, ExternalImage* out) noexcept {
+    DmaBufImage const& dmabuf = *(DmaBufImage const*) image;
+    const VkFormat format = getDmaBufFormat(dmabuf.fourcc);
+    if (format == VK_FORMAT_UNDEFINED || dmabuf.planeCount == 0 || dmabuf.planeCount > 3) {
+        return false;
+    }
+
+    // The layout of the planes is given by the modifier, and by their offsets and strides.
+    VkSubresourceLayout planeLayouts[3] = {};
+    for (uint32_t i = 0; i < dmabuf.planeCount; i++) {
+        planeLayouts[i].offset = dmabuf.planes[i].offset;
+        planeLayouts[i].rowPitch = dmabuf.planes[i].stride;
+    }
+    VkImageDrmFormatModifierExplicitCreateInfoEXT modifierInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_EXPLICIT_CREATE_INFO_EXT,
+        .drmFormatModifier = dmabuf.modifier,
+        .drmFormatModifierPlaneCount = dmabuf.planeCount,
+        .pPlaneLayouts = planeLayouts
+    };
+    VkExternalMemoryImageCreateInfo externalInfo = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO,
+        .pNext = &modifierInfo,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT
+    };
+    VkImageCreateInfo imageInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .pNext = &externalInfo,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { dmabuf.width, dmabuf.height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT,
+        .usage = VK_IMAGE_USAGE_SAMPLED_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VkImage vkimage;
+    if (vkCreateImage(device, &imageInfo, VKALLOC, &vkimage) != VK_SUCCESS) {
+        return false;
+    }
+
+    // A successful import takes ownership of the file descriptor, so we give it a duplicate.
+    VkMemoryFdPropertiesKHR fdProperties = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_FD_PROPERTIES_KHR
+    };
+    vkGetMemoryFdPropertiesKHR(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+            dmabuf.fd, &fdProperties);
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(device, vkimage, &memReqs);
+    const uint32_t memoryTypeBits = memReqs.memoryTypeBits & fdProperties.memoryTypeBits;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    uint32_t memoryTypeIndex = 0;
+    while (memoryTypeIndex < memoryProperties.memoryTypeCount &&
+            !(memoryTypeBits & (1u << memoryTypeIndex))) {
+        memoryTypeIndex++;
+    }
+    const int fd = memoryTypeIndex < memoryProperties.memoryTypeCount ? dup(dmabuf.fd) : -1;
+    VkImportMemoryFdInfoKHR importInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMPORT_MEMORY_FD_INFO_KHR,
+        .handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT,
+        .fd = fd
+    };
+    VkMemoryDedicatedAllocateInfo dedicatedInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+        .pNext = &importInfo,
+        .image = vkimage
+    };
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext = &dedicatedInfo,
+        .allocationSize = memReqs.size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+    VkDeviceMemory memory;
+    if (fd < 0 || vkAllocateMemory(device, &allocInfo, VKALLOC, &memory) != VK_SUCCESS) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        vkDestroyImage(device, vkimage, VKALLOC);
+        return false;
+    }
+    if (vkBindImageMemory(device, vkimage, memory, 0) != VK_SUCCESS) {
+        vkDestroyImage(device, vkimage, VKALLOC);
+        vkFreeMemory(device, memory, VKALLOC);
+        return false;
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    const bool ycbcr = format == VK_FORMAT_G8_B8R8_2PLANE_420_UNORM;
+    *out = {
+        .image = vkimage,
+        .memory = memory,
+        .format = format,
+        .features = formatProperties.optimalTilingFeatures,
+        .width = dmabuf.width,
+        .height = dmabuf.height,
+        .ycbcr = ycbcr,
+        .ycbcrModel = !ycbcr ? VK_SAMPLER_YCBCR_MODEL_CONVERSION_RGB_IDENTITY :
+                dmabuf.bt709 ? VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_709 :
+                VK_SAMPLER_YCBCR_MODEL_CONVERSION_YCBCR_601,
+        .ycbcrRange = dmabuf.fullRange ? VK_SAMPLER_YCBCR_RANGE_ITU_FULL :
+                VK_SAMPLER_YCBCR_RANGE_ITU_NARROW,
+        .xChromaOffset = VK_CHROMA_LOCATION_COSITED_EVEN,
+        .yChromaOffset = VK_CHROMA_LOCATION_MIDPOINT
+    };
+    return true;
+}
+
 } // namespace filament
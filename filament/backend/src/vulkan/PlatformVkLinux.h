@@ -39,6 +39,11 @@ public:
 
     void* createVkSurfaceKHR(void* nativeWindow, void* instance, uint64_t flags) noexcept override;
 
+    // External images are dma-bufs described by a backend::DmaBufImage.
+    const char* const* getExternalImageExtensions(uint32_t* count) const noexcept override;
+    bool importExternalImage(VkPhysicalDevice physicalDevice, VkDevice device,
+            void* image, ExternalImage* out) noexcept override;
+
     int getOSVersion() const noexcept override { return 0; }
 
 private:
@@ -19,6 +19,8 @@
 #include <utils/Panic.h>
 #include <utils/trap.h>
 
+#include <algorithm>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
@@ -33,12 +35,9 @@ namespace backend {
 // allocator by passing in a null pointer, and we pinpoint the argument by using the VKALLOC macro.
 static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 
-// Maximum number of descriptor sets that can be allocated by the pool.
-// TODO: Make VulkanBinder robust against a large number of descriptors.
-// There are several approaches we could take to deal with too many descriptors:
-// - Create another pool after hitting the limit of the first pool.
-// - Allow several uniform buffer descriptors to bind simultaneously instead of just one.
-static constexpr uint32_t MAX_DESCRIPTOR_SET_COUNT = 1500;
+// Number of descriptor sets that can be allocated by each pool. Another pool is created when all
+// of them are full, smaller pools are reset sooner since they hold fewer long-lived sets.
+static constexpr uint32_t DESCRIPTOR_POOL_SET_COUNT = 512;
 
 static VulkanBinder::RasterState createDefaultRasterState();
 
@@ -56,137 +55,229 @@ VulkanBinder::VulkanBinder() : mDefaultRasterState(createDefaultRasterState()) {
     mShaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
     mShaderStages[1].pName = "main";
     resetBindings();
-
-    mDescriptorKey = {};
 }
 
 VulkanBinder::~VulkanBinder() {
     destroyCache();
 }
 
-bool VulkanBinder::getOrCreateDescriptors(VkDescriptorSet descriptorSets[3],
-        VkPipelineLayout* pipelineLayout) noexcept {
+uint32_t VulkanBinder::getOrCreateDescriptors(VkDescriptorSet descriptorSets[3],
+        VkPipelineLayout* pipelineLayout,
+        uint32_t uniformBufferOffsets[UBUFFER_BINDING_COUNT]) noexcept {
     // If this method has never been called before, we need to create a new layout object.
     if (!mPipelineLayout) {
         createLayoutsAndDescriptors();
     }
 
-    // If no bindings have been dirtied, update the timestamp (most recent access) and return false
-    // to indicate there's no need to re-bind.
-    if (!mDirtyDescriptor) {
-        assert(mCurrentDescriptorBundle && mCurrentDescriptorBundle->bound);
-        descriptorSets[0] = mCurrentDescriptorBundle->handles[0];
-        descriptorSets[1] = mCurrentDescriptorBundle->handles[1];
-        descriptorSets[2] = mCurrentDescriptorBundle->handles[2];
-        mCurrentDescriptorBundle->timestamp = mCurrentTime;
-        return false;
+    // Select the layouts of the bound immutable samplers. All the sets are bound again with
+    // another pipeline layout, since the sets after the sampler set are disturbed.
+    if (mDirtyLayout) {
+        mDirtyLayout = false;
+        VkDescriptorSetLayout samplerSetLayout = mDescriptorSetLayouts[1];
+        VkPipelineLayout layout = mPipelineLayout;
+        VkSampler samplers[SAMPLER_BINDING_COUNT];
+        bool immutable = false;
+        for (uint32_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
+            samplers[i] = mImmutableSamplers.samplers[i];
+            immutable = immutable || samplers[i] != VK_NULL_HANDLE;
+        }
+        if (immutable) {
+            auto iter = mImmutableSamplerLayouts.find(mImmutableSamplers);
+            if (iter == mImmutableSamplerLayouts.end()) {
+                VkDescriptorSetLayout setLayout = createSamplerSetLayout(samplers);
+                iter = mImmutableSamplerLayouts.insert({ mImmutableSamplers,
+                        { setLayout, createPipelineLayout(setLayout) }}).first;
+            }
+            samplerSetLayout = iter->second.samplerSetLayout;
+            layout = iter->second.pipelineLayout;
+        }
+        mSamplerSetLayout = samplerSetLayout;
+        if (mPipelineKey.layout != layout) {
+            mPipelineKey.layout = layout;
+            mDirtyPipeline = true;
+            mUniformBufferSets.dirty = true;
+            mSamplerSets.dirty = true;
+            mInputAttachmentSets.dirty = true;
+        }
     }
+    *pipelineLayout = mPipelineKey.layout;
 
-    // Release the previously bound descriptor and update its time stamp.
-    if (mCurrentDescriptorBundle) {
-        mCurrentDescriptorBundle->timestamp = mCurrentTime;
-        mCurrentDescriptorBundle->bound = false;
+    // Each of the descriptor sets (uniforms, samplers, and input attachments) is retrieved from
+    // its own cache, and only the ones that changed need to be re-bound.
+    uint32_t dirtySets = 0;
+    const bool dirty[3] = {
+            mUniformBufferSets.dirty, mSamplerSets.dirty, mInputAttachmentSets.dirty };
+    const bool created[3] = {
+            getOrCreateDescriptorSet(mUniformBufferSets, 0, &descriptorSets[0]),
+            getOrCreateDescriptorSet(mSamplerSets, 1, &descriptorSets[1]),
+            getOrCreateDescriptorSet(mInputAttachmentSets, 2, &descriptorSets[2]) };
+    for (uint32_t i = 0; i < 3; i++) {
+        dirtySets |= dirty[i] ? (1u << i) : 0u;
     }
 
-    // If a cached object exists, update the timestamp (most recent access) and return true to
-    // indicate that the caller should call vmCmdBind. Note that robin_map iterators proffer a
-    // value method for obtaining a stable reference.
-    auto iter = mDescriptorBundles.find(mDescriptorKey);
-    if (UTILS_LIKELY(iter != mDescriptorBundles.end())) {
-        mCurrentDescriptorBundle = &iter.value();
-        descriptorSets[0] = mCurrentDescriptorBundle->handles[0];
-        descriptorSets[1] = mCurrentDescriptorBundle->handles[1];
-        descriptorSets[2] = mCurrentDescriptorBundle->handles[2];
-        mCurrentDescriptorBundle->timestamp = mCurrentTime;
-        mCurrentDescriptorBundle->bound = true;
-        mDirtyDescriptor = false;
-        *pipelineLayout = mPipelineLayout;
-        return true;
+    // The offsets of the uniform buffers are dynamic, changing them only re-binds the set.
+    if (mDirtyUniformBufferOffsets) {
+        dirtySets |= 1u;
+        mDirtyUniformBufferOffsets = false;
     }
+    std::copy(std::begin(mUniformBufferOffsets), std::end(mUniformBufferOffsets),
+            uniformBufferOffsets);
 
-    // Allocate one descriptor set for each type: uniforms, samplers, and input attachments.
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = 3;
-    allocInfo.pSetLayouts = mDescriptorSetLayouts;
-    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptorSets);
-    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
-    *pipelineLayout = mPipelineLayout;
-
-    // Here we construct a DescriptorBundle in place, then stash its pointer to allow fast
-    // subsequent calls to getOrCreateDescriptor when nothing has been dirtied. Note that the
-    // robin_map iterator type proffers a "value" method, which returns a stable reference.
-    auto& bundle = mDescriptorBundles.emplace(std::make_pair(mDescriptorKey, DescriptorBundle {
-        .handles = { descriptorSets[0], descriptorSets[1], descriptorSets[2] },
-        .timestamp = mCurrentTime,
-        .bound = true
-    })).first.value();
-
-    mCurrentDescriptorBundle = &bundle;
-    mDirtyDescriptor = false;
-
-    // Mutate the descriptor by setting all non-null bindings.
+    // Mutate the new descriptor sets by setting all non-null bindings.
     uint32_t nwrites = 0;
     VkWriteDescriptorSet* writes = mDescriptorWrites;
-    nwrites = 0;
-    for (uint32_t binding = 0; binding < UBUFFER_BINDING_COUNT; binding++) {
-        if (mDescriptorKey.uniformBuffers[binding]) {
-            VkDescriptorBufferInfo& bufferInfo = mDescriptorBuffers[binding];
-            bufferInfo.buffer = mDescriptorKey.uniformBuffers[binding];
-            bufferInfo.offset = mDescriptorKey.uniformBufferOffsets[binding];
-            bufferInfo.range = mDescriptorKey.uniformBufferSizes[binding];
-            VkWriteDescriptorSet& writeInfo = writes[nwrites++];
-            writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptorBundle->handles[0];
-            writeInfo.dstBinding = binding;
-            writeInfo.dstArrayElement = 0;
-            writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            writeInfo.pImageInfo = nullptr;
-            writeInfo.pBufferInfo = &bufferInfo;
-            writeInfo.pTexelBufferView = nullptr;
+    if (created[0]) {
+        const UniformBufferKey& key = mUniformBufferSets.key;
+        for (uint32_t binding = 0; binding < UBUFFER_BINDING_COUNT; binding++) {
+            if (key.buffers[binding]) {
+                VkDescriptorBufferInfo& bufferInfo = mDescriptorBuffers[binding];
+                bufferInfo.buffer = key.buffers[binding];
+                bufferInfo.offset = 0;
+                bufferInfo.range = key.sizes[binding];
+                VkWriteDescriptorSet& writeInfo = writes[nwrites++];
+                writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeInfo.pNext = nullptr;
+                writeInfo.dstSet = descriptorSets[0];
+                writeInfo.dstBinding = binding;
+                writeInfo.dstArrayElement = 0;
+                writeInfo.descriptorCount = 1;
+                writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+                writeInfo.pImageInfo = nullptr;
+                writeInfo.pBufferInfo = &bufferInfo;
+                writeInfo.pTexelBufferView = nullptr;
+            }
         }
     }
-    for (uint32_t binding = 0; binding < SAMPLER_BINDING_COUNT; binding++) {
-        if (mDescriptorKey.samplers[binding].sampler) {
-            VkDescriptorImageInfo& imageInfo = mDescriptorSamplers[binding];
-            imageInfo = mDescriptorKey.samplers[binding];
-            VkWriteDescriptorSet& writeInfo = writes[nwrites++];
-            writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptorBundle->handles[1];
-            writeInfo.dstBinding = binding;
-            writeInfo.dstArrayElement = 0;
-            writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            writeInfo.pImageInfo = &imageInfo;
-            writeInfo.pBufferInfo = nullptr;
-            writeInfo.pTexelBufferView = nullptr;
+    if (created[1]) {
+        const SamplerKey& key = mSamplerSets.key;
+        for (uint32_t binding = 0; binding < SAMPLER_BINDING_COUNT; binding++) {
+            if (key.samplers[binding].sampler) {
+                VkDescriptorImageInfo& imageInfo = mDescriptorSamplers[binding];
+                imageInfo = key.samplers[binding];
+                VkWriteDescriptorSet& writeInfo = writes[nwrites++];
+                writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeInfo.pNext = nullptr;
+                writeInfo.dstSet = descriptorSets[1];
+                writeInfo.dstBinding = binding;
+                writeInfo.dstArrayElement = 0;
+                writeInfo.descriptorCount = 1;
+                writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                writeInfo.pImageInfo = &imageInfo;
+                writeInfo.pBufferInfo = nullptr;
+                writeInfo.pTexelBufferView = nullptr;
+            }
         }
     }
-    for (uint32_t binding = 0; binding < TARGET_BINDING_COUNT; binding++) {
-        if (mDescriptorKey.inputAttachments[binding].imageView) {
-            VkDescriptorImageInfo& imageInfo = mDescriptorInputAttachments[binding];
-            imageInfo = mDescriptorKey.inputAttachments[binding];
-            VkWriteDescriptorSet& writeInfo = writes[nwrites++];
-            writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptorBundle->handles[2];
-            writeInfo.dstBinding = binding;
-            writeInfo.dstArrayElement = 0;
-            writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
-            writeInfo.pImageInfo = &imageInfo;
-            writeInfo.pBufferInfo = nullptr;
-            writeInfo.pTexelBufferView = nullptr;
+    if (created[2]) {
+        const InputAttachmentKey& key = mInputAttachmentSets.key;
+        for (uint32_t binding = 0; binding < TARGET_BINDING_COUNT; binding++) {
+            if (key.inputAttachments[binding].imageView) {
+                VkDescriptorImageInfo& imageInfo = mDescriptorInputAttachments[binding];
+                imageInfo = key.inputAttachments[binding];
+                VkWriteDescriptorSet& writeInfo = writes[nwrites++];
+                writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writeInfo.pNext = nullptr;
+                writeInfo.dstSet = descriptorSets[2];
+                writeInfo.dstBinding = binding;
+                writeInfo.dstArrayElement = 0;
+                writeInfo.descriptorCount = 1;
+                writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+                writeInfo.pImageInfo = &imageInfo;
+                writeInfo.pBufferInfo = nullptr;
+                writeInfo.pTexelBufferView = nullptr;
+            }
         }
     }
-    vkUpdateDescriptorSets(mDevice, nwrites, writes, 0, nullptr);
+    if (nwrites) {
+        vkUpdateDescriptorSets(mDevice, nwrites, writes, 0, nullptr);
+    }
+    return dirtySets;
+}
+
+// Retrieves the descriptor set of the bound key from the given cache, or allocates a new one.
+// Returns true if the set was allocated, in which case the caller needs to write it.
+template<typename Key>
+bool VulkanBinder::getOrCreateDescriptorSet(DescriptorCache<Key>& cache, uint32_t setIndex,
+        VkDescriptorSet* descriptorSet) noexcept {
+    // If no bindings have been dirtied, update the timestamp (most recent access).
+    if (!cache.dirty) {
+        assert(cache.current && cache.current->bound);
+        *descriptorSet = cache.current->handle;
+        cache.current->timestamp = mCurrentTime;
+        return false;
+    }
+
+    // Release the previously bound descriptor set and update its time stamp.
+    if (cache.current) {
+        cache.current->timestamp = mCurrentTime;
+        cache.current->bound = false;
+    }
+    cache.dirty = false;
+
+    // If a cached object exists, update the timestamp (most recent access). Note that robin_map
+    // iterators proffer a value method for obtaining a stable reference.
+    auto iter = cache.sets.find(cache.key);
+    if (UTILS_LIKELY(iter != cache.sets.end())) {
+        cache.current = &iter.value();
+        cache.current->timestamp = mCurrentTime;
+        cache.current->bound = true;
+        *descriptorSet = cache.current->handle;
+        return false;
+    }
+
+    uint16_t pool;
+    *descriptorSet = allocateDescriptorSet(
+            setIndex == 1 ? mSamplerSetLayout : mDescriptorSetLayouts[setIndex], &pool);
+
+    // Here we construct a DescriptorVal in place, then stash its pointer to allow fast
+    // subsequent calls to getOrCreateDescriptors when nothing has been dirtied.
+    cache.current = &cache.sets.emplace(std::make_pair(cache.key, DescriptorVal {
+        .handle = *descriptorSet,
+        .timestamp = mCurrentTime,
+        .pool = pool,
+        .bound = true
+    })).first.value();
     return true;
 }
 
+// Allocates a descriptor set from the current pool, or from the first empty pool when it's full.
+VkDescriptorSet VulkanBinder::allocateDescriptorSet(VkDescriptorSetLayout layout,
+        uint16_t* pool) noexcept {
+    if (mDescriptorPools[mCurrentDescriptorPool].allocatedCount == DESCRIPTOR_POOL_SET_COUNT) {
+        auto iter = std::find_if(mDescriptorPools.begin(), mDescriptorPools.end(),
+                [](DescriptorPool const& p) { return p.allocatedCount == 0; });
+        if (iter == mDescriptorPools.end()) {
+            ASSERT_POSTCONDITION(mDescriptorPools.size() < UINT16_MAX,
+                    "Too many descriptor pools.");
+            iter = mDescriptorPools.insert(iter, { createDescriptorPool(), 0, 0, 0 });
+        }
+        mCurrentDescriptorPool = uint16_t(iter - mDescriptorPools.begin());
+    }
+
+    DescriptorPool& current = mDescriptorPools[mCurrentDescriptorPool];
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = current.handle;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+    VkDescriptorSet descriptorSet;
+    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptorSet);
+    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    current.allocatedCount++;
+    current.liveCount++;
+    *pool = mCurrentDescriptorPool;
+    return descriptorSet;
+}
+
+// Gives a descriptor set back to its pool. The set may still be referenced by a command buffer
+// in flight, so the pool keeps the time it was last used.
+void VulkanBinder::releaseDescriptorSet(const DescriptorVal& val) noexcept {
+    DescriptorPool& pool = mDescriptorPools[val.pool];
+    assert(pool.liveCount > 0);
+    pool.liveCount--;
+    pool.timestamp = std::max(pool.timestamp, val.timestamp);
+}
+
 bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     ASSERT_POSTCONDITION(mPipelineLayout,
             "Must call getOrCreateDescriptor before getOrCreatePipeline.");
@@ -222,6 +313,8 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     // If we reach this point, we need to create and stash a brand new pipeline object.
     mShaderStages[0].module = mPipelineKey.shaders[0];
     mShaderStages[1].module = mPipelineKey.shaders[1];
+    mShaderStages[0].pSpecializationInfo = mPipelineKey.specialization;
+    mShaderStages[1].pSpecializationInfo = mPipelineKey.specialization;
 
     // We don't store array sizes to save space, but it's quick to count all non-zero
     // entries because these arrays have a small fixed-size capacity.
@@ -265,7 +358,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
 
     VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.layout = mPipelineLayout;
+    pipelineCreateInfo.layout = mPipelineKey.layout;
     pipelineCreateInfo.renderPass = mPipelineKey.renderPass;
     pipelineCreateInfo.subpass = mPipelineKey.subpassIndex;
     pipelineCreateInfo.stageCount = hasFragmentShader ? SHADER_MODULE_COUNT : 1;
@@ -296,7 +389,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
             << mShaderStages[0].module << ", " << mShaderStages[1].module << ")" << utils::io::endl;
     #endif
 
-    VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    VkResult err = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineCreateInfo,
             VKALLOC, pipeline);
     if (err) {
         utils::slog.e << "vkCreateGraphicsPipelines error " << err << utils::io::endl;
@@ -320,6 +413,11 @@ void VulkanBinder::bindProgramBundle(const ProgramBundle& bundle) noexcept {
             mPipelineKey.shaders[ssi] = shaders[ssi];
         }
     }
+    // pipelines also depend on the values of the specialization constants
+    if (mPipelineKey.specialization != bundle.specialization) {
+        mDirtyPipeline = true;
+        mPipelineKey.specialization = bundle.specialization;
+    }
 }
 
 void VulkanBinder::bindRasterState(const RasterState& rasterState) noexcept {
@@ -393,19 +491,20 @@ void VulkanBinder::bindVertexArray(const VertexArray& varray) noexcept {
 }
 
 void VulkanBinder::unbindUniformBuffer(VkBuffer uniformBuffer) noexcept {
-    auto& key = mDescriptorKey;
+    auto& key = mUniformBufferSets.key;
     for (uint32_t bindingIndex = 0u; bindingIndex < UBUFFER_BINDING_COUNT; ++bindingIndex) {
-        if (key.uniformBuffers[bindingIndex] == uniformBuffer) {
-            key.uniformBuffers[bindingIndex] = {};
-            key.uniformBufferSizes[bindingIndex] = {};
-            key.uniformBufferOffsets[bindingIndex] = {};
-            mDirtyDescriptor = true;
+        if (key.buffers[bindingIndex] == uniformBuffer) {
+            key.buffers[bindingIndex] = {};
+            key.sizes[bindingIndex] = {};
+            mUniformBufferOffsets[bindingIndex] = 0;
+            mUniformBufferSets.dirty = true;
         }
     }
     // This function is often called before deleting a uniform buffer. For safety, we need to evict
     // all descriptors that refer to the extinct uniform buffer, regardless of the binding offsets.
-    evictDescriptors([uniformBuffer] (const DescriptorKey& key) {
-        for (VkBuffer buf : key.uniformBuffers) {
+    evictDescriptors<UniformBufferKey>(mUniformBufferSets,
+            [uniformBuffer] (const UniformBufferKey& key) {
+        for (VkBuffer buf : key.buffers) {
             if (buf == uniformBuffer) {
                 return true;
             }
@@ -415,22 +514,26 @@ void VulkanBinder::unbindUniformBuffer(VkBuffer uniformBuffer) noexcept {
 }
 
 void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
-    for (auto& sampler : mDescriptorKey.samplers) {
+    for (auto& sampler : mSamplerSets.key.samplers) {
         if (sampler.imageView == imageView) {
-            mDirtyDescriptor = true;
+            mSamplerSets.dirty = true;
         }
     }
-    for (auto& target : mDescriptorKey.inputAttachments) {
+    for (auto& target : mInputAttachmentSets.key.inputAttachments) {
         if (target.imageView == imageView) {
-            mDirtyDescriptor = true;
+            mInputAttachmentSets.dirty = true;
         }
     }
-    evictDescriptors([imageView] (const DescriptorKey& key) {
+    evictDescriptors<SamplerKey>(mSamplerSets, [imageView] (const SamplerKey& key) {
         for (const auto& binding : key.samplers) {
             if (binding.imageView == imageView) {
                 return true;
             }
         }
+        return false;
+    });
+    evictDescriptors<InputAttachmentKey>(mInputAttachmentSets,
+            [imageView] (const InputAttachmentKey& key) {
         for (const auto& binding : key.inputAttachments) {
             if (binding.imageView == imageView) {
                 return true;
@@ -441,20 +544,22 @@ void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
 }
 
 // Discards all descriptor sets that pass the given filter. Immediately removes the cache entries,
-// but defers calling vkFreeDescriptorSets until the next eviction cycle.
-void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept {
+// their pools are reset once they're no longer in flight.
+template<typename Key>
+void VulkanBinder::evictDescriptors(DescriptorCache<Key>& cache,
+        std::function<bool(const Key&)> filter) noexcept {
     // Due to robin_map restrictions, we cannot use auto or a range-based loop.
-    decltype(mDescriptorBundles)::const_iterator iter;
-    for (iter = mDescriptorBundles.begin(); iter != mDescriptorBundles.end();) {
+    typename decltype(cache.sets)::const_iterator iter;
+    for (iter = cache.sets.begin(); iter != cache.sets.end();) {
         auto& pair = *iter;
         if (filter(pair.first)) {
             auto& cacheEntry = iter->second;
-            mDescriptorGraveyard.push_back({
-                .handles = { cacheEntry.handles[0], cacheEntry.handles[1], cacheEntry.handles[2] },
-                .timestamp = cacheEntry.timestamp,
-                .bound = false
-            });
-            iter = mDescriptorBundles.erase(iter);
+            releaseDescriptorSet(cacheEntry);
+            if (cache.current == &cacheEntry) {
+                cache.current = nullptr;
+                cache.dirty = true;
+            }
+            iter = cache.sets.erase(iter);
         } else {
             ++iter;
         }
@@ -466,26 +571,39 @@ void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuff
     ASSERT_POSTCONDITION(bindingIndex < UBUFFER_BINDING_COUNT,
             "Uniform bindings overflow: index = %d, capacity = %d.",
             bindingIndex, UBUFFER_BINDING_COUNT);
-    auto& key = mDescriptorKey;
-    if (key.uniformBuffers[bindingIndex] != uniformBuffer ||
-        key.uniformBufferOffsets[bindingIndex] != offset ||
-        key.uniformBufferSizes[bindingIndex] != size) {
-        key.uniformBuffers[bindingIndex] = uniformBuffer;
-        key.uniformBufferOffsets[bindingIndex] = offset;
-        key.uniformBufferSizes[bindingIndex] = size;
-        mDirtyDescriptor = true;
+    // The offset isn't part of the descriptor set, a range of a uniform buffer that moves between
+    // draws (e.g. the per-renderable uniforms) uses the same descriptor set.
+    auto& key = mUniformBufferSets.key;
+    if (key.buffers[bindingIndex] != uniformBuffer || key.sizes[bindingIndex] != size) {
+        key.buffers[bindingIndex] = uniformBuffer;
+        key.sizes[bindingIndex] = size;
+        mUniformBufferSets.dirty = true;
+    }
+    if (mUniformBufferOffsets[bindingIndex] != offset) {
+        mUniformBufferOffsets[bindingIndex] = uint32_t(offset);
+        mDirtyUniformBufferOffsets = true;
     }
 }
 
-void VulkanBinder::bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo samplerInfo) noexcept {
+void VulkanBinder::bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo samplerInfo,
+        bool immutable) noexcept {
     ASSERT_POSTCONDITION(bindingIndex < SAMPLER_BINDING_COUNT,
             "Sampler bindings overflow: index = %d, capacity = %d.",
             bindingIndex, SAMPLER_BINDING_COUNT);
-    VkDescriptorImageInfo& imageInfo = mDescriptorKey.samplers[bindingIndex];
+    const VkSampler immutableSampler = immutable ? samplerInfo.sampler : VK_NULL_HANDLE;
+    if (mImmutableSamplers.samplers[bindingIndex] != immutableSampler) {
+        mImmutableSamplers.samplers[bindingIndex] = immutableSampler;
+        mDirtyLayout = true;
+    }
+    // The fields are copied one by one so that the padding of the key, which is hashed, stays
+    // zeroed.
+    VkDescriptorImageInfo& imageInfo = mSamplerSets.key.samplers[bindingIndex];
     if (imageInfo.sampler != samplerInfo.sampler || imageInfo.imageView != samplerInfo.imageView ||
         imageInfo.imageLayout != samplerInfo.imageLayout) {
-        imageInfo = samplerInfo;
-        mDirtyDescriptor = true;
+        imageInfo.sampler = samplerInfo.sampler;
+        imageInfo.imageView = samplerInfo.imageView;
+        imageInfo.imageLayout = samplerInfo.imageLayout;
+        mSamplerSets.dirty = true;
     }
 }
 
@@ -494,11 +612,36 @@ void VulkanBinder::bindInputAttachment(uint32_t bindingIndex,
     ASSERT_POSTCONDITION(bindingIndex < TARGET_BINDING_COUNT,
             "Input attachment bindings overflow: index = %d, capacity = %d.",
             bindingIndex, TARGET_BINDING_COUNT);
-    VkDescriptorImageInfo& imageInfo = mDescriptorKey.inputAttachments[bindingIndex];
+    VkDescriptorImageInfo& imageInfo = mInputAttachmentSets.key.inputAttachments[bindingIndex];
     if (imageInfo.imageView != targetInfo.imageView ||
             imageInfo.imageLayout != targetInfo.imageLayout) {
-        imageInfo = targetInfo;
-        mDirtyDescriptor = true;
+        imageInfo.sampler = targetInfo.sampler;
+        imageInfo.imageView = targetInfo.imageView;
+        imageInfo.imageLayout = targetInfo.imageLayout;
+        mInputAttachmentSets.dirty = true;
+    }
+}
+
+void VulkanBinder::bindState(const VulkanBinder& binder) noexcept {
+    bindRenderPass(binder.mPipelineKey.renderPass, binder.mPipelineKey.subpassIndex);
+    if (!DescEqual()(mUniformBufferSets.key, binder.mUniformBufferSets.key)) {
+        mUniformBufferSets.key = binder.mUniformBufferSets.key;
+        mUniformBufferSets.dirty = true;
+    }
+    std::copy(std::begin(binder.mUniformBufferOffsets), std::end(binder.mUniformBufferOffsets),
+            std::begin(mUniformBufferOffsets));
+    mDirtyUniformBufferOffsets = true;
+    if (!DescEqual()(mSamplerSets.key, binder.mSamplerSets.key)) {
+        mSamplerSets.key = binder.mSamplerSets.key;
+        mSamplerSets.dirty = true;
+    }
+    if (!DescEqual()(mImmutableSamplers, binder.mImmutableSamplers)) {
+        mImmutableSamplers = binder.mImmutableSamplers;
+        mDirtyLayout = true;
+    }
+    if (!DescEqual()(mInputAttachmentSets.key, binder.mInputAttachmentSets.key)) {
+        mInputAttachmentSets.key = binder.mInputAttachmentSets.key;
+        mInputAttachmentSets.dirty = true;
     }
 }
 
@@ -515,7 +658,10 @@ void VulkanBinder::destroyCache() noexcept {
 
 void VulkanBinder::resetBindings() noexcept {
     mDirtyPipeline = true;
-    mDirtyDescriptor = true;
+    mUniformBufferSets.dirty = true;
+    mSamplerSets.dirty = true;
+    mInputAttachmentSets.dirty = true;
+    mDirtyUniformBufferOffsets = true;
 }
 
 // Frees up old descriptor sets and pipelines, then nulls out their key.
@@ -530,17 +676,11 @@ void VulkanBinder::gc() noexcept {
     }
     const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
 
+    gcDescriptors(mUniformBufferSets, evictTime);
+    gcDescriptors(mSamplerSets, evictTime);
+    gcDescriptors(mInputAttachmentSets, evictTime);
+
     // Due to robin_map restrictions, we cannot use auto or a range-based loop.
-    for (decltype(mDescriptorBundles)::const_iterator iter = mDescriptorBundles.begin();
-            iter != mDescriptorBundles.end();) {
-        auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
-            vkFreeDescriptorSets(mDevice, mDescriptorPool, 3, cacheEntry.handles);
-            iter = mDescriptorBundles.erase(iter);
-        } else {
-            ++iter;
-        }
-    }
     for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
             iter != mPipelines.end();) {
         auto& cacheEntry = iter->second;
@@ -551,23 +691,40 @@ void VulkanBinder::gc() noexcept {
             ++iter;
         }
     }
-    // The graveyard is composed of descriptors that contain references to extinct objects. We
-    // take care only to free the ones that are old enough to be evicted, since they might be
-    // referenced in a command buffer that hasn't finished executing.
-    decltype(mDescriptorGraveyard) graveyard;
-    graveyard.swap(mDescriptorGraveyard);
-    for (auto& val : graveyard) {
-        if (val.timestamp < evictTime) {
-           vkFreeDescriptorSets(mDevice, mDescriptorPool, 3, val.handles);
+    // A pool whose sets have all been released is reset in bulk, but only once the most recent of
+    // them is old enough to be evicted, since it might be referenced in a command buffer that
+    // hasn't finished executing.
+    for (DescriptorPool& pool : mDescriptorPools) {
+        if (pool.allocatedCount && !pool.liveCount && pool.timestamp < evictTime) {
+            vkResetDescriptorPool(mDevice, pool.handle, 0);
+            pool.allocatedCount = 0;
+            pool.timestamp = 0;
+        }
+    }
+}
+
+template<typename Key>
+void VulkanBinder::gcDescriptors(DescriptorCache<Key>& cache, uint32_t evictTime) noexcept {
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (typename decltype(cache.sets)::const_iterator iter = cache.sets.begin();
+            iter != cache.sets.end();) {
+        auto& cacheEntry = iter->second;
+        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
+            releaseDescriptorSet(cacheEntry);
+            iter = cache.sets.erase(iter);
         } else {
-            mDescriptorGraveyard.emplace_back(DescriptorBundle {
-                .handles = { val.handles[0], val.handles[1], val.handles[2] },
-                .timestamp = val.timestamp
-            });
+            ++iter;
         }
     }
 }
 
+template<typename Key>
+void VulkanBinder::clearDescriptors(DescriptorCache<Key>& cache) noexcept {
+    cache.sets.clear();
+    cache.current = nullptr;
+    cache.dirty = true;
+}
+
 void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     VkDescriptorSetLayoutBinding binding = {};
     binding.descriptorCount = 1; // NOTE: We never use arrays-of-blocks.
@@ -575,7 +732,7 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
 
     // First create the descriptor set layout for UBO's.
     VkDescriptorSetLayoutBinding ubindings[UBUFFER_BINDING_COUNT];
-    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     for (uint32_t i = 0; i < UBUFFER_BINDING_COUNT; i++) {
         binding.binding = i;
         ubindings[i] = binding;
@@ -587,15 +744,7 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &mDescriptorSetLayouts[0]);
 
     // Next create the descriptor set layout for samplers.
-    VkDescriptorSetLayoutBinding sbindings[SAMPLER_BINDING_COUNT];
-    binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    for (uint32_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
-        binding.binding = i;
-        sbindings[i] = binding;
-    }
-    dlinfo.bindingCount = SAMPLER_BINDING_COUNT;
-    dlinfo.pBindings = sbindings;
-    vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &mDescriptorSetLayouts[1]);
+    mDescriptorSetLayouts[1] = createSamplerSetLayout(nullptr);
 
     // Next create the descriptor set layout for input attachments.
     VkDescriptorSetLayoutBinding tbindings[TARGET_BINDING_COUNT];
@@ -609,34 +758,79 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     dlinfo.pBindings = tbindings;
     vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &mDescriptorSetLayouts[2]);
 
-    // Create the one and only VkPipelineLayout that we'll ever use.
-    VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
-    pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pPipelineLayoutCreateInfo.setLayoutCount = 3;
-    pPipelineLayoutCreateInfo.pSetLayouts = mDescriptorSetLayouts;
-    VkResult err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC,
-            &mPipelineLayout);
-    ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
+    // Create the VkPipelineLayout that we use unless immutable samplers are bound.
+    mPipelineLayout = createPipelineLayout(mDescriptorSetLayouts[1]);
+    mSamplerSetLayout = mDescriptorSetLayouts[1];
+    mPipelineKey.layout = mPipelineLayout;
+    mDirtyLayout = true;
 
-    // Create the VkDescriptorPool.
+    // Create the first VkDescriptorPool, the others are created when it's full.
+    mDescriptorPools.push_back({ createDescriptorPool(), 0, 0, 0 });
+    mCurrentDescriptorPool = 0;
+}
+
+// Each pool can hold DESCRIPTOR_POOL_SET_COUNT sets of any of the three layouts. Its sets are never
+// freed individually, so the pool doesn't need VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+// which lets the driver allocate linearly.
+VkDescriptorPool VulkanBinder::createDescriptorPool() noexcept {
     VkDescriptorPoolSize poolSizes[3] = {};
     VkDescriptorPoolCreateInfo poolInfo {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         .pNext = nullptr,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
-        .maxSets = MAX_DESCRIPTOR_SET_COUNT,
+        .flags = 0,
+        .maxSets = DESCRIPTOR_POOL_SET_COUNT,
         .poolSizeCount = 3,
         .pPoolSizes = poolSizes
     };
-    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
     poolSizes[0].descriptorCount = poolInfo.maxSets * UBUFFER_BINDING_COUNT;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = poolInfo.maxSets * SAMPLER_BINDING_COUNT;
     poolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
     poolSizes[2].descriptorCount = poolInfo.maxSets * TARGET_BINDING_COUNT;
 
-    err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &mDescriptorPool);
+    VkDescriptorPool pool;
+    VkResult err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &pool);
     ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    return pool;
+}
+
+// Creates the layout of the sampler descriptor set, with the given immutable samplers if any.
+VkDescriptorSetLayout VulkanBinder::createSamplerSetLayout(
+        VkSampler const* immutableSamplers) noexcept {
+    VkDescriptorSetLayoutBinding bindings[SAMPLER_BINDING_COUNT];
+    for (uint32_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
+        const bool immutable = immutableSamplers && immutableSamplers[i];
+        bindings[i] = {
+            .binding = i,
+            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            .descriptorCount = 1,
+            .stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS,
+            .pImmutableSamplers = immutable ? &immutableSamplers[i] : nullptr
+        };
+    }
+    VkDescriptorSetLayoutCreateInfo dlinfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .bindingCount = SAMPLER_BINDING_COUNT,
+        .pBindings = bindings
+    };
+    VkDescriptorSetLayout layout;
+    vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &layout);
+    return layout;
+}
+
+VkPipelineLayout VulkanBinder::createPipelineLayout(
+        VkDescriptorSetLayout samplerSetLayout) noexcept {
+    const VkDescriptorSetLayout setLayouts[3] = {
+            mDescriptorSetLayouts[0], samplerSetLayout, mDescriptorSetLayouts[2] };
+    VkPipelineLayoutCreateInfo pPipelineLayoutCreateInfo = {};
+    pPipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pPipelineLayoutCreateInfo.setLayoutCount = 3;
+    pPipelineLayoutCreateInfo.pSetLayouts = setLayouts;
+    VkPipelineLayout layout;
+    VkResult err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC, &layout);
+    ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
+    return layout;
 }
 
 void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
@@ -647,21 +841,32 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     // Our current descriptor set strategy can cause the # of descriptor sets to explode in certain
     // situations, so it's interesting to report the number that get stuffed into the cache.
     #ifndef NDEBUG
-    utils::slog.d << "Destroying " << mDescriptorBundles.size() << " bundles of descriptor sets."
-            << utils::io::endl;
+    utils::slog.d << "Destroying " << mUniformBufferSets.sets.size() << " uniform buffer, "
+            << mSamplerSets.sets.size() << " sampler and "
+            << mInputAttachmentSets.sets.size() << " input attachment descriptor sets in "
+            << mDescriptorPools.size() << " pools." << utils::io::endl;
     #endif
 
-    mDescriptorBundles.clear();
+    clearDescriptors(mUniformBufferSets);
+    clearDescriptors(mSamplerSets);
+    clearDescriptors(mInputAttachmentSets);
     vkDestroyPipelineLayout(mDevice, mPipelineLayout, VKALLOC);
     mPipelineLayout = VK_NULL_HANDLE;
+    for (auto const& iter : mImmutableSamplerLayouts) {
+        vkDestroyPipelineLayout(mDevice, iter.second.pipelineLayout, VKALLOC);
+        vkDestroyDescriptorSetLayout(mDevice, iter.second.samplerSetLayout, VKALLOC);
+    }
+    mImmutableSamplerLayouts.clear();
+    mSamplerSetLayout = VK_NULL_HANDLE;
     for (int i = 0; i < 3; i++) {
         vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayouts[i], VKALLOC);
         mDescriptorSetLayouts[i] = {};
     }
-    vkDestroyDescriptorPool(mDevice, mDescriptorPool, VKALLOC);
-    mDescriptorPool = VK_NULL_HANDLE;
-    mCurrentDescriptorBundle = nullptr;
-    mDirtyDescriptor = true;
+    for (DescriptorPool const& pool : mDescriptorPools) {
+        vkDestroyDescriptorPool(mDevice, pool.handle, VKALLOC);
+    }
+    mDescriptorPools.clear();
+    mCurrentDescriptorPool = 0;
 }
 
 bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1,
@@ -669,15 +874,18 @@ bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1
     return 0 == memcmp((const void*) &k1, (const void*) &k2, sizeof(k1));
 }
 
-bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
-        const VulkanBinder::DescriptorKey& k2) const {
+bool VulkanBinder::DescEqual::operator()(const VulkanBinder::UniformBufferKey& k1,
+        const VulkanBinder::UniformBufferKey& k2) const {
     for (uint32_t i = 0; i < UBUFFER_BINDING_COUNT; i++) {
-        if (k1.uniformBuffers[i] != k2.uniformBuffers[i] ||
-            k1.uniformBufferOffsets[i] != k2.uniformBufferOffsets[i] ||
-            k1.uniformBufferSizes[i] != k2.uniformBufferSizes[i]) {
+        if (k1.buffers[i] != k2.buffers[i] || k1.sizes[i] != k2.sizes[i]) {
             return false;
         }
     }
+    return true;
+}
+
+bool VulkanBinder::DescEqual::operator()(const VulkanBinder::SamplerKey& k1,
+        const VulkanBinder::SamplerKey& k2) const {
     for (uint32_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
         if (k1.samplers[i].sampler != k2.samplers[i].sampler ||
             k1.samplers[i].imageView != k2.samplers[i].imageView ||
@@ -685,6 +893,21 @@ bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
             return false;
         }
     }
+    return true;
+}
+
+bool VulkanBinder::DescEqual::operator()(const VulkanBinder::ImmutableSamplerKey& k1,
+        const VulkanBinder::ImmutableSamplerKey& k2) const {
+    for (uint32_t i = 0; i < SAMPLER_BINDING_COUNT; i++) {
+        if (k1.samplers[i] != k2.samplers[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VulkanBinder::DescEqual::operator()(const VulkanBinder::InputAttachmentKey& k1,
+        const VulkanBinder::InputAttachmentKey& k2) const {
     for (uint32_t i = 0; i < TARGET_BINDING_COUNT; i++) {
         if (k1.inputAttachments[i].imageView != k2.inputAttachments[i].imageView ||
             k1.inputAttachments[i].imageLayout != k2.inputAttachments[i].imageLayout) {
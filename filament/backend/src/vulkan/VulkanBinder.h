@@ -50,8 +50,10 @@ namespace backend {
 //        mBinder.bindPrimitiveTopology(geo.topology);
 //        mBinder.bindVertexArray(geo.varray);
 //        VkDescriptorSet descriptors[3];
-//        if (mBinder.getOrCreateDescriptors(descriptors, ...)) {
-//            vkCmdBindDescriptorSets(... descriptors ...);
+//        uint32_t offsets[UBUFFER_BINDING_COUNT];
+//        uint32_t dirtySets = mBinder.getOrCreateDescriptors(descriptors, ..., offsets);
+//        if (dirtySets) {
+//            vkCmdBindDescriptorSets(... descriptors ..., offsets);
 //        }
 //        VkPipeline pipeline;
 //        if (mBinder.getOrCreatePipeline(&pipeline)) {
@@ -67,10 +69,16 @@ namespace backend {
 //
 // In the name of simplicity, VulkanBinder has the following limitations:
 // - Push constants are not supported. (if adding support, see VkPipelineLayoutCreateInfo)
-// - Only three descriptor sets are bound at a time (one for each type of descriptor).
+// - Only three descriptor sets are bound at a time (one for each type of descriptor). Each of them
+//   is cached separately, so that changing e.g. the samplers doesn't create a new set of uniform
+//   buffers.
 // - Descriptor sets are never mutated using vkUpdateDescriptorSets, except upon creation.
+// - Descriptor sets are never freed individually. They are allocated linearly from a list of pools,
+//   and a pool is reset once all of its sets have been evicted and are no longer in flight.
 // - Assumes that viewport and scissor should be dynamic. (not baked into VkPipeline)
 // - Assumes that uniform buffers should be visible across all shader stages.
+// - Uniform buffers are dynamic uniform buffers, whose offsets are given to
+//   vkCmdBindDescriptorSets, so that binding another range of a buffer only re-binds the set.
 //
 class VulkanBinder {
 public:
@@ -89,10 +97,12 @@ public:
         VkVertexInputBindingDescription buffers[VERTEX_ATTRIBUTE_COUNT];
     };
 
-    // The ProgramBundle contains weak references to the compiled vertex and fragment shaders.
+    // The ProgramBundle contains weak references to the compiled vertex and fragment shaders,
+    // and to the values of their specialization constants, if any.
     struct ProgramBundle {
         VkShaderModule vertex;
         VkShaderModule fragment;
+        const VkSpecializationInfo* specialization;
     };
 
     // The RasterState POD contains standard graphics-related state like blending, culling, etc.
@@ -115,13 +125,18 @@ public:
     ~VulkanBinder();
     void setDevice(VkDevice device) { mDevice = device; }
 
+    // Pipelines are created through this cache, which can be VK_NULL_HANDLE.
+    void setPipelineCache(VkPipelineCache cache) { mPipelineCache = cache; }
+
     // Clients should initialize their copy of the raster state using this method. They can then
     // mutate their copy and pass it back through bindRasterState().
     const RasterState& getDefaultRasterState() const { return mDefaultRasterState; }
 
-    // Returns true if vkCmdBindDescriptorSets is required.
-    bool getOrCreateDescriptors(VkDescriptorSet descriptors[3], VkPipelineLayout* pipelineLayout)
-            noexcept;
+    // Returns a bitmask of the descriptor sets that need vkCmdBindDescriptorSets, if any. The
+    // dynamic offsets of the uniform buffers (set 0) are returned in uniformBufferOffsets.
+    uint32_t getOrCreateDescriptors(VkDescriptorSet descriptors[3],
+            VkPipelineLayout* pipelineLayout,
+            uint32_t uniformBufferOffsets[UBUFFER_BINDING_COUNT]) noexcept;
 
     // Returns true if any pipeline bindings have changed. (i.e., vkCmdBindPipeline is required)
     bool getOrCreatePipeline(VkPipeline* pipeline) noexcept;
@@ -133,10 +148,17 @@ public:
     void bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept;
     void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
             VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) noexcept;
-    void bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo) noexcept;
+    // An immutable sampler (e.g. one with a YCbCr conversion) is part of the descriptor set
+    // layout, binding it selects another pipeline layout.
+    void bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo,
+            bool immutable = false) noexcept;
     void bindInputAttachment(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo) noexcept;
     void bindVertexArray(const VertexArray& varray) noexcept;
 
+    // Binds the render pass, uniform buffers, samplers and input attachments that are bound to
+    // another binder, e.g. to continue its work in another command buffer.
+    void bindState(const VulkanBinder& binder) noexcept;
+
     // Checks if the given uniform is bound to any slot, and if so binds "null" to that slot.
     // Also invalidates all cached descriptors that refer to the given buffer.
     // This is only necessary when the client knows that the UBO is about to be destroyed.
@@ -168,7 +190,9 @@ private:
     #pragma pack(push, 1)
     struct UTILS_PACKED PipelineKey {
         VkShaderModule shaders[SHADER_MODULE_COUNT]; // 8*2 bytes
+        const VkSpecializationInfo* specialization; // 8 bytes
         RasterState rasterState; // 248 bytes
+        VkPipelineLayout layout; // 8 bytes
         VkRenderPass renderPass; // 8 bytes
         VkPrimitiveTopology topology : 16; // 2 bytes
         uint16_t subpassIndex; // 2 bytes
@@ -191,39 +215,89 @@ private:
         bool bound;
     };
 
-    // The descriptor key is a POD that represents all currently bound states that go into the
-    // descriptor set. We apply a hash function to its contents only if has been mutated since
-    // the previous call to getOrCreateDescriptors.
+    // The descriptor keys are PODs that represent all currently bound states that go into each of
+    // the descriptor sets. We apply a hash function to the contents of a key only if it has been
+    // mutated since the previous call to getOrCreateDescriptors.
     #pragma pack(push, 1)
-    struct UTILS_PACKED DescriptorKey {
-        VkBuffer uniformBuffers[UBUFFER_BINDING_COUNT];
+    struct UTILS_PACKED UniformBufferKey {
+        VkBuffer buffers[UBUFFER_BINDING_COUNT];
+        VkDeviceSize sizes[UBUFFER_BINDING_COUNT];
+    };
+    struct UTILS_PACKED SamplerKey {
         VkDescriptorImageInfo samplers[SAMPLER_BINDING_COUNT];
+    };
+    struct UTILS_PACKED InputAttachmentKey {
         VkDescriptorImageInfo inputAttachments[TARGET_BINDING_COUNT];
-        VkDeviceSize uniformBufferOffsets[UBUFFER_BINDING_COUNT];
-        VkDeviceSize uniformBufferSizes[UBUFFER_BINDING_COUNT];
+    };
+    struct UTILS_PACKED ImmutableSamplerKey {
+        VkSampler samplers[SAMPLER_BINDING_COUNT];
     };
     #pragma pack(pop)
 
-    static_assert(std::is_pod<DescriptorKey>::value, "DescriptorKey must be a POD.");
-
-    using DescHashFn = utils::hash::MurmurHashFn<DescriptorKey>;
+    static_assert(std::is_pod<UniformBufferKey>::value, "UniformBufferKey must be a POD.");
+    static_assert(std::is_pod<SamplerKey>::value, "SamplerKey must be a POD.");
+    static_assert(std::is_pod<InputAttachmentKey>::value, "InputAttachmentKey must be a POD.");
 
     struct DescEqual {
-        bool operator()(const DescriptorKey& k1, const DescriptorKey& k2) const;
+        bool operator()(const UniformBufferKey& k1, const UniformBufferKey& k2) const;
+        bool operator()(const SamplerKey& k1, const SamplerKey& k2) const;
+        bool operator()(const InputAttachmentKey& k1, const InputAttachmentKey& k2) const;
+        bool operator()(const ImmutableSamplerKey& k1, const ImmutableSamplerKey& k2) const;
     };
 
-    // Represents a set of descriptor sets that are bound simultanously.
-    struct DescriptorBundle {
-        VkDescriptorSet handles[3];
+    // The layouts used when immutable samplers are bound. The sampler descriptor set layout
+    // differs, the other sets are compatible with the ones of the default layout.
+    struct ImmutableSamplerLayout {
+        VkDescriptorSetLayout samplerSetLayout;
+        VkPipelineLayout pipelineLayout;
+    };
+
+    struct DescriptorVal {
+        VkDescriptorSet handle;
         uint32_t timestamp;
+        uint16_t pool;          // index in mDescriptorPools
         bool bound;
     };
 
+    // A pool is reset when its sets have all been released, and the last of them was used before
+    // the eviction time. Until then, released sets still take their place in the pool.
+    struct DescriptorPool {
+        VkDescriptorPool handle;
+        uint32_t allocatedCount;    // sets allocated since the pool was reset
+        uint32_t liveCount;         // allocated sets not yet released
+        uint32_t timestamp;         // most recent use of a released set
+    };
+
+    // The cache of one of the three descriptor sets, with its currently bound state.
+    template<typename Key>
+    struct DescriptorCache {
+        tsl::robin_map<Key, DescriptorVal, utils::hash::Fold64HashFn<Key>, DescEqual> sets;
+        Key key = {};
+        DescriptorVal* current = nullptr;
+        bool dirty = true;
+    };
+
+    template<typename Key>
+    bool getOrCreateDescriptorSet(DescriptorCache<Key>& cache, uint32_t setIndex,
+            VkDescriptorSet* descriptorSet) noexcept;
+    template<typename Key>
+    void evictDescriptors(DescriptorCache<Key>& cache,
+            std::function<bool(const Key&)> filter) noexcept;
+    template<typename Key>
+    void gcDescriptors(DescriptorCache<Key>& cache, uint32_t evictTime) noexcept;
+    template<typename Key>
+    void clearDescriptors(DescriptorCache<Key>& cache) noexcept;
+    VkDescriptorSet allocateDescriptorSet(VkDescriptorSetLayout layout, uint16_t* pool) noexcept;
+    void releaseDescriptorSet(const DescriptorVal& val) noexcept;
+    VkDescriptorPool createDescriptorPool() noexcept;
+
     void createLayoutsAndDescriptors() noexcept;
     void destroyLayoutsAndDescriptors() noexcept;
-    void evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept;
+    VkDescriptorSetLayout createSamplerSetLayout(VkSampler const* immutableSamplers) noexcept;
+    VkPipelineLayout createPipelineLayout(VkDescriptorSetLayout samplerSetLayout) noexcept;
 
     VkDevice mDevice = nullptr;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
     const RasterState mDefaultRasterState;
 
     // These structs are used only in a transient way but are stored for convenience.
@@ -236,28 +310,38 @@ private:
             UBUFFER_BINDING_COUNT + SAMPLER_BINDING_COUNT + TARGET_BINDING_COUNT];
     VkPipelineColorBlendAttachmentState mColorBlendAttachments[MRT::TARGET_COUNT];
 
-    // Current bindings are divided into two "keys" which are composed of a mix of actual values
+    // Current bindings are divided into "keys" which are composed of a mix of actual values
     // (e.g., blending is OFF) and weak references to Vulkan objects (e.g., shader programs and
-    // uniform buffers).
+    // uniform buffers). The descriptor keys are held by their caches.
     PipelineKey mPipelineKey;
-    DescriptorKey mDescriptorKey;
 
-    // Weak references to the currently bound pipeline and descriptor sets.
+    // Weak reference to the currently bound pipeline.
     PipelineVal* mCurrentPipeline = nullptr;
-    DescriptorBundle* mCurrentDescriptorBundle = nullptr;
 
-    // If one of these dirty flags is set, then one or more its constituent bindings have changed, so
-    // a new pipeline or descriptor set needs to be retrieved from the cache or created.
+    // If this dirty flag is set, then one or more its constituent bindings have changed, so a new
+    // pipeline needs to be retrieved from the cache or created. Each descriptor cache has its own.
     bool mDirtyPipeline = true;
-    bool mDirtyDescriptor = true;
 
     // Cached Vulkan objects. These objects are owned by the Binder.
     VkDescriptorSetLayout mDescriptorSetLayouts[3] = {};
     VkPipelineLayout mPipelineLayout = VK_NULL_HANDLE;
     tsl::robin_map<PipelineKey, PipelineVal, PipelineHashFn, PipelineEqual> mPipelines;
-    tsl::robin_map<DescriptorKey, DescriptorBundle, DescHashFn, DescEqual> mDescriptorBundles;
-    VkDescriptorPool mDescriptorPool;
-    std::vector<DescriptorBundle> mDescriptorGraveyard;
+    DescriptorCache<UniformBufferKey> mUniformBufferSets;       // set 0
+    DescriptorCache<SamplerKey> mSamplerSets;                   // set 1
+    DescriptorCache<InputAttachmentKey> mInputAttachmentSets;   // set 2
+
+    // The immutable samplers bound, and the layouts created for them. The sampler keys that only
+    // differ by immutable samplers use different samplers, so the sampler descriptor sets of each
+    // layout are still cached by their key.
+    ImmutableSamplerKey mImmutableSamplers = {};
+    bool mDirtyLayout = false;
+    tsl::robin_map<ImmutableSamplerKey, ImmutableSamplerLayout,
+            utils::hash::Fold64HashFn<ImmutableSamplerKey>, DescEqual> mImmutableSamplerLayouts;
+    VkDescriptorSetLayout mSamplerSetLayout = VK_NULL_HANDLE;       // the one in use
+    uint32_t mUniformBufferOffsets[UBUFFER_BINDING_COUNT] = {};
+    bool mDirtyUniformBufferOffsets = true;
+    std::vector<DescriptorPool> mDescriptorPools;
+    uint16_t mCurrentDescriptorPool = 0;    // the pool sets are allocated from
 
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint32_t mCurrentTime = 0;
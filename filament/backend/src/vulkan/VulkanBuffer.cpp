@@ -31,6 +31,9 @@ VulkanBuffer::VulkanBuffer(VulkanContext& context, VulkanStagePool& stagePool,
         .size = numBytes,
         .usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT
     };
+    // the transfer queue can upload to the buffer without ownership transfers
+    uint32_t queueFamilies[2];
+    setConcurrentSharing(context, bufferInfo, queueFamilies, true);
     VmaAllocationCreateInfo allocInfo {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
@@ -42,20 +45,35 @@ VulkanBuffer::~VulkanBuffer() {
 }
 
 void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes) {
-    assert(byteOffset == 0);
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, byteOffset, numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
+    vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numBytes);
+    loadFromStage(stage, byteOffset, numBytes);
+}
 
+void VulkanBuffer::loadFromCpu(BufferDescriptor& data, uint32_t byteOffset) {
+    VulkanStage const* stage = mStagePool.adoptStaging(data);
+    if (stage) {
+        loadFromStage(stage, byteOffset, uint32_t(data.size));
+    } else {
+        loadFromCpu(data.buffer, byteOffset, uint32_t(data.size));
+    }
+}
+
+void VulkanBuffer::loadFromStage(VulkanStage const* stage, uint32_t byteOffset,
+        uint32_t numBytes) {
+    assert(byteOffset == 0);
     auto copyToDevice = [this, numBytes, stage] (VulkanCommandBuffer& commands) {
-        VkBufferCopy region { .size = numBytes };
+        VkBufferCopy region { .srcOffset = stage->offset, .size = numBytes };
         vkCmdCopyBuffer(commands.cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
         mDisposer.acquire(mDisposerKey, commands.resources);
 
-        // Ensure that the copy finishes before the next draw call.
+        // Ensure that the copy finishes before the next draw call. On the transfer queue, the
+        // semaphore that the graphics queue waits for takes care of it.
+        if (isTransfer(mContext, commands)) {
+            mStagePool.releaseStage(stage, commands);
+            return;
+        }
         VkBufferMemoryBarrier barrier {
             .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
             .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
@@ -71,14 +89,9 @@ void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_
         mStagePool.releaseStage(stage, commands);
     };
 
-    // If inside beginFrame / endFrame, use the swap context, otherwise use the work cmdbuffer.
-    if (mContext.currentCommands) {
-        copyToDevice(*mContext.currentCommands);
-    } else {
-        acquireWorkCommandBuffer(mContext);
-        copyToDevice(mContext.work);
-        flushWorkCommandBuffer(mContext);
-    }
+    // If inside beginFrame / endFrame, use the swap context, otherwise use the transfer queue or
+    // the work cmdbuffer.
+    recordUpload(mContext, mDisposer, mDisposerKey, true, copyToDevice);
 }
 
 } // namespace filament
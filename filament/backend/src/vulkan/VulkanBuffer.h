@@ -30,8 +30,11 @@ public:
             VulkanDisposer::Key mDisposerKey, VkBufferUsageFlags usage, uint32_t numBytes);
     ~VulkanBuffer();
     void loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes);
+    // Uploads without copy if the data was written to a stage from acquireStaging().
+    void loadFromCpu(BufferDescriptor& data, uint32_t byteOffset);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
+    void loadFromStage(VulkanStage const* stage, uint32_t byteOffset, uint32_t numBytes);
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
     VulkanDisposer& mDisposer;
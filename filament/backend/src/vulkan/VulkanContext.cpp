@@ -35,9 +35,20 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+#include <iterator>
+#include <vector>
+
 namespace filament {
 namespace backend {
 
+// VK_KHR_imageless_framebuffer and the extensions it requires.
+static constexpr const char* IMAGELESS_FRAMEBUFFER_EXTENSIONS[] = {
+    VK_KHR_IMAGELESS_FRAMEBUFFER_EXTENSION_NAME,
+    VK_KHR_MAINTENANCE2_EXTENSION_NAME,
+    VK_KHR_IMAGE_FORMAT_LIST_EXTENSION_NAME,
+};
+
 VulkanCmdFence::VulkanCmdFence(VkDevice device, bool signaled) : device(device) {
     VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
     if (signaled) {
@@ -110,13 +121,34 @@ void selectPhysicalDevice(VulkanContext& context) {
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEnumerateDeviceExtensionProperties error.");
         bool supportsSwapchain = false;
         context.debugMarkersSupported = false;
+        context.multiviewSupported = false;
+        context.displayTimingSupported = false;
+        uint32_t externalImageExtensionCount = 0;
+        uint32_t imagelessFramebufferExtensionCount = 0;
         for (uint32_t k = 0; k < extensionCount; ++k) {
+            for (uint32_t e = 0; e < context.externalImageExtensionCount; ++e) {
+                if (!strcmp(extensions[k].extensionName, context.externalImageExtensions[e])) {
+                    externalImageExtensionCount++;
+                }
+            }
             if (!strcmp(extensions[k].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
                 supportsSwapchain = true;
             }
             if (!strcmp(extensions[k].extensionName, VK_EXT_DEBUG_MARKER_EXTENSION_NAME)) {
                 context.debugMarkersSupported = true;
             }
+            // the multiview feature is mandatory with the extension
+            if (!strcmp(extensions[k].extensionName, VK_KHR_MULTIVIEW_EXTENSION_NAME)) {
+                context.multiviewSupported = true;
+            }
+            if (!strcmp(extensions[k].extensionName, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+                context.displayTimingSupported = true;
+            }
+            for (const char* name : IMAGELESS_FRAMEBUFFER_EXTENSIONS) {
+                if (!strcmp(extensions[k].extensionName, name)) {
+                    imagelessFramebufferExtensionCount++;
+                }
+            }
         }
         if (!supportsSwapchain) continue;
 
@@ -125,6 +157,37 @@ void selectPhysicalDevice(VulkanContext& context) {
         vkGetPhysicalDeviceFeatures(physicalDevice, &context.physicalDeviceFeatures);
         vkGetPhysicalDeviceMemoryProperties(physicalDevice, &context.memoryProperties);
 
+        // External images are sampled through YCbCr conversions, which are an optional feature.
+        context.externalImagesSupported = false;
+        if (context.externalImageExtensionCount &&
+                externalImageExtensionCount == context.externalImageExtensionCount &&
+                vkGetPhysicalDeviceFeatures2KHR) {
+            VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcrFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
+            };
+            VkPhysicalDeviceFeatures2 features = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &ycbcrFeatures,
+            };
+            vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &features);
+            context.externalImagesSupported = ycbcrFeatures.samplerYcbcrConversion;
+        }
+
+        // Imageless framebuffers are an optional feature of their extension.
+        context.imagelessFramebufferSupported = false;
+        if (imagelessFramebufferExtensionCount == std::size(IMAGELESS_FRAMEBUFFER_EXTENSIONS) &&
+                vkGetPhysicalDeviceFeatures2KHR) {
+            VkPhysicalDeviceImagelessFramebufferFeatures imagelessFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGELESS_FRAMEBUFFER_FEATURES,
+            };
+            VkPhysicalDeviceFeatures2 features = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &imagelessFeatures,
+            };
+            vkGetPhysicalDeviceFeatures2KHR(physicalDevice, &features);
+            context.imagelessFramebufferSupported = imagelessFeatures.imagelessFramebuffer;
+        }
+
         // Print some driver or MoltenVK information if it is available.
         if (vkGetPhysicalDeviceProperties2KHR) {
             VkPhysicalDeviceDriverProperties driverProperties = {
@@ -173,8 +236,40 @@ void selectPhysicalDevice(VulkanContext& context) {
 }
 
 void createLogicalDevice(VulkanContext& context) {
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo[1] = {};
+    VkDeviceQueueCreateInfo deviceQueueCreateInfo[3] = {};
     const float queuePriority[] = {1.0f};
+
+    // Look for a family dedicated to compute (and transfer), its queues run concurrently with
+    // the graphics queue on most desktop GPUs.
+    uint32_t queueFamiliesCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queueFamiliesCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamiliesProperties(queueFamiliesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(context.physicalDevice, &queueFamiliesCount,
+            queueFamiliesProperties.data());
+    context.computeQueueFamilyIndex = 0xffff;
+    for (uint32_t j = 0; j < queueFamiliesCount; ++j) {
+        VkQueueFamilyProperties props = queueFamiliesProperties[j];
+        if (props.queueCount && (props.queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+                !(props.queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            context.computeQueueFamilyIndex = j;
+            break;
+        }
+    }
+    const bool hasComputeQueue = context.computeQueueFamilyIndex != 0xffff;
+
+    // Look for a family dedicated to transfers, typically a DMA engine that can copy data while
+    // the graphics queue renders.
+    context.transferQueueFamilyIndex = 0xffff;
+    for (uint32_t j = 0; j < queueFamiliesCount; ++j) {
+        VkQueueFamilyProperties props = queueFamiliesProperties[j];
+        if (props.queueCount && (props.queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+                !(props.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            context.transferQueueFamilyIndex = j;
+            break;
+        }
+    }
+    const bool hasTransferQueue = context.transferQueueFamilyIndex != 0xffff;
+
     VkDeviceCreateInfo deviceCreateInfo = {};
     std::vector<const char*> deviceExtensionNames = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -182,18 +277,66 @@ void createLogicalDevice(VulkanContext& context) {
     if (context.debugMarkersSupported && !context.debugUtilsSupported) {
         deviceExtensionNames.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
     }
+    if (context.displayTimingSupported) {
+        deviceExtensionNames.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    }
+    VkPhysicalDeviceMultiviewFeatures multiviewFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_FEATURES,
+        .multiview = VK_TRUE
+    };
+    if (context.multiviewSupported) {
+        deviceExtensionNames.push_back(VK_KHR_MULTIVIEW_EXTENSION_NAME);
+        deviceCreateInfo.pNext = &multiviewFeatures;
+    }
+    VkPhysicalDeviceSamplerYcbcrConversionFeatures ycbcrFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SAMPLER_YCBCR_CONVERSION_FEATURES,
+        .pNext = (void*) deviceCreateInfo.pNext,
+        .samplerYcbcrConversion = VK_TRUE
+    };
+    if (context.externalImagesSupported) {
+        deviceExtensionNames.insert(deviceExtensionNames.end(), context.externalImageExtensions,
+                context.externalImageExtensions + context.externalImageExtensionCount);
+        deviceCreateInfo.pNext = &ycbcrFeatures;
+    }
+    VkPhysicalDeviceImagelessFramebufferFeatures imagelessFeatures = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGELESS_FRAMEBUFFER_FEATURES,
+        .pNext = (void*) deviceCreateInfo.pNext,
+        .imagelessFramebuffer = VK_TRUE
+    };
+    if (context.imagelessFramebufferSupported) {
+        deviceExtensionNames.insert(deviceExtensionNames.end(),
+                std::begin(IMAGELESS_FRAMEBUFFER_EXTENSIONS),
+                std::end(IMAGELESS_FRAMEBUFFER_EXTENSIONS));
+        deviceCreateInfo.pNext = &imagelessFeatures;
+    }
     deviceQueueCreateInfo->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     deviceQueueCreateInfo->queueFamilyIndex = context.graphicsQueueFamilyIndex;
     deviceQueueCreateInfo->queueCount = 1;
     deviceQueueCreateInfo->pQueuePriorities = &queuePriority[0];
+    uint32_t queueCreateInfoCount = 1;
+    if (hasComputeQueue) {
+        VkDeviceQueueCreateInfo& info = deviceQueueCreateInfo[queueCreateInfoCount++];
+        info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        info.queueFamilyIndex = context.computeQueueFamilyIndex;
+        info.queueCount = 1;
+        info.pQueuePriorities = &queuePriority[0];
+    }
+    if (hasTransferQueue) {
+        VkDeviceQueueCreateInfo& info = deviceQueueCreateInfo[queueCreateInfoCount++];
+        info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        info.queueFamilyIndex = context.transferQueueFamilyIndex;
+        info.queueCount = 1;
+        info.pQueuePriorities = &queuePriority[0];
+    }
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.queueCreateInfoCount = queueCreateInfoCount;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfo;
 
     // We could simply enable all supported features, but since that may have performance
     // consequences let's just enable the features we need.
     const auto& supportedFeatures = context.physicalDeviceFeatures;
     VkPhysicalDeviceFeatures enabledFeatures {
+        .multiDrawIndirect = supportedFeatures.multiDrawIndirect,
         .textureCompressionETC2 = supportedFeatures.textureCompressionETC2,
         .textureCompressionBC = supportedFeatures.textureCompressionBC,
     };
@@ -215,17 +358,27 @@ void createLogicalDevice(VulkanContext& context) {
     result = vkCreateCommandPool(context.device, &createInfo, VKALLOC, &context.commandPool);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
 
-    // Create a timestamp pool large enough to hold a pair of queries for each timer.
-    VkQueryPoolCreateInfo tqpCreateInfo = {};
-    tqpCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
-    tqpCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    context.computeQueue = VK_NULL_HANDLE;
+    context.computeCommandPool = VK_NULL_HANDLE;
+    if (hasComputeQueue) {
+        vkGetDeviceQueue(context.device, context.computeQueueFamilyIndex, 0,
+                &context.computeQueue);
+        createInfo.queueFamilyIndex = context.computeQueueFamilyIndex;
+        result = vkCreateCommandPool(context.device, &createInfo, VKALLOC,
+                &context.computeCommandPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    }
 
-    std::unique_lock<utils::Mutex> timestamps_lock(context.timestamps.mutex);
-    tqpCreateInfo.queryCount = context.timestamps.used.size() * 2;
-    result = vkCreateQueryPool(context.device, &tqpCreateInfo, VKALLOC, &context.timestamps.pool);
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateQueryPool error.");
-    context.timestamps.used.reset();
-    timestamps_lock.unlock();
+    context.transferQueue = VK_NULL_HANDLE;
+    context.transferCommandPool = VK_NULL_HANDLE;
+    if (hasTransferQueue) {
+        vkGetDeviceQueue(context.device, context.transferQueueFamilyIndex, 0,
+                &context.transferQueue);
+        createInfo.queueFamilyIndex = context.transferQueueFamilyIndex;
+        result = vkCreateCommandPool(context.device, &createInfo, VKALLOC,
+                &context.transferCommandPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    }
 
     const VmaVulkanFunctions funcs {
         .vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
@@ -351,10 +504,10 @@ void createSwapChain(VulkanContext& context, VulkanSurfaceContext& surfaceContex
     // absolute minimum could easily require waiting for a driver or presentation layer to release
     // the previous frame's buffer. The only situation in which we'd ask for the minimum length is
     // when using a MAILBOX presentation strategy for low-latency situations where tearing is
-    // acceptable.
+    // acceptable. We also need an image for each frame in flight, plus the one being displayed.
     const uint32_t maxImageCount = caps.maxImageCount;
     const uint32_t minImageCount = caps.minImageCount;
-    uint32_t desiredImageCount = minImageCount + 1;
+    uint32_t desiredImageCount = std::max(minImageCount, context.maxFramesInFlight) + 1;
 
     // According to section 30.5 of VK 1.1, maxImageCount of zero means "that there is no limit on
     // the number of images, though there may be limits related to the total amount of memory used
@@ -479,6 +632,7 @@ void destroySwapChain(VulkanContext& context, VulkanSurfaceContext& surfaceConte
         disposer.release(swapContext.commands.resources);
         vkFreeCommandBuffers(device, context.commandPool, 1,
                 &swapContext.commands.cmdbuffer);
+        destroySubmissions(context, swapContext.submissions);
 
         // The wrapper object for the submission fence has shared ownership semantics, so here
         // we notify other owners that the swap chain (and its associated command buffers) have
@@ -566,26 +720,33 @@ void waitForIdle(VulkanContext& context) {
         return;
     }
 
-    // Flush the work command buffer and wait for it to finish.
+    // Flush the work command buffer and wait for all the submitted ones to finish.
     if (!context.work.fence->submitted) {
         flushWorkCommandBuffer(context);
         acquireWorkCommandBuffer(context);
     }
+    if (!context.submittedWork.empty()) {
+        std::vector<VkFence> fences;
+        fences.reserve(context.submittedWork.size());
+        for (VulkanCommandBuffer const& commands : context.submittedWork) {
+            fences.push_back(commands.fence->fence);
+        }
+        vkWaitForFences(context.device, (uint32_t) fences.size(), fences.data(), VK_TRUE, ~0ull);
+    }
 
     // Wait for submitted command buffer(s) to finish.
     if (context.currentSurface) {
-        VkFence fences[4];
-        uint32_t nfences = 0;
         auto& surfaceContext = *context.currentSurface;
+        std::vector<VkFence> fences(surfaceContext.swapContexts.size());
+        uint32_t nfences = 0;
         for (auto& swapContext : surfaceContext.swapContexts) {
-            assert(nfences < 4);
             if (swapContext.commands.fence && swapContext.commands.fence->submitted) {
                 fences[nfences++] = swapContext.commands.fence->fence;
                 swapContext.commands.fence->submitted = false;
             }
         }
         if (nfences > 0) {
-            vkWaitForFences(context.device, nfences, fences, VK_FALSE, ~0ull);
+            vkWaitForFences(context.device, nfences, fences.data(), VK_FALSE, ~0ull);
         }
 
         // Next flush the active command buffer and wait for it to finish.
@@ -634,6 +795,23 @@ bool acquireSwapCommandBuffer(VulkanContext& context) {
 
      cmdfence.reset(new VulkanCmdFence(context.device));
 
+    // The other submissions of this swap context were done before the fence was signaled, their
+    // command buffers and semaphores can be reused.
+    VulkanSubmissions& submissions = swap.submissions;
+    for (VkCommandBuffer cmdbuffer : submissions.submittedGraphics) {
+        vkResetCommandBuffer(cmdbuffer, 0);
+        submissions.graphics.push_back(cmdbuffer);
+    }
+    for (VkCommandBuffer cmdbuffer : submissions.submittedCompute) {
+        vkResetCommandBuffer(cmdbuffer, 0);
+        submissions.compute.push_back(cmdbuffer);
+    }
+    submissions.submittedGraphics.clear();
+    submissions.submittedCompute.clear();
+    submissions.usedSemaphores = 0;
+    submissions.imageAvailableWaited = false;
+    context.graphicsWaits.clear();
+
     // Restart the command buffer.
     VkCommandBuffer cmdbuffer = swap.commands.cmdbuffer;
     VkResult error = vkResetCommandBuffer(cmdbuffer, 0);
@@ -656,21 +834,15 @@ void flushCommandBuffer(VulkanContext& context) {
     makeSwapChainPresentable(context);
 
     // Submit the command buffer.
+    ASSERT_PRECONDITION(context.currentCommands == &swapContext.commands,
+            "The command buffer can't be flushed while recording async compute commands.");
     VkResult error = vkEndCommandBuffer(context.currentCommands->cmdbuffer);
     ASSERT_POSTCONDITION(!error, "vkEndCommandBuffer error.");
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    VkSubmitInfo submitInfo {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pWaitDstStageMask = &waitDestStageMask,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &context.currentCommands->cmdbuffer,
-    };
 
     auto& cmdfence = swapContext.commands.fence;
     std::unique_lock<utils::Mutex> lock(cmdfence->mutex);
-    error = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, cmdfence->fence);
+    submitSwapCommandBuffer(context, VK_NULL_HANDLE, cmdfence->fence);
     lock.unlock();
-    ASSERT_POSTCONDITION(!error, "vkQueueSubmit error.");
     swapContext.invalid = true;
     cmdfence->condition.notify_all();
 
@@ -705,13 +877,257 @@ VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>
     return VK_FORMAT_UNDEFINED;
 }
 
+// Adds the semaphores of the transfers that weren't waited for yet to 'waits'. The transfers
+// can be reused once 'waiter' is signaled.
+static void waitForTransfers(VulkanContext& context, std::vector<VkSemaphore>& waits,
+        std::shared_ptr<VulkanCmdFence> const& waiter) {
+    for (VulkanTransfer& transfer : context.transfers) {
+        if (transfer.pending) {
+            waits.push_back(transfer.semaphore);
+            transfer.waiter = waiter;
+            transfer.pending = false;
+        }
+    }
+}
+
+// Submits the ended command buffer of the current swap context. It waits for the semaphores
+// in graphicsWaits, and for the swap chain image if no submission of this frame did yet.
+void submitSwapCommandBuffer(VulkanContext& context, VkSemaphore signal, VkFence fence) {
+    VulkanSurfaceContext& surface = *context.currentSurface;
+    SwapContext& swapContext = getSwapContext(context);
+    VulkanSubmissions& submissions = swapContext.submissions;
+
+    std::vector<VkSemaphore>& waits = context.graphicsWaits;
+    waitForTransfers(context, waits, swapContext.commands.fence);
+    std::vector<VkPipelineStageFlags> stages(waits.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    if (!surface.headlessQueue && !submissions.imageAvailableWaited) {
+        waits.push_back(surface.imageAvailable);
+        stages.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+        submissions.imageAvailableWaited = true;
+    }
+
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = (uint32_t) waits.size(),
+        .pWaitSemaphores = waits.data(),
+        .pWaitDstStageMask = stages.data(),
+        .commandBufferCount = 1,
+        .pCommandBuffers = &swapContext.commands.cmdbuffer,
+        .signalSemaphoreCount = signal ? 1u : 0u,
+        .pSignalSemaphores = &signal,
+    };
+    VkResult error = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, fence);
+    ASSERT_POSTCONDITION(!error, "vkQueueSubmit error.");
+    waits.clear();
+}
+
+// Submits the commands recorded so far in the current swap context, and continues in a new
+// command buffer. The commands that follow can't rely on the state set by the previous ones.
+void splitSwapCommandBuffer(VulkanContext& context, VkSemaphore signal) {
+    SwapContext& swapContext = getSwapContext(context);
+    VulkanSubmissions& submissions = swapContext.submissions;
+
+    VkResult error = vkEndCommandBuffer(swapContext.commands.cmdbuffer);
+    ASSERT_POSTCONDITION(!error, "vkEndCommandBuffer error.");
+    submitSwapCommandBuffer(context, signal, VK_NULL_HANDLE);
+    submissions.submittedGraphics.push_back(swapContext.commands.cmdbuffer);
+
+    if (submissions.graphics.empty()) {
+        const VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = context.commandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        VkCommandBuffer cmdbuffer;
+        error = vkAllocateCommandBuffers(context.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(!error, "vkAllocateCommandBuffers error.");
+        submissions.graphics.push_back(cmdbuffer);
+    }
+    swapContext.commands.cmdbuffer = submissions.graphics.back();
+    submissions.graphics.pop_back();
+
+    const VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+    };
+    error = vkBeginCommandBuffer(swapContext.commands.cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(!error, "vkBeginCommandBuffer error.");
+}
+
+// Returns a semaphore that can be used once in the current frame.
+VkSemaphore acquireSwapSemaphore(VulkanContext& context) {
+    VulkanSubmissions& submissions = getSwapContext(context).submissions;
+    if (submissions.usedSemaphores == submissions.semaphores.size()) {
+        VkSemaphore semaphore;
+        createSemaphore(context.device, &semaphore);
+        submissions.semaphores.push_back(semaphore);
+    }
+    return submissions.semaphores[submissions.usedSemaphores++];
+}
+
+// Returns a begun command buffer of the compute queue, it's submitted in the current frame.
+VkCommandBuffer acquireAsyncComputeCommandBuffer(VulkanContext& context) {
+    assert(context.computeQueue);
+    VulkanSubmissions& submissions = getSwapContext(context).submissions;
+    if (submissions.compute.empty()) {
+        const VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = context.computeCommandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        VkCommandBuffer cmdbuffer;
+        VkResult error = vkAllocateCommandBuffers(context.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(!error, "vkAllocateCommandBuffers error.");
+        submissions.compute.push_back(cmdbuffer);
+    }
+    VkCommandBuffer cmdbuffer = submissions.compute.back();
+    submissions.compute.pop_back();
+    submissions.submittedCompute.push_back(cmdbuffer);
+
+    const VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    VkResult error = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(!error, "vkBeginCommandBuffer error.");
+    return cmdbuffer;
+}
+
+// Takes the ownership of a buffer for the async compute commands being recorded, before their
+// first use of it. The graphics queue releases it in endAsyncCompute().
+void acquireAsyncComputeBuffer(VulkanContext& context, VkBuffer buffer) {
+    std::vector<VkBuffer>& buffers = context.asyncResources.buffers;
+    if (std::find(buffers.begin(), buffers.end(), buffer) != buffers.end()) {
+        return;
+    }
+    buffers.push_back(buffer);
+    transferAsyncComputeResources(context, { .buffers = { buffer } },
+            context.asyncCompute.cmdbuffer, true, false);
+}
+
+void acquireAsyncComputeImage(VulkanContext& context, VkImage image) {
+    std::vector<VkImage>& images = context.asyncResources.images;
+    if (std::find(images.begin(), images.end(), image) != images.end()) {
+        return;
+    }
+    images.push_back(image);
+    transferAsyncComputeResources(context, { .images = { image } },
+            context.asyncCompute.cmdbuffer, true, false);
+}
+
+// Records one side of the transfer of 'resources' to the compute queue family, or back to the
+// graphics queue family. The queue giving them up records the release, the queue taking them
+// records the acquire once it waited for the release.
+void transferAsyncComputeResources(VulkanContext& context, VulkanAsyncResources const& resources,
+        VkCommandBuffer cmdbuffer, bool toCompute, bool release) {
+    const uint32_t srcFamily = toCompute ?
+            context.graphicsQueueFamilyIndex : context.computeQueueFamilyIndex;
+    const uint32_t dstFamily = toCompute ?
+            context.computeQueueFamilyIndex : context.graphicsQueueFamilyIndex;
+    const VkAccessFlags srcAccessMask = release ? VK_ACCESS_MEMORY_WRITE_BIT : 0;
+    const VkAccessFlags dstAccessMask = release ? 0 :
+            VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    std::vector<VkBufferMemoryBarrier> buffers;
+    buffers.reserve(resources.buffers.size());
+    for (VkBuffer buffer : resources.buffers) {
+        buffers.push_back({
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask,
+            .srcQueueFamilyIndex = srcFamily,
+            .dstQueueFamilyIndex = dstFamily,
+            .buffer = buffer,
+            .size = VK_WHOLE_SIZE
+        });
+    }
+    std::vector<VkImageMemoryBarrier> images;
+    images.reserve(resources.images.size());
+    for (VkImage image : resources.images) {
+        images.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            .srcAccessMask = srcAccessMask,
+            .dstAccessMask = dstAccessMask,
+            .oldLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .newLayout = VK_IMAGE_LAYOUT_GENERAL,
+            .srcQueueFamilyIndex = srcFamily,
+            .dstQueueFamilyIndex = dstFamily,
+            .image = image,
+            .subresourceRange = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS,
+            }
+        });
+    }
+    if (buffers.empty() && images.empty()) {
+        return;
+    }
+    vkCmdPipelineBarrier(cmdbuffer,
+            release ? VK_PIPELINE_STAGE_ALL_COMMANDS_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            release ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0, 0, nullptr, (uint32_t) buffers.size(), buffers.data(),
+            (uint32_t) images.size(), images.data());
+}
+
+void destroySubmissions(VulkanContext& context, VulkanSubmissions& submissions) {
+    const VkDevice device = context.device;
+    for (auto* cmdbuffers : { &submissions.graphics, &submissions.submittedGraphics }) {
+        if (!cmdbuffers->empty()) {
+            vkFreeCommandBuffers(device, context.commandPool, (uint32_t) cmdbuffers->size(),
+                    cmdbuffers->data());
+        }
+    }
+    for (auto* cmdbuffers : { &submissions.compute, &submissions.submittedCompute }) {
+        if (!cmdbuffers->empty()) {
+            vkFreeCommandBuffers(device, context.computeCommandPool,
+                    (uint32_t) cmdbuffers->size(), cmdbuffers->data());
+        }
+    }
+    for (VkSemaphore semaphore : submissions.semaphores) {
+        vkDestroySemaphore(device, semaphore, VKALLOC);
+    }
+    submissions = {};
+}
+
+// Returns the begun work command buffer. This never waits for the GPU: if the work command buffer
+// was submitted, it's set aside until its fence signals and another one is begun, either a
+// recycled one whose submission is done or a new one.
 VkCommandBuffer acquireWorkCommandBuffer(VulkanContext& context) {
     VulkanCommandBuffer& work = context.work;
-    const VkCommandBufferBeginInfo binfo { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    if (work.fence && work.fence->submitted) {
-        work.fence->submitted = false;
-        vkWaitForFences(context.device, 1, &work.fence->fence, VK_FALSE, UINT64_MAX);
-        vkResetCommandBuffer(work.cmdbuffer, 0);
+    if (work.fence && !work.fence->submitted) {
+        return work.cmdbuffer;
+    }
+    if (work.fence) {
+        context.submittedWork.push_back(std::move(work));
+        work.resources.clear();
+
+        auto iter = std::find_if(context.submittedWork.begin(), context.submittedWork.end(),
+                [device = context.device](VulkanCommandBuffer const& commands) {
+                    return vkGetFenceStatus(device, commands.fence->fence) == VK_SUCCESS;
+                });
+        if (iter != context.submittedWork.end()) {
+            // the resources are released by the next releaseWork(), which needs the disposer
+            context.completedWork.push_back(std::move(iter->resources));
+            work.cmdbuffer = iter->cmdbuffer;
+            context.submittedWork.erase(iter);
+            vkResetCommandBuffer(work.cmdbuffer, 0);
+        } else {
+            const VkCommandBufferAllocateInfo allocateInfo {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = context.commandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
+            };
+            VkResult error = vkAllocateCommandBuffers(context.device, &allocateInfo,
+                    &work.cmdbuffer);
+            ASSERT_POSTCONDITION(!error, "vkAllocateCommandBuffers error.");
+        }
+        const VkCommandBufferBeginInfo binfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+        };
         vkBeginCommandBuffer(work.cmdbuffer, &binfo);
     }
     work.fence.reset(new VulkanCmdFence(context.device));
@@ -721,10 +1137,14 @@ VkCommandBuffer acquireWorkCommandBuffer(VulkanContext& context) {
 void flushWorkCommandBuffer(VulkanContext& context) {
     VulkanCommandBuffer& work = context.work;
     ASSERT_PRECONDITION(!work.fence->submitted, "Flushed the work buffer more than once.");
-    const VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    std::vector<VkSemaphore> waits;
+    waitForTransfers(context, waits, work.fence);
+    const std::vector<VkPipelineStageFlags> stages(waits.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pWaitDstStageMask = &waitDestStageMask,
+        .waitSemaphoreCount = (uint32_t) waits.size(),
+        .pWaitSemaphores = waits.data(),
+        .pWaitDstStageMask = stages.data(),
         .commandBufferCount = 1,
         .pCommandBuffers = &work.cmdbuffer,
     };
@@ -733,6 +1153,127 @@ void flushWorkCommandBuffer(VulkanContext& context) {
     work.fence->submitted = true;
 }
 
+// Releases the resources of the submitted work command buffers that are done, this doesn't wait.
+// It runs in beginFrame(), and after each work submission outside of a frame so that uploads
+// made before the first frame don't hold on to their resources.
+void releaseWork(VulkanContext& context, VulkanDisposer& disposer) {
+    for (VulkanDisposer::Set& resources : context.completedWork) {
+        disposer.release(resources);
+    }
+    context.completedWork.clear();
+    for (VulkanCommandBuffer& commands : context.submittedWork) {
+        if (!commands.resources.empty() &&
+                vkGetFenceStatus(context.device, commands.fence->fence) == VK_SUCCESS) {
+            disposer.release(commands.resources);
+        }
+    }
+}
+
+// Waits for the device and destroys the work command buffers, this should be called while the
+// context's VkDevice is still alive.
+void destroyWork(VulkanContext& context, VulkanDisposer& disposer) {
+    vkDeviceWaitIdle(context.device);
+    releaseWork(context, disposer);
+    for (VulkanCommandBuffer& commands : context.submittedWork) {
+        vkFreeCommandBuffers(context.device, context.commandPool, 1, &commands.cmdbuffer);
+    }
+    context.submittedWork.clear();
+    disposer.release(context.work.resources);
+    vkFreeCommandBuffers(context.device, context.commandPool, 1, &context.work.cmdbuffer);
+    context.work.fence.reset();
+}
+
+// Returns a begun command buffer of the transfer queue, which must be flushed with
+// flushTransferCommandBuffer() before the next one is acquired.
+VulkanCommandBuffer& acquireTransferCommandBuffer(VulkanContext& context,
+        VulkanDisposer& disposer) {
+    assert(context.transferQueue);
+    releaseTransfers(context, disposer);
+
+    auto iter = std::find_if(context.transfers.begin(), context.transfers.end(),
+            [](VulkanTransfer const& transfer) { return transfer.free; });
+    if (iter == context.transfers.end()) {
+        VulkanTransfer transfer;
+        const VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = context.transferCommandPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            .commandBufferCount = 1
+        };
+        VkResult error = vkAllocateCommandBuffers(context.device, &allocateInfo,
+                &transfer.commands.cmdbuffer);
+        ASSERT_POSTCONDITION(!error, "vkAllocateCommandBuffers error.");
+        createSemaphore(context.device, &transfer.semaphore);
+        context.transfers.push_back(std::move(transfer));
+        iter = context.transfers.end() - 1;
+    } else {
+        vkResetCommandBuffer(iter->commands.cmdbuffer, 0);
+    }
+
+    VulkanTransfer& transfer = *iter;
+    transfer.free = false;
+    transfer.commands.fence.reset(new VulkanCmdFence(context.device));
+    const VkCommandBufferBeginInfo binfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkBeginCommandBuffer(transfer.commands.cmdbuffer, &binfo);
+    return transfer.commands;
+}
+
+// Submits a command buffer returned by acquireTransferCommandBuffer(), the next graphics
+// submission waits for it.
+void flushTransferCommandBuffer(VulkanContext& context, VulkanCommandBuffer& commands) {
+    auto iter = std::find_if(context.transfers.begin(), context.transfers.end(),
+            [&commands](VulkanTransfer const& transfer) { return &transfer.commands == &commands; });
+    assert(iter != context.transfers.end());
+    VulkanTransfer& transfer = *iter;
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &commands.cmdbuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &transfer.semaphore,
+    };
+    vkEndCommandBuffer(commands.cmdbuffer);
+    VkResult error = vkQueueSubmit(context.transferQueue, 1, &submitInfo, commands.fence->fence);
+    ASSERT_POSTCONDITION(!error, "vkQueueSubmit error.");
+    commands.fence->submitted = true;
+    transfer.pending = true;
+}
+
+// Releases the resources of the transfers whose commands and waiter are done, so they can be
+// reused.
+void releaseTransfers(VulkanContext& context, VulkanDisposer& disposer) {
+    for (VulkanTransfer& transfer : context.transfers) {
+        if (transfer.free || !transfer.waiter ||
+                vkGetFenceStatus(context.device, transfer.commands.fence->fence) != VK_SUCCESS ||
+                vkGetFenceStatus(context.device, transfer.waiter->fence) != VK_SUCCESS) {
+            continue;
+        }
+        disposer.release(transfer.commands.resources);
+        transfer.waiter.reset();
+        transfer.free = true;
+    }
+}
+
+// Waits for the device and destroys the transfers, this should be called while the context's
+// VkDevice is still alive.
+void destroyTransfers(VulkanContext& context, VulkanDisposer& disposer) {
+    if (!context.transferQueue) {
+        return;
+    }
+    // the graphics queue may still wait for the semaphores
+    vkDeviceWaitIdle(context.device);
+    for (VulkanTransfer& transfer : context.transfers) {
+        disposer.release(transfer.commands.resources);
+        vkFreeCommandBuffers(context.device, context.transferCommandPool, 1,
+                &transfer.commands.cmdbuffer);
+        vkDestroySemaphore(context.device, transfer.semaphore, VKALLOC);
+    }
+    context.transfers.clear();
+}
+
 void createFinalDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceContext,
         VkFormat depthFormat) {
     // Create an appropriately-sized device-only VkImage.
@@ -827,6 +1368,11 @@ VkImageLayout getTextureLayout(TextureUsage usage) {
         return VK_IMAGE_LAYOUT_GENERAL;
     }
 
+    // Storage images can only be accessed in the GENERAL layout.
+    if (any(usage & TextureUsage::STORAGE)) {
+        return VK_IMAGE_LAYOUT_GENERAL;
+    }
+
     // Finally, the layout for an immutable texture is optimal read-only.
     return VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 }
@@ -76,16 +76,66 @@ struct VulkanCommandBuffer {
     VulkanDisposer::Set resources;
 };
 
+// Async compute splits a frame in several submissions, see VulkanDriver::beginAsyncCompute().
+// These are the extra command buffers and semaphores of a swap context, they're recycled along
+// with its main command buffer.
+// Buffers and storage images used by async compute commands. The compute queue family owns them
+// from their first use by these commands, until the graphics queue waits for the commands. Storage
+// images are always in the GENERAL layout.
+struct VulkanAsyncResources {
+    std::vector<VkBuffer> buffers;
+    std::vector<VkImage> images;
+};
+
+struct VulkanSubmissions {
+    std::vector<VkCommandBuffer> graphics;              // available graphics command buffers
+    std::vector<VkCommandBuffer> submittedGraphics;     // submitted in this frame
+    std::vector<VkCommandBuffer> compute;               // available compute command buffers
+    std::vector<VkCommandBuffer> submittedCompute;      // submitted in this frame
+    std::vector<VkSemaphore> semaphores;
+    size_t usedSemaphores = 0;
+    bool imageAvailableWaited = false;
+};
+
+// Uploads made outside of a frame are submitted to the transfer queue, the graphics queue waits
+// for their semaphore in its next submission. A transfer is reused once those graphics commands
+// are done too, since they may still wait for the semaphore until then.
+struct VulkanTransfer {
+    VulkanCommandBuffer commands;
+    VkSemaphore semaphore;
+    std::shared_ptr<VulkanCmdFence> waiter;     // the graphics commands waiting for the semaphore
+    bool pending = false;                       // submitted, but not waited for yet
+    bool free = false;
+};
+
+// Timestamp query pools, each holds a pair of queries for each of its timers. A pool is added
+// when all the timers of the existing ones are in use.
 struct VulkanTimestamps {
-    VkQueryPool pool;
-    utils::bitset32 used;
+    struct Pool {
+        VkQueryPool pool;
+        utils::bitset256 used;
+    };
+    std::vector<Pool> pools;
     utils::Mutex mutex;
 };
 
+// vkCmdBeginRenderPass is recorded with the first command of the render pass, since that's when
+// we know if its first subpass executes secondary command buffers, see
+// VulkanDriver::executeSubStreams(). Until then the render pass is pending.
 struct VulkanRenderPass {
     VkRenderPass renderPass;
     uint32_t subpassMask;
     int currentSubpass;
+    VkFramebuffer framebuffer;      // VK_NULL_HANDLE if the framebuffer is imageless
+    VkViewport viewport;            // the viewport in the coordinates of the framebuffer
+    VkRenderPassBeginInfo beginInfo;
+    VkClearValue clearValues[MRT::TARGET_COUNT + MRT::TARGET_COUNT + 1];
+    // The image views given to vkCmdBeginRenderPass when the framebuffer is imageless, in the
+    // order of VulkanFboCache::getImagelessFramebuffer. attachmentInfo has no views otherwise.
+    VkImageView attachments[MRT::TARGET_COUNT + MRT::TARGET_COUNT + 1];
+    VkRenderPassAttachmentBeginInfo attachmentInfo;
+    VkSubpassContents contents;     // contents of the current subpass
+    bool pending;
 };
 
 // For now we only support a single-device, single-instance scenario. Our concept of "context" is a
@@ -101,8 +151,48 @@ struct VulkanContext {
     VulkanTimestamps timestamps;
     uint32_t graphicsQueueFamilyIndex;
     VkQueue graphicsQueue;
+
+    // Queue of a family with compute but no graphics support, its work can overlap with the
+    // graphics queue's. It's VK_NULL_HANDLE when the device doesn't have such a family.
+    uint32_t computeQueueFamilyIndex;
+    VkQueue computeQueue;
+    VkCommandPool computeCommandPool;
+
+    // Queue of a family with transfer support only, typically a DMA engine, its uploads can
+    // overlap with the graphics queue's work. It's VK_NULL_HANDLE when the device doesn't have
+    // such a family.
+    uint32_t transferQueueFamilyIndex;
+    VkQueue transferQueue;
+    VkCommandPool transferCommandPool;
+    std::vector<VulkanTransfer> transfers;
+
+    // The async compute commands being recorded, between beginAsyncCompute() and
+    // endAsyncCompute(). currentCommands points to it while they're recorded.
+    VulkanCommandBuffer asyncCompute;
+
+    // The resources the async compute commands being recorded took the ownership of.
+    VulkanAsyncResources asyncResources;
+
+    // Semaphores that the next graphics submission must wait for.
+    std::vector<VkSemaphore> graphicsWaits;
+
     bool debugMarkersSupported;
     bool debugUtilsSupported;
+    bool multiviewSupported = false;    // VK_KHR_multiview
+    bool displayTimingSupported = false;    // VK_GOOGLE_display_timing, for presentation times
+
+    // VK_KHR_imageless_framebuffer, with the extensions it depends on. When it's supported, the
+    // offscreen render targets use framebuffers that only depend on the attachments' formats,
+    // usages and dimensions, and the attachments' images are created with a format list.
+    bool imagelessFramebufferSupported = false;
+
+    // Device extensions needed to import external images, see
+    // VulkanPlatform::getExternalImageExtensions(). They're enabled when the device supports all
+    // of them and the sampler YCbCr conversion feature, in which case externalImagesSupported is
+    // true.
+    const char* const* externalImageExtensions = nullptr;
+    uint32_t externalImageExtensionCount = 0;
+    bool externalImagesSupported = false;
     VulkanBinder::RasterState rasterState;
     VulkanCommandBuffer* currentCommands;
     VulkanSurfaceContext* currentSurface;
@@ -111,9 +201,21 @@ struct VulkanContext {
     VkFormat finalDepthFormat;
     VmaAllocator allocator;
 
+    // All the pipelines are created through this cache, which persists across runs of the
+    // application when the platform has blob functions.
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+
     // The work context is used for activities unrelated to the swap chain or draw calls, such as
-    // uploads, blits, and transitions.
+    // uploads, blits, and transitions. Submitted work command buffers are kept until their fence
+    // signals and are then recycled, so that recording more work never waits for the GPU. The
+    // resources of the ones recycled before releaseWork() are kept in completedWork, one set per
+    // command buffer since each holds its own references.
     VulkanCommandBuffer work;
+    std::vector<VulkanCommandBuffer> submittedWork;
+    std::vector<VulkanDisposer::Set> completedWork;
+
+    // Number of frames the GPU can work on at once, each needs its own swap context.
+    uint32_t maxFramesInFlight = 2;
 };
 
 struct VulkanAttachment {
@@ -125,6 +227,7 @@ struct VulkanAttachment {
     VkImageLayout layout;
     uint8_t level;
     uint16_t layer;
+    uint8_t viewCount = 1;  // layers rendered by a multiview render pass, starting at 'layer'
 };
 
 // The SwapContext is the set of objects that gets "swapped" at each beginFrame().
@@ -132,6 +235,7 @@ struct VulkanAttachment {
 struct SwapContext {
     VulkanAttachment attachment;
     VulkanCommandBuffer commands;
+    VulkanSubmissions submissions;
     bool invalid;
 };
 
@@ -171,11 +275,81 @@ void releaseCommandBuffer(VulkanContext& context);
 void flushCommandBuffer(VulkanContext& context);
 VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>& candidates,
         VkImageTiling tiling, VkFormatFeatureFlags features);
+void submitSwapCommandBuffer(VulkanContext& context, VkSemaphore signal, VkFence fence);
+void splitSwapCommandBuffer(VulkanContext& context, VkSemaphore signal);
+VkSemaphore acquireSwapSemaphore(VulkanContext& context);
+VkCommandBuffer acquireAsyncComputeCommandBuffer(VulkanContext& context);
+void acquireAsyncComputeBuffer(VulkanContext& context, VkBuffer buffer);
+void acquireAsyncComputeImage(VulkanContext& context, VkImage image);
+void transferAsyncComputeResources(VulkanContext& context, VulkanAsyncResources const& resources,
+        VkCommandBuffer cmdbuffer, bool toCompute, bool release);
+void destroySubmissions(VulkanContext& context, VulkanSubmissions& submissions);
 VkCommandBuffer acquireWorkCommandBuffer(VulkanContext& context);
 void flushWorkCommandBuffer(VulkanContext& context);
+void releaseWork(VulkanContext& context, VulkanDisposer& disposer);
+void destroyWork(VulkanContext& context, VulkanDisposer& disposer);
+VulkanCommandBuffer& acquireTransferCommandBuffer(VulkanContext& context, VulkanDisposer& disposer);
+void flushTransferCommandBuffer(VulkanContext& context, VulkanCommandBuffer& commands);
+void releaseTransfers(VulkanContext& context, VulkanDisposer& disposer);
+void destroyTransfers(VulkanContext& context, VulkanDisposer& disposer);
 void createFinalDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 VkImageLayout getTextureLayout(TextureUsage usage);
 
+// Whether 'commands' are the async compute commands, which can only use the compute stage.
+inline bool isAsyncCompute(VulkanContext const& context, VulkanCommandBuffer const& commands) {
+    return &commands == &context.asyncCompute;
+}
+
+// Whether 'commands' are for the transfer queue, which can only use the transfer stage.
+inline bool isTransfer(VulkanContext const& context, VulkanCommandBuffer const& commands) {
+    for (VulkanTransfer const& transfer : context.transfers) {
+        if (&commands == &transfer.commands) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Lets the transfer queue use a resource without ownership transfers. 'families' must have room
+// for 2 indices and outlive 'info'. The async compute queue takes the ownership of the resources
+// it uses instead, see acquireAsyncComputeBuffer().
+template<typename CreateInfo>
+void setConcurrentSharing(VulkanContext const& context, CreateInfo& info, uint32_t* families,
+        bool transfer) {
+    uint32_t count = 0;
+    families[count++] = context.graphicsQueueFamilyIndex;
+    if (transfer && context.transferQueue) {
+        families[count++] = context.transferQueueFamilyIndex;
+    }
+    if (count > 1) {
+        info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        info.queueFamilyIndexCount = count;
+        info.pQueueFamilyIndices = families;
+    }
+}
+
+// Records an upload to 'resource' with 'record', which takes the VulkanCommandBuffer to use.
+// Inside beginFrame / endFrame, it goes to the current commands. Otherwise it goes to the
+// transfer queue if the resource can be used there and no commands in flight reference it,
+// or to the work command buffer.
+template<typename Record>
+void recordUpload(VulkanContext& context, VulkanDisposer& disposer, VulkanDisposer::Key resource,
+        bool transferable, Record record) {
+    if (context.currentCommands) {
+        record(*context.currentCommands);
+    } else if (transferable && context.transferQueue && !disposer.isInUse(resource)) {
+        VulkanCommandBuffer& commands = acquireTransferCommandBuffer(context, disposer);
+        disposer.acquire(resource, commands.resources);
+        record(commands);
+        flushTransferCommandBuffer(context, commands);
+    } else {
+        acquireWorkCommandBuffer(context);
+        record(context.work);
+        flushWorkCommandBuffer(context);
+        releaseWork(context, disposer);
+    }
+}
+
 } // namespace filament
 } // namespace backend
 
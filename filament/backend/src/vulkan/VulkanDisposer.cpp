@@ -19,45 +19,57 @@
 namespace filament {
 namespace backend {
 
-void VulkanDisposer::createDisposable(Key resource, std::function<void()> destructor) noexcept {
-    mDisposables[resource].destructor = destructor;
+void VulkanDisposer::createDisposable(Key resource, Destructor destructor) noexcept {
+    mDisposables[resource] = { 1, destructor };
 }
 
 void VulkanDisposer::addReference(Key resource) noexcept {
-    assert(mDisposables[resource].refcount > 0);
-    ++mDisposables[resource].refcount;
+    auto iter = mDisposables.find(resource);
+    assert(iter != mDisposables.end() && iter->second.refcount > 0);
+    ++iter.value().refcount;
 }
 
 void VulkanDisposer::removeReference(Key resource) noexcept {
-    assert(mDisposables[resource].refcount > 0);
-    if (--mDisposables[resource].refcount == 0) {
-        mGraveyard.emplace_back(std::move(mDisposables[resource]));
-        mDisposables.erase(resource);
+    auto iter = mDisposables.find(resource);
+    assert(iter != mDisposables.end() && iter->second.refcount > 0);
+    if (--iter.value().refcount == 0) {
+        mGraveyard.push_back(iter->second.destructor);
+        mDisposables.erase(iter);
     }
 }
+
 void VulkanDisposer::acquire(Key resource, Set& resources) noexcept {
     if (resource == nullptr) {
         return;
     }
-    auto iter = resources.find(resource);
-    if (iter == resources.end()) {
-        resources.insert(resource);
-        addReference(resource);
-    }
+    resources.push_back(resource);
+    addReference(resource);
+}
+
+bool VulkanDisposer::isInUse(Key resource) const noexcept {
+    auto iter = mDisposables.find(resource);
+    return iter != mDisposables.end() && iter->second.refcount > 1;
 }
 
 void VulkanDisposer::release(Set& resources) {
-    for (auto resource : resources) {
+    for (Key resource : resources) {
         removeReference(resource);
     }
+    // the capacity is kept for the next use of the set
     resources.clear();
 }
 
 void VulkanDisposer::gc() noexcept {
-    for (auto& ptr : mGraveyard) {
-        ptr.destructor();
+    // the destructors can remove references, which adds to the graveyard
+    std::vector<Destructor> graveyard;
+    graveyard.swap(mGraveyard);
+    for (Destructor const& destructor : graveyard) {
+        destructor.function(destructor.user, destructor.argument);
+    }
+    graveyard.clear();
+    if (mGraveyard.empty()) {
+        mGraveyard.swap(graveyard);
     }
-    mGraveyard.clear();
 }
 
 void VulkanDisposer::reset() noexcept {
@@ -18,10 +18,9 @@
 #define TNT_FILAMENT_DRIVER_VULKANDISPOSER_H
 
 #include <tsl/robin_map.h>
-#include <tsl/robin_set.h>
 
-#include <functional>
-#include <memory>
+#include <stdint.h>
+
 #include <vector>
 
 namespace filament {
@@ -31,14 +30,26 @@ namespace backend {
 // destruction due to potential use by one or more reference holders. An example of a reference
 // holder is an active Vulkan command buffer. Resources are represented with void* to allow callers
 // to use any type of handle. Reference holders (e.g. VulkanCommandBuffer) have an associated
-// robin_set of resource handles.
+// Set of resource handles, which they release all at once when their fence has signaled.
+//
+// Nothing is allocated per resource once the containers have grown: the destructors are plain
+// records rather than closures, and a Set is a vector that can hold the same resource more than
+// once, each entry holding its own reference, which is cheaper than looking it up.
 class VulkanDisposer {
 public:
     using Key = const void*;
-    using Set = tsl::robin_set<Key>;
+    using Set = std::vector<Key>;
+
+    // Destroys a resource by calling function(user, argument), e.g. with the driver and the id of
+    // a handle.
+    struct Destructor {
+        void (*function)(void* user, uint64_t argument);
+        void* user;
+        uint64_t argument;
+    };
 
     // Adds the given resource to the disposer and sets its reference count to 1.
-    void createDisposable(Key resource, std::function<void()> destructor) noexcept;
+    void createDisposable(Key resource, Destructor destructor) noexcept;
 
     // Increments the reference count.
     void addReference(Key resource) noexcept;
@@ -46,10 +57,13 @@ public:
     // Decrements the reference count and moves it to the graveyard if it becomes 0.
     void removeReference(Key resource) noexcept;
 
-    // If the given resource is not in the given set, then it gets added to the set and its
-    // reference count is incremented.
+    // Adds the given resource to the given set and increments its reference count.
     void acquire(Key resource, Set& resources) noexcept;
 
+    // Whether something else than the owner of the resource references it, e.g. a command buffer
+    // that may not have completed yet.
+    bool isInUse(Key resource) const noexcept;
+
     // Decrements the reference count for all resources in the set, then clears it.
     void release(Set& resources);
 
@@ -62,10 +76,10 @@ public:
 private:
     struct Disposable {
         int refcount = 1;
-        std::function<void()> destructor;
+        Destructor destructor;
     };
     tsl::robin_map<Key, Disposable> mDisposables;
-    std::vector<Disposable> mGraveyard;
+    std::vector<Destructor> mGraveyard;
 };
 
 } // namespace filament
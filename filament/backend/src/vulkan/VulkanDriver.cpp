@@ -23,10 +23,16 @@
 #include "VulkanHandles.h"
 #include "VulkanPlatform.h"
 
+#include "private/backend/CommandStream.h"
+
+#include <utils/algorithm.h>
 #include <utils/Panic.h>
 #include <utils/CString.h>
 #include <utils/trap.h>
 
+#include <algorithm>
+#include <thread>
+
 #ifndef NDEBUG
 #include <set>
 #endif
@@ -79,6 +85,15 @@ VKAPI_ATTR VkBool32 VKAPI_CALL debugUtilsCallback(VkDebugUtilsMessageSeverityFla
 namespace filament {
 namespace backend {
 
+UTILS_DEFINE_TLS(VulkanDriver::SubStreamRecorder*) VulkanDriver::sSubStream;
+
+// Only vkCmdExecuteCommands can be recorded in a subpass that executes secondary command buffers,
+// so markers are dropped there.
+static bool executesSecondaryCommandBuffers(VulkanRenderPass const& renderPass) {
+    return renderPass.renderPass != VK_NULL_HANDLE && !renderPass.pending &&
+            renderPass.contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS;
+}
+
 Driver* VulkanDriverFactory::create(VulkanPlatform* const platform,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept {
     return VulkanDriver::create(platform, ppEnabledExtensions, enabledExtensionCount);
@@ -87,7 +102,10 @@ Driver* VulkanDriverFactory::create(VulkanPlatform* const platform,
 VulkanDriver::VulkanDriver(VulkanPlatform* platform,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>()),
-        mContextManager(*platform), mStagePool(mContext, mDisposer), mFramebufferCache(mContext),
+        mContextManager(*platform),
+        // objects larger than the largest pool, like render targets, are allocated on the heap
+        mHandleMap("Handles", HANDLE_ARENA_SIZE, { 32, 96, 256 }),
+        mStagePool(mContext, mDisposer), mFramebufferCache(mContext),
         mSamplerCache(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
 
@@ -186,6 +204,10 @@ VulkanDriver::VulkanDriver(VulkanPlatform* platform,
     }
 #endif
 
+    // The extensions needed to import external images are enabled if the device has them all.
+    mContext.externalImageExtensions = mContextManager.getExternalImageExtensions(
+            &mContext.externalImageExtensionCount);
+
     // Initialize the following fields: physicalDevice, physicalDeviceProperties,
     // physicalDeviceFeatures, graphicsQueueFamilyIndex.
     selectPhysicalDevice(mContext);
@@ -193,6 +215,8 @@ VulkanDriver::VulkanDriver(VulkanPlatform* platform,
     // Initialize device and graphicsQueue.
     createLogicalDevice(mContext);
     mBinder.setDevice(mContext.device);
+    createPipelineCache();
+    createComputeLayout();
 
     // Choose a depth format that meets our requirements. Take care not to include stencil formats
     // just yet, since that would require a corollary change to the "aspect" flags for the VkImage.
@@ -243,28 +267,46 @@ void VulkanDriver::terminate() {
         return;
     }
 
-    // Flush the work command buffer.
-    acquireWorkCommandBuffer(mContext);
-    mDisposer.release(mContext.work.resources);
+    // Destroy the work command buffers and transfers once the GPU is done with them.
+    destroyWork(mContext, mDisposer);
+    destroyTransfers(mContext, mDisposer);
+
+    // The device is idle, deliver the pending read-backs.
+    completeReadPixels(true);
+    for (ReadPixelsStage const& stage : mFreeReadPixelsStages) {
+        destroyReadPixelsStage(stage);
+    }
+    mFreeReadPixelsStages.clear();
 
     // Allow the stage pool and disposer to clean up.
     mStagePool.gc();
     mDisposer.reset();
 
-    // Destroy the work command buffer and fence.
-    VulkanCommandBuffer& work = mContext.work;
-    VkDevice device = mContext.device;
-    vkFreeCommandBuffers(device, mContext.commandPool, 1, &work.cmdbuffer);
-    work.fence.reset();
-
     mStagePool.reset();
     mBinder.destroyCache();
+    mSubStreams.clear();
+    mRecorder.reset();
+    if (mJobSystem) {
+        mJobSystem->emancipate();
+        mJobSystem.reset();
+    }
+    destroyComputeLayout();
+    destroyPipelineCache();
     mFramebufferCache.reset();
     mSamplerCache.reset();
 
     vmaDestroyAllocator(mContext.allocator);
-    vkDestroyQueryPool(mContext.device, mContext.timestamps.pool, VKALLOC);
+    for (VulkanTimestamps::Pool const& pool : mContext.timestamps.pools) {
+        vkDestroyQueryPool(mContext.device, pool.pool, VKALLOC);
+    }
+    mContext.timestamps.pools.clear();
     vkDestroyCommandPool(mContext.device, mContext.commandPool, VKALLOC);
+    if (mContext.computeCommandPool) {
+        vkDestroyCommandPool(mContext.device, mContext.computeCommandPool, VKALLOC);
+    }
+    if (mContext.transferCommandPool) {
+        vkDestroyCommandPool(mContext.device, mContext.transferCommandPool, VKALLOC);
+    }
     vkDestroyDevice(mContext.device, VKALLOC);
     if (mDebugCallback) {
         vkDestroyDebugReportCallbackEXT(mContext.instance, mDebugCallback, VKALLOC);
@@ -278,6 +320,7 @@ void VulkanDriver::terminate() {
 }
 
 void VulkanDriver::tick(int) {
+    completeReadPixels(false);
     if (!mContext.currentSurface) {
         return;
     }
@@ -294,16 +337,38 @@ void VulkanDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId,
         backend::FrameFinishedCallback, void*) {
     // We allow multiple beginFrame / endFrame pairs before commit(), so gracefully return early
     // if the swap chain has already been acquired.
+    mInFrame = true;
     if (mContext.currentCommands) {
         return;
     }
 
-    // After each command buffer acquisition, we know that the previous submission of the acquired
-    // command buffer has finished, so we can decrement the refcount for each of its referenced
-    // resources.
+    // Decrement the refcount of the resources referenced by the work and transfer command buffers
+    // whose submission has finished, without waiting for the others.
 
     acquireWorkCommandBuffer(mContext);
-    mDisposer.release(mContext.work.resources);
+    releaseWork(mContext, mDisposer);
+    releaseTransfers(mContext, mDisposer);
+    completeReadPixels(false);
+
+    acquireSwapChain();
+
+    // Free old unused objects.
+    mStagePool.gc();
+    mFramebufferCache.gc();
+    mBinder.gc();
+    for (auto& subStream : mSubStreams) {
+        subStream->binder.gc();
+    }
+    mDisposer.gc();
+}
+
+void VulkanDriver::acquireSwapChain() {
+    // A swap chain can be committed twice in a frame, its first image must be presented before
+    // the next one is acquired.
+    if (std::find(mPendingPresents.begin(), mPendingPresents.end(), mContext.currentSurface) !=
+            mPendingPresents.end()) {
+        presentSwapChains();
+    }
 
     // With MoltenVK, it might take several attempts to acquire a swap chain that is not marked as
     // "out of date" after a resize event.
@@ -349,19 +414,21 @@ void VulkanDriver::beginFrame(int64_t monotonic_clock_ns, uint32_t frameId,
     // of allowing us to safely mutate descriptor sets. For now we're avoiding that strategy in the
     // interest of maintaining a small memory footprint.
     mBinder.resetBindings();
-
-    // Free old unused objects.
-    mStagePool.gc();
-    mFramebufferCache.gc();
-    mBinder.gc();
-    mDisposer.gc();
 }
 
 void VulkanDriver::setPresentationTime(int64_t monotonic_clock_ns) {
+    // applied to the swap chains presented next, see presentSwapChains()
+    mPresentationTime = mContext.displayTimingSupported ? monotonic_clock_ns : 0;
 }
 
 void VulkanDriver::endFrame(uint32_t frameId) {
-    // Do nothing here; see commit().
+    // The command buffers were submitted by commit(), only the presents are left.
+    presentSwapChains();
+    mInFrame = false;
+}
+
+void VulkanDriver::setMaxFramesInFlight(uint32_t count) {
+    mContext.maxFramesInFlight = count;
 }
 
 void VulkanDriver::flush(int) {
@@ -369,7 +436,12 @@ void VulkanDriver::flush(int) {
 }
 
 void VulkanDriver::finish(int) {
-    // Todo: equivalent of glFinish()
+    // The commands being recorded are not submitted, like glFinish() we only wait for the ones
+    // that were flushed.
+    vkQueueWaitIdle(mContext.graphicsQueue);
+    if (mContext.computeQueue != VK_NULL_HANDLE) {
+        vkQueueWaitIdle(mContext.computeQueue);
+    }
 }
 
 void VulkanDriver::createSamplerGroupR(Handle<HwSamplerGroup> sbh, size_t count) {
@@ -380,15 +452,21 @@ void VulkanDriver::createUniformBufferR(Handle<HwUniformBuffer> ubh, size_t size
         BufferUsage usage) {
     auto uniformBuffer = construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext,
             mStagePool, mDisposer, size, usage);
-    mDisposer.createDisposable(uniformBuffer, [this, ubh] () {
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
-    });
+    mDisposer.createDisposable(uniformBuffer, handleDestructor<VulkanUniformBuffer>(ubh));
 }
 
 void VulkanDriver::destroyUniformBuffer(Handle<HwUniformBuffer> ubh) {
     if (ubh) {
         auto buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
         mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
+        for (auto& subStream : mSubStreams) {
+            subStream->binder.unbindUniformBuffer(buffer->getGpuBuffer());
+        }
+        for (VkDescriptorBufferInfo& info : mCompute.storageBuffers) {
+            if (info.buffer == buffer->getGpuBuffer()) {
+                info = {};
+            }
+        }
 
         // We do not know if any pending draw calls are making use of this uniform buffer,
         // so assume the worst: that all command buffers are all using it.
@@ -417,9 +495,7 @@ void VulkanDriver::createVertexBufferR(Handle<HwVertexBuffer> vbh, uint8_t buffe
         BufferUsage usage) {
     auto vertexBuffer = construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool,
             mDisposer, bufferCount, attributeCount, elementCount, attributes);
-    mDisposer.createDisposable(vertexBuffer, [this, vbh] () {
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
-    });
+    mDisposer.createDisposable(vertexBuffer, handleDestructor<VulkanVertexBuffer>(vbh));
 }
 
 void VulkanDriver::destroyVertexBuffer(Handle<HwVertexBuffer> vbh) {
@@ -434,9 +510,7 @@ void VulkanDriver::createIndexBufferR(Handle<HwIndexBuffer> ibh,
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
     auto indexBuffer = construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool,
             mDisposer, elementSize, indexCount);
-    mDisposer.createDisposable(indexBuffer, [this, ibh] () {
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
-    });
+    mDisposer.createDisposable(indexBuffer, handleDestructor<VulkanIndexBuffer>(ibh));
 }
 
 void VulkanDriver::destroyIndexBuffer(Handle<HwIndexBuffer> ibh) {
@@ -450,10 +524,8 @@ void VulkanDriver::createTextureR(Handle<HwTexture> th, SamplerType target, uint
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
     auto vktexture = construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels,
-            format, samples, w, h, depth, usage, mStagePool);
-    mDisposer.createDisposable(vktexture, [this, th] () {
-        destruct_handle<VulkanTexture>(mHandleMap, th);
-    });
+            format, samples, w, h, depth, usage, mStagePool, mDisposer);
+    mDisposer.createDisposable(vktexture, handleDestructor<VulkanTexture>(th));
 }
 
 void VulkanDriver::createTextureSwizzledR(Handle<HwTexture> th, SamplerType target, uint8_t levels,
@@ -461,10 +533,8 @@ void VulkanDriver::createTextureSwizzledR(Handle<HwTexture> th, SamplerType targ
         TextureUsage usage,
         TextureSwizzle r, TextureSwizzle g, TextureSwizzle b, TextureSwizzle a) {
     auto vktexture = construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels,
-            format, samples, w, h, depth, usage, mStagePool);
-    mDisposer.createDisposable(vktexture, [this, th] () {
-        destruct_handle<VulkanTexture>(mHandleMap, th);
-    });
+            format, samples, w, h, depth, usage, mStagePool, mDisposer);
+    mDisposer.createDisposable(vktexture, handleDestructor<VulkanTexture>(th));
     // TODO: implement texture swizzling
 }
 
@@ -478,16 +548,30 @@ void VulkanDriver::importTextureR(Handle<HwTexture> th, intptr_t id,
 void VulkanDriver::destroyTexture(Handle<HwTexture> th) {
     if (th) {
         auto texture = handle_cast<VulkanTexture>(mHandleMap, th);
-        mBinder.unbindImageView(texture->imageView);
+        detachExternalImage(texture);
+        if (texture->stream) {
+            mExternalStreams.erase(std::find(mExternalStreams.begin(), mExternalStreams.end(),
+                    texture));
+        }
+        for (VkImageView view : texture->getPrimaryViews()) {
+            mBinder.unbindImageView(view);
+            for (auto& subStream : mSubStreams) {
+                subStream->binder.unbindImageView(view);
+            }
+        }
+        for (size_t i = 0; i < STORAGE_IMAGE_BINDING_COUNT; i++) {
+            if (mCompute.textures[i] == texture) {
+                mCompute.textures[i] = nullptr;
+                mCompute.images[i] = {};
+            }
+        }
         mDisposer.removeReference(texture);
     }
 }
 
 void VulkanDriver::createProgramR(Handle<HwProgram> ph, Program&& program) {
     auto vkprogram = construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
-    mDisposer.createDisposable(vkprogram, [this, ph] () {
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
-    });
+    mDisposer.createDisposable(vkprogram, handleDestructor<VulkanProgram>(ph));
 }
 
 void VulkanDriver::destroyProgram(Handle<HwProgram> ph) {
@@ -498,9 +582,7 @@ void VulkanDriver::destroyProgram(Handle<HwProgram> ph) {
 
 void VulkanDriver::createDefaultRenderTargetR(Handle<HwRenderTarget> rth, int) {
     auto renderTarget = construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
-    mDisposer.createDisposable(renderTarget, [this, rth] () {
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
-    });
+    mDisposer.createDisposable(renderTarget, handleDestructor<VulkanRenderTarget>(rth));
 }
 
 void VulkanDriver::createRenderTargetR(Handle<HwRenderTarget> rth,
@@ -513,6 +595,7 @@ void VulkanDriver::createRenderTargetR(Handle<HwRenderTarget> rth,
         }
         colorTargets[i].level = color[i].level;
         colorTargets[i].layer = color[i].layer;
+        colorTargets[i].viewCount = color[i].viewCount;
     }
 
     VulkanAttachment depthStencil[2] = {};
@@ -520,17 +603,17 @@ void VulkanDriver::createRenderTargetR(Handle<HwRenderTarget> rth,
     depthStencil[0].texture = handle ? handle_cast<VulkanTexture>(mHandleMap, handle) : nullptr;
     depthStencil[0].level = depth.level;
     depthStencil[0].layer = depth.layer;
+    depthStencil[0].viewCount = depth.viewCount;
 
     handle = stencil.handle;
     depthStencil[1].texture = handle ? handle_cast<VulkanTexture>(mHandleMap, handle) : nullptr;
     depthStencil[1].level = stencil.level;
     depthStencil[1].layer = stencil.layer;
+    depthStencil[1].viewCount = stencil.viewCount;
 
     auto renderTarget = construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext,
-            width, height, samples, colorTargets, depthStencil, mStagePool);
-    mDisposer.createDisposable(renderTarget, [this, rth] () {
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
-    });
+            width, height, samples, colorTargets, depthStencil, mStagePool, mDisposer);
+    mDisposer.createDisposable(renderTarget, handleDestructor<VulkanRenderTarget>(rth));
 }
 
 void VulkanDriver::destroyRenderTarget(Handle<HwRenderTarget> rth) {
@@ -651,9 +734,7 @@ Handle<HwTimerQuery> VulkanDriver::createTimerQueryS() noexcept {
     // before createTimerQueryR is executed.
     Handle<HwTimerQuery> tqh = alloc_handle<VulkanTimerQuery, HwTimerQuery>();
     auto query = construct_handle<VulkanTimerQuery>(mHandleMap, tqh, mContext);
-    mDisposer.createDisposable(query, [this, tqh] () {
-        destruct_handle<VulkanTimerQuery>(mHandleMap, tqh);
-    });
+    mDisposer.createDisposable(query, handleDestructor<VulkanTimerQuery>(tqh));
     return tqh;
 }
 
@@ -669,6 +750,13 @@ void VulkanDriver::destroySamplerGroup(Handle<HwSamplerGroup> sbh) {
                 binding = nullptr;
             }
         }
+        for (auto& subStream : mSubStreams) {
+            for (auto& binding : subStream->samplerBindings) {
+                if (binding == hwsb) {
+                    binding = nullptr;
+                }
+            }
+        }
         destruct_handle<VulkanSamplerGroup>(mHandleMap, sbh);
     }
 }
@@ -676,6 +764,7 @@ void VulkanDriver::destroySamplerGroup(Handle<HwSamplerGroup> sbh) {
 void VulkanDriver::destroySwapChain(Handle<HwSwapChain> sch) {
     if (sch) {
         VulkanSurfaceContext& surfaceContext = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+        presentSwapChains();
         backend::destroySwapChain(mContext, surfaceContext, mDisposer);
 
         vkDestroySurfaceKHR(mContext.instance, surfaceContext.surface, VKALLOC);
@@ -688,6 +777,22 @@ void VulkanDriver::destroySwapChain(Handle<HwSwapChain> sch) {
 }
 
 void VulkanDriver::destroyStream(Handle<HwStream> sh) {
+    if (sh) {
+        // the textures attached to the stream keep sampling its last image
+        VulkanStream* stream = handle_cast<VulkanStream>(mHandleMap, sh);
+        mExternalStreams.erase(std::remove_if(mExternalStreams.begin(), mExternalStreams.end(),
+                [stream](VulkanTexture* texture) {
+                    if (texture->stream != stream) {
+                        return false;
+                    }
+                    texture->stream = nullptr;
+                    return true;
+                }), mExternalStreams.end());
+        if (stream->pending.image) {
+            scheduleRelease(std::move(stream->pending));
+        }
+        destruct_handle<VulkanStream>(mHandleMap, sh);
+    }
 }
 
 void VulkanDriver::destroyTimerQuery(Handle<HwTimerQuery> tqh) {
@@ -706,11 +811,22 @@ Handle<HwStream> VulkanDriver::createStreamNative(void* nativeStream) {
 }
 
 Handle<HwStream> VulkanDriver::createStreamAcquired() {
-    return {};
+    Handle<HwStream> sh = alloc_handle<VulkanStream, HwStream>();
+    construct_handle<VulkanStream>(mHandleMap, sh);
+    return sh;
 }
 
+// Stashes the acquired image until the next updateStreams(), which is called before beginFrame.
+// If several images are set in the same frame, only the last one is used but all the callbacks
+// are called.
 void VulkanDriver::setAcquiredImage(Handle<HwStream> sh, void* image, backend::StreamCallback cb,
         void* userData) {
+    VulkanStream* stream = handle_cast<VulkanStream>(mHandleMap, sh);
+    if (stream->pending.image) {
+        scheduleRelease(std::move(stream->pending));
+        utils::slog.w << "Acquired image is set more than once per frame." << utils::io::endl;
+    }
+    stream->pending = { image, cb, userData };
 }
 
 void VulkanDriver::setStreamDimensions(Handle<HwStream> sh, uint32_t width, uint32_t height) {
@@ -721,6 +837,18 @@ int64_t VulkanDriver::getStreamTimestamp(Handle<HwStream> sh) {
 }
 
 void VulkanDriver::updateStreams(CommandStream* driver) {
+    for (VulkanTexture* texture : mExternalStreams) {
+        // the stream can be null since setExternalStream() may not have been processed yet
+        VulkanStream* stream = texture->stream;
+        if (!stream || !stream->pending.image) {
+            continue;
+        }
+        AcquiredImage acquired = stream->pending;
+        stream->pending = {};
+        driver->queueCommand([this, texture, acquired]() {
+            importExternalImage(texture, acquired.image, acquired);
+        });
+    }
 }
 
 void VulkanDriver::destroyFence(Handle<HwFence> fh) {
@@ -776,6 +904,12 @@ bool VulkanDriver::isTextureFormatMipmappable(backend::TextureFormat format) {
     }
 }
 
+bool VulkanDriver::isTextureFormatReshaped(TextureFormat format) {
+    // 24-bit and 48-bit color formats are stored as 32-bit and 64-bit formats, see getVkFormat()
+    const uint32_t bytesPerPixel = getBytesPerPixel(format);
+    return format != TextureFormat::DEPTH24 && (bytesPerPixel == 3 || bytesPerPixel == 6);
+}
+
 bool VulkanDriver::isRenderTargetFormatSupported(TextureFormat format) {
     assert(mContext.physicalDevice);
     VkFormat vkformat = getVkFormat(format);
@@ -795,26 +929,55 @@ bool VulkanDriver::isFrameBufferFetchSupported() {
     return true;
 }
 
+bool VulkanDriver::isComputeSupported() {
+    // compute shaders are a core feature of Vulkan
+    return true;
+}
+
+bool VulkanDriver::isDrawIndirectSupported() {
+    // indirect draws are a core feature of Vulkan, multiDrawIndirect is optional
+    return true;
+}
+
 bool VulkanDriver::isFrameTimeSupported() {
     return true;
 }
 
+bool VulkanDriver::isFoveatedRenderingSupported() {
+    // the Vulkan headers used here predate VK_KHR_fragment_shading_rate, the foveation parameters
+    // are ignored
+    return false;
+}
+
+bool VulkanDriver::isMultiviewSupported() {
+    return mContext.multiviewSupported;
+}
+
+uint32_t VulkanDriver::getUniformBufferOffsetAlignment() {
+    return uint32_t(mContext.physicalDeviceProperties.limits.minUniformBufferOffsetAlignment);
+}
+
 math::float2 VulkanDriver::getClipSpaceParams() {
     // z-coordinate of clip-space is in [0,w]
     return math::float2{ -0.5f, 0.5f };
 }
 
+void VulkanDriver::compilePrograms(CompileCallback callback, void* user) {
+    // shader modules are created with the programs, there is nothing left to compile
+    scheduleCallback(callback, user);
+}
+
 void VulkanDriver::updateVertexBuffer(Handle<HwVertexBuffer> vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset) {
     auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
-    vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, p.size);
+    vb.buffers[index]->loadFromCpu(p, byteOffset);
     scheduleDestroy(std::move(p));
 }
 
 void VulkanDriver::updateIndexBuffer(Handle<HwIndexBuffer> ibh, BufferDescriptor&& p,
         uint32_t byteOffset) {
     auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
-    ib.buffer->loadFromCpu(p.buffer, byteOffset, p.size);
+    ib.buffer->loadFromCpu(p, byteOffset);
     scheduleDestroy(std::move(p));
 }
 
@@ -843,9 +1006,11 @@ void VulkanDriver::updateCubeImage(Handle<HwTexture> th, uint32_t level,
 }
 
 void VulkanDriver::setupExternalImage(void* image) {
+    mContextManager.retainExternalImage(image);
 }
 
 void VulkanDriver::cancelExternalImage(void* image) {
+    mContextManager.releaseExternalImage(image);
 }
 
 bool VulkanDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapsedTime) {
@@ -868,7 +1033,7 @@ bool VulkanDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapse
     size_t dataSize = sizeof(results);
     VkDeviceSize stride = sizeof(uint64_t) * 2;
 
-    VkResult result = vkGetQueryPoolResults(mContext.device, mContext.timestamps.pool,
+    VkResult result = vkGetQueryPoolResults(mContext.device, vtq->pool,
             vtq->startingQueryIndex, 2, dataSize, (void*) results, stride,
             VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
 
@@ -893,6 +1058,22 @@ bool VulkanDriver::getTimerQueryValue(Handle<HwTimerQuery> tqh, uint64_t* elapse
     return true;
 }
 
+bool VulkanDriver::getFrameStatistics(FrameStatistics* statistics) {
+    return false;
+}
+
+bool VulkanDriver::getMemoryStatistics(MemoryStatistics* statistics) {
+    // The allocator is internally synchronized, and its budget is cheap to query every frame.
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetBudget(mContext.allocator, budgets);
+    *statistics = {};
+    for (uint32_t i = 0; i < mContext.memoryProperties.memoryHeapCount; i++) {
+        statistics->allocatedBytes += budgets[i].blockBytes;
+    }
+    statistics->stagingBytes = mStagePool.getSize();
+    return true;
+}
+
 SyncStatus VulkanDriver::getSyncStatus(Handle<HwSync> sh) {
     VulkanSync* sync = handle_cast<VulkanSync>(mHandleMap, sh);
     if (sync->fence == nullptr) {
@@ -909,17 +1090,138 @@ SyncStatus VulkanDriver::getSyncStatus(Handle<HwSync> sh) {
     }
 }
 
+BufferDescriptor VulkanDriver::allocateStaging(size_t size) {
+    return mStagePool.acquireStaging(uint32_t(size));
+}
+
+intptr_t VulkanDriver::getTextureNativeId(Handle<HwTexture> th) {
+    // each driver has its own VkDevice, textures can't be imported from another driver
+    return 0;
+}
+
 void VulkanDriver::setExternalImage(Handle<HwTexture> th, void* image) {
+    // the imported image holds its own reference to the platform image
+    importExternalImage(handle_cast<VulkanTexture>(mHandleMap, th), image, {});
+    mContextManager.releaseExternalImage(image);
 }
 
 void VulkanDriver::setExternalImagePlane(Handle<HwTexture> th, void* image, size_t plane) {
+    // The planes of an external image are sampled at once through its YCbCr conversion.
+    mContextManager.releaseExternalImage(image);
 }
 
 void VulkanDriver::setExternalStream(Handle<HwTexture> th, Handle<HwStream> sh) {
+    VulkanTexture* texture = handle_cast<VulkanTexture>(mHandleMap, th);
+    VulkanStream* stream = sh ? handle_cast<VulkanStream>(mHandleMap, sh) : nullptr;
+    if (stream && !texture->stream) {
+        mExternalStreams.push_back(texture);
+    } else if (!stream && texture->stream) {
+        mExternalStreams.erase(std::find(mExternalStreams.begin(), mExternalStreams.end(),
+                texture));
+    }
+    texture->stream = stream;
+}
+
+void VulkanDriver::importExternalImage(VulkanTexture* texture, void* image,
+        AcquiredImage const& acquired) {
+    VulkanPlatform::ExternalImage imported;
+    if (!mContext.externalImagesSupported || !mContextManager.importExternalImage(
+            mContext.physicalDevice, mContext.device, image, &imported)) {
+        utils::slog.e << "Unable to import external image." << utils::io::endl;
+        if (acquired.image) {
+            scheduleRelease(AcquiredImage(acquired));
+        }
+        return;
+    }
+
+    VkSamplerYcbcrConversionInfo conversionInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO
+    };
+    VkSampler ycbcrSampler = VK_NULL_HANDLE;
+    if (imported.ycbcr) {
+        const VulkanSamplerCache::YcbcrSampler sampler = mSamplerCache.getYcbcrSampler(imported);
+        conversionInfo.conversion = sampler.conversion;
+        ycbcrSampler = sampler.sampler;
+    }
+    const VkImageSubresourceRange range = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = 1,
+        .layerCount = 1
+    };
+    VkImageViewCreateInfo viewInfo = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .pNext = imported.ycbcr ? &conversionInfo : nullptr,
+        .image = imported.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = imported.format,
+        .subresourceRange = range
+    };
+    VkImageView view;
+    VkResult error = vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &view);
+    ASSERT_POSTCONDITION(!error, "Unable to create image view.");
+
+    auto* external = new VulkanExternalImage { imported, view, ycbcrSampler, acquired };
+    mDisposer.createDisposable(external, { [](void* user, uint64_t argument) {
+        VulkanDriver* const driver = static_cast<VulkanDriver*>(user);
+        auto* external = reinterpret_cast<VulkanExternalImage*>(uintptr_t(argument));
+        vkDestroyImageView(driver->mContext.device, external->view, VKALLOC);
+        driver->mContextManager.destroyExternalImage(driver->mContext.device, external->image);
+        if (external->acquired.image) {
+            driver->scheduleRelease(std::move(external->acquired));
+        }
+        delete external;
+    }, this, uintptr_t(external) });
+
+    // The image is acquired from its producer (e.g. the camera) and transitioned to the layout
+    // it is sampled in. Its content is preserved, even though the old layout is undefined.
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = imported.queueFamily,
+        .dstQueueFamilyIndex = mContext.graphicsQueueFamilyIndex,
+        .image = imported.image,
+        .subresourceRange = range
+    };
+    auto transition = [&](VulkanCommandBuffer& commands) {
+        vkCmdPipelineBarrier(commands.cmdbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                0, 0, nullptr, 0, nullptr, 1, &barrier);
+        mDisposer.acquire(external, commands.resources);
+    };
+    if (mContext.currentCommands) {
+        transition(*mContext.currentCommands);
+    } else {
+        acquireWorkCommandBuffer(mContext);
+        transition(mContext.work);
+        flushWorkCommandBuffer(mContext);
+        releaseWork(mContext, mDisposer);
+    }
+
+    detachExternalImage(texture);
+    texture->externalImage = external;
+}
+
+void VulkanDriver::detachExternalImage(VulkanTexture* texture) {
+    VulkanExternalImage* external = texture->externalImage;
+    if (!external) {
+        return;
+    }
+    mBinder.unbindImageView(external->view);
+    for (auto& subStream : mSubStreams) {
+        subStream->binder.unbindImageView(external->view);
+    }
+    mDisposer.removeReference(external);
+    texture->externalImage = nullptr;
 }
 
 void VulkanDriver::generateMipmaps(Handle<HwTexture> th) { }
 
+void VulkanDriver::setMinMaxLevels(Handle<HwTexture> th, uint32_t minLevel, uint32_t maxLevel) {
+    handle_cast<VulkanTexture>(mHandleMap, th)->setPrimaryRange(minLevel, maxLevel);
+}
+
 bool VulkanDriver::canGenerateMipmaps() {
     return false;
 }
@@ -927,11 +1229,20 @@ bool VulkanDriver::canGenerateMipmaps() {
 void VulkanDriver::loadUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data) {
     if (data.size > 0) {
         auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-        buffer->loadFromCpu(data.buffer, (uint32_t) data.size);
+        buffer->loadFromCpu(data, 0);
         scheduleDestroy(std::move(data));
     }
 }
 
+void VulkanDriver::updateUniformBuffer(Handle<HwUniformBuffer> ubh, BufferDescriptor&& data,
+        uint32_t byteOffset) {
+    if (data.size > 0) {
+        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        buffer->loadFromCpu(data, byteOffset);
+    }
+    scheduleDestroy(std::move(data));
+}
+
 void VulkanDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
         SamplerGroup&& samplerGroup) {
     auto* sb = handle_cast<VulkanSamplerGroup>(mHandleMap, sbh);
@@ -940,6 +1251,7 @@ void VulkanDriver::updateSamplerGroup(Handle<HwSamplerGroup> sbh,
 
 void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassParams& params) {
     assert(mContext.currentCommands);
+    assert(!isAsyncCompute(mContext, *mContext.currentCommands));
     assert(mContext.currentSurface);
     VulkanSurfaceContext& surface = *mContext.currentSurface;
     mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
@@ -966,7 +1278,8 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
         .discardStart = discardStart,
         .discardEnd = params.flags.discardEnd,
         .samples = rt->getSamples(),
-        .subpassMask = uint8_t(params.subpassMask)
+        .subpassMask = uint8_t(params.subpassMask),
+        .viewCount = rt->getViewCount()
     };
     for (int i = 0; i < MRT::TARGET_COUNT; i++) {
         rpkey.colorLayout[i] = rt->getColor(i).layout;
@@ -1010,7 +1323,50 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
         fbkey.depth = rpkey.samples == 1 ? depth.view : rt->getMsaaDepth().view;
         assert(fbkey.depth);
     }
-    VkFramebuffer vkfb = mFramebufferCache.getFramebuffer(fbkey);
+
+    // The offscreen render targets are often made of transient textures that change from frame
+    // to frame, so they use imageless framebuffers whose attachments are only described, and
+    // give their image views to vkCmdBeginRenderPass.
+    const bool imageless = mContext.imagelessFramebufferSupported && rt->isOffscreen();
+    VkImageView attachments[VulkanFboCache::ATTACHMENT_COUNT];
+    uint32_t attachmentCount = 0;
+    VkFramebuffer vkfb;
+    if (imageless) {
+        VulkanFboCache::ImagelessFboKey key = {
+            .renderPass = renderPass,
+            .width = fbkey.width,
+            .height = fbkey.height,
+            .layers = fbkey.layers,
+            .viewCount = rt->getViewCount()
+        };
+        auto addAttachment = [&key, &attachments](VkImageView view, VulkanTexture* texture) {
+            assert(texture);
+            attachments[key.attachmentCount] = view;
+            key.formats[key.attachmentCount] = texture->vkformat;
+            key.usages[key.attachmentCount] = texture->vkusage;
+            key.flags[key.attachmentCount] = texture->vkflags;
+            key.attachmentCount++;
+        };
+        for (int i = 0; i < MRT::TARGET_COUNT; i++) {
+            if (fbkey.color[i]) {
+                addAttachment(fbkey.color[i], fbkey.samples == 1 ?
+                        rt->getColor(i).texture : rt->getMsaaColor(i).texture);
+            }
+        }
+        for (int i = 0; i < MRT::TARGET_COUNT; i++) {
+            if (fbkey.resolve[i]) {
+                addAttachment(fbkey.resolve[i], rt->getColor(i).texture);
+            }
+        }
+        if (fbkey.depth) {
+            addAttachment(fbkey.depth,
+                    fbkey.samples == 1 ? depth.texture : rt->getMsaaDepth().texture);
+        }
+        attachmentCount = key.attachmentCount;
+        vkfb = mFramebufferCache.getImagelessFramebuffer(key);
+    } else {
+        vkfb = mFramebufferCache.getFramebuffer(fbkey);
+    }
 
     // The current command buffer now owns a reference to the render target and its attachments.
     mDisposer.acquire(rt, mContext.currentCommands->resources);
@@ -1019,8 +1375,25 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
         mDisposer.acquire(rt->getColor(i).texture, mContext.currentCommands->resources);
     }
 
-    // Populate the structures required for vkCmdBeginRenderPass.
-    VkRenderPassBeginInfo renderPassInfo {
+    // Populate the structures required for vkCmdBeginRenderPass, which is recorded with the first
+    // command of the render pass.
+    VulkanRenderPass& currentRenderPass = mContext.currentRenderPass;
+    // The secondary command buffers can't inherit an imageless framebuffer, whose views are
+    // unknown, so they inherit none.
+    currentRenderPass = {
+        .renderPass = renderPass,
+        .subpassMask = params.subpassMask,
+        .currentSubpass = 0,
+        .framebuffer = imageless ? VK_NULL_HANDLE : vkfb,
+        .pending = true
+    };
+    std::copy_n(attachments, attachmentCount, currentRenderPass.attachments);
+    currentRenderPass.attachmentInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_ATTACHMENT_BEGIN_INFO,
+        .attachmentCount = attachmentCount
+    };
+    VkRenderPassBeginInfo& renderPassInfo = currentRenderPass.beginInfo;
+    renderPassInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
         .renderPass = renderPass,
         .framebuffer = vkfb,
@@ -1032,7 +1405,7 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
 
     rt->transformClientRectToPlatform(&renderPassInfo.renderArea);
 
-    VkClearValue clearValues[MRT::TARGET_COUNT + MRT::TARGET_COUNT + 1] = {};
+    VkClearValue* const clearValues = currentRenderPass.clearValues;
 
     // NOTE: clearValues must be populated in the same order as the attachments array in
     // VulkanFboCache::getFramebuffer. Values must be provided regardless of whether Vulkan is
@@ -1056,13 +1429,9 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
         VkClearValue& clearValue = clearValues[renderPassInfo.clearValueCount++];
         clearValue.depthStencil = {(float) params.clearDepth, 0};
     }
-    renderPassInfo.pClearValues = &clearValues[0];
 
     const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
 
-    vkCmdBeginRenderPass(swapContext.commands.cmdbuffer, &renderPassInfo,
-            VK_SUBPASS_CONTENTS_INLINE);
-
     VkViewport viewport = mContext.viewport = {
         .x = (float) params.viewport.left,
         .y = (float) params.viewport.bottom,
@@ -1074,18 +1443,131 @@ void VulkanDriver::beginRenderPass(Handle<HwRenderTarget> rth, const RenderPassP
 
     mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
     vkCmdSetViewport(swapContext.commands.cmdbuffer, 0, 1, &viewport);
+    currentRenderPass.viewport = viewport;
+}
 
-    mContext.currentRenderPass = {
-        .renderPass = renderPassInfo.renderPass,
-        .subpassMask = params.subpassMask,
-        .currentSubpass = 0
-    };
+void VulkanDriver::beginPendingRenderPass(VkSubpassContents contents) {
+    VulkanRenderPass& renderPass = mContext.currentRenderPass;
+    assert(renderPass.pending);
+    renderPass.beginInfo.pClearValues = renderPass.clearValues;
+    if (renderPass.attachmentInfo.attachmentCount) {
+        renderPass.attachmentInfo.pAttachments = renderPass.attachments;
+        renderPass.beginInfo.pNext = &renderPass.attachmentInfo;
+    }
+    vkCmdBeginRenderPass(mContext.currentCommands->cmdbuffer, &renderPass.beginInfo, contents);
+    renderPass.contents = contents;
+    renderPass.pending = false;
+}
+
+// Returns the command buffer the driver thread records draws into, which is a secondary command
+// buffer in a subpass that executes secondary command buffers.
+VkCommandBuffer VulkanDriver::getDrawCommandBuffer() {
+    VulkanRenderPass& renderPass = mContext.currentRenderPass;
+    if (renderPass.pending) {
+        beginPendingRenderPass(VK_SUBPASS_CONTENTS_INLINE);
+    }
+    if (renderPass.contents == VK_SUBPASS_CONTENTS_INLINE) {
+        return mContext.currentCommands->cmdbuffer;
+    }
+    if (!mRecorder) {
+        mRecorder.reset(new VulkanRecorder(mContext));
+    }
+    if (mRecorder->getCommandBuffer() == VK_NULL_HANDLE) {
+        // the bindings of the binder are those of another command buffer
+        mBinder.resetBindings();
+        return mRecorder->begin(renderPass.viewport);
+    }
+    return mRecorder->getCommandBuffer();
+}
+
+// Executes the draws recorded by the driver thread into a secondary command buffer, if any.
+void VulkanDriver::flushDrawCommandBuffer() {
+    if (mRecorder && mRecorder->getCommandBuffer() != VK_NULL_HANDLE) {
+        VulkanCommandBuffer& commands = *mContext.currentCommands;
+        VkCommandBuffer cmdbuffer = mRecorder->end(commands.fence);
+        vkCmdExecuteCommands(commands.cmdbuffer, 1, &cmdbuffer);
+        mBinder.resetBindings();
+    }
+}
+
+bool VulkanDriver::executeSubStreams(CommandSubStreamRange const* ranges, size_t count) noexcept {
+    // Sub-streams are recorded in parallel only in a subpass that executes secondary command
+    // buffers, which is the case when they come first in the render pass.
+    VulkanRenderPass& renderPass = mContext.currentRenderPass;
+    const size_t hardwareThreadCount = std::thread::hardware_concurrency();
+    if (!mContext.currentCommands || renderPass.renderPass == VK_NULL_HANDLE ||
+            (!renderPass.pending &&
+                    renderPass.contents != VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS) ||
+            count < 2 || hardwareThreadCount < 2) {
+        return false;
+    }
+
+    if (renderPass.pending) {
+        beginPendingRenderPass(VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    }
+    flushDrawCommandBuffer();
+
+    if (!mJobSystem) {
+        // the driver thread takes part in the recording, the job system only needs a few threads
+        const size_t threadCount = std::max(size_t(1),
+                std::min(SUB_STREAM_THREAD_COUNT, hardwareThreadCount / 2));
+        mJobSystem.reset(new utils::JobSystem(threadCount));
+        mJobSystem->adopt();
+    }
+    while (mSubStreams.size() < count) {
+        mSubStreams.emplace_back(new SubStreamRecorder(mContext));
+        VulkanBinder& binder = mSubStreams.back()->binder;
+        binder.setDevice(mContext.device);
+        binder.setPipelineCache(mContext.pipelineCache);
+    }
+
+    // Each sub-stream starts with the state of the driver thread.
+    for (size_t i = 0; i < count; i++) {
+        SubStreamRecorder& r = *mSubStreams[i];
+        r.binder.bindState(mBinder);
+        r.binder.resetBindings();
+        std::copy(std::begin(mSamplerBindings), std::end(mSamplerBindings),
+                std::begin(r.samplerBindings));
+        r.rasterState = mContext.rasterState;
+        r.recorder.begin(renderPass.viewport);
+    }
+
+    utils::JobSystem& js = *mJobSystem;
+    utils::JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < count; i++) {
+        SubStreamRecorder& r = *mSubStreams[i];
+        CommandSubStreamRange const range = ranges[i];
+        js.run(js.createJob(parent, [this, &r, range](utils::JobSystem&, utils::JobSystem::Job*) {
+            sSubStream = &r;
+            CommandStream::execute(*this, range);
+            sSubStream = nullptr;
+        }));
+    }
+    js.runAndWait(parent);
+
+    // The secondary command buffers are executed in the order of the sub-streams.
+    VulkanCommandBuffer& commands = *mContext.currentCommands;
+    VkCommandBuffer cmdbuffers[CommandSubStreamGroup::MAX_SUB_STREAM_COUNT];
+    for (size_t i = 0; i < count; i++) {
+        SubStreamRecorder& r = *mSubStreams[i];
+        cmdbuffers[i] = r.recorder.end(commands.fence);
+        for (const void* resource : r.resources) {
+            mDisposer.acquire(resource, commands.resources);
+        }
+        r.resources.clear();
+    }
+    vkCmdExecuteCommands(commands.cmdbuffer, uint32_t(count), cmdbuffers);
+    return true;
 }
 
 void VulkanDriver::endRenderPass(int) {
     assert(mContext.currentCommands);
     assert(mContext.currentSurface);
     assert(mCurrentRenderTarget);
+    if (mContext.currentRenderPass.pending) {
+        beginPendingRenderPass(VK_SUBPASS_CONTENTS_INLINE);
+    }
+    flushDrawCommandBuffer();
     vkCmdEndRenderPass(mContext.currentCommands->cmdbuffer);
     mCurrentRenderTarget = VK_NULL_HANDLE;
     if (mContext.currentRenderPass.currentSubpass > 0) {
@@ -1106,7 +1588,12 @@ void VulkanDriver::nextSubpass(int) {
     assert(mCurrentRenderTarget);
     assert(mContext.currentRenderPass.subpassMask);
 
+    if (mContext.currentRenderPass.pending) {
+        beginPendingRenderPass(VK_SUBPASS_CONTENTS_INLINE);
+    }
+    flushDrawCommandBuffer();
     vkCmdNextSubpass(mContext.currentCommands->cmdbuffer, VK_SUBPASS_CONTENTS_INLINE);
+    mContext.currentRenderPass.contents = VK_SUBPASS_CONTENTS_INLINE;
 
     mBinder.bindRenderPass(mContext.currentRenderPass.renderPass,
             ++mContext.currentRenderPass.currentSubpass);
@@ -1147,6 +1634,12 @@ void VulkanDriver::makeCurrent(Handle<HwSwapChain> drawSch, Handle<HwSwapChain>
                                   "Vulkan driver does not support distinct draw/read swap chains.");
     VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleMap, drawSch)->surfaceContext;
     mContext.currentSurface = &sContext;
+
+    // Rendering to several swap chains in one frame: the previous one was committed, and this
+    // one needs its own image and command buffer.
+    if (mInFrame && !mContext.currentCommands) {
+        acquireSwapChain();
+    }
 }
 
 void VulkanDriver::commit(Handle<HwSwapChain> sch) {
@@ -1158,38 +1651,33 @@ void VulkanDriver::commit(Handle<HwSwapChain> sch) {
     // be done as part of the render pass because it does not know if it is last pass in the frame.
     makeSwapChainPresentable(mContext);
 
+    // The submission waits for the pending async compute work below, so it can take back the
+    // ownership of the resources it used.
+    ASSERT_PRECONDITION(!mCompute.asyncStart, "endAsyncCompute() must be called before commit().");
+    transferAsyncComputeResources(mContext, mCompute.asyncPendingResources,
+            mContext.currentCommands->cmdbuffer, false, false);
+    mCompute.asyncPendingResources = {};
+
     // Finalize the command buffer and set the cmdbuffer pointer to null.
     VkResult result = vkEndCommandBuffer(mContext.currentCommands->cmdbuffer);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
     mContext.currentCommands = nullptr;
 
-    // Submit the command buffer.
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    // Submit the command buffer. It waits for the async compute work that wasn't waited for yet,
+    // this guarantees it's done when the fence is signaled.
     VulkanSurfaceContext& surfaceContext = *mContext.currentSurface;
     SwapContext& swapContext = getSwapContext(mContext);
-    VkSubmitInfo submitInfo {
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = 1u,
-            .pWaitSemaphores = &surfaceContext.imageAvailable,
-            .pWaitDstStageMask = &waitDestStageMask,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &swapContext.commands.cmdbuffer,
-            .signalSemaphoreCount = 1u,
-            .pSignalSemaphores = &surfaceContext.renderingFinished,
-    };
-    if (surfaceContext.headlessQueue) {
-        submitInfo.waitSemaphoreCount = 0;
-        submitInfo.pWaitSemaphores = nullptr;
-        submitInfo.signalSemaphoreCount = 0;
-        submitInfo.pSignalSemaphores = nullptr;
-    }
+    mContext.graphicsWaits.insert(mContext.graphicsWaits.end(),
+            mCompute.asyncPending.begin(), mCompute.asyncPending.end());
+    mCompute.asyncPending.clear();
 
     auto& cmdfence = swapContext.commands.fence;
     std::unique_lock<utils::Mutex> lock(cmdfence->mutex);
-    result = vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, cmdfence->fence);
+    submitSwapCommandBuffer(mContext,
+            surfaceContext.headlessQueue ? VK_NULL_HANDLE : surfaceContext.renderingFinished,
+            cmdfence->fence);
     cmdfence->submitted = true;
     lock.unlock();
-    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
     swapContext.invalid = true;
     cmdfence->condition.notify_all();
 
@@ -1197,28 +1685,77 @@ void VulkanDriver::commit(Handle<HwSwapChain> sch) {
         return;
     }
 
-    // Present the backbuffer.
+    // Present the backbuffer, at the end of the frame when it's rendered to several swap chains.
     VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
-    VkPresentInfoKHR presentInfo {
-        .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-        .waitSemaphoreCount = 1,
-        .pWaitSemaphores = &surface.renderingFinished,
-        .swapchainCount = 1,
-        .pSwapchains = &surface.swapchain,
-        .pImageIndices = &surface.currentSwapIndex,
-    };
-    result = vkQueuePresentKHR(surface.presentQueue, &presentInfo);
+    mPendingPresents.push_back(&surface);
+    if (!mInFrame) {
+        presentSwapChains();
+    }
+}
+
+void VulkanDriver::presentSwapChains() {
+    constexpr size_t MAX_PRESENTS = 8;
+    while (!mPendingPresents.empty()) {
+        // Present at once the swap chains that share the present queue of the first one.
+        const VkQueue queue = mPendingPresents.front()->presentQueue;
+        VulkanSurfaceContext* surfaces[MAX_PRESENTS];
+        VkSemaphore semaphores[MAX_PRESENTS];
+        VkSwapchainKHR swapchains[MAX_PRESENTS];
+        uint32_t indices[MAX_PRESENTS];
+        VkResult results[MAX_PRESENTS];
+        VkPresentTimeGOOGLE times[MAX_PRESENTS];
+        uint32_t count = 0;
+        auto last = std::remove_if(mPendingPresents.begin(), mPendingPresents.end(),
+                [&](VulkanSurfaceContext* surface) {
+                    if (surface->presentQueue != queue || count == MAX_PRESENTS) {
+                        return false;
+                    }
+                    surfaces[count] = surface;
+                    semaphores[count] = surface->renderingFinished;
+                    swapchains[count] = surface->swapchain;
+                    indices[count] = surface->currentSwapIndex;
+                    times[count] = { .desiredPresentTime = uint64_t(mPresentationTime) };
+                    count++;
+                    return true;
+                });
+        mPendingPresents.erase(last, mPendingPresents.end());
+
+        VkPresentInfoKHR presentInfo {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+            .waitSemaphoreCount = count,
+            .pWaitSemaphores = semaphores,
+            .swapchainCount = count,
+            .pSwapchains = swapchains,
+            .pImageIndices = indices,
+            .pResults = results,
+        };
+        VkPresentTimesInfoGOOGLE presentTimes {
+            .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+            .swapchainCount = count,
+            .pTimes = times,
+        };
+        if (mPresentationTime) {
+            presentInfo.pNext = &presentTimes;
+        }
+        vkQueuePresentKHR(queue, &presentInfo);
 
-    // On Android Q and above, a suboptimal surface is always reported after screen rotation:
-    // https://android-developers.googleblog.com/2020/02/handling-device-orientation-efficiently.html
-    if (result == VK_SUBOPTIMAL_KHR && !surface.suboptimal) {
-        utils::slog.w << "Vulkan Driver: Suboptimal swap chain." << utils::io::endl;
-        surface.suboptimal = true;
-    }
+        for (uint32_t i = 0; i < count; i++) {
+            VulkanSurfaceContext& surface = *surfaces[i];
+
+            // On Android Q and above, a suboptimal surface is always reported after screen
+            // rotation:
+            // https://android-developers.googleblog.com/2020/02/handling-device-orientation-efficiently.html
+            if (results[i] == VK_SUBOPTIMAL_KHR && !surface.suboptimal) {
+                utils::slog.w << "Vulkan Driver: Suboptimal swap chain." << utils::io::endl;
+                surface.suboptimal = true;
+            }
 
-    // The surface can be "out of date" when it has been resized, which is not an error.
-    assert(result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR ||
-            result == VK_ERROR_OUT_OF_DATE_KHR);
+            // The surface can be "out of date" when it has been resized, which is not an error.
+            assert(results[i] == VK_SUCCESS || results[i] == VK_SUBOPTIMAL_KHR ||
+                    results[i] == VK_ERROR_OUT_OF_DATE_KHR);
+        }
+    }
+    mPresentationTime = 0;
 }
 
 void VulkanDriver::bindUniformBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
@@ -1226,24 +1763,54 @@ void VulkanDriver::bindUniformBuffer(size_t index, Handle<HwUniformBuffer> ubh)
     // The driver API does not currently expose offset / range, but it will do so in the future.
     const VkDeviceSize offset = 0;
     const VkDeviceSize size = VK_WHOLE_SIZE;
-    mBinder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(), offset, size);
+    SubStreamRecorder* const subStream = sSubStream;
+    VulkanBinder& binder = subStream ? subStream->binder : mBinder;
+    binder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(), offset, size);
 }
 
 void VulkanDriver::bindUniformBufferRange(size_t index, Handle<HwUniformBuffer> ubh,
         size_t offset, size_t size) {
     auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-    mBinder.bindUniformBuffer((uint32_t)index, buffer->getGpuBuffer(), offset, size);
+    SubStreamRecorder* const subStream = sSubStream;
+    VulkanBinder& binder = subStream ? subStream->binder : mBinder;
+    binder.bindUniformBuffer((uint32_t)index, buffer->getGpuBuffer(), offset, size);
 }
 
 void VulkanDriver::bindSamplers(size_t index, Handle<HwSamplerGroup> sbh) {
     auto* hwsb = handle_cast<VulkanSamplerGroup>(mHandleMap, sbh);
-    mSamplerBindings[index] = hwsb;
+    SubStreamRecorder* const subStream = sSubStream;
+    (subStream ? subStream->samplerBindings : mSamplerBindings)[index] = hwsb;
+}
+
+void VulkanDriver::bindStorageBuffer(size_t index, Handle<HwUniformBuffer> ubh) {
+    ASSERT_PRECONDITION(index < STORAGE_BUFFER_BINDING_COUNT, "Storage buffer index too large.");
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    mCompute.storageBuffers[index] = {
+        .buffer = buffer->getGpuBuffer(),
+        .offset = 0,
+        .range = VK_WHOLE_SIZE
+    };
+}
+
+void VulkanDriver::bindImage(size_t index, Handle<HwTexture> th, uint8_t level) {
+    ASSERT_PRECONDITION(index < STORAGE_IMAGE_BINDING_COUNT, "Image index too large.");
+    auto* texture = handle_cast<VulkanTexture>(mHandleMap, th);
+    assert(any(texture->usage & TextureUsage::STORAGE));
+    mCompute.textures[index] = texture;
+    mCompute.images[index] = {
+        .sampler = VK_NULL_HANDLE,
+        .imageView = texture->getImageView(level, 0, VK_IMAGE_ASPECT_COLOR_BIT),
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL
+    };
 }
 
 void VulkanDriver::insertEventMarker(char const* string, size_t len) {
     constexpr float MARKER_COLOR[] = { 0.0f, 1.0f, 0.0f, 1.0f };
     ASSERT_POSTCONDITION(mContext.currentCommands,
             "Markers can only be inserted within a beginFrame / endFrame.");
+    if (executesSecondaryCommandBuffers(mContext.currentRenderPass)) {
+        return;
+    }
     if (mContext.debugUtilsSupported) {
         VkDebugUtilsLabelEXT labelInfo = {
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
@@ -1265,6 +1832,9 @@ void VulkanDriver::pushGroupMarker(char const* string, size_t len) {
     constexpr float MARKER_COLOR[] = { 0.0f, 1.0f, 0.0f, 1.0f };
     ASSERT_POSTCONDITION(mContext.currentCommands,
             "Markers can only be inserted within a beginFrame / endFrame.");
+    if (executesSecondaryCommandBuffers(mContext.currentRenderPass)) {
+        return;
+    }
     if (mContext.debugUtilsSupported) {
         VkDebugUtilsLabelEXT labelInfo = {
             .sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_LABEL_EXT,
@@ -1284,6 +1854,9 @@ void VulkanDriver::pushGroupMarker(char const* string, size_t len) {
 void VulkanDriver::popGroupMarker(int) {
     ASSERT_POSTCONDITION(mContext.currentCommands,
             "Markers can only be inserted within a beginFrame / endFrame.");
+    if (executesSecondaryCommandBuffers(mContext.currentRenderPass)) {
+        return;
+    }
     if (mContext.debugUtilsSupported) {
         vkCmdEndDebugUtilsLabelEXT(mContext.currentCommands->cmdbuffer);
     } else if (mContext.debugMarkersSupported) {
@@ -1301,50 +1874,36 @@ void VulkanDriver::stopCapture(int) {
 
 void VulkanDriver::readPixels(Handle<HwRenderTarget> src, uint32_t x, uint32_t y,
         uint32_t width, uint32_t height, PixelBufferDescriptor&& pbd) {
-    const VkDevice device = mContext.device;
     const VulkanRenderTarget* srcTarget = handle_cast<VulkanRenderTarget>(mHandleMap, src);
     const VulkanTexture* srcTexture = srcTarget->getColor(0).texture;
     const VkFormat swapChainFormat = mContext.currentSurface->surfaceFormat.format;
     const VkFormat srcFormat = srcTexture ? srcTexture->vkformat : swapChainFormat;
     const bool swizzle = srcFormat == VK_FORMAT_B8G8R8A8_UNORM;
 
-    // Create a host visible, linearly tiled image as a staging area.
+    // Within a frame, the copy is recorded after the commands rendered so far, so that it reads
+    // what they rendered. Otherwise it's submitted right away with the work command buffer.
+    const bool inFrame = mContext.currentCommands != nullptr;
+    VulkanCommandBuffer& commands = inFrame ? *mContext.currentCommands : mContext.work;
+    assert(!inFrame || !isAsyncCompute(mContext, commands));
+    if (!inFrame) {
+        acquireWorkCommandBuffer(mContext);
+    }
+    const VkCommandBuffer cmdbuffer = commands.cmdbuffer;
 
-    VkImageCreateInfo imageInfo {
-        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = srcFormat,
-        .extent = { width, height, 1 },
-        .mipLevels = 1,
-        .arrayLayers = 1,
-        .samples = VK_SAMPLE_COUNT_1_BIT,
-        .tiling = VK_IMAGE_TILING_LINEAR,
-        .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
-        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-    };
+    const ReadPixelsStage stage = acquireReadPixelsStage(srcFormat, width, height);
 
-    VkImage stagingImage;
-    vkCreateImage(device, &imageInfo, VKALLOC, &stagingImage);
+    // Wait for the previous rendering to the source image and transition the staging image.
 
-    VkMemoryRequirements memReqs;
-    VkDeviceMemory stagingMemory;
-    vkGetImageMemoryRequirements(device, stagingImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    const VkMemoryBarrier renderingBarrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
     };
+    vkCmdPipelineBarrier(cmdbuffer,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &renderingBarrier, 0, nullptr, 0, nullptr);
 
-    vkAllocateMemory(device, &allocInfo, nullptr, &stagingMemory);
-    vkBindImageMemory(device, stagingImage, stagingMemory, 0);
-
-    // TODO: replace waitForIdle with an image barrier coupled with acquireWorkCommandBuffer.
-    waitForIdle(mContext);
-
-    // Transition the staging image layout.
-
-    VulkanTexture::transitionImageLayout(mContext.work.cmdbuffer, stagingImage,
+    VulkanTexture::transitionImageLayout(cmdbuffer, stage.image,
             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0, 1, 1,
             VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -1374,40 +1933,39 @@ void VulkanDriver::readPixels(Handle<HwRenderTarget> src, uint32_t x, uint32_t y
     // Transition the source image layout (which might be the swap chain)
 
     VkImage srcImage = srcTarget->getColor(0).image;
-    VulkanTexture::transitionImageLayout(mContext.work.cmdbuffer, srcImage,
+    VulkanTexture::transitionImageLayout(cmdbuffer, srcImage,
             VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, srcMipLevel, 1, 1,
             VK_IMAGE_ASPECT_COLOR_BIT);
 
-    // Perform the blit.
+    // Perform the copy.
 
-    vkCmdCopyImage(mContext.work.cmdbuffer, srcTarget->getColor(0).image,
-            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, stagingImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            1, &imageCopyRegion);
+    vkCmdCopyImage(cmdbuffer, srcImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            stage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageCopyRegion);
 
     // Restore the source image layout.
 
     if (srcTexture || mContext.currentSurface->presentQueue) {
         const VkImageLayout present = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-        VulkanTexture::transitionImageLayout(mContext.work.cmdbuffer, srcImage,
+        VulkanTexture::transitionImageLayout(cmdbuffer, srcImage,
                 VK_IMAGE_LAYOUT_UNDEFINED, srcTexture ? getTextureLayout(srcTexture->usage) : present,
                 srcMipLevel, 1, 1, VK_IMAGE_ASPECT_COLOR_BIT);
     } else {
-        VulkanTexture::transitionImageLayout(mContext.work.cmdbuffer, srcImage,
+        VulkanTexture::transitionImageLayout(cmdbuffer, srcImage,
                 VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
                 srcMipLevel, 1, 1, VK_IMAGE_ASPECT_COLOR_BIT);
     }
 
-    // Transition the staging image layout to GENERAL.
+    // Make the copy visible to the host once the commands are done.
 
     VkImageMemoryBarrier barrier = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
         .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         .newLayout = VK_IMAGE_LAYOUT_GENERAL,
         .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
         .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .image = stagingImage,
+        .image = stage.image,
         .subresourceRange = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .baseMipLevel = 0,
@@ -1417,39 +1975,112 @@ void VulkanDriver::readPixels(Handle<HwRenderTarget> src, uint32_t x, uint32_t y
         }
     };
 
-    vkCmdPipelineBarrier(mContext.work.cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-    // Flush and wait.
-
-    flushWorkCommandBuffer(mContext);
-    acquireWorkCommandBuffer(mContext);
-
-    VkImageSubresource subResource { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT };
-    VkSubresourceLayout subResourceLayout;
-    vkGetImageSubresourceLayout(device, stagingImage, &subResource, &subResourceLayout);
-
-    // Map image memory so we can start copying from it.
-
-    const uint8_t* srcPixels;
-    vkMapMemory(device, stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**) &srcPixels);
-    srcPixels += subResourceLayout.offset;
+    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
     // TODO: investigate why this Y-flip exists. This conditional seems to work with both
     // test_ReadPixels.cpp (readpixels from a normal render target with texture attachment) and
     // viewer_basic_test.cc (readpixels from an offscreen swap chain)
     const bool flipY = srcTexture ? true : false;
 
-    if (!DataReshaper::reshapeImage(&pbd, getComponentType(srcFormat), srcPixels,
-            subResourceLayout.rowPitch, width, height, swizzle, flipY)) {
-        utils::slog.e << "Unsupported PixelDataFormat or PixelDataType" << utils::io::endl;
+    mPendingReadPixels.push_back({ stage, commands.fence, std::move(pbd), swizzle, flipY });
+
+    if (!inFrame) {
+        flushWorkCommandBuffer(mContext);
+        acquireWorkCommandBuffer(mContext);
+        releaseWork(mContext, mDisposer);
+    }
+}
+
+VulkanDriver::ReadPixelsStage VulkanDriver::acquireReadPixelsStage(VkFormat format,
+        uint32_t width, uint32_t height) {
+    auto& stages = mFreeReadPixelsStages;
+    auto it = std::find_if(stages.begin(), stages.end(), [=](ReadPixelsStage const& stage) {
+        return stage.format == format && stage.width == width && stage.height == height;
+    });
+    if (it != stages.end()) {
+        const ReadPixelsStage stage = *it;
+        stages.erase(it);
+        return stage;
     }
 
-    vkUnmapMemory(device, stagingMemory);
-    vkFreeMemory(device, stagingMemory, nullptr);
-    vkDestroyImage(device, stagingImage, nullptr);
+    // Create a host visible, linearly tiled image as a staging area.
+
+    const VkDevice device = mContext.device;
+    ReadPixelsStage stage { .format = format, .width = width, .height = height };
+
+    VkImageCreateInfo imageInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = format,
+        .extent = { width, height, 1 },
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .tiling = VK_IMAGE_TILING_LINEAR,
+        .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+    };
+    vkCreateImage(device, &imageInfo, VKALLOC, &stage.image);
+
+    VkMemoryRequirements memReqs;
+    vkGetImageMemoryRequirements(device, stage.image, &memReqs);
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = memReqs.size,
+        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)
+    };
+    vkAllocateMemory(device, &allocInfo, nullptr, &stage.memory);
+    vkBindImageMemory(device, stage.image, stage.memory, 0);
+
+    VkImageSubresource subResource { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT };
+    VkSubresourceLayout subResourceLayout;
+    vkGetImageSubresourceLayout(device, stage.image, &subResource, &subResourceLayout);
+
+    void* pixels = nullptr;
+    vkMapMemory(device, stage.memory, 0, VK_WHOLE_SIZE, 0, &pixels);
+    stage.pixels = (uint8_t const*) pixels + subResourceLayout.offset;
+    stage.rowPitch = subResourceLayout.rowPitch;
+    return stage;
+}
+
+void VulkanDriver::releaseReadPixelsStage(ReadPixelsStage const& stage) {
+    // keep the most recently used stages
+    auto& stages = mFreeReadPixelsStages;
+    if (stages.size() == MAX_FREE_READ_PIXELS_STAGES) {
+        destroyReadPixelsStage(stages.front());
+        stages.erase(stages.begin());
+    }
+    stages.push_back(stage);
+}
 
-    scheduleDestroy(std::move(pbd));
+void VulkanDriver::destroyReadPixelsStage(ReadPixelsStage const& stage) {
+    const VkDevice device = mContext.device;
+    vkUnmapMemory(device, stage.memory);
+    vkFreeMemory(device, stage.memory, nullptr);
+    vkDestroyImage(device, stage.image, VKALLOC);
+}
+
+void VulkanDriver::completeReadPixels(bool deviceIdle) {
+    auto& pending = mPendingReadPixels;
+    auto it = pending.begin();
+    while (it != pending.end()) {
+        const bool done = vkGetFenceStatus(mContext.device, it->fence->fence) == VK_SUCCESS;
+        if (!done && !deviceIdle) {
+            ++it;
+            continue;
+        }
+        // the read-backs whose commands were never submitted are released without their pixels
+        if (done && !DataReshaper::reshapeImage(&it->buffer, getComponentType(it->stage.format),
+                it->stage.pixels, it->stage.rowPitch, it->stage.width, it->stage.height,
+                it->swizzle, it->flipY)) {
+            utils::slog.e << "Unsupported PixelDataFormat or PixelDataType" << utils::io::endl;
+        }
+        scheduleDestroy(std::move(it->buffer));
+        releaseReadPixelsStage(it->stage);
+        it = pending.erase(it);
+    }
 }
 
 void VulkanDriver::readStreamPixels(Handle<HwStream> sh, uint32_t x, uint32_t y, uint32_t width,
@@ -1557,16 +2188,34 @@ void VulkanDriver::blit(TargetBufferFlags buffers, Handle<HwRenderTarget> dst, V
     if (!mContext.currentCommands) {
         vkblit(acquireWorkCommandBuffer(mContext));
         flushWorkCommandBuffer(mContext);
+        releaseWork(mContext, mDisposer);
     } else {
         vkblit(mContext.currentCommands->cmdbuffer);
     }
 }
 
-void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> rph) {
+VkCommandBuffer VulkanDriver::prepareDraw(PipelineState const& pipelineState,
+        VulkanRenderPrimitive const& prim) {
     VulkanCommandBuffer* commands = mContext.currentCommands;
     ASSERT_POSTCONDITION(commands, "Draw calls can occur only within a beginFrame / endFrame.");
-    VkCommandBuffer cmdbuffer = commands->cmdbuffer;
-    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+
+    // Draws of a sub-stream are recorded by a job into its own command buffer and binder. The
+    // resources they use are acquired by the driver thread once the job is done, because the
+    // disposer isn't thread-safe.
+    SubStreamRecorder* const subStream = sSubStream;
+    VulkanBinder& binder = subStream ? subStream->binder : mBinder;
+    VulkanBinder::RasterState& vkstate = subStream ? subStream->rasterState : mContext.rasterState;
+    VulkanSamplerGroup* const* samplerBindings =
+            subStream ? subStream->samplerBindings : mSamplerBindings;
+    VkCommandBuffer cmdbuffer = subStream ?
+            subStream->recorder.getCommandBuffer() : getDrawCommandBuffer();
+    auto acquire = [this, subStream, commands](const void* resource) {
+        if (subStream) {
+            subStream->resources.push_back(resource);
+        } else {
+            mDisposer.acquire(resource, commands->resources);
+        }
+    };
 
     Handle<HwProgram> programHandle = pipelineState.program;
     RasterState rasterState = pipelineState.rasterState;
@@ -1574,9 +2223,9 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
     const Viewport& viewportScissor = pipelineState.scissor;
 
     auto* program = handle_cast<VulkanProgram>(mHandleMap, programHandle);
-    mDisposer.acquire(program, commands->resources);
-    mDisposer.acquire(prim.indexBuffer, commands->resources);
-    mDisposer.acquire(prim.vertexBuffer, commands->resources);
+    acquire(program);
+    acquire(prim.indexBuffer);
+    acquire(prim.vertexBuffer);
 
     // If this is a debug build, validate the current shader.
 #if !defined(NDEBUG)
@@ -1589,7 +2238,7 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
 
     const VulkanRenderTarget* rt = mCurrentRenderTarget;
 
-    mContext.rasterState.depthStencil = {
+    vkstate.depthStencil = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_TRUE,
         .depthWriteEnable = (VkBool32) rasterState.depthWrite,
@@ -1598,13 +2247,13 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
         .stencilTestEnable = VK_FALSE,
     };
 
-    mContext.rasterState.multisampling = {
+    vkstate.multisampling = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
         .rasterizationSamples = (VkSampleCountFlagBits) rt->getSamples(),
         .alphaToCoverageEnable = rasterState.alphaToCoverage,
     };
 
-    mContext.rasterState.blending = {
+    vkstate.blending = {
         .blendEnable = (VkBool32) rasterState.hasBlending(),
         .srcColorBlendFactor = getBlendFactor(rasterState.blendFunctionSrcRGB),
         .dstColorBlendFactor = getBlendFactor(rasterState.blendFunctionDstRGB),
@@ -1615,22 +2264,22 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
         .colorWriteMask = (VkColorComponentFlags) (rasterState.colorWrite ? 0xf : 0x0),
     };
 
-    VkPipelineRasterizationStateCreateInfo& vkraster = mContext.rasterState.rasterization;
+    VkPipelineRasterizationStateCreateInfo& vkraster = vkstate.rasterization;
     vkraster.cullMode = getCullMode(rasterState.culling);
     vkraster.frontFace = getFrontFace(rasterState.inverseFrontFaces);
     vkraster.depthBiasEnable = (depthOffset.constant || depthOffset.slope) ? VK_TRUE : VK_FALSE;
     vkraster.depthBiasConstantFactor = depthOffset.constant;
     vkraster.depthBiasSlopeFactor = depthOffset.slope;
 
-    mContext.rasterState.getColorTargetCount = rt->getColorTargetCount();
+    vkstate.getColorTargetCount = rt->getColorTargetCount();
 
     VulkanBinder::ProgramBundle shaderHandles = program->bundle;
 
     // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
-    mBinder.bindProgramBundle(shaderHandles);
-    mBinder.bindRasterState(mContext.rasterState);
-    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
-    mBinder.bindVertexArray(prim.varray);
+    binder.bindProgramBundle(shaderHandles);
+    binder.bindRasterState(vkstate);
+    binder.bindPrimitiveTopology(prim.primitiveTopology);
+    binder.bindVertexArray(prim.varray);
 
     // Query the program for the mapping from (SamplerGroupBinding,Offset) to (SamplerBinding),
     // where "SamplerBinding" is the integer in the GLSL, and SamplerGroupBinding is the abstract
@@ -1641,7 +2290,7 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
         if (samplerGroup.empty()) {
             continue;
         }
-        VulkanSamplerGroup* vksb = mSamplerBindings[samplerGroupIdx];
+        VulkanSamplerGroup* vksb = samplerBindings[samplerGroupIdx];
         if (!vksb) {
             continue;
         }
@@ -1660,9 +2309,22 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
             const SamplerParams& samplerParams = boundSampler->s;
             VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
             const auto* texture = handle_const_cast<VulkanTexture>(mHandleMap, boundSampler->t);
-            mDisposer.acquire(texture, commands->resources);
+            acquire(texture);
+
+            // An external image is sampled instead of the texture's own image, through an
+            // immutable sampler when it needs a YCbCr conversion.
+            if (VulkanExternalImage const* external = texture->externalImage) {
+                acquire(external);
+                const bool immutable = external->ycbcrSampler != VK_NULL_HANDLE;
+                binder.bindSampler(bindingPoint, {
+                    .sampler = immutable ? external->ycbcrSampler : vksampler,
+                    .imageView = external->view,
+                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                }, immutable);
+                continue;
+            }
 
-            mBinder.bindSampler(bindingPoint, {
+            binder.bindSampler(bindingPoint, {
                 .sampler = vksampler,
                 .imageView = texture->imageView,
                 .imageLayout = getTextureLayout(texture->usage)
@@ -1685,18 +2347,26 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
     rt->transformClientRectToPlatform(&scissor);
     vkCmdSetScissor(cmdbuffer, 0, 1, &scissor);
 
-    // Bind new descriptor sets if they need to change.
+    // Bind new descriptor sets if they need to change. The range between the first and the last
+    // set that changed is bound at once.
+    // The uniform buffers of set 0 take their dynamic offsets, e.g. the range of the
+    // per-renderable uniforms of this draw.
     VkDescriptorSet descriptors[3];
     VkPipelineLayout pipelineLayout;
-    if (mBinder.getOrCreateDescriptors(descriptors, &pipelineLayout)) {
-        vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 3,
-                descriptors, 0, nullptr);
+    uint32_t offsets[VulkanBinder::UBUFFER_BINDING_COUNT];
+    const uint32_t dirtySets = binder.getOrCreateDescriptors(descriptors, &pipelineLayout, offsets);
+    if (dirtySets) {
+        const uint32_t firstSet = utils::ctz(dirtySets);
+        const uint32_t setCount = 32u - utils::clz(dirtySets) - firstSet;
+        const uint32_t offsetCount = firstSet == 0 ? VulkanBinder::UBUFFER_BINDING_COUNT : 0;
+        vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+                firstSet, setCount, descriptors + firstSet, offsetCount, offsets);
     }
 
     // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
     // Creating a new pipeline is slow, so we should consider using pipeline cache objects.
     VkPipeline pipeline;
-    if (mBinder.getOrCreatePipeline(&pipeline)) {
+    if (binder.getOrCreatePipeline(&pipeline)) {
         vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
     }
 
@@ -1707,16 +2377,56 @@ void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> r
             prim.buffers.data(), prim.offsets.data());
     vkCmdBindIndexBuffer(cmdbuffer, prim.indexBuffer->buffer->getGpuBuffer(), 0,
             prim.indexBuffer->indexType);
+    return cmdbuffer;
+}
+
+void VulkanDriver::draw(PipelineState pipelineState, Handle<HwRenderPrimitive> rph,
+        uint32_t instanceCount) {
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    VkCommandBuffer cmdbuffer = prepareDraw(pipelineState, prim);
 
     // Finally, make the actual draw call. TODO: support subranges
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
+    // gl_InstanceIndex includes firstInstance, unlike gl_InstanceID on OpenGL, so it must be 0 for
+    // the instance index to go from 0 to instanceCount - 1 on all backends.
+    const uint32_t firstInstId = 0;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
+void VulkanDriver::drawIndirect(PipelineState pipelineState, Handle<HwRenderPrimitive> rph,
+        Handle<HwUniformBuffer> indirect, uint32_t offset, uint32_t drawCount) {
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, indirect);
+    if (UTILS_UNLIKELY(!drawCount)) {
+        return;
+    }
+    VkCommandBuffer cmdbuffer = prepareDraw(pipelineState, prim);
+
+    // see draw()
+    SubStreamRecorder* const subStream = sSubStream;
+    if (subStream) {
+        subStream->resources.push_back(buffer);
+    } else {
+        mDisposer.acquire(buffer, mContext.currentCommands->resources);
+    }
+
+    // DrawIndirectCommand has the layout of VkDrawIndexedIndirectCommand. Without the
+    // multiDrawIndirect feature, drawCount must be 0 or 1.
+    static_assert(sizeof(DrawIndirectCommand) == sizeof(VkDrawIndexedIndirectCommand),
+            "DrawIndirectCommand must match VkDrawIndexedIndirectCommand");
+    const uint32_t stride = sizeof(DrawIndirectCommand);
+    if (mContext.physicalDeviceFeatures.multiDrawIndirect) {
+        vkCmdDrawIndexedIndirect(cmdbuffer, buffer->getGpuBuffer(), offset, drawCount, stride);
+    } else {
+        for (uint32_t i = 0; i < drawCount; i++) {
+            vkCmdDrawIndexedIndirect(cmdbuffer, buffer->getGpuBuffer(), offset + i * stride, 1,
+                    stride);
+        }
+    }
+}
+
 void VulkanDriver::beginTimerQuery(Handle<HwTimerQuery> tqh) {
     VulkanCommandBuffer* commands = mContext.currentCommands;
     ASSERT_POSTCONDITION(commands, "Timer queries can occur only within a beginFrame / endFrame.");
@@ -1725,8 +2435,8 @@ void VulkanDriver::beginTimerQuery(Handle<HwTimerQuery> tqh) {
     const uint32_t index = vtq->startingQueryIndex;
     const VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
 
-    vkCmdResetQueryPool(commands->cmdbuffer, mContext.timestamps.pool, index, 2);
-    vkCmdWriteTimestamp(commands->cmdbuffer, stage, mContext.timestamps.pool, index);
+    vkCmdResetQueryPool(commands->cmdbuffer, vtq->pool, index, 2);
+    vkCmdWriteTimestamp(commands->cmdbuffer, stage, vtq->pool, index);
     vtq->cmdbuffer.store(commands);
 }
 
@@ -1737,12 +2447,15 @@ void VulkanDriver::endTimerQuery(Handle<HwTimerQuery> tqh) {
     VulkanTimerQuery* vtq = handle_cast<VulkanTimerQuery>(mHandleMap, tqh);
     const uint32_t index = vtq->stoppingQueryIndex;
     const VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    vkCmdWriteTimestamp(commands->cmdbuffer, stage, mContext.timestamps.pool, index);
+    vkCmdWriteTimestamp(commands->cmdbuffer, stage, vtq->pool, index);
 }
 
 void VulkanDriver::refreshSwapChain() {
     VulkanSurfaceContext& surface = *mContext.currentSurface;
 
+    // the images of the old swap chain must be presented before it's destroyed
+    presentSwapChains();
+
     assert(!surface.headlessQueue && "Resizing headless swap chains is not supported.");
     backend::destroySwapChain(mContext, surface, mDisposer);
     createSwapChain(mContext, surface);
@@ -1776,6 +2489,394 @@ void VulkanDriver::debugCommand(const char* methodName) {
 }
 #endif
 
+void VulkanDriver::dispatch(Handle<HwProgram> ph, math::uint3 groupCount) {
+    VulkanCommandBuffer* commands = mContext.currentCommands;
+    ASSERT_POSTCONDITION(commands, "Dispatches can occur only within a beginFrame / endFrame.");
+    ASSERT_PRECONDITION(mContext.currentRenderPass.renderPass == VK_NULL_HANDLE,
+            "Dispatches can't occur within a render pass.");
+    VkCommandBuffer cmdbuffer = commands->cmdbuffer;
+    VkDevice device = mContext.device;
+
+    auto* program = handle_cast<VulkanProgram>(mHandleMap, ph);
+    mDisposer.acquire(program, commands->resources);
+    if (UTILS_UNLIKELY(program->compute == VK_NULL_HANDLE)) {
+        utils::slog.e << "Dispatching a program without compute shader: "
+                << program->name.c_str() << utils::io::endl;
+        return;
+    }
+
+    if (UTILS_UNLIKELY(program->computePipeline == VK_NULL_HANDLE)) {
+        VkComputePipelineCreateInfo pipelineInfo {
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = program->compute,
+                .pName = "main",
+                .pSpecializationInfo = program->bundle.specialization
+            },
+            .layout = mCompute.pipelineLayout
+        };
+        VkResult error = vkCreateComputePipelines(device, mContext.pipelineCache,
+                1, &pipelineInfo, VKALLOC, &program->computePipeline);
+        ASSERT_POSTCONDITION(!error, "Unable to create compute pipeline.");
+    }
+
+    // The descriptor sets are allocated for this dispatch only, and freed once the command buffer
+    // has been executed.
+    VkDescriptorSet descriptors[2];
+    ComputeDescriptorPool* const pool = allocateComputeDescriptorSets(descriptors);
+    for (VkDescriptorSet descriptorSet : descriptors) {
+        mDisposer.createDisposable(descriptorSet, { [](void* user, uint64_t argument) {
+            ComputeDescriptorPool* const pool = static_cast<ComputeDescriptorPool*>(user);
+            const VkDescriptorSet descriptorSet = VkDescriptorSet(argument);
+            vkFreeDescriptorSets(pool->device, pool->pool, 1, &descriptorSet);
+        }, pool, uint64_t(descriptorSet) });
+        mDisposer.acquire(descriptorSet, commands->resources);
+        mDisposer.removeReference(descriptorSet);
+    }
+
+    VkWriteDescriptorSet writes[STORAGE_BUFFER_BINDING_COUNT + STORAGE_IMAGE_BINDING_COUNT];
+    uint32_t writeCount = 0;
+    for (uint32_t binding = 0; binding < STORAGE_BUFFER_BINDING_COUNT; binding++) {
+        if (mCompute.storageBuffers[binding].buffer) {
+            writes[writeCount++] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptors[0],
+                .dstBinding = binding,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &mCompute.storageBuffers[binding]
+            };
+        }
+    }
+    for (uint32_t binding = 0; binding < STORAGE_IMAGE_BINDING_COUNT; binding++) {
+        if (mCompute.textures[binding]) {
+            mDisposer.acquire(mCompute.textures[binding], commands->resources);
+            writes[writeCount++] = {
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = descriptors[1],
+                .dstBinding = binding,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+                .pImageInfo = &mCompute.images[binding]
+            };
+        }
+    }
+    vkUpdateDescriptorSets(device, writeCount, writes, 0, nullptr);
+
+    // the async compute queue takes the ownership of the resources before it uses them
+    if (isAsyncCompute(mContext, *commands)) {
+        for (VkDescriptorBufferInfo const& info : mCompute.storageBuffers) {
+            if (info.buffer) {
+                acquireAsyncComputeBuffer(mContext, info.buffer);
+            }
+        }
+        for (VulkanTexture const* texture : mCompute.textures) {
+            if (texture) {
+                acquireAsyncComputeImage(mContext, texture->textureImage);
+            }
+        }
+    }
+
+    vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, program->computePipeline);
+    vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_COMPUTE, mCompute.pipelineLayout,
+            0, 2, descriptors, 0, nullptr);
+    vkCmdDispatch(cmdbuffer, groupCount.x, groupCount.y, groupCount.z);
+}
+
+void VulkanDriver::memoryBarrier(MemoryBarrierFlags flags) {
+    VulkanCommandBuffer* commands = mContext.currentCommands;
+    ASSERT_POSTCONDITION(commands, "Barriers can occur only within a beginFrame / endFrame.");
+    VkAccessFlags dstAccessMask = 0;
+    if (any(flags & (MemoryBarrierFlags::STORAGE_BUFFER | MemoryBarrierFlags::STORAGE_IMAGE))) {
+        dstAccessMask |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::TEXTURE_FETCH)) {
+        dstAccessMask |= VK_ACCESS_SHADER_READ_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::UNIFORM_BUFFER)) {
+        dstAccessMask |= VK_ACCESS_UNIFORM_READ_BIT;
+    }
+    if (any(flags & MemoryBarrierFlags::INDIRECT_COMMAND)) {
+        dstAccessMask |= VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+    }
+    if (!dstAccessMask) {
+        return;
+    }
+    VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = dstAccessMask
+    };
+    // The compute queue only has the compute stage, the graphics queue gets the visibility of the
+    // async compute writes from the semaphore it waits for.
+    const VkPipelineStageFlags dstStageMask = isAsyncCompute(mContext, *commands) ?
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT :
+            VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+    vkCmdPipelineBarrier(commands->cmdbuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            dstStageMask, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanDriver::beginAsyncCompute(int) {
+    ASSERT_POSTCONDITION(mContext.currentCommands,
+            "Async compute can occur only within a beginFrame / endFrame.");
+    ASSERT_PRECONDITION(!mCompute.asyncStart, "beginAsyncCompute() called twice.");
+    if (!mContext.computeQueue) {
+        // the commands are recorded with the graphics commands
+        return;
+    }
+
+    // The async compute work starts after everything recorded so far. The graphics commands are
+    // only submitted in endAsyncCompute(), once they've released the resources it uses.
+    mCompute.asyncStart = acquireSwapSemaphore(mContext);
+    mContext.asyncCompute.cmdbuffer = acquireAsyncComputeCommandBuffer(mContext);
+    mContext.currentCommands = &mContext.asyncCompute;
+}
+
+void VulkanDriver::endAsyncCompute(int) {
+    if (!mCompute.asyncStart) {
+        return;
+    }
+    assert(isAsyncCompute(mContext, *mContext.currentCommands));
+    SwapContext& swapContext = getSwapContext(mContext);
+    VulkanAsyncResources& resources = mContext.asyncResources;
+
+    // The compute queue gives the resources back when it's done with them. The graphics queue
+    // releases them to the compute queue before the semaphore the work waits for, and the
+    // graphics commands that follow are in a new command buffer.
+    transferAsyncComputeResources(mContext, resources, mContext.asyncCompute.cmdbuffer,
+            false, true);
+    VkResult error = vkEndCommandBuffer(mContext.asyncCompute.cmdbuffer);
+    ASSERT_POSTCONDITION(!error, "vkEndCommandBuffer error.");
+    transferAsyncComputeResources(mContext, resources, swapContext.commands.cmdbuffer,
+            true, true);
+    splitSwapCommandBuffer(mContext, mCompute.asyncStart);
+    mBinder.resetBindings();
+
+    const VkSemaphore done = acquireSwapSemaphore(mContext);
+    const VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &mCompute.asyncStart,
+        .pWaitDstStageMask = &waitStageMask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &mContext.asyncCompute.cmdbuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &done,
+    };
+    error = vkQueueSubmit(mContext.computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    ASSERT_POSTCONDITION(!error, "vkQueueSubmit error.");
+    mCompute.asyncStart = VK_NULL_HANDLE;
+    mCompute.asyncPending.push_back(done);
+    VulkanAsyncResources& pending = mCompute.asyncPendingResources;
+    pending.buffers.insert(pending.buffers.end(),
+            resources.buffers.begin(), resources.buffers.end());
+    pending.images.insert(pending.images.end(), resources.images.begin(), resources.images.end());
+    resources = {};
+
+    // The graphics queue waits for this work before the end of the frame, so the resources it
+    // references can be released with those of the swap context.
+    swapContext.commands.resources.insert(swapContext.commands.resources.end(),
+            mContext.asyncCompute.resources.begin(), mContext.asyncCompute.resources.end());
+    mContext.asyncCompute.resources.clear();
+    mContext.asyncCompute.cmdbuffer = VK_NULL_HANDLE;
+    mContext.currentCommands = &swapContext.commands;
+}
+
+void VulkanDriver::waitAsyncCompute(int) {
+    ASSERT_PRECONDITION(!mCompute.asyncStart, "waitAsyncCompute() called before endAsyncCompute().");
+    if (mCompute.asyncPending.empty()) {
+        return;
+    }
+
+    // The graphics commands recorded so far don't need the async compute results, they can
+    // overlap with it. The ones that follow wait for it.
+    splitSwapCommandBuffer(mContext, VK_NULL_HANDLE);
+    mBinder.resetBindings();
+    mContext.graphicsWaits.insert(mContext.graphicsWaits.end(),
+            mCompute.asyncPending.begin(), mCompute.asyncPending.end());
+    mCompute.asyncPending.clear();
+    transferAsyncComputeResources(mContext, mCompute.asyncPendingResources,
+            mContext.currentCommands->cmdbuffer, false, false);
+    mCompute.asyncPendingResources = {};
+}
+
+// The pipeline cache is stored with the blob functions of the platform under this key.
+static constexpr const char PIPELINE_CACHE_KEY[] = "filament.vulkan.pipelineCache";
+
+// Checks that a pipeline cache was created by the same device and driver, some drivers don't
+// handle the data of other drivers gracefully.
+static bool isPipelineCacheCompatible(VkPhysicalDeviceProperties const& properties,
+        uint8_t const* data, size_t size) noexcept {
+    // this is the layout of VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+    struct Header {
+        uint32_t headerSize;
+        uint32_t headerVersion;
+        uint32_t vendorID;
+        uint32_t deviceID;
+        uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+    } header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerSize <= size &&
+            header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+            header.vendorID == properties.vendorID &&
+            header.deviceID == properties.deviceID &&
+            !memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+}
+
+void VulkanDriver::createPipelineCache() {
+    std::vector<uint8_t> data;
+    if (mContextManager.hasBlobFunc()) {
+        const size_t size = mContextManager.retrieveBlob(
+                PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY), nullptr, 0);
+        if (size) {
+            data.resize(size);
+            if (mContextManager.retrieveBlob(PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY),
+                    data.data(), size) != size ||
+                    !isPipelineCacheCompatible(mContext.physicalDeviceProperties,
+                            data.data(), size)) {
+                utils::slog.w << "Vulkan pipeline cache is invalid or from another device."
+                        << utils::io::endl;
+                data.clear();
+            }
+        }
+    }
+
+    VkPipelineCacheCreateInfo createInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = data.size(),
+        .pInitialData = data.data()
+    };
+    VkResult result = vkCreatePipelineCache(mContext.device, &createInfo, VKALLOC,
+            &mContext.pipelineCache);
+    if (result != VK_SUCCESS && !data.empty()) {
+        // the driver can still reject the data, start from an empty cache then
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        result = vkCreatePipelineCache(mContext.device, &createInfo, VKALLOC,
+                &mContext.pipelineCache);
+    }
+    if (result != VK_SUCCESS) {
+        // pipelines can be created without a cache
+        mContext.pipelineCache = VK_NULL_HANDLE;
+    }
+    mBinder.setPipelineCache(mContext.pipelineCache);
+}
+
+void VulkanDriver::destroyPipelineCache() {
+    if (mContext.pipelineCache == VK_NULL_HANDLE) {
+        return;
+    }
+    if (mContextManager.hasBlobFunc()) {
+        size_t size = 0;
+        vkGetPipelineCacheData(mContext.device, mContext.pipelineCache, &size, nullptr);
+        std::vector<uint8_t> data(size);
+        if (size && vkGetPipelineCacheData(mContext.device, mContext.pipelineCache,
+                &size, data.data()) == VK_SUCCESS) {
+            mContextManager.insertBlob(PIPELINE_CACHE_KEY, sizeof(PIPELINE_CACHE_KEY),
+                    data.data(), size);
+        }
+    }
+    vkDestroyPipelineCache(mContext.device, mContext.pipelineCache, VKALLOC);
+    mContext.pipelineCache = VK_NULL_HANDLE;
+    mBinder.setPipelineCache(VK_NULL_HANDLE);
+}
+
+void VulkanDriver::createComputeLayout() {
+    VkDevice device = mContext.device;
+
+    VkDescriptorSetLayoutBinding bindings[std::max(STORAGE_BUFFER_BINDING_COUNT,
+            STORAGE_IMAGE_BINDING_COUNT)];
+    VkDescriptorSetLayoutCreateInfo dlinfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pBindings = bindings
+    };
+    const VkDescriptorType types[2] = {
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE };
+    const uint32_t counts[2] = { STORAGE_BUFFER_BINDING_COUNT, STORAGE_IMAGE_BINDING_COUNT };
+    for (size_t set = 0; set < 2; set++) {
+        for (uint32_t i = 0; i < counts[set]; i++) {
+            bindings[i] = {
+                .binding = i,
+                .descriptorType = types[set],
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            };
+        }
+        dlinfo.bindingCount = counts[set];
+        vkCreateDescriptorSetLayout(device, &dlinfo, VKALLOC,
+                &mCompute.descriptorSetLayouts[set]);
+    }
+
+    VkPipelineLayoutCreateInfo layoutInfo {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 2,
+        .pSetLayouts = mCompute.descriptorSetLayouts
+    };
+    VkResult error = vkCreatePipelineLayout(device, &layoutInfo, VKALLOC,
+            &mCompute.pipelineLayout);
+    ASSERT_POSTCONDITION(!error, "Unable to create compute pipeline layout.");
+}
+
+VulkanDriver::ComputeDescriptorPool* VulkanDriver::allocateComputeDescriptorSets(
+        VkDescriptorSet* descriptorSets) {
+    VkDevice device = mContext.device;
+    VkDescriptorSetAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorSetCount = 2,
+        .pSetLayouts = mCompute.descriptorSetLayouts
+    };
+
+    // the most recent pool is the most likely to have room left
+    auto& pools = mCompute.descriptorPools;
+    for (auto it = pools.rbegin(); it != pools.rend(); ++it) {
+        allocInfo.descriptorPool = (*it)->pool;
+        if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets) == VK_SUCCESS) {
+            return it->get();
+        }
+    }
+
+    // Each dispatch uses one set of each layout.
+    constexpr uint32_t POOL_DISPATCH_COUNT = 256;
+    VkDescriptorPoolSize poolSizes[2] = {
+        { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, POOL_DISPATCH_COUNT * STORAGE_BUFFER_BINDING_COUNT },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, POOL_DISPATCH_COUNT * STORAGE_IMAGE_BINDING_COUNT },
+    };
+    VkDescriptorPoolCreateInfo poolInfo {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
+        .maxSets = POOL_DISPATCH_COUNT * 2,
+        .poolSizeCount = 2,
+        .pPoolSizes = poolSizes
+    };
+    VkDescriptorPool pool;
+    VkResult error = vkCreateDescriptorPool(device, &poolInfo, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(!error, "Unable to create compute descriptor pool.");
+    pools.push_back(std::make_unique<ComputeDescriptorPool>(ComputeDescriptorPool{ device, pool }));
+
+    allocInfo.descriptorPool = pool;
+    error = vkAllocateDescriptorSets(device, &allocInfo, descriptorSets);
+    ASSERT_POSTCONDITION(!error, "Unable to allocate compute descriptor sets.");
+    return pools.back().get();
+}
+
+void VulkanDriver::destroyComputeLayout() {
+    VkDevice device = mContext.device;
+    for (auto const& pool : mCompute.descriptorPools) {
+        vkDestroyDescriptorPool(device, pool->pool, VKALLOC);
+    }
+    vkDestroyPipelineLayout(device, mCompute.pipelineLayout, VKALLOC);
+    vkDestroyDescriptorSetLayout(device, mCompute.descriptorSetLayouts[0], VKALLOC);
+    vkDestroyDescriptorSetLayout(device, mCompute.descriptorSetLayouts[1], VKALLOC);
+    mCompute = {};
+}
+
 // explicit instantiation of the Dispatcher
 template class ConcreteDispatcher<VulkanDriver>;
 
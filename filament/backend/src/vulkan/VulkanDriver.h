@@ -21,25 +21,32 @@
 #include "VulkanDisposer.h"
 #include "VulkanContext.h"
 #include "VulkanFboCache.h"
+#include "VulkanRecorder.h"
 #include "VulkanSamplerCache.h"
 #include "VulkanStagePool.h"
 #include "VulkanUtility.h"
 
 #include "private/backend/Driver.h"
+#include "private/backend/HandleAllocator.h"
 #include "DriverBase.h"
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/JobSystem.h>
+#include <utils/ThreadLocal.h>
 
-#include <unordered_map>
+#include <memory>
 #include <vector>
 
 namespace filament {
 namespace backend {
 
 class VulkanPlatform;
+struct VulkanRenderPrimitive;
 struct VulkanRenderTarget;
 struct VulkanSamplerGroup;
+struct VulkanStream;
+struct VulkanTexture;
 
 class VulkanDriver final : public DriverBase {
 public:
@@ -59,6 +66,8 @@ private:
 
     ShaderModel getShaderModel() const noexcept final;
 
+    bool executeSubStreams(CommandSubStreamRange const* ranges, size_t count) noexcept override;
+
     template<typename T>
     friend class backend::ConcreteDispatcher;
 
@@ -80,72 +89,159 @@ private:
 private:
     backend::VulkanPlatform& mContextManager;
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = std::vector<uint8_t>;
-    using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
-    HandleMap mHandleMap;
-    std::mutex mHandleMapMutex;
-    HandleBase::HandleId mNextId = 1;
+    // Handles are stored in the same growable pools as the other backends, see HandleAllocator.
+    // The first segments of the pools only use HANDLE_ARENA_SIZE bytes.
+    static constexpr size_t HANDLE_ARENA_SIZE = 1024 * 1024;
+    HandleAllocator mHandleMap;
 
     template<typename Dp, typename B>
     Handle<B> alloc_handle() {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
+        return Handle<B>(mHandleMap.allocate<Dp>());
     }
 
     template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B> handle) noexcept {
+    Dp* handle_cast(HandleAllocator& handleMap, Handle<B> handle) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<Dp*>(blob.data());
+        return handleMap.handle_cast<Dp>(handle.getId());
     }
 
     template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
+    const Dp* handle_const_cast(HandleAllocator& handleMap, const Handle<B>& handle) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<const Dp*>(blob.data());
+        return handleMap.handle_cast<Dp>(handle.getId());
     }
 
     template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
+    Dp* construct_handle(HandleAllocator& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
         assert(handle);
         if (!handle) return nullptr; // better to get a NPE than random behavior/corruption
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob.data());
+        Dp* addr = handleMap.handle_cast<Dp>(handle.getId());
         new(addr) Dp(std::forward<ARGS>(args)...);
         return addr;
     }
 
     template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, const Handle<B>& handle) noexcept {
-        std::lock_guard<std::mutex> lock(mHandleMapMutex);
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        reinterpret_cast<Dp*>(blob.data())->~Dp();
-        handleMap.erase(handle.getId());
+    void destruct_handle(HandleAllocator& handleMap, const Handle<B>& handle) noexcept {
+        // Call the destructor and reclaim the storage and the id.
+        Dp* addr = handleMap.handle_cast<Dp>(handle.getId());
+        addr->~Dp();
+        handleMap.deallocate(handle.getId(), addr);
+    }
+
+    // The disposer's destructor of a handle, which calls destruct_handle().
+    template<typename Dp, typename B>
+    VulkanDisposer::Destructor handleDestructor(Handle<B> handle) noexcept {
+        return { [](void* user, uint64_t id) {
+            VulkanDriver* const driver = static_cast<VulkanDriver*>(user);
+            driver->destruct_handle<Dp>(driver->mHandleMap, Handle<B>(HandleBase::HandleId(id)));
+        }, this, handle.getId() };
     }
 
     void refreshSwapChain();
+    // acquires the next image of the current swap chain, and starts recording its commands
+    void acquireSwapChain();
+    // presents the swap chains committed since the last call, with one vkQueuePresentKHR per queue
+    void presentSwapChains();
+    void beginPendingRenderPass(VkSubpassContents contents);
+    VkCommandBuffer getDrawCommandBuffer();
+    void flushDrawCommandBuffer();
+    // binds the state, descriptors and buffers of a draw, returns the command buffer to record it
+    VkCommandBuffer prepareDraw(PipelineState const& pipelineState,
+            VulkanRenderPrimitive const& prim);
+    void createComputeLayout();
+    void destroyComputeLayout();
+    // allocates the descriptor sets of a dispatch, from a new pool if the others are full
+    struct ComputeDescriptorPool;
+    ComputeDescriptorPool* allocateComputeDescriptorSets(VkDescriptorSet* descriptorSets);
+    void createPipelineCache();
+    void destroyPipelineCache();
+
+    // Imports the platform-specific 'image' without copy, 'texture' samples it from now on. The
+    // previous image of the texture is destroyed once the commands sampling it are done, and
+    // the acquired image it came from, if any, is released then.
+    void importExternalImage(VulkanTexture* texture, void* image, AcquiredImage const& acquired);
+    void detachExternalImage(VulkanTexture* texture);
+
+    // The textures attached to an acquired stream, see updateStreams().
+    std::vector<VulkanTexture*> mExternalStreams;
+
+    // readPixels() copies the pixels to a host-visible staging image and returns, the copy to
+    // the client's buffer is made by completeReadPixels() once the commands that fill the image
+    // are done, so several read-backs can be in flight without stalling the driver thread. The
+    // staging images are recycled, since read-backs of the same size tend to repeat each frame.
+    struct ReadPixelsStage {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        uint8_t const* pixels = nullptr;    // persistently mapped
+        VkDeviceSize rowPitch = 0;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t width = 0;
+        uint32_t height = 0;
+    };
+    struct PendingReadPixels {
+        ReadPixelsStage stage;
+        std::shared_ptr<VulkanCmdFence> fence;
+        PixelBufferDescriptor buffer;
+        bool swizzle;
+        bool flipY;
+    };
+    static constexpr size_t MAX_FREE_READ_PIXELS_STAGES = 4;
+    ReadPixelsStage acquireReadPixelsStage(VkFormat format, uint32_t width, uint32_t height);
+    void releaseReadPixelsStage(ReadPixelsStage const& stage);
+    void destroyReadPixelsStage(ReadPixelsStage const& stage);
+    // completes the read-backs whose commands are done, or all of them once the device is idle
+    void completeReadPixels(bool deviceIdle);
+    std::vector<ReadPixelsStage> mFreeReadPixelsStages;
+    std::vector<PendingReadPixels> mPendingReadPixels;
+
+    // Compute programs have their own pipeline layout: storage buffers are in descriptor set 0
+    // and storage images in descriptor set 1, both at the index they're bound to.
+    static constexpr uint32_t STORAGE_BUFFER_BINDING_COUNT = 8;
+    static constexpr uint32_t STORAGE_IMAGE_BINDING_COUNT = 8;
+    // The descriptor sets of the dispatches are allocated from pools of a fixed size, and freed
+    // once the GPU is done with them. A pool is added when all of them are full.
+    struct ComputeDescriptorPool {
+        VkDevice device;
+        VkDescriptorPool pool;
+    };
+    struct {
+        VkDescriptorSetLayout descriptorSetLayouts[2] = {};
+        VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+        std::vector<std::unique_ptr<ComputeDescriptorPool>> descriptorPools;
+        VkDescriptorBufferInfo storageBuffers[STORAGE_BUFFER_BINDING_COUNT] = {};
+        VkDescriptorImageInfo images[STORAGE_IMAGE_BINDING_COUNT] = {};
+        VulkanTexture* textures[STORAGE_IMAGE_BINDING_COUNT] = {};
+        // signaled by the graphics work the current async compute work waits for
+        VkSemaphore asyncStart = VK_NULL_HANDLE;
+        // signaled by async compute work that the graphics queue hasn't waited for yet
+        std::vector<VkSemaphore> asyncPending;
+        // released by that work, the graphics queue acquires them when it waits for it
+        VulkanAsyncResources asyncPendingResources;
+    } mCompute;
+
+    // The sub-streams of a group are executed concurrently by jobs of mJobSystem, each records
+    // into secondary command buffers with its own state, see executeSubStreams(). The resources
+    // they reference are acquired by the driver thread once they're recorded, since VulkanDisposer
+    // isn't thread-safe.
+    static constexpr size_t SUB_STREAM_THREAD_COUNT = 3;
+    struct SubStreamRecorder {
+        explicit SubStreamRecorder(VulkanContext& context) : recorder(context) {}
+        VulkanRecorder recorder;
+        VulkanBinder binder;
+        VulkanBinder::RasterState rasterState;
+        VulkanSamplerGroup* samplerBindings[VulkanBinder::SAMPLER_BINDING_COUNT] = {};
+        VulkanDisposer::Set resources;
+    };
+    std::vector<std::unique_ptr<SubStreamRecorder>> mSubStreams;
+    std::unique_ptr<utils::JobSystem> mJobSystem;
+
+    // the recorder of the job currently executing a sub-stream on this thread, if any
+    static UTILS_DECLARE_TLS(SubStreamRecorder*) sSubStream;
+
+    // Draws recorded by the driver thread in a subpass that executes secondary command buffers.
+    std::unique_ptr<VulkanRecorder> mRecorder;
 
     VulkanContext mContext = {};
     VulkanBinder mBinder;
@@ -154,6 +250,15 @@ private:
     VulkanFboCache mFramebufferCache;
     VulkanSamplerCache mSamplerCache;
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
+
+    // Swap chains committed in the current frame, presented together at endFrame(). Within a
+    // frame, making another swap chain current after a commit starts recording its commands.
+    std::vector<VulkanSurfaceContext*> mPendingPresents;
+    bool mInFrame = false;
+
+    // Presentation time of the next presents, in the CLOCK_MONOTONIC time base, or zero. It's
+    // also the timestamp of the frames queued to a video encoder's surface.
+    int64_t mPresentationTime = 0;
     VulkanSamplerGroup* mSamplerBindings[VulkanBinder::SAMPLER_BINDING_COUNT] = {};
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
     VkDebugUtilsMessengerEXT mDebugMessenger = VK_NULL_HANDLE;
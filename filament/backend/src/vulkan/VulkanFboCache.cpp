@@ -31,6 +31,7 @@ bool VulkanFboCache::RenderPassEq::operator()(const RenderPassKey& k1,
     if (k1.samples != k2.samples) return false;
     if (k1.needsResolveMask != k2.needsResolveMask) return false;
     if (k1.subpassMask != k2.subpassMask) return false;
+    if (k1.viewCount != k2.viewCount) return false;
     if (k1.depthLayout != k2.depthLayout) return false;
     if (k1.depthFormat != k2.depthFormat) return false;
     for (int i = 0; i < MRT::TARGET_COUNT; i++) {
@@ -54,10 +55,27 @@ bool VulkanFboCache::FboKeyEqualFn::operator()(const FboKey& k1, const FboKey& k
     return true;
 }
 
+bool VulkanFboCache::ImagelessFboKeyEqualFn::operator()(const ImagelessFboKey& k1,
+        const ImagelessFboKey& k2) const {
+    if (k1.renderPass != k2.renderPass) return false;
+    if (k1.width != k2.width) return false;
+    if (k1.height != k2.height) return false;
+    if (k1.layers != k2.layers) return false;
+    if (k1.viewCount != k2.viewCount) return false;
+    if (k1.attachmentCount != k2.attachmentCount) return false;
+    for (uint32_t i = 0; i < k1.attachmentCount; i++) {
+        if (k1.formats[i] != k2.formats[i]) return false;
+        if (k1.usages[i] != k2.usages[i]) return false;
+        if (k1.flags[i] != k2.flags[i]) return false;
+    }
+    return true;
+}
+
 VulkanFboCache::VulkanFboCache(VulkanContext& context) : mContext(context) {}
 
 VulkanFboCache::~VulkanFboCache() {
-    ASSERT_POSTCONDITION(mFramebufferCache.empty() && mRenderPassCache.empty(),
+    ASSERT_POSTCONDITION(mFramebufferCache.empty() && mImagelessFramebufferCache.empty() &&
+            mRenderPassCache.empty(),
             "Please explicitly call reset() while the VkDevice is still alive.");
 }
 
@@ -113,6 +131,58 @@ VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config) noexcept {
     return framebuffer;
 }
 
+VkFramebuffer VulkanFboCache::getImagelessFramebuffer(ImagelessFboKey const& config) noexcept {
+    auto iter = mImagelessFramebufferCache.find(config);
+    if (UTILS_LIKELY(iter != mImagelessFramebufferCache.end() &&
+            iter->second.handle != VK_NULL_HANDLE)) {
+        iter.value().timestamp = mCurrentTime;
+        return iter->second.handle;
+    }
+
+    VkFramebufferAttachmentImageInfo attachments[ATTACHMENT_COUNT];
+    for (uint32_t i = 0; i < config.attachmentCount; i++) {
+        attachments[i] = {
+            .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENT_IMAGE_INFO,
+            .flags = config.flags[i],
+            .usage = config.usages[i],
+            .width = config.width,
+            .height = config.height,
+            .layerCount = config.viewCount,
+            .viewFormatCount = 1,
+            .pViewFormats = &config.formats[i]
+        };
+    }
+    VkFramebufferAttachmentsCreateInfo attachmentsInfo {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_ATTACHMENTS_CREATE_INFO,
+        .attachmentImageInfoCount = config.attachmentCount,
+        .pAttachmentImageInfos = attachments
+    };
+
+    #if FILAMENT_VULKAN_VERBOSE
+    utils::slog.d << "Creating imageless framebuffer " << config.width << "x" << config.height
+        << " for render pass " << config.renderPass << ", "
+        << "attachmentCount = " << config.attachmentCount
+        << utils::io::endl;
+    #endif
+
+    VkFramebufferCreateInfo info {
+        .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        .pNext = &attachmentsInfo,
+        .flags = VK_FRAMEBUFFER_CREATE_IMAGELESS_BIT,
+        .renderPass = config.renderPass,
+        .attachmentCount = config.attachmentCount,
+        .width = config.width,
+        .height = config.height,
+        .layers = config.layers,
+    };
+    mRenderPassRefCount[info.renderPass]++;
+    VkFramebuffer framebuffer;
+    VkResult error = vkCreateFramebuffer(mContext.device, &info, VKALLOC, &framebuffer);
+    ASSERT_POSTCONDITION(!error, "Unable to create imageless framebuffer.");
+    mImagelessFramebufferCache[config] = {framebuffer, mCurrentTime};
+    return framebuffer;
+}
+
 VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     auto iter = mRenderPassCache.find(config);
     if (UTILS_LIKELY(iter != mRenderPassCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
@@ -203,8 +273,20 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
         .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT,
     }};
 
+    // With multiview, each subpass renders all the layers of the attachments at once.
+    const uint32_t viewMask = config.viewCount > 1 ? (1u << config.viewCount) - 1u : 1u;
+    const uint32_t viewMasks[2] = { viewMask, viewMask };
+    VkRenderPassMultiviewCreateInfo multiviewInfo {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO,
+        .subpassCount = config.subpassMask ? 2u : 1u,
+        .pViewMasks = viewMasks,
+        .correlationMaskCount = 1u,
+        .pCorrelationMasks = &viewMask
+    };
+
     VkRenderPassCreateInfo renderPassInfo {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .pNext = config.viewCount > 1 ? &multiviewInfo : nullptr,
         .attachmentCount = 0u,
         .pAttachments = attachments,
         .subpassCount = config.subpassMask ? 2u : 1u,
@@ -224,6 +306,7 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
         TargetBufferFlags flag = TargetBufferFlags(int(TargetBufferFlags::COLOR0) << i);
         bool clear = any(config.clear & flag);
         bool discard = any(config.discardStart & flag);
+        bool discardEnd = any(config.discardEnd & flag);
         if (config.subpassMask & (1 << i)) {
             int subpassInputIndex = subpasses[1].inputAttachmentCount++;
             inputAttachmentRef[subpassInputIndex].layout = colorLayouts[i].subpass;
@@ -238,7 +321,7 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
             .format = config.colorFormat[i],
             .samples = (VkSampleCountFlagBits) config.samples,
             .loadOp = clear ? kClear : (discard ? kDontCare : kKeep),
-            .storeOp = config.samples == 1 ? kEnableStore : kDisableStore,
+            .storeOp = config.samples == 1 && !discardEnd ? kEnableStore : kDisableStore,
             .stencilLoadOp = kDontCare,
             .stencilStoreOp = kDisableStore,
             .initialLayout = colorLayouts[i].initial,
@@ -279,13 +362,14 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     if (hasDepth) {
         bool clear = any(config.clear & TargetBufferFlags::DEPTH);
         bool discard = any(config.discardStart & TargetBufferFlags::DEPTH);
+        bool discardEnd = any(config.discardEnd & TargetBufferFlags::DEPTH);
         depthAttachmentRef.layout = config.depthLayout;
         depthAttachmentRef.attachment = attachmentIndex;
         attachments[attachmentIndex++] = {
             .format = config.depthFormat,
             .samples = (VkSampleCountFlagBits) config.samples,
             .loadOp = clear ? kClear : (discard ? kDontCare : kKeep),
-            .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+            .storeOp = discardEnd ? kDisableStore : kEnableStore,
             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
             .initialLayout = config.depthLayout,
@@ -317,6 +401,11 @@ void VulkanFboCache::reset() noexcept {
         vkDestroyFramebuffer(mContext.device, pair.second.handle, VKALLOC);
     }
     mFramebufferCache.clear();
+    for (auto const& pair : mImagelessFramebufferCache) {
+        mRenderPassRefCount[pair.first.renderPass]--;
+        vkDestroyFramebuffer(mContext.device, pair.second.handle, VKALLOC);
+    }
+    mImagelessFramebufferCache.clear();
     for (auto pair : mRenderPassCache) {
         vkDestroyRenderPass(mContext.device, pair.second.handle, VKALLOC);
     }
@@ -340,6 +429,15 @@ void VulkanFboCache::gc() noexcept {
             iter.value().handle = VK_NULL_HANDLE;
         }
     }
+    for (auto iter = mImagelessFramebufferCache.begin();
+            iter != mImagelessFramebufferCache.end(); ++iter) {
+        const FboVal fbo = iter->second;
+        if (fbo.timestamp < evictTime && fbo.handle) {
+            mRenderPassRefCount[iter->first.renderPass]--;
+            vkDestroyFramebuffer(mContext.device, fbo.handle, VKALLOC);
+            iter.value().handle = VK_NULL_HANDLE;
+        }
+    }
     for (auto iter = mRenderPassCache.begin(); iter != mRenderPassCache.end(); ++iter) {
         const VkRenderPass handle = iter->second.handle;
         if (iter->second.timestamp < evictTime && handle && mRenderPassRefCount[handle] == 0) {
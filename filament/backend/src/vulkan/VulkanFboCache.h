@@ -49,7 +49,8 @@ public:
         uint8_t samples; // 1 byte
         uint8_t needsResolveMask; // 1 byte
         uint8_t subpassMask; // 1 bytes
-        uint16_t padding; // 2 bytes
+        uint8_t viewCount; // 1 byte
+        uint8_t padding; // 1 byte
     };
     struct RenderPassVal {
         VkRenderPass handle;
@@ -88,12 +89,38 @@ public:
         bool operator()(const FboKey& k1, const FboKey& k2) const;
     };
 
+    // ImagelessFboKey is the FboKey of an imageless framebuffer, which is only compatible with the
+    // image views given to vkCmdBeginRenderPass. It describes the attachments instead of referring
+    // to their views, so the render targets that use other textures of the same kind share it.
+    // The attachments are listed in the order of getFramebuffer, and the unused slots are zeroed.
+    static constexpr int ATTACHMENT_COUNT = MRT::TARGET_COUNT + MRT::TARGET_COUNT + 1;
+    struct alignas(8) ImagelessFboKey {
+        VkRenderPass renderPass; // 8 bytes
+        uint16_t width; // 2 bytes
+        uint16_t height; // 2 bytes
+        uint16_t layers; // 2 bytes
+        uint16_t viewCount; // 2 bytes, layers of each attachment's view
+        VkFormat formats[ATTACHMENT_COUNT]; // 36 bytes
+        VkImageUsageFlags usages[ATTACHMENT_COUNT]; // 36 bytes
+        VkImageCreateFlags flags[ATTACHMENT_COUNT]; // 36 bytes
+        uint32_t attachmentCount; // 4 bytes
+    };
+    static_assert(sizeof(ImagelessFboKey) == 128, "ImagelessFboKey has unexpected size.");
+    using ImagelessFboKeyHashFn = utils::hash::MurmurHashFn<ImagelessFboKey>;
+    struct ImagelessFboKeyEqualFn {
+        bool operator()(const ImagelessFboKey& k1, const ImagelessFboKey& k2) const;
+    };
+
     explicit VulkanFboCache(VulkanContext&);
     ~VulkanFboCache();
 
     // Retrieves or creates a VkFramebuffer handle.
     VkFramebuffer getFramebuffer(FboKey config) noexcept;
 
+    // Retrieves or creates an imageless VkFramebuffer handle. This requires
+    // VulkanContext::imagelessFramebufferSupported.
+    VkFramebuffer getImagelessFramebuffer(ImagelessFboKey const& config) noexcept;
+
     // Retrieves or creates a VkRenderPass handle.
     VkRenderPass getRenderPass(RenderPassKey config) noexcept;
 
@@ -106,6 +133,8 @@ public:
 private:
     VulkanContext& mContext;
     tsl::robin_map<FboKey, FboVal, FboKeyHashFn, FboKeyEqualFn> mFramebufferCache;
+    tsl::robin_map<ImagelessFboKey, FboVal, ImagelessFboKeyHashFn, ImagelessFboKeyEqualFn>
+            mImagelessFramebufferCache;
     tsl::robin_map<RenderPassKey, RenderPassVal, RenderPassHash, RenderPassEq> mRenderPassCache;
     tsl::robin_map<VkRenderPass, uint32_t> mRenderPassRefCount;
     uint32_t mCurrentTime = 0;
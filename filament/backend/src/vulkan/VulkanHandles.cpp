@@ -21,6 +21,12 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+#include <type_traits>
+#include <variant>
+
+#include <string.h>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 namespace filament {
@@ -48,13 +54,12 @@ static void clampToFramebuffer(VkRect2D* rect, uint32_t fbWidth, uint32_t fbHeig
 VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noexcept :
         HwProgram(builder.getName()), context(context) {
     auto const& blobs = builder.getShadersSource();
-    VkShaderModule* modules[2] = { &bundle.vertex, &bundle.fragment };
-    bool missing = false;
+    VkShaderModule* modules[Program::SHADER_TYPE_COUNT] = {
+            &bundle.vertex, &bundle.fragment, &compute };
     for (size_t i = 0; i < Program::SHADER_TYPE_COUNT; i++) {
         const auto& blob = blobs[i];
         VkShaderModule* module = modules[i];
         if (blob.empty()) {
-            missing = true;
             continue;
         }
         VkShaderModuleCreateInfo moduleInfo = {};
@@ -67,6 +72,8 @@ VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noe
 
     // Output a warning because it's okay to encounter empty blobs, but it's not okay to use
     // this program handle in a draw call.
+    const bool missing = compute == VK_NULL_HANDLE &&
+            (bundle.vertex == VK_NULL_HANDLE || bundle.fragment == VK_NULL_HANDLE);
     if (missing) {
         utils::slog.w << "Missing SPIR-V shader: " << builder.getName().c_str() << utils::io::endl;
         return;
@@ -74,6 +81,35 @@ VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noe
 
     // Make a copy of the binding map
     samplerGroupInfo = builder.getSamplerGroupInfo();
+
+    // All the constants are 32 bits in SPIR-V, booleans are VkBool32.
+    auto const& specConstants = builder.getSpecializationConstants();
+    if (!specConstants.empty()) {
+        specializationEntries.resize(specConstants.size());
+        specializationData.resize(specConstants.size());
+        for (size_t i = 0; i < specConstants.size(); i++) {
+            specializationEntries[i] = {
+                .constantID = specConstants[i].id,
+                .offset = uint32_t(i * sizeof(uint32_t)),
+                .size = sizeof(uint32_t)
+            };
+            std::visit([&data = specializationData[i]](auto value) {
+                using T = decltype(value);
+                if constexpr (std::is_same_v<T, bool>) {
+                    data = value ? VK_TRUE : VK_FALSE;
+                } else {
+                    memcpy(&data, &value, sizeof(data));
+                }
+            }, specConstants[i].value);
+        }
+        specializationInfo = {
+            .mapEntryCount = uint32_t(specializationEntries.size()),
+            .pMapEntries = specializationEntries.data(),
+            .dataSize = specializationData.size() * sizeof(uint32_t),
+            .pData = specializationData.data()
+        };
+        bundle.specialization = &specializationInfo;
+    }
 #if FILAMENT_VULKAN_VERBOSE
     utils::slog.d << "Created VulkanProgram " << builder.getName().c_str()
                 << ", variant = (" << utils::io::hex
@@ -86,6 +122,8 @@ VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noe
 VulkanProgram::~VulkanProgram() {
     vkDestroyShaderModule(context.device, bundle.vertex, VKALLOC);
     vkDestroyShaderModule(context.device, bundle.fragment, VKALLOC);
+    vkDestroyShaderModule(context.device, compute, VKALLOC);
+    vkDestroyPipeline(context.device, computePipeline, VKALLOC);
 }
 
 static VulkanAttachment createAttachment(VulkanAttachment spec) {
@@ -98,7 +136,8 @@ static VulkanAttachment createAttachment(VulkanAttachment spec) {
         .texture = spec.texture,
         .layout = getTextureLayout(spec.texture->usage),
         .level = spec.level,
-        .layer = spec.layer
+        .layer = spec.layer,
+        .viewCount = spec.viewCount
     };
 }
 
@@ -109,7 +148,8 @@ VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context) : HwRenderTarget(
 
 VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context, uint32_t width, uint32_t height,
             uint8_t samples, VulkanAttachment color[MRT::TARGET_COUNT],
-            VulkanAttachment depthStencil[2], VulkanStagePool& stagePool) :
+            VulkanAttachment depthStencil[2], VulkanStagePool& stagePool,
+            VulkanDisposer& disposer) :
             HwRenderTarget(width, height), mContext(context), mOffscreen(true), mSamples(samples) {
 
     // For each color attachment, create (or fetch from cache) a VkImageView that selects a specific
@@ -122,7 +162,8 @@ VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context, uint32_t width, u
             continue;
         }
         mColor[index].view = texture->getImageView(spec.level, spec.layer,
-                VK_IMAGE_ASPECT_COLOR_BIT);
+                VK_IMAGE_ASPECT_COLOR_BIT, spec.viewCount);
+        mViewCount = spec.viewCount;
     }
 
     // For the depth attachment, create (or fetch from cache) a VkImageView that selects a specific
@@ -132,16 +173,28 @@ VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context, uint32_t width, u
     VulkanTexture* depthTexture = mDepth.texture;
     if (depthTexture) {
         mDepth.view = depthTexture->getImageView(mDepth.level, mDepth.layer,
-                VK_IMAGE_ASPECT_DEPTH_BIT);
+                VK_IMAGE_ASPECT_DEPTH_BIT, mDepth.viewCount);
+        assert(mViewCount == 1 || mViewCount == mDepth.viewCount);
+        mViewCount = mDepth.viewCount;
     }
 
     if (samples == 1) {
         return;
     }
 
-    // The sidecar textures need to have only 1 miplevel and 1 array slice.
+    // multiview render targets can't be multi-sampled
+    assert(mViewCount == 1);
+
+    // The sidecar textures need to have only 1 miplevel and 1 array slice. They are only used as
+    // attachments of this render target and resolved within its render passes, so they're
+    // transient.
     const int level = 1;
     const int depth = 1;
+    auto sidecarUsage = [](TextureUsage usage) {
+        return (usage & (TextureUsage::COLOR_ATTACHMENT | TextureUsage::DEPTH_ATTACHMENT |
+                TextureUsage::STENCIL_ATTACHMENT | TextureUsage::SUBPASS_INPUT)) |
+                TextureUsage::TRANSIENT;
+    };
 
     // Create sidecar MSAA textures for color attachments.
     for (int index = 0; index < MRT::TARGET_COUNT; index++) {
@@ -149,7 +202,8 @@ VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context, uint32_t width, u
         VulkanTexture* texture = spec.texture;
         if (texture && texture->samples == 1) {
             VulkanTexture* msTexture = new VulkanTexture(context, texture->target, level,
-                    texture->format, samples, width, height, depth, texture->usage, stagePool);
+                    texture->format, samples, width, height, depth, sidecarUsage(texture->usage),
+                    stagePool, disposer);
             mMsaaAttachments[index] = createAttachment({ .texture = msTexture });
             mMsaaAttachments[index].view = msTexture->getImageView(0, 0, VK_IMAGE_ASPECT_COLOR_BIT);
         }
@@ -170,7 +224,8 @@ VulkanRenderTarget::VulkanRenderTarget(VulkanContext& context, uint32_t width, u
 
     // Create sidecar MSAA texture for the depth attachment.
     VulkanTexture* msTexture = new VulkanTexture(context, depthTexture->target, level,
-            depthTexture->format, samples, width, height, depth, depthTexture->usage, stagePool);
+            depthTexture->format, samples, width, height, depth, sidecarUsage(depthTexture->usage),
+            stagePool, disposer);
     mMsaaDepthAttachment = createAttachment({
         .texture = msTexture,
         .level = depthSpec.level,
@@ -207,8 +262,8 @@ VulkanSwapChain::VulkanSwapChain(VulkanContext& context, uint32_t width, uint32_
     surfaceContext.surfaceFormat.format = VK_FORMAT_R8G8B8A8_UNORM;
     surfaceContext.swapchain = VK_NULL_HANDLE;
 
-    // Somewhat arbitrarily, headless rendering is double-buffered.
-    surfaceContext.swapContexts.resize(2);
+    // Somewhat arbitrarily, headless rendering is at least double-buffered.
+    surfaceContext.swapContexts.resize(std::max(2u, context.maxFramesInFlight));
 
     // Allocate a command buffer for each swap context, just like a real swap chain.
     VkCommandBufferAllocateInfo allocateInfo = {
@@ -420,51 +475,79 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
     VkBufferCreateInfo bufferInfo {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = numBytes,
-        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        // uniform buffers can also be bound as storage buffers of compute programs, and hold the
+        // arguments of indirect draws
+        .usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
     };
+    // the transfer queue can use the buffer without ownership transfers
+    uint32_t queueFamilies[2];
+    setConcurrentSharing(context, bufferInfo, queueFamilies, true);
     VmaAllocationCreateInfo allocInfo {
         .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, nullptr);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
+void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset,
+        uint32_t numBytes) {
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numBytes);
-
-    auto copyToDevice = [this, numBytes, stage] (VulkanCommandBuffer& commands) {
-        VkBufferCopy region { .size = numBytes };
+    memcpy(stage->mapped, cpuData, numBytes);
+    vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numBytes);
+    loadFromStage(stage, byteOffset, numBytes);
+}
+
+void VulkanUniformBuffer::loadFromCpu(BufferDescriptor& data, uint32_t byteOffset) {
+    VulkanStage const* stage = mStagePool.adoptStaging(data);
+    if (stage) {
+        loadFromStage(stage, byteOffset, uint32_t(data.size));
+    } else {
+        loadFromCpu(data.buffer, byteOffset, uint32_t(data.size));
+    }
+}
+
+void VulkanUniformBuffer::loadFromStage(VulkanStage const* stage, uint32_t byteOffset,
+        uint32_t numBytes) {
+    auto copyToDevice = [this, byteOffset, numBytes, stage] (VulkanCommandBuffer& commands) {
+        VkBufferCopy region {
+            .srcOffset = stage->offset,
+            .dstOffset = byteOffset,
+            .size = numBytes
+        };
+        const bool compute = isAsyncCompute(mContext, commands);
+        if (compute) {
+            acquireAsyncComputeBuffer(mContext, mGpuBuffer);
+        }
         vkCmdCopyBuffer(commands.cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
         mDisposer.acquire(this, commands.resources);
 
-        // Ensure that the copy finishes before the next draw call.
+        // Ensure that the copy finishes before the next draw call, or the next dispatch when the
+        // commands are for the async compute queue. On the transfer queue, the semaphore that
+        // the graphics queue waits for takes care of it.
+        if (isTransfer(mContext, commands)) {
+            mStagePool.releaseStage(stage, commands);
+            return;
+        }
         VkBufferMemoryBarrier barrier {
             .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
             .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+            .dstAccessMask = compute ? VK_ACCESS_SHADER_READ_BIT :
+                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
             .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
             .buffer = mGpuBuffer,
             .size = VK_WHOLE_SIZE
         };
         vkCmdPipelineBarrier(commands.cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+                compute ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+                0, 0, nullptr, 1, &barrier, 0, nullptr);
 
         mStagePool.releaseStage(stage, commands);
     };
 
-    // If inside beginFrame / endFrame, use the swap context, otherwise use the work cmdbuffer.
-    if (mContext.currentCommands) {
-        copyToDevice(*mContext.currentCommands);
-    } else {
-        acquireWorkCommandBuffer(mContext);
-        copyToDevice(mContext.work);
-        flushWorkCommandBuffer(mContext);
-    }
+    // If inside beginFrame / endFrame, use the swap context, otherwise use the transfer queue or
+    // the work cmdbuffer.
+    recordUpload(mContext, mDisposer, this, true, copyToDevice);
 }
 
 VulkanUniformBuffer::~VulkanUniformBuffer() {
@@ -473,9 +556,10 @@ VulkanUniformBuffer::~VulkanUniformBuffer() {
 
 VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t levels,
         TextureFormat tformat, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
-        TextureUsage usage, VulkanStagePool& stagePool) :
+        TextureUsage usage, VulkanStagePool& stagePool, VulkanDisposer& disposer) :
         HwTexture(target, levels, samples, w, h, depth, tformat, usage),
-        vkformat(getVkFormat(tformat)), mContext(context), mStagePool(stagePool) {
+        vkformat(getVkFormat(tformat)), mContext(context), mStagePool(stagePool),
+        mDisposer(disposer) {
 
     // Vulkan does not support 24-bit depth, use the official fallback format.
     if (tformat == TextureFormat::DEPTH24) {
@@ -543,6 +627,40 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     if (any(usage & TextureUsage::DEPTH_ATTACHMENT)) {
         imageInfo.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
     }
+    // Transient attachments are never blitted, so they can be backed by lazily allocated memory,
+    // which tile-based GPUs only commit when an attachment is loaded or stored.
+    const bool transient = any(usage & TextureUsage::TRANSIENT) &&
+            !any(usage & (TextureUsage::SAMPLEABLE | TextureUsage::UPLOADABLE |
+                    TextureUsage::STORAGE));
+    if (transient) {
+        imageInfo.usage &= ~blittable;
+        imageInfo.usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+    // The transfer queue can upload to images that are only sampled without ownership transfers.
+    // Attachments are left exclusive, some GPUs don't compress concurrent images.
+    const TextureUsage attachments = TextureUsage::COLOR_ATTACHMENT |
+            TextureUsage::DEPTH_ATTACHMENT | TextureUsage::STENCIL_ATTACHMENT;
+    mTransferable = context.transferQueue != VK_NULL_HANDLE &&
+            any(usage & TextureUsage::UPLOADABLE) && !any(usage & attachments);
+    if (any(usage & TextureUsage::STORAGE)) {
+        imageInfo.usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    uint32_t queueFamilies[2];
+    setConcurrentSharing(context, imageInfo, queueFamilies, mTransferable);
+
+    // An imageless framebuffer lists the formats its attachments can be viewed with, which must
+    // match the format list of their image.
+    VkImageFormatListCreateInfo formatList = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_LIST_CREATE_INFO,
+        .viewFormatCount = 1,
+        .pViewFormats = &vkformat
+    };
+    if (context.imagelessFramebufferSupported && any(usage & attachments)) {
+        formatList.pNext = imageInfo.pNext;
+        imageInfo.pNext = &formatList;
+    }
+    vkusage = imageInfo.usage;
+    vkflags = imageInfo.flags;
 
     VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &textureImage);
     if (error || FILAMENT_VULKAN_VERBOSE) {
@@ -563,9 +681,24 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     VkMemoryAllocateInfo allocInfo = {
         .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        .memoryTypeIndex = VK_MAX_MEMORY_TYPES
     };
+    if (transient) {
+        // Desktop GPUs typically don't have lazily allocated memory.
+        const VkFlags lazy = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT |
+                VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+        for (uint32_t i = 0; i < context.memoryProperties.memoryTypeCount; i++) {
+            const VkFlags flags = context.memoryProperties.memoryTypes[i].propertyFlags;
+            if ((memReqs.memoryTypeBits & (1u << i)) && (flags & lazy) == lazy) {
+                allocInfo.memoryTypeIndex = i;
+                break;
+            }
+        }
+    }
+    if (allocInfo.memoryTypeIndex == VK_MAX_MEMORY_TYPES) {
+        allocInfo.memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
     error = vkAllocateMemory(context.device, &allocInfo, nullptr, &textureImageMemory);
     ASSERT_POSTCONDITION(!error, "Unable to allocate image memory.");
     error = vkBindImageMemory(context.device, textureImage, textureImageMemory, 0);
@@ -576,13 +709,46 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
 
     // Create a VkImageView so that shaders can sample from the image.
     // RenderTarget does not use this view because it selects a single miplevel.
+    imageView = createPrimaryView(0, levels - 1);
+
+    if (any(usage & (TextureUsage::COLOR_ATTACHMENT | TextureUsage::DEPTH_ATTACHMENT |
+            TextureUsage::STORAGE))) {
+        auto transition = [=](VulkanCommandBuffer commands) {
+            // If this is a SAMPLER_2D_ARRAY texture, then the depth argument stores the number of
+            // texture layers.
+            const uint32_t layers = target == SamplerType::SAMPLER_2D_ARRAY ? depth : 1;
+            VulkanTexture::transitionImageLayout(commands.cmdbuffer, textureImage,
+                    VK_IMAGE_LAYOUT_UNDEFINED, getTextureLayout(usage), 0, layers, levels, mAspect);
+        };
+        if (mContext.currentCommands) {
+            transition(*mContext.currentCommands);
+        } else {
+            acquireWorkCommandBuffer(mContext);
+            transition(mContext.work);
+            flushWorkCommandBuffer(mContext);
+        }
+    }
+}
+
+VulkanTexture::~VulkanTexture() {
+    vkDestroyImage(mContext.device, textureImage, VKALLOC);
+    vkFreeMemory(mContext.device, textureImageMemory, VKALLOC);
+    for (auto entry : mImageViews) {
+        vkDestroyImageView(mContext.device, entry.view, VKALLOC);
+    }
+    for (auto entry : mPrimaryViews) {
+        vkDestroyImageView(mContext.device, entry.view, VKALLOC);
+    }
+}
+
+VkImageView VulkanTexture::createPrimaryView(uint32_t minLevel, uint32_t maxLevel) {
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     viewInfo.image = textureImage;
     viewInfo.format = vkformat;
     viewInfo.subresourceRange.aspectMask = mAspect;
-    viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.levelCount = levels;
+    viewInfo.subresourceRange.baseMipLevel = minLevel;
+    viewInfo.subresourceRange.levelCount = maxLevel - minLevel + 1;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
@@ -597,112 +763,114 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
         viewInfo.subresourceRange.layerCount = 1;
     }
-    error = vkCreateImageView(context.device, &viewInfo, VKALLOC, &imageView);
+    VkImageView view;
+    VkResult error = vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &view);
     ASSERT_POSTCONDITION(!error, "Unable to create image view.");
+    mPrimaryViews.push_back({ minLevel, maxLevel, view });
+    return view;
+}
 
-    if (any(usage & (TextureUsage::COLOR_ATTACHMENT | TextureUsage::DEPTH_ATTACHMENT))) {
-        auto transition = [=](VulkanCommandBuffer commands) {
-            // If this is a SAMPLER_2D_ARRAY texture, then the depth argument stores the number of
-            // texture layers.
-            const uint32_t layers = target == SamplerType::SAMPLER_2D_ARRAY ? depth : 1;
-            VulkanTexture::transitionImageLayout(commands.cmdbuffer, textureImage,
-                    VK_IMAGE_LAYOUT_UNDEFINED, getTextureLayout(usage), 0, layers, levels, mAspect);
-        };
-        if (mContext.currentCommands) {
-            transition(*mContext.currentCommands);
-        } else {
-            acquireWorkCommandBuffer(mContext);
-            transition(mContext.work);
-            flushWorkCommandBuffer(mContext);
+void VulkanTexture::setPrimaryRange(uint32_t minLevel, uint32_t maxLevel) {
+    maxLevel = std::min(maxLevel, uint32_t(levels - 1));
+    minLevel = std::min(minLevel, maxLevel);
+    for (auto entry : mPrimaryViews) {
+        if (entry.minLevel == minLevel && entry.maxLevel == maxLevel) {
+            imageView = entry.view;
+            return;
         }
     }
+    imageView = createPrimaryView(minLevel, maxLevel);
 }
 
-VulkanTexture::~VulkanTexture() {
-    vkDestroyImage(mContext.device, textureImage, VKALLOC);
-    vkDestroyImageView(mContext.device, imageView, VKALLOC);
-    vkFreeMemory(mContext.device, textureImageMemory, VKALLOC);
-    for (auto entry : mImageViews) {
-        vkDestroyImageView(mContext.device, entry.view, VKALLOC);
+std::vector<VkImageView> VulkanTexture::getPrimaryViews() const {
+    std::vector<VkImageView> views;
+    views.reserve(mPrimaryViews.size());
+    for (auto entry : mPrimaryViews) {
+        views.push_back(entry.view);
     }
+    return views;
+}
+
+// Pixels given with 4 components for a 3-component format were reshaped by the client already,
+// see VulkanDriver::isTextureFormatReshaped().
+static bool hasFourComponents(PixelBufferDescriptor const& data) noexcept {
+    return data.format == PixelDataFormat::RGBA || data.format == PixelDataFormat::RGBA_INTEGER;
 }
 
-void VulkanTexture::update2DImage(const PixelBufferDescriptor& data, uint32_t width,
+void VulkanTexture::update2DImage(PixelBufferDescriptor& data, uint32_t width,
         uint32_t height, int miplevel) {
-    update3DImage(std::move(data), width, height, 1, miplevel);
+    update3DImage(data, width, height, 1, miplevel);
 }
 
-void VulkanTexture::update3DImage(const PixelBufferDescriptor& data, uint32_t width, uint32_t height,
+void VulkanTexture::update3DImage(PixelBufferDescriptor& data, uint32_t width, uint32_t height,
         uint32_t depth, int miplevel) {
     assert(width <= this->width && height <= this->height && depth <= this->depth);
     const uint32_t srcBytesPerTexel = getBytesPerPixel(format);
-    const bool reshape = srcBytesPerTexel == 3 || srcBytesPerTexel == 6;
+    const bool reshape = (srcBytesPerTexel == 3 || srcBytesPerTexel == 6) &&
+            !hasFourComponents(data);
     const void* cpuData = data.buffer;
     const uint32_t numSrcBytes = data.size;
     const uint32_t numDstBytes = reshape ? (4 * numSrcBytes / 3) : numSrcBytes;
 
-    // Create and populate the staging buffer.
-    VulkanStage const* stage = mStagePool.acquireStage(numDstBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    switch (srcBytesPerTexel) {
-        case 3:
-            // Morph the data from 3 bytes per texel to 4 bytes per texel and set alpha to 1.
-            DataReshaper::reshape<uint8_t, 3, 4>(mapped, cpuData, numSrcBytes);
-            break;
-        case 6:
-            // Morph the data from 6 bytes per texel to 8 bytes per texel. Note that this does not
-            // set alpha to 1 for half-float formats, but in practice that's fine since alpha is
-            // just a dummy channel in this situation.
-            DataReshaper::reshape<uint16_t, 3, 4>(mapped, cpuData, numSrcBytes);
-            break;
-        default:
-            memcpy(mapped, cpuData, numSrcBytes);
+    // Create and populate the staging buffer, unless the data was written to one directly.
+    VulkanStage const* stage = reshape ? nullptr : mStagePool.adoptStaging(data);
+    if (!stage) {
+        stage = mStagePool.acquireStage(numDstBytes);
+        void* mapped = stage->mapped;
+        switch (srcBytesPerTexel) {
+            case 3:
+                // Morph the data from 3 bytes per texel to 4 bytes per texel and set alpha to 1.
+                DataReshaper::reshape<uint8_t, 3, 4>(mapped, cpuData, numSrcBytes);
+                break;
+            case 6:
+                // Morph the data from 6 bytes per texel to 8 bytes per texel. Note that this does
+                // not set alpha to 1 for half-float formats, but in practice that's fine since
+                // alpha is just a dummy channel in this situation.
+                DataReshaper::reshape<uint16_t, 3, 4>(mapped, cpuData, numSrcBytes);
+                break;
+            default:
+                memcpy(mapped, cpuData, numSrcBytes);
+        }
+        vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numDstBytes);
     }
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numDstBytes);
 
     // Create a copy-to-device functor.
     auto copyToDevice = [this, stage, width, height, depth, miplevel] (VulkanCommandBuffer& commands) {
         transitionImageLayout(commands.cmdbuffer, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, 1, 1, mAspect);
-        copyBufferToImage(commands.cmdbuffer, stage->buffer, textureImage, width, height, depth,
-                nullptr, miplevel);
+        copyBufferToImage(commands.cmdbuffer, stage->buffer, stage->offset, textureImage,
+                width, height, depth, nullptr, miplevel);
         transitionImageLayout(commands.cmdbuffer, textureImage,VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                getTextureLayout(usage), miplevel, 1, 1, mAspect);
+                getTextureLayout(usage), miplevel, 1, 1, mAspect, isTransfer(mContext, commands));
 
         mStagePool.releaseStage(stage, commands);
     };
 
-    // If inside beginFrame / endFrame, use the swap context, otherwise use the work cmdbuffer.
-    if (mContext.currentCommands) {
-        copyToDevice(*mContext.currentCommands);
-    } else {
-        acquireWorkCommandBuffer(mContext);
-        copyToDevice(mContext.work);
-        flushWorkCommandBuffer(mContext);
-    }
+    // If inside beginFrame / endFrame, use the swap context, otherwise use the transfer queue or
+    // the work cmdbuffer.
+    recordUpload(mContext, mDisposer, this, mTransferable, copyToDevice);
 }
 
-void VulkanTexture::updateCubeImage(const PixelBufferDescriptor& data,
+void VulkanTexture::updateCubeImage(PixelBufferDescriptor& data,
         const FaceOffsets& faceOffsets, int miplevel) {
     assert(this->target == SamplerType::SAMPLER_CUBEMAP);
-    const bool reshape = getBytesPerPixel(format) == 3;
+    const bool reshape = getBytesPerPixel(format) == 3 && !hasFourComponents(data);
     const void* cpuData = data.buffer;
     const uint32_t numSrcBytes = data.size;
     const uint32_t numDstBytes = reshape ? (4 * numSrcBytes / 3) : numSrcBytes;
 
-    // Create and populate the staging buffer.
-    VulkanStage const* stage = mStagePool.acquireStage(numDstBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    if (reshape) {
-        DataReshaper::reshape<uint8_t, 3, 4>(mapped, cpuData, numSrcBytes);
-    } else {
-        memcpy(mapped, cpuData, numSrcBytes);
+    // Create and populate the staging buffer, unless the data was written to one directly.
+    VulkanStage const* stage = reshape ? nullptr : mStagePool.adoptStaging(data);
+    if (!stage) {
+        stage = mStagePool.acquireStage(numDstBytes);
+        void* mapped = stage->mapped;
+        if (reshape) {
+            DataReshaper::reshape<uint8_t, 3, 4>(mapped, cpuData, numSrcBytes);
+        } else {
+            memcpy(mapped, cpuData, numSrcBytes);
+        }
+        vmaFlushAllocation(mContext.allocator, stage->memory, stage->offset, numDstBytes);
     }
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-    vmaFlushAllocation(mContext.allocator, stage->memory, 0, numDstBytes);
 
     // Create a copy-to-device functor.
     auto copyToDevice = [this, faceOffsets, stage, miplevel] (VulkanCommandBuffer& commands) {
@@ -710,28 +878,24 @@ void VulkanTexture::updateCubeImage(const PixelBufferDescriptor& data,
         uint32_t height = std::max(1u, this->height >> miplevel);
         transitionImageLayout(commands.cmdbuffer, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, 6, 1, mAspect);
-        copyBufferToImage(commands.cmdbuffer, stage->buffer, textureImage, width, height, 1,
-                &faceOffsets, miplevel);
+        copyBufferToImage(commands.cmdbuffer, stage->buffer, stage->offset, textureImage,
+                width, height, 1, &faceOffsets, miplevel);
         transitionImageLayout(commands.cmdbuffer, textureImage,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, getTextureLayout(usage), miplevel, 6,
-                1, mAspect);
+                1, mAspect, isTransfer(mContext, commands));
 
         mStagePool.releaseStage(stage, commands);
     };
 
-    // If inside beginFrame / endFrame, use the swap context, otherwise use the work cmdbuffer.
-    if (mContext.currentCommands) {
-        copyToDevice(*mContext.currentCommands);
-    } else {
-        acquireWorkCommandBuffer(mContext);
-        copyToDevice(mContext.work);
-        flushWorkCommandBuffer(mContext);
-    }
+    // If inside beginFrame / endFrame, use the swap context, otherwise use the transfer queue or
+    // the work cmdbuffer.
+    recordUpload(mContext, mDisposer, this, mTransferable, copyToDevice);
 }
 
-VkImageView VulkanTexture::getImageView(int level, int layer, VkImageAspectFlags aspect) {
+VkImageView VulkanTexture::getImageView(int level, int layer, VkImageAspectFlags aspect,
+        uint8_t layerCount) {
     for (auto entry : mImageViews) {
-        if (entry.level == level && entry.layer == layer) {
+        if (entry.level == level && entry.layer == layer && entry.layerCount == layerCount) {
             return entry.view;
         }
     }
@@ -750,7 +914,7 @@ VkImageView VulkanTexture::getImageView(int level, int layer, VkImageAspectFlags
         viewInfo.subresourceRange.layerCount = 6;
     } else if (target == SamplerType::SAMPLER_2D_ARRAY) {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-        viewInfo.subresourceRange.layerCount = 1;
+        viewInfo.subresourceRange.layerCount = layerCount;
         viewInfo.subresourceRange.baseArrayLayer = layer;
     } else {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
@@ -759,7 +923,7 @@ VkImageView VulkanTexture::getImageView(int level, int layer, VkImageAspectFlags
 
     VkImageView imageView;
     vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &imageView);
-    mImageViews.emplace_back(ImageViewCacheEntry({level, layer, imageView}));
+    mImageViews.emplace_back(ImageViewCacheEntry({level, layer, layerCount, imageView}));
 
     // This is a very simplistic cache that exists only for the benefit of VulkanRenderTarget.
     // If it grows too big, there's a bug or we need to replace it with a more sophisticated cache.
@@ -771,7 +935,7 @@ VkImageView VulkanTexture::getImageView(int level, int layer, VkImageAspectFlags
 // TODO: replace the last 4 args with VkImageSubresourceRange
 void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
         VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel,
-        uint32_t layerCount, uint32_t levelCount, VkImageAspectFlags aspect) {
+        uint32_t layerCount, uint32_t levelCount, VkImageAspectFlags aspect, bool transferQueue) {
     if (oldLayout == newLayout) {
         return;
     }
@@ -805,9 +969,10 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
         case VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL:
         case VK_IMAGE_LAYOUT_GENERAL:
             barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.dstAccessMask = transferQueue ? 0 : VK_ACCESS_SHADER_READ_BIT;
             sourceStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-            destinationStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+            destinationStage = transferQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT :
+                    VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
             break;
 
         // We support PRESENT as a target layout to allow blitting from the swap chain.
@@ -826,8 +991,9 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
             &barrier);
 }
 
-void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkImage image,
-        uint32_t width, uint32_t height, uint32_t depth, FaceOffsets const* faceOffsets, uint32_t miplevel) {
+void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer,
+        VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height, uint32_t depth,
+        FaceOffsets const* faceOffsets, uint32_t miplevel) {
     VkExtent3D extent { width, height, depth };
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         assert(faceOffsets);
@@ -839,13 +1005,14 @@ void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
             region.imageSubresource.layerCount = 1;
             region.imageSubresource.mipLevel = miplevel;
             region.imageExtent = extent;
-            region.bufferOffset = faceOffsets->offsets[face];
+            region.bufferOffset = bufferOffset + faceOffsets->offsets[face];
         }
         vkCmdCopyBufferToImage(cmd, buffer, image,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 6, regions);
         return;
     }
     VkBufferImageCopy region = {};
+    region.bufferOffset = bufferOffset;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = miplevel;
     region.imageSubresource.layerCount = 1;
@@ -934,25 +1101,39 @@ void VulkanRenderPrimitive::setBuffers(VulkanVertexBuffer* vertexBuffer,
 
 VulkanTimerQuery::VulkanTimerQuery(VulkanContext& context) : mContext(context) {
     std::unique_lock<utils::Mutex> lock(context.timestamps.mutex);
-    utils::bitset32& bitset = context.timestamps.used;
-    const size_t maxTimers = bitset.size();
-    assert(bitset.count() < maxTimers);
-    for (size_t timerIndex = 0; timerIndex < maxTimers; ++timerIndex) {
-        if (!bitset.test(timerIndex)) {
-            bitset.set(timerIndex);
-            startingQueryIndex = timerIndex * 2;
-            stoppingQueryIndex = timerIndex * 2 + 1;
-            return;
-        }
+    std::vector<VulkanTimestamps::Pool>& pools = context.timestamps.pools;
+    const size_t maxTimers = utils::bitset256{}.size();
+    size_t p = 0;
+    while (p < pools.size() && pools[p].used.count() == maxTimers) {
+        p++;
+    }
+    if (p == pools.size()) {
+        // all the timers are in use, add a pool large enough to hold a pair of queries for each
+        VkQueryPoolCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = uint32_t(maxTimers * 2),
+        };
+        VkQueryPool queryPool;
+        VkResult result = vkCreateQueryPool(context.device, &createInfo, VKALLOC, &queryPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateQueryPool error.");
+        pools.push_back({ queryPool, {} });
+    }
+    utils::bitset256& bitset = pools[p].used;
+    size_t timerIndex = 0;
+    while (bitset.test(timerIndex)) {
+        timerIndex++;
     }
-    utils::slog.e << "More than " << maxTimers << " timers are not supported." << utils::io::endl;
-    startingQueryIndex = 0;
-    stoppingQueryIndex = 1;
+    bitset.set(timerIndex);
+    pool = pools[p].pool;
+    poolIndex = uint32_t(p);
+    startingQueryIndex = uint32_t(timerIndex * 2);
+    stoppingQueryIndex = uint32_t(timerIndex * 2 + 1);
 }
 
 VulkanTimerQuery::~VulkanTimerQuery() {
     std::unique_lock<utils::Mutex> lock(mContext.timestamps.mutex);
-    mContext.timestamps.used.unset(startingQueryIndex / 2);
+    mContext.timestamps.pools[poolIndex].used.unset(startingQueryIndex / 2);
 }
 
 } // namespace filament
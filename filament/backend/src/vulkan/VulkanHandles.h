@@ -20,6 +20,9 @@
 #include "VulkanDriver.h"
 #include "VulkanBinder.h"
 #include "VulkanBuffer.h"
+#include "VulkanPlatform.h"
+
+#include "private/backend/AcquiredImage.h"
 
 namespace filament {
 namespace backend {
@@ -28,8 +31,14 @@ struct VulkanProgram : public HwProgram {
     VulkanProgram(VulkanContext& context, const Program& builder) noexcept;
     ~VulkanProgram();
     VulkanContext& context;
-    VulkanBinder::ProgramBundle bundle;
+    VulkanBinder::ProgramBundle bundle = {};
     Program::SamplerGroupInfo samplerGroupInfo;
+    VkShaderModule compute = VK_NULL_HANDLE;
+    VkPipeline computePipeline = VK_NULL_HANDLE;    // created by the first dispatch()
+    // specialization constants of all the stages, referenced by bundle.specialization
+    VkSpecializationInfo specializationInfo = {};
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    std::vector<uint32_t> specializationData;
 };
 
 // The render target bundles together a set of attachments, each of which can have one of the
@@ -44,7 +53,7 @@ struct VulkanRenderTarget : private HwRenderTarget {
     // Creates an offscreen render target.
     VulkanRenderTarget(VulkanContext& context, uint32_t width, uint32_t height, uint8_t samples,
             VulkanAttachment color[MRT::TARGET_COUNT], VulkanAttachment depthStencil[2],
-            VulkanStagePool& stagePool);
+            VulkanStagePool& stagePool, VulkanDisposer& disposer);
 
     // Creates a special "default" render target (i.e. associated with the swap chain)
     explicit VulkanRenderTarget(VulkanContext& context);
@@ -61,12 +70,15 @@ struct VulkanRenderTarget : private HwRenderTarget {
     int getColorTargetCount() const;
     bool invalidate();
     uint8_t getSamples() const { return mSamples; }
+    uint8_t getViewCount() const { return mViewCount; }
+    bool isOffscreen() const { return mOffscreen; }
 private:
     VulkanAttachment mColor[MRT::TARGET_COUNT] = {};
     VulkanAttachment mDepth = {};
     VulkanContext& mContext;
     const bool mOffscreen;
     const uint8_t mSamples;
+    uint8_t mViewCount = 1;
     VulkanAttachment mMsaaAttachments[MRT::TARGET_COUNT] = {};
     VulkanAttachment mMsaaDepthAttachment = {};
 };
@@ -98,9 +110,12 @@ struct VulkanUniformBuffer : public HwUniformBuffer {
     VulkanUniformBuffer(VulkanContext& context, VulkanStagePool& stagePool,
             VulkanDisposer& disposer, uint32_t numBytes, backend::BufferUsage usage);
     ~VulkanUniformBuffer();
-    void loadFromCpu(const void* cpuData, uint32_t numBytes);
+    void loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes);
+    // Uploads without copy if the data was written to a stage from acquireStaging().
+    void loadFromCpu(BufferDescriptor& data, uint32_t byteOffset);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
+    void loadFromStage(VulkanStage const* stage, uint32_t byteOffset, uint32_t numBytes);
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
     VulkanDisposer& mDisposer;
@@ -112,49 +127,97 @@ struct VulkanSamplerGroup : public HwSamplerGroup {
     VulkanSamplerGroup(VulkanContext& context, uint32_t count) : HwSamplerGroup(count) {}
 };
 
+// A platform image sampled by a SAMPLER_EXTERNAL texture instead of its own image, see
+// VulkanDriver::importExternalImage(). It's a disposable, since the GPU may still sample it after
+// the texture gets another image.
+struct VulkanExternalImage {
+    VulkanPlatform::ExternalImage image;
+    VkImageView view;
+    VkSampler ycbcrSampler;     // immutable sampler, when the image needs a YCbCr conversion
+    AcquiredImage acquired;     // released along with the image, when it comes from a stream
+};
+
+// The image given to setAcquiredImage() is pending until the next updateStreams(), which hands
+// it to the textures attached to the stream.
+struct VulkanStream : public HwStream {
+    AcquiredImage pending;      // only used on the application thread
+};
+
 struct VulkanTexture : public HwTexture {
     VulkanTexture(VulkanContext& context, SamplerType target, uint8_t levels,
             TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
-            TextureUsage usage, VulkanStagePool& stagePool);
+            TextureUsage usage, VulkanStagePool& stagePool, VulkanDisposer& disposer);
     ~VulkanTexture();
-    void update2DImage(const PixelBufferDescriptor& data, uint32_t width, uint32_t height,
+    // The updates don't copy the data if it was written to memory from
+    // VulkanStagePool::acquireStaging() and needs no reshaping.
+    void update2DImage(PixelBufferDescriptor& data, uint32_t width, uint32_t height,
             int miplevel);
-    void update3DImage(const PixelBufferDescriptor& data, uint32_t width, uint32_t height,
+    void update3DImage(PixelBufferDescriptor& data, uint32_t width, uint32_t height,
             uint32_t depth, int miplevel);
-    void updateCubeImage(const PixelBufferDescriptor& data, const FaceOffsets& faceOffsets,
+    void updateCubeImage(PixelBufferDescriptor& data, const FaceOffsets& faceOffsets,
             int miplevel);
 
-    // Gets or creates a cached image view for a single miplevel and array layer.
-    VkImageView getImageView(int level, int layer, VkImageAspectFlags aspect);
+    // Gets or creates a cached image view for a single miplevel and 'layerCount' array layers
+    // starting at 'layer', more than one layer is only used by multiview render targets.
+    VkImageView getImageView(int level, int layer, VkImageAspectFlags aspect,
+            uint8_t layerCount = 1);
+
+    // Restricts the view used for sampling, i.e. imageView, to the levels [minLevel, maxLevel].
+    // The views of previous ranges are kept until the texture is destroyed, since descriptor sets
+    // may still refer to them.
+    void setPrimaryRange(uint32_t minLevel, uint32_t maxLevel);
+
+    // All the views imageView has been set to, see setPrimaryRange().
+    std::vector<VkImageView> getPrimaryViews() const;
 
     // Issues a barrier that transforms the layout of the image, e.g. from a CPU-writeable
-    // layout to a GPU-readable layout.
+    // layout to a GPU-readable layout. On the transfer queue, the barrier only uses the transfer
+    // stage and the graphics queue's semaphore wait makes the image visible to shaders.
     static void transitionImageLayout(VkCommandBuffer cmdbuffer, VkImage image,
             VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel,
-            uint32_t layers, uint32_t levels, VkImageAspectFlags aspect);
+            uint32_t layers, uint32_t levels, VkImageAspectFlags aspect,
+            bool transferQueue = false);
 
     VkFormat vkformat;
+    VkImageUsageFlags vkusage = 0;      // the usage and flags the image was created with
+    VkImageCreateFlags vkflags = 0;
     VkImageView imageView = VK_NULL_HANDLE;
     VkImage textureImage = VK_NULL_HANDLE;
     VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+
+    // The external image sampled instead of textureImage, and the stream it comes from, if any.
+    VulkanExternalImage* externalImage = nullptr;
+    VulkanStream* stream = nullptr;
 private:
 
-    // Issues a copy from a VkBuffer to a specified miplevel in a VkImage. The given width and
-    // height define a subregion within the miplevel.
-    void copyBufferToImage(VkCommandBuffer cmdbuffer, VkBuffer buffer, VkImage image,
-            uint32_t width, uint32_t height, uint32_t depth,
+    // Issues a copy from a VkBuffer, starting at bufferOffset, to a specified miplevel in a
+    // VkImage. The given width and height define a subregion within the miplevel.
+    void copyBufferToImage(VkCommandBuffer cmdbuffer, VkBuffer buffer, VkDeviceSize bufferOffset,
+            VkImage image, uint32_t width, uint32_t height, uint32_t depth,
             FaceOffsets const* faceOffsets, uint32_t miplevel);
 
     struct ImageViewCacheEntry {
         int level;
         int layer;
+        uint8_t layerCount;
+        VkImageView view;
+    };
+
+    struct PrimaryViewCacheEntry {
+        uint32_t minLevel;
+        uint32_t maxLevel;
         VkImageView view;
     };
 
+    VkImageView createPrimaryView(uint32_t minLevel, uint32_t maxLevel);
+
     std::vector<ImageViewCacheEntry> mImageViews;
+    std::vector<PrimaryViewCacheEntry> mPrimaryViews;
     VkImageAspectFlags mAspect;
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
+    VulkanDisposer& mDisposer;
+    bool mTransferable = false;     // uploads can use the transfer queue
 };
 
 struct VulkanRenderPrimitive : public HwRenderPrimitive {
@@ -186,6 +249,8 @@ struct VulkanSync : public HwSync {
 struct VulkanTimerQuery : public HwTimerQuery {
     VulkanTimerQuery(VulkanContext& context);
     ~VulkanTimerQuery();
+    VkQueryPool pool;
+    uint32_t poolIndex;     // in VulkanTimestamps::pools
     uint32_t startingQueryIndex;
     uint32_t stoppingQueryIndex;
     VulkanContext& mContext;
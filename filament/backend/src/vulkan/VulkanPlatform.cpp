@@ -19,7 +19,16 @@
 namespace filament {
 namespace backend {
 
+// All vkCreate* functions take an optional allocator. For now we select the default allocator by
+// passing in a null pointer, and we highlight the argument by using the VKALLOC constant.
+constexpr VkAllocationCallbacks* VKALLOC = nullptr;
+
 VulkanPlatform::~VulkanPlatform() = default;
 
+void VulkanPlatform::destroyExternalImage(VkDevice device, ExternalImage const& image) noexcept {
+    vkDestroyImage(device, image.image, VKALLOC);
+    vkFreeMemory(device, image.memory, VKALLOC);
+}
+
 } // namespace backend
 } // namespace filament
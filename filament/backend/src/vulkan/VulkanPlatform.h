@@ -19,6 +19,10 @@
 
 #include <backend/Platform.h>
 
+#include <bluevk/BlueVK.h>
+
+#include <stdint.h>
+
 // In debug builds, we enable validation layers and set up a debug callback if the extension is
 // available. Caution: the debug callback causes a null pointer dereference with optimized builds.
 //
@@ -42,9 +46,51 @@ namespace backend {
 
 class VulkanPlatform : public DefaultPlatform {
 public:
+    // A platform-specific image (e.g. an AHardwareBuffer) imported as a VkImage without copy.
+    struct ExternalImage {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkFormat format = VK_FORMAT_UNDEFINED;  // undefined when externalFormat is used
+        uint64_t externalFormat = 0;            // opaque format of the platform, if any
+        VkFormatFeatureFlags features = 0;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint32_t queueFamily = VK_QUEUE_FAMILY_EXTERNAL;    // owns the image until it's sampled
+
+        // The image is converted from YCbCr to RGB when it is sampled, with these parameters.
+        bool ycbcr = false;
+        VkSamplerYcbcrModelConversion ycbcrModel = VK_SAMPLER_YCBCR_MODEL_CONVERSION_RGB_IDENTITY;
+        VkSamplerYcbcrRange ycbcrRange = VK_SAMPLER_YCBCR_RANGE_ITU_FULL;
+        VkComponentMapping components = {};
+        VkChromaLocation xChromaOffset = VK_CHROMA_LOCATION_COSITED_EVEN;
+        VkChromaLocation yChromaOffset = VK_CHROMA_LOCATION_COSITED_EVEN;
+    };
+
     // Given a Vulkan instance and native window handle, creates the platform-specific surface.
     virtual void* createVkSurfaceKHR(void* nativeWindow, void* instance, uint64_t flags) noexcept = 0;
 
+    // Device extensions needed by importExternalImage(). External images are only supported by
+    // the devices that have all of them, and the sampler YCbCr conversion feature.
+    virtual const char* const* getExternalImageExtensions(uint32_t* count) const noexcept {
+        *count = 0;
+        return nullptr;
+    }
+
+    // Imports the platform-specific 'image' given to setExternalImage() or setAcquiredImage()
+    // as a sampled VkImage bound to the image's own memory. Returns false if it can't be imported.
+    virtual bool importExternalImage(VkPhysicalDevice physicalDevice, VkDevice device,
+            void* image, ExternalImage* out) noexcept {
+        return false;
+    }
+
+    // Destroys an image returned by importExternalImage(), once the GPU is done with it.
+    virtual void destroyExternalImage(VkDevice device, ExternalImage const& image) noexcept;
+
+    // Called on the application thread by setupExternalImage() to take ownership of the image,
+    // and to release it once it's imported or when the call is canceled.
+    virtual void retainExternalImage(void* image) noexcept {}
+    virtual void releaseExternalImage(void* image) noexcept {}
+
    ~VulkanPlatform() override;
 };
 
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "vulkan/VulkanRecorder.h"
+
+#include <utils/Panic.h>
+
+#include <algorithm>
+
+namespace filament {
+namespace backend {
+
+VulkanRecorder::VulkanRecorder(VulkanContext& context) : mContext(context) {
+    const VkCommandPoolCreateInfo createInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = context.graphicsQueueFamilyIndex
+    };
+    VkResult result = vkCreateCommandPool(context.device, &createInfo, VKALLOC, &mPool);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+}
+
+// The secondary command buffers are freed with their pool, the device must be idle.
+VulkanRecorder::~VulkanRecorder() {
+    vkDestroyCommandPool(mContext.device, mPool, VKALLOC);
+}
+
+VkCommandBuffer VulkanRecorder::begin(VkViewport const& viewport) {
+    assert(mCurrent == VK_NULL_HANDLE);
+    const VkDevice device = mContext.device;
+    auto iter = std::find_if(mSubmitted.begin(), mSubmitted.end(),
+            [device](Submitted const& submitted) {
+                return vkGetFenceStatus(device, submitted.fence->fence) == VK_SUCCESS;
+            });
+    if (iter != mSubmitted.end()) {
+        mCurrent = iter->cmdbuffer;
+        mSubmitted.erase(iter);
+        vkResetCommandBuffer(mCurrent, 0);
+    } else {
+        const VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = mPool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1
+        };
+        VkResult error = vkAllocateCommandBuffers(device, &allocateInfo, &mCurrent);
+        ASSERT_POSTCONDITION(!error, "vkAllocateCommandBuffers error.");
+    }
+
+    const VulkanRenderPass& renderPass = mContext.currentRenderPass;
+    const VkCommandBufferInheritanceInfo inheritanceInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = renderPass.renderPass,
+        .subpass = (uint32_t) renderPass.currentSubpass,
+        .framebuffer = renderPass.framebuffer
+    };
+    const VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo
+    };
+    VkResult error = vkBeginCommandBuffer(mCurrent, &beginInfo);
+    ASSERT_POSTCONDITION(!error, "vkBeginCommandBuffer error.");
+    vkCmdSetViewport(mCurrent, 0, 1, &viewport);
+    return mCurrent;
+}
+
+VkCommandBuffer VulkanRecorder::end(std::shared_ptr<VulkanCmdFence> const& fence) {
+    assert(mCurrent != VK_NULL_HANDLE);
+    VkResult error = vkEndCommandBuffer(mCurrent);
+    ASSERT_POSTCONDITION(!error, "vkEndCommandBuffer error.");
+    mSubmitted.push_back({ mCurrent, fence });
+    VkCommandBuffer cmdbuffer = mCurrent;
+    mCurrent = VK_NULL_HANDLE;
+    return cmdbuffer;
+}
+
+} // namespace backend
+} // namespace filament
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_VULKANRECORDER_H
+#define TNT_FILAMENT_DRIVER_VULKANRECORDER_H
+
+#include "VulkanContext.h"
+
+#include <memory>
+#include <vector>
+
+namespace filament {
+namespace backend {
+
+// Records commands of the current subpass into secondary command buffers, which the current
+// command buffer then executes. Each recorder has its own command pool, so several threads can
+// record at once as long as each uses its own recorder.
+//
+// Secondary command buffers are recycled once the fence of the command buffer that executed them
+// has signaled.
+class VulkanRecorder {
+public:
+    explicit VulkanRecorder(VulkanContext& context);
+    ~VulkanRecorder();
+
+    VulkanRecorder(VulkanRecorder const&) = delete;
+    VulkanRecorder& operator=(VulkanRecorder const&) = delete;
+
+    // Begins a secondary command buffer that continues the current subpass of the context.
+    // Secondary command buffers don't inherit the dynamic state, so the viewport is set again.
+    VkCommandBuffer begin(VkViewport const& viewport);
+
+    // Ends the secondary command buffer being recorded and returns it, 'fence' is the fence of
+    // the command buffer that executes it.
+    VkCommandBuffer end(std::shared_ptr<VulkanCmdFence> const& fence);
+
+    // Returns the secondary command buffer being recorded, or VK_NULL_HANDLE.
+    VkCommandBuffer getCommandBuffer() const noexcept { return mCurrent; }
+
+private:
+    struct Submitted {
+        VkCommandBuffer cmdbuffer;
+        std::shared_ptr<VulkanCmdFence> fence;
+    };
+
+    VulkanContext& mContext;
+    VkCommandPool mPool = VK_NULL_HANDLE;
+    VkCommandBuffer mCurrent = VK_NULL_HANDLE;
+    std::vector<Submitted> mSubmitted;
+};
+
+} // namespace backend
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_VULKANRECORDER_H
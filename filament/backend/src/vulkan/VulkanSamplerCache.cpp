@@ -18,6 +18,8 @@
 
 #include <utils/Panic.h>
 
+#include <string.h>
+
 namespace filament {
 namespace backend {
 
@@ -98,6 +100,7 @@ constexpr inline VkBool32 getCompareEnable(SamplerCompareMode mode) noexcept {
 VulkanSamplerCache::VulkanSamplerCache(VulkanContext& context) : mContext(context) {}
 
 VkSampler VulkanSamplerCache::getSampler(backend::SamplerParams params) noexcept {
+    std::lock_guard<utils::Mutex> lock(mMutex);
     auto iter = mCache.find(params.u);
     if (UTILS_LIKELY(iter != mCache.end())) {
         return iter->second;
@@ -126,11 +129,100 @@ VkSampler VulkanSamplerCache::getSampler(backend::SamplerParams params) noexcept
     return sampler;
 }
 
+VulkanSamplerCache::YcbcrSampler VulkanSamplerCache::getYcbcrSampler(
+        VulkanPlatform::ExternalImage const& image) noexcept {
+    // The chroma can only be filtered linearly if the format supports it.
+    const VkFilter chromaFilter =
+            (image.features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_YCBCR_CONVERSION_LINEAR_FILTER_BIT) ?
+            VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    const YcbcrKey key = {
+        .externalFormat = image.externalFormat,
+        .format = image.format,
+        .model = image.ycbcrModel,
+        .range = image.ycbcrRange,
+        .components = image.components,
+        .xChromaOffset = image.xChromaOffset,
+        .yChromaOffset = image.yChromaOffset,
+        .chromaFilter = chromaFilter
+    };
+
+    std::lock_guard<utils::Mutex> lock(mMutex);
+    auto iter = mYcbcrCache.find(key);
+    if (UTILS_LIKELY(iter != mYcbcrCache.end())) {
+        return iter->second;
+    }
+
+    // An external format is given to the conversion through a VkExternalFormatANDROID, which has
+    // the same layout on all platforms, and is only used when the format is undefined.
+    struct {
+        VkStructureType sType;
+        void* pNext;
+        uint64_t externalFormat;
+    } externalFormat = {
+        .sType = VK_STRUCTURE_TYPE_EXTERNAL_FORMAT_ANDROID,
+        .pNext = nullptr,
+        .externalFormat = image.externalFormat
+    };
+    VkSamplerYcbcrConversionCreateInfo conversionInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_CREATE_INFO,
+        .pNext = image.externalFormat ? &externalFormat : nullptr,
+        .format = image.format,
+        .ycbcrModel = image.ycbcrModel,
+        .ycbcrRange = image.ycbcrRange,
+        .components = image.components,
+        .xChromaOffset = image.xChromaOffset,
+        .yChromaOffset = image.yChromaOffset,
+        .chromaFilter = chromaFilter,
+        .forceExplicitReconstruction = VK_FALSE
+    };
+    YcbcrSampler result;
+    VkResult error = vkCreateSamplerYcbcrConversionKHR(mContext.device, &conversionInfo, VKALLOC,
+            &result.conversion);
+    ASSERT_POSTCONDITION(!error, "Unable to create sampler YCbCr conversion.");
+
+    VkSamplerYcbcrConversionInfo samplerConversionInfo = {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_YCBCR_CONVERSION_INFO,
+        .conversion = result.conversion
+    };
+    VkSamplerCreateInfo samplerInfo {
+        .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        .pNext = &samplerConversionInfo,
+        .magFilter = chromaFilter,
+        .minFilter = chromaFilter,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        .anisotropyEnable = VK_FALSE,
+        .maxAnisotropy = 1.0f,
+        .compareEnable = VK_FALSE,
+        .minLod = 0.0f,
+        .maxLod = 0.0f,
+        .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+        .unnormalizedCoordinates = VK_FALSE
+    };
+    error = vkCreateSampler(mContext.device, &samplerInfo, VKALLOC, &result.sampler);
+    ASSERT_POSTCONDITION(!error, "Unable to create sampler.");
+    mYcbcrCache.insert({key, result});
+    return result;
+}
+
+bool VulkanSamplerCache::YcbcrEqual::operator()(YcbcrKey const& lhs,
+        YcbcrKey const& rhs) const noexcept {
+    return !memcmp(&lhs, &rhs, sizeof(YcbcrKey));
+}
+
 void VulkanSamplerCache::reset() noexcept {
+    std::lock_guard<utils::Mutex> lock(mMutex);
     for (auto pair : mCache) {
         vkDestroySampler(mContext.device, pair.second, VKALLOC);
     }
     mCache.clear();
+    for (auto pair : mYcbcrCache) {
+        vkDestroySampler(mContext.device, pair.second.sampler, VKALLOC);
+        vkDestroySamplerYcbcrConversionKHR(mContext.device, pair.second.conversion, VKALLOC);
+    }
+    mYcbcrCache.clear();
 }
 
 } // namespace filament
@@ -18,22 +18,61 @@
 #define TNT_FILAMENT_DRIVER_VULKANSAMPLERCACHE_H
 
 #include "VulkanContext.h"
+#include "VulkanPlatform.h"
 #include "VulkanUtility.h"
 
+#include <utils/Hash.h>
+#include <utils/Mutex.h>
+
 #include <tsl/robin_map.h>
 
+#include <mutex>
+
 namespace filament {
 namespace backend {
 
-// Simple manager for VkSampler objects.
+// Simple manager for VkSampler objects. getSampler() can be called from several threads at once,
+// when sub-streams are recorded concurrently.
 class VulkanSamplerCache {
 public:
+    // A sampler that converts an external image from YCbCr to RGB, with the conversion the views
+    // of the image must be created with. It can only be bound as an immutable sampler.
+    struct YcbcrSampler {
+        VkSamplerYcbcrConversion conversion;
+        VkSampler sampler;
+    };
+
     explicit VulkanSamplerCache(VulkanContext&);
     VkSampler getSampler(backend::SamplerParams params) noexcept;
+
+    // Gets or creates the sampler of an external image that needs a YCbCr conversion, these
+    // samplers are linear and clamp to edge. Like the other samplers, they're only destroyed by
+    // reset().
+    YcbcrSampler getYcbcrSampler(VulkanPlatform::ExternalImage const& image) noexcept;
+
     void reset() noexcept;
 private:
+    struct YcbcrKey {
+        uint64_t externalFormat;
+        VkFormat format;
+        VkSamplerYcbcrModelConversion model;
+        VkSamplerYcbcrRange range;
+        VkComponentMapping components;
+        VkChromaLocation xChromaOffset;
+        VkChromaLocation yChromaOffset;
+        VkFilter chromaFilter;
+    };
+    static_assert(sizeof(YcbcrKey) == 48, "YcbcrKey must not have padding, it is hashed.");
+
+    struct YcbcrEqual {
+        bool operator()(YcbcrKey const& lhs, YcbcrKey const& rhs) const noexcept;
+    };
+
     VulkanContext& mContext;
     tsl::robin_map<uint32_t, VkSampler> mCache;
+    tsl::robin_map<YcbcrKey, YcbcrSampler, utils::hash::MurmurHashFn<YcbcrKey>, YcbcrEqual>
+            mYcbcrCache;
+    utils::Mutex mMutex;
 };
 
 } // namespace filament
@@ -22,7 +22,15 @@ namespace filament {
 namespace backend {
 
 VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) {
-    // First check if a stage exists whose capacity is greater than or equal to the requested size.
+    // Most uploads are small enough to be sub-allocated from the ring.
+    if (numBytes <= MAX_RING_STAGE_SIZE) {
+        VulkanStage const* stage = acquireRingStage(numBytes);
+        if (stage) {
+            return stage;
+        }
+    }
+
+    // Next check if a stage exists whose capacity is greater than or equal to the requested size.
     auto iter = mFreeStages.lower_bound(numBytes);
     if (iter != mFreeStages.end()) {
         auto stage = iter->second;
@@ -31,30 +39,149 @@ VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) {
         return stage;
     }
     // We were not able to find a sufficiently large stage, so create a new one.
+    VulkanStage* stage = createStage(numBytes);
+    stage->lastAccessed = mCurrentFrame;
+    mUsedStages.insert(stage);
+    return stage;
+}
+
+VulkanStage* VulkanStagePool::createStage(uint32_t numBytes) const noexcept {
     VulkanStage* stage = new VulkanStage({
         .memory = VK_NULL_HANDLE,
         .buffer = VK_NULL_HANDLE,
+        .offset = 0,
         .capacity = numBytes,
-        .lastAccessed = mCurrentFrame,
+        .mapped = nullptr,
+        .lastAccessed = 0,
     });
 
-    // Create the VkBuffer.
-    mUsedStages.insert(stage);
+    // Create the VkBuffer, which stays mapped until it's destroyed.
     VkBufferCreateInfo bufferInfo {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = numBytes,
         .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
     };
     VmaAllocationCreateInfo allocInfo {
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
         .usage = VMA_MEMORY_USAGE_CPU_ONLY
     };
+    VmaAllocationInfo info {};
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage->buffer, &stage->memory,
-            nullptr);
+            &info);
+    stage->mapped = info.pMappedData;
+    mSize.fetch_add(numBytes, std::memory_order_relaxed);
 
     return stage;
 }
 
+void VulkanStagePool::destroyStage(VulkanStage const* stage) noexcept {
+    vmaDestroyBuffer(mContext.allocator, stage->buffer, stage->memory);
+    mSize.fetch_sub(stage->capacity, std::memory_order_relaxed);
+    delete stage;
+}
+
+// The allocator is internally synchronized, and the stage is only added to the pool once adopted
+// by the driver thread.
+BufferDescriptor VulkanStagePool::acquireStaging(uint32_t numBytes) {
+    VulkanStage* stage = createStage(numBytes);
+    return BufferDescriptor(stage->mapped, numBytes, destroyStaging,
+            new Staging{ mContext.allocator, stage, &mSize });
+}
+
+void VulkanStagePool::destroyStaging(void* buffer, size_t size, void* user) {
+    Staging* staging = static_cast<Staging*>(user);
+    vmaDestroyBuffer(staging->allocator, staging->stage->buffer, staging->stage->memory);
+    staging->size->fetch_sub(staging->stage->capacity, std::memory_order_relaxed);
+    delete staging->stage;
+    delete staging;
+}
+
+VulkanStage const* VulkanStagePool::adoptStaging(BufferDescriptor& data) noexcept {
+    if (data.getCallback() != destroyStaging) {
+        return nullptr;
+    }
+    Staging* staging = static_cast<Staging*>(data.getUser());
+    VulkanStage* stage = staging->stage;
+    delete staging;
+    data.setCallback(nullptr);
+
+    // The application wrote the stage, make its writes visible to the GPU.
+    vmaFlushAllocation(mContext.allocator, stage->memory, 0, stage->capacity);
+    stage->lastAccessed = mCurrentFrame;
+    mUsedStages.insert(stage);
+    return stage;
+}
+
+VulkanStage const* VulkanStagePool::acquireRingStage(uint32_t numBytes) {
+    if (mRingBuffer == VK_NULL_HANDLE) {
+        VkBufferCreateInfo bufferInfo {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size = RING_CAPACITY,
+            .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        };
+        VmaAllocationCreateInfo allocInfo {
+            .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+            .usage = VMA_MEMORY_USAGE_CPU_ONLY
+        };
+        VmaAllocationInfo info {};
+        if (vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mRingBuffer,
+                &mRingMemory, &info) != VK_SUCCESS) {
+            mRingBuffer = VK_NULL_HANDLE;
+            mRingMemory = VK_NULL_HANDLE;
+            return nullptr;
+        }
+        mRingMapped = info.pMappedData;
+        mSize.fetch_add(RING_CAPACITY, std::memory_order_relaxed);
+    }
+
+    // Stages don't wrap around, so skip the end of the ring if the stage doesn't fit there.
+    uint64_t start = (mRingHead + RING_ALIGNMENT - 1) & ~uint64_t(RING_ALIGNMENT - 1);
+    uint64_t offset = start % RING_CAPACITY;
+    if (offset + numBytes > RING_CAPACITY) {
+        start += RING_CAPACITY - offset;
+        offset = 0;
+    }
+    if (start + numBytes - mRingTail > RING_CAPACITY) {
+        // The ring is full, the caller falls back to a dedicated stage.
+        return nullptr;
+    }
+    mRingHead = start + numBytes;
+
+    mRingStages.push_back({
+        .stage = {
+            .memory = mRingMemory,
+            .buffer = mRingBuffer,
+            .offset = uint32_t(offset),
+            .capacity = numBytes,
+            .mapped = static_cast<char*>(mRingMapped) + offset,
+            .lastAccessed = mCurrentFrame,
+        },
+        .end = mRingHead,
+        .released = false
+    });
+    return &mRingStages.back().stage;
+}
+
+void VulkanStagePool::releaseRingStage(VulkanStage const* stage) noexcept {
+    // VulkanStage is the first member of RingStage.
+    RingStage const* ringStage = reinterpret_cast<RingStage const*>(stage);
+    const_cast<RingStage*>(ringStage)->released = true;
+
+    // The ring only reclaims its oldest stages, in order.
+    while (!mRingStages.empty() && mRingStages.front().released) {
+        mRingTail = mRingStages.front().end;
+        mRingStages.pop_front();
+    }
+    if (mRingStages.empty()) {
+        mRingHead = mRingTail = 0;
+    }
+}
+
 void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
+    if (stage->buffer == mRingBuffer) {
+        releaseRingStage(stage);
+        return;
+    }
     auto iter = mUsedStages.find(stage);
     if (iter == mUsedStages.end()) {
         utils::slog.e << "Unknown stage: " << stage->capacity << " bytes" << utils::io::endl;
@@ -68,7 +195,10 @@ void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
 void VulkanStagePool::releaseStage(VulkanStage const* stage, VulkanCommandBuffer& cmd) noexcept {
     // Replace the previous owner of the stage with the given command buffer.  When the command
     // buffer finishes execution, the stage will finally be released back into the pool.
-    mDisposer.createDisposable(stage, [stage, this]() { this->releaseStage(stage); });
+    mDisposer.createDisposable(stage, { [](void* user, uint64_t stage) {
+        static_cast<VulkanStagePool*>(user)->releaseStage(
+                reinterpret_cast<VulkanStage const*>(uintptr_t(stage)));
+    }, this, uintptr_t(stage) });
     mDisposer.acquire(stage, cmd.resources);
     mDisposer.removeReference(stage);
 }
@@ -84,8 +214,7 @@ void VulkanStagePool::gc() noexcept {
     stages.swap(mFreeStages);
     for (auto pair : stages) {
         if (pair.second->lastAccessed < evictionTime) {
-            vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
-            delete pair.second;
+            destroyStage(pair.second);
         } else {
             mFreeStages.insert(pair);
         }
@@ -93,10 +222,17 @@ void VulkanStagePool::gc() noexcept {
 }
 
 void VulkanStagePool::reset() noexcept {
-    assert(mUsedStages.empty());
+    assert(mUsedStages.empty() && mRingStages.empty());
+    if (mRingBuffer != VK_NULL_HANDLE) {
+        vmaDestroyBuffer(mContext.allocator, mRingBuffer, mRingMemory);
+        mSize.fetch_sub(RING_CAPACITY, std::memory_order_relaxed);
+        mRingBuffer = VK_NULL_HANDLE;
+        mRingMemory = VK_NULL_HANDLE;
+        mRingMapped = nullptr;
+    }
+    mRingHead = mRingTail = 0;
     for (auto pair : mFreeStages) {
-        vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
-        delete pair.second;
+        destroyStage(pair.second);
     }
     mFreeStages.clear();
 }
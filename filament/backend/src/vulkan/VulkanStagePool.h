@@ -21,26 +21,45 @@
 
 #include "VulkanDisposer.h"
 
+#include <backend/BufferDescriptor.h>
+
+#include <atomic>
+#include <deque>
 #include <map>
 #include <unordered_set>
 
 namespace filament {
 namespace backend {
 
-// Immutable POD representing a shared CPU-GPU staging area.
+// Immutable POD representing a shared CPU-GPU staging area. Stages are persistently mapped, and
+// either own their buffer or are a range of the pool's staging ring.
 struct VulkanStage {
     VmaAllocation memory;
     VkBuffer buffer;
+    uint32_t offset;        // offset of the stage in the buffer, in bytes
     uint32_t capacity;
+    void* mapped;           // address of the stage, i.e. of its buffer at 'offset'
     mutable uint64_t lastAccessed;
 };
 
-// Manages a pool of stages, periodically releasing stages that have been unused for a while.
+// Manages the staging areas used to upload data to the GPU.
+//
+// Most uploads are sub-allocated from a persistently mapped ring buffer, whose ranges are
+// reclaimed once the command buffers that read them have completed. Uploads that are too large
+// for the ring, or that happen while it's full, get a dedicated stage from a pool, which
+// periodically releases stages that have been unused for a while.
 class VulkanStagePool {
 public:
     explicit VulkanStagePool(VulkanContext& context, VulkanDisposer& disposer) noexcept :
             mContext(context), mDisposer(disposer) {}
 
+    // Size of the staging ring, and largest upload that is sub-allocated from it.
+    static constexpr uint32_t RING_CAPACITY = 4u * 1024u * 1024u;
+    static constexpr uint32_t MAX_RING_STAGE_SIZE = RING_CAPACITY / 4u;
+
+    // Alignment of the stages in the ring, which covers the texel size of all formats.
+    static constexpr uint32_t RING_ALIGNMENT = 256u;
+
     // Finds or creates a stage whose capacity is at least the given number of bytes.
     VulkanStage const* acquireStage(uint32_t numBytes);
 
@@ -48,6 +67,19 @@ public:
     void releaseStage(VulkanStage const* stage) noexcept;
     void releaseStage(VulkanStage const* stage, VulkanCommandBuffer& cmd) noexcept;
 
+    // Creates a stage for the application to write directly, wrapped in a descriptor whose
+    // callback destroys the stage unless it's adopted. Unlike the other methods, this can be
+    // called from any thread.
+    BufferDescriptor acquireStaging(uint32_t numBytes);
+
+    // Takes over the stage of a descriptor made by acquireStaging(), which is then used and
+    // released like the ones from acquireStage(). Returns null for any other descriptor.
+    VulkanStage const* adoptStaging(BufferDescriptor& data) noexcept;
+
+    // Returns the size in bytes of all the stages, including the ring and the staging memory not
+    // adopted yet. This can be called from any thread.
+    size_t getSize() const noexcept { return mSize.load(std::memory_order_relaxed); }
+
     // Evicts old unused stages and bumps the current frame number.
     void gc() noexcept;
 
@@ -56,9 +88,44 @@ public:
     void reset() noexcept;
 
 private:
+    struct RingStage {
+        VulkanStage stage;      // must be first, see releaseStage()
+        uint64_t end;           // position of the end of the stage in the ring
+        bool released;
+    };
+
+    // Staging memory handed out by acquireStaging(), until it's adopted.
+    struct Staging {
+        VmaAllocator allocator;
+        VulkanStage* stage;
+        std::atomic<size_t>* size;
+    };
+
+    static void destroyStaging(void* buffer, size_t size, void* user);
+
+    // Creates a dedicated stage, without touching the state of the pool.
+    VulkanStage* createStage(uint32_t numBytes) const noexcept;
+
+    void destroyStage(VulkanStage const* stage) noexcept;
+
+    VulkanStage const* acquireRingStage(uint32_t numBytes);
+    void releaseRingStage(VulkanStage const* stage) noexcept;
+
     VulkanContext& mContext;
     VulkanDisposer& mDisposer;
 
+    // The ring is allocated on first use. Positions grow monotonically and wrap modulo the
+    // capacity, everything between mRingTail and mRingHead is in use.
+    VkBuffer mRingBuffer = VK_NULL_HANDLE;
+    VmaAllocation mRingMemory = VK_NULL_HANDLE;
+    void* mRingMapped = nullptr;
+    uint64_t mRingHead = 0;
+    uint64_t mRingTail = 0;
+
+    // Stages of the ring in allocation order. A deque keeps their address when it grows, and
+    // they're released mostly in order, as command buffers complete.
+    std::deque<RingStage> mRingStages;
+
     // Use an ordered multimap for quick (capacity => stage) lookups using lower_bound().
     std::multimap<uint32_t, VulkanStage const*> mFreeStages;
 
@@ -69,6 +136,9 @@ private:
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint64_t mCurrentFrame = 0;
     static constexpr uint32_t TIME_BEFORE_EVICTION = 3;
+
+    // Updated by acquireStaging() and by the staging callbacks on other threads.
+    mutable std::atomic<size_t> mSize{ 0 };
 };
 
 } // namespace filament
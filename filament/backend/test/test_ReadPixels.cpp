@@ -249,7 +249,7 @@ TEST_F(BackendTest, ReadPixels) {
         state.rasterState.depthWrite = false;
         state.rasterState.depthFunc = RasterState::DepthFunc::A;
         state.rasterState.culling = CullingMode::NONE;
-        getDriverApi().draw(state, triangle.getRenderPrimitive());
+        getDriverApi().draw(state, triangle.getRenderPrimitive(), 1);
 
         getDriverApi().endRenderPass();
 
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BackendTest.h"
+
+#include "ShaderGenerator.h"
+#include "TrianglePrimitive.h"
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shaders
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string vertex (R"(#version 450 core
+
+layout(location = 0) in vec4 mesh_position;
+
+void main() {
+    gl_Position = vec4(mesh_position.xy, 0.0, 1.0);
+}
+)");
+
+std::string fragment (R"(#version 450 core
+
+layout(constant_id = 0) const bool RED = false;
+layout(constant_id = 1) const float GREEN = 1.0;
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    fragColor = RED ? vec4(1.0, 0.0, 0.0, 1.0) : vec4(0.0, GREEN, 0.0, 1.0);
+}
+
+)");
+
+}
+
+namespace test {
+
+using namespace filament;
+using namespace filament::backend;
+
+/**
+ * This test case checks that the specialization constants of a program are applied: the constant
+ * selecting red is set, so the triangle must be red instead of green.
+ */
+TEST_F(BackendTest, SpecializationConstants) {
+    static constexpr uint32_t size = 64;
+    {
+        auto swapChain = getDriverApi().createSwapChainHeadless(size, size, 0);
+        getDriverApi().makeCurrent(swapChain, swapChain);
+
+        ShaderGenerator shaderGen(vertex, fragment, sBackend, sIsMobilePlatform);
+        Program p = shaderGen.getProgram();
+        p.specializationConstants({ { 0, true }, { 1, 0.5f } });
+        auto program = getDriverApi().createProgram(std::move(p));
+
+        Handle<HwTexture> texture = getDriverApi().createTexture(SamplerType::SAMPLER_2D, 1,
+                TextureFormat::RGBA8, 1, size, size, 1,
+                TextureUsage::COLOR_ATTACHMENT | TextureUsage::SAMPLEABLE);
+        Handle<HwRenderTarget> renderTarget = getDriverApi().createRenderTarget(
+                TargetBufferFlags::COLOR, size, size, 1, TargetBufferInfo(texture, 0), {}, {});
+
+        TrianglePrimitive triangle(getDriverApi());
+
+        RenderPassParams params = {};
+        fullViewport(params);
+        params.flags.clear = TargetBufferFlags::COLOR;
+        params.clearColor = {0.f, 0.f, 1.f, 1.f};
+        params.flags.discardStart = TargetBufferFlags::ALL;
+        params.flags.discardEnd = TargetBufferFlags::NONE;
+        params.viewport.width = size;
+        params.viewport.height = size;
+
+        PipelineState state;
+        state.program = program;
+        state.rasterState.colorWrite = true;
+        state.rasterState.depthWrite = false;
+        state.rasterState.depthFunc = RasterState::DepthFunc::A;
+        state.rasterState.culling = CullingMode::NONE;
+
+        getDriverApi().makeCurrent(swapChain, swapChain);
+        getDriverApi().beginFrame(0, 0, nullptr, nullptr);
+
+        getDriverApi().beginRenderPass(renderTarget, params);
+        getDriverApi().draw(state, triangle.getRenderPrimitive(), 1);
+        getDriverApi().endRenderPass();
+
+        // Read a pixel in the lower left corner, which the triangle covers.
+        void* buffer = calloc(1, 4);
+        PixelBufferDescriptor descriptor(buffer, 4, PixelDataFormat::RGBA, PixelDataType::UBYTE,
+                [](void* buffer, size_t, void*) {
+                    const uint8_t* pixel = (const uint8_t*) buffer;
+                    EXPECT_EQ(255, pixel[0]);
+                    EXPECT_EQ(0, pixel[1]);
+                    EXPECT_EQ(0, pixel[2]);
+                    free(buffer);
+                });
+        getDriverApi().readPixels(renderTarget, 4, 4, 1, 1, std::move(descriptor));
+
+        getDriverApi().flush();
+        getDriverApi().commit(swapChain);
+        getDriverApi().endFrame(0);
+
+        getDriverApi().destroyProgram(program);
+        getDriverApi().destroySwapChain(swapChain);
+        getDriverApi().destroyRenderTarget(renderTarget);
+        getDriverApi().destroyTexture(texture);
+    }
+
+    // This ensures all driver commands have finished before exiting the test.
+    getDriverApi().finish();
+
+    executeCommands();
+
+    getDriver().purge();
+}
+
+} // namespace test
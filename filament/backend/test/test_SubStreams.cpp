@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BackendTest.h"
+
+#include "ShaderGenerator.h"
+#include "TrianglePrimitive.h"
+
+#include "private/backend/CommandStream.h"
+
+#include <optional>
+#include <thread>
+
+#include <stdlib.h>
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Shaders
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::string vertex (R"(#version 450 core
+
+layout(location = 0) in vec4 mesh_position;
+
+void main() {
+    gl_Position = vec4(mesh_position.xy, 0.0, 1.0);
+}
+)");
+
+std::string fragment (R"(#version 450 core
+
+layout(location = 0) out vec4 fragColor;
+
+void main() {
+    fragColor = vec4(1.0);
+}
+
+)");
+
+constexpr uint32_t kSize = 64;
+
+}
+
+namespace test {
+
+using namespace filament;
+using namespace filament::backend;
+
+// Draws three triangles: two from sub-streams recorded concurrently on their own threads, and one
+// from the parent stream after them. This exercises both the state a driver keeps per sub-stream,
+// and the state it restores for the commands that follow a group.
+TEST_F(BackendTest, SubStreamDraws) {
+    // The test is executed within this block scope to force destructors to run before
+    // executeCommands().
+    {
+        auto swapChain = getDriverApi().createSwapChainHeadless(kSize, kSize, 0);
+        getDriverApi().makeCurrent(swapChain, swapChain);
+
+        ShaderGenerator shaderGen(vertex, fragment, sBackend, sIsMobilePlatform);
+        Program p = shaderGen.getProgram();
+        auto program = getDriverApi().createProgram(std::move(p));
+
+        Handle<HwTexture> texture = getDriverApi().createTexture(SamplerType::SAMPLER_2D, 1,
+                TextureFormat::RGBA8, 1, kSize, kSize, 1,
+                TextureUsage::COLOR_ATTACHMENT | TextureUsage::SAMPLEABLE);
+
+        Handle<HwRenderTarget> renderTarget = getDriverApi().createRenderTarget(
+                TargetBufferFlags::COLOR, kSize, kSize, 1, TargetBufferInfo(texture, 0), {}, {});
+
+        // One triangle per quadrant, the bottom-right quadrant is left empty.
+        TrianglePrimitive bottomLeft(getDriverApi());
+        TrianglePrimitive topRight(getDriverApi());
+        TrianglePrimitive topLeft(getDriverApi());
+        const math::float2 v0[3] {{-1.0f, -1.0f}, {  0.0f, -1.0f }, { -1.0f,  0.0f }};
+        const math::float2 v1[3] {{ 1.0f,  1.0f}, {  0.0f,  1.0f }, {  1.0f,  0.0f }};
+        const math::float2 v2[3] {{-1.0f,  1.0f}, { -1.0f,  0.0f }, {  0.0f,  1.0f }};
+        bottomLeft.updateVertices(v0);
+        topRight.updateVertices(v1);
+        topLeft.updateVertices(v2);
+
+        RenderPassParams params = {};
+        params.viewport = { 0, 0, kSize, kSize };
+        params.flags.clear = TargetBufferFlags::COLOR;
+        params.clearColor = {0.f, 1.f, 0.f, 1.f};
+        params.flags.discardStart = TargetBufferFlags::ALL;
+        params.flags.discardEnd = TargetBufferFlags::NONE;
+
+        PipelineState state;
+        state.program = program;
+        state.rasterState.colorWrite = true;
+        state.rasterState.depthWrite = false;
+        state.rasterState.depthFunc = RasterState::DepthFunc::A;
+        state.rasterState.culling = CullingMode::NONE;
+
+        getDriverApi().beginFrame(0, 0, nullptr, nullptr);
+        getDriverApi().beginRenderPass(renderTarget, params);
+
+        {
+            const size_t size = CommandBase::align(sizeof(COMMAND_TYPE(draw)));
+            std::optional<CommandSubStream> subStreams[2];
+            CommandSubStreamGroup group(getDriverApi());
+            subStreams[0].emplace(group, size);
+            subStreams[1].emplace(group, size);
+
+            auto record = [&state](CommandSubStream& subStream, TrianglePrimitive const& t) {
+                subStream.getStream().draw(state, t.getRenderPrimitive(), 1);
+                subStream.finish();
+            };
+            std::thread t0(record, std::ref(*subStreams[0]), std::cref(bottomLeft));
+            std::thread t1(record, std::ref(*subStreams[1]), std::cref(topRight));
+            t0.join();
+            t1.join();
+        }
+
+        getDriverApi().draw(state, topLeft.getRenderPrimitive(), 1);
+        getDriverApi().endRenderPass();
+
+        const size_t size = kSize * kSize * 4;
+        PixelBufferDescriptor descriptor(calloc(1, size), size,
+                PixelDataFormat::RGBA, PixelDataType::UBYTE,
+                [](void* buffer, size_t, void*) {
+                    auto pixel = [buffer](uint32_t x, uint32_t y) {
+                        const uint8_t* p = (const uint8_t*) buffer + (y * kSize + x) * 4;
+                        return uint32_t(p[0]) | p[1] << 8 | p[2] << 16 | uint32_t(p[3]) << 24;
+                    };
+                    // white where a triangle was drawn, green elsewhere
+                    const uint32_t white = 0xFFFFFFFF;
+                    const uint32_t green = 0xFF00FF00;
+                    const uint32_t q = kSize / 8;
+                    EXPECT_EQ(white, pixel(q, q));
+                    EXPECT_EQ(white, pixel(kSize - q, kSize - q));
+                    EXPECT_EQ(white, pixel(q, kSize - q));
+                    EXPECT_EQ(green, pixel(kSize - q, q));
+                    free(buffer);
+                });
+        getDriverApi().readPixels(renderTarget, 0, 0, kSize, kSize, std::move(descriptor));
+
+        getDriverApi().flush();
+        getDriverApi().commit(swapChain);
+        getDriverApi().endFrame(0);
+
+        getDriverApi().destroyProgram(program);
+        getDriverApi().destroySwapChain(swapChain);
+        getDriverApi().destroyRenderTarget(renderTarget);
+        getDriverApi().destroyTexture(texture);
+    }
+
+    // This ensures all driver commands have finished before exiting the test.
+    getDriverApi().finish();
+
+    executeCommands();
+
+    getDriver().purge();
+}
+
+} // namespace test
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include "RenderPass.h"
+
+#include "details/Camera.h"
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/Scene.h"
+#include "details/VertexBuffer.h"
+#include "details/View.h"
+
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/Viewport.h>
+
+#include <utils/EntityManager.h>
+#include <utils/memalign.h>
+
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::math;
+using namespace utils;
+
+/*
+ * Times each stage of the preparation of a frame separately, on synthetic scenes rendered with
+ * the NOOP backend. The arguments of the benchmarks are the number of renderables, of material
+ * instances they are spread over, of point lights and of shadow cascades of the directional
+ * light (0 disables its shadows).
+ *
+ * Each benchmark runs the stages before the one it times once, outside of the timed loop, the
+ * same way Renderer::renderJob() does.
+ */
+class FrameFixture : public benchmark::Fixture {
+protected:
+    using Command = RenderPass::Command;
+
+    FEngine* engine = nullptr;
+    FScene* scene = nullptr;
+    FView* view = nullptr;
+    Entity cameraEntity;
+    Entity sun;
+    VertexBuffer* vertexBuffer = nullptr;
+    IndexBuffer* indexBuffer = nullptr;
+    std::vector<MaterialInstance*> materialInstances;
+    std::vector<Entity> renderables;
+    std::vector<Entity> lights;
+    Command* commands = nullptr;
+    size_t commandCount = 0;
+    size_t cascadeCount = 0;
+
+    static constexpr float3 QUAD_VERTICES[4] = {
+            { -1, -1, 0 }, { 1, -1, 0 }, { -1, 1, 0 }, { 1, 1, 0 } };
+    static constexpr uint16_t QUAD_INDICES[6] = { 0, 1, 2, 3, 2, 1 };
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        const size_t renderableCount = size_t(state.range(0));
+        const size_t materialCount = size_t(state.range(1));
+        const size_t lightCount = size_t(state.range(2));
+        cascadeCount = size_t(state.range(3));
+
+        // the recording benchmark records the draws of the whole scene between two flushes
+        Engine::Config config;
+        config.minCommandBufferSizeInMB = 32;
+        config.commandBufferSizeInMB = 96;
+        engine = FEngine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+
+        scene = engine->createScene();
+        view = engine->createView();
+        cameraEntity = EntityManager::get().create();
+        FCamera* const camera = engine->createCamera(cameraEntity);
+        camera->setProjection(60, 16.0 / 9.0, 0.1, 100, Camera::Fov::HORIZONTAL);
+        view->setViewport({ 0, 0, 1920, 1080 });
+        view->setScene(scene);
+        view->setCamera(camera);
+
+        vertexBuffer = VertexBuffer::Builder()
+                .vertexCount(4)
+                .bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(*engine);
+        vertexBuffer->setBufferAt(*engine, 0,
+                VertexBuffer::BufferDescriptor(QUAD_VERTICES, sizeof(QUAD_VERTICES), nullptr));
+        indexBuffer = IndexBuffer::Builder()
+                .indexCount(6)
+                .bufferType(IndexBuffer::IndexType::USHORT)
+                .build(*engine);
+        indexBuffer->setBuffer(*engine,
+                IndexBuffer::BufferDescriptor(QUAD_INDICES, sizeof(QUAD_INDICES), nullptr));
+
+        materialInstances.resize(materialCount);
+        for (MaterialInstance*& mi : materialInstances) {
+            mi = engine->getDefaultMaterial()->createInstance(nullptr);
+        }
+
+        // renderables and point lights scattered around the frustum, so that some are culled
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> xy(-60.0f, 60.0f);
+        std::uniform_real_distribution<float> z(-90.0f, 10.0f);
+        std::uniform_real_distribution<float> radius(1.0f, 8.0f);
+
+        FTransformManager& tcm = engine->getTransformManager();
+        renderables.resize(renderableCount);
+        EntityManager::get().create(renderableCount, renderables.data());
+        for (size_t i = 0; i < renderableCount; i++) {
+            RenderableManager::Builder(1)
+                    .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                    .material(0, materialInstances[i % materialCount])
+                    .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                            vertexBuffer, indexBuffer)
+                    .castShadows(true)
+                    .receiveShadows(true)
+                    .build(*engine, renderables[i]);
+            tcm.setTransform(tcm.getInstance(renderables[i]),
+                    mat4f::translation(float3{ xy(gen), xy(gen), z(gen) }));
+            scene->addEntity(renderables[i]);
+        }
+
+        lights.resize(lightCount);
+        EntityManager::get().create(lightCount, lights.data());
+        for (Entity e : lights) {
+            LightManager::Builder(LightManager::Type::POINT)
+                    .position({ xy(gen), xy(gen), z(gen) })
+                    .falloff(radius(gen))
+                    .build(*engine, e);
+            scene->addEntity(e);
+        }
+
+        LightManager::ShadowOptions shadowOptions;
+        shadowOptions.shadowCascades = uint8_t(std::max(cascadeCount, size_t(1)));
+        LightManager::ShadowCascades::computeUniformSplits(
+                shadowOptions.cascadeSplitPositions, shadowOptions.shadowCascades);
+        sun = EntityManager::get().create();
+        LightManager::Builder(LightManager::Type::SUN)
+                .direction({ 0.3f, -1.0f, -0.4f })
+                .castShadows(cascadeCount > 0)
+                .shadowOptions(shadowOptions)
+                .build(*engine, sun);
+        scene->addEntity(sun);
+
+        // room for the color pass (up to 3 commands per primitive) and the shadow passes (1 per
+        // primitive), and their sentinels
+        commandCount = renderableCount * (3 + cascadeCount) + 64;
+        commands = (Command*)utils::aligned_alloc(commandCount * sizeof(Command), CACHELINE_SIZE);
+    }
+
+    void TearDown(const benchmark::State&) override {
+        utils::aligned_free(commands);
+        commands = nullptr;
+        engine->destroy(sun);
+        EntityManager::get().destroy(sun);
+        for (Entity e : lights) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(lights.size(), lights.data());
+        lights.clear();
+        for (Entity e : renderables) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(renderables.size(), renderables.data());
+        renderables.clear();
+        for (MaterialInstance* mi : materialInstances) {
+            engine->destroy(upcast(mi));
+        }
+        materialInstances.clear();
+        engine->destroy(upcast(indexBuffer));
+        engine->destroy(upcast(vertexBuffer));
+        engine->destroyCameraComponent(cameraEntity);
+        EntityManager::get().destroy(cameraEntity);
+        engine->destroy(view);
+        engine->destroy(scene);
+        Engine::destroy((Engine**)&engine);
+    }
+
+    // runs everything renderJob() does before generating the commands
+    void prepareFrame(filament::ArenaScope& arena) {
+        engine->prepare();
+        view->prepare(*engine, engine->getDriverApi(), arena, view->getViewport(), {});
+        view->froxelize(*engine);
+    }
+
+    RenderPass createPass() {
+        RenderPass pass(*engine, GrowingSlice<Command>(commands, commandCount));
+        RenderPass::RenderFlags renderFlags = 0;
+        if (view->hasShadowing())          renderFlags |= RenderPass::HAS_SHADOWING;
+        if (view->hasDirectionalLight())   renderFlags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+        if (view->hasDynamicLighting())    renderFlags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+        pass.setRenderFlags(renderFlags);
+        pass.setCamera(view->getCameraInfo());
+        return pass;
+    }
+
+    // the commands of the shadow passes (from the viewing camera, for simplicity), followed by
+    // the commands of the color pass, which are left to be sorted
+    void generateCommands(RenderPass& pass) {
+        FScene::RenderableSoa const& soa = scene->getRenderableData();
+        if (view->hasShadowing()) {
+            pass.setGeometry(soa, view->getVisibleDirectionalShadowCasters(),
+                    scene->getRenderableUBO());
+            for (size_t i = 0; i < cascadeCount; i++) {
+                pass.newCommandBuffer();
+                pass.appendCommands(RenderPass::SHADOW);
+            }
+        }
+        pass.newCommandBuffer();
+        pass.setGeometry(soa, view->getVisibleRenderables(), scene->getRenderableUBO());
+        pass.appendCommands(RenderPass::COLOR);
+    }
+};
+
+BENCHMARK_DEFINE_F(FrameFixture, scenePrepare)(benchmark::State& state) {
+    JobSystem& js = engine->getJobSystem();
+    engine->prepare();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            scene->prepare(js, mat4f{});
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_DEFINE_F(FrameFixture, culling)(benchmark::State& state) {
+    JobSystem& js = engine->getJobSystem();
+    engine->prepare();
+    scene->prepare(js, mat4f{});
+    FCamera const& camera = view->getCameraUser();
+    const Frustum frustum = FCamera::getFrustum(camera.getCullingProjectionMatrix(),
+            FCamera::getViewMatrix(camera.getModelMatrix()));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            FView::cullRenderables(*engine, scene->getRenderableData(), frustum,
+                    VISIBLE_RENDERABLE_BIT, scene->getCullingBvh(), scene->getCullingBvhRows());
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+// everything FView::prepare() does: the above, light culling, shadow casters culling,
+// partitioning of the renderables and update of their uniforms
+BENCHMARK_DEFINE_F(FrameFixture, viewPrepare)(benchmark::State& state) {
+    LinearAllocatorArena arena("frame benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    engine->prepare();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            filament::ArenaScope scope(arena);
+            view->prepare(*engine, engine->getDriverApi(), scope, view->getViewport(), {});
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    engine->flushAndWait();
+}
+
+BENCHMARK_DEFINE_F(FrameFixture, froxelization)(benchmark::State& state) {
+    LinearAllocatorArena arena("frame benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::ArenaScope scope(arena);
+    prepareFrame(scope);
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            view->froxelize(*engine);
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * std::max(state.range(2), int64_t(1)));
+    }
+    engine->flushAndWait();
+}
+
+BENCHMARK_DEFINE_F(FrameFixture, commandGeneration)(benchmark::State& state) {
+    LinearAllocatorArena arena("frame benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::ArenaScope scope(arena);
+    prepareFrame(scope);
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            RenderPass pass(createPass());
+            generateCommands(pass);
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    engine->flushAndWait();
+}
+
+BENCHMARK_DEFINE_F(FrameFixture, commandSorting)(benchmark::State& state) {
+    LinearAllocatorArena arena("frame benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::ArenaScope scope(arena);
+    prepareFrame(scope);
+    size_t sortedCount = 0;
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            state.PauseTiming();
+            RenderPass pass(createPass());
+            generateCommands(pass);
+            state.ResumeTiming();
+            pass.sortCommands();
+            sortedCount = pass.getCommands().size();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    state.counters["commands"] = double(sortedCount);
+    engine->flushAndWait();
+}
+
+BENCHMARK_DEFINE_F(FrameFixture, recording)(benchmark::State& state) {
+    LinearAllocatorArena arena("frame benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    filament::ArenaScope scope(arena);
+    prepareFrame(scope);
+    RenderPass pass(createPass());
+    generateCommands(pass);
+    pass.sortCommands();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            pass.execute(engine->getDriverApi(), "color", {}, {});
+            // the driver executes the commands outside of the timing
+            state.PauseTiming();
+            engine->flush();
+            state.ResumeTiming();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    engine->flushAndWait();
+}
+
+// 1k, 10k and 100k renderables, with 1 or 64 material instances, 0 or 256 point lights and
+// 0 (no shadows) or 4 shadow cascades
+static void frameArguments(benchmark::internal::Benchmark* b) {
+    b->ArgNames({ "renderables", "materials", "lights", "cascades" });
+    for (int64_t renderables : { 1000, 10000, 100000 }) {
+        for (int64_t materials : { 1, 64 }) {
+            for (int64_t lights : { 0, 256 }) {
+                for (int64_t cascades : { 0, 4 }) {
+                    b->Args({ renderables, materials, lights, cascades });
+                }
+            }
+        }
+    }
+    b->Unit(benchmark::kMicrosecond);
+}
+
+BENCHMARK_REGISTER_F(FrameFixture, scenePrepare)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, culling)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, viewPrepare)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, froxelization)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, commandGeneration)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, commandSorting)->Apply(frameArguments);
+BENCHMARK_REGISTER_F(FrameFixture, recording)->Apply(frameArguments);
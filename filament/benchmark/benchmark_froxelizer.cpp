@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include "details/Engine.h"
+#include "details/Froxelizer.h"
+#include "details/Scene.h"
+
+#include <filament/LightManager.h>
+#include <filament/Viewport.h>
+
+#include <utils/EntityManager.h>
+
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::math;
+using namespace utils;
+
+class FroxelizerFixture : public benchmark::Fixture {
+protected:
+    FEngine* engine = nullptr;
+    std::vector<Entity> entities;
+    FScene::LightSoa lights;
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        engine = FEngine::create(Engine::Backend::NOOP);
+
+        // half point lights, half spot lights, scattered in front of the camera
+        const size_t count = size_t(state.range(0));
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> xy(-20.0f, 20.0f);
+        std::uniform_real_distribution<float> z(-60.0f, -2.0f);
+        std::uniform_real_distribution<float> radius(1.0f, 8.0f);
+
+        lights.clear();
+        lights.push_back({}, {}, {}, {}, {}, {});   // the directional light is skipped
+        entities.resize(count);
+        EntityManager::get().create(count, entities.data());
+        for (size_t i = 0; i < count; i++) {
+            const bool spot = i & 1u;
+            LightManager::Builder(spot ? LightManager::Type::SPOT : LightManager::Type::POINT)
+                    .spotLightCone(0.5f, 0.7f)
+                    .build(*engine, entities[i]);
+            LightManager::Instance instance = engine->getLightManager().getInstance(entities[i]);
+            lights.push_back(float4{ xy(gen), xy(gen), z(gen), radius(gen) },
+                    normalize(float3{ xy(gen), xy(gen), -20.0f }), instance, 1, {}, {});
+        }
+    }
+
+    void TearDown(const benchmark::State&) override {
+        for (Entity e : entities) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(entities.size(), entities.data());
+        entities.clear();
+        lights.clear();
+        Engine::destroy((Engine**)&engine);
+    }
+};
+
+BENCHMARK_DEFINE_F(FroxelizerFixture, froxelizeLights)(benchmark::State& state) {
+    LinearAllocatorArena arena("froxelizer benchmark", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+
+    const Viewport vp(0, 0, 1920, 1080);
+    const mat4f p = mat4f::perspective(60, 16.0f / 9.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    Froxelizer froxelizer(*engine);
+    froxelizer.setOptions(5, 100);
+    froxelizer.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            froxelizer.froxelizeLights(*engine, {}, lights);
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+
+    froxelizer.terminate(engine->getDriverApi());
+}
+
+BENCHMARK_REGISTER_F(FroxelizerFixture, froxelizeLights)->RangeMultiplier(2)->Range(16, 256);
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Material.h>
+#include <filament/RenderableManager.h>
+#include <filament/Renderer.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+#include <filament/Viewport.h>
+
+#include <utils/EntityManager.h>
+
+#include <math/mat4.h>
+
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace filament::math;
+using namespace utils;
+
+/*
+ * Renders frames of a scene of N renderables with the NOOP backend, which measures the CPU time
+ * of the renderer without a GPU. The commands the backend executed for the last frame are
+ * reported as counters, so that changes of the number of draws or pipeline changes show up
+ * along with the timings.
+ */
+class RendererFixture : public benchmark::Fixture {
+protected:
+    Engine* engine = nullptr;
+    SwapChain* swapChain = nullptr;
+    Renderer* renderer = nullptr;
+    Scene* scene = nullptr;
+    View* view = nullptr;
+    Camera* camera = nullptr;
+    Entity cameraEntity;
+    VertexBuffer* vertexBuffer = nullptr;
+    IndexBuffer* indexBuffer = nullptr;
+    std::vector<Entity> renderables;
+
+    static constexpr float3 QUAD_VERTICES[4] = {
+            { -1, -1, 0 }, { 1, -1, 0 }, { -1, 1, 0 }, { 1, 1, 0 } };
+    static constexpr uint16_t QUAD_INDICES[6] = { 0, 1, 2, 3, 2, 1 };
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        engine = Engine::create(Engine::Backend::NOOP);
+        swapChain = engine->createSwapChain(1920, 1080);
+        renderer = engine->createRenderer();
+        scene = engine->createScene();
+
+        cameraEntity = EntityManager::get().create();
+        camera = engine->createCamera(cameraEntity);
+        camera->setProjection(60, 16.0 / 9.0, 0.1, 100, Camera::Fov::HORIZONTAL);
+
+        view = engine->createView();
+        view->setViewport({ 0, 0, 1920, 1080 });
+        view->setScene(scene);
+        view->setCamera(camera);
+
+        vertexBuffer = VertexBuffer::Builder()
+                .vertexCount(4)
+                .bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(*engine);
+        vertexBuffer->setBufferAt(*engine, 0,
+                VertexBuffer::BufferDescriptor(QUAD_VERTICES, sizeof(QUAD_VERTICES), nullptr));
+        indexBuffer = IndexBuffer::Builder()
+                .indexCount(6)
+                .bufferType(IndexBuffer::IndexType::USHORT)
+                .build(*engine);
+        indexBuffer->setBuffer(*engine,
+                IndexBuffer::BufferDescriptor(QUAD_INDICES, sizeof(QUAD_INDICES), nullptr));
+
+        // quads scattered in front of the camera
+        const size_t count = size_t(state.range(0));
+        std::default_random_engine gen; // NOLINT
+        std::uniform_real_distribution<float> xy(-20.0f, 20.0f);
+        std::uniform_real_distribution<float> z(-60.0f, -2.0f);
+
+        TransformManager& tcm = engine->getTransformManager();
+        renderables.resize(count);
+        EntityManager::get().create(count, renderables.data());
+        for (Entity e : renderables) {
+            RenderableManager::Builder(1)
+                    .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                    .material(0, engine->getDefaultMaterial()->getDefaultInstance())
+                    .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                            vertexBuffer, indexBuffer)
+                    .build(*engine, e);
+            tcm.setTransform(tcm.getInstance(e),
+                    mat4f::translation(float3{ xy(gen), xy(gen), z(gen) }));
+            scene->addEntity(e);
+        }
+    }
+
+    void TearDown(const benchmark::State&) override {
+        for (Entity e : renderables) {
+            engine->destroy(e);
+        }
+        EntityManager::get().destroy(renderables.size(), renderables.data());
+        renderables.clear();
+        engine->destroy(indexBuffer);
+        engine->destroy(vertexBuffer);
+        engine->destroyCameraComponent(cameraEntity);
+        EntityManager::get().destroy(cameraEntity);
+        engine->destroy(view);
+        engine->destroy(scene);
+        engine->destroy(renderer);
+        engine->destroy(swapChain);
+        Engine::destroy(&engine);
+    }
+};
+
+BENCHMARK_DEFINE_F(RendererFixture, renderFrame)(benchmark::State& state) {
+    for (auto _ : state) {
+        if (renderer->beginFrame(swapChain)) {
+            renderer->render(view);
+            renderer->endFrame();
+        }
+    }
+
+    engine->flushAndWait();
+    backend::FrameStatistics stats;
+    if (engine->getBackendFrameStatistics(&stats)) {
+        state.counters.insert({
+                { "draws",          double(stats.drawCount) },
+                { "pipelines",      double(stats.pipelineChangeCount) },
+                { "programs",       double(stats.programChangeCount) },
+                { "renderPasses",   double(stats.renderPassCount) },
+                { "samplerGroups",  double(stats.samplerGroupUpdateCount) },
+                { "uboBytes",       double(stats.uniformBufferBytes) },
+        });
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+BENCHMARK_REGISTER_F(RendererFixture, renderFrame)->RangeMultiplier(4)->Range(16, 4096);
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include "RenderPass.h"
+
+#include <utils/JobSystem.h>
+#include <utils/RadixSort.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace filament;
+using namespace utils;
+
+using Command = RenderPass::Command;
+
+class SortFixture : public benchmark::Fixture {
+protected:
+    std::vector<Command> commands;
+    std::vector<Command> sorted;
+    std::vector<Command> scratch;
+
+public:
+    void SetUp(const benchmark::State& state) override {
+        const size_t count = size_t(state.range(0));
+        std::default_random_engine gen; // NOLINT
+        std::uniform_int_distribution<uint64_t> rand;
+
+        // the high bits of the key (pass, channel, blending) are mostly constant, like they
+        // would be in a real command buffer.
+        commands.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            commands[i].key = (uint64_t(RenderPass::Pass::COLOR) | (rand(gen) & 0xFFFFFFFFFFllu));
+        }
+        sorted.resize(count);
+        scratch.resize(count);
+    }
+
+    void TearDown(const benchmark::State&) override {
+        commands.clear();
+        sorted.clear();
+        scratch.clear();
+    }
+};
+
+BENCHMARK_DEFINE_F(SortFixture, stdSort)(benchmark::State& state) {
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            std::copy(commands.begin(), commands.end(), sorted.begin());
+            std::sort(sorted.begin(), sorted.end());
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+}
+
+BENCHMARK_DEFINE_F(SortFixture, radixSort)(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            std::copy(commands.begin(), commands.end(), sorted.begin());
+            jobs::radix_sort(js, sorted.data(), sorted.data() + sorted.size(), scratch.data(),
+                    [](Command const& c) { return c.key; });
+            benchmark::ClobberMemory();
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * state.range(0));
+    }
+    js.emancipate();
+}
+
+BENCHMARK_REGISTER_F(SortFixture, stdSort)->Range(1 << 10, 1 << 18);
+BENCHMARK_REGISTER_F(SortFixture, radixSort)->Range(1 << 10, 1 << 18);
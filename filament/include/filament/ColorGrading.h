@@ -28,6 +28,7 @@
 namespace filament {
 
 class Engine;
+class ColorGradingLutCache;
 class FColorGrading;
 
 /**
@@ -58,7 +59,7 @@ class FColorGrading;
  *
  * Creating a new ColorGrading object may be more expensive than other Filament objects as a
  * 3D LUT may need to be generated. The generation of a 3D LUT, if necessary, may happen on
- * the CPU.
+ * the CPU, or on the GPU with a compute program when the backend supports it (desktop OpenGL).
  *
  * Ordering
  * ========
@@ -93,6 +94,7 @@ class FColorGrading;
  */
 class UTILS_PUBLIC ColorGrading : public FilamentAPI {
     struct BuilderDetails;
+    friend class ColorGradingLutCache;
 public:
     enum class QualityLevel : uint8_t {
         LOW,
@@ -17,9 +17,11 @@
 #ifndef TNT_FILAMENT_ENGINE_H
 #define TNT_FILAMENT_ENGINE_H
 
+#include <backend/BufferDescriptor.h>
 #include <backend/Platform.h>
 
 #include <utils/compiler.h>
+#include <utils/CString.h>
 
 namespace utils {
 class Entity;
@@ -39,6 +41,7 @@ class MaterialInstance;
 class Renderer;
 class RenderTarget;
 class Scene;
+class ParticleSystem;
 class Skybox;
 class Stream;
 class SwapChain;
@@ -148,6 +151,162 @@ public:
     using Platform = backend::Platform;
     using Backend = backend::Backend;
 
+    /**
+     * Configuration of an Engine instance, given to Engine::create(). It can't be changed
+     * after the Engine is created. Values out of their supported range are clamped.
+     *
+     * Point and spot lights are assigned to "froxels", the cells of a grid that divides the
+     * view frustum in tiles and depth slices. A finer grid gives shorter per-froxel light lists,
+     * which lowers the shading cost, but increases the CPU cost of assigning the lights and
+     * the memory used.
+     */
+    struct Config {
+        /**
+         * Maximum number of froxels used by a View, between 1024 and 32768. The actual number
+         * depends on the aspect ratio of the viewport. The default is 8192.
+         */
+        uint32_t froxelCount = 8192;
+
+        /**
+         * Number of depth slices of the froxel grid, between 2 and 64. The default is 16.
+         */
+        uint32_t froxelSliceCount = 16;
+
+        /**
+         * Maximum number of point and spot lights visible at once in a View, between 1 and 256.
+         * When more lights are visible, the ones farthest from the camera are ignored.
+         * The default is 256, which is the maximum supported by materials.
+         */
+        uint32_t maxLightCount = 256;
+
+        /**
+         * Size in MiB above which the textures the renderer keeps for reuse, such as the render
+         * targets of previous frames, are destroyed, least recently used first. The default
+         * is 64.
+         */
+        uint32_t textureCacheSizeInMB = 64;
+
+        /**
+         * Maximum number of frames in flight, i.e. frames submitted to the GPU that are not done
+         * yet, between 1 and 4. Renderer::beginFrame() skips frames beyond that, the command
+         * buffer and the swap chains are sized to match. Lower values reduce the latency from
+         * input to display, higher values increase the throughput when the CPU or GPU time of
+         * frames varies. Swap chains of the OpenGL backend are sized by the window system.
+         * The default is 2.
+         *
+         * @see Renderer::FrameRateOptions::lowLatency
+         */
+        uint32_t maxFramesInFlight = 2;
+
+        /**
+         * Size in MiB of the command buffer space guaranteed to be available to a frame. When a
+         * frame records more commands than this, the main thread may have to wait for the
+         * driver to execute them. 0 uses the default set at build time, which is 1.
+         */
+        uint32_t minCommandBufferSizeInMB = 0;
+
+        /**
+         * Total size in MiB of the command buffer, at least twice minCommandBufferSizeInMB
+         * (three times is recommended, so the main thread can get a frame ahead of the driver).
+         * 0 uses maxFramesInFlight + 1 times minCommandBufferSizeInMB.
+         */
+        uint32_t commandBufferSizeInMB = 0;
+
+        /**
+         * When true, the command buffer grows at the end of the frame after the main thread had
+         * to wait for space in it. This stalls until all the pending commands are executed,
+         * so it's best to size the command buffer properly, see getCommandBufferStatistics().
+         */
+        bool growCommandBuffer = false;
+
+        /**
+         * Functions used by the backend to persist caches across runs of the application: the
+         * pipeline cache of the Vulkan backend, which avoids hitches when pipelines are first
+         * used, the program binaries of the OpenGL backend, which avoid compiling the shaders
+         * of materials again, and the pipeline binary archive of the Metal backend (macOS 11
+         * and iOS 14 and above). They're called on the driver thread, and they're ignored if
+         * the Platform already has its own, see Platform::setBlobFunc().
+         */
+        Platform::InsertBlobFunc insertBlob;
+        Platform::RetrieveBlobFunc retrieveBlob;
+
+        /**
+         * When the backend compiles programs in the background (OpenGL with
+         * KHR_parallel_shader_compile), objects whose surface material program isn't ready yet
+         * are not drawn, instead of stalling the frame until it is. Use Material::compile() to
+         * create the programs ahead of time and be notified when they are ready.
+         * The default is false.
+         */
+        bool nonBlockingShaderCompilation = false;
+
+        /**
+         * When not null, the commands executed by the backend during the first
+         * commandCaptureFrameCount frames, with the content of their buffers, are written to
+         * this file. The cmdreplay tool replays them against any backend, which allows to
+         * measure the performance of a backend or of a GPU driver without the rest of the
+         * engine. The path is only read by Engine::create().
+         */
+        const char* commandCapturePath = nullptr;
+
+        /**
+         * Number of frames written to commandCapturePath. The default is 60.
+         */
+        uint32_t commandCaptureFrameCount = 60;
+    };
+
+    /**
+     * Statistics of the command buffer, see getCommandBufferStatistics().
+     */
+    struct CommandBufferStatistics {
+        size_t size;            //!< total size in bytes of the command buffer
+        size_t minSize;         //!< size in bytes guaranteed to be available to a frame
+        size_t highWatermark;   //!< largest amount in bytes of the command buffer used at once
+        uint32_t growCount;     //!< number of times the command buffer was grown
+    };
+
+    /**
+     * Statistics of the cache of textures the renderer keeps for reuse, see
+     * getTextureCacheStatistics(). The counters start when the Engine is created.
+     */
+    struct TextureCacheStatistics {
+        uint64_t hits;          //!< textures that were taken from the cache
+        uint64_t misses;        //!< textures that were allocated because none was cached
+        uint64_t evictions;     //!< cached textures that were destroyed
+        size_t cachedBytes;     //!< estimated size in bytes of the cached textures
+        size_t cachedCount;     //!< number of cached textures
+        size_t inUseBytes;      //!< estimated size in bytes of the textures in use
+        size_t inUseCount;      //!< number of textures in use
+    };
+
+    /**
+     * GPU memory used by the Engine, see getMemoryStatistics(). The sizes by category are
+     * estimated from the objects the Engine created.
+     */
+    struct MemoryStatistics {
+        size_t textureBytes;        //!< Textures, only the resident levels of streaming ones
+        size_t renderTargetBytes;   //!< textures the renderer uses for its passes
+        size_t textureCacheBytes;   //!< textures the renderer keeps for reuse
+        size_t vertexBufferBytes;   //!< VertexBuffers
+        size_t indexBufferBytes;    //!< IndexBuffers
+        size_t uniformBufferBytes;  //!< uniforms of the views, scenes and material instances
+        size_t stagingBytes;        //!< memory the backend keeps for uploads, 0 if unknown
+        size_t backendBytes;        //!< GPU memory the backend allocated, 0 if unknown
+        /**
+         * backendBytes when the backend knows it (Vulkan and Metal), or the sum of the other
+         * sizes. This is what the budget set with setMemoryBudget() is compared to.
+         */
+        size_t totalBytes;
+    };
+
+    /**
+     * Called by Renderer::beginFrame() when the memory used exceeds the budget, see
+     * setMemoryBudget().
+     *
+     * @param user          The pointer given to setMemoryBudget().
+     * @param statistics    The memory used.
+     */
+    using MemoryBudgetCallback = void(void* user, MemoryStatistics const& statistics);
+
     /**
      * Creates an instance of Engine
      *
@@ -170,6 +329,10 @@ public:
      *                          when creating filament's internal context.
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkan for instance).
+     *                          Use getSharedContext() of another Engine to share its
+     *                          textures, see Texture::Builder::share().
+     *
+     *  @param config           Configuration of the Engine, or nullptr to use the defaults.
      *
      *
      * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
@@ -185,7 +348,8 @@ public:
      * This method is thread-safe.
      */
     static Engine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
 #if UTILS_HAS_THREADING
     /**
@@ -227,10 +391,15 @@ public:
      *                          when creating filament's internal context.
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkan for instance).
+     *                          Use getSharedContext() of another Engine to share its
+     *                          textures, see Texture::Builder::share().
+     *
+     *  @param config           Configuration of the Engine, or nullptr to use the defaults.
      */
     static void createAsync(CreateCallback callback, void* user,
             Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
     /**
      * Retrieve an Engine* from createAsync(). This must be called from the same thread than
@@ -408,6 +577,7 @@ public:
     bool destroy(const Renderer* p);            //!< Destroys a Renderer object.
     bool destroy(const Scene* p);               //!< Destroys a Scene object.
     bool destroy(const Skybox* p);              //!< Destroys a SkyBox object.
+    bool destroy(const ParticleSystem* p);      //!< Destroys a ParticleSystem object.
     bool destroy(const ColorGrading* p);        //!< Destroys a ColorGrading object.
     bool destroy(const SwapChain* p);           //!< Destroys a SwapChain object.
     bool destroy(const Stream* p);              //!< Destroys a Stream object.
@@ -442,6 +612,111 @@ public:
      */
     Backend getBackend() const noexcept;
 
+    /**
+     * Returns the context of this Engine's backend, to pass as the sharedGLContext of
+     * Engine::create() so that the new Engine can use this Engine's textures with
+     * Texture::Builder::share() instead of duplicating them.
+     *
+     * Only OpenGL contexts are shared, nullptr is returned with the other backends. With Metal,
+     * Engines created on the same device can share their textures without a shared context.
+     *
+     * @return A platform-dependant context, or nullptr.
+     */
+    void* getSharedContext() noexcept;
+
+    /**
+     * Returns the configuration this Engine was created with, with values clamped to their
+     * supported range.
+     */
+    const Config& getConfig() const noexcept;
+
+    /**
+     * Returns statistics of the cache of textures the renderer keeps for reuse.
+     */
+    TextureCacheStatistics getTextureCacheStatistics() const noexcept;
+
+    /**
+     * Returns statistics of the command buffer. A high watermark above minSize means some
+     * frames may have waited for the driver, Config::minCommandBufferSizeInMB should be raised.
+     */
+    CommandBufferStatistics getCommandBufferStatistics() const noexcept;
+
+    /**
+     * Returns the counts of the commands the backend executed for the last frame, such as the
+     * number of draws and render passes. Only the NOOP backend counts them, so that benchmarks
+     * and tests which run without a GPU can track the work of the renderer. Call flushAndWait()
+     * first to get the counts of the last frame rendered.
+     *
+     * @return false if the backend doesn't count the commands.
+     */
+    bool getBackendFrameStatistics(backend::FrameStatistics* statistics) const noexcept;
+
+    /**
+     * Returns the GPU memory used by this Engine, by category. This iterates over all the
+     * textures and buffers, so it's best called once per frame at most.
+     */
+    MemoryStatistics getMemoryStatistics() const noexcept;
+
+    /**
+     * Returns the shader variants of the materials requested since the debug property
+     * "d.material.record_variants" was set, see getDebugRegistry(). Each line holds one variant
+     * key in hexadecimal followed by a space and the name of the material, e.g. "0x05 Lit".
+     * The property must be set before the materials are first rendered, since the variants
+     * are recorded when their program is created.
+     *
+     * This profile can be given to matc with --variant-profile, so that packages only hold the
+     * variants the application actually uses.
+     */
+    utils::CString getVariantProfile() const noexcept;
+
+    /**
+     * Destroys cached textures that are not in use, least recently used first, until the cache
+     * holds at most maxSizeInBytes. This is typically called when the system is low on memory.
+     * The cache is refilled as needed by the following frames.
+     *
+     * @param maxSizeInBytes    Size to trim the cache to. The default of 0 empties it.
+     */
+    void trimTextureCache(size_t maxSizeInBytes = 0) noexcept;
+
+    /**
+     * Sets the budget of the streaming textures, see Texture::Builder::streaming(). When the
+     * levels the renderer needs exceed the budget, the most detailed levels of the textures not
+     * rendered in the last frame are requested no more first, then those of the largest
+     * textures. The least detailed level of each texture is always requested.
+     *
+     * @param budgetInBytes Estimated size in bytes of the resident levels of all the streaming
+     *                      textures. The default of 0 means no budget.
+     */
+    void setTextureStreamingBudget(size_t budgetInBytes) noexcept;
+
+    /**
+     * Returns the budget of the streaming textures set with setTextureStreamingBudget().
+     */
+    size_t getTextureStreamingBudget() const noexcept;
+
+    /**
+     * Returns the estimated size in bytes of the resident levels of all the streaming textures.
+     */
+    size_t getTextureStreamingResidentSize() const noexcept;
+
+    /**
+     * Sets the GPU memory budget of this Engine. In each frame where
+     * MemoryStatistics::totalBytes exceeds the budget, \p callback is called from
+     * Renderer::beginFrame(), so that the application can lower its detail, e.g. with
+     * setTextureStreamingBudget() or trimTextureCache().
+     *
+     * @param budgetInBytes GPU memory budget in bytes. The default of 0 means no budget.
+     * @param callback      Called when the budget is exceeded.
+     * @param user          A pointer given back to \p callback unmodified.
+     */
+    void setMemoryBudget(size_t budgetInBytes,
+            MemoryBudgetCallback* callback = nullptr, void* user = nullptr) noexcept;
+
+    /**
+     * Returns the GPU memory budget set with setMemoryBudget().
+     */
+    size_t getMemoryBudget() const noexcept;
+
     /**
      * Allocate a small amount of memory directly in the command stream. The allocated memory is
      * guaranteed to be preserved until the current command buffer is executed
@@ -455,6 +730,24 @@ public:
      */
     void* streamAlloc(size_t size, size_t alignment = alignof(double)) noexcept;
 
+    /**
+     * Allocates staging memory for the application to write the data of an upload directly,
+     * e.g. streaming geometry. The returned descriptor is passed to VertexBuffer::setBufferAt(),
+     * IndexBuffer::setBuffer() or, wrapped in a PixelBufferDescriptor, to Texture::setImage().
+     *
+     * On Vulkan and Metal, this memory is mapped from a backend staging buffer, so the upload
+     * reads it without any copy (on Metal, only for updates of whole buffers). Other backends
+     * return ordinary memory, which they upload from like any other descriptor.
+     *
+     * @param size  size to allocate in bytes.
+     * @return      a descriptor of the mapped memory. It can be used for one upload, and the
+     *              memory is reclaimed once the upload completes or if the descriptor is
+     *              destroyed without being used.
+     *
+     * @note This must be called from the thread that owns the Engine.
+     */
+    backend::BufferDescriptor allocateStaging(size_t size);
+
 
     /**
      * helper for creating an Entity and Camera component in one call
@@ -25,6 +25,8 @@
 
 #include <math/mathfwd.h>
 
+#include <stdint.h>
+
 namespace filament {
 
 class Engine;
@@ -291,6 +293,56 @@ public:
      */
     Texture const* getIrradianceTexture() const noexcept;
 
+    /**
+     * Options of prefilter().
+     */
+    struct PrefilterOptions {
+        /**
+         * Number of GGX samples per texel of the first rough level. Like cmgen, the count
+         * doubles for each level from the third one, up to 1024.
+         */
+        uint16_t sampleCount = 32;
+
+        /**
+         * Whether the irradiance spherical harmonics are also computed from the environment.
+         */
+        bool irradiance = true;
+    };
+
+    /**
+     * Returns whether prefilter() is supported by the engine's backend. This requires compute
+     * shaders, and is currently only available with the desktop OpenGL backend.
+     */
+    static bool isPrefilterSupported(Engine& engine) noexcept;
+
+    /**
+     * Regenerates the reflections of this IndirectLight, and optionally its irradiance, from an
+     * environment cubemap, on the GPU.
+     *
+     * This is meant for environments that change at runtime, such as a dynamic sky or a
+     * reflection probe captured by rendering into a cubemap; static environments are better
+     * prefiltered offline with cmgen.
+     *
+     * The work is done by the next Renderer::render() call, within that frame for the
+     * reflections. The irradiance is read back from the GPU and applied a few frames later.
+     *
+     * The levels of the reflections cubemap are filtered with the same roughness as cmgen's.
+     * It must have been created with Texture::Usage::STORAGE and Texture::Usage::SAMPLEABLE,
+     * in the R11F_G11F_B10F, RGBA16F or RGBA32F format.
+     * The mip levels of the environment, if it has any, must be populated (e.g. with
+     * Texture::generateMipmaps()), they're used to filter the samples of the rough levels.
+     * The environment must not be destroyed until the frame has been rendered.
+     *
+     * @param engine        Engine this IndirectLight belongs to.
+     * @param environment   Cubemap of the radiance of the environment, in linear space.
+     * @param options       Sample count and irradiance update.
+     *
+     * @return false, and nothing is done, if this IndirectLight has no reflections cubemap,
+     *         the textures aren't suitable or isPrefilterSupported() is false.
+     */
+    bool prefilter(Engine& engine, Texture const* environment,
+            PrefilterOptions const& options) noexcept;
+
     /**
      * Helper to estimate the direction of the dominant light in the environment represented by
      * spherical harmonics.
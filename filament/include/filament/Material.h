@@ -100,6 +100,18 @@ public:
          */
         Builder& package(const void* payload, size_t size);
 
+        /**
+         * Specifies the material data without copying it, e.g. a memory-mapped material file.
+         * The shaders are then read from the material data, and decoded, only when a variant
+         * that uses them is first needed, so the memory used by the material doesn't grow with
+         * the number of variants it contains.
+         *
+         * @param payload Pointer to the material data, must stay valid and unchanged until the
+         *                Material is destroyed.
+         * @param size Size of the material data pointed to by "payload" in bytes.
+         */
+        Builder& packageNoCopy(const void* payload, size_t size);
+
         /**
          * Creates the Material object and returns a pointer to it.
          *
@@ -128,6 +140,28 @@ public:
      */
     MaterialInstance* createInstance(const char* name = nullptr) const noexcept;
 
+    using CompileCallback = backend::CompileCallback;
+
+    /**
+     * Creates the programs of the variants of this material now, rather than when each variant
+     * is first needed, to avoid hitches when the material is first rendered, e.g. during a
+     * loading screen. With KHR_parallel_shader_compile, the OpenGL backend compiles them in the
+     * background, in parallel.
+     *
+     * @param variants Features of the variants to compile: the variants which use a feature
+     *                 that isn't in this mask are skipped, e.g. UserVariantFilterBit::SKINNING
+     *                 can be left out for materials of static objects. The depth variants used
+     *                 for shadow maps and the depth prepass are included. The variants that
+     *                 were filtered out when the material was built are always skipped.
+     * @param callback Optional function called on the application thread, the next time
+     *                 Filament flushes its commands after all the programs are ready.
+     * @param user     Data passed to the callback.
+     *
+     * @see Engine::Config::nonBlockingShaderCompilation
+     */
+    void compile(UserVariantFilterMask variants = UserVariantFilterMask(UserVariantFilterBit::ALL),
+            CompileCallback callback = nullptr, void* user = nullptr) noexcept;
+
     //! Returns the name of this material as a null-terminated string.
     const char* getName() const noexcept;
 
@@ -214,6 +248,21 @@ public:
     //! Indicates whether an existing parameter is a sampler or not.
     bool isSampler(const char* name) const noexcept;
 
+    /**
+     * Returns the byte offset of a non-sampler parameter in the std140 uniform block of this
+     * material, to lay out the data passed to MaterialInstance::setParameters().
+     *
+     * @param name The name of the material parameter
+     *
+     * @return The offset in bytes of the parameter, or -1 if it isn't a non-sampler parameter.
+     *
+     * @see getParameterBlockSize()
+     */
+    ssize_t getParameterOffset(const char* name) const noexcept;
+
+    //! Returns the size in bytes of the std140 uniform block holding the material parameters.
+    size_t getParameterBlockSize() const noexcept;
+
     /**
      * Sets the value of the given parameter on this material's default instance.
      *
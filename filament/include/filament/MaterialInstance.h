@@ -124,6 +124,23 @@ public:
      */
     void setParameter(const char* name, RgbaType type, math::float4 color) noexcept;
 
+    /**
+     * Sets many non-sampler parameters at once from a packed buffer.
+     *
+     * The data must be laid out like the std140 uniform block of the Material, starting at
+     * \p offset bytes in the block; the offset of each parameter is given by
+     * Material::getParameterOffset(). Only the bytes that differ from the current values are
+     * uploaded to the GPU. The block also contains parameters set by the engine, such as the
+     * mask threshold, which must keep their current values if they are in the updated range.
+     *
+     * @param data      Packed values of the parameters. Cannot be nullptr.
+     * @param size      Size in bytes of data.
+     * @param offset    Offset in bytes of data in the uniform block.
+     * @throws utils::PreConditionPanic if the range exceeds Material::getParameterBlockSize()
+     *         or no-op if exceptions are disabled.
+     */
+    void setParameters(void const* data, size_t size, size_t offset = 0) noexcept;
+
     /**
      * Set up a custom scissor rectangle; by default this encompasses the View.
      *
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_PARTICLESYSTEM_H
+#define TNT_FILAMENT_PARTICLESYSTEM_H
+
+#include <filament/Box.h>
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+class FParticleSystem;
+
+class Engine;
+class MaterialInstance;
+class Texture;
+
+/**
+ * ParticleSystem
+ *
+ * A particle system emits, simulates and draws its particles entirely on the GPU: the particles
+ * are updated by compute programs, sorted back to front, and drawn with an indirect draw call
+ * whose instance count is the number of live particles. Nothing is uploaded by the CPU each
+ * frame besides the emitter's parameters.
+ *
+ * The particles are drawn as instanced quads by a renderable owned by the particle system, see
+ * getEntity(), which must be added to a Scene. Its transform (see TransformManager) is the
+ * emitter's transform, the particles are simulated in its local space.
+ *
+ * The quads are drawn with a user material, which must declare a `sampler2d` parameter named
+ * `particles`, with a `highp` precision. The particle of an instance is read in the vertex shader
+ * with two texelFetch() at (2 * (i % 256), i / 256) and (2 * (i % 256) + 1, i / 256), where i is
+ * gl_InstanceID: the first texel is the local position (xyz) and age in seconds (w), the second
+ * the velocity (xyz) and the lifetime in seconds (w). The quad's vertices have a POSITION in
+ * [-0.5, 0.5] in the xy plane, and a UV0 in [0, 1]. A typical vertex shader places the quad
+ * facing the camera:
+ *
+ * ~~~~~~~~~~~{.glsl}
+ *  void materialVertex(inout MaterialVertexInputs material) {
+ *      ivec2 texel = ivec2((gl_InstanceID % 256) * 2, gl_InstanceID / 256);
+ *      vec4 positionAge = texelFetch(materialParams_particles, texel, 0);
+ *      vec3 center = (getWorldFromModelMatrix() * vec4(positionAge.xyz, 1.0)).xyz;
+ *      vec2 corner = getPosition().xy * materialParams.size;
+ *      material.worldPosition.xyz = center + mat3(getWorldFromViewMatrix()) * vec3(corner, 0.0);
+ *  }
+ * ~~~~~~~~~~~
+ *
+ * Particle systems require compute programs and indirect draws, build() returns nullptr when the
+ * backend doesn't support them.
+ *
+ * Creation and destruction
+ * ========================
+ *
+ * A ParticleSystem object is created using the ParticleSystem::Builder and destroyed by calling
+ * Engine::destroy(const ParticleSystem*).
+ *
+ * ~~~~~~~~~~~{.cpp}
+ *  filament::ParticleSystem* particles = filament::ParticleSystem::Builder()
+ *              .maxParticles(100000)
+ *              .emissionRate(20000.0f)
+ *              .lifetime(3.0f, 5.0f)
+ *              .material(materialInstance)
+ *              .build(*engine);
+ *
+ *  scene->addEntity(particles->getEntity());
+ *
+ *  // every frame, before rendering
+ *  particles->simulate(deltaTime, cameraPositionInEmitterSpace);
+ *
+ *  engine->destroy(particles);
+ * ~~~~~~~~~~~
+ *
+ * @see Scene, RenderableManager
+ */
+class UTILS_PUBLIC ParticleSystem : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Use Builder to construct a ParticleSystem object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * Maximum number of live particles. When more particles are emitted, the oldest ones are
+         * replaced. The default is 1024 particles.
+         *
+         * @param count Number of particles, between 1 and 1048576.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& maxParticles(size_t count) noexcept;
+
+        /**
+         * Number of particles emitted per second. The default is 0, see also
+         * ParticleSystem::emit().
+         *
+         * @param particlesPerSecond Emission rate.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& emissionRate(float particlesPerSecond) noexcept;
+
+        /**
+         * Box in which the particles are emitted, in the local space of the particle system.
+         * The default is the origin.
+         *
+         * @param center    Center of the box.
+         * @param halfExtent Half extent of the box.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& emitter(math::float3 const& center, math::float3 const& halfExtent) noexcept;
+
+        /**
+         * Initial velocity of the particles, chosen uniformly in [velocity - spread,
+         * velocity + spread] on each axis. The default is (0, 1, 0), without spread.
+         *
+         * @param velocity  Mean initial velocity, in units per second.
+         * @param spread    Maximum deviation from velocity on each axis.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& velocity(math::float3 const& velocity, math::float3 const& spread) noexcept;
+
+        /**
+         * Lifetime of the particles, chosen uniformly in [minimum, maximum]. The default is
+         * 1 second.
+         *
+         * @param minimum   Minimum lifetime in seconds.
+         * @param maximum   Maximum lifetime in seconds.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& lifetime(float minimum, float maximum) noexcept;
+
+        /**
+         * Constant acceleration applied to the particles. The default is no acceleration.
+         *
+         * @param acceleration Acceleration in units per second squared, e.g. (0, -9.8, 0).
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& gravity(math::float3 const& acceleration) noexcept;
+
+        /**
+         * Whether the particles are sorted back to front, which is needed by most blending
+         * modes but not by additive blending. The default is true.
+         *
+         * Sorting n particles takes log2(n) * (log2(n) + 1) / 2 compute dispatches.
+         *
+         * @param sorted True to sort the particles, false otherwise.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& sorted(bool sorted) noexcept;
+
+        /**
+         * Material used to draw the particles, see ParticleSystem. This is mandatory.
+         *
+         * @param materialInstance A material instance whose material has a `sampler2d`
+         *                         parameter named `particles`. The particle system sets it.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& material(MaterialInstance* materialInstance) noexcept;
+
+        /**
+         * Bounding box of the particles in the local space of the particle system, used for
+         * frustum culling. By default the particles are never culled.
+         *
+         * @param axisAlignedBoundingBox The box enclosing all the particles.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& boundingBox(Box const& axisAlignedBoundingBox) noexcept;
+
+        /**
+         * Creates the ParticleSystem object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this ParticleSystem with.
+         *
+         * @return pointer to the newly created object, or nullptr if the backend doesn't
+         *         support compute programs and indirect draws, or if exceptions are disabled
+         *         and an error occurred.
+         *
+         * @exception utils::PostConditionPanic if a runtime error occurred, such as running out of
+         *            memory or other resources.
+         * @exception utils::PreConditionPanic if a parameter to a builder function was invalid.
+         */
+        ParticleSystem* build(Engine& engine);
+
+    private:
+        friend class FParticleSystem;
+    };
+
+    /**
+     * Advances the simulation. This records the compute passes that emit, update and sort the
+     * particles, it must be called from the Engine's thread, outside of
+     * Renderer::beginFrame() / Renderer::endFrame() and typically once per frame.
+     *
+     * @param deltaTime     Time elapsed since the last call, in seconds.
+     * @param sortOrigin    Position the particles are sorted back to front from, typically the
+     *                      camera, in the local space of the particle system.
+     */
+    void simulate(float deltaTime, math::float3 const& sortOrigin = {}) noexcept;
+
+    /**
+     * Emits particles at the next call to simulate(), in addition to the emission rate.
+     *
+     * @param count Number of particles to emit.
+     */
+    void emit(size_t count) noexcept;
+
+    /**
+     * Changes the emission rate.
+     *
+     * @param particlesPerSecond Number of particles emitted per second.
+     */
+    void setEmissionRate(float particlesPerSecond) noexcept;
+
+    /**
+     * Changes the box in which the particles are emitted.
+     *
+     * @param center    Center of the box, in the local space of the particle system.
+     * @param halfExtent Half extent of the box.
+     */
+    void setEmitter(math::float3 const& center, math::float3 const& halfExtent) noexcept;
+
+    /**
+     * Returns the entity of the renderable that draws the particles, which must be added to a
+     * Scene. It is destroyed with the particle system.
+     */
+    utils::Entity getEntity() const noexcept;
+
+    //! Returns the maximum number of live particles.
+    size_t getMaxParticles() const noexcept;
+
+    //! Returns the texture holding the particles, see ParticleSystem.
+    Texture const* getTexture() const noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PARTICLESYSTEM_H
@@ -108,6 +108,29 @@ public:
         float reserved = 0;
     };
 
+    /**
+     * Bounds of a cluster of triangles of a primitive, typically a meshlet of 64 vertices and
+     * about 128 triangles as built by meshoptimizer.
+     *
+     * Each frame, the clusters of the visible primitives are tested against the view frustum,
+     * the depth buffer of a previous frame when occlusion culling is enabled, and their normal
+     * cone when back faces are culled. Only the clusters that pass are drawn, with indirect
+     * draws. Clusters are ignored when the backend doesn't support indirect draws, in shadow
+     * maps, and for renderables with skinning, morphing or several instances.
+     *
+     * The bounds are given in object space, like the bounding box of the renderable.
+     *
+     * \see Builder::clusters(), setClustersAt()
+     */
+    struct Cluster {
+        math::float3 center;        //!< center of the bounding sphere
+        float radius = 0;           //!< radius of the bounding sphere
+        math::float3 coneAxis;      //!< average direction of the triangles' normals
+        float coneCutoff = 1;       //!< cosine of half the normal cone's angle, 1 to never cull
+        uint32_t offset = 0;        //!< first index of the cluster in the index buffer
+        uint32_t count = 0;         //!< number of indices of the cluster, a multiple of 3
+    };
+
     /**
      * Adds renderable components to entities using a builder pattern.
      */
@@ -267,6 +290,21 @@ public:
          */
         Builder& morphing(bool enable) noexcept;
 
+        /**
+         * Declares that the POSITION attribute of all the primitives holds quantized positions,
+         * typically normalized SHORT4 values, which map back to object space with:
+         * position = offset + scale * attribute. Positions are not quantized by default.
+         *
+         * The mapping is folded into the world transform given to the vertex shader, while the
+         * bounding box and the transform of the entity stay in object space. The scale is
+         * uniform so that normals and tangents are not affected. Quantized positions can't be
+         * combined with skinning or morphing, which work with object space positions.
+         *
+         * @param offset object space position of the attribute value 0
+         * @param scale object space size of the attribute value 1, or 0 to disable quantization
+         */
+        Builder& quantizedPositions(math::float3 offset, float scale) noexcept;
+
         /**
          * Sets an ordering index for blended primitives that all live at the same Z value.
          *
@@ -275,6 +313,72 @@ public:
          */
         Builder& blendOrder(size_t primitiveIndex, uint16_t order) noexcept;
 
+        /**
+         * Specifies the raw instance count of the draw calls of this renderable. The default is
+         * 1 instance and the maximum number of instances allowed is 65535.
+         *
+         * This only sets the instance count: filament doesn't provide any per-instance data.
+         * All the instances are drawn with a single instanced draw call and share everything
+         * of the renderable (world transform, material instances, etc...), so without a custom
+         * vertex shader they are all drawn at the same place. The vertex shader of the material
+         * is responsible for placing each instance, using the instance index, which goes from 0
+         * to instanceCount - 1 on all backends, to fetch per-instance data from a material
+         * parameter.
+         *
+         * The renderable is culled as a whole, so its bounding box must encompass all the
+         * instances.
+         *
+         * @param instanceCount the number of instances, between 1 and 65535.
+         */
+        Builder& instances(size_t instanceCount) noexcept;
+
+        /**
+         * Groups primitives into a level of detail. By default, all the primitives belong to a
+         * single level of detail, which is always drawn.
+         *
+         * Levels are made of consecutive primitives: level 0 uses the first primitiveCount
+         * primitives of the builder, level 1 the following ones and so on. Levels must be
+         * specified without gaps, up to 8 levels, and must cover all the primitives.
+         *
+         * Each frame, the screen coverage of the renderable is computed as the height of its
+         * projected bounding sphere divided by the viewport's height, and the first level whose
+         * screenCoverage is less than or equal to it is drawn. If the renderable covers less
+         * than the last level's screenCoverage, it is not drawn at all; use 0 for the last level
+         * to always draw it.
+         *
+         * @param level             index of the level of detail, 0 being the most detailed.
+         * @param primitiveCount    number of primitives in this level.
+         * @param screenCoverage    minimum screen coverage of this level, between 0 and 1.
+         *                          It must decrease with each level.
+         */
+        Builder& levelOfDetail(uint8_t level, size_t primitiveCount,
+                float screenCoverage) noexcept;
+
+        /**
+         * Sets the hysteresis applied when switching between levels of detail.
+         * A renderable only switches to another level once its screen coverage is past the
+         * level's threshold by more than the given ratio, which avoids flickering between two
+         * levels when the coverage stays close to a threshold. The default is 0 (disabled).
+         *
+         * @param ratio hysteresis ratio, typically 0.1 (10%).
+         *
+         * @see levelOfDetail()
+         */
+        Builder& levelOfDetailHysteresis(float ratio) noexcept;
+
+        /**
+         * Splits a primitive into clusters of triangles that are culled individually.
+         * The clusters must cover the index range of the primitive, which must be made of
+         * triangles. The clusters are copied when build() is called.
+         *
+         * @param index     zero-based index of the primitive
+         * @param clusters  the clusters, sorted by offset
+         * @param count     number of clusters, 0 to draw the primitive as a whole (the default)
+         *
+         * \see Cluster
+         */
+        Builder& clusters(size_t index, Cluster const* clusters, size_t count) noexcept;
+
         /**
          * Adds the Renderable component to an entity.
          *
@@ -309,6 +413,8 @@ public:
             MaterialInstance const* materialInstance = nullptr;
             PrimitiveType type = PrimitiveType::TRIANGLES;
             uint16_t blendOrder = 0;
+            Cluster const* clusters = nullptr;
+            size_t clusterCount = 0;
         };
     };
 
@@ -418,7 +524,8 @@ public:
     uint8_t getLayerMask(Instance instance) const noexcept;
 
     /**
-     * Gets the immutable number of primitives in the given renderable.
+     * Gets the immutable number of primitives in the given renderable, across all its levels of
+     * detail. Primitives are indexed in the order they were given to the Builder.
      */
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
@@ -452,6 +559,15 @@ public:
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
 
+    /**
+     * Changes the clusters of the given primitive, which are otherwise discarded when its
+     * geometry is changed.
+     *
+     * \see Builder::clusters()
+     */
+    void setClustersAt(Instance instance, size_t primitiveIndex,
+            Cluster const* clusters, size_t count) noexcept;
+
     /**
      * Changes the ordering index for blended primitives that all live at the same Z value.
      *
@@ -463,6 +579,20 @@ public:
      */
     void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept;
 
+    /**
+     * Sets the density of the texture coordinates of the given primitive, which is used to
+     * choose the levels needed of the streaming textures it samples. By default the texture
+     * coordinates are assumed to span [0, 1] across the bounding sphere of the renderable.
+     *
+     * \see Texture::Builder::streaming()
+     *
+     * @param instance the renderable of interest
+     * @param primitiveIndex the primitive of interest
+     * @param density UV units per world space unit, e.g. 0.5 if a texture repeats every 2 world
+     *                space units. 0 restores the default.
+     */
+    void setUvDensityAt(Instance instance, size_t primitiveIndex, float density) noexcept;
+
     /**
      * Retrieves the set of enabled attribute slots in the given primitive's VertexBuffer.
      */
@@ -98,21 +98,43 @@ public:
      * headRoomRatio: additional headroom for the GPU as a ratio of the targetFrameTime.
      *                Useful for taking into account constant costs like post-processing or
      *                GPU drivers on different platforms.
+     * postProcessingRatio: ratio of the targetFrameTime (minus the headroom) budgeted for
+     *                post-processing, the rest is budgeted for the main passes. Each budget is
+     *                then enforced separately. 0 uses a single budget for the whole frame.
      * history:   History size. higher values, tend to filter more (clamped to 30)
      * scaleRate: rate at which the gpu load is adjusted to reach the target frame rate
      *            This value can be computed as 1 / N, where N is the number of frames
      *            needed to reach 64% of the target scale factor.
      *            Higher values make the dynamic resolution react faster.
      *
+     * lowLatency: when true, beginFrame() waits for the GPU to finish the previous frames, so that
+     *             a new frame never queues behind them. This minimizes the latency from input to
+     *             display at the expense of throughput, since the CPU and GPU don't overlap.
+     *             See also Engine::Config::maxFramesInFlight.
+     *
+     * framePacing: when true, frames are paced on the display's vsync: beginFrame() only starts
+     *              a frame every `interval` refresh periods, raising the interval (e.g. from
+     *              120 to 60 or 40 fps) while the GPU can't keep up and lowering it back when it
+     *              can, and each frame is given a presentation time one interval after the
+     *              previous one (OpenGL on Android only). beginFrame() should be called on every
+     *              vsync, and returns false on the vsyncs that don't start a frame. On Android
+     *              (API 29 and above), the vsync and refresh rate are obtained from
+     *              AChoreographer when the thread calling setFrameRateOptions() and beginFrame()
+     *              has a looper, otherwise from beginFrame()'s vsyncSteadyClockTimeNano and
+     *              DisplayInfo.
+     *
      * @see View::DynamicResolutionOptions
      * @see Renderer::DisplayInfo
      *
      */
     struct FrameRateOptions {
         float headRoomRatio = 0.0f;    //!< additional headroom for the GPU
+        float postProcessingRatio = 0.0f; //!< budget of post-processing, between 0 and 0.9
         float scaleRate = 0.125f;      //!< rate at which the system reacts to load changes
         uint8_t history = 3;           //!< history size
         uint8_t interval = 1;          //!< desired frame interval in unit of 1.0 / DisplayInfo::refreshRate
+        bool lowLatency = false;       //!< wait for the GPU before starting a frame
+        bool framePacing = false;      //!< pace the frames on the display's vsync
     };
 
     /**
@@ -134,6 +156,97 @@ public:
         bool discard = true;
     };
 
+    /**
+     * Timings of a frame, as returned by getFrameTimings(). All times are in seconds.
+     *
+     * GPU timings are only known a few frames after a frame is submitted, so these are the timings
+     * of the most recent frame whose GPU results are available, identified by frameId.
+     */
+    struct FrameTimings {
+        struct Pass {
+            const char* name;   //!< name of the pass
+            float gpuTime;      //!< GPU time of the pass
+        };
+        /**
+         * Hardware performance counters of a phase of the frame, accumulated over all the views.
+         * Only the thread running the phase is counted, the JobSystem jobs it spawns are not.
+         */
+        struct PhaseCounters {
+            const char* name;       //!< name of the phase
+            uint64_t cpuCycles;     //!< CPU cycles
+            uint64_t instructions;  //!< instructions retired
+            uint64_t branchMisses;  //!< mispredicted branches
+            uint64_t l1dMisses;     //!< level 1 data cache read misses
+            uint64_t llcMisses;     //!< last level cache misses
+        };
+        uint32_t frameId = 0;               //!< frame these timings are for
+        float gpuTime = 0.0f;               //!< GPU time of the whole frame
+        float cullingTime = 0.0f;           //!< CPU time preparing and culling the views
+        float commandGenerationTime = 0.0f; //!< CPU time generating the draw commands
+        float commandSortingTime = 0.0f;    //!< CPU time sorting the draw commands
+        /**
+         * GPU time of each FrameGraph pass, in execution order, only when enabled with
+         * setPassTimingsEnabled(). Valid until the next call to beginFrame().
+         */
+        Pass const* passes = nullptr;
+        size_t passCount = 0;               //!< number of entries in passes
+        /**
+         * Passes that weren't timed because the frame ran out of timer queries. Their GPU time is
+         * only counted in gpuTime.
+         */
+        uint32_t untimedPassCount = 0;
+        /**
+         * Performance counters of each phase of the frame preparation: scene prepare, culling,
+         * froxelization, command generation, command sorting and command recording. Only when
+         * enabled with setPerformanceCountersEnabled(). Valid until the next call to beginFrame().
+         */
+        PhaseCounters const* phases = nullptr;
+        size_t phaseCount = 0;              //!< number of entries in phases
+    };
+
+    /**
+     * Counts of the work done to render the last frame, as returned by getFrameStatistics().
+     * These are always gathered, their cost is negligible.
+     */
+    struct FrameStatistics {
+        /**
+         * Commands recorded by the passes of a view with the same name, e.g. the shadow passes.
+         */
+        struct Pass {
+            const char* name;                           //!< name of the pass
+            uint32_t commandCount = 0;                  //!< commands recorded
+            uint32_t drawCount = 0;                     //!< draw calls
+            uint32_t programChangeCount = 0;            //!< changes of program
+            uint32_t pipelineChangeCount = 0;           //!< changes of program or raster state
+            uint32_t materialInstanceChangeCount = 0;   //!< changes of material instance
+        };
+        struct View {
+            const char* name = nullptr;                 //!< name of the view, may be null
+            uint32_t renderableCount = 0;               //!< renderables in the scene
+            uint32_t visibleRenderableCount = 0;        //!< renderables visible from the camera
+            uint32_t layerCulledCount = 0;              //!< renderables not in a visible layer
+            uint32_t frustumCulledCount = 0;            //!< renderables outside of the frustum
+            uint32_t occlusionCulledCount = 0;          //!< renderables culled by occlusion
+            uint32_t commandCount = 0;                  //!< commands generated for the color pass
+            uint32_t uniformBufferBytes = 0;            //!< bytes uploaded to uniform buffers
+            uint32_t executedPassCount = 0;             //!< FrameGraph passes executed
+            uint32_t culledPassCount = 0;               //!< FrameGraph passes culled
+            uint32_t maxFroxelLightCount = 0;           //!< lights in the fullest froxel
+            float averageFroxelLightCount = 0.0f;       //!< average lights per froxel
+            float emptyFroxelRatio = 1.0f;              //!< ratio of froxels without lights
+            Pass const* passes = nullptr;               //!< passes recording draw commands
+            size_t passCount = 0;                       //!< number of entries in passes
+        };
+        uint32_t frameId = 0;               //!< frame these statistics are for
+        /**
+         * Bytes uploaded to uniform buffers during the frame, including the material instances
+         * committed by beginFrame(), which are not attributed to a view.
+         */
+        uint32_t uniformBufferBytes = 0;
+        View const* views = nullptr;        //!< views rendered, valid until the next endFrame()
+        size_t viewCount = 0;               //!< number of entries in views
+    };
+
     /**
      * Information about the display this Renderer is associated to. This information is needed
      * to accurately compute dynamic-resolution scaling and for frame-pacing.
@@ -151,6 +264,44 @@ public:
      */
     void setClearOptions(const ClearOptions& options);
 
+    /**
+     * Enables or disables timing the GPU work of each FrameGraph pass. Each pass is then wrapped
+     * in a timer query, which has a small cost. Disabled by default.
+     *
+     * @see getFrameTimings()
+     */
+    void setPassTimingsEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns the GPU and CPU timings of the most recent frame whose GPU timings are available,
+     * typically a few frames ago. Nothing stalls waiting for the GPU.
+     *
+     * @see setPassTimingsEnabled()
+     */
+    FrameTimings getFrameTimings() const noexcept;
+
+    /**
+     * Enables or disables sampling hardware performance counters (cycles, instructions, branch
+     * and cache misses) around the main phases of each frame, which are then reported by
+     * getFrameTimings(). Disabled by default.
+     *
+     * This is only supported on Linux and Android, where the counters may have to be made
+     * accessible first (e.g. with /proc/sys/kernel/perf_event_paranoid). When not supported,
+     * the counters are all zero.
+     *
+     * @see getFrameTimings()
+     */
+    void setPerformanceCountersEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns the counts of the work done by the CPU to render the last frame: culling results,
+     * commands and draw calls, state changes, uniform uploads and FrameGraph passes, per view
+     * and per pass.
+     *
+     * @see getFrameTimings()
+     */
+    FrameStatistics getFrameStatistics() const noexcept;
+
     /**
      * Get the Engine that created this Renderer.
      *
@@ -223,6 +374,66 @@ public:
      */
     void render(View const* view);
 
+    /**
+     * Renders a batch of views into their RenderTarget, in a frame of their own and without a
+     * SwapChain. This is meant for offline rendering of many small views, e.g. thumbnails: the
+     * batch shares a single frame's setup and FrameGraph resources of the same size are reused
+     * from one view to the next. Views can render into different viewports of the same
+     * RenderTarget to fill an atlas.
+     *
+     * The results can be read back with readPixels(RenderTarget*, ...) right after this call,
+     * the read-backs complete asynchronously.
+     *
+     * @param views An array of pointers to the views to render. Each view must have a
+     *              RenderTarget, see View::setRenderTarget().
+     * @param count The number of views in the array.
+     *
+     * @attention
+     * renderStandaloneViews() must be called *outside* of beginFrame() / endFrame().
+     *
+     * @note
+     * renderStandaloneViews() must be called from the Engine's main thread (or external
+     * synchronization must be provided).
+     *
+     * @see
+     * render(), readPixels(), RenderTarget
+     */
+    void renderStandaloneViews(View const* const* views, size_t count);
+
+    /**
+     * A View and the SwapChain it is rendered into, see render(ViewOutput const*, size_t).
+     */
+    struct ViewOutput {
+        View const* view;       //!< the view to render
+        SwapChain* swapChain;   //!< the swap chain the view is rendered into
+    };
+
+    /**
+     * Renders views into several SwapChains in the current frame, e.g. one window per monitor.
+     * The work of the frame is shared: frame pacing and engine preparation happen once in
+     * beginFrame(), the scenes of several views are prepared once, and endFrame() finishes the
+     * frame with a single flush.
+     *
+     * The views are grouped by SwapChain, in the order the SwapChains first appear in the array.
+     * When the views of a SwapChain are rendered, the SwapChain rendered before it is committed.
+     * The last one becomes the current SwapChain, committed by endFrame(). Committed SwapChains
+     * are presented right away, except on Vulkan where they are presented all at once at
+     * endFrame().
+     *
+     * @param outputs An array of views and the SwapChains they are rendered into. The SwapChain
+     *                passed to beginFrame() is typically the first one, otherwise it's committed
+     *                with what was rendered into it so far.
+     * @param count   The number of elements in the array.
+     *
+     * @attention
+     * render() must be called *after* beginFrame() and *before* endFrame(). A SwapChain that was
+     * committed must not be rendered into again in the same frame.
+     *
+     * @see
+     * render(View const*), beginFrame(), endFrame()
+     */
+    void render(ViewOutput const* outputs, size_t count);
+
     /**
      * Flags used to configure the behavior of copyFrame().
      *
@@ -325,7 +536,10 @@ public:
      * It is also possible to use a Fence to wait for the read-back.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * readPixels() doesn't wait for the GPU: the pixels are copied to a staging buffer that the
+     * backend recycles, and to `buffer` once the GPU is done, so several read-backs can be in
+     * flight, e.g. to read back every frame. It still costs a copy of the pixels, on the GPU and
+     * on the backend's thread, and it's best to keep using the same size and format.
      *
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -385,7 +599,10 @@ public:
      * It is also possible to use a Fence to wait for the read-back.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * readPixels() doesn't wait for the GPU: the pixels are copied to a staging buffer that the
+     * backend recycles, and to `buffer` once the GPU is done, so several read-backs can be in
+     * flight, e.g. to read back every frame. It still costs a copy of the pixels, on the GPU and
+     * on the backend's thread, and it's best to keep using the same size and format.
      *
      */
     void readPixels(RenderTarget* renderTarget,
@@ -457,6 +674,28 @@ public:
      */
     void endFrame();
 
+    /**
+     * Sets the presentation time of the current frame, i.e. when it should be displayed.
+     *
+     * When the SwapChain is a video encoder's input surface (e.g. from
+     * MediaCodec.createInputSurface() on Android), this is also the timestamp of the encoded
+     * frame, so frames go from the GPU to the encoder without being read back.
+     *
+     * This overrides the presentation time picked by FrameRateOptions::framePacing. It's
+     * supported by the OpenGL backend (EGL_ANDROID_presentation_time) and the Vulkan backend
+     * (VK_GOOGLE_display_timing), and ignored otherwise.
+     *
+     * @param monotonic_clock_ns The presentation time in nanoseconds, in the CLOCK_MONOTONIC
+     *                           time base, i.e. System.nanoTime() on Android.
+     *
+     * @note
+     * setPresentationTime() must be called *after* beginFrame() and *before* endFrame().
+     *
+     * @see
+     * beginFrame(), endFrame()
+     */
+    void setPresentationTime(int64_t monotonic_clock_ns);
+
     /**
      * Returns the time in second of the last call to beginFrame(). This value is constant for all
      * views rendered during a frame. The epoch is set with resetUserTime().
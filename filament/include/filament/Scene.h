@@ -156,6 +156,34 @@ public:
      * @return Whether the given entity is in the Scene.
      */
     bool hasEntity(utils::Entity entity) const noexcept;
+
+    /**
+     * Enables or disables hierarchical culling of the Scene's renderables and lights.
+     *
+     * When enabled, a bounding volume hierarchy of the renderables is maintained, which allows
+     * to reject or accept whole groups of renderables at once when culling them against the
+     * camera and the shadow maps. This benefits large scenes made of mostly static renderables
+     * (tens of thousands or more). The hierarchy is rebuilt whenever entities are added to or
+     * removed from the Scene, and refitted when renderables move.
+     *
+     * A separate hierarchy of the point and spot lights is maintained the same way, so that only
+     * the lights near the camera's frustum are considered each frame, which benefits scenes with
+     * thousands of lights.
+     *
+     * Hierarchical culling is disabled by default.
+     *
+     * @param enabled true to enable hierarchical culling, false to disable it.
+     */
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether hierarchical culling is enabled.
+     *
+     * @return true if hierarchical culling is enabled.
+     *
+     * @see setHierarchicalCullingEnabled()
+     */
+    bool isHierarchicalCullingEnabled() const noexcept;
 };
 
 } // namespace filament
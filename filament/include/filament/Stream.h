@@ -125,6 +125,9 @@ public:
      *
      * This method should be called on the same thread that calls Renderer::beginFrame, which is
      * also where the callback is invoked.
+     *
+     * The image types are those of Texture::setExternalImage(). With the Vulkan backend, the
+     * image is sampled without copy and the callback is invoked once the GPU is done with it.
      */
     void setAcquiredImage(void* image, Callback callback, void* userdata) noexcept;
 
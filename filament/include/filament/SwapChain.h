@@ -82,6 +82,13 @@ namespace filament {
  *  }
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  *
+ * \note
+ * To record a video, the input `Surface` of a video encoder, from
+ * `MediaCodec.createInputSurface()`, can be used as a SwapChain the same way. The frames then go
+ * from the GPU to the encoder without any copy, and their timestamps are set with
+ * Renderer::setPresentationTime(). With the OpenGL backend, the EGL config is recordable when the
+ * device supports it.
+ *
  * Linux
  * -----
  *
@@ -185,6 +185,27 @@ public:
          */
         Builder& swizzle(Swizzle r, Swizzle g, Swizzle b, Swizzle a) noexcept;
 
+        /**
+         * Makes the texture a streaming texture, whose levels are uploaded on demand.
+         *
+         * All the levels are declared, but only the levels the renderer needs have to be
+         * resident. After each frame, getRequestedLevel() returns the most detailed level needed
+         * to render the renderables sampling the texture at their current size on screen, within
+         * the budget set with Engine::setTextureStreamingBudget(). The application uploads the
+         * missing levels with setImage(), from the least to the most detailed one, and each level
+         * as a whole. Levels that are no longer requested are evicted by the renderer, i.e. they
+         * are no longer sampled and have to be uploaded again if requested later.
+         *
+         * Until its least detailed level is uploaded, a streaming texture is not resident and
+         * must not be rendered.
+         *
+         * @param enabled Whether the texture is streamed (default: false).
+         * @return This Builder, for chaining calls.
+         * @attention The texture must use Sampler::SAMPLER_2D and Usage::DEFAULT.
+         * @see RenderableManager::setUvDensityAt()
+         */
+        Builder& streaming(bool enabled) noexcept;
+
         /**
          * Creates the Texture object and returns a pointer to it.
          *
@@ -230,6 +251,28 @@ public:
          */
         Builder& import(intptr_t id) noexcept;
 
+        /**
+         * Uses the texture of another Engine instead of creating one, so that both Engines
+         * render with the same texture memory. The dimensions, levels, sampler, format and usage
+         * of \p texture replace the ones set on this Builder.
+         *
+         * The Engine building this texture must have been created with
+         * engine.getSharedContext() as its shared context with OpenGL, or on the same device
+         * with Metal; textures can't be shared with the other backends, build() fails then.
+         * \p texture must be SAMPLEABLE and it must outlive the shared texture. build() waits
+         * for \p engine to create it.
+         *
+         * Updates are visible to both Engines, but they are not synchronized: only textures
+         * which are not updated anymore, such as the textures of loaded assets, should be
+         * shared.
+         *
+         * @param engine the Engine which created \p texture
+         * @param texture the texture to share
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& share(Engine& engine, Texture const* texture) noexcept;
+
     private:
         friend class FTexture;
     };
@@ -281,6 +324,29 @@ public:
      */
     InternalFormat getFormat() const noexcept;
 
+    /**
+     * Returns whether this texture is streamed, as set by Builder::streaming().
+     */
+    bool isStreaming() const noexcept;
+
+    /**
+     * Returns the most detailed level of a streaming texture that is resident: the levels from
+     * this one to getLevels() - 1 are resident. Returns getLevels() if no level is resident yet,
+     * and 0 if the texture is not streamed.
+     *
+     * @see Builder::streaming()
+     */
+    size_t getResidentLevel() const noexcept;
+
+    /**
+     * Returns the most detailed level of a streaming texture the renderer needs, as of the last
+     * frame. The application should upload the levels from getResidentLevel() - 1 down to this
+     * one. Returns 0 if the texture is not streamed.
+     *
+     * @see Builder::streaming()
+     */
+    size_t getRequestedLevel() const noexcept;
+
     /**
      * Specify the image of a 2D texture for a level.
      *
@@ -390,7 +456,9 @@ public:
      *
      * @param engine        Engine this texture is associated to.
      * @param image         An opaque handle to a platform specific image. Supported types are
-     *                      eglImageOES on Android and CVPixelBufferRef on iOS.
+     *                      eglImageOES on Android and CVPixelBufferRef on iOS. With the Vulkan
+     *                      backend, they are AHardwareBuffer* on Android and
+     *                      backend::DmaBufImage* on Linux; YUV images are sampled as RGB.
      *
      *                      On iOS the following pixel formats are supported:
      *                        - kCVPixelFormatType_32BGRA
@@ -455,7 +523,8 @@ public:
 
     /**
      * Generates all the mipmap levels automatically. This requires the texture to have a
-     * color-renderable format.
+     * color-renderable format. Formats the backend can't mipmap itself, such as integer formats,
+     * are downsampled on the GPU with a blit per level, nearest-filtered for integer formats.
      *
      * @param engine        Engine this texture is associated to.
      *
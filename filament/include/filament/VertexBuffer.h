@@ -46,6 +46,11 @@ class Engine;
  * For this reason, it is best to separate the constant data from the dynamic data into multiple
  * buffers.
  *
+ * Depth and shadow passes only read the positions, and the skinning and morphing attributes. When
+ * no other attribute is interleaved with them, these passes fetch them alone, which saves a lot of
+ * vertex bandwidth on mobile GPUs. This doesn't apply to materials with custom vertex code or
+ * the MASKED blending mode, whose depth passes may read any attribute.
+ *
  * It is possible, and even encouraged, to use a single vertex buffer for several Renderables.
  *
  * @see IndexBuffer, RenderableManager
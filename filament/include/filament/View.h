@@ -25,8 +25,10 @@
 #include <backend/DriverEnums.h>
 
 #include <utils/compiler.h>
+#include <utils/Entity.h>
 
 #include <math/mathfwd.h>
+#include <math/vec3.h>
 
 namespace filament {
 
@@ -218,13 +220,19 @@ public:
         float radius = 0.3f;    //!< Ambient Occlusion radius in meters, between 0 and ~10.
         float power = 1.0f;     //!< Controls ambient occlusion's contrast. Must be positive.
         float bias = 0.0005f;   //!< Self-occlusion bias in meters. Use to avoid self-occlusion. Between 0 and a few mm.
-        float resolution = 0.5f;//!< How each dimension of the AO buffer is scaled. Must be either 0.5 or 1.0.
+        float resolution = 0.5f;//!< How each dimension of the AO buffer is scaled. Must be 0.25, 0.5 or 1.0.
         float intensity = 1.0f; //!< Strength of the Ambient Occlusion effect.
         QualityLevel quality = QualityLevel::LOW; //!< affects # of samples used for AO.
         QualityLevel lowPassFilter = QualityLevel::MEDIUM; //!< affects AO smoothness
         QualityLevel upsampling = QualityLevel::LOW; //!< affects AO buffer upsampling quality
         bool enabled = false;    //!< enables or disables screen-space ambient occlusion
         float minHorizonAngleRad = 0.0f;  //!< min angle in radian to consider
+        /**
+         * Accumulates AO over several frames, using fewer samples per frame and reprojecting the
+         * previous frame's AO. This is best used with a lower resolution.
+         */
+        bool temporalFiltering = false;
+        float temporalFeedback = 0.1f;  //!< history feedback, between 0 (maximum accumulation) and 1 (none)
         /**
          * Screen Space Cone Tracing (SSCT) options
          * Ambient shadows from dominant light
@@ -251,6 +259,26 @@ public:
         float filterWidth = 1.0f;   //!< reconstruction filter width typically between 0 (sharper, aliased) and 1 (smoother)
         float feedback = 0.04f;     //!< history feedback, between 0 (maximum temporal AA) and 1 (no temporal AA).
         bool enabled = false;       //!< enables or disables temporal anti-aliasing
+        /**
+         * When dynamic resolution scales the view down, reconstruct the full resolution from
+         * the jittered lower resolution frames, instead of upscaling the anti-aliased frame.
+         * Material textures are sampled with a matching LOD bias.
+         */
+        bool upscaling = false;
+    };
+
+    /**
+     * Options for foveated rendering of the color pass. Away from the fovea the shading rate is
+     * progressively reduced, typically down to a fragment per 2x2 or 4x4 pixels in the
+     * periphery. This is only supported by some devices (currently OpenGL ES with
+     * GL_QCOM_framebuffer_foveated) and ignored otherwise.
+     * @see setFoveationOptions()
+     */
+    struct FoveationOptions {
+        math::float2 center = math::float2(0.5f); //!< center of the fovea, in normalized viewport coordinates
+        float radius = 0.25f;    //!< radius of the full-rate region, relative to the viewport half-size
+        float falloff = 2.0f;    //!< how fast the shading rate decreases outside of the fovea, 0 disables foveation
+        bool enabled = false;    //!< enables or disables foveated rendering
     };
 
     /**
@@ -270,6 +298,16 @@ public:
         TEMPORAL = 1    //!< Temporal dithering (default)
     };
 
+    /**
+     * Depth prepass modes of the color pass.
+     * @see setDepthPrepass
+     */
+    enum class DepthPrepass : uint8_t {
+        DISABLED,   //!< no depth prepass (default)
+        ENABLED,    //!< opaque objects are rendered in the depth buffer before being shaded
+        AUTO        //!< the depth prepass is used when it's measured to reduce the GPU time
+    };
+
     /**
      * List of available shadow mapping techniques.
      * @see setShadowType
@@ -475,6 +513,59 @@ public:
      */
     bool isShadowingEnabled() const noexcept;
 
+    /**
+     * Enables or disables caching of shadow maps across frames. Disabled by default.
+     *
+     * When enabled, a shadow map is only rendered again when its light, its projection or the
+     * shadow casters it sees have changed. A caster is considered changed when its transform,
+     * its primitives, its bones or morph weights, or any material instance state used to render
+     * it is changed. This is well suited to scenes where the lights and most casters are static.
+     *
+     * Changes that can't be detected, such as updating the content of a caster's vertex or index
+     * buffers, or material parameters that affect a caster's geometry, require calling
+     * invalidateShadowMaps().
+     *
+     * Caching keeps the shadow map texture allocated between frames.
+     *
+     * @param enabled true enables shadow map caching, false disables it.
+     *
+     * @see invalidateShadowMaps
+     */
+    void setShadowMapCachingEnabled(bool enabled) noexcept;
+
+    /**
+     * @return whether shadow map caching is enabled
+     */
+    bool isShadowMapCachingEnabled() const noexcept;
+
+    /**
+     * Forces all cached shadow maps to be rendered again the next time this View is rendered.
+     * This has no effect when shadow map caching is disabled.
+     *
+     * @see setShadowMapCachingEnabled
+     */
+    void invalidateShadowMaps() noexcept;
+
+    /**
+     * Enables or disables sample distribution shadow maps. Disabled by default.
+     *
+     * When enabled, the cascades of the directional shadow map only cover the range of depths
+     * visible on screen, instead of the whole camera frustum. That range is measured on the
+     * GPU and read back a frame or two later, so it lags behind fast camera moves. This puts more
+     * of the shadow map resolution where it's needed, so a smaller shadow map gives the same
+     * quality, but the cascades move when the visible depth range changes.
+     *
+     * This requires compute support in the backend, it has no effect otherwise.
+     *
+     * @param enabled true enables sample distribution shadow maps, false disables them.
+     */
+    void setSampleDistributionShadowsEnabled(bool enabled) noexcept;
+
+    /**
+     * @return whether sample distribution shadow maps are enabled
+     */
+    bool isSampleDistributionShadowsEnabled() const noexcept;
+
     /**
      * Enables or disables screen space refraction. Enabled by default.
      *
@@ -487,6 +578,44 @@ public:
      */
     bool isScreenSpaceRefractionEnabled() const noexcept;
 
+    /**
+     * Enables or disables the reuse of the screen space refraction capture of previous frames.
+     * Disabled by default.
+     *
+     * The opaque objects behind the refractive objects are only captured again once the camera
+     * moved by about a pixel, or every few frames. This suits slow-moving cameras, the opaque
+     * objects moving behind refractive objects may lag by a few frames.
+     *
+     * @param enabled true enables the reuse of the capture, false disables it.
+     */
+    void setScreenSpaceRefractionReuseEnabled(bool enabled) noexcept;
+
+    /**
+     * @return whether the screen space refraction capture of previous frames can be reused
+     */
+    bool isScreenSpaceRefractionReuseEnabled() const noexcept;
+
+    /**
+     * Enables or disables weighted-blended order-independent transparency. Disabled by default.
+     *
+     * When enabled, the objects with the TRANSPARENT or FADE blending modes aren't sorted
+     * back-to-front and don't need two passes. They're sorted by material like opaque objects,
+     * accumulated in dedicated buffers, then composited over the color pass at once. The result
+     * is an approximation that depends on the distance to the camera, which is best suited to
+     * dense particles or glass. The other blending modes are rendered as usual.
+     *
+     * This isn't supported with MSAA, transparent objects are sorted when MSAA is enabled.
+     * Materials must be built with this version of matc.
+     *
+     * @param enabled true enables order-independent transparency, false disables it.
+     */
+    void setOrderIndependentTransparencyEnabled(bool enabled) noexcept;
+
+    /**
+     * @return whether order-independent transparency is enabled
+     */
+    bool isOrderIndependentTransparencyEnabled() const noexcept;
+
     /**
      * Sets how many samples are to be used for MSAA in the post-process stage.
      * Default is 1 and disables MSAA.
@@ -639,6 +768,20 @@ public:
      */
     VignetteOptions getVignetteOptions() const noexcept;
 
+    /**
+     * Enables or disables foveated rendering of the color pass. Disabled by default.
+     *
+     * @param options options
+     */
+    void setFoveationOptions(FoveationOptions options) noexcept;
+
+    /**
+     * Queries the foveation options.
+     *
+     * @return the current foveation options for this view.
+     */
+    FoveationOptions getFoveationOptions() const noexcept;
+
     /**
      * Enables or disables dithering in the post-processing stage. Enabled by default.
      *
@@ -653,6 +796,27 @@ public:
      */
     Dithering getDithering() const noexcept;
 
+    /**
+     * Sets whether the color pass starts with a depth prepass. Disabled by default.
+     *
+     * The opaque and masked objects are first rendered in the depth buffer only, then each
+     * visible pixel is shaded once. This helps scenes with expensive materials and a lot of
+     * overdraw (e.g. foliage), at the cost of processing their geometry twice.
+     *
+     * With DepthPrepass::AUTO, the GPU time of the frames is periodically measured with and
+     * without the depth prepass, and the fastest is kept. This requires GPU timer queries.
+     *
+     * @param mode the depth prepass mode
+     */
+    void setDepthPrepass(DepthPrepass mode) noexcept;
+
+    /**
+     * Queries the depth prepass mode.
+     *
+     * @return the depth prepass mode set by setDepthPrepass().
+     */
+    DepthPrepass getDepthPrepass() const noexcept;
+
     /**
      * Sets the dynamic resolution options for this view. Dynamic resolution options
      * controls whether dynamic resolution is enabled, and if it is, how it behaves.
@@ -784,6 +948,81 @@ public:
      */
     bool isFrontFaceWindingInverted() const noexcept;
 
+    /**
+     * Enables or disables retained render commands (disabled by default).
+     *
+     * When enabled, the sorted render commands of this View are kept from one frame to the
+     * next and reused as long as the visible renderables, their primitives and their
+     * materials don't change. When only the camera or the position of renderables change,
+     * the depth ordering of the retained commands is updated instead of generating them again.
+     *
+     * This reduces the CPU cost of mostly static scenes, at the expense of some memory and of
+     * a small overhead for scenes that change every frame.
+     *
+     * @param enabled true to retain render commands across frames, false otherwise.
+     */
+    void setRetainedCommandsEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns true if render commands are retained across frames.
+     * See setRetainedCommandsEnabled() for more information.
+     */
+    bool isRetainedCommandsEnabled() const noexcept;
+
+    /**
+     * Enables or disables occlusion culling (disabled by default).
+     *
+     * When enabled, the depth buffer of a previous frame is read back asynchronously and
+     * renderables that are entirely hidden behind it are not drawn. This is mostly useful for
+     * scenes with a lot of occlusion, such as interiors.
+     *
+     * Because the depth buffer used is a few frames old, objects that were occluded by
+     * something that moved away quickly can be missing for a frame or two. Renderables that
+     * have culling disabled (see RenderableManager::Builder::culling()) are never culled.
+     * Occlusion culling requires the backend to support reading back the depth buffer, it has no
+     * effect otherwise.
+     *
+     * @param enabled true to enable occlusion culling, false otherwise.
+     */
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns true if occlusion culling is enabled.
+     * See setOcclusionCullingEnabled() for more information.
+     */
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Result of a picking query, see pick().
+     */
+    struct PickingQueryResult {
+        //! renderable found at the query's coordinates, null if there is none
+        utils::Entity renderable{};
+        //! window-space depth of the fragment found, 1 at the near plane and 0 at the far plane
+        float depth = 0.0f;
+        //! window coordinates of the fragment found: the center of the pixel and its depth
+        math::float3 fragCoords{};
+    };
+
+    using PickingQueryResultCallback = void(*)(PickingQueryResult const& result, void* user);
+
+    /**
+     * Creates a picking query, which finds the renderable visible at the given coordinates.
+     *
+     * The query is processed by the next Renderer::render() of this View. The renderables are
+     * drawn with their depth variant into a single pixel, and the pixel is read back
+     * asynchronously, so that the cost doesn't depend on the size of the View. The callback is
+     * called on the main thread once the GPU has rendered the query, typically a frame or two
+     * later. Only the renderables that write to the depth buffer can be picked.
+     *
+     * @param x         horizontal coordinate, in pixels from the left of the viewport
+     * @param y         vertical coordinate, in pixels from the bottom of the viewport
+     * @param callback  called with the result of the query
+     * @param user      user pointer given to the callback
+     */
+    void pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback,
+            void* user = nullptr) noexcept;
+
     // for debugging...
 
     //! debugging: allows to entirely disable frustum culling. (culling enabled by default).
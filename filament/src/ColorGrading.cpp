@@ -19,6 +19,8 @@
 #include "details/Engine.h"
 #include "details/Texture.h"
 
+#include "PostProcessManager.h"
+
 #include "FilamentAPI-impl.h"
 
 #include "ColorSpace.h"
@@ -46,64 +48,6 @@ using namespace backend;
 // Builder
 //------------------------------------------------------------------------------
 
-struct ColorGrading::BuilderDetails {
-    ColorGrading::QualityLevel quality = QualityLevel::MEDIUM;
-
-    ToneMapping toneMapping = ToneMapping::ACES_LEGACY;
-    // White balance
-    float2 whiteBalance     = {0.0f, 0.0f};
-    // Channel mixer
-    float3 outRed           = {1.0f, 0.0f, 0.0f};
-    float3 outGreen         = {0.0f, 1.0f, 0.0f};
-    float3 outBlue          = {0.0f, 0.0f, 1.0f};
-    // Tonal ranges
-    float3 shadows          = {1.0f, 1.0f, 1.0f};
-    float3 midtones         = {1.0f, 1.0f, 1.0f};
-    float3 highlights       = {1.0f, 1.0f, 1.0f};
-    float4 tonalRanges      = {0.0f, 0.333f, 0.550f, 1.0f}; // defaults in DaVinci Resolve
-    // ASC CDL
-    float3 slope            = {1.0f};
-    float3 offset           = {0.0f};
-    float3 power            = {1.0f};
-    // Color adjustments
-    float  contrast         = 1.0f;
-    float  vibrance         = 1.0f;
-    float  saturation       = 1.0f;
-    // Curves
-    float3 shadowGamma      = {1.0f};
-    float3 midPoint         = {1.0f};
-    float3 highlightScale   = {1.0f};
-    // Keep last
-    bool hasAdjustments     = false;
-
-    bool operator!=(const BuilderDetails &rhs) const {
-        return !(rhs == *this);
-    }
-
-    bool operator==(const BuilderDetails &rhs) const {
-        // Note: Do NOT compare hasAdjustments
-        return quality == rhs.quality &&
-               toneMapping == rhs.toneMapping &&
-               whiteBalance == rhs.whiteBalance &&
-               outRed == rhs.outRed &&
-               outGreen == rhs.outGreen &&
-               outBlue == rhs.outBlue &&
-               shadows == rhs.shadows &&
-               midtones == rhs.midtones &&
-               highlights == rhs.highlights &&
-               tonalRanges == rhs.tonalRanges &&
-               slope == rhs.slope &&
-               offset == rhs.offset &&
-               power == rhs.power &&
-               contrast == rhs.contrast &&
-               vibrance == rhs.vibrance &&
-               saturation == rhs.saturation &&
-               shadowGamma == rhs.shadowGamma &&
-               midPoint == rhs.midPoint &&
-               highlightScale == rhs.highlightScale;
-    }
-};
-
 using BuilderType = ColorGrading;
 BuilderType::Builder::Builder() noexcept = default;
 BuilderType::Builder::~Builder() noexcept = default;
@@ -442,6 +386,14 @@ FColorGrading::FColorGrading(FEngine& engine, const Builder& builder) {
 
     DriverApi& driver = engine.getDriverApi();
 
+    // Color gradings built with the same parameters share their LUT, which is only generated
+    // the first time.
+    ColorGradingLutCache& lutCache = engine.getColorGradingLutCache();
+    mLutHandle = lutCache.acquire(*builder.mImpl);
+    if (mLutHandle) {
+        return;
+    }
+
     Config config{
         .colorGradingTransformIn  = selectColorGradingTransformIn(builder->toneMapping),
         .colorGradingTransformOut = selectColorGradingTransformOut(builder->toneMapping),
@@ -452,35 +404,99 @@ FColorGrading::FColorGrading(FEngine& engine, const Builder& builder) {
         .lutDimension             = selectLutDimension(builder->quality)
     };
 
-    size_t lutElementCount = config.lutDimension * config.lutDimension * config.lutDimension;
-    size_t elementSize = sizeof(half4);
-    void* data = malloc(lutElementCount * elementSize);
+    const size_t dimension = config.lutDimension;
 
     TextureFormat textureFormat;
     PixelDataFormat format;
     PixelDataType type;
     selectLutTextureParams(builder->quality, textureFormat, format, type);
-     assert(FTexture::validatePixelFormatAndType(textureFormat, format, type));
+    assert(FTexture::validatePixelFormatAndType(textureFormat, format, type));
+
+    // When the backend supports it, the LUT is generated by a compute program instead, which
+    // keeps up with a color grading built again every frame, e.g. while a slider is dragged.
+    PostProcessManager& ppm = engine.getPostProcessManager();
+    if (ppm.hasComputeColorGradingLut(textureFormat)) {
+        mLutHandle = driver.createTexture(SamplerType::SAMPLER_3D, 1, textureFormat, 1,
+                dimension, dimension, dimension, TextureUsage::SAMPLEABLE | TextureUsage::STORAGE);
+        lutCache.insert(*builder.mImpl, mLutHandle);
+
+        PostProcessManager::ColorGradingLutParams params;
+        mat3f transformIn = config.colorGradingTransformIn;
+        if (builder->hasAdjustments) {
+            // White balance
+            transformIn = transformIn * LMS_to_sRGB *
+                    mat3f{ adaptationTransform(builder->whiteBalance) } * sRGB_to_LMS;
+        }
+        for (size_t i = 0; i < 3; i++) {
+            params.transformIn[i] = float4{ transformIn[i], 0.0f };
+            params.transformOut[i] = float4{ config.colorGradingTransformOut[i], 0.0f };
+        }
+        params.luma           = float4{ config.lumaTransform, 0.0f };
+        params.outRed         = float4{ builder->outRed, 0.0f };
+        params.outGreen       = float4{ builder->outGreen, 0.0f };
+        params.outBlue        = float4{ builder->outBlue, 0.0f };
+        params.shadows        = float4{ builder->shadows, 0.0f };
+        params.midtones       = float4{ builder->midtones, 0.0f };
+        params.highlights     = float4{ builder->highlights, 0.0f };
+        params.tonalRanges    = builder->tonalRanges;
+        params.slope          = float4{ builder->slope, 0.0f };
+        params.offset         = float4{ builder->offset, 0.0f };
+        params.power          = float4{ builder->power, 0.0f };
+        params.shadowGamma    = float4{ builder->shadowGamma, 0.0f };
+        params.midPoint       = float4{ builder->midPoint, 0.0f };
+        params.highlightScale = float4{ builder->highlightScale, 0.0f };
+        params.contrast       = builder->contrast;
+        params.vibrance       = builder->vibrance;
+        params.saturation     = builder->saturation;
+        params.dimension      = int32_t(dimension);
+        params.toneMapping    = int32_t(builder->toneMapping);
+        params.hasAdjustments = builder->hasAdjustments;
+        params.acesLog        = config.linearToLogTransform == linearAP1_to_ACEScct;
+        params.padding        = 0;
+
+        lutCache.addPending(nullptr, [&ppm, handle = mLutHandle, textureFormat, params](
+                DriverApi& driver) {
+            ppm.colorGradingLut(driver, handle, textureFormat, params);
+        });
+        return;
+    }
 
-     void* converted = nullptr;
+    // The LUT is generated by jobs while the engine goes on, e.g. with the rest of its
+    // initialization for the default color grading. It's uploaded before the next frame, see
+    // ColorGradingLutCache::flush(), so the texture can be used right away.
+    struct Generation {
+        Config config;
+        Builder builder;
+        void* data;
+        void* converted;
+    };
+
+    size_t lutElementCount = dimension * dimension * dimension;
+    size_t elementSize = sizeof(half4);
+
+    Generation* const generation = new Generation{ config, builder,
+            malloc(lutElementCount * elementSize), nullptr };
     if (type == PixelDataType::UINT_2_10_10_10_REV) {
         // convert input to UINT_2_10_10_10_REV if needed
-        converted = malloc(lutElementCount * sizeof(uint32_t));
+        generation->converted = malloc(lutElementCount * sizeof(uint32_t));
     }
 
-    //auto now = std::chrono::steady_clock::now();
-
     // Multithreadedly generate the tone mapping 3D look-up table using 32 jobs
     // Slices are 8 KiB (128 cache lines) apart.
     // This takes about 3-6ms on Android in Release
     JobSystem& js = engine.getJobSystem();
     auto *slices = js.createJob();
-    for (size_t b = 0; b < config.lutDimension; b++) {
-        auto *job = js.createJob(slices, [data, converted, b, &config, builder](JobSystem&, JobSystem::Job*) {
-            half4* UTILS_RESTRICT p = (half4*) data + b * config.lutDimension * config.lutDimension;
-            for (size_t g = 0; g < config.lutDimension; g++) {
-                for (size_t r = 0; r < config.lutDimension; r++) {
-                    float3 v = float3{ r, g, b } * (1.0f / float(config.lutDimension - 1u));
+    for (size_t b = 0; b < dimension; b++) {
+        auto *job = js.createJob(slices, [generation, b](JobSystem&, JobSystem::Job*) {
+            Config const& config = generation->config;
+            Builder const& builder = generation->builder;
+            void* const data = generation->data;
+            void* const converted = generation->converted;
+            const size_t dimension = config.lutDimension;
+            half4* UTILS_RESTRICT p = (half4*) data + b * dimension * dimension;
+            for (size_t g = 0; g < dimension; g++) {
+                for (size_t r = 0; r < dimension; r++) {
+                    float3 v = float3{ r, g, b } * (1.0f / float(dimension - 1u));
 
                     // LogC encoding
                     v = LogC_to_linear(v);
@@ -550,11 +566,11 @@ FColorGrading::FColorGrading(FEngine& engine, const Builder& builder) {
             }
 
             if (converted) {
-                uint32_t* const UTILS_RESTRICT dst = (uint32_t*)converted + b * config.lutDimension * config.lutDimension;
-                half4* UTILS_RESTRICT src = (half4*) data + b * config.lutDimension * config.lutDimension;
+                uint32_t* const UTILS_RESTRICT dst = (uint32_t*)converted + b * dimension * dimension;
+                half4* UTILS_RESTRICT src = (half4*) data + b * dimension * dimension;
                 // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
                 // 32-bits results in one go.
-                const size_t count = (config.lutDimension * config.lutDimension) & ~0x7u; // tell the compiler that we're a multiple of 8
+                const size_t count = (dimension * dimension) & ~0x7u; // tell the compiler that we're a multiple of 8
                 #pragma clang loop vectorize_width(8)
                 for (size_t i = 0; i < count; ++i) {
                     float4 v{ src[i] };
@@ -568,38 +584,41 @@ FColorGrading::FColorGrading(FEngine& engine, const Builder& builder) {
         });
         js.run(job);
     }
-
-    // TODO: Should we do a runAndRetain() and defer the wait() + texture creation until
-    //       getHwHandle() is invoked?
-    js.runAndWait(slices);
-
-    //std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - now;
-    //slog.d << "LUT generation time: " << duration.count() << " ms" << io::endl;
+    slices = js.runAndRetain(slices);
 
     mLutHandle = driver.createTexture(SamplerType::SAMPLER_3D, 1, textureFormat, 1,
-            config.lutDimension, config.lutDimension, config.lutDimension, TextureUsage::DEFAULT);
+            dimension, dimension, dimension, TextureUsage::DEFAULT);
+    lutCache.insert(*builder.mImpl, mLutHandle);
 
-    if (converted) {
-        free(data);
-        data = converted;
+    if (generation->converted) {
         elementSize = sizeof(uint32_t);
     }
-
-    driver.update3DImage(mLutHandle, 0,
-            0, 0, 0,
-            config.lutDimension, config.lutDimension, config.lutDimension,
-            PixelBufferDescriptor{
-                    data, lutElementCount * elementSize,format, type,
-                    [](void* buffer, size_t, void*) { free(buffer); }
-            }
-    );
+    lutCache.addPending(slices, [generation, handle = mLutHandle, dimension,
+            size = lutElementCount * elementSize, format, type](DriverApi& driver) {
+        void* data = generation->data;
+        if (generation->converted) {
+            free(data);
+            data = generation->converted;
+        }
+        delete generation;
+        driver.update3DImage(handle, 0,
+                0, 0, 0,
+                dimension, dimension, dimension,
+                PixelBufferDescriptor{
+                        data, size, format, type,
+                        [](void* buffer, size_t, void*) { free(buffer); }
+                }
+        );
+    });
 }
 
 FColorGrading::~FColorGrading() noexcept = default;
 
 void FColorGrading::terminate(FEngine& engine) {
-    DriverApi& driver = engine.getDriverApi();
-    driver.destroyTexture(mLutHandle);
+    ColorGradingLutCache& lutCache = engine.getColorGradingLutCache();
+    // the LUT can't be destroyed before it's uploaded
+    lutCache.flush(engine.getDriverApi(), engine.getJobSystem());
+    lutCache.release(engine.getDriverApi(), mLutHandle);
 }
 
 } //namespace filament
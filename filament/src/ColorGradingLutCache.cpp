@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ColorGradingLutCache.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace backend;
+using namespace utils;
+
+ColorGradingLutCache::~ColorGradingLutCache() noexcept {
+    assert(mKeys.empty());
+}
+
+void ColorGradingLutCache::terminate(DriverApi& driver) noexcept {
+    assert(mPending.empty());
+    for (auto const& item : mLuts) {
+        for (Entry const& entry : item.second) {
+            driver.destroyTexture(entry.handle);
+        }
+    }
+    mLuts.clear();
+    mKeys.clear();
+    mUnused.clear();
+}
+
+TextureHandle ColorGradingLutCache::acquire(Parameters const& parameters) noexcept {
+    auto pos = mLuts.find(parameters.hash());
+    if (pos != mLuts.end()) {
+        for (Entry& entry : pos.value()) {
+            if (entry.parameters != parameters) {
+                continue;
+            }
+            if (entry.refs++ == 0) {
+                mUnused.erase(std::find(mUnused.begin(), mUnused.end(), entry.handle));
+            }
+            mHits++;
+            return entry.handle;
+        }
+    }
+    mMisses++;
+    return {};
+}
+
+void ColorGradingLutCache::insert(Parameters const& parameters, TextureHandle handle) noexcept {
+    const uint64_t key = parameters.hash();
+    mLuts[key].push_back({ parameters, handle, 1 });
+    mKeys.insert({ handle.getId(), key });
+}
+
+void ColorGradingLutCache::release(DriverApi& driver, TextureHandle handle) noexcept {
+    auto key = mKeys.find(handle.getId());
+    assert(key != mKeys.end());
+    if (UTILS_UNLIKELY(key == mKeys.end())) {
+        return;
+    }
+    std::vector<Entry>& entries = mLuts[key->second];
+    auto entry = std::find_if(entries.begin(), entries.end(),
+            [handle](Entry const& e) { return e.handle == handle; });
+    assert(entry != entries.end());
+    if (--entry->refs > 0) {
+        return;
+    }
+
+    // keep the LUT around, and evict the least recently released one if there are too many
+    mUnused.push_back(handle);
+    if (mUnused.size() > MAX_UNUSED_LUTS) {
+        destroy(driver, mUnused.front());
+        mUnused.erase(mUnused.begin());
+    }
+}
+
+void ColorGradingLutCache::destroy(DriverApi& driver, TextureHandle handle) noexcept {
+    auto key = mKeys.find(handle.getId());
+    auto pos = mLuts.find(key->second);
+    std::vector<Entry>& entries = pos.value();
+    entries.erase(std::find_if(entries.begin(), entries.end(),
+            [handle](Entry const& e) { return e.handle == handle; }));
+    if (entries.empty()) {
+        mLuts.erase(pos);
+    }
+    mKeys.erase(key);
+    driver.destroyTexture(handle);
+}
+
+void ColorGradingLutCache::addPending(JobSystem::Job* job,
+        std::function<void(DriverApi&)> upload) noexcept {
+    mPending.push_back({ job, std::move(upload) });
+}
+
+void ColorGradingLutCache::flush(DriverApi& driver, JobSystem& js) noexcept {
+    for (Pending& pending : mPending) {
+        if (pending.job) {
+            js.waitAndRelease(pending.job);
+        }
+        pending.upload(driver);
+    }
+    mPending.clear();
+}
+
+ColorGradingLutCache::Statistics ColorGradingLutCache::getStatistics() const noexcept {
+    return { .hits = mHits, .misses = mMisses, .count = mKeys.size() };
+}
+
+} // namespace filament
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_COLORGRADINGLUTCACHE_H
+#define TNT_FILAMENT_COLORGRADINGLUTCACHE_H
+
+#include <backend/Handle.h>
+
+#include "private/backend/DriverApiForward.h"
+
+#include "details/ColorGrading.h"
+
+#include <utils/JobSystem.h>
+
+#include <tsl/robin_map.h>
+
+#include <functional>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Shares color grading LUTs between ColorGrading objects built with the same parameters.
+ *
+ * LUTs are looked up by a hash of the builder's parameters, and a hit is only taken after
+ * comparing the parameters themselves. LUTs are ref-counted. The last few
+ * LUTs that are no longer used are kept around, so that toggling between color gradings, e.g.
+ * in an editor, doesn't generate their LUTs again.
+ * This is only used from the main thread.
+ */
+class ColorGradingLutCache {
+public:
+    // number of unused LUTs kept around
+    static constexpr size_t MAX_UNUSED_LUTS = 4;
+
+    struct Statistics {
+        uint64_t hits = 0;          // LUTs shared with an existing one
+        uint64_t misses = 0;        // LUTs generated
+        size_t count = 0;           // number of LUTs alive, including unused ones
+    };
+
+    ColorGradingLutCache() noexcept = default;
+    ColorGradingLutCache(ColorGradingLutCache const& rhs) = delete;
+    ColorGradingLutCache& operator=(ColorGradingLutCache const& rhs) = delete;
+    ~ColorGradingLutCache() noexcept;
+
+    // destroys all the LUTs
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    using Parameters = ColorGrading::BuilderDetails;
+
+    // returns the LUT generated for 'parameters' with a new reference, or a null handle if there
+    // is none, in which case the caller generates it and adds it with insert()
+    backend::TextureHandle acquire(Parameters const& parameters) noexcept;
+
+    // adds a LUT generated for 'parameters', with one reference
+    void insert(Parameters const& parameters, backend::TextureHandle handle) noexcept;
+
+    // releases a LUT returned by acquire() or added by insert(), flush() must be called first
+    void release(backend::DriverApi& driver, backend::TextureHandle handle) noexcept;
+
+    // registers the upload of a LUT whose content is generated by 'job', which must be retained,
+    // or the generation of a LUT on the GPU when 'job' is null
+    void addPending(utils::JobSystem::Job* job,
+            std::function<void(backend::DriverApi&)> upload) noexcept;
+
+    // waits for the LUTs being generated and uploads them, this must be called before a frame
+    // samples them
+    void flush(backend::DriverApi& driver, utils::JobSystem& js) noexcept;
+
+    Statistics getStatistics() const noexcept;
+
+private:
+    struct Entry {
+        Parameters parameters;
+        backend::TextureHandle handle;
+        uint32_t refs;
+    };
+
+    // destroys a LUT, which must not be used anymore
+    void destroy(backend::DriverApi& driver, backend::TextureHandle handle) noexcept;
+
+    struct Pending {
+        utils::JobSystem::Job* job;
+        std::function<void(backend::DriverApi&)> upload;
+    };
+
+    // LUTs with the same hash share a bucket
+    tsl::robin_map<uint64_t, std::vector<Entry>> mLuts;
+    tsl::robin_map<backend::HandleBase::HandleId, uint64_t> mKeys;
+    std::vector<Pending> mPending;
+    std::vector<backend::TextureHandle> mUnused;  // from least to most recently released
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_COLORGRADINGLUTCACHE_H
@@ -20,6 +20,10 @@
 
 #include <math/fast.h>
 
+#include <algorithm>
+
+#include <assert.h>
+
 using namespace filament::math;
 
 namespace filament {
@@ -89,6 +93,28 @@ void Culler::intersects(
     }
 }
 
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const* UTILS_RESTRICT frusta,
+        uint8_t const* UTILS_RESTRICT bits,
+        size_t frustumCount,
+        float3 const* UTILS_RESTRICT center,
+        float3 const* UTILS_RESTRICT extent,
+        size_t count) noexcept {
+    assert(frustumCount <= MAX_FRUSTUM_COUNT);
+
+    // Each block of AABBs is tested against all the frusta before moving on to the next one, so
+    // it's fetched from memory once and then stays in the L1 cache. This keeps the vectorized
+    // single frustum loop, which wouldn't vectorize with a loop over the frusta inside of it.
+    count = round(count); // capacity guaranteed to be multiple of 8
+    for (size_t i = 0; i < count; i += FUSED_BLOCK_SIZE) {
+        const size_t c = std::min(count - i, FUSED_BLOCK_SIZE);
+        for (size_t f = 0; f < frustumCount; f++) {
+            intersects(results + i, frusta[f], center + i, extent + i, c, bits[f]);
+        }
+    }
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -129,6 +155,17 @@ void Culler::Test::intersects(
     Culler::intersects(results, frustum, c, e, count, 0);
 }
 
+void Culler::Test::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const* UTILS_RESTRICT frusta,
+        uint8_t const* UTILS_RESTRICT bits,
+        size_t frustumCount,
+        float3 const* UTILS_RESTRICT c,
+        float3 const* UTILS_RESTRICT e,
+        size_t count) noexcept {
+    Culler::intersects(results, frusta, bits, frustumCount, c, e, count);
+}
+
 void Culler::Test::intersects(
         result_type* UTILS_RESTRICT results,
         Frustum const& UTILS_RESTRICT frustum,
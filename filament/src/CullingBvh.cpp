@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/CullingBvh.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <assert.h>
+
+using namespace filament::math;
+
+namespace filament {
+
+void CullingBvh::clear() noexcept {
+    mNodes.clear();
+    mIds.clear();
+    mCenters.clear();
+    mExtents.clear();
+    mItemOfId.clear();
+    mLeafOfItem.clear();
+    mDirtyNodes.clear();
+    mDirty = false;
+}
+
+void CullingBvh::build(uint32_t const* ids, float3 const* centers, float3 const* extents,
+        size_t count) {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!count) {
+        return;
+    }
+
+    // the items are reordered during the build, using a permutation of their indices
+    std::vector<uint32_t> order(count);
+    std::iota(order.begin(), order.end(), 0u);
+
+    // a binary tree with leaves of at least LEAF_SIZE / 2 items has less than
+    // 4 * count / LEAF_SIZE nodes
+    mNodes.reserve(4 * count / LEAF_SIZE + 1);
+    buildNode(order.data(), 0, uint32_t(count), centers, extents);
+
+    const size_t paddedCount = count + Culler::MODULO;
+    mIds.resize(paddedCount, 0);
+    mCenters.resize(paddedCount, float3{});
+    mExtents.resize(paddedCount, float3{});
+    mLeafOfItem.resize(count);
+    uint32_t maxId = 0;
+    for (size_t i = 0; i < count; i++) {
+        mIds[i] = ids[order[i]];
+        mCenters[i] = centers[order[i]];
+        mExtents[i] = extents[order[i]];
+        maxId = std::max(maxId, mIds[i]);
+    }
+
+    mItemOfId.resize(maxId + 1u, std::numeric_limits<uint32_t>::max());
+    for (size_t i = 0; i < count; i++) {
+        mItemOfId[mIds[i]] = uint32_t(i);
+    }
+
+    for (size_t i = 0, c = mNodes.size(); i < c; i++) {
+        Node const& node = mNodes[i];
+        if (!node.right) {
+            std::fill(mLeafOfItem.begin() + node.first, mLeafOfItem.begin() + node.last,
+                    uint32_t(i));
+        }
+    }
+    mDirtyNodes.resize(mNodes.size(), false);
+}
+
+void CullingBvh::buildNode(uint32_t* order, uint32_t first, uint32_t last,
+        float3 const* centers, float3 const* extents) {
+    const uint32_t index = uint32_t(mNodes.size());
+    mNodes.push_back({ .first = first, .last = last, .right = 0 });
+
+    float3 lo = std::numeric_limits<float>::max();
+    float3 hi = std::numeric_limits<float>::lowest();
+    float3 clo = std::numeric_limits<float>::max();
+    float3 chi = std::numeric_limits<float>::lowest();
+    for (uint32_t i = first; i < last; i++) {
+        float3 const& c = centers[order[i]];
+        float3 const& e = extents[order[i]];
+        lo = min(lo, c - e);
+        hi = max(hi, c + e);
+        clo = min(clo, c);
+        chi = max(chi, c);
+    }
+    mNodes[index].center = (hi + lo) * 0.5f;
+    mNodes[index].extent = (hi - lo) * 0.5f;
+
+    if (last - first <= LEAF_SIZE) {
+        return;
+    }
+
+    // split at the median of the box centers, along the axis where they're the most spread
+    const float3 spread = chi - clo;
+    const size_t axis = spread.x >= spread.y ?
+            (spread.x >= spread.z ? 0 : 2) : (spread.y >= spread.z ? 1 : 2);
+    const uint32_t middle = first + (last - first) / 2;
+    std::nth_element(order + first, order + middle, order + last,
+            [centers, axis](uint32_t lhs, uint32_t rhs) {
+                return centers[lhs][axis] < centers[rhs][axis];
+            });
+
+    buildNode(order, first, middle, centers, extents);
+    const uint32_t right = uint32_t(mNodes.size());
+    buildNode(order, middle, last, centers, extents);
+    mNodes[index].right = right;
+}
+
+void CullingBvh::update(uint32_t id, float3 const& center, float3 const& extent) noexcept {
+    assert(id < mItemOfId.size());
+    const uint32_t item = mItemOfId[id];
+    assert(item < mLeafOfItem.size());
+    mCenters[item] = center;
+    mExtents[item] = extent;
+    mDirtyNodes[mLeafOfItem[item]] = true;
+    mDirty = true;
+}
+
+void CullingBvh::computeBounds(Node& node) const noexcept {
+    float3 lo = std::numeric_limits<float>::max();
+    float3 hi = std::numeric_limits<float>::lowest();
+    for (uint32_t i = node.first; i < node.last; i++) {
+        lo = min(lo, mCenters[i] - mExtents[i]);
+        hi = max(hi, mCenters[i] + mExtents[i]);
+    }
+    node.center = (hi + lo) * 0.5f;
+    node.extent = (hi - lo) * 0.5f;
+}
+
+void CullingBvh::refit() noexcept {
+    if (!mDirty) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // Children are always after their parent, so visiting the nodes backward guarantees
+    // the children are up-to-date when we get to a parent. Dirty flags are propagated upward.
+    std::vector<bool>& dirty = mDirtyNodes;
+    for (size_t i = mNodes.size(); i-- > 0;) {
+        Node& node = mNodes[i];
+        if (!node.right) {
+            if (dirty[i]) {
+                computeBounds(node);
+            }
+            continue;
+        }
+        const size_t left = i + 1;
+        const size_t right = node.right;
+        if (dirty[left] || dirty[right]) {
+            Node const& l = mNodes[left];
+            Node const& r = mNodes[right];
+            const float3 lo = min(l.center - l.extent, r.center - r.extent);
+            const float3 hi = max(l.center + l.extent, r.center + r.extent);
+            node.center = (hi + lo) * 0.5f;
+            node.extent = (hi - lo) * 0.5f;
+            dirty[i] = true;
+        }
+    }
+    std::fill(dirty.begin(), dirty.end(), false);
+    mDirty = false;
+}
+
+} // namespace filament
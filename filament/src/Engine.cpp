@@ -22,6 +22,7 @@
 #include "details/DFG.h"
 #include "details/VertexBuffer.h"
 #include "details/Fence.h"
+#include "details/Froxelizer.h"
 #include "details/Camera.h"
 #include "details/IndexBuffer.h"
 #include "details/IndirectLight.h"
@@ -29,6 +30,7 @@
 #include "details/Renderer.h"
 #include "details/RenderPrimitive.h"
 #include "details/Scene.h"
+#include "details/ParticleSystem.h"
 #include "details/Skybox.h"
 #include "details/Stream.h"
 #include "details/SwapChain.h"
@@ -44,8 +46,12 @@
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 
+#include <stdio.h>
+
 #include "generated/resources/materials.h"
 
 using namespace filament::math;
@@ -56,11 +62,12 @@ namespace filament {
 using namespace backend;
 using namespace filaflat;
 
-FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext) {
+FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        const Config* config) {
     SYSTRACE_ENABLE();
     SYSTRACE_CALL();
 
-    FEngine* instance = new FEngine(backend, platform, sharedGLContext);
+    FEngine* instance = new FEngine(backend, platform, sharedGLContext, config);
 
     // initialize all fields that need an instance of FEngine
     // (this cannot be done safely in the ctor)
@@ -77,6 +84,7 @@ FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLCont
             slog.e << "Selected backend not supported in this build." << io::endl;
             return nullptr;
         }
+        instance->setPlatformBlobFunc();
         instance->mDriver = platform->createDriver(sharedGLContext);
     } else {
         // start the driver thread
@@ -105,10 +113,10 @@ FEngine* FEngine::create(Backend backend, Platform* platform, void* sharedGLCont
 #if UTILS_HAS_THREADING
 
 void FEngine::createAsync(CreateCallback callback, void* user,
-        Backend backend, Platform* platform, void* sharedGLContext) {
+        Backend backend, Platform* platform, void* sharedGLContext, const Config* config) {
     SYSTRACE_ENABLE();
     SYSTRACE_CALL();
-    FEngine* instance = new FEngine(backend, platform, sharedGLContext);
+    FEngine* instance = new FEngine(backend, platform, sharedGLContext, config);
 
     // start the driver thread
     instance->mDriverThread = std::thread(&FEngine::loop, instance);
@@ -159,18 +167,52 @@ static constexpr float4 sFullScreenTriangleVertices[3] = {
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
-FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext) :
+Engine::Config FEngine::validateConfig(const Config* config) noexcept {
+    Config result;
+    if (config) {
+        result = *config;
+    }
+    result.froxelCount = clamp(result.froxelCount,
+            uint32_t(FROXEL_BUFFER_ENTRY_COUNT_MIN), uint32_t(FROXEL_BUFFER_ENTRY_COUNT_MAX));
+    result.froxelSliceCount = clamp(result.froxelSliceCount,
+            uint32_t(FROXEL_SLICE_COUNT_MIN), uint32_t(FROXEL_SLICE_COUNT_MAX));
+    // the lights UBO layout of materials is sized for CONFIG_MAX_LIGHT_COUNT lights
+    result.maxLightCount = clamp(result.maxLightCount, 1u, uint32_t(CONFIG_MAX_LIGHT_COUNT));
+    // the cache size is stored in bytes, in a size_t
+    result.textureCacheSizeInMB = std::min(result.textureCacheSizeInMB,
+            uint32_t(std::numeric_limits<size_t>::max() >> 20u));
+    result.maxFramesInFlight = clamp(result.maxFramesInFlight,
+            1u, uint32_t(FrameSkipper::MAX_FRAME_LATENCY));
+    if (result.minCommandBufferSizeInMB == 0) {
+        result.minCommandBufferSizeInMB = uint32_t(CONFIG_MIN_COMMAND_BUFFERS_SIZE >> 20u);
+    }
+    if (result.commandBufferSizeInMB == 0) {
+        // room for the commands of each frame in flight and the one being recorded
+        result.commandBufferSizeInMB =
+                (result.maxFramesInFlight + 1) * result.minCommandBufferSizeInMB;
+    }
+    // with less than twice the required size, flush() would block all the time
+    result.commandBufferSizeInMB = std::max(result.commandBufferSizeInMB,
+            2 * result.minCommandBufferSizeInMB);
+    return result;
+}
+
+FEngine::FEngine(Backend backend, Platform* platform, void* sharedGLContext,
+        const Config* config) :
         mBackend(backend),
         mPlatform(platform),
         mSharedGLContext(sharedGLContext),
+        mConfig(validateConfig(config)),
         mPostProcessManager(*this),
         mEntityManager(EntityManager::get()),
         mRenderableManager(*this),
-        mTransformManager(),
+        mTransformManager(&mJobSystem),
         mLightManager(*this),
         mCameraManager(*this),
-        mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
-        mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
+        mCommandBufferQueue(size_t(mConfig.minCommandBufferSizeInMB) << 20u,
+                size_t(mConfig.commandBufferSizeInMB) << 20u),
+        mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE +
+                Froxelizer::getPerFrameArenaSizeOverhead(mConfig)),
         mEngineEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1),
         mMainThreadId(std::this_thread::get_id())
@@ -192,10 +234,30 @@ void FEngine::init() {
     SYSTRACE_CALL();
 
     // this must be first.
-    mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
+    if (UTILS_UNLIKELY(mConfig.commandCapturePath)) {
+        // all the commands are captured, so that the driver objects can be created again
+        mCommandCapture = std::make_unique<CommandStreamCapture>(*mDriver,
+                mConfig.commandCapturePath, mConfig.commandCaptureFrameCount);
+        mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer(),
+                mCommandCapture->getDispatcher());
+    } else {
+        mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
+    }
     DriverApi& driverApi = getDriverApi();
 
-    mResourceAllocator = new ResourceAllocator(driverApi);
+    // before any swap chain is created
+    driverApi.setMaxFramesInFlight(mConfig.maxFramesInFlight);
+
+    // before any scene is created
+    const size_t uboAlignment = std::max(1u, driverApi.getUniformBufferOffsetAlignment());
+    mPerRenderableUboStride = uint32_t((PER_RENDERABLE_UIB_DATA_SIZE + uboAlignment - 1) /
+            uboAlignment * uboAlignment);
+
+    mResourceAllocator = new ResourceAllocator(driverApi,
+            size_t(mConfig.textureCacheSizeInMB) << 20u);
+
+    // First, so that the jobs generating its LUT run along the rest of the initialization.
+    mDefaultColorGrading = upcast(ColorGrading::Builder().build(*this));
 
     mFullScreenTriangleVb = upcast(VertexBuffer::Builder()
             .vertexCount(3)
@@ -221,33 +283,15 @@ void FEngine::init() {
     driverApi.setRenderPrimitiveRange(mFullScreenTriangleRph, PrimitiveType::TRIANGLES,
             0, 0, 2, (uint32_t)mFullScreenTriangleIb->getIndexCount());
 
-    mDefaultIblTexture = upcast(Texture::Builder()
-            .width(1).height(1).levels(1)
-            .format(Texture::InternalFormat::RGBA8)
-            .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
-            .build(*this));
-    static uint32_t pixel = 0;
-    Texture::PixelBufferDescriptor buffer(
-            &pixel, 4, // 4 bytes in 1 RGBA pixel
-            Texture::Format::RGBA, Texture::Type::UBYTE);
-    Texture::FaceOffsets offsets = {};
-    mDefaultIblTexture->setImage(*this, 0, std::move(buffer), offsets);
-
-    // 3 bands = 9 float3
-    const float sh[9 * 3] = { 0.0f };
-    mDefaultIbl = upcast(IndirectLight::Builder()
-            .reflections(mDefaultIblTexture)
-            .irradiance(3, reinterpret_cast<const float3*>(sh))
-            .build(*this));
-
-    mDefaultColorGrading = upcast(ColorGrading::Builder().build(*this));
-
     // Always initialize the default material, most materials' depth shaders fallback on it.
     mDefaultMaterial = upcast(
             FMaterial::DefaultMaterialBuilder()
                     .package(MATERIALS_DEFAULTMATERIAL_DATA, MATERIALS_DEFAULTMATERIAL_SIZE)
                     .build(*const_cast<FEngine*>(this)));
 
+    mDebugRegistry.registerProperty("d.material.record_variants",
+            &debug.material.record_variants);
+
     mPostProcessManager.init();
     mLightManager.init(*this);
     mDFG = std::make_unique<DFG>(*this);
@@ -273,7 +317,7 @@ void FEngine::shutdown() {
 #ifndef NDEBUG
     // print out some statistics about this run
     size_t wm = mCommandBufferQueue.getHighWatermark();
-    size_t wmpct = wm / (CONFIG_COMMAND_BUFFERS_SIZE / 100);
+    size_t wmpct = wm / (mCommandBufferQueue.getBufferSize() / 100);
     slog.d << "CircularBuffer: High watermark "
            << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
 #endif
@@ -284,6 +328,8 @@ void FEngine::shutdown() {
      * Destroy our own state first
      */
 
+    // pending LUTs may be generated by the post-process manager
+    mColorGradingLutCache.flush(driver, getJobSystem());
     mPostProcessManager.terminate(driver);  // free-up post-process manager resources
     mResourceAllocator->terminate();
     mDFG->terminate();                      // free-up the DFG
@@ -295,8 +341,8 @@ void FEngine::shutdown() {
     destroy(mFullScreenTriangleIb);
     destroy(mFullScreenTriangleVb);
 
-    destroy(mDefaultIblTexture);
     destroy(mDefaultIbl);
+    destroy(mDefaultIblTexture);
 
     destroy(mDefaultColorGrading);
 
@@ -313,7 +359,9 @@ void FEngine::shutdown() {
     cleanupResourceList(mViews);
     cleanupResourceList(mScenes);
     cleanupResourceList(mSkyboxes);
+    cleanupResourceList(mParticleSystems);
     cleanupResourceList(mColorGradings);
+    mColorGradingLutCache.terminate(driver);
 
     // this must be done after Skyboxes and before materials
     destroy(mSkyboxMaterial);
@@ -328,6 +376,12 @@ void FEngine::shutdown() {
     }
     cleanupResourceList(mFences);
 
+    // this must be done after materials
+    mProgramCache.terminate(driver);
+    mSamplerGroupCache.terminate(driver);
+    mMaterialUniformArena.terminate(driver);
+    mBonesArena.terminate(driver);
+
     /*
      * Shutdown the backend...
      */
@@ -366,17 +420,157 @@ void FEngine::prepare() {
     // prepare() is called once per Renderer frame. Ideally we would upload the content of
     // UBOs that are visible only. It's not such a big issue because the actual upload() is
     // skipped is the UBO hasn't changed. Still we could have a lot of these.
+    mPrepareCount++;
+
+    // free the scratch memory of the previous frame, each thread of the pool frees its own once
+    // it's not running a job, so background jobs (e.g. from gltfio) are not affected
+    mJobSystem.resetScratchArenas();
+
     FEngine::DriverApi& driver = getDriverApi();
+
+    // the LUTs generated since the last frame must be uploaded before they're sampled
+    mColorGradingLutCache.flush(driver, mJobSystem);
+
     for (auto& materialInstanceList : mMaterialInstances) {
         for (const auto& item : materialInstanceList.second) {
-            item->commit(driver);
+            item->commitDeferred(driver);
         }
     }
 
     // Commit default material instances.
     for (const auto& material : mMaterials) {
-        material->getDefaultInstance()->commit(driver);
+        material->getDefaultInstance()->commitDeferred(driver);
+    }
+
+    // upload the uniforms of all the instances with one update per shared buffer
+    addUniformBufferBytes(mMaterialUniformArena.flush(driver));
+
+    // the views requested the levels of the streaming textures while rendering the last frame
+    if (!mTextureStreamer.empty()) {
+        mTextureStreamer.update(driver, mTextureStreamingBudget);
+    }
+
+    if (mMemoryBudget.size && mMemoryBudget.callback) {
+        MemoryStatistics const statistics = getMemoryStatistics();
+        if (statistics.totalBytes > mMemoryBudget.size) {
+            mMemoryBudget.callback(mMemoryBudget.user, statistics);
+        }
+    }
+}
+
+Engine::CommandBufferStatistics FEngine::getCommandBufferStatistics() const noexcept {
+    CommandBufferQueue const& queue = mCommandBufferQueue;
+    return {
+            .size = queue.getBufferSize(),
+            .minSize = queue.getRequiredSize(),
+            .highWatermark = queue.getHighWatermark(),
+            .growCount = queue.getResizeCount()
+    };
+}
+
+bool FEngine::getBackendFrameStatistics(backend::FrameStatistics* statistics) const noexcept {
+    return getDriver().getFrameStatistics(statistics);
+}
+
+Engine::MemoryStatistics FEngine::getMemoryStatistics() const noexcept {
+    MemoryStatistics statistics{};
+    for (FTexture const* texture : mTextures) {
+        statistics.textureBytes += texture->getResidentSize();
+    }
+    for (FVertexBuffer const* vertexBuffer : mVertexBuffers) {
+        statistics.vertexBufferBytes += vertexBuffer->getSize();
+    }
+    for (FIndexBuffer const* indexBuffer : mIndexBuffers) {
+        statistics.indexBufferBytes += indexBuffer->getSize();
+    }
+
+    statistics.uniformBufferBytes = mMaterialUniformArena.getStatistics().bufferBytes +
+            mBonesArena.getStatistics().bufferBytes;
+    for (FView const* view : mViews) {
+        statistics.uniformBufferBytes += view->getUniformBufferSize();
+    }
+    for (FScene const* scene : mScenes) {
+        statistics.uniformBufferBytes += scene->getUniformBufferSize();
+    }
+
+    if (mResourceAllocator) {
+        ResourceAllocator::Statistics const cache = mResourceAllocator->getStatistics();
+        statistics.renderTargetBytes = cache.inUseSize;
+        statistics.textureCacheBytes = cache.cacheSize;
+    }
+
+    backend::MemoryStatistics backend;
+    if (getDriver().getMemoryStatistics(&backend)) {
+        statistics.stagingBytes = size_t(backend.stagingBytes);
+        statistics.backendBytes = size_t(backend.allocatedBytes);
+    }
+
+    statistics.totalBytes = statistics.backendBytes ? statistics.backendBytes :
+            statistics.textureBytes + statistics.renderTargetBytes +
+            statistics.textureCacheBytes + statistics.vertexBufferBytes +
+            statistics.indexBufferBytes + statistics.uniformBufferBytes +
+            statistics.stagingBytes;
+    return statistics;
+}
+
+void FEngine::recordVariant(CString const& materialName, uint8_t variantKey) {
+    mRecordedVariants[std::string(materialName.c_str(), materialName.size())].set(variantKey);
+}
+
+CString FEngine::getVariantProfile() const noexcept {
+    std::string profile;
+    for (auto const& entry : mRecordedVariants) {
+        entry.second.forEachSetBit([&profile, &entry](size_t variantKey) {
+            char key[8];
+            snprintf(key, sizeof(key), "0x%02zx ", variantKey);
+            profile.append(key).append(entry.first).append("\n");
+        });
     }
+    return CString(profile.c_str(), profile.size());
+}
+
+void FEngine::growCommandBufferIfNeeded() {
+    CommandBufferQueue& queue = mCommandBufferQueue;
+    if (UTILS_LIKELY(!mConfig.growCommandBuffer || !queue.isTooSmall())) {
+        return;
+    }
+    const size_t requiredSize = getGrownCommandBufferSize(
+            queue.getRequiredSize(), queue.getHighWatermark());
+    if (requiredSize <= queue.getRequiredSize()) {
+        return;
+    }
+    // room for the commands of each frame in flight, plus the one being recorded
+    const size_t bufferSize = requiredSize * (mConfig.maxFramesInFlight + 1);
+    flushCommandBuffer(queue);
+    queue.resize(requiredSize, bufferSize);
+    slog.i << "Command buffer grown to " << bufferSize / 1024 << " KiB" << io::endl;
+}
+
+size_t FEngine::getGrownCommandBufferSize(size_t requiredSize, size_t highWatermark) noexcept {
+    // double the guaranteed space, but at least cover the largest use we've seen
+    size_t size = std::max(requiredSize * 2, highWatermark);
+    // the circular buffer is mapped with pages of BLOCK_SIZE bytes
+    size = (size + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK;
+    size = std::min(size, MAX_GROWN_COMMAND_BUFFER_SIZE);
+    return std::max(size, requiredSize);
+}
+
+Engine::TextureCacheStatistics FEngine::getTextureCacheStatistics() const noexcept {
+    assert(mResourceAllocator);
+    ResourceAllocator::Statistics const statistics = mResourceAllocator->getStatistics();
+    return {
+            .hits = statistics.hits,
+            .misses = statistics.misses,
+            .evictions = statistics.evictions,
+            .cachedBytes = statistics.cacheSize,
+            .cachedCount = statistics.cacheCount,
+            .inUseBytes = statistics.inUseSize,
+            .inUseCount = statistics.inUseCount
+    };
+}
+
+void FEngine::trimTextureCache(size_t maxSizeInBytes) noexcept {
+    getResourceAllocator().trim(maxSizeInBytes);
 }
 
 void FEngine::gc() {
@@ -452,6 +646,13 @@ void FEngine::flushAndWait() {
 // Render thread / command queue
 // -----------------------------------------------------------------------------------------------
 
+void FEngine::setPlatformBlobFunc() noexcept {
+    if (mConfig.insertBlob && mConfig.retrieveBlob && !mPlatform->hasBlobFunc()) {
+        mPlatform->setBlobFunc(Platform::InsertBlobFunc(mConfig.insertBlob),
+                Platform::RetrieveBlobFunc(mConfig.retrieveBlob));
+    }
+}
+
 int FEngine::loop() {
     if (mPlatform == nullptr) {
         mPlatform = DefaultPlatform::create(&mBackend);
@@ -483,6 +684,10 @@ int FEngine::loop() {
         } else {
             debug.server->setEditCallback(FMaterial::onEditCallback);
             debug.server->setQueryCallback(FMaterial::onQueryCallback);
+            debug.server->setStatsCallback(FMaterial::onStatsCallback);
+            debug.server->setProfileCallback([](void* user, bool enabled) {
+                static_cast<FEngine*>(user)->getMaterialStatistics().setEnabled(enabled);
+            }, this);
         }
     }
 #endif
@@ -490,6 +695,7 @@ int FEngine::loop() {
     JobSystem::setThreadName("FEngine::loop");
     JobSystem::setThreadPriority(JobSystem::Priority::DISPLAY);
 
+    setPlatformBlobFunc();
     mDriver = mPlatform->createDriver(mSharedGLContext);
     mDriverBarrier.latch();
     if (UTILS_UNLIKELY(!mDriver)) {
@@ -522,6 +728,48 @@ void FEngine::flushCommandBuffer(CommandBufferQueue& commandQueue) {
     commandQueue.flush();
 }
 
+void FEngine::cancelIblPrefilter(FIndirectLight const* ibl) noexcept {
+    auto& requests = mIblPrefilterRequests;
+    requests.erase(std::remove_if(requests.begin(), requests.end(),
+            [ibl](FIndirectLight::PrefilterRequest const& request) {
+                return request.ibl == ibl;
+            }), requests.end());
+}
+
+const FTexture* FEngine::getDummyCubemap() const noexcept {
+    FTexture* texture = mDefaultIblTexture;
+    if (UTILS_UNLIKELY(texture == nullptr)) {
+        FEngine& engine = *const_cast<FEngine*>(this);
+        texture = upcast(Texture::Builder()
+                .width(1).height(1).levels(1)
+                .format(Texture::InternalFormat::RGBA8)
+                .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+                .build(engine));
+        static uint32_t pixel = 0;
+        Texture::PixelBufferDescriptor buffer(
+                &pixel, 4, // 4 bytes in 1 RGBA pixel
+                Texture::Format::RGBA, Texture::Type::UBYTE);
+        Texture::FaceOffsets offsets = {};
+        texture->setImage(engine, 0, std::move(buffer), offsets);
+        mDefaultIblTexture = texture;
+    }
+    return texture;
+}
+
+const FIndirectLight* FEngine::getDefaultIndirectLight() const noexcept {
+    FIndirectLight* ibl = mDefaultIbl;
+    if (UTILS_UNLIKELY(ibl == nullptr)) {
+        // 3 bands = 9 float3
+        const float sh[9 * 3] = { 0.0f };
+        ibl = upcast(IndirectLight::Builder()
+                .reflections(getDummyCubemap())
+                .irradiance(3, reinterpret_cast<const float3*>(sh))
+                .build(*const_cast<FEngine*>(this)));
+        mDefaultIbl = ibl;
+    }
+    return ibl;
+}
+
 const FMaterial* FEngine::getSkyboxMaterial() const noexcept {
     FMaterial const* material = mSkyboxMaterial;
     if (UTILS_UNLIKELY(material == nullptr)) {
@@ -570,6 +818,10 @@ FSkybox* FEngine::createSkybox(const Skybox::Builder& builder) noexcept {
     return create(mSkyboxes, builder);
 }
 
+FParticleSystem* FEngine::createParticleSystem(const ParticleSystem::Builder& builder) noexcept {
+    return create(mParticleSystems, builder);
+}
+
 FColorGrading* FEngine::createColorGrading(const ColorGrading::Builder& builder) noexcept {
     return create(mColorGradings, builder);
 }
@@ -737,6 +989,10 @@ inline bool FEngine::destroy(const FSkybox* p) {
     return terminateAndDestroy(p, mSkyboxes);
 }
 
+inline bool FEngine::destroy(const FParticleSystem* p) {
+    return terminateAndDestroy(p, mParticleSystems);
+}
+
 inline bool FEngine::destroy(const FColorGrading* p) {
     return terminateAndDestroy(p, mColorGradings);
 }
@@ -843,8 +1099,9 @@ void FEngine::destroy(FEngine* engine) {
 // Trampoline calling into private implementation
 // ------------------------------------------------------------------------------------------------
 
-Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext) {
-    return FEngine::create(backend, platform, sharedGLContext);
+Engine* Engine::create(Backend backend, Platform* platform, void* sharedGLContext,
+        const Config* config) {
+    return FEngine::create(backend, platform, sharedGLContext, config);
 }
 
 void Engine::destroy(Engine* engine) {
@@ -853,8 +1110,8 @@ void Engine::destroy(Engine* engine) {
 
 #if UTILS_HAS_THREADING
 void Engine::createAsync(Engine::CreateCallback callback, void* user, Backend backend,
-        Platform* platform, void* sharedGLContext) {
-    FEngine::createAsync(callback, user, backend, platform, sharedGLContext);
+        Platform* platform, void* sharedGLContext, const Config* config) {
+    FEngine::createAsync(callback, user, backend, platform, sharedGLContext, config);
 }
 
 Engine* Engine::getEngine(void* token) {
@@ -882,6 +1139,59 @@ Backend Engine::getBackend() const noexcept {
     return upcast(this)->getBackend();
 }
 
+void* Engine::getSharedContext() noexcept {
+    return upcast(this)->getSharedContext();
+}
+
+const Engine::Config& Engine::getConfig() const noexcept {
+    return upcast(this)->getConfig();
+}
+
+Engine::TextureCacheStatistics Engine::getTextureCacheStatistics() const noexcept {
+    return upcast(this)->getTextureCacheStatistics();
+}
+
+Engine::CommandBufferStatistics Engine::getCommandBufferStatistics() const noexcept {
+    return upcast(this)->getCommandBufferStatistics();
+}
+
+bool Engine::getBackendFrameStatistics(backend::FrameStatistics* statistics) const noexcept {
+    return upcast(this)->getBackendFrameStatistics(statistics);
+}
+
+utils::CString Engine::getVariantProfile() const noexcept {
+    return upcast(this)->getVariantProfile();
+}
+
+void Engine::trimTextureCache(size_t maxSizeInBytes) noexcept {
+    upcast(this)->trimTextureCache(maxSizeInBytes);
+}
+
+void Engine::setTextureStreamingBudget(size_t budgetInBytes) noexcept {
+    upcast(this)->setTextureStreamingBudget(budgetInBytes);
+}
+
+size_t Engine::getTextureStreamingBudget() const noexcept {
+    return upcast(this)->getTextureStreamingBudget();
+}
+
+size_t Engine::getTextureStreamingResidentSize() const noexcept {
+    return upcast(this)->getTextureStreamingResidentSize();
+}
+
+Engine::MemoryStatistics Engine::getMemoryStatistics() const noexcept {
+    return upcast(this)->getMemoryStatistics();
+}
+
+void Engine::setMemoryBudget(size_t budgetInBytes,
+        MemoryBudgetCallback* callback, void* user) noexcept {
+    upcast(this)->setMemoryBudget(budgetInBytes, callback, user);
+}
+
+size_t Engine::getMemoryBudget() const noexcept {
+    return upcast(this)->getMemoryBudget();
+}
+
 Renderer* Engine::createRenderer() noexcept {
     return upcast(this)->createRenderer();
 }
@@ -954,6 +1264,10 @@ bool Engine::destroy(const Skybox* p) {
     return upcast(this)->destroy(upcast(p));
 }
 
+bool Engine::destroy(const ParticleSystem* p) {
+    return upcast(this)->destroy(upcast(p));
+}
+
 bool Engine::destroy(const ColorGrading* p) {
     return upcast(this)->destroy(upcast(p));
 }
@@ -1002,6 +1316,10 @@ void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
 
+BufferDescriptor Engine::allocateStaging(size_t size) {
+    return upcast(this)->allocateStaging(size);
+}
+
 // The external-facing execute does a flush, and is meant only for single-threaded environments.
 // It also discards the boolean return value, which would otherwise indicate a thread exit.
 void Engine::execute() {
@@ -27,6 +27,13 @@ namespace filament {
 struct FrameHistoryEntry {
     FrameGraphTexture color;
     FrameGraphTexture::Descriptor colorDesc;
+    FrameGraphTexture ssao;
+    FrameGraphTexture::Descriptor ssaoDesc;
+    FrameGraphTexture refraction;
+    FrameGraphTexture::Descriptor refractionDesc;
+    math::float4 refractionRegion{};    // valid region of the refraction capture, see FRenderer
+    math::mat4f refractionWorldToClip;  // world to clip transform of the refraction capture
+    uint32_t refractionAge = 0;         // number of frames the refraction capture was reused
     math::mat4f projection;
     math::float2 jitter{};
     uint32_t frameId = 0;
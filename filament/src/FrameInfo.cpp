@@ -17,11 +17,16 @@
 #include "FrameInfo.h"
 
 #include <utils/Log.h>
+#include <utils/Mutex.h>
 #include <utils/Systrace.h>
 
 #include <math/scalar.h>
 
+#include <algorithm>
 #include <cmath>
+#include <mutex>
+
+#include <string.h>
 
 namespace filament {
 using namespace utils;
@@ -35,52 +40,316 @@ void move_backward(InputIterator first, InputIterator last, OutputIterator resul
     }
 }
 
-FrameInfoManager::FrameInfoManager(FEngine& engine) : mEngine(engine) {
-    backend::DriverApi& driver = mEngine.getDriverApi();
-    for (auto& query : mQueries) {
-        query = driver.createTimerQuery();
+void FramePerformanceCounters::reset() noexcept {
+    static constexpr const char* names[PHASE_COUNT] = {
+            "scene prepare",
+            "culling",
+            "froxelization",
+            "command generation",
+            "command sorting",
+            "command recording"
+    };
+    for (size_t i = 0; i < PHASE_COUNT; i++) {
+        phases[i] = { names[i] };
+    }
+}
+
+PerformanceCountersScope::PerformanceCountersScope(FramePerformanceCounters* counters,
+        FramePerformanceCounters::Phase phase) noexcept {
+    if (UTILS_LIKELY(!counters)) {
+        return;
+    }
+    // the counters only count the thread that opened them, so each thread needs its own
+    static thread_local Profiler sProfiler;
+    static thread_local bool sProfilerInitialized = false;
+    if (UTILS_UNLIKELY(!sProfilerInitialized)) {
+        sProfilerInitialized = true;
+        sProfiler.resetEvents(Profiler::EV_CPU_CYCLES | Profiler::EV_BPU_MISSES |
+                Profiler::EV_L1D_MISSES | Profiler::EV_LLC_MISSES);
+        sProfiler.start();
     }
+    if (sProfiler.isValid()) {
+        mPhase = &counters->phases[phase];
+        mProfiler = &sProfiler;
+        mStart = sProfiler.readCounters();
+    }
+}
+
+PerformanceCountersScope::~PerformanceCountersScope() noexcept {
+    if (UTILS_LIKELY(!mProfiler)) {
+        return;
+    }
+    Profiler::Counters const counters = mProfiler->readCounters() - mStart;
+    mPhase->cpuCycles += counters.getCpuCycles();
+    mPhase->instructions += counters.getInstructions();
+    mPhase->branchMisses += counters.getBranchMisses();
+    mPhase->l1dMisses += counters.getL1DMisses();
+    mPhase->llcMisses += counters.getLLCMisses();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void ViewStatistics::addPass(const char* name,
+        Renderer::FrameStatistics::Pass const& counts) noexcept {
+    static utils::Mutex lock;
+    std::lock_guard<utils::Mutex> guard(lock);
+    auto pos = std::find_if(passes.begin(), passes.end(),
+            [name](auto const& pass) { return !strcmp(pass.name, name); });
+    if (pos == passes.end()) {
+        passes.push_back({ name });
+        pos = passes.end() - 1;
+    }
+    pos->commandCount += counts.commandCount;
+    pos->drawCount += counts.drawCount;
+    pos->programChangeCount += counts.programChangeCount;
+    pos->pipelineChangeCount += counts.pipelineChangeCount;
+    pos->materialInstanceChangeCount += counts.materialInstanceChangeCount;
+}
+
+void FrameStatisticsManager::beginFrame(uint32_t frameId,
+        uint64_t engineUniformBufferBytes) noexcept {
+    mCurrent.frameId = frameId;
+    mCurrent.uniformBufferBytes = engineUniformBufferBytes;
+    mCurrent.viewUniformBufferBytes = 0;
+    mCurrent.viewCount = 0;
+}
+
+void FrameStatisticsManager::endFrame(uint64_t engineUniformBufferBytes) noexcept {
+    mCurrent.uniformBufferBytes = engineUniformBufferBytes - mCurrent.uniformBufferBytes +
+            mCurrent.viewUniformBufferBytes;
+    std::swap(mCurrent, mLast);
+    mLastViews.resize(mLast.viewCount);
+    for (size_t i = 0; i < mLast.viewCount; i++) {
+        ViewStatistics const& stats = mLast.views[i];
+        mLastViews[i] = stats.view;
+        mLastViews[i].passes = stats.passes.data();
+        mLastViews[i].passCount = stats.passes.size();
+    }
+    mCurrent.viewCount = 0;
+}
+
+ViewStatistics& FrameStatisticsManager::beginView() noexcept {
+    if (mCurrent.viewCount == mCurrent.views.size()) {
+        mCurrent.views.emplace_back();
+    }
+    ViewStatistics& stats = mCurrent.views[mCurrent.viewCount++];
+    stats.view = {};
+    stats.passes.clear();
+    return stats;
+}
+
+Renderer::FrameStatistics FrameStatisticsManager::getLastFrameStatistics() const noexcept {
+    return {
+            .frameId = mLast.frameId,
+            .uniformBufferBytes = uint32_t(mLast.uniformBufferBytes),
+            .views = mLastViews.data(),
+            .viewCount = mLastViews.size()
+    };
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameInfoManager::FrameInfoManager(FEngine& engine) : mEngine(engine) {
 }
 
 FrameInfoManager::~FrameInfoManager() noexcept = default;
 
 void FrameInfoManager::terminate() {
     backend::DriverApi& driver = mEngine.getDriverApi();
-    for (auto& query : mQueries) {
-        driver.destroyTimerQuery(query);
+    for (auto& segments : mSegments) {
+        for (auto& segment : segments.list) {
+            driver.destroyTimerQuery(segment.query);
+        }
+        segments.list.clear();
     }
 }
 
-void FrameInfoManager::beginFrame(Config const& config, uint32_t frameId) {
+bool FrameInfoManager::readSegments(Segments const& segments, duration times[2]) {
     backend::DriverApi& driver = mEngine.getDriverApi();
-    driver.beginTimerQuery(mQueries[mIndex]);
-    uint64_t elapsed = 0;
-    if (driver.getTimerQueryValue(mQueries[mLast], &elapsed)) {
-        mLast = (mLast + 1) % POOL_COUNT;
+    if (!segments.count) {
+        return false;
+    }
+    duration result[2]{};
+    for (size_t i = 0; i < segments.count; i++) {
+        uint64_t elapsed = 0;
+        if (!driver.getTimerQueryValue(segments.list[i].query, &elapsed)) {
+            return false;
+        }
         // conversion to our duration happens here
-        mFrameTime = std::chrono::duration<uint64_t, std::nano>(elapsed);
+        result[size_t(segments.list[i].category)] +=
+                std::chrono::duration<uint64_t, std::nano>(elapsed);
+    }
+    times[0] = result[0];
+    times[1] = result[1];
+
+    // all the results are available, publish the timings of that frame
+    FrameTimingInfo& timings = mFrameTimings;
+    timings.frameId = segments.frameId;
+    timings.gpuTime = result[0] + result[1];
+    timings.cpu = segments.cpu;
+    timings.counters = segments.counters;
+    timings.hasCounters = segments.hasCounters;
+    timings.passes.clear();
+    timings.untimedPassCount = segments.untimedPassCount;
+    MaterialStatistics& materialStatistics = mEngine.getMaterialStatistics();
+    const bool hasMaterials = materialStatistics.isEnabled();
+    for (size_t i = 0; i < segments.count; i++) {
+        Segment const& segment = segments.list[i];
+        uint64_t elapsed = 0;
+        driver.getTimerQueryValue(segment.query, &elapsed);
+        if (segment.hasMaterial && hasMaterials) {
+            materialStatistics.addGpuTime(segment.materialId, segment.variant, elapsed);
+        }
+        if (segment.name) {
+            const float time =
+                    duration(std::chrono::duration<uint64_t, std::nano>(elapsed)).count();
+            if (segment.continued && !timings.passes.empty()) {
+                timings.passes.back().gpuTime += time;
+            } else {
+                timings.passes.push_back({ segment.name, time });
+            }
+        }
+    }
+    if (hasMaterials) {
+        materialStatistics.endGpuFrame();
+    }
+    return true;
+}
+
+void FrameInfoManager::beginFrame(Config const& config, uint32_t frameId) {
+    if (readSegments(mSegments[mLast], mTimes)) {
+        mLast = (mLast + 1) % POOL_COUNT;
+    }
+    Segments& segments = mSegments[mIndex];
+    segments.count = 0;
+    segments.capacity = mEngine.getMaterialStatistics().isEnabled() ?
+            MAX_MATERIAL_SEGMENT_COUNT : BASE_SEGMENT_COUNT;
+    segments.untimedPassCount = 0;
+    segments.frameId = frameId;
+    segments.cpu = {};
+    segments.counters.reset();
+    segments.hasCounters = mPerformanceCountersEnabled;
+    mInPass = false;
+    beginSegment(Category::MAIN);
+    update(config, mTimes);
+}
+
+void FrameInfoManager::beginSegment(Category category) {
+    Segments const& segments = mSegments[mIndex];
+    if (segments.count) {
+        // a pass keeps being timed until it ends, unless its category changes
+        Segment const& current = segments.list[segments.count - 1];
+        if (current.category == category && (!current.name || mInPass)) {
+            return;
+        }
+    }
+    beginSegment(category, nullptr);
+}
+
+bool FrameInfoManager::beginSegment(Category category, const char* name, bool continued) {
+    backend::DriverApi& driver = mEngine.getDriverApi();
+    Segments& segments = mSegments[mIndex];
+    const bool overflow = segments.count + 1 >= segments.capacity;
+    if (overflow) {
+        // Past the budget, the rest of the frame goes to a single overflow segment which isn't
+        // attributed to any pass, and the passes it contains are counted instead.
+        if (name && !continued) {
+            segments.untimedPassCount++;
+        }
+        if (segments.count && segments.list[segments.count - 1].overflow) {
+            return false;
+        }
+        name = nullptr;
+        continued = false;
+    }
+    if (segments.count) {
+        driver.endTimerQuery(segments.list[segments.count - 1].query);
+    }
+    if (segments.count == segments.list.size()) {
+        segments.list.push_back({ driver.createTimerQuery(), category, name });
+    }
+    Segment& segment = segments.list[segments.count++];
+    segment.category = category;
+    segment.name = name;
+    segment.continued = continued;
+    segment.overflow = overflow;
+    segment.hasMaterial = false;
+    driver.beginTimerQuery(segment.query);
+    return !overflow;
+}
+
+void FrameInfoManager::beginExecute(size_t passCount) noexcept {
+    // each pass needs a segment, and one more resumes the time between passes afterwards
+    mSegments[mIndex].capacity += passCount + 1;
+}
+
+void FrameInfoManager::beginPass(const char* name) noexcept {
+    Segments const& segments = mSegments[mIndex];
+    assert(segments.count);
+    beginSegment(segments.list[segments.count - 1].category, name);
+    mInPass = true;
+}
+
+void FrameInfoManager::endPass() noexcept {
+    // The pass' query is only ended by the next segment, so that we don't need a query
+    // for the (usually empty) GPU work between two passes.
+    mInPass = false;
+}
+
+void FrameInfoManager::beginMaterial(uint32_t materialId, uint8_t variant) noexcept {
+    Segments& segments = mSegments[mIndex];
+    if (!segments.count) {
+        return;
+    }
+    Segment const& current = segments.list[segments.count - 1];
+    if (beginSegment(current.category, current.name, current.name != nullptr)) {
+        Segment& segment = segments.list[segments.count - 1];
+        segment.hasMaterial = true;
+        segment.materialId = materialId;
+        segment.variant = variant;
+    }
+}
+
+void FrameInfoManager::endMaterial() noexcept {
+    Segments const& segments = mSegments[mIndex];
+    if (!segments.count) {
+        return;
+    }
+    Segment const& current = segments.list[segments.count - 1];
+    if (current.hasMaterial) {
+        beginSegment(current.category, current.name, current.name != nullptr);
     }
-    update(config,mFrameTime);
 }
 
 void FrameInfoManager::endFrame() {
     backend::DriverApi& driver = mEngine.getDriverApi();
-    driver.endTimerQuery(mQueries[mIndex]);
+    Segments const& segments = mSegments[mIndex];
+    if (segments.count) {
+        driver.endTimerQuery(segments.list[segments.count - 1].query);
+    }
+    MaterialStatistics& materialStatistics = mEngine.getMaterialStatistics();
+    if (materialStatistics.isEnabled()) {
+        materialStatistics.endFrame();
+    }
     mIndex = (mIndex + 1) % POOL_COUNT;
 }
 
-void FrameInfoManager::update(Config const& config, FrameInfoManager::duration lastFrameTime) {
+void FrameInfoManager::update(Config const& config, duration const times[2]) {
     // keep an history of frame times
     auto& history = mFrameTimeHistory;
 
     // this is like doing { pop_back(); push_front(); }
     filament::move_backward(history.begin(), history.end() - 1, history.end());
-    history[0].frameTime = lastFrameTime;
+    history[0].mainTime = times[0];
+    history[0].postProcessingTime = times[1];
+    history[0].frameTime = times[0] + times[1];
 
     mFrameTimeHistorySize = std::min(++mFrameTimeHistorySize, uint32_t(MAX_FRAMETIME_HISTORY));
     if (UTILS_UNLIKELY(mFrameTimeHistorySize < 3)) {
         // not enough history to do anything useful
         history[0].valid = false;
+        history[0].kalman[0] = { times[0].count(), 0.0f };
+        history[0].kalman[1] = { times[1].count(), 0.0f };
         return;
     }
 
@@ -96,9 +365,53 @@ void FrameInfoManager::update(Config const& config, FrameInfoManager::duration l
 
     history[0].denoisedFrameTime = denoisedFrameTime;
 
-    // how much we need to scale the current workload to fit in our target, at this instant
+    // the budget of each category, post-processing is only budgeted separately if requested
     const duration targetWithHeadroom = config.targetFrameTime * (1.0f - config.headRoomRatio);
-    const duration measured = denoisedFrameTime;
+    const float budgets[2] = {
+            targetWithHeadroom.count() * (1.0f - config.postProcessingRatio),
+            targetWithHeadroom.count() * config.postProcessingRatio
+    };
+
+    // The GPU times of each category are filtered with a scalar Kalman filter, which unlike the
+    // median doesn't add a fixed latency. The measurement noise is the variance of the last N
+    // frames and the process noise allows the estimate to follow genuine load changes (e.g.
+    // thermal throttling) within a few frames.
+    float estimates[2];
+    for (size_t c = 0; c < 2; c++) {
+        float mean = 0.0f;
+        for (size_t i = 0; i < size; ++i) {
+            mean += (c ? history[i].postProcessingTime : history[i].mainTime).count();
+        }
+        mean /= float(size);
+        float measurementNoise = 0.0f;
+        for (size_t i = 0; i < size; ++i) {
+            const float d = (c ? history[i].postProcessingTime : history[i].mainTime).count() - mean;
+            measurementNoise += d * d;
+        }
+        measurementNoise = std::max(measurementNoise / float(size - 1), 1e-10f);
+
+        const float q = 0.02f * targetWithHeadroom.count();
+        const float processNoise = q * q;
+        const float measured = times[c].count();
+        const auto& previous = history[1].kalman[c];
+        const float variance = previous.variance + processNoise;
+        const float gain = variance / (variance + measurementNoise);
+        history[0].kalman[c].estimate = previous.estimate + gain * (measured - previous.estimate);
+        history[0].kalman[c].variance = (1.0f - gain) * variance;
+        estimates[c] = history[0].kalman[c].estimate;
+    }
+
+    // how much we need to scale the current workload to fit in our target, at this instant.
+    // With separate budgets, the category the furthest from its budget drives the error.
+    float error;
+    if (budgets[1] > 0.0f) {
+        error = std::min(
+                (budgets[0] - estimates[0]) / budgets[0],
+                (budgets[1] - estimates[1]) / budgets[1]);
+    } else {
+        const float measured = estimates[0] + estimates[1];
+        error = (targetWithHeadroom.count() - measured) / targetWithHeadroom.count();
+    }
 
     // We use a P.I.D. controller below to figure out the scaling factor to apply. In practice we
     // don't use the Derivative gain (so it's really a PI controller).
@@ -106,7 +419,7 @@ void FrameInfoManager::update(Config const& config, FrameInfoManager::duration l
     const float Ki = Kp / 10.0f;
     const float Kd = 0.0;
 
-    history[0].pid.error = (targetWithHeadroom - measured) / targetWithHeadroom;
+    history[0].pid.error = error;
     history[0].pid.integral = history[1].pid.integral + Ki * history[0].pid.error;
     history[0].pid.integral = math::clamp(history[0].pid.integral, -6.0f, 2.0f);
 
@@ -19,10 +19,17 @@
 
 #include "details/Engine.h"
 
+#include "fg/FrameGraph.h"
+
 #include "backend/Handle.h"
 
+#include <filament/Renderer.h>
+
+#include <utils/Profiler.h>
+
 #include <array>
 #include <chrono>
+#include <vector>
 
 #include <assert.h>
 #include <stdint.h>
@@ -34,24 +41,141 @@ struct FrameInfo {
     using duration = std::chrono::duration<float>;
     duration frameTime{};            // frame period
     duration denoisedFrameTime{};    // frame period (median filter)
+    // GPU time of the main passes (everything but post-processing) and of post-processing
+    duration mainTime{};
+    duration postProcessingTime{};
     bool valid = false;
     float scale = 1.0f;
     struct {
         float integral{};
         float error{};
     } pid;
+    // scalar Kalman filter state for the main and post-processing GPU times, in seconds
+    struct {
+        float estimate{};
+        float variance{};
+    } kalman[2];
+};
+
+// CPU time spent preparing a frame, accumulated over all its views
+struct FrameCpuTimings {
+    using duration = std::chrono::duration<float>;
+    duration culling{};
+    duration commandGeneration{};
+    duration commandSorting{};
+};
+
+// Hardware performance counters of the phases of a frame, accumulated over all its views
+struct FramePerformanceCounters {
+    enum Phase : uint8_t {
+        SCENE_PREPARE,
+        CULLING,
+        FROXELIZATION,
+        COMMAND_GENERATION,
+        COMMAND_SORTING,
+        COMMAND_RECORDING,
+        PHASE_COUNT
+    };
+    Renderer::FrameTimings::PhaseCounters phases[PHASE_COUNT] = {};
+
+    void reset() noexcept;
+};
+
+// Accumulates the performance counters of the calling thread into a phase, during its lifetime.
+// Does nothing if counters is null.
+class PerformanceCountersScope {
+public:
+    PerformanceCountersScope(FramePerformanceCounters* counters,
+            FramePerformanceCounters::Phase phase) noexcept;
+    ~PerformanceCountersScope() noexcept;
+
+    PerformanceCountersScope(PerformanceCountersScope const&) = delete;
+    PerformanceCountersScope& operator=(PerformanceCountersScope const&) = delete;
+
+private:
+    Renderer::FrameTimings::PhaseCounters* mPhase = nullptr;
+    utils::Profiler* mProfiler = nullptr;
+    utils::Profiler::Counters mStart;
+};
+
+// timings of a frame, as reported by FrameInfoManager a few frames later
+struct FrameTimingInfo {
+    uint32_t frameId = 0;
+    FrameInfo::duration gpuTime{};
+    FrameCpuTimings cpu;
+    FramePerformanceCounters counters;
+    bool hasCounters = false;
+    std::vector<Renderer::FrameTimings::Pass> passes;
+    uint32_t untimedPassCount = 0;
+};
+
+// counts of the work done to render a view, see Renderer::getFrameStatistics()
+struct ViewStatistics {
+    Renderer::FrameStatistics::View view;
+    std::vector<Renderer::FrameStatistics::Pass> passes;
+
+    // adds the commands recorded by a pass, passes with the same name are merged. This can be
+    // called concurrently by the parallel passes of a FrameGraph.
+    void addPass(const char* name, Renderer::FrameStatistics::Pass const& counts) noexcept;
+};
+
+// Gathers the statistics of the views rendered during a frame, and keeps those of the last one.
+class FrameStatisticsManager {
+public:
+    // engineUniformBufferBytes is FEngine::getUniformBufferBytes()
+    void beginFrame(uint32_t frameId, uint64_t engineUniformBufferBytes) noexcept;
+    void endFrame(uint64_t engineUniformBufferBytes) noexcept;
+
+    // the statistics of a view about to be rendered, valid until the next call
+    ViewStatistics& beginView() noexcept;
+
+    // bytes uploaded by a view, which the engine doesn't count
+    void addViewUniformBufferBytes(uint64_t size) noexcept {
+        mCurrent.viewUniformBufferBytes += size;
+    }
+
+    Renderer::FrameStatistics getLastFrameStatistics() const noexcept;
+
+private:
+    struct Frame {
+        uint32_t frameId = 0;
+        uint64_t uniformBufferBytes = 0;
+        uint64_t viewUniformBufferBytes = 0;
+        // only the first viewCount are used, the others keep their allocations for later frames
+        std::vector<ViewStatistics> views;
+        size_t viewCount = 0;
+    };
+    Frame mCurrent;
+    Frame mLast;
+    std::vector<Renderer::FrameStatistics::View> mLastViews;
 };
 
-class FrameInfoManager {
+class FrameInfoManager : public FrameGraph::ExecuteObserver {
     static constexpr size_t POOL_COUNT = 8;
     static constexpr size_t MAX_FRAMETIME_HISTORY = 32u;
+    // Each frame is measured with consecutive timer queries, because timer queries can't be
+    // nested on all backends. A few are needed to switch between categories (e.g. with several
+    // views), and one per pass when pass timings are enabled, which beginExecute() adds to the
+    // frame's budget. The last segment of the budget is reserved for the overflow, see
+    // beginSegment().
+    static constexpr size_t BASE_SEGMENT_COUNT = 8;
+    // Each run of commands using the same material variant gets a segment when the material
+    // statistics are enabled, see beginMaterial().
+    static constexpr size_t MAX_MATERIAL_SEGMENT_COUNT = 512;
 
 public:
     using duration = FrameInfo::duration;
 
+    // what the GPU time is attributed to
+    enum class Category : uint8_t {
+        MAIN,
+        POST_PROCESSING
+    };
+
     struct Config {
         duration targetFrameTime;
         float headRoomRatio;
+        float postProcessingRatio;
         float oneOverTau;
         uint32_t historySize;
     };
@@ -62,6 +186,40 @@ public:
     void beginFrame(Config const& config, uint32_t frameId);  // call this immediately after "make current"
     void endFrame(); // call this immediately before "swap buffers"
 
+    // attributes the GPU commands issued from now on to the given category
+    void beginSegment(Category category);
+
+    // times each FrameGraph pass it's passed to as an observer
+    void setPassTimingsEnabled(bool enabled) noexcept { mPassTimingsEnabled = enabled; }
+    bool isPassTimingsEnabled() const noexcept { return mPassTimingsEnabled; }
+
+    void beginExecute(size_t passCount) noexcept override;
+    void beginPass(const char* name) noexcept override;
+    void endPass() noexcept override;
+
+    // Attributes the GPU commands issued from now on to a material variant, until endMaterial().
+    // Only used when the Engine's MaterialStatistics are enabled, which need the commands to be
+    // issued in order.
+    void beginMaterial(uint32_t materialId, uint8_t variant) noexcept;
+    void endMaterial() noexcept;
+
+    // samples hardware performance counters around the phases of each frame
+    void setPerformanceCountersEnabled(bool enabled) noexcept {
+        mPerformanceCountersEnabled = enabled;
+    }
+
+    // performance counters of the current frame, or null if they're disabled
+    FramePerformanceCounters* getPerformanceCounters() noexcept {
+        Segments& segments = mSegments[mIndex];
+        return segments.hasCounters ? &segments.counters : nullptr;
+    }
+
+    // CPU timings of the current frame, to be accumulated into by the renderer
+    FrameCpuTimings& getCpuTimings() noexcept { return mSegments[mIndex].cpu; }
+
+    // timings of the most recent frame whose GPU results are available
+    FrameTimingInfo const& getFrameTimings() const noexcept { return mFrameTimings; }
+
     FrameInfo const& getLastFrameInfo() const {
         return mFrameTimeHistory[0];
     }
@@ -72,15 +230,49 @@ public:
 
 
 private:
-    void update(Config const& config, duration lastFrameTime);
+    struct Segment {
+        backend::Handle<backend::HwTimerQuery> query;
+        Category category;
+        // name of the pass, or nullptr for the time between passes and the overflow
+        const char* name;
+        // whether this segment collects the time past the frame's budget
+        bool overflow = false;
+        // whether this segment continues the pass of the previous one
+        bool continued = false;
+        // whether the time goes to the material variant below, see beginMaterial()
+        bool hasMaterial = false;
+        uint8_t variant = 0;
+        uint32_t materialId = 0;
+    };
+
+    struct Segments {
+        // grows as needed, up to 'capacity'. Only the first 'count' are used.
+        std::vector<Segment> list;
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+        // passes that started after the overflow segment, and weren't timed
+        uint32_t untimedPassCount = 0;
+        uint32_t frameId = 0;
+        FrameCpuTimings cpu;
+        FramePerformanceCounters counters;
+        bool hasCounters = false;
+    };
+
+    bool beginSegment(Category category, const char* name, bool continued = false);
+    bool readSegments(Segments const& segments, duration times[2]);
+    void update(Config const& config, duration const times[2]);
     FEngine& mEngine;
-    backend::Handle<backend::HwTimerQuery> mQueries[POOL_COUNT];
-    duration mFrameTime{};
+    Segments mSegments[POOL_COUNT];
+    duration mTimes[2]{};
     uint32_t mIndex = 0;
     uint32_t mLast = 0;
+    bool mPassTimingsEnabled = false;
+    bool mPerformanceCountersEnabled = false;
+    bool mInPass = false;
 
     std::array<FrameInfo, MAX_FRAMETIME_HISTORY> mFrameTimeHistory;
     uint32_t mFrameTimeHistorySize = 0;
+    FrameTimingInfo mFrameTimings;
 };
 
 
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__ANDROID__)
+#include <utils/api_level.h>
+#include <dlfcn.h>
+#endif
+
+namespace filament {
+
+#if defined(__ANDROID__)
+
+struct AChoreographer;
+
+// The AChoreographer functions we need are only available from API 29 (the 64-bits frame
+// callback) and API 30 (the refresh rate callback), so they're looked up at runtime.
+struct FramePacer::Choreographer {
+    using FrameCallback = void (*)(int64_t frameTimeNanos, void* data);
+    using RefreshRateCallback = void (*)(int64_t vsyncPeriodNanos, void* data);
+
+    AChoreographer* (*getInstance)() = nullptr;
+    void (*postFrameCallback64)(AChoreographer*, FrameCallback, void*) = nullptr;
+    void (*registerRefreshRateCallback)(AChoreographer*, RefreshRateCallback, void*) = nullptr;
+    void (*unregisterRefreshRateCallback)(AChoreographer*, RefreshRateCallback, void*) = nullptr;
+
+    AChoreographer* instance = nullptr;
+    std::atomic<int64_t> vsyncNanos{ 0 };
+    std::atomic<int64_t> vsyncPeriodNanos{ 0 };
+
+    // A frame callback is always pending, so the object is deleted by that callback once the
+    // FramePacer has stopped, see stop().
+    std::atomic<bool> stopped{ false };
+
+    template <typename T>
+    static void loadSymbol(T*& pfn, const char* symbol) noexcept {
+        pfn = (T*)dlsym(RTLD_DEFAULT, symbol);
+    }
+
+    static void onFrame(int64_t frameTimeNanos, void* data) {
+        Choreographer* const choreographer = static_cast<Choreographer*>(data);
+        if (choreographer->stopped.load(std::memory_order_relaxed)) {
+            delete choreographer;
+            return;
+        }
+        // the frame time is the vsync, in the CLOCK_MONOTONIC time base of steady_clock
+        choreographer->vsyncNanos.store(frameTimeNanos, std::memory_order_relaxed);
+        choreographer->postFrameCallback64(choreographer->instance, onFrame, choreographer);
+    }
+
+    static void onRefreshRate(int64_t vsyncPeriodNanos, void* data) {
+        Choreographer* const choreographer = static_cast<Choreographer*>(data);
+        choreographer->vsyncPeriodNanos.store(vsyncPeriodNanos, std::memory_order_relaxed);
+    }
+
+    // returns nullptr if AChoreographer isn't available, or if this thread has no looper
+    static Choreographer* start() noexcept {
+        if (utils::api_level() < 29) {
+            return nullptr;
+        }
+        Choreographer* choreographer = new Choreographer;
+        loadSymbol(choreographer->getInstance, "AChoreographer_getInstance");
+        loadSymbol(choreographer->postFrameCallback64, "AChoreographer_postFrameCallback64");
+        loadSymbol(choreographer->registerRefreshRateCallback,
+                "AChoreographer_registerRefreshRateCallback");
+        loadSymbol(choreographer->unregisterRefreshRateCallback,
+                "AChoreographer_unregisterRefreshRateCallback");
+        if (choreographer->getInstance && choreographer->postFrameCallback64) {
+            choreographer->instance = choreographer->getInstance();
+        }
+        if (!choreographer->instance) {
+            delete choreographer;
+            return nullptr;
+        }
+        if (choreographer->registerRefreshRateCallback &&
+                choreographer->unregisterRefreshRateCallback) {
+            choreographer->registerRefreshRateCallback(choreographer->instance,
+                    onRefreshRate, choreographer);
+        }
+        choreographer->postFrameCallback64(choreographer->instance, onFrame, choreographer);
+        return choreographer;
+    }
+
+    static void stop(Choreographer* choreographer) noexcept {
+        if (choreographer->registerRefreshRateCallback &&
+                choreographer->unregisterRefreshRateCallback) {
+            choreographer->unregisterRefreshRateCallback(choreographer->instance,
+                    onRefreshRate, choreographer);
+        }
+        choreographer->stopped.store(true, std::memory_order_relaxed);
+    }
+
+    int64_t getVsyncNanos() const noexcept {
+        return vsyncNanos.load(std::memory_order_relaxed);
+    }
+
+    int64_t getVsyncPeriodNanos() const noexcept {
+        return vsyncPeriodNanos.load(std::memory_order_relaxed);
+    }
+};
+
+#else
+
+struct FramePacer::Choreographer {
+    static Choreographer* start() noexcept { return nullptr; }
+    static void stop(Choreographer*) noexcept { }
+    int64_t getVsyncNanos() const noexcept { return 0; }
+    int64_t getVsyncPeriodNanos() const noexcept { return 0; }
+};
+
+#endif
+
+FramePacer::FramePacer() noexcept = default;
+
+FramePacer::~FramePacer() noexcept {
+    setEnabled(false);
+}
+
+void FramePacer::setEnabled(bool enabled) noexcept {
+    if (mEnabled == enabled) {
+        return;
+    }
+    mEnabled = enabled;
+    if (enabled) {
+        mChoreographer = Choreographer::start();
+    } else if (mChoreographer) {
+        Choreographer::stop(mChoreographer);
+        mChoreographer = nullptr;
+    }
+    mFrameVsync = {};
+    mLastPresentationTime = {};
+    mUnderBudgetCount = 0;
+    mOverBudgetCount = 0;
+}
+
+FramePacer::time_point FramePacer::getVsync(uint64_t vsyncSteadyClockTimeNano,
+        time_point now) const noexcept {
+    if (vsyncSteadyClockTimeNano) {
+        return time_point{ duration(vsyncSteadyClockTimeNano) };
+    }
+    const int64_t vsync = mChoreographer ? mChoreographer->getVsyncNanos() : 0;
+    return vsync ? time_point{ duration(vsync) } : now;
+}
+
+FramePacer::duration FramePacer::getRefreshPeriod(float refreshRate) const noexcept {
+    const int64_t period = mChoreographer ? mChoreographer->getVsyncPeriodNanos() : 0;
+    if (period > 0) {
+        return std::chrono::nanoseconds(period);
+    }
+    if (refreshRate > 0.0f) {
+        return std::chrono::nanoseconds(int64_t(1e9 / refreshRate));
+    }
+    return {};
+}
+
+bool FramePacer::beginFrame(time_point vsync, duration refreshPeriod,
+        uint8_t minInterval) noexcept {
+    if (refreshPeriod != mRefreshPeriod) {
+        // the display changed its refresh rate, start over from this frame
+        mRefreshPeriod = refreshPeriod;
+        mFrameVsync = {};
+        mLastPresentationTime = {};
+    }
+
+    mMinInterval = std::min(std::max(minInterval, uint8_t(1)), MAX_INTERVAL);
+    mInterval = std::max(mInterval, mMinInterval);
+
+    if (mRefreshPeriod == duration{}) {
+        return true;
+    }
+
+    // a vsync can be reported late by up to half a refresh period
+    if (mFrameVsync != time_point{} &&
+            vsync - mFrameVsync < mInterval * mRefreshPeriod - mRefreshPeriod / 2) {
+        return false;
+    }
+    mFrameVsync = vsync;
+    return true;
+}
+
+FramePacer::time_point FramePacer::getPresentationTime(duration vsyncOffset) noexcept {
+    // the hardware vsync of the frame
+    const time_point hwVsync = mFrameVsync - vsyncOffset;
+
+    // The frame can't be displayed before its CPU and GPU work is done. It's presented one
+    // interval after the previous frame to keep the cadence, unless that's too early, i.e. a
+    // frame was missed, or too far ahead, where queueing it would block the next frames.
+    const time_point earliest = hwVsync + LATENCY * mRefreshPeriod;
+    const time_point next = mLastPresentationTime + mInterval * mRefreshPeriod;
+    const bool onCadence = mLastPresentationTime != time_point{} &&
+            next >= earliest && next < earliest + mInterval * mRefreshPeriod;
+    mLastPresentationTime = onCadence ? next : earliest;
+
+    // the presentation time is set to the middle of the period we're interested in
+    return mLastPresentationTime - mRefreshPeriod / 2;
+}
+
+void FramePacer::update(std::chrono::duration<float> gpuFrameTime, bool skipped) noexcept {
+    if (mRefreshPeriod == duration{}) {
+        return;
+    }
+    using seconds = std::chrono::duration<float>;
+    const float period = std::chrono::duration_cast<seconds>(mRefreshPeriod).count();
+    const float gpuTime = gpuFrameTime.count();
+
+    // GPU times are measured a few frames late, so the interval only changes once they have
+    // been over (or well under) budget for a few frames, but a skipped frame raises it now.
+    const bool overBudget = gpuTime > float(mInterval) * period;
+    mOverBudgetCount = overBudget ? mOverBudgetCount + 1 : 0;
+    if ((skipped || mOverBudgetCount >= RAISE_FRAME_COUNT) && mInterval < MAX_INTERVAL) {
+        mInterval++;
+        mOverBudgetCount = 0;
+        mUnderBudgetCount = 0;
+        return;
+    }
+
+    const bool underBudget = gpuTime > 0.0f && gpuTime < 0.8f * float(mInterval - 1) * period;
+    mUnderBudgetCount = underBudget ? mUnderBudgetCount + 1 : 0;
+    if (mUnderBudgetCount >= LOWER_FRAME_COUNT && mInterval > mMinInterval) {
+        mInterval--;
+        mUnderBudgetCount = 0;
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMEPACER_H
+#define TNT_FILAMENT_FRAMEPACER_H
+
+#include <chrono>
+
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * FramePacer schedules the frames of a Renderer on the vsync of the display: it picks the frame
+ * interval, in refresh periods, decides which vsyncs start a frame, and when each frame is
+ * presented, so that frames are displayed at a steady cadence without stuffing the queue of the
+ * swap chain.
+ *
+ * On Android (API 29 and above), the vsync and refresh period come from AChoreographer when the
+ * thread calling Renderer::beginFrame() has a looper. Otherwise, the vsync passed to beginFrame()
+ * and DisplayInfo::refreshRate are used.
+ */
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+    using time_point = clock::time_point;
+    using duration = clock::duration;
+
+    // longest frame interval picked when the GPU can't keep up, in refresh periods
+    static constexpr uint8_t MAX_INTERVAL = 4;
+
+    FramePacer() noexcept;
+    ~FramePacer() noexcept;
+
+    FramePacer(FramePacer const&) = delete;
+    FramePacer& operator=(FramePacer const&) = delete;
+
+    // Starts or stops following the display's vsync. This must be called on the thread that
+    // calls Renderer::beginFrame().
+    void setEnabled(bool enabled) noexcept;
+
+    bool isEnabled() const noexcept { return mEnabled; }
+
+    // Returns the vsync of the frame beginning now: the vsync given to beginFrame() if any, or
+    // the last one reported by the platform, or 'now'.
+    time_point getVsync(uint64_t vsyncSteadyClockTimeNano, time_point now) const noexcept;
+
+    // Returns the refresh period reported by the platform, or the one of 'refreshRate'. Zero
+    // when the refresh rate is unknown, e.g. offscreen, in which case frames aren't paced.
+    duration getRefreshPeriod(float refreshRate) const noexcept;
+
+    // Returns whether a frame starts at this vsync, i.e. whether it's a whole interval after the
+    // vsync of the previous frame. 'minInterval' is the interval requested by the application.
+    bool beginFrame(time_point vsync, duration refreshPeriod, uint8_t minInterval) noexcept;
+
+    // Returns the presentation time of the frame started by the last beginFrame(). Frames are
+    // presented one interval apart, and no earlier than two refresh periods after their vsync.
+    time_point getPresentationTime(duration vsyncOffset) noexcept;
+
+    // Adapts the interval to the GPU time of the recent frames (zero if unknown), and to whether
+    // a frame was just skipped because the GPU is running behind.
+    void update(std::chrono::duration<float> gpuFrameTime, bool skipped) noexcept;
+
+    // current frame interval, in refresh periods
+    uint8_t getInterval() const noexcept { return mInterval; }
+
+private:
+    // frames needed under (resp. over) budget before the interval is lowered (resp. raised)
+    static constexpr uint32_t LOWER_FRAME_COUNT = 30;
+    static constexpr uint32_t RAISE_FRAME_COUNT = 3;
+
+    // refresh periods between a vsync and the earliest presentation of its frame
+    static constexpr uint32_t LATENCY = 2;
+
+    struct Choreographer;
+    Choreographer* mChoreographer = nullptr;
+
+    duration mRefreshPeriod{};
+    time_point mFrameVsync{};
+    time_point mLastPresentationTime{};
+    uint32_t mUnderBudgetCount = 0;
+    uint32_t mOverBudgetCount = 0;
+    uint8_t mMinInterval = 1;
+    uint8_t mInterval = 1;
+    bool mEnabled = false;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMEPACER_H
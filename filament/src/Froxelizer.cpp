@@ -56,45 +56,75 @@ static constexpr bool USE_NON_SQUARE_FROXELS = false;
 constexpr size_t FROXEL_BUFFER_WIDTH_SHIFT  = 6u;
 constexpr size_t FROXEL_BUFFER_WIDTH        = 1u << FROXEL_BUFFER_WIDTH_SHIFT;
 constexpr size_t FROXEL_BUFFER_WIDTH_MASK   = FROXEL_BUFFER_WIDTH - 1u;
-constexpr size_t FROXEL_BUFFER_HEIGHT       = (FROXEL_BUFFER_ENTRY_COUNT_MAX + FROXEL_BUFFER_WIDTH_MASK) / FROXEL_BUFFER_WIDTH;
 
 constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 5u;
 constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
+constexpr size_t RECORD_BUFFER_WIDTH_MASK   = RECORD_BUFFER_WIDTH - 1u;
 
-constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
-constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
-
-// Buffer needed for Froxelizer internal data structures (~256 KiB)
-constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
-                                                 (FROXEL_BUFFER_ENTRY_COUNT_MAX +
-                                                  FROXEL_BUFFER_ENTRY_COUNT_MAX + 3 +
-                                                  FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
-
+// the record buffer is sized for this many lights per froxel (on average)
+constexpr size_t RECORD_BUFFER_ENTRIES_PER_FROXEL = 8;
+constexpr size_t RECORD_BUFFER_ENTRY_COUNT_MAX    = 65536;
 
 // number of lights processed by one group (e.g. 32)
 static constexpr size_t LIGHT_PER_GROUP = sizeof(Froxelizer::LightGroupType) * 8;
 
-// number of groups (i.e. jobs) to use for froxelization (e.g. 8)
-static constexpr size_t GROUP_COUNT =
-        (CONFIG_MAX_LIGHT_COUNT + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
-
-
 // record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
 // so its maximum size is 128 KiB
-static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
+static_assert(RECORD_BUFFER_ENTRY_COUNT_MAX <= 65536,
         "RecordBuffer cannot be larger than 65536 entries");
 
+static_assert(FROXEL_BUFFER_ENTRY_COUNT_MAX <= std::numeric_limits<uint16_t>::max(),
+        "froxel indices must fit on 16 bits");
+
+// Buffer needed for Froxelizer internal data structures (~256 KiB)
+static size_t getFroxelDataArenaSize(Engine::Config const& config) noexcept {
+    return sizeof(float4) * (config.froxelCount + config.froxelCount + 3 +
+                             config.froxelSliceCount / 4 + 1);
+}
+
+static size_t getRecordBufferEntryCount(Engine::Config const& config) noexcept {
+    const size_t count = std::min(RECORD_BUFFER_ENTRY_COUNT_MAX,
+            config.froxelCount * RECORD_BUFFER_ENTRIES_PER_FROXEL);
+    // round to a whole number of lines of the record buffer
+    return (count + RECORD_BUFFER_WIDTH_MASK) & ~RECORD_BUFFER_WIDTH_MASK;
+}
+
+size_t Froxelizer::getGroupCount(size_t maxLightCount) noexcept {
+    constexpr size_t r = sizeof(LightRecord::bitset::container_type) / sizeof(LightGroupType);
+    const size_t count = (maxLightCount + LIGHT_PER_GROUP - 1) / LIGHT_PER_GROUP;
+    return (count + r - 1) / r * r;
+}
+
+size_t Froxelizer::getPerFrameArenaSize(Engine::Config const& config) noexcept {
+    // see prepare()
+    return config.froxelCount * sizeof(LightRecord) + CACHELINE_SIZE +
+           getGroupCount(config.maxLightCount) * config.froxelCount * sizeof(LightGroupType) +
+           CACHELINE_SIZE;
+}
+
+size_t Froxelizer::getPerFrameArenaSizeOverhead(Engine::Config const& config) noexcept {
+    const size_t size = getPerFrameArenaSize(config);
+    const size_t defaultSize = getPerFrameArenaSize(Engine::Config{});
+    return size > defaultSize ? size - defaultSize : 0;
+}
+
 Froxelizer::Froxelizer(FEngine& engine)
-        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
+        : mArena("froxel", getFroxelDataArenaSize(engine.getConfig())),
+          mFroxelBufferEntryCount(engine.getConfig().froxelCount),
+          mFroxelSliceCount(engine.getConfig().froxelSliceCount),
+          mRecordBufferEntryCount(uint32_t(getRecordBufferEntryCount(engine.getConfig()))),
+          mGroupCount(uint32_t(getGroupCount(engine.getConfig().maxLightCount))) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
     // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
-    mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
+    mRecordsBuffer = GPUBuffer(driverApi, { type, 1 },
+            RECORD_BUFFER_WIDTH, mRecordBufferEntryCount / RECORD_BUFFER_WIDTH);
     mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
-            FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+            FROXEL_BUFFER_WIDTH,
+            (mFroxelBufferEntryCount + FROXEL_BUFFER_WIDTH_MASK) / FROXEL_BUFFER_WIDTH);
 }
 
 Froxelizer::~Froxelizer() {
@@ -154,29 +184,33 @@ bool Froxelizer::prepare(
      * the command stream.
      */
 
-    // froxel buffer (~32 KiB)
+    // froxel buffer (~32 KiB w/ 8192 froxels), with whole rows because that's what we upload
+    const size_t froxelBufferSize =
+            (mFroxelBufferEntryCount + FROXEL_BUFFER_WIDTH_MASK) & ~FROXEL_BUFFER_WIDTH_MASK;
     mFroxelBufferUser = {
-            driverApi.allocatePod<FroxelEntry>(FROXEL_BUFFER_ENTRY_COUNT_MAX),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
+            driverApi.allocatePod<FroxelEntry>(froxelBufferSize),
+            froxelBufferSize };
+    mRecordCount = 0;
 
-    // record buffer (~64 KiB)
+    // record buffer (~64 KiB w/ 8192 froxels)
     mRecordBufferUser = {
-            driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT),
-            RECORD_BUFFER_ENTRY_COUNT };
+            driverApi.allocatePod<RecordBufferType>(mRecordBufferEntryCount),
+            mRecordBufferEntryCount };
 
     /*
      * Temporary allocations for processing all froxel data
+     * (this must match getPerFrameArenaSize())
      */
 
-    // light records per froxel (~256 KiB)
+    // light records per froxel (~256 KiB w/ 8192 froxels)
     mLightRecords = {
-            arena.allocate<LightRecord>(FROXEL_BUFFER_ENTRY_COUNT_MAX, CACHELINE_SIZE),
-            FROXEL_BUFFER_ENTRY_COUNT_MAX };
+            arena.allocate<LightRecord>(mFroxelBufferEntryCount, CACHELINE_SIZE),
+            mFroxelBufferEntryCount };
 
-    // froxel thread data (~256 KiB)
+    // froxel thread data (~256 KiB w/ 8192 froxels and 256 lights)
     mFroxelShardedData = {
-            arena.allocate<FroxelThreadData>(GROUP_COUNT, CACHELINE_SIZE),
-            uint32_t(GROUP_COUNT)
+            arena.allocate<LightGroupType>(mGroupCount * mFroxelBufferEntryCount, CACHELINE_SIZE),
+            mGroupCount * mFroxelBufferEntryCount
     };
 
     assert(mFroxelBufferUser.begin());
@@ -192,16 +226,15 @@ bool Froxelizer::prepare(
 
 void Froxelizer::computeFroxelLayout(
         uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-        filament::Viewport const& viewport) noexcept {
+        filament::Viewport const& viewport, size_t froxelCount, size_t froxelSliceCount) noexcept {
 
     if (USE_NON_SQUARE_FROXELS == false) {
         const uint32_t width  = std::max(16u, viewport.width);
         const uint32_t height = std::max(16u, viewport.height);
 
-        // calculate froxel dimension from FROXEL_BUFFER_ENTRY_COUNT_MAX and viewport
+        // calculate froxel dimension from the froxel count and viewport
         // - Start from the maximum number of froxels we can use in the x-y plane
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
-        size_t froxelPlaneCount = FROXEL_BUFFER_ENTRY_COUNT_MAX / froxelSliceCount;
+        size_t froxelPlaneCount = froxelCount / froxelSliceCount;
         // - compute the number of square froxels we need in width and height, rounded down
         //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
         //            |  froxelCountX / froxelCountY == width / height
@@ -230,7 +263,7 @@ void Froxelizer::computeFroxelLayout(
         // TODO: don't hardcode this
         *countX = uint16_t(32);
         *countY = uint16_t(16);
-        *countZ = uint16_t(FEngine::CONFIG_FROXEL_SLICE_COUNT);
+        *countZ = uint16_t(froxelSliceCount);
         if (viewport.height > viewport.width) {
             std::swap(*countX, *countY);
         }
@@ -247,7 +280,8 @@ bool Froxelizer::update() noexcept {
 
         uint2 froxelDimension;
         uint16_t froxelCountX, froxelCountY, froxelCountZ;
-        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ, viewport);
+        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ, viewport,
+                mFroxelBufferEntryCount, mFroxelSliceCount);
 
         mFroxelDimension = froxelDimension;
         mClipToFroxelX = (0.5f * viewport.width)  / froxelDimension.x;
@@ -261,7 +295,7 @@ bool Froxelizer::update() noexcept {
                << froxelDimension.x << "x" << froxelDimension.y << io::endl
                << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelCountZ
                << " = " << (froxelCountX * froxelCountY * froxelCountZ)
-               << " (" << FROXEL_BUFFER_ENTRY_COUNT_MAX - froxelCountX * froxelCountY * froxelCountZ << " lost)"
+               << " (" << mFroxelBufferEntryCount - froxelCountX * froxelCountY * froxelCountZ << " lost)"
                << io::endl;
 #endif
 
@@ -512,8 +546,11 @@ std::pair<size_t, size_t> Froxelizer::clipToIndices(float2 const& clip) const no
 
 void Froxelizer::commit(backend::DriverApi& driverApi) {
     // send data to GPU
-    mFroxelBuffer.commit(driverApi, mFroxelBufferUser);
-    mRecordsBuffer.commit(driverApi, mRecordBufferUser);
+    // only the froxels of the current layout and the records they use need to be uploaded
+    mFroxelBuffer.commit(driverApi,
+            mFroxelBufferUser.cbegin(), mFroxelBufferUser.cbegin() + mFroxelCount);
+    mRecordsBuffer.commit(driverApi,
+            mRecordBufferUser.cbegin(), mRecordBufferUser.cbegin() + mRecordCount);
 #ifndef NDEBUG
     mFroxelBufferUser.clear();
     mRecordBufferUser.clear();
@@ -526,7 +563,7 @@ void Froxelizer::froxelizeLights(FEngine& engine,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     // note: this is called asynchronously
     froxelizeLoop(engine, camera, lightData);
-    froxelizeAssignRecordsCompress();
+    froxelizeAssignRecordsCompress(engine.getJobSystem());
 
 #ifndef NDEBUG
     if (lightData.size()) {
@@ -539,7 +576,7 @@ void Froxelizer::froxelizeLights(FEngine& engine,
             // go through every lights for that froxel
             for (size_t i = 0; i < entry.count; i++) {
                 // get the light index
-                assert(entry.offset + i < RECORD_BUFFER_ENTRY_COUNT);
+                assert(entry.offset + i < mRecordBufferEntryCount);
 
                 size_t lightIndex = recordBufferUser[entry.offset + i];
                 assert(lightIndex <= CONFIG_MAX_LIGHT_INDEX);
@@ -552,27 +589,52 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 #endif
 }
 
+bool Froxelizer::hasLightsInRange(CameraInfo const& camera,
+        const FScene::LightSoa& lightData) const noexcept {
+    auto const* UTILS_RESTRICT spheres = lightData.data<FScene::POSITION_RADIUS>();
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        // same test as froxelizePointAndSpotLight(), z values are negative
+        const float z = (camera.view * float4{ spheres[i].xyz, 1 }).z;
+        if (z + spheres[i].w >= -mZLightFar) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Froxelizer::froxelizeLoop(FEngine& engine,
         const CameraInfo& UTILS_RESTRICT camera,
         const FScene::LightSoa& UTILS_RESTRICT lightData) noexcept {
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
+    Slice<LightGroupType> froxelThreadData = mFroxelShardedData;
     memset(froxelThreadData.data(), 0, froxelThreadData.sizeInBytes());
+    const size_t groupCount = mGroupCount;
+    assert(lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT <= groupCount * LIGHT_PER_GROUP);
 
     auto& lcm = engine.getLightManager();
     auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
 
-    auto process = [ this, &froxelThreadData,
+    // Each job processes the lights of one group (which share the same froxel bits) for a range
+    // of depth slices, so that jobs never write to the same froxels. Splitting the slices
+    // keeps all the threads busy even with few light groups.
+    const size_t froxelCountZ = mFroxelCountZ;
+    const size_t sliceRangeCount = std::min(froxelCountZ,
+            std::max(size_t(1), FROXELIZE_JOB_COUNT / groupCount));
+    const size_t slicesPerRange = (froxelCountZ + sliceRangeCount - 1) / sliceRangeCount;
+
+    auto process = [ this, &froxelThreadData, groupCount,
                      spheres, directions, instances, &camera, &lcm ]
-            (size_t count, size_t offset, size_t stride) {
+            (size_t count, size_t group, size_t zBegin, size_t zEnd) {
 
         const mat4f& projection = mProjection;
         const mat3f& vn = camera.view.upperLeft();
+        LightGroupType* const threadData =
+                froxelThreadData.data() + group * mFroxelBufferEntryCount;
 
-        for (size_t i = offset; i < count; i += stride) {
+        for (size_t i = group; i < count; i += groupCount) {
             const size_t j = i + FScene::DIRECTIONAL_LIGHTS_COUNT;
             FLightManager::Instance li = instances[j];
             LightParams light = {
@@ -583,129 +645,213 @@ void Froxelizer::froxelizeLoop(FEngine& engine,
                     .radius = spheres[j].w,
             };
 
-            const size_t group = i % GROUP_COUNT;
-            const size_t bit   = i / GROUP_COUNT;
+            const size_t bit = i / groupCount;
             assert(bit < LIGHT_PER_GROUP);
 
-            FroxelThreadData& threadData = froxelThreadData[group];
-            froxelizePointAndSpotLight(threadData, bit, projection, light);
+            froxelizePointAndSpotLight(threadData, bit, projection, light, zBegin, zEnd);
         }
     };
 
-    // we do 64 lights per job
     JobSystem& js = engine.getJobSystem();
+    const size_t lightCount = lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT;
 
     constexpr bool SINGLE_THREADED = false;
     if (!SINGLE_THREADED) {
         auto *parent = js.createJob();
-        for (size_t i = 0; i < GROUP_COUNT; i++) {
-            js.run(jobs::createJob(js, parent, std::cref(process),
-                    lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, i, GROUP_COUNT));
+        for (size_t i = 0; i < std::min(groupCount, lightCount); i++) {
+            for (size_t z = 0; z < froxelCountZ; z += slicesPerRange) {
+                js.run(jobs::createJob(js, parent, std::cref(process),
+                        lightCount, i, z, std::min(froxelCountZ, z + slicesPerRange)));
+            }
         }
         js.runAndWait(parent);
     } else {
-        js.runAndWait(jobs::createJob(js, nullptr, std::cref(process),
-                lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT, 0, 1)
-        );
+        for (size_t i = 0; i < groupCount; i++) {
+            process(lightCount, i, 0, froxelCountZ);
+        }
     }
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress() noexcept {
+void Froxelizer::froxelizeAssignRecordsCompress(JobSystem& js) noexcept {
 
     SYSTRACE_CALL();
 
-    Slice<FroxelThreadData> froxelThreadData = mFroxelShardedData;
+    // The froxels are split in ranges of whole rows, which are compressed in parallel. This
+    // is done in two passes: the first one computes how many records each range needs, which
+    // gives the offset of each range in the record buffer, the second one writes them.
+    const size_t froxelCountX = mFroxelCountX;
+    const size_t rowCount = getFroxelCount() / froxelCountX;
+    const size_t rangeCount = std::min(rowCount, FROXELIZE_JOB_COUNT);
+    const size_t rowsPerRange = (rowCount + rangeCount - 1) / rangeCount;
+    uint32_t offsets[FROXELIZE_JOB_COUNT + 1];
+
+    // occupancy of each range, for the statistics
+    uint32_t maxLightCounts[FROXELIZE_JOB_COUNT];
+    uint32_t lightCounts[FROXELIZE_JOB_COUNT];
+    uint32_t emptyCounts[FROXELIZE_JOB_COUNT];
+
+    auto forEachRange = [&](auto&& work) {
+        auto job = [&work, rowsPerRange, rowCount, froxelCountX](uint32_t start, uint32_t c) {
+            for (uint32_t i = start; i < start + c; i++) {
+                const size_t b = std::min(rowCount, i * rowsPerRange);
+                const size_t e = std::min(rowCount, b + rowsPerRange);
+                work(i, b * froxelCountX, e * froxelCountX);
+            }
+        };
+        js.runAndWait(jobs::parallel_for(js, nullptr, 0, uint32_t(rangeCount),
+                std::cref(job), jobs::CountSplitter<1, 8>()));
+    };
+
+    forEachRange([&](size_t range, size_t begin, size_t end) {
+        convertLightRecords(begin, end);
+        offsets[range + 1] = compressRecords<false>(begin, end, 0);
+
+        LightRecord const* const UTILS_RESTRICT records = mLightRecords.data();
+        uint32_t maxCount = 0, count = 0, emptyCount = 0;
+        for (size_t i = begin; i < end; i++) {
+            // same limit as compressRecords()
+            const uint32_t c = uint32_t(std::min(size_t(255), records[i].lights.count()));
+            maxCount = std::max(maxCount, c);
+            count += c;
+            emptyCount += c ? 0 : 1;
+        }
+        maxLightCounts[range] = maxCount;
+        lightCounts[range] = count;
+        emptyCounts[range] = emptyCount;
+    });
+
+    offsets[0] = 0;
+    for (size_t i = 0; i < rangeCount; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    forEachRange([this, &offsets](size_t range, size_t begin, size_t end) {
+        compressRecords<true>(begin, end, offsets[range]);
+    });
+
+    // records past the end of the buffer are dropped
+    mRecordCount = std::min(offsets[rangeCount], mRecordBufferEntryCount);
+
+    Statistics stats;
+    uint64_t lightCount = 0, emptyCount = 0;
+    for (size_t i = 0; i < rangeCount; i++) {
+        stats.maxLightCount = std::max(stats.maxLightCount, maxLightCounts[i]);
+        lightCount += lightCounts[i];
+        emptyCount += emptyCounts[i];
+    }
+    const size_t froxelCount = rowCount * froxelCountX;
+    stats.averageLightCount = froxelCount ? float(lightCount) / float(froxelCount) : 0.0f;
+    stats.emptyFroxelRatio = froxelCount ? float(emptyCount) / float(froxelCount) : 1.0f;
+    mStatistics = stats;
+
+#ifndef NDEBUG
+    if (offsets[rangeCount] >= mRecordBufferEntryCount) {
+        slog.d << "out of space: " << offsets[rangeCount] << " records needed" << io::endl;
+    }
+#endif
+}
+
+void Froxelizer::convertLightRecords(size_t begin, size_t end) noexcept {
+    LightGroupType const* const UTILS_RESTRICT froxelThreadData = mFroxelShardedData.data();
+    const size_t groupCount = mGroupCount;
+    const size_t froxelBufferEntryCount = mFroxelBufferEntryCount;
 
     // convert froxel data from N groups of M bits to LightRecord::bitset, so we can
     // easily compare adjacent froxels, for compaction. The conversion loops below get
     // inlined and vectorized in release builds.
+    // The words of the bitset past groupCount lights are left cleared (see prepare()).
 
     // this gets very well vectorized...
-    utils::Slice<LightRecord> records(mLightRecords);
-    for (size_t j = 0, jc = FROXEL_BUFFER_ENTRY_COUNT_MAX; j < jc; j++) {
-        for (size_t i = 0; i < LightRecord::bitset::WORLD_COUNT; i++) {
-            using container_type = LightRecord::bitset::container_type;
-            constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
-            container_type b = froxelThreadData[i * r][j];
+    using container_type = LightRecord::bitset::container_type;
+    constexpr size_t r = sizeof(container_type) / sizeof(LightGroupType);
+    assert(groupCount % r == 0 && groupCount / r <= LightRecord::bitset::WORLD_COUNT);
+    LightRecord* const UTILS_RESTRICT records = mLightRecords.data();
+    for (size_t j = begin; j < end; j++) {
+        for (size_t i = 0, ic = groupCount / r; i < ic; i++) {
+            container_type b = 0;
             for (size_t k = 0; k < r; k++) {
-                b |= (container_type(froxelThreadData[i * r + k][j]) << (LIGHT_PER_GROUP * k));
+                b |= (container_type(froxelThreadData[(i * r + k) * froxelBufferEntryCount + j])
+                        << (LIGHT_PER_GROUP * k));
             }
             records[j].lights.getBitsAt(i) = b;
         }
     }
+}
 
-    uint16_t offset = 0;
+template<bool WRITE>
+uint32_t Froxelizer::compressRecords(size_t begin, size_t end, uint32_t offset) noexcept {
+    utils::Slice<LightRecord> records(mLightRecords);
     FroxelEntry* const UTILS_RESTRICT froxels = mFroxelBufferUser.data();
 
     const size_t froxelCountX = mFroxelCountX;
+    const size_t groupCount = mGroupCount;
+    const uint32_t recordBufferEntryCount = mRecordBufferEntryCount;
     RecordBufferType* const UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
 
-    // how many froxel record entries were reused (for debugging)
-    UTILS_UNUSED size_t reused = 0;
-
-    for (size_t i = 0, c = getFroxelCount(); i < c;) {
+    for (size_t i = begin, c = end; i < c;) {
         LightRecord b = records[i];
         if (b.lights.none()) {
-            froxels[i++].u32 = 0;
+            if (WRITE) {
+                froxels[i].u32 = 0;
+            }
+            i++;
             continue;
         }
 
         // We have a limitation of 255 spot + 255 point lights per froxel.
-        // note: initializer list for union cannot have more than one element
-        FroxelEntry entry; 
-        entry.offset = offset;
-        entry.count = (uint8_t)std::min(size_t(255), b.lights.count());
+        const size_t lightCount = std::min(size_t(255), b.lights.count());
 
-        const size_t lightCount = entry.count;
-
-        if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
-#ifndef NDEBUG
-            slog.d << "out of space: " << i << ", at " << offset << io::endl;
-#endif
-            // note: instead of dropping froxels we could look for similar records we've already
-            // filed up.
-            do { // this compiles to memset()
-                froxels[i++].u32 = 0;
-            } while(i < c);
-            goto out_of_memory;
+        // note: initializer list for union cannot have more than one element
+        FroxelEntry entry;
+        entry.offset = uint16_t(offset);
+        entry.count = uint8_t(lightCount);
+
+        if (WRITE) {
+            if (UTILS_UNLIKELY(offset + lightCount >= recordBufferEntryCount)) {
+                // Out of space, this froxel and all the following ones that don't reuse an
+                // earlier record get no lights (all the following offsets are larger).
+                // note: instead of dropping froxels we could look for similar records we've
+                // already filed up.
+                entry.u32 = 0;
+            } else {
+                // iterate the bitfield
+                auto * const beginPoint = froxelRecords + offset;
+                b.lights.forEachSetBit([point = beginPoint, beginPoint, groupCount](size_t l) mutable {
+                    // make sure to keep this code branch-less
+                    const size_t group = l / LIGHT_PER_GROUP;
+                    const size_t bit   = l % LIGHT_PER_GROUP;
+                    l = bit * groupCount + group;
+                    *point = (RecordBufferType)l;
+                    // we need to "cancel" the write if we have more than 255 spot or point
+                    // lights (this is a limitation of the data type used to store the light
+                    // counts per froxel)
+                    point += (point - beginPoint < 255) ? 1 : 0;
+                });
+            }
         }
 
-        // iterate the bitfield
-        auto * const beginPoint = froxelRecords + offset;
-        b.lights.forEachSetBit([point = beginPoint, beginPoint](size_t l) mutable {
-            // make sure to keep this code branch-less
-            const size_t word = l / LIGHT_PER_GROUP;
-            const size_t bit  = l % LIGHT_PER_GROUP;
-            l = (bit * GROUP_COUNT) | (word % GROUP_COUNT);
-            *point = (RecordBufferType)l;
-            // we need to "cancel" the write if we have more than 255 spot or point lights
-            // (this is a limitation of the data type used to store the light counts per froxel)
-            point += (point - beginPoint < 255) ? 1 : 0;
-        });
-
-        offset += lightCount;
+        offset += uint32_t(lightCount);
 
-#ifndef NDEBUG
-        if (lightCount) { reused--; }
-#endif
         do {
-#ifndef NDEBUG
-            if (lightCount) { reused++; }
-#endif
-            froxels[i++].u32 = entry.u32;
+            if (WRITE) {
+                froxels[i].u32 = entry.u32;
+            }
+            i++;
             if (i >= c) break;
 
-            if (records[i].lights != b.lights && i >= froxelCountX) {
+            // the froxel above must be in the same range, other ranges are written concurrently
+            if (records[i].lights != b.lights && i >= begin + froxelCountX) {
                 // if this froxel record doesn't match the previous one on its left,
                 // we re-try with the record above it, which saves many froxel records
                 // (north of 10% in practice).
                 b = records[i - froxelCountX];
-                entry.u32 = froxels[i - froxelCountX].u32;
+                if (WRITE) {
+                    entry.u32 = froxels[i - froxelCountX].u32;
+                }
             }
         } while(records[i].lights == b.lights);
     }
-out_of_memory:
-    ;
+    return offset;
 }
 
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
@@ -731,9 +877,10 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
 }
 
 void Froxelizer::froxelizePointAndSpotLight(
-        FroxelThreadData& froxelThread, size_t bit,
+        LightGroupType* froxelThread, size_t bit,
         mat4f const& UTILS_RESTRICT p,
-        const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
+        const Froxelizer::LightParams& UTILS_RESTRICT light,
+        size_t zBegin, size_t zEnd) const noexcept {
 
     if (UTILS_UNLIKELY(light.position.z + light.radius < -mZLightFar)) { // z values are negative
         // This light is fully behind LightFar, it doesn't light anything
@@ -750,8 +897,8 @@ void Froxelizer::froxelizePointAndSpotLight(
     const size_t x1 = mFroxelCountX;
     const size_t y0 = 0;
     const size_t y1 = mFroxelCountY - 1;
-    const size_t z0 = 0;
-    const size_t z1 = mFroxelCountZ - 1;
+    size_t z0 = 0;
+    size_t z1 = mFroxelCountZ - 1;
 #else
     // find a reasonable bounding-box in froxel space for the sphere by projecting
     // it's (clipped) bounding-box to clip-space and converting to froxel indices.
@@ -773,18 +920,22 @@ void Froxelizer::froxelizePointAndSpotLight(
     const auto imin = clipToIndices(min(xyLeftNear, xyLeftFar));
     const size_t x0 = imin.first;
     const size_t y0 = imin.second;
-    const size_t z0 = findSliceZ(znear);
+    size_t z0 = findSliceZ(znear);
 
     const auto imax = clipToIndices(max(xyRightNear, xyRightFar));
     const size_t x1 = imax.first  + 1;  // x1 points to 1 past the last value (like end() does
     const size_t y1 = imax.second;      // y1 points to the last value
-    const size_t z1 = findSliceZ(zfar); // z1 points to the last value
+    size_t z1 = findSliceZ(zfar);       // z1 points to the last value
 
     assert(x0 < x1);
     assert(y0 <= y1);
     assert(z0 <= z1);
 #endif
 
+    // only process the slices this job is responsible for
+    z0 = std::max(z0, zBegin);
+    z1 = std::min(z1, zEnd - 1);
+
     const size_t zcenter = findSliceZ(s.z);
     float4 const * const UTILS_RESTRICT planesX = mPlanesX;
     float4 const * const UTILS_RESTRICT planesY = mPlanesY;
@@ -818,33 +969,25 @@ void Froxelizer::froxelizePointAndSpotLight(
 
                 if (cy.w > 0) {
                     // The reduced sphere from the previous stage intersects this horizontal plane
-                    // and we now have new smaller sphere centered on these two previous planes
-                    size_t bx = std::numeric_limits<size_t>::max(); // horizontal begin index
-                    size_t ex = 0; // horizontal end index
-
-                    // find the begin index (left side)
-                    for (size_t ix = x0; ix <= x1; ++ix) {
-                        // froxel that contain the center if ths sphere is special, we don't even
-                        // need to do the intersection check, it's always true.
-                        if (UTILS_LIKELY(ix != xcenter)) {
-                            float4 const& plane = ix < xcenter ? planesX[ix + 1] : planesX[ix];
-                            if (spherePlaneDistanceSquared(cy, plane.x, plane.z) > 0) {
-                                // The reduced sphere from the previous stage intersects this
-                                // vertical plane, we record the min/max froxel indices
-                                bx = std::min(bx, ix);
-                                ex = std::max(ex, ix);
-                            }
-                        } else {
-                            // this is the froxel containing the center of the sphere, it is
-                            // definitely participating
-                            bx = std::min(bx, ix);
-                            assert(ix + 1 >= ex);
-                            ex = ix + 1;
-                        }
+                    // and we now have new smaller sphere centered on these two previous planes.
+                    // The froxel containing its center always participates, and because the
+                    // sphere is convex, the vertical planes it intersects are contiguous around
+                    // it. So we just need to count the planes intersected on each side, which
+                    // is branch-less and vectorizes well.
+                    const size_t xc = clamp(xcenter, x0, x1 - 1);
+
+                    // left side, froxel ix participates if its right plane is intersected
+                    size_t bx = xc; // horizontal begin index
+                    for (size_t ix = x0; ix < xc; ++ix) {
+                        float4 const& plane = planesX[ix + 1];
+                        bx -= spherePlaneDistanceSquared(cy, plane.x, plane.z) > 0 ? 1 : 0;
                     }
 
-                    if (UTILS_UNLIKELY(bx >= ex)) {
-                        continue;
+                    // right side, froxel ix participates if its left plane is intersected
+                    size_t ex = xc + 1; // horizontal end index
+                    for (size_t ix = xc + 1; ix < x1; ++ix) {
+                        float4 const& plane = planesX[ix];
+                        ex += spherePlaneDistanceSquared(cy, plane.x, plane.z) > 0 ? 1 : 0;
                     }
 
                     assert(bx < mFroxelCountX && ex <= mFroxelCountX);
@@ -120,8 +120,12 @@ void GPUBuffer::terminate(backend::DriverApi& driverApi) noexcept {
 void GPUBuffer::commitSlow(backend::DriverApi& driverApi, void const* begin, void const* end) noexcept {
     const uintptr_t sizeInBytes = uintptr_t(end) - uintptr_t(begin);
     assert(sizeInBytes <= mRowSizeInBytes * mHeight);
-    driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, mHeight,
-            { begin, sizeInBytes, mFormat, mType });
+    // only update the rows that are covered by the data
+    const uint32_t height = uint32_t((sizeInBytes + mRowSizeInBytes - 1) / mRowSizeInBytes);
+    if (height) {
+        driverApi.update2DImage(mTexture, 0, 0, 0, mWidth, height,
+                { begin, size_t(height) * mRowSizeInBytes, mFormat, mType });
+    }
 }
 
 } // namespace filament
@@ -61,7 +61,9 @@ public:
 
     size_t getSize() const noexcept { return mSize; }
 
-    // source data isn't copied and must stay valid until the command-buffer is executed
+    // Source data isn't copied and must stay valid until the command-buffer is executed.
+    // Only the rows covered by [begin, end) are updated, the last one is read whole, so the
+    // source must extend to the end of that row.
     void commit(backend::DriverApi& driverApi, void const* begin, void const* end) noexcept {
         commitSlow(driverApi, begin, end);
     }
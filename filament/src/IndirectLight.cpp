@@ -68,7 +68,8 @@ IndirectLight::Builder& IndirectLight::Builder::irradiance(uint8_t bands, float3
     return *this;
 }
 
-IndirectLight::Builder& IndirectLight::Builder::radiance(uint8_t bands, float3 const* sh) noexcept {
+// Converts the radiance SH of an environment to the irradiance SH expected by the shaders
+static void radianceToIrradiance(uint8_t bands, float3 const* sh, float3* irradiance) noexcept {
     // Coefficient for the polynomial form of the SH functions -- these were taken from
     // "Stupid Spherical Harmonics (SH)" by Peter-Pike Sloan
     // They simply come for expanding the computation of each SH function.
@@ -122,11 +123,15 @@ IndirectLight::Builder& IndirectLight::Builder::radiance(uint8_t bands, float3 c
     static_assert(Debug::almost(A[7], -0.273137f), "coefficient mismatch");
     static_assert(Debug::almost(A[8],  0.136569f), "coefficient mismatch");
 
-    float3 irradiance[9];
-    bands = std::min(bands, uint8_t(3));
     for (size_t i = 0, c = bands * bands; i<c; ++i) {
         irradiance[i] = sh[i] * A[i];
     }
+}
+
+IndirectLight::Builder& IndirectLight::Builder::radiance(uint8_t bands, float3 const* sh) noexcept {
+    float3 irradiance[9];
+    bands = std::min(bands, uint8_t(3));
+    radianceToIrradiance(bands, sh, irradiance);
     return this->irradiance(bands, irradiance);
 }
 
@@ -194,6 +199,11 @@ FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
 }
 
 void FIndirectLight::terminate(FEngine& engine) {
+    engine.cancelIblPrefilter(this);
+    if (mIrradianceReadback) {
+        // the readbacks still in flight are dropped
+        mIrradianceReadback->ibl = nullptr;
+    }
     if (FEngine::CONFIG_IBL_USE_IRRADIANCE_MAP) {
         FEngine::DriverApi& driver = engine.getDriverApi();
         driver.destroyTexture(getIrradianceHwHandle());
@@ -208,6 +218,30 @@ backend::Handle<backend::HwTexture> FIndirectLight::getIrradianceHwHandle() cons
     return mIrradianceTexture ? mIrradianceTexture->getHwHandle() : backend::Handle<backend::HwTexture> {};
 }
 
+bool FIndirectLight::prefilter(FEngine& engine, FTexture const* environment,
+        PrefilterOptions const& options) noexcept {
+    if (!ASSERT_PRECONDITION_NON_FATAL(environment &&
+            environment->getTarget() == Texture::Sampler::SAMPLER_CUBEMAP,
+            "the environment must be a cubemap")) {
+        return false;
+    }
+    FTexture const* const reflections = mReflectionsTexture;
+    if (!reflections || !any(reflections->getUsage() & Texture::Usage::STORAGE) ||
+            !engine.getPostProcessManager().hasComputeIblPrefilter(reflections->getFormat())) {
+        return false;
+    }
+    if (options.irradiance && !mIrradianceReadback) {
+        mIrradianceReadback = std::make_shared<IrradianceReadback>(IrradianceReadback{ this });
+    }
+    engine.enqueueIblPrefilter({ this, environment, options,
+            options.irradiance ? mIrradianceReadback : nullptr });
+    return true;
+}
+
+void FIndirectLight::setRadiance(float3 const* sh) noexcept {
+    radianceToIrradiance(3, sh, mIrradianceCoefs.data());
+}
+
 math::float3 FIndirectLight::getDirectionEstimate(math::float3 const* f) noexcept {
     // The linear direction is found as normalize(-sh[3], -sh[1], sh[2]), but the coefficients
     // we store are already pre-normalized, so the negative sign disappears.
@@ -296,6 +330,16 @@ Texture const* IndirectLight::getIrradianceTexture() const noexcept {
     return upcast(this)->getIrradianceTexture();
 }
 
+bool IndirectLight::isPrefilterSupported(Engine& engine) noexcept {
+    return upcast(engine).getPostProcessManager().hasComputeIblPrefilter(
+            Texture::InternalFormat::RGBA16F);
+}
+
+bool IndirectLight::prefilter(Engine& engine, Texture const* environment,
+        PrefilterOptions const& options) noexcept {
+    return upcast(this)->prefilter(upcast(engine), upcast(environment), options);
+}
+
 math::float3 IndirectLight::getDirectionEstimate() const noexcept {
     return upcast(this)->getDirectionEstimate();
 }
@@ -48,6 +48,7 @@ using namespace backend;
 struct Material::BuilderDetails {
     const void* mPayload = nullptr;
     size_t mSize = 0;
+    bool mCopyPackage = true;
     MaterialParser* mMaterialParser = nullptr;
     bool mDefaultMaterial = false;
 };
@@ -67,12 +68,20 @@ BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs
 Material::Builder& Material::Builder::package(const void* payload, size_t size) {
     mImpl->mPayload = payload;
     mImpl->mSize = size;
+    mImpl->mCopyPackage = true;
+    return *this;
+}
+
+Material::Builder& Material::Builder::packageNoCopy(const void* payload, size_t size) {
+    mImpl->mPayload = payload;
+    mImpl->mSize = size;
+    mImpl->mCopyPackage = false;
     return *this;
 }
 
 Material* Material::Builder::build(Engine& engine) {
     MaterialParser* materialParser = FMaterial::createParser(
-            upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
+            upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize, mImpl->mCopyPackage);
 
     uint32_t v = 0;
     materialParser->getShaderModels(&v);
@@ -298,6 +307,13 @@ bool FMaterial::hasParameter(const char* name) const noexcept {
     return true;
 }
 
+ssize_t FMaterial::getParameterOffset(const char* name) const noexcept {
+    if (!mUniformInterfaceBlock.hasUniform(name)) {
+        return -1;
+    }
+    return mUniformInterfaceBlock.getUniformOffset(name, 0);
+}
+
 bool FMaterial::isSampler(const char* name) const noexcept {
     return mSamplerInterfaceBlock.hasSampler(name);
 }
@@ -311,7 +327,45 @@ UniformInterfaceBlock::UniformInfo const* FMaterial::reflect(
     return p == list.end() ? nullptr : &static_cast<UniformInterfaceBlock::UniformInfo const&>(*p);
 }
 
+// the public variant bits are the ones of Variant
+static_assert(uint8_t(UserVariantFilterBit::DIRECTIONAL_LIGHTING) == Variant::DIRECTIONAL_LIGHTING);
+static_assert(uint8_t(UserVariantFilterBit::DYNAMIC_LIGHTING) == Variant::DYNAMIC_LIGHTING);
+static_assert(uint8_t(UserVariantFilterBit::SHADOW_RECEIVER) == Variant::SHADOW_RECEIVER);
+static_assert(uint8_t(UserVariantFilterBit::SKINNING) == Variant::SKINNING_OR_MORPHING);
+static_assert(uint8_t(UserVariantFilterBit::FOG) == Variant::FOG);
+static_assert(uint8_t(UserVariantFilterBit::VSM) == Variant::VSM);
+
+void FMaterial::compile(UserVariantFilterMask variants, CompileCallback callback,
+        void* user) noexcept {
+    const ShaderModel sm = mEngine.getDriver().getShaderModel();
+    const bool surface = getMaterialDomain() == MaterialDomain::SURFACE;
+    const uint8_t allowed = variants | Variant::DEPTH;
+    for (size_t k = 0; k < VARIANT_COUNT; k++) {
+        const uint8_t variantKey = uint8_t(k);
+        if (Variant::isReserved(variantKey) || (surface && ((variantKey & ~allowed) ||
+                variantKey != Variant::filterVariant(variantKey, isVariantLit())))) {
+            continue;
+        }
+        // skip the variants which were filtered out when the material was built
+        const uint8_t vertexVariantKey =
+                surface ? Variant::filterVariantVertex(variantKey) : variantKey;
+        const uint8_t fragmentVariantKey =
+                surface ? Variant::filterVariantFragment(variantKey) : variantKey;
+        if (mMaterialParser->hasShader(sm, vertexVariantKey, ShaderType::VERTEX) &&
+                mMaterialParser->hasShader(sm, fragmentVariantKey, ShaderType::FRAGMENT)) {
+            getProgram(variantKey);
+        }
+    }
+    if (callback) {
+        mEngine.getDriverApi().compilePrograms(callback, user);
+    }
+}
+
 backend::Handle<backend::HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
+    if (UTILS_UNLIKELY(mEngine.debug.material.record_variants)) {
+        mEngine.recordVariant(mName, variantKey);
+    }
+
     switch (getMaterialDomain()) {
         case MaterialDomain::SURFACE:
             return getSurfaceProgramSlow(variantKey);
@@ -334,6 +388,7 @@ backend::Handle<backend::HwProgram> FMaterial::getSurfaceProgramSlow(uint8_t var
 
     Program pb = getProgramBuilderWithVariants(variantKey, vertexVariantKey, fragmentVariantKey);
     pb
+        .skipDrawsUntilReady(mEngine.getConfig().nonBlockingShaderCompilation)
         .setUniformBlock(BindingPoints::PER_VIEW, UibGenerator::getPerViewUib().getName())
         .setUniformBlock(BindingPoints::LIGHTS, UibGenerator::getLightsUib().getName())
         .setUniformBlock(BindingPoints::SHADOW, UibGenerator::getShadowUib().getName())
@@ -400,6 +455,7 @@ Program FMaterial::getProgramBuilderWithVariants(
 
     Program pb;
     pb      .diagnostics(mName, variantKey)
+            .cacheId(getCacheId())
             .withVertexShader(vsBuilder.data(), vsBuilder.size())
             .withFragmentShader(fsBuilder.data(), fsBuilder.size());
     return pb;
@@ -407,7 +463,8 @@ Program FMaterial::getProgramBuilderWithVariants(
 
 backend::Handle<backend::HwProgram> FMaterial::createAndCacheProgram(Program&& p,
         uint8_t variantKey) const noexcept {
-    auto program = mEngine.getDriverApi().createProgram(std::move(p));
+    // materials with identical shaders share their programs
+    auto program = mEngine.getProgramCache().acquire(mEngine.getDriverApi(), std::move(p));
     assert(program);
 
     mCachedPrograms[variantKey] = program;
@@ -458,6 +515,20 @@ void FMaterial::applyPendingEdits() noexcept {
     delete mMaterialParser;
     mMaterialParser = mPendingEdits;
     mPendingEdits = nullptr;
+    // the edited programs must not be confused with the original ones
+    mCacheId = 0;
+    mHasCacheId = true;
+}
+
+uint64_t FMaterial::getCacheId() const noexcept {
+    // The package is only hashed when the program binaries can be cached, and only when the first
+    // program is created, because reading all of it would defeat packageNoCopy() for memory-mapped
+    // packages otherwise.
+    if (!mHasCacheId) {
+        mCacheId = mEngine.hasPlatformBlobFunc() ? mMaterialParser->getPackageHash() : 0;
+        mHasCacheId = true;
+    }
+    return mCacheId;
 }
 
 /**
@@ -490,10 +561,38 @@ void FMaterial::onQueryCallback(void* userdata, uint64_t* pVariants) {
     *pVariants = variants;
 }
 
+size_t FMaterial::onStatsCallback(void* userdata, matdbg::MaterialVariantStats* stats,
+        size_t capacity) {
+#if FILAMENT_ENABLE_MATDBG
+    FMaterial* material = upcast((Material*) userdata);
+    MaterialStatistics::Totals totals;
+    if (!material->mEngine.getMaterialStatistics().get(material->getId(), &totals)) {
+        return 0;
+    }
+    const float frameScale = totals.frameCount ? 1.0f / float(totals.frameCount) : 0.0f;
+    const float gpuScale = totals.gpuFrameCount ? 1e-6f / float(totals.gpuFrameCount) : 0.0f;
+    size_t count = 0;
+    for (size_t i = 0; i < VARIANT_COUNT && count < capacity; i++) {
+        MaterialStatistics::Entry const& entry = totals.variants[i];
+        if (entry.drawCount || entry.gpuTime) {
+            stats[count++] = {
+                    uint8_t(i),
+                    float(entry.drawCount) * frameScale,
+                    float(entry.triangleCount) * frameScale,
+                    float(entry.gpuTime) * gpuScale };
+        }
+    }
+    return count;
+#else
+    return 0;
+#endif
+}
+
  /** @}*/
 
-MaterialParser* FMaterial::createParser(backend::Backend backend, const void* data, size_t size) {
-    MaterialParser* materialParser = new MaterialParser(backend, data, size);
+MaterialParser* FMaterial::createParser(backend::Backend backend, const void* data, size_t size,
+        bool copy) {
+    MaterialParser* materialParser = new MaterialParser(backend, data, size, copy);
 
     MaterialParser::ParseResult materialResult = materialParser->parse();
 
@@ -519,6 +618,7 @@ MaterialParser* FMaterial::createParser(backend::Backend backend, const void* da
 
 void FMaterial::destroyPrograms(FEngine& engine) {
     DriverApi& driverApi = engine.getDriverApi();
+    ProgramCache& programCache = engine.getProgramCache();
     auto& cachedPrograms = mCachedPrograms;
     for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
         if (!mIsDefaultMaterial) {
@@ -530,7 +630,7 @@ void FMaterial::destroyPrograms(FEngine& engine) {
                 continue;
             }
         }
-        driverApi.destroyProgram(cachedPrograms[i]);
+        programCache.release(driverApi, cachedPrograms[i]);
     }
 }
 
@@ -638,6 +738,14 @@ bool Material::isSampler(const char* name) const noexcept {
     return upcast(this)->isSampler(name);
 }
 
+ssize_t Material::getParameterOffset(const char* name) const noexcept {
+    return upcast(this)->getParameterOffset(name);
+}
+
+size_t Material::getParameterBlockSize() const noexcept {
+    return upcast(this)->getUniformInterfaceBlock().getSize();
+}
+
 MaterialInstance* Material::getDefaultInstance() noexcept {
     return upcast(this)->getDefaultInstance();
 }
@@ -646,4 +754,9 @@ MaterialInstance const* Material::getDefaultInstance() const noexcept {
     return upcast(this)->getDefaultInstance();
 }
 
+void Material::compile(UserVariantFilterMask variants, CompileCallback callback,
+        void* user) noexcept {
+    upcast(this)->compile(variants, callback, user);
+}
+
 } // namespace filament
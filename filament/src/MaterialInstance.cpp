@@ -27,6 +27,7 @@
 #include "details/Texture.h"
 
 #include <utils/Log.h>
+#include <utils/Panic.h>
 
 #include <string.h>
 
@@ -45,12 +46,13 @@ FMaterialInstance::FMaterialInstance(FEngine& engine, FMaterial const* material,
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms.setUniforms(material->getDefaultInstance()->getUniformBuffer());
-        mUbHandle = driver.createUniformBuffer(mUniforms.getSize(), backend::BufferUsage::DYNAMIC);
+        mUbSlot = engine.getMaterialUniformArena().allocate(driver, mUniforms.getSize());
     }
 
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
         mSamplers.setSamplers(material->getDefaultInstance()->getSamplerGroup());
-        mSbHandle = driver.createSamplerGroup(mSamplers.getSize());
+        mSbHandle = engine.getSamplerGroupCache().acquire(driver, mSamplers);
+        mSamplers.clean();
     }
 
     initialize(material);
@@ -62,12 +64,12 @@ void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* ma
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(material->getUniformInterfaceBlock().getSize());
-        mUbHandle = driver.createUniformBuffer(mUniforms.getSize(), backend::BufferUsage::STATIC);
+        mUbSlot = engine.getMaterialUniformArena().allocate(driver, mUniforms.getSize());
     }
 
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
         mSamplers = SamplerGroup(material->getSamplerInterfaceBlock().getSize());
-        mSbHandle = driver.createSamplerGroup(mSamplers.getSize());
+        mSbHandle = engine.getSamplerGroupCache().acquire(driver, mSamplers);
     }
 
     initialize(material);
@@ -77,8 +79,8 @@ FMaterialInstance::~FMaterialInstance() noexcept = default;
 
 void FMaterialInstance::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyUniformBuffer(mUbHandle);
-    driver.destroySamplerGroup(mSbHandle);
+    engine.getMaterialUniformArena().free(driver, mUbSlot);
+    engine.getSamplerGroupCache().release(driver, mSbHandle);
 }
 
 void FMaterialInstance::initialize(FMaterial const* material) {
@@ -115,13 +117,28 @@ void FMaterialInstance::initialize(FMaterial const* material) {
     }
 }
 
-void FMaterialInstance::commitSlow(DriverApi& driver) const {
+void FMaterialInstance::commitSlow(DriverApi& driver, bool flush) const {
     // update uniforms if needed
     if (mUniforms.isDirty()) {
-        driver.loadUniformBuffer(mUbHandle, mUniforms.toBufferDescriptor(driver));
+        // only the range of the changed parameters is written, at its place in our slot of
+        // the shared buffer
+        FEngine& engine = mMaterial->getEngine();
+        UniformBufferArena& arena = engine.getMaterialUniformArena();
+        const size_t offset = mUniforms.getDirtyOffset();
+        arena.update(mUbSlot, offset, static_cast<uint8_t const*>(mUniforms.getBuffer()) + offset,
+                mUniforms.getDirtySize());
+        mUniforms.clean();
+        if (flush) {
+            engine.addUniformBufferBytes(arena.flush(driver));
+        }
     }
     if (mSamplers.isDirty()) {
-        driver.updateSamplerGroup(mSbHandle, std::move(mSamplers.toCommandStream()));
+        // sampler groups are shared and never updated, switch to the one with our new samplers
+        SamplerGroupCache& cache = mMaterial->getEngine().getSamplerGroupCache();
+        auto sbh = cache.acquire(driver, mSamplers);
+        cache.release(driver, mSbHandle);
+        mSbHandle = sbh;
+        mSamplers.clean();
     }
 }
 
@@ -152,6 +169,13 @@ void FMaterialInstance::setParameter(const char* name,
     mSamplers.setSampler(index, { texture, params });
 }
 
+void FMaterialInstance::setParameters(void const* data, size_t size, size_t offset) noexcept {
+    ASSERT_PRECONDITION(offset + size <= mUniforms.getSize(),
+            "setParameters() range [%zu, %zu) exceeds the uniform block size %zu",
+            offset, offset + size, mUniforms.getSize());
+    mUniforms.setUniforms(offset, data, size);
+}
+
 void FMaterialInstance::setDoubleSided(bool doubleSided) noexcept {
     if (!mMaterial->hasDoubleSidedCapability()) {
         slog.w << "Parent material does not have double-sided capability." << io::endl;
@@ -165,18 +189,22 @@ void FMaterialInstance::setDoubleSided(bool doubleSided) noexcept {
 
 void FMaterialInstance::setCullingMode(CullingMode culling) noexcept {
     mCulling = culling;
+    mMaterial->getEngine().updateMaterialInstanceGeneration();
 }
 
 void FMaterialInstance::setColorWrite(bool enable) noexcept {
     mColorWrite = enable;
+    mMaterial->getEngine().updateMaterialInstanceGeneration();
 }
 
 void FMaterialInstance::setDepthWrite(bool enable) noexcept {
     mDepthWrite = enable;
+    mMaterial->getEngine().updateMaterialInstanceGeneration();
 }
 
 void FMaterialInstance::setDepthCulling(bool enable) noexcept {
     mDepthFunc = enable ? RasterState::DepthFunc::GE : RasterState::DepthFunc::A;
+    mMaterial->getEngine().updateMaterialInstanceGeneration();
 }
 
 const char* FMaterialInstance::getName() const noexcept {
@@ -296,6 +324,10 @@ void MaterialInstance::setParameter(const char* name, RgbaType type, float4 colo
     upcast(this)->setParameter<float4>(name, Color::toLinear(type, color));
 }
 
+void MaterialInstance::setParameters(void const* data, size_t size, size_t offset) noexcept {
+    upcast(this)->setParameters(data, size, offset);
+}
+
 void MaterialInstance::setScissor(uint32_t left, uint32_t bottom, uint32_t width,
         uint32_t height) noexcept {
     upcast(this)->setScissor(left, bottom, width, height);
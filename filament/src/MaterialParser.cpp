@@ -30,6 +30,7 @@
 #include <private/filament/UniformInterfaceBlock.h>
 
 #include <utils/CString.h>
+#include <utils/Hash.h>
 
 #include <stdlib.h>
 
@@ -42,8 +43,9 @@ namespace filament {
 
 // ------------------------------------------------------------------------------------------------
 
-MaterialParser::MaterialParserDetails::MaterialParserDetails(Backend backend, const void* data, size_t size)
-        : mManagedBuffer(data, size),
+MaterialParser::MaterialParserDetails::MaterialParserDetails(Backend backend, const void* data,
+        size_t size, bool copy)
+        : mManagedBuffer(data, size, copy),
           mChunkContainer(mManagedBuffer.data(), mManagedBuffer.size()),
           mMaterialChunk(mChunkContainer) {
     switch (backend) {
@@ -80,8 +82,8 @@ bool MaterialParser::MaterialParserDetails::getFromSimpleChunk(filamat::ChunkTyp
 
 // ------------------------------------------------------------------------------------------------
 
-MaterialParser::MaterialParser(Backend backend, const void* data, size_t size)
-        : mImpl(backend, data, size) {
+MaterialParser::MaterialParser(Backend backend, const void* data, size_t size, bool copy)
+        : mImpl(backend, data, size, copy) {
 }
 
 ChunkContainer& MaterialParser::getChunkContainer() noexcept {
@@ -264,6 +266,15 @@ bool MaterialParser::getShader(ShaderBuilder& shader,
             mImpl.mBlobDictionary, (uint8_t)shaderModel, variant, stage);
 }
 
+bool MaterialParser::hasShader(ShaderModel shaderModel, uint8_t variant,
+        ShaderType stage) const noexcept {
+    return mImpl.mMaterialChunk.hasShader((uint8_t)shaderModel, variant, stage);
+}
+
+uint64_t MaterialParser::getPackageHash() const noexcept {
+    return utils::hash::fnv1a64(mImpl.mManagedBuffer.data(), mImpl.mManagedBuffer.size());
+}
+
 // ------------------------------------------------------------------------------------------------
 
 
@@ -43,7 +43,8 @@ class SamplerInterfaceBlock;
 
 class MaterialParser {
 public:
-    MaterialParser(backend::Backend backend, const void* data, size_t size);
+    // If 'copy' is false, the package is used in place and must outlive the parser.
+    MaterialParser(backend::Backend backend, const void* data, size_t size, bool copy = true);
 
     MaterialParser(MaterialParser const& rhs) noexcept = delete;
     MaterialParser& operator=(MaterialParser const& rhs) noexcept = delete;
@@ -91,9 +92,17 @@ public:
     bool getShader(filaflat::ShaderBuilder& shader, backend::ShaderModel shaderModel,
             uint8_t variant, backend::ShaderType stage) noexcept;
 
+    // returns whether getShader() would succeed, without reading the shader
+    bool hasShader(backend::ShaderModel shaderModel,
+            uint8_t variant, backend::ShaderType stage) const noexcept;
+
+    // returns a hash of the whole package, which reads all of it
+    uint64_t getPackageHash() const noexcept;
+
 private:
     struct MaterialParserDetails {
-        MaterialParserDetails(backend::Backend backend, const void* data, size_t size);
+        MaterialParserDetails(backend::Backend backend, const void* data, size_t size,
+                bool copy);
 
         template<typename T>
         bool getFromSimpleChunk(filamat::ChunkType type, T* value) const noexcept;
@@ -104,12 +113,16 @@ private:
         class ManagedBuffer {
             void* mStart = nullptr;
             size_t mSize = 0;
+            bool mOwned = false;
         public:
-            explicit ManagedBuffer(const void* start, size_t size)
-                    : mStart(malloc(size)), mSize(size) {
-                memcpy(mStart, start, size);
+            explicit ManagedBuffer(const void* start, size_t size, bool copy)
+                    : mStart(copy ? malloc(size) : const_cast<void*>(start)),
+                      mSize(size), mOwned(copy) {
+                if (copy) {
+                    memcpy(mStart, start, size);
+                }
             }
-            ~ManagedBuffer() noexcept { free(mStart); }
+            ~ManagedBuffer() noexcept { if (mOwned) { free(mStart); } }
             ManagedBuffer(ManagedBuffer const& rhs) = delete;
             ManagedBuffer& operator=(ManagedBuffer const& rhs) = delete;
             void* data() const noexcept { return mStart; }
@@ -123,6 +136,7 @@ private:
 
         // Keep MaterialChunk alive between calls to getShader to avoid reload the shader index.
         filaflat::MaterialChunk mMaterialChunk;
+        // References the package, its blobs are only decoded by the first getShader() using them.
         filaflat::BlobDictionary mBlobDictionary;
         filamat::ChunkType mMaterialTag = filamat::ChunkType::Unknown;
         filamat::ChunkType mDictionaryTag = filamat::ChunkType::Unknown;
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MaterialStatistics.h"
+
+#include <mutex>
+
+namespace filament {
+
+void MaterialStatistics::setEnabled(bool enabled) noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    if (enabled && !isEnabled()) {
+        mEntries.clear();
+        mFrameCount = 0;
+        mGpuFrameCount = 0;
+    }
+    mEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+void MaterialStatistics::addDraws(uint32_t materialId, uint8_t variant,
+        uint32_t drawCount, uint64_t triangleCount) noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    Entry& entry = mEntries[getKey(materialId, variant)];
+    entry.drawCount += drawCount;
+    entry.triangleCount += triangleCount;
+}
+
+void MaterialStatistics::addGpuTime(uint32_t materialId, uint8_t variant,
+        uint64_t gpuTime) noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    mEntries[getKey(materialId, variant)].gpuTime += gpuTime;
+}
+
+void MaterialStatistics::endFrame() noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    mFrameCount++;
+}
+
+void MaterialStatistics::endGpuFrame() noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    mGpuFrameCount++;
+}
+
+bool MaterialStatistics::get(uint32_t materialId, Totals* totals) const noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
+    bool found = false;
+    for (size_t i = 0; i < VARIANT_COUNT; i++) {
+        auto pos = mEntries.find(getKey(materialId, uint8_t(i)));
+        if (pos != mEntries.end()) {
+            totals->variants[i] = pos->second;
+            found = true;
+        } else {
+            totals->variants[i] = {};
+        }
+    }
+    totals->frameCount = mFrameCount;
+    totals->gpuFrameCount = mGpuFrameCount;
+    return found;
+}
+
+} // namespace filament
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_MATERIALSTATISTICS_H
+#define TNT_FILAMENT_MATERIALSTATISTICS_H
+
+#include <private/filament/Variant.h>
+
+#include <utils/Mutex.h>
+
+#include <tsl/robin_map.h>
+
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Cost of the variants of each material, reported to the material debugger (matdbg).
+ *
+ * While enabled, the color passes record the draws and the triangles of each run of commands
+ * that use the same material variant, and time them on the GPU, see FrameInfoManager. These are
+ * accumulated from the main thread and read from the matdbg server's thread.
+ */
+class MaterialStatistics {
+public:
+    struct Entry {
+        uint64_t drawCount = 0;
+        uint64_t triangleCount = 0;
+        uint64_t gpuTime = 0;       // in nanoseconds
+    };
+
+    // sums of the entries of a material's variants, over frameCount (resp. gpuFrameCount) frames
+    struct Totals {
+        Entry variants[VARIANT_COUNT];
+        uint32_t frameCount = 0;
+        uint32_t gpuFrameCount = 0;
+    };
+
+    MaterialStatistics() noexcept = default;
+    MaterialStatistics(MaterialStatistics const& rhs) = delete;
+    MaterialStatistics& operator=(MaterialStatistics const& rhs) = delete;
+
+    // enabling the statistics resets them
+    void setEnabled(bool enabled) noexcept;
+    bool isEnabled() const noexcept { return mEnabled.load(std::memory_order_relaxed); }
+
+    void addDraws(uint32_t materialId, uint8_t variant,
+            uint32_t drawCount, uint64_t triangleCount) noexcept;
+    void addGpuTime(uint32_t materialId, uint8_t variant, uint64_t gpuTime) noexcept;
+
+    // counts a frame whose draws (resp. GPU times) were all added
+    void endFrame() noexcept;
+    void endGpuFrame() noexcept;
+
+    // returns false if nothing was recorded for this material
+    bool get(uint32_t materialId, Totals* totals) const noexcept;
+
+private:
+    static uint64_t getKey(uint32_t materialId, uint8_t variant) noexcept {
+        return (uint64_t(materialId) << 8u) | variant;
+    }
+
+    std::atomic<bool> mEnabled{ false };
+    mutable utils::Mutex mLock;
+    tsl::robin_map<uint64_t, Entry> mEntries;
+    uint32_t mFrameCount = 0;
+    uint32_t mGpuFrameCount = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_MATERIALSTATISTICS_H
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <math.h>
+
+using namespace filament::math;
+
+namespace filament {
+
+void OcclusionCuller::clear() noexcept {
+    mLevels.clear();
+}
+
+void OcclusionCuller::setDepth(float const* depth, uint32_t width, uint32_t height,
+        mat4f const& worldToClip) {
+    SYSTRACE_CALL();
+
+    mLevels.clear();
+    if (!width || !height) {
+        return;
+    }
+
+    mWorldToClip = worldToClip;
+    mLevels.push_back({ width, height,
+            std::vector<float>(depth, depth + size_t(width) * height) });
+
+    // each texel of a level is the farthest (i.e. smallest with inverted z) of the up to 2x2
+    // texels it covers in the previous level, down to a single texel
+    while (width > 1 || height > 1) {
+        Level const& src = mLevels.back();
+        Level dst{ std::max(1u, (width + 1u) / 2u), std::max(1u, (height + 1u) / 2u), {}};
+        dst.depth.resize(size_t(dst.width) * dst.height);
+        for (uint32_t y = 0; y < dst.height; y++) {
+            const uint32_t y0 = std::min(height - 1u, y * 2u);
+            const uint32_t y1 = std::min(height - 1u, y * 2u + 1u);
+            float const* const row0 = src.depth.data() + size_t(y0) * width;
+            float const* const row1 = src.depth.data() + size_t(y1) * width;
+            for (uint32_t x = 0; x < dst.width; x++) {
+                const uint32_t x0 = std::min(width - 1u, x * 2u);
+                const uint32_t x1 = std::min(width - 1u, x * 2u + 1u);
+                dst.depth[size_t(y) * dst.width + x] = std::min(
+                        std::min(row0[x0], row0[x1]), std::min(row1[x0], row1[x1]));
+            }
+        }
+        width = dst.width;
+        height = dst.height;
+        mLevels.push_back(std::move(dst));
+    }
+}
+
+bool OcclusionCuller::isOccluded(mat4f const& boxToClip,
+        float3 const& center, float3 const& extent) const noexcept {
+    if (UTILS_UNLIKELY(mLevels.empty())) {
+        return false;
+    }
+
+    float2 lo = std::numeric_limits<float>::max();
+    float2 hi = std::numeric_limits<float>::lowest();
+    float nearest = 0.0f;
+    for (size_t i = 0; i < 8; i++) {
+        const float3 corner = center + extent * float3{
+                (i & 1u) ? 1.0f : -1.0f, (i & 2u) ? 1.0f : -1.0f, (i & 4u) ? 1.0f : -1.0f };
+        const float4 clip = boxToClip * float4{ corner, 1.0f };
+        if (clip.w <= std::numeric_limits<float>::epsilon()) {
+            // the box crosses the camera plane, we can't project it
+            return false;
+        }
+        const float3 ndc = clip.xyz / clip.w;
+        lo = min(lo, ndc.xy);
+        hi = max(hi, ndc.xy);
+        // the projection is a regular GL projection, z is inverted when rendering
+        nearest = std::max(nearest, 0.5f - 0.5f * ndc.z);
+    }
+
+    lo = clamp(lo * 0.5f + 0.5f, 0.0f, 1.0f);
+    hi = clamp(hi * 0.5f + 0.5f, 0.0f, 1.0f);
+    if (nearest >= 1.0f || lo.x >= hi.x || lo.y >= hi.y) {
+        // the box touches the near plane or is off screen (frustum culling handles it)
+        return false;
+    }
+
+    // screen-space bounds in texels of the first level
+    Level const& base = mLevels.front();
+    const uint32_t x0 = std::min(base.width - 1u, uint32_t(lo.x * float(base.width)));
+    const uint32_t x1 = std::min(base.width - 1u, uint32_t(hi.x * float(base.width)));
+    const uint32_t y0 = std::min(base.height - 1u, uint32_t(lo.y * float(base.height)));
+    const uint32_t y1 = std::min(base.height - 1u, uint32_t(hi.y * float(base.height)));
+
+    // pick the first level where the bounds are covered by at most 2x2 texels
+    size_t level = 0;
+    while (level + 1 < mLevels.size() &&
+           ((x1 >> level) - (x0 >> level) > 1u || (y1 >> level) - (y0 >> level) > 1u)) {
+        level++;
+    }
+
+    Level const& l = mLevels[level];
+    float farthest = 1.0f;
+    for (uint32_t y = y0 >> level; y <= (y1 >> level); y++) {
+        for (uint32_t x = x0 >> level; x <= (x1 >> level); x++) {
+            farthest = std::min(farthest, l.depth[size_t(y) * l.width + x]);
+        }
+    }
+
+    // the box is occluded if its nearest point is behind the farthest occluder
+    return nearest < farthest;
+}
+
+size_t OcclusionCuller::cull(Culler::result_type* visibility,
+        float3 const* centers, float3 const* extents,
+        uint8_t const* layers, FRenderableManager::Visibility const* states, size_t count,
+        uint8_t visibleLayers, mat4f const& worldOrigin,
+        Culler::result_type mask) const noexcept {
+    if (UTILS_UNLIKELY(mLevels.empty())) {
+        return 0;
+    }
+
+    SYSTRACE_CALL();
+
+    size_t culledCount = 0;
+    const mat4f boxToClip = mWorldToClip * inverse(worldOrigin);
+    for (size_t i = 0; i < count; i++) {
+        if ((visibility[i] & mask) && (layers[i] & visibleLayers) && states[i].culling &&
+                isOccluded(boxToClip, centers[i], extents[i])) {
+            visibility[i] &= ~mask;
+            culledCount++;
+        }
+    }
+    return culledCount;
+}
+
+} // namespace filament
@@ -0,0 +1,596 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ParticleSystem.h"
+
+#include "components/RenderableManager.h"
+
+#include "details/Engine.h"
+#include "details/IndexBuffer.h"
+#include "details/Material.h"
+#include "details/MaterialInstance.h"
+#include "details/RenderPrimitive.h"
+#include "details/Texture.h"
+#include "details/VertexBuffer.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <filament/TextureSampler.h>
+
+#include <private/backend/Program.h>
+
+#include <backend/DriverEnums.h>
+
+#include <utils/Log.h>
+#include <utils/Panic.h>
+
+#include <algorithm>
+#include <string>
+
+#include <math.h>
+#include <stdlib.h>
+
+using namespace filament::math;
+using namespace utils;
+
+namespace filament {
+
+using namespace backend;
+
+// Parameters of the particle programs, in a storage buffer (std430)
+struct ParticleParams {
+    float4 emitterCenter;
+    float4 emitterHalfExtent;
+    float4 velocity;
+    float4 velocitySpread;
+    float4 gravity;             // w: time step in seconds
+    float4 sortOrigin;
+    float2 lifetime;            // minimum and maximum lifetime in seconds
+    uint32_t emitFirst;         // first particle replaced by an emitted one
+    uint32_t emitCount;         // number of particles emitted
+    uint32_t count;             // number of particles
+    uint32_t seed;
+    uint32_t padding[2];
+};
+
+static_assert(sizeof(ParticleParams) == 128, "ParticleParams doesn't match std430");
+
+// A particle, in a storage buffer (std430)
+struct Particle {
+    float4 positionAge;
+    float4 velocityLifetime;
+};
+
+// Sort key of a particle, in a storage buffer (std430)
+struct ParticleSortKey {
+    float distance;
+    uint32_t index;
+};
+
+// One step of the bitonic sort, in a storage buffer (std430)
+struct ParticleSortStep {
+    uint32_t j;                 // distance between the compared keys
+    uint32_t k;                 // size of the sequences being merged
+};
+
+static constexpr uint32_t kParticleGroupSize = 64;
+
+static constexpr const char* const sParticleCommon = R"GLSL(
+layout(local_size_x = 64) in;
+
+struct Particle {
+    vec4 positionAge;
+    vec4 velocityLifetime;
+};
+
+struct SortKey {
+    float distance;
+    uint index;
+};
+
+layout(std430, binding = 0) readonly buffer ParticleParams {
+    vec4 emitterCenter;
+    vec4 emitterHalfExtent;
+    vec4 velocity;
+    vec4 velocitySpread;
+    vec4 gravity;
+    vec4 sortOrigin;
+    vec2 lifetime;
+    uint emitFirst;
+    uint emitCount;
+    uint count;
+    uint seed;
+};
+
+layout(std430, binding = 2) coherent buffer DrawCommand {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+layout(rgba32f, binding = 0) uniform writeonly image2D state;
+
+// the dead particles, and the padding of the sort, are sorted after all the live particles
+const float DEAD = 3.402823e38;
+
+void store(uint slot, Particle p) {
+    ivec2 texel = ivec2((slot % PARTICLES_PER_ROW) * 2u, slot / PARTICLES_PER_ROW);
+    imageStore(state, texel, p.positionAge);
+    imageStore(state, texel + ivec2(1, 0), p.velocityLifetime);
+}
+)GLSL";
+
+// Respawns the emitted particles and integrates the live ones. The live particles are counted in
+// the draw command, and either written to the texture, or given a sort key.
+static constexpr const char* const sParticleSimulateShader = R"GLSL(
+layout(std430, binding = 1) buffer Particles {
+    Particle particles[];
+};
+
+#ifdef SORTED
+layout(std430, binding = 3) writeonly buffer SortKeys {
+    SortKey keys[];
+};
+#endif
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random(inout uint rng) {
+    rng = hash(rng);
+    return float(rng >> 8) * (1.0 / 16777216.0);
+}
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i >= count) {
+#ifdef SORTED
+        keys[i] = SortKey(DEAD, i);
+#endif
+        return;
+    }
+
+    Particle p = particles[i];
+    if ((i + count - emitFirst) % count < emitCount) {
+        uint rng = hash(i ^ hash(seed));
+        vec3 a = vec3(random(rng), random(rng), random(rng)) * 2.0 - 1.0;
+        vec3 b = vec3(random(rng), random(rng), random(rng)) * 2.0 - 1.0;
+        p.positionAge = vec4(emitterCenter.xyz + a * emitterHalfExtent.xyz, 0.0);
+        p.velocityLifetime = vec4(velocity.xyz + b * velocitySpread.xyz,
+                mix(lifetime.x, lifetime.y, random(rng)));
+    } else if (p.positionAge.w < p.velocityLifetime.w) {
+        float dt = gravity.w;
+        p.velocityLifetime.xyz += gravity.xyz * dt;
+        p.positionAge.xyz += p.velocityLifetime.xyz * dt;
+        p.positionAge.w += dt;
+    }
+    particles[i] = p;
+
+    bool alive = p.positionAge.w < p.velocityLifetime.w;
+#ifdef SORTED
+    // in ascending order, the farthest particles come first
+    vec3 d = p.positionAge.xyz - sortOrigin.xyz;
+    keys[i] = SortKey(alive ? -dot(d, d) : DEAD, i);
+    if (alive) {
+        atomicAdd(instanceCount, 1u);
+    }
+#else
+    if (alive) {
+        store(atomicAdd(instanceCount, 1u), p);
+    }
+#endif
+}
+)GLSL";
+
+// One compare-and-swap step of a bitonic sort of the keys, in ascending order.
+static constexpr const char* const sParticleSortShader = R"GLSL(
+layout(std430, binding = 3) buffer SortKeys {
+    SortKey keys[];
+};
+
+layout(std430, binding = 4) readonly buffer SortStep {
+    uint j;
+    uint k;
+};
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    uint l = i ^ j;
+    if (l > i) {
+        SortKey a = keys[i];
+        SortKey b = keys[l];
+        bool ascending = (i & k) == 0u;
+        if ((a.distance > b.distance) == ascending) {
+            keys[i] = b;
+            keys[l] = a;
+        }
+    }
+}
+)GLSL";
+
+// Writes the live particles to the texture, in the order of the sorted keys.
+static constexpr const char* const sParticleGatherShader = R"GLSL(
+layout(std430, binding = 1) readonly buffer Particles {
+    Particle particles[];
+};
+
+layout(std430, binding = 3) readonly buffer SortKeys {
+    SortKey keys[];
+};
+
+void main() {
+    uint i = gl_GlobalInvocationID.x;
+    if (i < instanceCount) {
+        store(i, particles[keys[i].index]);
+    }
+}
+)GLSL";
+
+static Handle<HwProgram> createParticleProgram(FEngine::DriverApi& driver, const char* name,
+        const char* shader, bool sorted) {
+    std::string source("#version 430 core\n");
+    source += "#define PARTICLES_PER_ROW ";
+    source += std::to_string(FParticleSystem::PARTICLES_PER_ROW) + "u\n";
+    if (sorted) {
+        source += "#define SORTED\n";
+    }
+    source += sParticleCommon;
+    source += shader;
+
+    Program p;
+    p.diagnostics(CString(name))
+            .withComputeShader(source.c_str(), source.size() + 1)
+            .setWorkGroupSize({ kParticleGroupSize, 1, 1 });
+    return driver.createProgram(std::move(p));
+}
+
+// A quad facing +z, drawn for each particle
+struct QuadVertex {
+    float3 position;
+    float2 uv;
+};
+
+static constexpr QuadVertex sQuadVertices[4] = {
+        { { -0.5f, -0.5f, 0.0f }, { 0.0f, 0.0f } },
+        { {  0.5f, -0.5f, 0.0f }, { 1.0f, 0.0f } },
+        { { -0.5f,  0.5f, 0.0f }, { 0.0f, 1.0f } },
+        { {  0.5f,  0.5f, 0.0f }, { 1.0f, 1.0f } },
+};
+
+static constexpr uint16_t sQuadIndices[6] = { 0, 1, 2, 2, 1, 3 };
+
+// ------------------------------------------------------------------------------------------------
+
+struct ParticleSystem::BuilderDetails {
+    size_t mMaxParticles = 1024;
+    float mEmissionRate = 0.0f;
+    float3 mEmitterCenter = {};
+    float3 mEmitterHalfExtent = {};
+    float3 mVelocity = { 0.0f, 1.0f, 0.0f };
+    float3 mVelocitySpread = {};
+    float2 mLifetime = { 1.0f, 1.0f };
+    float3 mGravity = {};
+    bool mSorted = true;
+    MaterialInstance* mMaterialInstance = nullptr;
+    Box mBoundingBox = {};
+    bool mHasBoundingBox = false;
+};
+
+using BuilderType = ParticleSystem;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+ParticleSystem::Builder& ParticleSystem::Builder::maxParticles(size_t count) noexcept {
+    mImpl->mMaxParticles = count;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::emissionRate(float particlesPerSecond) noexcept {
+    mImpl->mEmissionRate = particlesPerSecond;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::emitter(float3 const& center,
+        float3 const& halfExtent) noexcept {
+    mImpl->mEmitterCenter = center;
+    mImpl->mEmitterHalfExtent = halfExtent;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::velocity(float3 const& velocity,
+        float3 const& spread) noexcept {
+    mImpl->mVelocity = velocity;
+    mImpl->mVelocitySpread = spread;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::lifetime(float minimum, float maximum) noexcept {
+    mImpl->mLifetime = { minimum, maximum };
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::gravity(float3 const& acceleration) noexcept {
+    mImpl->mGravity = acceleration;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::sorted(bool sorted) noexcept {
+    mImpl->mSorted = sorted;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::material(
+        MaterialInstance* materialInstance) noexcept {
+    mImpl->mMaterialInstance = materialInstance;
+    return *this;
+}
+
+ParticleSystem::Builder& ParticleSystem::Builder::boundingBox(
+        Box const& axisAlignedBoundingBox) noexcept {
+    mImpl->mBoundingBox = axisAlignedBoundingBox;
+    mImpl->mHasBoundingBox = true;
+    return *this;
+}
+
+ParticleSystem* ParticleSystem::Builder::build(Engine& engine) {
+    FMaterialInstance const* mi = upcast(mImpl->mMaterialInstance);
+    if (!ASSERT_PRECONDITION_NON_FATAL(mi, "a particle system needs a material")) {
+        return nullptr;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(mi->getMaterial()->hasParameter("particles"),
+            "the material of a particle system must have a \"particles\" parameter")) {
+        return nullptr;
+    }
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mMaxParticles >= 1 &&
+            mImpl->mMaxParticles <= FParticleSystem::MAX_PARTICLES,
+            "maxParticles must be between 1 and %u", unsigned(FParticleSystem::MAX_PARTICLES))) {
+        return nullptr;
+    }
+
+    FEngine::DriverApi& driver = upcast(engine).getDriverApi();
+    if (!driver.isComputeSupported() || !driver.isDrawIndirectSupported()) {
+        slog.w << "Particle systems need compute programs and indirect draws" << io::endl;
+        return nullptr;
+    }
+
+    return upcast(engine).createParticleSystem(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FParticleSystem::FParticleSystem(FEngine& engine, const Builder& builder)
+        : mEngine(engine),
+          mMaterialInstance(upcast(builder->mMaterialInstance)),
+          mCount(uint32_t(builder->mMaxParticles)),
+          mEmissionRate(builder->mEmissionRate),
+          mEmitterCenter(builder->mEmitterCenter),
+          mEmitterHalfExtent(builder->mEmitterHalfExtent),
+          mVelocity(builder->mVelocity),
+          mVelocitySpread(builder->mVelocitySpread),
+          mLifetime(builder->mLifetime),
+          mGravity(builder->mGravity) {
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    // the bitonic sort needs a power of two keys, and at least a work group of them
+    mSortCount = 0;
+    if (builder->mSorted) {
+        mSortCount = kParticleGroupSize;
+        while (mSortCount < mCount) {
+            mSortCount <<= 1u;
+        }
+    }
+
+    mParams = driver.createUniformBuffer(sizeof(ParticleParams), BufferUsage::DYNAMIC);
+    mDrawCommand = driver.createUniformBuffer(sizeof(DrawIndirectCommand), BufferUsage::DYNAMIC);
+    mSimulateProgram = createParticleProgram(driver, "particle simulate",
+            sParticleSimulateShader, mSortCount != 0);
+    if (mSortCount) {
+        mSortKeys = driver.createUniformBuffer(mSortCount * sizeof(ParticleSortKey),
+                BufferUsage::DYNAMIC);
+        mSortStep = driver.createUniformBuffer(sizeof(ParticleSortStep), BufferUsage::DYNAMIC);
+        mSortProgram = createParticleProgram(driver, "particle sort",
+                sParticleSortShader, true);
+        mGatherProgram = createParticleProgram(driver, "particle gather",
+                sParticleGatherShader, true);
+    }
+
+    // all the particles start dead, with a zero age and lifetime
+    const size_t size = mCount * sizeof(Particle);
+    mParticles = driver.createUniformBuffer(size, BufferUsage::DYNAMIC);
+    driver.updateUniformBuffer(mParticles, { calloc(1, size), size,
+            [](void* buffer, size_t, void*) { free(buffer); } }, 0);
+
+    DrawIndirectCommand* command = driver.allocatePod<DrawIndirectCommand>(1);
+    *command = { 6, 0, 0, 0, 0 };
+    driver.updateUniformBuffer(mDrawCommand, { command, sizeof(DrawIndirectCommand) }, 0);
+
+    mTexture = upcast(Texture::Builder()
+            .width(PARTICLES_PER_ROW * 2)
+            .height((mCount + PARTICLES_PER_ROW - 1) / PARTICLES_PER_ROW)
+            .levels(1)
+            .format(Texture::InternalFormat::RGBA32F)
+            .usage(Texture::Usage::SAMPLEABLE | Texture::Usage::STORAGE)
+            .build(engine));
+
+    mVertexBuffer = upcast(VertexBuffer::Builder()
+            .vertexCount(4)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3,
+                    offsetof(QuadVertex, position), sizeof(QuadVertex))
+            .attribute(VertexAttribute::UV0, 0, VertexBuffer::AttributeType::FLOAT2,
+                    offsetof(QuadVertex, uv), sizeof(QuadVertex))
+            .build(engine));
+    mVertexBuffer->setBufferAt(engine, 0, { sQuadVertices, sizeof(sQuadVertices) });
+
+    mIndexBuffer = upcast(IndexBuffer::Builder()
+            .indexCount(6)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(engine));
+    mIndexBuffer->setBuffer(engine, { sQuadIndices, sizeof(sQuadIndices) });
+
+    // the texture is only read with texelFetch()
+    TextureSampler sampler(TextureSampler::MagFilter::NEAREST);
+    mMaterialInstance->setParameter("particles", mTexture, sampler);
+
+    mEntity = engine.getEntityManager().create();
+    RenderableManager::Builder(1)
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                    mVertexBuffer, mIndexBuffer)
+            .material(0, mMaterialInstance)
+            .boundingBox(builder->mHasBoundingBox ? builder->mBoundingBox : Box{ {}, { 1.0f } })
+            .culling(builder->mHasBoundingBox)
+            .castShadows(false)
+            .receiveShadows(false)
+            .build(engine, mEntity);
+
+    FRenderableManager& rcm = engine.getRenderableManager();
+    rcm.getRenderPrimitives(rcm.getInstance(mEntity))[0].setIndirectDraw(mDrawCommand);
+}
+
+void FParticleSystem::terminate(FEngine& engine) noexcept {
+    // use Engine::destroy because FEngine::destroy is inlined
+    Engine& e = engine;
+    e.destroy(mEntity);
+    engine.getEntityManager().destroy(mEntity);
+    e.destroy(mVertexBuffer);
+    e.destroy(mIndexBuffer);
+    e.destroy(mTexture);
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    driver.destroyUniformBuffer(mParams);
+    driver.destroyUniformBuffer(mParticles);
+    driver.destroyUniformBuffer(mDrawCommand);
+    driver.destroyProgram(mSimulateProgram);
+    if (mSortCount) {
+        driver.destroyUniformBuffer(mSortKeys);
+        driver.destroyUniformBuffer(mSortStep);
+        driver.destroyProgram(mSortProgram);
+        driver.destroyProgram(mGatherProgram);
+    }
+    mEntity = {};
+}
+
+void FParticleSystem::simulate(float deltaTime, float3 const& sortOrigin) noexcept {
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+
+    // the particles that don't fit are dropped
+    const float pending = mPendingCount + mEmissionRate * deltaTime;
+    const uint32_t emitCount = uint32_t(std::min(pending, float(mCount)));
+    mPendingCount = pending - floorf(pending);
+
+    ParticleParams* params = driver.allocatePod<ParticleParams>(1);
+    *params = {
+            .emitterCenter = { mEmitterCenter, 0.0f },
+            .emitterHalfExtent = { mEmitterHalfExtent, 0.0f },
+            .velocity = { mVelocity, 0.0f },
+            .velocitySpread = { mVelocitySpread, 0.0f },
+            .gravity = { mGravity, deltaTime },
+            .sortOrigin = { sortOrigin, 0.0f },
+            .lifetime = mLifetime,
+            .emitFirst = mEmitFirst,
+            .emitCount = emitCount,
+            .count = mCount,
+            .seed = mSeed++
+    };
+    driver.updateUniformBuffer(mParams, { params, sizeof(ParticleParams) }, 0);
+    mEmitFirst = (mEmitFirst + emitCount) % mCount;
+
+    // the live particles are counted again
+    DrawIndirectCommand* command = driver.allocatePod<DrawIndirectCommand>(1);
+    *command = { 6, 0, 0, 0, 0 };
+    driver.updateUniformBuffer(mDrawCommand, { command, sizeof(DrawIndirectCommand) }, 0);
+
+    driver.bindStorageBuffer(0, mParams);
+    driver.bindStorageBuffer(1, mParticles);
+    driver.bindStorageBuffer(2, mDrawCommand);
+    driver.bindImage(0, mTexture->getHwHandle(), 0);
+
+    const uint32_t particleGroups = (mCount + kParticleGroupSize - 1) / kParticleGroupSize;
+    if (!mSortCount) {
+        driver.dispatch(mSimulateProgram, { particleGroups, 1, 1 });
+    } else {
+        driver.bindStorageBuffer(3, mSortKeys);
+        driver.bindStorageBuffer(4, mSortStep);
+
+        const uint32_t sortGroups = mSortCount / kParticleGroupSize;
+        driver.dispatch(mSimulateProgram, { sortGroups, 1, 1 });
+        driver.memoryBarrier(MemoryBarrierFlags::STORAGE_BUFFER);
+
+        for (uint32_t k = 2; k <= mSortCount; k <<= 1u) {
+            for (uint32_t j = k >> 1u; j > 0; j >>= 1u) {
+                ParticleSortStep* step = driver.allocatePod<ParticleSortStep>(1);
+                *step = { j, k };
+                driver.updateUniformBuffer(mSortStep, { step, sizeof(ParticleSortStep) }, 0);
+                driver.dispatch(mSortProgram, { sortGroups, 1, 1 });
+                driver.memoryBarrier(MemoryBarrierFlags::STORAGE_BUFFER);
+            }
+        }
+
+        driver.dispatch(mGatherProgram, { particleGroups, 1, 1 });
+    }
+
+    // the texture and the draw command are used by the renderable, the particles by the next step
+    driver.memoryBarrier(MemoryBarrierFlags::TEXTURE_FETCH |
+            MemoryBarrierFlags::INDIRECT_COMMAND | MemoryBarrierFlags::STORAGE_BUFFER);
+}
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+void ParticleSystem::simulate(float deltaTime, math::float3 const& sortOrigin) noexcept {
+    upcast(this)->simulate(deltaTime, sortOrigin);
+}
+
+void ParticleSystem::emit(size_t count) noexcept {
+    upcast(this)->emit(count);
+}
+
+void ParticleSystem::setEmissionRate(float particlesPerSecond) noexcept {
+    upcast(this)->setEmissionRate(particlesPerSecond);
+}
+
+void ParticleSystem::setEmitter(math::float3 const& center,
+        math::float3 const& halfExtent) noexcept {
+    upcast(this)->setEmitter(center, halfExtent);
+}
+
+utils::Entity ParticleSystem::getEntity() const noexcept {
+    return upcast(this)->getEntity();
+}
+
+size_t ParticleSystem::getMaxParticles() const noexcept {
+    return upcast(this)->getMaxParticles();
+}
+
+Texture const* ParticleSystem::getTexture() const noexcept {
+    return upcast(this)->getTexture();
+}
+
+} // namespace filament
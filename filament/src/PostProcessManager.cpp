@@ -31,6 +31,7 @@
 
 #include "generated/resources/materials.h"
 
+#include <private/backend/Program.h>
 #include <private/filament/SibGenerator.h>
 
 #include <filament/MaterialEnums.h>
@@ -40,6 +41,7 @@
 
 #include <algorithm>
 #include <limits>
+#include <string>
 
 namespace filament {
 
@@ -187,11 +189,748 @@ PostProcessManager::PostProcessMaterial& PostProcessManager::getPostProcessMater
 
 #define MATERIAL(n) MATERIALS_ ## n ## _DATA, MATERIALS_ ## n ## _SIZE
 
+// ------------------------------------------------------------------------------------------------
+// Compute mipmap chain
+// ------------------------------------------------------------------------------------------------
+
+// Parameters of the downsample program, in a storage buffer (std430)
+struct DownsampleParams {
+    uint32_t counter;       // number of work groups done, must be 0 before dispatching
+    int32_t levelCount;     // number of levels to generate
+    int32_t layer;          // layer of an array texture
+    int32_t border;         // whether the outermost texels are set to 1
+};
+
+// Each work group of 16x16 invocations reduces a 32x32 tile of the base level, down to a single
+// texel at the 5th level, without leaving shared memory. The last work group to finish then
+// generates the remaining levels, which are small, from the 5th level written by all the groups.
+// The images must be coherent for the last group to see the other groups' writes.
+static constexpr const char* const sDownsampleComputeShader = R"GLSL(
+layout(local_size_x = 16, local_size_y = 16) in;
+
+#ifdef ARRAY
+#define IMAGE image2DArray
+#define COORD(p) ivec3(p, layer)
+#define SIZE(image) imageSize(image).xy
+#else
+#define IMAGE image2D
+#define COORD(p) (p)
+#define SIZE(image) imageSize(image)
+#endif
+
+layout(std430, binding = 0) coherent buffer DownsampleParams {
+    uint counter;
+    int levelCount;
+    int layer;
+    int border;
+};
+
+layout(FORMAT, binding = 0) uniform readonly IMAGE source;
+layout(FORMAT, binding = 1) uniform coherent IMAGE destination[MAX_LEVELS];
+
+shared vec4 tile[16][16];
+shared bool isLastGroup;
+
+vec4 average(vec4 a, vec4 b, vec4 c, vec4 d) {
+    return (a + b + c + d) * 0.25;
+}
+
+void store(int level, ivec2 p, vec4 value) {
+    ivec2 size = SIZE(destination[level]);
+    if (any(greaterThanEqual(p, size))) {
+        return;
+    }
+    if (border != 0 && (any(equal(p, ivec2(0))) || any(equal(p, size - 1)))) {
+        value = vec4(1.0);
+    }
+    imageStore(destination[level], COORD(p), value);
+}
+
+void main() {
+    ivec2 t = ivec2(gl_LocalInvocationID.xy);
+    ivec2 group = ivec2(gl_WorkGroupID.xy);
+
+    // first level, from the base level (clamped to its edges)
+    ivec2 last = SIZE(source) - 1;
+    ivec2 p = group * 32 + t * 2;
+    vec4 value = average(
+            imageLoad(source, COORD(min(p, last))),
+            imageLoad(source, COORD(min(p + ivec2(1, 0), last))),
+            imageLoad(source, COORD(min(p + ivec2(0, 1), last))),
+            imageLoad(source, COORD(min(p + ivec2(1, 1), last))));
+    store(0, group * 16 + t, value);
+    tile[t.y][t.x] = value;
+
+    // up to 4 more levels within the tile
+    int tileLevels = min(levelCount, 5);
+    for (int level = 1; level < tileLevels; level++) {
+        int n = 16 >> level;
+        bool active = all(lessThan(t, ivec2(n)));
+        memoryBarrierShared();
+        barrier();
+        if (active) {
+            ivec2 q = t * 2;
+            value = average(tile[q.y][q.x], tile[q.y][q.x + 1],
+                    tile[q.y + 1][q.x], tile[q.y + 1][q.x + 1]);
+        }
+        memoryBarrierShared();
+        barrier();
+        if (active) {
+            tile[t.y][t.x] = value;
+            store(level, group * n + t, value);
+        }
+    }
+
+    if (levelCount <= 5) {
+        return;
+    }
+
+    // make our writes visible, then find out if we're the last group
+    memoryBarrierImage();
+    barrier();
+    if (t == ivec2(0)) {
+        uint groupCount = gl_NumWorkGroups.x * gl_NumWorkGroups.y;
+        isLastGroup = atomicAdd(counter, 1u) == groupCount - 1u;
+    }
+    memoryBarrierShared();
+    barrier();
+    if (!isLastGroup) {
+        return;
+    }
+
+    for (int level = 5; level < levelCount; level++) {
+        ivec2 size = SIZE(destination[level]);
+        ivec2 previous = SIZE(destination[level - 1]) - 1;
+        for (int y = t.y; y < size.y; y += 16) {
+            for (int x = t.x; x < size.x; x += 16) {
+                ivec2 q = ivec2(x, y) * 2;
+                value = average(
+                        imageLoad(destination[level - 1], COORD(min(q, previous))),
+                        imageLoad(destination[level - 1], COORD(min(q + ivec2(1, 0), previous))),
+                        imageLoad(destination[level - 1], COORD(min(q + ivec2(0, 1), previous))),
+                        imageLoad(destination[level - 1], COORD(min(q + ivec2(1, 1), previous))));
+                store(level, ivec2(x, y), value);
+            }
+        }
+        memoryBarrierImage();
+        barrier();
+    }
+}
+)GLSL";
+
+// ------------------------------------------------------------------------------------------------
+// IBL prefilter
+// ------------------------------------------------------------------------------------------------
+
+// Parameters of a level of the IBL prefilter program, in a storage buffer (std430)
+struct IblPrefilterParams {
+    int32_t dimension;      // width and height of the level
+    int32_t sampleOffset;   // first sample of the level
+    int32_t sampleCount;    // number of samples of the level
+    int32_t padding;
+};
+
+// A GGX importance sample of the IBL prefilter program, in a storage buffer (std430)
+struct IblPrefilterSample {
+    float3 direction;       // in the tangent space of the texel's direction
+    float weight;           // normalized <n.l>
+    float lod;              // level of the environment the sample is read from
+    float padding[3];
+};
+static_assert(sizeof(IblPrefilterSample) == 32, "IblPrefilterSample doesn't match std430");
+
+// Parameters of the IBL spherical harmonics program, in a storage buffer (std430)
+struct IblShParams {
+    int32_t dimension;      // number of samples along each side of a face
+    float lod;              // level of the environment the samples are read from
+};
+
+// Number of samples along each side of a face for the SH projection
+static constexpr uint32_t kIblShDimension = 32;
+
+// Maximum number of samples per texel of a level, like cmgen the count doubles for each level
+static constexpr uint32_t kMaxIblPrefilterSamples = 1024;
+
+static constexpr const char* const sCubemapDirectionShader = R"GLSL(
+// direction of the center of texel p of a cubemap face, with the OpenGL face orientations
+vec3 getDirection(ivec2 p, int face, int dimension) {
+    vec2 uv = (vec2(p) + 0.5) * (2.0 / float(dimension)) - 1.0;
+    switch (face) {
+        case 0:  return vec3( 1.0, -uv.y, -uv.x);
+        case 1:  return vec3(-1.0, -uv.y,  uv.x);
+        case 2:  return vec3( uv.x,  1.0,  uv.y);
+        case 3:  return vec3( uv.x, -1.0, -uv.y);
+        case 4:  return vec3( uv.x, -uv.y,  1.0);
+        default: return vec3(-uv.x, -uv.y, -1.0);
+    }
+}
+)GLSL";
+
+// Each invocation writes a texel of a level of the reflections cubemap, the faces are the z
+// dimension of the dispatch. The samples are precomputed on the CPU, see
+// appendIblPrefilterSamples().
+static constexpr const char* const sIblPrefilterComputeShader = R"GLSL(
+layout(local_size_x = 8, local_size_y = 8) in;
+
+struct Sample {
+    vec3 direction;
+    float weight;
+    float lod;
+};
+
+layout(std430, binding = 0) readonly buffer IblPrefilterParams {
+    int dimension;
+    int sampleOffset;
+    int sampleCount;
+};
+
+layout(std430, binding = 1) readonly buffer IblPrefilterSamples {
+    Sample samples[];
+};
+
+uniform samplerCube environment;
+
+layout(FORMAT, binding = 0) uniform writeonly imageCube destination;
+
+void main() {
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+    int face = int(gl_GlobalInvocationID.z);
+    if (any(greaterThanEqual(p, ivec2(dimension)))) {
+        return;
+    }
+
+    // tangent frame around the texel's direction, rotated by a different angle for each texel
+    // like cmgen does, which trades the banding of low sample counts for noise
+    vec3 N = normalize(getDirection(p, face, dimension));
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 T = normalize(cross(up, N));
+    vec3 B = cross(N, T);
+    float angle = 6.2831853 * fract(52.9829189 * fract(dot(vec2(p), vec2(0.06711056, 0.00583715))));
+    float c = cos(angle);
+    float s = sin(angle);
+    mat3 tangentToWorld = mat3(c * T + s * B, c * B - s * T, N);
+
+    vec3 color = vec3(0.0);
+    for (int i = 0; i < sampleCount; i++) {
+        Sample smp = samples[sampleOffset + i];
+        color += smp.weight * textureLod(environment, tangentToWorld * smp.direction, smp.lod).rgb;
+    }
+    imageStore(destination, ivec3(p, face), vec4(color, 1.0));
+}
+)GLSL";
+
+// A single work group projects the environment on the first 3 bands of the real spherical
+// harmonics basis, and writes the 9 radiance coefficients to a 9x1 image.
+static constexpr const char* const sIblShComputeShader = R"GLSL(
+layout(local_size_x = 16, local_size_y = 16) in;
+
+layout(std430, binding = 0) readonly buffer IblShParams {
+    int dimension;
+    float lod;
+};
+
+uniform samplerCube environment;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D destination;
+
+shared vec3 partial[256];
+
+void main() {
+    int index = int(gl_LocalInvocationIndex);
+    vec3 sh[9];
+    for (int i = 0; i < 9; i++) {
+        sh[i] = vec3(0.0);
+    }
+
+    int texelCount = dimension * dimension;
+    for (int face = 0; face < 6; face++) {
+        for (int t = index; t < texelCount; t += 256) {
+            vec3 d = getDirection(ivec2(t % dimension, t / dimension), face, dimension);
+            // solid angle of the texel
+            float l2 = dot(d, d);
+            float solidAngle = 4.0 / (float(texelCount) * l2 * sqrt(l2));
+            vec3 s = d * inversesqrt(l2);
+            vec3 color = textureLod(environment, s, lod).rgb * solidAngle;
+            sh[0] += color *  0.282095;
+            sh[1] += color * (-0.488603 * s.y);
+            sh[2] += color * ( 0.488603 * s.z);
+            sh[3] += color * (-0.488603 * s.x);
+            sh[4] += color * ( 1.092548 * s.y * s.x);
+            sh[5] += color * (-1.092548 * s.y * s.z);
+            sh[6] += color * ( 0.315392 * (3.0 * s.z * s.z - 1.0));
+            sh[7] += color * (-1.092548 * s.z * s.x);
+            sh[8] += color * ( 0.546274 * (s.x * s.x - s.y * s.y));
+        }
+    }
+
+    for (int i = 0; i < 9; i++) {
+        partial[index] = sh[i];
+        memoryBarrierShared();
+        barrier();
+        for (int n = 128; n > 0; n >>= 1) {
+            if (index < n) {
+                partial[index] += partial[index + n];
+            }
+            memoryBarrierShared();
+            barrier();
+        }
+        if (index == 0) {
+            imageStore(destination, ivec2(i, 0), vec4(partial[0], 0.0));
+        }
+        memoryBarrierShared();
+        barrier();
+    }
+}
+)GLSL";
+
+// Reduces a depth buffer to the range of the depths of its samples, with a single work group.
+// The depth is reversed, the background is cleared to 0 and doesn't count. When there are no
+// samples, the range is empty (min > max).
+static constexpr const char* const sDepthRangeComputeShader = R"GLSL(
+layout(local_size_x = 16, local_size_y = 16) in;
+
+uniform sampler2D depth;
+
+layout(rgba32f, binding = 0) uniform writeonly image2D destination;
+
+shared vec2 partial[256];
+
+void main() {
+    int index = int(gl_LocalInvocationIndex);
+    ivec2 size = textureSize(depth, 0);
+
+    vec2 range = vec2(1.0, 0.0);
+    for (int y = int(gl_LocalInvocationID.y); y < size.y; y += 16) {
+        for (int x = int(gl_LocalInvocationID.x); x < size.x; x += 16) {
+            float d = texelFetch(depth, ivec2(x, y), 0).r;
+            if (d > 0.0) {
+                range = vec2(min(range.x, d), max(range.y, d));
+            }
+        }
+    }
+
+    partial[index] = range;
+    memoryBarrierShared();
+    barrier();
+    for (int n = 128; n > 0; n >>= 1) {
+        if (index < n) {
+            partial[index] = vec2(min(partial[index].x, partial[index + n].x),
+                    max(partial[index].y, partial[index + n].y));
+        }
+        memoryBarrierShared();
+        barrier();
+    }
+    if (index == 0) {
+        imageStore(destination, ivec2(0, 0), vec4(partial[0], 0.0, 0.0));
+    }
+}
+)GLSL";
+
+// ------------------------------------------------------------------------------------------------
+// Color grading LUT
+// ------------------------------------------------------------------------------------------------
+
+// Each invocation writes a texel of the LUT, like the jobs of FColorGrading do on the CPU. The
+// color transforms are the GLSL versions of the ones of ColorSpace.h and ToneMapping.h.
+static constexpr const char* const sColorGradingLutComputeShader = R"GLSL(
+layout(local_size_x = 4, local_size_y = 4, local_size_z = 4) in;
+
+layout(std430, binding = 0) readonly buffer ColorGradingLutParams {
+    mat3 transformIn;
+    mat3 transformOut;
+    vec4 luma;
+    vec4 outRed;
+    vec4 outGreen;
+    vec4 outBlue;
+    vec4 shadows;
+    vec4 midtones;
+    vec4 highlights;
+    vec4 tonalRanges;
+    vec4 slope;
+    vec4 offset;
+    vec4 power;
+    vec4 shadowGamma;
+    vec4 midPoint;
+    vec4 highlightScale;
+    float contrast;
+    float vibrance;
+    float saturation;
+    int dimension;
+    int toneMapping;
+    int hasAdjustments;
+    int acesLog;
+};
+
+layout(FORMAT, binding = 0) uniform writeonly image3D lut;
+
+const vec3 LUMA_REC709 = vec3(0.2126730, 0.7151520, 0.0721750);
+const vec3 LUMA_AP1 = vec3(0.272229, 0.674082, 0.0536895);
+const float MIDDLE_GRAY_ACEScct = 0.4135884;
+const float HALF_MAX = 65504.0;
+
+const mat3 AP1_to_XYZ = mat3(
+     0.6624541811,  0.2722287168, -0.0055746495,
+     0.1340042065,  0.6740817658,  0.0040607335,
+     0.1561876870,  0.0536895174,  1.0103391003);
+const mat3 XYZ_to_AP1 = mat3(
+     1.6410233797, -0.6636628587,  0.0117218943,
+    -0.3248032942,  1.6153315917, -0.0082844420,
+    -0.2364246952,  0.0167563477,  0.9883948585);
+const mat3 AP1_to_AP0 = mat3(
+     0.6954522414,  0.0447945634, -0.0055258826,
+     0.1406786965,  0.8596711185,  0.0040252103,
+     0.1638690622,  0.0955343182,  1.0015006723);
+const mat3 AP0_to_AP1 = mat3(
+     1.4514393161, -0.0765537734,  0.0083161484,
+    -0.2365107469,  1.1762296998, -0.0060324498,
+    -0.2149285693, -0.0996759264,  0.9977163014);
+
+vec3 LogC_to_linear(vec3 x) {
+    return (pow(vec3(10.0), (x - 0.386036) * (1.0 / 0.244161)) - 0.047996) * (1.0 / 5.555556);
+}
+
+vec3 linear_to_LogC(vec3 x) {
+    return 0.244161 * (log2(5.555556 * x + 0.047996) * 0.30103) + 0.386036;
+}
+
+vec3 ACEScct_to_linearAP1(vec3 x) {
+    vec3 linear = (x - 0.0729055341958355) * (1.0 / 10.5402377416545);
+    vec3 curve = mix(exp2(x * 17.52 - 9.72), vec3(HALF_MAX),
+            greaterThanEqual(x, vec3(1.467996312)));
+    return mix(curve, linear, lessThanEqual(x, vec3(0.155251141552511)));
+}
+
+vec3 linearAP1_to_ACEScct(vec3 x) {
+    return mix((log2(x) + 9.72) * (1.0 / 17.52), 10.5402377416545 * x + 0.0729055341958355,
+            lessThan(x, vec3(0.0078125)));
+}
+
+vec3 OECF_sRGB(vec3 x) {
+    return mix(1.055 * pow(x, vec3(1.0 / 2.4)) - 0.055, x * 12.92,
+            lessThanEqual(x, vec3(0.0031308)));
+}
+
+vec3 XYZ_to_xyY(vec3 v) {
+    return vec3(v.xy / max(v.x + v.y + v.z, 1e-5), v.y);
+}
+
+vec3 xyY_to_XYZ(vec3 v) {
+    float a = v.z / max(v.y, 1e-5);
+    return vec3(v.x * a, v.z, (1.0 - v.x - v.y) * a);
+}
+
+// ACES, from https://github.com/ampas/aces-dev, see ToneMapping.h
+
+float rgb_2_saturation(vec3 rgb) {
+    const float TINY = 1e-5;
+    float mi = min(min(rgb.r, rgb.g), rgb.b);
+    float ma = max(max(rgb.r, rgb.g), rgb.b);
+    return (max(ma, TINY) - max(mi, TINY)) / max(ma, 1e-2);
+}
+
+float rgb_2_yc(vec3 rgb) {
+    const float ycRadiusWeight = 1.75;
+    float r = rgb.r;
+    float g = rgb.g;
+    float b = rgb.b;
+    float chroma = sqrt(b * (b - g) + g * (g - r) + r * (r - b));
+    return (b + g + r + ycRadiusWeight * chroma) / 3.0;
+}
+
+float sigmoid_shaper(float x) {
+    float t = max(1.0 - abs(x / 2.0), 0.0);
+    float y = 1.0 + sign(x) * (1.0 - t * t);
+    return y / 2.0;
+}
+
+float glow_fwd(float ycIn, float glowGainIn, float glowMid) {
+    if (ycIn <= 2.0 / 3.0 * glowMid) {
+        return glowGainIn;
+    } else if (ycIn >= 2.0 * glowMid) {
+        return 0.0;
+    }
+    return glowGainIn * (glowMid / ycIn - 1.0 / 2.0);
+}
+
+float rgb_2_hue(vec3 rgb) {
+    float hue = 0.0;
+    if (!(rgb.x == rgb.y && rgb.y == rgb.z)) {
+        hue = degrees(atan(sqrt(3.0) * (rgb.y - rgb.z), 2.0 * rgb.x - rgb.y - rgb.z));
+    }
+    return (hue < 0.0) ? hue + 360.0 : hue;
+}
+
+float center_hue(float hue, float centerH) {
+    float hueCentered = hue - centerH;
+    if (hueCentered < -180.0) {
+        hueCentered = hueCentered + 360.0;
+    } else if (hueCentered > 180.0) {
+        hueCentered = hueCentered - 360.0;
+    }
+    return hueCentered;
+}
+
+vec3 darkSurround_to_dimSurround(vec3 linearCV) {
+    const float DIM_SURROUND_GAMMA = 0.9811;
+    vec3 xyY = XYZ_to_xyY(AP1_to_XYZ * linearCV);
+    xyY.z = pow(clamp(xyY.z, 0.0, HALF_MAX), DIM_SURROUND_GAMMA);
+    return XYZ_to_AP1 * xyY_to_XYZ(xyY);
+}
+
+vec3 ACES(vec3 color, float brightness) {
+    const float RRT_GLOW_GAIN = 0.05;
+    const float RRT_GLOW_MID = 0.08;
+    const float RRT_RED_SCALE = 0.82;
+    const float RRT_RED_PIVOT = 0.03;
+    const float RRT_RED_HUE = 0.0;
+    const float RRT_RED_WIDTH = 135.0;
+    const float RRT_SAT_FACTOR = 0.96;
+    const float ODT_SAT_FACTOR = 0.93;
+
+    vec3 ap0 = AP1_to_AP0 * color;
+
+    float saturation = rgb_2_saturation(ap0);
+    float ycIn = rgb_2_yc(ap0);
+    float s = sigmoid_shaper((saturation - 0.4) / 0.2);
+    float addedGlow = 1.0 + glow_fwd(ycIn, RRT_GLOW_GAIN * s, RRT_GLOW_MID);
+    ap0 *= addedGlow;
+
+    float hue = rgb_2_hue(ap0);
+    float centeredHue = center_hue(hue, RRT_RED_HUE);
+    float hueWeight = smoothstep(0.0, 1.0, 1.0 - abs(2.0 * centeredHue / RRT_RED_WIDTH));
+    hueWeight *= hueWeight;
+    ap0.r += hueWeight * saturation * (RRT_RED_PIVOT - ap0.r) * (1.0 - RRT_RED_SCALE);
+
+    vec3 ap1 = clamp(AP0_to_AP1 * ap0, 0.0, HALF_MAX);
+    ap1 = mix(vec3(dot(ap1, LUMA_AP1)), ap1, RRT_SAT_FACTOR);
+    ap1 *= brightness;
+
+    const float a = 2.785085;
+    const float b = 0.107772;
+    const float c = 2.936045;
+    const float d = 0.887122;
+    const float e = 0.806889;
+    vec3 rgbPost = (ap1 * (a * ap1 + b)) / (ap1 * (c * ap1 + d) + e);
+
+    vec3 linearCV = darkSurround_to_dimSurround(rgbPost);
+    return mix(vec3(dot(linearCV, LUMA_AP1)), linearCV, ODT_SAT_FACTOR);
+}
+
+vec3 Uchimura(vec3 x) {
+    const float P = 1.0;
+    const float a = 1.0;
+    const float m = 0.22;
+    const float l = 0.4;
+    const float c = 1.33;
+    const float b = 0.0;
+
+    const float l0 = ((P - m) * l) / a;
+    const float S0 = m + l0;
+    const float S1 = m + a * l0;
+    const float C2 = (a * P) / (P - S1);
+    const float CP = -C2 / P;
+
+    vec3 w0 = 1.0 - smoothstep(0.0, m, x);
+    vec3 w2 = step(m + l0, x);
+    vec3 w1 = 1.0 - w0 - w2;
+
+    vec3 T = m * pow(x / m, vec3(c)) + b;
+    vec3 S = P - (P - S1) * exp(CP * (x - S0));
+    vec3 L = m + a * (x - m);
+
+    return T * w0 + L * w1 + S * w2;
+}
+
+vec3 DisplayRange(vec3 x) {
+    const vec3 debugColors[17] = vec3[](
+            vec3(0.0,     0.0,     0.0),
+            vec3(0.0,     0.0,     0.1647),
+            vec3(0.0,     0.0,     0.3647),
+            vec3(0.0,     0.0,     0.6647),
+            vec3(0.0,     0.0,     0.9647),
+            vec3(0.0,     0.9255,  0.9255),
+            vec3(0.0,     0.5647,  0.0),
+            vec3(0.0,     0.7843,  0.0),
+            vec3(1.0,     1.0,     0.0),
+            vec3(0.90588, 0.75294, 0.0),
+            vec3(1.0,     0.5647,  0.0),
+            vec3(1.0,     0.0,     0.0),
+            vec3(0.8392,  0.0,     0.0),
+            vec3(1.0,     0.0,     1.0),
+            vec3(0.6,     0.3333,  0.7882),
+            vec3(1.0,     1.0,     1.0),
+            vec3(1.0,     1.0,     1.0));
+    float v = log2(dot(x, LUMA_REC709) / 0.18);
+    v = clamp(v + 5.0, 0.0, 15.0);
+    int index = int(v);
+    return mix(debugColors[index], debugColors[index + 1], clamp(v - float(index), 0.0, 1.0));
+}
+
+// the values of ColorGrading::ToneMapping
+vec3 toneMap(vec3 x) {
+    switch (toneMapping) {
+        case 1: return ACES(x, 1.0 / 0.6);
+        case 2: return ACES(x, 1.0);
+        case 3: return (x * (2.51 * x + 0.03)) / (x * (2.43 * x + 0.59) + 0.14);
+        case 4: return Uchimura(x);
+        case 5: return x / (1.0 + dot(x, LUMA_REC709));
+        case 6: return DisplayRange(x);
+        default: return x;
+    }
+}
+
+vec3 adjust(vec3 v) {
+    // Kill negative values before the next transforms
+    v = max(v, 0.0);
+
+    // Channel mixer
+    v = vec3(dot(v, outRed.rgb), dot(v, outGreen.rgb), dot(v, outBlue.rgb));
+
+    // Shadows/mid-tones/highlights
+    float y = dot(v, luma.rgb);
+    float s = 1.0 - smoothstep(tonalRanges.x, tonalRanges.y, y);
+    float h = smoothstep(tonalRanges.z, tonalRanges.w, y);
+    float m = 1.0 - s - h;
+    v = v * s * shadows.rgb + v * m * midtones.rgb + v * h * highlights.rgb;
+
+    // The adjustments below behave better in log space
+    v = acesLog != 0 ? linearAP1_to_ACEScct(v) : linear_to_LogC(v);
+
+    // ASC CDL
+    v = v * slope.rgb + offset.rgb;
+    v = mix(pow(v, power.rgb), v, lessThanEqual(v, vec3(0.0)));
+
+    // Contrast in log space
+    v = MIDDLE_GRAY_ACEScct + contrast * (v - MIDDLE_GRAY_ACEScct);
+
+    // Back to linear space
+    v = acesLog != 0 ? ACEScct_to_linearAP1(v) : LogC_to_linear(v);
+
+    // Vibrance in linear space
+    float r = v.r - max(v.g, v.b);
+    float sv = (vibrance - 1.0) / (1.0 + exp(-r * 3.0)) + 1.0;
+    vec3 l = (1.0 - sv) * LUMA_REC709;
+    v = vec3(dot(v, l + vec3(sv, 0.0, 0.0)), dot(v, l + vec3(0.0, sv, 0.0)),
+            dot(v, l + vec3(0.0, 0.0, sv)));
+
+    // Saturation in linear space
+    float ys = dot(v, LUMA_REC709);
+    v = ys + saturation * (v - ys);
+
+    // Kill negative values before tone mapping
+    v = max(v, 0.0);
+
+    // RGB curves
+    vec3 d = 1.0 / pow(midPoint.rgb, shadowGamma.rgb - 1.0);
+    vec3 dark = pow(v, shadowGamma.rgb) * d;
+    vec3 light = highlightScale.rgb * (v - midPoint.rgb) + midPoint.rgb;
+    return mix(light, dark, lessThanEqual(v, midPoint.rgb));
+}
+
+void main() {
+    ivec3 p = ivec3(gl_GlobalInvocationID);
+    if (any(greaterThanEqual(p, ivec3(dimension)))) {
+        return;
+    }
+
+    // LogC encoding
+    vec3 v = LogC_to_linear(vec3(p) * (1.0 / float(dimension - 1)));
+
+    // White balance, when there are adjustments, and conversion to the color grading color space
+    v = transformIn * v;
+
+    if (hasAdjustments != 0) {
+        v = adjust(v);
+    }
+
+    v = toneMap(v);
+
+    // Convert to the output color space
+    v = clamp(transformOut * v, 0.0, 1.0);
+
+    imageStore(lut, p, vec4(OECF_sRGB(v), 0.0));
+}
+)GLSL";
+
+static float2 hammersley(uint32_t i, float iN) noexcept {
+    constexpr float tof = 0.5f / 0x80000000U;
+    uint32_t bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return { i * iN, bits * tof };
+}
+
+// Inverse of the perceptualRoughness-to-LOD mapping of the shaders, same as cmgen's
+static float lodToPerceptualRoughness(float lod) noexcept {
+    const float a = 2.0f;
+    const float b = -1.0f;
+    return (lod != 0)
+            ? saturate((std::sqrt(a * a + 4.0f * b * lod) - a) / (2.0f * b))
+            : 0.0f;
+}
+
+// Appends the samples of a level of the reflections, like CubemapIBL::roughnessFilter() does on
+// the CPU: GGX importance samples weighted by <n.l>, read from the level of the environment
+// whose texels have about the solid angle of the sample (filtered importance sampling).
+// 'omegaP' is the solid angle of a texel of the base level of the environment.
+static void appendIblPrefilterSamples(std::vector<IblPrefilterSample>& samples,
+        float linearRoughness, uint32_t sampleCount, float omegaP, float maxLod) noexcept {
+    const size_t first = samples.size();
+    const float a2 = linearRoughness * linearRoughness;
+    float weight = 0.0f;
+    for (uint32_t i = 0; i < sampleCount; i++) {
+        // importance sample of the GGX distribution, around n = v = [0 0 1]
+        const float2 u = hammersley(i, 1.0f / sampleCount);
+        const float phi = 2.0f * float(F_PI) * u.x;
+        const float cosTheta2 = (1.0f - u.y) / (1.0f + (a2 - 1.0f) * u.y);
+        const float cosTheta = std::sqrt(cosTheta2);
+        const float sinTheta = std::sqrt(1.0f - cosTheta2);
+        const float3 H{ sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta };
+
+        // l = reflect(-n, h)
+        const float NoH = H.z;
+        const float NoL = 2.0f * NoH * NoH - 1.0f;
+        if (NoL > 0.0f) {
+            const float f = (a2 - 1.0f) * NoH * NoH + 1.0f;
+            const float pdf = a2 / (float(F_PI) * f * f) / 4.0f;
+            // log4(K) = 1 is a LOD bias that allows a bit of overlapping between samples
+            const float omegaS = 1.0f / (sampleCount * pdf);
+            const float lod = 0.5f * std::log2(omegaS / omegaP) + 1.0f;
+            samples.push_back({{ 2.0f * NoH * H.x, 2.0f * NoH * H.y, NoL }, NoL,
+                    clamp(lod, 0.0f, maxLod) });
+            weight += NoL;
+        }
+    }
+    for (size_t i = first; i < samples.size(); i++) {
+        samples[i].weight /= weight;
+    }
+}
+
+// GLSL image format qualifiers of the texture formats supported by downsamplePass()
+static const char* getImageFormatQualifier(TextureFormat format) noexcept {
+    switch (format) {
+        case TextureFormat::R16F:           return "r16f";
+        case TextureFormat::R32F:           return "r32f";
+        case TextureFormat::RG16F:          return "rg16f";
+        case TextureFormat::RG32F:          return "rg32f";
+        case TextureFormat::R11F_G11F_B10F: return "r11f_g11f_b10f";
+        case TextureFormat::RGBA8:          return "rgba8";
+        case TextureFormat::RGB10_A2:       return "rgb10_a2";
+        case TextureFormat::RGBA16F:        return "rgba16f";
+        case TextureFormat::RGBA32F:        return "rgba32f";
+        default:                            return nullptr;
+    }
+}
+
 void PostProcessManager::init() noexcept {
     auto& engine = mEngine;
     DriverApi& driver = engine.getDriverApi();
 
     registerPostProcessMaterial("sao", MATERIAL(SAO));
+    registerPostProcessMaterial("aoTemporal", MATERIAL(AOTEMPORAL));
     registerPostProcessMaterial("mipmapDepth", MATERIAL(MIPMAPDEPTH));
     registerPostProcessMaterial("vsmMipmap", MATERIAL(VSMMIPMAP));
     registerPostProcessMaterial("bilateralBlur", MATERIAL(BILATERALBLUR));
@@ -201,10 +940,12 @@ void PostProcessManager::init() noexcept {
     registerPostProcessMaterial("blitLow", MATERIAL(BLITLOW));
     registerPostProcessMaterial("blitMedium", MATERIAL(BLITMEDIUM));
     registerPostProcessMaterial("blitHigh", MATERIAL(BLITHIGH));
+    registerPostProcessMaterial("oitComposite", MATERIAL(OITCOMPOSITE));
     registerPostProcessMaterial("colorGrading", MATERIAL(COLORGRADING));
     registerPostProcessMaterial("colorGradingAsSubpass", MATERIAL(COLORGRADINGASSUBPASS));
     registerPostProcessMaterial("fxaa", MATERIAL(FXAA));
     registerPostProcessMaterial("taa", MATERIAL(TAA));
+    registerPostProcessMaterial("taaUpscale", MATERIAL(TAAUPSCALE));
     registerPostProcessMaterial("dofDownsample", MATERIAL(DOFDOWNSAMPLE));
     registerPostProcessMaterial("dofMipmap", MATERIAL(DOFMIPMAP));
     registerPostProcessMaterial("dofTiles", MATERIAL(DOFTILES));
@@ -213,15 +954,6 @@ void PostProcessManager::init() noexcept {
     registerPostProcessMaterial("dofMedian", MATERIAL(DOFMEDIAN));
     registerPostProcessMaterial("dofCombine", MATERIAL(DOFCOMBINE));
 
-    // UBO storage size.
-    // The effective kernel size is (kMaxPositiveKernelSize - 1) * 4 + 1.
-    // e.g.: 5 positive-side samples, give 4+1+4=9 samples both sides
-    // taking advantage of linear filtering produces an effective kernel of 8+1+8=17 samples
-    // and because it's a separable filter, the effective 2D filter kernel size is 17*17
-    // The total number of samples needed over the two passes is 18.
-    auto& separableGaussianBlur = getPostProcessMaterial("separableGaussianBlur");
-    mSeparableGaussianBlurKernelStorageSize = separableGaussianBlur.getMaterial()->reflect("kernel")->size;
-
     mDummyOneTexture = driver.createTexture(SamplerType::SAMPLER_2D, 1,
             TextureFormat::RGBA8, 1, 1, 1, 1, TextureUsage::DEFAULT);
 
@@ -240,6 +972,22 @@ void PostProcessManager::init() noexcept {
     driver.update2DImage(mDummyOneTexture, 0, 0, 0, 1, 1, std::move(dataOne));
     driver.update3DImage(mDummyOneTextureArray, 0, 0, 0, 0, 1, 1, 1, std::move(dataOneArray));
     driver.update2DImage(mDummyZeroTexture, 0, 0, 0, 1, 1, std::move(dataZero));
+
+    // The compute programs are given as GLSL, they could be generated by matc once it supports
+    // compute shaders. Desktop GL is needed for most image formats (e.g. rg32f).
+    mHasComputeDownsample = engine.getBackend() == Backend::OPENGL &&
+            engine.getDriver().getShaderModel() == ShaderModel::GL_CORE_41 &&
+            driver.isComputeSupported();
+    if (mHasComputeDownsample) {
+        mDownsampleParams = driver.createUniformBuffer(sizeof(DownsampleParams),
+                BufferUsage::DYNAMIC);
+        mIblPrefilterParams = driver.createUniformBuffer(
+                std::max(sizeof(IblPrefilterParams), sizeof(IblShParams)), BufferUsage::DYNAMIC);
+        mIblEnvironmentSamplers = driver.createSamplerGroup(1);
+        mDepthRangeSamplers = driver.createSamplerGroup(1);
+        mColorGradingLutParams = driver.createUniformBuffer(sizeof(ColorGradingLutParams),
+                BufferUsage::DYNAMIC);
+    }
 }
 
 void PostProcessManager::terminate(DriverApi& driver) noexcept {
@@ -247,6 +995,35 @@ void PostProcessManager::terminate(DriverApi& driver) noexcept {
     driver.destroyTexture(mDummyOneTexture);
     driver.destroyTexture(mDummyOneTextureArray);
     driver.destroyTexture(mDummyZeroTexture);
+    for (DownsampleProgram const& p : mDownsamplePrograms) {
+        driver.destroyProgram(p.program);
+    }
+    mDownsamplePrograms.clear();
+    if (mDownsampleParams) {
+        driver.destroyUniformBuffer(mDownsampleParams);
+    }
+    for (IblPrefilterProgram const& p : mIblPrefilterPrograms) {
+        driver.destroyProgram(p.program);
+    }
+    mIblPrefilterPrograms.clear();
+    if (mIblShProgram) {
+        driver.destroyProgram(mIblShProgram);
+    }
+    if (mIblPrefilterParams) {
+        driver.destroyUniformBuffer(mIblPrefilterParams);
+        driver.destroySamplerGroup(mIblEnvironmentSamplers);
+        driver.destroySamplerGroup(mDepthRangeSamplers);
+    }
+    if (mDepthRangeProgram) {
+        driver.destroyProgram(mDepthRangeProgram);
+    }
+    for (ColorGradingLutProgram const& p : mColorGradingLutPrograms) {
+        driver.destroyProgram(p.program);
+    }
+    mColorGradingLutPrograms.clear();
+    if (mColorGradingLutParams) {
+        driver.destroyUniformBuffer(mColorGradingLutParams);
+    }
     auto first = mMaterialRegistry.begin();
     auto last = mMaterialRegistry.end();
     while (first != last) {
@@ -255,14 +1032,27 @@ void PostProcessManager::terminate(DriverApi& driver) noexcept {
     }
 }
 
+// blending of a premultiplied color over the content of the render target
+static void setPremultipliedBlending(RasterState& rasterState) noexcept {
+    rasterState.blendFunctionSrcRGB   = BlendFunction::ONE;
+    rasterState.blendFunctionSrcAlpha = BlendFunction::ONE;
+    rasterState.blendFunctionDstRGB   = BlendFunction::ONE_MINUS_SRC_ALPHA;
+    rasterState.blendFunctionDstAlpha = BlendFunction::ONE_MINUS_SRC_ALPHA;
+}
+
 UTILS_NOINLINE
 void PostProcessManager::commitAndRender(FrameGraphRenderTarget const& out,
-        PostProcessMaterial const& material, uint8_t variant, DriverApi& driver) const noexcept {
+        PostProcessMaterial const& material, uint8_t variant, DriverApi& driver,
+        bool blend) const noexcept {
     FMaterialInstance* const mi = material.getMaterialInstance();
     mi->commit(driver);
     mi->use(driver);
+    PipelineState pipeline(material.getPipelineState(variant));
+    if (blend) {
+        setPremultipliedBlending(pipeline.rasterState);
+    }
     driver.beginRenderPass(out.target, out.params);
-    driver.draw(material.getPipelineState(variant), mEngine.getFullScreenRenderPrimitive());
+    driver.draw(pipeline, mEngine.getFullScreenRenderPrimitive(), 1);
     driver.endRenderPass();
 }
 
@@ -309,10 +1099,14 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::structure(FrameGraph& fg,
                         .attachments = {{}, data.depth },
                         .clearFlags = TargetBufferFlags::DEPTH
                 });
+
+                if (size_t size = pass.prepareParallelExecution()) {
+                    builder.parallel(size);
+                }
             },
             [=](FrameGraphPassResources const& resources, auto const& data, DriverApi& driver) {
                 auto out = resources.get(data.rt);
-                pass.execute(resources.getPassName(), out.target, out.params);
+                pass.execute(driver, resources.getPassName(), out.target, out.params);
             });
 
     auto depth = structurePass.getData().depth;
@@ -364,9 +1158,402 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::mipmapPass(FrameGraph& fg,
     return depthMipmapPass.getData().out;
 }
 
+bool PostProcessManager::hasComputeDownsample(TextureFormat format) const noexcept {
+    return mHasComputeDownsample && getImageFormatQualifier(format);
+}
+
+Handle<HwProgram> PostProcessManager::getDownsampleProgram(DriverApi& driver,
+        TextureFormat format, bool array) noexcept {
+    auto pos = std::find_if(mDownsamplePrograms.begin(), mDownsamplePrograms.end(),
+            [format, array](DownsampleProgram const& p) {
+                return p.format == format && p.array == array;
+            });
+    if (pos != mDownsamplePrograms.end()) {
+        return pos->program;
+    }
+
+    std::string source("#version 430 core\n");
+    source += "#define FORMAT ";
+    source += getImageFormatQualifier(format);
+    source += "\n#define MAX_LEVELS " + std::to_string(kMaxDownsampleLevels) + "\n";
+    if (array) {
+        source += "#define ARRAY\n";
+    }
+    source += sDownsampleComputeShader;
+
+    Program p;
+    p.diagnostics(CString("downsample"))
+            .withComputeShader(source.c_str(), source.size() + 1)
+            .setWorkGroupSize({ 16, 16, 1 });
+    Handle<HwProgram> program = driver.createProgram(std::move(p));
+    mDownsamplePrograms.push_back({ format, array, program });
+    return program;
+}
+
+FrameGraphId<FrameGraphTexture> PostProcessManager::downsamplePass(FrameGraph& fg,
+        FrameGraphId<FrameGraphTexture> input, uint8_t layer, uint8_t baseLevel,
+        uint8_t levelCount, bool preserveBorder) noexcept {
+
+    struct DownsampleData {
+        FrameGraphId<FrameGraphTexture> out;
+    };
+
+    auto& ppDownsample = fg.addComputePass<DownsampleData>("Downsample Pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.out = builder.image(builder.read(input));
+            },
+            [=](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto const& desc = resources.getDescriptor(data.out);
+                auto texture = resources.getTexture(data.out);
+                assert(hasComputeDownsample(desc.format));
+                assert(baseLevel + levelCount < desc.levels);
+
+                Handle<HwProgram> program = getDownsampleProgram(driver, desc.format,
+                        desc.type == SamplerType::SAMPLER_2D_ARRAY);
+
+                driver.bindStorageBuffer(0, mDownsampleParams);
+                for (uint8_t first = baseLevel, end = uint8_t(baseLevel + levelCount); first < end;) {
+                    const uint8_t count = std::min(uint8_t(end - first), kMaxDownsampleLevels);
+
+                    DownsampleParams* params = driver.allocatePod<DownsampleParams>(1);
+                    *params = { 0, count, layer, preserveBorder };
+                    driver.updateUniformBuffer(mDownsampleParams,
+                            { params, sizeof(DownsampleParams) }, 0);
+
+                    driver.bindImage(0, texture, first);
+                    for (uint8_t i = 0; i < count; i++) {
+                        driver.bindImage(i + 1, texture, uint8_t(first + i + 1));
+                    }
+
+                    // a work group for each 32x32 tile of the base level
+                    const uint32_t width = std::max(1u, desc.width >> first);
+                    const uint32_t height = std::max(1u, desc.height >> first);
+                    driver.dispatch(program, { (width + 31) / 32, (height + 31) / 32, 1 });
+
+                    first += count;
+                    if (first < end) {
+                        // the next dispatch starts from the last level we wrote
+                        driver.memoryBarrier(MemoryBarrierFlags::STORAGE_IMAGE |
+                                MemoryBarrierFlags::STORAGE_BUFFER);
+                    }
+                }
+            });
+
+    return ppDownsample.getData().out;
+}
+
+bool PostProcessManager::hasComputeIblPrefilter(TextureFormat format) const noexcept {
+    return mHasComputeDownsample && getImageFormatQualifier(format);
+}
+
+Handle<HwProgram> PostProcessManager::getIblPrefilterProgram(DriverApi& driver,
+        TextureFormat format) noexcept {
+    auto pos = std::find_if(mIblPrefilterPrograms.begin(), mIblPrefilterPrograms.end(),
+            [format](IblPrefilterProgram const& p) { return p.format == format; });
+    if (pos != mIblPrefilterPrograms.end()) {
+        return pos->program;
+    }
+
+    std::string source("#version 430 core\n");
+    source += "#define FORMAT ";
+    source += getImageFormatQualifier(format);
+    source += "\n";
+    source += sCubemapDirectionShader;
+    source += sIblPrefilterComputeShader;
+
+    Program::Sampler environment{ CString("environment"), 0 };
+    Program p;
+    p.diagnostics(CString("iblPrefilter"))
+            .withComputeShader(source.c_str(), source.size() + 1)
+            .setSamplerGroup(BindingPoints::PER_MATERIAL_INSTANCE, &environment, 1)
+            .setWorkGroupSize({ 8, 8, 1 });
+    Handle<HwProgram> program = driver.createProgram(std::move(p));
+    mIblPrefilterPrograms.push_back({ format, program });
+    return program;
+}
+
+Handle<HwProgram> PostProcessManager::getIblShProgram(DriverApi& driver) noexcept {
+    if (!mIblShProgram) {
+        std::string source("#version 430 core\n");
+        source += sCubemapDirectionShader;
+        source += sIblShComputeShader;
+
+        Program::Sampler environment{ CString("environment"), 0 };
+        Program p;
+        p.diagnostics(CString("iblSphericalHarmonics"))
+                .withComputeShader(source.c_str(), source.size() + 1)
+                .setSamplerGroup(BindingPoints::PER_MATERIAL_INSTANCE, &environment, 1)
+                .setWorkGroupSize({ 16, 16, 1 });
+        mIblShProgram = driver.createProgram(std::move(p));
+    }
+    return mIblShProgram;
+}
+
+void PostProcessManager::prefilterIndirectLight(FrameGraph& fg,
+        FIndirectLight::PrefilterRequest const& request) noexcept {
+    FTexture const* const reflections = request.ibl->getReflectionsTexture();
+    FTexture const* const environment = request.environment;
+    assert(reflections && hasComputeIblPrefilter(reflections->getFormat()));
+
+    const uint32_t dimension = uint32_t(reflections->getWidth());
+    const uint8_t levels = uint8_t(reflections->getLevelCount());
+    const uint32_t environmentDimension = uint32_t(environment->getWidth());
+    const float environmentMaxLod = float(environment->getLevelCount() - 1);
+
+    // All the samples are computed up front and uploaded once. Level 0 is a mirror, and like
+    // cmgen, the roughness of the other levels follows the LOD selection of the shaders.
+    const float omegaP = (4.0f * float(F_PI)) /
+            (6.0f * environmentDimension * environmentDimension);
+    std::vector<IblPrefilterSample> samples;
+    std::vector<IblPrefilterParams> params(levels);
+    for (uint8_t level = 0; level < levels; level++) {
+        const uint32_t levelDimension = std::max(1u, dimension >> level);
+        const int32_t offset = int32_t(samples.size());
+        if (level == 0) {
+            const float lod = std::log2(float(environmentDimension) / levelDimension);
+            samples.push_back({{ 0, 0, 1 }, 1.0f, clamp(lod, 0.0f, environmentMaxLod) });
+        } else {
+            const float perceptualRoughness =
+                    lodToPerceptualRoughness(saturate(level / (levels - 1.0f)));
+            const uint32_t count = std::min(kMaxIblPrefilterSamples,
+                    uint32_t(std::max(uint16_t(1), request.options.sampleCount)) << (level - 1u));
+            appendIblPrefilterSamples(samples, perceptualRoughness * perceptualRoughness,
+                    count, omegaP, environmentMaxLod);
+        }
+        params[level] = { int32_t(levelDimension), offset, int32_t(samples.size()) - offset, 0 };
+    }
+
+    SamplerParams environmentParams;
+    environmentParams.filterMag = SamplerMagFilter::LINEAR;
+    environmentParams.filterMin = SamplerMinFilter::LINEAR_MIPMAP_LINEAR;
+    SamplerGroup environmentSamplers(1);
+    environmentSamplers.setSampler(0, { environment->getHwHandle(), environmentParams });
+
+    struct IblPrefilterData {
+        FrameGraphId<FrameGraphTexture> reflections;
+    };
+
+    auto input = fg.import<FrameGraphTexture>("IBL Reflections", {
+            .width = dimension,
+            .height = dimension,
+            .levels = levels,
+            .type = SamplerType::SAMPLER_CUBEMAP,
+            .format = reflections->getFormat(),
+            .usage = TextureUsage::STORAGE | TextureUsage::SAMPLEABLE
+    }, FrameGraphTexture{ .texture = reflections->getHwHandle() });
+
+    fg.addComputePass<IblPrefilterData>("IBL Prefilter Pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.reflections = builder.image(input);
+            },
+            [=, samples = std::move(samples), params = std::move(params)](
+                    FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto const& desc = resources.getDescriptor(data.reflections);
+                auto texture = resources.getTexture(data.reflections);
+                Handle<HwProgram> program = getIblPrefilterProgram(driver, desc.format);
+
+                const size_t size = samples.size() * sizeof(IblPrefilterSample);
+                Handle<HwUniformBuffer> sampleBuffer = driver.createUniformBuffer(size,
+                        BufferUsage::STATIC);
+                void* const buffer = malloc(size);
+                memcpy(buffer, samples.data(), size);
+                driver.updateUniformBuffer(sampleBuffer, { buffer, size,
+                        [](void* buffer, size_t, void*) { free(buffer); }}, 0);
+
+                driver.updateSamplerGroup(mIblEnvironmentSamplers,
+                        std::move(environmentSamplers.toCommandStream()));
+                driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mIblEnvironmentSamplers);
+                driver.bindStorageBuffer(0, mIblPrefilterParams);
+                driver.bindStorageBuffer(1, sampleBuffer);
+
+                for (uint8_t level = 0; level < desc.levels; level++) {
+                    IblPrefilterParams* p = driver.allocatePod<IblPrefilterParams>(1);
+                    *p = params[level];
+                    driver.updateUniformBuffer(mIblPrefilterParams,
+                            { p, sizeof(IblPrefilterParams) }, 0);
+                    driver.bindImage(0, texture, level);
+                    const uint32_t groups = (uint32_t(p->dimension) + 7) / 8;
+                    driver.dispatch(program, { groups, groups, 6 });
+                }
+
+                // the buffer is released once the dispatches are done
+                driver.destroyUniformBuffer(sampleBuffer);
+            });
+
+    if (!request.irradiance) {
+        return;
+    }
+
+    struct IblShData {
+        FrameGraphId<FrameGraphTexture> sh;
+    };
+
+    auto& ppIblSh = fg.addComputePass<IblShData>("IBL SH Pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.sh = builder.createTexture("IBL SH", {
+                        .width = 9,
+                        .height = 1,
+                        .format = TextureFormat::RGBA32F
+                });
+                data.sh = builder.image(data.sh);
+            },
+            [=](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                Handle<HwProgram> program = getIblShProgram(driver);
+
+                // sample a level of the environment close to the resolution of the projection
+                IblShParams* p = driver.allocatePod<IblShParams>(1);
+                *p = { int32_t(kIblShDimension), clamp(
+                        std::log2(float(environmentDimension) / kIblShDimension),
+                        0.0f, environmentMaxLod) };
+                driver.updateUniformBuffer(mIblPrefilterParams, { p, sizeof(IblShParams) }, 0);
+
+                driver.updateSamplerGroup(mIblEnvironmentSamplers,
+                        std::move(environmentSamplers.toCommandStream()));
+                driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mIblEnvironmentSamplers);
+                driver.bindStorageBuffer(0, mIblPrefilterParams);
+                driver.bindImage(0, resources.getTexture(data.sh), 0);
+                driver.dispatch(program, { 1, 1, 1 });
+            });
+
+    struct IblShReadbackData {
+        FrameGraphId<FrameGraphTexture> sh;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    fg.addPass<IblShReadbackData>("IBL SH Readback",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.sh = builder.read(ppIblSh.getData().sh);
+                data.rt = builder.createRenderTarget("IBL SH Readback Target", {
+                        .attachments = {{ data.sh }}
+                });
+                builder.sideEffect();
+            },
+            [destination = request.irradiance](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto out = resources.get(data.rt);
+                const size_t size = 9 * sizeof(float4);
+                driver.readPixels(out.target, 0, 0, 9, 1, {
+                        malloc(size), size, PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                        [](void* buffer, size_t, void* user) {
+                            using Readback = std::shared_ptr<FIndirectLight::IrradianceReadback>;
+                            Readback* const destination = static_cast<Readback*>(user);
+                            FIndirectLight* const ibl = (*destination)->ibl;
+                            if (ibl) {
+                                float4 const* const sh = static_cast<float4 const*>(buffer);
+                                float3 radiance[9];
+                                for (size_t i = 0; i < 9; i++) {
+                                    radiance[i] = sh[i].xyz;
+                                }
+                                ibl->setRadiance(radiance);
+                            }
+                            free(buffer);
+                            delete destination;
+                        }, new std::shared_ptr<FIndirectLight::IrradianceReadback>(destination) });
+            });
+}
+
+Handle<HwProgram> PostProcessManager::getDepthRangeProgram(DriverApi& driver) noexcept {
+    if (!mDepthRangeProgram) {
+        std::string source("#version 430 core\n");
+        source += sDepthRangeComputeShader;
+
+        Program::Sampler depth{ CString("depth"), 0 };
+        Program p;
+        p.diagnostics(CString("depthRange"))
+                .withComputeShader(source.c_str(), source.size() + 1)
+                .setSamplerGroup(BindingPoints::PER_MATERIAL_INSTANCE, &depth, 1)
+                .setWorkGroupSize({ 16, 16, 1 });
+        mDepthRangeProgram = driver.createProgram(std::move(p));
+    }
+    return mDepthRangeProgram;
+}
+
+FrameGraphId<FrameGraphTexture> PostProcessManager::depthRange(FrameGraph& fg,
+        FrameGraphId<FrameGraphTexture> depth) noexcept {
+    assert(hasComputeDepthRange());
+
+    struct DepthRangeData {
+        FrameGraphId<FrameGraphTexture> depth;
+        FrameGraphId<FrameGraphTexture> range;
+    };
+
+    auto& ppDepthRange = fg.addComputePass<DepthRangeData>("Depth Range Pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.depth = builder.sample(depth);
+                data.range = builder.createTexture("Depth Range", {
+                        .width = 1,
+                        .height = 1,
+                        .format = TextureFormat::RGBA32F
+                });
+                data.range = builder.image(data.range);
+            },
+            [=](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                Handle<HwProgram> program = getDepthRangeProgram(driver);
+
+                // only the base level is reduced, with nearest filtering
+                SamplerGroup depthSamplers(1);
+                depthSamplers.setSampler(0, { resources.getTexture(data.depth), {}});
+                driver.updateSamplerGroup(mDepthRangeSamplers,
+                        std::move(depthSamplers.toCommandStream()));
+                driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mDepthRangeSamplers);
+                driver.bindImage(0, resources.getTexture(data.range), 0);
+                driver.dispatch(program, { 1, 1, 1 });
+            });
+
+    return ppDepthRange.getData().range;
+}
+
+bool PostProcessManager::hasComputeColorGradingLut(TextureFormat format) const noexcept {
+    return mHasComputeDownsample && getImageFormatQualifier(format);
+}
+
+Handle<HwProgram> PostProcessManager::getColorGradingLutProgram(DriverApi& driver,
+        TextureFormat format) noexcept {
+    auto pos = std::find_if(mColorGradingLutPrograms.begin(), mColorGradingLutPrograms.end(),
+            [format](ColorGradingLutProgram const& p) { return p.format == format; });
+    if (pos != mColorGradingLutPrograms.end()) {
+        return pos->program;
+    }
+
+    std::string source("#version 430 core\n");
+    source += "#define FORMAT ";
+    source += getImageFormatQualifier(format);
+    source += "\n";
+    source += sColorGradingLutComputeShader;
+
+    Program p;
+    p.diagnostics(CString("colorGradingLut"))
+            .withComputeShader(source.c_str(), source.size() + 1)
+            .setWorkGroupSize({ 4, 4, 4 });
+    Handle<HwProgram> program = driver.createProgram(std::move(p));
+    mColorGradingLutPrograms.push_back({ format, program });
+    return program;
+}
+
+void PostProcessManager::colorGradingLut(DriverApi& driver, Handle<HwTexture> lut,
+        TextureFormat format, ColorGradingLutParams const& params) noexcept {
+    assert(hasComputeColorGradingLut(format));
+    Handle<HwProgram> program = getColorGradingLutProgram(driver, format);
+
+    ColorGradingLutParams* p = driver.allocatePod<ColorGradingLutParams>(1);
+    *p = params;
+    driver.updateUniformBuffer(mColorGradingLutParams, { p, sizeof(ColorGradingLutParams) }, 0);
+    driver.bindStorageBuffer(0, mColorGradingLutParams);
+    driver.bindImage(0, lut, 0);
+    const uint32_t groups = (uint32_t(params.dimension) + 3) / 4;
+    driver.dispatch(program, { groups, groups, groups });
+
+    // the LUT is sampled by the color grading pass of the next frames
+    driver.memoryBarrier(MemoryBarrierFlags::ALL);
+}
+
 FrameGraphId<FrameGraphTexture> PostProcessManager::screenSpaceAmbientOcclusion(
         FrameGraph& fg, RenderPass& pass,
-        filament::Viewport const& svp, const CameraInfo& cameraInfo,
+        filament::Viewport const& svp, const CameraInfo& cameraInfo, FrameHistory& frameHistory,
         View::AmbientOcclusionOptions options) noexcept {
 
     FEngine& engine = mEngine;
@@ -409,6 +1596,13 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::screenSpaceAmbientOcclusion(
             break;
     }
 
+    if (options.temporalFiltering) {
+        // Each frame only takes half the samples, the history makes up for the rest. The spiral
+        // is slightly rotated every frame, so that successive frames don't use the same samples.
+        sampleCount = std::max(4.0f, std::floor(sampleCount * 0.5f));
+        spiralTurns += halton(frameHistory.getCurrent().frameId).x - 0.5f;
+    }
+
     switch (options.lowPassFilter) {
         default:
         case View::QualityLevel::LOW:
@@ -546,7 +1740,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::screenSpaceAmbientOcclusion(
                 pipeline.rasterState.depthFunc = RasterState::DepthFunc::L;
 
                 driver.beginRenderPass(ssao.target, ssao.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -569,10 +1763,98 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::screenSpaceAmbientOcclusion(
                 config);
     }
 
+    if (options.temporalFiltering) {
+        ssao = ssaoTemporalPass(fg, ssao, frameHistory, options.temporalFeedback);
+    }
+
     fg.getBlackboard().put("ssao", ssao);
     return ssao;
 }
 
+FrameGraphId<FrameGraphTexture> PostProcessManager::ssaoTemporalPass(FrameGraph& fg,
+        FrameGraphId<FrameGraphTexture> input, FrameHistory& frameHistory,
+        float feedback) noexcept {
+
+    FrameGraphId<FrameGraphTexture> depth = fg.getBlackboard().get<FrameGraphTexture>("structure");
+    assert(depth.isValid());
+
+    // if we don't have a compatible history yet, just use the current AO buffer as history
+    FrameHistoryEntry const& entry = frameHistory[0];
+    const FrameGraphTexture::Descriptor desc = fg.getDescriptor(input);
+    FrameGraphId<FrameGraphTexture> ssaoHistory = input;
+    mat4f const* historyProjection = &frameHistory.getCurrent().projection;
+    if (entry.ssao.texture && entry.ssaoDesc.width == desc.width &&
+            entry.ssaoDesc.height == desc.height && entry.ssaoDesc.format == desc.format) {
+        ssaoHistory = fg.import("SSAO history", entry.ssaoDesc, entry.ssao);
+        historyProjection = &entry.projection;
+    }
+
+    struct TemporalPassData {
+        FrameGraphId<FrameGraphTexture> ssao;
+        FrameGraphId<FrameGraphTexture> depth;
+        FrameGraphId<FrameGraphTexture> history;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    // The AO buffer isn't jittered, its texels are blended with the reprojected history clamped
+    // to their neighborhood, which rejects disoccluded texels. Only the AO channel is filtered.
+    auto& temporalPass = fg.addPass<TemporalPassData>("SSAO Temporal Pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.ssao = builder.sample(input);
+                data.depth = builder.sample(depth);
+                data.history = builder.sample(ssaoHistory);
+                data.output = builder.createTexture("SSAO Temporal output", desc);
+                data.output = builder.write(data.output);
+                data.rt = builder.createRenderTarget("SSAO Temporal target", {
+                        .attachments = { data.output }
+                });
+            },
+            [=, &frameHistory](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+
+                constexpr mat4f normalizedToClip = {
+                        float4{  2,  0,  0, 0 },
+                        float4{  0,  2,  0, 0 },
+                        float4{  0,  0,  -2, 0 },
+                        float4{ -1, -1, 1, 1 },
+                };
+
+                FrameHistoryEntry& current = frameHistory.getCurrent();
+
+                auto out = resources.get(data.rt);
+                auto ssao = resources.getTexture(data.ssao);
+                auto depth = resources.getTexture(data.depth);
+                auto history = resources.getTexture(data.history);
+
+                auto const& material = getPostProcessMaterial("aoTemporal");
+                FMaterialInstance* mi = material.getMaterialInstance();
+                mi->setParameter("ssao", ssao, {});     // nearest
+                mi->setParameter("depth", depth, {});   // nearest
+                mi->setParameter("alpha", feedback);
+                mi->setParameter("history", history, {
+                        .filterMag = SamplerMagFilter::LINEAR,
+                        .filterMin = SamplerMinFilter::LINEAR
+                });
+                mi->setParameter("reprojection",
+                        *historyProjection *
+                        inverse(current.projection) *
+                        normalizedToClip);
+
+                mi->commit(driver);
+                mi->use(driver);
+
+                driver.beginRenderPass(out.target, out.params);
+                driver.draw(material.getPipelineState(uint8_t(PostProcessVariant::OPAQUE)),
+                        mEngine.getFullScreenRenderPrimitive(), 1);
+                driver.endRenderPass();
+
+                resources.detach(data.output, &current.ssao, &current.ssaoDesc);
+            });
+
+    return temporalPass.getData().output;
+}
+
 FrameGraphId<FrameGraphTexture> PostProcessManager::bilateralBlurPass(
         FrameGraph& fg, FrameGraphId<FrameGraphTexture> input, math::int2 axis, float zf,
         TextureFormat format, BilateralPassConfig config) noexcept {
@@ -646,7 +1928,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::bilateralBlurPass(
                 pipeline.rasterState.depthFunc = RasterState::DepthFunc::L;
 
                 driver.beginRenderPass(blurred.target, blurred.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -655,18 +1937,46 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::bilateralBlurPass(
 
 FrameGraphId<FrameGraphTexture> PostProcessManager::generateGaussianMipmap(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, size_t roughnessLodCount,
-        bool reinhard, size_t kernelWidth, float sigmaRatio) noexcept {
+        bool reinhard, size_t kernelWidth, float sigmaRatio, float4 region) noexcept {
+    auto const& desc = fg.getDescriptor(input);
     for (size_t i = 1; i < roughnessLodCount; i++) {
-        input = gaussianBlurPass(fg, input, i - 1, input, i, reinhard, kernelWidth, sigmaRatio);
+        const float4 levelRegion = getGaussianMipmapRegion(region,
+                desc.width, desc.height, i, roughnessLodCount, kernelWidth);
+        input = gaussianBlurPass(fg, input, i - 1, input, i, reinhard, kernelWidth, sigmaRatio,
+                levelRegion);
         reinhard = false; // only do the reinhard filtering on the first level
     }
     return input;
 }
 
+float4 PostProcessManager::getGaussianMipmapRegion(float4 region, uint32_t width,
+        uint32_t height, size_t level, size_t roughnessLodCount, size_t kernelWidth) noexcept {
+    // each level is blurred from the previous one, which must be valid a kernel radius (plus
+    // one texel for the linear sampling) further
+    const float radius = float((kernelWidth - 1) / 2 + 1);
+    for (size_t i = level; i + 1 < roughnessLodCount; i++) {
+        const float2 grow = radius / float2{
+                FTexture::valueForLevel(uint8_t(i), width),
+                FTexture::valueForLevel(uint8_t(i), height) };
+        region = float4{ region.xy - grow, region.zw + grow };
+    }
+    return clamp(region, 0.0f, 1.0f);
+}
+
+backend::Viewport PostProcessManager::getRegionViewport(float4 region,
+        uint32_t width, uint32_t height) noexcept {
+    region = clamp(region, 0.0f, 1.0f);
+    const int32_t left   = int32_t(std::floor(region.x * float(width)));
+    const int32_t bottom = int32_t(std::floor(region.y * float(height)));
+    const int32_t right  = int32_t(std::ceil(region.z * float(width)));
+    const int32_t top    = int32_t(std::ceil(region.w * float(height)));
+    return { left, bottom, uint32_t(right - left), uint32_t(top - bottom) };
+}
+
 FrameGraphId<FrameGraphTexture> PostProcessManager::gaussianBlurPass(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, uint8_t srcLevel,
         FrameGraphId<FrameGraphTexture> output, uint8_t dstLevel,
-        bool reinhard, size_t kernelWidth, float sigmaRatio) noexcept {
+        bool reinhard, size_t kernelWidth, float sigmaRatio, float4 region) noexcept {
 
     const float sigma = (kernelWidth + 1.0f) / sigmaRatio;
 
@@ -715,6 +2025,18 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::gaussianBlurPass(FrameGraph&
         FrameGraphRenderTargetHandle tempRT;
     };
 
+    // UBO storage size.
+    // The effective kernel size is (kMaxPositiveKernelSize - 1) * 4 + 1.
+    // e.g.: 5 positive-side samples, give 4+1+4=9 samples both sides
+    // taking advantage of linear filtering produces an effective kernel of 8+1+8=17 samples
+    // and because it's a separable filter, the effective 2D filter kernel size is 17*17
+    // The total number of samples needed over the two passes is 18.
+    // The material is only loaded by the first blur, like the other post-process materials.
+    if (UTILS_UNLIKELY(!mSeparableGaussianBlurKernelStorageSize)) {
+        auto& separableGaussianBlur = getPostProcessMaterial("separableGaussianBlur");
+        mSeparableGaussianBlurKernelStorageSize =
+                separableGaussianBlur.getMaterial()->reflect("kernel")->size;
+    }
     const size_t kernelStorageSize = mSeparableGaussianBlurKernelStorageSize;
     auto& gaussianBlurPasses = fg.addPass<BlurPassData>("Gaussian Blur Passes",
             [&](FrameGraph::Builder& builder, auto& data) {
@@ -780,6 +2102,16 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::gaussianBlurPass(FrameGraph&
                 // The framegraph only computes discard flags at FrameGraphPass boundaries
                 hwTempRT.params.flags.discardEnd = TargetBufferFlags::NONE;
 
+                // the vertical pass reads the rows of the temporary buffer a kernel radius
+                // beyond the region, like the level below
+                const float radius = float((kernelWidth - 1) / 2 + 1);
+                const float grow = radius / float(tempDesc.height);
+                const backend::Viewport tempScissor = getRegionViewport(
+                        { region.x, region.y - grow, region.z, region.w + grow },
+                        tempDesc.width, tempDesc.height);
+                mi->setScissor(tempScissor.left, tempScissor.bottom,
+                        tempScissor.width, tempScissor.height);
+
                 commitAndRender(hwTempRT, separableGaussianBlur, driver);
 
                 // vertical pass
@@ -799,9 +2131,15 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::gaussianBlurPass(FrameGraph&
                 mi->commit(driver);
                 // we don't need to call use() here, since it's the same material
 
+                const backend::Viewport outScissor = getRegionViewport(region, width, height);
+                mi->setScissor(outScissor.left, outScissor.bottom,
+                        outScissor.width, outScissor.height);
+
                 driver.beginRenderPass(hwOutRT.target, hwOutRT.params);
-                driver.draw(separableGaussianBlur.getPipelineState(), fullScreenRenderPrimitive);
+                driver.draw(separableGaussianBlur.getPipelineState(), fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
+
+                mi->unsetScissor();
             });
 
     return gaussianBlurPasses.getData().out;
@@ -811,7 +2149,8 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input,
         const View::DepthOfFieldOptions& dofOptions,
         bool translucent,
-        const CameraInfo& cameraInfo) noexcept {
+        const CameraInfo& cameraInfo,
+        std::shared_ptr<DofTiles> const& tiles) noexcept {
 
     FEngine& engine = mEngine;
     Handle<HwRenderPrimitive> const& fullScreenRenderPrimitive = engine.getFullScreenRenderPrimitive();
@@ -854,6 +2193,25 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
     const uint8_t maxLevelCount = FTexture::maxLevelCount(width, height);
     uint8_t mipmapCount = min(maxLevelCount, uint8_t(maxMipLevels));
 
+    // Only the tiles that were out of focus in a previous frame are blurred, this is valid as long
+    // as the circle of confusion doesn't change. The readbacks have a few frames of latency, the
+    // bounds are grown by DOF_TILE_MARGIN tiles to account for the motion in the meantime.
+    filament::Viewport blurred{ 0, 0, colorDesc.width, colorDesc.height };
+    if (tiles) {
+        std::lock_guard<utils::Mutex> guard(tiles->lock);
+        if (tiles->valid && tiles->cocParams == cocParams &&
+                tiles->width == colorDesc.width && tiles->height == colorDesc.height) {
+            blurred = tiles->bounds;
+        }
+    }
+    const bool inFocus = blurred.width == 0 || blurred.height == 0;
+
+    // the scissor of the half-resolution passes, it covers the blurred bounds
+    const int32_t scissorLeft = blurred.left / 2;
+    const int32_t scissorBottom = blurred.bottom / 2;
+    const uint32_t scissorWidth = (blurred.left + blurred.width + 1) / 2 - scissorLeft;
+    const uint32_t scissorHeight = (blurred.bottom + blurred.height + 1) / 2 - scissorBottom;
+
     /*
      * Setup:
      *      - Downsample of color buffer
@@ -980,7 +2338,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
                     mi->setParameter("weightScale", 0.5f / float(1u<<level));
                     mi->commit(driver);
                     driver.beginRenderPass(out.target, out.params);
-                    driver.draw(pipeline, fullScreenRenderPrimitive);
+                    driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                     driver.endRenderPass();
                 }
             });
@@ -993,7 +2351,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
     auto inTilesCocMaxMin = ppDoFDownsample.getData().outCocFgBg;
 
     // Match this with TILE_SIZE in dofDilate.mat
-    const size_t tileSize = 16; // size of the tile in full resolution pixel
+    const size_t tileSize = DOF_TILE_SIZE; // size of the tile in full resolution pixel
     const uint32_t tileBufferWidth  = ((colorDesc.width  + (tileSize - 1u)) & ~(tileSize - 1u)) / 4u;
     const uint32_t tileBufferHeight = ((colorDesc.height + (tileSize - 1u)) & ~(tileSize - 1u)) / 4u;
     const size_t tileReductionCount = std::log2(tileSize) - 1.0; // -1 because we start from half-resolution
@@ -1076,6 +2434,15 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
     auto dilated = dilate(inTilesCocMaxMin);
     dilated = dilate(dilated);
 
+    if (tiles) {
+        readDofTiles(fg, dilated, tiles, cocParams, colorDesc.width, colorDesc.height);
+    }
+
+    if (inFocus) {
+        // nothing to blur, only the tiles are computed, for the readback
+        return input;
+    }
+
     /*
      * DoF blur pass
      */
@@ -1112,9 +2479,11 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
                 });
                 data.outForeground  = builder.write(data.outForeground);
                 data.outAlpha       = builder.write(data.outAlpha);
+                // the pixels outside of the scissor are cleared to a transparent DoF
                 data.rt = builder.createRenderTarget("DoF Target", {
                         .attachments = { { data.outForeground,
-                                           data.outAlpha, {}, {} }, {}, {} }
+                                           data.outAlpha, {}, {} }, {}, {} },
+                        .clearFlags = TargetBufferFlags::COLOR
                 });
             },
             [=](FrameGraphPassResources const& resources,
@@ -1151,7 +2520,9 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
                     outputDesc.height / (tileSize * 0.5f * tilesDesc.height)
                 });
                 mi->setParameter("bokehAngle",  bokehAngle);
+                mi->setScissor(scissorLeft, scissorBottom, scissorWidth, scissorHeight);
                 commitAndRender(out, material, driver);
+                mi->unsetScissor();
             });
 
     /*
@@ -1181,7 +2552,8 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
                 data.outAlpha       = builder.write(data.outAlpha);
                 data.rt = builder.createRenderTarget("DoF Target", {
                         .attachments = { { data.outForeground,
-                                                 data.outAlpha, {}, {} }, {}, {} }
+                                                 data.outAlpha, {}, {} }, {}, {} },
+                        .clearFlags = TargetBufferFlags::COLOR
                 });
             },
             [=](FrameGraphPassResources const& resources,
@@ -1204,7 +2576,9 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
                         outputDesc.width  / (tileSize * 0.5f * tilesDesc.width),
                         outputDesc.height / (tileSize * 0.5f * tilesDesc.height)
                 });
+                mi->setScissor(scissorLeft, scissorBottom, scissorWidth, scissorHeight);
                 commitAndRender(out, material, driver);
+                mi->unsetScissor();
             });
 
 
@@ -1270,6 +2644,97 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::dof(FrameGraph& fg,
     return ppDoFCombine.getData().output;
 }
 
+void PostProcessManager::readDofTiles(FrameGraph& fg, FrameGraphId<FrameGraphTexture> input,
+        std::shared_ptr<DofTiles> const& tiles, float2 cocParams,
+        uint32_t width, uint32_t height) noexcept {
+    {
+        std::lock_guard<utils::Mutex> guard(tiles->lock);
+        if (tiles->pending) {
+            // only keep one readback in flight
+            return;
+        }
+        tiles->pending = true;
+    }
+
+    struct Request {
+        std::shared_ptr<DofTiles> destination;
+        float2 cocParams;
+        uint32_t width;
+        uint32_t height;
+        uint32_t tilesWidth;
+        uint32_t tilesHeight;
+    };
+
+    struct DofTilesReadbackData {
+        FrameGraphId<FrameGraphTexture> tiles;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    fg.addPass<DofTilesReadbackData>("DoF Tiles Readback",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.tiles = builder.read(input);
+                data.rt = builder.createRenderTarget("DoF Tiles Readback Target", {
+                        .attachments = {{ data.tiles }}
+                });
+                builder.sideEffect();
+            },
+            [destination = tiles, cocParams, width, height](
+                    FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto const& desc = resources.getDescriptor(data.tiles);
+                auto out = resources.get(data.rt);
+                Request* const request = new Request{
+                        destination, cocParams, width, height, desc.width, desc.height };
+                const size_t size = size_t(desc.width) * desc.height * sizeof(float4);
+                driver.readPixels(out.target, 0, 0, desc.width, desc.height, {
+                        malloc(size), size, PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                        [](void* buffer, size_t, void* user) {
+                            Request* const request = static_cast<Request*>(user);
+                            float4 const* const tiles = static_cast<float4 const*>(buffer);
+                            // bounds of the tiles whose max or min CoC is out of focus
+                            int32_t x0 = std::numeric_limits<int32_t>::max(), x1 = -1;
+                            int32_t y0 = std::numeric_limits<int32_t>::max(), y1 = -1;
+                            for (int32_t y = 0; y < int32_t(request->tilesHeight); y++) {
+                                for (int32_t x = 0; x < int32_t(request->tilesWidth); x++) {
+                                    float4 const& tile = tiles[y * request->tilesWidth + x];
+                                    if (std::max(std::abs(tile.x), std::abs(tile.y)) >=
+                                            DOF_IN_FOCUS_COC) {
+                                        x0 = std::min(x0, x);
+                                        x1 = std::max(x1, x);
+                                        y0 = std::min(y0, y);
+                                        y1 = std::max(y1, y);
+                                    }
+                                }
+                            }
+                            filament::Viewport bounds{};
+                            if (x1 >= 0) {
+                                const int32_t w = int32_t(request->width);
+                                const int32_t h = int32_t(request->height);
+                                const int32_t left = std::max(0,
+                                        (x0 - DOF_TILE_MARGIN) * DOF_TILE_SIZE);
+                                const int32_t bottom = std::max(0,
+                                        (y0 - DOF_TILE_MARGIN) * DOF_TILE_SIZE);
+                                const int32_t right = std::min(w,
+                                        (x1 + 1 + DOF_TILE_MARGIN) * DOF_TILE_SIZE);
+                                const int32_t top = std::min(h,
+                                        (y1 + 1 + DOF_TILE_MARGIN) * DOF_TILE_SIZE);
+                                bounds = { left, bottom,
+                                        uint32_t(right - left), uint32_t(top - bottom) };
+                            }
+                            DofTiles& d = *request->destination;
+                            std::lock_guard<utils::Mutex> guard(d.lock);
+                            d.bounds = bounds;
+                            d.cocParams = request->cocParams;
+                            d.width = request->width;
+                            d.height = request->height;
+                            d.valid = true;
+                            d.pending = false;
+                            free(buffer);
+                            delete request;
+                        }, request });
+            });
+}
+
 FrameGraphId<FrameGraphTexture> PostProcessManager::bloomPass(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, TextureFormat outFormat,
         View::BloomOptions& bloomOptions, float2 scale) noexcept {
@@ -1363,7 +2828,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::bloomPass(FrameGraph& fg,
                     hwOutRT.params.flags.discardStart = TargetBufferFlags::COLOR;
                     hwOutRT.params.flags.discardEnd = TargetBufferFlags::NONE;
                     driver.beginRenderPass(hwOutRT.target, hwOutRT.params);
-                    driver.draw(pipeline, fullScreenRenderPrimitive);
+                    driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                     driver.endRenderPass();
 
                     // prepare the next level
@@ -1418,7 +2883,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::bloomPass(FrameGraph& fg,
                     mi->commit(driver);
 
                     driver.beginRenderPass(hwDstRT.target, hwDstRT.params);
-                    driver.draw(pipeline, fullScreenRenderPrimitive);
+                    driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                     driver.endRenderPass();
                 }
             });
@@ -1487,13 +2952,14 @@ void PostProcessManager::colorGradingSubpass(DriverApi& driver,  bool translucen
             PostProcessVariant::TRANSLUCENT : PostProcessVariant::OPAQUE);
 
     driver.nextSubpass();
-    driver.draw(material.getPipelineState(variant), fullScreenRenderPrimitive);
+    driver.draw(material.getPipelineState(variant), fullScreenRenderPrimitive, 1);
 }
 
 FrameGraphId<FrameGraphTexture> PostProcessManager::colorGrading(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, const FColorGrading* colorGrading,
         TextureFormat outFormat, bool translucent, bool fxaa, float2 scale,
-        View::BloomOptions bloomOptions, View::VignetteOptions vignetteOptions, bool dithering) noexcept {
+        View::BloomOptions bloomOptions, View::VignetteOptions vignetteOptions, bool dithering,
+        bool blend) noexcept {
 
     struct PostProcessColorGrading {
         FrameGraphId<FrameGraphTexture> input;
@@ -1595,7 +3061,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::colorGrading(FrameGraph& fg,
                 const uint8_t variant = uint8_t(translucent ?
                             PostProcessVariant::TRANSLUCENT : PostProcessVariant::OPAQUE);
 
-                commitAndRender(out, material, variant, driver);
+                commitAndRender(out, material, variant, driver, blend);
             }
     );
 
@@ -1604,7 +3070,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::colorGrading(FrameGraph& fg,
 
 FrameGraphId<FrameGraphTexture> PostProcessManager::fxaa(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input,
-        TextureFormat outFormat, bool translucent) noexcept {
+        TextureFormat outFormat, bool translucent, bool blend) noexcept {
 
     struct PostProcessFXAA {
         FrameGraphId<FrameGraphTexture> input;
@@ -1640,7 +3106,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::fxaa(FrameGraph& fg,
                 const uint8_t variant = uint8_t(translucent ?
                     PostProcessVariant::TRANSLUCENT : PostProcessVariant::OPAQUE);
 
-                commitAndRender(out, material, variant, driver);
+                commitAndRender(out, material, variant, driver, blend);
             });
 
     return ppFXAA.getData().output;
@@ -1663,14 +3129,23 @@ void PostProcessManager::prepareTaa(FrameHistory& frameHistory,
 
 FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, FrameHistory& frameHistory,
+        uint32_t outputWidth, uint32_t outputHeight,
         View::TemporalAntiAliasingOptions taaOptions,
         ColorGradingConfig colorGradingConfig) noexcept {
 
+    // The history is always at the output resolution, it's sampled with normalized coordinates.
+    auto const& inputDesc = fg.getDescriptor(input);
+    const bool upscaling = inputDesc.width != outputWidth || inputDesc.height != outputHeight;
+    const float2 inputToOutput = {
+            float(inputDesc.width) / float(outputWidth),
+            float(inputDesc.height) / float(outputHeight) };
+
     FrameHistoryEntry const& entry = frameHistory[0];
     FrameGraphId<FrameGraphTexture> colorHistory;
     mat4f const* historyProjection = nullptr;
     if (UTILS_UNLIKELY(!entry.color.texture)) {
         // if we don't have a history yet, just use the current color buffer as history
+        // (it's sampled with a linear filter, so it works when upscaling too)
         colorHistory = input;
         historyProjection = &frameHistory.getCurrent().projection;
     } else {
@@ -1693,6 +3168,8 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
     auto& taa = fg.addPass<TAAData>("TAA",
             [&](FrameGraph::Builder& builder, auto& data) {
                 auto desc = fg.getDescriptor(input);
+                desc.width = outputWidth;
+                desc.height = outputHeight;
                 data.color = builder.sample(input);
                 data.depth = builder.sample(depth);
                 data.history = builder.sample(colorHistory);
@@ -1728,31 +3205,43 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
 
                 FrameHistoryEntry& current = frameHistory.getCurrent();
 
-                float sum = 0.0;
-                float weights[9];
-
-                // this doesn't get vectorized (probably because of exp()), so don't bother
-                // unrolling it.
-                #pragma nounroll
-                for (size_t i = 0; i < 9; i++) {
-                    float2 d = sampleOffsets[i] - current.jitter;
-                    d *= 1.0f / taaOptions.filterWidth;
-                    // this is a gaussian fit of a 3.3 Blackman Harris window
-                    // see: "High Quality Temporal Supersampling" by Bruan Karis
-                    weights[i] = std::exp2(-3.3f * (d.x * d.x + d.y * d.y));
-                    sum += weights[i];
-                }
-                for (auto& w : weights) {
-                    w /= sum;
-                }
-
                 auto out = resources.get(data.rt);
                 auto color = resources.getTexture(data.color);
                 auto depth = resources.getTexture(data.depth);
                 auto history = resources.getTexture(data.history);
 
-                auto const& material = getPostProcessMaterial("taa");
+                auto const& material = upscaling ?
+                        getPostProcessMaterial("taaUpscale") : getPostProcessMaterial("taa");
                 FMaterialInstance* mi = material.getMaterialInstance();
+                if (UTILS_UNLIKELY(upscaling)) {
+                    // The distance between an output pixel and the input samples around it
+                    // depends on the pixel, so the material computes the weights of the
+                    // reconstruction filter. The filter's footprint is an output pixel, the
+                    // offsets and the jitter are in input pixels.
+                    mi->setParameter("jitter", current.jitter);
+                    mi->setParameter("filterScale",
+                            1.0f / (taaOptions.filterWidth * inputToOutput));
+                } else {
+                    float sum = 0.0;
+                    float weights[9];
+
+                    // this doesn't get vectorized (probably because of exp()), so don't bother
+                    // unrolling it.
+                    #pragma nounroll
+                    for (size_t i = 0; i < 9; i++) {
+                        float2 d = sampleOffsets[i] - current.jitter;
+                        d *= 1.0f / taaOptions.filterWidth;
+                        // this is a gaussian fit of a 3.3 Blackman Harris window
+                        // see: "High Quality Temporal Supersampling" by Bruan Karis
+                        weights[i] = std::exp2(-3.3f * (d.x * d.x + d.y * d.y));
+                        sum += weights[i];
+                    }
+                    for (auto& w : weights) {
+                        w /= sum;
+                    }
+
+                    mi->setParameter("filterWeights",  weights, 9);
+                }
                 mi->setParameter("color",  color, {});  // nearest
                 mi->setParameter("depth",  depth, {});  // nearest
                 mi->setParameter("alpha", taaOptions.feedback);
@@ -1760,7 +3249,6 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
                         .filterMag = SamplerMagFilter::LINEAR,
                         .filterMin = SamplerMinFilter::LINEAR
                 });
-                mi->setParameter("filterWeights",  weights, 9);
                 mi->setParameter("reprojection",
                         *historyProjection *
                         inverse(current.projection) *
@@ -1776,7 +3264,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
                     out.params.subpassMask = 1;
                 }
                 driver.beginRenderPass(out.target, out.params);
-                driver.draw(material.getPipelineState(variant), mEngine.getFullScreenRenderPrimitive());
+                driver.draw(material.getPipelineState(variant), mEngine.getFullScreenRenderPrimitive(), 1);
                 if (colorGradingConfig.asSubpass) {
                     colorGradingSubpass(driver, colorGradingConfig.translucent);
                 }
@@ -1790,7 +3278,7 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::taa(FrameGraph& fg,
 
 FrameGraphId<FrameGraphTexture> PostProcessManager::opaqueBlit(FrameGraph& fg,
         FrameGraphId<FrameGraphTexture> input, FrameGraphTexture::Descriptor outDesc,
-        SamplerMagFilter filter) noexcept {
+        SamplerMagFilter filter, float4 region) noexcept {
 
     struct PostProcessScaling {
         FrameGraphId<FrameGraphTexture> input;
@@ -1832,8 +3320,15 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::opaqueBlit(FrameGraph& fg,
             [=](FrameGraphPassResources const& resources, auto const& data, DriverApi& driver) {
                 auto in = resources.get(data.srt);
                 auto out = resources.get(data.drt);
+                auto regionViewport = [region](backend::Viewport const& vp) -> backend::Viewport {
+                    backend::Viewport r = getRegionViewport(region, vp.width, vp.height);
+                    r.left += vp.left;
+                    r.bottom += vp.bottom;
+                    return r;
+                };
                 driver.blit(TargetBufferFlags::COLOR,
-                        out.target, out.params.viewport, in.target, in.params.viewport, filter);
+                        out.target, regionViewport(out.params.viewport),
+                        in.target, regionViewport(in.params.viewport), filter);
             });
 
     // we rely on automatic culling of unused render passes
@@ -1883,13 +3378,10 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::blendBlit(
 
                 PipelineState pipeline(material.getPipelineState());
                 if (translucent) {
-                    pipeline.rasterState.blendFunctionSrcRGB   = BlendFunction::ONE;
-                    pipeline.rasterState.blendFunctionSrcAlpha = BlendFunction::ONE;
-                    pipeline.rasterState.blendFunctionDstRGB   = BlendFunction::ONE_MINUS_SRC_ALPHA;
-                    pipeline.rasterState.blendFunctionDstAlpha = BlendFunction::ONE_MINUS_SRC_ALPHA;
+                    setPremultipliedBlending(pipeline.rasterState);
                 }
                 driver.beginRenderPass(out.target, out.params);
-                driver.draw(pipeline, fullScreenRenderPrimitive);
+                driver.draw(pipeline, fullScreenRenderPrimitive, 1);
                 driver.endRenderPass();
             });
 
@@ -1897,6 +3389,37 @@ FrameGraphId<FrameGraphTexture> PostProcessManager::blendBlit(
     return ppQuadBlit.getData().output;
 }
 
+FrameGraphId<FrameGraphTexture> PostProcessManager::orderIndependentTransparencyComposite(
+        FrameGraph& fg, FrameGraphId<FrameGraphTexture> accumulation,
+        FrameGraphId<FrameGraphTexture> weights, FrameGraphId<FrameGraphTexture> color) noexcept {
+
+    struct OitCompositeData {
+        FrameGraphId<FrameGraphTexture> accumulation;
+        FrameGraphId<FrameGraphTexture> weights;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    auto& ppOitComposite = fg.addPass<OitCompositeData>("OIT composite",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.accumulation = builder.sample(accumulation);
+                data.weights = builder.sample(weights);
+                data.output = builder.write(builder.read(color));
+                data.rt = builder.createRenderTarget("OIT Composite Target", {
+                        .attachments = { data.output } });
+            },
+            [=](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto const& material = getPostProcessMaterial("oitComposite");
+                FMaterialInstance* const mi = material.getMaterialInstance();
+                mi->setParameter("accumulation", resources.getTexture(data.accumulation), {});
+                mi->setParameter("weights", resources.getTexture(data.weights), {});
+                commitAndRender(resources.get(data.rt), material, 0, driver, true);
+            });
+
+    return ppOitComposite.getData().output;
+}
+
 FrameGraphId<FrameGraphTexture> PostProcessManager::resolve(FrameGraph& fg,
         const char* outputBufferName, FrameGraphId<FrameGraphTexture> input) noexcept {
 
@@ -23,16 +23,21 @@
 
 #include "FrameHistory.h"
 
+#include "details/IndirectLight.h"
+
 #include <fg/FrameGraphHandle.h>
 
 #include <backend/DriverEnums.h>
 #include <filament/View.h>
 
 #include <utils/CString.h>
+#include <utils/Mutex.h>
 
 #include <tsl/robin_map.h>
 
+#include <memory>
 #include <random>
+#include <vector>
 
 namespace filament {
 
@@ -55,6 +60,19 @@ public:
         backend::TextureFormat ldrFormat{};
     };
 
+    // Bounds of the out-of-focus tiles of the depth of field, read back from the GPU. This is
+    // kept by the View and shared with the pending readback callbacks, which may be called after
+    // the View is destroyed.
+    struct DofTiles {
+        utils::Mutex lock;
+        filament::Viewport bounds;  // in pixels of the color buffer, empty when all in focus
+        math::float2 cocParams;     // circle of confusion parameters of the tiles
+        uint32_t width = 0;         // size of the color buffer
+        uint32_t height = 0;
+        bool valid = false;         // the bounds were read back at least once
+        bool pending = false;       // a readback is in flight
+    };
+
     explicit PostProcessManager(FEngine& engine) noexcept;
 
     void init() noexcept;
@@ -69,20 +87,30 @@ public:
     // SSAO
     FrameGraphId<FrameGraphTexture> screenSpaceAmbientOcclusion(FrameGraph& fg,
             RenderPass& pass, filament::Viewport const& svp,
-            CameraInfo const& cameraInfo,
+            CameraInfo const& cameraInfo, FrameHistory& frameHistory,
             View::AmbientOcclusionOptions options) noexcept;
 
     // Used in refraction pass
+    // Only 'region' of each level is filtered, in normalized [left, bottom, right, top]
+    // coordinates. Level 0 must be valid over getGaussianMipmapRegion(region, ..., 0, ...).
     FrameGraphId<FrameGraphTexture> generateGaussianMipmap(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, size_t roughnessLodCount, bool reinhard,
-            size_t kernelWidth, float sigmaRatio = 6.0f) noexcept;
+            size_t kernelWidth, float sigmaRatio = 6.0f,
+            math::float4 region = { 0, 0, 1, 1 }) noexcept;
+
+    // The region of 'level' read by generateGaussianMipmap() to filter 'region' of all the levels
+    static math::float4 getGaussianMipmapRegion(math::float4 region, uint32_t width,
+            uint32_t height, size_t level, size_t roughnessLodCount, size_t kernelWidth) noexcept;
 
     // Depth-of-field
+    // When 'tiles' is set, the blur is restricted to the out-of-focus tiles of a previous frame,
+    // and skipped when everything was in focus. The tiles of this frame are read back into it.
     FrameGraphId<FrameGraphTexture> dof(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input,
             const View::DepthOfFieldOptions& dofOptions,
             bool translucent,
-            const CameraInfo& cameraInfo) noexcept;
+            const CameraInfo& cameraInfo,
+            std::shared_ptr<DofTiles> const& tiles = {}) noexcept;
 
     // Color grading, tone mapping, etc.
     void colorGradingPrepareSubpass(backend::DriverApi& driver, const FColorGrading* colorGrading,
@@ -94,27 +122,32 @@ public:
     FrameGraphId<FrameGraphTexture> colorGrading(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, const FColorGrading* colorGrading,
             backend::TextureFormat outFormat, bool translucent, bool fxaa, math::float2 scale,
-            View::BloomOptions bloomOptions, View::VignetteOptions vignetteOptions, bool dithering) noexcept;
+            View::BloomOptions bloomOptions, View::VignetteOptions vignetteOptions, bool dithering,
+            bool blend = false) noexcept;
 
     // Anti-aliasing
     FrameGraphId<FrameGraphTexture> fxaa(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, backend::TextureFormat outFormat,
-            bool translucent) noexcept;
+            bool translucent, bool blend = false) noexcept;
 
     // Temporal Anti-aliasing
     void prepareTaa(FrameHistory& frameHistory,
             CameraInfo const& cameraInfo,
             View::TemporalAntiAliasingOptions const& taaOptions) const noexcept;
 
+    // The output is outputWidth x outputHeight, which is larger than the input when upscaling.
     FrameGraphId<FrameGraphTexture> taa(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, FrameHistory& frameHistory,
+            uint32_t outputWidth, uint32_t outputHeight,
             View::TemporalAntiAliasingOptions taaOptions,
             ColorGradingConfig colorGradingConfig) noexcept;
 
     // Blit/rescaling/resolves
+    // only 'region' is copied, in normalized [left, bottom, right, top] coordinates
     FrameGraphId<FrameGraphTexture> opaqueBlit(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, FrameGraphTexture::Descriptor outDesc,
-            backend::SamplerMagFilter filter = backend::SamplerMagFilter::LINEAR) noexcept;
+            backend::SamplerMagFilter filter = backend::SamplerMagFilter::LINEAR,
+            math::float4 region = { 0, 0, 1, 1 }) noexcept;
 
     FrameGraphId<FrameGraphTexture> blendBlit(
             FrameGraph& fg, bool translucent, View::QualityLevel quality,
@@ -123,10 +156,90 @@ public:
     FrameGraphId<FrameGraphTexture> resolve(FrameGraph& fg,
             const char* outputBufferName, FrameGraphId<FrameGraphTexture> input) noexcept;
 
+    // Order-independent transparency, blends the accumulated transparent objects over 'color'
+    FrameGraphId<FrameGraphTexture> orderIndependentTransparencyComposite(FrameGraph& fg,
+            FrameGraphId<FrameGraphTexture> accumulation, FrameGraphId<FrameGraphTexture> weights,
+            FrameGraphId<FrameGraphTexture> color) noexcept;
+
     // VSM shadow mipmap pass
     FrameGraphId<FrameGraphTexture> vsmMipmapPass(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, uint8_t layer, size_t level) noexcept;
 
+    // Maximum number of levels generated by a single dispatch of downsamplePass()
+    static constexpr uint8_t kMaxDownsampleLevels = 7;
+
+    // Whether downsamplePass() can be used with a texture of the given format, this requires
+    // compute support. Otherwise the mipmaps must be generated with a pass per level.
+    bool hasComputeDownsample(backend::TextureFormat format) const noexcept;
+
+    // Compute mipmap chain pass. Generates the 'levelCount' levels after 'baseLevel' of 'input',
+    // each texel is the average of the 2x2 texels it covers in the previous level. Up to
+    // kMaxDownsampleLevels levels are written by a single dispatch. 'layer' selects the layer
+    // of an array texture. With 'preserveBorder' the outermost texels of the generated levels
+    // are set to 1, like vsmMipmapPass() does.
+    FrameGraphId<FrameGraphTexture> downsamplePass(FrameGraph& fg,
+            FrameGraphId<FrameGraphTexture> input, uint8_t layer, uint8_t baseLevel,
+            uint8_t levelCount, bool preserveBorder) noexcept;
+
+    // Whether prefilterIndirectLight() can write reflections of the given format, this requires
+    // compute support.
+    bool hasComputeIblPrefilter(backend::TextureFormat format) const noexcept;
+
+    // Compute IBL prefilter passes. Each level of the request's reflections cubemap is the GGX
+    // prefiltered environment for the roughness of that level, and if requested, the irradiance
+    // of the IndirectLight is updated from the environment's spherical harmonics once they are
+    // read back, a few frames later.
+    void prefilterIndirectLight(FrameGraph& fg,
+            FIndirectLight::PrefilterRequest const& request) noexcept;
+
+    // Parameters of colorGradingLut(), in a storage buffer (std430). The 3x3 matrices are
+    // stored as 3 columns padded to 4 floats.
+    struct ColorGradingLutParams {
+        math::float4 transformIn[3];    // white balance and conversion to the grading space
+        math::float4 transformOut[3];   // conversion from the grading space to sRGB
+        math::float4 luma;              // luma coefficients of the grading space
+        math::float4 outRed;
+        math::float4 outGreen;
+        math::float4 outBlue;
+        math::float4 shadows;
+        math::float4 midtones;
+        math::float4 highlights;
+        math::float4 tonalRanges;
+        math::float4 slope;
+        math::float4 offset;
+        math::float4 power;
+        math::float4 shadowGamma;
+        math::float4 midPoint;
+        math::float4 highlightScale;
+        float contrast;
+        float vibrance;
+        float saturation;
+        int32_t dimension;
+        int32_t toneMapping;            // ColorGrading::ToneMapping
+        int32_t hasAdjustments;
+        int32_t acesLog;                // the log space of the adjustments is ACEScct, not LogC
+        int32_t padding;
+    };
+
+    // Whether colorGradingLut() can write LUTs of the given format, this requires compute
+    // support.
+    bool hasComputeColorGradingLut(backend::TextureFormat format) const noexcept;
+
+    // Generates a color grading 3D LUT with a compute program, like FColorGrading does on the
+    // CPU. The LUT must have been created with the STORAGE usage. This doesn't use the frame
+    // graph, since the LUT outlives the frame.
+    void colorGradingLut(backend::DriverApi& driver, backend::Handle<backend::HwTexture> lut,
+            backend::TextureFormat format, ColorGradingLutParams const& params) noexcept;
+
+    // Whether depthRange() can be used, this requires compute support.
+    bool hasComputeDepthRange() const noexcept { return mHasComputeDownsample; }
+
+    // Compute pass reducing a depth buffer to the range of its samples, the background excluded.
+    // The result is a 1x1 RGBA32F texture with the smallest depth in x and the largest in y,
+    // x > y when the depth buffer is empty.
+    FrameGraphId<FrameGraphTexture> depthRange(FrameGraph& fg,
+            FrameGraphId<FrameGraphTexture> depth) noexcept;
+
     backend::Handle<backend::HwTexture> getOneTexture() const { return mDummyOneTexture; }
     backend::Handle<backend::HwTexture> getZeroTexture() const { return mDummyZeroTexture; }
     backend::Handle<backend::HwTexture> getOneTextureArray() const { return mDummyOneTextureArray; }
@@ -149,22 +262,44 @@ private:
         float scale = 1.0f;
     };
 
+    // size of the DoF tiles in pixels, and CoC below which a tile is in focus
+    static constexpr int32_t DOF_TILE_SIZE = 16;
+    static constexpr int32_t DOF_TILE_MARGIN = 1;
+    static constexpr float DOF_IN_FOCUS_COC = 0.5f;
+
+    // reads the dilated CoC tiles back into the bounds of the out-of-focus tiles
+    void readDofTiles(FrameGraph& fg, FrameGraphId<FrameGraphTexture> input,
+            std::shared_ptr<DofTiles> const& tiles, math::float2 cocParams,
+            uint32_t width, uint32_t height) noexcept;
+
     FrameGraphId<FrameGraphTexture> bilateralBlurPass(
             FrameGraph& fg, FrameGraphId<FrameGraphTexture> input, math::int2 axis, float zf,
             backend::TextureFormat format, BilateralPassConfig config) noexcept;
 
+    // blends the AO buffer with the previous frame's, reprojected using the structure buffer
+    FrameGraphId<FrameGraphTexture> ssaoTemporalPass(FrameGraph& fg,
+            FrameGraphId<FrameGraphTexture> input, FrameHistory& frameHistory,
+            float feedback) noexcept;
+
+    // only 'region' of the destination level is written, see generateGaussianMipmap()
     FrameGraphId<FrameGraphTexture> gaussianBlurPass(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, uint8_t srcLevel,
             FrameGraphId<FrameGraphTexture> output, uint8_t dstLevel,
-            bool reinhard, size_t kernelWidth, float sigma = 6.0f) noexcept;
+            bool reinhard, size_t kernelWidth, float sigma = 6.0f,
+            math::float4 region = { 0, 0, 1, 1 }) noexcept;
+
+    // the pixels of a 'width' x 'height' target covering a normalized region
+    static backend::Viewport getRegionViewport(math::float4 region,
+            uint32_t width, uint32_t height) noexcept;
 
     FrameGraphId<FrameGraphTexture> bloomPass(FrameGraph& fg,
             FrameGraphId<FrameGraphTexture> input, backend::TextureFormat outFormat,
             View::BloomOptions& bloomOptions, math::float2 scale) noexcept;
 
+    // when 'blend' is set, the premultiplied output is blended over the render target's content
     void commitAndRender(FrameGraphRenderTarget const& out,
             PostProcessMaterial const& material, uint8_t variant,
-            backend::DriverApi& driver) const noexcept;
+            backend::DriverApi& driver, bool blend = false) const noexcept;
 
     void commitAndRender(FrameGraphRenderTarget const& out,
             PostProcessMaterial const& material,
@@ -216,6 +351,46 @@ private:
     backend::Handle<backend::HwTexture> mDummyOneTextureArray;
     backend::Handle<backend::HwTexture> mDummyZeroTexture;
 
+    // compute programs of downsamplePass(), created on first use for each format
+    struct DownsampleProgram {
+        backend::TextureFormat format;
+        bool array;
+        backend::Handle<backend::HwProgram> program;
+    };
+    backend::Handle<backend::HwProgram> getDownsampleProgram(backend::DriverApi& driver,
+            backend::TextureFormat format, bool array) noexcept;
+    std::vector<DownsampleProgram> mDownsamplePrograms;
+    backend::Handle<backend::HwUniformBuffer> mDownsampleParams;
+    bool mHasComputeDownsample = false;
+
+    // compute programs of prefilterIndirectLight(), created on first use
+    struct IblPrefilterProgram {
+        backend::TextureFormat format;
+        backend::Handle<backend::HwProgram> program;
+    };
+    backend::Handle<backend::HwProgram> getIblPrefilterProgram(backend::DriverApi& driver,
+            backend::TextureFormat format) noexcept;
+    backend::Handle<backend::HwProgram> getIblShProgram(backend::DriverApi& driver) noexcept;
+    std::vector<IblPrefilterProgram> mIblPrefilterPrograms;
+    backend::Handle<backend::HwProgram> mIblShProgram;
+    backend::Handle<backend::HwUniformBuffer> mIblPrefilterParams;
+    backend::Handle<backend::HwSamplerGroup> mIblEnvironmentSamplers;
+
+    // compute program of depthRange(), created on first use
+    backend::Handle<backend::HwProgram> getDepthRangeProgram(backend::DriverApi& driver) noexcept;
+    backend::Handle<backend::HwProgram> mDepthRangeProgram;
+    backend::Handle<backend::HwSamplerGroup> mDepthRangeSamplers;
+
+    // compute programs of colorGradingLut(), created on first use
+    struct ColorGradingLutProgram {
+        backend::TextureFormat format;
+        backend::Handle<backend::HwProgram> program;
+    };
+    backend::Handle<backend::HwProgram> getColorGradingLutProgram(backend::DriverApi& driver,
+            backend::TextureFormat format) noexcept;
+    std::vector<ColorGradingLutProgram> mColorGradingLutPrograms;
+    backend::Handle<backend::HwUniformBuffer> mColorGradingLutParams;
+
     size_t mSeparableGaussianBlurKernelStorageSize = 0;
 
     std::uniform_real_distribution<float> mUniformDistribution{0.0f, 1.0f};
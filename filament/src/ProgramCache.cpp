@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProgramCache.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+#include <utils/Hash.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <variant>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace backend;
+
+ProgramCache::~ProgramCache() noexcept {
+    assert(mPrograms.empty());
+}
+
+void ProgramCache::terminate(DriverApi& driver) noexcept {
+#ifndef NDEBUG
+    if (!mPrograms.empty()) {
+        utils::slog.w << mKeys.size() << " shared programs were not released" << utils::io::endl;
+    }
+#endif
+    for (auto const& item : mPrograms) {
+        for (Entry const& entry : item.second) {
+            driver.destroyProgram(entry.handle);
+        }
+    }
+    mPrograms.clear();
+    mKeys.clear();
+}
+
+uint64_t ProgramCache::hash(Program const& program) noexcept {
+    using utils::hash::fnv1a64;
+    uint64_t h = fnv1a64(nullptr, 0);
+    auto hashValue = [&h](auto const& value) {
+        h = fnv1a64(&value, sizeof(value), h);
+    };
+
+    // sizes are hashed as well so that the boundaries between the pieces matter
+    for (auto const& source : program.getShadersSource()) {
+        hashValue(source.size());
+        h = fnv1a64(source.data(), source.size(), h);
+    }
+    for (auto const& name : program.getUniformBlockInfo()) {
+        hashValue(name.size());
+        h = fnv1a64(name.c_str_safe(), name.size(), h);
+    }
+    for (auto const& samplers : program.getSamplerGroupInfo()) {
+        hashValue(samplers.size());
+        for (auto const& sampler : samplers) {
+            hashValue(sampler.name.size());
+            h = fnv1a64(sampler.name.c_str_safe(), sampler.name.size(), h);
+            hashValue(sampler.binding);
+        }
+    }
+    for (auto const& constant : program.getSpecializationConstants()) {
+        hashValue(constant.id);
+        hashValue(constant.value.index());
+        std::visit(hashValue, constant.value);
+    }
+    hashValue(program.getWorkGroupSize());
+    hashValue(program.skipsDrawsUntilReady());
+    return h;
+}
+
+ProgramCache::Key::Key(Program const& program)
+        : sources(program.getShadersSource()),
+          uniformBlocks(program.getUniformBlockInfo()),
+          samplerGroups(program.getSamplerGroupInfo()),
+          specializationConstants(program.getSpecializationConstants()),
+          workGroupSize(program.getWorkGroupSize()),
+          skipDrawsUntilReady(program.skipsDrawsUntilReady()) {
+}
+
+bool ProgramCache::Key::operator==(Program const& program) const noexcept {
+    auto const& otherSamplerGroups = program.getSamplerGroupInfo();
+    for (size_t i = 0; i < samplerGroups.size(); i++) {
+        auto const& lhs = samplerGroups[i];
+        auto const& rhs = otherSamplerGroups[i];
+        if (lhs.size() != rhs.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < lhs.size(); j++) {
+            if (lhs[j].binding != rhs[j].binding || lhs[j].name != rhs[j].name) {
+                return false;
+            }
+        }
+    }
+    auto const& otherConstants = program.getSpecializationConstants();
+    if (specializationConstants.size() != otherConstants.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < otherConstants.size(); i++) {
+        if (specializationConstants[i].id != otherConstants[i].id ||
+                specializationConstants[i].value != otherConstants[i].value) {
+            return false;
+        }
+    }
+    return sources == program.getShadersSource() &&
+           uniformBlocks == program.getUniformBlockInfo() &&
+           workGroupSize == program.getWorkGroupSize() &&
+           skipDrawsUntilReady == program.skipsDrawsUntilReady();
+}
+
+Handle<HwProgram> ProgramCache::acquire(DriverApi& driver, Program&& program) noexcept {
+    const uint64_t key = hash(program);
+    std::vector<Entry>& entries = mPrograms[key];
+    for (Entry& entry : entries) {
+        if (entry.key == program) {
+            entry.refs++;
+            mHits++;
+            return entry.handle;
+        }
+    }
+
+    Key fullKey(program);
+    Handle<HwProgram> handle = driver.createProgram(std::move(program));
+    assert(handle);
+    entries.push_back({ std::move(fullKey), handle, 1 });
+    mKeys.insert({ handle.getId(), key });
+    mMisses++;
+    return handle;
+}
+
+void ProgramCache::release(DriverApi& driver, Handle<HwProgram> handle) noexcept {
+    if (!handle) {
+        return;
+    }
+    auto key = mKeys.find(handle.getId());
+    assert(key != mKeys.end());
+    if (UTILS_UNLIKELY(key == mKeys.end())) {
+        return;
+    }
+    auto pos = mPrograms.find(key->second);
+    assert(pos != mPrograms.end());
+    std::vector<Entry>& entries = pos.value();
+    auto entry = std::find_if(entries.begin(), entries.end(),
+            [handle](Entry const& e) { return e.handle == handle; });
+    assert(entry != entries.end());
+    if (--entry->refs == 0) {
+        driver.destroyProgram(handle);
+        entries.erase(entry);
+        if (entries.empty()) {
+            mPrograms.erase(pos);
+        }
+        mKeys.erase(key);
+    }
+}
+
+ProgramCache::Statistics ProgramCache::getStatistics() const noexcept {
+    return { .hits = mHits, .misses = mMisses, .count = mKeys.size() };
+}
+
+} // namespace filament
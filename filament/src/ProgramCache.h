@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_PROGRAMCACHE_H
+#define TNT_FILAMENT_PROGRAMCACHE_H
+
+#include <backend/Handle.h>
+
+#include "private/backend/DriverApiForward.h"
+#include "private/backend/Program.h"
+
+#include <math/vec3.h>
+
+#include <tsl/robin_map.h>
+
+#include <array>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Shares programs between materials.
+ *
+ * Many materials end up with the same final shaders for some of their variants (e.g. the depth
+ * variants, or materials built from the same source with different parameter values), in which
+ * case they get the same program, which the driver compiles only once.
+ *
+ * Programs are looked up by a hash of their shaders, bindings and specialization constants, and
+ * a hit is only taken after comparing all of them, so a hash collision can't hand out the wrong
+ * program. Programs are ref-counted. This is only used from the main thread.
+ */
+class ProgramCache {
+public:
+    struct Statistics {
+        uint64_t hits = 0;          // programs shared with an existing one
+        uint64_t misses = 0;        // programs created by the driver
+        size_t count = 0;           // number of programs alive
+    };
+
+    ProgramCache() noexcept = default;
+    ProgramCache(ProgramCache const& rhs) = delete;
+    ProgramCache& operator=(ProgramCache const& rhs) = delete;
+    ~ProgramCache() noexcept;
+
+    // destroys the programs that were not released
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // returns a program identical to 'program', which is only created if there is none yet
+    backend::Handle<backend::HwProgram> acquire(backend::DriverApi& driver,
+            backend::Program&& program) noexcept;
+
+    // releases a program returned by acquire(), which is destroyed when it's no longer used
+    void release(backend::DriverApi& driver, backend::Handle<backend::HwProgram> handle) noexcept;
+
+    Statistics getStatistics() const noexcept;
+
+    // hash of everything in 'program' that ends up in the compiled program
+    static uint64_t hash(backend::Program const& program) noexcept;
+
+private:
+    // everything that's hashed, kept to tell programs with the same hash apart
+    struct Key {
+        std::array<std::vector<uint8_t>, backend::Program::SHADER_TYPE_COUNT> sources;
+        backend::Program::UniformBlockInfo uniformBlocks;
+        backend::Program::SamplerGroupInfo samplerGroups;
+        backend::Program::SpecializationConstantsInfo specializationConstants;
+        math::uint3 workGroupSize;
+        bool skipDrawsUntilReady;
+
+        explicit Key(backend::Program const& program);
+        bool operator==(backend::Program const& program) const noexcept;
+    };
+
+    struct Entry {
+        Key key;
+        backend::Handle<backend::HwProgram> handle;
+        uint32_t refs;
+    };
+
+    // programs with the same hash share a bucket
+    tsl::robin_map<uint64_t, std::vector<Entry>> mPrograms;
+    tsl::robin_map<backend::HandleBase::HandleId, uint64_t> mKeys;
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_PROGRAMCACHE_H
@@ -28,8 +28,13 @@
 #include <private/filament/UibGenerator.h>
 
 #include <utils/JobSystem.h>
+#include <utils/memalign.h>
+#include <utils/RadixSort.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <array>
+#include <optional>
 #include <utility>
 
 using namespace utils;
@@ -42,7 +47,9 @@ using namespace backend;
 RenderPass::RenderPass(FEngine& engine,
         GrowingSlice<RenderPass::Command> commands) noexcept
         : mEngine(engine), mCommands(commands),
-          mCustomCommands(engine.getPerRenderPassAllocator()) {
+          mCustomCommands(engine.getPerRenderPassAllocator()),
+          mSortStrategy(engine.debug.renderer.radix_sort ?
+                  SortStrategy::RADIX_SORT : SortStrategy::STD_SORT) {
     mCustomCommands.reserve(8); // preallocate allocate a reasonable number of custom commands
 }
 
@@ -71,13 +78,24 @@ void RenderPass::overridePolygonOffset(backend::PolygonOffset* polygonOffset) no
     }
 }
 
+void RenderPass::CommandCache::clear() noexcept {
+    std::vector<Row>().swap(rows);
+    std::vector<Command>().swap(commands);
+    soa = nullptr;
+    valid = false;
+}
+
 RenderPass::Command* RenderPass::newCommandBuffer() noexcept {
+    mCommandCache = nullptr;
+    mCommandsSorted = false;
+    mDeferredCommands = {};
     GrowingSlice<Command>& commands = mCommands;
     commands = GrowingSlice<Command>(commands.end(), commands.capacity() - commands.size());
     return commands.begin();
 }
 
-RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTypeFlags) noexcept {
+RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTypeFlags,
+        CommandCache* cache) noexcept {
     SYSTRACE_CONTEXT();
 
     FEngine& engine = mEngine;
@@ -87,6 +105,14 @@ RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTy
     const FScene::VisibleMaskType visibilityMask = mVisibilityMask;
     CameraInfo const& camera = mCamera;
     utils::Range<uint32_t> vr = mVisibleRenderables;
+
+    // commands can only be retained if they're the only ones in the command buffer
+    mCommandCache = nullptr;
+    mCommandsSorted = false;
+    if (!commands.empty()) {
+        cache = nullptr;
+    }
+
     if (UTILS_UNLIKELY(vr.empty())) {
         return commands.end();
     }
@@ -99,6 +125,39 @@ RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTy
     FScene::RenderableSoa const& soa = *mRenderableSoa;
     updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
 
+    // we extract camera position/forward outside of the loop, because these are not cheap.
+    const float3 cameraPosition(camera.getPosition());
+    const float3 cameraForwardVector(camera.getForwardVector());
+
+    if (cache) {
+        const CacheStatus status = getCacheStatus(*cache, commandTypeFlags, soa, vr,
+                cameraPosition, cameraForwardVector);
+        if (status != CacheStatus::INVALID) {
+            // the commands haven't changed since last time, recall them (already sorted)
+            SYSTRACE_NAME("recall cached commands");
+            const uint32_t count = uint32_t(cache->commands.size());
+            Command* const first = commands.grow(count);
+            std::copy(cache->commands.begin(), cache->commands.end(), first);
+            mCommandsSorted = true;
+            if (status == CacheStatus::STALE_DISTANCES) {
+                // only the distances to the camera changed, patch them, and sort again if
+                // that changed the order. The cache is updated by sortCommands().
+                updateDistanceBits(engine, first, count, soa, cameraPosition,
+                        cameraForwardVector);
+                mCommandsSorted = std::is_sorted(first, first + count);
+                prepareCache(*cache, commandTypeFlags, soa, vr, cameraPosition,
+                        cameraForwardVector);
+                mCommandCache = cache;
+            }
+            commands.grow(1)->key = uint64_t(Pass::SENTINEL);
+            mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
+            return commands.end();
+        }
+        // the commands generated below will be stored in the cache by sortCommands()
+        prepareCache(*cache, commandTypeFlags, soa, vr, cameraPosition, cameraForwardVector);
+        mCommandCache = cache;
+    }
+
     // compute how much maximum storage we need for this pass
     uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
     // double the color pass for transparent objects that need to render twice
@@ -107,19 +166,17 @@ RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTy
     growBy *= uint32_t(colorPass * 2 + depthPass);
     Command* const curr = commands.grow(growBy);
 
-    // we extract camera position/forward outside of the loop, because these are not cheap.
-    const float3 cameraPosition(camera.getPosition());
-    const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, visibilityMask, cameraPosition,
+    auto work = [commandTypeFlags, curr, &soa, vr, renderFlags, visibilityMask, cameraPosition,
                  cameraForwardVector]
             (uint32_t startIndex, uint32_t indexCount) {
         RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags, visibilityMask,
+                soa, vr, { startIndex, startIndex + indexCount }, renderFlags, visibilityMask,
                 cameraPosition, cameraForwardVector);
     };
 
     auto *jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
-            std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>());
+            std::cref(work),
+            CommandsSplitter(js, engine.getParallelLoopCosts().generateCommands));
 
     { // scope for systrace
         SYSTRACE_NAME("jobCommandsParallel");
@@ -136,11 +193,118 @@ RenderPass::Command* RenderPass::appendCommands(CommandTypeFlags const commandTy
     return commands.end();
 }
 
+RenderPass::Command* RenderPass::appendCommandsDeferred(
+        CommandTypeFlags const commandTypeFlags) noexcept {
+    GrowingSlice<Command>& commands = mCommands;
+    utils::Range<uint32_t> vr = mVisibleRenderables;
+
+    assert(!mDeferredCommands.first);
+    mCommandCache = nullptr;
+    mCommandsSorted = false;
+
+    if (UTILS_UNLIKELY(vr.empty())) {
+        return commands.end();
+    }
+    assert(mRenderableSoa);
+
+    // The summed primitive counts are only computed by generateAndSortCommands(), once for all
+    // the passes, so we count the primitives here.
+    auto const* const UTILS_RESTRICT primitives = mRenderableSoa->data<FScene::PRIMITIVES>();
+    uint32_t growBy = 0;
+    for (uint32_t i : vr) {
+        growBy += uint32_t(primitives[i].size());
+    }
+    // double the color pass for transparent objects that need to render twice
+    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+    const bool depthPass  = bool(commandTypeFlags & CommandTypeFlags::DEPTH);
+    growBy *= uint32_t(colorPass * 2 + depthPass);
+
+    mDeferredCommands = { commands.grow(growBy), commandTypeFlags };
+
+    // always add an "eof" command
+    commands.grow(1)->key = uint64_t(Pass::SENTINEL);
+
+    mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
+
+    return commands.end();
+}
+
+void RenderPass::generateDeferredCommands() noexcept {
+    if (!mDeferredCommands.first) {
+        return;
+    }
+
+    JobSystem& js = mEngine.getJobSystem();
+    FScene::RenderableSoa const& soa = *mRenderableSoa;
+    Command* const curr = mDeferredCommands.first;
+    const CommandTypeFlags commandTypeFlags = mDeferredCommands.commandTypeFlags;
+    const RenderFlags renderFlags = mFlags;
+    const FScene::VisibleMaskType visibilityMask = mVisibilityMask;
+    const utils::Range<uint32_t> vr = mVisibleRenderables;
+    const float3 cameraPosition(mCamera.getPosition());
+    const float3 cameraForwardVector(mCamera.getForwardVector());
+
+    auto work = [commandTypeFlags, curr, &soa, vr, renderFlags, visibilityMask, cameraPosition,
+                 cameraForwardVector]
+            (uint32_t startIndex, uint32_t indexCount) {
+        RenderPass::generateCommands(commandTypeFlags, curr,
+                soa, vr, { startIndex, startIndex + indexCount }, renderFlags, visibilityMask,
+                cameraPosition, cameraForwardVector);
+    };
+
+    // when called from a job, runAndWait() runs other jobs while it waits
+    auto *jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
+            std::cref(work),
+            CommandsSplitter(js, mEngine.getParallelLoopCosts().generateCommands));
+    js.runAndWait(jobCommandsParallel);
+
+    mDeferredCommands = {};
+}
+
+/* static */
+void RenderPass::generateAndSortCommands(JobSystem& js,
+        RenderPass* const* passes, size_t count) noexcept {
+    SYSTRACE_CALL();
+
+    // Commands are placed relative to the first renderable of their pass, so the summed
+    // primitive counts of all the renderables of all the passes serve every pass. They must
+    // be computed once up-front, as the passes' ranges overlap.
+    FScene::RenderableSoa const* soa = nullptr;
+    Range<uint32_t> all{ std::numeric_limits<uint32_t>::max(), 0 };
+    for (size_t i = 0; i < count; i++) {
+        RenderPass const& pass = *passes[i];
+        if (pass.mDeferredCommands.first) {
+            assert(!soa || soa == pass.mRenderableSoa);
+            soa = pass.mRenderableSoa;
+            all.first = std::min(all.first, pass.mVisibleRenderables.first);
+            all.last = std::max(all.last, pass.mVisibleRenderables.last);
+        }
+    }
+    if (soa) {
+        updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(*soa), all);
+    }
+
+    auto work = [passes](uint32_t start, uint32_t count) {
+        for (uint32_t i = start, c = start + count; i < c; i++) {
+            passes[i]->generateDeferredCommands();
+            passes[i]->sortCommands();
+        }
+    };
+
+    auto* job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(work), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+}
+
 RenderPass::Command* RenderPass::appendCustomCommand(Pass pass, CustomCommand custom, uint32_t order,
         std::function<void()> command) {
 
     assert((uint64_t(order) << CUSTOM_ORDER_SHIFT) <=  CUSTOM_ORDER_MASK);
 
+    // the command buffer can't be retained nor assumed sorted anymore
+    mCommandCache = nullptr;
+    mCommandsSorted = false;
+
     uint32_t index = mCustomCommands.size();
     mCustomCommands.push_back(std::move(command));
 
@@ -159,7 +323,46 @@ RenderPass::Command* RenderPass::sortCommands() noexcept {
 
     GrowingSlice<Command>& commands = mCommands;
 
-    std::sort(commands.begin(), commands.end());
+    if (mCommandsSorted) {
+        // commands recalled from a CommandCache are already sorted
+    } else if (mSortStrategy == SortStrategy::RADIX_SORT &&
+            commands.size() >= RADIX_SORT_MIN_COMMANDS_COUNT) {
+        // The per-renderpass arena is too small for the sort entries. Each radix pass moves a
+        // 16 bytes key/index entry instead of a 32 bytes command.
+        const uint32_t count = commands.size();
+        SortEntry* const entries = static_cast<SortEntry*>(
+                utils::aligned_alloc(2 * count * sizeof(SortEntry), alignof(SortEntry)));
+        if (entries) {
+            Command* const UTILS_RESTRICT cmds = commands.begin();
+            for (uint32_t i = 0; i < count; i++) {
+                entries[i] = { cmds[i].key, i, 0 };
+            }
+            jobs::radix_sort(mEngine.getJobSystem(), entries, entries + count, entries + count,
+                    [](SortEntry const& e) { return e.key; });
+
+            // Gather the commands in the sorted order, in place, one cycle of the permutation
+            // at a time. 'reserved' flags the entries whose command is in place.
+            for (uint32_t i = 0; i < count; i++) {
+                if (entries[i].reserved) {
+                    continue;
+                }
+                const Command first = cmds[i];
+                uint32_t j = i;
+                for (uint32_t k = entries[j].index; k != i; k = entries[j].index) {
+                    cmds[j] = cmds[k];
+                    entries[j].reserved = 1;
+                    j = k;
+                }
+                cmds[j] = first;
+                entries[j].reserved = 1;
+            }
+            utils::aligned_free(entries);
+        } else {
+            std::sort(commands.begin(), commands.end());
+        }
+    } else {
+        std::sort(commands.begin(), commands.end());
+    }
 
     // find the last command
     Command const* const last = std::partition_point(commands.begin(), commands.end(),
@@ -169,41 +372,325 @@ RenderPass::Command* RenderPass::sortCommands() noexcept {
 
     commands.resize(uint32_t(last - commands.begin()));
 
+    if (mCommandCache) {
+        mCommandCache->commands.assign(commands.begin(), commands.end());
+        mCommandCache->valid = true;
+    }
+    mCommandCache = nullptr;
+    mCommandsSorted = false;
+
     return commands.end();
 }
 
-void RenderPass::execute(const char* name,
+RenderPass::CacheStatus RenderPass::getCacheStatus(CommandCache const& cache,
+        uint32_t commandTypeFlags, FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        float3 cameraPosition, float3 cameraForward) const noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+
+    if (!cache.valid ||
+            cache.soa != &soa ||
+            cache.visibleFirst != vr.first ||
+            cache.rows.size() != vr.size() ||
+            cache.commandTypeFlags != commandTypeFlags ||
+            cache.renderFlags != mFlags ||
+            cache.visibilityMask != mVisibilityMask ||
+            cache.materialInstanceGeneration != engine.getMaterialInstanceGeneration() ||
+            rcm.getLayoutGeneration() > cache.renderableGeneration) {
+        return CacheStatus::INVALID;
+    }
+
+    auto const* const UTILS_RESTRICT soaInstance        = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT soaVisibilityMask  = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaReversedWinding = soa.data<FScene::REVERSED_WINDING_ORDER>();
+
+    bool distancesValid = cache.cameraPosition == cameraPosition &&
+                          cache.cameraForward == cameraForward;
+
+    CommandCache::Row const* UTILS_RESTRICT row = cache.rows.data();
+    for (uint32_t i : vr) {
+        // the renderable's visibility state, bones and primitives are covered by its generation
+        if (row->instance != soaInstance[i].asValue() ||
+                row->primitives != soaPrimitives[i].data() ||
+                row->primitiveCount != soaPrimitives[i].size() ||
+                row->visibleMask != soaVisibilityMask[i] ||
+                row->reversedWindingOrder != soaReversedWinding[i] ||
+                rcm.getGeneration(soaInstance[i]) > cache.renderableGeneration) {
+            return CacheStatus::INVALID;
+        }
+        distancesValid = distancesValid && row->worldAABBCenter == soaWorldAABBCenter[i];
+        ++row;
+    }
+
+    return distancesValid ? CacheStatus::VALID : CacheStatus::STALE_DISTANCES;
+}
+
+void RenderPass::prepareCache(CommandCache& cache, uint32_t commandTypeFlags,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        float3 cameraPosition, float3 cameraForward) const noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+
+    cache.valid = false; // until sortCommands() stores the commands
+    cache.soa = &soa;
+    cache.visibleFirst = vr.first;
+    cache.commandTypeFlags = uint8_t(commandTypeFlags);
+    cache.renderFlags = mFlags;
+    cache.visibilityMask = mVisibilityMask;
+    cache.materialInstanceGeneration = engine.getMaterialInstanceGeneration();
+    cache.renderableGeneration = rcm.getGeneration();
+    cache.cameraPosition = cameraPosition;
+    cache.cameraForward = cameraForward;
+
+    auto const* const UTILS_RESTRICT soaInstance        = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT soaVisibilityMask  = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaReversedWinding = soa.data<FScene::REVERSED_WINDING_ORDER>();
+
+    cache.rows.resize(vr.size());
+    CommandCache::Row* UTILS_RESTRICT row = cache.rows.data();
+    for (uint32_t i : vr) {
+        *row++ = {
+                .instance = soaInstance[i].asValue(),
+                .primitiveCount = uint32_t(soaPrimitives[i].size()),
+                .primitives = soaPrimitives[i].data(),
+                .worldAABBCenter = soaWorldAABBCenter[i],
+                .visibleMask = soaVisibilityMask[i],
+                .reversedWindingOrder = soaReversedWinding[i]
+        };
+    }
+}
+
+/* static */
+void RenderPass::updateDistanceBits(FEngine& engine, Command* const commands, uint32_t count,
+        FScene::RenderableSoa const& soa, float3 cameraPosition, float3 cameraForward) noexcept {
+    JobSystem& js = engine.getJobSystem();
+    auto const* const soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
+    const float cameraPositionDotForward = dot(cameraPosition, cameraForward);
+
+    // this must match the distance encoding done in generateCommandsImpl()
+    auto work = [soaWorldAABBCenter, cameraForward, cameraPositionDotForward](
+            Command* UTILS_RESTRICT curr, uint32_t c) {
+        for (Command* const last = curr + c; curr != last; ++curr) {
+            const uint32_t distanceBits = computeDistanceBits(
+                    soaWorldAABBCenter[curr->primitive.index],
+                    cameraForward, cameraPositionDotForward);
+            uint64_t key = curr->key;
+            switch (Pass(key & PASS_MASK)) {
+                case Pass::DEPTH:
+                    key &= ~DISTANCE_BITS_MASK;
+                    key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
+                    break;
+                case Pass::COLOR:
+                case Pass::REFRACT:
+                    key &= ~Z_BUCKET_MASK;
+                    key |= makeField(distanceBits >> 22u, Z_BUCKET_MASK, Z_BUCKET_SHIFT);
+                    break;
+                case Pass::BLENDED:
+                    key &= ~BLEND_DISTANCE_MASK;
+                    key |= makeField(~distanceBits, BLEND_DISTANCE_MASK, BLEND_DISTANCE_SHIFT);
+                    break;
+                default:
+                    break;
+            }
+            curr->key = key;
+        }
+    };
+
+    auto* job = jobs::parallel_for(js, nullptr, commands, count,
+            std::cref(work),
+            CommandsSplitter(js, engine.getParallelLoopCosts().updateDistanceBits));
+    js.runAndWait(job);
+}
+
+// Upper bound of the driver commands recorded for a Command: the material instance's uniforms and
+// samplers, the renderable's uniforms and bones, and the draw.
+static constexpr size_t MAX_DRIVER_COMMAND_SIZE =
+        CommandBase::align(sizeof(COMMAND_TYPE(bindSamplers))) +
+        CommandBase::align(sizeof(COMMAND_TYPE(bindUniformBufferRange))) * 3 +
+        std::max(CommandBase::align(sizeof(COMMAND_TYPE(draw))),
+                CommandBase::align(sizeof(COMMAND_TYPE(drawIndirect))));
+
+// Programs are created lazily by getProgram() which isn't thread-safe, so they must all exist
+// before commands are recorded concurrently. Commands are sorted by material, this is cheap.
+static void createPrograms(RenderPass::Command const* first,
+        RenderPass::Command const* last) noexcept {
+    FMaterialInstance const* mi = nullptr;
+    uint8_t variant = 0;
+    for (RenderPass::Command const* c = first; c != last; c++) {
+        if ((c->key & RenderPass::CUSTOM_MASK) != uint64_t(RenderPass::CustomCommand::PASS)) {
+            continue;
+        }
+        if (c->primitive.mi != mi || c->primitive.materialVariant.key != variant) {
+            mi = c->primitive.mi;
+            variant = c->primitive.materialVariant.key;
+            mi->getMaterial()->getProgram(variant);
+        }
+    }
+}
+
+void RenderPass::execute(DriverApi& driver, const char* name,
         backend::Handle<backend::HwRenderTarget> renderTarget,
         backend::RenderPassParams params) const noexcept {
-    FEngine& engine = mEngine;
-    DriverApi& driver = engine.getDriverApi();
     driver.beginRenderPass(renderTarget, params);
-    executeCommands(name);
+    executeCommands(driver, name);
     driver.endRenderPass();
 }
 
-void RenderPass::executeCommands(const char* name) const noexcept {
-    DriverApi& driver = mEngine.getDriverApi();
-    RenderPass::recordDriverCommands(driver, mCommands.begin(), mCommands.end());
+size_t RenderPass::prepareParallelExecution() const noexcept {
+    if (!mCustomCommands.empty() || mMaterialTimer) {
+        return 0;
+    }
+    createPrograms(mCommands.begin(), mCommands.end());
+    // the render pass, and the sub-streams of recordDriverCommandsParallel()
+    return CommandBase::align(sizeof(COMMAND_TYPE(beginRenderPass))) +
+            CommandBase::align(sizeof(COMMAND_TYPE(endRenderPass))) +
+            CommandSubStreamGroup::getOverheadSize(PARALLEL_RECORDING_MAX_JOBS) +
+            mCommands.size() * MAX_DRIVER_COMMAND_SIZE;
+}
+
+void RenderPass::executeCommands(DriverApi& driver, const char* name) const noexcept {
+    PassStatistics stats{ name };
+    RenderPass::recordDriverCommands(driver, mCommands.begin(), mCommands.end(), stats);
+    if (mStatistics) {
+        mStatistics->addPass(name, stats);
+    }
 }
 
 UTILS_NOINLINE // no need to be inlined
 void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, const Command* first,
-        const Command* last) const noexcept {
+        const Command* last, PassStatistics& stats) const noexcept {
     SYSTRACE_CALL();
 
     if (first != last) {
         SYSTRACE_VALUE32("commandCount", last - first);
 
+        // custom commands can record into any stream, so they must be recorded in order, and so
+        // must the timer queries of the material variants
+        if (mCustomCommands.empty() && !mMaterialTimer &&
+                size_t(last - first) >= PARALLEL_RECORDING_MIN_COMMANDS * 2 &&
+                mEngine.getJobSystem().getParallelSplitCount() > 0) {
+            recordDriverCommandsParallel(driver, first, last, stats);
+        } else {
+            recordDriverCommandsRange(driver, first, last, stats);
+        }
+        mCustomCommands.clear();
+    }
+}
+
+void RenderPass::recordDriverCommandsParallel(FEngine::DriverApi& driver, const Command* first,
+        const Command* last, PassStatistics& stats) const noexcept {
+    SYSTRACE_CALL();
+
+    static_assert(PARALLEL_RECORDING_MAX_JOBS <= CommandSubStreamGroup::MAX_SUB_STREAM_COUNT,
+            "each job records into a sub-stream of a group");
+
+    constexpr size_t maxCommandSize = MAX_DRIVER_COMMAND_SIZE;
+
+    // The sub-streams reserve their worst case size, so we flush the command buffer between
+    // batches to stay well within its guaranteed space.
+    const size_t maxBatchCount = std::max(size_t(1),
+            mEngine.getMinCommandBufferSize() / 2 / maxCommandSize);
+
+    createPrograms(first, last);
+
+    JobSystem& js = mEngine.getJobSystem();
+    const size_t maxJobCount = std::min(PARALLEL_RECORDING_MAX_JOBS,
+            size_t(1) << js.getParallelSplitCount());
+
+    while (first != last) {
+        const size_t batchCount = std::min(size_t(last - first), maxBatchCount);
+        const size_t jobCount = std::max(size_t(1), std::min(maxJobCount,
+                batchCount / PARALLEL_RECORDING_MIN_COMMANDS));
+        const size_t sliceCount = (batchCount + jobCount - 1) / jobCount;
+
+        // The sub-streams are reserved in order, which is the order they'll be executed in
+        // unless the driver executes them concurrently. That's possible because each slice binds
+        // its material instances and renderables, the other state is set before the pass.
+        std::array<std::optional<CommandSubStream>, PARALLEL_RECORDING_MAX_JOBS> subStreams;
+        std::array<PassStatistics, PARALLEL_RECORDING_MAX_JOBS> jobStats{};
+        CommandSubStreamGroup group(driver);
+        JobSystem::Job* parent = js.createJob();
+        for (size_t i = 0; i < jobCount; i++) {
+            Command const* const begin = first + i * sliceCount;
+            Command const* const end = first + std::min(batchCount, (i + 1) * sliceCount);
+            CommandSubStream& subStream = subStreams[i].emplace(group,
+                    (end - begin) * maxCommandSize);
+            PassStatistics& jobStat = jobStats[i];
+            js.run(js.createJob(parent,
+                    [this, &subStream, &jobStat, begin, end](JobSystem&, JobSystem::Job*) {
+                recordDriverCommandsRange(subStream.getStream(), begin, end, jobStat);
+            }));
+        }
+        js.runAndWait(parent);
+
+        for (size_t i = 0; i < jobCount; i++) {
+            subStreams[i]->finish();
+            stats.commandCount += jobStats[i].commandCount;
+            stats.drawCount += jobStats[i].drawCount;
+            stats.programChangeCount += jobStats[i].programChangeCount;
+            stats.pipelineChangeCount += jobStats[i].pipelineChangeCount;
+            stats.materialInstanceChangeCount += jobStats[i].materialInstanceChangeCount;
+        }
+
+        first += batchCount;
+        if (first != last) {
+            mEngine.flush();
+        }
+    }
+}
+
+void RenderPass::recordDriverCommandsRange(FEngine::DriverApi& driver, const Command* first,
+        const Command* last, PassStatistics& stats) const noexcept {
+    if (first != last) {
+        stats.commandCount += uint32_t(last - first);
+
         PolygonOffset dummyPolyOffset;
         PipelineState pipeline{ .polygonOffset = mPolygonOffset };
         PolygonOffset* const pPipelinePolygonOffset =
                 mPolygonOffsetOverride ? &dummyPolyOffset : &pipeline.polygonOffset;
 
         Handle<HwUniformBuffer> uboHandle = mUboHandle;
+        const size_t uboStride = mEngine.getPerRenderableUboStride();
         FMaterialInstance const* UTILS_RESTRICT mi = nullptr;
         FMaterial const* UTILS_RESTRICT ma = nullptr;
         auto const& customCommands = mCustomCommands;
+        uint16_t const* const UTILS_RESTRICT instanceCounts =
+                mRenderableSoa ? mRenderableSoa->data<FScene::INSTANCE_COUNT>() : nullptr;
+        uint32_t const* const UTILS_RESTRICT uboSlots =
+                mRenderableSoa ? mRenderableSoa->data<FScene::UBO_SLOT>() : nullptr;
+        uint32_t const* const UTILS_RESTRICT bonesOffsets =
+                mRenderableSoa ? mRenderableSoa->data<FScene::BONES_OFFSET>() : nullptr;
+        Handle<HwUniformBuffer> const* const UTILS_RESTRICT bonesUbh =
+                mRenderableSoa ? mRenderableSoa->data<FScene::BONES_UBH>() : nullptr;
+        ClusterDraws const* const clusterDraws = mClusterDraws;
+        uint32_t const* const UTILS_RESTRICT soaClusterDraws =
+                clusterDraws ? mRenderableSoa->data<FScene::CLUSTER_DRAWS>() : nullptr;
+        uint32_t drawCount = 0;
+        uint32_t programChangeCount = 0;
+        uint32_t pipelineChangeCount = 0;
+        uint32_t materialInstanceChangeCount = 0;
+        Handle<HwProgram> lastProgram;
+        uint32_t lastRasterState = 0;
+
+        // the current run of commands using the same material variant, when they're timed
+        FrameInfoManager* const materialTimer = mMaterialTimer;
+        MaterialStatistics& materialStatistics = mEngine.getMaterialStatistics();
+        struct {
+            FMaterial const* ma = nullptr;
+            uint8_t variant = 0;
+            uint32_t drawCount = 0;
+            uint64_t triangleCount = 0;
+        } run;
+        const auto endRun = [&materialStatistics, &run]() {
+            if (run.ma) {
+                materialStatistics.addDraws(run.ma->getId(), run.variant,
+                        run.drawCount, run.triangleCount);
+            }
+        };
 
         first--;
         while (++first != last) {
@@ -222,32 +709,166 @@ void RenderPass::recordDriverCommands(FEngine::DriverApi& driver, const Command*
             pipeline.rasterState = info.rasterState;
             if (UTILS_UNLIKELY(mi != info.mi)) {
                 // this is always taken the first time
+                info.mi->use(driver, mi);
                 mi = info.mi;
+                materialInstanceChangeCount++;
                 ma = mi->getMaterial();
                 pipeline.scissor = mi->getScissor();
                 *pPipelinePolygonOffset = mi->getPolygonOffset();
-                mi->use(driver);
             }
 
             pipeline.program = ma->getProgram(info.materialVariant.key);
-            size_t offset = info.index * sizeof(PerRenderableUib);
+            if (UTILS_UNLIKELY(pipeline.program != lastProgram ||
+                    pipeline.rasterState.u != lastRasterState)) {
+                programChangeCount += pipeline.program != lastProgram;
+                pipelineChangeCount++;
+                lastProgram = pipeline.program;
+                lastRasterState = pipeline.rasterState.u;
+            }
+
+            if (UTILS_UNLIKELY(materialTimer &&
+                    (run.ma != ma || run.variant != info.materialVariant.key))) {
+                endRun();
+                run = { ma, info.materialVariant.key };
+                materialTimer->beginMaterial(ma->getId(), run.variant);
+            }
+
+            // each renderable keeps its slot in the scene's UBO across frames
+            size_t offset = uboSlots[info.index] * uboStride;
             driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE,
-                    uboHandle, offset, sizeof(PerRenderableUib));
-            if (UTILS_UNLIKELY(info.perRenderableBones)) {
-                driver.bindUniformBuffer(BindingPoints::PER_RENDERABLE_BONES,
-                        info.perRenderableBones);
+                    uboHandle, offset, PER_RENDERABLE_UIB_DATA_SIZE);
+            if (UTILS_UNLIKELY(bonesUbh[info.index])) {
+                // the bones of the renderables share buffers, see FEngine::getBonesArena()
+                driver.bindUniformBufferRange(BindingPoints::PER_RENDERABLE_BONES,
+                        bonesUbh[info.index], bonesOffsets[info.index],
+                        CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone));
             }
-            driver.draw(pipeline, info.primitiveHandle);
+
+            if (UTILS_UNLIKELY(clusterDraws &&
+                    soaClusterDraws[info.index] != FScene::NO_CLUSTER_DRAWS &&
+                    info.primitiveIndex < MAX_CLUSTERED_PRIMITIVE_INDEX)) {
+                // only the visible clusters are drawn
+                const bool frontFacesOnly = info.rasterState.culling == CullingMode::BACK;
+                ClusterDraws::Range const& range = clusterDraws->ranges[
+                        soaClusterDraws[info.index] + info.primitiveIndex * 2u + frontFacesOnly];
+                if (range.first != ClusterDraws::WHOLE_PRIMITIVE) {
+                    if (UTILS_UNLIKELY(materialTimer && range.count)) {
+                        run.drawCount++;
+                        run.triangleCount += estimateTriangleCount(
+                                mRenderableSoa->elementAt<FScene::PRIMITIVES>(info.index), info,
+                                1, range.count);
+                    }
+                    if (range.count) {
+                        drawCount++;
+                        driver.drawIndirect(pipeline, info.primitiveHandle, clusterDraws->buffer,
+                                uint32_t(range.first * sizeof(DrawIndirectCommand)), range.count);
+                    }
+                    continue;
+                }
+            }
+
+            if (UTILS_UNLIKELY(info.indirect)) {
+                // the instance count is only known by the GPU, e.g. the live particles
+                FRenderPrimitive const& primitive = mRenderableSoa->elementAt<FScene::PRIMITIVES>(
+                        info.index)[info.primitiveIndex];
+                if (UTILS_UNLIKELY(materialTimer)) {
+                    run.drawCount++;
+                }
+                drawCount++;
+                driver.drawIndirect(pipeline, info.primitiveHandle,
+                        primitive.getIndirectDraw(), 0, 1);
+                continue;
+            }
+
+            // Consecutive commands drawing the same primitive with the same material instance
+            // aren't merged into an instanced draw: the instances would need to read their
+            // per-renderable uniforms through an instance index, which the generated shaders
+            // don't have.
+            const uint32_t instanceCount = instanceCounts[info.index];
+            if (UTILS_UNLIKELY(materialTimer)) {
+                run.drawCount++;
+                run.triangleCount += estimateTriangleCount(
+                        mRenderableSoa->elementAt<FScene::PRIMITIVES>(info.index), info,
+                        instanceCount, 0);
+            }
+            drawCount++;
+            driver.draw(pipeline, info.primitiveHandle, instanceCount);
+        }
+
+        stats.drawCount += drawCount;
+        stats.programChangeCount += programChangeCount;
+        stats.pipelineChangeCount += pipelineChangeCount;
+        stats.materialInstanceChangeCount += materialInstanceChangeCount;
+
+        if (UTILS_UNLIKELY(materialTimer)) {
+            endRun();
+            materialTimer->endMaterial();
         }
-        mCustomCommands.clear();
     }
 }
 
+uint64_t RenderPass::estimateTriangleCount(Slice<FRenderPrimitive> const& primitives,
+        PrimitiveInfo const& info, uint32_t instanceCount, uint32_t clusterCount) noexcept {
+    // the primitive index is clamped, the handle tells the primitive apart in that case (depth
+    // commands may draw its depth primitive)
+    FRenderPrimitive const* primitive = nullptr;
+    auto draws = [&info](FRenderPrimitive const& candidate) {
+        return candidate.getHwHandle() == info.primitiveHandle ||
+               candidate.getDepthHwHandle() == info.primitiveHandle;
+    };
+    if (info.primitiveIndex < primitives.size() && draws(primitives[info.primitiveIndex])) {
+        primitive = &primitives[info.primitiveIndex];
+    } else {
+        for (FRenderPrimitive const& candidate : primitives) {
+            if (draws(candidate)) {
+                primitive = &candidate;
+                break;
+            }
+        }
+    }
+    if (!primitive || primitive->getPrimitiveType() != PrimitiveType::TRIANGLES) {
+        return 0;
+    }
+    uint64_t triangleCount = primitive->getIndexCount() / 3;
+    if (clusterCount) {
+        // assumes the clusters have about the same size
+        auto const& clusters = primitive->getClusters();
+        triangleCount = clusters.empty() ? triangleCount :
+                triangleCount * clusterCount / clusters.size();
+    }
+    return triangleCount * instanceCount;
+}
+
+/* static */
+UTILS_ALWAYS_INLINE
+inline
+bool RenderPass::isInDepthPrepass(FMaterialInstance const* const UTILS_RESTRICT mi) noexcept {
+    // Opaque and masked objects that write depth with the default depth test. Objects using
+    // screen-space refraction are excluded, the opaque objects behind them must be rendered.
+    FMaterial const * const UTILS_RESTRICT ma = mi->getMaterial();
+    BlendingMode blendingMode = ma->getBlendingMode();
+    return (blendingMode == BlendingMode::OPAQUE || blendingMode == BlendingMode::MASKED) &&
+            ma->getRefractionMode() != RefractionMode::SCREEN_SPACE &&
+            mi->getDepthWrite() && mi->getDepthFunc() == RasterState::DepthFunc::GE;
+}
+
+/* static */
+UTILS_ALWAYS_INLINE
+inline
+bool RenderPass::isOrderIndependent(FMaterial const* const UTILS_RESTRICT ma) noexcept {
+    // Only these blending modes output to the order-independent transparency targets, see
+    // ShaderGenerator. The other blending modes are rendered in the sorted BLENDED pass.
+    BlendingMode blendingMode = ma->getBlendingMode();
+    return (blendingMode == BlendingMode::TRANSPARENT || blendingMode == BlendingMode::FADE) &&
+            ma->getRefractionMode() != RefractionMode::SCREEN_SPACE;
+}
+
 /* static */
 UTILS_ALWAYS_INLINE // this function exists only to make the code more readable. we want it inlined.
 inline              // and we don't need it in the compilation unit
 void RenderPass::setupColorCommand(Command& cmdDraw,
-        FMaterialInstance const* const UTILS_RESTRICT mi, bool inverseFrontFaces) noexcept {
+        FMaterialInstance const* const UTILS_RESTRICT mi, bool inverseFrontFaces,
+        bool depthPrepass, bool orderIndependentTransparency) noexcept {
 
     FMaterial const * const UTILS_RESTRICT ma = mi->getMaterial();
     uint8_t variant =
@@ -273,23 +894,72 @@ void RenderPass::setupColorCommand(Command& cmdDraw,
     keyDraw |= makeField(variant, MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
     keyDraw |= makeField(ma->getRasterState().alphaToCoverage, BLENDING_MASK, BLENDING_SHIFT);
 
-    cmdDraw.key = isBlendingCommand ? keyBlending : keyDraw;
+    // Order-independent commands are sorted like opaque ones. They accumulate the weighted
+    // colors and weights additively, and the revealage multiplicatively in alpha.
+    const bool isOrderIndependentCommand =
+            isBlendingCommand && orderIndependentTransparency && isOrderIndependent(ma);
+    uint64_t keyOrderIndependent = keyDraw;
+    keyOrderIndependent &= ~PASS_MASK;
+    keyOrderIndependent |= uint64_t(Pass::OIT);
+
+    cmdDraw.key = isOrderIndependentCommand ? keyOrderIndependent :
+            (isBlendingCommand ? keyBlending : keyDraw);
     cmdDraw.primitive.rasterState = ma->getRasterState();
     cmdDraw.primitive.rasterState.inverseFrontFaces = inverseFrontFaces;
     cmdDraw.primitive.rasterState.culling = mi->getCullingMode();
     cmdDraw.primitive.rasterState.colorWrite = mi->getColorWrite();
-    cmdDraw.primitive.rasterState.depthWrite = mi->getDepthWrite();
+    // the depth of the objects in the depth prepass is already final, they're only shaded where
+    // they're visible, which the GE test (with reversed-Z) lets through
+    cmdDraw.primitive.rasterState.depthWrite = mi->getDepthWrite() &&
+            !(depthPrepass && isInDepthPrepass(mi));
     cmdDraw.primitive.rasterState.depthFunc = mi->getDepthFunc();
+    if (isOrderIndependentCommand) {
+        RasterState& rs = cmdDraw.primitive.rasterState;
+        rs.blendFunctionSrcRGB = BlendFunction::ONE;
+        rs.blendFunctionDstRGB = BlendFunction::ONE;
+        rs.blendFunctionSrcAlpha = BlendFunction::ZERO;
+        rs.blendFunctionDstAlpha = BlendFunction::ONE_MINUS_SRC_ALPHA;
+        rs.depthWrite = false;
+        // the back and front faces don't need to be drawn in order anymore
+        if (ma->getTransparencyMode() == TransparencyMode::TWO_PASSES_TWO_SIDES) {
+            rs.culling = CullingMode::NONE;
+        }
+    }
     cmdDraw.primitive.mi = mi;
     cmdDraw.primitive.materialVariant.key = variant;
     // we keep "RasterState::colorWrite" to the value set by material (could be disabled)
 }
 
+/* static */
+UTILS_ALWAYS_INLINE
+inline uint32_t RenderPass::computeDistanceBits(float3 worldAABBCenter,
+        float3 cameraForward, float cameraPositionDotForward) noexcept {
+    // Code below is equivalent to:
+    // float3 d = worldAABBCenter - cameraPosition;
+    // float distance = dot(d, cameraForward);
+    // but saves a couple of instruction, because part of the math is done outside of the loop.
+    float distance = dot(worldAABBCenter, cameraForward) - cameraPositionDotForward;
+
+    // We negate the distance to the camera in order to create a bit pattern that will
+    // be sorted properly, this works because:
+    // - positive distances (now negative), will still be sorted by their absolute value
+    //   due to float representation.
+    // - negative distances (now positive) will be sorted BEFORE everything else, and we
+    //   don't care too much about their order (i.e. should objects far behind the camera
+    //   be sorted first? -- unclear, and probably irrelevant).
+    //   Here, objects close to the camera (but behind) will be drawn first.
+    // An alternative that keeps the mathematical ordering is given here:
+    //   distanceBits ^= ((int32_t(distanceBits) >> 31) | 0x80000000u);
+    distance = -distance;
+    return reinterpret_cast<uint32_t&>(distance);
+}
+
 /* static */
 UTILS_NOINLINE
 void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
-        FScene::RenderableSoa const& soa, Range<uint32_t> range, RenderFlags renderFlags,
-        FScene::VisibleMaskType visibilityMask, float3 cameraPosition, float3 cameraForward) noexcept {
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr, Range<uint32_t> range,
+        RenderFlags renderFlags, FScene::VisibleMaskType visibilityMask,
+        float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
     // we go throw the list of renderables just once.
@@ -297,7 +967,7 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     // the list twice)
 
     // compute how much maximum storage we need
-    uint32_t offset = FScene::getPrimitiveCount(soa, range.first);
+    uint32_t offset = FScene::getPrimitiveCount(soa, vr.first, range.first);
     // double the color pass for transparent objects that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & CommandTypeFlags::DEPTH);
@@ -350,16 +1020,20 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
     const bool depthContainsShadowCasters = bool(extraFlags & CommandTypeFlags::DEPTH_CONTAINS_SHADOW_CASTERS);
     const bool depthFilterTranslucentObjects = bool(extraFlags & CommandTypeFlags::DEPTH_FILTER_TRANSLUCENT_OBJECTS);
     const bool depthFilterAlphaMaskedObjects = bool(extraFlags & CommandTypeFlags::DEPTH_FILTER_ALPHA_MASKED_OBJECTS);
+    const bool withDepthPrepass = bool(extraFlags & CommandTypeFlags::WITH_DEPTH_PREPASS);
+    const bool withOrderIndependentTransparency =
+            bool(extraFlags & CommandTypeFlags::WITH_ORDER_INDEPENDENT_TRANSPARENCY);
+    const bool depthWithPicking = bool(extraFlags & CommandTypeFlags::DEPTH_WITH_PICKING);
 
     auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
     auto const* const UTILS_RESTRICT soaReversedWinding = soa.data<FScene::REVERSED_WINDING_ORDER>();
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
     auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
     auto const* const UTILS_RESTRICT soaVisibilityMask  = soa.data<FScene::VISIBLE_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
     const bool viewInverseFrontFaces = renderFlags & HAS_INVERSE_FRONT_FACES;
+    const float cameraPositionDotForward = dot(cameraPosition, cameraForward);
 
     Variant materialVariant;
     materialVariant.setDirectionalLighting(renderFlags & HAS_DIRECTIONAL_LIGHT);
@@ -372,9 +1046,12 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
 
     Command cmdDepth;
     cmdDepth.primitive.materialVariant = Variant{ Variant::DEPTH_VARIANT };
-    cmdDepth.primitive.materialVariant.setVsm(renderFlags & HAS_VSM);
+    // a depth prepass shares the color pass' target, VSM moments must not be written to it
+    const bool depthHasVsm = (renderFlags & HAS_VSM) && !withDepthPrepass && !depthWithPicking;
+    cmdDepth.primitive.materialVariant.setVsm(depthHasVsm);
+    cmdDepth.primitive.materialVariant.setPicking(depthWithPicking);
     cmdDepth.primitive.rasterState = {};
-    cmdDepth.primitive.rasterState.colorWrite = renderFlags & HAS_VSM;
+    cmdDepth.primitive.rasterState.colorWrite = depthHasVsm || depthWithPicking;
     cmdDepth.primitive.rasterState.depthWrite = true;
     cmdDepth.primitive.rasterState.depthFunc = RasterState::DepthFunc::GE;
     cmdDepth.primitive.rasterState.alphaToCoverage = false;
@@ -404,32 +1081,14 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
         //      d -= normalize(d) * length(soaWorldAABB[i].halfExtent);
         // However this doesn't work well at all for large planes.
 
-        // Code below is equivalent to:
-        // float3 d = soaWorldAABBCenter[i] - cameraPosition;
-        // float distance = dot(d, cameraForward);
-        // but saves a couple of instruction, because part of the math is done outside of the loop.
-        float distance = dot(soaWorldAABBCenter[i], cameraForward) - dot(cameraPosition, cameraForward);
-
-
-        // We negate the distance to the camera in order to create a bit pattern that will
-        // be sorted properly, this works because:
-        // - positive distances (now negative), will still be sorted by their absolute value
-        //   due to float representation.
-        // - negative distances (now positive) will be sorted BEFORE everything else, and we
-        //   don't care too much about their order (i.e. should objects far behind the camera
-        //   be sorted first? -- unclear, and probably irrelevant).
-        //   Here, objects close to the camera (but behind) will be drawn first.
-        // An alternative that keeps the mathematical ordering is given here:
-        //   distanceBits ^= ((int32_t(distanceBits) >> 31) | 0x80000000u);
-        distance = -distance;
-        const uint32_t distanceBits = reinterpret_cast<uint32_t&>(distance);
+        const uint32_t distanceBits = computeDistanceBits(soaWorldAABBCenter[i],
+                cameraForward, cameraPositionDotForward);
 
         // calculate the per-primitive face winding order inversion
         const bool inverseFrontFaces = viewInverseFrontFaces ^ soaReversedWinding[i];
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
-        cmdColor.primitive.index = (uint16_t)i;
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdColor.primitive.index = uint32_t(i);
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning || soaVisibility[i].morphing);
 
@@ -439,8 +1098,7 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
         cmdDepth.key |= uint64_t(CustomCommand::PASS);
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
-        cmdDepth.primitive.index = (uint16_t)i;
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.index = uint32_t(i);
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning || soaVisibility[i].morphing);
         cmdDepth.primitive.rasterState.inverseFrontFaces = inverseFrontFaces;
 
@@ -455,10 +1113,17 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
          */
         for (auto const& primitive : primitives) {
             FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            const uint8_t primitiveIndex = uint8_t(std::min(
+                    size_t(&primitive - primitives.begin()), MAX_CLUSTERED_PRIMITIVE_INDEX));
+            const bool hasIndirectDraw = bool(primitive.getIndirectDraw()) &&
+                    primitiveIndex < MAX_CLUSTERED_PRIMITIVE_INDEX;
             if (isColorPass) {
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
+                cmdColor.primitive.primitiveIndex = primitiveIndex;
+                cmdColor.primitive.indirect = hasIndirectDraw;
                 cmdColor.primitive.materialVariant = materialVariant;
-                RenderPass::setupColorCommand(cmdColor, mi, inverseFrontFaces);
+                RenderPass::setupColorCommand(cmdColor, mi, inverseFrontFaces,
+                        withDepthPrepass, withOrderIndependentTransparency);
 
                 const bool blendPass = Pass(cmdColor.key & PASS_MASK) == Pass::BLENDED;
                 if (blendPass) {
@@ -539,8 +1204,12 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
                 FMaterial const* const ma = mi->getMaterial();
                 RasterState rs = ma->getRasterState();
 
-                // unconditionally write the command
-                cmdDepth.primitive.primitiveHandle = primitive.getHwHandle();
+                // unconditionally write the command, the default material's depth variants
+                // don't need more than the depth attributes
+                cmdDepth.primitive.primitiveHandle = ma->hasCustomDepthShader() ?
+                        primitive.getHwHandle() : primitive.getDepthHwHandle();
+                cmdDepth.primitive.primitiveIndex = primitiveIndex;
+                cmdDepth.primitive.indirect = hasIndirectDraw;
                 cmdDepth.primitive.mi = mi;
                 cmdDepth.primitive.rasterState.culling = mi->getCullingMode();
                 *curr = cmdDepth;
@@ -554,6 +1223,9 @@ void RenderPass::generateCommandsImpl(uint32_t extraFlags,
                         & !(depthFilterAlphaMaskedObjects & rs.alphaToCoverage))
                                 | writeDepthForShadowCasters;
 
+                // the depth prepass must contain exactly the objects shaded without depth writes
+                issueDepth = withDepthPrepass ? isInDepthPrepass(mi) : issueDepth;
+
                 curr->key |= select(!issueDepth);
 
                 // handle the case where this primitive is empty / no-op
@@ -17,6 +17,7 @@
 #ifndef TNT_UTILS_RENDERPASS_H
 #define TNT_UTILS_RENDERPASS_H
 
+#include <filament/Renderer.h>
 #include <filament/Viewport.h>
 
 #include "details/Camera.h"
@@ -28,16 +29,18 @@
 #include <private/filament/Variant.h>
 
 #include <utils/compiler.h>
+#include <utils/JobSystem.h>
 #include <utils/Slice.h>
 
 #include <limits>
-
-namespace utils {
-class JobSystem;
-}
+#include <vector>
 
 namespace filament {
 
+class FrameInfoManager;
+class FRenderPrimitive;
+struct ViewStatistics;
+
 class RenderPass {
 public:
     static constexpr uint64_t DISTANCE_BITS_MASK            = 0xFFFFFFFFllu;
@@ -91,6 +94,7 @@ public:
         COLOR    = uint64_t(0x01) << PASS_SHIFT,
         REFRACT  = uint64_t(0x02) << PASS_SHIFT,
         BLENDED  = uint64_t(0x03) << PASS_SHIFT,
+        OIT      = uint64_t(0x04) << PASS_SHIFT,    // order-independent transparency
         SENTINEL = 0xffffffffffffffffllu
     };
 
@@ -110,11 +114,23 @@ public:
         DEPTH_FILTER_TRANSLUCENT_OBJECTS = 0x8,
         // alpha-tested objects are not rendered in the depth buffer
         DEPTH_FILTER_ALPHA_MASKED_OBJECTS = 0x10,
+        // the color pass starts with a depth prepass of its opaque objects, which are then
+        // shaded without writing depth, see isInDepthPrepass()
+        WITH_DEPTH_PREPASS = 0x20,
+        // transparent objects are rendered with weighted-blended order-independent transparency,
+        // in their own pass sorted by material, see isOrderIndependent()
+        WITH_ORDER_INDEPENDENT_TRANSPARENCY = 0x40,
+        // the depth commands use the picking variants, which output the object id and depth
+        DEPTH_WITH_PICKING = 0x80,
 
         // generate commands for shadow map
         SHADOW = DEPTH | DEPTH_CONTAINS_SHADOW_CASTERS,
         // generate commands for SSAO
         SSAO = DEPTH | DEPTH_FILTER_TRANSLUCENT_OBJECTS,
+        // generate the commands of the depth prepass, they sort before the color commands
+        DEPTH_PREPASS = DEPTH | WITH_DEPTH_PREPASS,
+        // generate the commands of a picking pass
+        PICKING = DEPTH | DEPTH_WITH_PICKING,
     };
 
 
@@ -140,6 +156,7 @@ public:
     // +------+--+--+-+---+--+------+----------+--------------------------------+
     // |000001|01|00|a|ppp|00|000000| Z-bucket |          material-id           |
     // |000010|01|00|a|ppp|00|000000| Z-bucket |          material-id           | refraction
+    // |000100|01|00|a|ppp|00|000000| Z-bucket |          material-id           | OIT
     // +------+--+--+-+---+--+------+----------+--------------------------------+
     // | correctness      |      optimizations (truncation allowed)             |
     //
@@ -209,14 +226,19 @@ public:
         return boolish ? -1llu : 0llu;
     }
 
+    // The per-renderable state (e.g. the bones) is read from the renderable's data at 'index'
+    // when the commands are recorded, which keeps this small and 'index' 32 bits.
     struct PrimitiveInfo { // 24 bytes
         FMaterialInstance const* mi = nullptr;                          // 8 bytes (4)
         backend::Handle<backend::HwRenderPrimitive> primitiveHandle;    // 4 bytes
-        backend::Handle<backend::HwUniformBuffer> perRenderableBones;   // 4 bytes
         backend::RasterState rasterState;                               // 4 bytes
-        uint16_t index = 0;                                             // 2 bytes
+        uint32_t index = 0;                                             // 4 bytes
         Variant materialVariant;                                        // 1 byte
-        uint8_t reserved = {};                                          // 1 byte
+        // index of the primitive in the renderable, clamped to MAX_CLUSTERED_PRIMITIVE_INDEX
+        uint8_t primitiveIndex = 0;                                     // 1 byte
+        // whether the primitive's draw arguments are written by the GPU, see FRenderPrimitive
+        bool indirect = false;                                          // 1 byte
+        uint8_t reserved = 0;                                           // 1 byte
     };
 
     struct alignas(8) Command {     // 32 bytes
@@ -231,6 +253,30 @@ public:
     };
     static_assert(std::is_trivially_destructible<Command>::value,
             "Command isn't trivially destructible");
+    static_assert(sizeof(Command) == 32, "Command should be 32 bytes");
+
+    /*
+     * Draws of the visible clusters of the primitives, see FView::prepareClusters().
+     *
+     * The CLUSTER_DRAWS of a renderable is the index in 'ranges' of the draws of its first
+     * primitive, or NO_CLUSTER_DRAWS. Each primitive has two ranges of DrawIndirectCommand in
+     * 'buffer': the clusters that are in the frustum and not occluded, then those of them that
+     * also have front faces, which is used when back faces are culled. Adjacent clusters are
+     * merged into a single draw.
+     */
+    struct ClusterDraws {
+        struct Range {
+            uint32_t first;     // index of the first DrawIndirectCommand
+            uint32_t count;     // number of DrawIndirectCommand, 0 if all the clusters are culled
+        };
+        // 'first' of the ranges of the primitives that have no clusters
+        static constexpr uint32_t WHOLE_PRIMITIVE = ~0u;
+        backend::Handle<backend::HwUniformBuffer> buffer;
+        Range const* ranges = nullptr;
+    };
+
+    // the primitives past this index in their renderable are always drawn as a whole
+    static constexpr size_t MAX_CLUSTERED_PRIMITIVE_INDEX = 255;
 
     using RenderFlags = uint8_t;
     static constexpr RenderFlags HAS_SHADOWING           = 0x01;
@@ -240,6 +286,52 @@ public:
     static constexpr RenderFlags HAS_FOG                 = 0x10;
     static constexpr RenderFlags HAS_VSM                 = 0x20;
 
+    /*
+     * Sorted commands of a pass, retained across frames.
+     *
+     * When a CommandCache is given to appendCommands(), the commands are only generated (and
+     * sorted) again if something they depend on changed since the previous call. When
+     * only the camera or the renderables' positions changed, the cached commands are reused
+     * and only their distance bits are updated (and the commands re-sorted if needed).
+     * This is meant for mostly static scenes.
+     */
+    class CommandCache {
+    public:
+        // frees the cached commands
+        void clear() noexcept;
+
+    private:
+        friend class RenderPass;
+
+        // per visible renderable state the commands depend on
+        struct Row {
+            uint32_t instance;
+            uint32_t primitiveCount;
+            FRenderPrimitive const* primitives;
+            math::float3 worldAABBCenter;
+            FScene::VisibleMaskType visibleMask;
+            bool reversedWindingOrder;
+        };
+
+        std::vector<Row> rows;
+        std::vector<Command> commands;  // sorted, without sentinels
+        FScene::RenderableSoa const* soa = nullptr;
+        uint64_t renderableGeneration = 0;
+        uint64_t materialInstanceGeneration = 0;
+        math::float3 cameraPosition{};
+        math::float3 cameraForward{};
+        uint32_t visibleFirst = 0;
+        FScene::VisibleMaskType visibilityMask = 0;
+        RenderFlags renderFlags = 0;
+        uint8_t commandTypeFlags = 0;
+        bool valid = false;
+    };
+
+    // How sortCommands() orders the command buffer
+    enum class SortStrategy : uint8_t {
+        STD_SORT,       // std::sort, on the calling thread
+        RADIX_SORT      // parallel LSD radix sort on the command key, using the JobSystem
+    };
 
     RenderPass(FEngine& engine, utils::GrowingSlice<Command> commands) noexcept;
     RenderPass(RenderPass const& rhs);
@@ -251,6 +343,30 @@ public:
     void setCamera(const CameraInfo& camera) noexcept;
     void setRenderFlags(RenderFlags flags) noexcept;
 
+    // Draws the visible clusters of the renderables that have some, instead of their whole
+    // primitives. This is only valid for passes that use the camera the clusters were culled
+    // with, null by default.
+    void setClusterDraws(ClusterDraws const* clusterDraws) noexcept {
+        mClusterDraws = clusterDraws;
+    }
+
+    // Selects the algorithm used by sortCommands(). The default is taken from the
+    // "d.renderer.radix_sort" debug property when the RenderPass is created.
+    void setSortStrategy(SortStrategy strategy) noexcept { mSortStrategy = strategy; }
+
+    // Records the draws of each material variant into the Engine's MaterialStatistics, and times
+    // them with the given FrameInfoManager. The commands are then recorded by a single thread.
+    // Null by default.
+    void setMaterialTimer(FrameInfoManager* frameInfoManager) noexcept {
+        mMaterialTimer = frameInfoManager;
+    }
+
+    // Adds the commands recorded by execute() and executeCommands() to the given statistics,
+    // under the name of the pass. Null by default.
+    void setStatistics(ViewStatistics* statistics) noexcept {
+        mStatistics = statistics;
+    }
+
     // Sets the visibility mask, which is AND-ed against each Renderable's VISIBLE_MASK to determine
     // if the renderable is visible for this pass.
     // Defaults to all 1's, which means all renderables in this render pass will be rendered.
@@ -270,7 +386,23 @@ public:
     Command* newCommandBuffer() noexcept;
 
     // returns mCommands.end()
-    Command* appendCommands(CommandTypeFlags commandTypeFlags) noexcept;
+    // If cache is provided and this is the first call since newCommandBuffer(), the commands
+    // are retained in it by sortCommands() and reused by the next call if still valid.
+    Command* appendCommands(CommandTypeFlags commandTypeFlags,
+            CommandCache* cache = nullptr) noexcept;
+
+    // Like appendCommands(), but only allocates the commands, they're generated later by
+    // generateAndSortCommands(). This allows several passes sharing a command buffer to
+    // generate their commands concurrently. Can be called only once per command buffer.
+    // returns mCommands.end()
+    Command* appendCommandsDeferred(CommandTypeFlags commandTypeFlags) noexcept;
+
+    // Generates the commands allocated by appendCommandsDeferred() and sorts the command buffer
+    // of each pass, like sortCommands() does. All the passes are processed concurrently by a
+    // single job graph, instead of paying for a fork/join per pass. The passes must use the
+    // same RenderableSoa.
+    static void generateAndSortCommands(utils::JobSystem& js,
+            RenderPass* const* passes, size_t count) noexcept;
 
     // returns mCommands.end()
     Command* appendCustomCommand(Pass pass, CustomCommand custom, uint32_t order,
@@ -280,11 +412,17 @@ public:
     // the new mCommands.end()
     Command* sortCommands() noexcept;
 
-    void execute(const char* name,
+    void execute(backend::DriverApi& driver, const char* name,
             backend::Handle<backend::HwRenderTarget> renderTarget,
             backend::RenderPassParams params) const noexcept;
 
-    void executeCommands(const char* name) const noexcept;
+    void executeCommands(backend::DriverApi& driver, const char* name) const noexcept;
+
+    // Returns an upper bound of the size of the driver commands recorded by execute(), for
+    // FrameGraph::Builder::parallel(), or 0 if they must be recorded on the engine's thread,
+    // i.e. with custom commands or a material timer. This creates the programs the commands
+    // use, since that can't be done concurrently.
+    size_t prepareParallelExecution() const noexcept;
 
     utils::GrowingSlice<Command>& getCommands() { return mCommands; }
     utils::Slice<Command> const& getCommands() const { return mCommands; }
@@ -302,24 +440,93 @@ private:
     static constexpr size_t JOBS_PARALLEL_FOR_COMMANDS_SIZE  =
             sizeof(Command) * JOBS_PARALLEL_FOR_COMMANDS_COUNT;
 
+    // Commands are recorded in parallel when there are at least twice this many and no custom
+    // commands, a job records at least this many commands.
+    static constexpr size_t PARALLEL_RECORDING_MIN_COMMANDS = 256;
+    static constexpr size_t PARALLEL_RECORDING_MAX_JOBS = 16;
+
     static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
             "Size of Commands jobs must be multiple of a cache-line size");
 
+    // The chunks of the parallel loops on commands are sized from their measured cost, which is
+    // the same for all the passes, see FEngine::getParallelLoopCosts().
+    using CommandsSplitter = utils::jobs::AdaptiveSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>;
+
+    // below this many commands, std::sort beats the radix sort's fixed cost
+    static constexpr size_t RADIX_SORT_MIN_COMMANDS_COUNT = 1024;
+
+    // The radix sort moves these instead of the commands, which are then gathered once in the
+    // sorted order.
+    struct SortEntry {  // 16 bytes
+        CommandKey key;
+        uint32_t index;
+        uint32_t reserved;
+    };
+
+    // 'commands' is where the commands of the first renderable of 'vr' go, range must be
+    // within 'vr'
     static inline void generateCommands(uint32_t commandTypeFlags, Command* commands,
-            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            utils::Range<uint32_t> range, RenderFlags renderFlags,
             FScene::VisibleMaskType visibilityMask, math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
+    // generates the commands allocated by appendCommandsDeferred(), the summed primitive
+    // counts must be up-to-date
+    void generateDeferredCommands() noexcept;
+
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> range,
             RenderFlags renderFlags, FScene::VisibleMaskType visibilityMask,
             math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
+    // positive distances in front of the camera, encoded for sorting, see generateCommandsImpl()
+    static inline uint32_t computeDistanceBits(math::float3 worldAABBCenter,
+            math::float3 cameraForward, float cameraPositionDotForward) noexcept;
+
+    enum class CacheStatus : uint8_t {
+        INVALID,            // the commands must be generated again
+        STALE_DISTANCES,    // the commands can be reused, but their distance bits are stale
+        VALID               // the commands can be reused as is
+    };
+
+    CacheStatus getCacheStatus(CommandCache const& cache, uint32_t commandTypeFlags,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            math::float3 cameraPosition, math::float3 cameraForward) const noexcept;
+
+    // records the state the commands we're about to generate depend on
+    void prepareCache(CommandCache& cache, uint32_t commandTypeFlags,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            math::float3 cameraPosition, math::float3 cameraForward) const noexcept;
+
+    // updates the distance bits of commands recalled from the cache, for the current camera
+    static void updateDistanceBits(FEngine& engine, Command* commands, uint32_t count,
+            FScene::RenderableSoa const& soa,
+            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
+
     static void setupColorCommand(Command& cmdDraw,
-            FMaterialInstance const* mi, bool inverseFrontFaces) noexcept;
+            FMaterialInstance const* mi, bool inverseFrontFaces, bool depthPrepass,
+            bool orderIndependentTransparency) noexcept;
+
+    static bool isInDepthPrepass(FMaterialInstance const* mi) noexcept;
+    static bool isOrderIndependent(FMaterial const* ma) noexcept;
 
+    // estimated number of triangles drawn by a command, for MaterialStatistics
+    static uint64_t estimateTriangleCount(utils::Slice<FRenderPrimitive> const& primitives,
+            PrimitiveInfo const& info, uint32_t instanceCount, uint32_t clusterCount) noexcept;
+
+    using PassStatistics = Renderer::FrameStatistics::Pass;
+
+    // the recorded commands are added to stats
     void recordDriverCommands(FEngine::DriverApi& driver, const Command* first,
-            const Command* last) const noexcept;
+            const Command* last, PassStatistics& stats) const noexcept;
+
+    // records the commands with several jobs, each into its own CommandSubStream of driver
+    void recordDriverCommandsParallel(FEngine::DriverApi& driver, const Command* first,
+            const Command* last, PassStatistics& stats) const noexcept;
+
+    void recordDriverCommandsRange(FEngine::DriverApi& driver, const Command* first,
+            const Command* last, PassStatistics& stats) const noexcept;
 
     static void updateSummedPrimitiveCounts(
             FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
@@ -339,12 +546,29 @@ private:
     utils::Range<uint32_t> mVisibleRenderables{};
     // the UBO containing the data for the renderables
     backend::Handle<backend::HwUniformBuffer> mUboHandle;
+    // the visible clusters of the renderables, or null
+    ClusterDraws const* mClusterDraws = nullptr;
 
     // info about the camera
     CameraInfo mCamera;
     // info about the scene features (e.g.: has shadows, lighting, etc...)
     RenderFlags mFlags{};
     FScene::VisibleMaskType mVisibilityMask = std::numeric_limits<FScene::VisibleMaskType>::max();
+    // algorithm used by sortCommands()
+    SortStrategy mSortStrategy = SortStrategy::STD_SORT;
+    // times the material variants, see setMaterialTimer()
+    FrameInfoManager* mMaterialTimer = nullptr;
+    // counts the recorded commands, see setStatistics()
+    ViewStatistics* mStatistics = nullptr;
+    // cache to update with the commands once they're sorted
+    CommandCache* mCommandCache = nullptr;
+    // true if the commands are already sorted (they came from the cache as is)
+    bool mCommandsSorted = false;
+    // commands allocated by appendCommandsDeferred() and not generated yet
+    struct {
+        Command* first = nullptr;
+        CommandTypeFlags commandTypeFlags{};
+    } mDeferredCommands;
     // whether to override the polygon offset setting
     bool mPolygonOffsetOverride = false;
     // value of the override
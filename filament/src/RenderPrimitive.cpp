@@ -45,15 +45,55 @@ void FRenderPrimitive::init(backend::DriverApi& driver,
         driver.setRenderPrimitiveRange(mHandle, entry.type,
                 (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
                 (uint32_t)entry.count);
+        setDepthPrimitive(driver, vertexBuffer, indexBuffer);
+        setDepthPrimitiveRange(driver, entry.type, entry.offset, entry.minIndex, entry.maxIndex,
+                entry.count);
 
         mPrimitiveType = entry.type;
+        mIndexCount = (uint32_t)entry.count;
         mEnabledAttributes = enabledAttributes;
+        setClusters(entry.clusters, entry.clusterCount);
     }
 }
 
+void FRenderPrimitive::setClusters(Cluster const* clusters, size_t count) {
+    mClusters.assign(clusters, clusters + count);
+}
+
 void FRenderPrimitive::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderPrimitive(mHandle);
+    if (mDepthHandle) {
+        driver.destroyRenderPrimitive(mDepthHandle);
+    }
+}
+
+void FRenderPrimitive::setDepthPrimitive(backend::DriverApi& driver,
+        FVertexBuffer const* vertices, FIndexBuffer const* indices) noexcept {
+    // Depth passes draw a primitive of their own, which only enables the depth attributes, when
+    // they're stored apart from the other attributes.
+    const AttributeBitset depthAttributes = vertices->getDepthAttributes();
+    if (depthAttributes.none()) {
+        if (mDepthHandle) {
+            driver.destroyRenderPrimitive(mDepthHandle);
+            mDepthHandle.clear();
+        }
+        return;
+    }
+    if (!mDepthHandle) {
+        mDepthHandle = driver.createRenderPrimitive();
+    }
+    driver.setRenderPrimitiveBuffer(mDepthHandle, vertices->getHwHandle(),
+            indices->getHwHandle(), (uint32_t)depthAttributes.getValue());
+}
+
+void FRenderPrimitive::setDepthPrimitiveRange(backend::DriverApi& driver,
+        RenderableManager::PrimitiveType type, size_t offset,
+        size_t minIndex, size_t maxIndex, size_t count) noexcept {
+    if (mDepthHandle) {
+        driver.setRenderPrimitiveRange(mDepthHandle, type,
+                (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    }
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
@@ -68,9 +108,13 @@ void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType typ
     driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
     driver.setRenderPrimitiveRange(mHandle, type,
             (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    setDepthPrimitive(driver, vertices, indices);
+    setDepthPrimitiveRange(driver, type, offset, minIndex, maxIndex, count);
 
     mPrimitiveType = type;
+    mIndexCount = (uint32_t)count;
     mEnabledAttributes = enabledAttributes;
+    mClusters.clear();
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type, size_t offset,
@@ -78,7 +122,10 @@ void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType typ
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.setRenderPrimitiveRange(mHandle, type,
             (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    setDepthPrimitiveRange(driver, type, offset, minIndex, maxIndex, count);
     mPrimitiveType = type;
+    mIndexCount = (uint32_t)count;
+    mClusters.clear();
 }
 
 } // namespace filament
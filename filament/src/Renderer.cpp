@@ -40,6 +40,9 @@
 #include <utils/Systrace.h>
 #include <utils/vector.h>
 
+#include <cmath>
+#include <limits>
+
 #include <assert.h>
 
 // this helps visualize what dynamic-scaling is doing
@@ -54,7 +57,7 @@ using namespace backend;
 
 FRenderer::FRenderer(FEngine& engine) :
         mEngine(engine),
-        mFrameSkipper(engine, 1u),
+        mFrameSkipper(engine, engine.getConfig().maxFramesInFlight - 1u),
         mFrameInfoManager(engine),
         mIsRGB8Supported(false),
         mPerRenderPassArena(engine.getPerRenderPassAllocator())
@@ -64,6 +67,8 @@ FRenderer::FRenderer(FEngine& engine) :
 
     debugRegistry.registerProperty("d.renderer.doFrameCapture",
             &engine.debug.renderer.doFrameCapture);
+    debugRegistry.registerProperty("d.renderer.radix_sort",
+            &engine.debug.renderer.radix_sort);
 }
 
 void FRenderer::init() noexcept {
@@ -119,6 +124,10 @@ void FRenderer::terminate(FEngine& engine) {
     // shut down threads if we created any.
     DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderTarget(mRenderTarget);
+    if (mStandaloneSwapChain) {
+        engine.destroy(mStandaloneSwapChain);
+        mStandaloneSwapChain = nullptr;
+    }
 
     // before we can destroy this Renderer's resources, we must make sure
     // that all pending commands have been executed (as they could reference data in this
@@ -137,6 +146,27 @@ void FRenderer::resetUserTime() {
     mUserEpoch = std::chrono::steady_clock::now();
 }
 
+void FRenderer::setPresentationTime(int64_t monotonic_clock_ns) {
+    // this overrides the presentation time picked by frame pacing in beginFrame()
+    mEngine.getDriverApi().setPresentationTime(monotonic_clock_ns);
+}
+
+Renderer::FrameTimings FRenderer::getFrameTimings() const noexcept {
+    FrameTimingInfo const& info = mFrameInfoManager.getFrameTimings();
+    return {
+            .frameId = info.frameId,
+            .gpuTime = info.gpuTime.count(),
+            .cullingTime = info.cpu.culling.count(),
+            .commandGenerationTime = info.cpu.commandGeneration.count(),
+            .commandSortingTime = info.cpu.commandSorting.count(),
+            .passes = info.passes.data(),
+            .passCount = info.passes.size(),
+            .untimedPassCount = info.untimedPassCount,
+            .phases = info.hasCounters ? info.counters.phases : nullptr,
+            .phaseCount = info.hasCounters ? size_t(FramePerformanceCounters::PHASE_COUNT) : 0
+    };
+}
+
 TextureFormat FRenderer::getHdrFormat(const View& view, bool translucent) const noexcept {
     if (translucent) {
         return mHdrTranslucent;
@@ -187,6 +217,97 @@ void FRenderer::render(FView const* view) {
     }
 }
 
+void FRenderer::render(ViewOutput const* outputs, size_t count) {
+    SYSTRACE_CALL();
+
+    assert(mSwapChain);
+
+    // the backend frame must be started before the first commit
+    if (mBeginFrameInternal) {
+        mBeginFrameInternal();
+        mBeginFrameInternal = {};
+    }
+
+    FEngine& engine = getEngine();
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    // There are only a few outputs, finding the first view of each swap chain is cheaper than
+    // sorting them.
+    for (size_t i = 0; i < count; i++) {
+        SwapChain* const swapChain = outputs[i].swapChain;
+        bool first = true;
+        for (size_t j = 0; j < i && first; j++) {
+            first = outputs[j].swapChain != swapChain;
+        }
+        if (!first) {
+            continue;
+        }
+
+        FSwapChain* const fSwapChain = upcast(swapChain);
+        if (fSwapChain != mSwapChain) {
+            mSwapChain->commit(driver);
+            mSwapChain = fSwapChain;
+            fSwapChain->makeCurrent(driver);
+        }
+        for (size_t k = i; k < count; k++) {
+            if (outputs[k].swapChain == swapChain) {
+                render(upcast(outputs[k].view));
+            }
+        }
+    }
+}
+
+void FRenderer::renderStandaloneViews(View const* const* views, size_t count) {
+    SYSTRACE_CALL();
+
+    ASSERT_PRECONDITION(!mSwapChain,
+            "renderStandaloneViews() must be called outside of beginFrame() / endFrame()");
+
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_PRECONDITION(views[i] && upcast(views[i])->getRenderTargetHandle(),
+                "views rendered by renderStandaloneViews() must have a RenderTarget");
+    }
+
+    FEngine& engine = getEngine();
+
+    // The backends need a current swap chain to record render passes into, the batch uses a tiny
+    // headless one that is never presented.
+    if (UTILS_UNLIKELY(!mStandaloneSwapChain)) {
+        mStandaloneSwapChain = engine.createSwapChain(1, 1, 0);
+    }
+
+    // The batch is never skipped, if the GPU is behind, the commands just queue up.
+    beginFrame(mStandaloneSwapChain, 0, nullptr, nullptr);
+    if (mBeginFrameInternal) {
+        mBeginFrameInternal();
+        mBeginFrameInternal = {};
+    }
+
+    { // scope for the root arena
+        ArenaScope rootArena(mPerRenderPassArena);
+
+        JobSystem& js = engine.getJobSystem();
+        auto *rootJob = js.setRootJob(js.createJob());
+
+        for (size_t i = 0; i < count; i++) {
+            FView& view = const_cast<FView&>(*upcast(views[i]));
+            if (UTILS_LIKELY(view.getScene())) {
+                // each view rewinds the arena to where it started, so that the memory used
+                // by the batch doesn't grow with the number of views
+                ArenaScope arena(rootArena.getAllocator());
+                renderJob(arena, view);
+
+                // the command buffer must be flushed regularly, it can't hold the whole batch
+                engine.flush();
+            }
+        }
+
+        js.runAndWait(rootJob);
+    }
+
+    endFrame();
+}
+
 void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     FEngine& engine = getEngine();
     JobSystem& js = engine.getJobSystem();
@@ -203,6 +324,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     bool fxaa = view.getAntiAliasing() == View::AntiAliasing::FXAA;
     uint8_t msaa = view.getSampleCount();
     float2 scale = view.updateScale(mFrameInfoManager.getLastFrameInfo());
+    const bool depthPrepass = view.updateDepthPrepass(mFrameInfoManager.getLastFrameInfo());
     const View::QualityLevel upscalingQuality = view.getDynamicResolutionOptions().quality;
     auto bloomOptions = view.getBloomOptions();
     auto dofOptions = view.getDepthOfFieldOptions();
@@ -222,17 +344,40 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
         scale = 1.0f;
     }
 
-    const bool scaled = any(notEqual(scale, float2(1.0f)));
+    // the accumulation buffers can't be multi-sampled, transparent objects are sorted with MSAA
+    const bool orderIndependentTransparency =
+            view.isOrderIndependentTransparencyEnabled() && msaa <= 1;
+
+    bool scaled = any(notEqual(scale, float2(1.0f)));
     filament::Viewport svp = vp.scale(scale);
     if (svp.empty()) {
         return;
     }
 
-    view.prepare(engine, driver, arena, svp, getShaderUserTime());
+    ViewStatistics& stats = mFrameStatistics.beginView();
+    const uint64_t engineUniformBufferBytes = engine.getUniformBufferBytes();
+    const uint64_t viewUniformBufferBytes = view.getUniformBufferBytes();
+
+    FrameCpuTimings& cpuTimings = mFrameInfoManager.getCpuTimings();
+    FramePerformanceCounters* const counters = mFrameInfoManager.getPerformanceCounters();
+    auto cpuStart = std::chrono::steady_clock::now();
+    view.prepare(engine, driver, arena, svp, getShaderUserTime(), counters);
+    cpuTimings.culling += std::chrono::steady_clock::now() - cpuStart;
+
+    FView::CullingStatistics const& culling = view.getCullingStatistics();
+    stats.view.name = view.getName();
+    stats.view.renderableCount = culling.renderableCount;
+    stats.view.visibleRenderableCount = culling.visibleCount;
+    stats.view.layerCulledCount = culling.layerCulledCount;
+    stats.view.frustumCulledCount = culling.frustumCulledCount;
+    stats.view.occlusionCulledCount = culling.occlusionCulledCount;
 
     // start froxelization immediately, it has no dependencies
     JobSystem::Job* jobFroxelize = js.runAndRetain(js.createJob(nullptr,
-            [&engine, &view](JobSystem&, JobSystem::Job*) { view.froxelize(engine); }));
+            [&engine, &view, counters](JobSystem&, JobSystem::Job*) {
+                PerformanceCountersScope scope(counters, FramePerformanceCounters::FROXELIZATION);
+                view.froxelize(engine);
+            }));
 
     /*
      * Allocate command buffer
@@ -254,6 +399,10 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     if (view.isFrontFaceWindingInverted()) renderFlags |= RenderPass::HAS_INVERSE_FRONT_FACES;
     if (view.hasVsm())                     renderFlags |= RenderPass::HAS_VSM;
     pass.setRenderFlags(renderFlags);
+    if (UTILS_UNLIKELY(engine.getMaterialStatistics().isEnabled())) {
+        pass.setMaterialTimer(&mFrameInfoManager);
+    }
+    pass.setStatistics(&stats);
 
     /*
      * Frame graph
@@ -261,12 +410,24 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     FrameGraph fg(engine.getResourceAllocator());
 
+    /*
+     * IBL prefilter, the requests made since the last frame are executed by the first view
+     */
+
+    for (auto const& request : engine.takeIblPrefilterRequests()) {
+        ppm.prefilterIndirectLight(fg, request);
+    }
+
     /*
      * Shadow pass
      */
 
     if (view.needsShadowMap()) {
+        // this is mostly generating and sorting the commands of the shadow passes
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_GENERATION);
+        cpuStart = std::chrono::steady_clock::now();
         view.renderShadowMaps(fg, engine, driver, pass);
+        cpuTimings.commandGeneration += std::chrono::steady_clock::now() - cpuStart;
     }
 
     const TargetBufferFlags discardedFlags = mDiscardedFlags;
@@ -321,6 +482,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
             .asSubpass =
                     colorGrading &&
                     msaa <= 1 && !bloomOptions.enabled && !dofOptions.enabled && !taaOptions.enabled &&
+                    !orderIndependentTransparency &&
                     driver.isFrameBufferFetchSupported(),
             .translucent = needsAlphaChannel,
             .fxaa = fxaa,
@@ -336,12 +498,22 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     pass.setCamera(cameraInfo);
     pass.setGeometry(scene.getRenderableData(), view.getVisibleRenderables(), scene.getRenderableUBO());
-    view.updatePrimitivesLod(engine, cameraInfo, scene.getRenderableData(), view.getVisibleRenderables());
-
-    fg.addTrivialSideEffectPass("Prepare View Uniforms", [svp, &view] (DriverApi& driver) {
+    view.updatePrimitivesLod(engine, cameraInfo, scene.getRenderableData(),
+            view.getVisibleRenderables(), true);
+    view.requestStreamingLevels(engine, cameraInfo, scene.getRenderableData(),
+            view.getVisibleRenderables(), view.getViewport().height);
+    pass.setClusterDraws(view.prepareClusters(engine, driver, scene.getRenderableData(),
+            view.getVisibleRenderables()));
+
+    // with TAA upscaling, textures are sampled as if we were rendering at the output resolution
+    const bool taaUpscaling = taaOptions.enabled && taaOptions.upscaling && scaled;
+    const float lodBias = taaUpscaling ? 0.5f * std::log2(scale.x * scale.y) : 0.0f;
+
+    fg.addTrivialSideEffectPass("Prepare View Uniforms", [svp, lodBias, &view] (DriverApi& driver) {
         CameraInfo cameraInfo = view.getCameraInfo();
         view.prepareCamera(cameraInfo);
         view.prepareViewport(svp);
+        view.prepareLodBias(lodBias);
         view.commitUniforms(driver);
     });
 
@@ -352,16 +524,50 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     // TODO: this should be a FrameGraph pass to participate to automatic culling
     pass.newCommandBuffer();
-    pass.appendCommands(RenderPass::CommandTypeFlags::SSAO);
-    pass.sortCommands();
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_GENERATION);
+        cpuStart = std::chrono::steady_clock::now();
+        pass.appendCommands(RenderPass::CommandTypeFlags::SSAO, view.getStructureCommandCache());
+        cpuTimings.commandGeneration += std::chrono::steady_clock::now() - cpuStart;
+    }
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_SORTING);
+        cpuStart = std::chrono::steady_clock::now();
+        pass.sortCommands();
+        cpuTimings.commandSorting += std::chrono::steady_clock::now() - cpuStart;
+    }
 
     // TODO: the scaling should depends on all passes that need the structure pass
-    ppm.structure(fg, pass, svp.width, svp.height, aoOptions.resolution);
+    auto structure = ppm.structure(fg, pass, svp.width, svp.height, aoOptions.resolution);
+
+    if (view.isOcclusionCullingEnabled()) {
+        // the structure buffer is read back for occlusion culling of the next frames
+        view.readOcclusionDepth(fg, structure, cameraInfo);
+    }
+
+    if (view.isSampleDistributionShadowsEnabled() && view.hasShadowing() &&
+            view.hasDirectionalLight() && ppm.hasComputeDepthRange()) {
+        // the depth range of the structure buffer bounds the shadow cascades of the next frames
+        view.readShadowDepthRange(fg, ppm.depthRange(fg, structure), cameraInfo);
+    }
+
+    if (view.hasPickingQueries()) {
+        // picking pass -- the depth commands of this pass also output the object id
+        pass.newCommandBuffer();
+        pass.appendCommands(RenderPass::CommandTypeFlags::PICKING);
+        pass.sortCommands();
+        view.readPickingQueries(fg, pass, svp, scale);
+    }
+
+    // The temporal SSAO uses the same history as TAA, but isn't jittered.
+    const bool temporalAmbientOcclusion = aoOptions.enabled && aoOptions.temporalFiltering;
+    if (taaOptions.enabled || temporalAmbientOcclusion) {
+        ppm.prepareTaa(view.getFrameHistory(), cameraInfo, taaOptions);
+    }
 
     // Apply the TAA jitter to everything after the structure pass, starting with the color pass.
     if (taaOptions.enabled) {
         auto& history = view.getFrameHistory();
-        ppm.prepareTaa(history, cameraInfo, taaOptions);
         // convert the sample position to jitter in clip-space
         float2 jitterInClipSpace =
                 history.getCurrent().jitter * (2.0f / float2{ svp.width, svp.height });
@@ -379,7 +585,8 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     if (aoOptions.enabled) {
         // we could rely on FrameGraph culling, but this creates unnecessary CPU work
-        ppm.screenSpaceAmbientOcclusion(fg, pass, svp, cameraInfo, aoOptions);
+        ppm.screenSpaceAmbientOcclusion(fg, pass, svp, cameraInfo, view.getFrameHistory(),
+                aoOptions);
     }
 
     // --------------------------------------------------------------------------------------------
@@ -387,8 +594,34 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     // TODO: ideally this should be a FrameGraph pass to participate to automatic culling
     pass.newCommandBuffer();
-    pass.appendCommands(RenderPass::COLOR);
-    pass.sortCommands();
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_GENERATION);
+        cpuStart = std::chrono::steady_clock::now();
+        uint8_t colorCommandTypeFlags = RenderPass::COLOR;
+        if (depthPrepass) {
+            colorCommandTypeFlags |= RenderPass::WITH_DEPTH_PREPASS;
+        }
+        if (orderIndependentTransparency) {
+            colorCommandTypeFlags |= RenderPass::WITH_ORDER_INDEPENDENT_TRANSPARENCY;
+        }
+        if (depthPrepass) {
+            // The depth prepass is part of the color pass, its commands sort first. Commands
+            // can't be retained when they're appended to others.
+            pass.appendCommands(RenderPass::CommandTypeFlags(colorCommandTypeFlags), nullptr);
+            pass.appendCommands(RenderPass::DEPTH_PREPASS, nullptr);
+        } else {
+            pass.appendCommands(RenderPass::CommandTypeFlags(colorCommandTypeFlags),
+                    view.getColorCommandCache());
+        }
+        cpuTimings.commandGeneration += std::chrono::steady_clock::now() - cpuStart;
+    }
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_SORTING);
+        cpuStart = std::chrono::steady_clock::now();
+        pass.sortCommands();
+        cpuTimings.commandSorting += std::chrono::steady_clock::now() - cpuStart;
+    }
+    stats.view.commandCount = uint32_t(pass.end() - pass.begin());
 
     FrameGraphTexture::Descriptor desc = {
             .width = config.svp.width,
@@ -401,7 +634,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
 
     // a non-drawing pass to prepare everything that need to be before the color passes execute
     fg.addTrivialSideEffectPass("Prepare Color Passes",
-            [=, &js, &view, &ppm](DriverApi& driver) {
+            [=, &js, &view, &ppm, &stats](DriverApi& driver) {
                 // prepare color grading as subpass material
                 if (colorGradingConfig.asSubpass) {
                     ppm.colorGradingPrepareSubpass(driver,
@@ -419,6 +652,10 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
                     js.waitAndRelease(sync);
                     view.commitFroxels(driver);
                 }
+                Froxelizer::Statistics const& froxels = view.getFroxelStatistics();
+                stats.view.maxFroxelLightCount = froxels.maxLightCount;
+                stats.view.averageFroxelLightCount = froxels.averageLightCount;
+                stats.view.emptyFroxelRatio = froxels.emptyFroxelRatio;
             }
     );
 
@@ -426,14 +663,34 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     auto colorGradingConfigForColor = colorGradingConfig;
     colorGradingConfigForColor.asSubpass = colorGradingConfigForColor.asSubpass && !taaOptions.enabled;
 
+    // the order-independent transparent objects are rendered last, in their own pass
+    Command const* const orderIndependent = std::partition_point(pass.begin(), pass.end(),
+            [](auto const& command) {
+                return (command.key & RenderPass::PASS_MASK) < uint64_t(RenderPass::Pass::OIT);
+            });
+    RenderPass colorCommands(pass);
+    colorCommands.getCommands().set(
+            const_cast<Command*>(pass.begin()),
+            const_cast<Command*>(orderIndependent));
+
     // the color pass itself + color-grading as subpass if needed
     FrameGraphId<FrameGraphTexture> colorPassOutput = colorPass(fg, "Color Pass",
-            desc, config, colorGradingConfigForColor, pass, view);
+            desc, config, colorGradingConfigForColor, colorCommands, view);
 
     // the color pass + refraction + color-grading as subpass if needed
     // this cancels the colorPass() call above if refraction is active.
     if (view.isScreenSpaceRefractionEnabled()) {
-        colorPassOutput = refractionPass(fg, config, colorGradingConfigForColor, pass, view);
+        colorPassOutput = refractionPass(fg, config, colorGradingConfigForColor, colorCommands,
+                view);
+    }
+
+    if (orderIndependent != pass.end()) {
+        RenderPass orderIndependentCommands(pass);
+        orderIndependentCommands.getCommands().set(
+                const_cast<Command*>(orderIndependent),
+                const_cast<Command*>(pass.end()));
+        colorPassOutput = orderIndependentTransparencyPass(fg, config,
+                orderIndependentCommands, view);
     }
 
     FrameGraphId<FrameGraphTexture> input = colorPassOutput;
@@ -455,31 +712,55 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     //       dedicated TAA pass for the DoF, as explained in
     //       "Life of a Bokeh" by Guillaume Abadie, SIGGRAPH 2018
 
+    // from here on, the GPU time is accounted for post-processing by dynamic resolution
+    if (hasPostProcess) {
+        fg.addTrivialSideEffectPass("Begin Post-processing", [this](DriverApi&) {
+            mFrameInfoManager.beginSegment(FrameInfoManager::Category::POST_PROCESSING);
+        });
+    }
+
     // TAA for color pass
     if (taaOptions.enabled) {
-        input = ppm.taa(fg, input, view.getFrameHistory(), taaOptions, colorGradingConfig);
+        if (taaUpscaling) {
+            // TAA reconstructs the full resolution, post-processing is done at this resolution
+            input = ppm.taa(fg, input, view.getFrameHistory(), vp.width, vp.height,
+                    taaOptions, colorGradingConfig);
+            scale = 1.0f;
+            scaled = false;
+        } else {
+            input = ppm.taa(fg, input, view.getFrameHistory(), svp.width, svp.height,
+                    taaOptions, colorGradingConfig);
+        }
     }
 
     // --------------------------------------------------------------------------------------------
     // Post Processing...
 
+    // When the view is blended into the swapchain, the last post-processing pass blends its
+    // output itself when it can, instead of going through an extra full-screen pass.
+    bool outputIsBlended = false;
     if (hasPostProcess) {
         if (dofOptions.enabled) {
-            input = ppm.dof(fg, input, dofOptions, needsAlphaChannel, cameraInfo);
+            input = ppm.dof(fg, input, dofOptions, needsAlphaChannel, cameraInfo,
+                    view.getDofTiles());
         }
         if (colorGrading) {
             if (!colorGradingConfig.asSubpass) {
+                outputIsBlended = blending && !fxaa && !scaled;
                 input = ppm.colorGrading(fg, input,
                         view.getColorGrading(),
                         colorGradingConfig.ldrFormat,
                         colorGradingConfig.translucent,
                         colorGradingConfig.fxaa,
                         scale, bloomOptions, vignetteOptions,
-                        colorGradingConfig.dithering);
+                        colorGradingConfig.dithering,
+                        outputIsBlended);
             }
         }
         if (fxaa) {
-            input = ppm.fxaa(fg, input, colorGradingConfig.ldrFormat, !colorGrading || needsAlphaChannel);
+            outputIsBlended = blending && !scaled;
+            input = ppm.fxaa(fg, input, colorGradingConfig.ldrFormat,
+                    !colorGrading || needsAlphaChannel, outputIsBlended);
         }
         if (scaled) {
             if (UTILS_LIKELY(!blending && upscalingQuality == View::QualityLevel::LOW)) {
@@ -487,6 +768,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
             } else {
                 input = ppm.blendBlit(fg, true, upscalingQuality, input,
                         { .format = colorGradingConfig.ldrFormat });
+                outputIsBlended = true;
             }
         }
     }
@@ -505,7 +787,7 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     const bool outputIsInput = fg.equal(input, colorPassOutput);
     if ((outputIsInput && viewRenderTarget == mRenderTarget &&
                     (msaa > 1 || colorGradingConfig.asSubpass)) ||
-        (!outputIsInput && blending)) {
+        (!outputIsInput && blending && !outputIsBlended)) {
         if (UTILS_LIKELY(!blending && upscalingQuality == View::QualityLevel::LOW)) {
             input = ppm.opaqueBlit(fg, input, { .format = colorGradingConfig.ldrFormat });
         } else {
@@ -517,9 +799,23 @@ void FRenderer::renderJob(ArenaScope& arena, FView& view) {
     auto output = input;
     fg.present(output);
     fg.moveResource(fgViewRenderTarget, output);
-    fg.compile();
+    fg.compile(view.getFrameGraphCompileCache());
     //fg.export_graphviz(slog.d, view.getName());
-    fg.execute(engine, driver);
+    stats.view.culledPassCount = uint32_t(fg.getCulledPassCount());
+    stats.view.executedPassCount = uint32_t(fg.getPassCount()) - stats.view.culledPassCount;
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::COMMAND_RECORDING);
+        fg.execute(engine, driver,
+                mFrameInfoManager.isPassTimingsEnabled() ? &mFrameInfoManager : nullptr);
+    }
+
+    mFrameInfoManager.beginSegment(FrameInfoManager::Category::MAIN);
+
+    mFrameStatistics.addViewUniformBufferBytes(
+            view.getUniformBufferBytes() - viewUniformBufferBytes);
+    stats.view.uniformBufferBytes = uint32_t(
+            engine.getUniformBufferBytes() - engineUniformBufferBytes +
+            view.getUniformBufferBytes() - viewUniformBufferBytes);
 
     // save the current history entry and destroy the oldest entry
     view.commitFrameHistory(engine);
@@ -531,7 +827,7 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
         ColorPassConfig config,
         PostProcessManager::ColorGradingConfig colorGradingConfig,
         RenderPass const& pass,
-        FView const& view) const noexcept {
+        FView& view) const noexcept {
 
     auto& blackboard = fg.getBlackboard();
     auto input = blackboard.get<FrameGraphTexture>("color");
@@ -553,11 +849,6 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
         blackboard.remove("color");
         blackboard.remove("depth");
 
-        RenderPass opaquePass(pass);
-        opaquePass.getCommands().set(
-                const_cast<Command*>(pass.begin()),
-                const_cast<Command*>(refraction));
-
         FrameGraphTexture::Descriptor desc = {
                 .width = config.svp.width,
                 .height = config.svp.height,
@@ -571,9 +862,6 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
             desc.usage |= backend::TextureUsage::SUBPASS_INPUT;
         }
 
-        input = colorPass(fg, "Color Pass (opaque)", desc, config,
-                { .asSubpass = false }, opaquePass, view);
-
         // vvv the actual refraction pass starts below vvv
 
         // scale factor for the gaussian so it matches our resolution / FOV
@@ -607,10 +895,7 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
         const uint8_t roughnessLodCount =
                 std::min(maxLod, FTexture::maxLevelCount(desc.width, desc.height));
 
-        // First we need to resolve the MSAA buffer if enabled
-        input = ppm.resolve(fg, "Resolved Color Buffer", input);
-
-        // Then copy the color buffer into a texture, and make sure to scale it back properly.
+        // The capture is scaled back to the viewport's aspect ratio.
         uint32_t w = config.svp.width;
         uint32_t h = config.svp.height;
         if (config.scale.x < config.scale.y) {
@@ -621,16 +906,105 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
             h = config.vp.height * config.scale.x;
         }
 
+        // Only the region around the refractive objects is captured and filtered, the margin
+        // accounts for the refracted rays leaving their screen-space bounds.
+        Command const* const refractionEnd = std::partition_point(refraction, pass.end(),
+                [](auto const& command) {
+                    return (command.key & RenderPass::PASS_MASK) <=
+                            uint64_t(RenderPass::Pass::REFRACT);
+                });
+        CameraInfo const& camera = view.getCameraInfo();
+        FScene::RenderableSoa const& renderableData = view.getScene()->getRenderableData();
+        const float4 bounds = getScreenBounds(refraction, refractionEnd, renderableData,
+                camera.projection * camera.view);
+        float4 region{ 0, 0, 1, 1 };
+        const float4 grownBounds = clamp(float4{
+                bounds.xy - REFRACTION_MARGIN, bounds.zw + REFRACTION_MARGIN }, 0.0f, 1.0f);
+        const float2 grownSize = grownBounds.zw - grownBounds.xy;
+        if (grownSize.x * grownSize.y < REFRACTION_MAX_REGION_AREA) {
+            region = grownBounds;
+        }
+
+        // The capture of a previous frame is reused while the camera barely moves, the bounds
+        // of the refractive objects are compared in both frames' clip spaces.
+        FrameHistory& frameHistory = view.getFrameHistory();
+        FrameHistoryEntry& previous = frameHistory[0];
+        FrameHistoryEntry& current = frameHistory.getCurrent();
+        const mat4f worldToClip = camera.projection * camera.view * camera.worldOrigin;
+        bool reuse = false;
+        if (view.isScreenSpaceRefractionReuseEnabled() && previous.refraction.texture &&
+                previous.refractionDesc.width == w && previous.refractionDesc.height == h &&
+                previous.refractionDesc.levels == roughnessLodCount &&
+                previous.refractionAge < REFRACTION_REUSE_MAX_AGE &&
+                all(lessThanEqual(previous.refractionRegion.xy, region.xy)) &&
+                all(greaterThanEqual(previous.refractionRegion.zw, region.zw))) {
+            const float4 previousBounds = getScreenBounds(refraction, refractionEnd,
+                    renderableData, previous.refractionWorldToClip * inverse(camera.worldOrigin));
+            const float2 size{ config.svp.width, config.svp.height };
+            const float4 displacement = abs(bounds - previousBounds) * float4{ size, size };
+            reuse = max(displacement) <= REFRACTION_REUSE_MAX_DISPLACEMENT;
+        }
+
+        if (reuse) {
+            // the capture is handed over to this frame's history, and all the commands are
+            // rendered in a single pass
+            current.refraction = previous.refraction;
+            current.refractionDesc = previous.refractionDesc;
+            current.refractionRegion = previous.refractionRegion;
+            current.refractionWorldToClip = previous.refractionWorldToClip;
+            current.refractionAge = previous.refractionAge + 1;
+            previous.refraction = {};
+            blackboard["ssr"] = fg.import("Refraction history",
+                    current.refractionDesc, current.refraction);
+            config.refractionLodOffset = refractionLodOffset;
+            return colorPass(fg, "Color Pass", desc, config, colorGradingConfig, pass, view);
+        }
+
+        RenderPass opaquePass(pass);
+        opaquePass.getCommands().set(
+                const_cast<Command*>(pass.begin()),
+                const_cast<Command*>(refraction));
+
+        input = colorPass(fg, "Color Pass (opaque)", desc, config,
+                { .asSubpass = false }, opaquePass, view);
+
+        // First we need to resolve the MSAA buffer if enabled
+        input = ppm.resolve(fg, "Resolved Color Buffer", input);
+
+        // Then copy the color buffer into a texture. Level 0 is needed a bit beyond the region,
+        // the mipmaps are filtered from it.
         input = ppm.opaqueBlit(fg, input, {
                 .width = w,
                 .height = h,
                 .levels = roughnessLodCount,
                 .format = TextureFormat::R11F_G11F_B10F,
-        });
+        }, SamplerMagFilter::LINEAR, PostProcessManager::getGaussianMipmapRegion(region,
+                w, h, 0, roughnessLodCount, kernelSize));
 
-        input = ppm.generateGaussianMipmap(fg, input, roughnessLodCount, true, kernelSize);
+        input = ppm.generateGaussianMipmap(fg, input, roughnessLodCount, true, kernelSize,
+                6.0f, region);
         blackboard["ssr"] = input;
 
+        if (view.isScreenSpaceRefractionReuseEnabled()) {
+            // keep the capture in the frame history, for the next frames
+            struct RefractionHistoryData {
+                FrameGraphId<FrameGraphTexture> capture;
+            };
+            fg.addPass<RefractionHistoryData>("Refraction History",
+                    [&](FrameGraph::Builder& builder, auto& data) {
+                        data.capture = builder.read(input);
+                        builder.sideEffect();
+                    },
+                    [&current](FrameGraphPassResources const& resources,
+                            auto const& data, DriverApi&) {
+                        resources.detach(data.capture,
+                                &current.refraction, &current.refractionDesc);
+                    });
+            current.refractionRegion = region;
+            current.refractionWorldToClip = worldToClip;
+            current.refractionAge = 0;
+        }
+
         // ^^^ the actual refraction pass ends above ^^^
 
         // set-up the refraction pass
@@ -657,6 +1031,126 @@ FrameGraphId<FrameGraphTexture> FRenderer::refractionPass(FrameGraph& fg,
     return output;
 }
 
+float4 FRenderer::getScreenBounds(Command const* first, Command const* last,
+        FScene::RenderableSoa const& renderableData, mat4f const& sceneToClip) noexcept {
+    float3 const* const centers = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* const extents = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    float2 lo{ std::numeric_limits<float>::max() };
+    float2 hi{ std::numeric_limits<float>::lowest() };
+    uint32_t index = std::numeric_limits<uint32_t>::max();
+    for (Command const* c = first; c != last; ++c) {
+        // skip the custom commands, and the other primitives of the same renderable
+        if ((c->key & RenderPass::CUSTOM_MASK) != uint64_t(RenderPass::CustomCommand::PASS) ||
+                c->primitive.index == index) {
+            continue;
+        }
+        index = c->primitive.index;
+        for (size_t i = 0; i < 8; i++) {
+            const float3 corner = centers[index] + extents[index] * float3{
+                    (i & 1u) ? 1.0f : -1.0f, (i & 2u) ? 1.0f : -1.0f, (i & 4u) ? 1.0f : -1.0f };
+            const float4 p = sceneToClip * float4{ corner, 1.0f };
+            if (p.w <= 0.0f) {
+                return { 0, 0, 1, 1 };
+            }
+            const float2 uv = p.xy / p.w * 0.5f + 0.5f;
+            lo = min(lo, uv);
+            hi = max(hi, uv);
+        }
+    }
+    return clamp(float4{ lo, hi }, 0.0f, 1.0f);
+}
+
+FrameGraphId<FrameGraphTexture> FRenderer::orderIndependentTransparencyPass(FrameGraph& fg,
+        ColorPassConfig const& config, RenderPass const& pass,
+        FView const& view) const noexcept {
+
+    struct OitPassData {
+        FrameGraphId<FrameGraphTexture> shadows;
+        FrameGraphId<FrameGraphTexture> ssao;
+        FrameGraphId<FrameGraphTexture> structure;
+        FrameGraphId<FrameGraphTexture> accumulation;
+        FrameGraphId<FrameGraphTexture> weights;
+        FrameGraphId<FrameGraphTexture> depth;
+        FrameGraphRenderTargetHandle rt{};
+    };
+
+    auto& oitPass = fg.addPass<OitPassData>("Order-Independent Transparency Pass",
+            [&](FrameGraph::Builder& builder, OitPassData& data) {
+                Blackboard& blackboard = fg.getBlackboard();
+                data.shadows = blackboard.get<FrameGraphTexture>("shadows");
+                data.ssao = blackboard.get<FrameGraphTexture>("ssao");
+                data.structure = blackboard.get<FrameGraphTexture>("structure");
+                data.depth = blackboard.get<FrameGraphTexture>("depth");
+
+                if (config.hasContactShadows) {
+                    assert(data.structure.isValid());
+                    data.structure = builder.sample(data.structure);
+                }
+                if (data.shadows.isValid()) {
+                    data.shadows = builder.sample(data.shadows);
+                }
+                if (data.ssao.isValid()) {
+                    data.ssao = builder.sample(data.ssao);
+                }
+
+                // the transparent objects are tested against the depth of the color pass
+                data.depth = builder.write(builder.read(data.depth));
+
+                data.accumulation = builder.createTexture("OIT Accumulation Buffer", {
+                        .width = config.svp.width,
+                        .height = config.svp.height,
+                        .format = TextureFormat::RGBA16F
+                });
+                data.weights = builder.createTexture("OIT Weights Buffer", {
+                        .width = config.svp.width,
+                        .height = config.svp.height,
+                        .format = TextureFormat::R16F
+                });
+                data.accumulation = builder.write(data.accumulation);
+                data.weights = builder.write(data.weights);
+
+                // the revealage, in the alpha channel, starts at 1
+                data.rt = builder.createRenderTarget("OIT Target", {
+                        .attachments = {{ data.accumulation, data.weights, {}, {} }, data.depth, {}},
+                        .clearColor = { 0.0f, 0.0f, 0.0f, 1.0f },
+                        .clearFlags = TargetBufferFlags::COLOR0 | TargetBufferFlags::COLOR1 });
+            },
+            [=, &view](FrameGraphPassResources const& resources,
+                    OitPassData const& data, DriverApi& driver) {
+                auto out = resources.get(data.rt);
+
+                PostProcessManager& ppm = getEngine().getPostProcessManager();
+                view.prepareSSAO(data.ssao.isValid() ?
+                        resources.getTexture(data.ssao) : ppm.getOneTexture());
+                view.prepareShadow(data.shadows.isValid() ?
+                        resources.getTexture(data.shadows) : ppm.getOneTextureArray());
+                if (data.structure.isValid()) {
+                    view.prepareStructure(resources.getTexture(data.structure));
+                }
+                view.prepareViewport(static_cast<filament::Viewport&>(out.params.viewport));
+                view.prepareOrderIndependentTransparency(true);
+                view.commitUniforms(driver);
+
+                driver.beginRenderPass(out.target, out.params);
+                pass.executeCommands(driver, resources.getPassName());
+                driver.endRenderPass();
+
+                view.prepareOrderIndependentTransparency(false);
+                view.commitUniforms(driver);
+            }
+    );
+
+    auto& blackboard = fg.getBlackboard();
+    blackboard["depth"] = oitPass.getData().depth;
+
+    PostProcessManager& ppm = mEngine.getPostProcessManager();
+    auto output = ppm.orderIndependentTransparencyComposite(fg,
+            oitPass.getData().accumulation, oitPass.getData().weights,
+            blackboard.get<FrameGraphTexture>("color"));
+    blackboard["color"] = output;
+    return output;
+}
+
 FrameGraphId<FrameGraphTexture> FRenderer::colorPass(FrameGraph& fg, const char* name,
         FrameGraphTexture::Descriptor const& colorBufferDesc,
         ColorPassConfig const& config, PostProcessManager::ColorGradingConfig colorGradingConfig,
@@ -789,15 +1283,16 @@ FrameGraphId<FrameGraphTexture> FRenderer::colorPass(FrameGraph& fg, const char*
                 view.commitUniforms(driver);
 
                 out.params.clearColor = data.clearColor;
+                out.params.foveation = view.getFoveationParams();
 
                 if (colorGradingConfig.asSubpass) {
                     out.params.subpassMask = 1;
                     driver.beginRenderPass(out.target, out.params);
-                    pass.executeCommands(resources.getPassName());
+                    pass.executeCommands(driver, resources.getPassName());
                     ppm.colorGradingSubpass(driver, colorGradingConfig.translucent);
                 } else {
                     driver.beginRenderPass(out.target, out.params);
-                    pass.executeCommands(resources.getPassName());
+                    pass.executeCommands(driver, resources.getPassName());
                 }
 
                 driver.endRenderPass();
@@ -871,11 +1366,23 @@ bool FRenderer::beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeN
 
     SYSTRACE_CALL();
 
+    if (mFrameRateOptions.lowLatency) {
+        // wait for the GPU to finish the previous frames, which also makes sure the
+        // FrameSkipper below never skips.
+        SYSTRACE_NAME("waitForGpu");
+        getEngine().flushAndWait();
+    }
+
     // get the timestamp as soon as possible
     using namespace std::chrono;
     const steady_clock::time_point now{ steady_clock::now() };
     const steady_clock::time_point userVsync{ steady_clock::duration(vsyncSteadyClockTimeNano) };
-    const time_point<steady_clock> appVsync(vsyncSteadyClockTimeNano ? userVsync : now);
+    const bool framePacing = mFramePacer.isEnabled();
+    const time_point<steady_clock> appVsync(framePacing ?
+            mFramePacer.getVsync(vsyncSteadyClockTimeNano, now) :
+            (vsyncSteadyClockTimeNano ? userVsync : now));
+    const steady_clock::duration refreshPeriod(framePacing ?
+            mFramePacer.getRefreshPeriod(mDisplayInfo.refreshRate) : steady_clock::duration{});
 
     mFrameId++;
 
@@ -930,47 +1437,26 @@ bool FRenderer::beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeN
 
         driver.beginFrame(appVsync.time_since_epoch().count(), mFrameId, callback, user);
 
+        // when frames are paced, they last the interval picked by the FramePacer
+        const FrameInfo::duration targetFrameTime = refreshPeriod != steady_clock::duration{} ?
+                FrameInfo::duration(refreshPeriod) * float(mFramePacer.getInterval()) :
+                FrameInfo::duration{ float(mFrameRateOptions.interval) / mDisplayInfo.refreshRate };
+
         // This need to occur after the backend beginFrame() because some backends need to start
         // a command buffer before creating a fence.
         mFrameInfoManager.beginFrame({
-                .targetFrameTime = FrameInfo::duration{
-                        float(mFrameRateOptions.interval) / mDisplayInfo.refreshRate
-                },
+                .targetFrameTime = targetFrameTime,
                 .headRoomRatio = mFrameRateOptions.headRoomRatio,
+                .postProcessingRatio = mFrameRateOptions.postProcessingRatio,
                 .oneOverTau = mFrameRateOptions.scaleRate,
                 .historySize = mFrameRateOptions.history
         }, mFrameId);
+        mFrameStatistics.beginFrame(mFrameId, engine.getUniformBufferBytes());
 
-        if (false && vsyncSteadyClockTimeNano) { // work in progress
-            const size_t interval = mFrameRateOptions.interval; // user requested swap-interval;
-            const steady_clock::duration refreshPeriod(uint64_t(1e9 / mDisplayInfo.refreshRate));
-            const steady_clock::duration presentationDeadline(mDisplayInfo.presentationDeadlineNanos);
+        if (refreshPeriod != steady_clock::duration{}) {
             const steady_clock::duration vsyncOffset(mDisplayInfo.vsyncOffsetNanos);
-
-            // hardware vsync timestamp
-            steady_clock::time_point hwVsync = appVsync - vsyncOffset;
-
-            // compute our desired presentation time. We can't pick a desired presentation time
-            // that's too far, or we won't be able to dequeue buffers.
-            steady_clock::time_point desiredPresentationTime = hwVsync + 2 * interval * refreshPeriod;
-
-            // Compute the deadline. This deadline is when the GPU must be finished.
-            // The deadline has 1ms backed in it on Android.
-            UTILS_UNUSED_IN_RELEASE
-            steady_clock::time_point deadline = desiredPresentationTime - presentationDeadline;
-
-            // one important thing is to make sure that the deadline is comfortably later than
-            // when the gpu will finish, otherwise we'll have inconsistent latency/frames.
-
-            // TODO: evaluate if we can make it in time, and if not why.
-            // If the problem is cpu+gpu latency we can try to push the desired presentation time
-            // further away, but this has limits, as only 2 buffers are dequeuable.
-            // If the problem is the gpu is overwhelmed, then we need to
-            //  - see if there is more headroom in dynamic resolution
-            //  - or start skipping frames. Ideally lower the framerate too.
-
-            // presentation time is set to the middle of the period we're interested in
-            steady_clock::time_point presentationTime = desiredPresentationTime - refreshPeriod / 2;
+            const steady_clock::time_point presentationTime =
+                    mFramePacer.getPresentationTime(vsyncOffset);
             driver.setPresentationTime(presentationTime.time_since_epoch().count());
         }
 
@@ -978,11 +1464,21 @@ bool FRenderer::beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeN
         engine.prepare();
     };
 
-    if (mFrameSkipper.beginFrame()) {
-        // if beginFrame() returns true, we are expecting a call to endFrame(),
-        // so do the beginFrame work right now, instead of requiring a call to render()
-        beginFrameInternal();
-        return true;
+    // when frames are paced, only the vsyncs a whole frame interval apart start a frame
+    if (!framePacing ||
+            mFramePacer.beginFrame(appVsync, refreshPeriod, mFrameRateOptions.interval)) {
+        const bool gpuReady = mFrameSkipper.beginFrame();
+        if (framePacing) {
+            // the interval goes up when the GPU can't keep up, and down when it can again
+            mFramePacer.update(mFrameInfoManager.getLastFrameInfo().denoisedFrameTime,
+                    !gpuReady);
+        }
+        if (gpuReady) {
+            // if beginFrame() returns true, we are expecting a call to endFrame(),
+            // so do the beginFrame work right now, instead of requiring a call to render()
+            beginFrameInternal();
+            return true;
+        }
     }
 
     // however, if we return false, the user is allowed to ignore us and render a frame anyways,
@@ -1013,6 +1509,7 @@ void FRenderer::endFrame() {
     }
 
     mFrameInfoManager.endFrame();
+    mFrameStatistics.endFrame(engine.getUniformBufferBytes());
     mFrameSkipper.endFrame();
 
     if (mSwapChain) {
@@ -1044,6 +1541,8 @@ void FRenderer::endFrame() {
 
     // make sure we're done with the gcs
     js.waitAndRelease(job);
+
+    engine.growCommandBufferIfNeeded();
 }
 
 void FRenderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -1111,6 +1610,14 @@ void Renderer::render(View const* view) {
     upcast(this)->render(upcast(view));
 }
 
+void Renderer::renderStandaloneViews(View const* const* views, size_t count) {
+    upcast(this)->renderStandaloneViews(views, count);
+}
+
+void Renderer::render(ViewOutput const* outputs, size_t count) {
+    upcast(this)->render(outputs, count);
+}
+
 bool Renderer::beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano,
         backend::FrameFinishedCallback callback, void* user) {
     return upcast(this)->beginFrame(upcast(swapChain), vsyncSteadyClockTimeNano, callback, user);
@@ -1145,6 +1652,10 @@ void Renderer::resetUserTime() {
     upcast(this)->resetUserTime();
 }
 
+void Renderer::setPresentationTime(int64_t monotonic_clock_ns) {
+    upcast(this)->setPresentationTime(monotonic_clock_ns);
+}
+
 void Renderer::setDisplayInfo(const DisplayInfo& info) noexcept {
     upcast(this)->setDisplayInfo(info);
 }
@@ -1157,4 +1668,20 @@ void Renderer::setClearOptions(const ClearOptions& options) {
     upcast(this)->setClearOptions(options);
 }
 
+void Renderer::setPassTimingsEnabled(bool enabled) noexcept {
+    upcast(this)->setPassTimingsEnabled(enabled);
+}
+
+Renderer::FrameTimings Renderer::getFrameTimings() const noexcept {
+    return upcast(this)->getFrameTimings();
+}
+
+Renderer::FrameStatistics Renderer::getFrameStatistics() const noexcept {
+    return upcast(this)->getFrameStatistics();
+}
+
+void Renderer::setPerformanceCountersEnabled(bool enabled) noexcept {
+    upcast(this)->setPerformanceCountersEnabled(enabled);
+}
+
 } // namespace filament
@@ -22,6 +22,8 @@
 
 #include <utils/Log.h>
 
+#include <algorithm>
+
 using namespace utils;
 
 namespace filament {
@@ -77,8 +79,8 @@ size_t ResourceAllocator::TextureKey::getSize() const noexcept {
     return size;
 }
 
-ResourceAllocator::ResourceAllocator(DriverApi& driverApi) noexcept
-        : mBackend(driverApi) {
+ResourceAllocator::ResourceAllocator(DriverApi& driverApi, size_t cacheCapacity) noexcept
+        : mBackend(driverApi), mCacheCapacity(cacheCapacity) {
 }
 
 ResourceAllocator::~ResourceAllocator() noexcept {
@@ -115,8 +117,8 @@ backend::TextureHandle ResourceAllocator::createTexture(const char* name,
     // Some WebGL implementations complain about an incomplete framebuffer when the attachment sizes
     // are heterogeneous. This merits further investigation.
 #if !defined(__EMSCRIPTEN__)
-    if (!(usage & TextureUsage::SAMPLEABLE)) {
-        // If this texture is not going to be sampled, we can round its size up
+    if (!(usage & (TextureUsage::SAMPLEABLE | TextureUsage::STORAGE))) {
+        // If this texture is not going to be accessed by shaders, we can round its size up
         // this helps prevent many reallocations for small size changes.
         // We round to 16 pixels, which works for 720p btw.
         width  = (width  + 15u) & ~15u;
@@ -134,17 +136,31 @@ backend::TextureHandle ResourceAllocator::createTexture(const char* name,
         auto& textureCache = mTextureCache;
         const TextureKey key{ name, target, levels, format, samples, width, height, depth, usage };
         auto it = textureCache.find(key);
+#if !defined(__EMSCRIPTEN__)
+        if (it == textureCache.end() &&
+                !(usage & (TextureUsage::SAMPLEABLE | TextureUsage::STORAGE))) {
+            // Attachments that are never sampled can be larger than requested, so they can
+            // alias a bigger texture whose lifetime ended, e.g. earlier in this frame.
+            it = findLargerAttachment(key);
+        }
+#endif
         if (UTILS_LIKELY(it != textureCache.end())) {
+            mStatistics.hits++;
             // we do, move the entry to the in-use list, and remove from the cache
+            // the in-use list keeps the key of the texture, which might be larger than requested
             handle = it->second.handle;
             mCacheSize -= it->second.size;
+            mInUseTextures.emplace(handle, TextureKey{ name,
+                    target, levels, format, samples, it->first.width, it->first.height, depth,
+                    usage });
             textureCache.erase(it);
         } else {
             // we don't, allocate a new texture and populate the in-use list
+            mStatistics.misses++;
             handle = mBackend.createTexture(
                     target, levels, format, samples, width, height, depth, usage);
+            mInUseTextures.emplace(handle, key);
         }
-        mInUseTextures.emplace(handle, key);
     } else {
         handle = mBackend.createTexture(
                 target, levels, format, samples, width, height, depth, usage);
@@ -152,6 +168,25 @@ backend::TextureHandle ResourceAllocator::createTexture(const char* name,
     return handle;
 }
 
+ResourceAllocator::TextureCache::iterator ResourceAllocator::findLargerAttachment(
+        TextureKey const& key) noexcept {
+    // best fit: the smallest compatible texture that is at most MAX_ATTACHMENT_WASTE times
+    // larger than the request
+    auto& textureCache = mTextureCache;
+    const size_t maxSize = key.getSize() * MAX_ATTACHMENT_WASTE;
+    auto best = textureCache.end();
+    for (auto it = textureCache.begin(); it != textureCache.end(); ++it) {
+        TextureKey const& k = it->first;
+        if (k.target == key.target && k.levels == key.levels && k.format == key.format &&
+            k.samples == key.samples && k.depth == key.depth && k.usage == key.usage &&
+            k.width >= key.width && k.height >= key.height && it->second.size <= maxSize &&
+            (best == textureCache.end() || it->second.size < best->second.size)) {
+            best = it;
+        }
+    }
+    return best;
+}
+
 void ResourceAllocator::destroyTexture(TextureHandle h) noexcept {
     if (mEnabled) {
         // find the texture in the in-use list (it must be there!)
@@ -180,17 +215,15 @@ void ResourceAllocator::gc() noexcept {
 
     // Purging strategy:
     // + remove entries that are older than a certain age
-    // - remove only one entry per gc(), unless we're at capacity
+    // - remove only one entry per gc(), unless we're over capacity
+    // + then, remove the least recently used entries until we're within capacity
 
     auto& textureCache = mTextureCache;
     for (auto it = textureCache.begin(); it != textureCache.end();) {
         const size_t ageDiff = age - it->second.age;
         if (ageDiff >= CACHE_MAX_AGE) {
-            mBackend.destroyTexture(it->second.handle);
-            mCacheSize -= it->second.size;
-            //slog.d << "purging " << it->second.handle.getId() << io::endl;
-            it = textureCache.erase(it);
-            if (mCacheSize < CACHE_CAPACITY) {
+            it = evict(it);
+            if (mCacheSize <= mCacheCapacity) {
                 // if we're not at capacity, only purge a single entry per gc, trying to
                 // avoid a burst of work.
                 break;
@@ -200,9 +233,48 @@ void ResourceAllocator::gc() noexcept {
         }
     }
 
+    trim(mCacheCapacity);
+
     //if (mAge % 60 == 0) dump();
-    // TODO: maybe purge LRU entries if we have more than a certain number
-    // TODO: maybe purge LRU entries if the size of the cache is too large
+}
+
+void ResourceAllocator::trim(size_t capacity) noexcept {
+    auto& textureCache = mTextureCache;
+    while (mCacheSize > capacity) {
+        // evict the least recently used entry, and the largest of those used at the same time
+        auto lru = std::min_element(textureCache.begin(), textureCache.end(),
+                [](auto const& lhs, auto const& rhs) {
+                    return lhs.second.age != rhs.second.age ?
+                            lhs.second.age < rhs.second.age : lhs.second.size > rhs.second.size;
+                });
+        assert(lru != textureCache.end());
+        evict(lru);
+    }
+}
+
+void ResourceAllocator::setCacheCapacity(size_t capacity) noexcept {
+    mCacheCapacity = capacity;
+    trim(capacity);
+}
+
+ResourceAllocator::TextureCache::iterator ResourceAllocator::evict(
+        TextureCache::iterator it) noexcept {
+    mBackend.destroyTexture(it->second.handle);
+    mCacheSize -= it->second.size;
+    mStatistics.evictions++;
+    //slog.d << "purging " << it->second.handle.getId() << io::endl;
+    return mTextureCache.erase(it);
+}
+
+ResourceAllocator::Statistics ResourceAllocator::getStatistics() const noexcept {
+    Statistics statistics = mStatistics;
+    statistics.cacheSize = mCacheSize;
+    statistics.cacheCount = mTextureCache.size();
+    for (auto const& it : mInUseTextures) {
+        statistics.inUseSize += it.second.getSize();
+    }
+    statistics.inUseCount = mInUseTextures.size();
+    return statistics;
 }
 
 UTILS_NOINLINE
@@ -60,7 +60,20 @@ protected:
 
 class ResourceAllocator final : public ResourceAllocatorInterface {
 public:
-    explicit ResourceAllocator(backend::DriverApi& driverApi) noexcept;
+    static constexpr size_t DEFAULT_CACHE_CAPACITY = 64u << 20u;   // 64 MiB
+
+    struct Statistics {
+        uint64_t hits = 0;          // textures created from the cache
+        uint64_t misses = 0;        // textures allocated because none was cached
+        uint64_t evictions = 0;     // cached textures destroyed
+        size_t cacheSize = 0;       // size in bytes of the cached textures
+        size_t cacheCount = 0;      // number of cached textures
+        size_t inUseSize = 0;       // size in bytes of the textures in use
+        size_t inUseCount = 0;      // number of textures in use
+    };
+
+    explicit ResourceAllocator(backend::DriverApi& driverApi,
+            size_t cacheCapacity = DEFAULT_CACHE_CAPACITY) noexcept;
     ~ResourceAllocator() noexcept override;
 
     void terminate() noexcept;
@@ -85,10 +98,20 @@ public:
 
     void gc() noexcept;
 
+    // evicts the least recently used textures until the cache holds at most 'capacity' bytes
+    void trim(size_t capacity) noexcept;
+
+    // sets the size in bytes above which gc() evicts cached textures, and trims the cache
+    void setCacheCapacity(size_t capacity) noexcept;
+
+    size_t getCacheCapacity() const noexcept { return mCacheCapacity; }
+
+    Statistics getStatistics() const noexcept;
+
 private:
-    // TODO: these should be settings of the engine
-    static constexpr size_t CACHE_CAPACITY = 64u << 20u;   // 64 MiB
     static constexpr size_t CACHE_MAX_AGE  = 30u;
+    // how much larger than requested a cached attachment can be, to be reused
+    static constexpr size_t MAX_ATTACHMENT_WASTE = 2u;
 
     struct TextureKey {
         const char* name; // doesn't participate in the hash
@@ -176,11 +199,21 @@ private:
         void emplace(ARGS&&... args);
     };
 
+    using TextureCache = AssociativeContainer<TextureKey, TextureCachePayload>;
+
+    // finds a cached non-sampleable texture that is compatible with, but larger than, 'key'
+    TextureCache::iterator findLargerAttachment(TextureKey const& key) noexcept;
+
+    // destroys a cached texture
+    TextureCache::iterator evict(TextureCache::iterator it) noexcept;
+
     backend::DriverApi& mBackend;
-    AssociativeContainer<TextureKey, TextureCachePayload> mTextureCache;
+    TextureCache mTextureCache;
     AssociativeContainer<backend::TextureHandle, TextureKey> mInUseTextures;
     size_t mAge = 0;
-    uint32_t mCacheSize = 0;
+    size_t mCacheSize = 0;
+    size_t mCacheCapacity;
+    Statistics mStatistics;
     const bool mEnabled = true;
 };
 
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SamplerGroupCache.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+#include <utils/Hash.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace backend;
+
+SamplerGroupCache::~SamplerGroupCache() noexcept {
+    assert(mGroups.empty());
+}
+
+void SamplerGroupCache::terminate(DriverApi& driver) noexcept {
+#ifndef NDEBUG
+    if (!mGroups.empty()) {
+        utils::slog.w << mKeys.size() << " shared sampler groups were not released"
+                << utils::io::endl;
+    }
+#endif
+    for (auto const& item : mGroups) {
+        for (Entry const& entry : item.second) {
+            driver.destroySamplerGroup(entry.handle);
+        }
+    }
+    mGroups.clear();
+    mKeys.clear();
+}
+
+uint64_t SamplerGroupCache::hash(SamplerGroup const& group) noexcept {
+    using utils::hash::fnv1a64;
+    uint64_t h = fnv1a64(nullptr, 0);
+    auto hashValue = [&h](auto const& value) {
+        h = fnv1a64(&value, sizeof(value), h);
+    };
+
+    hashValue(group.getSize());
+    SamplerGroup::Sampler const* const samplers = group.getSamplers();
+    for (size_t i = 0, c = group.getSize(); i < c; i++) {
+        hashValue(samplers[i].t.getId());
+        hashValue(samplers[i].s.u);
+    }
+    return h;
+}
+
+bool SamplerGroupCache::equal(SamplerGroup const& lhs, SamplerGroup const& rhs) noexcept {
+    if (lhs.getSize() != rhs.getSize()) {
+        return false;
+    }
+    SamplerGroup::Sampler const* const l = lhs.getSamplers();
+    SamplerGroup::Sampler const* const r = rhs.getSamplers();
+    for (size_t i = 0, c = lhs.getSize(); i < c; i++) {
+        if (l[i].t.getId() != r[i].t.getId() || l[i].s.u != r[i].s.u) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Handle<HwSamplerGroup> SamplerGroupCache::acquire(DriverApi& driver,
+        SamplerGroup const& group) noexcept {
+    const uint64_t key = hash(group);
+    std::vector<Entry>& entries = mGroups[key];
+    for (Entry& entry : entries) {
+        if (equal(entry.group, group)) {
+            entry.refs++;
+            mHits++;
+            return entry.handle;
+        }
+    }
+
+    Handle<HwSamplerGroup> handle = driver.createSamplerGroup(group.getSize());
+    // the copy is moved into the command stream, 'group' keeps its samplers
+    SamplerGroup copy(group);
+    driver.updateSamplerGroup(handle, std::move(copy));
+    entries.push_back({ group, handle, 1 });
+    mKeys.insert({ handle.getId(), key });
+    mMisses++;
+    return handle;
+}
+
+void SamplerGroupCache::release(DriverApi& driver, Handle<HwSamplerGroup> handle) noexcept {
+    if (!handle) {
+        return;
+    }
+    auto key = mKeys.find(handle.getId());
+    assert(key != mKeys.end());
+    if (UTILS_UNLIKELY(key == mKeys.end())) {
+        return;
+    }
+    auto pos = mGroups.find(key->second);
+    assert(pos != mGroups.end());
+    std::vector<Entry>& entries = pos.value();
+    auto entry = std::find_if(entries.begin(), entries.end(),
+            [handle](Entry const& e) { return e.handle == handle; });
+    assert(entry != entries.end());
+    if (--entry->refs == 0) {
+        driver.destroySamplerGroup(handle);
+        entries.erase(entry);
+        if (entries.empty()) {
+            mGroups.erase(pos);
+        }
+        mKeys.erase(key);
+    }
+}
+
+SamplerGroupCache::Statistics SamplerGroupCache::getStatistics() const noexcept {
+    return { .hits = mHits, .misses = mMisses, .count = mKeys.size() };
+}
+
+} // namespace filament
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_SAMPLERGROUPCACHE_H
+#define TNT_FILAMENT_SAMPLERGROUPCACHE_H
+
+#include <backend/Handle.h>
+
+#include "private/backend/DriverApiForward.h"
+#include "private/backend/SamplerGroup.h"
+
+#include <tsl/robin_map.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Shares sampler groups between material instances.
+ *
+ * Material instances using the same textures with the same parameters get the same backend
+ * sampler group, so the driver only tracks one object and binding can be skipped between
+ * consecutive instances that share it. A shared group is never updated, an instance whose
+ * samplers change acquires the group matching its new samplers and releases the old one.
+ *
+ * Sampler groups are looked up by a hash of their samplers, and a hit is only taken after
+ * comparing the samplers themselves. Sampler groups are ref-counted.
+ * This is only used from the main thread.
+ */
+class SamplerGroupCache {
+public:
+    struct Statistics {
+        uint64_t hits = 0;          // sampler groups shared with an existing one
+        uint64_t misses = 0;        // sampler groups created
+        size_t count = 0;           // number of sampler groups alive
+    };
+
+    SamplerGroupCache() noexcept = default;
+    SamplerGroupCache(SamplerGroupCache const& rhs) = delete;
+    SamplerGroupCache& operator=(SamplerGroupCache const& rhs) = delete;
+    ~SamplerGroupCache() noexcept;
+
+    // destroys the sampler groups that were not released
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // returns a sampler group with the samplers of 'group', which is only created if there is
+    // none yet
+    backend::Handle<backend::HwSamplerGroup> acquire(backend::DriverApi& driver,
+            backend::SamplerGroup const& group) noexcept;
+
+    // releases a sampler group returned by acquire(), destroyed when it's no longer used
+    void release(backend::DriverApi& driver,
+            backend::Handle<backend::HwSamplerGroup> handle) noexcept;
+
+    Statistics getStatistics() const noexcept;
+
+    static uint64_t hash(backend::SamplerGroup const& group) noexcept;
+
+private:
+    static bool equal(backend::SamplerGroup const& lhs,
+            backend::SamplerGroup const& rhs) noexcept;
+
+    struct Entry {
+        backend::SamplerGroup group;
+        backend::Handle<backend::HwSamplerGroup> handle;
+        uint32_t refs;
+    };
+
+    // sampler groups with the same hash share a bucket
+    tsl::robin_map<uint64_t, std::vector<Entry>> mGroups;
+    tsl::robin_map<backend::HandleBase::HandleId, uint64_t> mKeys;
+    uint64_t mHits = 0;
+    uint64_t mMisses = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_SAMPLERGROUPCACHE_H
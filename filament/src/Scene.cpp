@@ -25,12 +25,19 @@
 #include "details/IndirectLight.h"
 #include "details/Skybox.h"
 
+#include <math/simd.h>
+
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Range.h>
+#include <utils/Systrace.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
+#include <numeric>
+
+#include <string.h>
 
 using namespace filament::math;
 using namespace utils;
@@ -41,14 +48,123 @@ namespace filament {
 
 FScene::FScene(FEngine& engine) :
         mEngine(engine) {
+    engine.getEntityManager().registerListener(&mEntityListener);
+}
+
+FScene::~FScene() noexcept {
+    mEngine.getEntityManager().unregisterListener(&mEntityListener);
+}
+
+void FScene::EntityListener::onEntitiesDestroyed(size_t, Entity const*) noexcept {
+    // this can be called from any thread
+    entitiesDestroyed.store(true, std::memory_order_relaxed);
 }
 
-FScene::~FScene() noexcept = default;
+mat4f const& FScene::prepare(utils::JobSystem& js, const mat4f& viewWorldOriginTransform) {
+    SYSTRACE_CALL();
+
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
 
+    /*
+     * When several views render this scene in the same frame (split-screen, picture-in-picture),
+     * they all use the world origin of the first one, which typically differs only by the
+     * camera position. This way the views after the first only update what changed since.
+     */
+    const uint32_t frame = engine.getPrepareCount();
+    const mat4f worldOriginTransform =
+            mPreparedFrame == frame ? mGatheredWorldOrigin : viewWorldOriginTransform;
+    mPreparedFrame = frame;
 
-void FScene::prepare(const mat4f& worldOriginTransform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
+    /*
+     * The RenderableSoa is kept from frame to frame (its order might change because it's
+     * partitioned by FView, but not its content). We only need to gather all of it again when
+     * the list of entities in the scene, the world origin, or the component layout changed.
+     * Otherwise, only the renderables modified since the last call are updated.
+     */
+    const bool reuse = canReuseGatheredData(worldOriginTransform);
+    if (reuse) {
+        updateRenderables(js, worldOriginTransform);
+    } else {
+        gatherRenderables(js, worldOriginTransform);
+    }
+    updateCullingBvh(!reuse);
+    updateLightBvh(js, worldOriginTransform, !reuse);
+
+    // The LightSoa is sorted and trimmed during the frame, so it is always gathered again. With
+    // hierarchical culling, the punctual lights are added later by gatherVisibleLights().
+    gatherLights(js, worldOriginTransform);
+
+    mGatheredWorldOrigin = worldOriginTransform;
+    mGatheredGenerations = {
+            .renderables = rcm.getGeneration(),
+            .renderableLayout = rcm.getLayoutGeneration(),
+            .transforms = tcm.getGeneration(),
+            .transformLayout = tcm.getLayoutGeneration(),
+            .lights = lcm.getGeneration(),
+            .lightLayout = lcm.getLayoutGeneration()
+    };
+    return mGatheredWorldOrigin;
+}
+
+bool FScene::canReuseGatheredData(const mat4f& worldOriginTransform) const noexcept {
+    FEngine& engine = mEngine;
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FTransformManager const& tcm = engine.getTransformManager();
+    FLightManager const& lcm = engine.getLightManager();
+    Generations const& generations = mGatheredGenerations;
+    return !mEntitiesDirty &&
+           !mEntityListener.entitiesDestroyed.load(std::memory_order_relaxed) &&
+           generations.renderableLayout == rcm.getLayoutGeneration() &&
+           generations.transformLayout == tcm.getLayoutGeneration() &&
+           generations.lightLayout == lcm.getLayoutGeneration() &&
+           !memcmp(&mGatheredWorldOrigin, &worldOriginTransform, sizeof(mat4f));
+}
+
+UTILS_ALWAYS_INLINE
+inline void FScene::gatherRenderable(RenderableSoa& soa, size_t index,
+        FRenderableManager const& rcm, FTransformManager const& tcm,
+        FRenderableManager::Instance ri, FTransformManager::Instance ti,
+        const mat4f& worldOriginTransform) noexcept {
+    // get the world transform
+    const mat4f worldTransform = simd::multiply(worldOriginTransform, tcm.getWorldTransform(ti));
+    const bool reversedWindingOrder = det(worldTransform.upperLeft()) < 0;
+
+    // compute the world AABB so we can perform culling
+    const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
+
+    // quantized positions are dequantized by the transform given to the shaders, the AABB above
+    // stays in object space
+    mat4f model = worldTransform;
+    const float4 dequantization = rcm.getPositionDequantization(ri);
+    if (UTILS_UNLIKELY(dequantization.w != 0.0f)) {
+        model[0] *= dequantization.w;
+        model[1] *= dequantization.w;
+        model[2] *= dequantization.w;
+        model[3] = worldTransform * float4{ dequantization.xyz, 1.0f };
+    }
+
+    soa.elementAt<RENDERABLE_INSTANCE>(index)     = ri;
+    soa.elementAt<WORLD_TRANSFORM>(index)         = model;
+    soa.elementAt<REVERSED_WINDING_ORDER>(index)  = reversedWindingOrder;
+    soa.elementAt<VISIBILITY_STATE>(index)        = rcm.getVisibility(ri);
+    soa.elementAt<BONES_UBH>(index)               = rcm.getBonesUbh(ri);
+    soa.elementAt<BONES_OFFSET>(index)            = rcm.getBonesOffset(ri);
+    soa.elementAt<WORLD_AABB_CENTER>(index)       = worldAABB.center;
+    soa.elementAt<VISIBLE_MASK>(index)            = 0;
+    soa.elementAt<MORPH_WEIGHTS>(index)           = rcm.getMorphWeights(ri);
+    soa.elementAt<INSTANCE_COUNT>(index)          = rcm.getInstanceCount(ri);
+    soa.elementAt<LAYERS>(index)                  = rcm.getLayerMask(ri);
+    soa.elementAt<WORLD_AABB_EXTENT>(index)       = worldAABB.halfExtent;
+    soa.elementAt<PRIMITIVES>(index)              = {};
+    soa.elementAt<SUMMED_PRIMITIVE_COUNT>(index)  = 0;
+    soa.elementAt<CLUSTER_DRAWS>(index)           = NO_CLUSTER_DRAWS;
+}
+
+void FScene::gatherRenderables(utils::JobSystem& js, const mat4f& worldOriginTransform) {
+    SYSTRACE_CALL();
 
     FEngine& engine = mEngine;
     EntityManager& em = engine.getEntityManager();
@@ -57,9 +173,11 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
     FLightManager& lcm = engine.getLightManager();
     // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
-    auto& lightData = mLightData;
     auto const& entities = mEntities;
 
+    // we're about to filter out all dead entities
+    mEntityListener.entitiesDestroyed.store(false, std::memory_order_relaxed);
+    mEntitiesDirty = false;
 
     // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
     // component can be added after the entity is added to the scene.
@@ -75,9 +193,196 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
         sceneData.setCapacity(renderableDataCapacity);
     }
 
+    /*
+     * The gathering is done in three steps:
+     * 1. (parallel) look-up the renderable, transform and light component of each entity
+     * 2. (serial)   prefix-sum the results to compute the destination index of each entity
+     *               in the RenderableSoa. This keeps the output compact and in the same
+     *               order as a serial gather would produce.
+     * 3. (parallel) compute the world transforms / AABBs and write them directly in place.
+     */
+
+    // robin_set<> can't be accessed randomly, so we need a flat copy of the entity list
+    auto& gatherEntities = mGatherEntities;
+    gatherEntities.assign(entities.begin(), entities.end());
+
+    auto& gatherInfo = mGatherInfo;
+    gatherInfo.resize(gatherEntities.size());
+
+    auto lookupWork = [&em, &rcm, &tcm, &lcm, &gatherInfo, entities = gatherEntities.data()]
+            (uint32_t startIndex, uint32_t count) {
+        for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+            Entity const entity = entities[i];
+            GatherInfo& info = gatherInfo[i];
+            if (UTILS_UNLIKELY(!em.isAlive(entity))) {
+                info = {};
+                continue;
+            }
+            // getInstance() always returns null if the entity is the Null entity
+            // so we don't need to check for that, but we need to check it's alive
+            info.ri = rcm.getInstance(entity);
+            info.li = lcm.getInstance(entity);
+            info.ti = tcm.getInstance(entity);
+        }
+    };
+
+    auto* lookupJob = jobs::parallel_for(js, nullptr, 0, uint32_t(gatherInfo.size()),
+            std::cref(lookupWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_PREPARE_COUNT, 8>());
+    js.runAndWait(lookupJob);
+
+    // compute the destination indices, and record the lights and the transform of
+    // each renderable, so we can update them without looking them up again.
+    auto& renderableTransforms = mRenderableTransforms;
+    auto& lightComponents = mLightComponents;
+    auto& directionalLights = mDirectionalLights;
+    renderableTransforms.clear();
+    lightComponents.clear();
+    directionalLights.clear();
+    uint32_t renderableCount = 0;
+    for (GatherInfo& info : gatherInfo) {
+        info.renderableIndex = GatherInfo::INVALID;
+        // don't even draw this object if it doesn't have a transform (which shouldn't happen
+        // because one is always created when creating a Renderable component).
+        if (info.ri && info.ti) {
+            info.renderableIndex = renderableCount++;
+            if (renderableTransforms.size() <= info.ri) {
+                renderableTransforms.resize(info.ri + 1u);
+            }
+            renderableTransforms[info.ri] = info.ti;
+        }
+        if (info.li) {
+            if (UTILS_UNLIKELY(lcm.isDirectionalLight(info.li))) {
+                // we don't store the directional lights, because we only have a single one
+                directionalLights.push_back({ info.li, info.ti });
+            } else {
+                lightComponents.push_back({ info.li, info.ti });
+            }
+        }
+    }
+
+    // we know there is enough space in the array
+    sceneData.resize(renderableCount);
+
+    auto gatherWork = [&rcm, &tcm, &gatherInfo, &sceneData, &worldOriginTransform]
+            (uint32_t startIndex, uint32_t count) {
+        for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+            GatherInfo const& info = gatherInfo[i];
+            if (info.renderableIndex != GatherInfo::INVALID) {
+                gatherRenderable(sceneData, info.renderableIndex, rcm, tcm,
+                        info.ri, info.ti, worldOriginTransform);
+                sceneData.elementAt<UBO_SLOT>(info.renderableIndex) = info.renderableIndex;
+            }
+        }
+    };
+
+    auto* gatherJob = jobs::parallel_for(js, nullptr, 0, uint32_t(gatherInfo.size()),
+            std::cref(gatherWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_PREPARE_COUNT, 8>());
+    js.runAndWait(gatherJob);
+
+    // all the slots of the renderable UBO must be uploaded again
+    mDirtyUboSlots.assign(renderableCount, 1);
+}
+
+void FScene::updateRenderables(utils::JobSystem& js, const mat4f& worldOriginTransform) {
+    FEngine& engine = mEngine;
+    FRenderableManager& rcm = engine.getRenderableManager();
+    FTransformManager& tcm = engine.getTransformManager();
+    Generations const& generations = mGatheredGenerations;
+
+    if (rcm.getGeneration() == generations.renderables &&
+        tcm.getGeneration() == generations.transforms) {
+        // nothing changed since the last call
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // only the renderables (or their transform) modified since the last call are gathered again
+    auto& sceneData = mRenderableData;
+
+    // the culling hierarchy needs to know which renderables were updated
+    uint8_t* updatedRows = nullptr;
+    if (mHierarchicalCullingEnabled) {
+        mUpdatedRows.assign(sceneData.size(), 0);
+        updatedRows = mUpdatedRows.data();
+    }
+
+    auto updateWork = [&rcm, &tcm, &sceneData, &worldOriginTransform, updatedRows,
+            dirtyUboSlots = mDirtyUboSlots.data(),
+            transforms = mRenderableTransforms.data(),
+            renderableGeneration = generations.renderables,
+            transformGeneration = generations.transforms]
+            (uint32_t startIndex, uint32_t count) {
+        auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+        auto const* const UTILS_RESTRICT uboSlots = sceneData.data<UBO_SLOT>();
+        for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+            auto const ri = instances[i];
+            auto const ti = transforms[ri];
+            if (rcm.getGeneration(ri) > renderableGeneration ||
+                tcm.getGeneration(ti) > transformGeneration) {
+                gatherRenderable(sceneData, i, rcm, tcm, ri, ti, worldOriginTransform);
+                dirtyUboSlots[uboSlots[i]] = 1;
+                if (updatedRows) {
+                    updatedRows[i] = 1;
+                }
+            }
+        }
+    };
+
+    auto* updateJob = jobs::parallel_for(js, nullptr, 0, uint32_t(sceneData.size()),
+            std::cref(updateWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_PREPARE_COUNT, 8>());
+    js.runAndWait(updateJob);
+}
+
+void FScene::updateCullingBvh(bool rebuild) {
+    if (!mHierarchicalCullingEnabled) {
+        return;
+    }
+
+    auto const& sceneData = mRenderableData;
+    auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT centers = sceneData.data<WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents = sceneData.data<WORLD_AABB_EXTENT>();
+
+    if (rebuild || mCullingBvh.empty()) {
+        auto& ids = mCullingBvhIds;
+        ids.resize(sceneData.size());
+        for (size_t i = 0, c = sceneData.size(); i < c; i++) {
+            ids[i] = instances[i].asValue();
+        }
+        mCullingBvh.build(ids.data(), centers, extents, ids.size());
+        return;
+    }
+
+    auto const& updatedRows = mUpdatedRows;
+    for (size_t i = 0, c = updatedRows.size(); i < c; i++) {
+        if (updatedRows[i]) {
+            mCullingBvh.update(instances[i].asValue(), centers[i], extents[i]);
+        }
+    }
+    mUpdatedRows.clear();
+    mCullingBvh.refit();
+}
+
+void FScene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    mHierarchicalCullingEnabled = enabled;
+    if (!enabled) {
+        // the hierarchies will be built again if it's enabled later
+        mCullingBvh.clear();
+        mLightBvh.clear();
+    }
+}
+
+void FScene::gatherLights(utils::JobSystem& js, const mat4f& worldOriginTransform) {
+    FEngine& engine = mEngine;
+    FTransformManager& tcm = engine.getTransformManager();
+    FLightManager& lcm = engine.getLightManager();
+    auto& lightData = mLightData;
+    auto const& lightComponents = mLightComponents;
+
     // The light data list will always contain at least one entry for the
     // dominating directional light, even if there are no entities.
-    size_t lightDataCapacity = std::max<size_t>(1, entities.size());
+    size_t lightDataCapacity = std::max<size_t>(1, mEntities.size());
     // we need the capacity to be multiple of 16 for SIMD loops
     lightDataCapacity = (lightDataCapacity + 0xFu) & ~0xFu;
 
@@ -86,155 +391,323 @@ void FScene::prepare(const mat4f& worldOriginTransform) {
         lightData.setCapacity(lightDataCapacity);
     }
     // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+    if (mHierarchicalCullingEnabled) {
+        // the punctual lights are added by gatherVisibleLights()
+        lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
+    } else {
+        lightData.resize(DIRECTIONAL_LIGHTS_COUNT + lightComponents.size());
+
+        auto lightWork = [&tcm, &lcm, &lightData, &worldOriginTransform, &lightComponents]
+                (uint32_t startIndex, uint32_t count) {
+            for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+                const size_t index = DIRECTIONAL_LIGHTS_COUNT + i;
+                gatherLight(lcm, tcm, lightComponents[i], worldOriginTransform,
+                        &lightData.elementAt<POSITION_RADIUS>(index),
+                        &lightData.elementAt<DIRECTION>(index));
+                lightData.elementAt<LIGHT_INSTANCE>(index) = lightComponents[i].li;
+            }
+        };
 
+        auto* lightJob = jobs::parallel_for(js, nullptr, 0, uint32_t(lightComponents.size()),
+                std::cref(lightWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_PREPARE_COUNT, 8>());
+        js.runAndWait(lightJob);
+    }
 
-    // find the max intensity directional light index in our local array
+    // find the max intensity directional light. This is done serially, in entity order, so
+    // that the result is deterministic (in case of ties, the last one wins).
     float maxIntensity = 0.0f;
+    LightComponents const* dominant = nullptr;
+    for (LightComponents const& light : mDirectionalLights) {
+        if (lcm.getIntensity(light.li) >= maxIntensity) {
+            maxIntensity = lcm.getIntensity(light.li);
+            dominant = &light;
+        }
+    }
+    if (dominant) {
+        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(dominant->ti);
+        float3 d = lcm.getLocalDirection(dominant->li);
+        // using mat3f::getTransformForNormals handles non-uniform scaling
+        d = normalize(mat3f::getTransformForNormals(worldTransform.upperLeft()) * d);
+        lightData.elementAt<FScene::POSITION_RADIUS>(0) =
+                float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
+        lightData.elementAt<FScene::DIRECTION>(0)       = d;
+        lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = dominant->li;
+    }
 
-    for (Entity e : entities) {
-        if (!em.isAlive(e)) {
-            continue;
+    padLightData();
+}
+
+void FScene::padLightData() noexcept {
+    // some elements past the end of the array will be accessed by SIMD code, we need to make
+    // sure the data is valid enough as not to produce errors such as divide-by-zero
+    // (e.g. in computeLightRanges())
+    auto& lightData = mLightData;
+    for (size_t i = lightData.size(), e = (lightData.size() + 3u) & ~3u; i < e; i++) {
+        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+    }
+}
+
+UTILS_ALWAYS_INLINE
+inline void FScene::gatherLight(FLightManager const& lcm, FTransformManager const& tcm,
+        LightComponents const& light, const mat4f& worldOriginTransform,
+        float4* positionRadius, float3* direction) noexcept {
+    auto const li = light.li;
+    const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(light.ti);
+    const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
+    float3 d = 0;
+    if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+        d = lcm.getLocalDirection(li);
+        // using mat3f::getTransformForNormals handles non-uniform scaling
+        d = normalize(mat3f::getTransformForNormals(worldTransform.upperLeft()) * d);
+    }
+    *positionRadius = float4{ p.xyz, lcm.getRadius(li) };
+    *direction = d;
+}
+
+void FScene::updateLightBvh(utils::JobSystem& js, const mat4f& worldOriginTransform,
+        bool rebuild) {
+    if (!mHierarchicalCullingEnabled) {
+        return;
+    }
+
+    FEngine& engine = mEngine;
+    FTransformManager const& tcm = engine.getTransformManager();
+    FLightManager const& lcm = engine.getLightManager();
+    Generations const& generations = mGatheredGenerations;
+    auto const& lightComponents = mLightComponents;
+
+    rebuild = rebuild || mLightBvh.empty();
+    if (!rebuild &&
+        lcm.getGeneration() == generations.lights &&
+        tcm.getGeneration() == generations.transforms) {
+        // no light moved since the last call
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // the bounds of the lights are kept across frames, only the lights (or their transform)
+    // modified since the last call are gathered again
+    const size_t count = lightComponents.size();
+    mLightSpheres.resize(count);
+    mLightDirections.resize(count);
+    mUpdatedLights.assign(count, 0);
+
+    auto lightWork = [&tcm, &lcm, &lightComponents, &worldOriginTransform, rebuild,
+            spheres = mLightSpheres.data(), directions = mLightDirections.data(),
+            updated = mUpdatedLights.data(),
+            lightGeneration = generations.lights, transformGeneration = generations.transforms]
+            (uint32_t startIndex, uint32_t count) {
+        for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+            LightComponents const& light = lightComponents[i];
+            if (rebuild ||
+                lcm.getGeneration(light.li) > lightGeneration ||
+                tcm.getGeneration(light.ti) > transformGeneration) {
+                gatherLight(lcm, tcm, light, worldOriginTransform, &spheres[i], &directions[i]);
+                updated[i] = 1;
+            }
+        }
+    };
+
+    auto* lightJob = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(lightWork), jobs::CountSplitter<JOBS_PARALLEL_FOR_PREPARE_COUNT, 8>());
+    js.runAndWait(lightJob);
+
+    // the lights are identified by their index in mLightComponents, and bounded by the box of
+    // their sphere of influence
+    auto extent = [](float4 const& sphere) { return float3(sphere.w); };
+    if (rebuild) {
+        auto& ids = mCullingBvhIds;
+        ids.resize(count);
+        std::iota(ids.begin(), ids.end(), 0u);
+        std::vector<float3> centers(count);
+        std::vector<float3> extents(count);
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = mLightSpheres[i].xyz;
+            extents[i] = extent(mLightSpheres[i]);
         }
+        mLightBvh.build(ids.data(), centers.data(), extents.data(), count);
+        return;
+    }
 
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li) {
-            continue;
+    for (size_t i = 0; i < count; i++) {
+        if (mUpdatedLights[i]) {
+            mLightBvh.update(uint32_t(i), mLightSpheres[i].xyz, extent(mLightSpheres[i]));
         }
+    }
+    mLightBvh.refit();
+}
 
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTransform * tcm.getWorldTransform(ti);
-        const bool reversedWindingOrder = det(worldTransform.upperLeft()) < 0;
+void FScene::gatherVisibleLights(Frustum const& frustum) noexcept {
+    if (!mHierarchicalCullingEnabled) {
+        return;
+    }
 
-        // don't even draw this object if it doesn't have a transform (which shouldn't happen
-        // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,                       // RENDERABLE_INSTANCE
-                    worldTransform,           // WORLD_TRANSFORM
-                    reversedWindingOrder,     // REVERSED_WINDING_ORDER
-                    rcm.getVisibility(ri),    // VISIBILITY_STATE
-                    rcm.getBonesUbh(ri),      // BONES_UBH
-                    worldAABB.center,         // WORLD_AABB_CENTER
-                    0,                        // VISIBLE_MASK
-                    rcm.getMorphWeights(ri),  // MORPH_WEIGHTS
-                    rcm.getLayerMask(ri),     // LAYERS
-                    worldAABB.halfExtent,     // WORLD_AABB_EXTENT
-                    {},                       // PRIMITIVES
-                    0                         // SUMMED_PRIMITIVE_COUNT
-            );
-        }
+    SYSTRACE_CALL();
 
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    maxIntensity = lcm.getIntensity(li);
-                    float3 d = lcm.getLocalDirection(li);
-                    // using mat3f::getTransformForNormals handles non-uniform scaling
-                    d = normalize(mat3f::getTransformForNormals(worldTransform.upperLeft()) * d);
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) =
-                            float4{ 0, 0, 0, std::numeric_limits<float>::infinity() };
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using mat3f::getTransformForNormals handles non-uniform scaling
-                    d = normalize(mat3f::getTransformForNormals(worldTransform.upperLeft()) * d);
-                }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {}, {}, {});
+    // the punctual lights whose sphere of influence may intersect the frustum
+    auto& ids = mVisibleLightIds;
+    ids.clear();
+    mLightBvh.cull(frustum, 0, [&ids](uint32_t const* candidates,
+            Culler::result_type const* results, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (!results || results[i]) {
+                ids.push_back(candidates[i]);
             }
         }
+    });
+
+    auto& lightData = mLightData;
+    lightData.resize(DIRECTIONAL_LIGHTS_COUNT + ids.size());
+    for (size_t i = 0, c = ids.size(); i < c; i++) {
+        const size_t index = DIRECTIONAL_LIGHTS_COUNT + i;
+        lightData.elementAt<POSITION_RADIUS>(index) = mLightSpheres[ids[i]];
+        lightData.elementAt<DIRECTION>(index)       = mLightDirections[ids[i]];
+        lightData.elementAt<LIGHT_INSTANCE>(index)  = mLightComponents[ids[i]].li;
     }
+    padLightData();
+}
 
-    // some elements past the end of the array will be accessed by SIMD code, we need to make
-    // sure the data is valid enough as not to produce errors such as divide-by-zero
-    // (e.g. in computeLightRanges())
-    for (size_t i = lightData.size(), e = (lightData.size() + 3u) & ~3u; i < e; i++) {
-        new(lightData.data<POSITION_RADIUS>() + i) float4{ 0, 0, 0, 1 };
+UTILS_ALWAYS_INLINE
+inline void FScene::setRenderableUniforms(void* buffer, size_t offset,
+        FRenderableManager const& rcm, RenderableSoa const& soa, size_t index) noexcept {
+    mat4f const& model = soa.elementAt<WORLD_TRANSFORM>(index);
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelMatrix), model);
+
+    // Using mat3f::getTransformForNormals handles non-uniform scaling, but DOESN'T guarantee that
+    // the transformed normals will have unit-length, therefore they need to be normalized
+    // in the shader (that's already the case anyways, since normalization is needed after
+    // interpolation).
+    //
+    // We pre-scale normals by the inverse of the largest scale factor to avoid
+    // large post-transform magnitudes in the shader, especially in the fragment shader, where
+    // we use medium precision.
+    //
+    // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
+
+    mat3f m = simd::getTransformForNormals(model);
+    m *= mat3f(1.0f / std::sqrt(max(float3{length2(m[0]), length2(m[1]), length2(m[2])})));
+
+    // The shading normal must be flipped for mirror transformations.
+    // Basically we're shading the other side of the polygon and therefore need to negate the
+    // normal, similar to what we already do to support double-sided lighting.
+    if (soa.elementAt<REVERSED_WINDING_ORDER>(index)) {
+        m = -m;
     }
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
+
+    // Note that we cast bool to uint32_t. Booleans are byte-sized in C++, but we need to
+    // initialize all 32 bits in the UBO field.
+
+    FRenderableManager::Visibility visibility = soa.elementAt<VISIBILITY_STATE>(index);
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, skinningEnabled),
+            uint32_t(visibility.skinning));
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, morphingEnabled),
+            uint32_t(visibility.morphing));
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, screenSpaceContactShadows),
+            uint32_t(visibility.screenSpaceContactShadows));
+
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, morphWeights),
+            soa.elementAt<MORPH_WEIGHTS>(index));
+
+    // the picking variants output the entity's id
+    UniformBuffer::setUniform(buffer,
+            offset + offsetof(PerRenderableUib, objectId),
+            rcm.getEntity(soa.elementAt<RENDERABLE_INSTANCE>(index)).getId());
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept {
-    FEngine::DriverApi& driver = mEngine.getDriverApi();
-    const size_t size = visibleRenderables.size() * sizeof(PerRenderableUib);
+void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) noexcept {
+    SYSTRACE_CALL();
 
-    // allocate space into the command stream directly
-    void* const buffer = driver.allocate(size);
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    auto& sceneData = mRenderableData;
+    auto& dirtySlots = mDirtyUboSlots;
+    auto const* const UTILS_RESTRICT uboSlots = sceneData.data<UBO_SLOT>();
+    const size_t slotCount = dirtySlots.size();
+    const size_t stride = mEngine.getPerRenderableUboStride();
+
+    // the UBO has a slot for every renderable of the scene, visible or not
+    const size_t size = slotCount * stride;
+    if (mRenderableUboSize < size) {
+        // allocate 1/3 extra, with a minimum of 16 objects
+        const size_t count = std::max(size_t(16u), (4u * slotCount + 2u) / 3u);
+        mRenderableUboSize = uint32_t(count * stride);
+        driver.destroyUniformBuffer(mRenderableUbh);
+        mRenderableUbh = driver.createUniformBuffer(mRenderableUboSize,
+                backend::BufferUsage::DYNAMIC);
+        std::fill(dirtySlots.begin(), dirtySlots.end(), 1);
+    }
 
+    // find the visible renderables whose slot must be uploaded, invisible ones stay dirty until
+    // they become visible.
     bool hasContactShadows = false;
-    auto& sceneData = mRenderableData;
+    auto& rows = mUboUpdateRows;
+    rows.clear();
     for (uint32_t i : visibleRenderables) {
-        mat4f const& model = sceneData.elementAt<WORLD_TRANSFORM>(i);
-        const size_t offset = i * sizeof(PerRenderableUib);
-
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelMatrix), model);
-
-        // Using mat3f::getTransformForNormals handles non-uniform scaling, but DOESN'T guarantee that
-        // the transformed normals will have unit-length, therefore they need to be normalized
-        // in the shader (that's already the case anyways, since normalization is needed after
-        // interpolation).
-        //
-        // We pre-scale normals by the inverse of the largest scale factor to avoid
-        // large post-transform magnitudes in the shader, especially in the fragment shader, where
-        // we use medium precision.
-        //
-        // Note: if the model matrix is known to be a rigid-transform, we could just use it directly.
-
-        mat3f m = mat3f::getTransformForNormals(model.upperLeft());
-        m *= mat3f(1.0f / std::sqrt(max(float3{length2(m[0]), length2(m[1]), length2(m[2])})));
-
-        // The shading normal must be flipped for mirror transformations.
-        // Basically we're shading the other side of the polygon and therefore need to negate the
-        // normal, similar to what we already do to support double-sided lighting.
-        if (sceneData.elementAt<REVERSED_WINDING_ORDER>(i)) {
-            m = -m;
+        hasContactShadows = hasContactShadows ||
+                sceneData.elementAt<VISIBILITY_STATE>(i).screenSpaceContactShadows;
+        if (dirtySlots[uboSlots[i]]) {
+            rows.push_back(i);
         }
+    }
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, worldFromModelNormalMatrix), m);
-
-        // Note that we cast bool to uint32_t. Booleans are byte-sized in C++, but we need to
-        // initialize all 32 bits in the UBO field.
+    if (!rows.empty()) {
+        std::sort(rows.begin(), rows.end(), [uboSlots](uint32_t lhs, uint32_t rhs) {
+            return uboSlots[lhs] < uboSlots[rhs];
+        });
 
-        FRenderableManager::Visibility visibility = sceneData.elementAt<VISIBILITY_STATE>(i);
-        hasContactShadows = hasContactShadows || visibility.screenSpaceContactShadows;
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, skinningEnabled),
-                uint32_t(visibility.skinning));
+        size_t rangeCount = 1;
+        for (size_t i = 1, c = rows.size(); i < c; i++) {
+            rangeCount += (uboSlots[rows[i]] != uboSlots[rows[i - 1]] + 1u) ? 1 : 0;
+        }
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, morphingEnabled),
-                uint32_t(visibility.morphing));
+        if (rangeCount > MAX_RENDERABLE_UBO_UPDATE_COUNT) {
+            // Too many separate ranges, update a single one covering all of them instead,
+            // with the current data of all the slots in between, visible or not.
+            const uint32_t first = uboSlots[rows.front()];
+            const uint32_t last = uboSlots[rows.back()] + 1u;
+            auto& slotRows = mUboSlotRows;
+            slotRows.resize(slotCount);
+            for (uint32_t i = 0, c = uint32_t(sceneData.size()); i < c; i++) {
+                slotRows[uboSlots[i]] = i;
+            }
+            rows.assign(slotRows.begin() + first, slotRows.begin() + last);
+        }
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, screenSpaceContactShadows),
-                uint32_t(visibility.screenSpaceContactShadows));
+        // allocate space into the command stream directly, the slots are packed in order
+        FRenderableManager const& rcm = mEngine.getRenderableManager();
+        void* const buffer = driver.allocate(rows.size() * stride);
+        for (size_t i = 0, c = rows.size(); i < c; i++) {
+            setRenderableUniforms(buffer, i * stride, rcm, sceneData, rows[i]);
+            dirtySlots[uboSlots[rows[i]]] = 0;
+        }
 
-        UniformBuffer::setUniform(buffer,
-                offset + offsetof(PerRenderableUib, morphWeights),
-                sceneData.elementAt<MORPH_WEIGHTS>(i));
+        // upload each range of consecutive slots
+        for (size_t i = 0, c = rows.size(); i < c;) {
+            size_t j = i + 1;
+            while (j < c && uboSlots[rows[j]] == uboSlots[rows[j - 1]] + 1u) {
+                j++;
+            }
+            driver.updateUniformBuffer(mRenderableUbh, {
+                    static_cast<char*>(buffer) + i * stride,
+                    (j - i) * stride },
+                    uint32_t(uboSlots[rows[i]] * stride));
+            i = j;
+        }
+        mEngine.addUniformBufferBytes(rows.size() * stride);
     }
 
-    // TODO: handle static objects separately
     mHasContactShadows = hasContactShadows;
-    mRenderableViewUbh = renderableUbh;
-    driver.loadUniformBuffer(renderableUbh, { buffer, size });
 
     if (mSkybox) {
         mSkybox->commit(driver);
@@ -242,8 +715,8 @@ void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Hand
 }
 
 void FScene::terminate(FEngine& engine) {
-    // DO NOT destroy this UBO, it's owned by the View
-    mRenderableViewUbh.clear();
+    engine.getDriverApi().destroyUniformBuffer(mRenderableUbh);
+    mRenderableUbh.clear();
 }
 
 void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootArena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept {
@@ -253,7 +726,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
 
     /*
      * Here we copy our lights data into the GPU buffer, some lights might be left out if there
-     * are more than the GPU buffer allows (i.e. 256).
+     * are more than the engine is configured for (at most 256, which the GPU buffer allows).
      *
      * We always sort lights by distance to the camera plane so that:
      * - we can build light trees
@@ -278,10 +751,12 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
             [](auto const& lhs, auto const& rhs) { return lhs.second < rhs.second; });
 
     // drop excess lights
-    lightData.resize(std::min(size, CONFIG_MAX_LIGHT_COUNT + DIRECTIONAL_LIGHTS_COUNT));
+    const size_t count = std::min(size,
+            size_t(mEngine.getConfig().maxLightCount) + DIRECTIONAL_LIGHTS_COUNT);
+    lightData.resize(count);
 
     // number of point/spot lights
-    size_t positionalLightCount = size - DIRECTIONAL_LIGHTS_COUNT;
+    size_t positionalLightCount = count - DIRECTIONAL_LIGHTS_COUNT;
 
     // compute the light ranges (needed when building light trees)
     float2* const zrange = lightData.data<FScene::SCREEN_SPACE_Z_RANGE>();
@@ -292,7 +767,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
     auto const* UTILS_RESTRICT directions       = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances        = lightData.data<FScene::LIGHT_INSTANCE>();
     auto const* UTILS_RESTRICT shadowInfo       = lightData.data<FScene::SHADOW_INFO>();
-    for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = size; i < c; ++i) {
+    for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = count; i < c; ++i) {
         const size_t gpuIndex = i - DIRECTIONAL_LIGHTS_COUNT;
         auto li = instances[i];
         lp[gpuIndex].positionFalloff      = { spheres[i].xyz, lcm.getSquaredFalloffInv(li) };
@@ -304,6 +779,7 @@ void FScene::prepareDynamicLights(const CameraInfo& camera, ArenaScope& rootAren
     }
 
     driver.loadUniformBuffer(lightUbh, { lp, positionalLightCount * sizeof(LightsUib) });
+    mEngine.addUniformBufferBytes(positionalLightCount * sizeof(LightsUib));
 }
 
 // These methods need to exist so clang honors the __restrict__ keyword, which in turn
@@ -360,14 +836,16 @@ inline void FScene::computeLightRanges(
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    mEntitiesDirty = true;
 }
 
 void FScene::addEntities(const Entity* entities, size_t count) {
     mEntities.insert(entities, entities + count);
+    mEntitiesDirty = true;
 }
 
 void FScene::remove(Entity entity) {
-    mEntities.erase(entity);
+    mEntitiesDirty |= mEntities.erase(entity) != 0;
 }
 
 void FScene::removeEntities(const Entity* entities, size_t count) {
@@ -482,4 +960,12 @@ bool Scene::hasEntity(Entity entity) const noexcept {
     return upcast(this)->hasEntity(entity);
 }
 
+void Scene::setHierarchicalCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setHierarchicalCullingEnabled(enabled);
+}
+
+bool Scene::isHierarchicalCullingEnabled() const noexcept {
+    return upcast(this)->isHierarchicalCullingEnabled();
+}
+
 } // namespace filament
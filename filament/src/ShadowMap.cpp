@@ -79,12 +79,15 @@ void ShadowMap::render(DriverApi& driver, FView::Range const& range, RenderPass&
     pass.setCamera(cameraInfo);
     pass.setGeometry(scene.getRenderableData(), range, scene.getRenderableUBO());
 
-    // updatePrimitivesLod must be run before appendCommands.
-    view.updatePrimitivesLod(engine, cameraInfo, scene.getRenderableData(), range);
+    // updatePrimitivesLod must be run before appendCommands. Levels of detail are selected
+    // from the view's camera, so that shadows are cast by the geometry that's actually seen.
+    // They're left for the color pass to update.
+    view.updatePrimitivesLod(engine, view.getCameraInfo(), scene.getRenderableData(), range,
+            false);
 
+    // the commands are generated and sorted later, together with the other shadow maps'
     pass.newCommandBuffer();
-    pass.appendCommands(RenderPass::SHADOW);
-    pass.sortCommands();
+    pass.appendCommandsDeferred(RenderPass::SHADOW);
 }
 
 void ShadowMap::computeSceneCascadeParams(const FScene::LightSoa& lightData, size_t index,
@@ -600,12 +603,13 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
             0, 0, 0, 1
     });
 
-    // apply the 1-texel border viewport transform
-    const float o = 1.0f / mShadowMapLayout.atlasDimension;
+    // apply the 1-texel border viewport transform, and move the shadow map to its place in
+    // the atlas
+    const float2 o = (float2(mShadowMapLayout.atlasOffset) + 1.0f) / mShadowMapLayout.atlasDimension;
     const float s = 1.0f - 2.0f * (1.0f / mShadowMapLayout.textureDimension);
     const mat4f Mb(mat4f::row_major_init{
-             s, 0, 0, o,
-             0, s, 0, o,
+             s, 0, 0, o.x,
+             0, s, 0, o.y,
              0, 0, 1, 0,
              0, 0, 0, 1
     });
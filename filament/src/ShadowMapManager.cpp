@@ -14,15 +14,19 @@
  * limitations under the License.
  */
 
+#include "details/Culler.h"
 #include "details/ShadowMap.h"
 #include "details/ShadowMapManager.h"
 #include "details/Texture.h"
 #include "details/View.h"
 
 #include "RenderPass.h"
+#include "ResourceAllocator.h"
 
 #include <private/filament/SibGenerator.h>
 
+#include <utils/Hash.h>
+
 namespace filament {
 
 using namespace backend;
@@ -49,12 +53,29 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::update(
         UniformBuffer& shadowUb, FScene::RenderableSoa& renderableData,
         FScene::LightSoa& lightData) noexcept {
     calculateTextureRequirements(engine, view, lightData);
+    mCullingFrustumCount = 0;
     ShadowTechnique shadowTechnique = {};
-    shadowTechnique |= updateCascadeShadowMaps(engine, view, perViewUb, renderableData, lightData);
-    shadowTechnique |= updateSpotShadowMaps(engine, view, shadowUb, renderableData, lightData);
+    shadowTechnique |= updateCascadeShadowMaps(engine, view, perViewUb, lightData);
+    shadowTechnique |= updateSpotShadowMaps(engine, view, shadowUb, lightData);
+
+    // Cull the shadow casters of all the shadow maps in a single pass over the renderables.
+    if (mCullingFrustumCount) {
+        FView::cullRenderables(engine, renderableData,
+                mCullingFrusta.data(), mCullingBits.data(), mCullingFrustumCount,
+                view.getScene()->getCullingBvh(), view.getScene()->getCullingBvhRows());
+    }
     return shadowTechnique;
 }
 
+void ShadowMapManager::addCullingFrustum(Frustum const& frustum, size_t bit) noexcept {
+    static_assert(MAX_CULLING_FRUSTA <= Culler::MAX_FRUSTUM_COUNT,
+            "The shadow casters can't be culled in a single pass");
+    assert(mCullingFrustumCount < mCullingFrusta.size());
+    mCullingFrusta[mCullingFrustumCount] = frustum;
+    mCullingBits[mCullingFrustumCount] = uint8_t(bit);
+    mCullingFrustumCount++;
+}
+
 void ShadowMapManager::reset() noexcept {
     mCascadeShadowMaps.clear();
     mSpotShadowMaps.clear();
@@ -73,10 +94,96 @@ void ShadowMapManager::addSpotShadowMap(size_t lightIndex) noexcept {
     mSpotShadowMaps.emplace_back(mSpotShadowMapCache[maps].get(), lightIndex);
 }
 
+void ShadowMapManager::terminate(FEngine& engine) noexcept {
+    if (mShadowCache.texture) {
+        mShadowCache.destroy(engine.getResourceAllocator());
+        mShadowCache = {};
+    }
+    invalidateCache();
+}
+
+void ShadowMapManager::invalidateCache() noexcept {
+    mCacheKeys.fill({});
+}
+
+bool ShadowMapManager::CacheKey::operator==(CacheKey const& rhs) const noexcept {
+    return valid && rhs.valid &&
+           lightFromWorld == rhs.lightFromWorld &&
+           polygonOffset.slope == rhs.polygonOffset.slope &&
+           polygonOffset.constant == rhs.polygonOffset.constant &&
+           light == rhs.light &&
+           size == rhs.size &&
+           layer == rhs.layer &&
+           casterCount == rhs.casterCount &&
+           casterHash == rhs.casterHash &&
+           renderableLayoutGeneration == rhs.renderableLayoutGeneration &&
+           materialInstanceGeneration == rhs.materialInstanceGeneration;
+}
+
+ShadowMapManager::CacheKey ShadowMapManager::computeCacheKey(FEngine& engine, FView& view,
+        ShadowMapEntry const& map, utils::Range<uint32_t> casters,
+        FScene::VisibleMaskType visibilityMask) noexcept {
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    FScene::RenderableSoa const& soa = view.getScene()->getRenderableData();
+    ShadowMap const& shadowMap = *map.getShadowMap();
+
+    CacheKey key{
+            .lightFromWorld = view.hasVsm() ?
+                    shadowMap.getLightSpaceMatrixVsm() : shadowMap.getLightSpaceMatrix(),
+            .polygonOffset = shadowMap.getPolygonOffset(),
+            .light = view.getScene()->getLightData().elementAt<FScene::LIGHT_INSTANCE>(
+                    map.getLightIndex()).asValue(),
+            .size = map.getLayout().size,
+            .layer = map.getLayout().layer,
+            .renderableLayoutGeneration = rcm.getLayoutGeneration(),
+            .materialInstanceGeneration = engine.getMaterialInstanceGeneration(),
+            .valid = true
+    };
+
+    // everything the commands of a caster are generated from, with no padding so it can be hashed
+    struct Caster {
+        uint32_t instance;
+        uint32_t primitiveCount;
+        uint64_t generation;        // covers the visibility state, bones and primitives
+        uint64_t primitives;
+        mat4f worldTransform;
+        float4 morphWeights;
+        uint32_t reversedWindingOrder;
+        uint32_t reserved;
+    };
+    static_assert(sizeof(Caster) == 112, "Caster must not have padding");
+
+    auto const* const UTILS_RESTRICT soaInstance        = soa.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaWorldTransform  = soa.data<FScene::WORLD_TRANSFORM>();
+    auto const* const UTILS_RESTRICT soaMorphWeights    = soa.data<FScene::MORPH_WEIGHTS>();
+    auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaVisibilityMask  = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaReversedWinding = soa.data<FScene::REVERSED_WINDING_ORDER>();
+
+    uint32_t hash = 0;
+    for (uint32_t i : casters) {
+        if (!(soaVisibilityMask[i] & visibilityMask)) {
+            continue;
+        }
+        const Caster caster{
+                .instance = soaInstance[i].asValue(),
+                .primitiveCount = uint32_t(soaPrimitives[i].size()),
+                .generation = rcm.getGeneration(soaInstance[i]),
+                .primitives = uint64_t(uintptr_t(soaPrimitives[i].data())),
+                .worldTransform = soaWorldTransform[i],
+                .morphWeights = soaMorphWeights[i],
+                .reversedWindingOrder = soaReversedWinding[i],
+                .reserved = 0
+        };
+        hash = utils::hash::murmur3((uint32_t const*)&caster, sizeof(caster) / 4, hash);
+        key.casterCount++;
+    }
+    key.casterHash = hash;
+    return key;
+}
+
 void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
         backend::DriverApi& driver, RenderPass& pass) noexcept {
-    constexpr size_t MAX_SHADOW_LAYERS =
-        CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOW_CASTING_SPOTS;
     struct ShadowPassData {
         FrameGraphId<FrameGraphTexture> shadows;
         FrameGraphId<FrameGraphTexture> tempDepth;
@@ -85,68 +192,158 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
 
     using ShadowPass = std::pair<const ShadowMapEntry*, RenderPass>;
     std::vector<ShadowPass> passes;
-    passes.reserve(MAX_SHADOW_LAYERS);
+    passes.reserve(MAX_SHADOW_MAPS);
     uint8_t layerSampleCount[MAX_SHADOW_LAYERS] = {};
+    uint32_t renderedLayers = 0;
 
     assert(mTextureRequirements.layers <= MAX_SHADOW_LAYERS);
 
-    // These loops fill render passes with appropriate rendering commands for each shadow map.
-    // The actual render pass execution is deferred to the frame graph.
-    for (const auto& map : mCascadeShadowMaps) {
-        if (!map.hasVisibleShadows()) {
-            continue;
+    const bool fillWithCheckerboard = engine.debug.shadowmap.checkerboard && !view.hasVsm();
+
+    FrameGraphTexture::Descriptor shadowTextureDesc {
+        .width = mTextureRequirements.size, .height = mTextureRequirements.size,
+        .depth = mTextureRequirements.layers,
+        .levels = mTextureRequirements.levels,
+        .type = SamplerType::SAMPLER_2D_ARRAY,
+        .format = mTextureFormat,
+        .usage = TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE
+            | (fillWithCheckerboard ? TextureUsage::UPLOADABLE : (TextureUsage) 0)
+    };
+
+    if (view.hasVsm()) {
+        // TODO: support 16-bit VSM depth textures.
+        shadowTextureDesc.format = TextureFormat::RG32F;
+        shadowTextureDesc.usage = TextureUsage::COLOR_ATTACHMENT |
+                TextureUsage::SAMPLEABLE;
+        if (shadowTextureDesc.levels > 1 &&
+                engine.getPostProcessManager().hasComputeDownsample(shadowTextureDesc.format)) {
+            // the mipmaps are generated with a compute pass, see below
+            shadowTextureDesc.usage |= TextureUsage::STORAGE;
         }
+    }
 
-        map.getShadowMap()->render(driver, view.getVisibleDirectionalShadowCasters(), pass, view);
+    // The cached shadow texture is kept as long as its layout doesn't change. The debug
+    // checkerboard is uploaded each frame, so it's not compatible with caching.
+    const bool useCache = view.isShadowMapCachingEnabled() && !fillWithCheckerboard;
+    if (mShadowCache.texture && (!useCache ||
+            mShadowCacheDesc.width != shadowTextureDesc.width ||
+            mShadowCacheDesc.depth != shadowTextureDesc.depth ||
+            mShadowCacheDesc.levels != shadowTextureDesc.levels ||
+            mShadowCacheDesc.format != shadowTextureDesc.format)) {
+        terminate(engine);
+    }
+    if (useCache && !mShadowCache.texture) {
+        mShadowCache.create(engine.getResourceAllocator(), "Shadow Cache", shadowTextureDesc);
+        mShadowCacheDesc = shadowTextureDesc;
+        invalidateCache();
+    }
 
-        assert(map.getLayout().layer < mTextureRequirements.layers);
-        passes.emplace_back(&map, pass);
+    // All the shadow maps of a layer are rendered together, because the layer is cleared first.
+    // Without caching all the layers are rendered, otherwise only those where the key of a
+    // shadow map changed.
+    const size_t cascadeCount = mCascadeShadowMaps.size();
+    const size_t mapCount = cascadeCount + mSpotShadowMaps.size();
+    auto getMap = [&](size_t i) -> ShadowMapEntry const& {
+        return i < cascadeCount ? mCascadeShadowMaps[i] : mSpotShadowMaps[i - cascadeCount];
+    };
+    auto getCasters = [&](size_t i) -> FView::Range const& {
+        return i < cascadeCount ?
+                view.getVisibleDirectionalShadowCasters() : view.getVisibleSpotShadowCasters();
+    };
+    auto getVisibilityMask = [&](size_t i) -> FScene::VisibleMaskType {
+        return i < cascadeCount ?
+                VISIBLE_DIR_SHADOW_RENDERABLE : VISIBLE_SPOT_SHADOW_RENDERABLE_N(i - cascadeCount);
+    };
+    auto getCacheSlot = [&](size_t i) -> size_t {
+        // the spot shadow maps always come after all the possible cascades
+        return i < cascadeCount ? i : CONFIG_MAX_SHADOW_CASCADES + (i - cascadeCount);
+    };
+
+    uint32_t dirtyLayers = 0;
+    CacheKey keys[MAX_SHADOW_MAPS];
+    for (size_t i = 0; i < mapCount; i++) {
+        ShadowMapEntry const& map = getMap(i);
+        if (!map.hasVisibleShadows()) {
+            continue;
+        }
 
         const uint8_t layer = map.getLayout().layer;
         assert(layer < MAX_SHADOW_LAYERS);
-        layerSampleCount[layer] = map.getLayout().vsmSamples;
+        // all the shadow maps of a layer share its render target
+        layerSampleCount[layer] = std::max(layerSampleCount[layer], map.getLayout().vsmSamples);
+
+        if (!useCache) {
+            dirtyLayers |= 1u << layer;
+            continue;
+        }
+
+        // Levels of detail are part of the key, they must be selected like ShadowMap::render()
+        // does (and it's fine to do it twice, it only depends on the view's camera).
+        view.updatePrimitivesLod(engine, view.getCameraInfo(),
+                view.getScene()->getRenderableData(), getCasters(i), false);
+        keys[i] = computeCacheKey(engine, view, map, getCasters(i), getVisibilityMask(i));
+        if (!(keys[i] == mCacheKeys[getCacheSlot(i)])) {
+            dirtyLayers |= 1u << layer;
+        }
     }
-    for (size_t i = 0; i < mSpotShadowMaps.size(); i++) {
-        const auto& map = mSpotShadowMaps[i];
-        if (!map.hasVisibleShadows()) {
+
+    if (useCache) {
+        // the layers that are rendered again lose the shadow maps that are not in them anymore
+        for (auto& key : mCacheKeys) {
+            if (key.valid && (dirtyLayers & (1u << key.layer))) {
+                key = {};
+            }
+        }
+    }
+
+    // These loops fill render passes with appropriate rendering commands for each shadow map.
+    // The actual render pass execution is deferred to the frame graph.
+    for (size_t i = 0; i < mapCount; i++) {
+        ShadowMapEntry const& map = getMap(i);
+        const uint8_t layer = map.getLayout().layer;
+        if (!map.hasVisibleShadows() || !(dirtyLayers & (1u << layer))) {
             continue;
         }
 
-        pass.setVisibilityMask(VISIBLE_SPOT_SHADOW_RENDERABLE_N(i));
-        map.getShadowMap()->render(driver, view.getVisibleSpotShadowCasters(), pass, view);
-        pass.clearVisibilityMask();
+        if (i >= cascadeCount) {
+            pass.setVisibilityMask(getVisibilityMask(i));
+        }
+        map.getShadowMap()->render(driver, getCasters(i), pass, view);
 
-        assert(map.getLayout().layer < mTextureRequirements.layers);
+        assert(layer < mTextureRequirements.layers);
+        // the copy keeps the visibility mask, the commands are generated from it below
         passes.emplace_back(&map, pass);
+        pass.clearVisibilityMask();
+        renderedLayers |= 1u << layer;
 
-        const uint8_t layer = map.getLayout().layer;
-        assert(layer < MAX_SHADOW_LAYERS);
-        layerSampleCount[layer] = map.getLayout().vsmSamples;
+        if (useCache) {
+            mCacheKeys[getCacheSlot(i)] = keys[i];
+        }
     }
-    assert(passes.size() <= mTextureRequirements.layers);
+    assert(passes.size() <= MAX_SHADOW_MAPS);
 
-    const bool fillWithCheckerboard = engine.debug.shadowmap.checkerboard && !view.hasVsm();
+    // Generate and sort the commands of all the shadow maps at once. Each pass has its own
+    // part of the command buffer, allocated above.
+    RenderPass* shadowPasses[MAX_SHADOW_MAPS];
+    for (size_t i = 0, c = passes.size(); i < c; i++) {
+        shadowPasses[i] = &passes[i].second;
+    }
+    RenderPass::generateAndSortCommands(engine.getJobSystem(), shadowPasses, passes.size());
+
+    FrameGraphId<FrameGraphTexture> cachedShadows;
+    if (useCache) {
+        cachedShadows = fg.import("Shadow Cache", mShadowCacheDesc, mShadowCache);
+        if (passes.empty()) {
+            // all the shadow maps are already in the cache
+            fg.getBlackboard().put("shadows", cachedShadows);
+            return;
+        }
+    }
 
     auto& shadowPass = fg.addPass<ShadowPassData>("Shadow Pass",
             [&](FrameGraph::Builder& builder, auto& data) {
-                FrameGraphTexture::Descriptor shadowTextureDesc {
-                    .width = mTextureRequirements.size, .height = mTextureRequirements.size,
-                    .depth = mTextureRequirements.layers,
-                    .levels = mTextureRequirements.levels,
-                    .type = SamplerType::SAMPLER_2D_ARRAY,
-                    .format = mTextureFormat,
-                    .usage = TextureUsage::DEPTH_ATTACHMENT | TextureUsage::SAMPLEABLE
-                        | (fillWithCheckerboard ? TextureUsage::UPLOADABLE : (TextureUsage) 0)
-                };
-
-                if (view.hasVsm()) {
-                    // TODO: support 16-bit VSM depth textures.
-                    shadowTextureDesc.format = TextureFormat::RG32F;
-                    shadowTextureDesc.usage = TextureUsage::COLOR_ATTACHMENT |
-                            TextureUsage::SAMPLEABLE;
-                }
-
-                data.shadows = builder.createTexture("Shadow Texture", shadowTextureDesc);
+                data.shadows = useCache ? cachedShadows :
+                        builder.createTexture("Shadow Texture", shadowTextureDesc);
                 data.shadows = builder.write(data.shadows);
 
                 if (view.hasVsm()) {
@@ -170,6 +367,10 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
 
                 // Create a render target for each layer of the texture array.
                 for (uint8_t i = 0u; i < mTextureRequirements.layers; i++) {
+                    if (useCache && !(renderedLayers & (1u << i))) {
+                        // this layer is already in the cache
+                        continue;
+                    }
                     FrameGraphRenderTarget::Descriptor renderTargetDesc {};
                     if (view.hasVsm()) {
                         renderTargetDesc.attachments = { { data.shadows, 0u, i }, { data.tempDepth } };
@@ -187,6 +388,7 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
             },
             [=, passes = std::move(passes), &view, &engine](FrameGraphPassResources const& resources,
                     auto const& data, DriverApi& driver) mutable {
+                uint32_t clearedLayers = 0;
                 for (auto& [map, pass] : passes) {
                     FCamera const& camera = map->getShadowMap()->getCamera();
                     filament::CameraInfo cameraInfo(camera);
@@ -201,20 +403,29 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
                     // shadowing.fs). Unfortunately, the APIs don't seem let us clear depth
                     // attachments to anything greater than 1.0, so we'd need a way to do this other
                     // than clearing.
-                    const uint32_t dim = map->getLayout().size;
-                    filament::Viewport viewport { 1, 1, dim - 2, dim - 2 };
+                    const auto& layout = map->getLayout();
+                    const uint32_t dim = layout.size;
+                    filament::Viewport viewport { layout.x + 1, layout.y + 1, dim - 2, dim - 2 };
                     view.prepareViewport(viewport);
 
                     view.commitUniforms(driver);
 
-                    const auto layer = map->getLayout().layer;
+                    const auto layer = layout.layer;
                     auto rt = resources.get(data.rt[layer]);
                     rt.params.viewport = viewport;
 
+                    // a layer is only cleared before its first shadow map, the others must be
+                    // preserved
+                    if (clearedLayers & (1u << layer)) {
+                        rt.params.flags.clear = TargetBufferFlags::NONE;
+                        rt.params.flags.discardStart = TargetBufferFlags::NONE;
+                    }
+                    clearedLayers |= 1u << layer;
+
                     auto polygonOffset = map->getShadowMap()->getPolygonOffset();
                     pass.overridePolygonOffset(&polygonOffset);
 
-                    pass.execute("Shadow Pass", rt.target, rt.params);
+                    pass.execute(driver, "Shadow Pass", rt.target, rt.params);
                 }
 
                 engine.flush(); // Wake-up the driver thread
@@ -246,6 +457,15 @@ void ShadowMapManager::render(FrameGraph& fg, FEngine& engine, FView& view,
     if (mTextureRequirements.levels > 1) {
         auto& ppm = engine.getPostProcessManager();
         for (uint8_t layer = 0; layer < mTextureRequirements.layers; layer++) {
+            if (useCache && !(renderedLayers & (1u << layer))) {
+                continue;
+            }
+            if (ppm.hasComputeDownsample(TextureFormat::RG32F)) {
+                // all the levels of a layer are generated at once
+                shadows = ppm.downsamplePass(fg, shadows, layer, 0,
+                        uint8_t(mTextureRequirements.levels - 1), true);
+                continue;
+            }
             for (size_t level = 0; level < mTextureRequirements.levels - 1; level++) {
                 shadows = ppm.vsmMipmapPass(fg, shadows, layer, level);
             }
@@ -277,8 +497,7 @@ void ShadowMapManager::prepareShadow(backend::Handle<backend::HwTexture> texture
 
 ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
         FEngine& engine, FView& view,
-        UniformBuffer& perViewUb, FScene::RenderableSoa& renderableData,
-        FScene::LightSoa& lightData) noexcept {
+        UniformBuffer& perViewUb, FScene::LightSoa& lightData) noexcept {
     FScene* scene = view.getScene();
     const CameraInfo& viewingCameraInfo = view.getCameraInfo();
     uint8_t visibleLayers = view.getVisibleLayers();
@@ -307,9 +526,7 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
         };
         map.update(lightData, 0, scene, viewingCameraInfo, visibleLayers,
                 layout, cascadeParams);
-        Frustum const& frustum = map.getCamera().getFrustum();
-        FView::cullRenderables(engine.getJobSystem(), renderableData, frustum,
-                VISIBLE_DIR_SHADOW_RENDERABLE_BIT);
+        addCullingFrustum(map.getCamera().getFrustum(), VISIBLE_DIR_SHADOW_RENDERABLE_BIT);
 
         // Set shadowBias, using the first directional cascade.
         const float texelSizeWorldSpace = map.getTexelSizeWorldSpace();
@@ -329,6 +546,14 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
         vsFar = std::max(vsFar, cascadeParams.vsNearFar.y);
     }
 
+    // With sample distribution shadows, the cascades only cover the depths visible on screen.
+    // They were measured a few frames ago, so the range is widened to account for camera moves.
+    float2 vsDepthRange;
+    if (view.getShadowDepthRange(&vsDepthRange)) {
+        vsNear = std::min(vsNear, vsDepthRange.x * (1.0f - DEPTH_RANGE_MARGIN));
+        vsFar = std::max(vsFar, vsDepthRange.y * (1.0f + DEPTH_RANGE_MARGIN));
+    }
+
     const size_t cascadeCount = mCascadeShadowMaps.size();
 
     // We divide the camera frustum into N cascades. This gives us N + 1 split positions.
@@ -433,7 +658,7 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateCascadeShadowMaps(
 
 ShadowMapManager::ShadowTechnique ShadowMapManager::updateSpotShadowMaps(
         FEngine& engine, FView& view, UniformBuffer& shadowUb,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept {
+        FScene::LightSoa& lightData) noexcept {
 
     ShadowTechnique shadowTechnique{};
     FScene* scene = view.getScene();
@@ -456,7 +681,8 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateSpotShadowMaps(
                 .zResolution = mTextureZResolution,
                 .atlasDimension = textureSize,
                 .textureDimension = textureDimension,
-                .shadowDimension = textureDimension - 2
+                .shadowDimension = textureDimension - 2,
+                .atlasOffset = { entry.getLayout().x, entry.getLayout().y }
         };
         shadowMap.update(lightData, l, scene, viewingCameraInfo, visibleLayers, layout, {});
 
@@ -464,10 +690,9 @@ ShadowMapManager::ShadowTechnique ShadowMapManager::updateSpotShadowMaps(
         if (shadowMap.hasVisibleShadows()) {
             entry.setHasVisibleShadows(true);
 
-            // Cull shadow casters
+            // Shadow casters are culled at the end of update()
             UniformBuffer& u = shadowUb;
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            FView::cullRenderables(engine.getJobSystem(), renderableData, frustum,
+            addCullingFrustum(shadowMap.getCamera().getFrustum(),
                     VISIBLE_SPOT_SHADOW_RENDERABLE_N_BIT(i));
 
             mat4f const& lightFromWorldMatrix =
@@ -521,6 +746,30 @@ void ShadowMapManager::fillWithDebugPattern(backend::DriverApi& driverApi,
     }
 }
 
+float ShadowMapManager::computeScreenCoverage(CameraInfo const& camera,
+        float4 const& positionRadius) noexcept {
+    const float r = positionRadius.w;
+    const float d = length(positionRadius.xyz - camera.getPosition());
+    if (d <= r) {
+        return 1.0f;
+    }
+    // with a perspective projection, the sphere is seen under an angle whose tangent is
+    // r / sqrt(d^2 - r^2)
+    const mat4f& p = camera.projection;
+    const float extent = p[2][3] != 0.0f ? r * p[1][1] / std::sqrt(d * d - r * r) : r * p[1][1];
+    return std::min(1.0f, extent);
+}
+
+uint64_t ShadowMapManager::getAtlasCells(size_t level, size_t cell) noexcept {
+    const size_t side = ATLAS_GRID >> level;
+    const uint64_t row = (uint64_t(1) << side) - 1u;
+    uint64_t cells = 0;
+    for (size_t y = 0; y < side; y++) {
+        cells |= row << (cell + y * ATLAS_GRID);
+    }
+    return cells;
+}
+
 void ShadowMapManager::calculateTextureRequirements(FEngine& engine, FView& view,
         FScene::LightSoa& lightData) noexcept {
     auto& lcm = engine.getLightManager();
@@ -537,9 +786,9 @@ void ShadowMapManager::calculateTextureRequirements(FEngine& engine, FView& view
         return std::max((uint8_t) 1u, options.vsm.msaaSamples);
     };
 
-    // Lay out the shadow maps. For now, we take the largest requested dimension and allocate a
-    // texture of that size. Each cascade / shadow map gets its own layer in the array texture.
-    // The directional shadow cascades start on layer 0, followed by spot lights.
+    // Lay out the shadow maps. We take the largest requested dimension and allocate a texture of
+    // that size. Each cascade gets its own layer in the array texture, starting on layer 0. The
+    // spot light shadow maps are packed in an atlas in the following layers.
     uint8_t layer = 0;
     uint16_t maxDimension = 0;
     for (auto& cascade : mCascadeShadowMaps) {
@@ -555,18 +804,102 @@ void ShadowMapManager::calculateTextureRequirements(FEngine& engine, FView& view
         });
     }
     for (auto& spotShadowMap : mSpotShadowMaps) {
-        const size_t lightIndex = spotShadowMap.getLightIndex();
-        const uint16_t dim = getShadowMapSize(lightIndex);
-        const uint8_t vsmSamples = getShadowMapVsmSamples(lightIndex);
-        maxDimension = std::max(maxDimension, dim);
-        spotShadowMap.setLayout({
-            .layer = layer++,
-            .size = dim,
-            .vsmSamples = vsmSamples
+        maxDimension = std::max(maxDimension, (uint16_t)getShadowMapSize(spotShadowMap.getLightIndex()));
+    }
+
+    // Size of the region of the atlas covered by a shadow map at a given level. The regions
+    // below level 0 are multiples of the cell size so that they tile the layer exactly.
+    const uint32_t cellSize = maxDimension / ATLAS_GRID;
+    auto getRegionSize = [&](size_t level) -> uint32_t {
+        return level ? cellSize * uint32_t(ATLAS_GRID >> level) : maxDimension;
+    };
+
+    // Pick the level of each spot shadow map: its requested size is reduced by how much of the
+    // screen its light covers, and we take the smallest region that's still at least that size.
+    const CameraInfo& camera = view.getCameraInfo();
+    uint8_t levels[CONFIG_MAX_SHADOW_CASTING_SPOTS];
+    size_t order[CONFIG_MAX_SHADOW_CASTING_SPOTS];
+    size_t cellCount = 0;
+    for (size_t i = 0, c = mSpotShadowMaps.size(); i < c; i++) {
+        const size_t lightIndex = mSpotShadowMaps[i].getLightIndex();
+        const float coverage = computeScreenCoverage(camera,
+                lightData.elementAt<FScene::POSITION_RADIUS>(lightIndex));
+        const float desired = std::max(3.0f, float(getShadowMapSize(lightIndex)) *
+                std::max(coverage, 1.0f / ATLAS_GRID));
+        uint8_t level = 0;
+        while (level + 1u < ATLAS_LEVELS && float(getRegionSize(level + 1u)) >= desired) {
+            level++;
+        }
+        levels[i] = level;
+        order[i] = i;
+        const size_t side = ATLAS_GRID >> level;
+        cellCount += side * side;
+    }
+
+    // Allocating the largest shadow maps first guarantees that the free space is always made
+    // of whole regions of the current size, so they all fit in as many layers as their area
+    // needs, even when they're put back where they were in the previous frame.
+    std::stable_sort(order, order + mSpotShadowMaps.size(), [&levels](size_t lhs, size_t rhs) {
+        return levels[lhs] < levels[rhs];
+    });
+    constexpr size_t CELLS_PER_LAYER = ATLAS_GRID * ATLAS_GRID;
+    const size_t spotLayerCount = (cellCount + CELLS_PER_LAYER - 1) / CELLS_PER_LAYER;
+    assert(layer + spotLayerCount <= MAX_SHADOW_LAYERS);
+
+    uint64_t occupancy[CONFIG_MAX_SHADOW_CASTING_SPOTS] = {};
+    AtlasSlot slots[CONFIG_MAX_SHADOW_CASTING_SPOTS];
+    for (size_t j = 0, c = mSpotShadowMaps.size(); j < c; j++) {
+        const size_t i = order[j];
+        const uint8_t level = levels[i];
+        const uint32_t light = lightData.elementAt<FScene::LIGHT_INSTANCE>(
+                mSpotShadowMaps[i].getLightIndex()).asValue();
+
+        AtlasSlot slot{ .light = light, .level = level };
+        bool found = false;
+
+        // try the slot this light had in the previous frame first
+        for (size_t k = 0; k < mSpotAtlasSlotCount && !found; k++) {
+            AtlasSlot const& previous = mSpotAtlasSlots[k];
+            if (previous.light == light && previous.level == level &&
+                    previous.layer < spotLayerCount &&
+                    !(occupancy[previous.layer] & getAtlasCells(level, previous.cell))) {
+                slot = previous;
+                found = true;
+            }
+        }
+
+        // otherwise take the first free region
+        const size_t side = ATLAS_GRID >> level;
+        for (size_t l = 0; l < spotLayerCount && !found; l++) {
+            for (size_t cy = 0; cy < ATLAS_GRID && !found; cy += side) {
+                for (size_t cx = 0; cx < ATLAS_GRID && !found; cx += side) {
+                    const size_t cell = cy * ATLAS_GRID + cx;
+                    if (!(occupancy[l] & getAtlasCells(level, cell))) {
+                        slot.layer = uint8_t(l);
+                        slot.cell = uint8_t(cell);
+                        found = true;
+                    }
+                }
+            }
+        }
+        assert(found);
+
+        occupancy[slot.layer] |= getAtlasCells(level, slot.cell);
+        slots[i] = slot;
+
+        const size_t lightIndex = mSpotShadowMaps[i].getLightIndex();
+        mSpotShadowMaps[i].setLayout({
+            .layer = uint8_t(layer + slot.layer),
+            .size = std::min(uint32_t(getShadowMapSize(lightIndex)), getRegionSize(level)),
+            .vsmSamples = getShadowMapVsmSamples(lightIndex),
+            .x = uint16_t((slot.cell % ATLAS_GRID) * cellSize),
+            .y = uint16_t((slot.cell / ATLAS_GRID) * cellSize)
         });
     }
+    std::copy_n(slots, mSpotShadowMaps.size(), mSpotAtlasSlots.begin());
+    mSpotAtlasSlotCount = mSpotShadowMaps.size();
 
-    const uint8_t layersNeeded = layer;
+    const uint8_t layersNeeded = layer + spotLayerCount;
 
     // Only generate mipmaps for VSM when anisotropy is enabled.
     const bool useMipmapping = view.hasVsm() && view.getVsmShadowOptions().anisotropy > 0;
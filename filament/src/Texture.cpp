@@ -28,9 +28,14 @@
 #include <ibl/CubemapUtils.h>
 #include <ibl/Image.h>
 
+#include <math/simd.h>
+
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <filament/Texture.h>
 
+#include <algorithm>
+
 using namespace utils;
 
 namespace filament {
@@ -39,6 +44,8 @@ using namespace backend;
 
 struct Texture::BuilderDetails {
     intptr_t mImportedId = 0;
+    FEngine* mSharedEngine = nullptr;
+    FTexture const* mSharedTexture = nullptr;
     uint32_t mWidth = 1;
     uint32_t mHeight = 1;
     uint32_t mDepth = 1;
@@ -47,6 +54,7 @@ struct Texture::BuilderDetails {
     InternalFormat mFormat = InternalFormat::RGBA8;
     Usage mUsage = Usage::DEFAULT;
     bool mTextureIsSwizzled = false;
+    bool mStreaming = false;
     std::array<Swizzle, 4> mSwizzle = {
            Swizzle::CHANNEL_0, Swizzle::CHANNEL_1,
            Swizzle::CHANNEL_2, Swizzle::CHANNEL_3 };
@@ -102,13 +110,45 @@ Texture::Builder& Texture::Builder::import(intptr_t id) noexcept {
     return *this;
 }
 
+Texture::Builder& Texture::Builder::share(Engine& engine, Texture const* texture) noexcept {
+    mImpl->mSharedEngine = &upcast(engine);
+    mImpl->mSharedTexture = upcast(texture);
+    return *this;
+}
+
 Texture::Builder& Texture::Builder::swizzle(Swizzle r, Swizzle g, Swizzle b, Swizzle a) noexcept {
     mImpl->mTextureIsSwizzled = true;
     mImpl->mSwizzle = { r, g, b, a };
     return *this;
 }
 
+Texture::Builder& Texture::Builder::streaming(bool enabled) noexcept {
+    mImpl->mStreaming = enabled;
+    return *this;
+}
+
 Texture* Texture::Builder::build(Engine& engine) {
+    if (mImpl->mSharedTexture) {
+        FTexture const* texture = mImpl->mSharedTexture;
+        mImpl->mWidth = uint32_t(texture->getWidth());
+        mImpl->mHeight = uint32_t(texture->getHeight());
+        mImpl->mDepth = uint32_t(texture->getDepth());
+        mImpl->mLevels = uint8_t(texture->getLevelCount());
+        mImpl->mTarget = texture->getTarget();
+        mImpl->mFormat = texture->getFormat();
+        mImpl->mUsage = texture->getUsage();
+
+        // the backend object of the texture is created by the driver thread of its Engine
+        FEngine& sharedEngine = *mImpl->mSharedEngine;
+        sharedEngine.flushAndWait();
+        mImpl->mImportedId = sharedEngine.getDriverApi().getTextureNativeId(
+                texture->getHwHandle());
+        if (!ASSERT_POSTCONDITION_NON_FATAL(mImpl->mImportedId,
+                "Textures can't be shared with this backend")) {
+            return nullptr;
+        }
+    }
+
     if (!ASSERT_POSTCONDITION_NON_FATAL(Texture::isTextureFormatSupported(engine, mImpl->mFormat),
             "Texture format %u not supported on this platform", mImpl->mFormat)) {
         return nullptr;
@@ -128,6 +168,13 @@ Texture* Texture::Builder::build(Engine& engine) {
     ASSERT_POSTCONDITION_NON_FATAL((imported && sampleable) || !imported,
             "Imported texture must be SAMPLEABLE");
 
+    if (!ASSERT_PRECONDITION_NON_FATAL(!mImpl->mStreaming ||
+            (mImpl->mTarget == Sampler::SAMPLER_2D && mImpl->mUsage == TextureUsage::DEFAULT &&
+                    !imported),
+            "Streaming textures must be SAMPLER_2D, with the DEFAULT usage and not imported")) {
+        return nullptr;
+    }
+
     return upcast(engine).createTexture(*this);
 }
 
@@ -157,11 +204,22 @@ FTexture::FTexture(FEngine& engine, const Builder& builder) {
         mHandle = driver.importTexture(builder->mImportedId,
                 mTarget, mLevelCount, mFormat, mSampleCount, mWidth, mHeight, mDepth, mUsage);
     }
+
+    if (builder->mStreaming) {
+        // nothing is resident until the application uploads the least detailed level
+        mStreaming = true;
+        mResidentLevel = mLevelCount;
+        mRequestedLevel = uint8_t(mLevelCount - 1);
+        engine.getTextureStreamer().add(this);
+    }
 }
 
 // frees driver resources, object becomes invalid
 void FTexture::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
+    if (mStreaming) {
+        engine.getTextureStreamer().remove(this);
+    }
     driver.destroyTexture(mHandle);
 }
 
@@ -177,6 +235,89 @@ size_t FTexture::getDepth(size_t level) const noexcept {
     return valueForLevel(level, mDepth);
 }
 
+size_t FTexture::getSize(size_t firstLevel) const noexcept {
+    if (mTarget == Sampler::SAMPLER_EXTERNAL) {
+        // the image belongs to the platform
+        return 0;
+    }
+    const size_t blockWidth = std::max(size_t(1), getBlockWidth(mFormat));
+    const size_t blockHeight = std::max(size_t(1), getBlockHeight(mFormat));
+    const size_t layers = isCubemap() ? 6 : mDepth;
+    size_t size = 0;
+    for (size_t level = firstLevel; level < mLevelCount; level++) {
+        const size_t w = (getWidth(level) + blockWidth - 1) / blockWidth;
+        const size_t h = (getHeight(level) + blockHeight - 1) / blockHeight;
+        size += w * h * getFormatSize(mFormat);
+    }
+    return size * layers * std::max(uint8_t(1), mSampleCount);
+}
+
+// A backend that stores a 3-component format with 4 components, e.g. RGB8 on Vulkan, reshapes the
+// pixels on the driver thread, in the middle of a frame. Tightly packed pixels are reshaped here
+// instead, by the JobSystem, into staging memory the backend can upload without copy.
+// Returns true if the buffer was replaced with the reshaped pixels, whose byte offsets are then
+// 4/3 of the original ones.
+static bool reshapePixels(FEngine& engine, TextureFormat format,
+        Texture::PixelBufferDescriptor& buffer, uint32_t width) {
+    if (buffer.format != PixelDataFormat::RGB && buffer.format != PixelDataFormat::RGB_INTEGER) {
+        return false;
+    }
+
+    size_t componentSize;
+    switch (buffer.type) {
+        case PixelDataType::UBYTE:
+        case PixelDataType::BYTE:
+            componentSize = 1;
+            break;
+        case PixelDataType::USHORT:
+        case PixelDataType::SHORT:
+        case PixelDataType::HALF:
+            componentSize = 2;
+            break;
+        default:
+            return false;
+    }
+
+    const size_t bytesPerPixel = 3 * componentSize;
+    const bool tightlyPacked = !buffer.left && !buffer.top &&
+            (!buffer.stride || buffer.stride == width) && !(buffer.size % bytesPerPixel) &&
+            Texture::PixelBufferDescriptor::computeDataSize(buffer.format, buffer.type,
+                    width, 1, buffer.alignment) == width * bytesPerPixel;
+    if (!tightlyPacked || !engine.getDriverApi().isTextureFormatReshaped(format)) {
+        return false;
+    }
+
+    const size_t pixelCount = buffer.size / bytesPerPixel;
+    BufferDescriptor staging = engine.allocateStaging(pixelCount * 4 * componentSize);
+
+    // the 4th component is set like the backends do: 1 for 8-bit formats, 1.0h for 16-bit ones
+    constexpr size_t PIXELS_PER_JOB = 16384;
+    void* const dst = staging.buffer;
+    void const* const src = buffer.buffer;
+    auto reshape = [=](uint32_t start, uint32_t count) {
+        const size_t first = start * PIXELS_PER_JOB;
+        const size_t last = std::min(pixelCount, (start + count) * PIXELS_PER_JOB);
+        if (componentSize == 1) {
+            math::simd::expand3to4((uint8_t*)dst + first * 4, (uint8_t const*)src + first * 3,
+                    uint8_t(0xFF), last - first);
+        } else {
+            math::simd::expand3to4((uint16_t*)dst + first * 4, (uint16_t const*)src + first * 3,
+                    uint16_t(0x3C00), last - first);
+        }
+    };
+    JobSystem& js = engine.getJobSystem();
+    const uint32_t jobCount = uint32_t((pixelCount + PIXELS_PER_JOB - 1) / PIXELS_PER_JOB);
+    js.runAndWait(jobs::parallel_for(js, nullptr, 0, jobCount,
+            std::cref(reshape), jobs::CountSplitter<1, 8>()));
+
+    // this releases the client's buffer
+    buffer = Texture::PixelBufferDescriptor(std::move(staging),
+            buffer.format == PixelDataFormat::RGB ?
+                    PixelDataFormat::RGBA : PixelDataFormat::RGBA_INTEGER,
+            buffer.type);
+    return true;
+}
+
 void FTexture::setImage(FEngine& engine,
         size_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         Texture::PixelBufferDescriptor&& buffer) const {
@@ -235,8 +376,15 @@ void FTexture::setImage(FEngine& engine,
         return;
     }
 
+    reshapePixels(engine, mFormat, buffer, width);
+
     engine.getDriverApi().update2DImage(mHandle,
             uint8_t(level), xoffset, yoffset, width, height, std::move(buffer));
+
+    if (mStreaming && xoffset == 0 && yoffset == 0 &&
+            width == valueForLevel(level, mWidth) && height == valueForLevel(level, mHeight)) {
+        engine.getTextureStreamer().setLevelUploaded(engine.getDriverApi(), this, uint8_t(level));
+    }
 }
 
 void FTexture::setImage(FEngine& engine,
@@ -306,6 +454,8 @@ void FTexture::setImage(FEngine& engine,
         return;
     }
 
+    reshapePixels(engine, mFormat, buffer, width);
+
     engine.getDriverApi().update3DImage(mHandle,
             uint8_t(level), xoffset, yoffset, zoffset, width, height, depth, std::move(buffer));
 }
@@ -350,8 +500,15 @@ void FTexture::setImage(FEngine& engine, size_t level,
         return;
     }
 
+    FaceOffsets offsets = faceOffsets;
+    if (reshapePixels(engine, mFormat, buffer, valueForLevel(level, mWidth))) {
+        for (size_t i = 0; i < 6; i++) {
+            offsets[i] = offsets[i] / 3 * 4;
+        }
+    }
+
     engine.getDriverApi().updateCubeImage(mHandle, uint8_t(level),
-            std::move(buffer), faceOffsets);
+            std::move(buffer), offsets);
 }
 
 void FTexture::setExternalImage(FEngine& engine, void* image) noexcept {
@@ -387,8 +544,15 @@ void FTexture::setExternalStream(FEngine& engine, FStream* stream) noexcept {
 }
 
 void FTexture::generateMipmaps(FEngine& engine) const noexcept {
-    const bool formatMipmappable = engine.getDriverApi().isTextureFormatMipmappable(mFormat);
-    if (!ASSERT_POSTCONDITION_NON_FATAL(formatMipmappable, "Texture format is not mipmappable.")) {
+    FEngine::DriverApi& driver = engine.getDriverApi();
+
+    // Formats the backend can't mipmap, e.g. integer formats which aren't filterable, are
+    // downsampled level by level with blits instead, which only requires them to be renderable.
+    const bool formatMipmappable = driver.isTextureFormatMipmappable(mFormat);
+    const bool formatRenderable = !isDepthFormat(mFormat) &&
+            driver.isRenderTargetFormatSupported(mFormat);
+    if (!ASSERT_POSTCONDITION_NON_FATAL(formatMipmappable || formatRenderable,
+            "Texture format is not mipmappable.")) {
         return;
     }
 
@@ -396,14 +560,16 @@ void FTexture::generateMipmaps(FEngine& engine) const noexcept {
         return;
     }
 
-    if (engine.getDriverApi().canGenerateMipmaps()) {
-        engine.getDriverApi().generateMipmaps(mHandle);
+    if (formatMipmappable && driver.canGenerateMipmaps()) {
+        driver.generateMipmaps(mHandle);
         return;
     }
 
-    auto generateMipsForLayer = [this, &engine](uint16_t layer) {
-        FEngine::DriverApi& driver = engine.getDriverApi();
+    // integer formats can't be filtered, each texel of a level is one of the level above
+    const SamplerMagFilter filter = isIntegerFormat(mFormat) ?
+            SamplerMagFilter::NEAREST : SamplerMagFilter::LINEAR;
 
+    auto generateMipsForLayer = [this, &driver, filter](uint16_t layer) {
         // Wrap miplevel 0 in a render target so that we can use it as a blit source.
         uint8_t level = 0;
         uint32_t srcw = mWidth;
@@ -421,7 +587,7 @@ void FTexture::generateMipmaps(FEngine& engine) const noexcept {
             driver.blit(TargetBufferFlags::COLOR,
                     dstrth, { 0, 0, dstw, dsth },
                     srcrth, { 0, 0, srcw, srch },
-                    SamplerMagFilter::LINEAR);
+                    filter);
             driver.destroyRenderTarget(srcrth);
             srcrth = dstrth;
             srcw = dstw;
@@ -436,6 +602,10 @@ void FTexture::generateMipmaps(FEngine& engine) const noexcept {
         for (uint16_t layer = 0; layer < 6; ++layer) {
             generateMipsForLayer(layer);
         }
+    } else if (mTarget == Sampler::SAMPLER_2D_ARRAY) {
+        for (uint16_t layer = 0; layer < mDepth; ++layer) {
+            generateMipsForLayer(layer);
+        }
     }
 }
 
@@ -1043,6 +1213,18 @@ Texture::InternalFormat Texture::getFormat() const noexcept {
     return upcast(this)->getFormat();
 }
 
+bool Texture::isStreaming() const noexcept {
+    return upcast(this)->isStreaming();
+}
+
+size_t Texture::getResidentLevel() const noexcept {
+    return upcast(this)->getResidentLevel();
+}
+
+size_t Texture::getRequestedLevel() const noexcept {
+    return upcast(this)->getRequestedLevel();
+}
+
 void Texture::setImage(Engine& engine, size_t level,
         Texture::PixelBufferDescriptor&& buffer) const {
     upcast(this)->setImage(upcast(engine),
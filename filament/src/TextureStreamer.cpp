@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TextureStreamer.h"
+
+#include "details/Texture.h"
+
+#include "private/backend/BackendUtils.h"
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <assert.h>
+#include <math.h>
+
+namespace filament {
+
+using namespace backend;
+
+TextureStreamer::~TextureStreamer() noexcept {
+    assert(mTextures.empty());
+}
+
+void TextureStreamer::add(FTexture* texture) noexcept {
+    assert(texture->isStreaming());
+    mTextures.insert({ texture->getHwHandle().getId(),
+            { texture, uint8_t(texture->getLevelCount()) }});
+}
+
+void TextureStreamer::remove(FTexture const* texture) noexcept {
+    if (texture->mResidentLevel < texture->getLevelCount()) {
+        mResidentSize -= getSize(texture, texture->mResidentLevel);
+    }
+    mTextures.erase(texture->getHwHandle().getId());
+}
+
+size_t TextureStreamer::getSize(FTexture const* texture, uint8_t first) noexcept {
+    return texture->getSize(first);
+}
+
+void TextureStreamer::setLevelUploaded(DriverApi& driver,
+        FTexture const* texture, uint8_t level) noexcept {
+    auto pos = mTextures.find(texture->getHwHandle().getId());
+    if (UTILS_UNLIKELY(pos == mTextures.end())) {
+        return;
+    }
+    // the resident levels are contiguous, so only the level right above them extends them
+    FTexture* const t = pos->second.texture;
+    if (level + 1 == t->mResidentLevel) {
+        mResidentSize += getSize(t, level) - getSize(t, t->mResidentLevel);
+        t->mResidentLevel = level;
+        driver.setMinMaxLevels(t->getHwHandle(), level, t->getLevelCount() - 1);
+    }
+}
+
+void TextureStreamer::request(TextureHandle handle, float scale) noexcept {
+    auto pos = mTextures.find(handle.getId());
+    if (pos == mTextures.end()) {
+        return;
+    }
+    Entry& entry = pos.value();
+    FTexture const* const t = entry.texture;
+    const float size = float(std::max(t->getWidth(), t->getHeight()));
+    const float level = std::floor(std::log2(size * scale));
+    const uint8_t needed = uint8_t(std::clamp(level, 0.0f, float(t->getLevelCount() - 1)));
+    entry.neededLevel = std::min(entry.neededLevel, needed);
+}
+
+void TextureStreamer::update(DriverApi& driver, size_t budget) noexcept {
+    struct Candidate {
+        Entry* entry;
+        uint8_t level;      // most detailed level kept
+        bool requested;     // whether the texture was sampled in the last frame
+        size_t size;        // size in bytes of 'level'
+    };
+
+    // Textures sampled in the last frame get the levels requested, the others keep their
+    // resident levels, or get their least detailed level if they have none.
+    std::vector<Candidate> candidates;
+    candidates.reserve(mTextures.size());
+    size_t total = 0;
+    for (auto it = mTextures.begin(); it != mTextures.end(); ++it) {
+        Entry& entry = it.value();
+        FTexture const* const t = entry.texture;
+        const uint8_t levelCount = uint8_t(t->getLevelCount());
+        const bool requested = entry.neededLevel < levelCount;
+        const uint8_t level = requested ? entry.neededLevel :
+                std::min(t->mResidentLevel, uint8_t(levelCount - 1));
+        const size_t size = getSize(t, level);
+        candidates.push_back({ &entry, level, requested, size - getSize(t, level + 1) });
+        total += size;
+    }
+
+    // Over budget, drop the most detailed level of the textures not sampled in the last frame
+    // first, then of the textures whose most detailed level is the largest. The least detailed
+    // level of a texture is never dropped.
+    auto priority = [](Candidate const* lhs, Candidate const* rhs) {
+        return lhs->requested != rhs->requested ? lhs->requested : lhs->size < rhs->size;
+    };
+    if (budget && total > budget) {
+        std::vector<Candidate*> heap;
+        heap.reserve(candidates.size());
+        for (Candidate& candidate : candidates) {
+            if (candidate.level + 1 < candidate.entry->texture->getLevelCount()) {
+                heap.push_back(&candidate);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), priority);
+        while (total > budget && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), priority);
+            Candidate* const candidate = heap.back();
+            FTexture const* const t = candidate->entry->texture;
+            total -= candidate->size;
+            candidate->level++;
+            if (candidate->level + 1 < t->getLevelCount()) {
+                candidate->size = getSize(t, candidate->level) - getSize(t, candidate->level + 1);
+                std::push_heap(heap.begin(), heap.end(), priority);
+            } else {
+                heap.pop_back();
+            }
+        }
+    }
+
+    for (Candidate const& candidate : candidates) {
+        FTexture* const t = candidate.entry->texture;
+        t->mRequestedLevel = candidate.level;
+        if (t->mResidentLevel < candidate.level) {
+            mResidentSize -= getSize(t, t->mResidentLevel) - getSize(t, candidate.level);
+            t->mResidentLevel = candidate.level;
+            driver.setMinMaxLevels(t->getHwHandle(), candidate.level, t->getLevelCount() - 1);
+        }
+        candidate.entry->neededLevel = uint8_t(t->getLevelCount());
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_TEXTURESTREAMER_H
+#define TNT_FILAMENT_TEXTURESTREAMER_H
+
+#include <backend/Handle.h>
+
+#include "private/backend/DriverApiForward.h"
+
+#include <tsl/robin_map.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+class FTexture;
+
+/*
+ * Decides which levels of the streaming textures should be resident, see
+ * Texture::Builder::streaming().
+ *
+ * While a frame is rendered, the views request the level each streaming texture needs from the
+ * screen coverage of the renderables sampling it. At the beginning of the next frame, update()
+ * trims these requests to the Engine's budget and evicts the levels that are no longer needed.
+ * The application uploads the levels still missing, from the least to the most detailed.
+ * This is only used from the main thread.
+ */
+class TextureStreamer {
+public:
+    TextureStreamer() noexcept = default;
+    TextureStreamer(TextureStreamer const& rhs) = delete;
+    TextureStreamer& operator=(TextureStreamer const& rhs) = delete;
+    ~TextureStreamer() noexcept;
+
+    void add(FTexture* texture) noexcept;
+    void remove(FTexture const* texture) noexcept;
+
+    bool empty() const noexcept { return mTextures.empty(); }
+
+    // records that 'level' of a streaming texture was uploaded as a whole
+    void setLevelUploaded(backend::DriverApi& driver,
+            FTexture const* texture, uint8_t level) noexcept;
+
+    // Requests the levels of the streaming texture 'handle' -- if it is one -- needed to sample
+    // it across 'scale' times as many pixels as the texture is wide, i.e. the level is
+    // log2(max(width, height) * scale).
+    void request(backend::TextureHandle handle, float scale) noexcept;
+
+    // trims the requests made since the last call to 'budget' bytes (0 means no budget), and
+    // evicts the levels that are no longer requested
+    void update(backend::DriverApi& driver, size_t budget) noexcept;
+
+    // estimated size in bytes of the resident levels of all streaming textures
+    size_t getResidentSize() const noexcept { return mResidentSize; }
+
+private:
+    struct Entry {
+        FTexture* texture;
+        uint8_t neededLevel;    // most detailed level requested this frame, level count if none
+    };
+
+    // estimated size in bytes of the levels [first, levelCount) of 'texture'
+    static size_t getSize(FTexture const* texture, uint8_t first) noexcept;
+
+    tsl::robin_map<backend::HandleBase::HandleId, Entry> mTextures;
+    size_t mResidentSize = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_TEXTURESTREAMER_H
@@ -26,7 +26,8 @@ namespace filament {
 UniformBuffer::UniformBuffer(size_t size) noexcept
         : mBuffer(mStorage),
           mSize(uint32_t(size)),
-          mSomethingDirty(true) {
+          mDirtyBegin(0),
+          mDirtyEnd(uint32_t(size)) {
     if (UTILS_LIKELY(size > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(size);
     }
@@ -36,7 +37,8 @@ UniformBuffer::UniformBuffer(size_t size) noexcept
 UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
         : mBuffer(rhs.mBuffer),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mDirtyBegin(rhs.mDirtyBegin),
+          mDirtyEnd(rhs.mDirtyEnd) {
     if (UTILS_LIKELY(rhs.isLocalStorage())) {
         mBuffer = mStorage;
         memcpy(mBuffer, rhs.mBuffer, mSize);
@@ -47,7 +49,8 @@ UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
 
 UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     if (this != &rhs) {
-        mSomethingDirty = rhs.mSomethingDirty;
+        mDirtyBegin = rhs.mDirtyBegin;
+        mDirtyEnd = rhs.mDirtyEnd;
         if (UTILS_LIKELY(rhs.isLocalStorage())) {
             mBuffer = mStorage;
             mSize = rhs.mSize;
@@ -81,6 +84,26 @@ UniformBuffer& UniformBuffer::setUniforms(const UniformBuffer& rhs) noexcept {
     return *this;
 }
 
+void UniformBuffer::setUniforms(size_t offset, void const* data, size_t size) noexcept {
+    assert(offset + size <= mSize);
+    uint8_t const* const src = static_cast<uint8_t const*>(data);
+    uint8_t* const dst = static_cast<uint8_t*>(mBuffer) + offset;
+
+    // find the first and last bytes that differ, so that only those are uploaded
+    size_t begin = 0;
+    while (begin < size && src[begin] == dst[begin]) {
+        begin++;
+    }
+    if (begin == size) {
+        return;
+    }
+    size_t end = size;
+    while (src[end - 1] == dst[end - 1]) {
+        end--;
+    }
+    memcpy(invalidateUniforms(offset + begin, end - begin), src + begin, end - begin);
+}
+
 void* UniformBuffer::alloc(size_t size) noexcept {
     // these allocations have a long life span
     return ::malloc(size);
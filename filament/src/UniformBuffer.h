@@ -69,7 +69,13 @@ public:
     // invalidate a range of uniforms and return a pointer to it. offset and size given in bytes
     void* invalidateUniforms(size_t offset, size_t size) {
         assert(offset + size <= mSize);
-        mSomethingDirty = true;
+        if (isDirty()) {
+            mDirtyBegin = std::min(mDirtyBegin, uint32_t(offset));
+            mDirtyEnd = std::max(mDirtyEnd, uint32_t(offset + size));
+        } else {
+            mDirtyBegin = uint32_t(offset);
+            mDirtyEnd = uint32_t(offset + size);
+        }
         return static_cast<char*>(mBuffer) + offset;
     }
 
@@ -83,11 +89,19 @@ public:
     // size of the uniform buffer in bytes
     size_t getSize() const noexcept { return mSize; }
 
+    // copy a range of uniforms laid out like the buffer, only the bytes that differ from the
+    // current content are invalidated. offset and size given in bytes
+    void setUniforms(size_t offset, void const* data, size_t size) noexcept;
+
     // return if any uniform has been changed
-    bool isDirty() const noexcept { return mSomethingDirty; }
+    bool isDirty() const noexcept { return mDirtyBegin < mDirtyEnd; }
+
+    // range of the changed uniforms in bytes, which covers all of them
+    size_t getDirtyOffset() const noexcept { return mDirtyBegin; }
+    size_t getDirtySize() const noexcept { return mDirtyEnd - mDirtyBegin; }
 
     // mark the whole buffer as clean (no modified uniforms)
-    void clean() const noexcept { mSomethingDirty = false; }
+    void clean() const noexcept { mDirtyBegin = mDirtyEnd = 0; }
 
     /*
      * -----------------------------------------------
@@ -196,7 +210,9 @@ private:
     char mStorage[96];
     void *mBuffer = nullptr;
     uint32_t mSize = 0;
-    mutable bool mSomethingDirty = false;
+    // range of the changed uniforms, empty if none changed
+    mutable uint32_t mDirtyBegin = 0;
+    mutable uint32_t mDirtyEnd = 0;
 };
 
 // specialization for mat3f (which has a different alignment, see std140 layout rules)
@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "UniformBufferArena.h"
+
+#include "private/backend/DriverApi.h"
+
+#include <utils/compiler.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include <assert.h>
+#include <string.h>
+
+namespace filament {
+
+using namespace backend;
+
+UniformBufferArena::UniformBufferArena(size_t bufferSize, size_t bindingSize) noexcept
+        : mBufferSize(uint32_t(bufferSize)), mBindingSize(uint32_t(bindingSize)) {
+    assert(bufferSize >= MAX_SLOT_SIZE && bufferSize % MAX_SLOT_SIZE == 0);
+}
+
+UniformBufferArena::~UniformBufferArena() noexcept {
+    assert(mBuffers.empty());
+}
+
+void UniformBufferArena::terminate(DriverApi& driver) noexcept {
+#ifndef NDEBUG
+    if (mSlotCount) {
+        utils::slog.w << mSlotCount << " uniform buffer slots were not freed" << utils::io::endl;
+    }
+#endif
+    for (auto const& buffer : mBuffers) {
+        driver.destroyUniformBuffer(buffer->handle);
+    }
+    mBuffers.clear();
+    mDirtyBuffers.clear();
+    for (auto& slots : mFreeSlots) {
+        slots.clear();
+    }
+    mSlotCount = 0;
+    mBufferBytes = 0;
+}
+
+size_t UniformBufferArena::getSizeClass(size_t size) noexcept {
+    size_t sizeClass = 0;
+    while ((MIN_SLOT_SIZE << sizeClass) < size) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+UniformBufferArena::Buffer* UniformBufferArena::createBuffer(
+        DriverApi& driver, size_t size) noexcept {
+    auto buffer = std::make_unique<Buffer>();
+    buffer->handle = driver.createUniformBuffer(size, BufferUsage::DYNAMIC);
+    // zero-initialized, like the GPU buffer before its first update
+    buffer->data = std::make_unique<uint8_t[]>(size);
+    buffer->size = uint32_t(size);
+    mBufferBytes += size;
+    mBuffers.push_back(std::move(buffer));
+    return mBuffers.back().get();
+}
+
+UniformBufferArena::Slot UniformBufferArena::allocate(DriverApi& driver, size_t size) noexcept {
+    mSlotCount++;
+
+    if (UTILS_UNLIKELY(size > MAX_SLOT_SIZE)) {
+        // too large to share a buffer
+        Buffer* const buffer = createBuffer(driver, std::max(size, size_t(mBindingSize)));
+        return { buffer->handle, 0, uint32_t(size), buffer };
+    }
+
+    const size_t sizeClass = getSizeClass(size);
+    auto& freeSlots = mFreeSlots[sizeClass];
+    if (freeSlots.empty()) {
+        // split a new buffer into slots, handed out in increasing offsets
+        const uint32_t slotSize = uint32_t(MIN_SLOT_SIZE << sizeClass);
+        const uint32_t padding = mBindingSize > slotSize ? mBindingSize - slotSize : 0;
+        Buffer* const buffer = createBuffer(driver, mBufferSize + padding);
+        for (uint32_t offset = mBufferSize; offset > 0; offset -= slotSize) {
+            freeSlots.push_back({ buffer->handle, offset - slotSize, slotSize, buffer });
+        }
+    }
+
+    Slot slot = freeSlots.back();
+    freeSlots.pop_back();
+    return slot;
+}
+
+void UniformBufferArena::free(DriverApi& driver, Slot const& slot) noexcept {
+    if (!slot.handle) {
+        return;
+    }
+
+    assert(mSlotCount);
+    mSlotCount--;
+
+    if (UTILS_UNLIKELY(slot.size > MAX_SLOT_SIZE)) {
+        auto dirty = std::find(mDirtyBuffers.begin(), mDirtyBuffers.end(), slot.buffer);
+        if (dirty != mDirtyBuffers.end()) {
+            mDirtyBuffers.erase(dirty);
+        }
+        auto pos = std::find_if(mBuffers.begin(), mBuffers.end(),
+                [&slot](auto const& buffer) { return buffer.get() == slot.buffer; });
+        assert(pos != mBuffers.end());
+        mBufferBytes -= slot.buffer->size;
+        driver.destroyUniformBuffer(slot.handle);
+        mBuffers.erase(pos);
+        return;
+    }
+
+    mFreeSlots[getSizeClass(slot.size)].push_back(slot);
+}
+
+void UniformBufferArena::update(Slot const& slot,
+        size_t offset, void const* data, size_t size) noexcept {
+    Buffer* const buffer = slot.buffer;
+    assert(buffer);
+    assert(offset + size <= slot.size);
+    if (UTILS_UNLIKELY(!size)) {
+        return;
+    }
+    const uint32_t begin = slot.offset + uint32_t(offset);
+    const uint32_t end = begin + uint32_t(size);
+    memcpy(buffer->data.get() + begin, data, size);
+    if (buffer->dirtyBegin == buffer->dirtyEnd) {
+        mDirtyBuffers.push_back(buffer);
+        buffer->dirtyBegin = begin;
+        buffer->dirtyEnd = end;
+    } else {
+        buffer->dirtyBegin = std::min(buffer->dirtyBegin, begin);
+        buffer->dirtyEnd = std::max(buffer->dirtyEnd, end);
+    }
+}
+
+size_t UniformBufferArena::flush(DriverApi& driver) noexcept {
+    size_t bytes = 0;
+    for (Buffer* buffer : mDirtyBuffers) {
+        // the range between the updated slots is uploaded too, which costs less than an update
+        // per slot
+        const uint32_t size = buffer->dirtyEnd - buffer->dirtyBegin;
+        void* const p = driver.allocate(size);
+        memcpy(p, buffer->data.get() + buffer->dirtyBegin, size);
+        driver.updateUniformBuffer(buffer->handle, { p, size }, buffer->dirtyBegin);
+        buffer->dirtyBegin = buffer->dirtyEnd = 0;
+        bytes += size;
+    }
+    mDirtyBuffers.clear();
+    return bytes;
+}
+
+UniformBufferArena::Statistics UniformBufferArena::getStatistics() const noexcept {
+    return { .bufferCount = mBuffers.size(), .slotCount = mSlotCount,
+            .bufferBytes = mBufferBytes };
+}
+
+} // namespace filament
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_UNIFORMBUFFERARENA_H
+#define TNT_FILAMENT_UNIFORMBUFFERARENA_H
+
+#include <backend/Handle.h>
+
+#include "private/backend/DriverApiForward.h"
+
+#include <array>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Sub-allocates small uniform buffers, such as the ones of material instances, from a few large
+ * GPU buffers.
+ *
+ * Slots have a power-of-two size between MIN_SLOT_SIZE and MAX_SLOT_SIZE, a multiple of the
+ * largest uniform buffer offset alignment in use, so they can be bound with
+ * bindUniformBufferRange(). Each GPU buffer is split into slots of a single size, freed slots are
+ * reused by the next allocation of the same size. Allocations larger than the buffers get a
+ * buffer of their own.
+ *
+ * Uniform blocks must be bound with a range no smaller than their declared size, even when only
+ * a part of it is used (e.g. the bones). In that case the buffers are padded so that 'bindingSize'
+ * bytes can be bound from any slot.
+ *
+ * The content of the slots is written with update() into a copy of each GPU buffer, flush() then
+ * uploads the range written since the last flush with a single update per GPU buffer, which is
+ * much cheaper than one update per slot on backends that copy the whole buffer to update it.
+ *
+ * GPU buffers are only destroyed by terminate(). This is only used from the main thread.
+ */
+class UniformBufferArena {
+public:
+    // minimum size of a uniform block guaranteed by OpenGL ES 3.0
+    static constexpr size_t MAX_SLOT_SIZE = 16384;
+    static constexpr size_t MIN_SLOT_SIZE = 256;
+
+    // a GPU buffer and the copy of its content written by update()
+    struct Buffer {
+        backend::Handle<backend::HwUniformBuffer> handle;
+        std::unique_ptr<uint8_t[]> data;
+        uint32_t size = 0;
+        uint32_t dirtyBegin = 0;
+        uint32_t dirtyEnd = 0;
+    };
+
+    struct Slot {
+        backend::Handle<backend::HwUniformBuffer> handle;
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        Buffer* buffer = nullptr;
+    };
+
+    struct Statistics {
+        size_t bufferCount = 0;     // GPU buffers alive
+        size_t slotCount = 0;       // slots in use
+        size_t bufferBytes = 0;     // size of the GPU buffers alive
+    };
+
+    // bufferSize: size of the shared GPU buffers, a multiple of MAX_SLOT_SIZE
+    // bindingSize: size of the range bound from a slot, 0 if it's the size of the slot
+    explicit UniformBufferArena(size_t bufferSize = MAX_SLOT_SIZE, size_t bindingSize = 0) noexcept;
+    UniformBufferArena(UniformBufferArena const& rhs) = delete;
+    UniformBufferArena& operator=(UniformBufferArena const& rhs) = delete;
+    ~UniformBufferArena() noexcept;
+
+    // destroys all the GPU buffers, slots that were not freed become invalid
+    void terminate(backend::DriverApi& driver) noexcept;
+
+    // returns a slot of at least 'size' bytes
+    Slot allocate(backend::DriverApi& driver, size_t size) noexcept;
+
+    // returns a slot obtained from allocate() to the arena
+    void free(backend::DriverApi& driver, Slot const& slot) noexcept;
+
+    // writes 'size' bytes at 'offset' in the slot, they're uploaded by the next flush()
+    void update(Slot const& slot, size_t offset, void const* data, size_t size) noexcept;
+
+    // uploads everything written by update() since the last flush, returns the number of bytes
+    // uploaded
+    size_t flush(backend::DriverApi& driver) noexcept;
+
+    Statistics getStatistics() const noexcept;
+
+private:
+    // log2(MAX_SLOT_SIZE / MIN_SLOT_SIZE) + 1
+    static constexpr size_t SIZE_CLASS_COUNT = 7;
+    static_assert(MIN_SLOT_SIZE << (SIZE_CLASS_COUNT - 1) == MAX_SLOT_SIZE);
+
+    static size_t getSizeClass(size_t size) noexcept;
+
+    Buffer* createBuffer(backend::DriverApi& driver, size_t size) noexcept;
+
+    std::array<std::vector<Slot>, SIZE_CLASS_COUNT> mFreeSlots;
+    std::vector<std::unique_ptr<Buffer>> mBuffers;
+    std::vector<Buffer*> mDirtyBuffers;
+    size_t mSlotCount = 0;
+    size_t mBufferBytes = 0;
+    const uint32_t mBufferSize;
+    const uint32_t mBindingSize;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_UNIFORMBUFFERARENA_H
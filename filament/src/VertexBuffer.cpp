@@ -172,6 +172,23 @@ FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& build
     // NOTE: This flag needs to be set regardless of whether the attribute is actually declared.
     attributeArray[BONE_INDICES].flags |= Attribute::FLAG_INTEGER_TARGET;
 
+    // The depth attributes can be fetched alone if none of their buffers holds another attribute.
+    AttributeBitset depthAttributes;
+    for (VertexAttribute attribute : { POSITION, BONE_INDICES, BONE_WEIGHTS,
+            MORPH_POSITION_0, MORPH_POSITION_1, MORPH_POSITION_2, MORPH_POSITION_3 }) {
+        depthAttributes.set(attribute, declaredAttributes[attribute]);
+    }
+    const AttributeBitset otherAttributes = declaredAttributes & ~depthAttributes;
+    bool interleaved = false;
+    otherAttributes.forEachSetBit([&](size_t i) {
+        depthAttributes.forEachSetBit([&](size_t j) {
+            interleaved = interleaved || attributes[i].buffer == attributes[j].buffer;
+        });
+    });
+    if (depthAttributes[POSITION] && otherAttributes.any() && !interleaved) {
+        mDepthAttributes = depthAttributes;
+    }
+
     FEngine::DriverApi& driver = engine.getDriverApi();
     mHandle = driver.createVertexBuffer(
             mBufferCount, attributeCount, mVertexCount, attributeArray, backend::BufferUsage::STATIC);
@@ -186,6 +203,23 @@ size_t FVertexBuffer::getVertexCount() const noexcept {
     return mVertexCount;
 }
 
+size_t FVertexBuffer::getSize() const noexcept {
+    // a buffer is as large as the stride of its attributes times the vertex count
+    uint32_t strides[backend::MAX_VERTEX_ATTRIBUTE_COUNT] = {};
+    mDeclaredAttributes.forEachSetBit([&](size_t i) {
+        AttributeData const& attribute = mAttributes[i];
+        if (attribute.buffer < backend::MAX_VERTEX_ATTRIBUTE_COUNT) {
+            strides[attribute.buffer] = std::max(strides[attribute.buffer],
+                    uint32_t(attribute.stride));
+        }
+    });
+    size_t size = 0;
+    for (uint32_t stride : strides) {
+        size += size_t(stride) * mVertexCount;
+    }
+    return size;
+}
+
 void FVertexBuffer::setBufferAt(FEngine& engine, uint8_t bufferIndex,
         backend::BufferDescriptor&& buffer, uint32_t byteOffset) {
     if (bufferIndex < mBufferCount) {
@@ -24,10 +24,13 @@
 #include "details/Froxelizer.h"
 #include "details/IndirectLight.h"
 #include "details/Renderer.h"
+#include "details/RenderPrimitive.h"
 #include "details/RenderTarget.h"
 #include "details/Scene.h"
 #include "details/Skybox.h"
 
+#include "private/backend/CommandStream.h"
+
 #include <filament/Exposure.h>
 #include <filament/TextureSampler.h>
 
@@ -41,9 +44,15 @@
 #include <math/scalar.h>
 #include <math/fast.h>
 
+#include <algorithm>
+#include <limits>
+#include <mutex>
 #include <memory>
 #include <filament/View.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 using namespace filament::math;
 using namespace utils;
 
@@ -51,6 +60,10 @@ namespace filament {
 
 using namespace backend;
 
+// size of the commands recorded by a readback pass, see FrameGraph::Builder::parallel()
+static constexpr size_t READBACK_COMMAND_SIZE =
+        CommandBase::align(sizeof(COMMAND_TYPE(readPixels)));
+
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(PerViewUib::getUib().getSize()),
@@ -89,15 +102,21 @@ FView::FView(FEngine& engine)
 
 FView::~FView() noexcept = default;
 
+size_t FView::getUniformBufferSize() const noexcept {
+    return mPerViewUb.getSize() + CONFIG_MAX_LIGHT_COUNT * sizeof(LightsUib) +
+            mShadowUb.getSize() + mClusterDrawBufferSize;
+}
+
 void FView::terminate(FEngine& engine) {
     // Here we would cleanly free resources we've allocated or we own (currently none).
     DriverApi& driver = engine.getDriverApi();
     driver.destroyUniformBuffer(mPerViewUbh);
     driver.destroyUniformBuffer(mLightUbh);
     driver.destroyUniformBuffer(mShadowUbh);
+    driver.destroyUniformBuffer(mClusterDraws.buffer);
     driver.destroySamplerGroup(mPerViewSbh);
-    driver.destroyUniformBuffer(mRenderableUbh);
     drainFrameHistory(engine);
+    mShadowMapManager.terminate(engine);
     mFroxelizer.terminate(driver);
 }
 
@@ -129,6 +148,47 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
     }
 }
 
+bool FView::updateDepthPrepass(FrameInfo const& info) noexcept {
+    auto& state = mDepthPrepass;
+    if (state.mode != DepthPrepass::AUTO) {
+        state.enabled = state.mode == DepthPrepass::ENABLED;
+        return state.enabled;
+    }
+
+    // The GPU times are reported a few frames late, skip the ones that could have been
+    // measured before 'enabled' last changed.
+    constexpr uint32_t LATENCY = DEPTH_PREPASS_PROBE_LATENCY;
+    ++state.frameCount;
+    if (info.valid && state.frameCount > LATENCY) {
+        state.time[state.enabled] += info.mainTime.count();
+        state.count[state.enabled]++;
+    }
+
+    if (!state.probing && state.frameCount >= DEPTH_PREPASS_PROBE_PERIOD) {
+        // measure the other state for a while
+        state.enabled = !state.enabled;
+        state.probing = true;
+        state.frameCount = 0;
+    } else if (state.probing &&
+            state.frameCount >= LATENCY + DEPTH_PREPASS_PROBE_FRAME_COUNT) {
+        // Keep the probed state only if it's faster by a margin, the times are noisy and each
+        // change invalidates the retained commands.
+        const bool probed = state.enabled;
+        if (state.count[0] && state.count[1]) {
+            const float probedTime = state.time[probed] / float(state.count[probed]);
+            const float otherTime = state.time[!probed] / float(state.count[!probed]);
+            state.enabled = probedTime < otherTime * 0.95f ? probed : !probed;
+        } else {
+            state.enabled = !probed;
+        }
+        state.probing = false;
+        state.frameCount = 0;
+        state.time[0] = state.time[1] = 0.0f;
+        state.count[0] = state.count[1] = 0;
+    }
+    return state.enabled;
+}
+
 void FView::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     mFroxelizer.setOptions(zLightNear, zLightFar);
 }
@@ -141,6 +201,8 @@ float2 FView::updateScale(FrameInfo const& info) noexcept {
             return mScale;
         }
 
+        const float2 previousScale = mScale;
+
         // scaling factor we need to apply on the whole surface
         const float scale = info.scale;
         const float w = mViewport.width;
@@ -170,11 +232,22 @@ float2 FView::updateScale(FrameInfo const& info) noexcept {
             mScale = std::sqrt(scale);
         }
 
-        // now tweak the scaling factor to get multiples of 8 (to help quad-shading)
-        // i.e. 8x8=64 fragments, to try to help with warp sizes.
-        mScale = (floor(mScale * float2{ w, h } / 8) * 8) / float2{ w, h };
+        // Quantize the scale so the render targets only change size when the load changes
+        // noticeably. This avoids reallocating them every frame, and the hysteresis avoids
+        // toggling between two sizes when the scale hovers around a step.
+        constexpr float SCALE_STEP = 1.0f / 32.0f;
+        if (all(lessThan(abs(mScale - previousScale), float2(SCALE_STEP * 0.75f)))) {
+            mScale = previousScale;
+        } else {
+            mScale = round(mScale / SCALE_STEP) * SCALE_STEP;
+
+            // now tweak the scaling factor to get multiples of 8 (to help quad-shading)
+            // i.e. 8x8=64 fragments, to try to help with warp sizes.
+            mScale = (floor(mScale * float2{ w, h } / 8) * 8) / float2{ w, h };
+        }
 
-        // always clamp to the min/max scale range
+        // always clamp to the min/max scale range, also when the hysteresis kept the previous
+        // scale, which may be out of a range that just changed
         mScale = clamp(mScale, options.minScale, options.maxScale);
 
 //#define DEBUG_DYNAMIC_RESOLUTION
@@ -202,6 +275,231 @@ void FView::setVisibleLayers(uint8_t select, uint8_t values) noexcept {
     mVisibleLayers = (mVisibleLayers & ~select) | (values & select);
 }
 
+void FView::setRetainedCommandsEnabled(bool enabled) noexcept {
+    mRetainedCommandsEnabled = enabled;
+    if (!enabled) {
+        // release the memory used by the retained commands
+        mStructureCommandCache.clear();
+        mColorCommandCache.clear();
+    }
+}
+
+void FView::setOcclusionCullingEnabled(bool enabled) noexcept {
+    mOcclusionCullingEnabled = enabled;
+    if (enabled) {
+        if (!mOcclusionDepth) {
+            mOcclusionDepth = std::make_shared<OcclusionDepth>();
+        }
+    } else {
+        // pending readbacks keep their own reference
+        mOcclusionDepth.reset();
+        mOcclusionCuller.clear();
+    }
+}
+
+void FView::readOcclusionDepth(FrameGraph& fg, FrameGraphId<FrameGraphTexture> structure,
+        CameraInfo const& camera) noexcept {
+    assert(mOcclusionDepth);
+    {
+        std::lock_guard<utils::Mutex> guard(mOcclusionDepth->lock);
+        if (mOcclusionDepth->pending) {
+            // only keep one readback in flight
+            return;
+        }
+        mOcclusionDepth->pending = true;
+    }
+
+    struct Request {
+        std::shared_ptr<OcclusionDepth> destination;
+        math::mat4f worldToClip;
+        uint32_t width;
+        uint32_t height;
+    };
+
+    struct OcclusionReadbackData {
+        FrameGraphId<FrameGraphTexture> depth;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    // the view matrix has the world origin applied, which can change every frame
+    const mat4f worldToClip = camera.projection * camera.view * camera.worldOrigin;
+
+    fg.addPass<OcclusionReadbackData>("Occlusion Readback",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.depth = builder.read(structure);
+                data.rt = builder.createRenderTarget("Occlusion Readback Target", {
+                        .attachments = {{}, data.depth }
+                });
+                builder.sideEffect();
+                builder.parallel(READBACK_COMMAND_SIZE);
+            },
+            [destination = mOcclusionDepth, worldToClip](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto const& desc = resources.getDescriptor(data.depth);
+                auto out = resources.get(data.rt);
+                Request* const request = new Request{
+                        destination, worldToClip, desc.width, desc.height };
+                const size_t size = size_t(desc.width) * desc.height * sizeof(float);
+                driver.readPixels(out.target, 0, 0, desc.width, desc.height, {
+                        malloc(size), size,
+                        PixelDataFormat::DEPTH_COMPONENT, PixelDataType::FLOAT,
+                        [](void* buffer, size_t, void* user) {
+                            Request* const request = static_cast<Request*>(user);
+                            OcclusionDepth& d = *request->destination;
+                            std::lock_guard<utils::Mutex> guard(d.lock);
+                            float const* const depth = static_cast<float const*>(buffer);
+                            d.depth.assign(depth, depth + size_t(request->width) * request->height);
+                            d.width = request->width;
+                            d.height = request->height;
+                            d.worldToClip = request->worldToClip;
+                            d.ready = true;
+                            d.pending = false;
+                            free(buffer);
+                            delete request;
+                        }, request });
+            });
+}
+
+void FView::setSampleDistributionShadowsEnabled(bool enabled) noexcept {
+    if (enabled) {
+        if (!mShadowDepthRange) {
+            mShadowDepthRange = std::make_shared<ShadowDepthRange>();
+        }
+    } else {
+        // pending readbacks keep their own reference
+        mShadowDepthRange.reset();
+    }
+}
+
+void FView::readShadowDepthRange(FrameGraph& fg, FrameGraphId<FrameGraphTexture> range,
+        CameraInfo const& camera) noexcept {
+    assert(mShadowDepthRange);
+    {
+        std::lock_guard<utils::Mutex> guard(mShadowDepthRange->lock);
+        if (mShadowDepthRange->pending) {
+            // only keep one readback in flight
+            return;
+        }
+        mShadowDepthRange->pending = true;
+    }
+
+    struct Request {
+        std::shared_ptr<ShadowDepthRange> destination;
+        math::mat4f clipToView;
+    };
+
+    struct ShadowDepthRangeReadbackData {
+        FrameGraphId<FrameGraphTexture> range;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    fg.addPass<ShadowDepthRangeReadbackData>("Shadow Depth Range Readback",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.range = builder.read(range);
+                data.rt = builder.createRenderTarget("Shadow Depth Range Readback Target", {
+                        .attachments = {{ data.range }}
+                });
+                builder.sideEffect();
+                builder.parallel(READBACK_COMMAND_SIZE);
+            },
+            [destination = mShadowDepthRange, clipToView = inverse(camera.projection)](
+                    FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                auto out = resources.get(data.rt);
+                Request* const request = new Request{ destination, clipToView };
+                const size_t size = sizeof(float4);
+                driver.readPixels(out.target, 0, 0, 1, 1, {
+                        malloc(size), size, PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                        [](void* buffer, size_t, void* user) {
+                            Request* const request = static_cast<Request*>(user);
+                            ShadowDepthRange& d = *request->destination;
+                            float4 const range = *static_cast<float4 const*>(buffer);
+                            // the depth is reversed: the largest depth is the nearest
+                            auto viewSpaceZ = [request](float depth) {
+                                const float4 p = request->clipToView *
+                                        float4{ 0, 0, 1.0f - 2.0f * depth, 1 };
+                                return p.z / p.w;
+                            };
+                            std::lock_guard<utils::Mutex> guard(d.lock);
+                            if (range.x <= range.y) {
+                                d.vsNearFar = { viewSpaceZ(range.y), viewSpaceZ(range.x) };
+                                d.valid = true;
+                            }
+                            d.pending = false;
+                            free(buffer);
+                            delete request;
+                        }, request });
+            });
+}
+
+void FView::readPickingQueries(FrameGraph& fg, RenderPass const& pass,
+        filament::Viewport const& svp, float2 scale) noexcept {
+    struct PickingPassData {
+        FrameGraphId<FrameGraphTexture> picking;
+        FrameGraphId<FrameGraphTexture> depth;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    for (PickingQuery const& query : mPickingQueries) {
+        fg.addPass<PickingPassData>("Picking Pass",
+                [&](FrameGraph::Builder& builder, auto& data) {
+                    data.picking = builder.createTexture("Picking Buffer", {
+                            .width = 1, .height = 1, .format = TextureFormat::RG32F });
+                    data.depth = builder.createTexture("Picking Depth Buffer", {
+                            .width = 1, .height = 1, .format = TextureFormat::DEPTH32F });
+                    data.picking = builder.write(data.picking);
+                    data.depth = builder.write(data.depth);
+                    data.rt = builder.createRenderTarget("Picking Target", {
+                            .attachments = {{ data.picking }, data.depth },
+                            .clearFlags = TargetBufferFlags::COLOR | TargetBufferFlags::DEPTH
+                    });
+                    builder.sideEffect();
+                    if (size_t size = pass.prepareParallelExecution()) {
+                        builder.parallel(size + READBACK_COMMAND_SIZE);
+                    }
+                },
+                [=](FrameGraphPassResources const& resources,
+                        auto const& data, DriverApi& driver) {
+                    auto out = resources.get(data.rt);
+                    // the viewport is offset so that the queried pixel is the only one drawn
+                    const float2 p = float2{ query.x, query.y } * scale;
+                    out.params.viewport = { -int32_t(p.x), -int32_t(p.y), svp.width, svp.height };
+                    pass.execute(driver, resources.getPassName(), out.target, out.params);
+
+                    PickingQuery* const request = new PickingQuery(query);
+                    const size_t size = sizeof(float2);
+                    driver.readPixels(out.target, 0, 0, 1, 1, {
+                            malloc(size), size, PixelDataFormat::RG, PixelDataType::FLOAT,
+                            [](void* buffer, size_t, void* user) {
+                                PickingQuery* const request = static_cast<PickingQuery*>(user);
+                                float2 const picking = *static_cast<float2 const*>(buffer);
+                                // the object id is stored as the bits of the red channel
+                                uint32_t id;
+                                memcpy(&id, &picking.x, sizeof(id));
+                                View::PickingQueryResult result;
+                                result.renderable = Entity::import(int32_t(id));
+                                result.depth = picking.y;
+                                result.fragCoords = {
+                                        float(request->x) + 0.5f, float(request->y) + 0.5f,
+                                        picking.y };
+                                request->callback(result, request->user);
+                                free(buffer);
+                                delete request;
+                            }, request });
+                });
+    }
+    mPickingQueries.clear();
+}
+
+bool FView::getShadowDepthRange(float2* vsNearFar) const noexcept {
+    if (!mShadowDepthRange) {
+        return false;
+    }
+    std::lock_guard<utils::Mutex> guard(mShadowDepthRange->lock);
+    *vsNearFar = mShadowDepthRange->vsNearFar;
+    return mShadowDepthRange->valid;
+}
+
 bool FView::isSkyboxVisible() const noexcept {
     FSkybox const* skybox = mScene ? mScene->getSkybox() : nullptr;
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
@@ -272,7 +570,7 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
 
     scene->prepareDynamicLights(camera, arena, mLightUbh);
 
-    // here the array of visible lights has been shrunk to CONFIG_MAX_LIGHT_COUNT
+    // here the array of visible lights has been shrunk to Engine::Config::maxLightCount
     auto const& lightData = scene->getLightData();
 
     // trace the number of visible lights
@@ -343,7 +641,10 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     }
 
     // Dynamic lighting
-    mHasDynamicLighting = scene->getLightData().size() > FScene::DIRECTIONAL_LIGHTS_COUNT;
+    // When all the visible punctual lights are behind the light far plane, the froxels would all
+    // be empty, use the variant without dynamic lighting instead of walking empty light lists.
+    mHasDynamicLighting = lightData.size() > FScene::DIRECTIONAL_LIGHTS_COUNT &&
+            mFroxelizer.hasLightsInRange(camera, lightData);
     if (mHasDynamicLighting) {
         Froxelizer& froxelizer = mFroxelizer;
         if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf)) {
@@ -353,7 +654,8 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
 }
 
 void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& arena,
-        filament::Viewport const& viewport, float4 const& userTime) noexcept {
+        filament::Viewport const& viewport, float4 const& userTime,
+        FramePerformanceCounters* counters) noexcept {
     JobSystem& js = engine.getJobSystem();
 
     /*
@@ -390,6 +692,19 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
         worldOriginScene[3].xyz -= camera->getPosition();
     }
 
+    /*
+     * Gather all information needed to render this scene. Apply the world origin to all
+     * objects in the scene. If another view already prepared the scene this frame, its world
+     * origin is used instead, so that the scene isn't gathered again.
+     */
+    {
+        PerformanceCountersScope scope(counters, FramePerformanceCounters::SCENE_PREPARE);
+        worldOriginScene = scene->prepare(js, worldOriginScene);
+    }
+
+    // everything else in this function is accounted as culling
+    PerformanceCountersScope cullingCountersScope(counters, FramePerformanceCounters::CULLING);
+
     // Note: for debugging (i.e. visualize what the camera / objects are doing, using
     // the viewing camera), we can set worldOriginScene to identity when mViewingCamera
     // is set
@@ -399,18 +714,13 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
             mCullingCamera->getCullingProjectionMatrix(),
             FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
 
-    /*
-     * Gather all information needed to render this scene. Apply the world origin to all
-     * objects in the scene.
-     */
-    scene->prepare(worldOriginScene);
-
     /*
      * Light culling: runs in parallel with Renderable culling (below)
      */
 
     auto *prepareVisibleLightsJob = js.runAndRetain(js.createJob(nullptr,
             [&frustum = mCullingFrustum, &engine, scene](JobSystem& js, JobSystem::Job*) {
+                scene->gatherVisibleLights(frustum);
                 FView::prepareVisibleLights(
                         engine.getLightManager(), js, frustum, scene->getLightData());
             }));
@@ -428,7 +738,18 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
          * (this will set the VISIBLE_RENDERABLE bit)
          */
 
-        prepareVisibleRenderables(js, mCullingFrustum, renderableData);
+        prepareVisibleRenderables(engine, mCullingFrustum, renderableData);
+
+        /*
+         * Occlusion culling: clears the VISIBLE_RENDERABLE bit of the renderables hidden behind
+         * the depth buffer of a previous frame. Shadow casters are not affected.
+         */
+
+        uint32_t occlusionCulledCount = 0;
+        if (mOcclusionCullingEnabled) {
+            occlusionCulledCount = uint32_t(prepareOcclusionCulling(renderableData,
+                    worldOriginScene));
+        }
 
 
         /*
@@ -455,50 +776,62 @@ void FView::prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& are
          * contain punctual light shadow casters as well. The fourth group contains *only* punctual
          * shadow casters.
          *
-         * This operation is somewhat heavy as it sorts the whole SoA. We use std::partition instead
-         * of sort(), which gives us O(4.N) instead of O(N.log(N)) application of swap().
+         * This operation is somewhat heavy as it reorders the whole SoA. We compute the order of
+         * the renderables with a stable counting sort on their group, and then move each array of
+         * the SoA only once, instead of swapping all of them at each step of std::partition().
+         * Because the sort is stable, the order doesn't change as long as the visibility doesn't,
+         * in which case nothing is moved.
          */
 
         // calculate the sorting key for all elements, based on their visibility
+        const uint8_t visibleLayers = getVisibleLayers();
         uint8_t const* layers = renderableData.data<FScene::LAYERS>();
         auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
-        computeVisibilityMasks(getVisibleLayers(), layers, visibility, cullingMask.begin(),
+        computeVisibilityMasks(visibleLayers, layers, visibility, cullingMask.begin(),
                 renderableData.size(), hasVsm());
 
-        auto const beginRenderables = renderableData.begin();
-        auto beginCasters = partition(beginRenderables, renderableData.end(), VISIBLE_RENDERABLE);
-        auto beginCastersOnly = partition(beginCasters, renderableData.end(),
-                VISIBLE_RENDERABLE | VISIBLE_DIR_SHADOW_RENDERABLE);
-        auto beginSpotLightCastersOnly = partition(beginCastersOnly, renderableData.end(),
-                VISIBLE_DIR_SHADOW_RENDERABLE);
-        auto endSpotLightCastersOnly = std::partition(beginSpotLightCastersOnly,
-                renderableData.end(), [](auto it) {
-                    return (it.template get<FScene::VISIBLE_MASK>() & VISIBLE_SPOT_SHADOW_RENDERABLE);
-                });
+        // offsets[i] is the index of the first renderable of group i, the renderables culled
+        // by their layers are counted on the way for Renderer::getFrameStatistics()
+        const size_t count = renderableData.size();
+        uint32_t offsets[VISIBILITY_GROUP_COUNT + 1] = {};
+        uint32_t layerCulledCount = 0;
+        for (size_t i = 0; i < count; i++) {
+            offsets[getVisibilityGroup(cullingMask[i]) + 1]++;
+            layerCulledCount += !(layers[i] & visibleLayers);
+        }
+        for (size_t i = 1; i <= VISIBILITY_GROUP_COUNT; i++) {
+            offsets[i] += offsets[i - 1];
+        }
 
-        // convert to indices
-        uint32_t iEnd = uint32_t(beginSpotLightCastersOnly - beginRenderables);
-        uint32_t iSpotLightCastersEnd = uint32_t(endSpotLightCastersOnly - beginRenderables);
-        mVisibleRenderables = Range{ 0, uint32_t(beginCastersOnly - beginRenderables) };
-        mVisibleDirectionalShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
+        mVisibilityOrder.resize(count);
+        uint32_t* const order = mVisibilityOrder.data();
+        uint32_t positions[VISIBILITY_GROUP_COUNT];
+        std::copy_n(offsets, VISIBILITY_GROUP_COUNT, positions);
+        for (size_t i = 0; i < count; i++) {
+            order[positions[getVisibilityGroup(cullingMask[i])]++] = uint32_t(i);
+        }
+        renderableData.permute(order);
+
+        // convert to ranges
+        uint32_t iEnd = offsets[3];
+        uint32_t iSpotLightCastersEnd = offsets[4];
+        mVisibleRenderables = Range{ 0, offsets[2] };
+        // the renderables that are neither visible nor culled by their layers or by occlusion
+        // culling were culled by the frustum
+        mCullingStatistics = {
+                .renderableCount = uint32_t(count),
+                .visibleCount = offsets[2],
+                .layerCulledCount = layerCulledCount,
+                .frustumCulledCount =
+                        uint32_t(count) - offsets[2] - layerCulledCount - occlusionCulledCount,
+                .occlusionCulledCount = occlusionCulledCount };
+        mVisibleDirectionalShadowCasters = Range{ offsets[1], iEnd };
         mSpotLightShadowCasters = Range{ 0, iSpotLightCastersEnd };
         merged = Range{ 0, iSpotLightCastersEnd };
 
         // update those UBOs
-        const size_t size = merged.size() * sizeof(PerRenderableUib);
-        if (size) {
-            if (mRenderableUBOSize < size) {
-                // allocate 1/3 extra, with a minimum of 16 objects
-                const size_t count = std::max(size_t(16u), (4u * merged.size() + 2u) / 3u);
-                mRenderableUBOSize = uint32_t(count * sizeof(PerRenderableUib));
-                driver.destroyUniformBuffer(mRenderableUbh);
-                mRenderableUbh = driver.createUniformBuffer(mRenderableUBOSize,
-                        backend::BufferUsage::STREAM);
-            } else {
-                // TODO: should we shrink the underlying UBO at some point?
-            }
-            assert(mRenderableUbh);
-            scene->updateUBOs(merged, mRenderableUbh);
+        if (!merged.empty()) {
+            scene->updateUBOs(merged);
         }
     }
 
@@ -599,16 +932,18 @@ void FView::computeVisibilityMasks(
 }
 
 UTILS_NOINLINE
-/* static */ FScene::RenderableSoa::iterator FView::partition(
-        FScene::RenderableSoa::iterator begin,
-        FScene::RenderableSoa::iterator end,
-        uint8_t mask) noexcept {
-    return std::partition(begin, end, [mask](auto it) {
-        // Mask VISIBLE_MASK to ignore higher bits related to spot shadows. We only partition based
-        // on renderable and directional shadow visibility.
-        return (it.template get<FScene::VISIBLE_MASK>() &
-                (VISIBLE_RENDERABLE | VISIBLE_DIR_SHADOW_RENDERABLE)) == mask;
-    });
+size_t FView::getVisibilityGroup(FScene::VisibleMaskType mask) noexcept {
+    // Only the renderable and directional shadow visibility matter for the first three groups.
+    switch (mask & (VISIBLE_RENDERABLE | VISIBLE_DIR_SHADOW_RENDERABLE)) {
+        case VISIBLE_RENDERABLE:
+            return 0;
+        case VISIBLE_RENDERABLE | VISIBLE_DIR_SHADOW_RENDERABLE:
+            return 1;
+        case VISIBLE_DIR_SHADOW_RENDERABLE:
+            return 2;
+        default:
+            return (mask & VISIBLE_SPOT_SHADOW_RENDERABLE) ? 3 : 4;
+    }
 }
 
 void FView::prepareCamera(const CameraInfo& camera) const noexcept {
@@ -646,6 +981,30 @@ void FView::prepareViewport(const filament::Viewport &viewport) const noexcept {
     u.setUniform(offsetof(PerViewUib, origin), float2{ viewport.left, viewport.bottom });
 }
 
+backend::FoveationParams FView::getFoveationParams() const noexcept {
+    FoveationOptions const& options = mFoveationOptions;
+    if (!options.enabled) {
+        return {};
+    }
+    // The pixel density is 1 / max(1, gain^2 * d^2 - foveaArea), where d is the distance to the
+    // focal point in NDC. It stays 1 up to d = radius with this foveaArea.
+    const float gain = options.falloff;
+    return {
+            .focalPoint = options.center * 2.0f - 1.0f,
+            .gain = math::float2(gain),
+            .foveaArea = gain * gain * options.radius * options.radius - 1.0f
+    };
+}
+
+void FView::prepareLodBias(float bias) const noexcept {
+    mPerViewUb.setUniform(offsetof(PerViewUib, lodBias), bias);
+}
+
+void FView::prepareOrderIndependentTransparency(bool enabled) const noexcept {
+    // transparent materials output to the order-independent transparency targets when set
+    mPerViewUb.setUniform(offsetof(PerViewUib, oitEnabled), enabled ? 1.0f : 0.0f);
+}
+
 void FView::prepareSSAO(Handle<HwTexture> ssao) const noexcept {
     // High quality sampling is enabled only if AO itself is enabled and upsampling quality is at
     // least set to high and of course only if upsampling is needed.
@@ -699,10 +1058,12 @@ void FView::froxelize(FEngine& engine) const noexcept {
 void FView::commitUniforms(backend::DriverApi& driver) const noexcept {
     if (mPerViewUb.isDirty()) {
         driver.loadUniformBuffer(mPerViewUbh, mPerViewUb.toBufferDescriptor(driver));
+        mUniformBufferBytes += mPerViewUb.getSize();
     }
 
     if (mShadowUb.isDirty()) {
         driver.loadUniformBuffer(mShadowUbh, mShadowUb.toBufferDescriptor(driver));
+        mUniformBufferBytes += mShadowUb.getSize();
     }
 
     if (mPerViewSb.isDirty()) {
@@ -710,6 +1071,11 @@ void FView::commitUniforms(backend::DriverApi& driver) const noexcept {
     }
 }
 
+Froxelizer::Statistics FView::getFroxelStatistics() const noexcept {
+    // without dynamic lighting, the froxels are all empty
+    return mHasDynamicLighting ? mFroxelizer.getStatistics() : Froxelizer::Statistics{};
+}
+
 void FView::commitFroxels(backend::DriverApi& driverApi) const noexcept {
     if (mHasDynamicLighting) {
         mFroxelizer.commit(driverApi);
@@ -717,19 +1083,95 @@ void FView::commitFroxels(backend::DriverApi& driverApi) const noexcept {
 }
 
 UTILS_NOINLINE
-void FView::prepareVisibleRenderables(JobSystem& js,
+void FView::prepareVisibleRenderables(FEngine& engine,
         Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isFrustumCullingEnabled())) {
-        FView::cullRenderables(js, renderableData, frustum, VISIBLE_RENDERABLE_BIT);
+        FView::cullRenderables(engine, renderableData, frustum, VISIBLE_RENDERABLE_BIT,
+                mScene->getCullingBvh(), mScene->getCullingBvhRows());
     } else {
         std::uninitialized_fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
     }
 }
 
-void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+size_t FView::prepareOcclusionCulling(FScene::RenderableSoa& renderableData,
+        mat4f const& worldOrigin) noexcept {
+    SYSTRACE_CALL();
+    assert(mOcclusionDepth);
+
+    OcclusionDepth& d = *mOcclusionDepth;
+    std::unique_lock<utils::Mutex> lock(d.lock);
+    if (d.ready) {
+        std::vector<float> depth;
+        std::swap(depth, d.depth);
+        const uint32_t width = d.width;
+        const uint32_t height = d.height;
+        const mat4f worldToClip = d.worldToClip;
+        d.ready = false;
+        lock.unlock();
+        mOcclusionCuller.setDepth(depth.data(), width, height, worldToClip);
+    } else {
+        lock.unlock();
+    }
+
+    return mOcclusionCuller.cull(renderableData.data<FScene::VISIBLE_MASK>(),
+            renderableData.data<FScene::WORLD_AABB_CENTER>(),
+            renderableData.data<FScene::WORLD_AABB_EXTENT>(),
+            renderableData.data<FScene::LAYERS>(),
+            renderableData.data<FScene::VISIBILITY_STATE>(),
+            renderableData.size(), getVisibleLayers(), worldOrigin, VISIBLE_RENDERABLE);
+}
+
+void FView::findCullingBvhRows(FScene::RenderableSoa const& renderableData,
+        std::vector<uint32_t>& rows) noexcept {
+    // The RenderableSoa is reordered every frame, so we first need to find the current row
+    // of each renderable. The buffer only grows, so this doesn't allocate once it's large enough.
+    auto const* const UTILS_RESTRICT instances =
+            renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    uint32_t maxInstance = 0;
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        maxInstance = std::max(maxInstance, instances[i].asValue());
+    }
+    if (rows.size() < maxInstance + 1u) {
+        rows.resize(maxInstance + 1u);
+    }
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        rows[instances[i].asValue()] = uint32_t(i);
+    }
+}
+
+void FView::cullRenderablesHierarchical(FScene::RenderableSoa& renderableData,
+        Frustum const& frustum, size_t bit, CullingBvh const& bvh,
+        uint32_t const* rows) noexcept {
+    SYSTRACE_NAME("cullRenderables (hierarchical)");
+
+    FScene::VisibleMaskType* const UTILS_RESTRICT visibleArray =
+            renderableData.data<FScene::VISIBLE_MASK>();
+    const Culler::result_type allVisible = Culler::result_type(1u << bit);
+    bvh.cull(frustum, bit, [rows, visibleArray, allVisible]
+            (uint32_t const* ids, Culler::result_type const* results, size_t count) {
+        if (results) {
+            for (size_t i = 0; i < count; i++) {
+                visibleArray[rows[ids[i]]] |= results[i];
+            }
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                visibleArray[rows[ids[i]]] |= allVisible;
+            }
+        }
+    });
+}
+
+void FView::cullRenderables(FEngine& engine, FScene::RenderableSoa& renderableData,
+        Frustum const& frustum, size_t bit, CullingBvh const* bvh,
+        std::vector<uint32_t>& bvhRows) noexcept {
+
+    if (bvh && !bvh->empty()) {
+        findCullingBvhRows(renderableData, bvhRows);
+        cullRenderablesHierarchical(renderableData, frustum, bit, *bvh, bvhRows.data());
+        return;
+    }
 
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
@@ -745,9 +1187,51 @@ void FView::cullRenderables(JobSystem& js,
                 worldAABBExtent + index, c, bit);
     };
 
-    // launch the computation on multiple threads
+    // launch the computation on multiple threads, the chunks are sized from the measured cost of
+    // culling, which is the same for all the callers.
+    using Splitter = jobs::AdaptiveSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>;
+    JobSystem& js = engine.getJobSystem();
     auto *job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
-            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+            std::ref(functor), Splitter(js, engine.getParallelLoopCosts().culling));
+    js.runAndWait(job);
+}
+
+void FView::cullRenderables(FEngine& engine, FScene::RenderableSoa& renderableData,
+        Frustum const* frusta, uint8_t const* bits, size_t count,
+        CullingBvh const* bvh, std::vector<uint32_t>& bvhRows) noexcept {
+    assert(count <= Culler::MAX_FRUSTUM_COUNT);
+
+    if (bvh && !bvh->empty()) {
+        // each frustum rejects different subtrees of the hierarchy, so it's traversed once per
+        // frustum
+        findCullingBvhRows(renderableData, bvhRows);
+        for (size_t i = 0; i < count; i++) {
+            cullRenderablesHierarchical(renderableData, frusta[i], bits[i], *bvh,
+                    bvhRows.data());
+        }
+        return;
+    }
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    FScene::VisibleMaskType* visibleArray = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // culling job (this runs on multiple threads)
+    auto functor = [frusta, bits, count, worldAABBCenter, worldAABBExtent, visibleArray]
+            (uint32_t index, uint32_t c) {
+        Culler::intersects(
+                visibleArray + index,
+                frusta, bits, count,
+                worldAABBCenter + index,
+                worldAABBExtent + index, c);
+    };
+
+    // the cost of a chunk depends on the number of frusta, so it's measured separately from the
+    // single frustum culling above
+    using Splitter = jobs::AdaptiveSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>;
+    JobSystem& js = engine.getJobSystem();
+    auto *job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+            std::ref(functor), Splitter(js, engine.getParallelLoopCosts().cullingFrusta));
     js.runAndWait(job);
 }
 
@@ -808,16 +1292,252 @@ void FView::prepareVisibleLights(FLightManager const& lcm, utils::JobSystem&,
     lightData.resize(visibleLightCount);
 }
 
-void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
-        FScene::RenderableSoa& renderableData, Range visible) noexcept {
-    FRenderableManager const& rcm = engine.getRenderableManager();
+void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo& camera,
+        FScene::RenderableSoa& renderableData, Range visible, bool updateLevels) noexcept {
+    FRenderableManager& rcm = engine.getRenderableManager();
+
+    // The levels are kept per view, since each view has its own camera.
+    std::vector<uint8_t>& levels = mLodLevels;
+    if (updateLevels) {
+        levels.resize(rcm.getComponentCount() + 1);
+    }
+
+    // The screen coverage of a sphere of radius r at distance d is r * p[1][1] / d with a
+    // perspective projection, and r * p[1][1] with an orthographic projection, where the
+    // coverage is the projected diameter divided by the viewport height.
+    const float scale = camera.projection[1][1];
+    const bool perspective = camera.projection[2][3] != 0.0f;
+    const float3 position = camera.getPosition();
+
+    auto const* const UTILS_RESTRICT centers = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents = renderableData.data<FScene::WORLD_AABB_EXTENT>();
     for (uint32_t index : visible) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
         auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
+        uint8_t level = 0;
+        if (UTILS_UNLIKELY(rcm.hasLevelsOfDetail(ri))) {
+            const float radius = length(extents[index]);
+            const float d = std::max(std::numeric_limits<float>::min(),
+                    perspective ? distance(centers[index], position) : 1.0f);
+            const uint8_t current = ri.asValue() < levels.size() ? levels[ri.asValue()] : 0;
+            level = rcm.selectLevelOfDetail(ri, radius * scale / d, current);
+            if (updateLevels) {
+                levels[ri.asValue()] = level;
+            }
+        }
         renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
     }
 }
 
+void FView::requestStreamingLevels(FEngine& engine, const CameraInfo& camera,
+        FScene::RenderableSoa const& renderableData, Range visible,
+        uint32_t viewportHeight) const noexcept {
+    TextureStreamer& streamer = engine.getTextureStreamer();
+    if (streamer.empty()) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // Same screen coverage as in updatePrimitivesLod(). A primitive sampling a texture across
+    // a UV range u needs a level of log2(size * u / pixels), where pixels is the projected
+    // diameter of the renderable in pixels.
+    const float scale = camera.projection[1][1] * float(viewportHeight);
+    const bool perspective = camera.projection[2][3] != 0.0f;
+    const float3 position = camera.getPosition();
+
+    auto const* const UTILS_RESTRICT centers = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    for (uint32_t index : visible) {
+        const float radius = length(extents[index]);
+        const float d = std::max(std::numeric_limits<float>::min(),
+                perspective ? distance(centers[index], position) : 1.0f);
+        const float pixels = std::max(1.0f, 2.0f * radius * scale / d);
+        for (FRenderPrimitive const& primitive :
+                renderableData.elementAt<FScene::PRIMITIVES>(index)) {
+            FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            if (!mi) {
+                continue;
+            }
+            // by default the UVs are assumed to span [0, 1] across the renderable
+            const float density = primitive.getUvDensity();
+            const float uvRange = density > 0.0f ? density * 2.0f * radius : 1.0f;
+            backend::SamplerGroup const& samplers = mi->getSamplerGroup();
+            for (size_t i = 0, c = samplers.getSize(); i < c; i++) {
+                backend::Handle<backend::HwTexture> t = samplers.getSamplers()[i].t;
+                if (t) {
+                    streamer.request(t, uvRange / pixels);
+                }
+            }
+        }
+    }
+}
+
+RenderPass::ClusterDraws const* FView::prepareClusters(FEngine& engine,
+        FEngine::DriverApi& driver, FScene::RenderableSoa& renderableData,
+        Range visible) noexcept {
+    SYSTRACE_CALL();
+    using ClusterDraws = RenderPass::ClusterDraws;
+    using Cluster = FRenderPrimitive::Cluster;
+
+    if (!driver.isDrawIndirectSupported()) {
+        return nullptr;
+    }
+
+    FRenderableManager& rcm = engine.getRenderableManager();
+    auto& ranges = mClusterDrawRanges;
+    auto& commands = mClusterDrawCommands;
+    auto& clusterVisibility = mClusterVisibility;
+    ranges.clear();
+    commands.clear();
+
+    // the clusters are culled with the culling camera, like the renderables
+    mat4f const& worldOrigin = mViewingCameraInfo.worldOrigin;
+    const float3 cameraPosition = (worldOrigin * float4{ mCullingCamera->getPosition(), 1 }).xyz;
+    float4 const* const frustumPlanes = mCullingFrustum.getNormalizedPlanes();
+    const bool occlusionCulling = mOcclusionCullingEnabled && !mOcclusionCuller.empty();
+    const mat4f worldToClip = mOcclusionCuller.getWorldToClip() * inverse(worldOrigin);
+
+    auto const* const UTILS_RESTRICT soaInstances =
+            renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT soaWorldTransforms =
+            renderableData.data<FScene::WORLD_TRANSFORM>();
+    auto const* const UTILS_RESTRICT soaReversedWinding =
+            renderableData.data<FScene::REVERSED_WINDING_ORDER>();
+    auto const* const UTILS_RESTRICT soaVisibility =
+            renderableData.data<FScene::VISIBILITY_STATE>();
+    auto const* const UTILS_RESTRICT soaInstanceCounts =
+            renderableData.data<FScene::INSTANCE_COUNT>();
+    auto const* const UTILS_RESTRICT soaPrimitives = renderableData.data<FScene::PRIMITIVES>();
+    uint32_t* const UTILS_RESTRICT soaClusterDraws = renderableData.data<FScene::CLUSTER_DRAWS>();
+
+    // appends the draws of the clusters whose visibility has all the bits of 'mask', adjacent
+    // clusters are drawn together
+    constexpr uint8_t VISIBLE = 0x1;
+    constexpr uint8_t FRONT_FACING = 0x2;
+    auto appendDraws = [&commands, &clusterVisibility](std::vector<Cluster> const& clusters,
+            uint8_t mask) -> ClusterDraws::Range {
+        const size_t first = commands.size();
+        for (size_t k = 0, c = clusters.size(); k < c; k++) {
+            if ((clusterVisibility[k] & mask) != mask) {
+                continue;
+            }
+            Cluster const& cluster = clusters[k];
+            if (commands.size() > first &&
+                    commands.back().firstIndex + commands.back().indexCount == cluster.offset) {
+                commands.back().indexCount += cluster.count;
+            } else {
+                commands.push_back({ cluster.count, 1, cluster.offset, 0, 0 });
+            }
+        }
+        return { uint32_t(first), uint32_t(commands.size() - first) };
+    };
+
+    for (uint32_t index : visible) {
+        soaClusterDraws[index] = FScene::NO_CLUSTER_DRAWS;
+
+        // the bounds of the clusters don't account for the vertex shader moving the vertices
+        const auto visibility = soaVisibility[index];
+        if (visibility.skinning || visibility.morphing || soaInstanceCounts[index] != 1) {
+            continue;
+        }
+
+        Slice<FRenderPrimitive> const& primitives = soaPrimitives[index];
+        const size_t primitiveCount =
+                std::min(primitives.size(), RenderPass::MAX_CLUSTERED_PRIMITIVE_INDEX);
+        if (std::none_of(primitives.begin(), primitives.begin() + primitiveCount,
+                [](FRenderPrimitive const& primitive) {
+                    return !primitive.getClusters().empty();
+                })) {
+            continue;
+        }
+
+        // The world transform maps the vertex positions to the world, including the
+        // dequantization of quantized positions, while the clusters are in object space.
+        mat4f objectToWorld = soaWorldTransforms[index];
+        const float4 dequantization = rcm.getPositionDequantization(soaInstances[index]);
+        if (UTILS_UNLIKELY(dequantization.w != 0.0f)) {
+            objectToWorld = objectToWorld * mat4f::scaling(1.0f / dequantization.w) *
+                    mat4f::translation(-dequantization.xyz);
+        }
+
+        // The clusters are tested in object space, where the planes of the frustum are
+        // transformed with the transpose of objectToWorld and renormalized, so that the
+        // distances to the bounding spheres are exact even with a non-uniform scale.
+        float4 planes[6];
+        for (size_t k = 0; k < 6; k++) {
+            const float4 plane = transpose(objectToWorld) * frustumPlanes[k];
+            planes[k] = plane / length(plane.xyz);
+        }
+        const float3 eye = (inverse(objectToWorld) * float4{ cameraPosition, 1 }).xyz;
+        const mat4f objectToClip = worldToClip * objectToWorld;
+
+        // The normal cones stay valid with uniform scales only, and the front faces must be
+        // those of the triangles' winding order.
+        const float3 scale = {
+                length(objectToWorld[0].xyz),
+                length(objectToWorld[1].xyz),
+                length(objectToWorld[2].xyz) };
+        const bool coneCulling = !soaReversedWinding[index] && !mFrontFaceWindingInverted &&
+                std::abs(scale.x - scale.y) <= scale.x * 1e-3f &&
+                std::abs(scale.x - scale.z) <= scale.x * 1e-3f;
+
+        soaClusterDraws[index] = uint32_t(ranges.size());
+        for (size_t j = 0; j < primitiveCount; j++) {
+            std::vector<Cluster> const& clusters = primitives[j].getClusters();
+            if (clusters.empty()) {
+                ranges.push_back({ ClusterDraws::WHOLE_PRIMITIVE, 0 });
+                ranges.push_back({ ClusterDraws::WHOLE_PRIMITIVE, 0 });
+                continue;
+            }
+
+            clusterVisibility.resize(clusters.size());
+            for (size_t k = 0, c = clusters.size(); k < c; k++) {
+                Cluster const& cluster = clusters[k];
+                bool inFrustum = true;
+                for (size_t p = 0; p < 6; p++) {
+                    inFrustum = inFrustum &&
+                            dot(planes[p].xyz, cluster.center) + planes[p].w < cluster.radius;
+                }
+                const bool occluded = inFrustum && occlusionCulling &&
+                        mOcclusionCuller.isOccluded(objectToClip, cluster.center,
+                                float3(cluster.radius));
+                // meshoptimizer's test of the normal cone with the bounding sphere
+                const float3 v = cluster.center - eye;
+                const bool backFacing = coneCulling &&
+                        dot(v, cluster.coneAxis) >= cluster.coneCutoff * length(v) + cluster.radius;
+                clusterVisibility[k] = uint8_t((inFrustum && !occluded ? VISIBLE : 0) |
+                        (backFacing ? 0 : FRONT_FACING));
+            }
+
+            const ClusterDraws::Range all = appendDraws(clusters, VISIBLE);
+            ranges.push_back(all);
+            ranges.push_back(coneCulling ? appendDraws(clusters, VISIBLE | FRONT_FACING) : all);
+        }
+    }
+
+    if (ranges.empty()) {
+        return nullptr;
+    }
+
+    const size_t size = commands.size() * sizeof(DrawIndirectCommand);
+    if (mClusterDrawBufferSize < size) {
+        // allocate 1/3 extra, with a minimum of 64 draws
+        const size_t count = std::max(size_t(64u), (4u * commands.size() + 2u) / 3u);
+        mClusterDrawBufferSize = uint32_t(count * sizeof(DrawIndirectCommand));
+        driver.destroyUniformBuffer(mClusterDraws.buffer);
+        mClusterDraws.buffer = driver.createUniformBuffer(mClusterDrawBufferSize,
+                BufferUsage::DYNAMIC);
+    }
+    if (size) {
+        void* const data = malloc(size);
+        memcpy(data, commands.data(), size);
+        driver.updateUniformBuffer(mClusterDraws.buffer, { data, size,
+                [](void* buffer, size_t, void*) { free(buffer); } }, 0);
+    }
+    mClusterDraws.ranges = ranges.data();
+    return &mClusterDraws;
+}
+
 void FView::renderShadowMaps(FrameGraph& fg, FEngine& engine, FEngine::DriverApi& driver,
         RenderPass& pass) noexcept {
     mShadowMapManager.render(fg, engine, *this, driver, pass);
@@ -828,6 +1548,8 @@ void FView::commitFrameHistory(FEngine& engine) noexcept {
     auto& frameHistory = mFrameHistory;
     FrameHistoryEntry& last = frameHistory.back();
     last.color.destroy(engine.getResourceAllocator());
+    last.ssao.destroy(engine.getResourceAllocator());
+    last.refraction.destroy(engine.getResourceAllocator());
 
     // and then push the new history entry to the history stack
     frameHistory.commit();
@@ -957,6 +1679,14 @@ View::Dithering View::getDithering() const noexcept {
     return upcast(this)->getDithering();
 }
 
+void View::setDepthPrepass(DepthPrepass mode) noexcept {
+    upcast(this)->setDepthPrepass(mode);
+}
+
+View::DepthPrepass View::getDepthPrepass() const noexcept {
+    return upcast(this)->getDepthPrepass();
+}
+
 void View::setDynamicResolutionOptions(const DynamicResolutionOptions& options) noexcept {
     upcast(this)->setDynamicResolutionOptions(options);
 }
@@ -989,6 +1719,27 @@ bool View::isFrontFaceWindingInverted() const noexcept {
     return upcast(this)->isFrontFaceWindingInverted();
 }
 
+void View::setRetainedCommandsEnabled(bool enabled) noexcept {
+    upcast(this)->setRetainedCommandsEnabled(enabled);
+}
+
+bool View::isRetainedCommandsEnabled() const noexcept {
+    return upcast(this)->isRetainedCommandsEnabled();
+}
+
+void View::setOcclusionCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setOcclusionCullingEnabled(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+void View::pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback,
+        void* user) noexcept {
+    upcast(this)->pick(x, y, callback, user);
+}
+
 void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
@@ -1053,6 +1804,14 @@ View::VignetteOptions View::getVignetteOptions() const noexcept {
     return upcast(this)->getVignetteOptions();
 }
 
+void View::setFoveationOptions(View::FoveationOptions options) noexcept {
+    upcast(this)->setFoveationOptions(options);
+}
+
+View::FoveationOptions View::getFoveationOptions() const noexcept {
+    return upcast(this)->getFoveationOptions();
+}
+
 void View::setBlendMode(BlendMode blendMode) noexcept {
     upcast(this)->setBlendMode(blendMode);
 }
@@ -1069,6 +1828,26 @@ bool View::isShadowingEnabled() const noexcept {
     return upcast(this)->isShadowingEnabled();
 }
 
+void View::setShadowMapCachingEnabled(bool enabled) noexcept {
+    upcast(this)->setShadowMapCachingEnabled(enabled);
+}
+
+bool View::isShadowMapCachingEnabled() const noexcept {
+    return upcast(this)->isShadowMapCachingEnabled();
+}
+
+void View::setSampleDistributionShadowsEnabled(bool enabled) noexcept {
+    upcast(this)->setSampleDistributionShadowsEnabled(enabled);
+}
+
+bool View::isSampleDistributionShadowsEnabled() const noexcept {
+    return upcast(this)->isSampleDistributionShadowsEnabled();
+}
+
+void View::invalidateShadowMaps() noexcept {
+    upcast(this)->invalidateShadowMaps();
+}
+
 void View::setScreenSpaceRefractionEnabled(bool enabled) noexcept {
     upcast(this)->setScreenSpaceRefractionEnabled(enabled);
 }
@@ -1077,4 +1856,20 @@ bool View::isScreenSpaceRefractionEnabled() const noexcept {
     return upcast(this)->isScreenSpaceRefractionEnabled();
 }
 
+void View::setScreenSpaceRefractionReuseEnabled(bool enabled) noexcept {
+    upcast(this)->setScreenSpaceRefractionReuseEnabled(enabled);
+}
+
+bool View::isScreenSpaceRefractionReuseEnabled() const noexcept {
+    return upcast(this)->isScreenSpaceRefractionReuseEnabled();
+}
+
+void View::setOrderIndependentTransparencyEnabled(bool enabled) noexcept {
+    upcast(this)->setOrderIndependentTransparencyEnabled(enabled);
+}
+
+bool View::isOrderIndependentTransparencyEnabled() const noexcept {
+    return upcast(this)->isOrderIndependentTransparencyEnabled();
+}
+
 } // namespace filament
@@ -67,9 +67,23 @@ public:
     void prepare(backend::DriverApi& driver) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        size_t const count = mManager.getComponentCount();
         mManager.gc(em);
+        if (count != mManager.getComponentCount()) {
+            ++mLayoutGeneration;
+        }
     }
 
+    // changes when light components are added or removed, which can invalidate existing
+    // Instances. Used by FScene to keep its light list across frames.
+    uint64_t getLayoutGeneration() const noexcept { return mLayoutGeneration; }
+
+    // getGeneration() changes whenever the position, direction or falloff of any light is
+    // modified, getGeneration(Instance) is the generation at which that light's were last
+    // modified. Used by FScene to only update the bounds of the lights that changed.
+    uint64_t getGeneration() const noexcept { return mGeneration; }
+    uint64_t getGeneration(Instance i) const noexcept { return mManager[i].generation; }
+
     struct LightType {
         Type type : 3;
         bool shadowCaster : 1;
@@ -234,9 +248,10 @@ private:
         SUN_HALO_FALLOFF,   // state for the directional light sun
         INTENSITY,
         FALLOFF,
+        GENERATION,         // generation of the last change to the bounds of the light
     };
 
-    using Base = utils::SingleInstanceComponentManager<  // 120 bytes
+    using Base = utils::SingleInstanceComponentManager<  // 128 bytes
             LightType,      //  1
             math::float3,   // 12
             math::float3,   // 12
@@ -247,7 +262,8 @@ private:
             float,          //  4
             float,          //  4
             float,          //  4
-            float           //  4
+            float,          //  4
+            uint64_t        //  8
     >;
 
     struct Sim : public Base {
@@ -273,6 +289,7 @@ private:
                 Field<SUN_HALO_FALLOFF>     sunHaloFalloff;
                 Field<INTENSITY>            intensity;
                 Field<FALLOFF>              squaredFallOffInv;
+                Field<GENERATION>           generation;
             };
         };
 
@@ -286,6 +303,8 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint64_t mLayoutGeneration = 0;
+    uint64_t mGeneration = 0;
 };
 
 FILAMENT_UPCAST(LightManager)
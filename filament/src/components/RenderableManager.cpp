@@ -29,6 +29,8 @@
 #include <utils/Log.h>
 #include <utils/Panic.h>
 
+#include <array>
+
 using namespace filament::math;
 using namespace utils;
 
@@ -36,7 +38,14 @@ namespace filament {
 
 struct RenderableManager::BuilderDetails {
     using Entry = RenderableManager::Builder::Entry;
+    struct LevelOfDetail {
+        size_t primitiveCount = 0;
+        float screenCoverage = -1.0f;   // negative when the level is not set
+    };
     std::vector<Entry> mEntries;
+    std::array<LevelOfDetail, CONFIG_MAX_LOD_COUNT> mLevels;
+    size_t mLevelCount = 0;
+    float mLevelHysteresis = 0.0f;
     Box mAABB;
     uint8_t mLayerMask = 0x1;
     uint8_t mPriority = 0x4;
@@ -46,8 +55,10 @@ struct RenderableManager::BuilderDetails {
     bool mScreenSpaceContactShadows : 1;
     bool mMorphingEnabled : 1;
     size_t mSkinningBoneCount = 0;
+    size_t mInstanceCount = 1;
     Bone const* mUserBones = nullptr;
     mat4f const* mUserBoneMatrices = nullptr;
+    float4 mPositionDequantization{};   // offset and scale, no quantization when the scale is 0
 
     explicit BuilderDetails(size_t count)
             : mEntries(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
@@ -163,6 +174,12 @@ RenderableManager::Builder& RenderableManager::Builder::morphing(bool enable) no
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::quantizedPositions(float3 offset,
+        float scale) noexcept {
+    mImpl->mPositionDequantization = { offset, scale };
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index, uint16_t blendOrder) noexcept {
     if (index < mImpl->mEntries.size()) {
         mImpl->mEntries[index].blendOrder = blendOrder;
@@ -170,6 +187,35 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::instances(size_t instanceCount) noexcept {
+    mImpl->mInstanceCount = instanceCount;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetail(uint8_t level,
+        size_t primitiveCount, float screenCoverage) noexcept {
+    if (level < CONFIG_MAX_LOD_COUNT) {
+        mImpl->mLevels[level] = { primitiveCount, std::max(0.0f, screenCoverage) };
+        mImpl->mLevelCount = std::max(mImpl->mLevelCount, size_t(level) + 1);
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::levelOfDetailHysteresis(
+        float ratio) noexcept {
+    mImpl->mLevelHysteresis = std::max(0.0f, ratio);
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::clusters(size_t index,
+        Cluster const* clusters, size_t count) noexcept {
+    if (index < mImpl->mEntries.size()) {
+        mImpl->mEntries[index].clusters = clusters;
+        mImpl->mEntries[index].clusterCount = count;
+    }
+    return *this;
+}
+
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
     bool isEmpty = true;
 
@@ -178,6 +224,43 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
         return Error;
     }
 
+    if (!ASSERT_PRECONDITION_NON_FATAL(
+            mImpl->mInstanceCount >= 1 && mImpl->mInstanceCount <= CONFIG_MAX_INSTANCES,
+            "instance count is %zu, but must be between 1 and %zu",
+            mImpl->mInstanceCount, CONFIG_MAX_INSTANCES)) {
+        return Error;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mPositionDequantization.w == 0.0f ||
+            (!mImpl->mSkinningBoneCount && !mImpl->mMorphingEnabled),
+            "[entity=%u] quantized positions can't be used with skinning or morphing",
+            entity.getId())) {
+        return Error;
+    }
+
+    size_t levelsPrimitiveCount = 0;
+    for (size_t i = 0, c = mImpl->mLevelCount; i < c; i++) {
+        auto const& lod = mImpl->mLevels[i];
+        if (!ASSERT_PRECONDITION_NON_FATAL(lod.screenCoverage >= 0.0f,
+                "[entity=%u] level of detail %u is missing", entity.getId(), i)) {
+            return Error;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL(
+                !i || lod.screenCoverage < mImpl->mLevels[i - 1].screenCoverage,
+                "[entity=%u] screen coverage of level of detail %u must be less than the "
+                "previous level's", entity.getId(), i)) {
+            return Error;
+        }
+        levelsPrimitiveCount += lod.primitiveCount;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(
+            !mImpl->mLevelCount || levelsPrimitiveCount == mImpl->mEntries.size(),
+            "[entity=%u] levels of detail have %u primitives, but the renderable has %u",
+            entity.getId(), levelsPrimitiveCount, mImpl->mEntries.size())) {
+        return Error;
+    }
+
     for (size_t i = 0, c = mImpl->mEntries.size(); i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
@@ -212,6 +295,18 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
             return Error;
         }
 
+        for (size_t j = 0; j < entry.clusterCount; j++) {
+            Cluster const& cluster = entry.clusters[j];
+            if (!ASSERT_PRECONDITION_NON_FATAL(entry.type == PrimitiveType::TRIANGLES &&
+                    cluster.offset >= entry.offset &&
+                    cluster.offset + cluster.count <= entry.offset + entry.count,
+                    "[entity=%u, primitive @ %u] cluster %u is not within the triangles of the "
+                    "primitive", entity.getId(), i, j)) {
+                entry.vertices = nullptr;
+                return Error;
+            }
+        }
+
         // this can't be an error because (1) those values are not immutable, so the caller
         // could fix later, and (2) the material's shader will work (i.e. compile), and
         // use the default values for this attribute, which maybe be acceptable.
@@ -264,6 +359,7 @@ void FRenderableManager::create(
     }
     Instance ci = manager.addComponent(entity);
     assert(ci);
+    mLayoutGeneration = ++mGeneration;
 
     if (ci) {
         // create and initialize all needed RenderPrimitives
@@ -285,25 +381,37 @@ void FRenderableManager::create(
         setSkinning(ci, false);
         setMorphing(ci, builder->mMorphingEnabled);
         setMorphWeights(ci, {0, 0, 0, 0});
+        manager[ci].instances = uint16_t(builder->mInstanceCount);
+        manager[ci].positionDequantization = builder->mPositionDequantization;
+
+        if (UTILS_UNLIKELY(builder->mLevelCount)) {
+            std::unique_ptr<LevelsOfDetail>& lods = manager[ci].lods;
+            lods = std::unique_ptr<LevelsOfDetail>(new LevelsOfDetail{});
+            lods->count = uint8_t(builder->mLevelCount);
+            lods->hysteresis = builder->mLevelHysteresis;
+            for (size_t i = 0, c = builder->mLevelCount; i < c; i++) {
+                lods->offsets[i + 1] = lods->offsets[i] +
+                        uint32_t(builder->mLevels[i].primitiveCount);
+                lods->screenCoverage[i] = builder->mLevels[i].screenCoverage;
+            }
+        }
 
         const size_t count = builder->mSkinningBoneCount;
         if (UTILS_UNLIKELY(count > 0 || builder->mMorphingEnabled)) {
             std::unique_ptr<Bones>& bones = manager[ci].bones;
-            // Note that we are sizing the bones UBO according to CONFIG_MAX_BONE_COUNT rather than
-            // mSkinningBoneCount. According to the OpenGL ES 3.2 specification in 7.6.3 Uniform
-            // Buffer Object Bindings:
+            // According to the OpenGL ES 3.2 specification in 7.6.3 Uniform Buffer Object
+            // Bindings:
             //
             //     the uniform block must be populated with a buffer object with a size no smaller
             //     than the minimum required size of the uniform block (the value of
             //     UNIFORM_BLOCK_DATA_SIZE).
             //
-            // This unfortunately means that we are using a large memory footprint for skinned
-            // renderables. In the future we could try addressing this by implementing a paging
-            // system such that multiple skinned renderables will share regions within a single
-            // large block of bones.
+            // So the bones are bound with a range of CONFIG_MAX_BONE_COUNT bones, but only
+            // mSkinningBoneCount of them are stored: the renderables share large buffers, padded
+            // so the range of the last slot doesn't overflow, see FEngine::getBonesArena().
             bones = std::unique_ptr<Bones>(new Bones{
-                    driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone),
-                            backend::BufferUsage::DYNAMIC),
+                    mEngine.getBonesArena().allocate(driver,
+                            std::max(count, size_t(1)) * sizeof(PerRenderableUibBone)),
                     UniformBuffer{ count * sizeof(PerRenderableUibBone) },
                     count
             });
@@ -330,6 +438,7 @@ void FRenderableManager::destroy(utils::Entity e) noexcept {
     if (ci) {
         destroyComponent(ci);
         mManager.removeComponent(e);
+        mLayoutGeneration = ++mGeneration;
     }
 }
 
@@ -362,7 +471,7 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     // destroy the bones structures if any
     std::unique_ptr<Bones> const& bones = manager[ci].bones;
     if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+        engine.getBonesArena().free(driver, bones->slot);
     }
 }
 
@@ -381,24 +490,85 @@ void FRenderableManager::prepare(
         utils::Range<uint32_t> list) const noexcept {
     const auto& manager = mManager;
 
+    UniformBufferArena& arena = mEngine.getBonesArena();
     std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones = manager.raw_array<BONES>();
     for (uint32_t index : list) {
         size_t i = instances[index].asValue();
         assert(i);  // we should never get the null instance here
         if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.loadUniformBuffer(bones[i]->handle, bones[i]->bones.toBufferDescriptor(driver));
+            UniformBuffer const& ub = bones[i]->bones;
+            if (ub.isDirty()) {
+                // only the changed bones are written, at their place in our slot
+                const size_t offset = ub.getDirtyOffset();
+                arena.update(bones[i]->slot, offset,
+                        static_cast<uint8_t const*>(ub.getBuffer()) + offset, ub.getDirtySize());
+                ub.clean();
             }
         }
     }
+
+    // the bones of all the renderables are uploaded with one update per shared buffer
+    mEngine.addUniformBufferBytes(arena.flush(driver));
+}
+
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    Slice<FRenderPrimitive> primitives = mManager[instance].primitives;
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    if (UTILS_LIKELY(!lods)) {
+        return level ? Slice<FRenderPrimitive>{} : primitives;
+    }
+    assert(level <= lods->count);
+    if (level == lods->count) {
+        return {};
+    }
+    return { primitives.begin() + lods->offsets[level],
+             primitives.begin() + lods->offsets[level + 1] };
+}
+
+uint8_t FRenderableManager::selectLevelOfDetail(Instance instance,
+        float screenCoverage, uint8_t current) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    if (UTILS_LIKELY(!lods)) {
+        return 0;
+    }
+
+    // levels have decreasing screen coverage, pick the first one that fits. If none do, we
+    // pick lods->count, i.e. the renderable isn't drawn.
+    float const* const coverages = lods->screenCoverage;
+    const uint8_t count = lods->count;
+    uint8_t level = 0;
+    while (level < count && screenCoverage < coverages[level]) {
+        level++;
+    }
+
+    // with hysteresis, we only switch to a coarser (resp. finer) level once the coverage is
+    // sufficiently below (resp. above) the current level's bounds. The current level may come
+    // from a renderable that had more levels.
+    current = std::min(current, count);
+    const float h = lods->hysteresis;
+    if (h > 0.0f && level != current) {
+        if (level > current) {
+            if (screenCoverage >= coverages[current] * (1.0f - h)) {
+                level = current;
+            }
+        } else {
+            if (screenCoverage < coverages[current - 1] * (1.0f + h)) {
+                level = current;
+            }
+        }
+    }
+
+    return level;
 }
 
-void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
+void FRenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
+            updateGeneration(instance);
             AttributeBitset required = mi->getMaterial()->getRequiredAttributes();
             AttributeBitset declared = primitives[primitiveIndex].getEnabledAttributes();
             if (UTILS_UNLIKELY((declared & required) != required)) {
@@ -411,9 +581,9 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 }
 
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -423,20 +593,31 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
     return nullptr;
 }
 
-void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
+void FRenderableManager::setBlendOrderAt(Instance instance,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
+            updateGeneration(instance);
+        }
+    }
+}
+
+void FRenderableManager::setUvDensityAt(Instance instance,
+        size_t primitiveIndex, float density) noexcept {
+    if (instance) {
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
+        if (primitiveIndex < primitives.size()) {
+            primitives[primitiveIndex].setUvDensity(std::max(0.0f, density));
         }
     }
 }
 
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
-        Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
+        Instance instance, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -444,24 +625,36 @@ AttributeBitset FRenderableManager::getEnabledAttributesAt(
     return AttributeBitset{};
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
         size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
                     0, vertices->getVertexCount() - 1, count);
+            updateGeneration(instance);
         }
     }
 }
 
-void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+void FRenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
+            updateGeneration(instance);
+        }
+    }
+}
+
+void FRenderableManager::setClustersAt(Instance instance, size_t primitiveIndex,
+        Cluster const* clusters, size_t count) noexcept {
+    if (instance) {
+        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance);
+        if (primitiveIndex < primitives.size()) {
+            primitives[primitiveIndex].setClusters(clusters, count);
         }
     }
 }
@@ -505,6 +698,7 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setMorphWeights(Instance ci, const float4& weights) noexcept {
     if (ci) {
         mManager[ci].morphWeights = weights;
+        updateGeneration(ci);
     }
 }
 
@@ -593,37 +787,46 @@ uint8_t RenderableManager::getLayerMask(Instance instance) const noexcept {
 }
 
 size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
-    return upcast(this)->getPrimitiveCount(instance, 0);
+    return upcast(this)->getPrimitiveCount(instance);
 }
 
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    upcast(this)->setMaterialInstanceAt(instance, primitiveIndex, upcast(materialInstance));
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
         Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getMaterialInstanceAt(instance, 0, primitiveIndex);
+    return upcast(this)->getMaterialInstanceAt(instance, primitiveIndex);
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    upcast(this)->setBlendOrderAt(instance, primitiveIndex, order);
+}
+
+void RenderableManager::setUvDensityAt(Instance instance, size_t primitiveIndex, float density) noexcept {
+    upcast(this)->setUvDensityAt(instance, primitiveIndex, density);
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
-    return upcast(this)->getEnabledAttributesAt(instance, 0, primitiveIndex);
+    return upcast(this)->getEnabledAttributesAt(instance, primitiveIndex);
 }
 
 void RenderableManager::setGeometryAt(Instance instance, size_t primitiveIndex,
         PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
         size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex,
+    upcast(this)->setGeometryAt(instance, primitiveIndex,
             type, upcast(vertices), upcast(indices), offset, count);
 }
 
 void RenderableManager::setGeometryAt(RenderableManager::Instance instance, size_t primitiveIndex,
         RenderableManager::PrimitiveType type, size_t offset, size_t count) noexcept {
-    upcast(this)->setGeometryAt(instance, 0, primitiveIndex, type, offset, count);
+    upcast(this)->setGeometryAt(instance, primitiveIndex, type, offset, count);
+}
+
+void RenderableManager::setClustersAt(Instance instance, size_t primitiveIndex,
+        Cluster const* clusters, size_t count) noexcept {
+    upcast(this)->setClustersAt(instance, primitiveIndex, clusters, count);
 }
 
 void RenderableManager::setBones(Instance instance,
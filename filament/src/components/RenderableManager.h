@@ -20,6 +20,7 @@
 #include "upcast.h"
 
 #include "UniformBuffer.h"
+#include "UniformBufferArena.h"
 
 #include "private/backend/DriverApiForward.h"
 
@@ -28,6 +29,7 @@
 #include <filament/Box.h>
 #include <filament/RenderableManager.h>
 
+#include <private/filament/EngineEnums.h>
 #include <private/filament/UibGenerator.h>
 
 #include <utils/Entity.h>
@@ -80,6 +82,14 @@ public:
         return mManager.getInstance(e);
     }
 
+    utils::Entity getEntity(Instance instance) const noexcept {
+        return mManager.getEntity(instance);
+    }
+
+    size_t getComponentCount() const noexcept {
+        return mManager.getComponentCount();
+    }
+
     void create(const RenderableManager::Builder& builder, utils::Entity entity);
 
     void destroy(utils::Entity e) noexcept;
@@ -91,9 +101,26 @@ public:
             utils::Range<uint32_t> list) const noexcept;
 
     void gc(utils::EntityManager& em) noexcept {
+        size_t const count = mManager.getComponentCount();
         mManager.gc(em);
+        if (count != mManager.getComponentCount()) {
+            mLayoutGeneration = ++mGeneration;
+        }
     }
 
+    /*
+     * Generation counters, used by FScene and RenderPass to detect what changed since they last
+     * gathered their data.
+     * - getGeneration() changes whenever any data gathered by FScene, or any primitive used to
+     *   generate render commands, is modified.
+     * - getLayoutGeneration() changes when components are added or removed, which can
+     *   invalidate existing Instances.
+     * - getGeneration(Instance) is the generation at which that instance was last modified.
+     */
+    uint64_t getGeneration() const noexcept { return mGeneration; }
+    uint64_t getLayoutGeneration() const noexcept { return mLayoutGeneration; }
+    inline uint64_t getGeneration(Instance instance) const noexcept;
+
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -126,37 +153,60 @@ public:
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
     inline filament::math::float4 getMorphWeights(Instance instance) const noexcept;
+    inline filament::math::float4 getPositionDequantization(Instance instance) const noexcept;
+    inline uint16_t getInstanceCount(Instance instance) const noexcept;
 
     inline backend::Handle<backend::HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
     inline uint32_t getBoneCount(Instance instance) const noexcept;
 
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
-    inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
-    void setMaterialInstanceAt(Instance instance, uint8_t level,
+    inline size_t getLevelCount(Instance instance) const noexcept;
+    inline bool hasLevelsOfDetail(Instance instance) const noexcept;
+    inline size_t getPrimitiveCount(Instance instance) const noexcept;
+    void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
-    MaterialInstance* getMaterialInstanceAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+    MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
             size_t offset, size_t count) noexcept;
-    void setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
+    void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
-    void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
-    AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    void setClustersAt(Instance instance, size_t primitiveIndex,
+            Cluster const* clusters, size_t count) noexcept;
+    void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t blendOrder) noexcept;
+    void setUvDensityAt(Instance instance, size_t primitiveIndex, float density) noexcept;
+    AttributeBitset getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept;
+    // all the primitives of the renderable, regardless of their level of detail
+    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance) const noexcept;
+    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance) noexcept;
+    // primitives of the given level of detail, empty for level == getLevelCount()
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
+
+    // Selects the level of detail to use for the given screen coverage. 'current' is the level
+    // selected the last time for the same camera, which the hysteresis sticks to.
+    uint8_t selectLevelOfDetail(Instance instance, float screenCoverage,
+            uint8_t current) const noexcept;
 
 private:
+    inline void updateGeneration(Instance instance) noexcept;
     void destroyComponent(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
     struct Bones {
-        filament::backend::Handle<backend::HwUniformBuffer> handle;
+        UniformBufferArena::Slot slot;  // sub-allocated from FEngine::getBonesArena()
         UniformBuffer bones;
         size_t count;
     };
 
+    struct LevelsOfDetail {
+        uint32_t offsets[CONFIG_MAX_LOD_COUNT + 1] = {};    // first primitive of each level
+        float screenCoverage[CONFIG_MAX_LOD_COUNT] = {};    // minimum coverage of each level
+        float hysteresis = 0.0f;
+        uint8_t count = 0;                                  // number of levels
+    };
+
     friend class ::FilamentTest_Bones_Test;
 
     static void makeBone(PerRenderableUibBone* out, math::mat4f const& transforms) noexcept;
@@ -165,18 +215,26 @@ private:
         AABB,               // user data
         LAYERS,             // user data
         MORPH_WEIGHTS,      // user data
+        POSITION_DEQUANTIZATION, // user data, offset and scale of quantized positions
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
+        INSTANCES,          // user data, number of instances to draw
+        LODS,               // user data, levels of detail, null with a single level
         BONES,              // filament data, UBO storing a pointer to the bones information
+        GENERATION,         // filament data, generation of the last change
     };
 
     using Base = utils::SingleInstanceComponentManager<
             Box,                             // AABB
             uint8_t,                         // LAYERS
             filament::math::float4,          // MORPH_WEIGHTS
+            filament::math::float4,          // POSITION_DEQUANTIZATION
             Visibility,                      // VISIBILITY
             utils::Slice<FRenderPrimitive>,  // PRIMITIVES
-            std::unique_ptr<Bones>           // BONES
+            uint16_t,                        // INSTANCES
+            std::unique_ptr<LevelsOfDetail>, // LODS
+            std::unique_ptr<Bones>,          // BONES
+            uint64_t                         // GENERATION
     >;
 
     struct Sim : public Base {
@@ -194,9 +252,13 @@ private:
                 Field<AABB>         aabb;
                 Field<LAYERS>       layers;
                 Field<MORPH_WEIGHTS> morphWeights;
+                Field<POSITION_DEQUANTIZATION> positionDequantization;
                 Field<VISIBILITY>   visibility;
                 Field<PRIMITIVES>   primitives;
+                Field<INSTANCES>    instances;
+                Field<LODS>         lods;
                 Field<BONES>        bones;
+                Field<GENERATION>   generation;
             };
         };
 
@@ -210,13 +272,24 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint64_t mGeneration = 0;
+    uint64_t mLayoutGeneration = 0;
 };
 
 FILAMENT_UPCAST(RenderableManager)
 
+void FRenderableManager::updateGeneration(Instance instance) noexcept {
+    mManager[instance].generation = ++mGeneration;
+}
+
+uint64_t FRenderableManager::getGeneration(Instance instance) const noexcept {
+    return mManager[instance].generation;
+}
+
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
         mManager[instance].aabb = aabb;
+        updateGeneration(instance);
     }
 }
 
@@ -225,12 +298,14 @@ void FRenderableManager::setLayerMask(Instance instance,
     if (instance) {
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
+        updateGeneration(instance);
     }
 }
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
         mManager[instance].layers = layerMask;
+        updateGeneration(instance);
     }
 }
 
@@ -238,6 +313,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
+        updateGeneration(instance);
     }
 }
 
@@ -245,6 +321,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -252,6 +329,7 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -259,6 +337,7 @@ void FRenderableManager::setScreenSpaceContactShadows(Instance instance, bool en
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.screenSpaceContactShadows = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -266,6 +345,7 @@ void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -273,6 +353,7 @@ void FRenderableManager::setSkinning(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.skinning = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -280,6 +361,7 @@ void FRenderableManager::setMorphing(Instance instance, bool enable) noexcept {
     if (instance) {
         Visibility& visibility = mManager[instance].visibility;
         visibility.morphing = enable;
+        updateGeneration(instance);
     }
 }
 
@@ -319,13 +401,27 @@ filament::math::float4 FRenderableManager::getMorphWeights(Instance instance) co
     return mManager[instance].morphWeights;
 }
 
+filament::math::float4 FRenderableManager::getPositionDequantization(
+        Instance instance) const noexcept {
+    return mManager[instance].positionDequantization;
+}
+
+uint16_t FRenderableManager::getInstanceCount(Instance instance) const noexcept {
+    return mManager[instance].instances;
+}
+
 Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
 
 backend::Handle<backend::HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
     std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : backend::Handle<backend::HwUniformBuffer>{};
+    return bones ? bones->slot.handle : backend::Handle<backend::HwUniformBuffer>{};
+}
+
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
+    return bones ? bones->slot.offset : 0;
 }
 
 inline uint32_t FRenderableManager::getBoneCount(Instance instance) const noexcept {
@@ -334,17 +430,27 @@ inline uint32_t FRenderableManager::getBoneCount(Instance instance) const noexce
 }
 
 utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
+        Instance instance) const noexcept {
     return mManager[instance].primitives;
 }
 
 utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
+        Instance instance) noexcept {
     return mManager[instance].primitives;
 }
 
-size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
-    return getRenderPrimitives(instance, level).size();
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    return lods ? lods->count : 1;
+}
+
+bool FRenderableManager::hasLevelsOfDetail(Instance instance) const noexcept {
+    std::unique_ptr<LevelsOfDetail> const& lods = mManager[instance].lods;
+    return bool(lods);
+}
+
+size_t FRenderableManager::getPrimitiveCount(Instance instance) const noexcept {
+    return getRenderPrimitives(instance).size();
 }
 
 } // namespace filament
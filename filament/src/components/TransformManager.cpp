@@ -16,7 +16,14 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
 #include <math/mat4.h>
+#include <math/simd.h>
+
+#include <algorithm>
+#include <functional>
 
 using namespace utils;
 using namespace filament::math;
@@ -25,6 +32,10 @@ namespace filament {
 
 FTransformManager::FTransformManager() noexcept = default;
 
+FTransformManager::FTransformManager(JobSystem* js) noexcept
+        : mJobSystem(js) {
+}
+
 FTransformManager::~FTransformManager() noexcept = default;
 
 void FTransformManager::terminate() noexcept {
@@ -45,12 +56,14 @@ void FTransformManager::create(Entity entity, Instance parent, const mat4f& loca
     Instance i = manager.addComponent(entity);
     assert(i);
     assert(i != parent);
+    mLayoutGeneration = ++mGeneration;
 
     if (i && i != parent) {
         manager[i].parent = 0;
         manager[i].next = 0;
         manager[i].prev = 0;
         manager[i].firstChild = 0;
+        manager[i].dirty = false;
         insertNode(i, parent);
         setTransform(i, localTransform);
     }
@@ -118,6 +131,10 @@ void FTransformManager::destroy(Entity e) noexcept {
         Instance child = manager[i].firstChild;
         while (child) {
             manager[child].parent = 0;
+            if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
+                // they become roots, their world transform is updated on commit
+                manager[child].dirty = true;
+            }
             child = manager[child].next;
         }
 
@@ -128,6 +145,8 @@ void FTransformManager::destroy(Entity e) noexcept {
         if (moved != i) {
             updateNode(i);
         }
+
+        mLayoutGeneration = ++mGeneration;
     }
 }
 
@@ -142,26 +161,30 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
 }
 
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
-    if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
-        return;
-    }
-
     validateNode(i);
     auto& manager = mManager;
     assert(i);
 
+    if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
+        // the world transforms of this node and its descendants are updated on commit
+        manager[i].dirty = true;
+        return;
+    }
+
     // find our parent's world transform, if any
     // note: by using the raw_array() we don't need to check that parent is valid.
     Instance parent = manager[i].parent;
     mat4f const& pt = manager.raw_array<WORLD>()[parent];
 
     // compute our world transform
-    manager[i].world = pt * static_cast<mat4f const&>(manager[i].local);
+    const uint64_t generation = ++mGeneration;
+    manager[i].world = simd::multiply(pt, static_cast<mat4f const&>(manager[i].local));
+    manager[i].generation = generation;
 
     // update our children's world transforms
     Instance child = manager[i].firstChild;
     if (UTILS_UNLIKELY(child)) { // assume we don't have a hierarchy in the common case
-        transformChildren(manager, child);
+        transformChildren(manager, child, generation);
     }
 }
 
@@ -172,23 +195,103 @@ void FTransformManager::openLocalTransformTransaction() noexcept {
 void FTransformManager::commitLocalTransformTransaction() noexcept {
     if (mLocalTransformTransactionOpen) {
         mLocalTransformTransactionOpen = false;
-        auto& manager = mManager;
+        updateDirtyNodes();
+    }
+}
+
+void FTransformManager::updateDirtyNodes() noexcept {
+    SYSTRACE_CALL();
+
+    auto& manager = mManager;
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    /*
+     * The update is done in three steps:
+     * 1. (serial)   sort children after their parent, which keeps the traversal below mostly
+     *               linear in memory, compute the depth of each node and propagate the dirty
+     *               flags to the descendants.
+     * 2. (serial)   bucket the dirty nodes by depth.
+     * 3. (parallel) update the world transforms one level at a time, all the nodes of a level
+     *               only depend on the previous level.
+     */
+
+    auto& depths = mDepths;
+    depths.resize(manager.end());
+    depths[0] = 0; // the null instance is the parent of all the roots
+
+    bool reordered = false;
+    uint32_t maxDepth = 0;
+    size_t dirtyCount = 0;
+    uint8_t* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        // Ensure that children are always sorted after their parent.
+        while (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
+            swapNode(i, manager[i].parent);
+            reordered = true;
+        }
+        Instance parent = manager[i].parent;
+        assert(parent < i);
+        depths[i] = depths[parent] + 1;
+        dirty[i] |= dirty[parent];
+        if (dirty[i]) {
+            maxDepth = std::max(maxDepth, depths[i]);
+            dirtyCount++;
+        }
+    }
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
+    if (dirtyCount) {
+        // counting sort of the dirty nodes by depth, which keeps them in memory order
+        auto& offsets = mLevelOffsets;
+        offsets.assign(maxDepth + 2, 0);
         for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            while (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
+            offsets[depths[i] + 1] += dirty[i];
+        }
+        for (size_t d = 1; d < offsets.size(); d++) {
+            offsets[d] += offsets[d - 1];
+        }
+        auto& nodes = mDirtyNodes;
+        nodes.resize(dirtyCount);
+        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+            if (dirty[i]) {
+                nodes[offsets[depths[i]]++] = i;
+                dirty[i] = false;
+            }
+        }
+        // offsets[d] is now the end of level d, i.e. the start of level d + 1
+
+        const uint64_t generation = ++mGeneration;
+        auto work = [&soa, nodes = nodes.data(), generation](uint32_t start, uint32_t count) {
+            mat4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+            mat4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+            Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+            uint64_t* const UTILS_RESTRICT generations = soa.data<GENERATION>();
+            for (size_t j = start, c = start + count; j < c; j++) {
+                const Instance i = nodes[j];
+                world[i] = simd::multiply(world[parents[i]], local[i]);
+                generations[i] = generation;
+            }
+        };
+
+        for (size_t d = 1; d <= maxDepth; d++) {
+            const uint32_t start = offsets[d - 1];
+            const uint32_t count = offsets[d] - start;
+            if (mJobSystem && count >= JOBS_PARALLEL_FOR_UPDATE_COUNT * 2) {
+                JobSystem& js = *mJobSystem;
+                js.runAndWait(jobs::parallel_for(js, nullptr, start, count, std::cref(work),
+                        jobs::CountSplitter<JOBS_PARALLEL_FOR_UPDATE_COUNT, 8>()));
+            } else {
+                work(start, count);
             }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
         }
     }
+
+    if (reordered) {
+        // instances have been reordered
+        mLayoutGeneration = ++mGeneration;
+    }
 }
 
 // Inserts a parentless node in the hierarchy
@@ -225,6 +328,8 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<GENERATION>(i), manager.elementAt<GENERATION>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -311,18 +416,20 @@ void FTransformManager::updateNode(Instance i) noexcept {
     validateNode(next);
 }
 
-void FTransformManager::transformChildren(Sim& manager, Instance ci) noexcept {
+void FTransformManager::transformChildren(Sim& manager, Instance ci,
+        uint64_t generation) noexcept {
     while (ci) {
         // update child's world transform
         Instance parent = manager[ci].parent;
         mat4f const& pt = manager[parent].world;
         mat4f const& local = manager[ci].local;
-        manager[ci].world = pt * local;
+        manager[ci].world = simd::multiply(pt, local);
+        manager[ci].generation = generation;
 
         // assume we don't have a deep hierarchy
         Instance child = manager[ci].firstChild;
         if (UTILS_UNLIKELY(child)) {
-            transformChildren(manager, child);
+            transformChildren(manager, child, generation);
         }
 
         // process our next child
@@ -28,6 +28,12 @@
 
 #include <math/mat4.h>
 
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class UTILS_PRIVATE FTransformManager : public TransformManager {
@@ -35,6 +41,10 @@ public:
     using Instance = TransformManager::Instance;
 
     FTransformManager() noexcept;
+
+    // if a JobSystem is given, commitLocalTransformTransaction() uses it to update large
+    // hierarchies in parallel
+    explicit FTransformManager(utils::JobSystem* js) noexcept;
     ~FTransformManager() noexcept;
 
     // free-up all resources
@@ -91,6 +101,21 @@ public:
         return mManager[ci].world;
     }
 
+    /*
+     * Generation counters, used by FScene to detect what changed since it last gathered
+     * its data.
+     * - getGeneration() changes whenever any world transform is modified.
+     * - getLayoutGeneration() changes when components are added, removed or reordered, which
+     *   can invalidate existing Instances.
+     * - getGeneration(Instance) is the generation at which that instance's world transform
+     *   was last modified.
+     */
+    uint64_t getGeneration() const noexcept { return mGeneration; }
+    uint64_t getLayoutGeneration() const noexcept { return mLayoutGeneration; }
+    uint64_t getGeneration(Instance ci) const noexcept {
+        return mManager[ci].generation;
+    }
+
 private:
     struct Sim;
 
@@ -100,7 +125,8 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
-    static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    void updateDirtyNodes() noexcept;
+    static void transformChildren(Sim& manager, Instance firstChild, uint64_t generation) noexcept;
 
     friend class TransformManager::children_iterator;
 
@@ -111,6 +137,8 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        GENERATION,     // generation of the last change to the world transform
+        DIRTY,          // world transform must be updated when the transaction is committed
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -119,7 +147,9 @@ private:
             Instance,
             Instance,
             Instance,
-            Instance
+            Instance,
+            uint64_t,
+            uint8_t
     >;
 
     struct Sim : public Base {
@@ -142,6 +172,8 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<GENERATION>   generation;
+                Field<DIRTY>        dirty;
             };
         };
 
@@ -153,7 +185,18 @@ private:
         }
     };
 
+    // minimum number of nodes of a level in the hierarchy for it to be updated in parallel
+    static constexpr size_t JOBS_PARALLEL_FOR_UPDATE_COUNT = 256;
+
     Sim mManager;
+    utils::JobSystem* const mJobSystem = nullptr;
+
+    // scratch storage for commitLocalTransformTransaction(), kept to avoid allocations
+    std::vector<uint32_t> mDepths;          // depth of each node, 1 for roots
+    std::vector<uint32_t> mLevelOffsets;    // first entry of each level in mDirtyNodes
+    std::vector<Instance> mDirtyNodes;      // nodes to update, sorted by depth
+    uint64_t mGeneration = 0;
+    uint64_t mLayoutGeneration = 0;
     bool mLocalTransformTransactionOpen = false;
 };
 
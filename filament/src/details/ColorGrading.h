@@ -24,12 +24,107 @@
 
 #include <filament/ColorGrading.h>
 
-#include <math/mathfwd.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <utils/Hash.h>
+
+#include <stdint.h>
 
 namespace filament {
 
 class FEngine;
 
+// The parameters of a ColorGrading, which are also the key of its LUT in ColorGradingLutCache.
+struct ColorGrading::BuilderDetails {
+    ColorGrading::QualityLevel quality = QualityLevel::MEDIUM;
+
+    ToneMapping toneMapping = ToneMapping::ACES_LEGACY;
+    // White balance
+    math::float2 whiteBalance     = {0.0f, 0.0f};
+    // Channel mixer
+    math::float3 outRed           = {1.0f, 0.0f, 0.0f};
+    math::float3 outGreen         = {0.0f, 1.0f, 0.0f};
+    math::float3 outBlue          = {0.0f, 0.0f, 1.0f};
+    // Tonal ranges
+    math::float3 shadows          = {1.0f, 1.0f, 1.0f};
+    math::float3 midtones         = {1.0f, 1.0f, 1.0f};
+    math::float3 highlights       = {1.0f, 1.0f, 1.0f};
+    math::float4 tonalRanges      = {0.0f, 0.333f, 0.550f, 1.0f}; // defaults in DaVinci Resolve
+    // ASC CDL
+    math::float3 slope            = {1.0f};
+    math::float3 offset           = {0.0f};
+    math::float3 power            = {1.0f};
+    // Color adjustments
+    float        contrast         = 1.0f;
+    float        vibrance         = 1.0f;
+    float        saturation       = 1.0f;
+    // Curves
+    math::float3 shadowGamma      = {1.0f};
+    math::float3 midPoint         = {1.0f};
+    math::float3 highlightScale   = {1.0f};
+    // Keep last
+    bool         hasAdjustments   = false;
+
+    bool operator!=(const BuilderDetails &rhs) const {
+        return !(rhs == *this);
+    }
+
+    bool operator==(const BuilderDetails &rhs) const {
+        // Note: Do NOT compare hasAdjustments
+        return quality == rhs.quality &&
+               toneMapping == rhs.toneMapping &&
+               whiteBalance == rhs.whiteBalance &&
+               outRed == rhs.outRed &&
+               outGreen == rhs.outGreen &&
+               outBlue == rhs.outBlue &&
+               shadows == rhs.shadows &&
+               midtones == rhs.midtones &&
+               highlights == rhs.highlights &&
+               tonalRanges == rhs.tonalRanges &&
+               slope == rhs.slope &&
+               offset == rhs.offset &&
+               power == rhs.power &&
+               contrast == rhs.contrast &&
+               vibrance == rhs.vibrance &&
+               saturation == rhs.saturation &&
+               shadowGamma == rhs.shadowGamma &&
+               midPoint == rhs.midPoint &&
+               highlightScale == rhs.highlightScale;
+    }
+
+    // Identifies the LUT generated from these parameters, see ColorGradingLutCache.
+    uint64_t hash() const noexcept {
+        // Note: Do NOT hash hasAdjustments, it's derived from the other parameters
+        using utils::hash::fnv1a64;
+        uint64_t h = fnv1a64(nullptr, 0);
+        auto hashValue = [&h](auto const& value) {
+            h = fnv1a64(&value, sizeof(value), h);
+        };
+        hashValue(quality);
+        hashValue(toneMapping);
+        hashValue(whiteBalance);
+        hashValue(outRed);
+        hashValue(outGreen);
+        hashValue(outBlue);
+        hashValue(shadows);
+        hashValue(midtones);
+        hashValue(highlights);
+        hashValue(tonalRanges);
+        hashValue(slope);
+        hashValue(offset);
+        hashValue(power);
+        hashValue(contrast);
+        hashValue(vibrance);
+        hashValue(saturation);
+        hashValue(shadowGamma);
+        hashValue(midPoint);
+        hashValue(highlightScale);
+        return h;
+    }
+};
+
 class FColorGrading : public ColorGrading {
 public:
     FColorGrading(FEngine& engine, const Builder& builder);
@@ -44,7 +139,7 @@ public:
     backend::TextureHandle getHwHandle() const noexcept { return mLutHandle; }
 
 private:
-    backend::TextureHandle mLutHandle;
+    backend::TextureHandle mLutHandle;   // see ColorGradingLutCache
 };
 
 FILAMENT_UPCAST(ColorGrading)
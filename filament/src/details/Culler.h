@@ -47,6 +47,9 @@ public:
 
     using result_type = uint8_t;
 
+    // Maximum number of frusta culled in a single pass, one per bit of result_type
+    static constexpr size_t MAX_FRUSTUM_COUNT = 8;
+
     /*
      * returns whether each AABB in an array intersects with the frustum
      */
@@ -56,6 +59,18 @@ public:
             math::float3 const* extent,
             size_t count, size_t bit) noexcept;
 
+    /*
+     * returns whether each AABB in an array intersects with each of the frustumCount frusta,
+     * frusta[i] sets bit bits[i] of the results. The AABBs are read from memory only once.
+     */
+    static void intersects(result_type* results,
+            Frustum const* frusta,
+            uint8_t const* bits,
+            size_t frustumCount,
+            math::float3 const* center,
+            math::float3 const* extent,
+            size_t count) noexcept;
+
     /*
      * returns whether each sphere in an array intersects with the frustum
      */
@@ -87,11 +102,23 @@ public:
                 math::float3 const* e,
                 size_t count) noexcept;
 
+        static void intersects(result_type* results,
+                Frustum const* frusta,
+                uint8_t const* bits,
+                size_t frustumCount,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count) noexcept;
+
         static void intersects(result_type* results,
                 Frustum const& frustum,
                 math::float4 const* b,
                 size_t count) noexcept;
     };
+
+private:
+    // Number of AABBs culled against all the frusta at a time, they fit in the L1 cache (6 KiB)
+    static constexpr size_t FUSED_BLOCK_SIZE = 256;
 };
 
 } // namespace filament
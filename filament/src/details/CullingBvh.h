@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_CULLINGBVH_H
+#define TNT_FILAMENT_DETAILS_CULLINGBVH_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * A bounding volume hierarchy of axis-aligned boxes, used to cull large numbers of (mostly
+ * static) objects against a frustum.
+ *
+ * Each item is identified by an id (e.g. a renderable instance) chosen by the caller. Whole
+ * subtrees are rejected or accepted at once, and the leaves, which hold up to LEAF_SIZE items,
+ * are tested with the regular Culler.
+ *
+ * The hierarchy is built once with build(), the bounds of items can then be changed with
+ * update(), followed by refit() which only recomputes the bounds of the affected nodes. Refitting
+ * doesn't change the topology, so the hierarchy should be built again when the items moved a lot.
+ */
+class CullingBvh {
+public:
+    // maximum number of items in a leaf, must be a multiple of Culler::MODULO
+    static constexpr size_t LEAF_SIZE = 32;
+
+    CullingBvh() noexcept = default;
+    CullingBvh(CullingBvh const& rhs) = delete;
+    CullingBvh& operator=(CullingBvh const& rhs) = delete;
+
+    // builds the hierarchy from scratch, ids must be unique
+    void build(uint32_t const* ids, math::float3 const* centers, math::float3 const* extents,
+            size_t count);
+
+    // destroys the hierarchy
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mNodes.empty(); }
+
+    // changes the bounds of an item, refit() must be called before culling
+    void update(uint32_t id, math::float3 const& center, math::float3 const& extent) noexcept;
+
+    // updates the bounds of the nodes containing items changed by update()
+    void refit() noexcept;
+
+    /*
+     * Culls the hierarchy against the frustum. For each run of items that is not entirely
+     * outside of the frustum, calls:
+     *
+     *      visible(uint32_t const* ids, Culler::result_type const* results, size_t count);
+     *
+     * results[i] has the visibility bit set if the item is visible, if results is nullptr all
+     * the items are visible. The visibility bit is given by 'bit', as with Culler::intersects().
+     */
+    template<typename VISIBLE>
+    void cull(Frustum const& frustum, size_t bit, VISIBLE visible) const noexcept;
+
+private:
+    struct Node {                   // 40 bytes
+        math::float3 center;        // center of the bounding box
+        math::float3 extent;        // half-extent of the bounding box
+        uint32_t first;             // first item of this subtree
+        uint32_t last;              // one past the last item of this subtree
+        // index of the right child of an inner node, 0 for a leaf. The left child always
+        // immediately follows its parent.
+        uint32_t right;
+        uint32_t reserved;
+    };
+
+    enum class Classification { OUTSIDE, INTERSECTS, INSIDE };
+
+    void buildNode(uint32_t* order, uint32_t first, uint32_t last,
+            math::float3 const* centers, math::float3 const* extents);
+
+    void computeBounds(Node& node) const noexcept;
+
+    static inline Classification classify(math::float4 const* UTILS_RESTRICT planes,
+            math::float3 const& center, math::float3 const& extent) noexcept;
+
+    // nodes in depth-first order
+    std::vector<Node> mNodes;
+
+    // items, sorted so that the items of any subtree are contiguous. There are at least
+    // Culler::MODULO extra items at the end to allow Culler to process whole multiples.
+    std::vector<uint32_t> mIds;
+    std::vector<math::float3> mCenters;
+    std::vector<math::float3> mExtents;
+
+    // for each id, index of its item
+    std::vector<uint32_t> mItemOfId;
+    // for each item, index of its leaf
+    std::vector<uint32_t> mLeafOfItem;
+    // nodes whose bounds must be recomputed by refit()
+    std::vector<bool> mDirtyNodes;
+    bool mDirty = false;
+};
+
+CullingBvh::Classification CullingBvh::classify(math::float4 const* UTILS_RESTRICT planes,
+        math::float3 const& center, math::float3 const& extent) noexcept {
+    // same test as Culler::intersects(), planes point outside of the frustum
+    Classification result = Classification::INSIDE;
+    for (size_t j = 0; j < 6; j++) {
+        const float d = dot(planes[j].xyz, center) + planes[j].w;
+        const float r = dot(abs(planes[j].xyz), extent);
+        if (d - r >= 0) {
+            return Classification::OUTSIDE;
+        }
+        if (d + r >= 0) {
+            result = Classification::INTERSECTS;
+        }
+    }
+    return result;
+}
+
+template<typename VISIBLE>
+void CullingBvh::cull(Frustum const& frustum, size_t bit, VISIBLE visible) const noexcept {
+    if (UTILS_UNLIKELY(mNodes.empty())) {
+        return;
+    }
+
+    math::float4 const* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
+    Node const* const UTILS_RESTRICT nodes = mNodes.data();
+
+    // the depth of the tree is bounded by log2(item count), because we split at the median
+    uint32_t stack[64];
+    size_t depth = 0;
+    stack[depth++] = 0;
+    while (depth) {
+        Node const& node = nodes[stack[--depth]];
+        Classification const c = classify(planes, node.center, node.extent);
+        if (c == Classification::OUTSIDE) {
+            continue;
+        }
+        if (c == Classification::INSIDE) {
+            visible(mIds.data() + node.first, nullptr, node.last - node.first);
+            continue;
+        }
+        if (!node.right) {
+            Culler::result_type results[LEAF_SIZE] = {};
+            Culler::intersects(results, frustum,
+                    mCenters.data() + node.first, mExtents.data() + node.first,
+                    node.last - node.first, bit);
+            visible(mIds.data() + node.first, results, node.last - node.first);
+            continue;
+        }
+        stack[depth++] = node.right;
+        stack[depth++] = uint32_t(&node - nodes) + 1;
+    }
+}
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_CULLINGBVH_H
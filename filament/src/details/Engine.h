@@ -18,7 +18,13 @@
 #define TNT_FILAMENT_DETAILS_ENGINE_H
 
 #include "upcast.h"
+#include "ColorGradingLutCache.h"
+#include "MaterialStatistics.h"
 #include "PostProcessManager.h"
+#include "ProgramCache.h"
+#include "SamplerGroupCache.h"
+#include "TextureStreamer.h"
+#include "UniformBufferArena.h"
 
 #include "components/CameraManager.h"
 #include "components/LightManager.h"
@@ -30,17 +36,21 @@
 #include "details/DebugRegistry.h"
 #include "details/Fence.h"
 #include "details/IndexBuffer.h"
+#include "details/IndirectLight.h"
 #include "details/RenderTarget.h"
 #include "details/ResourceList.h"
 #include "details/ColorGrading.h"
+#include "details/ParticleSystem.h"
 #include "details/Skybox.h"
 
 #include "private/backend/CommandStream.h"
+#include "private/backend/CommandStreamCapture.h"
 #include "private/backend/CommandBufferQueue.h"
 #include "private/backend/DriverApi.h"
 
 #include <private/filament/EngineEnums.h>
 #include <private/filament/UniformInterfaceBlock.h>
+#include <private/filament/Variant.h>
 
 #include <filament/Engine.h>
 #include <filament/VertexBuffer.h>
@@ -49,6 +59,7 @@
 #include <filament/MaterialEnums.h>
 #include <filament/Texture.h>
 #include <filament/ColorGrading.h>
+#include <filament/ParticleSystem.h>
 #include <filament/Skybox.h>
 
 #include <filament/Stream.h>
@@ -59,6 +70,7 @@
 namespace filament {
 namespace matdbg {
 class DebugServer;
+struct MaterialVariantStats;
 } // namespace matdbg
 } // namespace filament
 #endif
@@ -67,13 +79,19 @@ class DebugServer;
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/bitset.h>
+#include <utils/CString.h>
 #include <utils/JobSystem.h>
 #include <utils/CountDownLatch.h>
 
 #include <chrono>
+#include <map>
 #include <memory>
 #include <random>
+#include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace filament {
 
@@ -118,7 +136,6 @@ public:
     // TODO: these should come from a configuration object
     static constexpr float  CONFIG_Z_LIGHT_NEAR            = 5;
     static constexpr float  CONFIG_Z_LIGHT_FAR             = 100;
-    static constexpr size_t CONFIG_FROXEL_SLICE_COUNT      = 16;
     static constexpr bool   CONFIG_IBL_USE_IRRADIANCE_MAP  = false;
 
     static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE   = filament::CONFIG_PER_RENDER_PASS_ARENA_SIZE;
@@ -128,12 +145,14 @@ public:
 
 public:
     static FEngine* create(Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
 #if UTILS_HAS_THREADING
     static void createAsync(CreateCallback callback, void* user,
             Backend backend = Backend::DEFAULT,
-            Platform* platform = nullptr, void* sharedGLContext = nullptr);
+            Platform* platform = nullptr, void* sharedGLContext = nullptr,
+            const Config* config = nullptr);
 
     static FEngine* getEngine(void* token);
 #endif
@@ -156,8 +175,9 @@ public:
 
     const FMaterial* getDefaultMaterial() const noexcept { return mDefaultMaterial; }
     const FMaterial* getSkyboxMaterial() const noexcept;
-    const FIndirectLight* getDefaultIndirectLight() const noexcept { return mDefaultIbl; }
-    const FTexture* getDummyCubemap() const noexcept { return mDefaultIblTexture; }
+    // the default IBL and the dummy cubemap are created on first use
+    const FIndirectLight* getDefaultIndirectLight() const noexcept;
+    const FTexture* getDummyCubemap() const noexcept;
     const FColorGrading* getDefaultColorGrading() const noexcept { return mDefaultColorGrading; }
 
     backend::Handle<backend::HwRenderPrimitive> getFullScreenRenderPrimitive() const noexcept {
@@ -172,6 +192,18 @@ public:
         return mFullScreenTriangleIb;
     }
 
+    // IndirectLight::prefilter() requests, executed by the next frame rendered
+    void enqueueIblPrefilter(FIndirectLight::PrefilterRequest request) {
+        mIblPrefilterRequests.push_back(std::move(request));
+    }
+
+    std::vector<FIndirectLight::PrefilterRequest> takeIblPrefilterRequests() noexcept {
+        return std::exchange(mIblPrefilterRequests, {});
+    }
+
+    // drops the pending requests of an IndirectLight that is being destroyed
+    void cancelIblPrefilter(FIndirectLight const* ibl) noexcept;
+
     PostProcessManager const& getPostProcessManager() const noexcept {
         return mPostProcessManager;
     }
@@ -208,13 +240,78 @@ public:
         return mBackend;
     }
 
+    void* getSharedContext() noexcept {
+        return mPlatform->getSharedContext();
+    }
+
+    bool hasPlatformBlobFunc() const noexcept {
+        return mPlatform->hasBlobFunc();
+    }
+
+    Config const& getConfig() const noexcept {
+        return mConfig;
+    }
+
     ResourceAllocator& getResourceAllocator() noexcept {
         assert(mResourceAllocator);
         return *mResourceAllocator;
     }
 
+    TextureCacheStatistics getTextureCacheStatistics() const noexcept;
+
+    CommandBufferStatistics getCommandBufferStatistics() const noexcept;
+
+    bool getBackendFrameStatistics(backend::FrameStatistics* statistics) const noexcept;
+
+    // records that a variant of a material was requested, see debug.material.record_variants
+    void recordVariant(utils::CString const& materialName, uint8_t variantKey);
+
+    utils::CString getVariantProfile() const noexcept;
+
+    // size in bytes guaranteed to be available in the command buffer after a flush
+    size_t getMinCommandBufferSize() const noexcept {
+        return mCommandBufferQueue.getRequiredSize();
+    }
+
+    // grows the command buffer if it was too small and Config::growCommandBuffer is set, this
+    // must be called between frames
+    void growCommandBufferIfNeeded();
+
+    // growCommandBufferIfNeeded() doesn't grow the guaranteed space beyond this
+    static constexpr size_t MAX_GROWN_COMMAND_BUFFER_SIZE = 64u << 20u;
+
+    // Returns the space to guarantee to a frame after 'requiredSize' was too small for a frame
+    // that used up to 'highWatermark' bytes, a multiple of CircularBuffer::BLOCK_SIZE no larger
+    // than MAX_GROWN_COMMAND_BUFFER_SIZE, or 'requiredSize' if it can't grow.
+    static size_t getGrownCommandBufferSize(size_t requiredSize, size_t highWatermark) noexcept;
+
+    void trimTextureCache(size_t maxSizeInBytes) noexcept;
+
+    void setTextureStreamingBudget(size_t budgetInBytes) noexcept {
+        mTextureStreamingBudget = budgetInBytes;
+    }
+
+    size_t getTextureStreamingBudget() const noexcept { return mTextureStreamingBudget; }
+
+    size_t getTextureStreamingResidentSize() const noexcept {
+        return mTextureStreamer.getResidentSize();
+    }
+
+    MemoryStatistics getMemoryStatistics() const noexcept;
+
+    void setMemoryBudget(size_t budgetInBytes,
+            MemoryBudgetCallback* callback, void* user) noexcept {
+        mMemoryBudget = { budgetInBytes, callback, user };
+    }
+
+    size_t getMemoryBudget() const noexcept { return mMemoryBudget.size; }
+
     void* streamAlloc(size_t size, size_t alignment) noexcept;
 
+    backend::BufferDescriptor allocateStaging(size_t size) {
+        return getDriverApi().allocateStaging(size);
+    }
+
     Epoch getEngineEpoch() const { return mEngineEpoch; }
     duration getEngineTime() const noexcept {
         return clock::now() - getEngineEpoch();
@@ -229,6 +326,7 @@ public:
     FMaterial* createMaterial(const Material::Builder& builder) noexcept;
     FTexture* createTexture(const Texture::Builder& builder) noexcept;
     FSkybox* createSkybox(const Skybox::Builder& builder) noexcept;
+    FParticleSystem* createParticleSystem(const ParticleSystem::Builder& builder) noexcept;
     FColorGrading* createColorGrading(const ColorGrading::Builder& builder) noexcept;
     FStream* createStream(const Stream::Builder& builder) noexcept;
     FRenderTarget* createRenderTarget(const RenderTarget::Builder& builder) noexcept;
@@ -259,6 +357,7 @@ public:
     bool destroy(const FRenderer* p);
     bool destroy(const FScene* p);
     bool destroy(const FSkybox* p);
+    bool destroy(const FParticleSystem* p);
     bool destroy(const FColorGrading* p);
     bool destroy(const FStream* p);
     bool destroy(const FTexture* p);
@@ -284,6 +383,71 @@ public:
     void prepare();
     void gc();
 
+    // incremented by prepare(), i.e. once per Renderer frame
+    uint32_t getPrepareCount() const noexcept { return mPrepareCount; }
+
+    // programs shared by all materials, see FMaterial::createAndCacheProgram()
+    ProgramCache& getProgramCache() const noexcept {
+        return mProgramCache;
+    }
+
+    // sampler groups shared by material instances, see FMaterialInstance::commitSlow()
+    SamplerGroupCache& getSamplerGroupCache() noexcept {
+        return mSamplerGroupCache;
+    }
+
+    // LUTs shared by color gradings, see FColorGrading::FColorGrading()
+    ColorGradingLutCache& getColorGradingLutCache() noexcept {
+        return mColorGradingLutCache;
+    }
+
+    // Measured costs of the parallel loops of the engine, see utils::jobs::AdaptiveSplitter. They
+    // are shared by all the views and passes, since the cost of an item doesn't depend on them.
+    struct ParallelLoopCosts {
+        utils::jobs::SplitterCost culling;              // FView::cullRenderables(), one frustum
+        utils::jobs::SplitterCost cullingFrusta;        // FView::cullRenderables(), many frusta
+        utils::jobs::SplitterCost generateCommands;     // RenderPass::appendCommands()
+        utils::jobs::SplitterCost updateDistanceBits;   // RenderPass::updateDistanceBits()
+    };
+    ParallelLoopCosts& getParallelLoopCosts() noexcept {
+        return mParallelLoopCosts;
+    }
+
+    // levels of the streaming textures, see FView::requestStreamingLevels()
+    TextureStreamer& getTextureStreamer() noexcept {
+        return mTextureStreamer;
+    }
+
+    // cost of the material variants, for matdbg
+    MaterialStatistics& getMaterialStatistics() noexcept {
+        return mMaterialStatistics;
+    }
+
+    // bytes uploaded to the uniform buffers of the scenes and material instances, see
+    // Renderer::getFrameStatistics()
+    void addUniformBufferBytes(size_t size) noexcept {
+        mUniformBufferBytes += size;
+    }
+    uint64_t getUniformBufferBytes() const noexcept {
+        return mUniformBufferBytes;
+    }
+
+    // distance between the renderables' slots in the scenes' UBOs, which is the size of the
+    // data the shaders use rounded up to the driver's uniform buffer offset alignment
+    uint32_t getPerRenderableUboStride() const noexcept {
+        return mPerRenderableUboStride;
+    }
+
+    // uniform buffers of the material instances, see FMaterialInstance::use()
+    UniformBufferArena& getMaterialUniformArena() noexcept {
+        return mMaterialUniformArena;
+    }
+
+    // bones of the skinned renderables, see FRenderableManager::create()
+    UniformBufferArena& getBonesArena() noexcept {
+        return mBonesArena;
+    }
+
     filaflat::ShaderBuilder& getVertexShaderBuilder() const noexcept {
         return mVertexShaderBuilder;
     }
@@ -306,12 +470,27 @@ public:
         return mRandomEngine;
     }
 
+    // Incremented each time a material instance state used to generate render commands changes
+    // (e.g. its culling mode). Used to invalidate retained render commands.
+    void updateMaterialInstanceGeneration() noexcept {
+        ++mMaterialInstanceGeneration;
+    }
+
+    uint64_t getMaterialInstanceGeneration() const noexcept {
+        return mMaterialInstanceGeneration;
+    }
+
 private:
-    FEngine(Backend backend, Platform* platform, void* sharedGLContext);
+    FEngine(Backend backend, Platform* platform, void* sharedGLContext, const Config* config);
+
+    // returns the given configuration (or the default one) clamped to the supported ranges
+    static Config validateConfig(const Config* config) noexcept;
     void init();
     void shutdown();
 
     int loop();
+    // installs the blob functions of the Config on the platform, before the driver is created
+    void setPlatformBlobFunc() noexcept;
     void flushCommandBuffer(backend::CommandBufferQueue& commandBufferQueue);
 
     template<typename T, typename L>
@@ -326,12 +505,30 @@ private:
     Platform* mPlatform = nullptr;
     bool mOwnPlatform = false;
     void* mSharedGLContext = nullptr;
+    const Config mConfig;
     bool mTerminated = false;
     backend::Handle<backend::HwRenderPrimitive> mFullScreenTriangleRph;
     FVertexBuffer* mFullScreenTriangleVb = nullptr;
     FIndexBuffer* mFullScreenTriangleIb = nullptr;
 
     PostProcessManager mPostProcessManager;
+    mutable ProgramCache mProgramCache;
+    SamplerGroupCache mSamplerGroupCache;
+    ColorGradingLutCache mColorGradingLutCache;
+    ParallelLoopCosts mParallelLoopCosts;
+    TextureStreamer mTextureStreamer;
+    MaterialStatistics mMaterialStatistics;
+    uint64_t mUniformBufferBytes = 0;
+    uint32_t mPerRenderableUboStride = sizeof(PerRenderableUib);
+    size_t mTextureStreamingBudget = 0;
+    struct {
+        size_t size = 0;
+        MemoryBudgetCallback* callback = nullptr;
+        void* user = nullptr;
+    } mMemoryBudget;
+    UniformBufferArena mMaterialUniformArena;
+    UniformBufferArena mBonesArena{ 4 * UniformBufferArena::MAX_SLOT_SIZE,
+            CONFIG_MAX_BONE_COUNT * sizeof(PerRenderableUibBone) };
 
     utils::EntityManager& mEntityManager;
     FRenderableManager mRenderableManager;
@@ -352,18 +549,25 @@ private:
     ResourceList<FMaterial> mMaterials{ "Material" };
     ResourceList<FTexture> mTextures{ "Texture" };
     ResourceList<FSkybox> mSkyboxes{ "Skybox" };
+    ResourceList<FParticleSystem> mParticleSystems{ "ParticleSystem" };
     ResourceList<FColorGrading> mColorGradings{ "ColorGrading" };
     ResourceList<FRenderTarget> mRenderTargets{ "RenderTarget" };
 
     mutable uint32_t mMaterialId = 0;
+    uint32_t mPrepareCount = 0;
+
+    // variants requested per material name, while debug.material.record_variants is set
+    std::map<std::string, utils::bitset<uint64_t, (VARIANT_COUNT + 63) / 64>> mRecordedVariants;
 
     // FMaterialInstance are handled directly by FMaterial
     std::unordered_map<const FMaterial*, ResourceList<FMaterialInstance>> mMaterialInstances;
+    uint64_t mMaterialInstanceGeneration = 0;
 
     std::unique_ptr<DFG> mDFG;
 
     std::thread mDriverThread;
     backend::CommandBufferQueue mCommandBufferQueue;
+    std::unique_ptr<backend::CommandStreamCapture> mCommandCapture;
     DriverApi mCommandStream;
 
     LinearAllocatorArena mPerRenderPassAllocator;
@@ -381,6 +585,8 @@ private:
     mutable FTexture* mDefaultIblTexture = nullptr;
     mutable FIndirectLight* mDefaultIbl = nullptr;
 
+    std::vector<FIndirectLight::PrefilterRequest> mIblPrefilterRequests;
+
     mutable FColorGrading* mDefaultColorGrading = nullptr;
 
     mutable utils::CountDownLatch mDriverBarrier;
@@ -410,10 +616,18 @@ public:
         struct {
             bool camera_at_origin = true;
         } view;
+        struct {
+            // When set to true, the variants requested by each material are recorded for
+            // Engine::getVariantProfile().
+            bool record_variants = false;
+        } material;
         struct {
             // When set to true, the backend will attempt to capture the next frame and write the
             // capture to file. At the moment, only supported by the Metal backend.
             bool doFrameCapture = false;
+            // When set to true, render pass commands are sorted with a parallel radix sort
+            // instead of std::sort.
+            bool radix_sort = false;
         } renderer;
         matdbg::DebugServer* server = nullptr;
     } debug;
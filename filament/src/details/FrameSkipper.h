@@ -26,8 +26,9 @@ namespace filament {
 class FEngine;
 
 class FrameSkipper {
-    static constexpr size_t MAX_FRAME_LATENCY = 4;
 public:
+    static constexpr size_t MAX_FRAME_LATENCY = 4;
+
     explicit FrameSkipper(FEngine& engine, size_t latency = 2) noexcept;
     ~FrameSkipper() noexcept;
 
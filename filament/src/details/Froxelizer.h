@@ -76,15 +76,21 @@ public:
 // 256 lights max
 //
 
-// Max number of froxels limited by:
+// The number of froxels is chosen at Engine creation (Engine::Config::froxelCount), and is
+// limited by:
 // - max texture size [min 2048]
 // - chosen texture width [64]
 // - size of CPU-side indices [16 bits]
 // Also, increasing the number of froxels adds more pressure on the "record buffer" which stores
-// the light indices per froxel. The record buffer is limited to 65536 entries, so with
-// 8192 froxels, we can store 8 lights per froxels assuming they're all used. In practice, some
-// froxels are not used, so we can store more.
-static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 8192;
+// the light indices per froxel. The record buffer is sized for 8 lights per froxel, assuming
+// they're all used, up to 65536 entries (i.e. 8192 froxels). In practice, some froxels are not
+// used, so we can store more.
+static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MIN = 1024;
+static constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX = 32768;
+
+// limits of the number of depth slices (Engine::Config::froxelSliceCount)
+static constexpr size_t FROXEL_SLICE_COUNT_MIN = 2;
+static constexpr size_t FROXEL_SLICE_COUNT_MAX = 64;
 
 class Froxelizer {
 public:
@@ -93,6 +99,10 @@ public:
 
     void terminate(backend::DriverApi& driverApi) noexcept;
 
+    // Per-frame memory needed by a Froxelizer with this configuration in excess of what the
+    // default configuration needs, which the per-render-pass arena must account for.
+    static size_t getPerFrameArenaSizeOverhead(Engine::Config const& config) noexcept;
+
     // gpu buffer containing records. valid after construction.
     GPUBuffer const& getRecordBuffer() const noexcept { return mRecordsBuffer; }
 
@@ -137,6 +147,21 @@ public:
     // send froxel data to GPU
     void commit(backend::DriverApi& driverApi);
 
+    // Returns whether any punctual light of lightData reaches the froxels, i.e. isn't entirely
+    // behind the light far plane. When none does, froxelizeLights() would leave all froxels
+    // empty. lightData must be in the state froxelizeLights() is called with.
+    bool hasLightsInRange(CameraInfo const& camera,
+            const FScene::LightSoa& lightData) const noexcept;
+
+    // occupancy of the froxels by the lights, computed by froxelizeLights()
+    struct Statistics {
+        uint32_t maxLightCount = 0;         // lights in the most occupied froxel
+        float averageLightCount = 0.0f;     // average lights per froxel
+        float emptyFroxelRatio = 1.0f;      // ratio of the froxels without lights
+    };
+
+    Statistics const& getStatistics() const noexcept { return mStatistics; }
+
 
     /*
      * Only for testing/debugging...
@@ -159,9 +184,13 @@ public:
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
     // this is chosen so froxelizePointAndSpotLight() vectorizes 4 froxel tests / spotlight
-    // with 256 lights this implies 8 jobs (256 / 32) for froxelization.
+    // with 256 lights this implies 8 groups (256 / 32) for froxelization, each of them split
+    // in ranges of depth slices to make up about FROXELIZE_JOB_COUNT jobs.
     using LightGroupType = uint32_t;
 
+    // target number of jobs used to assign lights to froxels and to compress the records
+    static constexpr size_t FROXELIZE_JOB_COUNT = 32;
+
 private:
     struct LightRecord {
         using bitset = utils::bitset<uint64_t, (CONFIG_MAX_LIGHT_COUNT + 63) / 64>;
@@ -190,8 +219,6 @@ private:
         uint16_t reserved;
     };
 
-    using FroxelThreadData = std::array<LightGroupType, FROXEL_BUFFER_ENTRY_COUNT_MAX>;
-
     void setViewport(Viewport const& viewport) noexcept;
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
@@ -199,10 +226,21 @@ private:
     void froxelizeLoop(FEngine& engine,
             const CameraInfo& camera, const FScene::LightSoa& lightData) noexcept;
 
-    void froxelizeAssignRecordsCompress() noexcept;
+    void froxelizeAssignRecordsCompress(utils::JobSystem& js) noexcept;
 
-    void froxelizePointAndSpotLight(FroxelThreadData& froxelThread, size_t bit,
-            math::mat4f const& projection, const LightParams& light) const noexcept;
+    // converts the per-group light bits of the froxels [begin, end) to mLightRecords
+    void convertLightRecords(size_t begin, size_t end) noexcept;
+
+    // Compresses the records of the froxels [begin, end), starting at 'offset' in the record
+    // buffer, and returns the offset past the last record. Froxel entries and records are only
+    // written if WRITE is true, which allows to compute the offsets of all ranges first.
+    template<bool WRITE>
+    uint32_t compressRecords(size_t begin, size_t end, uint32_t offset) noexcept;
+
+    // assigns a light to the froxels of the depth slices [zBegin, zEnd)
+    void froxelizePointAndSpotLight(LightGroupType* froxelThread, size_t bit,
+            math::mat4f const& projection, const LightParams& light,
+            size_t zBegin, size_t zEnd) const noexcept;
 
     static void computeLightTree(LightTreeNode* lightTree,
             utils::Slice<RecordBufferType> const& lightList,
@@ -218,7 +256,13 @@ private:
 
     static void computeFroxelLayout(
             math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-            Viewport const& viewport) noexcept;
+            Viewport const& viewport, size_t froxelCount, size_t froxelSliceCount) noexcept;
+
+    // number of groups of LIGHT_PER_GROUP lights needed for maxLightCount lights, rounded
+    // so they fill whole LightRecord::bitset words
+    static size_t getGroupCount(size_t maxLightCount) noexcept;
+
+    static size_t getPerFrameArenaSize(Engine::Config const& config) noexcept;
 
     // internal state dependant on the viewport and needed for froxelizing
     LinearAllocatorArena mArena;                    // ~256 KiB
@@ -228,13 +272,26 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
-    utils::Slice<FroxelThreadData> mFroxelShardedData;  // 256 KiB w/  256 lights
+    // one array of froxel light bits per group of lights, mFroxelBufferEntryCount apart
+    utils::Slice<LightGroupType> mFroxelShardedData;    // 256 KiB w/  256 lights
     utils::Slice<FroxelEntry> mFroxelBufferUser;        //  32 KiB w/ 8192 froxels
 
     // max 32 KiB  (actual: resolution dependant)
     utils::Slice<RecordBufferType> mRecordBufferUser;   //  64 KiB
     utils::Slice<LightRecord> mLightRecords;            // 256 KiB w/ 256 lights
 
+    // configuration, constant after construction
+    const uint32_t mFroxelBufferEntryCount;
+    const uint32_t mFroxelSliceCount;
+    const uint32_t mRecordBufferEntryCount;
+    const uint32_t mGroupCount;
+
+    // number of records used in mRecordBufferUser
+    uint32_t mRecordCount = 0;
+
+    // occupancy of the froxels computed by the last froxelizeLights()
+    Statistics mStatistics;
+
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
     uint16_t mFroxelCountZ = 0;
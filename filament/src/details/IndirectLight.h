@@ -29,15 +29,32 @@
 #include <math/mat3.h>
 
 #include <array>
+#include <memory>
 
 namespace filament {
 
 class FEngine;
+class FTexture;
 
 class FIndirectLight : public IndirectLight {
 public:
     static constexpr float DEFAULT_INTENSITY = 30000.0f;    // lux of the sun
 
+    // Destination of the irradiance read back after a GPU prefilter. The readback callbacks and
+    // FIndirectLight are both used on the engine's thread only, so there is no locking; 'ibl'
+    // is cleared when the IndirectLight is destroyed.
+    struct IrradianceReadback {
+        FIndirectLight* ibl = nullptr;
+    };
+
+    // A prefilter() request, queued in the engine and executed by the next frame rendered
+    struct PrefilterRequest {
+        FIndirectLight const* ibl;
+        FTexture const* environment;
+        PrefilterOptions options;
+        std::shared_ptr<IrradianceReadback> irradiance; // null if the irradiance isn't updated
+    };
+
     FIndirectLight(FEngine& engine, const Builder& builder) noexcept;
 
     void terminate(FEngine& engine);
@@ -57,6 +74,12 @@ public:
     static math::float3 getDirectionEstimate(const math::float3 sh[9]) noexcept;
     static math::float4 getColorEstimate(const math::float3 sh[9], math::float3 direction) noexcept;
 
+    bool prefilter(FEngine& engine, FTexture const* environment,
+            PrefilterOptions const& options) noexcept;
+
+    // sets the irradiance from the 9 radiance SH coefficients of the environment
+    void setRadiance(math::float3 const* sh) noexcept;
+
 private:
     FTexture const* mReflectionsTexture = nullptr;
     FTexture const* mIrradianceTexture = nullptr;
@@ -64,6 +87,7 @@ private:
     float mIntensity = DEFAULT_INTENSITY;
     math::mat3f mRotation;
     uint8_t mLevelCount = 0;
+    std::shared_ptr<IrradianceReadback> mIrradianceReadback;
 };
 
 FILAMENT_UPCAST(IndirectLight)
@@ -65,10 +65,15 @@ public:
     // Create an instance of this material
     FMaterialInstance* createInstance(const char* name) const noexcept;
 
+    // creates the programs of the variants of this material which only use features in 'variants'
+    void compile(UserVariantFilterMask variants, CompileCallback callback, void* user) noexcept;
+
     bool hasParameter(const char* name) const noexcept;
 
     bool isSampler(const char* name) const noexcept;
 
+    ssize_t getParameterOffset(const char* name) const noexcept;
+
     UniformInterfaceBlock::UniformInfo const* reflect(utils::StaticString const& name) const noexcept;
 
     FMaterialInstance const* getDefaultInstance() const noexcept { return &mDefaultInstance; }
@@ -113,6 +118,10 @@ public:
     bool hasDoubleSidedCapability() const noexcept { return mDoubleSidedCapability; }
     float getMaskThreshold() const noexcept { return mMaskThreshold; }
     bool hasShadowMultiplier() const noexcept { return mHasShadowMultiplier; }
+
+    // false when the depth variants are the default material's, which only read the positions,
+    // skinning and morphing data
+    bool hasCustomDepthShader() const noexcept { return mHasCustomDepthShader; }
     AttributeBitset getRequiredAttributes() const noexcept { return mRequiredAttributes; }
     RefractionMode getRefractionMode() const noexcept { return mRefractionMode; }
     RefractionType getRefractionType() const noexcept { return mRefractionType; }
@@ -151,15 +160,23 @@ public:
     /** Queries the program cache to check which variants are resident. */
     static void onQueryCallback(void* userdata, uint64_t* pVariants);
 
+    /** Reports the cost of the variants, see MaterialStatistics. */
+    static size_t onStatsCallback(void* userdata, matdbg::MaterialVariantStats* stats,
+            size_t capacity);
+
     /** @}*/
 
-    static MaterialParser* createParser(backend::Backend backend, const void* data, size_t size);
+    static MaterialParser* createParser(backend::Backend backend, const void* data, size_t size,
+            bool copy = true);
 
 private:
     backend::Handle<backend::HwProgram> getProgramSlow(uint8_t variantKey) const noexcept;
     backend::Handle<backend::HwProgram> getSurfaceProgramSlow(uint8_t variantKey) const noexcept;
     backend::Handle<backend::HwProgram> getPostProcessProgramSlow(uint8_t variantKey) const noexcept;
 
+    // the id given to the programs, hashed from the package by the first program that needs it
+    uint64_t getCacheId() const noexcept;
+
     // try to order by frequency of use
     mutable std::array<backend::Handle<backend::HwProgram>, VARIANT_COUNT> mCachedPrograms;
 
@@ -198,6 +215,9 @@ private:
     utils::CString mName;
     FEngine& mEngine;
     const uint32_t mMaterialId;
+    // hash of the material package, identifies its programs across runs, see getCacheId()
+    mutable uint64_t mCacheId = 0;
+    mutable bool mHasCacheId = false;
     mutable uint32_t mMaterialInstanceId = 0;
     MaterialParser* mMaterialParser = nullptr;
     std::atomic<MaterialParser*> mPendingEdits = {};
@@ -47,15 +47,25 @@ public:
 
     void commit(FEngine::DriverApi& driver) const {
         if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
-            commitSlow(driver);
+            commitSlow(driver, true);
         }
     }
 
-    void use(FEngine::DriverApi& driver) const {
-        if (mUbHandle) {
-            driver.bindUniformBuffer(BindingPoints::PER_MATERIAL_INSTANCE, mUbHandle);
+    // like commit(), but the uniforms are only uploaded by the next flush of
+    // FEngine::getMaterialUniformArena(), so many instances can be uploaded at once
+    void commitDeferred(FEngine::DriverApi& driver) const {
+        if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
+            commitSlow(driver, false);
         }
-        if (mSbHandle) {
+    }
+
+    // 'previous' is the instance used right before, if any, whose sampler group is still bound
+    void use(FEngine::DriverApi& driver, FMaterialInstance const* previous = nullptr) const {
+        if (mUbSlot.handle) {
+            driver.bindUniformBufferRange(BindingPoints::PER_MATERIAL_INSTANCE,
+                    mUbSlot.handle, mUbSlot.offset, mUniforms.getSize());
+        }
+        if (mSbHandle && !(previous && previous->mSbHandle == mSbHandle)) {
             driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mSbHandle);
         }
     }
@@ -72,6 +82,8 @@ public:
     void setParameter(const char* name,
             backend::Handle<backend::HwTexture> texture, backend::SamplerParams params) noexcept;
 
+    void setParameters(void const* data, size_t size, size_t offset) noexcept;
+
     FMaterial const* getMaterial() const noexcept { return mMaterial; }
 
     uint64_t getSortingKey() const noexcept { return mMaterialSortingKey; }
@@ -142,12 +154,12 @@ private:
     void initDefaultInstance(FEngine& engine, FMaterial const* material);
     void initialize(FMaterial const* material);
 
-    void commitSlow(FEngine::DriverApi& driver) const;
+    void commitSlow(FEngine::DriverApi& driver, bool flush) const;
 
     // keep these grouped, they're accessed together in the render-loop
     FMaterial const* mMaterial = nullptr;
-    backend::Handle<backend::HwUniformBuffer> mUbHandle;
-    backend::Handle<backend::HwSamplerGroup> mSbHandle;
+    UniformBufferArena::Slot mUbSlot;   // sub-allocated from FEngine::getMaterialUniformArena()
+    mutable backend::Handle<backend::HwSamplerGroup> mSbHandle; // from FEngine::getSamplerGroupCache()
 
     UniformBuffer mUniforms;
     backend::SamplerGroup mSamplers;
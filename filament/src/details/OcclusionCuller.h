@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include "components/RenderableManager.h"
+
+#include "details/Culler.h"
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Occlusion culling against a hierarchical depth buffer (Hi-Z).
+ *
+ * The depth buffer is typically the structure buffer of a previous frame, read back from the GPU.
+ * It uses inverted z, i.e. 1 is the near plane and 0 is infinitely far, and its first row is the
+ * bottom of the image. A pyramid is built where each texel holds the farthest depth of the texels
+ * it covers, so that testing a box against a handful of texels of the right level is
+ * conservative: a box is only reported as occluded when it's behind everything that was drawn
+ * in its screen-space bounds.
+ *
+ * Because the depth buffer is from an earlier frame, objects that were hidden by something that
+ * has since moved away can be culled for a frame or two.
+ */
+class OcclusionCuller {
+public:
+    OcclusionCuller() noexcept = default;
+    OcclusionCuller(OcclusionCuller const& rhs) = delete;
+    OcclusionCuller& operator=(OcclusionCuller const& rhs) = delete;
+
+    /*
+     * Builds the pyramid from a width x height depth buffer. worldToClip is the matrix that was
+     * used to render it, from world space (i.e. without the world origin) to clip space.
+     */
+    void setDepth(float const* depth, uint32_t width, uint32_t height,
+            math::mat4f const& worldToClip);
+
+    // releases the pyramid, no objects are occluded after this
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mLevels.empty(); }
+
+    // the matrix given to setDepth()
+    math::mat4f const& getWorldToClip() const noexcept { return mWorldToClip; }
+
+    /*
+     * Clears 'mask' in visibility[i] for each box with 'mask' set which is occluded, and returns
+     * how many were. Boxes that aren't in one of the visible layers, or that have culling
+     * disabled, are skipped since they're hidden or drawn regardless. The boxes are given in a
+     * space that transforms to world space with worldOrigin, typically the world origin of the
+     * current frame.
+     */
+    size_t cull(Culler::result_type* visibility,
+            math::float3 const* centers, math::float3 const* extents,
+            uint8_t const* layers, FRenderableManager::Visibility const* states, size_t count,
+            uint8_t visibleLayers, math::mat4f const& worldOrigin,
+            Culler::result_type mask) const noexcept;
+
+    // returns whether an axis-aligned box, given in clip space by 'boxToClip', is occluded
+    bool isOccluded(math::mat4f const& boxToClip,
+            math::float3 const& center, math::float3 const& extent) const noexcept;
+
+private:
+    struct Level {
+        uint32_t width;
+        uint32_t height;
+        std::vector<float> depth;
+    };
+
+    // level 0 has the size of the depth buffer, each level is half the size of the previous one
+    std::vector<Level> mLevels;
+    math::mat4f mWorldToClip;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
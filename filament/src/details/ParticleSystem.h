@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
+#define TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
+
+#include "upcast.h"
+
+#include <filament/ParticleSystem.h>
+
+#include <backend/Handle.h>
+
+#include <utils/compiler.h>
+#include <utils/Entity.h>
+
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+namespace filament {
+
+class FEngine;
+class FIndexBuffer;
+class FMaterialInstance;
+class FTexture;
+class FVertexBuffer;
+
+/*
+ * The particles live in a storage buffer. Each call to simulate() dispatches:
+ * - a simulation program, which respawns the emitted particles, integrates the live ones and
+ *   counts them in the instance count of the renderable's DrawIndirectCommand,
+ * - when sorted, a bitonic sort of the particles' distances to the sort origin, with the dead
+ *   particles last, then a program that gathers the particles into the texture in that order.
+ *   Otherwise the simulation program writes the live particles directly into the texture.
+ * The emitted particles replace the particles in a ring, so the oldest ones are replaced first.
+ */
+class FParticleSystem : public ParticleSystem {
+public:
+    // particles per row of the texture, each particle is two texels
+    static constexpr uint32_t PARTICLES_PER_ROW = 256;
+    static constexpr size_t MAX_PARTICLES = 1024 * 1024;
+
+    FParticleSystem(FEngine& engine, const Builder& builder);
+
+    void terminate(FEngine& engine) noexcept;
+
+    void simulate(float deltaTime, math::float3 const& sortOrigin) noexcept;
+
+    void emit(size_t count) noexcept { mPendingCount += float(count); }
+
+    void setEmissionRate(float particlesPerSecond) noexcept {
+        mEmissionRate = particlesPerSecond;
+    }
+
+    void setEmitter(math::float3 const& center, math::float3 const& halfExtent) noexcept {
+        mEmitterCenter = center;
+        mEmitterHalfExtent = halfExtent;
+    }
+
+    utils::Entity getEntity() const noexcept { return mEntity; }
+
+    size_t getMaxParticles() const noexcept { return mCount; }
+
+    FTexture const* getTexture() const noexcept { return mTexture; }
+
+private:
+    FEngine& mEngine;
+
+    // we don't own this
+    FMaterialInstance* mMaterialInstance;
+
+    // we own these
+    utils::Entity mEntity;
+    FVertexBuffer* mVertexBuffer = nullptr;
+    FIndexBuffer* mIndexBuffer = nullptr;
+    FTexture* mTexture = nullptr;
+    backend::Handle<backend::HwUniformBuffer> mParams;
+    backend::Handle<backend::HwUniformBuffer> mParticles;
+    backend::Handle<backend::HwUniformBuffer> mSortKeys;
+    backend::Handle<backend::HwUniformBuffer> mSortStep;
+    backend::Handle<backend::HwUniformBuffer> mDrawCommand;
+    backend::Handle<backend::HwProgram> mSimulateProgram;
+    backend::Handle<backend::HwProgram> mSortProgram;
+    backend::Handle<backend::HwProgram> mGatherProgram;
+
+    uint32_t mCount;                    // maximum number of particles
+    uint32_t mSortCount;                // mCount rounded up to a power of two, 0 if not sorted
+    uint32_t mEmitFirst = 0;            // next particle replaced by an emitted one
+    uint32_t mSeed = 0;
+    float mPendingCount = 0.0f;         // particles to emit, including the fractional ones
+    float mEmissionRate;
+    math::float3 mEmitterCenter;
+    math::float3 mEmitterHalfExtent;
+    math::float3 mVelocity;
+    math::float3 mVelocitySpread;
+    math::float2 mLifetime;
+    math::float3 mGravity;
+};
+
+FILAMENT_UPCAST(ParticleSystem)
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_PARTICLESYSTEM_H
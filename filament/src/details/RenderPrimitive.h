@@ -25,6 +25,8 @@
 
 #include <utils/compiler.h>
 
+#include <vector>
+
 namespace filament {
 
 class FEngine;
@@ -34,6 +36,8 @@ class FRenderer;
 
 class FRenderPrimitive {
 public:
+    using Cluster = RenderableManager::Cluster;
+
     FRenderPrimitive() noexcept = default;
 
     void init(backend::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
@@ -45,26 +49,60 @@ public:
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
 
+    // the clusters are discarded when the geometry is changed by set()
+    void setClusters(Cluster const* clusters, size_t count);
+
     // frees driver resources, object becomes invalid
     void terminate(FEngine& engine);
 
     const FMaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
     backend::Handle<backend::HwRenderPrimitive> getHwHandle() const noexcept { return mHandle; }
+
+    // The primitive drawn by the depth variants of the materials without a custom depth shader.
+    // It only fetches the positions, skinning and morphing data when the vertex buffer stores
+    // them apart from the other attributes, see FVertexBuffer::getDepthAttributes().
+    backend::Handle<backend::HwRenderPrimitive> getDepthHwHandle() const noexcept {
+        return mDepthHandle ? mDepthHandle : mHandle;
+    }
     backend::PrimitiveType getPrimitiveType() const noexcept { return mPrimitiveType; }
+    uint32_t getIndexCount() const noexcept { return mIndexCount; }
     AttributeBitset getEnabledAttributes() const noexcept { return mEnabledAttributes; }
     uint16_t getBlendOrder() const noexcept { return mBlendOrder; }
+    float getUvDensity() const noexcept { return mUvDensity; }
+    std::vector<Cluster> const& getClusters() const noexcept { return mClusters; }
+    backend::Handle<backend::HwUniformBuffer> getIndirectDraw() const noexcept {
+        return mIndirectDraw;
+    }
 
     void setMaterialInstance(FMaterialInstance const* mi) noexcept { mMaterialInstance = mi; }
     void setBlendOrder(uint16_t order) noexcept {
         mBlendOrder = static_cast<uint16_t>(order & 0x7FFF);
     }
+    void setUvDensity(float density) noexcept { mUvDensity = density; }
+
+    // The primitive is drawn with the DrawIndirectCommand at the start of 'buffer', whose
+    // arguments are written by the GPU, see FParticleSystem. The buffer isn't owned.
+    void setIndirectDraw(backend::Handle<backend::HwUniformBuffer> buffer) noexcept {
+        mIndirectDraw = buffer;
+    }
 
 private:
+    void setDepthPrimitive(backend::DriverApi& driver,
+            FVertexBuffer const* vertices, FIndexBuffer const* indices) noexcept;
+
+    void setDepthPrimitiveRange(backend::DriverApi& driver, RenderableManager::PrimitiveType type,
+            size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
+
     FMaterialInstance const* mMaterialInstance = nullptr;
     backend::Handle<backend::HwRenderPrimitive> mHandle;
+    backend::Handle<backend::HwRenderPrimitive> mDepthHandle;   // null if it would be mHandle
     backend::PrimitiveType mPrimitiveType = backend::PrimitiveType::NONE;
+    uint32_t mIndexCount = 0;
     AttributeBitset mEnabledAttributes;
     uint16_t mBlendOrder = 0;
+    float mUvDensity = 0.0f;            // UV units per world unit, 0 if unknown
+    std::vector<Cluster> mClusters;     // empty when the primitive is drawn as a whole
+    backend::Handle<backend::HwUniformBuffer> mIndirectDraw;
 };
 
 } // namespace filament
@@ -20,6 +20,7 @@
 #include "upcast.h"
 
 #include "FrameInfo.h"
+#include "FramePacer.h"
 #include "RenderPass.h"
 
 #include "details/Allocators.h"
@@ -58,6 +59,16 @@ class ShadowMap;
 class FRenderer : public Renderer {
     static constexpr size_t MAX_FRAMETIME_HISTORY = 32u;
 
+    // margin around the refractive objects captured for the refraction, in normalized
+    // coordinates, and the area above which the whole screen is captured
+    static constexpr float REFRACTION_MARGIN = 0.1f;
+    static constexpr float REFRACTION_MAX_REGION_AREA = 0.75f;
+
+    // a refraction capture is reused while the refractive objects move less than this many
+    // pixels on screen, for at most REFRACTION_REUSE_MAX_AGE frames
+    static constexpr float REFRACTION_REUSE_MAX_DISPLACEMENT = 1.0f;
+    static constexpr uint32_t REFRACTION_REUSE_MAX_AGE = 8u;
+
 public:
     explicit FRenderer(FEngine& engine);
     ~FRenderer() noexcept;
@@ -71,6 +82,8 @@ public:
     // do all the work here!
     void render(FView const* view);
     void renderJob(ArenaScope& arena, FView& view);
+    void renderStandaloneViews(View const* const* views, size_t count);
+    void render(ViewOutput const* outputs, size_t count);
 
     void copyFrame(FSwapChain* dstSwapChain, Viewport const& dstViewport,
             Viewport const& srcViewport, CopyFrameFlag flags);
@@ -81,6 +94,8 @@ public:
 
     void resetUserTime();
 
+    void setPresentationTime(int64_t monotonic_clock_ns);
+
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             backend::PixelBufferDescriptor&& buffer);
 
@@ -111,12 +126,32 @@ public:
         // headroom can't be larger than frame time, or less than 0
         frameRateOptions.headRoomRatio = std::min(frameRateOptions.headRoomRatio, 1.0f);
         frameRateOptions.headRoomRatio = std::max(frameRateOptions.headRoomRatio, 0.0f);
+
+        // the main passes always need some budget
+        frameRateOptions.postProcessingRatio = std::min(frameRateOptions.postProcessingRatio, 0.9f);
+        frameRateOptions.postProcessingRatio = std::max(frameRateOptions.postProcessingRatio, 0.0f);
+
+        mFramePacer.setEnabled(frameRateOptions.framePacing);
     }
 
     void setClearOptions(const ClearOptions& options) {
         mClearOptions = options;
     }
 
+    void setPassTimingsEnabled(bool enabled) noexcept {
+        mFrameInfoManager.setPassTimingsEnabled(enabled);
+    }
+
+    void setPerformanceCountersEnabled(bool enabled) noexcept {
+        mFrameInfoManager.setPerformanceCountersEnabled(enabled);
+    }
+
+    FrameTimings getFrameTimings() const noexcept;
+
+    FrameStatistics getFrameStatistics() const noexcept {
+        return mFrameStatistics.getLastFrameStatistics();
+    }
+
 private:
     friend class Renderer;
     using Command = RenderPass::Command;
@@ -145,10 +180,21 @@ private:
             PostProcessManager::ColorGradingConfig colorGradingConfig,
             RenderPass const& pass, FView const& view) const noexcept;
 
+    // the view's frame history keeps the refraction capture when it can be reused
     FrameGraphId<FrameGraphTexture> refractionPass(FrameGraph& fg,
             ColorPassConfig config,
             PostProcessManager::ColorGradingConfig colorGradingConfig,
-            RenderPass const& pass, FView const& view) const noexcept;
+            RenderPass const& pass, FView& view) const noexcept;
+
+    // normalized [left, bottom, right, top] screen-space bounds of the renderables drawn by
+    // the commands, the whole screen if one of them crosses the camera plane
+    static math::float4 getScreenBounds(Command const* first, Command const* last,
+            FScene::RenderableSoa const& renderableData, math::mat4f const& sceneToClip) noexcept;
+
+    // renders the order-independent transparent commands of 'pass' and composites them
+    FrameGraphId<FrameGraphTexture> orderIndependentTransparencyPass(FrameGraph& fg,
+            ColorPassConfig const& config, RenderPass const& pass,
+            FView const& view) const noexcept;
 
     void recordHighWatermark(size_t watermark) noexcept {
         mCommandsHighWatermark = std::max(mCommandsHighWatermark, watermark);
@@ -173,11 +219,14 @@ private:
     // keep a reference to our engine
     FEngine& mEngine;
     FrameSkipper mFrameSkipper;
+    FramePacer mFramePacer;
     backend::Handle<backend::HwRenderTarget> mRenderTarget;
     FSwapChain* mSwapChain = nullptr;
+    FSwapChain* mStandaloneSwapChain = nullptr;     // created by renderStandaloneViews()
     size_t mCommandsHighWatermark = 0;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    FrameStatisticsManager mFrameStatistics;
     backend::TextureFormat mHdrTranslucent{};
     backend::TextureFormat mHdrQualityMedium{};
     backend::TextureFormat mHdrQualityHigh{};
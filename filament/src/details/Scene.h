@@ -23,6 +23,7 @@
 #include "components/TransformManager.h"
 
 #include "details/Culler.h"
+#include "details/CullingBvh.h"
 
 #include "Allocators.h"
 
@@ -31,13 +32,22 @@
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
+#include <utils/EntityManager.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <atomic>
 #include <cstddef>
+#include <limits>
+#include <vector>
+
 #include <tsl/robin_set.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 struct CameraInfo;
@@ -70,6 +80,9 @@ public:
     size_t getLightCount() const noexcept;
     bool hasEntity(utils::Entity entity) const noexcept;
 
+    void setHierarchicalCullingEnabled(bool enabled) noexcept;
+    bool isHierarchicalCullingEnabled() const noexcept { return mHierarchicalCullingEnabled; }
+
 public:
     /*
      * Filaments-scope Public API
@@ -83,12 +96,21 @@ public:
     ~FScene() noexcept;
     void terminate(FEngine& engine);
 
-    void prepare(const math::mat4f& worldOriginTransform);
+    /*
+     * Gathers the scene with the given world origin and returns the world origin actually used.
+     * All the views of a scene share the origin picked by the first view that prepares it in a
+     * frame, so that the scene is gathered only once per frame however many views render it.
+     */
+    math::mat4f const& prepare(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
     void prepareDynamicLights(const CameraInfo& camera, ArenaScope& arena, backend::Handle<backend::HwUniformBuffer> lightUbh) noexcept;
 
 
     filament::backend::Handle<backend::HwUniformBuffer> getRenderableUBO() const noexcept {
-        return mRenderableViewUbh;
+        return mRenderableUbh;
+    }
+
+    size_t getUniformBufferSize() const noexcept {
+        return mRenderableUboSize;
     }
 
     /*
@@ -97,15 +119,21 @@ public:
 
     using VisibleMaskType = Culler::result_type;
 
+    // CLUSTER_DRAWS of the renderables whose primitives are drawn as a whole
+    static constexpr uint32_t NO_CLUSTER_DRAWS = ~0u;
+
     enum {
         RENDERABLE_INSTANCE,    //  4 | instance of the Renderable component
         WORLD_TRANSFORM,        // 16 | instance of the Transform component
         REVERSED_WINDING_ORDER, //  1 | det(WORLD_TRANSFORM)<0
         VISIBILITY_STATE,       //  1 | visibility data of the component
         BONES_UBH,              //  4 | bones uniform buffer handle
+        BONES_OFFSET,           //  4 | offset of the bones in their uniform buffer
         WORLD_AABB_CENTER,      // 12 | world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 | each bit represents a visibility in a pass
         MORPH_WEIGHTS,          //  4 | floats for morphing
+        INSTANCE_COUNT,         //  2 | number of instances to draw
+        UBO_SLOT,               //  4 | index of the renderable's data in the renderable UBO
 
         // These are not needed anymore after culling
         LAYERS,                 //  1 | layers
@@ -114,6 +142,7 @@ public:
         // These are temporaries and should be stored out of line
         PRIMITIVES,             //  8 | level-of-detail'ed primitives
         SUMMED_PRIMITIVE_COUNT, //  4 | summed visible primitive counts
+        CLUSTER_DRAWS,          //  4 | first cluster draws of the primitives, see FView
     };
 
     using RenderableSoa = utils::StructureOfArrays<
@@ -122,15 +151,28 @@ public:
             bool,                                       // REVERSED_WINDING_ORDER
             FRenderableManager::Visibility,             // VISIBILITY_STATE
             backend::Handle<backend::HwUniformBuffer>,  // BONES_UBH
+            uint32_t,                                   // BONES_OFFSET
             math::float3,                               // WORLD_AABB_CENTER
             VisibleMaskType,                            // VISIBLE_MASK
             math::float4,                               // MORPH_WEIGHTS
+            uint16_t,                                   // INSTANCE_COUNT
+            uint32_t,                                   // UBO_SLOT
             uint8_t,                                    // LAYERS
             math::float3,                               // WORLD_AABB_EXTENT
             utils::Slice<FRenderPrimitive>,             // PRIMITIVES
-            uint32_t                                    // SUMMED_PRIMITIVE_COUNT
+            uint32_t,                                   // SUMMED_PRIMITIVE_COUNT
+            uint32_t                                    // CLUSTER_DRAWS
     >;
 
+    // The culling hierarchy of the renderables, identified by their instance; or nullptr if
+    // hierarchical culling is disabled.
+    CullingBvh const* getCullingBvh() const noexcept {
+        return mHierarchicalCullingEnabled ? &mCullingBvh : nullptr;
+    }
+
+    // scratch buffer for FView::cullRenderables(), which keeps its capacity between frames
+    std::vector<uint32_t>& getCullingBvhRows() noexcept { return mCullingBvhRows; }
+
     RenderableSoa const& getRenderableData() const noexcept { return mRenderableData; }
     RenderableSoa& getRenderableData() noexcept { return mRenderableData; }
 
@@ -196,11 +238,76 @@ public:
     LightSoa const& getLightData() const noexcept { return mLightData; }
     LightSoa& getLightData() noexcept { return mLightData; }
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables, backend::Handle<backend::HwUniformBuffer> renderableUbh) noexcept;
+    // With hierarchical culling, prepare() only gathers the directional light. This adds the
+    // punctual lights whose sphere of influence may intersect the frustum, found with the
+    // lights hierarchy. Does nothing otherwise.
+    void gatherVisibleLights(Frustum const& frustum) noexcept;
+
+    // uploads the per-renderable data of the given renderables that changed since the last call
+    void updateUBOs(utils::Range<uint32_t> visibleRenderables) noexcept;
 
     bool hasContactShadows() const noexcept;
 
 private:
+    // number of entities processed by each job in prepare()
+    static constexpr size_t JOBS_PARALLEL_FOR_PREPARE_COUNT = 256;
+
+    // maximum number of separate ranges of the renderable UBO updated by updateUBOs(), above
+    // that a single range covering all of them is updated
+    static constexpr size_t MAX_RENDERABLE_UBO_UPDATE_COUNT = 16;
+
+    // per-entity scratch data used by prepare() to gather the scene in parallel
+    struct GatherInfo {
+        static constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+        FRenderableManager::Instance ri;
+        FTransformManager::Instance ti;
+        FLightManager::Instance li;
+        uint32_t renderableIndex = INVALID; // destination index in the RenderableSoa
+    };
+
+    // components of a light gathered in mLightData
+    struct LightComponents {
+        FLightManager::Instance li;
+        FTransformManager::Instance ti;
+    };
+
+    // generation of the component managers at the time mRenderableData was gathered
+    struct Generations {
+        uint64_t renderables = 0;
+        uint64_t renderableLayout = 0;
+        uint64_t transforms = 0;
+        uint64_t transformLayout = 0;
+        uint64_t lights = 0;
+        uint64_t lightLayout = 0;
+    };
+
+    // notified when any entity is destroyed, at which point the gathered data can't be reused.
+    struct EntityListener : public utils::EntityManager::Listener {
+        std::atomic<bool> entitiesDestroyed = { false };
+        void onEntitiesDestroyed(size_t n, utils::Entity const* entities) noexcept override;
+    };
+
+    bool canReuseGatheredData(const math::mat4f& worldOriginTransform) const noexcept;
+    void gatherRenderables(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
+    void updateRenderables(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
+    void gatherLights(utils::JobSystem& js, const math::mat4f& worldOriginTransform);
+    void updateCullingBvh(bool rebuild);
+    void updateLightBvh(utils::JobSystem& js, const math::mat4f& worldOriginTransform,
+            bool rebuild);
+    void padLightData() noexcept;
+
+    static inline void gatherLight(FLightManager const& lcm, FTransformManager const& tcm,
+            LightComponents const& light, const math::mat4f& worldOriginTransform,
+            math::float4* positionRadius, math::float3* direction) noexcept;
+
+    static inline void gatherRenderable(RenderableSoa& soa, size_t index,
+            FRenderableManager const& rcm, FTransformManager const& tcm,
+            FRenderableManager::Instance ri, FTransformManager::Instance ti,
+            const math::mat4f& worldOriginTransform) noexcept;
+
+    static inline void setRenderableUniforms(void* buffer, size_t offset,
+            FRenderableManager const& rcm, RenderableSoa const& soa, size_t index) noexcept;
+
     static inline void computeLightRanges(math::float2* zrange,
             CameraInfo const& camera, const math::float4* spheres, size_t count) noexcept;
 
@@ -218,6 +325,64 @@ private:
      */
     tsl::robin_set<utils::Entity> mEntities;
 
+    /*
+     * Scratch buffers used by prepare(). They're kept here so their storage can be reused
+     * from frame to frame.
+     */
+    std::vector<utils::Entity> mGatherEntities;
+    std::vector<GatherInfo> mGatherInfo;
+
+    /*
+     * Bookkeeping that allows prepare() to keep mRenderableData across frames and to only
+     * update the renderables that changed.
+     * - mRenderableTransforms is indexed by renderable Instance
+     * - mLightComponents and mDirectionalLights are in entity order
+     */
+    std::vector<FTransformManager::Instance> mRenderableTransforms;
+    std::vector<LightComponents> mLightComponents;
+    std::vector<LightComponents> mDirectionalLights;
+    Generations mGatheredGenerations;
+    math::mat4f mGatheredWorldOrigin;
+    uint32_t mPreparedFrame = 0;        // FEngine::getPrepareCount() of the last prepare()
+    EntityListener mEntityListener;
+    bool mEntitiesDirty = true;
+
+    /*
+     * Hierarchical culling
+     * - mCullingBvhIds is a scratch buffer used to build the hierarchy
+     * - mCullingBvhRows is a scratch buffer used to cull against the hierarchy
+     * - mUpdatedRows flags the rows of mRenderableData updated by updateRenderables()
+     */
+    CullingBvh mCullingBvh;
+    std::vector<uint32_t> mCullingBvhIds;
+    std::vector<uint32_t> mCullingBvhRows;
+    std::vector<uint8_t> mUpdatedRows;
+    bool mHierarchicalCullingEnabled = false;
+
+    /*
+     * Hierarchical culling of the punctual lights, identified by their index in mLightComponents
+     * - mLightSpheres and mLightDirections are the gathered lights, kept across frames
+     * - mUpdatedLights flags the lights updated by updateLightBvh()
+     * - mVisibleLightIds is a scratch buffer used by gatherVisibleLights()
+     */
+    CullingBvh mLightBvh;
+    std::vector<math::float4> mLightSpheres;
+    std::vector<math::float3> mLightDirections;
+    std::vector<uint8_t> mUpdatedLights;
+    std::vector<uint32_t> mVisibleLightIds;
+
+    /*
+     * Per-renderable UBO, kept across frames. Each row of mRenderableData owns the slot given by
+     * its UBO_SLOT, which doesn't change when the rows are reordered, so that only the rows that
+     * changed need to be uploaded.
+     * - mDirtyUboSlots flags the slots whose content must be uploaded
+     * - mUboUpdateRows and mUboSlotRows are scratch buffers used by updateUBOs()
+     */
+    backend::Handle<backend::HwUniformBuffer> mRenderableUbh;
+    uint32_t mRenderableUboSize = 0;
+    std::vector<uint8_t> mDirtyUboSlots;
+    std::vector<uint32_t> mUboUpdateRows;
+    std::vector<uint32_t> mUboSlotRows;
 
     /*
      * The data below is valid only during a view pass. i.e. if a scene is used in multiple
@@ -227,7 +392,6 @@ private:
      */
     RenderableSoa mRenderableData;
     LightSoa mLightData;
-    backend::Handle<backend::HwUniformBuffer> mRenderableViewUbh; // This is actually owned by the view.
     bool mHasContactShadows = false;
 };
 
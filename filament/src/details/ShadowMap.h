@@ -28,6 +28,7 @@
 #include <filament/Viewport.h>
 
 #include <math/mat4.h>
+#include <math/vec2.h>
 #include <math/vec4.h>
 
 namespace filament {
@@ -55,6 +56,9 @@ public:
         // the dimension of the actual shadow map, taking into account the 1 texel border
         // e.g., for a texture dimension of 512, shadowDimension would be 510
         size_t shadowDimension = 0;
+
+        // the position of the shadow map texture within the atlas, in texels
+        math::uint2 atlasOffset = {};
     };
 
     struct CascadeParameters {
@@ -88,6 +92,8 @@ public:
             filament::CameraInfo const& camera, uint8_t visibleLayers,
             ShadowMapLayout layout, const CascadeParameters& cascadeParams) noexcept;
 
+    // Sets up the pass for this shadow map and allocates its commands in a new command buffer.
+    // They're generated by RenderPass::generateAndSortCommands().
     void render(backend::DriverApi& driver, utils::Range<uint32_t> const& range, RenderPass& pass,
             FView& view) noexcept;
 
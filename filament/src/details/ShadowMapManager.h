@@ -17,6 +17,7 @@
 #ifndef TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
 #define TNT_FILAMENT_DETAILS_SHADOWMAPMANAGER_H
 
+#include <filament/Frustum.h>
 #include <filament/Viewport.h>
 
 #include <private/backend/DriverApi.h>
@@ -32,7 +33,11 @@
 #include "fg/FrameGraph.h"
 #include "fg/FrameGraphPassResources.h"
 
+#include <math/mat4.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <utils/Range.h>
 
 #include <array>
 #include <memory>
@@ -41,6 +46,7 @@
 namespace filament {
 
 class FView;
+struct CameraInfo;
 
 class ShadowMap;
 class RenderPass;
@@ -58,6 +64,9 @@ public:
     explicit ShadowMapManager(FEngine& engine);
     ~ShadowMapManager();
 
+    // Releases the shadow map cache.
+    void terminate(FEngine& engine) noexcept;
+
     // Reset shadow map layout.
     void reset() noexcept;
 
@@ -69,10 +78,14 @@ public:
     ShadowTechnique update(FEngine& engine, FView& view, UniformBuffer& perViewUb, UniformBuffer& shadowUb,
             FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept;
 
-    // Renders all of the shadow maps.
+    // Renders all of the shadow maps. When shadow map caching is enabled on the view, only the
+    // shadow maps that changed since they were last rendered are.
     void render(FrameGraph& fg, FEngine& engine, FView& view, backend::DriverApi& driver,
             RenderPass& pass) noexcept;
 
+    // Forces all the cached shadow maps to be rendered again.
+    void invalidateCache() noexcept;
+
     // Prepares the shadow sampler.
     void prepareShadow(backend::Handle<backend::HwTexture> texture, FView const& view)
         const noexcept;
@@ -82,11 +95,35 @@ public:
     }
 
 private:
+    static constexpr size_t MAX_SHADOW_MAPS =
+            CONFIG_MAX_SHADOW_CASCADES + CONFIG_MAX_SHADOW_CASTING_SPOTS;
+    // each shadow map needs at most one layer
+    static constexpr size_t MAX_SHADOW_LAYERS = MAX_SHADOW_MAPS;
 
     struct ShadowLayout {
         uint8_t layer = 0;
         uint32_t size = 0;
         uint8_t vsmSamples = 1;
+        // position of the shadow map in its layer, in texels
+        uint16_t x = 0;
+        uint16_t y = 0;
+    };
+
+    // Spot shadow maps are packed in layers divided in ATLAS_GRID x ATLAS_GRID cells. A shadow
+    // map at level l of the atlas covers (ATLAS_GRID >> l)^2 cells, level 0 is the whole layer.
+    static constexpr size_t ATLAS_GRID = 8;
+    static constexpr size_t ATLAS_LEVELS = 4;
+
+    // Fraction of the depth range of sample distribution shadows added on each side of it.
+    static constexpr float DEPTH_RANGE_MARGIN = 0.1f;
+
+    // Where a spot light's shadow map was placed in the atlas, kept across frames so that
+    // shadow maps don't move around when lights are added or removed.
+    struct AtlasSlot {
+        uint32_t light = 0;     // light instance
+        uint8_t layer = 0;      // spot layer, i.e. not counting the cascades
+        uint8_t level = 0;
+        uint8_t cell = 0;       // cy * ATLAS_GRID + cx
     };
 
     struct TextureRequirements {
@@ -96,14 +133,46 @@ private:
     } mTextureRequirements;
 
     ShadowTechnique updateCascadeShadowMaps(FEngine& engine, FView& view, UniformBuffer& perViewUb,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept;
+            FScene::LightSoa& lightData) noexcept;
     ShadowTechnique updateSpotShadowMaps(FEngine& engine, FView& view, UniformBuffer& shadowUb,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept;
+            FScene::LightSoa& lightData) noexcept;
     static void fillWithDebugPattern(backend::DriverApi& driverApi,
             backend::Handle<backend::HwTexture> texture, size_t dimensions) noexcept;
 
     void calculateTextureRequirements(FEngine& engine, FView& view, FScene::LightSoa& lightData) noexcept;
 
+    // the casters of a shadow map are culled against 'frustum' at the end of update()
+    void addCullingFrustum(Frustum const& frustum, size_t bit) noexcept;
+
+    // returns how much of the screen's height the sphere of influence of a light covers, in [0, 1]
+    static float computeScreenCoverage(CameraInfo const& camera,
+            math::float4 const& positionRadius) noexcept;
+
+    // returns the cells covered by a shadow map at 'level' whose first cell is 'cell'
+    static uint64_t getAtlasCells(size_t level, size_t cell) noexcept;
+
+    class ShadowMapEntry;
+
+    // Everything a cached shadow map depends on. A layer of the cached texture is valid as long
+    // as the keys of the shadow maps it holds are unchanged.
+    struct CacheKey {
+        math::mat4f lightFromWorld;
+        backend::PolygonOffset polygonOffset;
+        uint32_t light = 0;                         // light instance
+        uint32_t size = 0;                          // shadow map dimension
+        uint32_t layer = 0;
+        uint32_t casterCount = 0;
+        uint32_t casterHash = 0;                    // hash of the visible casters
+        uint64_t renderableLayoutGeneration = 0;
+        uint64_t materialInstanceGeneration = 0;
+        bool valid = false;
+
+        bool operator==(CacheKey const& rhs) const noexcept;
+    };
+
+    static CacheKey computeCacheKey(FEngine& engine, FView& view, ShadowMapEntry const& map,
+            utils::Range<uint32_t> casters, FScene::VisibleMaskType visibilityMask) noexcept;
+
     class ShadowMapEntry {
     public:
         ShadowMapEntry() = default;
@@ -180,6 +249,22 @@ private:
 
     std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASCADES> mCascadeShadowMapCache;
     std::array<std::unique_ptr<ShadowMap>, CONFIG_MAX_SHADOW_CASTING_SPOTS> mSpotShadowMapCache;
+
+    // Shadow map texture kept across frames when caching is enabled, and the key of the shadow
+    // map rendered in each of its layers.
+    FrameGraphTexture mShadowCache;
+    FrameGraphTexture::Descriptor mShadowCacheDesc;
+    std::array<CacheKey, MAX_SHADOW_MAPS> mCacheKeys;
+
+    std::array<AtlasSlot, CONFIG_MAX_SHADOW_CASTING_SPOTS> mSpotAtlasSlots;
+    size_t mSpotAtlasSlotCount = 0;
+
+    // Frusta the shadow casters are culled against, and the visibility bit each of them sets:
+    // the directional light's, then one per spot shadow map.
+    static constexpr size_t MAX_CULLING_FRUSTA = 1 + CONFIG_MAX_SHADOW_CASTING_SPOTS;
+    std::array<Frustum, MAX_CULLING_FRUSTA> mCullingFrusta;
+    std::array<uint8_t, MAX_CULLING_FRUSTA> mCullingBits = {};
+    size_t mCullingFrustumCount = 0;
 };
 
 } // namespace filament
@@ -43,6 +43,15 @@ public:
     size_t getHeight(size_t level = 0) const noexcept;
     size_t getDepth(size_t level = 0) const noexcept;
     size_t getLevelCount() const noexcept { return mLevelCount; }
+
+    // estimated size in bytes of the levels [firstLevel, levelCount), of all faces and layers
+    size_t getSize(size_t firstLevel = 0) const noexcept;
+
+    // estimated size in bytes of the memory this texture uses, only the resident levels count
+    // for a streaming texture
+    size_t getResidentSize() const noexcept {
+        return getSize(mStreaming ? mResidentLevel : 0);
+    }
     size_t getMaxLevelCount() const noexcept { return FTexture::maxLevelCount(mWidth, mHeight); }
     Sampler getTarget() const noexcept { return mTarget; }
     InternalFormat getFormat() const noexcept { return mFormat; }
@@ -77,6 +86,10 @@ public:
 
     bool isCubemap() const noexcept { return mTarget == Sampler::SAMPLER_CUBEMAP; }
 
+    bool isStreaming() const noexcept { return mStreaming; }
+    size_t getResidentLevel() const noexcept { return mResidentLevel; }
+    size_t getRequestedLevel() const noexcept { return mRequestedLevel; }
+
     FStream const* getStream() const noexcept { return mStream; }
 
     /*
@@ -113,6 +126,7 @@ public:
 
 private:
     friend class Texture;
+    friend class TextureStreamer;
     FStream* mStream = nullptr;
     backend::Handle<backend::HwTexture> mHandle;
     uint32_t mWidth = 1;
@@ -123,6 +137,11 @@ private:
     uint8_t mLevelCount = 1;
     uint8_t mSampleCount = 1;
     Usage mUsage = Usage::DEFAULT;
+
+    // streaming state, see TextureStreamer
+    bool mStreaming = false;
+    uint8_t mResidentLevel = 0;     // most detailed resident level, mLevelCount if none
+    uint8_t mRequestedLevel = 0;    // most detailed level the renderer needs
 };
 
 
@@ -45,10 +45,21 @@ public:
 
     size_t getVertexCount() const noexcept;
 
+    // size in bytes of all the buffers
+    size_t getSize() const noexcept;
+
     AttributeBitset getDeclaredAttributes() const noexcept {
         return mDeclaredAttributes;
     }
 
+    // The attributes read by the depth variants of the materials without a custom depth shader,
+    // i.e. the positions, skinning and morphing data, when no other attribute is stored in their
+    // buffers. Depth passes then fetch them alone, see FRenderPrimitive::getDepthHwHandle().
+    // Empty when they're interleaved with the other attributes, or when there are no others.
+    AttributeBitset getDepthAttributes() const noexcept {
+        return mDepthAttributes;
+    }
+
     // no-op if bufferIndex out of range
     void setBufferAt(FEngine& engine, uint8_t bufferIndex,
             backend::BufferDescriptor&& buffer, uint32_t byteOffset = 0);
@@ -63,6 +74,7 @@ private:
     backend::Handle<backend::HwVertexBuffer> mHandle;
     std::array<AttributeData, backend::MAX_VERTEX_ATTRIBUTE_COUNT> mAttributes;
     AttributeBitset mDeclaredAttributes;
+    AttributeBitset mDepthAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
 };
@@ -23,17 +23,22 @@
 
 #include "FrameInfo.h"
 #include "FrameHistory.h"
+#include "PostProcessManager.h"
+#include "RenderPass.h"
 #include "UniformBuffer.h"
 
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/ColorGrading.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
 #include "details/RenderTarget.h"
 #include "details/ShadowMap.h"
 #include "details/ShadowMapManager.h"
 #include "details/Scene.h"
 
+#include "fg/FrameGraph.h"
+
 #include <private/filament/EngineEnums.h>
 
 #include "private/backend/DriverApi.h"
@@ -42,12 +47,16 @@
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/Mutex.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
 #include <math/scalar.h>
 
+#include <memory>
+#include <vector>
+
 namespace utils {
 class JobSystem;
 } // namespace utils;
@@ -67,6 +76,7 @@ class FEngine;
 class FMaterialInstance;
 class FRenderer;
 class FScene;
+struct FramePerformanceCounters;
 
 // The value of the 'VISIBLE_MASK' after culling. Each bit represents visibility in a frustum
 // (either camera or light).
@@ -113,8 +123,11 @@ public:
 
     void terminate(FEngine& engine);
 
+    // counters, if not null, accumulates the performance counters of the scene preparation and
+    // culling
     void prepare(FEngine& engine, backend::DriverApi& driver, ArenaScope& arena,
-            Viewport const& viewport, math::float4 const& userTime) noexcept;
+            Viewport const& viewport, math::float4 const& userTime,
+            FramePerformanceCounters* counters = nullptr) noexcept;
 
     void setScene(FScene* scene) { mScene = scene; }
     FScene const* getScene() const noexcept { return mScene; }
@@ -142,6 +155,34 @@ public:
     void setFrontFaceWindingInverted(bool inverted) noexcept { mFrontFaceWindingInverted = inverted; }
     bool isFrontFaceWindingInverted() const noexcept { return mFrontFaceWindingInverted; }
 
+    void setRetainedCommandsEnabled(bool enabled) noexcept;
+    bool isRetainedCommandsEnabled() const noexcept { return mRetainedCommandsEnabled; }
+
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+    bool isOcclusionCullingEnabled() const noexcept { return mOcclusionCullingEnabled; }
+
+    // reads back the structure depth buffer asynchronously, for occlusion culling of next frames
+    void readOcclusionDepth(FrameGraph& fg, FrameGraphId<FrameGraphTexture> structure,
+            CameraInfo const& camera) noexcept;
+
+    void pick(uint32_t x, uint32_t y, PickingQueryResultCallback callback, void* user) noexcept {
+        mPickingQueries.push_back({ x, y, callback, user });
+    }
+    bool hasPickingQueries() const noexcept { return !mPickingQueries.empty(); }
+
+    // renders each pending picking query into a single pixel with the picking commands of
+    // 'pass', and reads them back asynchronously
+    void readPickingQueries(FrameGraph& fg, RenderPass const& pass,
+            filament::Viewport const& svp, math::float2 scale) noexcept;
+
+    // caches for the structure and color pass commands, nullptr if retained commands are disabled
+    RenderPass::CommandCache* getStructureCommandCache() noexcept {
+        return mRetainedCommandsEnabled ? &mStructureCommandCache : nullptr;
+    }
+    RenderPass::CommandCache* getColorCommandCache() noexcept {
+        return mRetainedCommandsEnabled ? &mColorCommandCache : nullptr;
+    }
+
 
     void setVisibleLayers(uint8_t select, uint8_t values) noexcept;
     uint8_t getVisibleLayers() const noexcept {
@@ -159,6 +200,8 @@ public:
 
     void prepareCamera(const CameraInfo& camera) const noexcept;
     void prepareViewport(const Viewport& viewport) const noexcept;
+    void prepareLodBias(float bias) const noexcept;
+    void prepareOrderIndependentTransparency(bool enabled) const noexcept;
     void prepareShadowing(FEngine& engine, backend::DriverApi& driver,
             FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData) noexcept;
     void prepareLighting(FEngine& engine, FEngine::DriverApi& driver,
@@ -172,6 +215,9 @@ public:
     void commitUniforms(backend::DriverApi& driver) const noexcept;
     void commitFroxels(backend::DriverApi& driverApi) const noexcept;
 
+    // occupancy of the froxels, valid once froxelize() is done
+    Froxelizer::Statistics getFroxelStatistics() const noexcept;
+
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
     bool hasShadowing() const noexcept { return mHasShadowing; }
@@ -182,18 +228,70 @@ public:
     void renderShadowMaps(FrameGraph& fg, FEngine& engine, FEngine::DriverApi& driver,
             RenderPass& pass) noexcept;
 
+    // Selects the levels of detail of the visible renderables. The levels are selected with
+    // hysteresis from the ones the color pass selected last, only the color pass must set
+    // 'updateLevels' to keep its selection for the next frame.
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
+            FScene::RenderableSoa& renderableData, Range visible, bool updateLevels) noexcept;
+
+    // requests the levels of the streaming textures sampled by the visible primitives, this must
+    // be called after updatePrimitivesLod()
+    void requestStreamingLevels(FEngine& engine, const CameraInfo& camera,
+            FScene::RenderableSoa const& renderableData, Range visible,
+            uint32_t viewportHeight) const noexcept;
+
+    // Culls the clusters of the visible primitives, once their level of detail is selected,
+    // and uploads the draws of the clusters that pass. Returns null when no primitive has
+    // clusters or indirect draws are not supported, the primitives are then drawn as a whole.
+    RenderPass::ClusterDraws const* prepareClusters(FEngine& engine, FEngine::DriverApi& driver,
             FScene::RenderableSoa& renderableData, Range visible) noexcept;
 
     void setShadowingEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
     bool isShadowingEnabled() const noexcept { return mShadowingEnabled; }
 
+    void setShadowMapCachingEnabled(bool enabled) noexcept { mShadowMapCachingEnabled = enabled; }
+
+    bool isShadowMapCachingEnabled() const noexcept { return mShadowMapCachingEnabled; }
+
+    void invalidateShadowMaps() noexcept { mShadowMapManager.invalidateCache(); }
+
+    void setSampleDistributionShadowsEnabled(bool enabled) noexcept;
+    bool isSampleDistributionShadowsEnabled() const noexcept { return bool(mShadowDepthRange); }
+
+    // reads back the depth range computed by PostProcessManager::depthRange() asynchronously,
+    // the cascades of the next frames are fitted to it
+    void readShadowDepthRange(FrameGraph& fg, FrameGraphId<FrameGraphTexture> range,
+            CameraInfo const& camera) noexcept;
+
+    // view-space depth range of the visible samples, false until one was read back
+    bool getShadowDepthRange(math::float2* vsNearFar) const noexcept;
+
+    std::shared_ptr<PostProcessManager::DofTiles> const& getDofTiles() const noexcept {
+        return mDofTiles;
+    }
+
     void setScreenSpaceRefractionEnabled(bool enabled) noexcept { mScreenSpaceRefractionEnabled = enabled; }
 
     bool isScreenSpaceRefractionEnabled() const noexcept { return mScreenSpaceRefractionEnabled; }
 
+    void setScreenSpaceRefractionReuseEnabled(bool enabled) noexcept {
+        mScreenSpaceRefractionReuseEnabled = enabled;
+    }
+
+    bool isScreenSpaceRefractionReuseEnabled() const noexcept {
+        return mScreenSpaceRefractionReuseEnabled;
+    }
+
+    void setOrderIndependentTransparencyEnabled(bool enabled) noexcept {
+        mOrderIndependentTransparencyEnabled = enabled;
+    }
+
+    bool isOrderIndependentTransparencyEnabled() const noexcept {
+        return mOrderIndependentTransparencyEnabled;
+    }
+
     FCamera const* getDirectionalLightCamera() const noexcept {
         return &mShadowMapManager.getCascadeShadowMap(0)->getDebugCamera();
     }
@@ -260,8 +358,19 @@ public:
         return mHasPostProcessPass;
     }
 
+    void setDepthPrepass(DepthPrepass mode) noexcept {
+        mDepthPrepass = { .mode = mode };
+    }
+
+    DepthPrepass getDepthPrepass() const noexcept {
+        return mDepthPrepass.mode;
+    }
+
     math::float2 updateScale(FrameInfo const& info) noexcept;
 
+    // returns whether the color pass of this frame starts with a depth prepass
+    bool updateDepthPrepass(FrameInfo const& info) noexcept;
+
     void setDynamicResolutionOptions(View::DynamicResolutionOptions const& options) noexcept;
 
     DynamicResolutionOptions getDynamicResolutionOptions() const noexcept {
@@ -294,9 +403,10 @@ public:
         options.radius = math::max(0.0f, options.radius);
         options.bias = math::clamp(options.bias, 0.0f, 0.1f);
         options.power = std::max(0.0f, options.power);
-        // snap to the closer of 0.5 or 1.0
-        options.resolution = std::floor(
-                math::clamp(options.resolution * 2.0f, 1.0f, 2.0f) + 0.5f) * 0.5f;
+        // snap to the closer of 0.25, 0.5 or 1.0
+        options.resolution = options.resolution < 0.375f ? 0.25f :
+                (options.resolution < 0.75f ? 0.5f : 1.0f);
+        options.temporalFeedback = math::clamp(options.temporalFeedback, 0.0f, 1.0f);
         options.intensity = std::max(0.0f, options.intensity);
         options.minHorizonAngleRad = math::clamp(options.minHorizonAngleRad, 0.0f, math::f::PI_2);
         options.ssct.lightConeRad = math::clamp(options.ssct.lightConeRad, 0.0f, math::f::PI_2);
@@ -378,6 +488,20 @@ public:
         return mVignetteOptions;
     }
 
+    void setFoveationOptions(FoveationOptions options) noexcept {
+        options.center = saturate(options.center);
+        options.radius = std::max(0.0f, options.radius);
+        options.falloff = std::max(0.0f, options.falloff);
+        mFoveationOptions = options;
+    }
+
+    FoveationOptions getFoveationOptions() const noexcept {
+        return mFoveationOptions;
+    }
+
+    // foveation of the color pass, in the backend's terms
+    backend::FoveationParams getFoveationParams() const noexcept;
+
     void setBlendMode(BlendMode blendMode) noexcept {
         mBlendMode = blendMode;
     }
@@ -398,6 +522,24 @@ public:
         return mSpotLightShadowCasters;
     }
 
+    // what happened to the renderables of the scene during the last prepare()
+    struct CullingStatistics {
+        uint32_t renderableCount = 0;
+        uint32_t visibleCount = 0;
+        uint32_t layerCulledCount = 0;
+        uint32_t frustumCulledCount = 0;
+        uint32_t occlusionCulledCount = 0;
+    };
+
+    CullingStatistics const& getCullingStatistics() const noexcept {
+        return mCullingStatistics;
+    }
+
+    // bytes uploaded by commitUniforms() since this view was created
+    uint64_t getUniformBufferBytes() const noexcept {
+        return mUniformBufferBytes;
+    }
+
     FCamera const& getCameraUser() const noexcept { return *mCullingCamera; }
     FCamera& getCameraUser() noexcept { return *mCullingCamera; }
     void setCameraUser(FCamera* camera) noexcept { setCullingCamera(camera); }
@@ -407,13 +549,25 @@ public:
         return mRenderTarget == nullptr ? kEmptyHandle : mRenderTarget->getHwHandle();
     }
 
-    static void cullRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-            Frustum const& frustum, size_t bit) noexcept;
+    // bvh is the scene's culling hierarchy, or nullptr to cull all the renderables one by one,
+    // bvhRows is a scratch buffer used with the hierarchy, see FScene::getCullingBvhRows()
+    static void cullRenderables(FEngine& engine, FScene::RenderableSoa& renderableData,
+            Frustum const& frustum, size_t bit, CullingBvh const* bvh,
+            std::vector<uint32_t>& bvhRows) noexcept;
+
+    // culls against all the frusta in a single pass over the renderables, frusta[i] sets bit
+    // bits[i] of the visibility mask; count must be at most Culler::MAX_FRUSTUM_COUNT
+    static void cullRenderables(FEngine& engine, FScene::RenderableSoa& renderableData,
+            Frustum const* frusta, uint8_t const* bits, size_t count,
+            CullingBvh const* bvh, std::vector<uint32_t>& bvhRows) noexcept;
 
     UniformBuffer& getViewUniforms() const { return mPerViewUb; }
     backend::SamplerGroup& getViewSamplers() const { return mPerViewSb; }
     UniformBuffer& getShadowUniforms() const { return mShadowUb; }
 
+    // size in bytes of the uniform buffers this view allocated
+    size_t getUniformBufferSize() const noexcept;
+
     // Returns the frame history FIFO. This is typically used by the FrameGraph to access
     // previous frame data.
     FrameHistory& getFrameHistory() noexcept { return mFrameHistory; }
@@ -424,10 +578,26 @@ public:
     // (e.g.: after the FrameFraph execution).
     void commitFrameHistory(FEngine& engine) noexcept;
 
+    // Returns the culling results of the last FrameGraph compiled for this View. They're reused
+    // when the next FrameGraph has the same structure.
+    FrameGraph::CompileCache& getFrameGraphCompileCache() noexcept { return mFrameGraphCompileCache; }
+
 private:
-    void prepareVisibleRenderables(utils::JobSystem& js,
+    // fills rows[i] with the row of the renderable instance i in renderableData
+    static void findCullingBvhRows(FScene::RenderableSoa const& renderableData,
+            std::vector<uint32_t>& rows) noexcept;
+
+    static void cullRenderablesHierarchical(FScene::RenderableSoa& renderableData,
+            Frustum const& frustum, size_t bit, CullingBvh const& bvh,
+            uint32_t const* rows) noexcept;
+
+    void prepareVisibleRenderables(FEngine& engine,
             Frustum const& frustum, FScene::RenderableSoa& renderableData) const noexcept;
 
+    // returns the number of renderables culled
+    size_t prepareOcclusionCulling(FScene::RenderableSoa& renderableData,
+            math::mat4f const& worldOrigin) noexcept;
+
     static void prepareVisibleLights(
             FLightManager const& lcm, utils::JobSystem& js, Frustum const& frustum,
             FScene::LightSoa& lightData) noexcept;
@@ -448,19 +618,15 @@ private:
     // being terminated.
     void drainFrameHistory(FEngine& engine) noexcept;
 
-    // we don't inline this one, because the function is quite large and there is not much to
-    // gain from inlining.
-    static FScene::RenderableSoa::iterator partition(
-            FScene::RenderableSoa::iterator begin,
-            FScene::RenderableSoa::iterator end,
-            uint8_t mask) noexcept;
+    // Renderables are ordered by group of visibility, see prepare().
+    static constexpr size_t VISIBILITY_GROUP_COUNT = 5;
+    static size_t getVisibilityGroup(FScene::VisibleMaskType mask) noexcept;
 
     // these are accessed in the render loop, keep together
     backend::Handle<backend::HwSamplerGroup> mPerViewSbh;
     backend::Handle<backend::HwUniformBuffer> mPerViewUbh;
     backend::Handle<backend::HwUniformBuffer> mLightUbh;
     backend::Handle<backend::HwUniformBuffer> mShadowUbh;
-    backend::Handle<backend::HwUniformBuffer> mRenderableUbh;
 
     FScene* mScene = nullptr;
     FCamera* mCullingCamera = nullptr;
@@ -474,6 +640,54 @@ private:
     Viewport mViewport;
     bool mCulling = true;
     bool mFrontFaceWindingInverted = false;
+    bool mRetainedCommandsEnabled = false;
+    bool mOcclusionCullingEnabled = false;
+
+    // Depth buffer read back from the GPU for occlusion culling, it's shared with the pending
+    // readback callbacks, which may be called after the View is destroyed.
+    struct OcclusionDepth {
+        utils::Mutex lock;
+        std::vector<float> depth;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        math::mat4f worldToClip;
+        bool ready = false;     // a new depth buffer is available
+        bool pending = false;   // a readback is in flight
+    };
+    std::shared_ptr<OcclusionDepth> mOcclusionDepth;
+
+    // Depth range read back from the GPU for sample distribution shadows, shared with the
+    // pending readback callbacks like OcclusionDepth.
+    struct ShadowDepthRange {
+        utils::Mutex lock;
+        math::float2 vsNearFar;
+        bool valid = false;     // vsNearFar was read back at least once
+        bool pending = false;   // a readback is in flight
+    };
+    std::shared_ptr<ShadowDepthRange> mShadowDepthRange;
+
+    struct PickingQuery {
+        uint32_t x;
+        uint32_t y;
+        PickingQueryResultCallback callback;
+        void* user;
+    };
+    std::vector<PickingQuery> mPickingQueries;
+
+    // Bounds of the out-of-focus depth of field tiles, see PostProcessManager::dof()
+    std::shared_ptr<PostProcessManager::DofTiles> mDofTiles =
+            std::make_shared<PostProcessManager::DofTiles>();
+    OcclusionCuller mOcclusionCuller;
+
+    // draws of the visible clusters, see prepareClusters()
+    RenderPass::ClusterDraws mClusterDraws;
+    std::vector<RenderPass::ClusterDraws::Range> mClusterDrawRanges;
+    std::vector<backend::DrawIndirectCommand> mClusterDrawCommands;
+    std::vector<uint8_t> mClusterVisibility;
+    uint32_t mClusterDrawBufferSize = 0;
+
+    RenderPass::CommandCache mStructureCommandCache;
+    RenderPass::CommandCache mColorCommandCache;
 
     FRenderTarget* mRenderTarget = nullptr;
 
@@ -482,8 +696,27 @@ private:
     AntiAliasing mAntiAliasing = AntiAliasing::FXAA;
     ToneMapping mToneMapping = ToneMapping::ACES;
     Dithering mDithering = Dithering::TEMPORAL;
+
+    // With DepthPrepass::AUTO, the prepass is toggled for PROBE_FRAME_COUNT frames every
+    // PROBE_PERIOD frames and the state with the lowest average GPU time is kept.
+    static constexpr uint32_t DEPTH_PREPASS_PROBE_PERIOD = 120;
+    static constexpr uint32_t DEPTH_PREPASS_PROBE_FRAME_COUNT = 16;
+    // maximum latency of the GPU times, in frames (see FrameInfoManager)
+    static constexpr uint32_t DEPTH_PREPASS_PROBE_LATENCY = 8;
+    struct {
+        DepthPrepass mode = DepthPrepass::DISABLED;
+        bool enabled = false;       // whether the current frame has a depth prepass
+        bool probing = false;       // whether 'enabled' is being measured for a few frames
+        uint32_t frameCount = 0;    // frames since 'enabled' last changed
+        float time[2] = {};         // accumulated GPU time without and with the prepass
+        uint32_t count[2] = {};
+    } mDepthPrepass;
+
     bool mShadowingEnabled = true;
+    bool mShadowMapCachingEnabled = false;
     bool mScreenSpaceRefractionEnabled = true;
+    bool mScreenSpaceRefractionReuseEnabled = false;
+    bool mOrderIndependentTransparencyEnabled = false;
     bool mHasPostProcessPass = true;
     AmbientOcclusionOptions mAmbientOcclusionOptions{};
     ShadowType mShadowType = ShadowType::PCF;
@@ -492,6 +725,7 @@ private:
     FogOptions mFogOptions;
     DepthOfFieldOptions mDepthOfFieldOptions;
     VignetteOptions mVignetteOptions;
+    FoveationOptions mFoveationOptions;
     TemporalAntiAliasingOptions mTemporalAntiAliasingOptions;
     BlendMode mBlendMode = BlendMode::OPAQUE;
     const FColorGrading* mColorGrading = nullptr;
@@ -509,6 +743,7 @@ private:
     mutable backend::SamplerGroup mPerViewSb;
 
     mutable FrameHistory mFrameHistory{};
+    FrameGraph::CompileCache mFrameGraphCompileCache;
 
     utils::CString mName;
 
@@ -516,7 +751,10 @@ private:
     Range mVisibleRenderables;
     Range mVisibleDirectionalShadowCasters;
     Range mSpotLightShadowCasters;
-    uint32_t mRenderableUBOSize = 0;
+    std::vector<uint32_t> mVisibilityOrder; // order of the renderables by visibility, per frame
+    std::vector<uint8_t> mLodLevels;        // level of detail of each renderable instance
+    CullingStatistics mCullingStatistics;
+    mutable uint64_t mUniformBufferBytes = 0;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
     mutable bool mHasShadowing = false;
@@ -25,11 +25,19 @@
 
 #include "details/Engine.h"
 
+#include "private/backend/CommandStream.h"
+
 #include <backend/DriverEnums.h>
 #include <backend/Handle.h>
 
-#include <utils/Panic.h>
+#include <utils/JobSystem.h>
 #include <utils/Log.h>
+#include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <array>
+#include <optional>
 
 using namespace utils;
 
@@ -79,11 +87,31 @@ FrameGraphId<FrameGraphTexture> FrameGraph::Builder::sample(FrameGraphId<FrameGr
     return mPass.sample(mFrameGraph, input);
 }
 
+FrameGraphId<FrameGraphTexture> FrameGraph::Builder::image(FrameGraphId<FrameGraphTexture> output) {
+    assert(mPass.isCompute);
+    return mPass.image(mFrameGraph, output);
+}
+
 FrameGraph::Builder& FrameGraph::Builder::sideEffect() noexcept {
     mPass.hasSideEffect = true;
     return *this;
 }
 
+FrameGraph::Builder& FrameGraph::Builder::asyncCompute() noexcept {
+    assert(mPass.isCompute);
+    mPass.isAsyncCompute = true;
+    return *this;
+}
+
+FrameGraph::Builder& FrameGraph::Builder::parallel(size_t maxCommandSize) noexcept {
+    mPass.parallelCommandSize = maxCommandSize;
+    return *this;
+}
+
+void FrameGraph::Builder::compute() noexcept {
+    mPass.isCompute = true;
+}
+
 // ------------------------------------------------------------------------------------------------
 
 FrameGraph::FrameGraph(ResourceAllocatorInterface& resourceAllocator)
@@ -132,7 +160,7 @@ FrameGraphHandle FrameGraph::createResourceNode(fg::ResourceEntryBase* resource)
     auto& resourceNodes = mResourceNodes;
     auto& resourceNodeEntries = mResourceNodeEntries;
     size_t index = resourceNodes.size();
-    ResourceNode* pBase = mArena.make<ResourceNode>(resource, resource->version);
+    ResourceNode* pBase = mArena.make<ResourceNode>(resource, resource->version, uint16_t(index));
     resourceNodeEntries.emplace_back(pBase, *this);
     resourceNodes.emplace_back(pBase);
     return FrameGraphHandle{ (uint16_t)index };
@@ -264,10 +292,95 @@ fg::ResourceEntryBase& FrameGraph::getResourceEntryBaseUnchecked(FrameGraphHandl
 }
 
 FrameGraph& FrameGraph::compile() noexcept {
+    cull();
+    computeLifetimes();
+    return *this;
+}
+
+FrameGraph& FrameGraph::compile(CompileCache& cache) noexcept {
     Vector<fg::PassNode>& passNodes = mPassNodes;
-    Vector<ResourceNode*>& resourceNodes = mResourceNodes;
     Vector<UniquePtr<fg::ResourceEntryBase>>& resourceRegistry = mResourceEntries;
 
+    Vector<uint32_t> signature(mArena);
+    computeSignature(signature);
+
+    if (signature.size() == cache.mSignature.size() &&
+            std::equal(signature.begin(), signature.end(), cache.mSignature.begin())) {
+        // same structure as the last time, so the culling results are the same
+        for (size_t i = 0, c = passNodes.size(); i < c; i++) {
+            passNodes[i].refCount = cache.mPassRefCounts[i];
+        }
+        for (size_t i = 0, c = resourceRegistry.size(); i < c; i++) {
+            fg::ResourceEntryBase* const resource = resourceRegistry[i].get();
+            const uint32_t first = cache.mFirstPass[i];
+            const uint32_t last = cache.mLastPass[i];
+            resource->refs = cache.mResourceRefs[i];
+            resource->first = first != CompileCache::NONE ? &passNodes[first] : nullptr;
+            resource->last = last != CompileCache::NONE ? &passNodes[last] : nullptr;
+        }
+    } else {
+        cull();
+        auto indexOf = [&passNodes](PassNode const* pass) {
+            return pass ? uint32_t(pass - passNodes.data()) : CompileCache::NONE;
+        };
+        cache.mSignature.assign(signature.begin(), signature.end());
+        cache.mPassRefCounts.resize(passNodes.size());
+        for (size_t i = 0, c = passNodes.size(); i < c; i++) {
+            cache.mPassRefCounts[i] = passNodes[i].refCount;
+        }
+        cache.mResourceRefs.resize(resourceRegistry.size());
+        cache.mFirstPass.resize(resourceRegistry.size());
+        cache.mLastPass.resize(resourceRegistry.size());
+        for (size_t i = 0, c = resourceRegistry.size(); i < c; i++) {
+            fg::ResourceEntryBase const* const resource = resourceRegistry[i].get();
+            cache.mResourceRefs[i] = resource->refs;
+            cache.mFirstPass[i] = indexOf(resource->first);
+            cache.mLastPass[i] = indexOf(resource->last);
+        }
+    }
+
+    computeLifetimes();
+    return *this;
+}
+
+size_t FrameGraph::getPassCount() const noexcept {
+    return mPassNodes.size();
+}
+
+size_t FrameGraph::getCulledPassCount() const noexcept {
+    return std::count_if(mPassNodes.begin(), mPassNodes.end(),
+            [](PassNode const& pass) { return !pass.refCount; });
+}
+
+void FrameGraph::computeSignature(Vector<uint32_t>& signature) const noexcept {
+    // Culling only depends on which nodes the passes read and write, and which nodes refer to
+    // the same resource, which moveResource() can change.
+    auto const& passNodes = mPassNodes;
+    auto const& resourceNodes = mResourceNodes;
+    signature.push_back(uint32_t(passNodes.size()));
+    signature.push_back(uint32_t(resourceNodes.size()));
+    signature.push_back(uint32_t(mResourceEntries.size()));
+    for (PassNode const& pass : passNodes) {
+        signature.push_back(uint32_t(pass.hasSideEffect));
+        signature.push_back(uint32_t(pass.reads.size()));
+        for (FrameGraphHandle resource : pass.reads) {
+            signature.push_back(resourceNodes[resource.index]->index);
+        }
+        signature.push_back(uint32_t(pass.writes.size()));
+        for (FrameGraphHandle resource : pass.writes) {
+            signature.push_back(resourceNodes[resource.index]->index);
+        }
+    }
+    for (ResourceNode const* node : resourceNodes) {
+        signature.push_back(node->index);
+        signature.push_back(node->resource->id);
+    }
+}
+
+void FrameGraph::cull() noexcept {
+    Vector<fg::PassNode>& passNodes = mPassNodes;
+    Vector<ResourceNode*>& resourceNodes = mResourceNodes;
+
     /*
      * compute passes and resource reference counts
      */
@@ -349,13 +462,23 @@ FrameGraph& FrameGraph::compile() noexcept {
         }
     }
 
-    // update the SAMPLEABLE bit, now that we culled unneeded passes
+}
+
+void FrameGraph::computeLifetimes() noexcept {
+    Vector<fg::PassNode>& passNodes = mPassNodes;
+    Vector<UniquePtr<fg::ResourceEntryBase>>& resourceRegistry = mResourceEntries;
+
+    // update the SAMPLEABLE and STORAGE bits, now that we culled unneeded passes
     for (PassNode& pass : passNodes) {
         if (pass.refCount) {
             for (auto handle : pass.samples) {
                 auto& texture = getResourceEntryUnchecked(handle);
                 texture.descriptor.usage |= backend::TextureUsage::SAMPLEABLE;
             }
+            for (auto handle : pass.images) {
+                auto& texture = getResourceEntryUnchecked(handle);
+                texture.descriptor.usage |= backend::TextureUsage::STORAGE;
+            }
         }
     }
 
@@ -380,12 +503,9 @@ FrameGraph& FrameGraph::compile() noexcept {
             }
         }
     }
-
-    return *this;
 }
 
-void FrameGraph::executeInternal(PassNode const& node, DriverApi& driver) noexcept {
-    assert(node.base);
+void FrameGraph::preExecute(PassNode const& node) noexcept {
     // create concrete resources and rendertargets
     for (VirtualResource* resource : node.devirtualize) {
         resource->preExecuteDevirtualize(*this);
@@ -401,11 +521,9 @@ void FrameGraph::executeInternal(PassNode const& node, DriverApi& driver) noexce
         auto& entry = getResourceEntryUnchecked<FrameGraphRenderTarget>(handle);
         static_cast<RenderTargetResourceEntry&>(entry).update(*this, node);
     }
+}
 
-    // execute the pass
-    FrameGraphPassResources resources(*this, node);
-    node.base->execute(resources, driver);
-
+void FrameGraph::postExecute(PassNode const& node) noexcept {
     for (VirtualResource* resource : node.devirtualize) {
         resource->postExecuteDevirtualize(*this);
     };
@@ -417,6 +535,107 @@ void FrameGraph::executeInternal(PassNode const& node, DriverApi& driver) noexce
     });
 }
 
+void FrameGraph::executeInternal(PassNode const& node, DriverApi& driver) noexcept {
+    assert(node.base);
+    preExecute(node);
+
+    // execute the pass
+    FrameGraphPassResources resources(*this, node);
+    node.base->execute(resources, driver);
+
+    // make the writes of a compute pass visible to the passes that follow
+    if (node.isCompute) {
+        driver.memoryBarrier(backend::MemoryBarrierFlags::ALL);
+    }
+
+    postExecute(node);
+}
+
+size_t FrameGraph::collectParallelPasses(size_t first, size_t parallelBudget,
+        PassNode const** nodes, size_t* next) const noexcept {
+    auto const& passNodes = mPassNodes;
+    auto const& resourceNodes = mResourceNodes;
+
+    // The passes are collected in order, so their commands are executed in the same order as
+    // if they had been recorded one after the other. A pass that uses a resource of a collected
+    // pass depends on it, it starts the next group.
+    size_t count = 0;
+    size_t size = 0;
+    auto usesCollectedResource = [&](PassNode const& node) {
+        auto used = [&](FrameGraphHandle handle) {
+            ResourceEntryBase const* const resource = resourceNodes[handle.index]->resource;
+            auto usesResource = [&](FrameGraphHandle other) {
+                return resourceNodes[other.index]->resource == resource;
+            };
+            return std::any_of(nodes, nodes + count, [&](PassNode const* collected) {
+                return std::any_of(collected->reads.begin(), collected->reads.end(),
+                        usesResource) ||
+                       std::any_of(collected->writes.begin(), collected->writes.end(),
+                        usesResource);
+            });
+        };
+        return std::any_of(node.reads.begin(), node.reads.end(), used) ||
+               std::any_of(node.writes.begin(), node.writes.end(), used);
+    };
+
+    size_t i = first;
+    for (size_t c = passNodes.size(); i < c && count < MAX_PARALLEL_PASSES; i++) {
+        PassNode const& node = passNodes[i];
+        if (!node.refCount) {
+            // culled passes don't break a group
+            continue;
+        }
+        if (!node.parallelCommandSize || node.isCompute ||
+                size + node.parallelCommandSize > parallelBudget ||
+                usesCollectedResource(node)) {
+            break;
+        }
+        size += node.parallelCommandSize;
+        nodes[count++] = &node;
+    }
+    *next = i;
+    return count;
+}
+
+void FrameGraph::executeParallel(JobSystem& js, PassNode const* const* nodes, size_t count,
+        DriverApi& driver) noexcept {
+    SYSTRACE_CALL();
+
+    // Resources are created and destroyed on this thread, before and after the passes. This is
+    // possible because the passes don't share resources.
+    for (size_t i = 0; i < count; i++) {
+        preExecute(*nodes[i]);
+    }
+
+    // room for the markers around each pass
+    constexpr size_t markersSize =
+            CommandBase::align(sizeof(COMMAND_TYPE(pushGroupMarker))) +
+            CommandBase::align(sizeof(COMMAND_TYPE(popGroupMarker)));
+
+    // The sub-streams are reserved in order, they're executed in that order.
+    std::array<std::optional<CommandSubStream>, MAX_PARALLEL_PASSES> subStreams;
+    JobSystem::Job* parent = js.createJob();
+    for (size_t i = 0; i < count; i++) {
+        PassNode const& node = *nodes[i];
+        assert(node.base);
+        CommandSubStream& subStream = subStreams[i].emplace(driver,
+                node.parallelCommandSize + markersSize);
+        js.run(js.createJob(parent, [this, &node, &subStream](JobSystem&, JobSystem::Job*) {
+            DriverApi& stream = subStream.getStream();
+            stream.pushGroupMarker(node.name);
+            FrameGraphPassResources resources(*this, node);
+            node.base->execute(resources, stream);
+            stream.popGroupMarker();
+        }));
+    }
+    js.runAndWait(parent);
+
+    for (size_t i = 0; i < count; i++) {
+        subStreams[i]->finish();
+        postExecute(*nodes[i]);
+    }
+}
+
 void FrameGraph::reset() noexcept {
     // reset the frame graph state
     mPassNodes.clear();
@@ -426,30 +645,112 @@ void FrameGraph::reset() noexcept {
     mId = 0;
 }
 
-void FrameGraph::execute(FEngine& engine, DriverApi& driver) noexcept {
+void FrameGraph::execute(FEngine& engine, DriverApi& driver,
+        ExecuteObserver* observer) noexcept {
+    // Passes can't be timed while they're recorded concurrently. The sub-streams of parallel
+    // passes reserve their worst case size, only half of the command buffer's guaranteed space
+    // is used by them.
+    JobSystem& js = engine.getJobSystem();
+    const size_t parallelBudget = (observer || !js.getParallelSplitCount()) ?
+            0 : engine.getMinCommandBufferSize() / 2;
+    executePasses(&engine, &js, parallelBudget, driver, observer);
+}
+
+void FrameGraph::execute(DriverApi& driver, ExecuteObserver* observer) noexcept {
+    executePasses(nullptr, nullptr, 0, driver, observer);
+}
+
+void FrameGraph::execute(JobSystem& js, size_t parallelBudget, DriverApi& driver) noexcept {
+    executePasses(nullptr, &js, parallelBudget, driver, nullptr);
+}
+
+void FrameGraph::executePasses(FEngine* engine, JobSystem* js, size_t parallelBudget,
+        DriverApi& driver, ExecuteObserver* observer) noexcept {
     auto const& passNodes = mPassNodes;
+    auto const& resourceNodes = mResourceNodes;
+
+    // resources used by the async compute passes that may still be running
+    Vector<VirtualResource const*> asyncResources(mArena);
+    auto usesAsyncResource = [&](PassNode const& node) {
+        auto used = [&](FrameGraphHandle handle) {
+            return std::find(asyncResources.begin(), asyncResources.end(),
+                    resourceNodes[handle.index]->resource) != asyncResources.end();
+        };
+        return std::any_of(node.reads.begin(), node.reads.end(), used) ||
+               std::any_of(node.writes.begin(), node.writes.end(), used);
+    };
+
+    if (observer) {
+        observer->beginExecute(std::count_if(passNodes.begin(), passNodes.end(),
+                [](PassNode const& node) {
+                    return node.refCount && !(node.isAsyncCompute && node.destroy.empty());
+                }));
+    }
+
     driver.pushGroupMarker("FrameGraph");
-    for (PassNode const& node : passNodes) {
-        if (node.refCount) {
-            driver.pushGroupMarker(node.name);
-            executeInternal(node, driver);
-            driver.popGroupMarker();
+    for (size_t i = 0, c = passNodes.size(); i < c;) {
+        PassNode const& node = passNodes[i];
+        if (!node.refCount) {
+            i++;
+            continue;
+        }
+
+        if (js && node.parallelCommandSize) {
+            PassNode const* nodes[MAX_PARALLEL_PASSES];
+            size_t next;
+            const size_t count = collectParallelPasses(i, parallelBudget, nodes, &next);
+            if (count > 1) {
+                if (!asyncResources.empty() &&
+                        std::any_of(nodes, nodes + count, [&](PassNode const* node) {
+                            return usesAsyncResource(*node);
+                        })) {
+                    driver.waitAsyncCompute();
+                    asyncResources.clear();
+                }
+                if (engine) {
+                    // make room for the sub-streams in the command buffer
+                    engine->flush();
+                }
+                executeParallel(*js, nodes, count, driver);
+                i = next;
+                continue;
+            }
         }
-    }
-    // this is a good place to kick the GPU, since we've just done a bunch of work
-    driver.flush();
-    driver.popGroupMarker();
-    reset();
-}
 
-void FrameGraph::execute(DriverApi& driver) noexcept {
-    for (PassNode const& node : mPassNodes) {
-        if (node.refCount) {
-            executeInternal(node, driver);
+        if (!asyncResources.empty() && usesAsyncResource(node)) {
+            driver.waitAsyncCompute();
+            asyncResources.clear();
         }
+        // the resources destroyed by a pass could be reused by the next ones right away
+        const bool async = node.isAsyncCompute && node.destroy.empty();
+        driver.pushGroupMarker(node.name);
+        if (async) {
+            driver.beginAsyncCompute();
+        } else if (observer) {
+            observer->beginPass(node.name);
+        }
+        executeInternal(node, driver);
+        if (!async && observer) {
+            observer->endPass();
+        }
+        if (async) {
+            driver.endAsyncCompute();
+            for (FrameGraphHandle handle : node.reads) {
+                asyncResources.push_back(resourceNodes[handle.index]->resource);
+            }
+            for (FrameGraphHandle handle : node.writes) {
+                asyncResources.push_back(resourceNodes[handle.index]->resource);
+            }
+        }
+        driver.popGroupMarker();
+        i++;
+    }
+    if (!asyncResources.empty()) {
+        driver.waitAsyncCompute();
     }
     // this is a good place to kick the GPU, since we've just done a bunch of work
     driver.flush();
+    driver.popGroupMarker();
     reset();
 }
 
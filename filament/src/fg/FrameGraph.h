@@ -33,6 +33,7 @@
 
 #include <utils/Log.h>
 
+#include <limits>
 #include <vector>
 #include <memory>
 
@@ -44,6 +45,10 @@
  *
  */
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class FEngine;
@@ -113,10 +118,25 @@ public:
         // Sample from a texture resource (implies read())
         FrameGraphId<FrameGraphTexture> sample(FrameGraphId<FrameGraphTexture> input);
 
+        // Write to a texture resource as a storage image, from a compute pass (implies write())
+        [[nodiscard]] FrameGraphId<FrameGraphTexture> image(FrameGraphId<FrameGraphTexture> output);
+
         // Declare that this pass has side effects outside the framegraph (i.e. it can't be culled)
         // Calling write() on an imported resource automatically adds a side-effect.
         Builder& sideEffect() noexcept;
 
+        // Declare that this compute pass can run concurrently with the passes that follow it, up
+        // to the first one that uses one of its resources. The backend may then execute it on a
+        // separate queue. A pass that is the last user of a resource always runs in order.
+        Builder& asyncCompute() noexcept;
+
+        // Declare that this pass can record its commands on a job thread, concurrently with the
+        // parallel passes next to it that don't use its resources. Its commands are still
+        // executed in order. The Execute lambda must only record into the DriverApi it's given,
+        // and not change state used by other passes. maxCommandSize is an upper bound of the
+        // size of the commands it records (see COMMAND_TYPE()).
+        Builder& parallel(size_t maxCommandSize) noexcept;
+
         // Helpers --------------------------------------------------------------------
 
         // Return the name of the pass being built
@@ -135,6 +155,7 @@ public:
         friend class FrameGraph;
         Builder(FrameGraph& fg, fg::PassNode& pass) noexcept;
         ~Builder() noexcept;
+        void compute() noexcept;
         FrameGraphHandle readImpl(FrameGraphHandle input);
         [[nodiscard]] FrameGraphHandle writeImpl(FrameGraphHandle output);
         FrameGraphId<FrameGraphRenderTarget> createRenderTargetImpl(
@@ -181,6 +202,19 @@ public:
         return *pass;
     }
 
+    /*
+     * Add a compute pass to the framegraph, see addPass().
+     * The Execute lambda dispatches compute programs, a compute pass never has a render target.
+     * The writes of a compute pass are made visible to the passes executed after it.
+     */
+    template <typename Data, typename Setup, typename Execute>
+    FrameGraphPass<Data, Execute>& addComputePass(const char* name, Setup setup, Execute&& execute) {
+        return addPass<Data>(name, [&setup](Builder& builder, Data& data) {
+                    builder.compute();
+                    setup(builder, data);
+                }, std::forward<Execute>(execute));
+    }
+
     // Adds a simple execute-only pass with side effect (so it's not culled)
     template<typename Execute>
     void addTrivialSideEffectPass(const char* name, Execute&& execute) {
@@ -236,11 +270,56 @@ public:
 
     void moveResource(FrameGraphId<FrameGraphRenderTarget> from, FrameGraphId<FrameGraphTexture> to);
 
+    /*
+     * The results of compile() that only depend on the structure of the graph, i.e. its passes
+     * and how they use resources, but not on the resource descriptors. A CompileCache is kept
+     * across frames, typically by a View, so that compile() doesn't need to cull the graph
+     * again when its structure is unchanged.
+     */
+    class CompileCache {
+    public:
+        // forces the next compile() to cull the graph
+        void clear() noexcept { mSignature.clear(); }
+
+    private:
+        friend class FrameGraph;
+        static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+        std::vector<uint32_t> mSignature;       // structure of the graph
+        std::vector<uint32_t> mPassRefCounts;   // for each pass
+        std::vector<uint32_t> mResourceRefs;    // for each resource
+        std::vector<uint32_t> mFirstPass;       // for each resource, index of its first pass
+        std::vector<uint32_t> mLastPass;        // for each resource, index of its last pass
+    };
+
     // allocates concrete resources and culls unreferenced passes
     FrameGraph& compile() noexcept;
 
-    // execute all referenced passes and flush the command queue after each pass
-    void execute(FEngine& engine, backend::DriverApi& driver) noexcept;
+    // same as above, but reuses the culling results of the previous frame graph compiled with
+    // this cache if it had the same structure, and updates the cache otherwise
+    FrameGraph& compile(CompileCache& cache) noexcept;
+
+    // number of passes added, and how many of them compile() culled
+    size_t getPassCount() const noexcept;
+    size_t getCulledPassCount() const noexcept;
+
+    // notified around the execution of each pass, e.g. to time them
+    class ExecuteObserver {
+    public:
+        // called once before the passes, with the number of passes that will be reported
+        virtual void beginExecute(size_t passCount) noexcept = 0;
+        // name is the name given to addPass()
+        virtual void beginPass(const char* name) noexcept = 0;
+        virtual void endPass() noexcept = 0;
+    protected:
+        ~ExecuteObserver() noexcept = default;
+    };
+
+    // execute all referenced passes and flush the command queue after each pass. Async compute
+    // passes are not reported to the observer, since they don't run in order with the others.
+    // Consecutive parallel passes that are independent of each other record their commands
+    // concurrently on the engine's JobSystem, unless there is an observer.
+    void execute(FEngine& engine, backend::DriverApi& driver,
+            ExecuteObserver* observer = nullptr) noexcept;
 
 
     /*
@@ -248,8 +327,12 @@ public:
      */
 
     // execute all referenced passes -- this version is for unit-testing, where we don't have
-    // an engine necessarily.
-    void execute(backend::DriverApi& driver) noexcept;
+    // an engine necessarily. Like the version above, the passes are recorded within group markers.
+    void execute(backend::DriverApi& driver, ExecuteObserver* observer = nullptr) noexcept;
+
+    // same as above, but the parallel passes are recorded on 'js', with up to 'parallelBudget'
+    // bytes of commands recorded concurrently
+    void execute(utils::JobSystem& js, size_t parallelBudget, backend::DriverApi& driver) noexcept;
 
     // print the frame graph as a graphviz file in the log
     void export_graphviz(utils::io::ostream& out, const char* viewName);
@@ -278,8 +361,38 @@ private:
 
     FrameGraphHandle createResourceNode(fg::ResourceEntryBase* resource) noexcept;
 
+    // most passes recorded concurrently, one sub-stream each
+    static constexpr size_t MAX_PARALLEL_PASSES = 16;
+
+    void executePasses(FEngine* engine, utils::JobSystem* js, size_t parallelBudget,
+            backend::DriverApi& driver, ExecuteObserver* observer) noexcept;
+
     void executeInternal(fg::PassNode const& node, backend::DriverApi& driver) noexcept;
 
+    // creates the resources of a pass and updates its render targets, before executing it
+    void preExecute(fg::PassNode const& node) noexcept;
+
+    // destroys the resources whose last user is this pass, after executing it
+    void postExecute(fg::PassNode const& node) noexcept;
+
+    // Collects the parallel passes starting at passNodes[first] which can be recorded
+    // concurrently, returns their count and the index of the pass that follows them.
+    size_t collectParallelPasses(size_t first, size_t parallelBudget,
+            fg::PassNode const** nodes, size_t* next) const noexcept;
+
+    // records the commands of the passes concurrently, each into a sub-stream of 'driver'
+    void executeParallel(utils::JobSystem& js, fg::PassNode const* const* nodes, size_t count,
+            backend::DriverApi& driver) noexcept;
+
+    // computes the pass and resource reference counts, culls passes and computes lifetimes
+    void cull() noexcept;
+
+    // creates the devirtualize and destroy lists of the passes, once they've been culled
+    void computeLifetimes() noexcept;
+
+    // appends a description of the structure of the graph to 'signature'
+    void computeSignature(Vector<uint32_t>& signature) const noexcept;
+
     ResourceAllocatorInterface& getResourceAllocator() noexcept { return mResourceAllocator; }
 
     void reset() noexcept;
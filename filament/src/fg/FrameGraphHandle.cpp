@@ -47,9 +47,9 @@ void FrameGraphTexture::create(ResourceAllocatorInterface& allocator, const char
 
     // texture that can't be sampled can't have LOD -- they obviously can't be accessed
     // note: this could happen if a texture was created with LODs, but a later pass didn't
-    // actually sample from it.
+    // actually sample from it. Storage images can be written at any LOD though.
     uint8_t levels = desc.levels;
-    if (!(desc.usage & TextureUsage::SAMPLEABLE)) {
+    if (!(desc.usage & (TextureUsage::SAMPLEABLE | TextureUsage::STORAGE))) {
         levels = 1;
     }
     assert(levels <= FTexture::maxLevelCount(desc.width, desc.height));
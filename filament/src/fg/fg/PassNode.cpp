@@ -27,6 +27,7 @@ PassNode::PassNode(FrameGraph& fg, const char* name, uint32_t id,
           reads(fg.getArena()),
           writes(fg.getArena()),
           samples(fg.getArena()),
+          images(fg.getArena()),
           renderTargets(fg.getArena()),
           devirtualize(fg.getArena()),
           destroy(fg.getArena()) {
@@ -63,6 +64,19 @@ FrameGraphId<FrameGraphTexture> PassNode::sample(FrameGraph& fg,
     return handle;
 }
 
+FrameGraphId<FrameGraphTexture> PassNode::image(FrameGraph& fg,
+        FrameGraphId<FrameGraphTexture> handle) {
+    // image() implies a write
+    FrameGraphId<FrameGraphTexture> r(write(fg, handle));
+
+    auto pos = std::find_if(images.begin(), images.end(),
+            [&r](FrameGraphHandle cur) { return r.index == cur.index; });
+    if (pos == images.end()) {
+        images.push_back(r);
+    }
+    return r;
+}
+
 FrameGraphId<FrameGraphRenderTarget> PassNode::use(FrameGraph& fg,
         FrameGraphId<FrameGraphRenderTarget> handle) {
     // use() implies a read
@@ -46,6 +46,7 @@ struct PassNode {
     FrameGraphId<FrameGraphTexture> sample(FrameGraph& fg, FrameGraphId<FrameGraphTexture> handle);
     FrameGraphId<FrameGraphRenderTarget> use(FrameGraph& fg, FrameGraphId<FrameGraphRenderTarget> handle);
     FrameGraphHandle write(FrameGraph& fg, const FrameGraphHandle& handle);
+    FrameGraphId<FrameGraphTexture> image(FrameGraph& fg, FrameGraphId<FrameGraphTexture> handle);
 
     // constants
     const char* const name = nullptr;                       // our name
@@ -56,6 +57,7 @@ struct PassNode {
     Vector<FrameGraphHandle> reads;                     // resources we're reading from
     Vector<FrameGraphHandle> writes;                    // resources we're writing to
     Vector<FrameGraphId<FrameGraphTexture>> samples;    // resources we're sampling from
+    Vector<FrameGraphId<FrameGraphTexture>> images;     // resources we're writing as storage images
     Vector<FrameGraphId<FrameGraphRenderTarget>> renderTargets;
 
     // computed during compile()
@@ -65,6 +67,9 @@ struct PassNode {
 
     // set by the builder
     bool hasSideEffect = false;             // whether this pass has side effects
+    bool isCompute = false;                 // whether this pass dispatches compute programs
+    bool isAsyncCompute = false;            // whether this compute pass can overlap the next ones
+    size_t parallelCommandSize = 0;         // commands recorded on a job thread, 0 if not parallel
 };
 
 } // namespace fg
@@ -79,7 +79,22 @@ void RenderTargetResourceEntry::resolve(FrameGraph& fg) noexcept {
             // update usage flags for referenced attachments
             entry.descriptor.usage |= usages[i];
 
-            // update attachment sample count if not specified and usage permits it
+            // an attachment that is only used by a single pass, and not in any other way, doesn't
+            // need to outlive it, tile-based GPUs can keep it in tile memory. This includes
+            // attachments read as subpass inputs by a later subpass of the same pass, which is
+            // how passes that only read their predecessor's output at the same pixel are merged.
+            constexpr TextureUsage attachmentUsages = TextureUsage::COLOR_ATTACHMENT |
+                    TextureUsage::DEPTH_ATTACHMENT | TextureUsage::STENCIL_ATTACHMENT |
+                    TextureUsage::SUBPASS_INPUT | TextureUsage::TRANSIENT;
+            if (!entry.imported && entry.first == entry.last &&
+                none(entry.descriptor.usage & ~attachmentUsages)) {
+                entry.descriptor.usage |= TextureUsage::TRANSIENT;
+            }
+
+            // update attachment sample count if not specified and usage permits it. A transient
+            // multi-sampled attachment never needs multi-sampled memory: the backends keep its
+            // samples in tile memory (lazily allocated images on Vulkan, implicitly resolved
+            // renderbuffers on GL).
             if (!entry.descriptor.samples &&
                 none(entry.descriptor.usage & backend::TextureUsage::SAMPLEABLE)) {
                 entry.descriptor.samples = descriptor.samples;
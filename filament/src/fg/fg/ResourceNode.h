@@ -27,8 +27,8 @@ struct PassNode;
 class ResourceEntryBase;
 
 struct ResourceNode { // 24
-    ResourceNode(ResourceEntryBase* resource, uint8_t version) noexcept
-            : resource(resource), version(version) {}
+    ResourceNode(ResourceEntryBase* resource, uint8_t version, uint16_t index) noexcept
+            : resource(resource), version(version), index(index) {}
 
     ResourceNode(ResourceNode const&) = delete;
     ResourceNode(ResourceNode&&) noexcept = default;
@@ -45,6 +45,7 @@ struct ResourceNode { // 24
 
     // constants
     const uint8_t version;          // version of the resource when the node was created
+    const uint16_t index;           // index of the handle that created this node
 };
 
 } // namespace fg
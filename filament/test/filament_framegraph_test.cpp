@@ -24,6 +24,12 @@
 
 #include "private/backend/CommandStream.h"
 
+#include <utils/JobSystem.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
 using namespace filament;
 using namespace backend;
 
@@ -356,6 +362,70 @@ TEST(FrameGraphTest, SimplePassCulling) {
     resourceAllocator.terminate();
 }
 
+TEST(FrameGraphTest, ExecuteObserver) {
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    struct Observer : public FrameGraph::ExecuteObserver {
+        std::vector<std::string> events;
+        void beginExecute(size_t passCount) noexcept override {
+            events.push_back("execute " + std::to_string(passCount));
+        }
+        void beginPass(const char* name) noexcept override {
+            events.push_back(std::string("begin ") + name);
+        }
+        void endPass() noexcept override {
+            events.push_back("end");
+        }
+    } observer;
+
+    struct PassData {
+        FrameGraphId<FrameGraphTexture> input;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    auto& renderPass = fg.addPass<PassData>("Render",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.output = builder.write(builder.createTexture("color buffer"));
+                data.rt = builder.createRenderTarget("rt", { .attachments = { data.output } });
+            },
+            [&](FrameGraphPassResources const&, auto const&, backend::DriverApi&) {
+                // the observer is notified before the pass executes
+                EXPECT_EQ(2u, observer.events.size());
+            });
+
+    auto& postProcessPass = fg.addPass<PassData>("PostProcess",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.input = builder.sample(renderPass.getData().output);
+                data.output = builder.write(builder.createTexture("postprocess buffer"));
+                data.rt = builder.createRenderTarget("postprocess rt", {
+                        .attachments = { data.output } });
+            },
+            [](FrameGraphPassResources const&, auto const&, backend::DriverApi&) {});
+
+    fg.addPass<PassData>("Culled",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.input = builder.sample(renderPass.getData().output);
+                data.output = builder.write(builder.createTexture("unused buffer"));
+                data.rt = builder.createRenderTarget("unused rt", {
+                        .attachments = { data.output } });
+            },
+            [](FrameGraphPassResources const&, auto const&, backend::DriverApi&) {});
+
+    fg.present(postProcessPass.getData().output);
+    fg.compile();
+    fg.execute(driverApi, &observer);
+
+    // culled passes are not reported
+    std::vector<std::string> expected = { "execute 3",
+            "begin Render", "end", "begin PostProcess", "end", "begin Present", "end" };
+    EXPECT_EQ(expected, observer.events);
+
+    resourceAllocator.terminate();
+}
+
 TEST(FrameGraphTest, MoveGenericResource) {
     // This checks that:
     // - two passes writing in the same resource, that is replaced (moved) by
@@ -444,3 +514,356 @@ TEST(FrameGraphTest, MoveGenericResource) {
     EXPECT_EQ(h[1], h[3]);
     EXPECT_EQ(h[3], h[0]);
 }
+
+TEST(FrameGraphTest, CompileCache) {
+    // This checks that a cached compilation is reused only when the graph has the same structure
+
+    MockResourceAllocator resourceAllocator;
+    FrameGraph::CompileCache cache;
+
+    struct RenderPassData {
+        FrameGraphId<GenericResource> output;
+    };
+
+    for (size_t frame = 0; frame < 3; frame++) {
+        FrameGraph fg(resourceAllocator);
+        bool executed[3] = {};
+
+        auto& p0 = fg.addPass<RenderPassData>("P0",
+                [&](FrameGraph::Builder& builder, auto& data) {
+                    data.output = builder.create<GenericResource>("r0");
+                    data.output = builder.write(data.output);
+                },
+                [&](FrameGraphPassResources const& resources,
+                        auto const& data, backend::DriverApi& driver) {
+                    executed[0] = true;
+                    EXPECT_TRUE(resources.get(data.output).id);
+                });
+
+        auto& p1 = fg.addPass<RenderPassData>("P1",
+                [&](FrameGraph::Builder& builder, auto& data) {
+                    builder.read(p0.getData().output);
+                    data.output = builder.create<GenericResource>("r1");
+                    data.output = builder.write(data.output);
+                },
+                [&](FrameGraphPassResources const& resources,
+                        auto const& data, backend::DriverApi& driver) {
+                    executed[1] = true;
+                    EXPECT_TRUE(resources.get(data.output).id);
+                });
+
+        auto& p2 = fg.addPass<RenderPassData>("P2",
+                [&](FrameGraph::Builder& builder, auto& data) {
+                    data.output = builder.create<GenericResource>("r2");
+                    data.output = builder.write(data.output);
+                },
+                [&](FrameGraphPassResources const& resources,
+                        auto const& data, backend::DriverApi& driver) {
+                    executed[2] = true;
+                    EXPECT_TRUE(resources.get(data.output).id);
+                });
+
+        fg.present(p1.getData().output);
+        if (frame == 2) {
+            // the structure changes, P2 is no longer culled
+            fg.present(p2.getData().output);
+        }
+
+        fg.compile(cache);
+        fg.execute(driverApi);
+
+        EXPECT_TRUE(executed[0]);
+        EXPECT_TRUE(executed[1]);
+        EXPECT_EQ(frame == 2, executed[2]);
+    }
+}
+
+TEST(FrameGraphTest, ComputePass) {
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    bool computePassExecuted = false;
+    bool renderPassExecuted = false;
+
+    struct ComputePassData {
+        FrameGraphId<FrameGraphTexture> output;
+    };
+
+    auto& computePass = fg.addComputePass<ComputePassData>("Compute",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.output = builder.createTexture("image", {
+                        .width = 64, .height = 64, .format = TextureFormat::RGBA16F });
+                data.output = builder.image(data.output);
+                EXPECT_TRUE(fg.isValid(data.output));
+            },
+            [=, &computePassExecuted, &renderPassExecuted](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                EXPECT_FALSE(renderPassExecuted);
+                computePassExecuted = true;
+                auto const& desc = resources.getDescriptor(data.output);
+                EXPECT_TRUE(any(desc.usage & TextureUsage::STORAGE));
+                EXPECT_TRUE(any(desc.usage & TextureUsage::SAMPLEABLE));
+                EXPECT_TRUE(resources.getTexture(data.output));
+            });
+
+    struct RenderPassData {
+        FrameGraphId<FrameGraphTexture> input;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    auto& renderPass = fg.addPass<RenderPassData>("Render",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.input = builder.sample(computePass.getData().output);
+                data.output = builder.createTexture("color buffer",
+                        { .format = TextureFormat::RGBA16F });
+                data.output = builder.write(data.output);
+                data.rt = builder.createRenderTarget("rt", { .attachments = { data.output } });
+            },
+            [=, &renderPassExecuted](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                renderPassExecuted = true;
+                auto const& desc = resources.getDescriptor(data.output);
+                EXPECT_FALSE(any(desc.usage & TextureUsage::STORAGE));
+            });
+
+    fg.present(renderPass.getData().output);
+    fg.compile();
+    fg.execute(driverApi);
+
+    EXPECT_TRUE(computePassExecuted);
+    EXPECT_TRUE(renderPassExecuted);
+
+    resourceAllocator.terminate();
+}
+
+TEST(FrameGraphTest, AsyncComputePass) {
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    struct Observer : public FrameGraph::ExecuteObserver {
+        std::vector<std::string> events;
+        void beginExecute(size_t passCount) noexcept override {
+            events.push_back("execute " + std::to_string(passCount));
+        }
+        void beginPass(const char* name) noexcept override {
+            events.push_back(std::string("begin ") + name);
+        }
+        void endPass() noexcept override {
+        }
+    } observer;
+
+    std::vector<std::string> executed;
+
+    struct ComputePassData {
+        FrameGraphId<FrameGraphTexture> output;
+    };
+
+    auto& computePass = fg.addComputePass<ComputePassData>("Compute",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.output = builder.createTexture("image", {
+                        .width = 64, .height = 64, .format = TextureFormat::RGBA16F });
+                data.output = builder.image(data.output);
+                builder.asyncCompute();
+            },
+            [&](FrameGraphPassResources const&, auto const&, DriverApi&) {
+                executed.push_back("Compute");
+            });
+
+    struct RenderPassData {
+        FrameGraphId<FrameGraphTexture> input;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    // doesn't use the image of the compute pass, so it can overlap with it
+    auto& shadowPass = fg.addPass<RenderPassData>("Shadow",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.output = builder.write(builder.createTexture("shadow buffer"));
+                data.rt = builder.createRenderTarget("shadow rt", {
+                        .attachments = { data.output } });
+            },
+            [&](FrameGraphPassResources const&, auto const&, DriverApi&) {
+                executed.push_back("Shadow");
+            });
+
+    auto& renderPass = fg.addPass<RenderPassData>("Render",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.input = builder.sample(computePass.getData().output);
+                builder.sample(shadowPass.getData().output);
+                data.output = builder.write(builder.createTexture("color buffer"));
+                data.rt = builder.createRenderTarget("rt", { .attachments = { data.output } });
+            },
+            [&](FrameGraphPassResources const&, auto const&, DriverApi&) {
+                executed.push_back("Render");
+            });
+
+    fg.present(renderPass.getData().output);
+    fg.compile();
+    fg.execute(driverApi, &observer);
+
+    // the async compute pass runs first, but isn't reported to the observer
+    std::vector<std::string> expectedExecuted = { "Compute", "Shadow", "Render" };
+    EXPECT_EQ(expectedExecuted, executed);
+    std::vector<std::string> expectedEvents = {
+            "execute 3", "begin Shadow", "begin Render", "begin Present" };
+    EXPECT_EQ(expectedEvents, observer.events);
+
+    resourceAllocator.terminate();
+}
+
+TEST(FrameGraphTest, TransientAttachment) {
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    bool colorPassExecuted = false;
+
+    struct ColorPassData {
+        FrameGraphId<FrameGraphTexture> outColor;
+        FrameGraphId<FrameGraphTexture> outDepth;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    auto& colorPass = fg.addPass<ColorPassData>("color pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.outColor = builder.createTexture("color buffer",
+                        { .format = TextureFormat::RGBA16F });
+                data.outDepth = builder.createTexture("depth buffer",
+                        { .format = TextureFormat::DEPTH24 });
+                data.outColor = builder.write(data.outColor);
+                data.outDepth = builder.write(data.outDepth);
+                data.rt = builder.createRenderTarget("rt color+depth", {
+                        .attachments = { data.outColor, data.outDepth }
+                });
+            },
+            [=, &colorPassExecuted](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                colorPassExecuted = true;
+                // the depth buffer is only used by this pass, the color buffer is presented
+                EXPECT_TRUE(any(resources.getDescriptor(data.outDepth).usage &
+                        TextureUsage::TRANSIENT));
+                EXPECT_FALSE(any(resources.getDescriptor(data.outColor).usage &
+                        TextureUsage::TRANSIENT));
+                auto const& rt = resources.get(data.rt);
+                EXPECT_EQ(TargetBufferFlags::DEPTH, rt.params.flags.discardEnd);
+            });
+
+    fg.present(colorPass.getData().outColor);
+    fg.compile();
+    fg.execute(driverApi);
+
+    EXPECT_TRUE(colorPassExecuted);
+
+    resourceAllocator.terminate();
+}
+
+TEST(FrameGraphTest, TransientSubpassInput) {
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    bool colorPassExecuted = false;
+
+    struct ColorPassData {
+        FrameGraphId<FrameGraphTexture> color;
+        FrameGraphId<FrameGraphTexture> output;
+        FrameGraphRenderTargetHandle rt;
+    };
+
+    // the color buffer is tone-mapped into the output by a second subpass of the same pass
+    auto& colorPass = fg.addPass<ColorPassData>("color pass",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.color = builder.createTexture("color buffer", {
+                        .format = TextureFormat::RGBA16F,
+                        .usage = TextureUsage::SUBPASS_INPUT });
+                data.output = builder.createTexture("tonemapped buffer",
+                        { .format = TextureFormat::RGBA8 });
+                data.color = builder.write(builder.read(data.color));
+                data.output = builder.write(data.output);
+                data.rt = builder.createRenderTarget("rt color+output", {
+                        .attachments = {{ data.color, data.output, {}, {}}, {}, {}}
+                });
+            },
+            [=, &colorPassExecuted](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                colorPassExecuted = true;
+                EXPECT_TRUE(any(resources.getDescriptor(data.color).usage &
+                        TextureUsage::TRANSIENT));
+                EXPECT_FALSE(any(resources.getDescriptor(data.output).usage &
+                        TextureUsage::TRANSIENT));
+                auto const& rt = resources.get(data.rt);
+                EXPECT_EQ(TargetBufferFlags::COLOR0, rt.params.flags.discardEnd);
+            });
+
+    fg.present(colorPass.getData().output);
+    fg.compile();
+    fg.execute(driverApi);
+
+    EXPECT_TRUE(colorPassExecuted);
+
+    resourceAllocator.terminate();
+}
+
+TEST(FrameGraphTest, ParallelPasses) {
+
+    utils::JobSystem js;
+    js.adopt();
+
+    ResourceAllocator resourceAllocator(driverApi);
+    FrameGraph fg(resourceAllocator);
+
+    std::atomic<int> parallelPassCount{ 0 };
+    bool dependentPassExecuted = false;
+
+    struct PassData {
+        FrameGraphId<FrameGraphTexture> input;
+        FrameGraphId<FrameGraphTexture> output;
+    };
+
+    // A and B don't share resources, they're recorded concurrently into their own sub-stream
+    auto addIndependentPass = [&](const char* name) -> auto& {
+        return fg.addPass<PassData>(name,
+                [&](FrameGraph::Builder& builder, auto& data) {
+                    data.output = builder.createTexture("output", {
+                            .width = 16, .height = 16, .format = TextureFormat::RGBA8 });
+                    data.output = builder.write(data.output);
+                    builder.sideEffect();
+                    builder.parallel(64);
+                },
+                [&](FrameGraphPassResources const& resources,
+                        auto const& data, DriverApi& driver) {
+                    EXPECT_NE(&driver, &driverApi);
+                    EXPECT_TRUE(resources.getTexture(data.output));
+                    parallelPassCount++;
+                });
+    };
+
+    auto& passA = addIndependentPass("A");
+    addIndependentPass("B");
+
+    // C reads the output of A, so it's recorded after it, directly into the stream
+    fg.addPass<PassData>("C",
+            [&](FrameGraph::Builder& builder, auto& data) {
+                data.input = builder.sample(passA.getData().output);
+                builder.sideEffect();
+                builder.parallel(64);
+            },
+            [&](FrameGraphPassResources const& resources,
+                    auto const& data, DriverApi& driver) {
+                EXPECT_EQ(&driver, &driverApi);
+                EXPECT_EQ(2, parallelPassCount);
+                dependentPassExecuted = true;
+            });
+
+    fg.compile();
+    fg.execute(js, 1024, driverApi);
+
+    EXPECT_EQ(2, parallelPassCount);
+    EXPECT_TRUE(dependentPassExecuted);
+
+    resourceAllocator.terminate();
+    js.emancipate();
+}
@@ -35,16 +35,29 @@
 #include <private/filament/UniformInterfaceBlock.h>
 #include <private/filament/UibGenerator.h>
 #include <private/backend/BackendUtils.h>
+#include <private/backend/HandleAllocator.h>
 
 #include "details/Allocators.h"
 #include "details/Material.h"
 #include "details/Camera.h"
+#include "details/CullingBvh.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/RenderPrimitive.h"
+#include "details/Texture.h"
+#include "details/VertexBuffer.h"
 #include "details/Engine.h"
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
+#include "ProgramCache.h"
+#include "ResourceAllocator.h"
 #include "UniformBuffer.h"
 
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <vector>
+
 using namespace filament;
 using namespace filament::math;
 using namespace utils;
@@ -277,6 +290,90 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(c, tcm.getChildCount(newParent));
 }
 
+TEST(FilamentTest, TransformManagerHierarchy) {
+    JobSystem js;
+    js.adopt();
+    {
+        filament::FTransformManager tcm(&js);
+        EntityManager& em = EntityManager::get();
+
+        // a few roots, and wide levels so they're updated in parallel
+        constexpr size_t ROOT_COUNT = 4;
+        constexpr size_t LEVEL_COUNT = 4;
+        constexpr size_t LEVEL_SIZE = 1200;
+        std::vector<Entity> entities(ROOT_COUNT + LEVEL_COUNT * LEVEL_SIZE);
+        em.create(entities.size(), entities.data());
+
+        // create the nodes from the deepest level, so children come before their parent
+        for (size_t i = entities.size(); i-- > 0;) {
+            tcm.create(entities[i]);
+        }
+
+        std::default_random_engine generator(82828);
+        std::uniform_real_distribution<float> offset(-10.0f, 10.0f);
+        std::vector<Entity> parents(entities.size());
+        for (size_t l = 0; l < LEVEL_COUNT; l++) {
+            const size_t first = l ? ROOT_COUNT + (l - 1) * LEVEL_SIZE : 0;
+            const size_t count = l ? LEVEL_SIZE : ROOT_COUNT;
+            std::uniform_int_distribution<size_t> parent(first, first + count - 1);
+            for (size_t i = 0; i < LEVEL_SIZE; i++) {
+                const size_t child = ROOT_COUNT + l * LEVEL_SIZE + i;
+                parents[child] = entities[parent(generator)];
+                tcm.setParent(tcm.getInstance(entities[child]), tcm.getInstance(parents[child]));
+            }
+        }
+
+        auto check = [&]() {
+            // entities are sorted by level, so parents are always computed first
+            std::vector<mat4f> expected(entities.size());
+            for (size_t i = 0; i < entities.size(); i++) {
+                mat4f const& local = tcm.getTransform(tcm.getInstance(entities[i]));
+                const size_t p = std::find(entities.begin(), entities.begin() + i, parents[i]) -
+                        entities.begin();
+                expected[i] = p < i ? expected[p] * local : local;
+                ASSERT_EQ(expected[i], tcm.getWorldTransform(tcm.getInstance(entities[i])));
+            }
+        };
+
+        tcm.openLocalTransformTransaction();
+        for (Entity e : entities) {
+            tcm.setTransform(tcm.getInstance(e), mat4f::translation(
+                    float3{ offset(generator), offset(generator), offset(generator) }));
+        }
+        tcm.commitLocalTransformTransaction();
+        check();
+
+        // only the modified subtree is updated, and instances don't move
+        const uint64_t layoutGeneration = tcm.getLayoutGeneration();
+        const uint64_t generation = tcm.getGeneration();
+        const Entity modified = entities[ROOT_COUNT + 7];
+        tcm.openLocalTransformTransaction();
+        tcm.setTransform(tcm.getInstance(modified), mat4f::translation(float3{ 1, 2, 3 }));
+        tcm.commitLocalTransformTransaction();
+        EXPECT_EQ(layoutGeneration, tcm.getLayoutGeneration());
+        EXPECT_GT(tcm.getGeneration(), generation);
+        check();
+
+        size_t updatedCount = 0;
+        for (Entity e : entities) {
+            bool inSubtree = false;
+            for (Entity a = e; !a.isNull(); a = tcm.getParent(tcm.getInstance(a))) {
+                inSubtree = inSubtree || a == modified;
+            }
+            EXPECT_EQ(inSubtree, tcm.getGeneration(tcm.getInstance(e)) > generation);
+            updatedCount += inSubtree ? 1 : 0;
+        }
+        EXPECT_GT(updatedCount, LEVEL_COUNT - 1);
+        EXPECT_LT(updatedCount, entities.size() / 2);
+
+        for (Entity e : entities) {
+            tcm.destroy(e);
+        }
+        em.destroy(entities.size(), entities.data());
+    }
+    js.emancipate();
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -544,6 +641,164 @@ TEST(FilamentTest, BoxCulling) {
     EXPECT_TRUE( frustum.intersects( { 0, 200 }) );
 }
 
+TEST(FilamentTest, FusedCulling) {
+    const Frustum frusta[] = {
+            Frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100)),
+            Frustum(mat4f::ortho(-50, 50, -50, 50, 0, 200)),
+            Frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100) *
+                    mat4f::rotation(F_PI_2, float3{ 0, 1, 0 })),
+    };
+    const uint8_t bits[] = { 1, 2, 5 };
+
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+    // more than one block of the fused loop
+    constexpr size_t COUNT = 1000;
+    std::vector<float3> centers(Culler::round(COUNT));
+    std::vector<float3> extents(Culler::round(COUNT));
+    for (size_t i = 0; i < COUNT; i++) {
+        centers[i] = { position(generator), position(generator), position(generator) };
+        extents[i] = { size(generator), size(generator), size(generator) };
+    }
+
+    std::vector<Culler::result_type> expected(Culler::round(COUNT), 0);
+    for (size_t f = 0; f < 3; f++) {
+        std::vector<Culler::result_type> results(Culler::round(COUNT), 0);
+        Culler::Test::intersects(results.data(), frusta[f], centers.data(), extents.data(), COUNT);
+        for (size_t i = 0; i < COUNT; i++) {
+            expected[i] |= Culler::result_type(results[i] ? 1u << bits[f] : 0u);
+        }
+    }
+
+    // the bits already set are kept
+    std::vector<Culler::result_type> actual(Culler::round(COUNT), 0x80);
+    Culler::Test::intersects(actual.data(), frusta, bits, 3,
+            centers.data(), extents.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        EXPECT_EQ(expected[i] | 0x80, actual[i]);
+    }
+}
+
+TEST(FilamentTest, HierarchicalCulling) {
+    Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
+
+    std::default_random_engine generator(82828);
+    std::uniform_real_distribution<float> position(-200.0f, 200.0f);
+    std::uniform_real_distribution<float> size(0.1f, 5.0f);
+
+    constexpr size_t COUNT = 5000;
+    std::vector<uint32_t> ids(COUNT);
+    std::vector<float3> centers(Culler::round(COUNT));
+    std::vector<float3> extents(Culler::round(COUNT));
+    for (size_t i = 0; i < COUNT; i++) {
+        // ids don't need to be contiguous
+        ids[i] = uint32_t(i * 3 + 1);
+        centers[i] = { position(generator), position(generator), position(generator) };
+        extents[i] = { size(generator), size(generator), size(generator) };
+    }
+
+    auto check = [&](CullingBvh const& bvh) {
+        std::vector<Culler::result_type> expected(Culler::round(COUNT), 0);
+        Culler::Test::intersects(expected.data(), frustum, centers.data(), extents.data(), COUNT);
+
+        std::vector<Culler::result_type> actual(COUNT * 3 + 1, 0);
+        bvh.cull(frustum, 1, [&](uint32_t const* ids, Culler::result_type const* results,
+                size_t count) {
+            for (size_t i = 0; i < count; i++) {
+                actual[ids[i]] |= results ? results[i] : Culler::result_type(2);
+            }
+        });
+
+        size_t visibleCount = 0;
+        for (size_t i = 0; i < COUNT; i++) {
+            EXPECT_EQ(bool(expected[i]), bool(actual[ids[i]] & 2));
+            visibleCount += expected[i] ? 1 : 0;
+        }
+        EXPECT_GT(visibleCount, 0);
+        EXPECT_LT(visibleCount, COUNT);
+    };
+
+    CullingBvh bvh;
+    bvh.build(ids.data(), centers.data(), extents.data(), COUNT);
+    check(bvh);
+
+    // move some of the boxes, and refit
+    for (size_t i = 0; i < COUNT; i += 7) {
+        centers[i] = { position(generator), position(generator), position(generator) };
+        bvh.update(ids[i], centers[i], extents[i]);
+    }
+    bvh.refit();
+    check(bvh);
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    const mat4f projection = mat4f::frustum(-1, 1, -1, 1, 1, 100);
+    auto windowDepth = [&](float z) {
+        const float4 clip = projection * float4{ 0, 0, z, 1 };
+        return 0.5f - 0.5f * clip.z / clip.w;
+    };
+
+    // a wall at z = -10, with a hole showing the background on the left quarter of the screen
+    constexpr uint32_t WIDTH = 64;
+    constexpr uint32_t HEIGHT = 48;
+    std::vector<float> depth(WIDTH * HEIGHT, windowDepth(-10));
+    for (uint32_t y = 0; y < HEIGHT; y++) {
+        std::fill_n(depth.data() + y * WIDTH, WIDTH / 4, 0.0f);
+    }
+
+    OcclusionCuller culler;
+    EXPECT_TRUE(culler.empty());
+    culler.setDepth(depth.data(), WIDTH, HEIGHT, projection);
+    EXPECT_FALSE(culler.empty());
+
+    const float3 extent{ 1 };
+
+    // in front of the wall, straddling it, and behind it
+    EXPECT_FALSE(culler.isOccluded(projection, { 0, 0, -5 }, extent));
+    EXPECT_FALSE(culler.isOccluded(projection, { 0, 0, -10 }, extent));
+    EXPECT_TRUE(culler.isOccluded(projection, { 0, 0, -20 }, extent));
+
+    // behind the wall, but visible through the hole, even partially
+    EXPECT_FALSE(culler.isOccluded(projection, { -16, 0, -20 }, extent));
+    EXPECT_FALSE(culler.isOccluded(projection, { -10, 0, -20 }, extent));
+    EXPECT_TRUE(culler.isOccluded(projection, { -6, 0, -20 }, extent));
+
+    // large boxes use the coarser levels of the pyramid
+    EXPECT_TRUE(culler.isOccluded(projection, { 30, 0, -50 }, float3{ 15, 15, 1 }));
+    EXPECT_FALSE(culler.isOccluded(projection, { 0, 0, -50 }, float3{ 40, 20, 1 }));
+
+    // crossing the camera plane
+    EXPECT_FALSE(culler.isOccluded(projection, { 0, 0, -20 }, float3{ 1, 1, 30 }));
+
+    // cull() only clears the requested bit, of the boxes that have it set, are in a visible
+    // layer and have culling enabled, and takes the world origin of the boxes into account
+    const mat4f worldOrigin = mat4f::translation(float3{ 0, 0, -100 });
+    std::vector<float3> centers = {
+            { 0, 0, -105 }, { 0, 0, -120 }, { 0, 0, -120 }, { -16, 0, -120 },
+            { 0, 0, -120 }, { 0, 0, -120 }, {}, {} };
+    std::vector<float3> extents(centers.size(), extent);
+    std::vector<Culler::result_type> visibility = { 3, 3, 2, 3, 3, 3, 0, 0 };
+    std::vector<uint8_t> layers = { 1, 1, 1, 1, 2, 1, 0, 0 };
+    FRenderableManager::Visibility enabled{};
+    enabled.culling = true;
+    std::vector<FRenderableManager::Visibility> states(centers.size(), enabled);
+    states[5].culling = false;
+    EXPECT_EQ(1, culler.cull(visibility.data(), centers.data(), extents.data(),
+            layers.data(), states.data(), 6, 1, worldOrigin, 1));
+    EXPECT_EQ(3, visibility[0]);
+    EXPECT_EQ(2, visibility[1]);
+    EXPECT_EQ(2, visibility[2]);
+    EXPECT_EQ(3, visibility[3]);
+    EXPECT_EQ(3, visibility[4]);
+    EXPECT_EQ(3, visibility[5]);
+
+    culler.clear();
+    EXPECT_TRUE(culler.empty());
+    EXPECT_FALSE(culler.isOccluded(projection, { 0, 0, -20 }, extent));
+}
+
 TEST(FilamentTest, SphereCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -727,6 +982,370 @@ TEST(FilamentTest, FroxelData) {
     Engine::destroy((Engine **)&engine);
 }
 
+TEST(FilamentTest, FroxelConfig) {
+    using namespace filament;
+
+    // out of range values are clamped
+    Engine::Config config;
+    config.froxelCount = 100000;
+    config.froxelSliceCount = 1;
+    config.maxLightCount = 1000;
+    FEngine* engine = FEngine::create(Engine::Backend::DEFAULT, nullptr, nullptr, &config);
+    EXPECT_EQ(FROXEL_BUFFER_ENTRY_COUNT_MAX, engine->getConfig().froxelCount);
+    EXPECT_EQ(FROXEL_SLICE_COUNT_MIN, engine->getConfig().froxelSliceCount);
+    EXPECT_EQ(CONFIG_MAX_LIGHT_COUNT, engine->getConfig().maxLightCount);
+    Engine::destroy((Engine **)&engine);
+
+    config.froxelCount = 2048;
+    config.froxelSliceCount = 8;
+    config.maxLightCount = 32;
+    engine = FEngine::create(Engine::Backend::DEFAULT, nullptr, nullptr, &config);
+
+    LinearAllocatorArena arena("FRenderer: per-frame allocator", FEngine::CONFIG_PER_RENDER_PASS_ARENA_SIZE);
+    utils::ArenaScope<LinearAllocatorArena> scope(arena);
+
+    Viewport vp(0, 0, 1920, 1080);
+    mat4f p = mat4f::perspective(90, 16.0f / 9.0f, 0.1, 100, mat4f::Fov::HORIZONTAL);
+
+    Froxelizer froxelData(*engine);
+    froxelData.setOptions(5, 100);
+    froxelData.prepare(engine->getDriverApi(), scope, vp, p, 0.1, 100);
+
+    EXPECT_EQ(8, froxelData.getFroxelCountZ());
+    EXPECT_LE(froxelData.getFroxelCount(), 2048);
+    EXPECT_EQ(2048, froxelData.getFroxelBufferUser().size());
+
+    Entity e = engine->getEntityManager().create();
+    LightManager::Builder(LightManager::Type::POINT).build(*engine, e);
+    LightManager::Instance instance = engine->getLightManager().getInstance(e);
+
+    // as many lights as the engine is configured for, all at the same spot
+    FScene::LightSoa lights;
+    lights.push_back({}, {}, {}, {}, {}, {});   // first one is always skipped
+    for (size_t i = 0; i < config.maxLightCount; i++) {
+        lights.push_back(float4{ 0, 0, -10, 1 }, {}, instance, 1, {}, {});
+    }
+
+    froxelData.froxelizeLights(*engine, {}, lights);
+    auto const& froxelBuffer = froxelData.getFroxelBufferUser();
+    auto const& recordBuffer = froxelData.getRecordBufferUser();
+    size_t froxelCount = 0;
+    for (size_t i = 0, c = froxelData.getFroxelCount(); i < c; i++) {
+        auto const& entry = froxelBuffer[i];
+        if (entry.count) {
+            // every froxel touched by a light is touched by all of them, exactly once
+            EXPECT_EQ(config.maxLightCount, entry.count);
+            uint64_t seen = 0;
+            for (size_t j = 0; j < entry.count; j++) {
+                size_t index = recordBuffer[entry.offset + j];
+                ASSERT_LT(index, config.maxLightCount);
+                seen |= uint64_t(1) << index;
+            }
+            EXPECT_EQ((uint64_t(1) << config.maxLightCount) - 1, seen);
+            froxelCount++;
+        }
+    }
+    EXPECT_GT(froxelCount, 0);
+
+    froxelData.terminate(engine->getDriverApi());
+    engine->destroy(e);
+
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, TextureCache) {
+    using namespace filament;
+    using namespace backend;
+
+    Engine::Config config;
+    config.textureCacheSizeInMB = 1;
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+    ResourceAllocator& allocator = engine->getResourceAllocator();
+    EXPECT_EQ(1u << 20u, allocator.getCacheCapacity());
+
+    // width * 1 KiB
+    auto create = [&allocator](uint32_t width) {
+        return allocator.createTexture("test", SamplerType::SAMPLER_2D, 1,
+                TextureFormat::RGBA8, 1, width, 256, 1,
+                TextureUsage::COLOR_ATTACHMENT | TextureUsage::SAMPLEABLE);
+    };
+
+    allocator.destroyTexture(create(256));
+    Engine::TextureCacheStatistics statistics = engine->getTextureCacheStatistics();
+    EXPECT_EQ(0, statistics.hits);
+    EXPECT_EQ(1, statistics.misses);
+    EXPECT_EQ(1, statistics.cachedCount);
+    EXPECT_EQ(256 * 256 * 4, statistics.cachedBytes);
+
+    TextureHandle h = create(256);
+    statistics = engine->getTextureCacheStatistics();
+    EXPECT_EQ(1, statistics.hits);
+    EXPECT_EQ(0, statistics.cachedCount);
+    EXPECT_EQ(1, statistics.inUseCount);
+    EXPECT_EQ(256 * 256 * 4, statistics.inUseBytes);
+    allocator.destroyTexture(h);
+
+    // over capacity, gc() evicts the least recently used textures first
+    for (uint32_t i = 0; i < 4; i++) {
+        allocator.gc();
+        allocator.destroyTexture(create(384 + i));
+    }
+    allocator.gc();
+    statistics = engine->getTextureCacheStatistics();
+    EXPECT_LE(statistics.cachedBytes, 1u << 20u);
+    EXPECT_EQ(3, statistics.evictions);
+    EXPECT_EQ(2, statistics.cachedCount);
+
+    engine->trimTextureCache(0);
+    statistics = engine->getTextureCacheStatistics();
+    EXPECT_EQ(0, statistics.cachedCount);
+    EXPECT_EQ(0, statistics.cachedBytes);
+    EXPECT_EQ(5, statistics.evictions);
+
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, TextureStreaming) {
+    using namespace filament;
+    using namespace backend;
+
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP);
+    FTexture* texture = upcast(Texture::Builder()
+            .width(256)
+            .height(256)
+            .levels(9)
+            .format(Texture::InternalFormat::RGBA8)
+            .streaming(true)
+            .build(*engine));
+
+    // nothing is resident at first, and the least detailed level is requested
+    EXPECT_TRUE(texture->isStreaming());
+    EXPECT_EQ(9u, texture->getResidentLevel());
+    EXPECT_EQ(8u, texture->getRequestedLevel());
+
+    static uint8_t pixels[256 * 256 * 4] = {};
+    auto upload = [engine, texture](size_t level) {
+        texture->setImage(*engine, level, 0, 0,
+                uint32_t(texture->getWidth(level)), uint32_t(texture->getHeight(level)),
+                Texture::PixelBufferDescriptor(pixels,
+                        texture->getWidth(level) * texture->getHeight(level) * 4,
+                        Texture::Format::RGBA, Texture::Type::UBYTE));
+    };
+    upload(8);
+    EXPECT_EQ(8u, texture->getResidentLevel());
+    EXPECT_EQ(4u, engine->getTextureStreamingResidentSize());
+
+    // levels are uploaded from the least to the most detailed
+    upload(6);
+    EXPECT_EQ(8u, texture->getResidentLevel());
+
+    // sampling the texture across 64 pixels needs level 2
+    TextureStreamer& streamer = engine->getTextureStreamer();
+    streamer.request(texture->getHwHandle(), 1.0f / 64.0f);
+    engine->prepare();
+    EXPECT_EQ(2u, texture->getRequestedLevel());
+    for (size_t level = 7; level >= 2; level--) {
+        upload(level);
+    }
+    EXPECT_EQ(2u, texture->getResidentLevel());
+    size_t size = 0;
+    for (size_t level = 2; level < 9; level++) {
+        size += texture->getWidth(level) * texture->getHeight(level) * 4;
+    }
+    EXPECT_EQ(size, engine->getTextureStreamingResidentSize());
+
+    // over budget, the most detailed level is evicted
+    engine->setTextureStreamingBudget(size - 1);
+    streamer.request(texture->getHwHandle(), 1.0f / 64.0f);
+    engine->prepare();
+    EXPECT_EQ(3u, texture->getRequestedLevel());
+    EXPECT_EQ(3u, texture->getResidentLevel());
+    EXPECT_EQ(size - 64 * 64 * 4, engine->getTextureStreamingResidentSize());
+
+    // a texture that is not sampled keeps its resident levels
+    engine->setTextureStreamingBudget(0);
+    engine->prepare();
+    EXPECT_EQ(3u, texture->getRequestedLevel());
+    EXPECT_EQ(3u, texture->getResidentLevel());
+
+    engine->destroy(texture);
+    EXPECT_EQ(0u, engine->getTextureStreamingResidentSize());
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, CommandBufferConfig) {
+    using namespace filament;
+
+    // the total size is at least twice the guaranteed size
+    Engine::Config config;
+    config.minCommandBufferSizeInMB = 2;
+    config.commandBufferSizeInMB = 3;
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+    EXPECT_EQ(4u, engine->getConfig().commandBufferSizeInMB);
+
+    Engine::CommandBufferStatistics statistics = engine->getCommandBufferStatistics();
+    EXPECT_EQ(2u << 20u, statistics.minSize);
+    EXPECT_EQ(4u << 20u, statistics.size);
+    EXPECT_EQ(0u, statistics.growCount);
+
+    // flushing records some commands
+    engine->flushAndWait();
+    statistics = engine->getCommandBufferStatistics();
+    EXPECT_GT(statistics.highWatermark, 0u);
+    EXPECT_LE(statistics.highWatermark, statistics.size);
+
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, CommandBufferGrowth) {
+    using namespace filament;
+    using backend::CircularBuffer;
+
+    // the guaranteed space doubles, or covers the largest use seen
+    EXPECT_EQ(2u << 20u, FEngine::getGrownCommandBufferSize(1u << 20u, 1u << 20u));
+    EXPECT_EQ(3u << 20u, FEngine::getGrownCommandBufferSize(1u << 20u, 3u << 20u));
+
+    // it's rounded up to whole blocks of the circular buffer
+    const size_t size = FEngine::getGrownCommandBufferSize(1u << 20u, (3u << 20u) + 1u);
+    EXPECT_EQ(0u, size % CircularBuffer::BLOCK_SIZE);
+    EXPECT_EQ((3u << 20u) + CircularBuffer::BLOCK_SIZE, size);
+
+    // it's capped, and never shrinks
+    EXPECT_EQ(FEngine::MAX_GROWN_COMMAND_BUFFER_SIZE,
+            FEngine::getGrownCommandBufferSize(1u << 20u, size_t(1u) << 30u));
+    EXPECT_EQ(FEngine::MAX_GROWN_COMMAND_BUFFER_SIZE, FEngine::getGrownCommandBufferSize(
+            FEngine::MAX_GROWN_COMMAND_BUFFER_SIZE, size_t(1u) << 30u));
+    EXPECT_EQ(size_t(128u) << 20u, FEngine::getGrownCommandBufferSize(128u << 20u, 0u));
+}
+
+TEST(FilamentTest, MaxFramesInFlightConfig) {
+    using namespace filament;
+
+    Engine::Config config;
+    config.maxFramesInFlight = 8;
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+    Engine::Config const& result = engine->getConfig();
+    EXPECT_EQ(4u, result.maxFramesInFlight);
+    // the command buffer holds the commands of each frame in flight, plus the one being recorded
+    EXPECT_EQ(5u * result.minCommandBufferSizeInMB, result.commandBufferSizeInMB);
+    Engine::destroy((Engine **)&engine);
+
+    config.maxFramesInFlight = 0;
+    engine = FEngine::create(Engine::Backend::NOOP, nullptr, nullptr, &config);
+    EXPECT_EQ(1u, engine->getConfig().maxFramesInFlight);
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, MaterialCompile) {
+    using namespace filament;
+
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP);
+    Material* material = const_cast<FMaterial*>(engine->getDefaultMaterial());
+
+    // the callback is called by the engine, once the driver has processed the request
+    bool ready = false;
+    material->compile(UserVariantFilterMask(UserVariantFilterBit::ALL),
+            [](void* user) { *static_cast<bool*>(user) = true; }, &ready);
+    EXPECT_FALSE(ready);
+    engine->flushAndWait();
+    EXPECT_TRUE(ready);
+
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, ProgramCache) {
+    using namespace filament;
+    using backend::Program;
+
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP);
+    FEngine::DriverApi& driver = engine->getDriverApi();
+    ProgramCache cache;
+
+    auto makeProgram = [](const char* fragment, const char* name) {
+        static const char vertex[] = "void main() { }";
+        Program p;
+        p.diagnostics(utils::CString(name))
+                .withVertexShader(vertex, sizeof(vertex))
+                .withFragmentShader(fragment, strlen(fragment) + 1)
+                .setUniformBlock(0, utils::CString("FrameUniforms"));
+        return p;
+    };
+
+    // the name of the material doesn't matter, only the shaders and their bindings do
+    auto a = cache.acquire(driver, makeProgram("void main() { }", "a"));
+    auto b = cache.acquire(driver, makeProgram("void main() { }", "b"));
+    auto c = cache.acquire(driver, makeProgram("void main() { discard; }", "c"));
+    EXPECT_EQ(a, b);
+    EXPECT_NE(a, c);
+    EXPECT_EQ(1u, cache.getStatistics().hits);
+    EXPECT_EQ(2u, cache.getStatistics().misses);
+    EXPECT_EQ(2u, cache.getStatistics().count);
+
+    Program d = makeProgram("void main() { }", "d");
+    d.setUniformBlock(1, utils::CString("ObjectUniforms"));
+    EXPECT_NE(ProgramCache::hash(makeProgram("void main() { }", "a")), ProgramCache::hash(d));
+
+    // specialization constants are part of the program
+    Program e = makeProgram("void main() { }", "e");
+    e.specializationConstants({{ 0, true }});
+    auto f = cache.acquire(driver, std::move(e));
+    EXPECT_NE(a, f);
+    cache.release(driver, f);
+
+    // a shared program is destroyed once all its users have released it
+    cache.release(driver, a);
+    EXPECT_EQ(2u, cache.getStatistics().count);
+    cache.release(driver, b);
+    EXPECT_EQ(1u, cache.getStatistics().count);
+    cache.release(driver, c);
+    EXPECT_EQ(0u, cache.getStatistics().count);
+
+    cache.terminate(driver);
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, HandleAllocator) {
+    using backend::HandleAllocator;
+    using backend::HandleBase;
+
+    struct Small { uint32_t value; };
+    struct Large { uint32_t values[256]; };
+
+    // the first segments hold 64 small objects, more requires growing
+    HandleAllocator allocator("test", 64 * 16 * 16, { 16, 64, 208 });
+    EXPECT_EQ(64u, allocator.getPoolStatistics(0).capacity);
+
+    std::vector<HandleBase::HandleId> ids;
+    for (uint32_t i = 0; i < 200; i++) {
+        HandleBase::HandleId id = allocator.allocate<Small>();
+        EXPECT_NE(HandleBase::nullid, id);
+        new(allocator.handle_cast<Small>(id)) Small{ i };
+        ids.push_back(id);
+    }
+    HandleBase::HandleId large = allocator.allocate<Large>();
+    allocator.handle_cast<Large>(large)->values[255] = 42;
+
+    // objects didn't move when the pool grew
+    for (uint32_t i = 0; i < 200; i++) {
+        EXPECT_EQ(i, allocator.handle_cast<Small>(ids[i])->value);
+    }
+    EXPECT_EQ(42u, allocator.handle_cast<Large>(large)->values[255]);
+
+    HandleAllocator::PoolStatistics stats = allocator.getPoolStatistics(0);
+    EXPECT_EQ(200u, stats.used);
+    EXPECT_EQ(4u, stats.segmentCount);
+    EXPECT_EQ(1u, allocator.getPoolStatistics(HandleAllocator::POOL_COUNT - 1).used);
+
+    for (HandleBase::HandleId id : ids) {
+        allocator.deallocate(id, allocator.handle_cast<Small>(id));
+    }
+    allocator.deallocate(large, allocator.handle_cast<Large>(large));
+    stats = allocator.getPoolStatistics(0);
+    EXPECT_EQ(0u, stats.used);
+    EXPECT_EQ(200u, stats.highWatermark);
+    EXPECT_EQ(0u, allocator.getPoolStatistics(HandleAllocator::POOL_COUNT - 1).used);
+}
+
 TEST(FilamentTest, Bones) {
 
     struct Shader {
@@ -860,6 +1479,90 @@ TEST(FilamentTest, Bones) {
     }
 }
 
+TEST(FilamentTest, LevelsOfDetail) {
+    using namespace filament;
+
+    FEngine* engine = FEngine::create();
+    utils::Entity e = engine->getEntityManager().create();
+
+    RenderableManager::Builder(4)
+            .culling(false)
+            .levelOfDetail(0, 2, 0.5f)
+            .levelOfDetail(1, 1, 0.1f)
+            .levelOfDetail(2, 1, 0.01f)
+            .levelOfDetailHysteresis(0.2f)
+            .build(*engine, e);
+
+    FRenderableManager& rcm = engine->getRenderableManager();
+    auto ri = rcm.getInstance(e);
+    EXPECT_TRUE(rcm.hasLevelsOfDetail(ri));
+    EXPECT_EQ(rcm.getLevelCount(ri), 3);
+    EXPECT_EQ(rcm.getPrimitiveCount(ri), 4);
+    EXPECT_EQ(rcm.getRenderPrimitives(ri, 0).size(), 2);
+    EXPECT_EQ(rcm.getRenderPrimitives(ri, 1).size(), 1);
+    EXPECT_EQ(rcm.getRenderPrimitives(ri, 2).size(), 1);
+    EXPECT_EQ(rcm.getRenderPrimitives(ri, 3).size(), 0);
+    EXPECT_EQ(rcm.getRenderPrimitives(ri, 1).begin(), rcm.getRenderPrimitives(ri).begin() + 2);
+
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 1.0f, 0), 0);
+    // within the hysteresis band, we stay at level 0
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.45f, 0), 0);
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.35f, 0), 1);
+    // and now we stay at level 1
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.55f, 1), 1);
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.65f, 1), 0);
+    // the same coverage selects a different level depending on the level selected last
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.45f, 1), 1);
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.45f, 0), 0);
+    // below the last level's coverage, the renderable isn't drawn
+    EXPECT_EQ(rcm.selectLevelOfDetail(ri, 0.001f, 0), 3);
+
+    // levels must cover all the primitives
+    utils::Entity e2 = engine->getEntityManager().create();
+    auto result = RenderableManager::Builder(4)
+            .culling(false)
+            .levelOfDetail(0, 2, 0.5f)
+            .levelOfDetail(1, 1, 0.1f)
+            .build(*engine, e2);
+    EXPECT_EQ(result, RenderableManager::Builder::Error);
+
+    rcm.destroy(e);
+    engine->getEntityManager().destroy(e);
+    engine->getEntityManager().destroy(e2);
+    Engine::destroy((Engine **)&engine);
+}
+
+TEST(FilamentTest, RenderableInstances) {
+    using namespace filament;
+
+    FEngine* engine = FEngine::create(Engine::Backend::NOOP);
+    FRenderableManager& rcm = engine->getRenderableManager();
+    utils::EntityManager& em = engine->getEntityManager();
+    utils::Entity e1 = em.create();
+    utils::Entity e2 = em.create();
+    utils::Entity e3 = em.create();
+
+    // renderables are drawn once by default
+    RenderableManager::Builder(1).culling(false).build(*engine, e1);
+    EXPECT_EQ(rcm.getInstanceCount(rcm.getInstance(e1)), 1);
+
+    // the count is given as is to the draw calls
+    RenderableManager::Builder(1).culling(false).instances(8).build(*engine, e2);
+    EXPECT_EQ(rcm.getInstanceCount(rcm.getInstance(e2)), 8);
+
+    // a renderable is drawn at least once
+    auto result = RenderableManager::Builder(1).culling(false).instances(0).build(*engine, e3);
+    EXPECT_EQ(result, RenderableManager::Builder::Error);
+    EXPECT_FALSE(rcm.hasComponent(e3));
+
+    rcm.destroy(e1);
+    rcm.destroy(e2);
+    em.destroy(e1);
+    em.destroy(e2);
+    em.destroy(e3);
+    Engine::destroy((Engine **)&engine);
+}
+
 TEST(FilamentTest, GoogleLineDirective) {
     {
         char s[512] = "#line 10 \"foobar\"";
@@ -905,6 +1608,50 @@ TEST(FilamentTest, GoogleLineDirective) {
     }
 }
 
+TEST(FilamentTest, VertexBufferDepthAttributes) {
+    using namespace filament;
+    using AttributeType = VertexBuffer::AttributeType;
+
+    FEngine* engine = FEngine::create();
+
+    // positions and bones apart from the UVs, depth passes fetch them alone
+    FVertexBuffer* separate = upcast(VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(3)
+            .attribute(VertexAttribute::POSITION, 0, AttributeType::FLOAT3)
+            .attribute(VertexAttribute::BONE_INDICES, 1, AttributeType::USHORT4)
+            .attribute(VertexAttribute::BONE_WEIGHTS, 1, AttributeType::FLOAT4, 8, 24)
+            .attribute(VertexAttribute::UV0, 2, AttributeType::FLOAT2)
+            .build(*engine));
+    AttributeBitset expected;
+    expected.set(VertexAttribute::POSITION);
+    expected.set(VertexAttribute::BONE_INDICES);
+    expected.set(VertexAttribute::BONE_WEIGHTS);
+    EXPECT_EQ(separate->getDepthAttributes(), expected);
+
+    // interleaved positions and UVs
+    FVertexBuffer* interleaved = upcast(VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, AttributeType::FLOAT3, 0, 20)
+            .attribute(VertexAttribute::UV0, 0, AttributeType::FLOAT2, 12, 20)
+            .build(*engine));
+    EXPECT_TRUE(interleaved->getDepthAttributes().none());
+
+    // positions only, the depth primitive would be the same
+    FVertexBuffer* positions = upcast(VertexBuffer::Builder()
+            .vertexCount(3)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, AttributeType::FLOAT3)
+            .build(*engine));
+    EXPECT_TRUE(positions->getDepthAttributes().none());
+
+    engine->destroy(separate);
+    engine->destroy(interleaved);
+    engine->destroy(positions);
+    Engine::destroy((Engine **)&engine);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -17,10 +17,14 @@
 #include <fstream>
 #include <iostream>
 
+#include <string.h>
+
 #include <gtest/gtest.h>
 
 #include "MaterialParser.h"
 
+#include <filaflat/ShaderBuilder.h>
+
 #include "filament_test_resources.h"
 
 using namespace filament;
@@ -41,6 +45,37 @@ TEST(MaterialParser, Parse) {
             "See instructions in filament_test_material_parser.cpp" << std::endl;
 }
 
+// A package used in place must give the same shaders as a copied one.
+TEST(MaterialParser, ParseWithoutCopy) {
+    MaterialParser copied(backend::Backend::OPENGL,
+            FILAMENT_TEST_RESOURCES_TEST_MATERIAL_DATA, FILAMENT_TEST_RESOURCES_TEST_MATERIAL_SIZE);
+    MaterialParser inPlace(backend::Backend::OPENGL,
+            FILAMENT_TEST_RESOURCES_TEST_MATERIAL_DATA, FILAMENT_TEST_RESOURCES_TEST_MATERIAL_SIZE,
+            false);
+    ASSERT_TRUE(copied.parse() == MaterialParser::ParseResult::SUCCESS);
+    ASSERT_TRUE(inPlace.parse() == MaterialParser::ParseResult::SUCCESS);
+
+    size_t shaderCount = 0;
+    filaflat::ShaderBuilder copiedShader;
+    filaflat::ShaderBuilder inPlaceShader;
+    for (auto shaderModel : { backend::ShaderModel::GL_ES_30, backend::ShaderModel::GL_CORE_41 }) {
+        for (size_t variant = 0; variant < 256; variant++) {
+            for (auto stage : { backend::ShaderType::VERTEX, backend::ShaderType::FRAGMENT }) {
+                if (!copied.hasShader(shaderModel, uint8_t(variant), stage)) {
+                    continue;
+                }
+                ASSERT_TRUE(copied.getShader(copiedShader, shaderModel, uint8_t(variant), stage));
+                ASSERT_TRUE(inPlace.getShader(inPlaceShader, shaderModel, uint8_t(variant), stage));
+                ASSERT_EQ(copiedShader.size(), inPlaceShader.size());
+                EXPECT_EQ(0, memcmp(copiedShader.data(), inPlaceShader.data(),
+                        copiedShader.size()));
+                shaderCount++;
+            }
+        }
+    }
+    EXPECT_GT(shaderCount, 0u);
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -82,6 +82,17 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
     DictionarySpirv = charTo64bitNum("DIC_SPIR"),
 };
 
+// Compression schemes of the dictionary chunks.
+enum class DictionaryCompression : uint32_t {
+    NONE = 0,           // text dictionaries only
+    SMOLV = 1,          // SPIR-V dictionaries only, each blob is smol-v encoded
+    DEFLATE = 2,        // zlib; for SPIR-V dictionaries, each blob is smol-v encoded then deflated
+};
+
+// A text dictionary is uncompressed unless it starts with this instead of its line count, in
+// which case the compression scheme follows.
+static constexpr uint32_t DICTIONARY_TEXT_COMPRESSED = 0xffffffff;
+
 } // namespace filamat
 
 #endif // TNT_FILAMAT_MATERIAL_CHUNK_TYPES_H
@@ -27,7 +27,7 @@
 namespace filament {
 
 // update this when a new version of filament wouldn't work with older materials
-static constexpr size_t MATERIAL_VERSION = 10;
+static constexpr size_t MATERIAL_VERSION = 14;
 
 /**
  * Supported shading models
@@ -210,6 +210,22 @@ enum class Property : uint8_t {
     // when adding new Properties, make sure to update MATERIAL_PROPERTIES_COUNT
 };
 
+/**
+ * Features that select the variant of a material's program, see Material::compile().
+ */
+enum class UserVariantFilterBit : uint8_t {
+    DIRECTIONAL_LIGHTING = 0x01,    //!< a directional light is present
+    DYNAMIC_LIGHTING     = 0x02,    //!< point, spot or area lights are present
+    SHADOW_RECEIVER      = 0x04,    //!< the renderable receives shadows
+    SKINNING             = 0x08,    //!< the renderable is skinned or morphed
+    FOG                  = 0x20,    //!< fog is enabled
+    VSM                  = 0x40,    //!< shadows use variance shadow maps
+    ALL                  = 0x6F,
+};
+
+//! A combination of UserVariantFilterBit values.
+using UserVariantFilterMask = uint8_t;
+
 } // namespace filament
 
 #endif
@@ -62,6 +62,12 @@ constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
 // We store 64 bytes per bone.
 constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
 
+// The maximum number of instances of an instanced renderable.
+constexpr size_t CONFIG_MAX_INSTANCES = 65535;
+
+// The maximum number of levels of detail of a renderable.
+constexpr size_t CONFIG_MAX_LOD_COUNT = 8;
+
 } // namespace filament
 
 #endif // TNT_FILAMENT_driver/EngineEnums.h
@@ -22,6 +22,8 @@
 
 #include <private/filament/EngineEnums.h>
 
+#include <stddef.h>
+
 namespace filament {
 
 class UniformInterfaceBlock;
@@ -126,7 +128,8 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
     float aoReserved3;
 
     math::float2 clipControl;
-    math::float2 padding1;
+    float lodBias;                    // LOD bias of the materials' textures, e.g. with TAA upscaling
+    float oitEnabled;                 // !0: transparent materials output weighted-blended OIT
 
     // bring PerViewUib to 2 KiB
     filament::math::float4 padding2[60];
@@ -136,7 +139,10 @@ struct PerViewUib { // NOLINT(cppcoreguidelines-pro-type-member-init)
 static_assert(sizeof(PerViewUib) == sizeof(filament::math::float4) * 128,
         "PerViewUib should be exactly 2KiB");
 
-// PerRenderableUib must have an alignment of 256 to be compatible with all versions of GLES.
+// PerRenderableUib has an alignment of 256 to be compatible with all versions of GLES. However,
+// only its first PER_RENDERABLE_UIB_DATA_SIZE bytes are used by the shaders, so the renderables'
+// slots are only PER_RENDERABLE_UIB_DATA_SIZE bytes rounded up to the uniform buffer offset
+// alignment of the driver apart, see FEngine::getPerRenderableUboStride().
 struct alignas(256) PerRenderableUib {
     filament::math::mat4f worldFromModelMatrix;
     filament::math::mat3f worldFromModelNormalMatrix; // this gets expanded to 48 bytes during the copy to the UBO
@@ -145,9 +151,13 @@ struct alignas(256) PerRenderableUib {
     int32_t skinningEnabled; // 0=disabled, 1=enabled, ignored unless variant & SKINNING_OR_MORPHING
     int32_t morphingEnabled; // 0=disabled, 1=enabled, ignored unless variant & SKINNING_OR_MORPHING
     uint32_t screenSpaceContactShadows; // 0=disabled, 1=enabled, ignored unless variant & SKINNING_OR_MORPHING
-    float padding0;
+    uint32_t objectId;  // entity id of the renderable, written by the picking variants
 };
 
+// size of the std140 block the shaders declare for PerRenderableUib
+static constexpr size_t PER_RENDERABLE_UIB_DATA_SIZE = offsetof(PerRenderableUib, objectId) + 4;
+static_assert(PER_RENDERABLE_UIB_DATA_SIZE == 144, "PerRenderableUib layout changed");
+
 struct LightsUib {
     static const UniformInterfaceBlock& getUib() noexcept {
         return UibGenerator::getLightsUib();
@@ -107,7 +107,8 @@ UniformInterfaceBlock const& UibGenerator::getPerViewUib() noexcept  {
             .add("aoReserved3",             1, UniformInterfaceBlock::Type::FLOAT)
 
             .add("clipControl",             1, UniformInterfaceBlock::Type::FLOAT2)
-            .add("padding1",                1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("lodBias",                 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("oitEnabled",              1, UniformInterfaceBlock::Type::FLOAT)
 
             // bring PerViewUib to 2 KiB
             .add("padding2", 60, UniformInterfaceBlock::Type::FLOAT4)
@@ -124,7 +125,7 @@ UniformInterfaceBlock const& UibGenerator::getPerRenderableUib() noexcept {
             .add("skinningEnabled", 1, UniformInterfaceBlock::Type::INT)
             .add("morphingEnabled", 1, UniformInterfaceBlock::Type::INT)
             .add("screenSpaceContactShadows", 1, UniformInterfaceBlock::Type::UINT)
-            .add("padding0", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("objectId", 1, UniformInterfaceBlock::Type::UINT, Precision::HIGH)
             .build();
     return uib;
 }
@@ -17,6 +17,8 @@
 #ifndef TNT_FILAFLAT_BLOBDICTIONARY_H
 #define TNT_FILAFLAT_BLOBDICTIONARY_H
 
+#include <utils/compiler.h>
+
 #include <cstdint>
 #include <vector>
 
@@ -25,6 +27,9 @@
 namespace filaflat {
 
 // Flat list of blobs that can be referenced by index.
+// Blobs are either owned by the dictionary, or reference memory that outlives it, such as the
+// material package. Encoded blobs are decoded the first time they are requested, which makes
+// getBlob() and getString() not thread-safe.
 class BlobDictionary {
 public:
     BlobDictionary() = default;
@@ -32,12 +37,26 @@ public:
 
     using Blob = std::vector<uint8_t>;
 
+    // Decodes an encoded blob into 'blob', returns false if the data couldn't be decoded.
+    using Decoder = bool(*)(const char* data, size_t size, Blob* blob);
+
     inline void addBlob(const char* blob, size_t len) noexcept {
-        mBlobs.emplace_back(blob, blob + len);
+        addBlob(Blob(blob, blob + len));
     }
 
     inline void addBlob(Blob&& blob) noexcept {
-        mBlobs.push_back(std::move(blob));
+        mBlobs.push_back({ nullptr, 0, nullptr, std::move(blob) });
+    }
+
+    // Adds a blob without copying it, 'blob' must outlive the dictionary.
+    inline void addReference(const char* blob, size_t len) noexcept {
+        mBlobs.push_back({ blob, len, nullptr, {} });
+    }
+
+    // Adds an encoded blob without copying it, it is decoded by 'decoder' when it's first
+    // requested. 'blob' must outlive the dictionary.
+    inline void addEncodedBlob(const char* blob, size_t len, Decoder decoder) noexcept {
+        mBlobs.push_back({ blob, len, decoder, {} });
     }
 
     inline bool isEmpty() const noexcept {
@@ -48,13 +67,28 @@ public:
         mBlobs.reserve(size);
     }
 
+    // Returns nullptr if the blob couldn't be decoded.
     inline const char* getBlob(size_t index, size_t* size) const noexcept {
-        *size = mBlobs[index].size();
-        return (const char*) mBlobs[index].data();
+        Entry& entry = mBlobs[index];
+        if (UTILS_UNLIKELY(entry.decoder)) {
+            if (!entry.decoder(entry.data, entry.size, &entry.blob)) {
+                *size = 0;
+                return nullptr;
+            }
+            entry.data = nullptr;
+            entry.decoder = nullptr;
+        }
+        if (entry.data) {
+            *size = entry.size;
+            return entry.data;
+        }
+        *size = entry.blob.size();
+        return (const char*) entry.blob.data();
     }
 
     inline const char* getString(size_t index) const noexcept {
-        return (const char*) mBlobs[index].data();
+        size_t size;
+        return getBlob(index, &size);
     }
 
     inline size_t size() const noexcept {
@@ -62,7 +96,13 @@ public:
     }
 
 private:
-    std::vector<Blob> mBlobs;
+    struct Entry {
+        const char* data;   // referenced or encoded blob, nullptr if the blob is owned
+        size_t size;
+        Decoder decoder;    // set until an encoded blob is decoded
+        Blob blob;          // owned or decoded blob
+    };
+    mutable std::vector<Entry> mBlobs;
 };
 
 } // namespace filaflat
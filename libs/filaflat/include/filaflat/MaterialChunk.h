@@ -42,6 +42,9 @@ public:
             BlobDictionary const& dictionary,
             uint8_t shaderModel, uint8_t variant, uint8_t stage);
 
+    // returns whether the material has a shader for this shader model, variant and stage
+    bool hasShader(uint8_t shaderModel, uint8_t variant, uint8_t stage) const noexcept;
+
 private:
     ChunkContainer const& mContainer;
     filamat::ChunkType mMaterialTag = filamat::ChunkType::Unknown;
@@ -24,12 +24,68 @@
 #include <smolv.h>
 #endif
 
+#include <zlib.h>
+
 #include <assert.h>
+#include <string.h>
 
 using namespace filamat;
 
 namespace filaflat {
 
+// Decompresses a deflated blob of a known size.
+static bool decompressDeflate(const char* compressed, size_t compressedSize,
+        uint8_t* data, size_t size) {
+    uLongf decompressedSize = uLongf(size);
+    return uncompress(data, &decompressedSize, (const Bytef*) compressed,
+            uLong(compressedSize)) == Z_OK && decompressedSize == size;
+}
+
+#if defined (FILAMENT_DRIVER_SUPPORTS_VULKAN)
+static bool decodeSpirv(const char* compressed, size_t compressedSize,
+        BlobDictionary::Blob* spirv) {
+    spirv->resize(smolv::GetDecodedBufferSize(compressed, compressedSize));
+    return smolv::Decode(compressed, compressedSize, spirv->data(), spirv->size());
+}
+
+// The deflated blobs start with the size of their smol-v encoding.
+static bool decodeDeflatedSpirv(const char* compressed, size_t compressedSize,
+        BlobDictionary::Blob* spirv) {
+    if (compressedSize < sizeof(uint32_t)) {
+        return false;
+    }
+    const uint8_t* header = (const uint8_t*) compressed;
+    const uint32_t encodedSize = header[0] | (header[1] << 8) | (header[2] << 16) |
+            (uint32_t(header[3]) << 24);
+    BlobDictionary::Blob encoded(encodedSize);
+    if (!decompressDeflate(compressed + sizeof(uint32_t), compressedSize - sizeof(uint32_t),
+            encoded.data(), encoded.size())) {
+        return false;
+    }
+    return decodeSpirv((const char*) encoded.data(), encoded.size(), spirv);
+}
+#endif
+
+static bool unflattenLines(Unflattener& unflattener, uint32_t stringCount,
+        BlobDictionary& dictionary, bool copy) {
+    dictionary.reserve(stringCount);
+    for (uint32_t i = 0; i < stringCount; i++) {
+        const char* str;
+        if (!unflattener.read(&str)) {
+            return false;
+        }
+        // BlobDictionary hold binary chunks and does not care if the data holds text, it is
+        // therefore crucial to include the trailing null. Unless copied, the strings are
+        // referenced in place and must outlive the dictionary.
+        if (copy) {
+            dictionary.addBlob(str, strlen(str) + 1);
+        } else {
+            dictionary.addReference(str, strlen(str) + 1);
+        }
+    }
+    return true;
+}
+
 bool DictionaryReader::unflatten(ChunkContainer const& container,
         ChunkContainer::Type dictionaryTag,
         BlobDictionary& dictionary) {
@@ -43,9 +99,10 @@ bool DictionaryReader::unflatten(ChunkContainer const& container,
         if (!unflattener.read(&compressionScheme)) {
             return false;
         }
-        // For now, 1 is the only acceptable compression scheme.
-        assert(compressionScheme == 1);
-
+        if (compressionScheme != uint32_t(DictionaryCompression::SMOLV) &&
+                compressionScheme != uint32_t(DictionaryCompression::DEFLATE)) {
+            return false;
+        }
 
         uint32_t blobCount;
         if (!unflattener.read(&blobCount)) {
@@ -61,15 +118,16 @@ bool DictionaryReader::unflatten(ChunkContainer const& container,
             }
 
 #if defined (FILAMENT_DRIVER_SUPPORTS_VULKAN)
-            size_t spirvSize = smolv::GetDecodedBufferSize(compressed, compressedSize);
-            if (spirvSize == 0) {
-                return false;
+            // The blobs are only decoded when a shader that uses them is requested.
+            if (compressionScheme == uint32_t(DictionaryCompression::DEFLATE)) {
+                dictionary.addEncodedBlob(compressed, compressedSize, &decodeDeflatedSpirv);
+                continue;
             }
-            BlobDictionary::Blob spirv(spirvSize);
-            if (!smolv::Decode(compressed, compressedSize, spirv.data(), spirvSize)) {
+            // checking the header here is cheap
+            if (smolv::GetDecodedBufferSize(compressed, compressedSize) == 0) {
                 return false;
             }
-            dictionary.addBlob(std::move(spirv));
+            dictionary.addEncodedBlob(compressed, compressedSize, &decodeSpirv);
 #else
             return false;
 #endif
@@ -82,17 +140,28 @@ bool DictionaryReader::unflatten(ChunkContainer const& container,
             return false;
         }
 
-        dictionary.reserve(stringCount);
-        for (uint32_t i = 0; i < stringCount; i++) {
-            const char* str;
-            if (!unflattener.read(&str)) {
-                return false;
-            }
-            // BlobDictionary hold binary chunks and does not care if the data holds text, it is
-            // therefore crucial to include the trailing null.
-            dictionary.addBlob(str, strlen(str) + 1);
+        if (stringCount != DICTIONARY_TEXT_COMPRESSED) {
+            return unflattenLines(unflattener, stringCount, dictionary, false);
         }
-        return true;
+
+        // All the lines are needed by any text shader, so the dictionary is decompressed
+        // right away.
+        uint32_t compressionScheme;
+        uint64_t size;
+        const char* compressed;
+        size_t compressedSize;
+        if (!unflattener.read(&compressionScheme) ||
+                compressionScheme != uint32_t(DictionaryCompression::DEFLATE) ||
+                !unflattener.read(&size) || !unflattener.read(&compressed, &compressedSize)) {
+            return false;
+        }
+        std::vector<uint8_t> lines(size);
+        if (!decompressDeflate(compressed, compressedSize, lines.data(), lines.size())) {
+            return false;
+        }
+        Unflattener linesUnflattener(lines.data(), lines.data() + lines.size());
+        return linesUnflattener.read(&stringCount) &&
+                unflattenLines(linesUnflattener, stringCount, dictionary, true);
     }
 
     return false;
@@ -152,6 +152,9 @@ bool MaterialChunk::getSpirvShader(BlobDictionary const& dictionary,
     size_t index = pos->second;
     size_t shaderSize;
     const char* shaderContent = dictionary.getBlob(index, &shaderSize);
+    if (!shaderContent) {
+        return false;
+    }
 
     shaderBuilder.reset();
     shaderBuilder.announce(shaderSize);
@@ -159,6 +162,10 @@ bool MaterialChunk::getSpirvShader(BlobDictionary const& dictionary,
     return true;
 }
 
+bool MaterialChunk::hasShader(uint8_t shaderModel, uint8_t variant, uint8_t stage) const noexcept {
+    return mOffsets.find(makeKey(shaderModel, variant, stage)) != mOffsets.end();
+}
+
 bool MaterialChunk::getShader(ShaderBuilder& shaderBuilder,
         BlobDictionary const& dictionary, uint8_t shaderModel, uint8_t variant, uint8_t stage) {
     switch (mMaterialTag) {
@@ -38,6 +38,10 @@
 #include <utils/compiler.h>
 #include <utils/CString.h>
 
+namespace utils {
+class JobSystem;
+}
+
 namespace filamat {
 
 struct MaterialInfo;
@@ -100,6 +104,7 @@ protected:
     Optimization mOptimization = Optimization::PERFORMANCE;
     bool mPrintShaders = false;
     bool mGenerateDebugInfo = false;
+    bool mCompressShaders = false;
     utils::bitset32 mShaderModels;
     struct CodeGenParams {
         int shaderModel;
@@ -192,6 +197,7 @@ public:
     using SubpassType = filament::backend::SubpassType;
     using SamplerFormat = filament::backend::SamplerFormat;
     using SamplerPrecision = filament::backend::Precision;
+    using VariablePrecision = filament::backend::Precision;
     using CullingMode = filament::backend::CullingMode;
 
     enum class VariableQualifier : uint8_t {
@@ -256,6 +262,13 @@ public:
     //! Custom variables (all float4).
     MaterialBuilder& variable(Variable v, const char* name) noexcept;
 
+    /**
+     * Custom variable interpolated with the given precision in the fragment shader. With the
+     * DEFAULT precision, variables are highp unless fragmentMediumPrecision() is enabled. Large
+     * texture coordinates or positions should be declared HIGH.
+     */
+    MaterialBuilder& variable(Variable v, const char* name, VariablePrecision precision) noexcept;
+
     /**
      * Require a specified attribute.
      *
@@ -418,6 +431,15 @@ public:
     //! Enable / disable flipping of the Y coordinate of UV attributes, enabled by default.
     MaterialBuilder& flipUV(bool flipUV) noexcept;
 
+    /**
+     * Enable / disable mediump as the default precision of the fragment shaders, disabled by
+     * default. The fragment shaders of GL_ES_30 are already mediump by default; this extends it
+     * to every shader model and interpolates the custom variables in mediump unless their
+     * precision is given, which doubles the arithmetic throughput of GPUs with fp16 ALUs.
+     * Texture lookups done with mediump coordinates are reported as warnings.
+     */
+    MaterialBuilder& fragmentMediumPrecision(bool fragmentMediumPrecision) noexcept;
+
     //! Enable / disable multi-bounce ambient occlusion, disabled by default on mobile.
     MaterialBuilder& multiBounceAmbientOcclusion(bool multiBounceAO) noexcept;
 
@@ -462,9 +484,29 @@ public:
     //! If true, will include debugging information in generated SPIRV.
     MaterialBuilder& generateDebugInfo(bool generateDebugInfo) noexcept;
 
+    /**
+     * If true, the shader dictionaries of the package are compressed with deflate, which makes
+     * the package smaller. The SPIR-V shaders are decompressed when they're first needed.
+     */
+    MaterialBuilder& compressShaders(bool compressShaders) noexcept;
+
+    /**
+     * Sets a directory where the compiled shaders are cached across builds, created if needed.
+     * A shader is only compiled again when its generated code or its compilation options change,
+     * the directory can be shared by concurrent builds. Ignored by filamat_lite.
+     */
+    MaterialBuilder& shaderCacheDirectory(const char* directory) noexcept;
+
     //! Specifies a list of variants that should be filtered out during code generation.
     MaterialBuilder& variantFilter(uint8_t variantFilter) noexcept;
 
+    /**
+     * Only generates the shaders needed by the given variant keys, such as the variants recorded
+     * at runtime by Engine::getVariantProfile(). The other variants can't be rendered with the
+     * material. All the variants are generated by default, or if count is 0.
+     */
+    MaterialBuilder& variants(const uint8_t* variantKeys, size_t count) noexcept;
+
     //! Adds a new preprocessor macro definition to the shader code. Can be called repeatedly.
     MaterialBuilder& shaderDefine(const char* name, const char* value) noexcept;
 
@@ -478,6 +520,13 @@ public:
     //! Build the material.
     Package build() noexcept;
 
+    /**
+     * Build the material, compiling the shaders of all its variants in parallel on the given
+     * JobSystem. The calling thread must have been adopted by the JobSystem. The package is the
+     * same as the one build() produces.
+     */
+    Package build(utils::JobSystem& jobSystem) noexcept;
+
 public:
     // The methods and types below are for internal use
     /// @cond never
@@ -547,6 +596,7 @@ public:
 
     using PropertyList = bool[MATERIAL_PROPERTIES_COUNT];
     using VariableList = utils::CString[MATERIAL_VARIABLES_COUNT];
+    using VariablePrecisionList = VariablePrecision[MATERIAL_VARIABLES_COUNT];
     using OutputList = std::vector<Output>;
 
     static constexpr size_t MAX_COLOR_OUTPUT = filament::backend::MRT::TARGET_COUNT;
@@ -575,11 +625,15 @@ public:
 
     uint8_t getVariantFilter() const { return mVariantFilter; }
 
+    const utils::CString& getMaterialName() const noexcept { return mMaterialName; }
+
     /// @endcond
 
 private:
     void prepareToBuild(MaterialInfo& info) noexcept;
 
+    Package buildPackage(utils::JobSystem* jobSystem) noexcept;
+
     // Return true if the shader is syntactically and semantically valid.
     // This method finds all the properties defined in the fragment and
     // vertex shaders of the material.
@@ -595,8 +649,8 @@ private:
     void writeCommonChunks(ChunkContainer& container, MaterialInfo& info) const noexcept;
     void writeSurfaceChunks(ChunkContainer& container) const noexcept;
 
-    bool generateShaders(const std::vector<Variant>& variants, ChunkContainer& container,
-            const MaterialInfo& info) const noexcept;
+    bool generateShaders(utils::JobSystem* jobSystem, const std::vector<Variant>& variants,
+            ChunkContainer& container, const MaterialInfo& info) const noexcept;
 
     bool isLit() const noexcept { return mShading != filament::Shading::UNLIT; }
 
@@ -635,6 +689,9 @@ private:
     PropertyList mProperties;
     ParameterList mParameters;
     VariableList mVariables;
+    VariablePrecisionList mVariablePrecisions = {
+            VariablePrecision::DEFAULT, VariablePrecision::DEFAULT,
+            VariablePrecision::DEFAULT, VariablePrecision::DEFAULT };
     OutputList mOutputs;
 
     BlendingMode mBlendingMode = BlendingMode::OPAQUE;
@@ -670,6 +727,8 @@ private:
 
     bool mFlipUV = true;
 
+    bool mFragmentMediumPrecision = false;
+
     bool mMultiBounceAO = false;
     bool mMultiBounceAOSet = false;
 
@@ -678,6 +737,10 @@ private:
 
     bool mEnableFramebufferFetch = false;
 
+    utils::CString mShaderCacheDirectory;
+    // one bit per variant key, none set if all the variants are generated
+    utils::bitset<uint64_t, 2> mVariants;
+
     PreprocessorDefineList mDefines;
 };
 
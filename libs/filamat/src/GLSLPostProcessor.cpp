@@ -16,7 +16,12 @@
 
 #include "GLSLPostProcessor.h"
 
+#include "ShaderCache.h"
+
+#include <mutex>
 #include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <GlslangToSpv.h>
@@ -29,6 +34,7 @@
 #include "sca/builtinResource.h"
 #include "sca/GLSLTools.h"
 
+#include <utils/Hash.h>
 #include <utils/Log.h>
 
 using namespace glslang;
@@ -37,10 +43,12 @@ using namespace spvtools;
 
 namespace filamat {
 
-GLSLPostProcessor::GLSLPostProcessor(MaterialBuilder::Optimization optimization, uint32_t flags)
+GLSLPostProcessor::GLSLPostProcessor(MaterialBuilder::Optimization optimization, uint32_t flags,
+        ShaderCache const* cache)
         : mOptimization(optimization),
           mPrintShaders(flags & PRINT_SHADERS),
-          mGenerateDebugInfo(flags & GENERATE_DEBUG_INFO) {
+          mGenerateDebugInfo(flags & GENERATE_DEBUG_INFO),
+          mCache(cache) {
 }
 
 GLSLPostProcessor::~GLSLPostProcessor() {
@@ -227,6 +235,7 @@ bool GLSLPostProcessor::process(const std::string& inputShader, Config const& co
                 SpvOptions options;
                 options.generateDebugInfo = mGenerateDebugInfo;
                 GlslangToSpv(*program.getIntermediate(mShLang), *mSpirvOutput, &options);
+                validateMediumPrecision(*mSpirvOutput, config);
                 if (mMslOutput) {
                     SpvToMsl(mSpirvOutput, mMslOutput, config);
                 }
@@ -292,6 +301,7 @@ void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
             SpvOptions options;
             options.generateDebugInfo = mGenerateDebugInfo;
             GlslangToSpv(*program.getIntermediate(mShLang), *mSpirvOutput, &options);
+            validateMediumPrecision(*mSpirvOutput, config);
         }
     }
 
@@ -304,6 +314,72 @@ void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
     }
 }
 
+// Outputs of the optimizations done by this process, shared by all the post-processors (each
+// shader gets its own). The entries are found by the hash of their key and contain the key
+// itself, so that a collision of the hashes is a miss. The cache is emptied when it grows too
+// large, for long-running processes.
+// The text is the MSL output and the GLSL output separated by a null character.
+struct OptimizedOutputs {
+    std::string key;
+    std::string text;
+    SpirvBlob spirv;
+};
+static constexpr size_t MAX_OPTIMIZED_OUTPUTS_COUNT = 4096;
+static std::mutex sOptimizedOutputsLock;
+static std::unordered_map<uint64_t, OptimizedOutputs> sOptimizedOutputs;
+
+std::string GLSLPostProcessor::getOptimizationKey(SpirvBlob const& spirv,
+        Config const& config) const {
+    // The module already depends on the shader and on the debug info option, the key adds the
+    // options of the optimization and of the cross-compilation.
+    std::string key = "spirv-opt optimization=" + std::to_string(int(mOptimization)) +
+            " stage=" + std::to_string(int(config.shaderType)) +
+            " model=" + std::to_string(int(config.shaderModel)) +
+            " outputs=" + std::to_string(int(mGlslOutput != nullptr)) +
+            std::to_string(int(mSpirvOutput != nullptr)) +
+            std::to_string(int(mMslOutput != nullptr)) + " fbfetch=";
+    for (auto const& location : config.glsl.subpassInputToColorLocation) {
+        key += std::to_string(location.first) + ":" + std::to_string(location.second) + ",";
+    }
+    key += "\n";
+    key.append(reinterpret_cast<const char*>(spirv.data()), spirv.size() * sizeof(uint32_t));
+    return key;
+}
+
+bool GLSLPostProcessor::getOptimizedOutputs(std::string const& key, std::string* text,
+        SpirvBlob* spirv) const {
+    const uint64_t hash = utils::hash::fnv1a64(key.data(), key.size());
+    {
+        std::lock_guard<std::mutex> lock(sOptimizedOutputsLock);
+        auto pos = sOptimizedOutputs.find(hash);
+        if (pos != sOptimizedOutputs.end() && pos->second.key == key) {
+            *text = pos->second.text;
+            *spirv = pos->second.spirv;
+            return true;
+        }
+    }
+    if (mCache && mCache->get(key, text, spirv)) {
+        std::lock_guard<std::mutex> lock(sOptimizedOutputsLock);
+        sOptimizedOutputs[hash] = { key, *text, *spirv };
+        return true;
+    }
+    return false;
+}
+
+void GLSLPostProcessor::putOptimizedOutputs(std::string const& key, std::string const& text,
+        SpirvBlob const& spirv) const {
+    {
+        std::lock_guard<std::mutex> lock(sOptimizedOutputsLock);
+        if (sOptimizedOutputs.size() >= MAX_OPTIMIZED_OUTPUTS_COUNT) {
+            sOptimizedOutputs.clear();
+        }
+        sOptimizedOutputs[utils::hash::fnv1a64(key.data(), key.size())] = { key, text, spirv };
+    }
+    if (mCache) {
+        mCache->put(key, text, spirv);
+    }
+}
+
 void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         GLSLPostProcessor::Config const& config) const {
     SpirvBlob spirv;
@@ -312,6 +388,25 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
     SpvOptions options;
     options.generateDebugInfo = mGenerateDebugInfo;
     GlslangToSpv(*tShader.getIntermediate(), spirv, &options);
+    validateMediumPrecision(spirv, config);
+
+    // Many variants compile to the same module, e.g. when a define doesn't change the code of
+    // a shader, their optimization and cross-compilation is only done once.
+    const std::string key = getOptimizationKey(spirv, config);
+    std::string text;
+    if (getOptimizedOutputs(key, &text, &spirv)) {
+        const size_t separator = text.find('\0');
+        if (mSpirvOutput) {
+            *mSpirvOutput = std::move(spirv);
+        }
+        if (mMslOutput) {
+            *mMslOutput = text.substr(0, separator);
+        }
+        if (mGlslOutput && separator != std::string::npos) {
+            *mGlslOutput = text.substr(separator + 1);
+        }
+        return;
+    }
 
     // Run the SPIR-V optimizer
     OptimizerPtr optimizer = createOptimizer(mOptimization, config);
@@ -347,6 +442,50 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
 
         *mGlslOutput = glslCompiler.compile();
     }
+
+    text = mMslOutput ? *mMslOutput : std::string();
+    text += '\0';
+    if (mGlslOutput) {
+        text += *mGlslOutput;
+    }
+    putOptimizedOutputs(key, text, mSpirvOutput ? *mSpirvOutput : SpirvBlob());
+}
+
+void GLSLPostProcessor::validateMediumPrecision(SpirvBlob const& spirv, Config const& config) {
+    if (!config.checkMediumPrecision || config.shaderType != filament::backend::FRAGMENT) {
+        return;
+    }
+
+    // Texture coordinates need more than the 10 bits of mantissa of mediump as soon as they
+    // address more than ~1024 texels, or when they are large and wrap. glslang decorates every
+    // mediump result with RelaxedPrecision, the decorations precede the functions.
+    constexpr size_t HEADER_SIZE = 5;
+    std::unordered_set<uint32_t> relaxedIds;
+    size_t count = 0;
+    for (size_t i = HEADER_SIZE; i < spirv.size(); ) {
+        const uint32_t wordCount = spirv[i] >> 16u;
+        const uint32_t opcode = spirv[i] & 0xFFFFu;
+        if (wordCount == 0 || i + wordCount > spirv.size()) {
+            break;
+        }
+        if (opcode == spv::OpDecorate && wordCount >= 3 &&
+                spirv[i + 2] == spv::DecorationRelaxedPrecision) {
+            relaxedIds.insert(spirv[i + 1]);
+        }
+        // the coordinate is the 4th operand of all the OpImageSample* instructions
+        if (opcode >= spv::OpImageSampleImplicitLod &&
+                opcode <= spv::OpImageSampleProjDrefExplicitLod && wordCount >= 5 &&
+                relaxedIds.find(spirv[i + 4]) != relaxedIds.end()) {
+            count++;
+        }
+        i += wordCount;
+    }
+
+    if (count) {
+        utils::slog.w << "Warning: " << count << " texture lookup(s) of the fragment shader use "
+                "mediump coordinates, declare the variables they are computed from highp if "
+                "they can be large" << utils::io::endl;
+    }
 }
 
 std::shared_ptr<spvtools::Optimizer> GLSLPostProcessor::createOptimizer(
@@ -32,6 +32,8 @@
 
 namespace filamat {
 
+class ShaderCache;
+
 using SpirvBlob = std::vector<uint32_t>;
 
 class GLSLPostProcessor {
@@ -42,7 +44,10 @@ public:
         GENERATE_DEBUG_INFO = 1 << 1,
     };
 
-    GLSLPostProcessor(MaterialBuilder::Optimization optimization, uint32_t flags);
+    // 'cache', if any, keeps the optimized shaders across compilations, in addition to the
+    // cache of this process
+    GLSLPostProcessor(MaterialBuilder::Optimization optimization, uint32_t flags,
+            ShaderCache const* cache = nullptr);
 
     ~GLSLPostProcessor();
 
@@ -52,6 +57,8 @@ public:
         struct {
             std::vector<std::pair<uint32_t, uint32_t>> subpassInputToColorLocation;
         } glsl;
+        // warn about the risky uses of mediump found in the fragment shader
+        bool checkMediumPrecision = false;
     };
 
     bool process(const std::string& inputShader, Config const& config,
@@ -79,9 +86,19 @@ private:
 
     void optimizeSpirv(OptimizerPtr optimizer, SpirvBlob& spirv) const;
 
+    // logs the risky uses of mediump in the unoptimized module 'spirv', if the config asks for it
+    static void validateMediumPrecision(SpirvBlob const& spirv, Config const& config);
+
+    // key of the optimized and cross-compiled outputs of the unoptimized module 'spirv'
+    std::string getOptimizationKey(SpirvBlob const& spirv, Config const& config) const;
+    bool getOptimizedOutputs(std::string const& key, std::string* text, SpirvBlob* spirv) const;
+    void putOptimizedOutputs(std::string const& key, std::string const& text,
+            SpirvBlob const& spirv) const;
+
     const MaterialBuilder::Optimization mOptimization;
     const bool mPrintShaders;
     const bool mGenerateDebugInfo;
+    ShaderCache const* const mCache;
     std::string* mGlslOutput = nullptr;
     SpirvBlob* mSpirvOutput = nullptr;
     std::string* mMslOutput = nullptr;
@@ -16,8 +16,12 @@
 
 #include "filamat/MaterialBuilder.h"
 
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <vector>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
@@ -45,6 +49,7 @@
 
 #ifndef FILAMAT_LITE
 #include "GLSLPostProcessor.h"
+#include "ShaderCache.h"
 #include "sca/GLSLTools.h"
 #else
 #include "sca/GLSLToolsLite.h"
@@ -177,6 +182,13 @@ MaterialBuilder& MaterialBuilder::variable(Variable v, const char* name) noexcep
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::variable(Variable v, const char* name,
+        VariablePrecision precision) noexcept {
+    variable(v, name);
+    mVariablePrecisions[size_t(v)] = precision;
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::parameter(UniformType type, const char* name) noexcept {
     ASSERT_POSTCONDITION(mParameterCount < MAX_PARAMETERS_COUNT, "Too many parameters");
     mParameters[mParameterCount++] = { name, type, 1 };
@@ -336,6 +348,11 @@ MaterialBuilder& MaterialBuilder::flipUV(bool flipUV) noexcept {
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::fragmentMediumPrecision(bool fragmentMediumPrecision) noexcept {
+    mFragmentMediumPrecision = fragmentMediumPrecision;
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::multiBounceAmbientOcclusion(bool multiBounceAO) noexcept {
     mMultiBounceAO = multiBounceAO;
     mMultiBounceAOSet = true;
@@ -378,11 +395,32 @@ MaterialBuilder& MaterialBuilder::generateDebugInfo(bool generateDebugInfo) noex
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::compressShaders(bool compressShaders) noexcept {
+    mCompressShaders = compressShaders;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::shaderCacheDirectory(const char* directory) noexcept {
+    mShaderCacheDirectory = CString(directory);
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::variantFilter(uint8_t variantFilter) noexcept {
     mVariantFilter = variantFilter;
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::variants(const uint8_t* variantKeys, size_t count) noexcept {
+    static_assert(decltype(mVariants)::BIT_COUNT >= filament::VARIANT_COUNT);
+    mVariants.reset();
+    for (size_t i = 0; i < count; i++) {
+        if (variantKeys[i] < filament::VARIANT_COUNT) {
+            mVariants.set(variantKeys[i]);
+        }
+    }
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::shaderDefine(const char* name, const char* value) noexcept {
     mDefines.emplace_back(name, value);
     return *this;
@@ -447,6 +485,10 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
     info.specularAntiAliasing = mSpecularAntiAliasing;
     info.clearCoatIorChange = mClearCoatIorChange;
     info.flipUV = mFlipUV;
+    info.fragmentMediumPrecision = mFragmentMediumPrecision;
+    static_assert(sizeof(info.variablePrecisions) == sizeof(mVariablePrecisions));
+    std::copy(std::begin(mVariablePrecisions), std::end(mVariablePrecisions),
+            std::begin(info.variablePrecisions));
     info.requiredAttributes = mRequiredAttributes;
     info.blendingMode = mBlendingMode;
     info.postLightingBlendingMode = mPostLightingBlendingMode;
@@ -596,14 +638,23 @@ static void showErrorMessage(const char* materialName, uint8_t variant,
             << shaderCode;
 }
 
-bool MaterialBuilder::generateShaders(const std::vector<Variant>& variants, ChunkContainer& container,
-        const MaterialInfo& info) const noexcept {
-    // Create a postprocessor to optimize / compile to Spir-V if necessary.
+bool MaterialBuilder::generateShaders(JobSystem* jobSystem, const std::vector<Variant>& variants,
+        ChunkContainer& container, const MaterialInfo& info) const noexcept {
 #ifndef FILAMAT_LITE
     uint32_t flags = 0;
     flags |= mPrintShaders ? GLSLPostProcessor::PRINT_SHADERS : 0;
     flags |= mGenerateDebugInfo ? GLSLPostProcessor::GENERATE_DEBUG_INFO : 0;
-    GLSLPostProcessor postProcessor(mOptimization, flags);
+
+    // A cache hit wouldn't print the shader.
+    std::unique_ptr<ShaderCache> cache;
+    if (!mShaderCacheDirectory.empty() && !mPrintShaders) {
+        cache = std::make_unique<ShaderCache>(utils::Path(mShaderCacheDirectory.c_str()));
+        if (!cache->isValid()) {
+            utils::slog.w << "Warning: the shader cache directory "
+                    << mShaderCacheDirectory.c_str() << " can't be used." << utils::io::endl;
+            cache.reset();
+        }
+    }
 #endif
 
     // Generate all shaders.
@@ -617,8 +668,6 @@ bool MaterialBuilder::generateShaders(const std::vector<Variant>& variants, Chun
 #ifndef FILAMAT_LITE
     BlobDictionary spirvDictionary;
 #endif
-    std::vector<uint32_t> spirv;
-    std::string msl;
 
     ShaderGenerator sg(mProperties, mVariables, mOutputs, mDefines, mMaterialCode.getResolved(),
             mMaterialCode.getLineOffset(), mMaterialVertexCode.getResolved(),
@@ -629,112 +678,181 @@ bool MaterialBuilder::generateShaders(const std::vector<Variant>& variants, Chun
             mBlendingMode == BlendingMode::MASKED || !emptyVertexCode;
     container.addSimpleChild<bool>(ChunkType::MaterialHasCustomDepthShader, customDepth);
 
+    // Each shader is compiled independently into its own slot, possibly in parallel. The slots
+    // are then added to the dictionaries in order, so that the package doesn't depend on the
+    // order in which the shaders were compiled.
+    struct CompiledShader {
+        CodeGenParams const* params;
+        Variant const* variant;
+        std::string shader;             // GLSL, or MSL for Metal
+        std::vector<uint32_t> spirv;
+        bool ok;
+    };
+
+    std::vector<CompiledShader> shaders;
+    shaders.reserve(mCodeGenPermutations.size() * variants.size());
     for (const auto& params : mCodeGenPermutations) {
+        assertSingleTargetApi(params.targetApi);
+        for (const auto& v : variants) {
+            shaders.push_back({ &params, &v, {}, {}, false });
+        }
+    }
+
+    auto compile = [&](CompiledShader& compiled) {
+        const CodeGenParams& params = *compiled.params;
+        const Variant& v = *compiled.variant;
         const ShaderModel shaderModel = ShaderModel(params.shaderModel);
         const TargetApi targetApi = params.targetApi;
         const TargetLanguage targetLanguage = params.targetLanguage;
 
-        assertSingleTargetApi(targetApi);
-
         // Metal Shading Language is cross-compiled from Vulkan.
         const bool targetApiNeedsSpirv =
                 (targetApi == TargetApi::VULKAN || targetApi == TargetApi::METAL);
         const bool targetApiNeedsMsl = targetApi == TargetApi::METAL;
-        std::vector<uint32_t>* pSpirv = targetApiNeedsSpirv ? &spirv : nullptr;
+        std::string msl;
+        std::vector<uint32_t>* pSpirv = targetApiNeedsSpirv ? &compiled.spirv : nullptr;
         std::string* pMsl = targetApiNeedsMsl ? &msl : nullptr;
 
-        TextEntry glslEntry{0};
-        SpirvEntry spirvEntry{0};
-        TextEntry metalEntry{0};
-
-        glslEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-        spirvEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-        metalEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-
-        for (const auto& v : variants) {
-            glslEntry.variant = v.variant;
-            spirvEntry.variant = v.variant;
-            metalEntry.variant = v.variant;
-
-            // Generate raw shader code.
-            // The quotes in Google-style line directives cause problems with certain drivers. These
-            // directives are optimized away when using the full filamat, so down below we
-            // explicitly remove them when using filamat lite.
-            std::string shader;
-            if (v.stage == filament::backend::ShaderType::VERTEX) {
-                shader = sg.createVertexProgram(
-                        shaderModel, targetApi, targetLanguage, info, v.variant,
-                        mInterpolation, mVertexDomain);
+        // Generate raw shader code.
+        // The quotes in Google-style line directives cause problems with certain drivers. These
+        // directives are optimized away when using the full filamat, so down below we
+        // explicitly remove them when using filamat lite.
+        std::string shader;
+        if (v.stage == filament::backend::ShaderType::VERTEX) {
+            shader = sg.createVertexProgram(
+                    shaderModel, targetApi, targetLanguage, info, v.variant,
+                    mInterpolation, mVertexDomain);
 #ifdef FILAMAT_LITE
-                GLSLToolsLite glslTools;
-                glslTools.removeGoogleLineDirectives(shader);
+            GLSLToolsLite glslTools;
+            glslTools.removeGoogleLineDirectives(shader);
 #endif
-            } else if (v.stage == filament::backend::ShaderType::FRAGMENT) {
-                shader = sg.createFragmentProgram(
-                        shaderModel, targetApi, targetLanguage, info, v.variant, mInterpolation);
+        } else if (v.stage == filament::backend::ShaderType::FRAGMENT) {
+            shader = sg.createFragmentProgram(
+                    shaderModel, targetApi, targetLanguage, info, v.variant, mInterpolation);
 #ifdef FILAMAT_LITE
-                GLSLToolsLite glslTools;
-                glslTools.removeGoogleLineDirectives(shader);
+            GLSLToolsLite glslTools;
+            glslTools.removeGoogleLineDirectives(shader);
 #endif
-            }
+        }
 
 #ifndef FILAMAT_LITE
 
-            GLSLPostProcessor::Config config{
-                    .shaderType = v.stage,
-                    .shaderModel = shaderModel,
-                    .glsl = {}
-            };
+        GLSLPostProcessor::Config config{
+                .shaderType = v.stage,
+                .shaderModel = shaderModel,
+                .glsl = {}
+        };
 
-            if (mEnableFramebufferFetch) {
-                config.glsl.subpassInputToColorLocation.emplace_back(0, 0);
+        if (mEnableFramebufferFetch) {
+            config.glsl.subpassInputToColorLocation.emplace_back(0, 0);
+        }
+        config.checkMediumPrecision = info.fragmentMediumPrecision;
+
+        // The generated code already depends on the material, the variant and the target, the
+        // key adds the options of the compilation.
+        std::string key;
+        if (cache) {
+            key = "api=" + std::to_string(int(targetApi)) +
+                    " language=" + std::to_string(int(targetLanguage)) +
+                    " stage=" + std::to_string(int(v.stage)) +
+                    " model=" + std::to_string(int(shaderModel)) +
+                    " optimization=" + std::to_string(int(mOptimization)) +
+                    " flags=" + std::to_string(flags) +
+                    " fbfetch=" + std::to_string(int(mEnableFramebufferFetch)) + "\n" + shader;
+            if (cache->get(key, &compiled.shader, &compiled.spirv)) {
+                compiled.ok = true;
+                return;
             }
+        }
 
-            bool ok = postProcessor.process(shader, config, &shader, pSpirv, pMsl);
+        // The postprocessor keeps the state of the shader it processes, each shader needs its
+        // own. glslang keeps its own per-thread state.
+        GLSLPostProcessor postProcessor(mOptimization, flags, cache.get());
+        compiled.ok = postProcessor.process(shader, config, &shader, pSpirv, pMsl);
 #else
-            bool ok = true;
+        compiled.ok = true;
 #endif
-            if (!ok) {
-                showErrorMessage(mMaterialName.c_str_safe(), v.variant, targetApi, v.stage, shader);
-                return false;
-            }
 
-            if (targetApi == TargetApi::OPENGL) {
-                if (targetLanguage == TargetLanguage::SPIRV) {
-                    sg.fixupExternalSamplers(shaderModel, shader, info);
-                }
+        if (compiled.ok && targetApi == TargetApi::OPENGL &&
+                targetLanguage == TargetLanguage::SPIRV) {
+            sg.fixupExternalSamplers(shaderModel, shader, info);
+        }
 
-                glslEntry.stage = v.stage;
-                glslEntry.shader = shader;
-                textDictionary.addText(glslEntry.shader);
-                glslEntries.push_back(glslEntry);
-            }
+        compiled.shader = (compiled.ok && targetApiNeedsMsl) ? std::move(msl) : std::move(shader);
 
 #ifndef FILAMAT_LITE
-            if (targetApi == TargetApi::VULKAN) {
-                assert(!spirv.empty());
-                spirvEntry.stage = v.stage;
-                spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                spirv.clear();
-                spirvEntries.push_back(spirvEntry);
-            }
-            if (targetApi == TargetApi::METAL) {
-                assert(!spirv.empty());
-                assert(msl.length() > 0);
-                metalEntry.stage = v.stage;
-                metalEntry.shader = msl;
-                spirv.clear();
-                msl.clear();
-                textDictionary.addText(metalEntry.shader);
-                metalEntries.push_back(metalEntry);
-            }
+        if (cache && compiled.ok) {
+            cache->put(key, compiled.shader, compiled.spirv);
+        }
 #endif
+    };
+
+    // Printing the shaders from several threads would interleave them.
+    if (jobSystem && !mPrintShaders) {
+        auto work = [&shaders, &compile](uint32_t startIndex, uint32_t count) {
+            for (size_t i = startIndex, e = startIndex + count; i < e; i++) {
+                compile(shaders[i]);
+            }
+        };
+        auto* job = jobs::parallel_for(*jobSystem, nullptr, 0, uint32_t(shaders.size()),
+                std::cref(work), jobs::CountSplitter<1>());
+        jobSystem->runAndWait(job);
+    } else {
+        for (auto& compiled : shaders) {
+            compile(compiled);
         }
     }
 
+    for (auto& compiled : shaders) {
+        const TargetApi targetApi = compiled.params->targetApi;
+        const Variant& v = *compiled.variant;
+        const uint8_t shaderModel = static_cast<uint8_t>(compiled.params->shaderModel);
+
+        if (!compiled.ok) {
+            showErrorMessage(mMaterialName.c_str_safe(), v.variant, targetApi, v.stage,
+                    compiled.shader);
+            return false;
+        }
+
+        if (targetApi == TargetApi::OPENGL) {
+            TextEntry glslEntry{0};
+            glslEntry.shaderModel = shaderModel;
+            glslEntry.variant = v.variant;
+            glslEntry.stage = v.stage;
+            glslEntry.shader = std::move(compiled.shader);
+            textDictionary.addText(glslEntry.shader);
+            glslEntries.push_back(glslEntry);
+        }
+
+#ifndef FILAMAT_LITE
+        if (targetApi == TargetApi::VULKAN) {
+            assert(!compiled.spirv.empty());
+            SpirvEntry spirvEntry{0};
+            spirvEntry.shaderModel = shaderModel;
+            spirvEntry.variant = v.variant;
+            spirvEntry.stage = v.stage;
+            spirvEntry.dictionaryIndex = spirvDictionary.addBlob(compiled.spirv);
+            spirvEntries.push_back(spirvEntry);
+        }
+        if (targetApi == TargetApi::METAL) {
+            assert(!compiled.spirv.empty());
+            assert(compiled.shader.length() > 0);
+            TextEntry metalEntry{0};
+            metalEntry.shaderModel = shaderModel;
+            metalEntry.variant = v.variant;
+            metalEntry.stage = v.stage;
+            metalEntry.shader = std::move(compiled.shader);
+            textDictionary.addText(metalEntry.shader);
+            metalEntries.push_back(metalEntry);
+        }
+#endif
+        // the compiled shader isn't needed anymore
+        compiled.spirv = {};
+    }
+
     // Emit dictionary chunk (TextDictionaryReader and DictionaryTextChunk)
     const auto& dictionaryChunk = container.addChild<filamat::DictionaryTextChunk>(
-            std::move(textDictionary), ChunkType::DictionaryText);
+            std::move(textDictionary), ChunkType::DictionaryText, mCompressShaders);
 
     // Emit GLSL chunk (MaterialTextChunk).
     if (!glslEntries.empty()) {
@@ -746,7 +864,8 @@ bool MaterialBuilder::generateShaders(const std::vector<Variant>& variants, Chun
 #ifndef FILAMAT_LITE
     if (!spirvEntries.empty()) {
         const bool stripInfo = !mGenerateDebugInfo;
-        container.addChild<filamat::DictionarySpirvChunk>(std::move(spirvDictionary), stripInfo);
+        container.addChild<filamat::DictionarySpirvChunk>(std::move(spirvDictionary), stripInfo,
+                mCompressShaders);
         container.addChild<MaterialSpirvChunk>(std::move(spirvEntries));
     }
 
@@ -809,6 +928,14 @@ MaterialBuilder& MaterialBuilder::enableFramebufferFetch() noexcept {
 }
 
 Package MaterialBuilder::build() noexcept {
+    return buildPackage(nullptr);
+}
+
+Package MaterialBuilder::build(JobSystem& jobSystem) noexcept {
+    return buildPackage(&jobSystem);
+}
+
+Package MaterialBuilder::buildPackage(JobSystem* jobSystem) noexcept {
     if (materialBuilderClients == 0) {
         utils::slog.e << "Error: MaterialBuilder::init() must be called before build()."
             << utils::io::endl;
@@ -853,9 +980,9 @@ Package MaterialBuilder::build() noexcept {
 
     // Generate all shaders and write the shader chunks.
     const auto variants = mMaterialDomain == MaterialDomain::SURFACE ?
-        determineSurfaceVariants(mVariantFilter, isLit(), mShadowMultiplier) :
-        determinePostProcessVariants();
-    bool success = generateShaders(variants, container, info);
+        determineSurfaceVariants(mVariantFilter, isLit(), mShadowMultiplier, mVariants) :
+        determinePostProcessVariants(mVariants);
+    bool success = generateShaders(jobSystem, variants, container, info);
 
     if (!success) {
         // Return an empty package to signal a failure to build the material.
@@ -21,34 +21,54 @@
 namespace filamat {
 
 std::vector<Variant> determineSurfaceVariants(uint8_t variantFilter, bool isLit,
-        bool shadowMultiplier) {
+        bool shadowMultiplier, VariantSet const& usedVariants) {
     std::vector<Variant> variants;
     uint8_t variantMask = ~variantFilter;
+
+    // the picking variants share the FOG bit, filtering out the fog doesn't remove them
+    auto filter = [variantMask](uint8_t k) -> uint8_t {
+        return k & (filament::Variant::isValidDepthVariant(k) ?
+                uint8_t(variantMask | filament::Variant::PICKING) : variantMask);
+    };
+
+    // a shader is needed if a used variant maps to it, see FMaterial::getSurfaceProgramSlow()
+    VariantSet usedVertexVariants;
+    VariantSet usedFragmentVariants;
+    usedVariants.forEachSetBit([&](size_t k) {
+        uint8_t v = filament::Variant::filterVariant(filter(uint8_t(k)),
+                isLit || shadowMultiplier);
+        usedVertexVariants.set(filament::Variant::filterVariantVertex(v));
+        usedFragmentVariants.set(filament::Variant::filterVariantFragment(v));
+    });
+    const bool allVariants = usedVariants.none();
+
     for (uint8_t k = 0; k < filament::VARIANT_COUNT; k++) {
         if (filament::Variant::isReserved(k)) {
             continue;
         }
 
         // Remove variants for unlit materials
-        uint8_t v = filament::Variant::filterVariant(
-                k & variantMask, isLit || shadowMultiplier);
+        uint8_t v = filament::Variant::filterVariant(filter(k), isLit || shadowMultiplier);
 
-        if (filament::Variant::filterVariantVertex(v) == k) {
+        if (filament::Variant::filterVariantVertex(v) == k &&
+                (allVariants || usedVertexVariants[k])) {
             variants.emplace_back(k, filament::backend::ShaderType::VERTEX);
         }
 
-        if (filament::Variant::filterVariantFragment(v) == k) {
+        if (filament::Variant::filterVariantFragment(v) == k &&
+                (allVariants || usedFragmentVariants[k])) {
             variants.emplace_back(k, filament::backend::ShaderType::FRAGMENT);
         }
     }
     return variants;
 }
 
-std::vector<Variant> determinePostProcessVariants() {
+std::vector<Variant> determinePostProcessVariants(VariantSet const& usedVariants) {
     std::vector<Variant> variants;
-    // TODO: add a way to filter out post-process variants (e.g., the transparent variant if only
-    // opaque is needed)
     for (size_t k = 0; k < filament::POST_PROCESS_VARIANT_COUNT; k++) {
+        if (usedVariants.any() && !usedVariants[k]) {
+            continue;
+        }
         variants.emplace_back(k, filament::backend::ShaderType::VERTEX);
         variants.emplace_back(k, filament::backend::ShaderType::FRAGMENT);
     }
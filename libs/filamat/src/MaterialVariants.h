@@ -21,6 +21,8 @@
 
 #include <backend/DriverEnums.h>
 
+#include <utils/bitset.h>
+
 #include <vector>
 
 namespace filamat {
@@ -34,10 +36,14 @@ struct Variant {
     Stage stage;
 };
 
+// one bit per variant key
+using VariantSet = utils::bitset<uint64_t, (filament::VARIANT_COUNT + 63) / 64>;
+
+// Only the shaders needed by the variants of usedVariants are kept, unless it's empty.
 std::vector<Variant> determineSurfaceVariants(uint8_t variantFilter, bool isLit,
-        bool shadowMultiplier);
+        bool shadowMultiplier, VariantSet const& usedVariants = {});
 
-std::vector<Variant> determinePostProcessVariants();
+std::vector<Variant> determinePostProcessVariants(VariantSet const& usedVariants = {});
 
 } // namespace filamat
 
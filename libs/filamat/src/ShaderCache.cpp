@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShaderCache.h"
+
+#include <utils/Hash.h>
+
+#include <fstream>
+#include <random>
+
+#include <stdio.h>
+
+namespace filamat {
+
+// Changing the layout of the files or the way shaders are compiled (e.g. a new version of
+// glslang or of the SPIR-V optimizer) must bump this, to invalidate the existing entries.
+static constexpr uint32_t CACHE_MAGIC = 0x4353'4d46; // 'FMSC'
+static constexpr uint32_t CACHE_VERSION = 1;
+
+ShaderCache::ShaderCache(utils::Path directory) noexcept
+        : mDirectory(std::move(directory)) {
+    mValid = mDirectory.isDirectory() || mDirectory.mkdirRecursive();
+}
+
+utils::Path ShaderCache::getEntryPath(std::string const& key) const {
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx",
+            (unsigned long long)utils::hash::fnv1a64(key.data(), key.size()));
+    return mDirectory.concat(name);
+}
+
+template<typename T>
+static bool readValue(std::ifstream& in, T* value) {
+    return bool(in.read(reinterpret_cast<char*>(value), sizeof(T)));
+}
+
+template<typename T>
+static void writeValue(std::ofstream& out, T value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+bool ShaderCache::get(std::string const& key, std::string* shader,
+        std::vector<uint32_t>* spirv) const {
+    if (!mValid) {
+        return false;
+    }
+
+    std::ifstream in(getEntryPath(key).getPath(), std::ios::binary);
+    if (!in) {
+        return false;
+    }
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t size = 0;
+    if (!readValue(in, &magic) || !readValue(in, &version) || !readValue(in, &size) ||
+            magic != CACHE_MAGIC || version != CACHE_VERSION || size != key.size()) {
+        return false;
+    }
+
+    // the key is compared in full, a collision of the hashes is a miss
+    std::string storedKey(size, '\0');
+    if (!in.read(&storedKey[0], std::streamsize(size)) || storedKey != key) {
+        return false;
+    }
+
+    std::string text;
+    if (!readValue(in, &size)) {
+        return false;
+    }
+    text.resize(size);
+    if (size && !in.read(&text[0], std::streamsize(size))) {
+        return false;
+    }
+
+    std::vector<uint32_t> words;
+    if (!readValue(in, &size)) {
+        return false;
+    }
+    words.resize(size);
+    if (size && !in.read(reinterpret_cast<char*>(words.data()),
+            std::streamsize(size * sizeof(uint32_t)))) {
+        return false;
+    }
+
+    *shader = std::move(text);
+    *spirv = std::move(words);
+    return true;
+}
+
+void ShaderCache::put(std::string const& key, std::string const& shader,
+        std::vector<uint32_t> const& spirv) const {
+    if (!mValid) {
+        return;
+    }
+
+    // The entry is written to a file of its own first, other compilations (possibly other
+    // processes) never see a partial entry.
+    const utils::Path path = getEntryPath(key);
+    thread_local std::mt19937_64 generator{ std::random_device{}() };
+    const std::string temporary = path.getPath() + "." + std::to_string(generator()) + ".tmp";
+
+    { // scope for the file
+        std::ofstream out(temporary, std::ios::binary);
+        if (!out) {
+            return;
+        }
+        writeValue(out, CACHE_MAGIC);
+        writeValue(out, CACHE_VERSION);
+        writeValue(out, uint64_t(key.size()));
+        out.write(key.data(), std::streamsize(key.size()));
+        writeValue(out, uint64_t(shader.size()));
+        out.write(shader.data(), std::streamsize(shader.size()));
+        writeValue(out, uint64_t(spirv.size()));
+        out.write(reinterpret_cast<const char*>(spirv.data()),
+                std::streamsize(spirv.size() * sizeof(uint32_t)));
+        if (!out) {
+            out.close();
+            remove(temporary.c_str());
+            return;
+        }
+    }
+
+    // If another compilation added the same entry meanwhile, either one is fine.
+    if (rename(temporary.c_str(), path.getPath().c_str()) != 0) {
+        remove(temporary.c_str());
+    }
+}
+
+} // namespace filamat
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMAT_SHADERCACHE_H
+#define TNT_FILAMAT_SHADERCACHE_H
+
+#include <utils/Path.h>
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace filamat {
+
+/*
+ * ShaderCache is a persistent, content-addressed cache of compiled shaders, stored as one file per
+ * shader in a directory. An entry is keyed by everything the compilation depends on: the generated
+ * shader, which already contains the include-resolved material code and the variant, the shader
+ * model, the target API and language and the post-processing options.
+ *
+ * The files are named after a hash of the key, and contain the key itself so that a hash
+ * collision is a miss rather than a wrong shader. Entries are written to a temporary file first
+ * and then renamed, so that several compilations can share the directory.
+ *
+ * All the methods can be called from several threads at once.
+ */
+class ShaderCache {
+public:
+    explicit ShaderCache(utils::Path directory) noexcept;
+
+    bool isValid() const noexcept { return mValid; }
+
+    // Returns whether the compiled shader for 'key' is in the cache, and if so its GLSL or MSL
+    // output in 'shader' and its SPIR-V in 'spirv'.
+    bool get(std::string const& key, std::string* shader, std::vector<uint32_t>* spirv) const;
+
+    // Adds the compiled shader for 'key' to the cache, failures are ignored.
+    void put(std::string const& key, std::string const& shader,
+            std::vector<uint32_t> const& spirv) const;
+
+private:
+    utils::Path getEntryPath(std::string const& key) const;
+
+    utils::Path mDirectory;
+    bool mValid;
+};
+
+} // namespace filamat
+
+#endif // TNT_FILAMAT_SHADERCACHE_H
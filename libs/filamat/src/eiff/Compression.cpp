@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Compression.h"
+
+#include <zlib.h>
+
+namespace filamat {
+
+std::vector<uint8_t> compressDeflate(const void* data, size_t size) {
+    // Packages are compressed once at build time, the best compression is worth its cost.
+    uLongf compressedSize = compressBound(uLong(size));
+    std::vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, (const Bytef*) data, uLong(size),
+            Z_BEST_COMPRESSION) != Z_OK) {
+        return {};
+    }
+    compressed.resize(compressedSize);
+    return compressed;
+}
+
+} // namespace filamat
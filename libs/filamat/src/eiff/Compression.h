@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMAT_COMPRESSION_H
+#define TNT_FILAMAT_COMPRESSION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace filamat {
+
+// Compresses 'size' bytes with deflate (zlib format), returns an empty vector if it failed.
+// The result is decompressed by filaflat::DictionaryReader.
+std::vector<uint8_t> compressDeflate(const void* data, size_t size);
+
+} // namespace filamat
+
+#endif // TNT_FILAMAT_COMPRESSION_H
@@ -16,33 +16,61 @@
 
 #include "DictionarySpirvChunk.h"
 
+#include "Compression.h"
+
 #include <smolv.h>
 
 namespace filamat {
 
-DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary&& dictionary, bool stripDebugInfo) :
-        Chunk(ChunkType::DictionarySpirv), mDictionary(dictionary), mStripDebugInfo(stripDebugInfo) {
+DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary&& dictionary, bool stripDebugInfo,
+        bool compress) :
+        Chunk(ChunkType::DictionarySpirv), mDictionary(dictionary), mStripDebugInfo(stripDebugInfo),
+        mCompress(compress) {
 }
 
 void DictionarySpirvChunk::flatten(Flattener& f) {
+    // The chunk is flattened twice, by the dry run and then for real.
+    if (mEncoded.empty()) {
+        uint32_t flags = 0;
+        if (mStripDebugInfo) {
+            flags |= smolv::kEncodeFlagStripDebugInfo;
+        }
 
-    // For now, 1 is the only acceptable compression scheme.
-    f.writeUint32(1);
+        mEncoded.reserve(mDictionary.getBlobCount());
+        for (size_t i = 0 ; i < mDictionary.getBlobCount() ; i++) {
+            const std::string& spirv = mDictionary.getBlob(i);
+            smolv::ByteArray compressed;
+            if (!smolv::Encode(spirv.data(), spirv.size(), compressed, flags)) {
+                utils::slog.e << "Error with SPIRV compression" << utils::io::endl;
+            }
+            mEncoded.push_back(std::move(compressed));
+        }
 
-    uint32_t flags = 0;
-    if (mStripDebugInfo) {
-        flags |= smolv::kEncodeFlagStripDebugInfo;
+        // Each blob is deflated on its own, so that shaders can be decompressed on demand. The
+        // deflated blobs are prefixed with the size of their smol-v encoding.
+        if (mCompress) {
+            std::vector<std::vector<uint8_t>> deflated(mEncoded.size());
+            for (size_t i = 0; i < mEncoded.size() && mCompress; i++) {
+                const uint32_t size = uint32_t(mEncoded[i].size());
+                deflated[i] = compressDeflate(mEncoded[i].data(), size);
+                deflated[i].insert(deflated[i].begin(), {
+                        uint8_t(size), uint8_t(size >> 8), uint8_t(size >> 16), uint8_t(size >> 24) });
+                mCompress = deflated[i].size() > sizeof(size);
+            }
+            if (mCompress) {
+                mEncoded = std::move(deflated);
+            } else {
+                utils::slog.w << "Warning: the SPIRV dictionary couldn't be deflated"
+                        << utils::io::endl;
+            }
+        }
     }
 
-    f.writeUint32(mDictionary.getBlobCount());
-    for (size_t i = 0 ; i < mDictionary.getBlobCount() ; i++) {
-        const std::string& spirv = mDictionary.getBlob(i);
-        smolv::ByteArray compressed;
-        if (!smolv::Encode(spirv.data(), spirv.size(), compressed, flags)) {
-            utils::slog.e << "Error with SPIRV compression" << utils::io::endl;
-        }
+    f.writeUint32(uint32_t(mCompress ? DictionaryCompression::DEFLATE : DictionaryCompression::SMOLV));
 
-        f.writeBlob((const char*) compressed.data(), compressed.size());
+    f.writeUint32(mEncoded.size());
+    for (const auto& encoded : mEncoded) {
+        f.writeBlob((const char*) encoded.data(), encoded.size());
     }
 }
 
@@ -28,7 +28,8 @@ namespace filamat {
 
 class DictionarySpirvChunk final : public Chunk {
 public:
-    explicit DictionarySpirvChunk(BlobDictionary&& dictionary, bool stripDebugInfo);
+    explicit DictionarySpirvChunk(BlobDictionary&& dictionary, bool stripDebugInfo,
+            bool compress = false);
     ~DictionarySpirvChunk() = default;
 
 private:
@@ -36,6 +37,9 @@ private:
 
     BlobDictionary mDictionary;
     bool mStripDebugInfo;
+    bool mCompress;
+    // encoded blobs, computed by the first flatten()
+    std::vector<std::vector<uint8_t>> mEncoded;
 };
 
 } // namespace filamat
@@ -16,13 +16,39 @@
 
 #include "DictionaryTextChunk.h"
 
+#include "Compression.h"
+
 namespace filamat {
 
-DictionaryTextChunk::DictionaryTextChunk(LineDictionary&& dictionary, ChunkType chunkType) :
-        Chunk(chunkType), mDictionary(dictionary) {
+DictionaryTextChunk::DictionaryTextChunk(LineDictionary&& dictionary, ChunkType chunkType,
+        bool compress) :
+        Chunk(chunkType), mDictionary(dictionary), mCompress(compress) {
 }
 
 void DictionaryTextChunk::flatten(Flattener& f) {
+    // The chunk is flattened twice, by the dry run and then for real.
+    if (mCompress && mCompressed.empty()) {
+        Flattener dryRunner(nullptr);
+        flattenLines(dryRunner);
+        std::vector<uint8_t> lines(dryRunner.getBytesWritten());
+        Flattener writer(lines.data());
+        flattenLines(writer);
+        mUncompressedSize = lines.size();
+        mCompressed = compressDeflate(lines.data(), lines.size());
+    }
+
+    // If the compression failed, the dictionary is stored uncompressed.
+    if (!mCompressed.empty()) {
+        f.writeUint32(DICTIONARY_TEXT_COMPRESSED);
+        f.writeUint32(uint32_t(DictionaryCompression::DEFLATE));
+        f.writeUint64(mUncompressedSize);
+        f.writeBlob((const char*) mCompressed.data(), mCompressed.size());
+    } else {
+        flattenLines(f);
+    }
+}
+
+void DictionaryTextChunk::flattenLines(Flattener& f) const {
     // NumStrings
     f.writeUint32(mDictionary.getLineCount());
 
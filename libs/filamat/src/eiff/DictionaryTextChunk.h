@@ -28,15 +28,20 @@ namespace filamat {
 
 class DictionaryTextChunk final : public Chunk {
 public:
-    DictionaryTextChunk(LineDictionary&& dictionary, ChunkType chunkType);
+    DictionaryTextChunk(LineDictionary&& dictionary, ChunkType chunkType, bool compress = false);
     ~DictionaryTextChunk() = default;
 
     const LineDictionary& getDictionary() const noexcept { return mDictionary; }
 
 private:
     void flatten(Flattener& f) override;
+    void flattenLines(Flattener& f) const;
 
     const LineDictionary mDictionary;
+    const bool mCompress;
+    // compressed lines, computed by the first flatten()
+    std::vector<uint8_t> mCompressed;
+    size_t mUncompressedSize = 0;
 };
 
 } // namespace filamat
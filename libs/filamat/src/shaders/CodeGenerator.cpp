@@ -93,7 +93,7 @@ Precision CodeGenerator::getDefaultPrecision(ShaderType type) const {
     if (type == ShaderType::VERTEX) {
         return Precision::HIGH;
     } else if (type == ShaderType::FRAGMENT) {
-        if (mShaderModel < ShaderModel::GL_CORE_41) {
+        if (mShaderModel < ShaderModel::GL_CORE_41 || mFragmentMediumPrecision) {
             return Precision::MEDIUM;
         } else {
             return Precision::HIGH;
@@ -134,7 +134,7 @@ io::sstream& CodeGenerator::generatePostProcessMain(io::sstream& out, ShaderType
 }
 
 io::sstream& CodeGenerator::generateVariable(io::sstream& out, ShaderType type,
-        const CString& name, size_t index) const {
+        const CString& name, size_t index, Precision precision) const {
 
     if (!name.empty()) {
         if (type == ShaderType::VERTEX) {
@@ -142,7 +142,12 @@ io::sstream& CodeGenerator::generateVariable(io::sstream& out, ShaderType type,
             out << "\n#define VARIABLE_CUSTOM_AT" << index << " variable_" << name.c_str() << "\n";
             out << "LAYOUT_LOCATION(" << index << ") out vec4 variable_" << name.c_str() << ";\n";
         } else if (type == ShaderType::FRAGMENT) {
-            out << "\nLAYOUT_LOCATION(" << index << ") in highp vec4 variable_" << name.c_str() << ";\n";
+            if (precision == Precision::DEFAULT) {
+                precision = mFragmentMediumPrecision ? Precision::MEDIUM : Precision::HIGH;
+            }
+            out << "\nLAYOUT_LOCATION(" << index << ") in "
+                << getPrecisionQualifier(precision, Precision::DEFAULT)
+                << " vec4 variable_" << name.c_str() << ";\n";
         }
     }
     return out;
@@ -248,6 +253,50 @@ io::sstream& CodeGenerator::generateDepthShaderMain(io::sstream& out, ShaderType
     return out;
 }
 
+io::sstream& CodeGenerator::generateOrderIndependentTransparencyProlog(io::sstream& out) const {
+    out << "\n#define main materialFragmentMain\n";
+    return out;
+}
+
+io::sstream& CodeGenerator::generateOrderIndependentTransparencyEpilog(io::sstream& out) const {
+    // Weighted-blended OIT, from "Weighted Blended Order-Independent Transparency", McGuire and
+    // Bavoil 2013, equation 7. fragColor is premultiplied, the color target accumulates the
+    // weighted colors and the revealage (in alpha), the second target accumulates the weights.
+    // gl_FragCoord.w is the inverse of the view-space distance with a perspective projection.
+    out << R"GLSL(
+#undef main
+LAYOUT_LOCATION(1) out float fragOitWeight;
+void main() {
+    materialFragmentMain();
+    if (frameUniforms.oitEnabled != 0.0) {
+        float z = 1.0 / gl_FragCoord.w;
+        float w = clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+        fragOitWeight = fragColor.a * w;
+        fragColor.rgb *= w;
+    }
+}
+)GLSL";
+    return out;
+}
+
+io::sstream& CodeGenerator::generatePickingProlog(io::sstream& out) const {
+    out << "\n#define main depthFragmentMain\n";
+    return out;
+}
+
+io::sstream& CodeGenerator::generatePickingEpilog(io::sstream& out) const {
+    // The picking target is RG32F, the object id is stored as the bits of the red channel.
+    out << R"GLSL(
+#undef main
+LAYOUT_LOCATION(0) out highp vec2 outPicking;
+void main() {
+    depthFragmentMain();
+    outPicking = vec2(uintBitsToFloat(objectUniforms.objectId), gl_FragCoord.z);
+}
+)GLSL";
+    return out;
+}
+
 const char* CodeGenerator::getUniformPrecisionQualifier(UniformType type, Precision precision,
         Precision uniformPrecision, Precision defaultPrecision) const noexcept {
     if (!hasPrecision(type)) {
@@ -492,6 +541,11 @@ io::sstream& CodeGenerator::generateGetters(io::sstream& out, ShaderType type) c
         out << SHADERS_GETTERS_VS_DATA;
     } else if (type == ShaderType::FRAGMENT) {
         out << SHADERS_GETTERS_FS_DATA;
+        // bias to pass to texture() for the material's textures to keep the sharpness of the
+        // output resolution when rendering at a lower resolution (e.g. with TAA upscaling)
+        out << "float getTextureLodBias() {\n"
+               "    return frameUniforms.lodBias;\n"
+               "}\n";
     }
     return out;
 }
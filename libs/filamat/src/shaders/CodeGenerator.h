@@ -43,9 +43,13 @@ class UTILS_PRIVATE CodeGenerator {
     using TargetApi = MaterialBuilder::TargetApi;
     using TargetLanguage = MaterialBuilder::TargetLanguage;
 public:
+    // 'fragmentMediumPrecision' makes mediump the default precision of the fragment shaders and
+    // of their custom variables on every shader model
     CodeGenerator(filament::backend::ShaderModel shaderModel,
-            TargetApi targetApi, TargetLanguage targetLanguage) noexcept
-            : mShaderModel(shaderModel), mTargetApi(targetApi), mTargetLanguage(targetLanguage) {
+            TargetApi targetApi, TargetLanguage targetLanguage,
+            bool fragmentMediumPrecision = false) noexcept
+            : mShaderModel(shaderModel), mTargetApi(targetApi), mTargetLanguage(targetLanguage),
+              mFragmentMediumPrecision(fragmentMediumPrecision) {
         if (targetApi == TargetApi::ALL) {
             utils::slog.e << "Must resolve target API before codegen." << utils::io::endl;
             std::terminate();
@@ -82,7 +86,8 @@ public:
 
     // generate declarations for custom interpolants
     utils::io::sstream& generateVariable(utils::io::sstream& out, ShaderType type,
-            const utils::CString& name, size_t index) const;
+            const utils::CString& name, size_t index,
+            filament::backend::Precision precision = filament::backend::Precision::DEFAULT) const;
 
     // generate declarations for non-custom "in" variables
     utils::io::sstream& generateShaderInputs(utils::io::sstream& out, ShaderType type,
@@ -98,6 +103,16 @@ public:
     // generate no-op shader for depth prepass
     utils::io::sstream& generateDepthShaderMain(utils::io::sstream& out, ShaderType type) const;
 
+    // wrap the fragment shader's main() of blended materials, so that it outputs to the
+    // weighted-blended order-independent transparency targets when the view enables it
+    utils::io::sstream& generateOrderIndependentTransparencyProlog(utils::io::sstream& out) const;
+    utils::io::sstream& generateOrderIndependentTransparencyEpilog(utils::io::sstream& out) const;
+
+    // wrap the fragment shader's main() of the depth variants with picking, so that it also
+    // outputs the object id and the depth of the fragment to the picking target
+    utils::io::sstream& generatePickingProlog(utils::io::sstream& out) const;
+    utils::io::sstream& generatePickingEpilog(utils::io::sstream& out) const;
+
     // generate uniforms
     utils::io::sstream& generateUniforms(utils::io::sstream& out, ShaderType type, uint8_t binding,
             const filament::UniformInterfaceBlock& uib) const;
@@ -149,6 +164,7 @@ private:
     filament::backend::ShaderModel mShaderModel;
     TargetApi mTargetApi;
     TargetLanguage mTargetLanguage;
+    bool mFragmentMediumPrecision;
 
     // return type name of uniform  (e.g.: "vec3", "vec4", "float")
     static char const* getUniformTypeName(filament::UniformInterfaceBlock::Type uniformType) noexcept;
@@ -40,6 +40,7 @@ struct UTILS_PUBLIC MaterialInfo {
     bool specularAntiAliasing;
     bool clearCoatIorChange;
     bool flipUV;
+    bool fragmentMediumPrecision;
     bool multiBounceAO;
     bool multiBounceAOSet;
     bool specularAOSet;
@@ -54,6 +55,8 @@ struct UTILS_PUBLIC MaterialInfo {
     filament::SamplerInterfaceBlock sib;
     filament::SubpassInfo subpass;
     filament::SamplerBindingMap samplerBindings;
+    // one per custom variable, see MaterialBuilder::MATERIAL_VARIABLES_COUNT
+    filament::backend::Precision variablePrecisions[4];
 };
 
 }
@@ -177,7 +177,8 @@ std::string ShaderGenerator::createVertexProgram(filament::backend::ShaderModel
 
     utils::io::sstream vs;
 
-    const CodeGenerator cg(shaderModel, targetApi, targetLanguage);
+    const CodeGenerator cg(shaderModel, targetApi, targetLanguage,
+            material.fragmentMediumPrecision);
     const bool lit = material.isLit;
     const filament::Variant variant(variantKey);
 
@@ -294,7 +295,8 @@ std::string ShaderGenerator::createFragmentProgram(filament::backend::ShaderMode
                 variantKey, material.samplerBindings);
     }
 
-    const CodeGenerator cg(shaderModel, targetApi, targetLanguage);
+    const CodeGenerator cg(shaderModel, targetApi, targetLanguage,
+            material.fragmentMediumPrecision);
     const bool lit = material.isLit;
     const filament::Variant variant(variantKey);
 
@@ -351,6 +353,7 @@ std::string ShaderGenerator::createFragmentProgram(filament::backend::ShaderMode
     cg.generateDefine(fs, "HAS_SHADOW_MULTIPLIER", material.hasShadowMultiplier);
     cg.generateDefine(fs, "HAS_FOG", variant.hasFog());
     cg.generateDefine(fs, "HAS_VSM", variant.hasVsm());
+    cg.generateDefine(fs, "HAS_PICKING", variant.hasPicking());
 
     // material defines
     cg.generateDefine(fs, "MATERIAL_HAS_DOUBLE_SIDED_CAPABILITY", material.hasDoubleSidedCapability);
@@ -406,7 +409,9 @@ std::string ShaderGenerator::createFragmentProgram(filament::backend::ShaderMode
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        cg.generateVariable(fs, ShaderType::FRAGMENT, variable, variableIndex++);
+        cg.generateVariable(fs, ShaderType::FRAGMENT, variable, variableIndex,
+                material.variablePrecisions[variableIndex]);
+        variableIndex++;
     }
 
     // uniforms and samplers
@@ -440,7 +445,13 @@ std::string ShaderGenerator::createFragmentProgram(filament::backend::ShaderMode
         }
         // these variants are special and are treated as DEPTH variants. Filament will never
         // request that variant for the color pass.
+        if (variant.hasPicking()) {
+            cg.generatePickingProlog(fs);
+        }
         cg.generateDepthShaderMain(fs, ShaderType::FRAGMENT);
+        if (variant.hasPicking()) {
+            cg.generatePickingEpilog(fs);
+        }
     } else {
         appendShader(fs, mMaterialCode, mMaterialLineOffset);
         if (material.isLit) {
@@ -448,8 +459,18 @@ std::string ShaderGenerator::createFragmentProgram(filament::backend::ShaderMode
         } else {
             cg.generateShaderUnlit(fs, ShaderType::FRAGMENT, variant, material.hasShadowMultiplier);
         }
-        // entry point
+        // entry point, blended materials can be rendered with order-independent transparency
+        const bool hasOrderIndependentTransparency =
+                (material.blendingMode == BlendingMode::TRANSPARENT ||
+                 material.blendingMode == BlendingMode::FADE) &&
+                material.refractionMode != RefractionMode::SCREEN_SPACE;
+        if (hasOrderIndependentTransparency) {
+            cg.generateOrderIndependentTransparencyProlog(fs);
+        }
         cg.generateShaderMain(fs, ShaderType::FRAGMENT);
+        if (hasOrderIndependentTransparency) {
+            cg.generateOrderIndependentTransparencyEpilog(fs);
+        }
     }
 
     cg.generateEpilog(fs);
@@ -511,7 +532,7 @@ std::string ShaderGenerator::createPostProcessFragmentProgram(
         filament::backend::ShaderModel sm, MaterialBuilder::TargetApi targetApi,
         MaterialBuilder::TargetLanguage targetLanguage, MaterialInfo const& material,
         uint8_t variant, const filament::SamplerBindingMap& samplerBindingMap) const noexcept {
-    const CodeGenerator cg(sm, targetApi, targetLanguage);
+    const CodeGenerator cg(sm, targetApi, targetLanguage, material.fragmentMediumPrecision);
     utils::io::sstream fs;
     cg.generateProlog(fs, ShaderType::FRAGMENT, false);
 
@@ -523,7 +544,9 @@ std::string ShaderGenerator::createPostProcessFragmentProgram(
     // custom material variables
     size_t variableIndex = 0;
     for (const auto& variable : mVariables) {
-        cg.generateVariable(fs, ShaderType::FRAGMENT, variable, variableIndex++);
+        cg.generateVariable(fs, ShaderType::FRAGMENT, variable, variableIndex,
+                material.variablePrecisions[variableIndex]);
+        variableIndex++;
     }
 
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
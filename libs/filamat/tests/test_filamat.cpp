@@ -23,6 +23,13 @@
 
 #include <filamat/Enums.h>
 
+#include <private/filament/Variant.h>
+
+#include <utils/JobSystem.h>
+#include <utils/Path.h>
+
+#include <string.h>
+
 using namespace ASTUtils;
 using namespace filament::backend;
 
@@ -695,6 +702,110 @@ TEST_F(MaterialCompiler, Arrays) {
     EXPECT_TRUE(result.isValid());
 }
 
+TEST_F(MaterialCompiler, ParallelBuildMatchesSerialBuild) {
+    auto build = [](utils::JobSystem* jobSystem) {
+        filamat::MaterialBuilder builder;
+        builder.parameter(UniformType::FLOAT4, "color");
+        builder.targetApi(filamat::MaterialBuilder::TargetApi::ALL);
+        return jobSystem ? builder.build(*jobSystem) : builder.build();
+    };
+
+    filamat::Package serial = build(nullptr);
+
+    utils::JobSystem jobSystem;
+    jobSystem.adopt();
+    filamat::Package parallel = build(&jobSystem);
+    jobSystem.emancipate();
+
+    ASSERT_TRUE(serial.isValid());
+    ASSERT_TRUE(parallel.isValid());
+    ASSERT_EQ(serial.getSize(), parallel.getSize());
+    EXPECT_EQ(0, memcmp(serial.getData(), parallel.getData(), serial.getSize()));
+}
+
+TEST_F(MaterialCompiler, CachedBuildMatchesUncachedBuild) {
+    const utils::Path cacheDirectory =
+            utils::Path::getTemporaryDirectory().concat("filamat_test_shader_cache");
+    auto build = [&cacheDirectory](bool cached) {
+        filamat::MaterialBuilder builder;
+        builder.parameter(UniformType::FLOAT4, "color");
+        builder.targetApi(filamat::MaterialBuilder::TargetApi::ALL);
+        if (cached) {
+            builder.shaderCacheDirectory(cacheDirectory.c_str());
+        }
+        return builder.build();
+    };
+
+    filamat::Package uncached = build(false);
+    filamat::Package populated = build(true);   // fills the cache
+    EXPECT_FALSE(cacheDirectory.listContents().empty());
+    filamat::Package cached = build(true);      // uses the cache
+
+    for (utils::Path entry : cacheDirectory.listContents()) {
+        entry.unlinkFile();
+    }
+
+    ASSERT_TRUE(uncached.isValid());
+    ASSERT_TRUE(populated.isValid());
+    ASSERT_TRUE(cached.isValid());
+    ASSERT_EQ(uncached.getSize(), populated.getSize());
+    ASSERT_EQ(uncached.getSize(), cached.getSize());
+    EXPECT_EQ(0, memcmp(uncached.getData(), populated.getData(), uncached.getSize()));
+    EXPECT_EQ(0, memcmp(uncached.getData(), cached.getData(), uncached.getSize()));
+}
+
+TEST_F(MaterialCompiler, CompressedBuildIsSmaller) {
+    auto build = [](bool compressed) {
+        filamat::MaterialBuilder builder;
+        builder.parameter(UniformType::FLOAT4, "color");
+        builder.targetApi(filamat::MaterialBuilder::TargetApi::ALL);
+        builder.compressShaders(compressed);
+        return builder.build();
+    };
+
+    filamat::Package uncompressed = build(false);
+    filamat::Package compressed = build(true);
+
+    ASSERT_TRUE(uncompressed.isValid());
+    ASSERT_TRUE(compressed.isValid());
+    EXPECT_LT(compressed.getSize(), uncompressed.getSize());
+}
+
+TEST_F(MaterialCompiler, VariantsRestrictTheShaders) {
+    auto build = [](std::vector<uint8_t> const& variants) {
+        filamat::MaterialBuilder builder;
+        builder.parameter(UniformType::FLOAT4, "color");
+        builder.variants(variants.data(), variants.size());
+        return builder.build();
+    };
+
+    filamat::Package all = build({});
+    filamat::Package some = build({ 0, filament::Variant::DEPTH });
+
+    ASSERT_TRUE(all.isValid());
+    ASSERT_TRUE(some.isValid());
+    EXPECT_LT(some.getSize(), all.getSize());
+}
+
+TEST_F(MaterialCompiler, FragmentMediumPrecision) {
+    filamat::MaterialBuilder builder;
+    builder.parameter(SamplerType::SAMPLER_2D, "albedo");
+    builder.variable(filamat::MaterialBuilder::Variable::CUSTOM0, "uv");
+    builder.variable(filamat::MaterialBuilder::Variable::CUSTOM1, "largeUv",
+            filamat::MaterialBuilder::VariablePrecision::HIGH);
+    builder.material(
+            "void material(inout MaterialInputs material) {\n"
+            "    prepareMaterial(material);\n"
+            "    material.baseColor = texture(materialParams_albedo, variable_uv.xy) +\n"
+            "            texture(materialParams_albedo, variable_largeUv.xy);\n"
+            "}\n");
+    builder.targetApi(filamat::MaterialBuilder::TargetApi::ALL);
+    builder.fragmentMediumPrecision(true);
+
+    filamat::Package result = builder.build();
+    EXPECT_TRUE(result.isValid());
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -61,15 +61,13 @@ bool IBL::loadFromKtx(const std::string& prefix) {
         return false;
     }
 
-    auto createKtx = [] (Path path) {
-        using namespace std;
-        ifstream file(path.getPath(), ios::binary);
-        vector<uint8_t> contents((istreambuf_iterator<char>(file)), {});
-        return new image::KtxBundle(contents.data(), contents.size());
-    };
-
-    KtxBundle* iblKtx = createKtx(iblPath);
-    KtxBundle* skyKtx = createKtx(skyPath);
+    KtxBundle* iblKtx = KtxBundle::createFromFile(iblPath.c_str());
+    KtxBundle* skyKtx = KtxBundle::createFromFile(skyPath.c_str());
+    if (!iblKtx || !skyKtx) {
+        delete iblKtx;
+        delete skyKtx;
+        return false;
+    }
 
     mSkyboxTexture = ktx::createTexture(&mEngine, skyKtx, false);
     mTexture = ktx::createTexture(&mEngine, iblKtx, false);
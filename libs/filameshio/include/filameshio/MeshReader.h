@@ -28,6 +28,7 @@ namespace filament {
 }
 
 namespace utils {
+    class JobSystem;
     class Path;
 }
 
@@ -88,11 +89,26 @@ public:
      * file cannot be matched to a material in the registry, a default material is
      * used instead. The default material can be overridden by adding a material
      * named "DefaultMaterial" to the registry.
+     *
+     * Where supported, the file is memory-mapped and uncompressed vertices and
+     * indices are uploaded straight from the mapping, which is released once both
+     * buffers have been consumed by the engine.
      */
     static Mesh loadMeshFromFile(filament::Engine* engine,
             const utils::Path& path,
             MaterialRegistry& materials);
 
+    /**
+     * Loads filamesh renderables from several files, see loadMeshFromFile(). The
+     * files are opened and their compressed buffers decoded in parallel on the
+     * given job system, then the renderables are created on the calling thread,
+     * which must be adopted by the job system. Meshes that cannot be loaded are
+     * left empty in outMeshes.
+     */
+    static void loadMeshesFromFiles(filament::Engine* engine, utils::JobSystem& js,
+            const utils::Path* paths, size_t count,
+            MaterialRegistry& materials, Mesh* outMeshes);
+
     /**
      * Loads a filamesh renderable from an in-memory buffer. The material registry
      * can be used to provide named materials. If a material found in the filamesh
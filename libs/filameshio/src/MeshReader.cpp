@@ -29,9 +29,11 @@
 #include <meshoptimizer.h>
 
 #include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
 #include <utils/Log.h>
 #include <utils/Path.h>
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
@@ -39,9 +41,12 @@
 
 #include <fcntl.h>
 #if !defined(WIN32)
+#    include <sys/mman.h>
 #    include <unistd.h>
+#    define HAS_MMAP 1
 #else
 #    include <io.h>
+#    define HAS_MMAP 0
 #endif
 
 using namespace filament;
@@ -157,55 +162,100 @@ static size_t fileSize(int fd) {
     return filesize;
 }
 
-namespace filamesh {
-
-MeshReader::Mesh MeshReader::loadMeshFromFile(filament::Engine* engine, const utils::Path& path,
-        MaterialRegistry& materials) {
-
-    Mesh mesh;
+namespace {
 
-    int fd = open(path.c_str(), O_RDONLY);
+// The contents of a filamesh file, mapped or read in memory. The vertex and index buffers each
+// hold a reference, the file is released once both have been consumed.
+struct MeshFile {
+    void* data = nullptr;
+    size_t size = 0;
+    std::atomic<uint32_t> references = { 2 };
 
-    size_t size = fileSize(fd);
-    char* data = (char*) malloc(size);
-    read(fd, data, size);
-
-    if (data) {
-        char *p = data;
-        char *magic = p;
-        p += sizeof(MAGICID);
-
-        if (!strncmp(MAGICID, magic, 8)) {
-            mesh = loadMeshFromBuffer(engine, data, nullptr, nullptr, materials);
+    static MeshFile* open(const utils::Path& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        size_t size = fileSize(fd);
+        if (size < sizeof(MAGICID) + sizeof(Header)) {
+            close(fd);
+            return nullptr;
         }
+#if HAS_MMAP
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            return nullptr;
+        }
+#else
+        void* data = malloc(size);
+        const bool complete = read(fd, data, size) == size;
+        close(fd);
+        if (!complete) {
+            free(data);
+            return nullptr;
+        }
+#endif
+        MeshFile* file = new MeshFile{ data, size };
+        if (strncmp(MAGICID, (const char*) data, 8)) {
+            utils::slog.e << "Magic string not found." << utils::io::endl;
+            file->references = 1;
+            release(nullptr, 0, file);
+            return nullptr;
+        }
+        return file;
+    }
 
-        Fence::waitAndDestroy(engine->createFence());
-        free(data);
+    // Called by the vertex and index buffer descriptors.
+    static void release(void*, size_t, void* user) {
+        MeshFile* file = (MeshFile*) user;
+        if (file->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#if HAS_MMAP
+            munmap(file->data, file->size);
+#else
+            free(file->data);
+#endif
+            delete file;
+        }
     }
-    close(fd);
+};
 
-    return mesh;
-}
+// A parsed filamesh, whose buffers are ready to be handed to the engine. Everything else is
+// copied out of the source, which may be released before the mesh is built.
+struct DecodedMesh {
+    Header header;
+    std::vector<Part> parts;
+    std::vector<std::string> partsMaterial;
+    bool hasUV1 = false;
+
+    void const* indices = nullptr;
+    size_t indicesSize = 0;
+    MeshReader::Callback indicesCallback = nullptr;
+    void* indicesUser = nullptr;
+
+    void const* vertices = nullptr;
+    size_t verticesSize = 0;
+    MeshReader::Callback verticesCallback = nullptr;
+    void* verticesUser = nullptr;
+};
 
-MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
-        void const* data, Callback destructor, void* user,
-        MaterialInstance* defaultMaterial) {
-    MaterialRegistry reg;
-    reg.registerMaterialInstance(utils::CString(DEFAULT_MATERIAL), defaultMaterial);
-    return loadMeshFromBuffer(engine, data, destructor, user, reg);
-}
+} // anonymous namespace
 
-MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
-        void const* data, Callback destructor, void* user,
-        MaterialRegistry& materials) {
+// Parses the given filamesh and decodes its compressed buffers, if any. This doesn't touch the
+// engine, so it can run on any thread. Compressed buffers are decoded into temporary buffers and
+// the user callback is called immediately afterwards for the source data, which does not get
+// passed to the GPU. If decoding fails, the user callback is called for all the source data.
+static bool decodeMesh(void const* data, MeshReader::Callback destructor, void* user,
+        DecodedMesh& mesh) {
     const uint8_t* p = (const uint8_t*) data;
     if (strncmp(MAGICID, (const char *) p, 8)) {
         utils::slog.e << "Magic string not found." << utils::io::endl;
-        return {};
+        return false;
     }
     p += 8;
 
-    Header* header = (Header*) p;
+    const Header* header = (const Header*) p;
+    mesh.header = *header;
     p += sizeof(Header);
 
     uint8_t const* vertexData = p;
@@ -214,31 +264,26 @@ MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
     uint8_t const* indices = p;
     p += header->indexSize;
 
-    Part* parts = (Part*) p;
+    const Part* parts = (const Part*) p;
+    mesh.parts.assign(parts, parts + header->parts);
     p += header->parts * sizeof(Part);
 
     uint32_t materialCount = (uint32_t) *p;
     p += sizeof(uint32_t);
 
-    std::vector<std::string> partsMaterial(materialCount);
+    mesh.partsMaterial.resize(materialCount);
     for (size_t i = 0; i < materialCount; i++) {
         uint32_t nameLength = (uint32_t) *p;
         p += sizeof(uint32_t);
-        partsMaterial[i] = (const char*) p;
+        mesh.partsMaterial[i] = (const char*) p;
         p += nameLength + 1; // null terminated
     }
 
-    Mesh mesh;
+    constexpr uint32_t uintmax = std::numeric_limits<uint32_t>::max();
+    mesh.hasUV1 = header->offsetUV1 != uintmax && header->strideUV1 != uintmax;
 
-    mesh.indexBuffer = IndexBuffer::Builder()
-            .indexCount(header->indexCount)
-            .bufferType(header->indexType == UI16 ? IndexBuffer::IndexType::USHORT
-                    : IndexBuffer::IndexType::UINT)
-            .build(*engine);
+    auto freecb = [](void* buffer, size_t size, void* user) { free(buffer); };
 
-    // If the index buffer is compressed, then decode the indices into a temporary buffer.
-    // The user callback can be called immediately afterwards because the source data does not get
-    // passed to the GPU.
     const size_t indicesSize = header->indexSize;
     if (header->flags & COMPRESSION) {
         size_t indexSize = header->indexType == UI16 ? sizeof(uint16_t) : sizeof(uint32_t);
@@ -247,60 +292,31 @@ MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
         void* uncompressed = malloc(uncompressedSize);
         int err = meshopt_decodeIndexBuffer(uncompressed, indexCount, indexSize, indices,
                 indicesSize);
-        if (err) {
-            utils::slog.e << "Unable to decode index buffer." << utils::io::endl;
-            return {};
-        }
         if (destructor) {
             destructor((void*) indices, indicesSize, user);
         }
-        auto freecb = [](void* buffer, size_t size, void* user) { free(buffer); };
-        mesh.indexBuffer->setBuffer(*engine,
-                IndexBuffer::BufferDescriptor(uncompressed, uncompressedSize, freecb, nullptr));
+        if (err) {
+            utils::slog.e << "Unable to decode index buffer." << utils::io::endl;
+            free(uncompressed);
+            if (destructor) {
+                destructor((void*) vertexData, header->vertexSize, user);
+            }
+            return false;
+        }
+        mesh.indices = uncompressed;
+        mesh.indicesSize = uncompressedSize;
+        mesh.indicesCallback = freecb;
     } else {
-        mesh.indexBuffer->setBuffer(*engine,
-                IndexBuffer::BufferDescriptor(indices, indicesSize, destructor, user));
+        mesh.indices = indices;
+        mesh.indicesSize = indicesSize;
+        mesh.indicesCallback = destructor;
+        mesh.indicesUser = user;
     }
 
-    VertexBuffer::Builder vbb;
-    vbb.vertexCount(header->vertexCount)
-            .bufferCount(1)
-            .normalized(VertexAttribute::COLOR)
-            .normalized(VertexAttribute::TANGENTS);
-
-    VertexBuffer::AttributeType uvtype = (header->flags & TEXCOORD_SNORM16) ?
-            VertexBuffer::AttributeType::SHORT2 : VertexBuffer::AttributeType::HALF2;
-
-    vbb
-            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4,
-                        header->offsetPosition, uint8_t(header->stridePosition))
-            .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
-                        header->offsetTangents, uint8_t(header->strideTangents))
-            .attribute(VertexAttribute::COLOR, 0, VertexBuffer::AttributeType::UBYTE4,
-                        header->offsetColor, uint8_t(header->strideColor))
-            .attribute(VertexAttribute::UV0, 0, uvtype,
-                        header->offsetUV0, uint8_t(header->strideUV0))
-            .normalized(VertexAttribute::UV0, header->flags & TEXCOORD_SNORM16);
-
-    constexpr uint32_t uintmax = std::numeric_limits<uint32_t>::max();
-    const bool hasUV1 = header->offsetUV1 != uintmax && header->strideUV1 != uintmax;
-
-    if (hasUV1) {
-        vbb
-            .attribute(VertexAttribute::UV1, 0, VertexBuffer::AttributeType::HALF2,
-                    header->offsetUV1, uint8_t(header->strideUV1))
-            .normalized(VertexAttribute::UV1);
-    }
-
-    mesh.vertexBuffer = vbb.build(*engine);
-
-    // If the vertex buffer is compressed, then decode the vertices into a temporary buffer.
-    // The user callback can be called immediately afterwards because the source data does not get
-    // passed to the GPU.
     const size_t verticesSize = header->vertexSize;
     if (header->flags & COMPRESSION) {
         size_t vertexSize = sizeof(half4) + sizeof(short4) + sizeof(ubyte4) + sizeof(ushort2) +
-                (hasUV1 ? sizeof(ushort2) : 0);
+                (mesh.hasUV1 ? sizeof(ushort2) : 0);
         size_t vertexCount = header->vertexCount;
         size_t uncompressedSize = vertexSize * vertexCount;
         void* uncompressed = malloc(uncompressedSize);
@@ -334,26 +350,83 @@ MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
                 err |= decode(dstdata, vertexCount, sizeof(ushort2), srcdata, sizes->uv1);
             }
         }
-        if (err) {
-            utils::slog.e << "Unable to decode vertex buffer." << utils::io::endl;
-            return {};
-        }
         if (destructor) {
             destructor((void*) vertexData, verticesSize, user);
         }
-        auto freecb = [](void* buffer, size_t size, void* user) { free(buffer); };
-        mesh.vertexBuffer->setBufferAt(*engine, 0,
-                IndexBuffer::BufferDescriptor(uncompressed, uncompressedSize, freecb, nullptr));
+        if (err) {
+            utils::slog.e << "Unable to decode vertex buffer." << utils::io::endl;
+            free(uncompressed);
+            free((void*) mesh.indices);
+            return false;
+        }
+        mesh.vertices = uncompressed;
+        mesh.verticesSize = uncompressedSize;
+        mesh.verticesCallback = freecb;
     } else {
-        mesh.vertexBuffer->setBufferAt(*engine, 0,
-                VertexBuffer::BufferDescriptor(vertexData, verticesSize, destructor, user));
+        mesh.vertices = vertexData;
+        mesh.verticesSize = verticesSize;
+        mesh.verticesCallback = destructor;
+        mesh.verticesUser = user;
     }
 
+    return true;
+}
+
+// Creates the engine objects of a decoded mesh, this must run on the engine's thread.
+static MeshReader::Mesh buildMesh(Engine* engine, DecodedMesh const& decoded,
+        MeshReader::MaterialRegistry& materials) {
+    const Header* header = &decoded.header;
+
+    MeshReader::Mesh mesh;
+
+    mesh.indexBuffer = IndexBuffer::Builder()
+            .indexCount(header->indexCount)
+            .bufferType(header->indexType == UI16 ? IndexBuffer::IndexType::USHORT
+                    : IndexBuffer::IndexType::UINT)
+            .build(*engine);
+
+    mesh.indexBuffer->setBuffer(*engine, IndexBuffer::BufferDescriptor(decoded.indices,
+            decoded.indicesSize, decoded.indicesCallback, decoded.indicesUser));
+
+    VertexBuffer::Builder vbb;
+    vbb.vertexCount(header->vertexCount)
+            .bufferCount(1)
+            .normalized(VertexAttribute::COLOR)
+            .normalized(VertexAttribute::TANGENTS);
+
+    VertexBuffer::AttributeType uvtype = (header->flags & TEXCOORD_SNORM16) ?
+            VertexBuffer::AttributeType::SHORT2 : VertexBuffer::AttributeType::HALF2;
+
+    vbb
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4,
+                        header->offsetPosition, uint8_t(header->stridePosition))
+            .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
+                        header->offsetTangents, uint8_t(header->strideTangents))
+            .attribute(VertexAttribute::COLOR, 0, VertexBuffer::AttributeType::UBYTE4,
+                        header->offsetColor, uint8_t(header->strideColor))
+            .attribute(VertexAttribute::UV0, 0, uvtype,
+                        header->offsetUV0, uint8_t(header->strideUV0))
+            .normalized(VertexAttribute::UV0, header->flags & TEXCOORD_SNORM16);
+
+    if (decoded.hasUV1) {
+        vbb
+            .attribute(VertexAttribute::UV1, 0, VertexBuffer::AttributeType::HALF2,
+                    header->offsetUV1, uint8_t(header->strideUV1))
+            .normalized(VertexAttribute::UV1);
+    }
+
+    mesh.vertexBuffer = vbb.build(*engine);
+
+    mesh.vertexBuffer->setBufferAt(*engine, 0, VertexBuffer::BufferDescriptor(decoded.vertices,
+            decoded.verticesSize, decoded.verticesCallback, decoded.verticesUser));
+
     mesh.renderable = utils::EntityManager::get().create();
 
     RenderableManager::Builder builder(header->parts);
     builder.boundingBox(header->aabb);
 
+    const auto& parts = decoded.parts;
+    const auto& partsMaterial = decoded.partsMaterial;
     const auto defaultmi = materials.getMaterialInstance(utils::CString(DEFAULT_MATERIAL));
     for (size_t i = 0; i < header->parts; i++) {
         builder.geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
@@ -384,4 +457,54 @@ MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
     return mesh;
 }
 
+namespace filamesh {
+
+MeshReader::Mesh MeshReader::loadMeshFromFile(filament::Engine* engine, const utils::Path& path,
+        MaterialRegistry& materials) {
+    MeshFile* file = MeshFile::open(path);
+    if (!file) {
+        return {};
+    }
+    // The buffers release the file once uploaded, there is no need to wait for the engine.
+    return loadMeshFromBuffer(engine, file->data, MeshFile::release, file, materials);
+}
+
+void MeshReader::loadMeshesFromFiles(filament::Engine* engine, utils::JobSystem& js,
+        const utils::Path* paths, size_t count, MaterialRegistry& materials, Mesh* outMeshes) {
+    std::vector<DecodedMesh> decoded(count);
+    std::vector<uint8_t> valid(count);
+
+    auto decodeFiles = [&](uint32_t start, uint32_t n) {
+        for (uint32_t i = start; i < start + n; i++) {
+            MeshFile* file = MeshFile::open(paths[i]);
+            valid[i] = file && decodeMesh(file->data, MeshFile::release, file, decoded[i]);
+        }
+    };
+    auto job = utils::jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::ref(decodeFiles), utils::jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+
+    for (size_t i = 0; i < count; i++) {
+        outMeshes[i] = valid[i] ? buildMesh(engine, decoded[i], materials) : Mesh{};
+    }
+}
+
+MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
+        void const* data, Callback destructor, void* user,
+        MaterialInstance* defaultMaterial) {
+    MaterialRegistry reg;
+    reg.registerMaterialInstance(utils::CString(DEFAULT_MATERIAL), defaultMaterial);
+    return loadMeshFromBuffer(engine, data, destructor, user, reg);
+}
+
+MeshReader::Mesh MeshReader::loadMeshFromBuffer(filament::Engine* engine,
+        void const* data, Callback destructor, void* user,
+        MaterialRegistry& materials) {
+    DecodedMesh decoded;
+    if (!decodeMesh(data, destructor, user, decoded)) {
+        return {};
+    }
+    return buildMesh(engine, decoded, materials);
+}
+
 } // namespace filamesh
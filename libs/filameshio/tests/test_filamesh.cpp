@@ -27,8 +27,12 @@
 #include <math/quat.h>
 #include <math/vec3.h>
 
+#include <utils/JobSystem.h>
+#include <utils/Path.h>
+
 #include <gtest/gtest.h>
 
+#include <fstream>
 #include <sstream>
 
 using namespace filament;
@@ -216,6 +220,75 @@ TEST_F(FilameshTest, Interleaved) {
     engine->destroy(mi);
 }
 
+TEST_F(FilameshTest, FromFiles) {
+    // Serialize a single-triangle mesh with 1 UV set to a file
+    const Header header {
+        .version = VERSION,
+        .parts = 1,
+        .aabb = unitBox,
+        .flags = INTERLEAVED | TEXCOORD_SNORM16,
+        .offsetPosition = offsetof(InterleavedVertex, position),
+        .stridePosition = sizeof(InterleavedVertex),
+        .offsetTangents = offsetof(InterleavedVertex, tangent),
+        .strideTangents = sizeof(InterleavedVertex),
+        .offsetColor = offsetof(InterleavedVertex, color),
+        .strideColor = sizeof(InterleavedVertex),
+        .offsetUV0 = offsetof(InterleavedVertex, uv0),
+        .strideUV0 = sizeof(InterleavedVertex),
+        .offsetUV1 = maxint,
+        .strideUV1 = maxint,
+        .vertexCount = vertexCount,
+        .vertexSize = sizeof(interleavedVertices),
+        .indexType = IndexType::UI16,
+        .indexCount = 3,
+        .indexSize = sizeof(uint16_t) * 3
+    };
+    const uint32_t nmats = 1;
+    const string matname = "DefaultMaterial";
+    const uint32_t matnamelength = matname.size();
+
+    utils::Path path = utils::Path::getTemporaryDirectory() + "test_filamesh.filamesh";
+    {
+        ofstream stream(path.getPath(), ios::binary);
+        write(stream, MAGICID, sizeof(MAGICID));
+        write(stream, &header, sizeof(header));
+        write(stream, interleavedVertices, sizeof(interleavedVertices));
+        write(stream, indices, sizeof(indices));
+        write(stream, parts, sizeof(parts));
+        write(stream, &nmats, sizeof(nmats));
+        write(stream, &matnamelength, sizeof(matnamelength));
+        write(stream, matname.c_str(), matnamelength + 1);
+    }
+
+    MaterialInstance* mi = engine->getDefaultMaterial()->createInstance();
+    MeshReader::MaterialRegistry registry;
+    registry.registerMaterialInstance(utils::CString(matname.c_str()), mi);
+    auto& rm = engine->getRenderableManager();
+
+    auto mesh = MeshReader::loadMeshFromFile(engine, path, registry);
+    EXPECT_EQ(rm.getPrimitiveCount(rm.getInstance(mesh.renderable)), 1);
+    engine->destroy(mesh.renderable);
+
+    // Load the same file twice and a missing file on the job system.
+    utils::JobSystem js;
+    js.adopt();
+    const utils::Path paths[] = { path, "does_not_exist.filamesh", path };
+    MeshReader::Mesh meshes[3];
+    MeshReader::loadMeshesFromFiles(engine, js, paths, 3, registry, meshes);
+    js.emancipate();
+
+    EXPECT_EQ(rm.getPrimitiveCount(rm.getInstance(meshes[0].renderable)), 1);
+    EXPECT_TRUE(meshes[1].renderable.isNull());
+    EXPECT_EQ(meshes[1].vertexBuffer, nullptr);
+    EXPECT_EQ(rm.getPrimitiveCount(rm.getInstance(meshes[2].renderable)), 1);
+    engine->destroy(meshes[0].renderable);
+    engine->destroy(meshes[2].renderable);
+
+    // Cleanup.
+    engine->destroy(mi);
+    path.unlinkFile();
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
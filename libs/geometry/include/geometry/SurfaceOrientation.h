@@ -23,6 +23,10 @@
 
 #include <utils/compiler.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 /**
@@ -84,6 +88,14 @@ public:
         Builder& triangles(const filament::math::uint3*) noexcept;
         Builder& triangles(const filament::math::ushort3*) noexcept;
 
+        /**
+         * Optional job system used to split the work of build() over several threads, which
+         * only pays off for large meshes. build() waits for the jobs, so it can be called from
+         * a job of the same job system. The result does not depend on the number of threads, but
+         * the tangents of meshes with UVs can differ in the last bits from a build without it.
+         */
+        Builder& jobSystem(utils::JobSystem* jobSystem) noexcept;
+
         /**
          * Generates quats or returns null if the submitted data is an incomplete combination.
          */
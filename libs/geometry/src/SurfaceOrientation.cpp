@@ -16,20 +16,31 @@
 
 #include <geometry/SurfaceOrientation.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
 #include <math/mat3.h>
 #include <math/norm.h>
+#include <math/simd.h>
 
+#include <algorithm>
+#include <functional>
 #include <vector>
 
 namespace filament {
 namespace geometry {
 
 using namespace filament::math;
+using namespace utils;
 using std::vector;
 using Builder = SurfaceOrientation::Builder;
 
+// Vertices or triangles processed by a job, below which a loop is not worth splitting.
+static constexpr size_t MIN_ITEMS_PER_JOB = 4096;
+
+// Maximum number of triangle chunks accumulating tangents, see buildWithUvs().
+static constexpr size_t MAX_TRIANGLE_CHUNKS = 16;
+
 struct OrientationBuilderImpl {
     size_t vertexCount = 0;
     const float3* normals = nullptr;
@@ -43,6 +54,7 @@ struct OrientationBuilderImpl {
     size_t uvStride = 0;
     size_t positionStride = 0;
     size_t triangleCount = 0;
+    JobSystem* jobSystem = nullptr;
     SurfaceOrientation* buildWithNormalsOnly();
     SurfaceOrientation* buildWithSuppliedTangents();
     SurfaceOrientation* buildWithUvs();
@@ -110,6 +122,11 @@ Builder& Builder::triangles(const ushort3* triangles) noexcept {
     return *this;
 }
 
+Builder& Builder::jobSystem(JobSystem* jobSystem) noexcept {
+    mImpl->jobSystem = jobSystem;
+    return *this;
+}
+
 SurfaceOrientation* Builder::build() {
     if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->vertexCount > 0, "Vertex count must be non-zero.")) {
         return nullptr;
@@ -151,19 +168,35 @@ static float3 randomPerp(const float3& n) {
     return perp / sqrlen;
 }
 
+// Calls func(start, count) over the range [0, count), split over the job system when there is one
+// and the range is large enough.
+template<typename F>
+static void forEachRange(JobSystem* js, size_t count, F const& func) {
+    if (js && count >= MIN_ITEMS_PER_JOB * 2) {
+        js->runAndWait(jobs::parallel_for(*js, nullptr, 0, uint32_t(count), std::cref(func),
+                jobs::CountSplitter<MIN_ITEMS_PER_JOB>()));
+    } else {
+        func(0, uint32_t(count));
+    }
+}
+
 SurfaceOrientation* OrientationBuilderImpl::buildWithNormalsOnly() {
     vector<quatf> quats(vertexCount);
 
-    const float3* normal = this->normals;
+    const uint8_t* normals = (const uint8_t*) this->normals;
     size_t nstride = this->normalStride ? this->normalStride : sizeof(float3);
 
-    for (size_t qindex = 0; qindex < vertexCount; ++qindex) {
-        float3 n = *normal;
-        float3 b = randomPerp(n);
-        float3 t = cross(n, b);
-        quats[qindex] = mat3f::packTangentFrame({t, b, n});
-        normal = (const float3*) (((const uint8_t*) normal) + nstride);
-    }
+    forEachRange(jobSystem, vertexCount,
+            [&quats, normals, nstride](uint32_t start, uint32_t count) {
+        const float3* normal = (const float3*) (normals + start * nstride);
+        for (size_t qindex = start, end = start + count; qindex < end; ++qindex) {
+            float3 n = *normal;
+            float3 b = randomPerp(n);
+            float3 t = cross(n, b);
+            quats[qindex] = mat3f::packTangentFrame({t, b, n});
+            normal = (const float3*) (((const uint8_t*) normal) + nstride);
+        }
+    });
 
     return new SurfaceOrientation(new OrientationImpl( { std::move(quats) } ));
 }
@@ -171,29 +204,34 @@ SurfaceOrientation* OrientationBuilderImpl::buildWithNormalsOnly() {
 SurfaceOrientation* OrientationBuilderImpl::buildWithSuppliedTangents() {
     vector<quatf> quats(vertexCount);
 
-    const float3* normal = this->normals;
+    const uint8_t* normals = (const uint8_t*) this->normals;
     size_t nstride = this->normalStride ? this->normalStride : sizeof(float3);
 
-    const float3* tanvec = (const float3*) this->tangents;
-    const float* tandir = &this->tangents->w;
+    const uint8_t* tangents = (const uint8_t*) this->tangents;
     size_t tstride = this->tangentStride ? this->tangentStride : sizeof(float4);
 
-    for (size_t qindex = 0; qindex < vertexCount; ++qindex) {
-        float3 n = *normal;
-        float3 t = *tanvec;
-        float3 b = *tandir > 0 ? cross(t, n) : cross(n, t);
-
-        // Some assets do not provide perfectly orthogonal tangents and normals, so we adjust the
-        // tangent to enforce orthonormality. We would rather honor the exact normal vector than
-        // the exact tangent vector since the latter is only used for bump mapping and anisotropic
-        // lighting.
-        t = *tandir > 0 ? cross(n, b) : cross(b, n);
-
-        quats[qindex] = mat3f::packTangentFrame({t, b, n});
-        normal = (const float3*) (((const uint8_t*) normal) + nstride);
-        tanvec = (const float3*) (((const uint8_t*) tanvec) + tstride);
-        tandir = (const float*) (((const uint8_t*) tandir) + tstride);
-    }
+    forEachRange(jobSystem, vertexCount,
+            [&quats, normals, nstride, tangents, tstride](uint32_t start, uint32_t count) {
+        const float3* normal = (const float3*) (normals + start * nstride);
+        const float3* tanvec = (const float3*) (tangents + start * tstride);
+        const float* tandir = &((const float4*) tanvec)->w;
+        for (size_t qindex = start, end = start + count; qindex < end; ++qindex) {
+            float3 n = *normal;
+            float3 t = *tanvec;
+            float3 b = *tandir > 0 ? cross(t, n) : cross(n, t);
+
+            // Some assets do not provide perfectly orthogonal tangents and normals, so we adjust
+            // the tangent to enforce orthonormality. We would rather honor the exact normal vector
+            // than the exact tangent vector since the latter is only used for bump mapping and
+            // anisotropic lighting.
+            t = *tandir > 0 ? cross(n, b) : cross(b, n);
+
+            quats[qindex] = mat3f::packTangentFrame({t, b, n});
+            normal = (const float3*) (((const uint8_t*) normal) + nstride);
+            tanvec = (const float3*) (((const uint8_t*) tanvec) + tstride);
+            tandir = (const float*) (((const uint8_t*) tandir) + tstride);
+        }
+    });
 
     return new SurfaceOrientation(new OrientationImpl( { std::move(quats) } ));
 }
@@ -220,66 +258,120 @@ SurfaceOrientation* OrientationBuilderImpl::buildWithUvs() {
     if (!ASSERT_PRECONDITION_NON_FATAL(this->positionStride == 0, "Non-zero positions stride not yet supported.")) {
         return nullptr;
     }
-    vector<float3> tan1(vertexCount);
-    vector<float3> tan2(vertexCount);
-    memset(tan1.data(), 0, sizeof(float3) * vertexCount);
-    memset(tan2.data(), 0, sizeof(float3) * vertexCount);
-    for (size_t a = 0; a < triangleCount; ++a) {
-        uint3 tri = triangles16 ? uint3(triangles16[a]) : triangles32[a];
-        const float3& v1 = positions[tri.x];
-        const float3& v2 = positions[tri.y];
-        const float3& v3 = positions[tri.z];
-        const float2& w1 = uvs[tri.x];
-        const float2& w2 = uvs[tri.y];
-        const float2& w3 = uvs[tri.z];
-        float x1 = v2.x - v1.x;
-        float x2 = v3.x - v1.x;
-        float y1 = v2.y - v1.y;
-        float y2 = v3.y - v1.y;
-        float z1 = v2.z - v1.z;
-        float z2 = v3.z - v1.z;
-        float s1 = w2.x - w1.x;
-        float s2 = w3.x - w1.x;
-        float t1 = w2.y - w1.y;
-        float t2 = w3.y - w1.y;
-        float d = s1 * t2 - s2 * t1;
-        float3 sdir, tdir;
-        // In general we can't guarantee smooth tangents when the UV's are non-smooth, but let's at
-        // least avoid divide-by-zero and fall back to normals-only method.
-        if (d == 0.0) {
-            const float3& n1 = normals[tri.x];
-            sdir = randomPerp(n1);
-            tdir = cross(n1, sdir);
-        } else {
-            sdir = {t2 * x1 - t1 * x2, t2 * y1 - t1 * y2, t2 * z1 - t1 * z2};
-            tdir = {s1 * x2 - s2 * x1, s1 * y2 - s2 * y1, s1 * z2 - s2 * z1};
-            float r = 1.0f / d;
-            sdir *= r;
-            tdir *= r;
+    // Each chunk of consecutive triangles accumulates the tangents of the vertices it references
+    // into its own buffers, which only cover the range of indices of these vertices. The chunks
+    // are built in parallel, then summed per vertex in chunk order. Without a job system a single
+    // chunk spans all the triangles.
+    struct Chunk {
+        size_t first = 0;
+        size_t count = 0;
+        uint32_t minIndex = 0;
+        uint32_t maxIndex = 0;
+        vector<float3> tan1;
+        vector<float3> tan2;
+    };
+    const size_t chunkSize = jobSystem ?
+            std::max(MIN_ITEMS_PER_JOB, (triangleCount + MAX_TRIANGLE_CHUNKS - 1) /
+                    MAX_TRIANGLE_CHUNKS) : std::max(triangleCount, size_t(1));
+    vector<Chunk> chunks((triangleCount + chunkSize - 1) / chunkSize);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        chunks[i].first = i * chunkSize;
+        chunks[i].count = std::min(chunkSize, triangleCount - chunks[i].first);
+    }
+
+    auto getTriangle = [this](size_t a) {
+        return triangles16 ? uint3(triangles16[a]) : triangles32[a];
+    };
+
+    auto accumulate = [this, &chunks, &getTriangle](uint32_t start, uint32_t count) {
+        for (size_t i = start, end = start + count; i < end; ++i) {
+            Chunk& chunk = chunks[i];
+            uint32_t minIndex = std::numeric_limits<uint32_t>::max();
+            uint32_t maxIndex = 0;
+            for (size_t a = chunk.first, e = chunk.first + chunk.count; a < e; ++a) {
+                uint3 tri = getTriangle(a);
+                minIndex = std::min({ minIndex, tri.x, tri.y, tri.z });
+                maxIndex = std::max({ maxIndex, tri.x, tri.y, tri.z });
+            }
+            chunk.minIndex = minIndex;
+            chunk.maxIndex = maxIndex;
+            chunk.tan1.resize(maxIndex - minIndex + 1);
+            chunk.tan2.resize(maxIndex - minIndex + 1);
+            vector<float3>& tan1 = chunk.tan1;
+            vector<float3>& tan2 = chunk.tan2;
+            for (size_t a = chunk.first, e = chunk.first + chunk.count; a < e; ++a) {
+                uint3 tri = getTriangle(a);
+                const uint3 local = tri - minIndex;
+                const float3& v1 = positions[tri.x];
+                const float3& v2 = positions[tri.y];
+                const float3& v3 = positions[tri.z];
+                const float2& w1 = uvs[tri.x];
+                const float2& w2 = uvs[tri.y];
+                const float2& w3 = uvs[tri.z];
+                float x1 = v2.x - v1.x;
+                float x2 = v3.x - v1.x;
+                float y1 = v2.y - v1.y;
+                float y2 = v3.y - v1.y;
+                float z1 = v2.z - v1.z;
+                float z2 = v3.z - v1.z;
+                float s1 = w2.x - w1.x;
+                float s2 = w3.x - w1.x;
+                float t1 = w2.y - w1.y;
+                float t2 = w3.y - w1.y;
+                float d = s1 * t2 - s2 * t1;
+                float3 sdir, tdir;
+                // In general we can't guarantee smooth tangents when the UV's are non-smooth, but
+                // let's at least avoid divide-by-zero and fall back to normals-only method.
+                if (d == 0.0) {
+                    const float3& n1 = normals[tri.x];
+                    sdir = randomPerp(n1);
+                    tdir = cross(n1, sdir);
+                } else {
+                    sdir = {t2 * x1 - t1 * x2, t2 * y1 - t1 * y2, t2 * z1 - t1 * z2};
+                    tdir = {s1 * x2 - s2 * x1, s1 * y2 - s2 * y1, s1 * z2 - s2 * z1};
+                    float r = 1.0f / d;
+                    sdir *= r;
+                    tdir *= r;
+                }
+                tan1[local.x] += sdir;
+                tan1[local.y] += sdir;
+                tan1[local.z] += sdir;
+                tan2[local.x] += tdir;
+                tan2[local.y] += tdir;
+                tan2[local.z] += tdir;
+            }
         }
-        tan1[tri.x] += sdir;
-        tan1[tri.y] += sdir;
-        tan1[tri.z] += sdir;
-        tan2[tri.x] += tdir;
-        tan2[tri.y] += tdir;
-        tan2[tri.z] += tdir;
+    };
+    if (jobSystem && chunks.size() > 1) {
+        jobSystem->runAndWait(jobs::parallel_for(*jobSystem, nullptr, 0, uint32_t(chunks.size()),
+                std::cref(accumulate), jobs::CountSplitter<1>()));
+    } else {
+        accumulate(0, uint32_t(chunks.size()));
     }
 
     vector<quatf> quats(vertexCount);
-    for (size_t a = 0; a < vertexCount; a++) {
-        const float3& n = normals[a];
-        const float3& t1 = tan1[a];
-        const float3& t2 = tan2[a];
-
-        // Gram-Schmidt orthogonalize
-        float3 t = normalize(t1 - n * dot(n, t1));
-
-        // Calculate handedness
-        float w = (dot(cross(n, t1), t2) < 0.0f) ? -1.0f : 1.0f;
-
-        float3 b = w < 0 ? cross(t, n) : cross(n, t);
-        quats[a] = mat3f::packTangentFrame({t, b, n});
-    }
+    forEachRange(jobSystem, vertexCount, [this, &chunks, &quats](uint32_t start, uint32_t count) {
+        for (size_t a = start, e = start + count; a < e; a++) {
+            const float3& n = normals[a];
+            float3 t1{};
+            float3 t2{};
+            for (const Chunk& chunk : chunks) {
+                if (a >= chunk.minIndex && a <= chunk.maxIndex) {
+                    t1 += chunk.tan1[a - chunk.minIndex];
+                    t2 += chunk.tan2[a - chunk.minIndex];
+                }
+            }
+
+            // Gram-Schmidt orthogonalize
+            float3 t = normalize(t1 - n * dot(n, t1));
+
+            // Calculate handedness
+            float w = (dot(cross(n, t1), t2) < 0.0f) ? -1.0f : 1.0f;
+
+            float3 b = w < 0 ? cross(t, n) : cross(n, t);
+            quats[a] = mat3f::packTangentFrame({t, b, n});
+        }
+    });
     return new SurfaceOrientation(new OrientationImpl( { std::move(quats) } ));
 }
 
@@ -314,6 +406,10 @@ void SurfaceOrientation::getQuats(short4* out, size_t quatCount, size_t stride)
     const vector<quatf>& in = mImpl->quaternions;
     quatCount = std::min(quatCount, in.size());
     stride = stride ? stride : sizeof(decltype(*out));
+    if (stride == sizeof(decltype(*out))) {
+        simd::packSnorm16(out, in.data(), quatCount);
+        return;
+    }
     for (size_t i = 0; i < quatCount; ++i) {
         *out = packSnorm16(in[i].xyzw);
         out = (decltype(out)) (((uint8_t*) out) + stride);
@@ -324,6 +420,10 @@ void SurfaceOrientation::getQuats(quath* out, size_t quatCount, size_t stride) c
     const vector<quatf>& in = mImpl->quaternions;
     quatCount = std::min(quatCount, in.size());
     stride = stride ? stride : sizeof(decltype(*out));
+    if (stride == sizeof(decltype(*out))) {
+        simd::packHalf(out, in.data(), quatCount);
+        return;
+    }
     for (size_t i = 0; i < quatCount; ++i) {
         *out = quath(in[i]);
         out = (decltype(out)) (((uint8_t*) out) + stride);
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filament/Engine.h>
+
+#include <gltfio/AssetLoader.h>
+#include <gltfio/FilamentAsset.h>
+#include <gltfio/MaterialProvider.h>
+#include <gltfio/ResourceLoader.h>
+
+#include <getopt/getopt.h>
+
+#include <utils/EntityManager.h>
+#include <utils/NameComponentManager.h>
+#include <utils/Path.h>
+
+#include <cgltf.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+using namespace filament;
+using namespace gltfio;
+using namespace utils;
+
+using clock_type = std::chrono::steady_clock;
+
+struct Config {
+    Engine::Backend backend = Engine::Backend::NOOP;
+    bool ubershader = false;
+    size_t iterations = 5;
+    std::string csvPath;
+};
+
+// Times spent loading a file, in seconds. The phases of ResourceLoader are its LoadTimings.
+struct Timings {
+    float parsing = 0;              // cgltf_parse() alone
+    float materialInstances = 0;    // MaterialProvider::createMaterialInstance()
+    float asset = 0;                // the rest of AssetLoader::createAssetFromBinary()
+    ResourceLoader::LoadTimings resources;
+    float gpuUpload = 0;            // waiting for the backend to process the uploads
+};
+
+static constexpr size_t PHASE_COUNT = 12;
+
+static const char* const PHASE_NAMES[PHASE_COUNT] = {
+        "parsing", "asset", "material instances", "buffers", "meshopt", "draco", "meshes",
+        "upload", "tangents", "textures", "other", "gpu upload"
+};
+
+static void getPhases(Timings const& t, float phases[PHASE_COUNT]) {
+    const ResourceLoader::LoadTimings& r = t.resources;
+    const float values[PHASE_COUNT] = {
+            t.parsing, t.asset, t.materialInstances, r.buffers, r.meshopt, r.draco, r.meshes,
+            r.upload, r.tangents, r.textures, r.other, t.gpuUpload
+    };
+    std::copy_n(values, PHASE_COUNT, phases);
+}
+
+// Forwards to another provider, timing the creation of the material instances.
+class TimedMaterialProvider : public MaterialProvider {
+public:
+    explicit TimedMaterialProvider(MaterialProvider* provider) : mProvider(provider) {}
+
+    MaterialSource getSource() const noexcept override {
+        return mProvider->getSource();
+    }
+
+    MaterialInstance* createMaterialInstance(MaterialKey* config, UvMap* uvmap,
+            const char* label) override {
+        const auto start = clock_type::now();
+        MaterialInstance* mi = mProvider->createMaterialInstance(config, uvmap, label);
+        mTime += std::chrono::duration<float>(clock_type::now() - start).count();
+        return mi;
+    }
+
+    const Material* const* getMaterials() const noexcept override {
+        return mProvider->getMaterials();
+    }
+
+    size_t getMaterialsCount() const noexcept override {
+        return mProvider->getMaterialsCount();
+    }
+
+    void destroyMaterials() override {
+        mProvider->destroyMaterials();
+    }
+
+    // returns the time spent since the last call, in seconds
+    float takeTime() noexcept {
+        const float time = mTime;
+        mTime = 0;
+        return time;
+    }
+
+private:
+    MaterialProvider* mProvider;
+    float mTime = 0;
+};
+
+static void printUsage(const char* name) {
+    std::string execName(Path(name).getName());
+    std::string usage(
+            "BENCHMARK_GLTFIO measures the time spent in each phase of loading glTF binary files\n"
+            "Usage:\n"
+            "    BENCHMARK_GLTFIO [options] <glb file> [<glb file> ...]\n"
+            "\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Print this message\n\n"
+            "   --api, -a\n"
+            "       Specify the backend API: noop (default), opengl, vulkan, or metal\n\n"
+            "   --iterations=<count>, -n <count>\n"
+            "       Load each file the given number of times, 5 by default. The first load\n"
+            "       includes the creation of the materials\n\n"
+            "   --ubershader, -u\n"
+            "       Use the ubershader materials instead of generating them\n\n"
+            "   --csv=<path>, -c <path>\n"
+            "       Also write the mean times to the given CSV file\n\n"
+    );
+    const std::string from("BENCHMARK_GLTFIO");
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    std::cout << usage;
+}
+
+static int handleArguments(int argc, char* argv[], Config* config) {
+    static constexpr const char* OPTSTR = "ha:n:uc:";
+    static const struct option OPTIONS[] = {
+            { "help",       no_argument,       nullptr, 'h' },
+            { "api",        required_argument, nullptr, 'a' },
+            { "iterations", required_argument, nullptr, 'n' },
+            { "ubershader", no_argument,       nullptr, 'u' },
+            { "csv",        required_argument, nullptr, 'c' },
+            { nullptr, 0, nullptr, 0 }
+    };
+    int opt;
+    int optionIndex = 0;
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'a':
+                if (arg == "noop") {
+                    config->backend = Engine::Backend::NOOP;
+                } else if (arg == "opengl") {
+                    config->backend = Engine::Backend::OPENGL;
+                } else if (arg == "vulkan") {
+                    config->backend = Engine::Backend::VULKAN;
+                } else if (arg == "metal") {
+                    config->backend = Engine::Backend::METAL;
+                } else {
+                    std::cerr << "Unrecognized backend. "
+                            "Must be 'noop'|'opengl'|'vulkan'|'metal'.\n";
+                }
+                break;
+            case 'n':
+                config->iterations = std::max(1, std::stoi(arg));
+                break;
+            case 'u':
+                config->ubershader = true;
+                break;
+            case 'c':
+                config->csvPath = arg;
+                break;
+        }
+    }
+    return optind;
+}
+
+static bool readFile(const Path& path, std::vector<uint8_t>* content) {
+    std::ifstream in(path.getPath(), std::ifstream::binary | std::ifstream::ate);
+    if (!in) {
+        return false;
+    }
+    content->resize(size_t(in.tellg()));
+    in.seekg(0);
+    return bool(in.read((char*) content->data(), std::streamsize(content->size())));
+}
+
+static bool loadFile(Engine* engine, AssetLoader* loader, TimedMaterialProvider* materials,
+        const Path& path, std::vector<uint8_t> const& content, Timings* timings) {
+    // cgltf_parse() is timed on its own, createAssetFromBinary() parses the content again
+    auto start = clock_type::now();
+    cgltf_options options{};
+    cgltf_data* data = nullptr;
+    cgltf_result result = cgltf_parse(&options, content.data(), content.size(), &data);
+    timings->parsing = std::chrono::duration<float>(clock_type::now() - start).count();
+    cgltf_free(data);
+    if (result != cgltf_result_success) {
+        std::cerr << "Unable to parse " << path << std::endl;
+        return false;
+    }
+
+    materials->takeTime();
+    start = clock_type::now();
+    FilamentAsset* asset = loader->createAssetFromBinary(content.data(), uint32_t(content.size()));
+    const float assetTime = std::chrono::duration<float>(clock_type::now() - start).count();
+    if (!asset) {
+        std::cerr << "Unable to load " << path << std::endl;
+        return false;
+    }
+    timings->materialInstances = materials->takeTime();
+    timings->asset = std::max(0.0f, assetTime - timings->parsing - timings->materialInstances);
+
+    const std::string gltfPath = path.getAbsolutePath();
+    ResourceConfiguration configuration = {};
+    configuration.engine = engine;
+    configuration.gltfPath = gltfPath.c_str();
+    configuration.normalizeSkinningWeights = true;
+    ResourceLoader resourceLoader(configuration);
+    const bool loaded = resourceLoader.loadResources(asset);
+    timings->resources = resourceLoader.getLoadTimings();
+
+    start = clock_type::now();
+    engine->flushAndWait();
+    timings->gpuUpload = std::chrono::duration<float>(clock_type::now() - start).count();
+
+    loader->destroyAsset(asset);
+    engine->flushAndWait();
+    if (!loaded) {
+        std::cerr << "Unable to load the resources of " << path << std::endl;
+    }
+    return loaded;
+}
+
+int main(int argc, char* argv[]) {
+    Config config;
+    const int optionIndex = handleArguments(argc, argv, &config);
+    if (optionIndex >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    Engine* engine = Engine::create(config.backend);
+    if (!engine) {
+        std::cerr << "Unable to create the engine" << std::endl;
+        return 1;
+    }
+    MaterialProvider* provider = config.ubershader ?
+            createUbershaderLoader(engine) : createMaterialGenerator(engine);
+    TimedMaterialProvider materials(provider);
+    NameComponentManager names(EntityManager::get());
+    AssetLoader* loader = AssetLoader::create({ engine, &materials, &names });
+
+    std::ofstream csv;
+    if (!config.csvPath.empty()) {
+        csv.open(config.csvPath);
+        csv << "file";
+        for (const char* name : PHASE_NAMES) {
+            csv << "," << name;
+        }
+        csv << "\n";
+    }
+
+    int status = 0;
+    for (int i = optionIndex; i < argc; i++) {
+        const Path path(argv[i]);
+        std::vector<uint8_t> content;
+        if (!readFile(path, &content)) {
+            std::cerr << "Unable to read " << path << std::endl;
+            status = 1;
+            continue;
+        }
+
+        float mean[PHASE_COUNT] = {};
+        float min[PHASE_COUNT];
+        std::fill_n(min, PHASE_COUNT, std::numeric_limits<float>::max());
+        bool loaded = true;
+        for (size_t n = 0; n < config.iterations && loaded; n++) {
+            Timings timings;
+            loaded = loadFile(engine, loader, &materials, path, content, &timings);
+            float phases[PHASE_COUNT];
+            getPhases(timings, phases);
+            for (size_t p = 0; p < PHASE_COUNT; p++) {
+                mean[p] += phases[p] / float(config.iterations);
+                min[p] = std::min(min[p], phases[p]);
+            }
+        }
+        if (!loaded) {
+            status = 1;
+            continue;
+        }
+
+        std::cout << path.getName() << " (" << content.size() / 1024 << " KiB, "
+                << config.iterations << " iterations), mean / min in ms:\n";
+        float total = 0;
+        for (size_t p = 0; p < PHASE_COUNT; p++) {
+            std::cout << "    " << std::left << std::setw(20) << PHASE_NAMES[p] << std::right
+                    << std::fixed << std::setprecision(3)
+                    << std::setw(10) << mean[p] * 1e3f
+                    << std::setw(10) << min[p] * 1e3f << "\n";
+            total += mean[p];
+        }
+        std::cout << "    " << std::left << std::setw(20) << "total" << std::right
+                << std::setw(10) << total * 1e3f << "\n\n";
+
+        if (csv.is_open()) {
+            csv << path.getName();
+            for (float value : mean) {
+                csv << "," << value * 1e3f;
+            }
+            csv << "\n";
+        }
+    }
+
+    AssetLoader::destroy(&loader);
+    materials.destroyMaterials();
+    delete provider;
+    Engine::destroy(&engine);
+    return status;
+}
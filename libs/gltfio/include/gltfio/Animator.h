@@ -20,6 +20,12 @@
 #include <gltfio/FilamentAsset.h>
 #include <gltfio/FilamentInstance.h>
 
+#include <stddef.h>
+
+namespace filament {
+    class Engine;
+}
+
 namespace gltfio {
 
 struct FFilamentAsset;
@@ -47,6 +53,58 @@ public:
      */
     void applyAnimation(size_t animationIndex, float time) const;
 
+    /** An animation to blend with blendAnimations(). */
+    struct AnimationLayer {
+        size_t animationIndex;      //!< Zero-based index for the \c animation of interest.
+        float time;                 //!< Elapsed time of interest in seconds.
+        float weight;               //!< Weight of the animation in the blend.
+    };
+
+    /**
+     * Blends several animations, e.g. to cross-fade between them, and applies the result like
+     * applyAnimation().
+     *
+     * The interpolated translations, rotations, scales and morph weights of all the layers are
+     * accumulated per target with their weights, then the transform of each target is set once.
+     * Where the weights add up to less than 1, the current transform of the target makes up for
+     * the rest, otherwise the result is normalized by the total weight. Layers with a weight of
+     * 0 or less are skipped.
+     *
+     * @param layers The animations to blend.
+     * @param count Number of layers.
+     */
+    void blendAnimations(const AnimationLayer* layers, size_t count) const;
+
+    /** An animation to apply with applyAnimations(). */
+    struct AnimationEntry {
+        const Animator* animator;   //!< Animator of the asset or instance to animate.
+        size_t animationIndex;      //!< Zero-based index for the \c animation of interest.
+        float time;                 //!< Elapsed time of interest in seconds.
+        float weight = 1.0f;        //!< Less than 1 blends the animation into the current pose.
+    };
+
+    /**
+     * Applies several animations at once, typically to many instances, then updates the bone
+     * matrices of their animators.
+     *
+     * The channels of the animations are evaluated in parallel on the JobSystem of the engine,
+     * the local transforms are set in a single transaction of filament::TransformManager, and the
+     * bone matrices of each animator are computed in parallel.
+     *
+     * Entries are applied in order, an entry with a weight lower than 1 is blended into the pose
+     * set by the previous entries, so several animations of an instance can be cross-faded.
+     * Morph weights are not blended, they are set by the entries with a positive weight.
+     *
+     * An animation of an Animator must not be in several entries, and an Animator of an asset
+     * must not be used along with the Animators of its instances.
+     *
+     * @param engine The engine of the assets, whose JobSystem is used.
+     * @param entries The animations to apply.
+     * @param count Number of entries.
+     */
+    static void applyAnimations(filament::Engine& engine, const AnimationEntry* entries,
+            size_t count);
+
     /**
      * Computes root-to-node transforms for all bone nodes, then passes
      * the results into filament::RenderableManager::setBones.
@@ -58,6 +58,35 @@ struct AssetConfiguration {
 
     //! Optional default node name for anonymous nodes
     char* defaultNodeName = nullptr;
+
+    //! Shares the material instances of identical untextured glTF materials across all the assets
+    //! and instances created by the loader, which then don't own them. Changing the parameters of
+    //! a shared material instance affects all the assets that use it.
+    bool shareMaterialInstances = false;
+
+    //! Stores float positions as normalized 16 bits integers relative to the bounding box of
+    //! their mesh, and float texture coordinates as half floats. The positions of skinned,
+    //! morphed and level of detail meshes are not quantized. This relies on the min / max
+    //! properties of the position accessors, which ResourceLoader can't recompute.
+    bool quantizeVertices = false;
+
+    //! Copies the float positions of interleaved vertex data into a tightly packed buffer, so
+    //! that depth and shadow passes, which only read the positions, don't fetch the other
+    //! attributes with them. This uses more memory, since the interleaved data is kept for the
+    //! other attributes. Quantized positions are always packed.
+    bool separatePositions = false;
+
+    //! Reorders the triangles of the meshes for the vertex cache and for overdraw, and their
+    //! vertices for fetch locality, on JobSystem workers when ResourceLoader loads the asset.
+    //! 32 bits indices are stored as 16 bits when possible. The data is rewritten in place, so the
+    //! primitives sharing buffer views with others are not reordered.
+    bool optimizeMeshes = false;
+
+    //! Splits the triangles of the meshes into clusters of up to 64 vertices and 124 triangles,
+    //! with their bounds and normal cone, so that the renderer culls them individually (see
+    //! RenderableManager::Cluster). This implies optimizeMeshes and only applies to the
+    //! primitives that it reorders.
+    bool clusterMeshes = false;
 };
 
 /**
@@ -178,6 +207,33 @@ public:
     FilamentAsset* createInstancedAsset(const uint8_t* bytes, uint32_t numBytes,
             FilamentInstance** instances, size_t numInstances);
 
+    /**
+     * Adds an instance to an asset created with createInstancedAsset().
+     *
+     * The new instance shares the material instances, vertex buffers and textures of the asset,
+     * only its entities, transform components and renderable components are created. The
+     * entities and components of instances removed with destroyInstance() are reused first, in
+     * which case the source data of the asset isn't needed and nothing is created.
+     *
+     * Otherwise this must be called before FilamentAsset::releaseSourceData(). The entities of
+     * the new instance are not part of the asset's Animator, nor of popRenderables() once the
+     * resources are loaded: add them to the scene with Scene::addEntities() and animate them
+     * with FilamentInstance::getAnimator().
+     *
+     * @param asset the primary asset, which has ownership over the new instance
+     * @return the added instance
+     */
+    FilamentInstance* createInstance(FilamentAsset* asset);
+
+    /**
+     * Removes an instance from its asset.
+     *
+     * The entities and components of the instance are kept by the asset and reused by the next
+     * call to createInstance(), they are destroyed with the asset. Remove them from the scene
+     * first, for instance with Scene::removeEntities().
+     */
+    void destroyInstance(FilamentInstance* instance);
+
     /**
      * Takes a pointer to an opaque pipeline object and returns a bundle of Filament objects.
      *
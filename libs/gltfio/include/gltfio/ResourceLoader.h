@@ -28,6 +28,7 @@ namespace filament {
 namespace gltfio {
 
 struct FFilamentAsset;
+class AssetCache;
 class AssetPool;
 
 /**
@@ -50,6 +51,31 @@ struct ResourceConfiguration {
     //! If true, computes the bounding boxes of all \c POSITION attibutes. Well formed glTF files
     //! do not need this, but it is useful for robustness.
     bool recomputeBoundingBoxes;
+
+    //! If true, the buffer files referenced by the glTF file are memory-mapped rather than read
+    //! into memory. Their pages are only loaded when used, and the pages of the vertex and index
+    //! data are paged out once uploaded to the GPU (Linux 5.4 and newer), which lowers the peak
+    //! memory usage of large scenes. Only supported on platforms with a file system and mmap(),
+    //! ignored otherwise.
+    bool memoryMapBuffers;
+
+    //! Maximum number of texel bytes that each call to ResourceLoader::asyncUpdateLoad() uploads,
+    //! or 0 for no limit. The decoded textures that don't fit are uploaded by the following calls,
+    //! base color textures first and occlusion textures last. At least one texture is uploaded
+    //! per call.
+    size_t asyncUploadBudget;
+
+    //! Optional path of a file that caches the processed vertex and index data of the asset, so
+    //! that Draco decoding, skinning weights normalization, tangent generation and bounding box
+    //! computation only happen the first time the asset is loaded. The file is written if it
+    //! doesn't exist or if it was written for different glTF data, which is detected from the
+    //! layout of the data rather than its contents. The string pointer is not retained.
+    const char* cachePath;
+
+    //! If true, the textures of the assets loaded with this loader are shared when their encoded
+    //! images are identical, even across assets. Each texture is decoded and uploaded once, and
+    //! destroyed with the last asset that uses it.
+    bool shareTextures;
 };
 
 /**
@@ -70,6 +96,22 @@ class ResourceLoader {
 public:
     using BufferDescriptor = filament::backend::BufferDescriptor;
 
+    /**
+     * Time spent by the last #loadResources or #asyncBeginLoad in each of its phases, in
+     * seconds, see #getLoadTimings. Uploads only include the CPU side, i.e. handing the data to
+     * the engine, and asynchronous loads don't include the textures decoded in the background.
+     */
+    struct LoadTimings {
+        float buffers = 0;      //!< reading or mapping the buffers
+        float meshopt = 0;      //!< decoding the meshopt compressed buffer views
+        float draco = 0;        //!< decoding the Draco compressed meshes
+        float meshes = 0;       //!< optimizing and clustering the meshes
+        float upload = 0;       //!< uploading the vertex and index buffers
+        float tangents = 0;     //!< computing the tangent frames
+        float textures = 0;     //!< decoding the images and creating the textures
+        float other = 0;        //!< skins, bounding boxes, morph targets and the asset cache
+    };
+
     ResourceLoader(const ResourceConfiguration& config);
     ~ResourceLoader();
 
@@ -80,8 +122,9 @@ public:
      * own (external resources might come from a filesystem, a database, or the internet) so this
      * method allows clients to download external resources and push them to the loader.
      *
-     * Every resource should be passed in before calling #loadResources or #asyncBeginLoad. See
-     * also FilamentAsset#getResourceUris.
+     * Every resource should be passed in before calling #loadResources. #asyncBeginLoad only
+     * needs the buffers, see #hasBufferData: the images added after it are decoded and uploaded as
+     * they arrive, which lets clients stream them in. See also FilamentAsset#getResourceUris.
      *
      * When loading GLB files (as opposed to JSON-based glTF files), clients typically do not
      * need to call this method.
@@ -93,6 +136,12 @@ public:
      */
     bool hasResourceData(const char* uri) const;
 
+    /**
+     * Checks if all the external buffers of the given asset have been added to the URI cache,
+     * which is all that #asyncBeginLoad needs. Always true on platforms with a file system.
+     */
+    bool hasBufferData(const FilamentAsset* asset) const;
+
     /**
      * Loads resources for the given asset from the filesystem or data cache and "finalizes" the
      * asset by transforming the vertex data format if necessary, decoding image files, supplying
@@ -127,6 +176,9 @@ public:
      *
      * Clients must periodically call this until #asyncGetLoadProgress returns 100%.
      * After progress reaches 100%, calling this is harmless; it just does nothing.
+     *
+     * The amount of texel data uploaded by each call can be limited with
+     * ResourceConfiguration::asyncUploadBudget.
      */
     void asyncUpdateLoad();
 
@@ -138,11 +190,18 @@ public:
      */
     void asyncCancelLoad();
 
+    /**
+     * Returns the time spent in each phase of the last resource load, for benchmarking.
+     */
+    LoadTimings getLoadTimings() const;
+
 private:
     bool loadResources(FFilamentAsset* asset, bool async);
     void applySparseData(FFilamentAsset* asset) const;
+    void loadMorphTargets(FFilamentAsset* asset) const;
     void normalizeSkinningWeights(FFilamentAsset* asset) const;
     void updateBoundingBoxes(FFilamentAsset* asset) const;
+    void applyCachedBoundingBoxes(FFilamentAsset* asset, const AssetCache& cache) const;
     AssetPool* mPool;
     struct Impl;
     Impl* pImpl;
@@ -21,10 +21,12 @@
 #include "math.h"
 #include "upcast.h"
 
+#include <filament/Engine.h>
 #include <filament/MaterialEnums.h>
 #include <filament/RenderableManager.h>
 #include <filament/TransformManager.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Log.h>
 
 #include <math/mat4.h>
@@ -33,8 +35,11 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 
-#include <map>
+#include <tsl/robin_map.h>
+
+#include <algorithm>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 using namespace filament;
@@ -44,7 +49,7 @@ using namespace utils;
 
 namespace gltfio {
 
-using TimeValues = std::map<float, size_t>;
+using TimeValues = std::vector<float>;  // sorted, the index of a time is its keyframe
 using SourceValues = std::vector<float>;
 using BoneVector = std::vector<filament::math::mat4f>;
 
@@ -58,6 +63,11 @@ struct Channel {
     const Sampler* sourceData;
     utils::Entity targetEntity;
     enum { TRANSLATION, ROTATION, SCALE, WEIGHTS } transformType;
+
+    // keyframe found by the last sampling of the channel, playback usually finds the next one
+    // right there or just after it. This is only written by the thread that applies animations,
+    // see sampleChannel().
+    mutable size_t cursor = 0;
 };
 
 struct Animation {
@@ -67,23 +77,42 @@ struct Animation {
     vector<Channel> channels;
 };
 
+// Weighted sums of the sampled values targeting an entity, see blendAnimations().
+struct Blend {
+    Entity entity;
+    float3 translation;
+    float4 rotation;        // quaternion, with its sign aligned on the first one
+    float3 scale;
+    float4 morphWeights;
+    uint4 morphTargets;     // targets of the morph weights
+    uint32_t morphTargetCount;
+    float3 trsWeights;      // sum of the weights of the translations, rotations and scales
+    float morphWeight;
+};
+
 struct AnimatorImpl {
     vector<Animation> animations;
     BoneVector boneMatrices;
+    vector<Blend> blends;                           // scratch buffers of blendAnimations()
+    tsl::robin_map<uint32_t, uint32_t> blendIndices;
     FFilamentAsset* asset = nullptr;
     FFilamentInstance* instance = nullptr;
     RenderableManager* renderableManager;
     TransformManager* transformManager;
+
+    void updateBoneMatrices();
+    void setMorphWeights(Entity entity, float4 weights, uint4 targets);
 };
 
 static void createSampler(const cgltf_animation_sampler& src, Sampler& dst) {
-    // Copy the time values into a red-black tree.
+    // Copy the time values into a flat array, glTF requires them to be strictly increasing.
     const cgltf_accessor* timelineAccessor = src.input;
     const uint8_t* timelineBlob = (const uint8_t*) timelineAccessor->buffer_view->buffer->data;
     const float* timelineFloats = (const float*) (timelineBlob + timelineAccessor->offset +
             timelineAccessor->buffer_view->offset);
-    for (size_t i = 0, len = timelineAccessor->count; i < len; ++i) {
-        dst.times[timelineFloats[i]] = i;
+    dst.times.assign(timelineFloats, timelineFloats + timelineAccessor->count);
+    if (!std::is_sorted(dst.times.begin(), dst.times.end())) {
+        slog.w << "Animation sampler times are not increasing." << io::endl;
     }
 
     // Convert source data to float.
@@ -181,7 +210,7 @@ Animator::Animator(FFilamentAsset* asset, FFilamentInstance* instance) {
             Sampler& dstSampler = dstAnim.samplers[j];
             createSampler(srcSampler, dstSampler);
             if (dstSampler.times.size() > 1) {
-                float maxtime = (--dstSampler.times.end())->first;
+                float maxtime = dstSampler.times.back();
                 dstAnim.duration = std::max(dstAnim.duration, maxtime);
             }
         }
@@ -207,147 +236,515 @@ size_t Animator::getAnimationCount() const {
     return mImpl->animations.size();
 }
 
-void Animator::applyAnimation(size_t animationIndex, float time) const {
-    const Animation& anim = mImpl->animations[animationIndex];
-    TransformManager* transformManager = mImpl->transformManager;
-    RenderableManager* renderableManager = mImpl->renderableManager;
-    time = fmod(time, anim.duration);
-    for (const auto& channel : anim.channels) {
-        const Sampler* sampler = channel.sourceData;
-        if (sampler->times.size() < 2) {
-            continue;
-        }
+// Finds the keyframes around the given time and interpolates them. Returns false if the channel
+// has less than 2 keyframes, otherwise its value in 'out': the translation or scale in xyz, the
+// rotation quaternion, or the morph weights. Only the MAX_MORPH_TARGETS most influential morph
+// weights are kept, 'targets' receives the index of their targets.
+// 'cursor' is the keyframe where the search starts, it receives the keyframe found. It's not
+// Channel::cursor itself, so that channels can be sampled in parallel.
+static bool sampleChannel(const Channel& channel, size_t& cursor, float time, float4* out,
+        uint4* targets = nullptr) {
+    const Sampler* sampler = channel.sourceData;
+    if (sampler->times.size() < 2) {
+        return false;
+    }
 
-        TransformManager::Instance node = transformManager->getInstance(channel.targetEntity);
-        const TimeValues& times = sampler->times;
-
-        // Find the first keyframe after the given time, or the keyframe that matches it exactly.
-        TimeValues::const_iterator iter = times.lower_bound(time);
-
-        // Compute the interpolant (between 0 and 1) and determine the keyframe pair.
-        float t = 0.0f;
-        size_t nextIndex;
-        size_t prevIndex;
-        if (iter == times.end()) {
-            nextIndex = times.size() - 1;
-            prevIndex = nextIndex;
-        } else if (iter == times.begin()) {
-            nextIndex = 0;
-            prevIndex = 0;
+    const TimeValues& times = sampler->times;
+
+    // Find the first keyframe after the given time, or the keyframe that matches it exactly.
+    // It's usually the one found last time or the one after, otherwise we search for it.
+    const size_t count = times.size();
+    auto isNext = [&times, count, time](size_t index) {
+        return index < count && times[index] >= time && (index == 0 || times[index - 1] < time);
+    };
+    size_t index = cursor;
+    if (!isNext(index)) {
+        if (isNext(index + 1)) {
+            index++;
         } else {
-            TimeValues::const_iterator prev = iter; --prev;
-            nextIndex = iter->second;
-            prevIndex = prev->second;
-            const float nextTime = iter->first;
-            const float prevTime = prev->first;
-            float deltaTime = nextTime - prevTime;
-            assert(deltaTime >= 0);
-            if (deltaTime > 0) {
-                t = (time - prevTime) / deltaTime;
-            }
+            index = std::lower_bound(times.begin(), times.end(), time) - times.begin();
         }
+    }
+    cursor = index;
+
+    // Compute the interpolant (between 0 and 1) and determine the keyframe pair.
+    float t = 0.0f;
+    size_t nextIndex;
+    size_t prevIndex;
+    if (index == count) {
+        nextIndex = count - 1;
+        prevIndex = nextIndex;
+    } else if (index == 0) {
+        nextIndex = 0;
+        prevIndex = 0;
+    } else {
+        nextIndex = index;
+        prevIndex = index - 1;
+        const float nextTime = times[nextIndex];
+        const float prevTime = times[prevIndex];
+        float deltaTime = nextTime - prevTime;
+        assert(deltaTime >= 0);
+        if (deltaTime > 0) {
+            t = (time - prevTime) / deltaTime;
+        }
+    }
 
-        // Perform the interpolation. This is a simple but inefficient implementation; Filament
-        // stores transforms as mat4's but glTF animation is based on TRS (translation rotation
-        // scale).
-        mat4f xform = transformManager->getTransform(node);
-        float3 scale;
-        quatf rotation;
-        float3 translation;
-        decomposeMatrix(xform, &translation, &rotation, &scale);
+    if (sampler->interpolation == Sampler::STEP) {
+        t = 0.0f;
+    }
 
-        if (sampler->interpolation == Sampler::STEP) {
-            t = 0.0f;
+    switch (channel.transformType) {
+
+        case Channel::SCALE:
+        case Channel::TRANSLATION: {
+            const float3* srcVec3 = (const float3*) sampler->values.data();
+            if (sampler->interpolation == Sampler::CUBIC) {
+                float3 vert0 = srcVec3[prevIndex * 3 + 1];
+                float3 tang0 = srcVec3[prevIndex * 3 + 2];
+                float3 tang1 = srcVec3[nextIndex * 3];
+                float3 vert1 = srcVec3[nextIndex * 3 + 1];
+                out->xyz = cubicSpline(vert0, tang0, vert1, tang1, t);
+            } else {
+                out->xyz = ((1 - t) * srcVec3[prevIndex]) + (t * srcVec3[nextIndex]);
+            }
+            break;
         }
 
-        switch (channel.transformType) {
-
-            case Channel::SCALE: {
-                const float3* srcVec3 = (const float3*) sampler->values.data();
-                if (sampler->interpolation == Sampler::CUBIC) {
-                    float3 vert0 = srcVec3[prevIndex * 3 + 1];
-                    float3 tang0 = srcVec3[prevIndex * 3 + 2];
-                    float3 tang1 = srcVec3[nextIndex * 3];
-                    float3 vert1 = srcVec3[nextIndex * 3 + 1];
-                    scale = cubicSpline(vert0, tang0, vert1, tang1, t);
-                } else {
-                    scale = ((1 - t) * srcVec3[prevIndex]) + (t * srcVec3[nextIndex]);
-                }
-                break;
+        case Channel::ROTATION: {
+            const quatf* srcQuat = (const quatf*) sampler->values.data();
+            quatf rotation;
+            if (sampler->interpolation == Sampler::CUBIC) {
+                quatf vert0 = srcQuat[prevIndex * 3 + 1];
+                quatf tang0 = srcQuat[prevIndex * 3 + 2];
+                quatf tang1 = srcQuat[nextIndex * 3];
+                quatf vert1 = srcQuat[nextIndex * 3 + 1];
+                rotation = normalize(cubicSpline(vert0, tang0, vert1, tang1, t));
+            } else {
+                rotation = slerp(srcQuat[prevIndex], srcQuat[nextIndex], t);
             }
+            *out = rotation.xyzw;
+            break;
+        }
 
-            case Channel::TRANSLATION: {
-                const float3* srcVec3 = (const float3*) sampler->values.data();
-                if (sampler->interpolation == Sampler::CUBIC) {
-                    float3 vert0 = srcVec3[prevIndex * 3 + 1];
-                    float3 tang0 = srcVec3[prevIndex * 3 + 2];
-                    float3 tang1 = srcVec3[nextIndex * 3];
-                    float3 vert1 = srcVec3[nextIndex * 3 + 1];
-                    translation = cubicSpline(vert0, tang0, vert1, tang1, t);
-                } else {
-                    translation = ((1 - t) * srcVec3[prevIndex]) + (t * srcVec3[nextIndex]);
+        case Channel::WEIGHTS: {
+            float4 weights(0, 0, 0, 0);
+            uint4 indices(0, 1, 2, 3);
+            const float* const samplerValues = sampler->values.data();
+            assert(sampler->values.size() % times.size() == 0);
+            const int valuesPerKeyframe = sampler->values.size() / times.size();
+            const bool cubic = sampler->interpolation == Sampler::CUBIC;
+            assert(!cubic || valuesPerKeyframe % 3 == 0);
+            const int numMorphTargets = cubic ? valuesPerKeyframe / 3 : valuesPerKeyframe;
+
+            auto weightAt = [=](int comp) {
+                if (cubic) {
+                    const float* const inTangents = samplerValues;
+                    const float* const splineVerts = samplerValues + numMorphTargets;
+                    const float* const outTangents = samplerValues + numMorphTargets * 2;
+                    float vert0 = splineVerts[comp + prevIndex * valuesPerKeyframe];
+                    float tang0 = outTangents[comp + prevIndex * valuesPerKeyframe];
+                    float tang1 = inTangents[comp + nextIndex * valuesPerKeyframe];
+                    float vert1 = splineVerts[comp + nextIndex * valuesPerKeyframe];
+                    return cubicSpline(vert0, tang0, vert1, tang1, t);
+                }
+                float previous = samplerValues[comp + prevIndex * valuesPerKeyframe];
+                float current = samplerValues[comp + nextIndex * valuesPerKeyframe];
+                return (1 - t) * previous + t * current;
+            };
+
+            const int numComponents = targets ? numMorphTargets :
+                    std::min((int) MAX_MORPH_TARGETS, numMorphTargets);
+            for (int comp = 0; comp < numComponents; ++comp) {
+                const float weight = weightAt(comp);
+                if (comp < (int) MAX_MORPH_TARGETS) {
+                    weights[comp] = weight;
+                    continue;
+                }
+                // replaces the least influential weight kept so far
+                size_t least = 0;
+                for (size_t i = 1; i < MAX_MORPH_TARGETS; i++) {
+                    if (std::abs(weights[i]) < std::abs(weights[least])) {
+                        least = i;
+                    }
+                }
+                if (std::abs(weight) > std::abs(weights[least])) {
+                    weights[least] = weight;
+                    indices[least] = comp;
                 }
-                break;
             }
+            *out = weights;
+            if (targets) {
+                *targets = indices;
+            }
+            break;
+        }
+    }
+    return true;
+}
 
+// Applies sampled channels targeting the same node to its local transform, blended with the
+// given weight. This is a simple but inefficient implementation; Filament stores transforms as
+// mat4's but glTF animation is based on TRS (translation rotation scale).
+static mat4f applySamples(const mat4f& xform, const Channel* const* channels,
+        const float4* samples, size_t count, float weight) {
+    float3 scale;
+    quatf rotation;
+    float3 translation;
+    decomposeMatrix(xform, &translation, &rotation, &scale);
+    const bool blend = weight < 1.0f;
+    for (size_t i = 0; i < count; i++) {
+        const float4& sample = samples[i];
+        switch (channels[i]->transformType) {
+            case Channel::SCALE:
+                scale = blend ? mix(scale, sample.xyz, weight) : sample.xyz;
+                break;
+            case Channel::TRANSLATION:
+                translation = blend ? mix(translation, sample.xyz, weight) : sample.xyz;
+                break;
             case Channel::ROTATION: {
-                const quatf* srcQuat = (const quatf*) sampler->values.data();
-                if (sampler->interpolation == Sampler::CUBIC) {
-                    quatf vert0 = srcQuat[prevIndex * 3 + 1];
-                    quatf tang0 = srcQuat[prevIndex * 3 + 2];
-                    quatf tang1 = srcQuat[nextIndex * 3];
-                    quatf vert1 = srcQuat[nextIndex * 3 + 1];
-                    rotation = normalize(cubicSpline(vert0, tang0, vert1, tang1, t));
-                } else {
-                    rotation = slerp(srcQuat[prevIndex], srcQuat[nextIndex], t);
-                }
+                const quatf q(sample.xyz, sample.w);
+                rotation = blend ? slerp(rotation, q, weight) : q;
                 break;
             }
+            case Channel::WEIGHTS:
+                break;
+        }
+    }
+    return composeMatrix(translation, rotation, scale);
+}
 
-            case Channel::WEIGHTS: {
-                float4 weights(0, 0, 0, 0);
-                const float* const samplerValues = sampler->values.data();
-                assert(sampler->values.size() % times.size() == 0);
-                const int valuesPerKeyframe = sampler->values.size() / times.size();
+void Animator::applyAnimation(size_t animationIndex, float time) const {
+    const Animation& anim = mImpl->animations[animationIndex];
+    TransformManager* transformManager = mImpl->transformManager;
+    time = fmod(time, anim.duration);
+    for (const auto& channel : anim.channels) {
+        float4 sample;
+        uint4 targets;
+        if (!sampleChannel(channel, channel.cursor, time, &sample, &targets)) {
+            continue;
+        }
+        if (channel.transformType == Channel::WEIGHTS) {
+            mImpl->setMorphWeights(channel.targetEntity, sample, targets);
+            continue;
+        }
+        TransformManager::Instance node = transformManager->getInstance(channel.targetEntity);
+        const Channel* pChannel = &channel;
+        mat4f xform = applySamples(transformManager->getTransform(node),
+                &pChannel, &sample, 1, 1.0f);
+        transformManager->setTransform(node, xform);
+    }
+}
 
-                if (sampler->interpolation == Sampler::CUBIC) {
-                    assert(valuesPerKeyframe % 3 == 0);
-                    const int numMorphTargets = valuesPerKeyframe / 3;
-                    const float* const inTangents = samplerValues;
-                    const float* const splineVerts = samplerValues + numMorphTargets;
-                    const float* const outTangents = samplerValues + numMorphTargets * 2;
+// Adds the weight of a morph target to a blend, which keeps the most influential targets.
+static void addMorphWeight(Blend& blend, uint32_t target, float weight) {
+    for (size_t i = 0; i < blend.morphTargetCount; i++) {
+        if (blend.morphTargets[i] == target) {
+            blend.morphWeights[i] += weight;
+            return;
+        }
+    }
+    if (blend.morphTargetCount < MAX_MORPH_TARGETS) {
+        blend.morphTargets[blend.morphTargetCount] = target;
+        blend.morphWeights[blend.morphTargetCount] = weight;
+        blend.morphTargetCount++;
+        return;
+    }
+    size_t least = 0;
+    for (size_t i = 1; i < MAX_MORPH_TARGETS; i++) {
+        if (std::abs(blend.morphWeights[i]) < std::abs(blend.morphWeights[least])) {
+            least = i;
+        }
+    }
+    if (std::abs(weight) > std::abs(blend.morphWeights[least])) {
+        blend.morphTargets[least] = target;
+        blend.morphWeights[least] = weight;
+    }
+}
 
-                    const int numComponents = std::min((int) MAX_MORPH_TARGETS, numMorphTargets);
-                    for (int comp = 0; comp < numComponents; ++comp) {
-                        float vert0 = splineVerts[comp + prevIndex * valuesPerKeyframe];
-                        float tang0 = outTangents[comp + prevIndex * valuesPerKeyframe];
-                        float tang1 = inTangents[comp + nextIndex * valuesPerKeyframe];
-                        float vert1 = splineVerts[comp + nextIndex * valuesPerKeyframe];
-                        weights[comp] = cubicSpline(vert0, tang0, vert1, tang1, t);
+void Animator::blendAnimations(const AnimationLayer* layers, size_t count) const {
+    TransformManager* transformManager = mImpl->transformManager;
+    vector<Blend>& blends = mImpl->blends;
+    auto& blendIndices = mImpl->blendIndices;
+    blends.clear();
+    blendIndices.clear();
+
+    // Accumulate the weighted samples of all the layers, per target.
+    for (size_t i = 0; i < count; i++) {
+        const AnimationLayer& layer = layers[i];
+        const float weight = layer.weight;
+        if (weight <= 0) {
+            continue;
+        }
+        const Animation& anim = mImpl->animations[layer.animationIndex];
+        const float time = fmod(layer.time, anim.duration);
+        for (const auto& channel : anim.channels) {
+            float4 sample;
+            uint4 targets;
+            if (!sampleChannel(channel, channel.cursor, time, &sample, &targets)) {
+                continue;
+            }
+            auto pos = blendIndices.find(channel.targetEntity.getId());
+            if (pos == blendIndices.end()) {
+                pos = blendIndices.insert({ channel.targetEntity.getId(),
+                        uint32_t(blends.size()) }).first;
+                blends.push_back({ channel.targetEntity });
+            }
+            Blend& blend = blends[pos->second];
+            switch (channel.transformType) {
+                case Channel::TRANSLATION:
+                    blend.translation += weight * sample.xyz;
+                    blend.trsWeights.x += weight;
+                    break;
+                case Channel::ROTATION:
+                    // q and -q are the same rotation, but they cancel out when added
+                    blend.rotation += dot(blend.rotation, sample) < 0 ? -weight * sample :
+                            weight * sample;
+                    blend.trsWeights.y += weight;
+                    break;
+                case Channel::SCALE:
+                    blend.scale += weight * sample.xyz;
+                    blend.trsWeights.z += weight;
+                    break;
+                case Channel::WEIGHTS:
+                    for (size_t t = 0; t < MAX_MORPH_TARGETS; t++) {
+                        addMorphWeight(blend, targets[t], weight * sample[t]);
                     }
-                } else {
-                    const int numComponents = std::min((int) MAX_MORPH_TARGETS, valuesPerKeyframe);
-                    for (int comp = 0; comp < numComponents; ++comp) {
-                        float previous = samplerValues[comp + prevIndex * valuesPerKeyframe];
-                        float current = samplerValues[comp + nextIndex * valuesPerKeyframe];
-                        weights[comp] = (1 - t) * previous + t * current;
+                    blend.morphWeight += weight;
+                    break;
+            }
+        }
+    }
+
+    // Write each target once. When the weights add up to less than 1, the current transform
+    // makes up for the rest, otherwise the sums are normalized.
+    transformManager->openLocalTransformTransaction();
+    for (const Blend& blend : blends) {
+        if (any(greaterThan(blend.trsWeights, float3(0)))) {
+            TransformManager::Instance node = transformManager->getInstance(blend.entity);
+            float3 scale;
+            quatf rotation;
+            float3 translation;
+            decomposeMatrix(transformManager->getTransform(node), &translation, &rotation, &scale);
+            const float3 w = blend.trsWeights;
+            if (w.x > 0) {
+                translation = w.x < 1 ? blend.translation + (1 - w.x) * translation :
+                        blend.translation / w.x;
+            }
+            if (w.y > 0) {
+                float4 q = blend.rotation;
+                if (w.y < 1) {
+                    q += dot(q, rotation.xyzw) < 0 ? (w.y - 1) * rotation.xyzw :
+                            (1 - w.y) * rotation.xyzw;
+                }
+                q = normalize(q);
+                rotation = quatf(q.xyz, q.w);
+            }
+            if (w.z > 0) {
+                scale = w.z < 1 ? blend.scale + (1 - w.z) * scale : blend.scale / w.z;
+            }
+            transformManager->setTransform(node, composeMatrix(translation, rotation, scale));
+        }
+        if (blend.morphWeight > 0) {
+            // the current morph weights can't be read back, they count as 0
+            mImpl->setMorphWeights(blend.entity, blend.morphWeight < 1 ?
+                    blend.morphWeights : blend.morphWeights / blend.morphWeight,
+                    blend.morphTargets);
+        }
+    }
+    transformManager->commitLocalTransformTransaction();
+}
+
+void Animator::applyAnimations(Engine& engine, const AnimationEntry* entries, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    TransformManager& transformManager = engine.getTransformManager();
+    JobSystem& js = engine.getJobSystem();
+
+    // Consecutive channels of an animation which target the same node, glTF exporters usually
+    // write the translation, rotation and scale of a node next to each other.
+    struct NodeGroup {
+        TransformManager::Instance node;
+        uint32_t first;
+        uint32_t count;
+        mat4f transform;    // blended into the pose from before applyAnimations()
+    };
+    struct EntryState {
+        float weight;
+        vector<size_t> cursors;             // keyframes found, written back to the channels
+        vector<const Channel*> channels;    // the channels that have a value
+        vector<float4> samples;
+        vector<uint4> morphTargets;         // targets of the morph weights samples, in order
+        vector<NodeGroup> groups;
+    };
+    vector<EntryState> states(count);
+
+    // The channels are sampled and the transforms computed in parallel, this only reads the
+    // TransformManager.
+    auto evaluate = [&](uint32_t startIndex, uint32_t entryCount) {
+        for (size_t i = startIndex, e = startIndex + entryCount; i < e; i++) {
+            const AnimationEntry& entry = entries[i];
+            const Animation& anim = entry.animator->mImpl->animations[entry.animationIndex];
+            const float time = fmod(entry.time, anim.duration);
+            EntryState& state = states[i];
+            state.weight = entry.weight;
+            state.cursors.resize(anim.channels.size());
+            for (size_t j = 0, n = anim.channels.size(); j < n; j++) {
+                const Channel& channel = anim.channels[j];
+                float4 sample;
+                uint4 targets;
+                state.cursors[j] = channel.cursor;
+                if (sampleChannel(channel, state.cursors[j], time, &sample, &targets)) {
+                    state.channels.push_back(&channel);
+                    state.samples.push_back(sample);
+                    if (channel.transformType == Channel::WEIGHTS) {
+                        state.morphTargets.push_back(targets);
                     }
                 }
+            }
+            Entity target;
+            for (uint32_t c = 0, n = state.channels.size(); c < n; c++) {
+                const Channel* channel = state.channels[c];
+                if (channel->transformType == Channel::WEIGHTS) {
+                    target = {};
+                    continue;
+                }
+                if (channel->targetEntity == target && !state.groups.empty()) {
+                    state.groups.back().count++;
+                    continue;
+                }
+                target = channel->targetEntity;
+                state.groups.push_back({ transformManager.getInstance(target), c, 1, {} });
+            }
+            for (NodeGroup& group : state.groups) {
+                group.transform = applySamples(transformManager.getTransform(group.node),
+                        &state.channels[group.first], &state.samples[group.first], group.count,
+                        state.weight);
+            }
+        }
+    };
+    auto* job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(evaluate), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+
+    // The transforms are set in order, the world transforms are only computed once at the end.
+    // A node already set by a previous entry is blended again into its new pose.
+    std::unordered_set<uint32_t> updatedNodes;
+    transformManager.openLocalTransformTransaction();
+    for (size_t i = 0; i < count; i++) {
+        const EntryState& state = states[i];
+        for (const NodeGroup& group : state.groups) {
+            if (!updatedNodes.insert(group.node.asValue()).second) {
+                transformManager.setTransform(group.node,
+                        applySamples(transformManager.getTransform(group.node),
+                                &state.channels[group.first], &state.samples[group.first],
+                                group.count, state.weight));
+            } else {
+                transformManager.setTransform(group.node, group.transform);
+            }
+        }
+        AnimatorImpl* impl = entries[i].animator->mImpl;
+        const Animation& anim = impl->animations[entries[i].animationIndex];
+        for (size_t j = 0, n = anim.channels.size(); j < n; j++) {
+            anim.channels[j].cursor = state.cursors[j];
+        }
+        const uint4* morphTargets = state.morphTargets.data();
+        for (size_t c = 0, n = state.channels.size(); c < n; c++) {
+            const Channel* channel = state.channels[c];
+            if (channel->transformType == Channel::WEIGHTS) {
+                const uint4 targets = *morphTargets++;
+                if (state.weight > 0) {
+                    impl->setMorphWeights(channel->targetEntity, state.samples[c], targets);
+                }
+            }
+        }
+    }
+    transformManager.commitLocalTransformTransaction();
+
+    // Each animator updates its own renderables, with its own scratch buffer.
+    vector<AnimatorImpl*> animators;
+    animators.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        AnimatorImpl* impl = entries[i].animator->mImpl;
+        if (std::find(animators.begin(), animators.end(), impl) == animators.end()) {
+            animators.push_back(impl);
+        }
+    }
+    auto updateBones = [&animators](uint32_t startIndex, uint32_t animatorCount) {
+        for (size_t i = startIndex, e = startIndex + animatorCount; i < e; i++) {
+            animators[i]->updateBoneMatrices();
+        }
+    };
+    job = jobs::parallel_for(js, nullptr, 0, uint32_t(animators.size()),
+            std::cref(updateBones), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+}
 
-                auto renderable = renderableManager->getInstance(channel.targetEntity);
-                renderableManager->setMorphWeights(renderable, weights);
-                continue;
+// The morph attributes of most meshes hold their targets in order. Meshes with more targets hold
+// the most influential ones: a target already held by an attribute stays there, the others are
+// uploaded to the attributes that aren't needed anymore.
+void AnimatorImpl::setMorphWeights(Entity entity, float4 weights, uint4 targets) {
+    auto renderable = renderableManager->getInstance(entity);
+    auto pos = asset->mMorphTargetSetsByEntity.find(entity);
+    if (pos == asset->mMorphTargetSetsByEntity.end()) {
+        float4 ordered(0);
+        for (size_t i = 0; i < MAX_MORPH_TARGETS; i++) {
+            if (weights[i] != 0 && targets[i] < MAX_MORPH_TARGETS) {
+                ordered[targets[i]] = weights[i];
             }
         }
+        renderableManager->setMorphWeights(renderable, ordered);
+        return;
+    }
 
-        xform = composeMatrix(translation, rotation, scale);
-        transformManager->setTransform(node, xform);
+    const vector<size_t>& sets = pos->second;
+    const MorphTargetSet& reference = asset->mMorphTargetSets[sets[0]];
+    int attributeTargets[MAX_MORPH_TARGETS] = { -1, -1, -1, -1 };
+    float4 attributeWeights(0);
+    size_t pending[MAX_MORPH_TARGETS];
+    size_t pendingCount = 0;
+    for (size_t i = 0; i < MAX_MORPH_TARGETS; i++) {
+        if (weights[i] == 0) {
+            continue;
+        }
+        auto held = std::find(reference.boundTargets, reference.boundTargets + MAX_MORPH_TARGETS,
+                int(targets[i]));
+        size_t attribute = held - reference.boundTargets;
+        if (attribute < MAX_MORPH_TARGETS && attributeTargets[attribute] < 0) {
+            attributeTargets[attribute] = int(targets[i]);
+            attributeWeights[attribute] = weights[i];
+        } else {
+            pending[pendingCount++] = i;
+        }
+    }
+    for (size_t attribute = 0, p = 0; p < pendingCount; attribute++) {
+        if (attributeTargets[attribute] < 0) {
+            attributeTargets[attribute] = int(targets[pending[p]]);
+            attributeWeights[attribute] = weights[pending[p]];
+            p++;
+        }
     }
+
+    // the vertex buffers may be shared with other renderables, each of them is checked
+    for (size_t index : sets) {
+        MorphTargetSet& set = asset->mMorphTargetSets[index];
+        if (set.positions.empty()) {
+            continue;   // not loaded yet
+        }
+        for (size_t attribute = 0; attribute < MAX_MORPH_TARGETS; attribute++) {
+            const int target = attributeTargets[attribute];
+            if (target >= 0 && set.boundTargets[attribute] != target) {
+                set.bindTarget(*asset->mEngine, attribute, target);
+            }
+        }
+    }
+    renderableManager->setMorphWeights(renderable, attributeWeights);
 }
 
-void Animator::updateBoneMatrices() {
-    auto renderableManager = mImpl->renderableManager;
-    auto transformManager = mImpl->transformManager;
+void AnimatorImpl::updateBoneMatrices() {
+    auto renderableManager = this->renderableManager;
+    auto transformManager = this->transformManager;
 
     auto update = [=](const SkinVector& skins, BoneVector& boneVector) {
         for (const auto& skin : skins) {
@@ -377,17 +774,21 @@ void Animator::updateBoneMatrices() {
         }
     };
 
-    if (mImpl->instance) {
-        update(mImpl->instance->skins, mImpl->boneMatrices);
-    } else if (mImpl->asset->mInstances.empty()) {
-        update(mImpl->asset->mSkins, mImpl->boneMatrices);
+    if (instance) {
+        update(instance->skins, boneMatrices);
+    } else if (asset->mInstances.empty()) {
+        update(asset->mSkins, boneMatrices);
     } else {
-        for (FFilamentInstance* instance : mImpl->asset->mInstances) {
-            update(instance->skins, mImpl->boneMatrices);
+        for (FFilamentInstance* instance : asset->mInstances) {
+            update(instance->skins, boneMatrices);
         }
     }
 }
 
+void Animator::updateBoneMatrices() {
+    mImpl->updateBoneMatrices();
+}
+
 float Animator::getAnimationDuration(size_t animationIndex) const {
     return mImpl->animations[animationIndex].duration;
 }
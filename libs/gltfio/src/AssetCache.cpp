@@ -0,0 +1,282 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AssetCache.h"
+
+#include <utils/Log.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+using namespace utils;
+
+namespace gltfio {
+
+static constexpr char MAGIC[8] = { 'G', 'L', 'T', 'F', 'I', 'O', 'C', 0 };
+static constexpr uint32_t VERSION = 2;
+
+namespace {
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t bufferCount;
+    uint32_t nodeBoundsCount;
+    uint32_t hasAssetBounds;
+    uint32_t clustersCount;
+    uint32_t reserved;
+    uint64_t key;
+};
+
+struct BufferHeader {
+    uint8_t type;
+    uint8_t bufferIndex;
+    uint16_t reserved;
+    uint32_t ordinal;
+    uint64_t size;
+};
+
+struct FileBounds {
+    uint32_t node;
+    float min[3];
+    float max[3];
+};
+
+struct ClustersHeader {
+    uint32_t mesh;
+    uint32_t primitive;
+    uint64_t count;
+};
+
+using Cluster = RenderableManager::Cluster;
+
+// FNV-1a
+class Hasher {
+public:
+    template<typename T>
+    void add(const T& value) {
+        const uint8_t* bytes = (const uint8_t*) &value;
+        for (size_t i = 0; i < sizeof(T); i++) {
+            mHash = (mHash ^ bytes[i]) * 0x100000001b3ull;
+        }
+    }
+    uint64_t get() const { return mHash; }
+private:
+    uint64_t mHash = 0xcbf29ce484222325ull;
+};
+
+} // anonymous namespace
+
+AssetCache::~AssetCache() {
+    for (Buffer& buffer : mBuffers) {
+        free(buffer.data);
+    }
+}
+
+uint64_t AssetCache::computeKey(const cgltf_data* gltf, uint32_t flags) {
+    Hasher hasher;
+    hasher.add(VERSION);
+    hasher.add(flags);
+    hasher.add(gltf->buffers_count);
+    for (cgltf_size i = 0; i < gltf->buffers_count; i++) {
+        hasher.add(gltf->buffers[i].size);
+    }
+    hasher.add(gltf->buffer_views_count);
+    for (cgltf_size i = 0; i < gltf->buffer_views_count; i++) {
+        const cgltf_buffer_view& view = gltf->buffer_views[i];
+        hasher.add(view.buffer - gltf->buffers);
+        hasher.add(view.offset);
+        hasher.add(view.size);
+        hasher.add(view.stride);
+    }
+    hasher.add(gltf->accessors_count);
+    for (cgltf_size i = 0; i < gltf->accessors_count; i++) {
+        const cgltf_accessor& accessor = gltf->accessors[i];
+        hasher.add(accessor.buffer_view ? accessor.buffer_view - gltf->buffer_views : -1);
+        hasher.add(accessor.component_type);
+        hasher.add(accessor.type);
+        hasher.add(accessor.offset);
+        hasher.add(accessor.count);
+        hasher.add(accessor.is_sparse);
+    }
+    hasher.add(gltf->meshes_count);
+    for (cgltf_size i = 0; i < gltf->meshes_count; i++) {
+        const cgltf_mesh& mesh = gltf->meshes[i];
+        hasher.add(mesh.primitives_count);
+        for (cgltf_size j = 0; j < mesh.primitives_count; j++) {
+            const cgltf_primitive& prim = mesh.primitives[j];
+            hasher.add(prim.indices ? prim.indices - gltf->accessors : -1);
+            hasher.add(prim.has_draco_mesh_compression);
+            hasher.add(prim.attributes_count);
+            for (cgltf_size k = 0; k < prim.attributes_count; k++) {
+                hasher.add(prim.attributes[k].type);
+                hasher.add(prim.attributes[k].index);
+                hasher.add(prim.attributes[k].data - gltf->accessors);
+            }
+            hasher.add(prim.targets_count);
+        }
+    }
+    hasher.add(gltf->nodes_count);
+    for (cgltf_size i = 0; i < gltf->nodes_count; i++) {
+        const cgltf_mesh* mesh = gltf->nodes[i].mesh;
+        hasher.add(mesh ? mesh - gltf->meshes : -1);
+    }
+    return hasher.get();
+}
+
+void AssetCache::addBuffer(BufferType type, uint32_t ordinal, uint8_t bufferIndex,
+        const void* data, size_t size) {
+    void* copy = malloc(size);
+    memcpy(copy, data, size);
+    mBuffers.push_back({ type, bufferIndex, ordinal, size, copy });
+}
+
+void AssetCache::addNodeBounds(uint32_t node, const Aabb& aabb) {
+    mNodeBounds.push_back({ node, aabb });
+}
+
+void AssetCache::setAssetBounds(const Aabb& aabb) {
+    mAssetBounds = aabb;
+    mHasAssetBounds = true;
+}
+
+void AssetCache::addClusters(uint32_t mesh, uint32_t primitive, const Cluster* clusters,
+        size_t count) {
+    mClusters.push_back({ mesh, primitive, { clusters, clusters + count } });
+}
+
+bool AssetCache::write(const char* path, uint64_t key) const {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        slog.w << "Unable to write asset cache " << path << io::endl;
+        return false;
+    }
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.bufferCount = uint32_t(mBuffers.size());
+    header.nodeBoundsCount = uint32_t(mNodeBounds.size());
+    header.hasAssetBounds = mHasAssetBounds;
+    header.clustersCount = uint32_t(mClusters.size());
+    header.key = key;
+    bool success = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (const Buffer& buffer : mBuffers) {
+        const BufferHeader bufferHeader = {
+                uint8_t(buffer.type), buffer.bufferIndex, 0, buffer.ordinal, buffer.size };
+        success = success && fwrite(&bufferHeader, sizeof(bufferHeader), 1, file) == 1;
+        success = success && fwrite(buffer.data, 1, buffer.size, file) == buffer.size;
+    }
+
+    auto writeBounds = [&success, file](uint32_t node, const Aabb& aabb) {
+        const FileBounds bounds = { node,
+                { aabb.min.x, aabb.min.y, aabb.min.z }, { aabb.max.x, aabb.max.y, aabb.max.z } };
+        success = success && fwrite(&bounds, sizeof(bounds), 1, file) == 1;
+    };
+    for (const NodeBounds& nodeBounds : mNodeBounds) {
+        writeBounds(nodeBounds.node, nodeBounds.aabb);
+    }
+    if (mHasAssetBounds) {
+        writeBounds(0, mAssetBounds);
+    }
+
+    for (const PrimitiveClusters& primitive : mClusters) {
+        const ClustersHeader clustersHeader = {
+                primitive.mesh, primitive.primitive, primitive.clusters.size() };
+        const size_t count = primitive.clusters.size();
+        success = success && fwrite(&clustersHeader, sizeof(clustersHeader), 1, file) == 1;
+        success = success &&
+                fwrite(primitive.clusters.data(), sizeof(Cluster), count, file) == count;
+    }
+
+    success = fclose(file) == 0 && success;
+    if (!success) {
+        slog.w << "Unable to write asset cache " << path << io::endl;
+        remove(path);
+    }
+    return success;
+}
+
+bool AssetCache::read(const char* path, uint64_t key) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    FileHeader header;
+    bool success = fread(&header, sizeof(header), 1, file) == 1 &&
+            !memcmp(header.magic, MAGIC, sizeof(MAGIC)) && header.version == VERSION &&
+            header.key == key;
+
+    for (uint32_t i = 0; success && i < header.bufferCount; i++) {
+        BufferHeader bufferHeader;
+        success = fread(&bufferHeader, sizeof(bufferHeader), 1, file) == 1;
+        void* data = success ? malloc(bufferHeader.size) : nullptr;
+        success = data && fread(data, 1, bufferHeader.size, file) == bufferHeader.size;
+        if (!success) {
+            free(data);
+            break;
+        }
+        mBuffers.push_back({ BufferType(bufferHeader.type), bufferHeader.bufferIndex,
+                bufferHeader.ordinal, bufferHeader.size, data });
+    }
+
+    auto readBounds = [&success, file](uint32_t* node, Aabb* aabb) {
+        FileBounds bounds = {};
+        success = success && fread(&bounds, sizeof(bounds), 1, file) == 1;
+        *node = bounds.node;
+        aabb->min = { bounds.min[0], bounds.min[1], bounds.min[2] };
+        aabb->max = { bounds.max[0], bounds.max[1], bounds.max[2] };
+    };
+    for (uint32_t i = 0; success && i < header.nodeBoundsCount; i++) {
+        NodeBounds nodeBounds;
+        readBounds(&nodeBounds.node, &nodeBounds.aabb);
+        mNodeBounds.push_back(nodeBounds);
+    }
+    if (success && header.hasAssetBounds) {
+        uint32_t node;
+        readBounds(&node, &mAssetBounds);
+        mHasAssetBounds = true;
+    }
+
+    for (uint32_t i = 0; success && i < header.clustersCount; i++) {
+        ClustersHeader clustersHeader;
+        success = fread(&clustersHeader, sizeof(clustersHeader), 1, file) == 1;
+        if (!success) {
+            break;
+        }
+        PrimitiveClusters primitive = { clustersHeader.mesh, clustersHeader.primitive };
+        primitive.clusters.resize(clustersHeader.count);
+        success = fread(primitive.clusters.data(), sizeof(Cluster), clustersHeader.count,
+                file) == clustersHeader.count;
+        mClusters.push_back(std::move(primitive));
+    }
+
+    fclose(file);
+    if (!success) {
+        for (Buffer& buffer : mBuffers) {
+            free(buffer.data);
+        }
+        mBuffers.clear();
+        mNodeBounds.clear();
+        mClusters.clear();
+        mHasAssetBounds = false;
+    }
+    return success;
+}
+
+} // namespace gltfio
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GLTFIO_ASSET_CACHE_H
+#define GLTFIO_ASSET_CACHE_H
+
+#include <filament/Box.h>
+#include <filament/RenderableManager.h>
+
+#include <cgltf.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace gltfio {
+
+// Holds the vertex and index data that ResourceLoader uploads once it has been processed, i.e.
+// after Draco decoding, sparse data, skinning weights normalization and tangent generation, as
+// well as the recomputed bounding boxes and the clusters of the primitives. See
+// ResourceConfiguration::cachePath.
+//
+// Vertex and index buffers are identified by their order of first appearance in the buffer slots
+// of the asset, which only depends on the glTF data. The cache file is only valid for the glTF
+// data that it was written for, as checked by the key.
+class AssetCache {
+public:
+    enum class BufferType : uint8_t { VERTEX, INDEX };
+
+    struct Buffer {
+        BufferType type;
+        uint8_t bufferIndex; // for vertex buffers only
+        uint32_t ordinal;
+        size_t size;
+        void* data; // allocated with malloc()
+    };
+
+    struct NodeBounds {
+        uint32_t node;
+        filament::Aabb aabb;
+    };
+
+    struct PrimitiveClusters {
+        uint32_t mesh;
+        uint32_t primitive;
+        std::vector<filament::RenderableManager::Cluster> clusters;
+    };
+
+    AssetCache() = default;
+    AssetCache(const AssetCache&) = delete;
+    AssetCache& operator=(const AssetCache&) = delete;
+    ~AssetCache();
+
+    // Computes the key of the given glTF data, from the layout of its buffers, accessors and
+    // meshes rather than the contents of the buffers, which are not all loaded at this point.
+    static uint64_t computeKey(const cgltf_data* gltf, uint32_t flags);
+
+    // Copies the given data, which is about to be uploaded.
+    void addBuffer(BufferType type, uint32_t ordinal, uint8_t bufferIndex, const void* data,
+            size_t size);
+    void addNodeBounds(uint32_t node, const filament::Aabb& aabb);
+    void setAssetBounds(const filament::Aabb& aabb);
+    void addClusters(uint32_t mesh, uint32_t primitive,
+            const filament::RenderableManager::Cluster* clusters, size_t count);
+
+    bool write(const char* path, uint64_t key) const;
+
+    // Returns false if the file doesn't exist, is corrupted, or was written for another key.
+    bool read(const char* path, uint64_t key);
+
+    std::vector<Buffer>& getBuffers() { return mBuffers; }
+    const std::vector<NodeBounds>& getNodeBounds() const { return mNodeBounds; }
+    bool hasAssetBounds() const { return mHasAssetBounds; }
+    const filament::Aabb& getAssetBounds() const { return mAssetBounds; }
+    const std::vector<PrimitiveClusters>& getClusters() const { return mClusters; }
+
+private:
+    std::vector<Buffer> mBuffers;
+    std::vector<NodeBounds> mNodeBounds;
+    std::vector<PrimitiveClusters> mClusters;
+    filament::Aabb mAssetBounds;
+    bool mHasAssetBounds = false;
+};
+
+} // namespace gltfio
+
+#endif // GLTFIO_ASSET_CACHE_H
@@ -37,13 +37,18 @@
 #include <math/vec4.h>
 
 #include <utils/EntityManager.h>
+#include <utils/Hash.h>
 #include <utils/Log.h>
 #include <utils/Panic.h>
 #include <utils/NameComponentManager.h>
 #include <utils/Systrace.h>
 
 #include <tsl/robin_map.h>
+#include <tsl/robin_set.h>
 
+#include <algorithm>
+#include <cmath>
+#include <memory>
 #include <vector>
 
 #define CGLTF_IMPLEMENTATION
@@ -60,33 +65,6 @@ namespace gltfio {
 
 static const auto FREE_CALLBACK = [](void* mem, size_t, void*) { free(mem); };
 
-// MeshCache
-// ---------
-// If a given glTF mesh is referenced by multiple glTF nodes, then it generates a separate Filament
-// renderable for each of those nodes. All renderables generated by a given mesh share a common set
-// of VertexBuffer and IndexBuffer objects. To achieve the sharing behavior, the loader maintains a
-// small cache. The cache keys are glTF mesh definitions and the cache entries are lists of
-// primitives, where a "primitive" is a reference to a Filament VertexBuffer and IndexBuffer.
-struct Primitive {
-    VertexBuffer* vertices = nullptr;
-    IndexBuffer* indices = nullptr;
-    Aabb aabb; // object-space bounding box
-};
-using MeshCache = tsl::robin_map<const cgltf_mesh*, std::vector<Primitive>>;
-
-// MatInstanceCache
-// ----------------
-// Each glTF material definition corresponds to a single filament::MaterialInstance, which are
-// cached here in the loader. The filament::Material objects that are used to create instances are
-// cached in MaterialProvider. If a given glTF material is referenced by multiple glTF meshes, then
-// their corresponding filament primitives will share the same Filament MaterialInstance and UvMap.
-// The UvMap is a mapping from each texcoord slot in glTF to one of Filament's 2 texcoord sets.
-struct MaterialEntry {
-    MaterialInstance* instance;
-    UvMap uvmap;
-};
-using MatInstanceCache = tsl::robin_map<intptr_t, MaterialEntry>;
-
 // Sometimes a glTF bufferview includes unused data at the end (e.g. in skinning.gltf) so we need to
 // compute the correct size of the vertex buffer. Filament automatically infers the size of
 // driver-level vertex buffers from the attribute data (stride, count, offset) and clients are
@@ -110,6 +88,104 @@ static const char* getNodeName(const cgltf_node* node, const char* defaultNodeNa
     return defaultNodeName;
 }
 
+// Number of levels of detail supported by RenderableManager.
+static constexpr size_t MAX_LOD_COUNT = 8;
+
+// Reads the JSON array of numbers that follows the given key. The extensions and extras read by
+// the loader don't nest arrays, so a plain search is enough.
+static void getJsonNumbers(const char* json, const char* key, std::vector<float>* numbers) {
+    const std::string quoted = std::string("\"") + key + "\"";
+    const char* p = strstr(json, quoted.c_str());
+    if (!p || !(p = strchr(p + quoted.size(), '['))) {
+        return;
+    }
+    for (char* end = nullptr; ; p = end) {
+        while (*p == ',' || *p == '[' || *p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') ++p;
+        const float value = strtof(p, &end);
+        if (end == p) {
+            break;
+        }
+        numbers->push_back(value);
+    }
+}
+
+// Maps the positions of a mesh to normalized 16 bits integers relative to the center of its
+// bounding box, with a uniform scale so that normals and tangents are unaffected. Returns a zero
+// scale if the positions can't be quantized: skinning and morphing work in object space.
+static float4 computePositionDequantization(const cgltf_mesh* mesh) {
+    float3 minp(std::numeric_limits<float>::max());
+    float3 maxp(std::numeric_limits<float>::lowest());
+    for (cgltf_size i = 0; i < mesh->primitives_count; ++i) {
+        const cgltf_primitive& prim = mesh->primitives[i];
+        if (prim.targets_count > 0) {
+            return {};
+        }
+        const cgltf_accessor* positions = nullptr;
+        for (cgltf_size j = 0; j < prim.attributes_count; ++j) {
+            if (prim.attributes[j].type == cgltf_attribute_type_joints) {
+                return {};
+            }
+            if (prim.attributes[j].type == cgltf_attribute_type_position) {
+                positions = prim.attributes[j].data;
+            }
+        }
+        if (!positions || positions->type != cgltf_type_vec3 ||
+                positions->component_type != cgltf_component_type_r_32f ||
+                !positions->has_min || !positions->has_max) {
+            return {};
+        }
+        minp = min(minp, float3(positions->min[0], positions->min[1], positions->min[2]));
+        maxp = max(maxp, float3(positions->max[0], positions->max[1], positions->max[2]));
+    }
+    const float scale = max(maxp - minp) * 0.5f;
+    if (!(scale > 0.0f) || !std::isfinite(scale)) {
+        return {};
+    }
+    return { (minp + maxp) * 0.5f, scale };
+}
+
+// Gathers the meshes of the levels of detail of a node, listed by MSFT_lod from the most detailed
+// one, and their minimum screen coverage from the MSFT_screencoverage extras of the node.
+static void getLevelsOfDetail(const cgltf_data* srcAsset, const cgltf_node* node,
+        std::vector<const cgltf_mesh*>* meshes, std::vector<float>* coverages) {
+    meshes->push_back(node->mesh);
+    std::vector<float> ids;
+    for (cgltf_size i = 0; i < node->extensions_count; ++i) {
+        if (!strcmp(node->extensions[i].name, "MSFT_lod")) {
+            getJsonNumbers(node->extensions[i].data, "ids", &ids);
+        }
+    }
+    for (float id : ids) {
+        if (id >= 0 && id < srcAsset->nodes_count && srcAsset->nodes[size_t(id)].mesh &&
+                meshes->size() < MAX_LOD_COUNT) {
+            meshes->push_back(srcAsset->nodes[size_t(id)].mesh);
+        }
+    }
+    if (meshes->size() == 1) {
+        return;
+    }
+
+    const cgltf_extras& extras = node->extras;
+    if (extras.end_offset > extras.start_offset) {
+        const std::string json(srcAsset->json + extras.start_offset,
+                extras.end_offset - extras.start_offset);
+        getJsonNumbers(json.c_str(), "MSFT_screencoverage", coverages);
+    }
+
+    // Without valid coverages, each level is used until the asset covers half as much of the
+    // screen as the previous one, and the last level is always drawn.
+    bool valid = coverages->size() >= meshes->size();
+    for (size_t i = 0; valid && i < meshes->size(); ++i) {
+        valid = (*coverages)[i] >= 0 && (!i || (*coverages)[i] < (*coverages)[i - 1]);
+    }
+    if (!valid) {
+        coverages->resize(meshes->size());
+        for (size_t i = 0; i < meshes->size(); ++i) {
+            (*coverages)[i] = i + 1 < meshes->size() ? 0.5f / float(1 << i) : 0.0f;
+        }
+    }
+}
+
 struct FAssetLoader : public AssetLoader {
     FAssetLoader(const AssetConfiguration& config) :
             mEntityManager(config.entities ? *config.entities : EntityManager::get()),
@@ -118,7 +194,15 @@ struct FAssetLoader : public AssetLoader {
             mTransformManager(config.engine->getTransformManager()),
             mMaterials(config.materials),
             mEngine(config.engine),
-            mDefaultNodeName(config.defaultNodeName) {}
+            mDefaultNodeName(config.defaultNodeName),
+            mQuantizeVertices(config.quantizeVertices),
+            mSeparatePositions(config.separatePositions),
+            mOptimizeMeshes(config.optimizeMeshes || config.clusterMeshes),
+            mClusterMeshes(config.clusterMeshes) {
+        if (config.shareMaterialInstances) {
+            mSharedMaterialCache = std::make_shared<SharedMaterialCache>(mEngine);
+        }
+    }
 
     FFilamentAsset* createAssetFromJson(const uint8_t* bytes, uint32_t nbytes);
     FFilamentAsset* createAssetFromBinary(const uint8_t* bytes, uint32_t nbytes);
@@ -148,7 +232,12 @@ struct FAssetLoader : public AssetLoader {
         return mMaterials->getMaterials();
     }
 
+    FFilamentInstance* createInstance(FFilamentAsset* primary);
+    void destroyInstance(FFilamentInstance* instance);
+
     void createAsset(const cgltf_data* srcAsset, size_t numInstances);
+    void findLodNodes(const cgltf_data* srcAsset);
+    FFilamentInstance* addInstance(const cgltf_scene* scene, bool enableLight);
     void createEntity(const cgltf_node* node, Entity parent, bool enableLight,
             FFilamentInstance* instance);
     void createRenderable(const cgltf_node* node, Entity entity, const char* name);
@@ -171,11 +260,20 @@ struct FAssetLoader : public AssetLoader {
     MaterialProvider* mMaterials;
     Engine* mEngine;
 
-    // The loader owns a few transient mappings used only for the current asset being loaded.
+    // The loader owns a few transient mappings used only for the current asset being loaded, the
+    // mesh and material instance caches are kept with the asset.
     FFilamentAsset* mResult;
-    MatInstanceCache mMatInstanceCache;
-    MeshCache mMeshCache;
+    tsl::robin_set<const cgltf_node*> mLodNodes;
+    tsl::robin_set<const cgltf_mesh*> mLodMeshes;
+
+    // Material instances shared across assets, and the UvMap of each one.
+    std::shared_ptr<SharedMaterialCache> mSharedMaterialCache;
+    tsl::robin_map<uint64_t, UvMap> mSharedUvMaps;
     const char* mDefaultNodeName;
+    const bool mQuantizeVertices;
+    const bool mSeparatePositions;
+    const bool mOptimizeMeshes;
+    const bool mClusterMeshes;
     bool mError = false;
     bool mDiagnosticsEnabled = false;
 };
@@ -261,6 +359,10 @@ void FAssetLoader::createAsset(const cgltf_data* srcAsset, size_t numInstances)
     mResult = new FFilamentAsset(mEngine, mNameManager, &mEntityManager);
     mResult->mSourceAsset = srcAsset;
     mResult->acquireSourceAsset();
+    mResult->mQuantizeVertices = mQuantizeVertices;
+    mResult->mSeparatePositions = mSeparatePositions;
+    mResult->mOptimizeMeshes = mOptimizeMeshes;
+    mResult->mClusterMeshes = mClusterMeshes;
 
     // If there is no default scene specified, then the default is the first one.
     // It is not an error for a glTF file to have zero scenes.
@@ -269,6 +371,8 @@ void FAssetLoader::createAsset(const cgltf_data* srcAsset, size_t numInstances)
         return;
     }
 
+    findLodNodes(srcAsset);
+
     // Create a single root node with an identity transform as a convenience to the client.
     mResult->mRoot = mEntityManager.create();
     mTransformManager.create(mResult->mRoot);
@@ -284,24 +388,7 @@ void FAssetLoader::createAsset(const cgltf_data* srcAsset, size_t numInstances)
         // buffers and index buffers) and mMatInstanceCache (materials and textures) help avoid
         // needless duplication of resources.
         for (size_t index = 0; index < numInstances; ++index) {
-            // Create a root node within each instance that is a child of the primary root.
-            auto rootTransform = mTransformManager.getInstance(mResult->mRoot);
-            Entity instanceRoot = mEntityManager.create();
-            mTransformManager.create(instanceRoot, rootTransform);
-
-            // Create an instance object, which is a just a lightweight wrapper around a vector of
-            // entities and a lazily created animator.
-            FFilamentInstance* instance = new FFilamentInstance;
-            instance->root = instanceRoot;
-            instance->animator = nullptr;
-            instance->owner = mResult;
-            mResult->mInstances.push_back(instance);
-
-            // For each scene root, recursively create all entities.
-            for (cgltf_size i = 0, len = scene->nodes_count; i < len; ++i) {
-                cgltf_node** nodes = scene->nodes;
-                createEntity(nodes[i], instanceRoot, index == 0, instance);
-            }
+            addInstance(scene, index == 0);
         }
     }
 
@@ -330,13 +417,119 @@ void FAssetLoader::createAsset(const cgltf_data* srcAsset, size_t numInstances)
     }
 
     // We're done with the import, so free up transient bookkeeping resources.
-    mMatInstanceCache.clear();
-    mMeshCache.clear();
+    mLodNodes.clear();
+    mLodMeshes.clear();
     mError = false;
 }
 
+void FAssetLoader::findLodNodes(const cgltf_data* srcAsset) {
+    // The nodes of the coarser levels of detail only provide meshes to the nodes that list them.
+    // The meshes of all the levels are recorded too, since their positions can't be quantized.
+    for (cgltf_size i = 0, len = srcAsset->nodes_count; i < len; ++i) {
+        const cgltf_node& node = srcAsset->nodes[i];
+        std::vector<float> ids;
+        for (cgltf_size j = 0; node.mesh && j < node.extensions_count; ++j) {
+            if (!strcmp(node.extensions[j].name, "MSFT_lod")) {
+                getJsonNumbers(node.extensions[j].data, "ids", &ids);
+            }
+        }
+        if (!ids.empty()) {
+            mLodMeshes.insert(node.mesh);
+        }
+        for (float id : ids) {
+            if (id >= 0 && id < len) {
+                mLodNodes.insert(&srcAsset->nodes[size_t(id)]);
+                mLodMeshes.insert(srcAsset->nodes[size_t(id)].mesh);
+            }
+        }
+    }
+}
+
+FFilamentInstance* FAssetLoader::addInstance(const cgltf_scene* scene, bool enableLight) {
+    // Create a root node within each instance that is a child of the primary root.
+    auto rootTransform = mTransformManager.getInstance(mResult->mRoot);
+    Entity instanceRoot = mEntityManager.create();
+    mTransformManager.create(instanceRoot, rootTransform);
+
+    // Create an instance object, which is a just a lightweight wrapper around a vector of
+    // entities and a lazily created animator.
+    FFilamentInstance* instance = new FFilamentInstance;
+    instance->root = instanceRoot;
+    instance->animator = nullptr;
+    instance->owner = mResult;
+    mResult->mInstances.push_back(instance);
+
+    // For each scene root, recursively create all entities.
+    for (cgltf_size i = 0, len = scene->nodes_count; i < len; ++i) {
+        cgltf_node** nodes = scene->nodes;
+        createEntity(nodes[i], instanceRoot, enableLight, instance);
+    }
+    return instance;
+}
+
+FFilamentInstance* FAssetLoader::createInstance(FFilamentAsset* primary) {
+    SYSTRACE_CALL();
+    ASSERT_PRECONDITION(!primary->mInstances.empty() || !primary->mRecycledInstances.empty(),
+            "Instances can only be added to assets created with createInstancedAsset.");
+
+    // Reuse the entities and components of a destroyed instance, which only need their local
+    // transforms to be restored.
+    if (!primary->mRecycledInstances.empty()) {
+        FFilamentInstance* instance = primary->mRecycledInstances.back();
+        primary->mRecycledInstances.pop_back();
+        TransformManager& tm = mTransformManager;
+        tm.openLocalTransformTransaction();
+        tm.setTransform(tm.getInstance(instance->root), mat4f());
+        for (size_t i = 0, n = instance->entities.size(); i < n; ++i) {
+            tm.setTransform(tm.getInstance(instance->entities[i]), primary->mRestTransforms[i]);
+        }
+        tm.commitLocalTransformTransaction();
+        primary->mInstances.push_back(instance);
+        return instance;
+    }
+
+    const cgltf_data* srcAsset = primary->mSourceAsset;
+    ASSERT_PRECONDITION(srcAsset, "Instances can't be added after releaseSourceData().");
+    const cgltf_scene* scene = srcAsset->scene ? srcAsset->scene : srcAsset->scenes;
+
+    mResult = primary;
+    findLodNodes(srcAsset);
+    FFilamentInstance* instance = addInstance(scene, false);
+    mLodNodes.clear();
+    mLodMeshes.clear();
+    mError = false;
+
+    // If the resources are already loaded, the skins are copied from another instance since
+    // their entities are created in the same order.
+    const FFilamentInstance* prototype = primary->mInstances[0];
+    if (!prototype->skins.empty()) {
+        tsl::robin_map<Entity, Entity> entities;
+        for (size_t i = 0, n = prototype->entities.size(); i < n; ++i) {
+            entities[prototype->entities[i]] = instance->entities[i];
+        }
+        instance->skins = prototype->skins;
+        for (Skin& skin : instance->skins) {
+            for (Entity& joint : skin.joints) joint = entities[joint];
+            for (Entity& target : skin.targets) target = entities[target];
+        }
+    }
+    return instance;
+}
+
+void FAssetLoader::destroyInstance(FFilamentInstance* instance) {
+    FFilamentAsset* primary = instance->owner;
+    auto iter = std::find(primary->mInstances.begin(), primary->mInstances.end(), instance);
+    ASSERT_PRECONDITION(iter != primary->mInstances.end(), "The instance was already destroyed.");
+    primary->mInstances.erase(iter);
+    primary->mRecycledInstances.push_back(instance);
+}
+
 void FAssetLoader::createEntity(const cgltf_node* node, Entity parent, bool enableLight,
         FFilamentInstance* instance) {
+    if (mLodNodes.find(node) != mLodNodes.end()) {
+        return;
+    }
+
     Entity entity = mEntityManager.create();
 
     // Always create a transform component to reflect the original hierarchy.
@@ -358,6 +551,9 @@ void FAssetLoader::createEntity(const cgltf_node* node, Entity parent, bool enab
     if (instance) {
         instance->entities.push_back(entity);
         instance->nodeMap[node] = entity;
+        if (mResult->mRestTransforms.size() < instance->entities.size()) {
+            mResult->mRestTransforms.push_back(localTransform);
+        }
     } else {
         mResult->mNodeMap[node] = entity;
     }
@@ -394,77 +590,136 @@ void FAssetLoader::createEntity(const cgltf_node* node, Entity parent, bool enab
 }
 
 void FAssetLoader::createRenderable(const cgltf_node* node, Entity entity, const char* name) {
-    const cgltf_mesh* mesh = node->mesh;
-
     // Compute the transform relative to the root.
     auto thisTransform = mTransformManager.getInstance(entity);
     mat4f worldTransform = mTransformManager.getWorldTransform(thisTransform);
 
-    cgltf_size nprims = mesh->primitives_count;
-    RenderableManager::Builder builder(nprims);
+    // The primitives of the coarser levels of detail follow those of the node's own mesh.
+    std::vector<const cgltf_mesh*> meshes;
+    std::vector<float> coverages;
+    getLevelsOfDetail(mResult->mSourceAsset, node, &meshes, &coverages);
+    const size_t levelCount = meshes.size();
 
-    // If the mesh is already loaded, obtain the list of Filament VertexBuffer / IndexBuffer objects
-    // that were already generated (one for each primitive), otherwise allocate a new list of
-    // pointers for the primitives.
-    auto iter = mMeshCache.find(mesh);
-    if (iter == mMeshCache.end()) {
-        mMeshCache[mesh].resize(nprims);
+    cgltf_size nprims = 0;
+    for (const cgltf_mesh* mesh : meshes) {
+        nprims += mesh->primitives_count;
     }
-    Primitive* outputPrim = mMeshCache[mesh].data();
-    const cgltf_primitive* inputPrim = &mesh->primitives[0];
+    RenderableManager::Builder builder(nprims);
 
     Aabb aabb;
 
     cgltf_size numMorphTargets = 0;
-
-    // For each prim, create a Filament VertexBuffer, IndexBuffer, and MaterialInstance.
-    for (cgltf_size index = 0; index < nprims; ++index, ++outputPrim, ++inputPrim) {
-        RenderableManager::PrimitiveType primType;
-        if (!getPrimitiveType(inputPrim->type, &primType)) {
-            slog.e << "Unsupported primitive type in " << name << io::endl;
+    float4 positionDequantization = {};
+
+    for (size_t level = 0, index = 0; level < levelCount; ++level) {
+        const cgltf_mesh* mesh = meshes[level];
+        const cgltf_size levelPrims = mesh->primitives_count;
+
+        // If the mesh is already loaded, obtain the list of Filament VertexBuffer / IndexBuffer
+        // objects that were already generated (one for each primitive), otherwise allocate a new
+        // list of pointers for the primitives.
+        auto iter = mResult->mMeshCache.find(mesh);
+        if (iter == mResult->mMeshCache.end()) {
+            std::vector<Primitive>& primitives = mResult->mMeshCache[mesh];
+            primitives.resize(levelPrims);
+            // All the primitives of a mesh share the dequantization, which goes with the
+            // transform of the renderable.
+            if (mQuantizeVertices && mLodMeshes.find(mesh) == mLodMeshes.end()) {
+                const float4 dequantization = computePositionDequantization(mesh);
+                for (Primitive& primitive : primitives) {
+                    primitive.positionDequantization = dequantization;
+                }
+            }
         }
+        Primitive* outputPrim = mResult->mMeshCache[mesh].data();
+        const cgltf_primitive* inputPrim = &mesh->primitives[0];
+
+        // For each prim, create a Filament VertexBuffer, IndexBuffer, and MaterialInstance.
+        for (cgltf_size i = 0; i < levelPrims; ++i, ++index, ++outputPrim, ++inputPrim) {
+            RenderableManager::PrimitiveType primType;
+            if (!getPrimitiveType(inputPrim->type, &primType)) {
+                slog.e << "Unsupported primitive type in " << name << io::endl;
+            }
 
-        if (inputPrim->targets_count > 0) {
-            if (numMorphTargets > 0 && inputPrim->targets_count != numMorphTargets) {
-                slog.e << "Sister primitives must all have the same number of morph targets."
-                        << io::endl;
+            if (inputPrim->targets_count > 0) {
+                if (numMorphTargets > 0 && inputPrim->targets_count != numMorphTargets) {
+                    slog.e << "Sister primitives must all have the same number of morph targets."
+                            << io::endl;
+                }
+                numMorphTargets = inputPrim->targets_count;
             }
-            numMorphTargets = inputPrim->targets_count;
-        }
 
-        // Create a material instance for this primitive or fetch one from the cache.
-        UvMap uvmap {};
-        bool hasVertexColor = primitiveHasVertexColor(inputPrim);
-        MaterialInstance* mi = createMaterialInstance(inputPrim->material, &uvmap, hasVertexColor);
-        if (!mi) {
-            mError = true;
-            continue;
-        }
+            // Create a material instance for this primitive or fetch one from the cache.
+            UvMap uvmap {};
+            bool hasVertexColor = primitiveHasVertexColor(inputPrim);
+            MaterialInstance* mi = createMaterialInstance(inputPrim->material, &uvmap,
+                    hasVertexColor);
+            if (!mi) {
+                mError = true;
+                continue;
+            }
 
-        mResult->mDependencyGraph.addEdge(entity, mi);
-        builder.material(index, mi);
+            // Instances added after loading are not tracked by the dependency graph.
+            if (!mResult->mDependencyGraph.isFinalized()) {
+                mResult->mDependencyGraph.addEdge(entity, mi);
+            }
+            builder.material(index, mi);
+
+            // The textures of the coarser levels are uploaded first.
+            if (levelCount > 1) {
+                const uint8_t rank = uint8_t(levelCount - 1 - level);
+                auto pos = mResult->mDetailRanks.find(mi);
+                if (pos == mResult->mDetailRanks.end() || pos->second > rank) {
+                    mResult->mDetailRanks[mi] = rank;
+                }
+            }
 
-        // Create a Filament VertexBuffer and IndexBuffer for this prim if we haven't already.
-        if (!outputPrim->vertices && !createPrimitive(inputPrim, outputPrim, uvmap, name)) {
-            mError = true;
-            continue;
-        }
+            // Create a Filament VertexBuffer and IndexBuffer for this prim if we haven't already.
+            if (!outputPrim->vertices && !createPrimitive(inputPrim, outputPrim, uvmap, name)) {
+                mError = true;
+                continue;
+            }
 
-        // Expand the object-space bounding box.
-        aabb.min = min(outputPrim->aabb.min, aabb.min);
-        aabb.max = max(outputPrim->aabb.max, aabb.max);
+            if (outputPrim->morphTargetSet >= 0) {
+                mResult->mMorphTargetSetsByEntity[entity].push_back(outputPrim->morphTargetSet);
+            }
+
+            positionDequantization = outputPrim->positionDequantization;
+
+            // Expand the object-space bounding box.
+            aabb.min = min(outputPrim->aabb.min, aabb.min);
+            aabb.max = max(outputPrim->aabb.max, aabb.max);
+
+            // We are not using the optional offset, minIndex, maxIndex, and count arguments when
+            // calling geometry() on the builder. It appears that the glTF spec does not have
+            // facilities for these parameters, which is not a huge loss since some of the buffer
+            // view and accessor features already have this functionality.
+            builder.geometry(index, primType, outputPrim->vertices, outputPrim->indices);
+
+            // The clusters are set once ResourceLoader has built them, unless it already did.
+            if (mClusterMeshes) {
+                auto clusters = mResult->mClusters.find(inputPrim);
+                if (clusters != mResult->mClusters.end()) {
+                    builder.clusters(index, clusters->second.data(), clusters->second.size());
+                } else {
+                    mResult->mClusteredPrimitives.push_back({ entity, index, inputPrim });
+                }
+            }
+        }
 
-        // We are not using the optional offset, minIndex, maxIndex, and count arguments when
-        // calling geometry() on the builder. It appears that the glTF spec does not have
-        // facilities for these parameters, which is not a huge loss since some of the buffer
-        // view and accessor features already have this functionality.
-        builder.geometry(index, primType, outputPrim->vertices, outputPrim->indices);
+        if (levelCount > 1) {
+            builder.levelOfDetail(uint8_t(level), levelPrims, coverages[level]);
+        }
     }
 
     if (numMorphTargets > 0) {
         builder.morphing(true);
     }
 
+    if (positionDequantization.w != 0.0f) {
+        builder.quantizedPositions(positionDequantization.xyz, positionDequantization.w);
+    }
+
     const Aabb transformed = aabb.transform(worldTransform);
 
     // Expand the world-space bounding box.
@@ -497,6 +752,7 @@ void FAssetLoader::createRenderable(const cgltf_node* node, Entity entity, const
     if (numMorphTargets > 0) {
         RenderableManager::Instance renderable = mRenderableManager.getInstance(entity);
         float4 weights(0, 0, 0, 0);
+        const cgltf_mesh* mesh = node->mesh;
         for (cgltf_size i = 0; i < std::min(MAX_MORPH_TARGETS, mesh->weights_count); ++i) {
             weights[i] = mesh->weights[i];
         }
@@ -515,6 +771,10 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
         slots->push_back(entry);
     };
 
+    // With mesh optimization, 16 bits indices are used when they can address all the vertices.
+    const bool shortIndices = mOptimizeMeshes && inPrim->attributes_count > 0 &&
+            inPrim->attributes[0].data->count <= 65536;
+
     // In glTF, each primitive may or may not have an index buffer.
     IndexBuffer* indices;
     const cgltf_accessor* accessor = inPrim->indices;
@@ -525,12 +785,17 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
             return false;
         }
 
+        BufferSlot slot = { accessor };
+        if (shortIndices && indexType == IndexBuffer::IndexType::UINT) {
+            indexType = IndexBuffer::IndexType::USHORT;
+            slot.shortIndices = true;
+        }
+
         indices = IndexBuffer::Builder()
             .indexCount(accessor->count)
             .bufferType(indexType)
             .build(*mEngine);
 
-        BufferSlot slot = { accessor };
         slot.indexBuffer = indices;
         addBufferSlot(slot);
     } else {
@@ -539,13 +804,18 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
 
         indices = IndexBuffer::Builder()
             .indexCount(vertexCount)
-            .bufferType(IndexBuffer::IndexType::UINT)
+            .bufferType(shortIndices ? IndexBuffer::IndexType::USHORT :
+                    IndexBuffer::IndexType::UINT)
             .build(*mEngine);
 
-        const size_t indexDataSize = vertexCount * sizeof(uint32_t);
-        uint32_t* indexData = (uint32_t*) malloc(indexDataSize);
+        const size_t indexDataSize = vertexCount * (shortIndices ? 2 : 4);
+        void* indexData = malloc(indexDataSize);
         for (size_t i = 0; i < vertexCount; ++i) {
-            indexData[i] = i;
+            if (shortIndices) {
+                ((uint16_t*) indexData)[i] = uint16_t(i);
+            } else {
+                ((uint32_t*) indexData)[i] = i;
+            }
         }
         IndexBuffer::BufferDescriptor bd(indexData, indexDataSize, FREE_CALLBACK);
         indices->setBuffer(*mEngine, std::move(bd));
@@ -634,6 +904,37 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
             outPrim->aabb.max = max(outPrim->aabb.max, float3(maxp[0], maxp[1], maxp[2]));
         }
 
+        if (atype == cgltf_attribute_type_position && outPrim->positionDequantization.w != 0.0f) {
+            vbb.attribute(semantic, slot, VertexBuffer::AttributeType::SHORT4);
+            vbb.normalized(semantic);
+            BufferSlot positions = { accessor, atype, slot++ };
+            positions.quantization = VertexQuantization::POSITION_SNORM16;
+            positions.dequantization = outPrim->positionDequantization;
+            addBufferSlot(positions);
+            continue;
+        }
+
+        if (atype == cgltf_attribute_type_texcoord && mQuantizeVertices &&
+                accessor->type == cgltf_type_vec2 &&
+                accessor->component_type == cgltf_component_type_r_32f) {
+            vbb.attribute(semantic, slot, VertexBuffer::AttributeType::HALF2);
+            BufferSlot texcoords = { accessor, atype, slot++ };
+            texcoords.quantization = VertexQuantization::HALF;
+            addBufferSlot(texcoords);
+            continue;
+        }
+
+        if (atype == cgltf_attribute_type_position && mSeparatePositions &&
+                accessor->type == cgltf_type_vec3 &&
+                accessor->component_type == cgltf_component_type_r_32f &&
+                accessor->stride > sizeof(float3)) {
+            vbb.attribute(semantic, slot, VertexBuffer::AttributeType::FLOAT3);
+            BufferSlot positions = { accessor, atype, slot++ };
+            positions.quantization = VertexQuantization::PACKED;
+            addBufferSlot(positions);
+            continue;
+        }
+
         VertexBuffer::AttributeType fatype;
         if (!getElementType(accessor->type, accessor->component_type, &fatype)) {
             slog.e << "Unsupported accessor type in " << name << io::endl;
@@ -657,14 +958,38 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
     }
 
     cgltf_size targetsCount = inPrim->targets_count;
-    if (targetsCount > MAX_MORPH_TARGETS) {
-        slog.w << "Too many morph targets in " << name << io::endl;
-        targetsCount = MAX_MORPH_TARGETS;
-    }
 
     constexpr int baseTangentsAttr = (int) VertexAttribute::MORPH_TANGENTS_0;
     constexpr int basePositionAttr = (int) VertexAttribute::MORPH_POSITION_0;
 
+    // With more targets than attributes, the attributes hold the position deltas of the most
+    // influential targets, which ResourceLoader and the Animator upload as floats.
+    if (targetsCount > MAX_MORPH_TARGETS) {
+        slog.w << "Only the positions of the morph targets are animated in " << name
+                << ", it has more than " << MAX_MORPH_TARGETS << io::endl;
+        for (cgltf_size targetIndex = 0; targetIndex < targetsCount; targetIndex++) {
+            const cgltf_morph_target& morphTarget = inPrim->targets[targetIndex];
+            for (cgltf_size aindex = 0; aindex < morphTarget.attributes_count; aindex++) {
+                const cgltf_accessor* accessor = morphTarget.attributes[aindex].data;
+                if (morphTarget.attributes[aindex].type == cgltf_attribute_type_position &&
+                        accessor->has_min && accessor->has_max) {
+                    const float* minp = &accessor->min[0];
+                    const float* maxp = &accessor->max[0];
+                    outPrim->aabb.min = min(outPrim->aabb.min, float3(minp[0], minp[1], minp[2]));
+                    outPrim->aabb.max = max(outPrim->aabb.max, float3(maxp[0], maxp[1], maxp[2]));
+                }
+            }
+        }
+        outPrim->morphTargetSet = int(mResult->mMorphTargetSets.size());
+        mResult->mMorphTargetSets.push_back({ inPrim, nullptr, slot, vertexCount, {},
+                { -1, -1, -1, -1 } });
+        for (size_t i = 0; i < MAX_MORPH_TARGETS; i++) {
+            VertexAttribute attr = (VertexAttribute) (basePositionAttr + i);
+            vbb.attribute(attr, slot++, VertexBuffer::AttributeType::FLOAT3);
+        }
+        targetsCount = 0;
+    }
+
     for (cgltf_size targetIndex = 0; targetIndex < targetsCount; targetIndex++) {
         const cgltf_morph_target& morphTarget = inPrim->targets[targetIndex];
         for (cgltf_size aindex = 0; aindex < morphTarget.attributes_count; aindex++) {
@@ -760,6 +1085,9 @@ bool FAssetLoader::createPrimitive(const cgltf_primitive* inPrim, Primitive* out
     for (size_t i = firstSlot; i < mResult->mBufferSlots.size(); ++i) {
         mResult->mBufferSlots[i].vertexBuffer = vertices;
     }
+    if (outPrim->morphTargetSet >= 0) {
+        mResult->mMorphTargetSets[outPrim->morphTargetSet].vertexBuffer = vertices;
+    }
 
     if (needsDummyData) {
         uint32_t size = sizeof(ubyte4) * vertexCount;
@@ -849,8 +1177,8 @@ void FAssetLoader::createCamera(const cgltf_camera* camera, Entity entity) {
 MaterialInstance* FAssetLoader::createMaterialInstance(const cgltf_material* inputMat,
         UvMap* uvmap, bool vertexColor) {
     intptr_t key = ((intptr_t) inputMat) ^ (vertexColor ? 1 : 0);
-    auto iter = mMatInstanceCache.find(key);
-    if (iter != mMatInstanceCache.end()) {
+    auto iter = mResult->mMatInstanceCache.find(key);
+    if (iter != mResult->mMatInstanceCache.end()) {
         *uvmap = iter->second.uvmap;
         return iter->second.instance;
     }
@@ -945,6 +1273,38 @@ MaterialInstance* FAssetLoader::createMaterialInstance(const cgltf_material* inp
             break;
     }
 
+    // Untextured materials are identified by their key and parameters, which don't depend on the
+    // asset, so that identical ones can share a material instance.
+    const bool shared = mSharedMaterialCache && !matkey.hasBaseColorTexture &&
+            !matkey.hasMetallicRoughnessTexture && !matkey.hasSpecularGlossinessTexture &&
+            !matkey.hasNormalTexture && !matkey.hasOcclusionTexture &&
+            !matkey.hasEmissiveTexture && !matkey.hasClearCoatTexture &&
+            !matkey.hasClearCoatRoughnessTexture && !matkey.hasClearCoatNormalTexture &&
+            !matkey.hasTransmissionTexture;
+    uint64_t sharedKey = 0;
+    if (shared) {
+        const float* e = inputMat->emissive_factor;
+        const float* c = mrConfig.base_color_factor;
+        const float* df = sgConfig.diffuse_factor;
+        const float* sf = sgConfig.specular_factor;
+        const float parameters[] = {
+            inputMat->alpha_mode == cgltf_alpha_mode_mask ? inputMat->alpha_cutoff : 0.0f,
+            e[0], e[1], e[2], c[0], c[1], c[2], c[3],
+            mrConfig.metallic_factor, mrConfig.roughness_factor,
+            df[0], df[1], df[2], df[3], sf[0], sf[1], sf[2], sgConfig.glossiness_factor,
+            ccConfig.clearcoat_factor, ccConfig.clearcoat_roughness_factor,
+            trConfig.transmission_factor,
+        };
+        sharedKey = SharedMaterialCache::computeKey(parameters, sizeof(parameters),
+                hash::fnv1a64(&matkey, sizeof(matkey)));
+        if (MaterialInstance* mi = mSharedMaterialCache->acquire(sharedKey)) {
+            mResult->shareOwnership(mSharedMaterialCache, mi);
+            *uvmap = mSharedUvMaps[sharedKey];
+            mResult->mMatInstanceCache[key] = {mi, *uvmap};
+            return mi;
+        }
+    }
+
     // This not only creates a material instance, it modifies the material key according to our
     // rendering constraints. For example, Filament only supports 2 sets of texture coordinates.
     MaterialInstance* mi = mMaterials->createMaterialInstance(&matkey, uvmap, inputMat->name);
@@ -953,7 +1313,13 @@ MaterialInstance* FAssetLoader::createMaterialInstance(const cgltf_material* inp
         return nullptr;
     }
 
-    mResult->mMaterialInstances.push_back(mi);
+    if (shared) {
+        mSharedMaterialCache->add(sharedKey, mi);
+        mSharedUvMaps[sharedKey] = *uvmap;
+        mResult->shareOwnership(mSharedMaterialCache, mi);
+    } else {
+        mResult->mMaterialInstances.push_back(mi);
+    }
 
     if (inputMat->alpha_mode == cgltf_alpha_mode_mask) {
         mi->setMaskThreshold(inputMat->alpha_cutoff);
@@ -1074,13 +1440,22 @@ MaterialInstance* FAssetLoader::createMaterialInstance(const cgltf_material* inp
         }
     }
 
-    mMatInstanceCache[key] = {mi, *uvmap};
+    mResult->mMatInstanceCache[key] = {mi, *uvmap};
     return mi;
 }
 
 void FAssetLoader::addTextureBinding(MaterialInstance* materialInstance, const char* parameterName,
         const cgltf_texture* srcTexture, bool srgb) {
-    if (!srcTexture->image) {
+    // The image is optional when KHR_texture_basisu provides one, ResourceLoader picks the image.
+    auto hasBasisuImage = [srcTexture]() {
+        for (cgltf_size i = 0; i < srcTexture->extensions_count; ++i) {
+            if (!strcmp(srcTexture->extensions[i].name, "KHR_texture_basisu")) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (!srcTexture->image && !hasBasisuImage()) {
         slog.w << "Texture is missing image (" << srcTexture->name << ")." << io::endl;
         return;
     }
@@ -1164,6 +1539,14 @@ FilamentAsset* AssetLoader::createAssetFromHandle(const void* handle) {
     return upcast(this)->mResult;
 }
 
+FilamentInstance* AssetLoader::createInstance(FilamentAsset* asset) {
+    return upcast(this)->createInstance(upcast(asset));
+}
+
+void AssetLoader::destroyInstance(FilamentInstance* instance) {
+    upcast(this)->destroyInstance(upcast(instance));
+}
+
 void AssetLoader::enableDiagnostics(bool enable) {
     upcast(this)->mDiagnosticsEnabled = enable;
 }
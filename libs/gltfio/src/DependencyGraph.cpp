@@ -73,10 +73,11 @@ void DependencyGraph::markAsReady(Texture* texture) {
     for (auto material : materials) {
         auto& status = mMaterialToTexture.at(material);
 
-        // Check this material's texture parameters, there are 5 in the worst case.
+        // Check this material's texture parameters, there are 5 in the worst case. A parameter
+        // has no texture yet while the image it comes from is being streamed in.
         bool materialIsReady = true;
         for (auto pair : status.params) {
-            if (!pair.second->ready) {
+            if (!pair.second || !pair.second->ready) {
                 materialIsReady = false;
                 break;
             }
@@ -73,6 +73,7 @@ public:
 
     // This is called at the end of the initial asset loading phase.
     void finalize();
+    bool isFinalized() const noexcept { return mFinalized; }
 
     // These are called after textures have created and decoded.
     void addEdge(filament::Texture* texture, Material* material, const char* parameter);
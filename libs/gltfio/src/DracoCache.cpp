@@ -22,6 +22,8 @@
 
 #include <utils/Log.h>
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 #include <vector>
 
@@ -44,6 +46,36 @@ DracoMesh* DracoCache::findOrCreateMesh(const cgltf_buffer_view* key) {
     return mesh;
 }
 
+void DracoCache::decodeMeshes(utils::JobSystem& js, const cgltf_buffer_view* const* keys,
+        size_t count) {
+    vector<const cgltf_buffer_view*> missing;
+    for (size_t i = 0; i < count; i++) {
+        const cgltf_buffer_view* key = keys[i];
+        if (mCache.find(key) == mCache.end() &&
+                std::find(missing.begin(), missing.end(), key) == missing.end()) {
+            assert(key->buffer && key->buffer->data);
+            missing.push_back(key);
+        }
+    }
+
+    vector<DracoMesh*> meshes(missing.size());
+    auto decode = [&missing, &meshes](uint32_t startIndex, uint32_t meshCount) {
+        for (size_t i = startIndex, e = startIndex + meshCount; i < e; i++) {
+            const cgltf_buffer_view* key = missing[i];
+            const uint8_t* compressedData = key->offset + (uint8_t*) key->buffer->data;
+            meshes[i] = DracoMesh::decode(compressedData, key->size);
+        }
+    };
+    auto* job = jobs::parallel_for(js, nullptr, 0, uint32_t(missing.size()),
+            std::cref(decode), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+
+    // decoding errors are cached too, like in findOrCreateMesh()
+    for (size_t i = 0; i < missing.size(); i++) {
+        mCache.emplace(missing[i], meshes[i]);
+    }
+}
+
 DracoMesh::DracoMesh(struct DracoMeshDetails* details) : mDetails(details) {}
 
 #if GLTFIO_DRACO_SUPPORTED
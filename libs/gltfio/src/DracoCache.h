@@ -19,6 +19,8 @@
 
 #include <cgltf.h>
 
+#include <utils/JobSystem.h>
+
 #include <tsl/robin_map.h>
 
 #include <memory>
@@ -38,6 +40,9 @@ class DracoMesh;
 class DracoCache {
 public:
     DracoMesh* findOrCreateMesh(const cgltf_buffer_view* key);
+
+    // Decodes the meshes that are not in the cache yet in parallel, each of them once.
+    void decodeMeshes(utils::JobSystem& js, const cgltf_buffer_view* const* keys, size_t count);
 private:
     tsl::robin_map<const cgltf_buffer_view*, std::unique_ptr<DracoMesh>> mCache;
 };
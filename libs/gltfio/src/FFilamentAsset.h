@@ -18,9 +18,11 @@
 #define GLTFIO_FFILAMENTASSET_H
 
 #include <gltfio/FilamentAsset.h>
+#include <gltfio/MaterialProvider.h>
 
 #include <filament/Engine.h>
 #include <filament/IndexBuffer.h>
+#include <filament/MaterialEnums.h>
 #include <filament/MaterialInstance.h>
 #include <filament/RenderableManager.h>
 #include <filament/Texture.h>
@@ -29,6 +31,8 @@
 #include <filament/VertexBuffer.h>
 
 #include <math/mat4.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
 
 #include <utils/Entity.h>
 
@@ -38,12 +42,18 @@
 #include "DependencyGraph.h"
 #include "DracoCache.h"
 #include "FFilamentInstance.h"
+#include "SharedResourceCache.h"
 
 #include <tsl/robin_map.h>
 #include <tsl/htrie_map.h>
 
+#include <algorithm>
+#include <memory>
 #include <vector>
 
+#include <stdlib.h>
+#include <string.h>
+
 namespace utils {
     class NameComponentManager;
     class EntityManager;
@@ -54,6 +64,14 @@ namespace gltfio {
 class Animator;
 class Wireframe;
 
+// Conversion of float vertex data by ResourceLoader, see AssetConfiguration::quantizeVertices.
+enum class VertexQuantization : uint8_t {
+    NONE,
+    POSITION_SNORM16,   // float3 to normalized short4, mapped by the slot's dequantization
+    HALF,               // floats to half floats
+    PACKED,             // floats copied out of their interleaved buffer view
+};
+
 // Encapsulates VertexBuffer::setBufferAt() or IndexBuffer::setBuffer().
 struct BufferSlot {
     const cgltf_accessor* accessor;
@@ -62,8 +80,64 @@ struct BufferSlot {
     int morphTarget; // 0 if no morphing, otherwise 1-based index
     filament::VertexBuffer* vertexBuffer;
     filament::IndexBuffer* indexBuffer;
+    VertexQuantization quantization = VertexQuantization::NONE;
+    filament::math::float4 dequantization = {}; // offset and scale of quantized positions
+    bool shortIndices = false; // 32 bits indices stored as 16 bits
+};
+
+// Morph targets of a primitive that has more targets than the morphing vertex attributes. The
+// position deltas of all the targets are kept, and the attributes hold the most influential
+// ones, see AnimatorImpl::setMorphWeights().
+struct MorphTargetSet {
+    const cgltf_primitive* primitive;
+    filament::VertexBuffer* vertexBuffer;
+    int bufferIndex;    // buffer of MORPH_POSITION_0, followed by the buffers of the others
+    size_t vertexCount;
+    std::vector<std::vector<filament::math::float3>> positions; // filled by ResourceLoader
+    int boundTargets[filament::MAX_MORPH_TARGETS];   // target held by each attribute, or -1
+
+    // Uploads the position deltas of a target to one of the attributes.
+    void bindTarget(filament::Engine& engine, size_t attribute, int target) {
+        const size_t size = vertexCount * sizeof(filament::math::float3);
+        void* data = malloc(size);
+        memcpy(data, positions[target].data(), size);
+        vertexBuffer->setBufferAt(engine, uint8_t(bufferIndex + attribute),
+                filament::VertexBuffer::BufferDescriptor(data, size,
+                        [](void* mem, size_t, void*) { free(mem); }));
+        boundTargets[attribute] = target;
+    }
 };
 
+// MeshCache
+// ---------
+// If a given glTF mesh is referenced by multiple glTF nodes, then it generates a separate Filament
+// renderable for each of those nodes. All renderables generated by a given mesh share a common set
+// of VertexBuffer and IndexBuffer objects. To achieve the sharing behavior, the asset keeps a small
+// cache until its source data is released, which also serves instances added after loading. The
+// cache keys are glTF mesh definitions and the cache entries are lists of primitives, where a
+// "primitive" is a reference to a Filament VertexBuffer and IndexBuffer.
+struct Primitive {
+    filament::VertexBuffer* vertices = nullptr;
+    filament::IndexBuffer* indices = nullptr;
+    filament::Aabb aabb; // object-space bounding box
+    int morphTargetSet = -1; // index in the asset's morph target sets, if it has too many targets
+    filament::math::float4 positionDequantization = {}; // offset and scale, 0 if not quantized
+};
+using MeshCache = tsl::robin_map<const cgltf_mesh*, std::vector<Primitive>>;
+
+// MatInstanceCache
+// ----------------
+// Each glTF material definition corresponds to a single filament::MaterialInstance, which are
+// cached with the asset. The filament::Material objects that are used to create instances are
+// cached in MaterialProvider. If a given glTF material is referenced by multiple glTF meshes, then
+// their corresponding filament primitives will share the same Filament MaterialInstance and UvMap.
+// The UvMap is a mapping from each texcoord slot in glTF to one of Filament's 2 texcoord sets.
+struct MaterialEntry {
+    filament::MaterialInstance* instance;
+    UvMap uvmap;
+};
+using MatInstanceCache = tsl::robin_map<intptr_t, MaterialEntry>;
+
 // Encapsulates a connection between Texture and MaterialInstance.
 struct TextureSlot {
     const cgltf_texture* texture;
@@ -178,6 +252,25 @@ struct FFilamentAsset : public FilamentAsset {
         mTextures.push_back(texture);
     }
 
+    // Keeps a reference to a texture of a shared cache, released when the asset is destroyed.
+    void shareOwnership(const std::shared_ptr<SharedTextureCache>& cache,
+            filament::Texture* texture) {
+        mSharedTextureCache = cache;
+        mSharedTextures.push_back(texture);
+    }
+
+    // Keeps a reference to a material instance of a shared cache, released when the asset is
+    // destroyed. The material instance is listed once in the asset's material instances.
+    void shareOwnership(const std::shared_ptr<SharedMaterialCache>& cache,
+            filament::MaterialInstance* mi) {
+        mSharedMaterialCache = cache;
+        if (std::find(mSharedMaterialInstances.begin(), mSharedMaterialInstances.end(), mi) ==
+                mSharedMaterialInstances.end()) {
+            mMaterialInstances.push_back(mi);
+        }
+        mSharedMaterialInstances.push_back(mi);
+    }
+
     void bindTexture(const TextureSlot& tb, filament::Texture* texture) {
         tb.materialInstance->setParameter(tb.materialParameter, texture, tb.sampler);
         mDependencyGraph.addEdge(texture, tb.materialInstance, tb.materialParameter);
@@ -194,18 +287,41 @@ struct FFilamentAsset : public FilamentAsset {
     std::vector<filament::VertexBuffer*> mVertexBuffers;
     std::vector<filament::IndexBuffer*> mIndexBuffers;
     std::vector<filament::Texture*> mTextures;
+    std::shared_ptr<SharedTextureCache> mSharedTextureCache;
+    std::vector<filament::Texture*> mSharedTextures;
+    std::shared_ptr<SharedMaterialCache> mSharedMaterialCache;
+    std::vector<filament::MaterialInstance*> mSharedMaterialInstances;
     filament::Aabb mBoundingBox;
     utils::Entity mRoot;
     std::vector<FFilamentInstance*> mInstances;
+    std::vector<FFilamentInstance*> mRecycledInstances; // destroyed, reused by createInstance()
+    std::vector<filament::math::mat4f> mRestTransforms; // local transforms of instance entities
     SkinVector mSkins; // unused for instanced assets
     Animator* mAnimator = nullptr;
     Wireframe* mWireframe = nullptr;
     int mSourceAssetRefCount = 0;
     bool mResourcesLoaded = false;
     bool mSharedSourceAsset = false;
+    bool mQuantizeVertices = false;
+    bool mSeparatePositions = false;
+    bool mOptimizeMeshes = false;
+    bool mClusterMeshes = false;
     DependencyGraph mDependencyGraph;
     DracoCache mDracoCache;
     tsl::htrie_map<char, std::vector<utils::Entity>> mNameToEntity;
+    std::vector<MorphTargetSet> mMorphTargetSets;
+    tsl::robin_map<utils::Entity, std::vector<size_t>> mMorphTargetSetsByEntity;
+
+    // Clusters of the triangles of the primitives, built by ResourceLoader when clusterMeshes is
+    // enabled. They're set on the renderables that were created before that once available.
+    struct ClusteredPrimitive {
+        utils::Entity entity;
+        size_t index;
+        const cgltf_primitive* primitive;
+    };
+    using Clusters = std::vector<filament::RenderableManager::Cluster>;
+    tsl::robin_map<const cgltf_primitive*, Clusters> mClusters;
+    std::vector<ClusteredPrimitive> mClusteredPrimitives;
 
     // Sentinels for situations where ResourceLoader needs to generate data.
     const cgltf_accessor mGenerateNormals = {};
@@ -215,6 +331,12 @@ struct FFilamentAsset : public FilamentAsset {
     std::vector<BufferSlot> mBufferSlots;
     std::vector<TextureSlot> mTextureSlots;
     std::vector<const char*> mResourceUris;
+
+    // For material instances used by levels of detail, the number of coarser levels before the
+    // first one using them. Their textures are uploaded after those of the coarser levels.
+    tsl::robin_map<const filament::MaterialInstance*, uint8_t> mDetailRanks;
+    MeshCache mMeshCache;
+    MatInstanceCache mMatInstanceCache;
     const cgltf_data* mSourceAsset = nullptr;
     NodeMap mNodeMap; // unused for instanced assets
     std::vector<std::pair<const cgltf_primitive*, filament::VertexBuffer*> > mPrimitives;
@@ -37,6 +37,10 @@ FFilamentAsset::~FFilamentAsset() {
         delete instance->animator;
         delete instance;
     }
+    for (FFilamentInstance* instance : mRecycledInstances) {
+        delete instance->animator;
+        delete instance;
+    }
 
     delete mAnimator;
     delete mWireframe;
@@ -55,7 +59,13 @@ FFilamentAsset::~FFilamentAsset() {
         mEntityManager->destroy(entity);
     }
     for (auto mi : mMaterialInstances) {
-        mEngine->destroy(mi);
+        auto& shared = mSharedMaterialInstances;
+        if (std::find(shared.begin(), shared.end(), mi) == shared.end()) {
+            mEngine->destroy(mi);
+        }
+    }
+    for (auto mi : mSharedMaterialInstances) {
+        mSharedMaterialCache->release(mi);
     }
     for (auto vb : mVertexBuffers) {
         mEngine->destroy(vb);
@@ -66,6 +76,9 @@ FFilamentAsset::~FFilamentAsset() {
     for (auto tx : mTextures) {
         mEngine->destroy(tx);
     }
+    for (auto tx : mSharedTextures) {
+        mSharedTextureCache->release(tx);
+    }
 }
 
 Animator* FFilamentAsset::getAnimator() noexcept {
@@ -91,10 +104,16 @@ void FFilamentAsset::releaseSourceData() noexcept {
     mPrimitives = {};
     mBufferSlots = {};
     mTextureSlots = {};
+    mDetailRanks = {};
+    mMeshCache = {};
+    mMatInstanceCache = {};
     releaseSourceAsset();
     for (FFilamentInstance* instance : mInstances) {
         instance->nodeMap = {};
     }
+    for (FFilamentInstance* instance : mRecycledInstances) {
+        instance->nodeMap = {};
+    }
 }
 
 void FFilamentAsset::releaseSourceAsset() {
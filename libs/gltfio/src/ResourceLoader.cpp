@@ -17,7 +17,9 @@
 #include <gltfio/ResourceLoader.h>
 #include <gltfio/Image.h>
 
+#include "AssetCache.h"
 #include "FFilamentAsset.h"
+#include "SharedResourceCache.h"
 #include "upcast.h"
 
 #include <filament/Engine.h>
@@ -28,19 +30,32 @@
 
 #include <geometry/SurfaceOrientation.h>
 
+#include <image/KtxBundle.h>
+#include <image/KtxUtility.h>
+
 #include <utils/JobSystem.h>
 #include <utils/Log.h>
 #include <utils/Systrace.h>
 
 #include <cgltf.h>
 
+#include <meshoptimizer.h>
+
 #include <math/quat.h>
+#include <math/simd.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
 #include <tsl/robin_map.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #if defined(__EMSCRIPTEN__) || defined(ANDROID)
 #define USE_FILESYSTEM 0
@@ -49,6 +64,16 @@
 #include <utils/Path.h>
 #endif
 
+#if USE_FILESYSTEM && !defined(WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#else
+#define HAS_MMAP 0
+#endif
+
 using namespace filament;
 using namespace filament::math;
 using namespace utils;
@@ -65,6 +90,18 @@ namespace {
         int numComponents;
         bool srgb;
         bool completed;
+        int priority;
+        uint64_t sharedKey;
+
+        // The image data of this URI hasn't been added yet, the texture is created and decoded
+        // when it is, see ResourceLoader::addResourceData().
+        bool deferred;
+
+        // KTX images are not decoded by stb, their texels are uploaded as they are stored.
+        bool isKtx;
+        image::KtxInfo ktxInfo;
+        uint32_t ktxLevels;
+        std::atomic<image::KtxBundle*> ktx;
     };
 
     using BufferTextureCache = tsl::robin_map<const void*, std::unique_ptr<TextureCacheEntry>>;
@@ -80,12 +117,22 @@ struct ResourceLoader::Impl {
         mEngine = config.engine;
         mNormalizeSkinningWeights = config.normalizeSkinningWeights;
         mRecomputeBoundingBoxes = config.recomputeBoundingBoxes;
+        mMemoryMapBuffers = config.memoryMapBuffers;
+        mAsyncUploadBudget = config.asyncUploadBudget;
+        mCachePath = std::string(config.cachePath ? config.cachePath : "");
+        if (config.shareTextures) {
+            mSharedTextureCache = std::make_shared<SharedTextureCache>(mEngine);
+        }
     }
 
     Engine* mEngine;
     bool mNormalizeSkinningWeights;
     bool mRecomputeBoundingBoxes;
+    bool mMemoryMapBuffers;
+    size_t mAsyncUploadBudget;
+    LoadTimings mLoadTimings;
     std::string mGltfPath;
+    std::string mCachePath;
 
     // User-provided resource data with URI string keys, populated with addResourceData().
     // This is used on platforms without traditional file systems, such as Android and WebGL.
@@ -97,18 +144,45 @@ struct ResourceLoader::Impl {
     // two caches: one for URI-based textures and one for buffer-based textures.
     BufferTextureCache mBufferTextureCache;
     UriTextureCache mUriTextureCache;
+
+    // Textures shared with the other assets, see ResourceConfiguration::shareTextures.
+    std::shared_ptr<SharedTextureCache> mSharedTextureCache;
+
+    // The image selected for each glTF texture, which is the KTX image of KHR_texture_basisu if the
+    // engine supports its format, otherwise the regular image.
+    tsl::robin_map<const cgltf_texture*, const cgltf_image*> mTextureImages;
+
     int mNumDecoderTasks;
     int mNumDecoderTasksFinished;
     JobSystem::Job* mDecoderRootJob = nullptr;
-    FFilamentAsset* mCurrentAsset;
-
+    std::vector<JobSystem::Job*> mDeferredDecoderJobs;
+    FFilamentAsset* mCurrentAsset = nullptr;
+
+    // The vertex and index buffers of the asset being loaded in order of first appearance in its
+    // buffer slots, which identifies them in the cache. The uploads go through setVertexBuffer()
+    // and setIndexBuffer() so that the cache can record them.
+    std::vector<VertexBuffer*> mVertexBuffers;
+    std::vector<IndexBuffer*> mIndexBuffers;
+    tsl::robin_map<const void*, uint32_t> mBufferOrdinals;
+    AssetCache* mCacheRecorder = nullptr;
+
+    void setVertexBuffer(VertexBuffer* vb, uint8_t bufferIndex,
+            VertexBuffer::BufferDescriptor&& bd);
+    void setIndexBuffer(IndexBuffer* ib, IndexBuffer::BufferDescriptor&& bd);
     void computeTangents(FFilamentAsset* asset);
     bool createTextures(bool async);
+    void shareTexture(TextureCacheEntry* entry, const void* data, size_t size);
+    void createTexture(TextureCacheEntry* entry);
+    void addDeferredTexture(const char* uri);
+    void waitForDecoderJobs();
     void cancelTextureDecoding();
     void addTextureCacheEntry(const TextureSlot& tb);
+    const cgltf_image* selectImage(const cgltf_texture* srcTexture, bool srgb,
+            image::KtxInfo* info, uint32_t* levels);
+    TextureCacheEntry* findTextureCacheEntry(const cgltf_texture* srcTexture);
     void bindTextureToMaterial(const TextureSlot& tb);
     void decodeSingleTexture();
-    void uploadPendingTextures();
+    void uploadPendingTextures(size_t budget);
     void releasePendingTextures();
     ~Impl();
 };
@@ -116,6 +190,105 @@ struct ResourceLoader::Impl {
 uint32_t computeBindingSize(const cgltf_accessor* accessor);
 uint32_t computeBindingOffset(const cgltf_accessor* accessor);
 
+// Memory-mapped buffer files, see ResourceConfiguration::memoryMapBuffers. They are mapped
+// copy-on-write because some of the source data is modified in place, e.g. by
+// normalizeSkinningWeights() or optimizeMeshes(). Uploaded pages are paged out rather than
+// discarded: a page may also hold modified data that is still to be uploaded, and discarding a
+// modified page of a private mapping would read it back from the file without the modifications.
+class MappedFiles {
+public:
+    static cgltf_result map(const cgltf_memory_options* memoryOptions,
+            const cgltf_file_options* fileOptions, const char* path, cgltf_size* size,
+            void** data);
+    static void release(const cgltf_memory_options* memoryOptions,
+            const cgltf_file_options* fileOptions, void* data);
+
+    // pages out the pages of a range of a mapped file, if any, keeping their content
+    static void dropPages(const void* data, size_t size);
+
+private:
+    static std::mutex sLock;
+    static tsl::robin_map<const void*, size_t> sMappings;
+};
+
+std::mutex MappedFiles::sLock;
+tsl::robin_map<const void*, size_t> MappedFiles::sMappings;
+
+cgltf_result MappedFiles::map(const cgltf_memory_options*, const cgltf_file_options*,
+        const char* path, cgltf_size* size, void** data) {
+#if HAS_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return cgltf_result_file_not_found;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return cgltf_result_io_error;
+    }
+    const size_t length = size_t(st.st_size);
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return cgltf_result_io_error;
+    }
+    std::lock_guard<std::mutex> guard(sLock);
+    sMappings[addr] = length;
+    if (size) {
+        *size = length;
+    }
+    *data = addr;
+    return cgltf_result_success;
+#else
+    return cgltf_result_io_error;
+#endif
+}
+
+void MappedFiles::release(const cgltf_memory_options* memoryOptions,
+        const cgltf_file_options*, void* data) {
+#if HAS_MMAP
+    {
+        std::lock_guard<std::mutex> guard(sLock);
+        auto pos = sMappings.find(data);
+        if (pos != sMappings.end()) {
+            munmap(data, pos->second);
+            sMappings.erase(pos);
+            return;
+        }
+    }
+#endif
+    // buffers that were not mapped, e.g. decoded from base64, come from cgltf's allocator
+    if (memoryOptions->free) {
+        memoryOptions->free(memoryOptions->user_data, data);
+    } else {
+        free(data);
+    }
+}
+
+void MappedFiles::dropPages(const void* data, size_t size) {
+    // Unlike MADV_DONTNEED, MADV_PAGEOUT keeps the content of the pages modified in place: they
+    // are written to swap, while unmodified pages are simply reclaimed. Kernels older than
+    // Linux 5.4 reject it, the pages then stay resident.
+#if HAS_MMAP && defined(MADV_PAGEOUT)
+    std::lock_guard<std::mutex> guard(sLock);
+    const uintptr_t begin = uintptr_t(data);
+    const uintptr_t end = begin + size;
+    for (auto const& mapping : sMappings) {
+        const uintptr_t base = uintptr_t(mapping.first);
+        if (begin >= base && end <= base + mapping.second) {
+            // only the pages that are entirely within the range
+            const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+            const uintptr_t first = (begin + pageSize - 1) & ~(pageSize - 1);
+            const uintptr_t last = end & ~(pageSize - 1);
+            if (first < last) {
+                madvise((void*) first, last - first, MADV_PAGEOUT);
+            }
+            return;
+        }
+    }
+#endif
+}
+
 // The AssetPool tracks references to raw source data (cgltf hierarchies) and frees them
 // appropriately. It releases all source assets only after the pending upload count is zero and the
 // client has destroyed the ResourceLoader object. If the ResourceLoader is destroyed while uploads
@@ -136,6 +309,7 @@ public:
         ++mPendingUploads;
     }
     static void onLoadedResource(void* buffer, size_t size, void* user) {
+        MappedFiles::dropPages(buffer, size);
         auto pool = (AssetPool*) user;
         if (--pool->mPendingUploads == 0 && pool->mLoaderDestroyed) {
             delete pool;
@@ -204,9 +378,270 @@ static void convertBytesToShorts(uint16_t* dst, const uint8_t* src, size_t count
     }
 }
 
-static void decodeDracoMeshes(FFilamentAsset* asset) {
+static void convertIntsToShorts(uint16_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = uint16_t(src[i]);
+    }
+}
+
+// Converts the float data of a vertex buffer slot to the quantized type declared by AssetLoader.
+static VertexBuffer::BufferDescriptor quantizeVertices(const BufferSlot& slot) {
+    const cgltf_accessor* accessor = slot.accessor;
+    if (slot.quantization == VertexQuantization::POSITION_SNORM16) {
+        const size_t count = accessor->count;
+        std::vector<float3> positions(count);
+        cgltf_accessor_unpack_floats(accessor, &positions[0].x, count * 3);
+        const float3 offset = slot.dequantization.xyz;
+        const float scale = 1.0f / slot.dequantization.w;
+        std::vector<float4> normalized(count);
+        for (size_t i = 0; i < count; ++i) {
+            normalized[i] = float4{ (positions[i] - offset) * scale, 1.0f };
+        }
+        const size_t size = count * sizeof(short4);
+        short4* data = (short4*) malloc(size);
+        simd::packSnorm16((int16_t*) data, &normalized[0].x, count * 4);
+        return VertexBuffer::BufferDescriptor(data, size, FREE_CALLBACK);
+    }
+    const size_t count = accessor->count * cgltf_num_components(accessor->type);
+    if (slot.quantization == VertexQuantization::PACKED) {
+        const size_t size = count * sizeof(float);
+        float* data = (float*) malloc(size);
+        cgltf_accessor_unpack_floats(accessor, data, count);
+        return VertexBuffer::BufferDescriptor(data, size, FREE_CALLBACK);
+    }
+    assert(slot.quantization == VertexQuantization::HALF);
+    std::vector<float> floats(count);
+    cgltf_accessor_unpack_floats(accessor, floats.data(), count);
+    const size_t size = count * sizeof(half);
+    half* data = (half*) malloc(size);
+    simd::packHalf(data, floats.data(), count);
+    return VertexBuffer::BufferDescriptor(data, size, FREE_CALLBACK);
+}
+
+// Finds the value of a key in the JSON object of an extension, which cgltf keeps as a string. The
+// keys of the extensions read by the loader are not nested, so a plain search is enough.
+static const char* findJsonValue(const char* json, const char* key) {
+    auto skipSpaces = [](const char* p) {
+        while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') ++p;
+        return p;
+    };
+    const size_t length = strlen(key);
+    for (const char* p = strchr(json, '"'); p; p = strchr(p + 1, '"')) {
+        if (strncmp(p + 1, key, length) || p[length + 1] != '"') {
+            continue;
+        }
+        const char* value = skipSpaces(p + length + 2);
+        if (*value == ':') {
+            return skipSpaces(value + 1);
+        }
+    }
+    return nullptr;
+}
+
+static size_t getJsonSize(const char* json, const char* key, size_t fallback) {
+    const char* value = findJsonValue(json, key);
+    return value ? strtoul(value, nullptr, 10) : fallback;
+}
+
+static bool isJsonString(const char* json, const char* key, const char* string) {
+    const char* value = findJsonValue(json, key);
+    const size_t length = strlen(string);
+    return value && value[0] == '"' && !strncmp(value + 1, string, length) &&
+            value[length + 1] == '"';
+}
+
+// The filters of EXT_meshopt_compression, applied in place after decoding. The vendored
+// meshoptimizer predates them, they follow the reference decoders of the extension.
+template<typename T>
+static void decodeFilterOct(T* data, size_t count) {
+    const float max = float((1 << (sizeof(T) * 8 - 1)) - 1);
+    for (size_t i = 0; i < count; ++i, data += 4) {
+        // z encodes 1.0 with the same number of bits as x and y
+        float x = float(data[0]);
+        float y = float(data[1]);
+        float z = float(data[2]) - std::abs(x) - std::abs(y);
+        const float t = z >= 0.0f ? 0.0f : z;
+        x += x >= 0.0f ? t : -t;
+        y += y >= 0.0f ? t : -t;
+        const float s = max / std::sqrt(x * x + y * y + z * z);
+        data[0] = T(std::lround(x * s));
+        data[1] = T(std::lround(y * s));
+        data[2] = T(std::lround(z * s));
+    }
+}
+
+static void decodeFilterQuat(int16_t* data, size_t count) {
+    const float scale = 1.0f / std::sqrt(2.0f);
+    for (size_t i = 0; i < count; ++i, data += 4) {
+        // the 2 low bits of w are the index of the largest component, the others its scale
+        const float s = scale / float(data[3] | 3);
+        const float x = float(data[0]) * s;
+        const float y = float(data[1]) * s;
+        const float z = float(data[2]) * s;
+        const float w = std::sqrt(std::max(0.0f, 1.0f - x * x - y * y - z * z));
+        const int index = data[3] & 3;
+        data[(index + 1) & 3] = int16_t(std::lround(x * 32767.0f));
+        data[(index + 2) & 3] = int16_t(std::lround(y * 32767.0f));
+        data[(index + 3) & 3] = int16_t(std::lround(z * 32767.0f));
+        data[(index + 0) & 3] = int16_t(std::lround(w * 32767.0f));
+    }
+}
+
+static void decodeFilterExp(uint32_t* data, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        // 24 bits of signed mantissa and 8 bits of signed exponent
+        const int32_t mantissa = int32_t(data[i] << 8) >> 8;
+        const int32_t exponent = int32_t(data[i]) >> 24;
+        const float value = std::ldexp(float(mantissa), exponent);
+        memcpy(data + i, &value, sizeof(value));
+    }
+}
+
+// Decodes the buffer views compressed with EXT_meshopt_compression in parallel, into the fallback
+// buffers that they reference. Fallback buffers that were loaded already hold the uncompressed
+// data, they're left untouched. Returns false if any buffer view can't be decoded.
+static bool decodeMeshoptCompression(JobSystem& js, cgltf_data* gltf) {
+    enum class Filter { NONE, OCTAHEDRAL, QUATERNION, EXPONENTIAL };
+    struct CompressedView {
+        cgltf_buffer_view* view;
+        const uint8_t* source;
+        size_t sourceSize;
+        size_t count;
+        size_t stride;
+        bool triangles;
+        Filter filter;
+        bool success;
+    };
+
+    std::vector<CompressedView> compressedViews;
+    for (cgltf_size i = 0; i < gltf->buffer_views_count; ++i) {
+        cgltf_buffer_view* view = &gltf->buffer_views[i];
+        const char* json = nullptr;
+        for (cgltf_size j = 0; j < view->extensions_count; ++j) {
+            if (!strcmp(view->extensions[j].name, "EXT_meshopt_compression")) {
+                json = view->extensions[j].data;
+            }
+        }
+        if (!json || view->buffer->data) {
+            continue;
+        }
+
+        CompressedView compressed = { view };
+        const size_t bufferIndex = getJsonSize(json, "buffer", gltf->buffers_count);
+        const size_t byteOffset = getJsonSize(json, "byteOffset", 0);
+        compressed.sourceSize = getJsonSize(json, "byteLength", 0);
+        compressed.count = getJsonSize(json, "count", 0);
+        compressed.stride = getJsonSize(json, "byteStride", 0);
+        compressed.triangles = isJsonString(json, "mode", "TRIANGLES");
+
+        if (!findJsonValue(json, "filter") || isJsonString(json, "filter", "NONE")) {
+            compressed.filter = Filter::NONE;
+        } else if (isJsonString(json, "filter", "OCTAHEDRAL")) {
+            compressed.filter = Filter::OCTAHEDRAL;
+        } else if (isJsonString(json, "filter", "QUATERNION")) {
+            compressed.filter = Filter::QUATERNION;
+        } else if (isJsonString(json, "filter", "EXPONENTIAL")) {
+            compressed.filter = Filter::EXPONENTIAL;
+        } else {
+            slog.e << "Unknown meshopt filter in buffer view " << i << io::endl;
+            return false;
+        }
+
+        // meshoptimizer only asserts its parameters, so they're checked here. The INDICES mode
+        // needs a newer version of meshoptimizer.
+        const bool attributes = isJsonString(json, "mode", "ATTRIBUTES");
+        const size_t stride = compressed.stride;
+        const bool valid = attributes ? stride % 4 == 0 && stride <= 256 :
+                compressed.triangles && compressed.count % 3 == 0 && (stride == 2 || stride == 4);
+        const bool validFilter = compressed.filter == Filter::NONE ||
+                (compressed.filter == Filter::OCTAHEDRAL && (stride == 4 || stride == 8)) ||
+                (compressed.filter == Filter::QUATERNION && stride == 8) ||
+                (compressed.filter == Filter::EXPONENTIAL && stride % 4 == 0);
+        if (!valid || !validFilter || compressed.count * stride > view->size ||
+                view->offset + view->size > view->buffer->size) {
+            slog.e << "Unsupported meshopt compression in buffer view " << i << io::endl;
+            return false;
+        }
+        const cgltf_buffer* source = bufferIndex < gltf->buffers_count ?
+                &gltf->buffers[bufferIndex] : nullptr;
+        if (!source || !source->data || byteOffset + compressed.sourceSize > source->size) {
+            slog.e << "Missing meshopt compressed data for buffer view " << i << io::endl;
+            return false;
+        }
+        compressed.source = byteOffset + (const uint8_t*) source->data;
+        compressedViews.push_back(compressed);
+    }
+
+    // Allocate the fallback buffers, cgltf_free() releases them like the loaded ones.
+    for (CompressedView& compressed : compressedViews) {
+        cgltf_buffer* buffer = compressed.view->buffer;
+        if (!buffer->data) {
+            buffer->data = calloc(1, buffer->size);
+        }
+    }
+
+    auto decode = [&compressedViews](uint32_t startIndex, uint32_t viewCount) {
+        for (size_t i = startIndex, e = startIndex + viewCount; i < e; i++) {
+            CompressedView& compressed = compressedViews[i];
+            const cgltf_buffer_view* view = compressed.view;
+            uint8_t* destination = view->offset + (uint8_t*) view->buffer->data;
+            const size_t count = compressed.count;
+            const size_t stride = compressed.stride;
+            const int result = compressed.triangles ?
+                    meshopt_decodeIndexBuffer(destination, count, stride, compressed.source,
+                            compressed.sourceSize) :
+                    meshopt_decodeVertexBuffer(destination, count, stride, compressed.source,
+                            compressed.sourceSize);
+            compressed.success = result == 0;
+            if (!compressed.success) {
+                continue;
+            }
+            switch (compressed.filter) {
+                case Filter::NONE:
+                    break;
+                case Filter::OCTAHEDRAL:
+                    if (stride == 4) {
+                        decodeFilterOct((int8_t*) destination, count);
+                    } else {
+                        decodeFilterOct((int16_t*) destination, count);
+                    }
+                    break;
+                case Filter::QUATERNION:
+                    decodeFilterQuat((int16_t*) destination, count);
+                    break;
+                case Filter::EXPONENTIAL:
+                    decodeFilterExp((uint32_t*) destination, count * stride / 4);
+                    break;
+            }
+        }
+    };
+    auto* job = jobs::parallel_for(js, nullptr, 0, uint32_t(compressedViews.size()),
+            std::cref(decode), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+
+    for (const CompressedView& compressed : compressedViews) {
+        if (!compressed.success) {
+            slog.e << "Unable to decode meshopt compressed buffer view "
+                   << compressed.view - gltf->buffer_views << io::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void decodeDracoMeshes(JobSystem& js, FFilamentAsset* asset) {
     DracoCache* dracoCache = &asset->mDracoCache;
 
+    // Decode the compressed meshes in parallel first, a mesh shared by several primitives is
+    // only decoded once. Copying the data to the accessors below is cheap.
+    std::vector<const cgltf_buffer_view*> compressedViews;
+    for (auto pair : asset->mPrimitives) {
+        if (pair.first->has_draco_mesh_compression) {
+            compressedViews.push_back(pair.first->draco_mesh_compression.buffer_view);
+        }
+    }
+    dracoCache->decodeMeshes(js, compressedViews.data(), compressedViews.size());
+
     // For a given primitive and attribute, find the corresponding accessor.
     auto findAccessor = [](const cgltf_primitive* prim, cgltf_attribute_type type, cgltf_int idx) {
         for (cgltf_size i = 0; i < prim->attributes_count; i++) {
@@ -261,6 +696,250 @@ static void decodeDracoMeshes(FFilamentAsset* asset) {
     }
 }
 
+// Returns the size of the elements of a vertex or index accessor, 0 if it isn't supported.
+static size_t getElementSize(const cgltf_accessor* accessor) {
+    switch (accessor->component_type) {
+        case cgltf_component_type_r_8:
+        case cgltf_component_type_r_8u:
+            return cgltf_num_components(accessor->type);
+        case cgltf_component_type_r_16:
+        case cgltf_component_type_r_16u:
+            return cgltf_num_components(accessor->type) * 2;
+        case cgltf_component_type_r_32u:
+        case cgltf_component_type_r_32f:
+            return cgltf_num_components(accessor->type) * 4;
+        default:
+            return 0;
+    }
+}
+
+// Rewrites the vertices of an accessor in place, vertex i moves to remap[i] unless it's unused.
+static void remapVertices(const cgltf_accessor* accessor, const uint32_t* remap) {
+    const size_t size = getElementSize(accessor);
+    const size_t stride = accessor->stride;
+    uint8_t* data = computeBindingOffset(accessor) + (uint8_t*) accessor->buffer_view->buffer->data;
+    std::vector<uint8_t> source(accessor->count * size);
+    for (size_t i = 0, n = accessor->count; i < n; ++i) {
+        memcpy(source.data() + i * size, data + i * stride, size);
+    }
+    for (size_t i = 0, n = accessor->count; i < n; ++i) {
+        if (remap[i] != ~0u) {
+            memcpy(data + remap[i] * stride, source.data() + i * size, size);
+        }
+    }
+}
+
+// Splits triangles optimized for the vertex cache into meshlets, whose triangles are made
+// consecutive, and computes their bounds. The indices are left untouched if that fails.
+static void buildClusters(std::vector<uint32_t>& indices, const std::vector<float3>& points,
+        FFilamentAsset::Clusters* clusters) {
+    constexpr size_t MAX_VERTICES = 64;
+    constexpr size_t MAX_TRIANGLES = 124;
+    std::vector<meshopt_Meshlet> meshlets(
+            meshopt_buildMeshletsBound(indices.size(), MAX_VERTICES, MAX_TRIANGLES));
+    meshlets.resize(meshopt_buildMeshlets(meshlets.data(), indices.data(), indices.size(),
+            points.size(), MAX_VERTICES, MAX_TRIANGLES));
+
+    std::vector<uint32_t> clustered;
+    clustered.reserve(indices.size());
+    clusters->resize(meshlets.size());
+    for (size_t i = 0, n = meshlets.size(); i < n; ++i) {
+        const meshopt_Meshlet& meshlet = meshlets[i];
+        const meshopt_Bounds bounds = meshopt_computeMeshletBounds(meshlet, &points[0].x,
+                points.size(), sizeof(float3));
+        RenderableManager::Cluster& cluster = (*clusters)[i];
+        cluster.center = { bounds.center[0], bounds.center[1], bounds.center[2] };
+        cluster.radius = bounds.radius;
+        cluster.coneAxis = { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2] };
+        cluster.coneCutoff = bounds.cone_cutoff;
+        cluster.offset = uint32_t(clustered.size());
+        cluster.count = meshlet.triangle_count * 3u;
+        for (size_t t = 0; t < meshlet.triangle_count; ++t) {
+            for (size_t c = 0; c < 3; ++c) {
+                clustered.push_back(meshlet.vertices[meshlet.indices[t][c]]);
+            }
+        }
+    }
+
+    if (clustered.size() != indices.size()) {
+        clusters->clear();
+        return;
+    }
+    indices.swap(clustered);
+}
+
+// Reorders the triangles of a primitive for the vertex cache and for overdraw, then its vertices
+// for fetch locality. Vertices that no triangle references end up last. If clusters is not null,
+// the triangles are also split into clusters.
+static void optimizePrimitive(const cgltf_primitive* prim, FFilamentAsset::Clusters* clusters) {
+    const cgltf_accessor* positions = nullptr;
+    for (cgltf_size i = 0; i < prim->attributes_count; ++i) {
+        if (prim->attributes[i].type == cgltf_attribute_type_position) {
+            positions = prim->attributes[i].data;
+        }
+    }
+    const cgltf_accessor* indexAccessor = prim->indices;
+    const size_t indexCount = indexAccessor->count;
+    const size_t vertexCount = positions->count;
+
+    std::vector<uint32_t> indices(indexCount);
+    for (size_t i = 0; i < indexCount; ++i) {
+        indices[i] = uint32_t(cgltf_accessor_read_index(indexAccessor, i));
+        if (indices[i] >= vertexCount) {
+            return;
+        }
+    }
+    std::vector<float3> points(vertexCount);
+    cgltf_accessor_unpack_floats(positions, &points[0].x, vertexCount * 3);
+
+    meshopt_optimizeVertexCache(indices.data(), indices.data(), indexCount, vertexCount);
+    meshopt_optimizeOverdraw(indices.data(), indices.data(), indexCount, &points[0].x,
+            vertexCount, sizeof(float3), 1.05f);
+    if (clusters) {
+        buildClusters(indices, points, clusters);
+    }
+    std::vector<uint32_t> remap(vertexCount);
+    meshopt_optimizeVertexFetchRemap(remap.data(), indices.data(), indexCount, vertexCount);
+    meshopt_remapIndexBuffer(indices.data(), indices.data(), indexCount, remap.data());
+
+    for (cgltf_size i = 0; i < prim->attributes_count; ++i) {
+        remapVertices(prim->attributes[i].data, remap.data());
+    }
+    for (cgltf_size i = 0; i < prim->targets_count; ++i) {
+        const cgltf_morph_target& target = prim->targets[i];
+        for (cgltf_size j = 0; j < target.attributes_count; ++j) {
+            remapVertices(target.attributes[j].data, remap.data());
+        }
+    }
+
+    uint8_t* data = computeBindingOffset(indexAccessor) +
+            (uint8_t*) indexAccessor->buffer_view->buffer->data;
+    for (size_t i = 0; i < indexCount; ++i) {
+        switch (indexAccessor->component_type) {
+            case cgltf_component_type_r_8u:
+                data[i] = uint8_t(indices[i]);
+                break;
+            case cgltf_component_type_r_16u:
+                ((uint16_t*) data)[i] = uint16_t(indices[i]);
+                break;
+            default:
+                ((uint32_t*) data)[i] = indices[i];
+                break;
+        }
+    }
+}
+
+// Optimizes the indexed triangle primitives, see AssetConfiguration::optimizeMeshes. Their data
+// is rewritten in place, so the primitives sharing buffer views with others are skipped. The
+// clusters of the optimized primitives are added to the given map, unless it is null.
+static void optimizeMeshes(JobSystem& js, const cgltf_data* gltf,
+        tsl::robin_map<const cgltf_primitive*, FFilamentAsset::Clusters>* clusters) {
+    // Find the primitive that owns each buffer view, null when it is shared.
+    tsl::robin_map<const cgltf_buffer_view*, const cgltf_primitive*> owners;
+    auto forEachAccessor = [](const cgltf_primitive& prim, auto&& fn) {
+        fn(prim.indices);
+        for (cgltf_size i = 0; i < prim.attributes_count; ++i) {
+            fn(prim.attributes[i].data);
+        }
+        for (cgltf_size i = 0; i < prim.targets_count; ++i) {
+            for (cgltf_size j = 0; j < prim.targets[i].attributes_count; ++j) {
+                fn(prim.targets[i].attributes[j].data);
+            }
+        }
+    };
+    for (cgltf_size m = 0; m < gltf->meshes_count; ++m) {
+        for (cgltf_size p = 0; p < gltf->meshes[m].primitives_count; ++p) {
+            const cgltf_primitive* prim = &gltf->meshes[m].primitives[p];
+            forEachAccessor(*prim, [&owners, prim](const cgltf_accessor* accessor) {
+                if (accessor && accessor->buffer_view) {
+                    auto [pos, inserted] = owners.insert({ accessor->buffer_view, prim });
+                    if (!inserted && pos->second != prim) {
+                        owners[accessor->buffer_view] = nullptr;
+                    }
+                }
+            });
+        }
+    }
+
+    std::vector<const cgltf_primitive*> primitives;
+    for (cgltf_size m = 0; m < gltf->meshes_count; ++m) {
+        for (cgltf_size p = 0; p < gltf->meshes[m].primitives_count; ++p) {
+            const cgltf_primitive* prim = &gltf->meshes[m].primitives[p];
+            if (prim->type != cgltf_primitive_type_triangles || !prim->indices ||
+                    prim->indices->count % 3 || !prim->attributes_count) {
+                continue;
+            }
+            const size_t vertexCount = prim->attributes[0].data->count;
+            bool eligible = getElementSize(prim->indices) > 0;
+            bool hasPositions = false;
+            forEachAccessor(*prim, [&](const cgltf_accessor* accessor) {
+                eligible = eligible && accessor->buffer_view && !accessor->is_sparse &&
+                        owners[accessor->buffer_view] == prim && getElementSize(accessor) > 0 &&
+                        (accessor == prim->indices || accessor->count == vertexCount);
+            });
+            for (cgltf_size i = 0; i < prim->attributes_count; ++i) {
+                hasPositions |= prim->attributes[i].type == cgltf_attribute_type_position;
+            }
+            if (eligible && hasPositions) {
+                primitives.push_back(prim);
+            }
+        }
+    }
+
+    std::vector<FFilamentAsset::Clusters> primitiveClusters(clusters ? primitives.size() : 0);
+    auto optimize = [&primitives, &primitiveClusters](uint32_t start, uint32_t count) {
+        for (size_t i = start, e = start + count; i < e; ++i) {
+            optimizePrimitive(primitives[i],
+                    primitiveClusters.empty() ? nullptr : &primitiveClusters[i]);
+        }
+    };
+    auto* job = jobs::parallel_for(js, nullptr, 0, uint32_t(primitives.size()),
+            std::cref(optimize), jobs::CountSplitter<1>());
+    js.runAndWait(job);
+
+    for (size_t i = 0, n = primitiveClusters.size(); i < n; ++i) {
+        if (!primitiveClusters[i].empty()) {
+            (*clusters)[primitives[i]] = std::move(primitiveClusters[i]);
+        }
+    }
+}
+
+// Reads the clusters of the primitives from the cache, or records them in the cache, then sets
+// them on the renderables that were created before they were available.
+static void applyClusters(FFilamentAsset* asset, const AssetCache* cached, AssetCache* recorder) {
+    const cgltf_data* gltf = asset->mSourceAsset;
+    auto& clusters = asset->mClusters;
+    if (cached) {
+        for (const AssetCache::PrimitiveClusters& primitive : cached->getClusters()) {
+            if (primitive.mesh < gltf->meshes_count &&
+                    primitive.primitive < gltf->meshes[primitive.mesh].primitives_count) {
+                clusters[&gltf->meshes[primitive.mesh].primitives[primitive.primitive]] =
+                        primitive.clusters;
+            }
+        }
+    } else if (recorder) {
+        for (cgltf_size m = 0; m < gltf->meshes_count; ++m) {
+            for (cgltf_size p = 0; p < gltf->meshes[m].primitives_count; ++p) {
+                auto pos = clusters.find(&gltf->meshes[m].primitives[p]);
+                if (pos != clusters.end()) {
+                    recorder->addClusters(uint32_t(m), uint32_t(p), pos->second.data(),
+                            pos->second.size());
+                }
+            }
+        }
+    }
+
+    RenderableManager& rm = asset->mEngine->getRenderableManager();
+    for (const FFilamentAsset::ClusteredPrimitive& clustered : asset->mClusteredPrimitives) {
+        auto pos = clusters.find(clustered.primitive);
+        RenderableManager::Instance ri = rm.getInstance(clustered.entity);
+        if (pos != clusters.end() && ri) {
+            rm.setClustersAt(ri, clustered.index, pos->second.data(), pos->second.size());
+        }
+    }
+    asset->mClusteredPrimitives.clear();
+}
+
 ResourceLoader::ResourceLoader(const ResourceConfiguration& config) :
         mPool(new AssetPool), pImpl(new Impl(config)) { }
 
@@ -278,12 +957,33 @@ void ResourceLoader::addResourceData(const char* uri, BufferDescriptor&& buffer)
         SYSTRACE_ASYNC_BEGIN("addResourceData", 1);
     }
     pImpl->mUriDataCache.emplace(uri, std::move(buffer));
+
+    // The images that were missing when an asynchronous load started are decoded as they arrive.
+    if (pImpl->mCurrentAsset) {
+        pImpl->addDeferredTexture(uri);
+    }
 }
 
 bool ResourceLoader::hasResourceData(const char* uri) const {
     return pImpl->mUriDataCache.find(uri) != pImpl->mUriDataCache.end();
 }
 
+bool ResourceLoader::hasBufferData(const FilamentAsset* asset) const {
+    #if !USE_FILESYSTEM
+    const cgltf_data* gltf = upcast(asset)->mSourceAsset;
+    for (cgltf_size i = 0; gltf && i < gltf->buffers_count; ++i) {
+        const char* uri = gltf->buffers[i].uri;
+        if (gltf->buffers[i].data || !uri || strncmp(uri, "data:", 5) == 0) {
+            continue;
+        }
+        if (strstr(uri, "://") == nullptr && !hasResourceData(uri)) {
+            return false;
+        }
+    }
+    #endif
+    return true;
+}
+
 bool ResourceLoader::loadResources(FilamentAsset* asset) {
     FFilamentAsset* fasset = upcast(asset);
     return loadResources(fasset, false);
@@ -301,6 +1001,17 @@ bool ResourceLoader::loadResources(FFilamentAsset* asset, bool async) {
     const cgltf_data* gltf = asset->mSourceAsset;
     cgltf_options options {};
 
+    // returns the time since the previous call, to measure each phase
+    LoadTimings& timings = pImpl->mLoadTimings;
+    timings = {};
+    auto lapStart = std::chrono::steady_clock::now();
+    auto lap = [&lapStart]() {
+        const auto now = std::chrono::steady_clock::now();
+        const float seconds = std::chrono::duration<float>(now - lapStart).count();
+        lapStart = now;
+        return seconds;
+    };
+
     // For emscripten and Android builds we have a custom implementation of cgltf_load_buffers which
     // looks inside a cache of externally-supplied data blobs, rather than loading from the
     // filesystem.
@@ -362,7 +1073,13 @@ bool ResourceLoader::loadResources(FFilamentAsset* asset, bool async) {
 
     #else
 
-    // Read data from the file system and base64 URIs.
+    // Read data from the file system and base64 URIs. cgltf_free() releases the buffers with the
+    // file options of the asset, so they must match the ones used for reading.
+    if (pImpl->mMemoryMapBuffers && HAS_MMAP) {
+        options.file.read = MappedFiles::map;
+        options.file.release = MappedFiles::release;
+        ((cgltf_data*) gltf)->file = options.file;
+    }
     cgltf_result result = cgltf_load_buffers(&options, (cgltf_data*) gltf, pImpl->mGltfPath.c_str());
     if (result != cgltf_result_success) {
         slog.e << "Unable to load resources." << io::endl;
@@ -371,6 +1088,7 @@ bool ResourceLoader::loadResources(FFilamentAsset* asset, bool async) {
 
     #endif
     SYSTRACE_NAME_END();
+    timings.buffers = lap();
 
     #ifndef NDEBUG
     if (cgltf_validate((cgltf_data*) gltf) != cgltf_result_success) {
@@ -379,14 +1097,60 @@ bool ResourceLoader::loadResources(FFilamentAsset* asset, bool async) {
     }
     #endif
 
+    // Decompress the meshopt buffer views before anything reads them.
+    timings.other += lap();
+    if (!decodeMeshoptCompression(pImpl->mEngine->getJobSystem(), (cgltf_data*) gltf)) {
+        return false;
+    }
+    timings.meshopt = lap();
+
+    // Number the vertex and index buffers for the cache.
+    pImpl->mVertexBuffers.clear();
+    pImpl->mIndexBuffers.clear();
+    pImpl->mBufferOrdinals.clear();
+    for (auto slot : asset->mBufferSlots) {
+        if (slot.vertexBuffer && !pImpl->mBufferOrdinals.count(slot.vertexBuffer)) {
+            pImpl->mBufferOrdinals[slot.vertexBuffer] = uint32_t(pImpl->mVertexBuffers.size());
+            pImpl->mVertexBuffers.push_back(slot.vertexBuffer);
+        }
+        if (slot.indexBuffer && !pImpl->mBufferOrdinals.count(slot.indexBuffer)) {
+            pImpl->mBufferOrdinals[slot.indexBuffer] = uint32_t(pImpl->mIndexBuffers.size());
+            pImpl->mIndexBuffers.push_back(slot.indexBuffer);
+        }
+    }
+
+    // Use the processed data of the cache if it is up to date, otherwise record it.
+    AssetCache cache;
+    const uint64_t cacheKey = AssetCache::computeKey(gltf,
+            (pImpl->mNormalizeSkinningWeights ? 1 : 0) | (pImpl->mRecomputeBoundingBoxes ? 2 : 0) |
+            (asset->mQuantizeVertices ? 4 : 0) | (asset->mOptimizeMeshes ? 8 : 0) |
+            (asset->mClusterMeshes ? 16 : 0) | (asset->mSeparatePositions ? 32 : 0));
+    const bool useCache = !pImpl->mCachePath.empty();
+    const bool cached = useCache && cache.read(pImpl->mCachePath.c_str(), cacheKey);
+    pImpl->mCacheRecorder = useCache && !cached ? &cache : nullptr;
+
     // Decompress Draco meshes early on, which allows us to exploit subsequent processing such as
     // tangent generation.
-    decodeDracoMeshes(asset);
+    timings.other += lap();
+    if (!cached) {
+        decodeDracoMeshes(pImpl->mEngine->getJobSystem(), asset);
+    }
+    timings.draco = lap();
+
+    // Optimize the meshes once they are decompressed, before their data is read.
+    if (!cached && asset->mOptimizeMeshes) {
+        optimizeMeshes(pImpl->mEngine->getJobSystem(), gltf,
+                asset->mClusterMeshes ? &asset->mClusters : nullptr);
+    }
+    if (asset->mClusterMeshes) {
+        applyClusters(asset, cached ? &cache : nullptr, pImpl->mCacheRecorder);
+    }
+    timings.meshes = lap();
 
     // Normalize skinning weights, then "import" each skin into the asset by building a mapping of
     // skins to their affected entities.
     if (gltf->skins_count > 0) {
-        if (pImpl->mNormalizeSkinningWeights) {
+        if (pImpl->mNormalizeSkinningWeights && !cached) {
             normalizeSkinningWeights(asset);
         }
         if (asset->mInstances.empty()) {
@@ -399,53 +1163,113 @@ bool ResourceLoader::loadResources(FFilamentAsset* asset, bool async) {
     }
 
     if (pImpl->mRecomputeBoundingBoxes) {
-        updateBoundingBoxes(asset);
+        if (cached) {
+            applyCachedBoundingBoxes(asset, cache);
+        } else {
+            updateBoundingBoxes(asset);
+        }
     }
 
     Engine& engine = *pImpl->mEngine;
-
-    // Upload VertexBuffer and IndexBuffer data to the GPU.
-    for (auto slot : asset->mBufferSlots) {
-        const cgltf_accessor* accessor = slot.accessor;
-        if (!accessor->buffer_view) {
-            continue;
+    timings.other += lap();
+
+    // Upload the cached VertexBuffer and IndexBuffer data to the GPU, in the order it was recorded.
+    if (cached) {
+        for (AssetCache::Buffer& buffer : cache.getBuffers()) {
+            if (buffer.type == AssetCache::BufferType::VERTEX &&
+                    buffer.ordinal < pImpl->mVertexBuffers.size()) {
+                VertexBuffer::BufferDescriptor bd(buffer.data, buffer.size, FREE_CALLBACK);
+                pImpl->mVertexBuffers[buffer.ordinal]->setBufferAt(engine, buffer.bufferIndex,
+                        std::move(bd));
+                buffer.data = nullptr;
+            } else if (buffer.type == AssetCache::BufferType::INDEX &&
+                    buffer.ordinal < pImpl->mIndexBuffers.size()) {
+                IndexBuffer::BufferDescriptor bd(buffer.data, buffer.size, FREE_CALLBACK);
+                pImpl->mIndexBuffers[buffer.ordinal]->setBuffer(engine, std::move(bd));
+                buffer.data = nullptr;
+            }
         }
-        auto bufferData = (const uint8_t*) accessor->buffer_view->buffer->data;
-        const uint8_t* data = computeBindingOffset(accessor) + bufferData;
-        const uint32_t size = computeBindingSize(accessor);
-        if (slot.vertexBuffer) {
+    } else {
+        // Upload VertexBuffer and IndexBuffer data to the GPU.
+        for (auto slot : asset->mBufferSlots) {
+            const cgltf_accessor* accessor = slot.accessor;
+            if (slot.quantization != VertexQuantization::NONE) {
+                // this also applies the sparse data
+                pImpl->setVertexBuffer(slot.vertexBuffer, slot.bufferIndex,
+                        quantizeVertices(slot));
+                continue;
+            }
+            if (!accessor->buffer_view) {
+                continue;
+            }
+            auto bufferData = (const uint8_t*) accessor->buffer_view->buffer->data;
+            const uint8_t* data = computeBindingOffset(accessor) + bufferData;
+            const uint32_t size = computeBindingSize(accessor);
+            if (slot.vertexBuffer) {
+                mPool->addPendingUpload();
+                VertexBuffer::BufferDescriptor bd(data, size, AssetPool::onLoadedResource, mPool);
+                pImpl->setVertexBuffer(slot.vertexBuffer, slot.bufferIndex, std::move(bd));
+                continue;
+            }
+            assert(slot.indexBuffer);
+            if (slot.shortIndices) {
+                const size_t size16 = accessor->count * sizeof(uint16_t);
+                uint16_t* data16 = (uint16_t*) malloc(size16);
+                convertIntsToShorts(data16, (const uint32_t*) data, accessor->count);
+                IndexBuffer::BufferDescriptor bd(data16, size16, FREE_CALLBACK);
+                pImpl->setIndexBuffer(slot.indexBuffer, std::move(bd));
+                continue;
+            }
+            if (accessor->component_type == cgltf_component_type_r_8u) {
+                const size_t size16 = size * 2;
+                uint16_t* data16 = (uint16_t*) malloc(size16);
+                convertBytesToShorts(data16, data, size);
+                IndexBuffer::BufferDescriptor bd(data16, size16, FREE_CALLBACK);
+                pImpl->setIndexBuffer(slot.indexBuffer, std::move(bd));
+                continue;
+            }
             mPool->addPendingUpload();
-            VertexBuffer::BufferDescriptor bd(data, size, AssetPool::onLoadedResource, mPool);
-            slot.vertexBuffer->setBufferAt(engine, slot.bufferIndex, std::move(bd));
-            continue;
+            IndexBuffer::BufferDescriptor bd(data, size, AssetPool::onLoadedResource, mPool);
+            pImpl->setIndexBuffer(slot.indexBuffer, std::move(bd));
         }
-        assert(slot.indexBuffer);
-        if (accessor->component_type == cgltf_component_type_r_8u) {
-            const size_t size16 = size * 2;
-            uint16_t* data16 = (uint16_t*) malloc(size16);
-            convertBytesToShorts(data16, data, size);
-            IndexBuffer::BufferDescriptor bd(data16, size16, FREE_CALLBACK);
-            slot.indexBuffer->setBuffer(engine, std::move(bd));
-            continue;
-        }
-        mPool->addPendingUpload();
-        IndexBuffer::BufferDescriptor bd(data, size, AssetPool::onLoadedResource, mPool);
-        slot.indexBuffer->setBuffer(engine, std::move(bd));
     }
 
     // Apply sparse data modifications to base arrays, then upload the result.
-    applySparseData(asset);
+    if (!cached) {
+        applySparseData(asset);
+    }
+    timings.upload = lap();
+
+    // Keep the positions of all the morph targets of the primitives that have too many of them.
+    loadMorphTargets(asset);
 
     // Compute surface orientation quaternions if necessary. This is similar to sparse data in that
     // we need to generate the contents of a GPU buffer by processing one or more CPU buffer(s).
-    pImpl->computeTangents(asset);
+    timings.other += lap();
+    if (!cached) {
+        pImpl->computeTangents(asset);
+    }
+    timings.tangents = lap();
+
+    if (pImpl->mCacheRecorder) {
+        cache.write(pImpl->mCachePath.c_str(), cacheKey);
+        pImpl->mCacheRecorder = nullptr;
+    }
 
     // Non-textured renderables are now considered ready, so notify the dependency graph.
     asset->mDependencyGraph.finalize();
     pImpl->mCurrentAsset = asset;
 
+    timings.other += lap();
+
     // Finally, load image files and create Filament Textures.
-    return pImpl->createTextures(async);
+    const bool texturesCreated = pImpl->createTextures(async);
+    timings.textures = lap();
+    return texturesCreated;
+}
+
+ResourceLoader::LoadTimings ResourceLoader::getLoadTimings() const {
+    return pImpl->mLoadTimings;
 }
 
 bool ResourceLoader::asyncBeginLoad(FilamentAsset* asset) {
@@ -463,23 +1287,115 @@ float ResourceLoader::asyncGetLoadProgress() const {
 }
 
 void ResourceLoader::asyncUpdateLoad() {
-    if (!UTILS_HAS_THREADING) {
+    if (!UTILS_HAS_JOB_THREADS) {
         pImpl->decodeSingleTexture();
     }
-    pImpl->uploadPendingTextures();
+    pImpl->uploadPendingTextures(pImpl->mAsyncUploadBudget);
+}
+
+// Images of KHR_texture_basisu are read as KTX 1.1 containers, see
+// https://www.khronos.org/registry/KTX/specs/1.0/ktxspec_v1.html. Only 2D textures are supported.
+static constexpr uint8_t KTX_IDENTIFIER[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static constexpr size_t KTX_HEADER_SIZE = 64;
+
+static bool parseKtxHeader(const uint8_t* header, size_t size, image::KtxInfo* info,
+        uint32_t* levels) {
+    if (size < KTX_HEADER_SIZE || memcmp(header, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER))) {
+        return false;
+    }
+    uint32_t fields[13];
+    memcpy(fields, header + sizeof(KTX_IDENTIFIER), sizeof(fields));
+    memcpy(info, fields, sizeof(image::KtxInfo));
+    const uint32_t arrayElements = fields[9];
+    const uint32_t faces = fields[10];
+    *levels = std::max(fields[11], 1u);
+    return info->endianness == 0x04030201 && info->pixelDepth == 0 && arrayElements == 0 &&
+            faces == 1;
+}
+
+static Texture::InternalFormat getKtxFormat(const image::KtxInfo& info, bool srgb) {
+    const Texture::InternalFormat format = image::ktx::toTextureFormat(info);
+    if (srgb && format == Texture::InternalFormat::RGB8) {
+        return Texture::InternalFormat::SRGB8;
+    }
+    if (srgb && format == Texture::InternalFormat::RGBA8) {
+        return Texture::InternalFormat::SRGB8_A8;
+    }
+    return format;
+}
+
+#if USE_FILESYSTEM
+static std::vector<uint8_t> readFile(const Path& path, size_t maxSize = SIZE_MAX) {
+    std::ifstream in(path.c_str(), std::ifstream::binary | std::ifstream::ate);
+    if (!in) {
+        return {};
+    }
+    std::vector<uint8_t> contents(std::min(size_t(in.tellg()), maxSize));
+    in.seekg(0);
+    in.read((char*) contents.data(), contents.size());
+    return contents;
+}
+
+// the file is mapped and its levels are uploaded from the mapping, see uploadKtx()
+static image::KtxBundle* loadKtxFile(const Path& path) {
+    image::KtxBundle* ktx = image::KtxBundle::createFromFile(path.c_str());
+    if (!ktx) {
+        slog.e << "Unable to load texture: " << path.c_str() << io::endl;
+    }
+    return ktx;
+}
+#endif
+
+// Uploads all the levels of a KTX texture as they are stored, the bundle is destroyed once the
+// driver has consumed all of them.
+static void uploadKtx(Engine& engine, Texture* texture, image::KtxBundle* ktx) {
+    struct Upload {
+        image::KtxBundle* ktx;
+        uint32_t remainingLevels;
+    };
+    auto callback = [](void*, size_t, void* user) {
+        Upload* upload = (Upload*) user;
+        if (--upload->remainingLevels == 0) {
+            delete upload->ktx;
+            delete upload;
+        }
+    };
+    const image::KtxInfo& info = ktx->getInfo();
+    const uint32_t levels = ktx->getNumMipLevels();
+    Upload* upload = new Upload{ktx, levels};
+    for (uint32_t level = 0; level < levels; ++level) {
+        uint8_t* data;
+        uint32_t size;
+        ktx->getBlob({level, 0, 0}, &data, &size);
+        if (image::ktx::isCompressed(info)) {
+            Texture::PixelBufferDescriptor pbd(data, size,
+                    image::ktx::toCompressedPixelDataType(info), size, callback, upload);
+            texture->setImage(engine, level, std::move(pbd));
+        } else {
+            Texture::PixelBufferDescriptor pbd(data, size, image::ktx::toPixelDataFormat(info),
+                    image::ktx::toPixelDataType(info), callback, upload);
+            texture->setImage(engine, level, std::move(pbd));
+        }
+    }
 }
 
 void ResourceLoader::Impl::decodeSingleTexture() {
-    assert(!UTILS_HAS_THREADING);
+    assert(!UTILS_HAS_JOB_THREADS);
     int w, h, c;
 
     // Check if any buffer-based textures haven't been decoded yet.
     for (auto& pair : mBufferTextureCache) {
         const uint8_t* sourceData = (const uint8_t*) pair.first;
         TextureCacheEntry* entry = pair.second.get();
-        if (entry->texels) {
+        if (entry->texels || entry->ktx || entry->completed) {
             continue;
         }
+        if (entry->isKtx) {
+            entry->ktx = new image::KtxBundle(sourceData, entry->bufferSize);
+            return;
+        }
         entry->texels = stbi_load_from_memory(sourceData, entry->bufferSize, &w, &h, &c, 4);
         return;
     }
@@ -488,7 +1404,7 @@ void ResourceLoader::Impl::decodeSingleTexture() {
     for (auto& pair : mUriTextureCache) {
         auto uri = pair.first;
         TextureCacheEntry* entry = pair.second.get();
-        if (entry->texels) {
+        if (entry->texels || entry->ktx || entry->completed || entry->deferred) {
             continue;
         }
 
@@ -496,6 +1412,10 @@ void ResourceLoader::Impl::decodeSingleTexture() {
         auto iter = mUriDataCache.find(uri);
         if (iter != mUriDataCache.end()) {
             const uint8_t* sourceData = (const uint8_t*) iter->second.buffer;
+            if (entry->isKtx) {
+                entry->ktx = new image::KtxBundle(sourceData, iter->second.size);
+                return;
+            }
             entry->texels = stbi_load_from_memory(sourceData, iter->second.size, &w, &h, &c, 4);
             return;
         }
@@ -508,29 +1428,84 @@ void ResourceLoader::Impl::decodeSingleTexture() {
             return;
         #else
             Path fullpath = Path(mGltfPath).getParent() + uri;
+            if (entry->isKtx) {
+                entry->ktx = loadKtxFile(fullpath);
+                return;
+            }
             entry->texels = stbi_load(fullpath.c_str(), &w, &h, &c, 4);
             return;
         #endif
     }
 }
 
-void ResourceLoader::Impl::uploadPendingTextures() {
-    auto upload = [this](TextureCacheEntry* entry, Engine& engine) {
+// Textures that contribute the most to the look of an asset are uploaded first when the uploads
+// are spread over several calls to asyncUpdateLoad().
+static int getUploadPriority(const char* materialParameter) {
+    if (!strcmp(materialParameter, "baseColorMap")) return 0;
+    if (!strcmp(materialParameter, "normalMap")) return 1;
+    if (!strcmp(materialParameter, "metallicRoughnessMap")) return 2;
+    if (!strcmp(materialParameter, "emissiveMap")) return 3;
+    if (!strcmp(materialParameter, "occlusionMap")) return 5;
+    return 4;
+}
+
+// The textures of the coarser levels of detail of an asset are uploaded first, so that it can be
+// drawn with its coarsest level as early as possible.
+static int getUploadPriority(const FFilamentAsset* asset, const TextureSlot& slot) {
+    auto iter = asset->mDetailRanks.find(slot.materialInstance);
+    const int rank = iter == asset->mDetailRanks.end() ? 0 : iter->second;
+    return rank * 6 + getUploadPriority(slot.materialParameter);
+}
+
+void ResourceLoader::Impl::uploadPendingTextures(size_t budget) {
+    // Gather the decoded textures that haven't been uploaded yet, in order of priority.
+    std::vector<TextureCacheEntry*> pending;
+    auto gather = [&pending](TextureCacheEntry* entry) {
+        if (entry->texture && !entry->completed && (entry->texels || entry->ktx)) {
+            pending.push_back(entry);
+        }
+    };
+    for (auto& pair : mBufferTextureCache) gather(pair.second.get());
+    for (auto& pair : mUriTextureCache) gather(pair.second.get());
+    std::stable_sort(pending.begin(), pending.end(),
+            [](const TextureCacheEntry* lhs, const TextureCacheEntry* rhs) {
+                return lhs->priority < rhs->priority;
+            });
+
+    size_t uploadedSize = 0;
+    for (TextureCacheEntry* entry : pending) {
         Texture* texture = entry->texture;
-        uint8_t* texels = entry->texels;
-        if (texture && texels && !entry->completed) {
-            Texture::PixelBufferDescriptor pbd(texels,
-                    texture->getWidth() * texture->getHeight() * 4,
+        image::KtxBundle* ktx = entry->ktx;
+        size_t size = 0;
+        if (ktx) {
+            for (uint32_t level = 0; level < ktx->getNumMipLevels(); ++level) {
+                uint8_t* data;
+                uint32_t levelSize;
+                ktx->getBlob({level, 0, 0}, &data, &levelSize);
+                size += levelSize;
+            }
+        } else {
+            size = texture->getWidth() * texture->getHeight() * 4;
+        }
+
+        // The remaining textures are uploaded by the next calls once the budget is spent.
+        if (budget && uploadedSize && uploadedSize + size > budget) {
+            break;
+        }
+        uploadedSize += size;
+
+        if (ktx) {
+            uploadKtx(*mEngine, texture, ktx);
+        } else {
+            Texture::PixelBufferDescriptor pbd(entry->texels, size,
                     Texture::Format::RGBA, Texture::Type::UBYTE, FREE_CALLBACK);
-            texture->setImage(engine, 0, std::move(pbd));
-            texture->generateMipmaps(engine);
-            entry->completed = true;
-            mNumDecoderTasksFinished++;
-            mCurrentAsset->mDependencyGraph.markAsReady(texture);
+            texture->setImage(*mEngine, 0, std::move(pbd));
+            texture->generateMipmaps(*mEngine);
         }
-    };
-    for (auto& pair : mBufferTextureCache) upload(pair.second.get(), *mEngine);
-    for (auto& pair : mUriTextureCache) upload(pair.second.get(), *mEngine);
+        entry->completed = true;
+        mNumDecoderTasksFinished++;
+        mCurrentAsset->mDependencyGraph.markAsReady(texture);
+    }
 }
 
 void ResourceLoader::Impl::releasePendingTextures() {
@@ -542,21 +1517,111 @@ void ResourceLoader::Impl::releasePendingTextures() {
             // if uploads have been cancelled then we need to free them explicitly.
             free(texels);
         }
+        if (texture && !entry->completed) {
+            delete entry->ktx.exchange(nullptr);
+            if (mSharedTextureCache) {
+                mSharedTextureCache->unshare(texture);
+            }
+        }
     };
     for (auto& pair : mBufferTextureCache) release(pair.second.get(), *mEngine);
     for (auto& pair : mUriTextureCache) release(pair.second.get(), *mEngine);
 }
 
+const cgltf_image* ResourceLoader::Impl::selectImage(const cgltf_texture* srcTexture, bool srgb,
+        image::KtxInfo* info, uint32_t* levels) {
+    const cgltf_data* srcAsset = mCurrentAsset->mSourceAsset;
+
+    // Peeks at the KTX header of an image, from its buffer view, the user-supplied resource cache
+    // or the file system.
+    auto readHeader = [this](const cgltf_image* image, uint8_t* header) {
+        if (const cgltf_buffer_view* bv = image->buffer_view) {
+            if (!bv->buffer->data || bv->size < KTX_HEADER_SIZE) {
+                return false;
+            }
+            memcpy(header, bv->offset + (const uint8_t*) bv->buffer->data, KTX_HEADER_SIZE);
+            return true;
+        }
+        if (!image->uri) {
+            return false;
+        }
+        auto iter = mUriDataCache.find(image->uri);
+        if (iter != mUriDataCache.end()) {
+            if (iter->second.size < KTX_HEADER_SIZE) {
+                return false;
+            }
+            memcpy(header, iter->second.buffer, KTX_HEADER_SIZE);
+            return true;
+        }
+        #if !USE_FILESYSTEM
+            return false;
+        #else
+            Path fullpath = Path(mGltfPath).getParent() + image->uri;
+            std::vector<uint8_t> contents = readFile(fullpath, KTX_HEADER_SIZE);
+            if (contents.size() < KTX_HEADER_SIZE) {
+                return false;
+            }
+            memcpy(header, contents.data(), KTX_HEADER_SIZE);
+            return true;
+        #endif
+    };
+
+    for (cgltf_size i = 0; i < srcTexture->extensions_count; ++i) {
+        const cgltf_extension& extension = srcTexture->extensions[i];
+        if (strcmp(extension.name, "KHR_texture_basisu") || !extension.data) {
+            continue;
+        }
+        const size_t index = getJsonSize(extension.data, "source", srcAsset->images_count);
+        if (index >= srcAsset->images_count) {
+            continue;
+        }
+        const cgltf_image* image = srcAsset->images + index;
+        uint8_t header[KTX_HEADER_SIZE];
+        if (readHeader(image, header) && parseKtxHeader(header, KTX_HEADER_SIZE, info, levels) &&
+                Texture::isTextureFormatSupported(*mEngine, getKtxFormat(*info, srgb))) {
+            return image;
+        }
+    }
+
+    // Fall back to the regular image, which is optional when KHR_texture_basisu is used.
+    *levels = 0;
+    return srcTexture->image;
+}
+
 void ResourceLoader::Impl::addTextureCacheEntry(const TextureSlot& tb) {
     TextureCacheEntry* entry = nullptr;
 
     const cgltf_texture* srcTexture = tb.texture;
-    const cgltf_buffer_view* bv = srcTexture->image->buffer_view;
-    const char* uri = srcTexture->image->uri;
+    if (mTextureImages.find(srcTexture) != mTextureImages.end()) {
+        return;
+    }
+    image::KtxInfo ktxInfo;
+    uint32_t ktxLevels = 0;
+    const cgltf_image* srcImage = selectImage(srcTexture, tb.srgb, &ktxInfo, &ktxLevels);
+    mTextureImages[srcTexture] = srcImage;
+    if (!srcImage) {
+        slog.w << "Texture has no supported image." << io::endl;
+        return;
+    }
+
+    const cgltf_buffer_view* bv = srcImage->buffer_view;
+    const char* uri = srcImage->uri;
     const uint32_t totalSize = uint32_t(bv ? bv->size : 0);
     void** data = bv ? &bv->buffer->data : nullptr;
     const size_t offset = bv ? bv->offset : 0;
 
+    // The dimensions of KTX images are known from their header, they don't need to be peeked at.
+    auto initKtx = [&](TextureCacheEntry* entry) {
+        entry->isKtx = ktxLevels > 0;
+        if (entry->isKtx) {
+            entry->ktxInfo = ktxInfo;
+            entry->ktxLevels = ktxLevels;
+            entry->width = ktxInfo.pixelWidth;
+            entry->height = ktxInfo.pixelHeight;
+        }
+        return entry->isKtx;
+    };
+
     // Check if the texture binding uses BufferView data (i.e. it does not have a URI).
     if (data) {
         const uint8_t* sourceData = offset + (const uint8_t*) *data;
@@ -566,9 +1631,13 @@ void ResourceLoader::Impl::addTextureCacheEntry(const TextureSlot& tb) {
         }
         entry = (mBufferTextureCache[sourceData] = std::make_unique<TextureCacheEntry>()).get();
         entry->srgb = tb.srgb;
+        entry->priority = getUploadPriority(mCurrentAsset, tb);
+        entry->bufferSize = totalSize;
+        if (initKtx(entry)) {
+            return;
+        }
         stbi_info_from_memory(sourceData, totalSize, &entry->width, &entry->height,
                 &entry->numComponents);
-        entry->bufferSize = totalSize;
         return;
     }
 
@@ -580,6 +1649,10 @@ void ResourceLoader::Impl::addTextureCacheEntry(const TextureSlot& tb) {
 
     entry = (mUriTextureCache[uri] = std::make_unique<TextureCacheEntry>()).get();
     entry->srgb = tb.srgb;
+    entry->priority = getUploadPriority(mCurrentAsset, tb);
+    if (initKtx(entry)) {
+        return;
+    }
 
     // Check the user-supplied resource cache for this URI, otherwise peek at the file.
     auto iter = mUriDataCache.find(uri);
@@ -590,62 +1663,161 @@ void ResourceLoader::Impl::addTextureCacheEntry(const TextureSlot& tb) {
         return;
     }
     #if !USE_FILESYSTEM
-        slog.e << "Unable to load texture: " << uri << io::endl;
+        entry->deferred = true;
     #else
         Path fullpath = Path(mGltfPath).getParent() + uri;
         stbi_info(fullpath.c_str(), &entry->width, &entry->height, &entry->numComponents);
     #endif
 }
 
-void ResourceLoader::Impl::bindTextureToMaterial(const TextureSlot& tb) {
-    FFilamentAsset* asset = mCurrentAsset;
-
-    const cgltf_texture* srcTexture = tb.texture;
-    const cgltf_buffer_view* bv = srcTexture->image->buffer_view;
-    const char* uri = srcTexture->image->uri;
+TextureCacheEntry* ResourceLoader::Impl::findTextureCacheEntry(const cgltf_texture* srcTexture) {
+    auto iter = mTextureImages.find(srcTexture);
+    const cgltf_image* srcImage = iter != mTextureImages.end() ? iter->second : nullptr;
+    if (!srcImage) {
+        return nullptr;
+    }
+    const cgltf_buffer_view* bv = srcImage->buffer_view;
+    const char* uri = srcImage->uri;
     void** data = bv ? &bv->buffer->data : nullptr;
     const size_t offset = bv ? bv->offset : 0;
 
     // First check if this is a buffer-based texture.
     if (data) {
         const uint8_t* sourceData = offset + (const uint8_t*) *data;
-        auto& entry = mBufferTextureCache[sourceData];
-        if (entry.get() && entry->texture) {
-            asset->bindTexture(tb, entry->texture);
-        }
-        return;
+        auto entry = mBufferTextureCache.find(sourceData);
+        return entry != mBufferTextureCache.end() ? entry->second.get() : nullptr;
     }
 
     // Next check if this is a URI-based texture.
-    auto& entry = mUriTextureCache[uri];
-    if (entry.get() && entry->texture) {
-        asset->bindTexture(tb, entry->texture);
+    auto entry = mUriTextureCache.find(uri);
+    return entry != mUriTextureCache.end() ? entry->second.get() : nullptr;
+}
+
+void ResourceLoader::Impl::bindTextureToMaterial(const TextureSlot& tb) {
+    TextureCacheEntry* entry = findTextureCacheEntry(tb.texture);
+    if (entry && entry->texture) {
+        mCurrentAsset->bindTexture(tb, entry->texture);
     }
 }
-void ResourceLoader::Impl::cancelTextureDecoding() {
+
+void ResourceLoader::Impl::waitForDecoderJobs() {
     JobSystem* js = &mEngine->getJobSystem();
     if (mDecoderRootJob) {
         js->waitAndRelease(mDecoderRootJob);
         mDecoderRootJob = nullptr;
     }
+    for (JobSystem::Job*& job : mDeferredDecoderJobs) {
+        js->waitAndRelease(job);
+    }
+    mDeferredDecoderJobs.clear();
+}
+
+void ResourceLoader::Impl::cancelTextureDecoding() {
+    waitForDecoderJobs();
     releasePendingTextures();
     mBufferTextureCache.clear();
     mUriTextureCache.clear();
+    mTextureImages.clear();
     mCurrentAsset = nullptr;
     mNumDecoderTasksFinished = 0;
     mNumDecoderTasks = 0;
 }
 
+// Creates a job that decodes the image of a texture from its encoded data.
+static JobSystem::Job* createDecoderJob(JobSystem& js, JobSystem::Job* parent,
+        TextureCacheEntry* entry, const uint8_t* data, size_t size) {
+    return jobs::createJob(js, parent, [=] {
+        if (entry->isKtx) {
+            entry->ktx = new image::KtxBundle(data, size);
+            return;
+        }
+        int width, height, comp;
+        entry->texels = stbi_load_from_memory(data, size, &width, &height, &comp, 4);
+    });
+}
+
+void ResourceLoader::Impl::shareTexture(TextureCacheEntry* entry, const void* data, size_t size) {
+    entry->sharedKey = SharedTextureCache::computeKey(data, size, entry->srgb);
+    if (Texture* texture = mSharedTextureCache->acquire(entry->sharedKey)) {
+        entry->texture = texture;
+        entry->completed = true;
+        mNumDecoderTasksFinished++;
+        mCurrentAsset->shareOwnership(mSharedTextureCache, texture);
+    }
+}
+
+void ResourceLoader::Impl::createTexture(TextureCacheEntry* entry) {
+    if (entry->texture) {
+        return;
+    }
+    if (entry->isKtx) {
+        entry->texture = Texture::Builder()
+            .width(entry->width)
+            .height(entry->height)
+            .levels(uint8_t(entry->ktxLevels))
+            .format(getKtxFormat(entry->ktxInfo, entry->srgb))
+            .build(*mEngine);
+    } else {
+        entry->texture = Texture::Builder()
+            .width(entry->width)
+            .height(entry->height)
+            .levels(0xff)
+            .format(entry->srgb ? Texture::InternalFormat::SRGB8_A8 :
+                    Texture::InternalFormat::RGBA8)
+            .build(*mEngine);
+    }
+    if (mSharedTextureCache) {
+        mSharedTextureCache->add(entry->sharedKey, entry->texture);
+        mCurrentAsset->shareOwnership(mSharedTextureCache, entry->texture);
+    } else {
+        mCurrentAsset->takeOwnership(entry->texture);
+    }
+}
+
+void ResourceLoader::Impl::addDeferredTexture(const char* uri) {
+    auto iter = mUriTextureCache.find(uri);
+    if (iter == mUriTextureCache.end() || !iter->second->deferred) {
+        return;
+    }
+    TextureCacheEntry* entry = iter->second.get();
+    const BufferDescriptor& buffer = mUriDataCache.find(uri)->second;
+    const uint8_t* sourceData = (const uint8_t*) buffer.buffer;
+    entry->deferred = false;
+    stbi_info_from_memory(sourceData, buffer.size, &entry->width, &entry->height,
+            &entry->numComponents);
+
+    if (mSharedTextureCache) {
+        shareTexture(entry, sourceData, buffer.size);
+    }
+    createTexture(entry);
+    FFilamentAsset* asset = mCurrentAsset;
+    for (auto slot : asset->mTextureSlots) {
+        if (findTextureCacheEntry(slot.texture) == entry) {
+            bindTextureToMaterial(slot);
+        }
+    }
+    if (entry->completed) {
+        asset->mDependencyGraph.markAsReady(entry->texture);
+        return;
+    }
+
+    // Without worker threads, the image is decoded by a later call to asyncUpdateLoad().
+    if (UTILS_HAS_JOB_THREADS) {
+        JobSystem& js = mEngine->getJobSystem();
+        mDeferredDecoderJobs.push_back(js.runAndRetain(
+                createDecoderJob(js, nullptr, entry, sourceData, buffer.size),
+                JobSystem::BACKGROUND));
+    }
+}
+
 bool ResourceLoader::Impl::createTextures(bool async) {
     // If any decoding jobs are still underway, wait for them to finish.
     JobSystem* js = &mEngine->getJobSystem();
-    if (mDecoderRootJob) {
-        js->waitAndRelease(mDecoderRootJob);
-        mDecoderRootJob = nullptr;
-    }
+    waitForDecoderJobs();
 
     mBufferTextureCache.clear();
     mUriTextureCache.clear();
+    mTextureImages.clear();
 
     // First, determine texture dimensions and create texture cache entries.
     FFilamentAsset* asset = mCurrentAsset;
@@ -653,6 +1825,13 @@ bool ResourceLoader::Impl::createTextures(bool async) {
         addTextureCacheEntry(slot);
     }
 
+    // A texture shared by several material parameters is uploaded with the highest priority.
+    for (auto slot : asset->mTextureSlots) {
+        if (TextureCacheEntry* entry = findTextureCacheEntry(slot.texture)) {
+            entry->priority = std::min(entry->priority, getUploadPriority(asset, slot));
+        }
+    }
+
     // Tally up the total number of textures that need to be decoded. Zero textures is a special
     // case that needs to report 100% progress right away, so we set NumDecoderTasks and Finished
     // both to 1. If they were both 0, this would indicate that loading has not started.
@@ -664,61 +1843,90 @@ bool ResourceLoader::Impl::createTextures(bool async) {
         mNumDecoderTasksFinished = 0;
     }
 
-    // Next create blank Filament textures.
-    auto createTexture = [=](TextureCacheEntry* entry) {
-        entry->texture = Texture::Builder()
-            .width(entry->width)
-            .height(entry->height)
-            .levels(0xff)
-            .format(entry->srgb ? Texture::InternalFormat::SRGB8_A8 : Texture::InternalFormat::RGBA8)
-            .build(*mEngine);
-        asset->takeOwnership(entry->texture);
-    };
+    // Reuse the shared textures of identical images, which don't need to be decoded. Images are
+    // identified by their contents, except image files, which are identified by their path.
+    if (mSharedTextureCache) {
+        for (auto& pair : mBufferTextureCache) {
+            shareTexture(pair.second.get(), pair.first, pair.second->bufferSize);
+        }
+        for (auto& pair : mUriTextureCache) {
+            auto iter = mUriDataCache.find(pair.first);
+            if (iter != mUriDataCache.end()) {
+                shareTexture(pair.second.get(), iter->second.buffer, iter->second.size);
+                continue;
+            }
+            #if USE_FILESYSTEM
+                Path fullpath = (Path(mGltfPath).getParent() + pair.first).getAbsolutePath();
+                shareTexture(pair.second.get(), fullpath.c_str(), strlen(fullpath.c_str()));
+            #endif
+        }
+    }
+
+    // Next create blank Filament textures. The sizes of the deferred images aren't known yet.
     for (auto& pair : mBufferTextureCache) createTexture(pair.second.get());
-    for (auto& pair : mUriTextureCache) createTexture(pair.second.get());
+    for (auto& pair : mUriTextureCache) {
+        if (!pair.second->deferred) {
+            createTexture(pair.second.get());
+        }
+    }
 
     // Bind the textures to material instances.
     for (auto slot : asset->mTextureSlots) {
         bindTextureToMaterial(slot);
     }
 
+    // The shared textures that were reused are ready already.
+    auto markShared = [asset](TextureCacheEntry* entry) {
+        if (entry->completed) {
+            asset->mDependencyGraph.markAsReady(entry->texture);
+        }
+    };
+    for (auto& pair : mBufferTextureCache) markShared(pair.second.get());
+    for (auto& pair : mUriTextureCache) markShared(pair.second.get());
+
     // Before creating jobs for PNG / JPEG decoding, we might need to return early. On single
     // threaded systems, it is usually fine to create jobs because the job system will simply
     // execute serially. However if the client requests async behavior, then we need to wait
     // until subsequent calls to asyncUpdateLoad().
-    if (!UTILS_HAS_THREADING && async) {
+    if (!UTILS_HAS_JOB_THREADS && async) {
         return true;
     }
 
     JobSystem::Job* parent = js->createJob();
 
+    // When loading asynchronously, the decoding jobs run in the background so that they don't
+    // delay the jobs of the frames being rendered meanwhile.
+    const uint32_t runFlags = async ? JobSystem::BACKGROUND : 0;
+
     // Kick off jobs that decode texels from buffer pointers.
     for (auto& pair : mBufferTextureCache) {
         const uint8_t* sourceData = (const uint8_t*) pair.first;
         TextureCacheEntry* entry = pair.second.get();
-        JobSystem::Job* decode = jobs::createJob(*js, parent, [=] {
-            int width, height, comp;
-            entry->texels = stbi_load_from_memory(sourceData, entry->bufferSize,
-                    &width, &height, &comp, 4);
-        });
-        js->run(decode);
+        if (entry->completed) {
+            continue;
+        }
+        js->run(createDecoderJob(*js, parent, entry, sourceData, entry->bufferSize), runFlags);
     }
 
     // Kick off jobs that decode texels from URI strings.
     for (auto& pair : mUriTextureCache) {
         auto uri = pair.first;
         TextureCacheEntry* entry = pair.second.get();
+        if (entry->completed) {
+            continue;
+        }
+
+        // Asynchronous loads decode the missing images once they're added.
+        if (entry->deferred && async) {
+            continue;
+        }
 
         // First, check the user-supplied resource cache for this URI.
         auto iter = mUriDataCache.find(uri);
         if (iter != mUriDataCache.end()) {
             const uint8_t* sourceData = (const uint8_t*) iter->second.buffer;
-            JobSystem::Job* decode = jobs::createJob(*js, parent, [=] {
-                int width, height, comp;
-                entry->texels = stbi_load_from_memory(sourceData, iter->second.size, &width,
-                        &height, &comp, 4);
-            });
-            js->run(decode);
+            js->run(createDecoderJob(*js, parent, entry, sourceData, iter->second.size),
+                    runFlags);
             continue;
         }
 
@@ -729,10 +1937,14 @@ bool ResourceLoader::Impl::createTextures(bool async) {
         #else
             Path fullpath = Path(mGltfPath).getParent() + uri;
             JobSystem::Job* decode = jobs::createJob(*js, parent, [=] {
+                if (entry->isKtx) {
+                    entry->ktx = loadKtxFile(fullpath);
+                    return;
+                }
                 int width, height, comp;
                 entry->texels = stbi_load(fullpath.c_str(), &width, &height, &comp, 4);
             });
-            js->run(decode);
+            js->run(decode, runFlags);
         #endif
     }
 
@@ -746,7 +1958,7 @@ bool ResourceLoader::Impl::createTextures(bool async) {
 
     // Finally, upload texels to the GPU and generate mipmaps.
     mCurrentAsset = asset;
-    uploadPendingTextures();
+    uploadPendingTextures(0);
 
     return true;
 }
@@ -815,8 +2027,11 @@ void ResourceLoader::Impl::computeTangents(FFilamentAsset* asset) {
             return;
         }
 
+        // Large primitives are also split over the job system, in addition to the primitives
+        // being processed in parallel.
         geometry::SurfaceOrientation::Builder sob;
         sob.vertexCount(vertexCount);
+        sob.jobSystem(&mEngine->getJobSystem());
 
         // Convert normals into packed floats.
         if (normalsInfo) {
@@ -935,20 +2150,35 @@ void ResourceLoader::Impl::computeTangents(FFilamentAsset* asset) {
     for (JobParams& params : jobParams) {
         VertexBuffer::BufferDescriptor bd(params.results, params.vertexCount * sizeof(short4),
                 FREE_CALLBACK);
-        params.vb->setBufferAt(*mEngine, params.slot, std::move(bd));
+        setVertexBuffer(params.vb, params.slot, std::move(bd));
     }
 }
 
-ResourceLoader::Impl::~Impl() {
-    if (mDecoderRootJob) {
-        mEngine->getJobSystem().waitAndRelease(mDecoderRootJob);
+void ResourceLoader::Impl::setVertexBuffer(VertexBuffer* vb, uint8_t bufferIndex,
+        VertexBuffer::BufferDescriptor&& bd) {
+    if (mCacheRecorder) {
+        mCacheRecorder->addBuffer(AssetCache::BufferType::VERTEX, mBufferOrdinals[vb], bufferIndex,
+                bd.buffer, bd.size);
+    }
+    vb->setBufferAt(*mEngine, bufferIndex, std::move(bd));
+}
+
+void ResourceLoader::Impl::setIndexBuffer(IndexBuffer* ib, IndexBuffer::BufferDescriptor&& bd) {
+    if (mCacheRecorder) {
+        mCacheRecorder->addBuffer(AssetCache::BufferType::INDEX, mBufferOrdinals[ib], 0,
+                bd.buffer, bd.size);
     }
+    ib->setBuffer(*mEngine, std::move(bd));
+}
+
+ResourceLoader::Impl::~Impl() {
+    waitForDecoderJobs();
 }
 
 void ResourceLoader::applySparseData(FFilamentAsset* asset) const {
     for (auto slot : asset->mBufferSlots) {
         const cgltf_accessor* accessor = slot.accessor;
-        if (!accessor->is_sparse) {
+        if (!accessor->is_sparse || slot.quantization != VertexQuantization::NONE) {
             continue;
         }
         cgltf_size numFloats = accessor->count * cgltf_num_components(accessor->type);
@@ -956,7 +2186,31 @@ void ResourceLoader::applySparseData(FFilamentAsset* asset) const {
         float* generated = (float*) malloc(numBytes);
         cgltf_accessor_unpack_floats(accessor, generated, numFloats);
         VertexBuffer::BufferDescriptor bd(generated, numBytes, FREE_CALLBACK);
-        slot.vertexBuffer->setBufferAt(*pImpl->mEngine, slot.bufferIndex, std::move(bd));
+        pImpl->setVertexBuffer(slot.vertexBuffer, slot.bufferIndex, std::move(bd));
+    }
+}
+
+void ResourceLoader::loadMorphTargets(FFilamentAsset* asset) const {
+    for (MorphTargetSet& set : asset->mMorphTargetSets) {
+        const cgltf_primitive& prim = *set.primitive;
+        set.positions.resize(prim.targets_count);
+        for (cgltf_size targetIndex = 0; targetIndex < prim.targets_count; targetIndex++) {
+            // targets without positions keep zero deltas
+            auto& positions = set.positions[targetIndex];
+            positions.resize(set.vertexCount, float3(0));
+            const cgltf_morph_target& morphTarget = prim.targets[targetIndex];
+            for (cgltf_size aindex = 0; aindex < morphTarget.attributes_count; aindex++) {
+                const cgltf_attribute& attribute = morphTarget.attributes[aindex];
+                if (attribute.type == cgltf_attribute_type_position &&
+                        attribute.data->count == set.vertexCount) {
+                    cgltf_accessor_unpack_floats(attribute.data, &positions[0].x,
+                            set.vertexCount * 3);
+                }
+            }
+        }
+        for (size_t i = 0; i < MAX_MORPH_TARGETS; i++) {
+            set.bindTarget(*pImpl->mEngine, i, int(i));
+        }
     }
 }
 
@@ -1067,6 +2321,10 @@ void ResourceLoader::updateBoundingBoxes(FFilamentAsset* asset) const {
             }
             auto renderable = rm.getInstance(iter.second);
             rm.setAxisAlignedBoundingBox(renderable, Box().set(aabb.min, aabb.max));
+            if (pImpl->mCacheRecorder) {
+                const uint32_t node = uint32_t(iter.first - asset->mSourceAsset->nodes);
+                pImpl->mCacheRecorder->addNodeBounds(node, aabb);
+            }
 
             // Transform this bounding box, then update the asset-level bounding box.
             auto transformable = tm.getInstance(iter.second);
@@ -1082,6 +2340,29 @@ void ResourceLoader::updateBoundingBoxes(FFilamentAsset* asset) const {
     }
 
     asset->mBoundingBox = assetBounds;
+    if (pImpl->mCacheRecorder) {
+        pImpl->mCacheRecorder->setAssetBounds(assetBounds);
+    }
+}
+
+void ResourceLoader::applyCachedBoundingBoxes(FFilamentAsset* asset,
+        const AssetCache& cache) const {
+    auto& rm = pImpl->mEngine->getRenderableManager();
+    const cgltf_data* gltf = asset->mSourceAsset;
+    NodeMap& nodeMap = asset->mInstances.empty() ? asset->mNodeMap : asset->mInstances[0]->nodeMap;
+    for (const AssetCache::NodeBounds& bounds : cache.getNodeBounds()) {
+        if (bounds.node >= gltf->nodes_count) {
+            continue;
+        }
+        auto iter = nodeMap.find(gltf->nodes + bounds.node);
+        if (iter != nodeMap.end()) {
+            auto renderable = rm.getInstance(iter->second);
+            rm.setAxisAlignedBoundingBox(renderable, Box().set(bounds.aabb.min, bounds.aabb.max));
+        }
+    }
+    if (cache.hasAssetBounds()) {
+        asset->mBoundingBox = cache.getAssetBounds();
+    }
 }
 
 } // namespace gltfio
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef GLTFIO_SHARED_RESOURCE_CACHE_H
+#define GLTFIO_SHARED_RESOURCE_CACHE_H
+
+#include <filament/Engine.h>
+
+#include <utils/Hash.h>
+
+#include <tsl/robin_map.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <assert.h>
+
+namespace filament {
+    class MaterialInstance;
+    class Texture;
+}
+
+namespace gltfio {
+
+// Reference-counted Filament objects shared by several assets, looked up by a hash of what they
+// were created from: the encoded image of textures (ResourceConfiguration::shareTextures) or the
+// parameters of material instances (AssetConfiguration::shareMaterialInstances). The assets that
+// use its objects keep the cache alive, so that it can outlive the loader that created it.
+// Objects are created, acquired and released on the main thread only.
+template<typename T>
+class SharedResourceCache {
+public:
+    explicit SharedResourceCache(filament::Engine* engine) : mEngine(engine) {}
+    SharedResourceCache(const SharedResourceCache&) = delete;
+    SharedResourceCache& operator=(const SharedResourceCache&) = delete;
+
+    ~SharedResourceCache() {
+        // The assets release all their references before they release the cache.
+        assert(mEntries.empty());
+    }
+
+    static uint64_t computeKey(const void* data, size_t size, uint64_t seed) {
+        const uint64_t header[2] = { size, seed };
+        return utils::hash::fnv1a64(data, size, utils::hash::fnv1a64(header, sizeof(header)));
+    }
+
+    // Returns the object with the given key with a new reference to it, or null if there's none.
+    T* acquire(uint64_t key) {
+        auto iter = mObjects.find(key);
+        if (iter == mObjects.end()) {
+            return nullptr;
+        }
+        mEntries[iter->second].references++;
+        return iter->second;
+    }
+
+    // Adds an object with a first reference to it.
+    void add(uint64_t key, T* object) {
+        assert(mObjects.find(key) == mObjects.end());
+        mObjects[key] = object;
+        mEntries[object] = { key, 1 };
+    }
+
+    // Releases a reference to an object, which is destroyed with its last reference.
+    void release(T* object) {
+        auto iter = mEntries.find(object);
+        assert(iter != mEntries.end());
+        if (--iter.value().references == 0) {
+            unshare(object);
+            mEntries.erase(iter);
+            mEngine->destroy(object);
+        }
+    }
+
+    // Stops sharing an object whose creation was cancelled, its references remain valid.
+    void unshare(T* object) {
+        auto iter = mEntries.find(object);
+        assert(iter != mEntries.end());
+        auto shared = mObjects.find(iter->second.key);
+        if (shared != mObjects.end() && shared->second == object) {
+            mObjects.erase(shared);
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        uint32_t references;
+    };
+    filament::Engine* const mEngine;
+    tsl::robin_map<uint64_t, T*> mObjects;
+    tsl::robin_map<const T*, Entry> mEntries;
+};
+
+using SharedTextureCache = SharedResourceCache<filament::Texture>;
+using SharedMaterialCache = SharedResourceCache<filament::MaterialInstance>;
+
+} // namespace gltfio
+
+#endif // GLTFIO_SHARED_RESOURCE_CACHE_H
@@ -56,6 +56,20 @@ public:
             float linearRoughness, size_t maxNumSamples, math::float3 mirror, bool prefilter,
             Progress updater = {});
 
+    /**
+     * Returns the number of samples roughnessFilter() needs to prefilter a cubemap of the given
+     * dimension, at most maxNumSamples. Because each sample reads a level of the environment
+     * matching its solid angle, the samples only need to be dense enough that this footprint
+     * is small compared to a texel of the destination or to the GGX lobe; more samples don't
+     * change the result visibly. This is a few hundred samples at most.
+     *
+     * @param dim               dimension of the destination cubemap
+     * @param linearRoughness   roughness
+     * @param maxNumSamples     maximum number of samples
+     */
+    static size_t getAdaptiveSampleCount(size_t dim, float linearRoughness,
+            size_t maxNumSamples);
+
     //! Computes the "DFG" term of the "split-sum" approximation and stores it in a 2D image
     static void DFG(utils::JobSystem& js, Image& dst, bool multiscatter, bool cloth);
 
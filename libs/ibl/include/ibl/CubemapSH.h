@@ -47,6 +47,15 @@ public:
     static std::unique_ptr<math::float3[]> computeSH(
             utils::JobSystem& js, const Cubemap& cm, size_t numBands, bool irradiance);
 
+    /**
+     * 3 bands Spherical Harmonics decomposition of the given cubemap, same as computeSH() but
+     * the 9 coefficients are written to 'sh' without any allocation. This is the fast path
+     * computeSH() uses for 3 bands, it is cheap enough to run every frame on a small cubemap,
+     * e.g. to update a dynamic light probe.
+     */
+    static void computeSH3Bands(utils::JobSystem& js, const Cubemap& cm, math::float3* sh,
+            bool irradiance);
+
     /**
      * Render given spherical harmonics into a cubemap
      */
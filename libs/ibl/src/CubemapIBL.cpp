@@ -27,6 +27,7 @@
 
 #include <math/mat3.h>
 #include <math/scalar.h>
+#include <math/simd.h>
 
 #include <random>
 #include <vector>
@@ -406,11 +407,23 @@ void CubemapIBL::roughnessFilter(
         return lhs.brdf_NoL < rhs.brdf_NoL;
     });
 
+    // The sample directions are also stored as separate x, y and z arrays, this lets each
+    // texel rotate all of them into its own frame with SIMD before doing the lookups. The cache
+    // is shared by all the faces and scanlines.
+    const size_t cacheSize = cache.size();
+    std::vector<float> cacheL(cacheSize * 3);
+    for (size_t i = 0; i < cacheSize; i++) {
+        cacheL[i] = cache[i].L.x;
+        cacheL[i + cacheSize] = cache[i].L.y;
+        cacheL[i + cacheSize * 2] = cache[i].L.z;
+    }
 
     struct State {
         // maybe blue-noise instead would look even better
         std::default_random_engine gen;
         std::uniform_real_distribution<float> distribution{ -F_PI, F_PI };
+        // the sample directions rotated in the frame of the current texel
+        std::vector<float> L;
     };
 
     auto scanline = [&](State& state, size_t y,
@@ -420,7 +433,11 @@ void CubemapIBL::roughnessFilter(
             updater(0, (float) p / ((float) dim * 6.0f));
         }
         mat3 R;
-        const size_t numSamples = cache.size();
+        const size_t numSamples = cacheSize;
+        state.L.resize(numSamples * 3);
+        float* const Lx = state.L.data();
+        float* const Ly = Lx + numSamples;
+        float* const Lz = Ly + numSamples;
         for (size_t x = 0; x < dim; ++x, ++data) {
             const float2 p(Cubemap::center(x, y));
             const float3 N(dst.getDirectionFor(f, p.x, p.y) * mirror);
@@ -433,10 +450,13 @@ void CubemapIBL::roughnessFilter(
 
             R *= mat3f::rotation(state.distribution(state.gen), float3{0,0,1});
 
+            simd::transform(Lx, Ly, Lz, mat3f(R), cacheL.data(),
+                    cacheL.data() + numSamples, cacheL.data() + numSamples * 2, numSamples);
+
             float3 Li = 0;
             for (size_t sample = 0; sample < numSamples; sample++) {
                 const CacheEntry& e = cache[sample];
-                const float3 L(R * e.L);
+                const float3 L(Lx[sample], Ly[sample], Lz[sample]);
                 const Cubemap& cmBase = levels[e.l0];
                 const Cubemap& next = levels[e.l1];
                 const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
@@ -455,6 +475,48 @@ void CubemapIBL::roughnessFilter(
     }
 }
 
+size_t CubemapIBL::getAdaptiveSampleCount(size_t dim, float linearRoughness,
+        size_t maxNumSamples) {
+    // fewer samples than this shows the pattern of the Hammersley sequence
+    constexpr size_t MIN_SAMPLES = 32;
+    // K is the LOD bias of roughnessFilter()
+    constexpr float K = 4;
+
+    if (linearRoughness == 0) {
+        return 1;
+    }
+
+    // The solid angle of a sample is 1 / (N * pdf), we use the weighted geometric mean of
+    // 1 / pdf over the lobe, which isn't skewed by the few samples at grazing angles.
+    constexpr size_t ESTIMATE_SAMPLES = 256;
+    float logOmega = 0;
+    float weight = 0;
+    for (size_t i = 0; i < ESTIMATE_SAMPLES; i++) {
+        const float2 u = hammersley(uint32_t(i), 1.0f / ESTIMATE_SAMPLES);
+        const float3 H = hemisphereImportanceSampleDggx(u, linearRoughness);
+        const float NoL = 2 * H.z * H.z - 1;
+        if (NoL > 0) {
+            const float pdf = DistributionGGX(H.z, linearRoughness) / 4;
+            logOmega -= NoL * std::log2(pdf);
+            weight += NoL;
+        }
+    }
+
+    // The footprint K * omegaS of a sample is invisible either when it's smaller than a texel of
+    // the destination, or when it's small compared to the lobe (here 1/64th of its solid angle,
+    // i.e. 1/8th of its width, which takes K * 64 samples).
+    constexpr float LOBE_SAMPLES = K * 64;
+    const float omegaLobe = std::exp2(logOmega / weight);
+    const float omegaDst = (4.0f * (float) F_PI) / float(6 * dim * dim);
+    const float count = std::min(std::ceil(K * omegaLobe / omegaDst), LOBE_SAMPLES);
+
+    size_t numSamples = MIN_SAMPLES;
+    while (numSamples < count && numSamples < maxNumSamples) {
+        numSamples *= 2;
+    }
+    return std::min(numSamples, maxNumSamples);
+}
+
 /*
  *
  * Importance sampling
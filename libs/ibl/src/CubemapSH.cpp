@@ -507,11 +507,133 @@ void CubemapSH::windowSH(std::unique_ptr<float3[]>& sh, size_t numBands, float c
     }
 }
 
+// -----------------------------------------------------------------------------------------------
+// 3 bands fast path
+// -----------------------------------------------------------------------------------------------
+
+/*
+ * With 3 bands the non-normalized SH basis computed by computeShBasis() is a fixed polynomial of
+ * the direction, so we evaluate it directly on SH3_LANES texels at a time, stored as separate
+ * arrays. The fixed size loops over the lanes are vectorized by the compiler.
+ */
+static constexpr size_t SH3_LANES = 8;
+
+struct SH3Lanes {
+    float x[SH3_LANES];
+    float y[SH3_LANES];
+    float z[SH3_LANES];
+};
+
+// Loads the directions of up to SH3_LANES texels starting at x0, the unused lanes are zeroed
+static size_t loadSH3Lanes(SH3Lanes& lanes, const Cubemap& cm, Cubemap::Face f,
+        size_t x0, size_t y, size_t dim) {
+    const size_t count = std::min(SH3_LANES, dim - x0);
+    for (size_t i = 0; i < SH3_LANES; i++) {
+        const float3 s = i < count ? cm.getDirectionFor(f, x0 + i, y) : float3{ 0 };
+        lanes.x[i] = s.x;
+        lanes.y[i] = s.y;
+        lanes.z[i] = s.z;
+    }
+    return count;
+}
+
+// SHb[k][i] is the k-th basis function for the direction of lane i, see computeShBasis()
+static void computeSH3Basis(float (&SHb)[9][SH3_LANES], SH3Lanes const& s) {
+    for (size_t i = 0; i < SH3_LANES; i++) {
+        const float x = s.x[i];
+        const float y = s.y[i];
+        const float z = s.z[i];
+        SHb[0][i] = 1.0f;
+        SHb[1][i] = -y;
+        SHb[2][i] = z;
+        SHb[3][i] = -x;
+        SHb[4][i] = 6.0f * x * y;
+        SHb[5][i] = -3.0f * y * z;
+        SHb[6][i] = 1.5f * z * z - 0.5f;
+        SHb[7][i] = -3.0f * z * x;
+        SHb[8][i] = 3.0f * (x * x - y * y);
+    }
+}
+
+// accumulates the non-normalized 3 bands SH of the cubemap into SH
+static void projectSH3Bands(JobSystem& js, const Cubemap& cm, float3* SH) {
+    struct State {
+        // per lane sums, for each coefficient and color channel
+        float sum[9][3][SH3_LANES] = {};
+    };
+
+    auto scanline = [&](State& state, size_t y, Cubemap::Face f, Cubemap::Texel const* data,
+            size_t dim) {
+        for (size_t x0 = 0; x0 < dim; x0 += SH3_LANES) {
+            SH3Lanes s;
+            const size_t count = loadSH3Lanes(s, cm, f, x0, y, dim);
+
+            // sampled colors weighted by their solid angle, zero for the unused lanes
+            float color[3][SH3_LANES] = {};
+            for (size_t i = 0; i < count; i++) {
+                const float3 c(Cubemap::sampleAt(data + x0 + i) *
+                        CubemapUtils::solidAngle(dim, x0 + i, y));
+                color[0][i] = c.r;
+                color[1][i] = c.g;
+                color[2][i] = c.b;
+            }
+
+            float SHb[9][SH3_LANES];
+            computeSH3Basis(SHb, s);
+            for (size_t k = 0; k < 9; k++) {
+                for (size_t c = 0; c < 3; c++) {
+                    for (size_t i = 0; i < SH3_LANES; i++) {
+                        state.sum[k][c][i] += color[c][i] * SHb[k][i];
+                    }
+                }
+            }
+        }
+    };
+
+    auto reduce = [SH](State& state) {
+        for (size_t k = 0; k < 9; k++) {
+            for (size_t i = 0; i < SH3_LANES; i++) {
+                SH[k] += float3{ state.sum[k][0][i], state.sum[k][1][i], state.sum[k][2][i] };
+            }
+        }
+    };
+
+    // small cubemaps, like the ones of dynamic probes, aren't worth the jobs overhead
+    Cubemap& c = const_cast<Cubemap&>(cm);
+    if (cm.getDimensions() <= 64) {
+        CubemapUtils::processSingleThreaded<State>(c, js, scanline, reduce);
+    } else {
+        CubemapUtils::process<State>(c, js, scanline, reduce);
+    }
+}
+
+void CubemapSH::computeSH3Bands(JobSystem& js, const Cubemap& cm, float3* sh, bool irradiance) {
+    constexpr size_t numBands = 3;
+    std::fill_n(sh, numBands * numBands, float3{ 0 });
+    projectSH3Bands(js, cm, sh);
+
+    for (size_t l = 0; l < numBands; l++) {
+        const float truncatedCosSh = irradiance ? computeTruncatedCosSh(l) : 1.0f;
+        sh[SHindex(0, l)] *= Kml(0, l) * truncatedCosSh;
+        for (size_t m = 1; m <= l; m++) {
+            sh[SHindex(-m, l)] *= F_SQRT2 * Kml(m, l) * truncatedCosSh;
+            sh[SHindex( m, l)] *= F_SQRT2 * Kml(m, l) * truncatedCosSh;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------
+
 std::unique_ptr<float3[]> CubemapSH::computeSH(JobSystem& js, const Cubemap& cm, size_t numBands, bool irradiance) {
 
     const size_t numCoefs = numBands * numBands;
     std::unique_ptr<float3[]> SH(new float3[numCoefs]{});
 
+    if (numBands == 3) {
+        computeSH3Bands(js, cm, SH.get(), irradiance);
+        return SH;
+    }
+
     struct State {
         State() = default;
         explicit State(size_t numCoefs) : numCoefs(numCoefs) { }
@@ -581,6 +703,37 @@ void CubemapSH::renderSH(JobSystem& js, Cubemap& cm,
     // precompute the scaling factor K
     const std::vector<float> K = Ki(numBands);
 
+    if (numBands == 3) {
+        // same as below, using the 3 bands fast path of computeSH()
+        float3 C[9];
+        for (size_t k = 0; k < 9; k++) {
+            C[k] = sh[k] * (K[k] * float(F_1_PI));
+        }
+        CubemapUtils::process<CubemapUtils::EmptyState>(cm, js,
+                [&](CubemapUtils::EmptyState&, size_t y,
+                        Cubemap::Face f, Cubemap::Texel* data, size_t dim) {
+                    for (size_t x0 = 0; x0 < dim; x0 += SH3_LANES) {
+                        SH3Lanes s;
+                        const size_t count = loadSH3Lanes(s, cm, f, x0, y, dim);
+                        float SHb[9][SH3_LANES];
+                        computeSH3Basis(SHb, s);
+                        float color[3][SH3_LANES] = {};
+                        for (size_t k = 0; k < 9; k++) {
+                            for (size_t c = 0; c < 3; c++) {
+                                for (size_t i = 0; i < SH3_LANES; i++) {
+                                    color[c][i] += C[k][c] * SHb[k][i];
+                                }
+                            }
+                        }
+                        for (size_t i = 0; i < count; i++) {
+                            Cubemap::writeAt(data + x0 + i,
+                                    Cubemap::Texel(color[0][i], color[1][i], color[2][i]));
+                        }
+                    }
+                });
+        return;
+    }
+
     struct State {
         // we compute the min just for debugging -- it's not actually needed.
         float3 min = std::numeric_limits<float>::max();
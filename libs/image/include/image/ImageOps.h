@@ -22,6 +22,10 @@
 #include <cstddef>
 #include <initializer_list>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 // Concatenates images horizontally to create a filmstrip atlas, similar to numpy's hstack.
@@ -65,14 +69,18 @@ using PresenceCallback = bool(*)(const LinearImage& img, uint32_t col, uint32_t
 
 // Generates a two-channel field of non-normalized coordinates that indicate the nearest pixel
 // whose presence function returns true. This is the first step before generating a distance
-// field or generalized Voronoi map.
-LinearImage computeCoordField(const LinearImage& src, PresenceCallback presence, void* user);
+// field or generalized Voronoi map. The presence function is called from the calling thread only,
+// the optional job system splits the distance transform into bands of rows.
+LinearImage computeCoordField(const LinearImage& src, PresenceCallback presence, void* user,
+        utils::JobSystem* js = nullptr);
 
 // Generates a single-channel Euclidean distance field with positive values outside the region
 // of interest in the source image, and zero values inside. If sqrt is false, the computed
 // distances are squared. If signed distance (SDF) is desired, this function can be called a second
-// time using an inverted source field.
-LinearImage edtFromCoordField(const LinearImage& coordField, bool sqrt);
+// time using an inverted source field. The optional job system splits the rows over several
+// threads.
+LinearImage edtFromCoordField(const LinearImage& coordField, bool sqrt,
+        utils::JobSystem* js = nullptr);
 
 // Dereferences the given coordinate field. Useful for creating Voronoi diagrams or dilated images.
 LinearImage voronoiFromCoordField(const LinearImage& coordField, const LinearImage& src);
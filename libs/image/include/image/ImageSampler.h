@@ -19,6 +19,10 @@
 
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 /**
@@ -96,19 +100,24 @@ struct ImageSampler {
     Boundary north;
     Boundary west;
     Boundary south;
+    utils::JobSystem* jobSystem = nullptr; // Optional, splits the rows over several threads.
 };
 
 /**
  * Resizes or blurs the given linear image, producing a new linear image with the given dimensions.
+ *
+ * The filters are separable, each pass is split into bands of rows over the sampler's job system
+ * when it has one. The result does not depend on the job system.
  */
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
         const ImageSampler& sampler);
 
 /**
- * Resizes the given linear image using a simplified API that takes target dimensions and filter.
+ * Resizes the given linear image using a simplified API that takes target dimensions and filter,
+ * and an optional job system.
  */
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
-        Filter filter = Filter::DEFAULT);
+        Filter filter = Filter::DEFAULT, utils::JobSystem* js = nullptr);
 
 /**
  * Computes a single sample for the given texture coordinate and writes the resulting color
@@ -136,8 +145,11 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
  * Source image need not be power-of-two. In the result vector, the half-size image is returned at
  * index 0, the quarter-size image is at index 1, etc. Please note that the original-sized image is
  * not included.
+ *
+ * The optional job system splits the work of each level over several threads.
  */
-void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount);
+void generateMipmaps(const LinearImage& source, Filter, LinearImage* result, uint32_t mipCount,
+        utils::JobSystem* js = nullptr);
 
 /**
  * Returns the number of miplevels it would take to downsample the given image down to 1x1. This
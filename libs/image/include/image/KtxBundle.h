@@ -78,6 +78,16 @@ public:
      */
     KtxBundle(uint8_t const* bytes, uint32_t nbytes);
 
+    /**
+     * Creates a new bundle from the given KTX file, or returns null if the file can't be read.
+     *
+     * Where supported, the file is memory-mapped and the blobs are read in place rather than
+     * copied, until one of them is resized with setBlob() or allocateBlob(). The mapping is
+     * released with the bundle, so a texture created with ktx::createTexture() never holds a copy
+     * of the file while it is uploaded.
+     */
+    static KtxBundle* createFromFile(const char* path);
+
     /**
      * Serializes the bundle into the given target memory. Returns false if there's not enough
      * memory.
@@ -264,6 +274,9 @@ public:
     static constexpr uint32_t SRGB8_ALPHA8_ETC2_EAC = 0x9279;
 
 private:
+    KtxBundle();
+    void deserialize(uint8_t const* bytes, uint32_t nbytes);
+
     image::KtxInfo mInfo = {};
     uint32_t mNumMipLevels;
     uint32_t mArrayLength;
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_IMAGEJOBS_H
+#define IMAGE_IMAGEJOBS_H
+
+#include <utils/JobSystem.h>
+
+#include <functional>
+
+#include <stdint.h>
+
+namespace image {
+
+// Calls proc(firstRow, rowCount) over bands of the rows [0, height), split over the job system
+// when there is one. The bands don't overlap, so proc can write to its rows without locking.
+template<typename PROC>
+void forEachRowBand(utils::JobSystem* js, uint32_t height, PROC const& proc) {
+    if (js && height > 1) {
+        auto job = utils::jobs::parallel_for(*js, nullptr, 0, height, std::cref(proc),
+                utils::jobs::CountSplitter<8, 8>());
+        js->runAndWait(job);
+    } else {
+        proc(0u, height);
+    }
+}
+
+} // namespace image
+
+#endif // IMAGE_IMAGEJOBS_H
@@ -16,8 +16,11 @@
 
 #include <image/ImageOps.h>
 
+#include "ImageJobs.h"
+
 #include <math/vec3.h>
 #include <math/vec4.h>
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
 #include <algorithm>
@@ -311,22 +314,25 @@ static void edt(const float* f, float* d, float* z, float* v, float* i, size_t n
     }
 }
 
-static LinearImage computeHorizontalEdt(const LinearImage& src, LinearImage cx) {
+static LinearImage computeHorizontalEdt(const LinearImage& src, LinearImage cx,
+        utils::JobSystem* js) {
     const uint32_t width = src.getWidth();
     const uint32_t height = src.getHeight();
     LinearImage tmp0(width + 1, height + 1, 1);
     LinearImage tmp1(width + 1, height + 1, 1);
     LinearImage dst(width, height, 1);
 
-    // TODO: use utils::job::parallel_for.
-    for (uint32_t row = 0; row < height; ++row) {
-        const float* f = src.getPixelRef(0, row);
-        float* d = dst.getPixelRef(0, row);
-        float* z = tmp0.getPixelRef(0, row);
-        float* v = tmp1.getPixelRef(0, row);
-        float* i = cx.getPixelRef(0, row);
-        edt(f, d, z, v, i, width);
-    }
+    // Each row only touches its own row of the temporary images, so the rows are independent.
+    forEachRowBand(js, height, [&](uint32_t first, uint32_t count) {
+        for (uint32_t row = first; row < first + count; ++row) {
+            const float* f = src.getPixelRef(0, row);
+            float* d = dst.getPixelRef(0, row);
+            float* z = tmp0.getPixelRef(0, row);
+            float* v = tmp1.getPixelRef(0, row);
+            float* i = cx.getPixelRef(0, row);
+            edt(f, d, z, v, i, width);
+        }
+    });
 
     return dst;
 }
@@ -334,7 +340,8 @@ static LinearImage computeHorizontalEdt(const LinearImage& src, LinearImage cx)
 // Implements the paper 'Distance Transforms of Sampled Functions' by Felzenszwalb and Huttenlocher
 // but generalized to compute a coordinate field rather than a distance field. Coordinate fields are
 // more broadly useful and transforming them into distance fields is extremely cheap.
-LinearImage computeCoordField(const LinearImage& src, PresenceCallback presence, void* user) {
+LinearImage computeCoordField(const LinearImage& src, PresenceCallback presence, void* user,
+        utils::JobSystem* js) {
     const uint32_t width = src.getWidth();
     const uint32_t height = src.getHeight();
     LinearImage f0(width, height, 1);
@@ -348,47 +355,52 @@ LinearImage computeCoordField(const LinearImage& src, PresenceCallback presence,
     LinearImage cx(width, height, 1);
     LinearImage cy(height, width, 1);
 
-    f0 = computeHorizontalEdt(f0, cx);
+    f0 = computeHorizontalEdt(f0, cx, js);
     f0 = transpose(f0);
-    f0 = computeHorizontalEdt(f0, cy);
+    f0 = computeHorizontalEdt(f0, cy, js);
     f0 = transpose(f0);
 
     // NOTE: this could be extended to compute a volumetric distance field by transposing
     // X with Z at this point (rather than X with Y) and re-invoking computeHorizontalEdt.
 
     LinearImage coords(width, height, 2);
-    for (uint32_t row = 0; row < height; ++row) {
-        for (uint32_t col = 0; col < width; ++col) {
-            float y = cy.getPixelRef(row, col)[0];
-            float x = cx.getPixelRef(col, y)[0];
-            float* dst = coords.getPixelRef(col, row);
-            dst[0] = x;
-            dst[1] = y;
+    forEachRowBand(js, height, [&](uint32_t first, uint32_t count) {
+        for (uint32_t row = first; row < first + count; ++row) {
+            for (uint32_t col = 0; col < width; ++col) {
+                float y = cy.getPixelRef(row, col)[0];
+                float x = cx.getPixelRef(col, y)[0];
+                float* dst = coords.getPixelRef(col, row);
+                dst[0] = x;
+                dst[1] = y;
+            }
         }
-    }
+    });
 
     return coords;
 }
 
-LinearImage edtFromCoordField(const LinearImage& coordField, bool sqrt) {
+LinearImage edtFromCoordField(const LinearImage& coordField, bool sqrt, utils::JobSystem* js) {
     const uint32_t width = coordField.getWidth();
     const uint32_t height = coordField.getHeight();
     LinearImage result(width, height, 1);
-    for (int32_t row = 0; row < height; ++row) {
-        const float frow = row;
-        float* dst = result.getPixelRef(0, row);
-        for (uint32_t col = 0; col < width; ++col) {
-            const float fcol = col;
-            const float* coord = coordField.getPixelRef(col, row);
-            const float dx = coord[0] - fcol;
-            const float dy = coord[1] - frow;
-            float distance = dx * dx + dy * dy;
+    forEachRowBand(js, height, [&](uint32_t first, uint32_t count) {
+        for (uint32_t row = first; row < first + count; ++row) {
+            const float frow = row;
+            float* dst = result.getPixelRef(0, row);
+            const float* coord = coordField.getPixelRef(0, row);
+            // The branch is hoisted out of the inner loops so that the compiler can vectorize them.
+            for (uint32_t col = 0; col < width; ++col) {
+                const float dx = coord[col * 2] - float(col);
+                const float dy = coord[col * 2 + 1] - frow;
+                dst[col] = dx * dx + dy * dy;
+            }
             if (sqrt) {
-                distance = std::sqrt(distance);
+                for (uint32_t col = 0; col < width; ++col) {
+                    dst[col] = std::sqrt(dst[col]);
+                }
             }
-            dst[col] = distance;
         }
-    }
+    });
     return result;
 }
 
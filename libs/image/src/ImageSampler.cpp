@@ -17,13 +17,19 @@
 #include <image/ImageSampler.h>
 #include <image/ImageOps.h>
 
+#include "ImageJobs.h"
+
 #include <math/scalar.h>
+#include <math/simd.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/CString.h>
 
+#include <algorithm>
+#include <limits>
 #include <memory>
 #include <vector>
 #include <unordered_map>
@@ -32,6 +38,8 @@ using namespace image;
 
 namespace {
 
+namespace simd = filament::math::simd;
+
 struct FilterFunction {
     float (*fn)(float) = nullptr;
     float boundingRadius = 1;
@@ -131,8 +139,9 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
     // As an optimization, compute the "filterBound", which is the half-width of the filter within
     // the [0,1] domain. If this were a huge number, the filtered results would look the same, but
     // the filter would perform very poorly because it would be iterating over a lot more samples
-    // than necessary.
-    const float filterBounds = domainScale * std::abs(filter.boundingRadius);
+    // than necessary. The filter is evaluated at t = domainScale * distance, so its half-width is
+    // its bounding radius divided by domainScale.
+    const float filterBounds = std::abs(filter.boundingRadius) / domainScale;
 
     // Iterate through target samples. "xtarget" points to the center of each target pixel.
     float xtarget = dtarget / 2.0f;
@@ -143,9 +152,18 @@ void generateMadProgram(uint32_t ntarget, uint32_t nsource, float left, float ri
         uint32_t count = 0;
         float sum = 0;
 
-        // Iterate through source samples that lie within the bounded region.
-        const auto isource_lower = int32_t((xtarget - filterBounds) * nsource);
-        const auto isource_upper = int32_t(std::ceil((xtarget + filterBounds) * nsource));
+        // Iterate through source samples that lie within the bounded region, after mapping it
+        // from the source range to the whole row. One extra sample is visited on each side to
+        // stay clear of rounding, its weight is zero anyway. The bounds of a zero-width filter
+        // (NEAREST) select the samples on each side of the target, which its function doesn't.
+        int32_t isource_lower = int32_t(xtarget * nsource);
+        int32_t isource_upper = int32_t(std::ceil(xtarget * nsource));
+        if (filterBounds != 0) {
+            const float xlower = left + (xtarget - filterBounds) * (right - left);
+            const float xupper = left + (xtarget + filterBounds) * (right - left);
+            isource_lower = int32_t(std::floor(xlower * nsource - 0.5f)) - 1;
+            isource_upper = int32_t(std::ceil(xupper * nsource - 0.5f)) + 1;
+        }
         for (int32_t isource = isource_lower; isource <= isource_upper; ++isource) {
             const float xsource = (((isource + 0.5f) / nsource) - left) / (right - left);
             const bool outside_image = isource < 0 || isource >= int32_t(nsource);
@@ -208,26 +226,28 @@ FilterFunction createFilterFunction(Filter ftype) {
 }
 
 template <class VecT>
-void normalizeImpl(LinearImage& image) {
-    const uint32_t width = image.getWidth(), height = image.getHeight();
-    auto vecs = (VecT*) image.getPixelRef();
-    for (uint32_t n = 0; n < width * height; ++n) {
+void normalizeImpl(float* pixels, uint32_t count) {
+    auto vecs = (VecT*) pixels;
+    for (uint32_t n = 0; n < count; ++n) {
         vecs[n] = normalize(vecs[n]);
     }
 }
 
-void normalize(LinearImage& image) {
+// Normalizes the given rows of a 3 or 4 channel image.
+void normalizeRows(LinearImage& image, uint32_t row, uint32_t count) {
     ASSERT_PRECONDITION(image.getChannels() == 3 || image.getChannels() == 4,
                         "Must be a 3 or 4 channel image");
+    float* pixels = image.getPixelRef(0, row);
     if (image.getChannels() == 3) {
-      normalizeImpl< filament::math::float3>(image);
+      normalizeImpl< filament::math::float3>(pixels, image.getWidth() * count);
     } else {
-      normalizeImpl< filament::math::float4>(image);
+      normalizeImpl< filament::math::float4>(pixels, image.getWidth() * count);
     }
 }
 
 LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
-        uint32_t twidth, Filter filter, float left, float right, float filterRadiusMultiplier) {
+        uint32_t twidth, Filter filter, float left, float right, float filterRadiusMultiplier,
+        utils::JobSystem* js = nullptr) {
     const uint32_t swidth = source.getWidth();
     const uint32_t sheight = source.getHeight();
     const uint32_t nchan = source.getChannels();
@@ -242,39 +262,92 @@ LinearImage resampleImage1D(const LinearImage& source, MadProgram* program,
 
     // Allocate the target image.
     LinearImage result(twidth, sheight, nchan);
-    float const* sourceRow = source.getPixelRef();
-    float* targetRow = result.getPixelRef();
 
-    // The MIN filter is special because it starts with non-zero values and ignores filter weights.
-    if (filter == Filter::MINIMUM) {
-        for (uint32_t n = 0; n < twidth * sheight * nchan; ++n) {
-            targetRow[n] = std::numeric_limits<float>::max();
+    // Resize the image horizontally by executing the MAD instructions over each row. The MIN
+    // filter is special because it starts with non-zero values and ignores filter weights.
+    forEachRowBand(js, sheight, [&source, &result, program, filter](uint32_t row, uint32_t count) {
+        const uint32_t sstride = source.getWidth() * source.getChannels();
+        const uint32_t tstride = result.getWidth() * result.getChannels();
+        float const* sourceRow = source.getPixelRef(0, row);
+        float* targetRow = result.getPixelRef(0, row);
+        if (filter == Filter::MINIMUM) {
+            std::fill_n(targetRow, tstride * count, std::numeric_limits<float>::max());
+            for (uint32_t n = 0; n < count; ++n) {
+                for (auto mad : *program) {
+                    const float a = sourceRow[mad.sourceIndex];
+                    const float b = targetRow[mad.targetIndex];
+                    targetRow[mad.targetIndex] = std::min(a, b);
+                }
+                targetRow += tstride;
+                sourceRow += sstride;
+            }
+            return;
         }
-        for (uint32_t row = 0; row < sheight; ++row) {
+        for (uint32_t n = 0; n < count; ++n) {
             for (auto mad : *program) {
-                const float a = sourceRow[mad.sourceIndex];
-                const float b = targetRow[mad.targetIndex];
-                targetRow[mad.targetIndex] = std::min(a, b);
+                targetRow[mad.targetIndex] += sourceRow[mad.sourceIndex] * mad.weight;
             }
-            targetRow += twidth * nchan;
-            sourceRow += swidth * nchan;
+            targetRow += tstride;
+            sourceRow += sstride;
         }
-        return result;
-    }
 
-    // Resize the image horizontally by executing the MAD instructions over each row.
-    for (uint32_t row = 0; row < sheight; ++row) {
-        for (auto mad : *program) {
-            targetRow[mad.targetIndex] += sourceRow[mad.sourceIndex] * mad.weight;
+        // Perform post processing for the current pass.
+        if (filter == Filter::GAUSSIAN_NORMALS) {
+            normalizeRows(result, row, count);
         }
-        targetRow += twidth * nchan;
-        sourceRow += swidth * nchan;
-    }
+    });
+    return result;
+}
 
-    // Perform post processing for the current pass.
-    if (filter == Filter::GAUSSIAN_NORMALS) {
-        normalize(result);
+// Resizes the image vertically. Rather than transposing the image and resizing its rows, each
+// target row is computed directly as a weighted sum of entire source rows, which makes the inner
+// loop contiguous and lets it use SIMD. The sums are accumulated in the same order, so the result
+// is the same as with the transposition.
+LinearImage resampleImageVertical(const LinearImage& source, MadProgram* program,
+        uint32_t theight, Filter filter, float top, float bottom, float filterRadiusMultiplier,
+        utils::JobSystem* js) {
+    const uint32_t swidth = source.getWidth();
+    const uint32_t sheight = source.getHeight();
+    const uint32_t nchan = source.getChannels();
+    const bool mag = theight > sheight;
+    if (filter == Filter::DEFAULT) filter = mag ? Filter::MITCHELL : Filter::LANCZOS;
+    const FilterFunction vfn = createFilterFunction(filter);
+
+    // Generate the MAD instructions over rows, they are sorted by target row.
+    program->clear();
+    generateMadProgram(theight, sheight, top, bottom, vfn, filterRadiusMultiplier, program);
+    std::vector<uint32_t> firstMad(theight + 1, 0);
+    for (auto mad : *program) {
+        firstMad[mad.targetIndex + 1]++;
     }
+    for (uint32_t row = 0; row < theight; ++row) {
+        firstMad[row + 1] += firstMad[row];
+    }
+
+    LinearImage result(swidth, theight, nchan);
+    forEachRowBand(js, theight,
+            [&source, &result, program, &firstMad, filter](uint32_t row, uint32_t count) {
+        const uint32_t width = source.getWidth() * source.getChannels();
+        for (uint32_t trow = row; trow < row + count; ++trow) {
+            float* target = result.getPixelRef(0, trow);
+            MadInstruction const* first = program->data() + firstMad[trow];
+            MadInstruction const* last = program->data() + firstMad[trow + 1];
+            if (filter == Filter::MINIMUM) {
+                std::fill_n(target, width, std::numeric_limits<float>::max());
+                for (auto mad = first; mad != last; ++mad) {
+                    simd::minimum(target, source.getPixelRef(0, mad->sourceIndex), width);
+                }
+                continue;
+            }
+            for (auto mad = first; mad != last; ++mad) {
+                simd::multiplyAccumulate(target, source.getPixelRef(0, mad->sourceIndex),
+                        mad->weight, width);
+            }
+        }
+        if (filter == Filter::GAUSSIAN_NORMALS) {
+            normalizeRows(result, row, count);
+        }
+    });
     return result;
 }
 
@@ -300,18 +373,20 @@ LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t he
     const float top = sampler.sourceRegion.top;
     const float right = sampler.sourceRegion.right;
     const float bottom = sampler.sourceRegion.bottom;
+    utils::JobSystem* js = sampler.jobSystem;
     MadProgram program;
     LinearImage result;
-    result = transpose(resampleImage1D(source, &program, width, hfilter, left, right, radius));
-    result = transpose(resampleImage1D(result, &program, height, vfilter, top, bottom, radius));
+    result = resampleImage1D(source, &program, width, hfilter, left, right, radius, js);
+    result = resampleImageVertical(result, &program, height, vfilter, top, bottom, radius, js);
     return result;
 }
 
 LinearImage resampleImage(const LinearImage& source, uint32_t width, uint32_t height,
-        Filter filter) {
+        Filter filter, utils::JobSystem* js) {
     return resampleImage(source, width, height, ImageSampler {
         .horizontalFilter = filter,
-        .verticalFilter = filter
+        .verticalFilter = filter,
+        .jobSystem = js
     });
 }
 
@@ -337,14 +412,15 @@ void computeSingleSample(const LinearImage& source, float x, float y, SingleSamp
 
 // Unlike traditional mipmap generation, our implementation generates all levels from the original
 // image, under the premise that this produces a higher quality result.
-void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips) {
+void generateMipmaps(const LinearImage& source, Filter filter, LinearImage* result, uint32_t mips,
+        utils::JobSystem* js) {
     mips = std::min(mips, getMipmapCount(source));
     uint32_t width = source.getWidth();
     uint32_t height = source.getHeight();
     for (uint32_t n = 0; n < mips; ++n) {
         width = std::max(width >> 1u, 1u);
         height = std::max(height >> 1u, 1u);
-        result[n] = resampleImage(source, width, height, filter);
+        result[n] = resampleImage(source, width, height, filter, js);
     }
 }
 
@@ -18,10 +18,21 @@
 
 #include <utils/Panic.h>
 
+#include <fstream>
 #include <string>
 #include <vector>
 #include <unordered_map>
 
+#if !defined(WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAS_MMAP 1
+#else
+#define HAS_MMAP 0
+#endif
+
 namespace {
 
 struct SerializationHeader {
@@ -56,12 +67,54 @@ struct KtxMetadata {
 // Extremely simple contiguous storage for an array of blobs. Assumes that the total number of blobs
 // is relatively small compared to the size of each blob, and that resizing individual blobs does
 // not occur frequently.
+//
+// A bundle created from a mapped file instead reads its blobs in place from the mapping, at the
+// given offsets, until one of them is resized.
 struct KtxBlobList {
     std::vector<uint8_t> blobs;
     std::vector<uint32_t> sizes;
+    std::vector<size_t> offsets;
+    uint8_t* mapping = nullptr;
+    size_t mappingSize = 0;
+
+    ~KtxBlobList() {
+        unmap();
+    }
+
+    void unmap() {
+#if HAS_MMAP
+        if (mapping) {
+            munmap(mapping, mappingSize);
+        }
+#endif
+        mapping = nullptr;
+        mappingSize = 0;
+        offsets.clear();
+    }
+
+    // Copies the blobs out of the mapping, into contiguous storage.
+    void detach() {
+        if (!mapping) {
+            return;
+        }
+        size_t total = 0;
+        for (uint32_t size : sizes) {
+            total += size;
+        }
+        blobs.resize(total);
+        uint8_t* dst = blobs.data();
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            memcpy(dst, mapping + offsets[i], sizes[i]);
+            dst += sizes[i];
+        }
+        unmap();
+    }
 
     // Obtains a pointer to the given blob.
     uint8_t* get(uint32_t blobIndex) {
+        if (mapping) {
+            return mapping + offsets[blobIndex];
+        }
         uint8_t* result = blobs.data();
         for (uint32_t i = 0; i < blobIndex; ++i) {
             result += sizes[i];
@@ -71,6 +124,7 @@ struct KtxBlobList {
 
     // Resizes the blob at the given index by building a new contiguous array and swapping.
     void resize(uint32_t blobIndex, uint32_t newSize) {
+        detach();
         uint32_t preSize = 0;
         uint32_t postSize = 0;
         for (uint32_t i = 0; i < sizes.size(); ++i) {
@@ -108,6 +162,52 @@ KtxBundle::KtxBundle(uint32_t numMipLevels, uint32_t arrayLength, bool isCubemap
 
 KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
         mBlobs(new KtxBlobList), mMetadata(new KtxMetadata) {
+    deserialize(bytes, nbytes);
+}
+
+KtxBundle::KtxBundle() : mBlobs(new KtxBlobList), mMetadata(new KtxMetadata) {
+}
+
+KtxBundle* KtxBundle::createFromFile(const char* path) {
+#if HAS_MMAP
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(SerializationHeader)) {
+        close(fd);
+        return nullptr;
+    }
+    // The mapping is private and writable, so that writing to a blob returned by getBlob()
+    // doesn't affect the file.
+    const size_t length = size_t(st.st_size);
+    void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    KtxBundle* bundle = new KtxBundle();
+    bundle->mBlobs->mapping = (uint8_t*) addr;
+    bundle->mBlobs->mappingSize = length;
+    bundle->deserialize((uint8_t const*) addr, uint32_t(length));
+    return bundle;
+#else
+    std::ifstream in(path, std::ifstream::ate | std::ifstream::binary);
+    if (!in) {
+        return nullptr;
+    }
+    std::vector<uint8_t> contents(in.tellg());
+    if (contents.size() < sizeof(SerializationHeader)) {
+        return nullptr;
+    }
+    in.seekg(0);
+    in.read((char*) contents.data(), contents.size());
+    return new KtxBundle(contents.data(), uint32_t(contents.size()));
+#endif
+}
+
+void KtxBundle::deserialize(uint8_t const* bytes, uint32_t nbytes) {
     ASSERT_PRECONDITION(sizeof(SerializationHeader) <= nbytes, "KTX buffer is too small");
 
     // First, "parse" the header by casting it to a struct.
@@ -149,18 +249,31 @@ KtxBundle::KtxBundle(uint8_t const* bytes, uint32_t nbytes) :
     const bool isNonArrayCube = mNumCubeFaces > 1 && mArrayLength == 1;
     const uint32_t facesPerMip = mArrayLength * mNumCubeFaces;
 
-    // Extract blobs from the serialized byte stream.
-    const uint32_t totalSize = nbytes - (pdata - bytes);
-    mBlobs->blobs.resize(totalSize);
+    // Extract blobs from the serialized byte stream, or only record where they are when the
+    // bytes are our mapping.
+    const bool mapped = bytes == mBlobs->mapping;
+    if (mapped) {
+        mBlobs->offsets.resize(mBlobs->sizes.size());
+    } else {
+        const uint32_t totalSize = nbytes - (pdata - bytes);
+        mBlobs->blobs.resize(totalSize);
+    }
     for (uint32_t mipmap = 0; mipmap < mNumMipLevels; ++mipmap) {
         const uint32_t imageSize = *((uint32_t const*) pdata);
         const uint32_t faceSize = isNonArrayCube ? imageSize : (imageSize / facesPerMip);
         const uint32_t levelSize = faceSize * mNumCubeFaces * mArrayLength;
         pdata += sizeof(uint32_t);
-        memcpy(mBlobs->get(flatten(this, {mipmap, 0, 0})), pdata, levelSize);
+        ASSERT_PRECONDITION(pdata + levelSize <= bytes + nbytes, "KTX buffer is truncated");
+        if (!mapped) {
+            memcpy(mBlobs->get(flatten(this, {mipmap, 0, 0})), pdata, levelSize);
+        }
         for (uint32_t layer = 0; layer < mArrayLength; ++layer) {
             for (uint32_t face = 0; face < mNumCubeFaces; ++face) {
-                mBlobs->sizes[flatten(this, {mipmap, layer, face})] = faceSize;
+                const size_t flatIndex = flatten(this, {mipmap, layer, face});
+                mBlobs->sizes[flatIndex] = faceSize;
+                if (mapped) {
+                    mBlobs->offsets[flatIndex] = size_t(pdata - bytes);
+                }
                 pdata += faceSize;
                 pdata += cubePadding;
             }
@@ -26,13 +26,16 @@
 
 #include <gtest/gtest.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Path.h>
 
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <cstring>
 #include <fstream>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <vector>
@@ -362,6 +365,83 @@ TEST_F(ImageTest, Mipmaps) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, JobSystem) { // NOLINT
+    utils::JobSystem js;
+    js.adopt();
+
+    // The results must not depend on splitting the rows over the job system.
+    LinearImage src = createNormalMap(200);
+    for (Filter filter : { Filter::BOX, Filter::NEAREST, Filter::GAUSSIAN_NORMALS,
+            Filter::MITCHELL, Filter::LANCZOS, Filter::MINIMUM }) {
+        EXPECT_EQ(compare(resampleImage(src, 73, 150, filter),
+                resampleImage(src, 73, 150, filter, &js)), 0);
+        EXPECT_EQ(compare(resampleImage(src, 333, 41, filter),
+                resampleImage(src, 333, 41, filter, &js)), 0);
+    }
+
+    const uint32_t count = getMipmapCount(src);
+    vector<LinearImage> mips(count);
+    vector<LinearImage> jobMips(count);
+    generateMipmaps(src, Filter::LANCZOS, mips.data(), count);
+    generateMipmaps(src, Filter::LANCZOS, jobMips.data(), count, &js);
+    for (uint32_t index = 0; index < count; ++index) {
+        EXPECT_EQ(compare(mips[index], jobMips[index]), 0);
+    }
+
+    auto presence = [] (const LinearImage& img, uint32_t col, uint32_t row, void*) {
+        return img.getPixelRef(col, row)[2] > 0.99f;
+    };
+    LinearImage cf = computeCoordField(src, presence, nullptr);
+    LinearImage jobCf = computeCoordField(src, presence, nullptr, &js);
+    EXPECT_EQ(compare(cf, jobCf), 0);
+    EXPECT_EQ(compare(edtFromCoordField(cf, true), edtFromCoordField(cf, true, &js)), 0);
+
+    js.emancipate();
+}
+
+TEST_F(ImageTest, StreamingDecode) { // NOLINT
+    utils::JobSystem js;
+    js.adopt();
+
+    // Streaming must deliver exactly the pixels of a regular decode, including when the blocks
+    // are converted on the job system.
+    LinearImage src = createNormalMap(97);
+    for (ImageEncoder::Format format : { ImageEncoder::Format::PNG, ImageEncoder::Format::HDR,
+            ImageEncoder::Format::EXR }) {
+        std::stringstream encoded;
+        ASSERT_TRUE(ImageEncoder::encode(encoded, format, src, "", "normals"));
+        const string data = encoded.str();
+
+        istringstream in(data);
+        LinearImage decoded = ImageDecoder::decode(in, "normals");
+        ASSERT_TRUE(decoded.isValid());
+
+        LinearImage streamed;
+        istringstream streamIn(data);
+        ASSERT_TRUE(ImageDecoder::decode(streamIn, "normals", ImageDecoder::ColorSpace::SRGB,
+                [&streamed](ImageDecoder::ImageInfo const& info) {
+                    streamed = LinearImage(info.width, info.height, info.channels);
+                    return true;
+                },
+                [&streamed](ImageDecoder::Block const& block) {
+                    const uint32_t channels = streamed.getChannels();
+                    for (uint32_t y = 0; y < block.height; y++) {
+                        memcpy(streamed.getPixelRef(block.x, block.y + y),
+                                block.data + y * block.stride * channels,
+                                block.width * channels * sizeof(float));
+                    }
+                }, &js));
+        EXPECT_EQ(compare(decoded, streamed), 0);
+
+        istringstream cancelIn(data);
+        EXPECT_FALSE(ImageDecoder::decode(cancelIn, "normals", ImageDecoder::ColorSpace::SRGB,
+                [](ImageDecoder::ImageInfo const&) { return false; },
+                [](ImageDecoder::Block const&) { FAIL(); }));
+    }
+
+    js.emancipate();
+}
+
 TEST_F(ImageTest, Ktx) { // NOLINT
     uint8_t foo[] = {1, 2, 3};
     uint8_t* data;
@@ -427,6 +507,50 @@ TEST_F(ImageTest, Ktx) { // NOLINT
     }
 }
 
+TEST_F(ImageTest, KtxFromFile) { // NOLINT
+    uint8_t level0[] = {1, 2, 3, 4, 5, 6, 7, 8};
+    uint8_t level1[] = {9, 10, 11, 12};
+    KtxBundle nascent(2, 1, false);
+    ASSERT_TRUE(nascent.setBlob({0, 0, 0}, level0, sizeof(level0)));
+    ASSERT_TRUE(nascent.setBlob({1, 0, 0}, level1, sizeof(level1)));
+
+    const uint32_t serializedSize = nascent.getSerializedLength();
+    vector<uint8_t> serialized(serializedSize);
+    ASSERT_TRUE(nascent.serialize(serialized.data(), serializedSize));
+
+    utils::Path path = utils::Path::getTemporaryDirectory() + "test_image_mapped.ktx";
+    {
+        std::ofstream out(path.getPath(), std::ios::binary);
+        out.write((const char*) serialized.data(), serializedSize);
+    }
+
+    ASSERT_EQ(KtxBundle::createFromFile("does_not_exist.ktx"), nullptr);
+
+    std::unique_ptr<KtxBundle> mapped(KtxBundle::createFromFile(path.c_str()));
+    ASSERT_NE(mapped, nullptr);
+    ASSERT_EQ(mapped->getNumMipLevels(), 2);
+
+    uint8_t* data;
+    uint32_t size;
+    ASSERT_TRUE(mapped->getBlob({0, 0, 0}, &data, &size));
+    ASSERT_EQ(size, sizeof(level0));
+    ASSERT_EQ(memcmp(data, level0, size), 0);
+    ASSERT_TRUE(mapped->getBlob({1, 0, 0}, &data, &size));
+    ASSERT_EQ(size, sizeof(level1));
+    ASSERT_EQ(memcmp(data, level1, size), 0);
+
+    // Resizing a blob moves the bundle out of the mapping.
+    uint8_t bigger[] = {1, 2, 3, 4, 5, 6};
+    ASSERT_TRUE(mapped->setBlob({1, 0, 0}, bigger, sizeof(bigger)));
+    ASSERT_TRUE(mapped->getBlob({0, 0, 0}, &data, &size));
+    ASSERT_EQ(memcmp(data, level0, size), 0);
+    ASSERT_TRUE(mapped->getBlob({1, 0, 0}, &data, &size));
+    ASSERT_EQ(size, sizeof(bigger));
+    ASSERT_EQ(memcmp(data, bigger, size), 0);
+
+    path.unlinkFile();
+}
+
 TEST_F(ImageTest, getSphericalHarmonics) {
     KtxBundle ktx(2, 1, true);
 
@@ -53,6 +53,9 @@ enum class CompressedFormat {
     SRGB_ALPHA_S3TC_DXT3 = 0x8C4E,
     SRGB_ALPHA_S3TC_DXT5 = 0x8C4F,
 
+    RED_RGTC1 = 0x8DBB,
+    RG_RGTC2 = 0x8DBD,
+
     RGBA_ASTC_4x4 = 0x93B0,
     RGBA_ASTC_5x4 = 0x93B1,
     RGBA_ASTC_5x5 = 0x93B2,
@@ -159,18 +162,29 @@ EtcConfig etcParseOptionString(const std::string& options);
 
 // S3TC ////////////////////////////////////////////////////////////////////////////////////////////
 
+// Controls how fast S3TC compression occurs at the cost of quality in the resulting image.
+enum class S3tcQuality {
+    FAST,   // One refinement step of the endpoints.
+    HIGH,   // Two refinement steps, about 30-40% slower.
+};
+
 // Informs the S3TC encoder of the desired output.
 struct S3tcConfig {
     CompressedFormat format;
     bool srgb;
+    S3tcQuality quality = S3tcQuality::FAST;
 };
 
-// Uses the CPU to compress a linear image (1 to 4 channels) into an S3TC texture.
+// Uses the CPU to compress a linear image (1 to 4 channels) into an S3TC texture. The rows of
+// blocks are compressed on all the available cores. Besides DXT1 and DXT5, the one and two channel
+// RGTC formats (also known as BC4 and BC5) are supported, they compress the first channel or the
+// first two channels of the image.
 CompressedTexture s3tcCompress(const LinearImage& source, S3tcConfig config);
 
 // Parses an underscore-delimited string to produce an S3TC compression configuration. Currently
-// this only accepts "rgb_dxt1" and "rgba_dxt5". If the string is malformed, this returns a config
-// with an invalid format.
+// this only accepts "rgb_dxt1", "rgba_dxt5", "r_bc4" and "rg_bc5", optionally followed by "_hq"
+// for the higher quality encoding. If the string is malformed, this returns a config with an
+// invalid format.
 S3tcConfig s3tcParseOptionString(const std::string& options);
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
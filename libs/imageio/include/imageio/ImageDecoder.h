@@ -17,11 +17,16 @@
 #ifndef IMAGE_IMAGEDECODER_H_
 #define IMAGE_IMAGEDECODER_H_
 
+#include <functional>
 #include <iosfwd>
 #include <string>
 
 #include <image/LinearImage.h>
 
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace image {
 
 class ImageDecoder {
@@ -31,15 +36,56 @@ public:
         SRGB
     };
 
+    // Size of the image about to be streamed, see BlockCallback.
+    struct ImageInfo {
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+    };
+
+    // A rectangle of decoded linear floating-point data. Pixels have ImageInfo::channels
+    // interleaved components and rows are 'stride' pixels apart. The data is only valid for the
+    // duration of the callback.
+    struct Block {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        float const* data;
+    };
+
+    // Called once before any block. Returning false stops decoding.
+    using InfoCallback = std::function<bool(ImageInfo const& info)>;
+
+    // Called with each decoded block. Scanline formats deliver whole rows from top to bottom,
+    // tiled OpenEXR files deliver their tiles in any order.
+    using BlockCallback = std::function<void(Block const& block)>;
+
     // Returns linear floating-point data, or a non-valid image if an error occured.
     static LinearImage decode(std::istream& stream, const std::string& sourceName,
             ColorSpace sourceSpace = ColorSpace::SRGB);
 
+    // Streams linear floating-point data to the given callbacks without holding the decoded
+    // image, so it can be converted on the fly into the caller's own storage. Returns false if
+    // an error occured or if onInfo returned false.
+    //
+    // When a job system is given, OpenEXR blocks are converted on it in parallel and onBlock may
+    // be called concurrently from several threads, with disjoint blocks.
+    static bool decode(std::istream& stream, const std::string& sourceName,
+            ColorSpace sourceSpace, InfoCallback const& onInfo, BlockCallback const& onBlock,
+            utils::JobSystem* js = nullptr);
+
     class Decoder {
     public:
         virtual LinearImage decode() = 0;
         virtual ~Decoder() = default;
 
+        // Streams the image to the given callbacks, see ImageDecoder::decode(). The default
+        // implementation decodes the whole image first and delivers it as a single block.
+        virtual bool decodeBlocks(InfoCallback const& onInfo, BlockCallback const& onBlock,
+                utils::JobSystem* js);
+
         ColorSpace getColorSpace() const noexcept {
             return mColorSpace;
         }
@@ -48,6 +94,10 @@ public:
             mColorSpace = colorSpace;
         }
 
+    protected:
+        // Implements decode() on top of decodeBlocks(), for decoders that stream.
+        LinearImage decodeToLinearImage();
+
     private:
         ColorSpace mColorSpace = ColorSpace::SRGB;
     };
@@ -60,6 +110,9 @@ private:
         PSD,
         EXR
     };
+
+    static Decoder* createDecoder(std::istream& stream, const std::string& sourceName,
+            ColorSpace sourceSpace);
 };
 
 } // namespace image
@@ -19,8 +19,10 @@
 #include <image/ImageOps.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <thread>
+#include <vector>
 
 #include <astcenc.h>
 #include <Etc.h>
@@ -359,45 +361,94 @@ static uint32_t imin(uint32_t a, uint32_t b) {
     return (a < b) ? a : b;
 }
 
-static void extract4x4RGBA(uint8_t* dst, const LinearImage& source, uint32_t x0, uint32_t y0) {
+// Extracts a block of 4x4 pixels with the given number of channels, clamping the coordinates to
+// the image, and the channels to the channels of the image.
+static void extract4x4(uint8_t* dst, const LinearImage& source, uint32_t x0, uint32_t y0,
+        uint32_t channels) {
     const uint32_t maxx = source.getWidth() - 1;
     const uint32_t maxy = source.getHeight() - 1;
+    const uint32_t maxc = source.getChannels() - 1;
     for (uint32_t y = y0, y1 = y0 + 4; y < y1; ++y) {
-        for (uint32_t x = x0, x1 = x0 + 4; x < x1; ++x, dst += 4) {
+        for (uint32_t x = x0, x1 = x0 + 4; x < x1; ++x, dst += channels) {
             int clamped_x = imin(maxx, x);
             int clamped_y = imin(maxy, y);
-            float const* rgba = source.getPixelRef(clamped_x, clamped_y);
-            dst[0] = (uint8_t) std::min(255.0f, std::max(0.0f, (rgba[0] * 255.0f)));
-            dst[1] = (uint8_t) std::min(255.0f, std::max(0.0f, (rgba[1] * 255.0f)));
-            dst[2] = (uint8_t) std::min(255.0f, std::max(0.0f, (rgba[2] * 255.0f)));
-            dst[3] = (uint8_t) std::min(255.0f, std::max(0.0f, (rgba[3] * 255.0f)));
+            float const* pixel = source.getPixelRef(clamped_x, clamped_y);
+            for (uint32_t c = 0; c < channels; ++c) {
+                const float value = pixel[imin(maxc, c)];
+                dst[c] = (uint8_t) std::min(255.0f, std::max(0.0f, (value * 255.0f)));
+            }
         }
     }
 }
 
+// Calls encodeRow(y) for each row of blocks, on as many threads as there are cores. The rows are
+// handed out one at a time, which balances the load when some blocks are slower to encode.
+template<typename ENCODER>
+static void encodeBlockRows(uint32_t yblocks, ENCODER const& encodeRow) {
+    const uint32_t threadCount = std::min(yblocks,
+            std::max(1u, std::thread::hardware_concurrency()));
+    std::atomic<uint32_t> nextRow{ 0 };
+    auto work = [&nextRow, &encodeRow, yblocks]() {
+        for (uint32_t y = nextRow++; y < yblocks; y = nextRow++) {
+            encodeRow(y);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < threadCount; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
 // Our S3TC / DXT encoder uses the STB implementation by Fabian Giesen.
 //
 // Due to limitations in STB, this only supports the following formats:
 //  - DXT1 with no alpha (16 input pixels in 64 bits of output, 6:1)
 //  - DXT5 with alpha (16 input pixels into 128 bits of output, 4:1)
+//  - BC4 with one channel (16 input pixels in 64 bits of output, 2:1)
+//  - BC5 with two channels (16 input pixels in 128 bits of output, 2:1)
 //
-// TODO: investigate using something more capable than STB (eg AMD Compressenator, bimg, libsquish)
+// TODO: investigate using something more capable than STB for BC7 (eg AMD Compressenator, bc7enc)
 CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
     const bool dxt5 = config.format == CompressedFormat::RGBA_S3TC_DXT5;
-    LinearImage source = extendToFourChannels(original);
-    uint8_t block[64];
-    uint32_t xblocks = (source.getWidth() + 3) / 4;
-    uint32_t yblocks = (source.getHeight() + 3) / 4;
-    uint32_t size = xblocks * yblocks * (dxt5 ? 16 : 8);
+    const bool bc4 = config.format == CompressedFormat::RED_RGTC1;
+    const bool bc5 = config.format == CompressedFormat::RG_RGTC2;
+    const int mode = config.quality == S3tcQuality::HIGH ? STB_DXT_HIGHQUAL : STB_DXT_NORMAL;
+    const uint32_t channels = bc4 ? 1 : (bc5 ? 2 : 4);
+    const uint32_t blockSize = (dxt5 || bc5) ? 16 : 8;
+    const LinearImage source = channels == 4 ? extendToFourChannels(original) : original;
+    const uint32_t xblocks = (source.getWidth() + 3) / 4;
+    const uint32_t yblocks = (source.getHeight() + 3) / 4;
+    const uint32_t size = xblocks * yblocks * blockSize;
     uint8_t* buffer = new uint8_t[size];
-    uint8_t* dst = buffer;
-    for (int y = 0, h = source.getHeight(); y < h; y += 4) {
-        for (int x = 0, w = source.getWidth(); x < w; x += 4) {
-            extract4x4RGBA(block, source, x, y);
-            stb_compress_dxt_block(dst, block, dxt5, 8);
-            dst += dxt5 ? 16 : 8;
+
+    // STB initializes its tables on the first block without any synchronization, so this is done
+    // once before starting the threads.
+    static const bool sInitialized = [] {
+        uint8_t block[64] = {};
+        uint8_t dst[16];
+        stb_compress_dxt_block(dst, block, 0, STB_DXT_NORMAL);
+        return true;
+    }();
+    (void) sInitialized;
+
+    encodeBlockRows(yblocks, [&](uint32_t y) {
+        uint8_t block[64];
+        uint8_t* dst = buffer + y * xblocks * blockSize;
+        for (uint32_t x = 0; x < xblocks; ++x, dst += blockSize) {
+            extract4x4(block, source, x * 4, y * 4, channels);
+            if (bc4) {
+                stb_compress_bc4_block(dst, block);
+            } else if (bc5) {
+                stb_compress_bc5_block(dst, block);
+            } else {
+                stb_compress_dxt_block(dst, block, dxt5, mode);
+            }
         }
-    }
+    });
     return {
         .format = config.format,
         .size = size,
@@ -406,11 +457,23 @@ CompressedTexture s3tcCompress(const LinearImage& original, S3tcConfig config) {
 }
 
 S3tcConfig s3tcParseOptionString(const std::string& options) {
-    if (options == "rgb_dxt1") {
-        return {CompressedFormat::RGB_S3TC_DXT1, false};
+    std::string format = options;
+    S3tcQuality quality = S3tcQuality::FAST;
+    if (format.size() > 3 && format.compare(format.size() - 3, 3, "_hq") == 0) {
+        format.resize(format.size() - 3);
+        quality = S3tcQuality::HIGH;
+    }
+    if (format == "rgb_dxt1") {
+        return {CompressedFormat::RGB_S3TC_DXT1, false, quality};
+    }
+    if (format == "rgba_dxt5") {
+        return {CompressedFormat::RGBA_S3TC_DXT5, false, quality};
+    }
+    if (format == "r_bc4") {
+        return {CompressedFormat::RED_RGTC1, false, quality};
     }
-    if (options == "rgba_dxt5") {
-        return {CompressedFormat::RGBA_S3TC_DXT5, false};
+    if (format == "rg_bc5") {
+        return {CompressedFormat::RG_RGTC2, false, quality};
     }
     return {};
 }
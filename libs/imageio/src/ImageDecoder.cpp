@@ -34,11 +34,14 @@
 #    include <arpa/inet.h>
 #endif
 
+#include <math/half.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
 #include <tinyexr.h>
 
+#include <utils/JobSystem.h>
+
 #include <vector>
 
 #include <image/ColorTransform.h>
@@ -62,6 +65,8 @@ private:
 
     // ImageDecoder::Decoder interface
     LinearImage decode() override;
+    bool decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+            ImageDecoder::BlockCallback const& onBlock, utils::JobSystem* js) override;
 
     static void cb_error(png_structp, png_const_charp);
     static void cb_stream(png_structp png, png_bytep buffer, png_size_t size);
@@ -91,6 +96,8 @@ private:
 
     // ImageDecoder::Decoder interface
     LinearImage decode() override;
+    bool decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+            ImageDecoder::BlockCallback const& onBlock, utils::JobSystem* js) override;
 
     static const char sigRadiance[];
     static const char sigRGBE[];
@@ -136,6 +143,8 @@ private:
 
     // ImageDecoder::Decoder interface
     LinearImage decode() override;
+    bool decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+            ImageDecoder::BlockCallback const& onBlock, utils::JobSystem* js) override;
 
     static const char sig[];
     std::istream& mStream;
@@ -145,8 +154,8 @@ private:
 
 // -----------------------------------------------------------------------------------------------
 
-LinearImage ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
-        ColorSpace sourceSpace) {
+ImageDecoder::Decoder* ImageDecoder::createDecoder(std::istream& stream,
+        const std::string& sourceName, ColorSpace sourceSpace) {
 
     Format format = Format::NONE;
 
@@ -166,31 +175,82 @@ LinearImage ImageDecoder::decode(std::istream& stream, const std::string& source
 
     stream.seekg(pos);
 
-    std::unique_ptr<Decoder> decoder;
+    Decoder* decoder = nullptr;
     switch (format) {
         case Format::NONE:
-            return LinearImage();
+            break;
         case Format::PNG:
-            decoder.reset(PNGDecoder::create(stream));
+            decoder = PNGDecoder::create(stream);
             decoder->setColorSpace(sourceSpace);
             break;
         case Format::HDR:
-            decoder.reset(HDRDecoder::create(stream));
+            decoder = HDRDecoder::create(stream);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
         case Format::PSD:
-            decoder.reset(PSDDecoder::create(stream));
+            decoder = PSDDecoder::create(stream);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
         case Format::EXR:
-            decoder.reset(EXRDecoder::create(stream, sourceName));
+            decoder = EXRDecoder::create(stream, sourceName);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
     }
+    return decoder;
+}
 
+LinearImage ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
+        ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(createDecoder(stream, sourceName, sourceSpace));
+    if (!decoder) {
+        return LinearImage();
+    }
     return decoder->decode();
 }
 
+bool ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
+        ColorSpace sourceSpace, InfoCallback const& onInfo, BlockCallback const& onBlock,
+        utils::JobSystem* js) {
+    std::unique_ptr<Decoder> decoder(createDecoder(stream, sourceName, sourceSpace));
+    if (!decoder) {
+        return false;
+    }
+    return decoder->decodeBlocks(onInfo, onBlock, js);
+}
+
+bool ImageDecoder::Decoder::decodeBlocks(InfoCallback const& onInfo, BlockCallback const& onBlock,
+        utils::JobSystem*) {
+    LinearImage image = decode();
+    if (!image.isValid()) {
+        return false;
+    }
+    const uint32_t width = image.getWidth();
+    const uint32_t height = image.getHeight();
+    if (!onInfo({ width, height, image.getChannels() })) {
+        return false;
+    }
+    onBlock({ 0, 0, width, height, width, image.getPixelRef() });
+    return true;
+}
+
+LinearImage ImageDecoder::Decoder::decodeToLinearImage() {
+    LinearImage image;
+    bool success = decodeBlocks(
+            [&image](ImageInfo const& info) {
+                image = LinearImage(info.width, info.height, info.channels);
+                return true;
+            },
+            [&image](Block const& block) {
+                const uint32_t channels = image.getChannels();
+                for (uint32_t y = 0; y < block.height; y++) {
+                    memcpy(image.getPixelRef(block.x, block.y + y),
+                            block.data + y * block.stride * channels,
+                            block.width * channels * sizeof(float));
+                }
+            }, nullptr);
+    return success ? image : LinearImage();
+}
+
 // -----------------------------------------------------------------------------------------------
 
 static inline float read32(std::istream& istream) {
@@ -233,7 +293,12 @@ PNGDecoder::~PNGDecoder() {
 }
 
 LinearImage PNGDecoder::decode() {
-    std::unique_ptr<uint8_t[]> imageData;
+    return decodeToLinearImage();
+}
+
+bool PNGDecoder::decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+        ImageDecoder::BlockCallback const& onBlock, utils::JobSystem*) {
+    using namespace filament::math;
     try {
         mInfo = png_create_info_struct(mPNG);
         png_read_info(mPNG, mInfo);
@@ -261,6 +326,7 @@ LinearImage PNGDecoder::decode() {
         if (bitDepth < 16) {
             png_set_expand_16(mPNG);
         }
+        const int passes = png_set_interlace_handling(mPNG);
 
         png_read_update_info(mPNG, mInfo);
 
@@ -270,44 +336,61 @@ LinearImage PNGDecoder::decode() {
         uint32_t width  = png_get_image_width(mPNG, mInfo);
         uint32_t height = png_get_image_height(mPNG, mInfo);
         size_t rowBytes = png_get_rowbytes(mPNG, mInfo);
+        const uint32_t channels = colorType == PNG_COLOR_TYPE_RGBA ? 4 : 3;
 
-        imageData = std::make_unique<uint8_t[]>(height * rowBytes);
-        std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
-        for (size_t y = 0 ; y < height ; y++) {
-            rowPointers[y] = &imageData[y * rowBytes];
+        if (!onInfo({ width, height, channels })) {
+            mStream.seekg(mStreamStartPos);
+            return false;
         }
-        png_read_image(mPNG, rowPointers.get());
-        png_read_end(mPNG, mInfo);
 
-        if (colorType == PNG_COLOR_TYPE_RGBA) {
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear<filament::math::float4>);
-            } else {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [](const filament::math::float4& color) ->  filament::math::float4 { return color; });
+        // Non-interlaced images are read one row at a time, interlaced images can only be
+        // delivered once all of their passes have been read.
+        const size_t bufferedRows = passes > 1 ? height : 1;
+        std::unique_ptr<uint8_t[]> imageData(new uint8_t[bufferedRows * rowBytes]);
+        if (passes > 1) {
+            std::unique_ptr<png_bytep[]> rowPointers(new png_bytep[height]);
+            for (size_t y = 0 ; y < height ; y++) {
+                rowPointers[y] = &imageData[y * rowBytes];
             }
-        } else {
-            // Convert to linear float (PNG 16 stores data in network order (big endian).
-            if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        sRGBToLinear< filament::math::float3>);
+            png_read_image(mPNG, rowPointers.get());
+        }
+
+        // Convert to linear float (PNG 16 stores data in network order (big endian).
+        const bool sRGB = getColorSpace() == ImageDecoder::ColorSpace::SRGB;
+        std::unique_ptr<float[]> row(new float[width * channels]);
+        for (uint32_t y = 0; y < height; y++) {
+            uint8_t* src = imageData.get();
+            if (passes > 1) {
+                src += y * rowBytes;
             } else {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
-                        [](uint16_t v) -> uint16_t { return ntohs(v); },
-                        [](const filament::math::float3& color) ->  filament::math::float3 { return color; });
+                png_read_row(mPNG, src, nullptr);
             }
+            uint16_t const* p = reinterpret_cast<uint16_t const*>(src);
+            float* d = row.get();
+            for (uint32_t x = 0; x < width * channels; x++) {
+                d[x] = float(ntohs(p[x])) / std::numeric_limits<uint16_t>::max();
+            }
+            if (sRGB && channels == 4) {
+                float4* pixels = reinterpret_cast<float4*>(d);
+                for (uint32_t x = 0; x < width; x++) {
+                    pixels[x] = sRGBToLinear<float4>(pixels[x]);
+                }
+            } else if (sRGB) {
+                float3* pixels = reinterpret_cast<float3*>(d);
+                for (uint32_t x = 0; x < width; x++) {
+                    pixels[x] = sRGBToLinear<float3>(pixels[x]);
+                }
+            }
+            onBlock({ 0, y, width, 1, width, d });
         }
+        png_read_end(mPNG, mInfo);
+        return true;
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding PNG: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
-        imageData.release();
     }
-    return LinearImage();
+    return false;
 }
 
 void PNGDecoder::cb_stream(png_structp png, png_bytep buffer, png_size_t size) {
@@ -353,6 +436,11 @@ HDRDecoder::HDRDecoder(std::istream& stream)
 HDRDecoder::~HDRDecoder() = default;
 
 LinearImage HDRDecoder::decode() {
+    return decodeToLinearImage();
+}
+
+bool HDRDecoder::decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+        ImageDecoder::BlockCallback const& onBlock, utils::JobSystem*) {
     try {
         float gamma;
         float exposure;
@@ -375,13 +463,14 @@ LinearImage HDRDecoder::decode() {
             } while (true);
         }
 
-        LinearImage image(width, height, 3);
-
-        if (sx == '-') image = horizontalFlip(image);
-        if (sy == '+') image = verticalFlip(image);
+        if (!onInfo({ width, height, 3 })) {
+            mStream.seekg(mStreamStartPos);
+            return false;
+        }
 
-        // Allocate memory to hold one row of decoded pixel data.
+        // Allocate memory to hold one row of encoded and decoded pixel data.
         std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width * 4]);
+        std::unique_ptr<filament::math::float3[]> row(new filament::math::float3[width]);
 
         // First, test for non-RLE images.
         const auto pos = mStream.tellg();
@@ -390,7 +479,7 @@ LinearImage HDRDecoder::decode() {
 
         if (rgbe[0] != 0x2 || rgbe[1] != 0x2 || (rgbe[2] & 0x80) || width < 8 || width > 32767) {
             for (uint32_t y = 0; y < height; y++) {
-                filament::math::float3* dst = reinterpret_cast<filament::math::float3*>(image.getPixelRef(0, y));
+                filament::math::float3* dst = row.get();
                 mStream.read((char*) rgbe.get(), width * 4);
                 // (rgb/256) * 2^(e-128)
                 size_t pixel = 0;
@@ -402,6 +491,7 @@ LinearImage HDRDecoder::decode() {
                         dst[x] = (v + 0.5f) * std::ldexp(1.0f, rgbe[pixel + 3] - (128 + 8));
                     }
                 }
+                onBlock({ 0, y, width, 1, width, &dst->x });
             }
         } else {
             for (uint32_t y = 0; y < height; y++) {
@@ -444,7 +534,7 @@ LinearImage HDRDecoder::decode() {
                 uint8_t const* g = &rgbe[width];
                 uint8_t const* b = &rgbe[2 * width];
                 uint8_t const* e = &rgbe[3 * width];
-                filament::math::float3* dst = reinterpret_cast<filament::math::float3*>(image.getPixelRef(0, y));
+                filament::math::float3* dst = row.get();
                 // (rgb/256) * 2^(e-128)
                 for (size_t x = 0; x < width; x++, r++, g++, b++, e++) {
                     if (e[0] == 0.0f) {
@@ -454,17 +544,18 @@ LinearImage HDRDecoder::decode() {
                         dst[x] = (v + 0.5f) * std::ldexp(1.0f, e[0] - (128 + 8));
                     }
                 }
+                onBlock({ 0, y, width, 1, width, &dst->x });
             }
         }
 
-        return image;
+        return true;
 
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
     }
-    return LinearImage();
+    return false;
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -599,6 +690,29 @@ EXRDecoder::EXRDecoder(std::istream& stream, const std::string& sourceName)
 EXRDecoder::~EXRDecoder() = default;
 
 LinearImage EXRDecoder::decode() {
+    return decodeToLinearImage();
+}
+
+bool EXRDecoder::decodeBlocks(ImageDecoder::InfoCallback const& onInfo,
+        ImageDecoder::BlockCallback const& onBlock, utils::JobSystem* js) {
+    using namespace utils;
+
+    // A rectangle of the image, with one plane per channel, 'stride' pixels per row.
+    struct EXRBlock {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+        uint32_t height;
+        uint32_t stride;
+        unsigned char const* const* planes;
+        size_t offset;
+    };
+
+    EXRHeader header;
+    EXRImage exrImage;
+    InitEXRHeader(&header);
+    InitEXRImage(&exrImage);
+
     try {
         // copy the EXR data in memory
         std::vector<unsigned char> src;
@@ -608,46 +722,137 @@ LinearImage EXRDecoder::decode() {
         }
         src.insert(src.end(), &buffer[0], &buffer[mStream.gcount()]);
 
-        int width;
-        int height;
-        float* rgba;
-        const char* error;
-
-        int ret = LoadEXRFromMemory(&rgba, &width, &height, src.data(), src.size(), &error);
+        const char* error = nullptr;
+        EXRVersion version;
+        int ret = ParseEXRVersionFromMemory(&version, src.data(), src.size());
+        if (ret == TINYEXR_SUCCESS) {
+            ret = ParseEXRHeaderFromMemory(&header, &version, src.data(), src.size(), &error);
+        }
+        // HALF channels are kept as such, and only converted block by block below. This halves
+        // the size of the decoded image compared to LoadEXRFromMemory().
+        if (ret == TINYEXR_SUCCESS) {
+            ret = LoadEXRImageFromMemory(&exrImage, &header, src.data(), src.size(), &error);
+        }
         if (ret != TINYEXR_SUCCESS) {
-            std::cerr << "Could not decode OpenEXR: " << error << std::endl;
-            FreeEXRErrorMessage(error);
+            std::cerr << "Could not decode OpenEXR: " << (error ? error : "invalid file")
+                    << std::endl;
+            if (error) {
+                FreeEXRErrorMessage(error);
+            }
+            FreeEXRHeader(&header);
             mStream.seekg(mStreamStartPos);
-            return LinearImage();
+            return false;
         }
 
         src.clear();
         src.shrink_to_fit();
 
-        LinearImage image((uint32_t) width, (uint32_t) height, 3);
+        // Use R, G and B, or replicate the only channel of grayscale images.
+        int channel[3] = { 0, 0, 0 };
+        if (header.num_channels > 1) {
+            channel[0] = channel[1] = channel[2] = -1;
+            for (int c = 0; c < header.num_channels; c++) {
+                for (int i = 0; i < 3; i++) {
+                    if (!strcmp(header.channels[c].name, i == 0 ? "R" : (i == 1 ? "G" : "B"))) {
+                        channel[i] = c;
+                    }
+                }
+            }
+            if (channel[0] < 0 || channel[1] < 0 || channel[2] < 0) {
+                throw std::runtime_error("R, G and B channels are required");
+            }
+        }
 
-        size_t i = 0;
-        for (uint32_t y = 0; y < height; y++) {
-            for (uint32_t x = 0; x < width; x++) {
-                 filament::math::float3& pixel = *reinterpret_cast< filament::math::float3*>(image.getPixelRef(x, y));
-                pixel.r = rgba[i++];
-                pixel.g = rgba[i++];
-                pixel.b = rgba[i++];
-                // skip alpha
-                i++;
+        const uint32_t width = (uint32_t) exrImage.width;
+        const uint32_t height = (uint32_t) exrImage.height;
+
+        std::vector<EXRBlock> blocks;
+        if (header.tiled) {
+            for (int i = 0; i < exrImage.num_tiles; i++) {
+                EXRTile const& tile = exrImage.tiles[i];
+                // only the first level of mipmapped or ripmapped files is decoded
+                if (tile.level_x || tile.level_y) {
+                    continue;
+                }
+                const uint32_t x = uint32_t(tile.offset_x * header.tile_size_x);
+                const uint32_t y = uint32_t(tile.offset_y * header.tile_size_y);
+                if (x >= width || y >= height) {
+                    continue;
+                }
+                blocks.push_back({ x, y,
+                        std::min(uint32_t(tile.width), width - x),
+                        std::min(uint32_t(tile.height), height - y),
+                        uint32_t(header.tile_size_x), tile.images, 0 });
+            }
+        } else {
+            constexpr uint32_t ROWS_PER_BLOCK = 16;
+            for (uint32_t y = 0; y < height; y += ROWS_PER_BLOCK) {
+                blocks.push_back({ 0, y, width, std::min(ROWS_PER_BLOCK, height - y), width,
+                        exrImage.images, size_t(y) * width });
             }
         }
 
-        free(rgba);
+        if (!onInfo({ width, height, 3 })) {
+            FreeEXRImage(&exrImage);
+            FreeEXRHeader(&header);
+            mStream.seekg(mStreamStartPos);
+            return false;
+        }
 
-        return image;
+        auto fetch = [&header](unsigned char const* plane, int c, size_t i) -> float {
+            switch (header.pixel_types[c]) {
+                case TINYEXR_PIXELTYPE_HALF:
+                    return float(reinterpret_cast<filament::math::half const*>(plane)[i]);
+                case TINYEXR_PIXELTYPE_UINT:
+                    return float(reinterpret_cast<uint32_t const*>(plane)[i]);
+                default:
+                    return reinterpret_cast<float const*>(plane)[i];
+            }
+        };
+
+        auto convert = [&](EXRBlock const& block, std::vector<float>& rgb) {
+            rgb.resize(size_t(block.width) * block.height * 3);
+            float* d = rgb.data();
+            for (uint32_t y = 0; y < block.height; y++) {
+                const size_t row = block.offset + size_t(y) * block.stride;
+                for (uint32_t x = 0; x < block.width; x++) {
+                    for (int i = 0; i < 3; i++) {
+                        *d++ = fetch(block.planes[channel[i]], channel[i], row + x);
+                    }
+                }
+            }
+            onBlock({ block.x, block.y, block.width, block.height, block.width, rgb.data() });
+        };
+
+        if (js) {
+            auto task = [&](EXRBlock* first, size_t count) {
+                std::vector<float> rgb;
+                for (size_t i = 0; i < count; i++) {
+                    convert(first[i], rgb);
+                }
+            };
+            auto job = jobs::parallel_for(*js, nullptr, blocks.data(), uint32_t(blocks.size()),
+                    std::ref(task), jobs::CountSplitter<1, 8>());
+            js->runAndWait(job);
+        } else {
+            std::vector<float> rgb;
+            for (EXRBlock const& block : blocks) {
+                convert(block, rgb);
+            }
+        }
+
+        FreeEXRImage(&exrImage);
+        FreeEXRHeader(&header);
+        return true;
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding OpenEXR: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
     }
 
-    return LinearImage();
+    FreeEXRImage(&exrImage);
+    FreeEXRHeader(&header);
+    return false;
 }
 
 } // namespace image
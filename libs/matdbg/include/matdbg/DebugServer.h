@@ -28,6 +28,17 @@ class CivetServer;
 namespace filament {
 namespace matdbg {
 
+/**
+ * Cost of a shader variant of a material, averaged per frame over the frames profiled since
+ * profiling was enabled.
+ */
+struct MaterialVariantStats {
+    uint8_t variant;
+    float drawCount;
+    float triangleCount;    // estimated from the index counts of the primitives
+    float gpuTime;          // in milliseconds
+};
+
 /**
  * Server-side material debugger.
  *
@@ -48,6 +59,8 @@ public:
 
     using EditCallback = void(*)(void* userdata, const utils::CString& name, const void*, size_t);
     using QueryCallback = void(*)(void* userdata, uint64_t* variants);
+    using StatsCallback = size_t(*)(void* userdata, MaterialVariantStats* stats, size_t capacity);
+    using ProfileCallback = void(*)(void* user, bool enabled);
 
     /**
      * Sets up a callback that allows the Filament engine to listen for shader edits. The callback
@@ -61,6 +74,22 @@ public:
      */
     void setQueryCallback(QueryCallback callback) { mQueryCallback = callback; }
 
+    /**
+     * Sets up a callback that asks the Filament engine for the cost of the variants of a
+     * material, it returns the number of variants written. The callback might be triggered from
+     * a secondary thread.
+     */
+    void setStatsCallback(StatsCallback callback) { mStatsCallback = callback; }
+
+    /**
+     * Sets up a callback that enables or disables the profiling of the materials, which slows
+     * down rendering. The callback might be triggered from a secondary thread.
+     */
+    void setProfileCallback(ProfileCallback callback, void* user) {
+        mProfileCallback = callback;
+        mProfileUser = user;
+    }
+
     bool isReady() const { return mServer; }
 
 private:
@@ -99,6 +128,9 @@ private:
 
     EditCallback mEditCallback = nullptr;
     QueryCallback mQueryCallback = nullptr;
+    StatsCallback mStatsCallback = nullptr;
+    ProfileCallback mProfileCallback = nullptr;
+    void* mProfileUser = nullptr;
 
     class FileRequestHandler* mFileHandler = nullptr;
     class RestRequestHandler* mRestHandler = nullptr;
@@ -26,6 +26,8 @@
 namespace filament {
 namespace matdbg {
 
+struct MaterialVariantStats;
+
 // This class generates portions of JSON messages that are sent to the web client.
 // Note that some portions of these JSON strings are generated by directly in DebugServer,
 // as well as CommonWriter.
@@ -47,6 +49,14 @@ public:
     bool writeActiveInfo(const filaflat::ChunkContainer& package, backend::Backend backend,
             uint64_t activeVariants);
 
+    // Generates a JSON string describing the cost of the material.
+    //
+    // The object is of the form { "variants": [ ... ], "vulkan": [ ... ] } where each variant
+    // has its draw count, triangle count and GPU time per frame, and each SPIR-V shader has its
+    // instruction count and ID bound. Shaders have the same index as in writeMaterialInfo().
+    bool writeStatsInfo(const filaflat::ChunkContainer& package,
+            const MaterialVariantStats* stats, size_t count);
+
 private:
     utils::CString mJsonString;
 };
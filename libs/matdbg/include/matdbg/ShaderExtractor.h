@@ -45,6 +45,11 @@ public:
     static utils::CString spirvToGLSL(const uint32_t* data, size_t wordCount);
     static utils::CString spirvToText(const uint32_t* data, size_t wordCount);
 
+    // Counts the instructions of a SPIR-V module and returns its ID bound, which gives a rough
+    // idea of the register pressure. Returns false if the module is malformed.
+    static bool getSpirvStats(const uint32_t* data, size_t wordCount,
+            uint32_t* instructionCount, uint32_t* idBound);
+
 private:
     filaflat::ChunkContainer mChunkContainer;
     filaflat::MaterialChunk mMaterialChunk;
@@ -32,7 +32,9 @@ std::string formatVariantString(uint8_t variant) noexcept {
         if (variant & Variant::SHADOW_RECEIVER)       variantString += "SRE|";
         if (variant & Variant::SKINNING_OR_MORPHING)  variantString += "SKN|";
         if (variant & Variant::DEPTH)                 variantString += "DEP|";
-        if (variant & Variant::FOG)                   variantString += "FOG|";
+        if (variant & Variant::FOG) {
+            variantString += (variant & Variant::DEPTH) ? "PCK|" : "FOG|";
+        }
         if (variant & Variant::VSM)                   variantString += "VSM|";
         variantString = variantString.substr(0, variantString.length() - 1);
     }
@@ -33,6 +33,8 @@
 
 #include <backend/DriverEnums.h>
 
+#include <private/filament/Variant.h>
+
 #include <sstream>
 #include <string>
 
@@ -104,6 +106,8 @@ private:
 //    GET /api/material?matid={id}
 //    GET /api/shader?matid={id}&type=[glsl|spirv]&[glindex|vkindex|metalindex]={index}
 //    GET /api/active
+//    GET /api/profile?enable=[0|1]
+//    GET /api/stats?matid={id}
 //
 class RestRequestHandler : public CivetHandler {
 public:
@@ -182,6 +186,20 @@ public:
         }
 
         const size_t qlength = strlen(request->query_string);
+
+        if (uri == "/api/profile") {
+            char enable[2] = {};
+            if (mg_get_var(request->query_string, qlength, "enable", enable, sizeof(enable)) < 0) {
+                return error(__LINE__);
+            }
+            if (mServer->mProfileCallback) {
+                mServer->mProfileCallback(mServer->mProfileUser, enable[0] == '1');
+            }
+            mg_printf(conn, kSuccessHeader.c_str(), "application/json");
+            mg_printf(conn, "{}");
+            return true;
+        }
+
         char matid[9] = {};
         if (mg_get_var(request->query_string, qlength, "matid", matid, sizeof(matid)) < 0) {
             return error(__LINE__);
@@ -197,6 +215,21 @@ public:
             return error(__LINE__);
         }
 
+        if (uri == "/api/stats") {
+            MaterialVariantStats stats[VARIANT_COUNT];
+            size_t count = 0;
+            if (mServer->mStatsCallback) {
+                count = mServer->mStatsCallback(result->userdata, stats, VARIANT_COUNT);
+            }
+            JsonWriter writer;
+            if (!writer.writeStatsInfo(package, stats, count)) {
+                return error(__LINE__);
+            }
+            mg_printf(conn, kSuccessHeader.c_str(), "application/json");
+            mg_printf(conn, "%s", writer.getJsonString());
+            return true;
+        }
+
         if (uri == "/api/material") {
             JsonWriter writer;
             if (!writer.writeMaterialInfo(package)) {
@@ -20,7 +20,9 @@
 
 #include <backend/DriverEnums.h>
 
+#include <matdbg/DebugServer.h>
 #include <matdbg/JsonWriter.h>
+#include <matdbg/ShaderExtractor.h>
 #include <matdbg/ShaderInfo.h>
 
 #include "CommonWriter.h"
@@ -256,5 +258,56 @@ bool JsonWriter::writeActiveInfo(const filaflat::ChunkContainer& package,
     return true;
 }
 
+bool JsonWriter::writeStatsInfo(const filaflat::ChunkContainer& package,
+        const MaterialVariantStats* stats, size_t count) {
+    ostringstream json;
+    json << "{\"variants\": [\n";
+    for (size_t i = 0; i < count; i++) {
+        const auto& item = stats[i];
+        json
+            << "    {"
+            << "\"variant\": \"" << std::hex << int(item.variant) << std::dec << "\", "
+            << "\"variantString\": \"" << formatVariantString(item.variant) << "\", "
+            << "\"drawCount\": " << item.drawCount << ", "
+            << "\"triangleCount\": " << item.triangleCount << ", "
+            << "\"gpuTime\": " << item.gpuTime << " }"
+            << ((i == count - 1) ? "\n" : ",\n");
+    }
+    json << "],\n";
+
+    // Offline compilers aren't available here, SPIR-V is the closest to what the GPU runs.
+    json << "\"vulkan\": [\n";
+    vector<ShaderInfo> shaders(getShaderCount(package, ChunkType::MaterialSpirv));
+    if (!shaders.empty()) {
+        if (!getVkShaderInfo(package, shaders.data())) {
+            return false;
+        }
+        ShaderExtractor extractor(Backend::VULKAN, package.getData(), package.getSize());
+        if (!extractor.parse()) {
+            return false;
+        }
+        for (size_t i = 0; i < shaders.size(); i++) {
+            const auto& item = shaders[i];
+            filaflat::ShaderBuilder builder;
+            uint32_t instructionCount = 0;
+            uint32_t idBound = 0;
+            if (extractor.getShader(item.shaderModel, item.variant, item.pipelineStage, builder)) {
+                ShaderExtractor::getSpirvStats((const uint32_t*) builder.data(),
+                        builder.size() / 4, &instructionCount, &idBound);
+            }
+            json
+                << "    {"
+                << "\"index\": " << i << ", "
+                << "\"variant\": \"" << std::hex << int(item.variant) << std::dec << "\", "
+                << "\"instructionCount\": " << instructionCount << ", "
+                << "\"idBound\": " << idBound << " }"
+                << ((i == shaders.size() - 1) ? "\n" : ",\n");
+        }
+    }
+    json << "]}";
+    mJsonString = CString(json.str().c_str());
+    return true;
+}
+
 } // namespace matdbg
 } // namespace filament
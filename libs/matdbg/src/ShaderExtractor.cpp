@@ -123,5 +123,26 @@ CString ShaderExtractor::spirvToText(const uint32_t* begin, size_t wordCount) {
     return result;
 }
 
+bool ShaderExtractor::getSpirvStats(const uint32_t* begin, size_t wordCount,
+        uint32_t* instructionCount, uint32_t* idBound) {
+    // The header is made of the magic number, the version, the generator, the ID bound and a
+    // reserved word. Each instruction starts with its word count in the high 16 bits.
+    constexpr size_t kHeaderSize = 5;
+    if (wordCount < kHeaderSize || begin[0] != 0x07230203) {
+        return false;
+    }
+    uint32_t count = 0;
+    for (size_t i = kHeaderSize; i < wordCount; count++) {
+        const uint32_t instructionWordCount = begin[i] >> 16u;
+        if (instructionWordCount == 0) {
+            return false;
+        }
+        i += instructionWordCount;
+    }
+    *instructionCount = count;
+    *idBound = begin[3];
+    return true;
+}
+
 } // namespace matdbg
 } // namespace filament
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PerformanceCounters.h"
+
+#include <benchmark/benchmark.h>
+
+#include <math/simd.h>
+
+#include <vector>
+
+using namespace filament::math;
+
+static constexpr size_t COUNT = 1024;
+
+UTILS_NOINLINE
+static void init(std::vector<mat4f>& v) noexcept {
+    for (size_t i = 0; i < v.size(); i++) {
+        const float f = float(i + 1) / float(v.size() + 1);
+        v[i] = mat4f::translation(float3{ f, 2 * f, -f }) *
+               mat4f::rotation(f * F_PI, float3{ 0, 1, 1 }) *
+               mat4f::scaling(float3{ 1 + f });
+    }
+}
+
+struct Operator {
+    static const char* label() { return "operator"; }
+};
+struct Simd {
+    static const char* label() { return "simd"; }
+};
+
+template <typename T>
+static void BM_multiply(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<mat4f> data(COUNT);
+    std::vector<mat4f> res(COUNT);
+    init(data);
+    const mat4f lhs = data[COUNT / 2];
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::multiply(res.data(), lhs, data.data(), COUNT);
+            } else {
+                for (size_t i = 0; i < COUNT; i++) {
+                    res[i] = lhs * data[i];
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(res);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * COUNT);
+    }
+}
+
+template <typename T>
+static void BM_transform(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<mat4f> m(1);
+    std::vector<float4> data(COUNT);
+    std::vector<float4> res(COUNT);
+    init(m);
+    for (size_t i = 0; i < COUNT; i++) {
+        data[i] = float4{ float(i), -float(i), 0.5f * float(i), 1.0f };
+    }
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::transform(res.data(), m[0], data.data(), COUNT);
+            } else {
+                for (size_t i = 0; i < COUNT; i++) {
+                    res[i] = m[0] * data[i];
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(res);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * COUNT);
+    }
+}
+
+template <typename T>
+static void BM_rigidTransform(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<mat4f> m(COUNT);
+    std::vector<float3> centers(COUNT);
+    std::vector<float3> halfExtents(COUNT, float3{ 0.5f, 1.0f, 2.0f });
+    std::vector<float3> outCenters(COUNT);
+    std::vector<float3> outHalfExtents(COUNT);
+    init(m);
+    for (size_t i = 0; i < COUNT; i++) {
+        centers[i] = float3{ float(i), 1.0f, -float(i) };
+    }
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::rigidTransform(outCenters.data(), outHalfExtents.data(), m.data(),
+                        centers.data(), halfExtents.data(), COUNT);
+            } else {
+                for (size_t i = 0; i < COUNT; i++) {
+                    const mat3f u(m[i].upperLeft());
+                    outCenters[i] = u * centers[i] + m[i][3].xyz;
+                    outHalfExtents[i] = abs(u) * halfExtents[i];
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(outCenters);
+            benchmark::DoNotOptimize(outHalfExtents);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * COUNT);
+    }
+}
+
+template <typename T>
+static void BM_transformForNormals(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<mat4f> data(COUNT);
+    std::vector<mat3f> res(COUNT);
+    init(data);
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::getTransformForNormals(res.data(), data.data(), COUNT);
+            } else {
+                for (size_t i = 0; i < COUNT; i++) {
+                    res[i] = mat3f::getTransformForNormals(data[i].upperLeft());
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(res);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * COUNT);
+    }
+}
+
+template <typename T>
+static void BM_packHalf(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<float> data(COUNT * 4);
+    std::vector<half> res(COUNT * 4);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (float(i) / float(data.size())) * 2048.0f - 1024.0f;
+    }
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::packHalf(res.data(), data.data(), data.size());
+            } else {
+                for (size_t i = 0, c = data.size(); i < c; i++) {
+                    res[i] = half(data[i]);
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(res);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * data.size());
+    }
+}
+
+template <typename T>
+static void BM_packSnorm16(benchmark::State& state) noexcept {
+    state.SetLabel(T::label());
+    std::vector<float> data(COUNT * 4);
+    std::vector<int16_t> res(COUNT * 4);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (float(i) / float(data.size())) * 2.0f - 1.0f;
+    }
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            if (std::is_same<T, Simd>::value) {
+                simd::packSnorm16(res.data(), data.data(), data.size());
+            } else {
+                for (size_t i = 0, c = data.size(); i < c; i++) {
+                    res[i] = packSnorm16(data[i]);
+                }
+            }
+            benchmark::ClobberMemory();
+            benchmark::DoNotOptimize(res);
+        }
+        pc.stop();
+        state.SetItemsProcessed(state.iterations() * data.size());
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_multiply, Operator);
+BENCHMARK_TEMPLATE(BM_multiply, Simd);
+
+BENCHMARK_TEMPLATE(BM_transform, Operator);
+BENCHMARK_TEMPLATE(BM_transform, Simd);
+
+BENCHMARK_TEMPLATE(BM_rigidTransform, Operator);
+BENCHMARK_TEMPLATE(BM_rigidTransform, Simd);
+
+BENCHMARK_TEMPLATE(BM_transformForNormals, Operator);
+BENCHMARK_TEMPLATE(BM_transformForNormals, Simd);
+
+BENCHMARK_TEMPLATE(BM_packHalf, Operator);
+BENCHMARK_TEMPLATE(BM_packHalf, Simd);
+
+BENCHMARK_TEMPLATE(BM_packSnorm16, Operator);
+BENCHMARK_TEMPLATE(BM_packSnorm16, Simd);
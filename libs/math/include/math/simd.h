@@ -0,0 +1,536 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_MATH_SIMD_H
+#define TNT_MATH_SIMD_H
+
+#include <math/compiler.h>
+#include <math/half.h>
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/norm.h>
+#include <math/quat.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#   define MATH_SIMD_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define MATH_SIMD_SSE 1
+#endif
+
+/*
+ * Explicitly vectorized versions of the matrix operations and of the data packing found in hot
+ * loops, using NEON or SSE when available, and the regular operators otherwise. They produce the
+ * same results as the operators, up to floating point rounding.
+ *
+ * The array variants process 'count' elements, the inputs and outputs can't overlap.
+ */
+
+namespace filament {
+namespace math {
+namespace simd {
+
+namespace details {
+
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+
+#if defined(MATH_SIMD_NEON)
+
+using f32x4 = float32x4_t;
+
+inline f32x4 load(float const* p) noexcept { return vld1q_f32(p); }
+inline void store(float* p, f32x4 v) noexcept { vst1q_f32(p, v); }
+inline f32x4 splat(float f) noexcept { return vdupq_n_f32(f); }
+inline f32x4 mul(f32x4 a, f32x4 b) noexcept { return vmulq_f32(a, b); }
+inline f32x4 abs(f32x4 a) noexcept { return vabsq_f32(a); }
+inline f32x4 min(f32x4 a, f32x4 b) noexcept { return vminq_f32(a, b); }
+// a * b + c
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) noexcept {
+#if defined(__aarch64__)
+    return vfmaq_f32(c, a, b);
+#else
+    return vmlaq_f32(c, a, b);
+#endif
+}
+
+#else // MATH_SIMD_SSE
+
+using f32x4 = __m128;
+
+inline f32x4 load(float const* p) noexcept { return _mm_loadu_ps(p); }
+inline void store(float* p, f32x4 v) noexcept { _mm_storeu_ps(p, v); }
+inline f32x4 splat(float f) noexcept { return _mm_set1_ps(f); }
+inline f32x4 mul(f32x4 a, f32x4 b) noexcept { return _mm_mul_ps(a, b); }
+inline f32x4 abs(f32x4 a) noexcept { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+inline f32x4 min(f32x4 a, f32x4 b) noexcept { return _mm_min_ps(a, b); }
+// a * b + c
+inline f32x4 madd(f32x4 a, f32x4 b, f32x4 c) noexcept { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+
+#endif
+
+// the columns of a mat4f
+struct Columns {
+    f32x4 c0, c1, c2, c3;
+};
+
+inline Columns load(mat4f const& m) noexcept {
+    return { load(&m[0][0]), load(&m[1][0]), load(&m[2][0]), load(&m[3][0]) };
+}
+
+// m * v
+inline f32x4 transform(Columns const& m, float x, float y, float z, float w) noexcept {
+    f32x4 r = mul(m.c0, splat(x));
+    r = madd(m.c1, splat(y), r);
+    r = madd(m.c2, splat(z), r);
+    return madd(m.c3, splat(w), r);
+}
+
+// m * v, ignoring the 4th column of m
+inline f32x4 transform3(Columns const& m, float x, float y, float z) noexcept {
+    f32x4 r = mul(m.c0, splat(x));
+    r = madd(m.c1, splat(y), r);
+    return madd(m.c2, splat(z), r);
+}
+
+inline void store3(float3* p, f32x4 v) noexcept {
+    float tmp[4];
+    store(tmp, v);
+    *p = { tmp[0], tmp[1], tmp[2] };
+}
+
+#endif
+
+} // namespace details
+
+/**
+ * Returns lhs * rhs.
+ */
+inline mat4f MATH_PURE multiply(mat4f const& lhs, mat4f const& rhs) noexcept {
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const Columns l = load(lhs);
+    mat4f r;
+    for (size_t i = 0; i < 4; i++) {
+        store(&r[i][0], transform(l, rhs[i][0], rhs[i][1], rhs[i][2], rhs[i][3]));
+    }
+    return r;
+#else
+    return lhs * rhs;
+#endif
+}
+
+/**
+ * out[i] = lhs * rhs[i]
+ */
+inline void multiply(mat4f* out, mat4f const& lhs, mat4f const* rhs, size_t count) noexcept {
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const Columns l = load(lhs);
+    for (size_t j = 0; j < count; j++) {
+        mat4f const& m = rhs[j];
+        for (size_t i = 0; i < 4; i++) {
+            store(&out[j][i][0], transform(l, m[i][0], m[i][1], m[i][2], m[i][3]));
+        }
+    }
+#else
+    for (size_t j = 0; j < count; j++) {
+        out[j] = lhs * rhs[j];
+    }
+#endif
+}
+
+/**
+ * out[i] = m * in[i]
+ */
+inline void transform(float4* out, mat4f const& m, float4 const* in, size_t count) noexcept {
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const Columns c = load(m);
+    for (size_t i = 0; i < count; i++) {
+        store(&out[i][0], transform(c, in[i].x, in[i].y, in[i].z, in[i].w));
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        out[i] = m * in[i];
+    }
+#endif
+}
+
+/**
+ * out[i] = m * in[i], with the vectors given as separate x, y and z arrays (structure of arrays)
+ */
+inline void transform(float* outX, float* outY, float* outZ, mat3f const& m,
+        float const* x, float const* y, float const* z, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const f32x4 m00 = splat(m[0][0]), m01 = splat(m[0][1]), m02 = splat(m[0][2]);
+    const f32x4 m10 = splat(m[1][0]), m11 = splat(m[1][1]), m12 = splat(m[1][2]);
+    const f32x4 m20 = splat(m[2][0]), m21 = splat(m[2][1]), m22 = splat(m[2][2]);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        const f32x4 vx = load(x + i);
+        const f32x4 vy = load(y + i);
+        const f32x4 vz = load(z + i);
+        store(outX + i, madd(m20, vz, madd(m10, vy, mul(m00, vx))));
+        store(outY + i, madd(m21, vz, madd(m11, vy, mul(m01, vx))));
+        store(outZ + i, madd(m22, vz, madd(m12, vy, mul(m02, vx))));
+    }
+#endif
+    for (; i < count; i++) {
+        const float3 v = m * float3{ x[i], y[i], z[i] };
+        outX[i] = v.x;
+        outY[i] = v.y;
+        outZ[i] = v.z;
+    }
+}
+
+/**
+ * Transforms a box given by its center and half extent with a rigid transform, that is:
+ *   center = upperLeft(m) * center + m[3].xyz
+ *   halfExtent = abs(upperLeft(m)) * halfExtent
+ */
+inline void rigidTransform(float3& outCenter, float3& outHalfExtent,
+        mat4f const& m, float3 const& center, float3 const& halfExtent) noexcept {
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const Columns c = load(m);
+    const Columns a = { abs(c.c0), abs(c.c1), abs(c.c2), c.c3 };
+    store3(&outCenter, transform(c, center.x, center.y, center.z, 1.0f));
+    store3(&outHalfExtent, transform3(a, halfExtent.x, halfExtent.y, halfExtent.z));
+#else
+    const mat3f u(m.upperLeft());
+    outCenter = u * center + m[3].xyz;
+    outHalfExtent = abs(u) * halfExtent;
+#endif
+}
+
+/**
+ * Transforms 'count' boxes given by their centers and half extents with the rigid transform of
+ * the same index, see rigidTransform() above.
+ */
+inline void rigidTransform(float3* outCenters, float3* outHalfExtents, mat4f const* m,
+        float3 const* centers, float3 const* halfExtents, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        rigidTransform(outCenters[i], outHalfExtents[i], m[i], centers[i], halfExtents[i]);
+    }
+}
+
+/**
+ * Returns mat3f::getTransformForNormals(m.upperLeft()), i.e. the cofactor matrix of the upper
+ * left 3x3 of m.
+ */
+inline mat3f MATH_PURE getTransformForNormals(mat4f const& m) noexcept {
+#if defined(MATH_SIMD_SSE)
+    // the columns of the cofactor matrix are the cross products of the other two columns
+    auto yzx = [](__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1)); };
+    auto cross = [yzx](__m128 a, __m128 b) {
+        // (a * b.yzx - a.yzx * b).yzx
+        return yzx(_mm_sub_ps(_mm_mul_ps(a, yzx(b)), _mm_mul_ps(yzx(a), b)));
+    };
+    using namespace details;
+    const Columns c = load(m);
+    mat3f r;
+    store3(&r[0], cross(c.c1, c.c2));
+    store3(&r[1], cross(c.c2, c.c0));
+    store3(&r[2], cross(c.c0, c.c1));
+    return r;
+#else
+    // NEON has no cheap 3-lane shuffle, the compiler does as well with the scalar version
+    return mat3f::getTransformForNormals(m.upperLeft());
+#endif
+}
+
+/**
+ * out[i] = getTransformForNormals(in[i])
+ */
+inline void getTransformForNormals(mat3f* out, mat4f const* in, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = getTransformForNormals(in[i]);
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Arrays
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * out[i] += in[i] * weight
+ */
+inline void multiplyAccumulate(float* out, float const* in, float weight, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    const f32x4 w = splat(weight);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        store(out + i, madd(load(in + i), w, load(out + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] += in[i] * weight;
+    }
+}
+
+/**
+ * out[i] = min(out[i], in[i])
+ */
+inline void minimum(float* out, float const* in, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) || defined(MATH_SIMD_SSE)
+    using namespace details;
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        store(out + i, min(load(out + i), load(in + i)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = out[i] < in[i] ? out[i] : in[i];
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+// Packing
+// ------------------------------------------------------------------------------------------------
+
+/**
+ * out[i] = half(in[i])
+ */
+inline void packHalf(half* out, float const* in, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) && defined(__aarch64__)
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        vst1_u16((uint16_t*)(out + i), vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(in + i))));
+    }
+#elif defined(MATH_SIMD_SSE)
+    // same algorithm as fp<>::fromf(), without branches
+    const __m128i absMask = _mm_set1_epi32(0x7FFFFFFF);
+    const __m128i roundingMask = _mm_set1_epi32(~0xFFF);
+    const __m128i rounding = _mm_set1_epi32(0x1000);
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32(15 << 23));
+    const __m128i infinity = _mm_set1_epi32(31 << 23);
+    const __m128i fp32Infinity = _mm_set1_epi32(0x7F800000);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        const __m128i b = _mm_castps_si128(_mm_loadu_ps(in + i));
+        const __m128i a = _mm_and_si128(b, absMask);
+        __m128i r = _mm_add_epi32(_mm_and_si128(a, roundingMask), rounding);
+        r = _mm_castps_si128(_mm_mul_ps(_mm_castsi128_ps(r), magic));
+        const __m128i overflow = _mm_cmpgt_epi32(r, infinity);
+        r = _mm_or_si128(_mm_andnot_si128(overflow, r), _mm_and_si128(overflow, infinity));
+        r = _mm_srli_epi32(r, 13);
+        // inf and nan
+        const __m128i isInfNan = _mm_cmpgt_epi32(a, _mm_sub_epi32(fp32Infinity, _mm_set1_epi32(1)));
+        const __m128i isNan = _mm_cmpgt_epi32(a, fp32Infinity);
+        const __m128i special = _mm_or_si128(_mm_set1_epi32(0x7C00),
+                _mm_and_si128(isNan, _mm_set1_epi32(0x200)));
+        r = _mm_or_si128(_mm_andnot_si128(isInfNan, r), _mm_and_si128(isInfNan, special));
+        r = _mm_or_si128(r, _mm_srli_epi32(_mm_andnot_si128(absMask, b), 16));
+        // sign-extend so that the signed saturation of packs is a no-op
+        r = _mm_srai_epi32(_mm_slli_epi32(r, 16), 16);
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packs_epi32(r, r));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = half(in[i]);
+    }
+}
+
+/**
+ * out[i] = float(in[i])
+ */
+inline void unpackHalf(float* out, half const* in, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) && defined(__aarch64__)
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16((uint16_t const*)(in + i)))));
+    }
+#elif defined(MATH_SIMD_SSE)
+    // same algorithm as fp<>::tof()
+    const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((0xFE - 15) << 23));
+    const __m128 infnan = _mm_castsi128_ps(_mm_set1_epi32((0x80 + 15) << 23));
+    const __m128i expMask = _mm_set1_epi32(0xFF << 23);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        const __m128i h = _mm_unpacklo_epi16(
+                _mm_loadl_epi64((__m128i const*)(in + i)), _mm_setzero_si128());
+        const __m128i a = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x7FFF)), 13);
+        __m128 r = _mm_mul_ps(_mm_castsi128_ps(a), magic);
+        r = _mm_or_ps(r, _mm_and_ps(_mm_cmpge_ps(r, infnan), _mm_castsi128_ps(expMask)));
+        const __m128i sign = _mm_slli_epi32(_mm_and_si128(h, _mm_set1_epi32(0x8000)), 16);
+        _mm_storeu_ps(out + i, _mm_or_ps(r, _mm_castsi128_ps(sign)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = float(in[i]);
+    }
+}
+
+/**
+ * out[i] = packSnorm16(in[i]), the vectorized versions round ties to even.
+ */
+inline void packSnorm16(int16_t* out, float const* in, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) && defined(__aarch64__)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t minusOne = vdupq_n_f32(-1.0f);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        const float32x4_t v = vminq_f32(vmaxq_f32(vld1q_f32(in + i), minusOne), one);
+        vst1_s16(out + i, vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v, 32767.0f))));
+    }
+#elif defined(MATH_SIMD_SSE)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 scale = _mm_set1_ps(32767.0f);
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        const __m128 v = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), minusOne), one);
+        const __m128i r = _mm_cvtps_epi32(_mm_mul_ps(v, scale));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packs_epi32(r, r));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = math::packSnorm16(in[i]);
+    }
+}
+
+/**
+ * out[i] = packSnorm8(in[i]), the vectorized versions round ties to even.
+ */
+inline void packSnorm8(int8_t* out, float const* in, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON) && defined(__aarch64__)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t minusOne = vdupq_n_f32(-1.0f);
+    for (size_t n = count & ~size_t(7); i < n; i += 8) {
+        const float32x4_t v0 = vminq_f32(vmaxq_f32(vld1q_f32(in + i), minusOne), one);
+        const float32x4_t v1 = vminq_f32(vmaxq_f32(vld1q_f32(in + i + 4), minusOne), one);
+        const int16x4_t r0 = vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v0, 127.0f)));
+        const int16x4_t r1 = vqmovn_s32(vcvtnq_s32_f32(vmulq_n_f32(v1, 127.0f)));
+        vst1_s8(out + i, vqmovn_s16(vcombine_s16(r0, r1)));
+    }
+#elif defined(MATH_SIMD_SSE)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 scale = _mm_set1_ps(127.0f);
+    for (size_t n = count & ~size_t(7); i < n; i += 8) {
+        const __m128 v0 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i), minusOne), one);
+        const __m128 v1 = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(in + i + 4), minusOne), one);
+        const __m128i r = _mm_packs_epi32(
+                _mm_cvtps_epi32(_mm_mul_ps(v0, scale)), _mm_cvtps_epi32(_mm_mul_ps(v1, scale)));
+        _mm_storel_epi64((__m128i*)(out + i), _mm_packs_epi16(r, r));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = math::packSnorm8(in[i]);
+    }
+}
+
+/**
+ * Expands 'count' pixels of 3 interleaved 8-bit components to 4 components, the 4th one is set
+ * to 'alpha', e.g. RGB8 to RGBA8.
+ */
+inline void expand3to4(uint8_t* out, uint8_t const* in, uint8_t alpha, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON)
+    const uint8x16_t a = vdupq_n_u8(alpha);
+    for (size_t n = count & ~size_t(15); i < n; i += 16) {
+        const uint8x16x3_t rgb = vld3q_u8(in + i * 3);
+        const uint8x16x4_t rgba = {{ rgb.val[0], rgb.val[1], rgb.val[2], a }};
+        vst4q_u8(out + i * 4, rgba);
+    }
+#elif defined(MATH_SIMD_SSE)
+    // SSE2 has no byte shuffle, so 4 pixels are moved at once within 32-bit words (x86 is
+    // little-endian)
+    const uint32_t a = uint32_t(alpha) << 24;
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        uint32_t w[3];
+        memcpy(w, in + i * 3, sizeof(w));
+        const uint32_t rgba[4] = {
+                (w[0] & 0xFFFFFFu) | a,
+                (w[0] >> 24) | ((w[1] & 0xFFFFu) << 8) | a,
+                (w[1] >> 16) | ((w[2] & 0xFFu) << 16) | a,
+                (w[2] >> 8) | a };
+        memcpy(out + i * 4, rgba, sizeof(rgba));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i * 4 + 0] = in[i * 3 + 0];
+        out[i * 4 + 1] = in[i * 3 + 1];
+        out[i * 4 + 2] = in[i * 3 + 2];
+        out[i * 4 + 3] = alpha;
+    }
+}
+
+/**
+ * Expands 'count' pixels of 3 interleaved 16-bit components to 4 components, the 4th one is set
+ * to 'alpha', e.g. RGB16F to RGBA16F.
+ */
+inline void expand3to4(uint16_t* out, uint16_t const* in, uint16_t alpha, size_t count) noexcept {
+    size_t i = 0;
+#if defined(MATH_SIMD_NEON)
+    const uint16x8_t a = vdupq_n_u16(alpha);
+    for (size_t n = count & ~size_t(7); i < n; i += 8) {
+        const uint16x8x3_t rgb = vld3q_u16(in + i * 3);
+        const uint16x8x4_t rgba = {{ rgb.val[0], rgb.val[1], rgb.val[2], a }};
+        vst4q_u16(out + i * 4, rgba);
+    }
+#elif defined(MATH_SIMD_SSE)
+    // same as above, with 64-bit words
+    const uint64_t a = uint64_t(alpha) << 48;
+    for (size_t n = count & ~size_t(3); i < n; i += 4) {
+        uint64_t w[3];
+        memcpy(w, in + i * 3, sizeof(w));
+        const uint64_t rgba[4] = {
+                (w[0] & 0xFFFFFFFFFFFFu) | a,
+                (w[0] >> 48) | ((w[1] & 0xFFFFFFFFu) << 16) | a,
+                (w[1] >> 32) | ((w[2] & 0xFFFFu) << 32) | a,
+                (w[2] >> 16) | a };
+        memcpy(out + i * 4, rgba, sizeof(rgba));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i * 4 + 0] = in[i * 3 + 0];
+        out[i * 4 + 1] = in[i * 3 + 1];
+        out[i * 4 + 2] = in[i * 3 + 2];
+        out[i * 4 + 3] = alpha;
+    }
+}
+
+/**
+ * Packs tangent frame quaternions to snorm16, out[i] = packSnorm16(in[i].xyzw)
+ */
+inline void packSnorm16(short4* out, quatf const* in, size_t count) noexcept {
+    static_assert(sizeof(short4) == 4 * sizeof(int16_t), "short4 must be tightly packed");
+    static_assert(sizeof(quatf) == 4 * sizeof(float), "quatf must be tightly packed");
+    packSnorm16(reinterpret_cast<int16_t*>(out), reinterpret_cast<float const*>(in), count * 4);
+}
+
+/**
+ * Packs tangent frame quaternions to half floats, out[i] = quath(in[i])
+ */
+inline void packHalf(quath* out, quatf const* in, size_t count) noexcept {
+    static_assert(sizeof(quath) == 4 * sizeof(half), "quath must be tightly packed");
+    static_assert(sizeof(quatf) == 4 * sizeof(float), "quatf must be tightly packed");
+    packHalf(reinterpret_cast<half*>(out), reinterpret_cast<float const*>(in), count * 4);
+}
+
+} // namespace simd
+} // namespace math
+} // namespace filament
+
+#endif // TNT_MATH_SIMD_H
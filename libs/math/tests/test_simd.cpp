@@ -0,0 +1,230 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <math/simd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace filament::math;
+
+static const mat4f A(
+        1.0f, -2.0f, 3.0f, 0.0f,
+        0.5f, 4.0f, -1.0f, 0.0f,
+        -3.0f, 0.25f, 2.0f, 0.0f,
+        10.0f, -20.0f, 30.0f, 1.0f);
+
+static const mat4f B = mat4f::translation(float3{ 1, 2, 3 }) *
+        mat4f::rotation(0.7f, float3{ 1, 1, 0 }) *
+        mat4f::scaling(float3{ 2, -1, 0.5f });
+
+static void expectNear(mat4f const& expected, mat4f const& actual) {
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            EXPECT_NEAR(expected[i][j], actual[i][j], 1e-4f);
+        }
+    }
+}
+
+static void expectNear(float3 const& expected, float3 const& actual) {
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_NEAR(expected[i], actual[i], 1e-4f);
+    }
+}
+
+TEST(SimdTest, Multiply) {
+    expectNear(A * B, simd::multiply(A, B));
+    expectNear(B * A, simd::multiply(B, A));
+
+    mat4f in[3] = { A, B, mat4f{} };
+    mat4f out[3];
+    simd::multiply(out, B, in, 3);
+    for (size_t i = 0; i < 3; i++) {
+        expectNear(B * in[i], out[i]);
+    }
+}
+
+TEST(SimdTest, Transform) {
+    float4 in[3] = { { 1, 2, 3, 1 }, { -1, 0.5f, 4, 0 }, { 0, 0, 0, 1 } };
+    float4 out[3];
+    simd::transform(out, A, in, 3);
+    for (size_t i = 0; i < 3; i++) {
+        float4 const expected = A * in[i];
+        for (size_t j = 0; j < 4; j++) {
+            EXPECT_NEAR(expected[j], out[i][j], 1e-4f);
+        }
+    }
+}
+
+TEST(SimdTest, TransformArrays) {
+    // an odd count exercises the scalar tail
+    const mat3f m = A.upperLeft();
+    std::vector<float> x(13), y(13), z(13);
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = float(i) * 0.5f - 2.0f;
+        y[i] = 1.0f - float(i) * 0.25f;
+        z[i] = float(i % 3) - 1.0f;
+    }
+    std::vector<float> ox(x.size()), oy(x.size()), oz(x.size());
+    simd::transform(ox.data(), oy.data(), oz.data(), m, x.data(), y.data(), z.data(), x.size());
+    for (size_t i = 0; i < x.size(); i++) {
+        expectNear(m * float3{ x[i], y[i], z[i] }, float3{ ox[i], oy[i], oz[i] });
+    }
+}
+
+TEST(SimdTest, RigidTransform) {
+    mat4f m[2] = { A, B };
+    float3 centers[2] = { { 1, 2, 3 }, { -4, 0, 1 } };
+    float3 halfExtents[2] = { { 0.5f, 1, 2 }, { 3, 3, 0.25f } };
+    float3 outCenters[2];
+    float3 outHalfExtents[2];
+    simd::rigidTransform(outCenters, outHalfExtents, m, centers, halfExtents, 2);
+    for (size_t i = 0; i < 2; i++) {
+        const mat3f u(m[i].upperLeft());
+        expectNear(u * centers[i] + m[i][3].xyz, outCenters[i]);
+        expectNear(abs(u) * halfExtents[i], outHalfExtents[i]);
+    }
+}
+
+TEST(SimdTest, TransformForNormals) {
+    mat4f in[2] = { A, B };
+    mat3f out[2];
+    simd::getTransformForNormals(out, in, 2);
+    for (size_t i = 0; i < 2; i++) {
+        const mat3f expected = mat3f::getTransformForNormals(in[i].upperLeft());
+        for (size_t j = 0; j < 3; j++) {
+            expectNear(expected[j], out[i][j]);
+        }
+    }
+}
+
+TEST(SimdTest, Arrays) {
+    // an odd count exercises the scalar tail
+    std::vector<float> in(37);
+    std::vector<float> acc(in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        in[i] = float(i) * 0.25f - 3.0f;
+        acc[i] = 1.0f - float(i) * 0.5f;
+    }
+
+    std::vector<float> out(acc);
+    simd::multiplyAccumulate(out.data(), in.data(), 0.3f, in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_NEAR(acc[i] + in[i] * 0.3f, out[i], 1e-6f);
+    }
+
+    out = acc;
+    simd::minimum(out.data(), in.data(), in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_EQ(std::min(acc[i], in[i]), out[i]);
+    }
+}
+
+TEST(SimdTest, Half) {
+    std::vector<float> in;
+    for (float f = 1e-8f; f < 1e6f; f *= 1.37f) {
+        in.push_back(f);
+        in.push_back(-f);
+    }
+    in.push_back(0.0f);
+    in.push_back(-0.0f);
+    in.push_back(65504.0f);
+    in.push_back(65520.0f);
+    in.push_back(std::numeric_limits<float>::infinity());
+    in.push_back(-std::numeric_limits<float>::infinity());
+    in.push_back(std::numeric_limits<float>::quiet_NaN());
+
+    std::vector<half> out(in.size());
+    simd::packHalf(out.data(), in.data(), in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_EQ(getBits(half(in[i])), getBits(out[i])) << in[i];
+    }
+
+    std::vector<float> back(in.size());
+    simd::unpackHalf(back.data(), out.data(), out.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        const float expected = float(out[i]);
+        if (std::isnan(expected)) {
+            EXPECT_TRUE(std::isnan(back[i]));
+        } else {
+            EXPECT_EQ(expected, back[i]) << in[i];
+        }
+    }
+}
+
+TEST(SimdTest, Snorm) {
+    std::vector<float> in;
+    for (int i = -1100; i <= 1100; i += 3) {
+        in.push_back(float(i) / 1013.0f);
+    }
+
+    std::vector<int16_t> out16(in.size());
+    simd::packSnorm16(out16.data(), in.data(), in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_NEAR(packSnorm16(in[i]), out16[i], 1) << in[i];
+    }
+
+    std::vector<int8_t> out8(in.size());
+    simd::packSnorm8(out8.data(), in.data(), in.size());
+    for (size_t i = 0; i < in.size(); i++) {
+        EXPECT_NEAR(packSnorm8(in[i]), out8[i], 1) << in[i];
+    }
+}
+
+TEST(SimdTest, Quaternions) {
+    const quatf in[3] = {
+            normalize(quatf{ 1, 2, 3, 4 }), normalize(quatf{ -1, 0.5f, 0, 2 }), quatf{ 1 } };
+
+    short4 out16[3];
+    simd::packSnorm16(out16, in, 3);
+    quath outh[3];
+    simd::packHalf(outh, in, 3);
+    for (size_t i = 0; i < 3; i++) {
+        const short4 expected = packSnorm16(in[i].xyzw);
+        for (size_t j = 0; j < 4; j++) {
+            EXPECT_NEAR(expected[j], out16[i][j], 1);
+            EXPECT_EQ(getBits(quath(in[i])[j]), getBits(outh[i][j]));
+        }
+    }
+}
+
+TEST(SimdTest, Expand3to4) {
+    // 37 pixels covers the vectorized loops and their remainders
+    const size_t count = 37;
+    std::vector<uint8_t> in8(count * 3);
+    std::vector<uint16_t> in16(count * 3);
+    for (size_t i = 0; i < count * 3; i++) {
+        in8[i] = uint8_t(i * 7 + 1);
+        in16[i] = uint16_t(i * 1031 + 3);
+    }
+
+    std::vector<uint8_t> out8(count * 4);
+    simd::expand3to4(out8.data(), in8.data(), uint8_t(0xFF), count);
+    std::vector<uint16_t> out16(count * 4);
+    simd::expand3to4(out16.data(), in16.data(), uint16_t(0x3C00), count);
+    for (size_t i = 0; i < count; i++) {
+        for (size_t c = 0; c < 3; c++) {
+            EXPECT_EQ(in8[i * 3 + c], out8[i * 4 + c]) << i;
+            EXPECT_EQ(in16[i * 3 + c], out16[i * 4 + c]) << i;
+        }
+        EXPECT_EQ(0xFF, out8[i * 4 + 3]) << i;
+        EXPECT_EQ(0x3C00, out16[i * 4 + 3]) << i;
+    }
+}
@@ -21,6 +21,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <math.h>
+
 using namespace utils;
 
 
@@ -78,7 +80,57 @@ static void BM_JobSystemParallelFor(benchmark::State& state) {
     js.emancipate();
 }
 
+// some work for each item of a loop
+static void items(uint32_t start, uint32_t count) {
+    for (uint32_t i = start, e = start + count; i < e; i++) {
+        float v = float(i);
+        for (size_t j = 0; j < 16; j++) {
+            v = sqrtf(v + 1.0f);
+        }
+        benchmark::DoNotOptimize(v);
+    }
+}
+
+static void BM_JobSystemParallelForCountSplitter(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const uint32_t count = uint32_t(state.range(0));
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto job = jobs::parallel_for(js, nullptr, 0, count, &items,
+                    jobs::CountSplitter<16, 8>());
+            js.runAndWait(job);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * count);
+
+    js.emancipate();
+}
+
+static void BM_JobSystemParallelForAdaptiveSplitter(benchmark::State& state) {
+    JobSystem js;
+    js.adopt();
+
+    const uint32_t count = uint32_t(state.range(0));
+    jobs::AdaptiveSplitter<16, 8>::Cost cost;
+    {
+        PerformanceCounters pc(state);
+        for (auto _ : state) {
+            auto job = jobs::parallel_for(js, nullptr, 0, count, &items,
+                    jobs::AdaptiveSplitter<16, 8>(js, cost));
+            js.runAndWait(job);
+        }
+    }
+    state.SetItemsProcessed((int64_t)state.iterations() * count);
+
+    js.emancipate();
+}
+
 
 BENCHMARK(BM_JobSystem);
 BENCHMARK(BM_JobSystemAsChildren4k);
 BENCHMARK(BM_JobSystemParallelFor);
+BENCHMARK(BM_JobSystemParallelForCountSplitter)->Arg(64)->Arg(4096)->Arg(262144);
+BENCHMARK(BM_JobSystemParallelForAdaptiveSplitter)->Arg(64)->Arg(4096)->Arg(262144);
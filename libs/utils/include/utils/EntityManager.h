@@ -87,6 +87,18 @@ public:
     // unregisters a listener.
     void unregisterListener(Listener* l) noexcept;
 
+    // position of a reader in the list of destroyed entities
+    using DestroyedCursor = uint64_t;
+
+    // Copies up to 'count' of the entities destroyed since 'cursor' into 'entities', and advances
+    // 'cursor' past them. Returns the number of entities copied, 0 once they've all been read.
+    // Only the most recently destroyed entities are kept, 'lost' is set to true if some were
+    // dropped before being read, in which case the caller must check its entities with
+    // isAlive(). This allows component managers to garbage collect their components
+    // incrementally. Thread safe.
+    size_t readDestroyedEntities(DestroyedCursor& cursor, Entity* entities, size_t count,
+            bool& lost) const noexcept;
+
 
     /* no user serviceable parts below */
 
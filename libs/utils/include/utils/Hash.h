@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <string.h>
 
 namespace utils {
 namespace hash {
@@ -46,6 +47,32 @@ inline uint32_t murmur3(const uint32_t* key, size_t wordCount, uint32_t seed) no
     return h;
 }
 
+// 64-bit FNV-1a hash of 'size' bytes. 'seed' can be the hash of previous data, to hash data
+// made of several pieces.
+inline uint64_t fnv1a64(const void* data, size_t size,
+        uint64_t seed = 0xcbf29ce484222325u) noexcept {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ bytes[i]) * 0x100000001b3u;
+    }
+    return h;
+}
+
+// Hash of 'wordCount' 64-bit words, with one multiply per word. It's cheaper than murmur3 but
+// mixes less, which is fine for the small POD keys of hash maps that compare their keys anyway.
+inline uint32_t fold64(const void* key, size_t wordCount, uint64_t seed = 0) noexcept {
+    const uint8_t* bytes = static_cast<const uint8_t*>(key);
+    uint64_t h = seed;
+    for (size_t i = 0; i < wordCount; i++, bytes += 8) {
+        uint64_t k;
+        memcpy(&k, bytes, 8); // the keys can be packed
+        h = (h ^ k) * 0x9e3779b97f4a7c15u;
+        h ^= h >> 32u;
+    }
+    return uint32_t(h ^ (h >> 29u));
+}
+
 template<typename T>
 struct MurmurHashFn {
     uint32_t operator()(const T& key) const noexcept {
@@ -54,6 +81,14 @@ struct MurmurHashFn {
     }
 };
 
+template<typename T>
+struct Fold64HashFn {
+    uint32_t operator()(const T& key) const noexcept {
+        static_assert(0 == (sizeof(key) & 7u), "Hashing requires a size that is a multiple of 8.");
+        return fold64(&key, sizeof(key) / 8);
+    }
+};
+
 // combines two hashes together
 template<class T>
 inline void combine(size_t& seed, const T& v) noexcept {
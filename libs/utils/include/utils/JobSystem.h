@@ -20,7 +20,10 @@
 #include <assert.h>
 
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <initializer_list>
+#include <memory>
 #include <thread>
 #include <vector>
 
@@ -39,7 +42,10 @@
 namespace utils {
 
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
+    // The job pool starts with INITIAL_JOB_COUNT jobs and grows up to MAX_JOB_COUNT jobs when
+    // they are all in use, the memory of the jobs that are never used is never touched.
+    static constexpr size_t INITIAL_JOB_COUNT = 4096;
+    static constexpr size_t MAX_JOB_COUNT = 16384;
     static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
     using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
 
@@ -72,7 +78,8 @@ public:
         uint16_t parent;                                        //  2 |  2
         std::atomic<uint16_t> runningJobCount = { 1 };          //  2 |  2
         mutable std::atomic<uint16_t> refCount = { 1 };         //  2 |  2
-                                                                //  6 |  2 (padding)
+        std::atomic<uint16_t> continuation = { 0x7FFF };        //  2 |  2
+                                                                //  4 |  0 (padding)
                                                                 // 64 | 64
     };
 
@@ -250,13 +257,17 @@ public:
      * Add job to this thread's execution queue. It's reference will drop automatically.
      * Current thread must be owned by JobSystem's thread pool. See adopt().
      *
+     * BACKGROUND jobs, e.g. decoding textures, only start once no other job is waiting to run,
+     * and threads waiting on a job don't pick them unless they run a background job themselves.
+     * The flag only applies to the given job, not to the jobs it creates.
+     *
      * The job can't be used after this call.
      */
-    enum runFlags { DONT_SIGNAL = 0x1 };
+    enum runFlags { DONT_SIGNAL = 0x1, BACKGROUND = 0x2 };
     void run(Job*& job, uint32_t flags = 0) noexcept;
     void run(Job*&& job, uint32_t flags = 0) noexcept { // allows run(createJob(...));
         Job* p = job;
-        run(p);
+        run(p, flags);
     }
 
     void signal() noexcept;
@@ -269,6 +280,25 @@ public:
      */
     Job* runAndRetain(Job* job, uint32_t flags = 0) noexcept;
 
+    /*
+     * Add job to the execution queue once all its dependencies have finished, without blocking
+     * the calling thread. This allows expressing a graph of jobs rather than waiting at sync
+     * points, e.g.: runAfter(b, { a, c }) runs b once a and c have finished.
+     *
+     * The dependencies must be retained or not run yet, they can be released right after this
+     * call. Use retain() first to wait on the job later.
+     * Current thread must be owned by JobSystem's thread pool. See adopt().
+     *
+     * The job can't be used after this call.
+     */
+    void runAfter(Job*& job, std::initializer_list<Job*> dependencies,
+            uint32_t flags = 0) noexcept;
+    void runAfter(Job*&& job, std::initializer_list<Job*> dependencies,
+            uint32_t flags = 0) noexcept { // allows runAfter(createJob(...), ...);
+        Job* p = job;
+        runAfter(p, dependencies, flags);
+    }
+
     /*
      * Wait on a job and destroys it.
      * Current thread must be owned by JobSystem's thread pool. See adopt().
@@ -291,6 +321,59 @@ public:
         runAndWait(p);
     }
 
+    using ScratchArena = Arena<LinearAllocator, LockingPolicy::NoLock>;
+    static constexpr size_t SCRATCH_ARENA_SIZE = 256 * 1024;
+
+    /*
+     * Returns the scratch arena of the calling thread, from which jobs can allocate temporary
+     * memory without locks nor heap allocations. Its memory is freed all at once after
+     * resetScratchArenas() is called, typically once per frame, or by rewinding it, e.g. with an
+     * ArenaScope. Each thread has an arena of SCRATCH_ARENA_SIZE bytes, created the first time
+     * it is used, allocations fail once it is full.
+     * Current thread must be owned by JobSystem's thread pool. See adopt().
+     */
+    ScratchArena& getScratchArena() noexcept;
+
+    /*
+     * Frees the memory of the scratch arenas. The arena of the calling thread is reset
+     * immediately, so it must not be in use. The arena of each thread of the pool is reset by
+     * the thread itself, before it runs its next job, so jobs still running, like background
+     * jobs started during an earlier frame, keep their memory. The arenas of the other adopted
+     * threads are reset when they call this.
+     */
+    void resetScratchArenas() noexcept;
+
+    /*
+     * Statistics of a thread of the pool or of an adopted thread, collected while enabled with
+     * setStatisticsEnabled(). Collecting them adds a few atomic stores and two clock reads to
+     * each job.
+     */
+    struct Statistics {
+        // a job that ran for d microseconds is counted in bucket min(log2(d) + 1, 15), bucket 0
+        // counts the jobs that ran for less than a microsecond.
+        static constexpr size_t DURATION_BUCKET_COUNT = 16;
+
+        uint32_t executedJobs = 0;  // jobs run by the thread
+        uint32_t stolenJobs = 0;    // jobs run by the thread that were queued by another thread
+        uint32_t failedSteals = 0;  // attempts to steal a job that found none
+        uint32_t sleeps = 0;        // times the thread waited for a job
+        uint64_t sleepNanoseconds = 0;
+        uint32_t durations[DURATION_BUCKET_COUNT] = {};
+    };
+
+    // Enables or disables collecting statistics, they are disabled by default.
+    void setStatisticsEnabled(bool enabled) noexcept {
+        mStatisticsEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Returns the number of threads with statistics and copies up to count of them to
+    // statistics, which can be null. The threads of the pool come first, followed by the
+    // adopted threads. The values are collected since the last reset.
+    size_t getStatistics(Statistics* statistics, size_t count) const noexcept;
+
+    // Resets the statistics of all threads.
+    void resetStatistics() noexcept;
+
     // for debugging
     friend utils::io::ostream& operator << (utils::io::ostream& out, JobSystem const& js);
 
@@ -309,10 +392,24 @@ public:
     static void setThreadPriority(Priority priority) noexcept;
     static void setThreadAffinityById(size_t id) noexcept;
 
+    // Returns the ids of the CPUs, fastest first. On big.LITTLE SoCs the big cores come first,
+    // otherwise the ids are in increasing order.
+    static std::vector<uint16_t> getCpusByCapacity() noexcept;
+
     size_t getParallelSplitCount() const noexcept {
         return mParallelSplitCount;
     }
 
+    // number of threads in the pool, not counting the adopted threads
+    size_t getThreadCount() const noexcept {
+        return mThreadCount;
+    }
+
+    // number of jobs that haven't been picked by a thread yet, this is only an estimate
+    size_t getQueuedJobCount() const noexcept {
+        return mActiveJobs.load(std::memory_order_relaxed);
+    }
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -330,6 +427,7 @@ private:
     struct alignas(CACHELINE_SIZE) ThreadState {    // this causes 40-bytes padding
         // make sure storage is cache-line aligned
         WorkQueue workQueue;
+        WorkQueue backgroundQueue;
 
         // these are not accessed by the worker threads
         alignas(CACHELINE_SIZE)     // this causes 56-bytes padding
@@ -337,6 +435,20 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t id;
+        uint16_t cpu;               // CPU the thread is pinned to
+        uint16_t backgroundDepth;   // number of background jobs being run by the thread
+        std::unique_ptr<ScratchArena> scratchArena; // created when first used
+        uint32_t scratchEpoch;      // value of mScratchEpoch when scratchArena was last reset
+
+        // only written by the thread, see Statistics
+        struct {
+            std::atomic<uint32_t> executedJobs;
+            std::atomic<uint32_t> stolenJobs;
+            std::atomic<uint32_t> failedSteals;
+            std::atomic<uint32_t> sleeps;
+            std::atomic<uint64_t> sleepNanoseconds;
+            std::atomic<uint32_t> durations[Statistics::DURATION_BUCKET_COUNT];
+        } stats;
     };
 
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
@@ -348,17 +460,21 @@ private:
     void decRef(Job const* job) noexcept;
 
     Job* allocateJob() noexcept;
+    void* growJobPool() noexcept;
     JobSystem::ThreadState* getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
 
     void requestExit() noexcept;
     bool exitRequested() const noexcept;
     bool hasActiveJobs() const noexcept;
+    bool hasActiveForegroundJobs() const noexcept;
 
     void loop(ThreadState* state) noexcept;
-    bool execute(JobSystem::ThreadState& state) noexcept;
-    Job* steal(JobSystem::ThreadState& state) noexcept;
+    bool execute(JobSystem::ThreadState& state, bool background) noexcept;
+    Job* steal(JobSystem::ThreadState& state, bool background, bool* isBackground) noexcept;
     void finish(Job* job) noexcept;
+    void releaseDependency(Job* gate) noexcept;
+    void notifyContinuations(Job* job) noexcept;
 
     void put(WorkQueue& workQueue, Job* job) noexcept {
         size_t index = job - mJobStorageBase;
@@ -378,7 +494,7 @@ private:
         return !index ? nullptr : &mJobStorageBase[index - 1];
     }
 
-    void wait(std::unique_lock<Mutex>& lock) noexcept;
+    void wait(std::unique_lock<Mutex>& lock, ThreadState& state) noexcept;
     void wake() noexcept;
 
     // these have thread contention, keep them together
@@ -387,7 +503,12 @@ private:
     uint32_t mWaiterCount = 0;
 
     std::atomic<uint32_t> mActiveJobs = { 0 };
-    utils::Arena<utils::ThreadSafeObjectPoolAllocator<Job>, LockingPolicy::NoLock> mJobPool;
+    std::atomic<uint32_t> mActiveBackgroundJobs = { 0 };
+    std::atomic<uint32_t> mScratchEpoch = { 0 };         // incremented by resetScratchArenas()
+    utils::HeapArea mJobStorage;                        // room for MAX_JOB_COUNT jobs
+    utils::ThreadSafeObjectPoolAllocator<Job> mJobPool;
+    utils::Mutex mJobPoolLock;
+    size_t mJobPoolCount = INITIAL_JOB_COUNT;           // jobs added to the pool so far
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -401,6 +522,7 @@ private:
     alignas(16) // at least we align to half (or quarter) cache-line
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { false };       // this one is almost never written
+    std::atomic<bool> mStatisticsEnabled = { false };   // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
     Job* const mJobStorageBase;                         // Base for conversion to indices
     uint16_t mThreadCount = 0;                          // total # of threads in the pool
@@ -452,6 +574,19 @@ JobSystem::Job* createJob(JobSystem& js, JobSystem::Job* parent,
 
 namespace details {
 
+// Runs a chunk of a parallel_for through the splitter when it measures the chunks, see
+// AdaptiveSplitter.
+template<typename S, typename F>
+inline auto execute(S const& splitter, F& functor, uint32_t start, uint32_t count, int) noexcept
+        -> decltype(splitter.execute(functor, start, count)) {
+    return splitter.execute(functor, start, count);
+}
+
+template<typename S, typename F>
+inline void execute(S const&, F& functor, uint32_t start, uint32_t count, long) noexcept {
+    functor(start, count);
+}
+
 template<typename S, typename F>
 struct ParallelForJobData {
     using SplitterType = S;
@@ -508,7 +643,7 @@ struct ParallelForJobData {
         } else {
 execute:
             // we're done splitting, do the real work here!
-            functor(start, count);
+            details::execute(splitter, functor, start, count, 0);
         }
     }
 
@@ -526,6 +661,7 @@ private:
         // then linearly create all jobs with number of elements required by the splitter
         JobSystem::Job* job = nullptr;
         auto& func = functor;
+        auto& split = splitter;
         size_type const first = start;
         size_type const end = first + count;
         size_type curr = first;
@@ -534,9 +670,10 @@ private:
             // this creates jobs from the end of the buffer because the WorkStealingDequeue
             // is a LIFO, this could help streaming to the d-cache.
             const size_type pos = end - (curr - first) - c;
-            job = js.createJob(parent, [func, pos, c](JobSystem&, JobSystem::Job*) {
-                func(pos, c);
-            });
+            job = js.createJob(parent,
+                    [func, split, pos, c](JobSystem&, JobSystem::Job*) mutable {
+                        details::execute(split, func, pos, c, 0);
+                    });
             if (UTILS_UNLIKELY(!job)) {
                 goto finish; // oops, no more job available
             }
@@ -547,7 +684,7 @@ private:
         assert(end >= curr);
         assert(end - curr >= c);
         js.signal();
-        functor(start, end - curr);
+        details::execute(splitter, functor, start, end - curr, 0);
     }
 
     size_type start;            // 4
@@ -597,6 +734,63 @@ public:
     }
 };
 
+// The measured cost of the items of a loop, see AdaptiveSplitter.
+struct SplitterCost {
+    std::atomic<float> nanosecondsPerItem = { 0.0f };  // 0 until measured
+};
+
+/*
+ * A splitter that sizes the chunks from the measured cost of the items, so that a chunk is never
+ * too short to be worth a job, and that only splits while some threads could pick up the other
+ * half, in the spirit of lazy binary splitting.
+ *
+ * The cost is measured by the chunks of a loop and kept in a Cost, which should be shared by all
+ * the invocations of the same loop and live as long as the object that runs it, e.g.:
+ *
+ *   AdaptiveSplitter<16>::Cost mCost;  // member of the object that runs the loop
+ *   parallel_for(js, nullptr, 0, count, std::cref(work), AdaptiveSplitter<16>(js, mCost));
+ */
+template <size_t MIN_COUNT = 1, size_t MAX_SPLITS = 12>
+class AdaptiveSplitter {
+public:
+    // chunks shorter than this don't amortize the cost of a job
+    static constexpr float MIN_CHUNK_DURATION_NS = 20000.0f;
+
+    using Cost = SplitterCost;
+
+    AdaptiveSplitter(JobSystem const& js, Cost& cost) noexcept : mJobSystem(&js), mCost(&cost) { }
+
+    bool split(size_t splits, size_t count) const noexcept {
+        if (splits >= MAX_SPLITS || count < MIN_COUNT * 2) {
+            return false;
+        }
+        const float cost = mCost->nanosecondsPerItem.load(std::memory_order_relaxed);
+        if (cost > 0.0f && float(count) * cost < MIN_CHUNK_DURATION_NS * 2.0f) {
+            return false;
+        }
+        return mJobSystem->getQueuedJobCount() < mJobSystem->getThreadCount();
+    }
+
+    template<typename F>
+    void execute(F& functor, uint32_t start, uint32_t count) const noexcept {
+        const auto begin = std::chrono::steady_clock::now();
+        functor(start, count);
+        if (UTILS_LIKELY(count)) {
+            const std::chrono::duration<float, std::nano> duration =
+                    std::chrono::steady_clock::now() - begin;
+            const float cost = duration.count() / float(count);
+            // moving average, concurrent updates can overwrite each other, which is harmless
+            const float previous = mCost->nanosecondsPerItem.load(std::memory_order_relaxed);
+            mCost->nanosecondsPerItem.store(previous > 0.0f ?
+                    previous + (cost - previous) * 0.125f : cost, std::memory_order_relaxed);
+        }
+    }
+
+private:
+    JobSystem const* mJobSystem;
+    Cost* mCost;
+};
+
 } // namespace jobs
 } // namespace utils
 
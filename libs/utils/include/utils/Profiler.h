@@ -44,6 +44,8 @@ public:
         BRANCH_MISSES   = 5,
         ICACHE_REFS     = 6,
         ICACHE_MISSES   = 7,
+        LLC_REFS        = 8,
+        LLC_MISSES      = 9,
 
         // Must be last one
         EVENT_COUNT
@@ -57,10 +59,13 @@ public:
         EV_BPU_MISSES = 1u << BRANCH_MISSES,
         EV_L1I_REFS   = 1u << ICACHE_REFS,
         EV_L1I_MISSES = 1u << ICACHE_MISSES,
+        EV_LLC_REFS   = 1u << LLC_REFS,
+        EV_LLC_MISSES = 1u << LLC_MISSES,
         // helpers
         EV_L1D_RATES = EV_L1D_REFS | EV_L1D_MISSES,
         EV_L1I_RATES = EV_L1I_REFS | EV_L1I_MISSES,
         EV_BPU_RATES = EV_BPU_REFS | EV_BPU_MISSES,
+        EV_LLC_RATES = EV_LLC_REFS | EV_LLC_MISSES,
     };
 
     Profiler() noexcept; // must call resetEvents()
@@ -109,6 +114,8 @@ public:
         uint64_t getL1IMisses() const           { return counters[ICACHE_MISSES].value; }
         uint64_t getBranchInstructions() const  { return counters[BRANCHES].value; }
         uint64_t getBranchMisses() const        { return counters[BRANCH_MISSES].value; }
+        uint64_t getLLCReferences() const       { return counters[LLC_REFS].value; }
+        uint64_t getLLCMisses() const           { return counters[LLC_MISSES].value; }
 
         std::chrono::duration<uint64_t, std::nano> getWallTime() const {
             return std::chrono::duration<uint64_t, std::nano>(time_enabled);
@@ -160,6 +167,12 @@ public:
             return 1.0 - getBranchMissRate();
         }
 
+        double getLLCMissRate() const noexcept {
+            uint64_t cacheReferences = getLLCReferences();
+            uint64_t cacheMisses = getLLCMisses();
+            return double(cacheMisses) / double(cacheReferences);
+        }
+
         double getMPKI(uint64_t misses) const noexcept {
             return (misses * 1000.0) / getInstructions();
         }
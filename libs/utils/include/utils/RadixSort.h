@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_RADIXSORT_H
+#define TNT_UTILS_RADIXSORT_H
+
+#include <utils/compiler.h>
+#include <utils/JobSystem.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+namespace jobs {
+
+constexpr size_t RADIX_SORT_MIN_CHUNK_SIZE = 4096;
+constexpr size_t RADIX_SORT_MAX_CHUNKS = 64;
+
+/*
+ * Stable, parallel LSD radix sort of [first, last) on a 64-bit key.
+ *
+ * keyOf(const T&) must return the uint64_t sort key of an element. Elements are sorted in
+ * ascending key order and elements with equal keys keep their relative order.
+ *
+ * The input is split into up to RADIX_SORT_MAX_CHUNKS fixed chunks and each 8-bit digit is
+ * processed with a parallel histogram pass followed by a parallel scatter pass. Digits that
+ * are the same for all keys are detected up front and skipped entirely, which typically
+ * removes most of the passes when only a few bits of the key are actually used.
+ *
+ * scratch must point to storage for at least (last - first) elements; it's used as the
+ * ping-pong buffer and its content is undefined on return.
+ *
+ * Elements are only ever copy-assigned (never moved), so T must be trivially copy-assignable
+ * and trivially destructible; scratch doesn't need to hold constructed objects.
+ */
+template<typename T, typename KEY>
+void radix_sort(JobSystem& js, T* first, T* last, T* scratch, KEY keyOf) noexcept {
+    static_assert(std::is_trivially_copy_assignable<T>::value &&
+                  std::is_trivially_destructible<T>::value,
+            "radix_sort() requires a trivially copy-assignable and destructible T");
+
+    constexpr size_t RADIX_BITS = 8;
+    constexpr size_t RADIX = 1u << RADIX_BITS;
+    constexpr size_t DIGIT_COUNT = sizeof(uint64_t) * 8 / RADIX_BITS;
+
+    const uint32_t count = uint32_t(last - first);
+    if (count < 2) {
+        return;
+    }
+
+    const uint32_t chunkCount = uint32_t(std::min(RADIX_SORT_MAX_CHUNKS,
+            std::max(size_t(1), count / RADIX_SORT_MIN_CHUNK_SIZE)));
+    const uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    // runs work(chunkIndex, chunkBegin, chunkEnd) for each chunk, in parallel
+    auto forEachChunk = [&js, chunkCount, chunkSize, count](auto&& work) {
+        auto job = [&work, chunkSize, count](uint32_t start, uint32_t c) {
+            for (uint32_t i = start; i < start + c; i++) {
+                const uint32_t b = std::min(count, i * chunkSize);
+                work(i, b, std::min(count, b + chunkSize));
+            }
+        };
+        js.runAndWait(parallel_for(js, nullptr, 0, chunkCount,
+                std::cref(job), CountSplitter<1, 8>()));
+    };
+
+    // find which bits are actually changing across all keys
+    std::unique_ptr<uint64_t[]> bits(new uint64_t[chunkCount * 2]);
+    forEachChunk([&](uint32_t chunk, uint32_t b, uint32_t e) {
+        uint64_t ones = ~uint64_t(0);
+        uint64_t zeros = 0;
+        for (uint32_t i = b; i < e; i++) {
+            const uint64_t key = keyOf(first[i]);
+            ones &= key;
+            zeros |= key;
+        }
+        bits[chunk * 2 + 0] = ones;
+        bits[chunk * 2 + 1] = zeros;
+    });
+    uint64_t ones = ~uint64_t(0);
+    uint64_t zeros = 0;
+    for (uint32_t i = 0; i < chunkCount; i++) {
+        ones &= bits[i * 2 + 0];
+        zeros |= bits[i * 2 + 1];
+    }
+    const uint64_t varying = ones ^ zeros;
+    if (!varying) {
+        return; // all keys are equal, nothing to do
+    }
+
+    // per chunk histograms, turned into per chunk scatter offsets
+    using Histogram = uint32_t[RADIX];
+    std::unique_ptr<Histogram[]> histograms(new Histogram[chunkCount]);
+
+    T* src = first;
+    T* dst = scratch;
+    for (size_t digit = 0; digit < DIGIT_COUNT; digit++) {
+        const size_t shift = digit * RADIX_BITS;
+        if (!((varying >> shift) & (RADIX - 1))) {
+            continue; // this digit is constant, the pass would be a no-op
+        }
+
+        forEachChunk([&](uint32_t chunk, uint32_t b, uint32_t e) {
+            uint32_t* const UTILS_RESTRICT h = histograms[chunk];
+            std::fill_n(h, RADIX, 0);
+            for (uint32_t i = b; i < e; i++) {
+                h[(keyOf(src[i]) >> shift) & (RADIX - 1)]++;
+            }
+        });
+
+        // exclusive prefix sum, bucket-major then chunk-major, which keeps the sort stable
+        uint32_t sum = 0;
+        for (size_t bucket = 0; bucket < RADIX; bucket++) {
+            for (uint32_t chunk = 0; chunk < chunkCount; chunk++) {
+                const uint32_t c = histograms[chunk][bucket];
+                histograms[chunk][bucket] = sum;
+                sum += c;
+            }
+        }
+
+        forEachChunk([&](uint32_t chunk, uint32_t b, uint32_t e) {
+            uint32_t* const UTILS_RESTRICT offsets = histograms[chunk];
+            T const* const UTILS_RESTRICT s = src;
+            T* const UTILS_RESTRICT d = dst;
+            for (uint32_t i = b; i < e; i++) {
+                d[offsets[(keyOf(s[i]) >> shift) & (RADIX - 1)]++] = s[i];
+            }
+        });
+
+        std::swap(src, dst);
+    }
+
+    if (src != first) {
+        // we did an odd number of passes, the result is in scratch
+        forEachChunk([&](uint32_t, uint32_t b, uint32_t e) {
+            std::copy(src + b, src + e, first + b);
+        });
+    }
+}
+
+} // namespace jobs
+} // namespace utils
+
+#endif // TNT_UTILS_RADIXSORT_H
@@ -45,17 +45,6 @@ class EntityManager;
  */
 template <typename ... Elements>
 class UTILS_PUBLIC SingleInstanceComponentManager {
-private:
-
-    // this is just to avoid using std::default_random_engine, since we're in a public header.
-    class default_random_engine {
-        uint32_t mState = 1u; // must be 0 < seed < 0x7fffffff
-    public:
-        inline uint32_t operator()() noexcept {
-            return mState = uint32_t((uint64_t(mState) * 48271u) % 0x7fffffffu);
-        }
-    };
-
 protected:
     static constexpr size_t ENTITY_INDEX = sizeof ... (Elements);
 
@@ -125,7 +114,8 @@ public:
     inline Instance removeComponent(Entity e);
 
     // trigger one round of garbage collection. this is intended to be called on a regular
-    // basis. This gc gives up after it cannot randomly free 'ratio' component in a row.
+    // basis. This removes the components of the entities destroyed since the last gc(),
+    // 'ratio' is unused.
     void gc(const EntityManager& em, size_t ratio = 4) noexcept {
         gc(em, ratio, [this](Entity e) {
                     removeComponent(e);
@@ -231,23 +221,32 @@ protected:
     }
 
     template<typename REMOVE>
-    void gc(const EntityManager& em, size_t ratio,
+    void gc(const EntityManager& em, UTILS_UNUSED size_t ratio,
             REMOVE removeComponent) noexcept {
-        Entity const* entities = getEntities();
-        size_t count = getComponentCount();
-        size_t aliveInARow = 0;
-        default_random_engine& rng = mRng;
-        #pragma nounroll
-        while (count && aliveInARow < ratio) {
-            // note: using the modulo favorizes lower number
-            size_t i = rng() % count;
-            if (UTILS_LIKELY(em.isAlive(entities[i]))) {
-                ++aliveInARow;
-                continue;
+        // consume the entities destroyed since the last gc(), instead of polling ours
+        Entity destroyed[64];
+        bool lost = false;
+        size_t n;
+        while ((n = em.readDestroyedEntities(mDestroyedCursor, destroyed, 64, lost))) {
+            for (size_t i = 0; i < n; i++) {
+                if (hasComponent(destroyed[i])) {
+                    removeComponent(destroyed[i]);
+                }
+            }
+        }
+
+        if (UTILS_UNLIKELY(lost)) {
+            // some destroyed entities were dropped before we could read them, check all ours.
+            // Removing a component moves the last one in its place, so we go backward.
+            #pragma nounroll
+            for (size_t i = getComponentCount(); i > 0; i--) {
+                if (i <= getComponentCount()) {
+                    Entity const e = getEntities()[i - 1];
+                    if (!em.isAlive(e)) {
+                        removeComponent(e);
+                    }
+                }
             }
-            aliveInARow = 0;
-            count--;
-            removeComponent(entities[i]);
         }
     }
 
@@ -257,7 +256,7 @@ protected:
 private:
     // maps an entity to an instance index
     tsl::robin_map<Entity, Instance> mInstanceMap;
-    default_random_engine mRng;
+    EntityManager::DestroyedCursor mDestroyedCursor = 0;
 };
 
 // Keep these outside of the class because CLion has trouble parsing them
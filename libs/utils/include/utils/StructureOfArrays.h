@@ -17,6 +17,7 @@
 #ifndef TNT_UTILS_STRUCTUREOFARRAYS_H
 #define TNT_UTILS_STRUCTUREOFARRAYS_H
 
+#include <algorithm>
 #include <array>        // note: this is safe, see how std::array is used below (inline / private)
 #include <cstddef>
 #include <functional>
@@ -25,6 +26,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <utils/Allocator.h>
 #include <utils/compiler.h>
@@ -317,6 +319,47 @@ public:
         });
     }
 
+    // Reorders the elements of all arrays, so that the element at index i is the one that was at
+    // index order[i], where order is a permutation of [0, size). Each array is gathered once
+    // through a temporary buffer instead of swapping all the arrays at each step of an
+    // algorithm like std::partition(), and the elements already in place at both ends of the
+    // arrays are not moved. The arrays stay at the same address.
+    UTILS_NOINLINE
+    void permute(uint32_t const* order) noexcept {
+        size_t first = 0;
+        size_t last = mSize;
+        while (first < last && order[first] == first) {
+            first++;
+        }
+        while (last > first && order[last - 1] == last - 1) {
+            last--;
+        }
+        const size_t count = last - first;
+        if (!count) {
+            return;
+        }
+
+        void* const buffer = mAllocator.alloc(std::max({ sizeof(Elements)... }) * count);
+        forEach([buffer, order, first, count](auto p) {
+            using T = typename std::decay<decltype(*p)>::type;
+            T* UTILS_RESTRICT const temp = static_cast<T*>(buffer);
+            for (size_t i = 0; i < count; i++) {
+                new(temp + i) T(std::move(p[order[first + i]]));
+            }
+            // for trivial cases, just call memcpy()
+            if (std::is_trivially_copyable<T>::value &&
+                std::is_trivially_destructible<T>::value) {
+                memcpy(p + first, temp, count * sizeof(T));
+            } else {
+                for (size_t i = 0; i < count; i++) {
+                    p[first + i] = std::move(temp[i]);
+                    temp[i].~T();
+                }
+            }
+        });
+        mAllocator.free(buffer);
+    }
+
     // remove and destroy the last element of each array
     inline void pop_back() noexcept {
         if (mSize) {
@@ -224,21 +224,165 @@ private:
 } // namespace details
 } // namespace utils
 
+// SYSTRACE_START_RECORDING, SYSTRACE_STOP_RECORDING and SYSTRACE_EXPORT are only used by the
+// desktop backend, on Android the traces are captured by the system.
+#define SYSTRACE_START_RECORDING()
+#define SYSTRACE_STOP_RECORDING()
+#define SYSTRACE_EXPORT(path)
+
 // ------------------------------------------------------------------------------------------------
 #else // !ANDROID
 // ------------------------------------------------------------------------------------------------
 
-#define SYSTRACE_ENABLE()
-#define SYSTRACE_DISABLE()
-#define SYSTRACE_CONTEXT()
-#define SYSTRACE_NAME(name)
-#define SYSTRACE_NAME_BEGIN(name)
-#define SYSTRACE_NAME_END()
-#define SYSTRACE_CALL()
-#define SYSTRACE_ASYNC_BEGIN(name, cookie)
-#define SYSTRACE_ASYNC_END(name, cookie)
-#define SYSTRACE_VALUE32(name, val)
-#define SYSTRACE_VALUE64(name, val)
+/*
+ * On desktop platforms, the events of the enabled tags are recorded in per-thread ring buffers
+ * while recording is started, and can then be exported in the Chrome trace event format, which
+ * can be opened with chrome://tracing or https://ui.perfetto.dev.
+ * When not recording, each trace only costs a relaxed atomic load.
+ */
+
+#include <atomic>
+
+#include <stdint.h>
+
+#include <utils/compiler.h>
+
+#ifndef SYSTRACE_TAG
+#define SYSTRACE_TAG (SYSTRACE_TAG_ALWAYS)
+#endif
+
+#define SYSTRACE_ENABLE() ::utils::details::Systrace::enable(SYSTRACE_TAG)
+#define SYSTRACE_DISABLE() ::utils::details::Systrace::disable(SYSTRACE_TAG)
+
+// starts recording the events of the enabled tags, previously recorded events are discarded
+#define SYSTRACE_START_RECORDING() ::utils::details::Systrace::startRecording()
+
+// stops recording, the recorded events are kept until exported or recording starts again
+#define SYSTRACE_STOP_RECORDING() ::utils::details::Systrace::stopRecording()
+
+// writes the recorded events to the given file, in the Chrome trace event format
+#define SYSTRACE_EXPORT(path) ::utils::details::Systrace::exportChromeTrace(path)
+
+#define SYSTRACE_CONTEXT() ::utils::details::Systrace ___tracer(SYSTRACE_TAG)
+#define SYSTRACE_NAME(name) ::utils::details::ScopedTrace ___tracer(SYSTRACE_TAG, name)
+#define SYSTRACE_CALL() SYSTRACE_NAME(__FUNCTION__)
+#define SYSTRACE_NAME_BEGIN(name) ___tracer.traceBegin(SYSTRACE_TAG, name)
+#define SYSTRACE_NAME_END() ___tracer.traceEnd(SYSTRACE_TAG)
+#define SYSTRACE_ASYNC_BEGIN(name, cookie) ___tracer.asyncBegin(SYSTRACE_TAG, name, cookie)
+#define SYSTRACE_ASYNC_END(name, cookie) ___tracer.asyncEnd(SYSTRACE_TAG, name, cookie)
+#define SYSTRACE_VALUE32(name, val) ___tracer.value(SYSTRACE_TAG, name, int32_t(val))
+#define SYSTRACE_VALUE64(name, val) ___tracer.value(SYSTRACE_TAG, name, int64_t(val))
+
+// ------------------------------------------------------------------------------------------------
+// No user serviceable code below...
+// ------------------------------------------------------------------------------------------------
+
+namespace utils {
+namespace details {
+
+class UTILS_PUBLIC Systrace {
+public:
+
+    enum tags {
+        NEVER       = SYSTRACE_TAG_NEVER,
+        ALWAYS      = SYSTRACE_TAG_ALWAYS,
+        FILAMENT    = SYSTRACE_TAG_FILAMENT,
+        JOBSYSTEM   = SYSTRACE_TAG_JOBSYSTEM
+    };
+
+    // Event names longer than this are truncated.
+    static constexpr size_t MAX_NAME_LENGTH = 45;
+
+    explicit Systrace(uint32_t tag) noexcept
+            : mIsTracingEnabled(sRecordedTags.load(std::memory_order_relaxed) & tag) {
+    }
+
+    static void enable(uint32_t tags) noexcept;
+    static void disable(uint32_t tags) noexcept;
+
+    static void startRecording() noexcept;
+    static void stopRecording() noexcept;
+    static bool exportChromeTrace(const char* path) noexcept;
+
+    inline void asyncBegin(uint32_t tag, const char* name, int32_t cookie) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(ASYNC_BEGIN, tag, name, cookie);
+        }
+    }
+
+    inline void asyncEnd(uint32_t tag, const char* name, int32_t cookie) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(ASYNC_END, tag, name, cookie);
+        }
+    }
+
+    inline void value(uint32_t tag, const char* name, int32_t value) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(VALUE, tag, name, value);
+        }
+    }
+
+    inline void value(uint32_t tag, const char* name, int64_t value) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(VALUE, tag, name, value);
+        }
+    }
+
+    inline void traceBegin(uint32_t tag, const char* name) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(BEGIN, tag, name, 0);
+        }
+    }
+
+    inline void traceEnd(uint32_t tag) noexcept {
+        if (tag && UTILS_UNLIKELY(mIsTracingEnabled)) {
+            record(END, tag, nullptr, 0);
+        }
+    }
+
+private:
+    enum EventType : uint8_t {
+        BEGIN, END, ASYNC_BEGIN, ASYNC_END, VALUE
+    };
+
+    static void record(EventType type, uint32_t tag, const char* name, int64_t value) noexcept;
+    static void updateRecordedTags() noexcept;
+
+    // the enabled tags (and SYSTRACE_TAG_ALWAYS) while recording, 0 otherwise
+    static std::atomic<uint32_t> sRecordedTags;
+
+    // cached for the lifetime of the context, so that a scope started while recording is
+    // always closed.
+    const bool mIsTracingEnabled;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+class ScopedTrace {
+public:
+    ScopedTrace(uint32_t tag, const char* name) noexcept : mTrace(tag), mTag(tag) {
+        mTrace.traceBegin(tag, name);
+    }
+
+    inline ~ScopedTrace() noexcept {
+        mTrace.traceEnd(mTag);
+    }
+
+    inline void value(uint32_t tag, const char* name, int32_t v) noexcept {
+        mTrace.value(tag, name, v);
+    }
+
+    inline void value(uint32_t tag, const char* name, int64_t v) noexcept {
+        mTrace.value(tag, name, v);
+    }
+
+private:
+    Systrace mTrace;
+    const uint32_t mTag;
+};
+
+} // namespace details
+} // namespace utils
 
 #endif // ANDROID
 
@@ -104,6 +104,15 @@
 #   define UTILS_HAS_THREADING 1
 #endif
 
+// Whether the JobSystem can run jobs on worker threads. On the web, pthreads builds back the
+// JobSystem with web workers, but the WebGL context belongs to the main thread so there is still
+// no driver thread.
+#if defined(__EMSCRIPTEN_PTHREADS__) && !defined(FILAMENT_SINGLE_THREADED)
+#   define UTILS_HAS_JOB_THREADS 1
+#else
+#   define UTILS_HAS_JOB_THREADS UTILS_HAS_THREADING
+#endif
+
 #if __has_attribute(noinline)
 #define UTILS_NOINLINE __attribute__((noinline))
 #else
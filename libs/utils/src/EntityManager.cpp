@@ -47,6 +47,12 @@ void EntityManager::destroy(size_t n, Entity* entities) noexcept {
     static_cast<EntityManagerImpl *>(this)->destroy(n, entities);
 }
 
+size_t EntityManager::readDestroyedEntities(DestroyedCursor& cursor, Entity* entities,
+        size_t count, bool& lost) const noexcept {
+    return static_cast<EntityManagerImpl const *>(this)->readDestroyedEntities(
+            cursor, entities, count, lost);
+}
+
 void EntityManager::registerListener(EntityManager::Listener* l) noexcept {
     static_cast<EntityManagerImpl *>(this)->registerListener(l);
 }
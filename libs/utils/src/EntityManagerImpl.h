@@ -30,6 +30,8 @@
 #include <tsl/robin_map.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
 #include <deque>
 #include <mutex> // for std::lock_guard
 #include <vector>
@@ -39,6 +41,9 @@ namespace utils {
 
 static constexpr const size_t MIN_FREE_INDICES = 1024;
 
+// number of destroyed entities kept for readDestroyedEntities(), must be a power of two
+static constexpr const size_t DESTROYED_ENTITIES_COUNT = 4096;
+
 class UTILS_PRIVATE EntityManagerImpl : public EntityManager {
 public:
     using EntityManager::getGeneration;
@@ -52,14 +57,33 @@ public:
         auto& freeList = mFreeList;
         uint8_t* const gens = mGens;
 
+        // In the common case, we just grab the next n indices, which doesn't need the lock.
+        // This works only until all indices have been used once, or enough indices have been
+        // freed, at which point we're always in the slower case below.
+        if (UTILS_LIKELY(mFreeListSize.load(std::memory_order_relaxed) < MIN_FREE_INDICES)) {
+            Entity::Type first;
+            if (reserveIndices(n, &first)) {
+                for (size_t i = 0; i < n; i++) {
+                    index = Entity::Type(first + i);
+                    entities[i] = Entity{ makeIdentity(gens[index], index) };
+                }
+#if FILAMENT_UTILS_TRACK_ENTITIES
+                std::lock_guard<Mutex> lock(mFreeListLock);
+                for (size_t i = 0; i < n; i++) {
+                    mDebugActiveEntities.emplace(entities[i], CallStack::unwind(5));
+                }
+#endif
+                return;
+            }
+        }
+
         // this must be thread-safe, acquire the free-list mutex
         std::lock_guard<Mutex> lock(mFreeListLock);
-        Entity::Type currentIndex = mCurrentIndex;
         for (size_t i = 0; i < n; i++) {
             // If we have more than a certain number of freed indices, get one from the list.
             // this is a trade-off between how often we recycle indices and how large the free list
             // can grow.
-            if (UTILS_UNLIKELY(currentIndex >= RAW_INDEX_COUNT || freeList.size() >= MIN_FREE_INDICES)) {
+            if (UTILS_UNLIKELY(freeList.size() >= MIN_FREE_INDICES || !reserveIndices(1, &index))) {
 
                 // this could only happen if we had gone through all the indices at least once
                 if (UTILS_UNLIKELY(freeList.empty())) {
@@ -70,19 +94,13 @@ public:
 
                 index = freeList.front();
                 freeList.pop_front();
-            } else {
-                // In the common case, we just grab the next index.
-                // This works only until all indices have been used once, at which point
-                // we're always in the slower case above. The idea is that we have enough indices
-                // that it doesn't happen in practice.
-                index = currentIndex++;
             }
             entities[i] = Entity{ makeIdentity(gens[index], index) };
 #if FILAMENT_UTILS_TRACK_ENTITIES
             mDebugActiveEntities.emplace(entities[i], CallStack::unwind(5));
 #endif
         }
-        mCurrentIndex = currentIndex;
+        mFreeListSize.store(freeList.size(), std::memory_order_relaxed);
     }
 
     void destroy(size_t n, Entity* entities) noexcept {
@@ -105,6 +123,8 @@ public:
             if (isAlive(entities[i])) {
                 Entity::Type index = getIndex(entities[i]);
                 freeList.push_back(index);
+                mDestroyedEntities[mDestroyedCount++ & (DESTROYED_ENTITIES_COUNT - 1)] =
+                        entities[i];
 
                 // The generation update doesn't require the lock because it's only used for isAlive()
                 // and entities work as weak references -- it just means that isAlive() could return
@@ -117,6 +137,7 @@ public:
 #endif
             }
         }
+        mFreeListSize.store(freeList.size(), std::memory_order_relaxed);
         lock.unlock();
 
         // notify our listeners that some entities are being destroyed
@@ -126,6 +147,23 @@ public:
         }
     }
 
+    size_t readDestroyedEntities(DestroyedCursor& cursor, Entity* entities, size_t count,
+            bool& lost) const noexcept {
+        std::lock_guard<Mutex> lock(mFreeListLock);
+        const uint64_t end = mDestroyedCount;
+        const uint64_t first = end > DESTROYED_ENTITIES_COUNT ? end - DESTROYED_ENTITIES_COUNT : 0;
+        if (UTILS_UNLIKELY(cursor < first)) {
+            lost = true;
+            cursor = first;
+        }
+        const size_t n = std::min(size_t(end - cursor), count);
+        for (size_t i = 0; i < n; i++) {
+            entities[i] = mDestroyedEntities[(cursor + i) & (DESTROYED_ENTITIES_COUNT - 1)];
+        }
+        cursor += n;
+        return n;
+    }
+
     void registerListener(EntityManager::Listener* l) noexcept {
         std::lock_guard<Mutex> lock(mListenerLock);
         mListeners.insert(l);
@@ -167,11 +205,29 @@ public:
 #endif
 
 private:
-    uint32_t mCurrentIndex = 1;
+    // reserves n consecutive indices that were never used, without locking
+    bool reserveIndices(size_t n, Entity::Type* first) noexcept {
+        uint32_t index = mCurrentIndex.load(std::memory_order_relaxed);
+        do {
+            if (UTILS_UNLIKELY(n > RAW_INDEX_COUNT - index)) {
+                return false;
+            }
+        } while (!mCurrentIndex.compare_exchange_weak(index, uint32_t(index + n),
+                std::memory_order_relaxed, std::memory_order_relaxed));
+        *first = index;
+        return true;
+    }
+
+    std::atomic<uint32_t> mCurrentIndex = { 1 };
 
     // stores indices that got freed
     mutable Mutex mFreeListLock;
     std::deque<Entity::Type> mFreeList;
+    std::atomic<size_t> mFreeListSize = { 0 }; // mirrors mFreeList.size(), read without the lock
+
+    // the most recently destroyed entities, see readDestroyedEntities()
+    Entity mDestroyedEntities[DESTROYED_ENTITIES_COUNT];
+    uint64_t mDestroyedCount = 0;
 
     mutable Mutex mListenerLock;
     tsl::robin_set<Listener*> mListeners;
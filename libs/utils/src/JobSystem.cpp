@@ -23,9 +23,13 @@
 
 #include <utils/JobSystem.h>
 
+#include <algorithm>
 #include <cmath>
 #include <random>
 
+#include <stdio.h>
+
+#include <utils/algorithm.h>
 #include <utils/compiler.h>
 #include <utils/memalign.h>
 #include <utils/Panic.h>
@@ -66,6 +70,29 @@
 
 namespace utils {
 
+// Job::continuation values that are not job indices
+static constexpr uint16_t NO_CONTINUATION = 0x7FFF;
+static constexpr uint16_t FINISHED = 0x7FFE;
+
+// A gate holds a job to run once its dependencies have finished, it lives in the storage of an
+// internal job. Each dependency refers to the gate through a link, another internal job which
+// stores the gate in its storage. The links of a dependency are chained by Job::continuation.
+struct Gate {
+    JobSystem::Job* job;
+    std::atomic<uint32_t> pendingCount;
+    uint32_t flags;
+};
+
+// statistics are only written by the thread they belong to
+template<typename T>
+static inline void increment(std::atomic<T>& counter, T value = 1) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static inline uint64_t getNanoseconds(std::chrono::steady_clock::duration duration) noexcept {
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
+
 void JobSystem::setThreadName(const char* name) noexcept {
 #if defined(__linux__)
     pthread_setname_np(pthread_self(), name);
@@ -103,9 +130,37 @@ void JobSystem::setThreadAffinityById(size_t id) noexcept {
 #endif
 }
 
+std::vector<uint16_t> JobSystem::getCpusByCapacity() noexcept {
+    const size_t count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint16_t> cpus(count);
+    std::vector<uint32_t> frequencies(count, 0);
+    for (size_t i = 0; i < count; i++) {
+        cpus[i] = uint16_t(i);
+#if defined(__linux__)
+        // the maximum frequency of a CPU tells apart the big and LITTLE cores
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%zu/cpufreq/cpuinfo_max_freq", i);
+        FILE* file = fopen(path, "r");
+        if (file) {
+            if (fscanf(file, "%u", &frequencies[i]) != 1) {
+                frequencies[i] = 0;
+            }
+            fclose(file);
+        }
+#endif
+    }
+    std::stable_sort(cpus.begin(), cpus.end(), [&frequencies](uint16_t lhs, uint16_t rhs) {
+        return frequencies[lhs] > frequencies[rhs];
+    });
+    return cpus;
+}
+
 JobSystem::JobSystem(const size_t userThreadCount, const size_t adoptableThreadsCount) noexcept
-    : mJobPool("JobSystem Job pool", MAX_JOB_COUNT * sizeof(Job)),
-      mJobStorageBase(static_cast<Job *>(mJobPool.getAllocator().getCurrent()))
+    : mJobStorage((MAX_JOB_COUNT + 1) * sizeof(Job)),
+      mJobPool(pointermath::align(mJobStorage.begin(), alignof(Job)),
+              pointermath::add(pointermath::align(mJobStorage.begin(), alignof(Job)),
+                      INITIAL_JOB_COUNT * sizeof(Job))),
+      mJobStorageBase(static_cast<Job *>(mJobPool.getCurrent()))
 {
     SYSTRACE_ENABLE();
 
@@ -124,7 +179,7 @@ JobSystem::JobSystem(const size_t userThreadCount, const size_t adoptableThreads
         // one of the thread will be the user thread
         threadPoolCount = hwThreads - 1;
     }
-    threadPoolCount = std::min(UTILS_HAS_THREADING ? 32 : 0, threadPoolCount);
+    threadPoolCount = std::min(UTILS_HAS_JOB_THREADS ? 32 : 0, threadPoolCount);
 
     mThreadStates = aligned_vector<ThreadState>(threadPoolCount + adoptableThreadsCount);
     mThreadCount = uint16_t(threadPoolCount);
@@ -138,11 +193,20 @@ JobSystem::JobSystem(const size_t userThreadCount, const size_t adoptableThreads
     const size_t hardwareThreadCount = mThreadCount;
     auto& states = mThreadStates;
 
+    // pin the threads to the fastest CPUs first, so that they run on the big cores of big.LITTLE
+    // SoCs, this is the same as pinning thread i to CPU i on other systems.
+    const std::vector<uint16_t> cpus = getCpusByCapacity();
+
+    resetStatistics();
+
     #pragma nounroll
     for (size_t i = 0, n = states.size(); i < n; i++) {
         auto& state = states[i];
         state.rndGen = default_random_engine(rd());
         state.id = (uint32_t)i;
+        state.cpu = cpus[i % cpus.size()];
+        state.backgroundDepth = 0;
+        state.scratchEpoch = 0;
         state.js = this;
         if (i < hardwareThreadCount) {
             // don't start a thread of adoptable thread slots
@@ -184,7 +248,8 @@ void JobSystem::decRef(Job const* job) noexcept {
     assert(c > 0);
     if (c == 1) {
         // This was the last reference, it's safe to destroy the job.
-        mJobPool.destroy(job);
+        job->~Job();
+        mJobPool.free(const_cast<Job*>(job));
     }
 }
 
@@ -204,14 +269,29 @@ inline bool JobSystem::hasActiveJobs() const noexcept {
     return mActiveJobs.load(std::memory_order_relaxed) > 0;
 }
 
+inline bool JobSystem::hasActiveForegroundJobs() const noexcept {
+    // both counters are loaded separately, so the difference can be transiently off, which only
+    // delays picking a job until the next attempt.
+    return int32_t(mActiveJobs.load(std::memory_order_relaxed) -
+            mActiveBackgroundJobs.load(std::memory_order_relaxed)) > 0;
+}
+
 inline bool JobSystem::hasJobCompleted(JobSystem::Job const* job) noexcept {
     return job->runningJobCount.load(std::memory_order_relaxed) <= 0;
 }
 
-void JobSystem::wait(std::unique_lock<Mutex>& lock) noexcept {
+void JobSystem::wait(std::unique_lock<Mutex>& lock, ThreadState& state) noexcept {
+    const bool statistics = mStatisticsEnabled.load(std::memory_order_relaxed);
+    const auto start = statistics ?
+            std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
     ++mWaiterCount;
     mWaiterCondition.wait(lock);
     --mWaiterCount;
+    if (UTILS_UNLIKELY(statistics)) {
+        increment(state.stats.sleeps);
+        increment(state.stats.sleepNanoseconds,
+                getNanoseconds(std::chrono::steady_clock::now() - start));
+    }
 }
 
 void JobSystem::wake() noexcept {
@@ -230,7 +310,32 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
 }
 
 JobSystem::Job* JobSystem::allocateJob() noexcept {
-    return mJobPool.make<Job>();
+    void* p = mJobPool.alloc();
+    if (UTILS_UNLIKELY(!p)) {
+        p = growJobPool();
+    }
+    return p ? new(p) Job : nullptr;
+}
+
+UTILS_NOINLINE
+void* JobSystem::growJobPool() noexcept {
+    std::lock_guard<Mutex> lock(mJobPoolLock);
+
+    // another thread might have grown the pool while we were waiting for the lock
+    void* p = mJobPool.alloc();
+    if (p || mJobPoolCount == MAX_JOB_COUNT) {
+        return p;
+    }
+
+    // double the size of the pool, the new jobs are adjacent to the existing ones so that they
+    // can still be referred to by their index.
+    const size_t count = std::min(mJobPoolCount, MAX_JOB_COUNT - mJobPoolCount);
+    Job* const jobs = mJobStorageBase + mJobPoolCount;
+    for (size_t i = 1; i < count; i++) {
+        mJobPool.free(jobs + i);
+    }
+    mJobPoolCount += count;
+    return jobs;
 }
 
 inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -255,27 +360,49 @@ inline JobSystem::ThreadState* JobSystem::getStateToStealFrom(JobSystem::ThreadS
     return stateToStealFrom;
 }
 
-JobSystem::Job* JobSystem::steal(JobSystem::ThreadState& state) noexcept {
+JobSystem::Job* JobSystem::steal(JobSystem::ThreadState& state, bool background,
+        bool* isBackground) noexcept {
     HEAVY_SYSTRACE_CALL();
+    const bool statistics = mStatisticsEnabled.load(std::memory_order_relaxed);
     Job* job = nullptr;
     do {
+        bool stolen = false;
         ThreadState* const stateToStealFrom = getStateToStealFrom(state);
         if (UTILS_LIKELY(stateToStealFrom)) {
             job = steal(stateToStealFrom->workQueue);
+            stolen = job != nullptr;
+        }
+        // background jobs are only picked once no other job is waiting to run, starting with
+        // our own.
+        if (!job && background && !hasActiveForegroundJobs()) {
+            job = pop(state.backgroundQueue);
+            if (!job && stateToStealFrom) {
+                job = steal(stateToStealFrom->backgroundQueue);
+                stolen = job != nullptr;
+            }
+            *isBackground = job != nullptr;
+        }
+        if (UTILS_UNLIKELY(statistics)) {
+            if (stolen) {
+                increment(state.stats.stolenJobs);
+            } else if (!job) {
+                increment(state.stats.failedSteals);
+            }
         }
         // nullptr -> nothing to steal in that queue either, if there are active jobs,
         // continue to try stealing one.
-    } while (!job && hasActiveJobs());
+    } while (!job && (background ? hasActiveJobs() : hasActiveForegroundJobs()));
     return job;
 }
 
-bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
+bool JobSystem::execute(JobSystem::ThreadState& state, bool background) noexcept {
     HEAVY_SYSTRACE_CALL();
 
+    bool isBackground = false;
     Job* job = pop(state.workQueue);
     if (UTILS_UNLIKELY(job == nullptr)) {
         // our queue is empty, try to steal a job
-        job = steal(state);
+        job = steal(state, background, &isBackground);
     }
 
     if (job) {
@@ -283,11 +410,30 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
         uint32_t activeJobs = mActiveJobs.fetch_sub(1, std::memory_order_relaxed);
         assert(activeJobs); // whoops, we were already at 0
         HEAVY_SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs - 1);
+        if (isBackground) {
+            mActiveBackgroundJobs.fetch_sub(1, std::memory_order_relaxed);
+            state.backgroundDepth++;
+        }
+
+        const bool statistics = mStatisticsEnabled.load(std::memory_order_relaxed);
+        const auto start = statistics ?
+                std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
 
         if (UTILS_LIKELY(job->function)) {
             HEAVY_SYSTRACE_NAME("job->function");
             job->function(job->storage, *this, job);
         }
+
+        if (UTILS_UNLIKELY(statistics)) {
+            const uint64_t us = getNanoseconds(std::chrono::steady_clock::now() - start) / 1000;
+            const size_t bucket = us ? std::min(Statistics::DURATION_BUCKET_COUNT - 1,
+                    size_t(32 - utils::clz(unsigned(std::min(us, uint64_t(UINT32_MAX)))))) : 0;
+            increment(state.stats.executedJobs);
+            increment(state.stats.durations[bucket]);
+        }
+        if (isBackground) {
+            state.backgroundDepth--;
+        }
         finish(job);
     }
     return job != nullptr;
@@ -299,7 +445,7 @@ void JobSystem::loop(ThreadState* state) noexcept {
 
     // set a CPU affinity on each of our JobSystem thread to prevent them from jumping from core
     // to core. On Android, it looks like the affinity needs to be reset from time to time.
-    setThreadAffinityById(state->id);
+    setThreadAffinityById(state->cpu);
 
     // record our work queue
     mThreadMapLock.lock();
@@ -309,11 +455,21 @@ void JobSystem::loop(ThreadState* state) noexcept {
 
     // run our main loop...
     do {
-        if (!execute(*state)) {
+        // no job is running on this thread, it's a good time to reset our scratch arena if
+        // that was requested, before the next job allocates from it
+        const uint32_t scratchEpoch = mScratchEpoch.load(std::memory_order_relaxed);
+        if (UTILS_UNLIKELY(state->scratchEpoch != scratchEpoch)) {
+            state->scratchEpoch = scratchEpoch;
+            if (state->scratchArena) {
+                state->scratchArena->reset();
+            }
+        }
+
+        if (!execute(*state, true)) {
             std::unique_lock<Mutex> lock(mWaiterLock);
             while (!exitRequested() && !hasActiveJobs()) {
-                wait(lock);
-                setThreadAffinityById(state->id);
+                wait(lock, *state);
+                setThreadAffinityById(state->cpu);
             }
         }
     } while (!exitRequested());
@@ -336,6 +492,7 @@ void JobSystem::finish(Job* job) noexcept {
             // no more work, destroy this job and notify its parent
             notify = true;
             Job* const parent = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+            notifyContinuations(job);
             decRef(job);
             job = parent;
         } else {
@@ -407,7 +564,12 @@ void JobSystem::run(JobSystem::Job*& job, uint32_t flags) noexcept {
     // an assert() in execute(). Either way, it's not "wrong", but the assert() is useful.
     uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_relaxed);
 
-    put(state.workQueue, job);
+    if (flags & BACKGROUND) {
+        mActiveBackgroundJobs.fetch_add(1, std::memory_order_relaxed);
+        put(state.backgroundQueue, job);
+    } else {
+        put(state.workQueue, job);
+    }
 
     HEAVY_SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs + 1);
 
@@ -428,6 +590,119 @@ JobSystem::Job* JobSystem::runAndRetain(JobSystem::Job* job, uint32_t flags) noe
     return retained;
 }
 
+JobSystem::ScratchArena& JobSystem::getScratchArena() noexcept {
+    ThreadState& state(getState());
+    if (UTILS_UNLIKELY(!state.scratchArena)) {
+        state.scratchArena.reset(new ScratchArena("JobSystem scratch arena", SCRATCH_ARENA_SIZE));
+    }
+    return *state.scratchArena;
+}
+
+void JobSystem::resetScratchArenas() noexcept {
+    // the threads of the pool reset their own arena when they're idle, see loop()
+    const uint32_t scratchEpoch = mScratchEpoch.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    ThreadState& state(getState());
+    state.scratchEpoch = scratchEpoch;
+    if (state.scratchArena) {
+        state.scratchArena->reset();
+    }
+}
+
+size_t JobSystem::getStatistics(Statistics* statistics, size_t count) const noexcept {
+    auto const& states = mThreadStates;
+    if (statistics) {
+        for (size_t i = 0, n = std::min(count, states.size()); i < n; i++) {
+            auto const& stats = states[i].stats;
+            Statistics& s = statistics[i];
+            s.executedJobs = stats.executedJobs.load(std::memory_order_relaxed);
+            s.stolenJobs = stats.stolenJobs.load(std::memory_order_relaxed);
+            s.failedSteals = stats.failedSteals.load(std::memory_order_relaxed);
+            s.sleeps = stats.sleeps.load(std::memory_order_relaxed);
+            s.sleepNanoseconds = stats.sleepNanoseconds.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < Statistics::DURATION_BUCKET_COUNT; j++) {
+                s.durations[j] = stats.durations[j].load(std::memory_order_relaxed);
+            }
+        }
+    }
+    return states.size();
+}
+
+void JobSystem::resetStatistics() noexcept {
+    // counts made by the threads while resetting might be lost
+    for (auto& state : mThreadStates) {
+        auto& stats = state.stats;
+        stats.executedJobs.store(0, std::memory_order_relaxed);
+        stats.stolenJobs.store(0, std::memory_order_relaxed);
+        stats.failedSteals.store(0, std::memory_order_relaxed);
+        stats.sleeps.store(0, std::memory_order_relaxed);
+        stats.sleepNanoseconds.store(0, std::memory_order_relaxed);
+        for (auto& duration : stats.durations) {
+            duration.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+void JobSystem::runAfter(JobSystem::Job*& job, std::initializer_list<Job*> dependencies,
+        uint32_t flags) noexcept {
+    HEAVY_SYSTRACE_CALL();
+
+    Job* const gate = allocateJob();
+    ASSERT_POSTCONDITION(gate, "JobSystem: too many jobs");
+
+    // the extra count is released last, so the job can't run before all dependencies are linked
+    new(gate->storage) Gate{ job, { uint32_t(dependencies.size() + 1) }, flags };
+
+    for (Job* dependency : dependencies) {
+        Job* const link = allocateJob();
+        ASSERT_POSTCONDITION(link, "JobSystem: too many jobs");
+        link->storage[0] = gate;
+
+        const uint16_t index = uint16_t(link - mJobStorageBase);
+        uint16_t head = dependency->continuation.load(std::memory_order_acquire);
+        while (head != FINISHED) {
+            link->continuation.store(head, std::memory_order_relaxed);
+            if (dependency->continuation.compare_exchange_weak(head, index,
+                    std::memory_order_release, std::memory_order_acquire)) {
+                break;
+            }
+        }
+        if (head == FINISHED) {
+            // this dependency has finished already
+            decRef(link);
+            releaseDependency(gate);
+        }
+    }
+
+    releaseDependency(gate);
+
+    // after runAfter() returns, the job is virtually invalid (it'll die on its own)
+    job = nullptr;
+}
+
+void JobSystem::releaseDependency(JobSystem::Job* gate) noexcept {
+    Gate* const g = reinterpret_cast<Gate*>(gate->storage);
+    if (g->pendingCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        Job* job = g->job;
+        const uint32_t flags = g->flags;
+        g->~Gate();
+        decRef(gate);
+        run(job, flags);
+    }
+}
+
+void JobSystem::notifyContinuations(JobSystem::Job* job) noexcept {
+    // from now on, new dependents of this job don't need to wait for it
+    uint16_t index = job->continuation.exchange(FINISHED, std::memory_order_acq_rel);
+    while (index != NO_CONTINUATION) {
+        Job* const link = &mJobStorageBase[index];
+        Job* const gate = static_cast<Job*>(link->storage[0]);
+        index = link->continuation.load(std::memory_order_relaxed);
+        decRef(link);
+        releaseDependency(gate);
+    }
+}
+
 void JobSystem::waitAndRelease(Job*& job) noexcept {
     SYSTRACE_CALL();
 
@@ -435,8 +710,12 @@ void JobSystem::waitAndRelease(Job*& job) noexcept {
     assert(job->refCount.load(std::memory_order_relaxed) >= 1);
 
     ThreadState& state(getState());
+
+    // Waiting threads don't pick background jobs, which could delay them for long, unless they
+    // run a background job themselves or there's no other thread to run them.
+    const bool background = state.backgroundDepth > 0 || mThreadCount == 0;
     do {
-        if (!execute(state)) {
+        if (!execute(state, background)) {
             // test if job has completed first, to possibly avoid taking the lock
             if (hasJobCompleted(job)) {
                 break;
@@ -452,8 +731,9 @@ void JobSystem::waitAndRelease(Job*& job) noexcept {
             // continue to handle more jobs, as they get added.
 
             std::unique_lock<Mutex> lock(mWaiterLock);
-            if (!hasJobCompleted(job) && !hasActiveJobs() && !exitRequested()) {
-                wait(lock);
+            const bool hasJobs = background ? hasActiveJobs() : hasActiveForegroundJobs();
+            if (!hasJobCompleted(job) && !hasJobs && !exitRequested()) {
+                wait(lock, state);
             }
         }
     } while (!hasJobCompleted(job) && !exitRequested());
@@ -115,8 +115,9 @@ uint32_t Profiler::resetEvents(uint32_t eventMask) noexcept {
         }
 
         if (eventMask & EV_L1D_REFS) {
-            pe.type = PERF_TYPE_HARDWARE;
-            pe.config = PERF_COUNT_HW_CACHE_REFERENCES;
+            pe.type = PERF_TYPE_HW_CACHE;
+            pe.config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ<<8) | (PERF_COUNT_HW_CACHE_RESULT_ACCESS<<16);
             mCountersFd[DCACHE_REFS] = perf_event_open(&pe, 0, -1, groupFd, 0);
             if (mCountersFd[DCACHE_REFS] > 0) {
                 mIds[DCACHE_REFS] = count++;
@@ -125,8 +126,9 @@ uint32_t Profiler::resetEvents(uint32_t eventMask) noexcept {
         }
 
         if (eventMask & EV_L1D_MISSES) {
-            pe.type = PERF_TYPE_HARDWARE;
-            pe.config = PERF_COUNT_HW_CACHE_MISSES;
+            pe.type = PERF_TYPE_HW_CACHE;
+            pe.config = PERF_COUNT_HW_CACHE_L1D |
+                (PERF_COUNT_HW_CACHE_OP_READ<<8) | (PERF_COUNT_HW_CACHE_RESULT_MISS<<16);
             mCountersFd[DCACHE_MISSES] = perf_event_open(&pe, 0, -1, groupFd, 0);
             if (mCountersFd[DCACHE_MISSES] > 0) {
                 mIds[DCACHE_MISSES] = count++;
@@ -134,6 +136,26 @@ uint32_t Profiler::resetEvents(uint32_t eventMask) noexcept {
             }
         }
 
+        if (eventMask & EV_LLC_REFS) {
+            pe.type = PERF_TYPE_HARDWARE;
+            pe.config = PERF_COUNT_HW_CACHE_REFERENCES;
+            mCountersFd[LLC_REFS] = perf_event_open(&pe, 0, -1, groupFd, 0);
+            if (mCountersFd[LLC_REFS] > 0) {
+                mIds[LLC_REFS] = count++;
+                mEnabledEvents |= EV_LLC_REFS;
+            }
+        }
+
+        if (eventMask & EV_LLC_MISSES) {
+            pe.type = PERF_TYPE_HARDWARE;
+            pe.config = PERF_COUNT_HW_CACHE_MISSES;
+            mCountersFd[LLC_MISSES] = perf_event_open(&pe, 0, -1, groupFd, 0);
+            if (mCountersFd[LLC_MISSES] > 0) {
+                mIds[LLC_MISSES] = count++;
+                mEnabledEvents |= EV_LLC_MISSES;
+            }
+        }
+
         if (eventMask & EV_BPU_REFS) {
             pe.type = PERF_TYPE_HARDWARE;
             pe.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
@@ -138,4 +138,266 @@ void Systrace::init(uint32_t tag) noexcept {
 } // namespace details
 } // namespace utils
 
+#else // !ANDROID
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+namespace utils {
+namespace details {
+
+namespace {
+
+// Number of events kept per thread, the oldest ones are overwritten when the buffer is full.
+// Must be a power of two.
+constexpr size_t EVENTS_PER_THREAD = 16384;
+
+struct Event {
+    int64_t time;       // in nanoseconds, since recording started
+    int64_t value;      // counter value or async cookie
+    uint8_t type;
+    uint8_t tag;
+    char name[Systrace::MAX_NAME_LENGTH + 1];
+};
+
+static_assert(sizeof(Event) == 64, "Event should fit in a cache line");
+
+// Only written by its thread, read by exportChromeTrace().
+struct ThreadBuffer {
+    std::atomic<uint64_t> head = { 0 };     // number of events recorded
+    std::atomic<bool> inUse = { true };     // false once the thread has exited
+    uint32_t tid = 0;
+    char threadName[16] = {};
+    Event events[EVENTS_PER_THREAD];
+};
+
+struct Registry {
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    uint32_t enabledTags = 0;
+    bool recording = false;
+};
+
+Registry& getRegistry() noexcept {
+    // never destroyed, threads can still trace while the process exits
+    static Registry* registry = new Registry();
+    return *registry;
+}
+
+// Releases the buffer of a thread when it exits, so that it can be reused by a new thread.
+struct ThreadBufferOwner {
+    ThreadBuffer* buffer = nullptr;
+    ~ThreadBufferOwner() noexcept {
+        if (buffer) {
+            buffer->inUse.store(false, std::memory_order_relaxed);
+        }
+    }
+};
+
+thread_local ThreadBufferOwner tThreadBuffer;
+
+// time at which recording started, in nanoseconds
+std::atomic<int64_t> sOrigin = { 0 };
+
+int64_t now() noexcept {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UTILS_NOINLINE
+ThreadBuffer* acquireThreadBuffer() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    ThreadBuffer* buffer = nullptr;
+    for (auto const& b : registry.buffers) {
+        // the events of an exited thread are lost when its buffer is reused
+        if (!b->inUse.load(std::memory_order_relaxed)) {
+            buffer = b.get();
+            buffer->head.store(0, std::memory_order_relaxed);
+            buffer->inUse.store(true, std::memory_order_relaxed);
+            break;
+        }
+    }
+    if (!buffer) {
+        registry.buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = registry.buffers.back().get();
+        buffer->tid = uint32_t(registry.buffers.size());
+    }
+#if defined(__linux__) || defined(__APPLE__)
+    pthread_getname_np(pthread_self(), buffer->threadName, sizeof(buffer->threadName));
+#else
+    snprintf(buffer->threadName, sizeof(buffer->threadName), "thread %u", buffer->tid);
+#endif
+    return buffer;
+}
+
+const char* getCategory(uint8_t tag) noexcept {
+    switch (tag) {
+        case SYSTRACE_TAG_FILAMENT:  return "filament";
+        case SYSTRACE_TAG_JOBSYSTEM: return "jobsystem";
+        default:                     return "always";
+    }
+}
+
+void writeString(FILE* file, const char* s) noexcept {
+    fputc('"', file);
+    for (; *s; s++) {
+        const char c = *s;
+        if (c == '"' || c == '\\') {
+            fputc('\\', file);
+            fputc(c, file);
+        } else if ((unsigned char)c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+} // anonymous namespace
+
+std::atomic<uint32_t> Systrace::sRecordedTags = { 0 };
+
+void Systrace::updateRecordedTags() noexcept {
+    Registry const& registry = getRegistry();
+    sRecordedTags.store(registry.recording ? (registry.enabledTags | SYSTRACE_TAG_ALWAYS) : 0,
+            std::memory_order_relaxed);
+}
+
+void Systrace::enable(uint32_t tags) noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.enabledTags |= tags;
+    updateRecordedTags();
+}
+
+void Systrace::disable(uint32_t tags) noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.enabledTags &= ~tags;
+    updateRecordedTags();
+}
+
+void Systrace::startRecording() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    for (auto const& buffer : registry.buffers) {
+        buffer->head.store(0, std::memory_order_relaxed);
+    }
+    sOrigin.store(now(), std::memory_order_relaxed);
+    registry.recording = true;
+    updateRecordedTags();
+}
+
+void Systrace::stopRecording() noexcept {
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+    registry.recording = false;
+    updateRecordedTags();
+}
+
+void Systrace::record(EventType type, uint32_t tag, const char* name, int64_t value) noexcept {
+    ThreadBuffer* buffer = tThreadBuffer.buffer;
+    if (UTILS_UNLIKELY(!buffer)) {
+        buffer = tThreadBuffer.buffer = acquireThreadBuffer();
+    }
+
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    Event& event = buffer->events[head & (EVENTS_PER_THREAD - 1)];
+    event.time = now() - sOrigin.load(std::memory_order_relaxed);
+    event.value = value;
+    event.type = type;
+    event.tag = uint8_t(tag);
+    if (name) {
+        strncpy(event.name, name, MAX_NAME_LENGTH);
+        event.name[MAX_NAME_LENGTH] = '\0';
+    } else {
+        event.name[0] = '\0';
+    }
+    // publish the event to exportChromeTrace()
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Systrace::exportChromeTrace(const char* path) noexcept {
+    FILE* file = fopen(path, "w");
+    if (UTILS_UNLIKELY(!file)) {
+        slog.e << "Error opening trace file: " << path << io::endl;
+        return false;
+    }
+
+    Registry& registry = getRegistry();
+    std::lock_guard<std::mutex> guard(registry.lock);
+
+    fputs("{\"traceEvents\":[", file);
+    const char* separator = "\n";
+    for (auto const& buffer : registry.buffers) {
+        const uint64_t head = buffer->head.load(std::memory_order_acquire);
+        if (!head) {
+            continue;
+        }
+
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                "\"args\":{\"name\":", separator, buffer->tid);
+        writeString(file, buffer->threadName);
+        fputs("}}", file);
+        separator = ",\n";
+
+        // when the buffer has wrapped around, the beginning of the oldest scopes are lost
+        uint32_t depth = 0;
+        const uint64_t first = head > EVENTS_PER_THREAD ? head - EVENTS_PER_THREAD : 0;
+        for (uint64_t i = first; i < head; i++) {
+            Event const& event = buffer->events[i & (EVENTS_PER_THREAD - 1)];
+            if (event.type == END) {
+                if (!depth) {
+                    continue;
+                }
+                depth--;
+                fprintf(file, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                        separator, double(event.time) * 1e-3, buffer->tid);
+                continue;
+            }
+
+            fprintf(file, "%s{\"name\":", separator);
+            writeString(file, event.name);
+            fprintf(file, ",\"cat\":\"%s\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,",
+                    getCategory(event.tag), double(event.time) * 1e-3, buffer->tid);
+            switch (event.type) {
+                case BEGIN:
+                    depth++;
+                    fputs("\"ph\":\"B\"}", file);
+                    break;
+                case ASYNC_BEGIN:
+                    fprintf(file, "\"ph\":\"b\",\"id\":%" PRId64 "}", event.value);
+                    break;
+                case ASYNC_END:
+                    fprintf(file, "\"ph\":\"e\",\"id\":%" PRId64 "}", event.value);
+                    break;
+                case VALUE:
+                    fprintf(file, "\"ph\":\"C\",\"args\":{\"value\":%" PRId64 "}}",
+                            event.value);
+                    break;
+                case END:
+                    break;
+            }
+        }
+    }
+    fputs("\n]}\n", file);
+
+    return fclose(file) == 0;
+}
+
+} // namespace details
+} // namespace utils
+
 #endif // ANDROID
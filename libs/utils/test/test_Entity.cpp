@@ -17,6 +17,7 @@
 #include <gtest/gtest.h>
 
 #include <memory>
+#include <thread>
 
 #include "../src/EntityManagerImpl.h"
 #include <utils/NameComponentManager.h>
@@ -176,3 +177,74 @@ TEST(EntityTest, NameComponent) {
 
     cm.gc(em);
 }
+
+TEST(EntityTest, ConcurrentCreate) {
+    EntityManagerImpl em;
+    constexpr size_t COUNT = 4096;
+    std::unique_ptr<Entity[]> entities(new Entity[COUNT * 2]);
+    std::thread t([&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            entities[i] = em.create();
+        }
+    });
+    for (size_t i = 0; i < COUNT; i++) {
+        entities[COUNT + i] = em.create();
+    }
+    t.join();
+
+    // all the entities are distinct
+    std::sort(entities.get(), entities.get() + COUNT * 2);
+    EXPECT_TRUE(std::adjacent_find(entities.get(), entities.get() + COUNT * 2) ==
+            entities.get() + COUNT * 2);
+    em.destroy(COUNT * 2, entities.get());
+}
+
+TEST(EntityTest, DestroyedEntities) {
+    EntityManagerImpl em;
+    Entity entities[8];
+    em.create(8, entities);
+
+    EntityManager::DestroyedCursor cursor = 0;
+    Entity destroyed[8];
+    bool lost = false;
+    EXPECT_EQ(0, em.readDestroyedEntities(cursor, destroyed, 8, lost));
+
+    em.destroy(3, entities);
+    EXPECT_EQ(2, em.readDestroyedEntities(cursor, destroyed, 2, lost));
+    EXPECT_EQ(entities[0], destroyed[0]);
+    EXPECT_EQ(entities[1], destroyed[1]);
+    EXPECT_EQ(1, em.readDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_EQ(entities[2], destroyed[0]);
+    EXPECT_EQ(0, em.readDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_FALSE(lost);
+
+    // a reader that falls too far behind is told it lost some
+    for (size_t i = 0; i < DESTROYED_ENTITIES_COUNT; i++) {
+        Entity e = em.create();
+        em.destroy(e);
+    }
+    cursor = 0;
+    EXPECT_EQ(8, em.readDestroyedEntities(cursor, destroyed, 8, lost));
+    EXPECT_TRUE(lost);
+}
+
+TEST(EntityTest, NameComponentGc) {
+    EntityManagerImpl em;
+    NameComponentManager cm(em);
+
+    Entity entities[8];
+    em.create(8, entities);
+    for (auto e : entities) {
+        cm.addComponent(e);
+    }
+
+    em.destroy(4, entities + 2);
+    cm.gc(em);
+    EXPECT_EQ(4, cm.getComponentCount());
+    EXPECT_TRUE(cm.hasComponent(entities[0]));
+    EXPECT_TRUE(cm.hasComponent(entities[1]));
+    EXPECT_FALSE(cm.hasComponent(entities[2]));
+    EXPECT_FALSE(cm.hasComponent(entities[5]));
+    EXPECT_TRUE(cm.hasComponent(entities[6]));
+    EXPECT_TRUE(cm.hasComponent(entities[7]));
+}
@@ -22,6 +22,7 @@
 #include <math/vec3.h>
 #include <math/mat3.h>
 
+#include <algorithm>
 #include <array>
 #include <thread>
 #include <utils/Allocator.h>
@@ -218,6 +219,97 @@ TEST(JobSystem, JobSystemParallelChildren) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemManyChildren) {
+    JobSystem js;
+    js.adopt();
+
+    struct User {
+        std::atomic_int calls = {0};
+        void func(JobSystem&, JobSystem::Job*) {
+            calls++;
+        };
+    } j;
+
+    // more jobs than the initial size of the job pool
+    JobSystem::Job* root = js.createJob<User, &User::func>(nullptr, &j);
+    for (int i=0 ; i<10000 ; i++) {
+        JobSystem::Job* job = js.createJob<User, &User::func>(root, &j);
+        ASSERT_NE(nullptr, job);
+        js.run(job, JobSystem::DONT_SIGNAL);
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(10001, j.calls);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemBackgroundChildren) {
+    JobSystem js;
+    js.adopt();
+
+    struct User {
+        std::atomic_int backgroundCalls = {0};
+        std::atomic_int calls = {0};
+        void background(JobSystem& js, JobSystem::Job* job) {
+            // jobs created by a background job are regular jobs
+            JobSystem::Job* child = js.createJob<User, &User::func>(job, this);
+            js.runAndWait(child);
+            backgroundCalls++;
+        };
+        void func(JobSystem&, JobSystem::Job*) {
+            calls++;
+        };
+    } j;
+
+    JobSystem::Job* root = js.createJob(nullptr);
+    for (int i=0 ; i<64 ; i++) {
+        js.run(js.createJob<User, &User::background>(root, &j), JobSystem::BACKGROUND);
+        js.run(js.createJob<User, &User::func>(root, &j));
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(64, j.backgroundCalls);
+    EXPECT_EQ(128, j.calls);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemRunAfter) {
+    JobSystem js;
+    js.adopt();
+
+    std::atomic_int order = {0};
+    int a = -1, b = -1, c = -1, d = -1;
+
+    JobSystem::Job* jobA = jobs::createJob(js, nullptr, [&] { a = order++; });
+    JobSystem::Job* jobB = jobs::createJob(js, nullptr, [&] { b = order++; });
+    JobSystem::Job* jobC = jobs::createJob(js, nullptr, [&] { c = order++; });
+    JobSystem::Job* retainedA = js.retain(jobA);
+    JobSystem::Job* retainedB = js.runAndRetain(jobB);
+    JobSystem::Job* retainedC = js.retain(jobC);
+
+    // c depends on a which hasn't run yet, and on b which might have finished already
+    js.runAfter(jobC, { retainedA, retainedB });
+    js.release(retainedB);
+    js.run(jobA);
+    js.waitAndRelease(retainedC);
+
+    EXPECT_EQ(2, c);
+    EXPECT_NE(a, b);
+
+    // d depends on a job that has finished
+    JobSystem::Job* jobD = jobs::createJob(js, nullptr, [&] { d = order++; });
+    JobSystem::Job* retainedD = js.retain(jobD);
+    js.runAfter(jobD, { retainedA });
+    js.release(retainedA);
+    js.waitAndRelease(retainedD);
+
+    EXPECT_EQ(3, d);
+
+    js.emancipate();
+}
+
 
 TEST(JobSystem, JobSystemSequentialChildren) {
     JobSystem js;
@@ -284,6 +376,148 @@ TEST(JobSystem, JobSystemParallelFor) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemParallelForAdaptiveSplitter) {
+    JobSystem js;
+    js.adopt();
+
+    AdaptiveSplitter<4>::Cost cost;
+    for (size_t n = 0; n < 2; n++) {
+        std::vector<int> items(4096 * 16, 0);
+        auto work = [&items](uint32_t start, uint32_t count) {
+            for (uint32_t i = start; i < start + count; i++) {
+                items[i]++;
+            }
+        };
+        JobSystem::Job* job = parallel_for(js, nullptr, 0, uint32_t(items.size()),
+                std::cref(work), AdaptiveSplitter<4>(js, cost));
+        js.runAndWait(job);
+
+        // the second loop is split from the cost measured by the first one
+        for (int item : items) {
+            EXPECT_EQ(1, item);
+        }
+        EXPECT_GT(cost.nanosecondsPerItem.load(), 0.0f);
+    }
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemStatistics) {
+    JobSystem js;
+    js.adopt();
+
+    // nothing is collected until enabled
+    js.runAndWait(js.createJob());
+    std::vector<JobSystem::Statistics> statistics(js.getStatistics(nullptr, 0));
+    js.getStatistics(statistics.data(), statistics.size());
+    for (auto const& s : statistics) {
+        EXPECT_EQ(0, s.executedJobs);
+    }
+
+    js.setStatisticsEnabled(true);
+    JobSystem::Job* root = js.createJob();
+    for (int i=0 ; i<256 ; i++) {
+        js.run(js.createJob(root), JobSystem::DONT_SIGNAL);
+    }
+    js.runAndWait(root);
+    js.setStatisticsEnabled(false);
+
+    js.getStatistics(statistics.data(), statistics.size());
+    uint32_t executedJobs = 0;
+    uint32_t durations = 0;
+    for (auto const& s : statistics) {
+        executedJobs += s.executedJobs;
+        for (uint32_t count : s.durations) {
+            durations += count;
+        }
+    }
+    EXPECT_EQ(257, executedJobs);
+    EXPECT_EQ(257, durations);
+
+    js.resetStatistics();
+    js.getStatistics(statistics.data(), statistics.size());
+    for (auto const& s : statistics) {
+        EXPECT_EQ(0, s.executedJobs);
+    }
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemScratchArena) {
+    JobSystem js;
+    js.adopt();
+
+    struct User {
+        std::atomic_int allocations = {0};
+        void func(JobSystem& js, JobSystem::Job*) {
+            JobSystem::ScratchArena& arena = js.getScratchArena();
+            uint32_t* p = arena.alloc<uint32_t>(256);
+            if (p) {
+                std::fill_n(p, 256, 42u);
+                allocations++;
+            }
+        };
+    } j;
+
+    JobSystem::Job* root = js.createJob();
+    for (int i=0 ; i<64 ; i++) {
+        js.run(js.createJob<User, &User::func>(root, &j));
+    }
+    js.runAndWait(root);
+    EXPECT_EQ(64, j.allocations);
+
+    // allocations fail once the arena is full, resetting frees all of its memory
+    js.resetScratchArenas();
+    JobSystem::ScratchArena& arena = js.getScratchArena();
+    EXPECT_EQ(nullptr, arena.alloc(JobSystem::SCRATCH_ARENA_SIZE + 1));
+    void* p = arena.alloc(1024);
+    EXPECT_NE(nullptr, p);
+    EXPECT_NE(p, arena.alloc(1024));
+    js.resetScratchArenas();
+    EXPECT_EQ(p, arena.alloc(1024));
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemScratchArenaRunningJob) {
+    JobSystem js;
+    if (js.getThreadCount() == 0) {
+        return;
+    }
+    js.adopt();
+
+    // a job running while the arenas are reset keeps its memory
+    struct User {
+        std::atomic_bool allocated = { false };
+        std::atomic_bool reset = { false };
+        bool preserved = false;
+        void func(JobSystem& js, JobSystem::Job*) {
+            JobSystem::ScratchArena& arena = js.getScratchArena();
+            uint32_t* p = arena.alloc<uint32_t>(256);
+            std::fill_n(p, 256, 42u);
+            allocated = true;
+            while (!reset) {
+                std::this_thread::yield();
+            }
+            uint32_t* q = arena.alloc<uint32_t>(256);
+            std::fill_n(q, 256, 0u);
+            preserved = q != p && std::all_of(p, p + 256, [](uint32_t v) { return v == 42u; });
+        };
+    } j;
+
+    // the adopted thread doesn't execute jobs until runAndWait(), a thread of the pool runs it
+    JobSystem::Job* job = js.runAndRetain(js.createJob<User, &User::func>(nullptr, &j));
+    while (!j.allocated) {
+        std::this_thread::yield();
+    }
+    js.resetScratchArenas();
+    j.reset = true;
+    js.waitAndRelease(job);
+    EXPECT_TRUE(j.preserved);
+
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemDelegates) {
     JobSystem js;
     js.adopt();
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/JobSystem.h>
+#include <utils/RadixSort.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace utils;
+
+struct Item {
+    uint64_t key;
+    uint32_t index;
+};
+
+static std::vector<Item> sorted(JobSystem& js, std::vector<Item> items) {
+    std::vector<Item> scratch(items.size());
+    jobs::radix_sort(js, items.data(), items.data() + items.size(), scratch.data(),
+            [](Item const& item) { return item.key; });
+    return items;
+}
+
+static void expectStableSort(std::vector<Item> const& items, std::vector<Item> const& result) {
+    std::vector<Item> expected(items);
+    std::stable_sort(expected.begin(), expected.end(),
+            [](Item const& lhs, Item const& rhs) { return lhs.key < rhs.key; });
+    ASSERT_EQ(expected.size(), result.size());
+    for (size_t i = 0; i < expected.size(); i++) {
+        EXPECT_EQ(expected[i].key, result[i].key);
+        EXPECT_EQ(expected[i].index, result[i].index);
+    }
+}
+
+TEST(RadixSort, Small) {
+    JobSystem js;
+    js.adopt();
+
+    EXPECT_TRUE(sorted(js, {}).empty());
+
+    std::vector<Item> items = { { 3, 0 }, { 1, 1 }, { 2, 2 }, { 1, 3 }, { 0, 4 } };
+    expectStableSort(items, sorted(js, items));
+
+    js.emancipate();
+}
+
+TEST(RadixSort, Random) {
+    JobSystem js;
+    js.adopt();
+
+    std::default_random_engine gen; // NOLINT
+    std::uniform_int_distribution<uint64_t> rand;
+
+    // large enough to be split in many chunks, with all digits varying
+    std::vector<Item> items(64 * 4096 + 17);
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i] = { rand(gen), uint32_t(i) };
+    }
+    expectStableSort(items, sorted(js, items));
+
+    js.emancipate();
+}
+
+TEST(RadixSort, FewVaryingDigits) {
+    JobSystem js;
+    js.adopt();
+
+    std::default_random_engine gen; // NOLINT
+    std::uniform_int_distribution<uint64_t> rand(0, 15);
+
+    // only one digit varies (odd number of passes) and there are many duplicates
+    std::vector<Item> items(3 * 4096);
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i] = { 0xF00D000000000000llu | (rand(gen) << 16u), uint32_t(i) };
+    }
+    expectStableSort(items, sorted(js, items));
+
+    // all keys are equal
+    for (size_t i = 0; i < items.size(); i++) {
+        items[i].key = 42;
+    }
+    expectStableSort(items, sorted(js, items));
+
+    js.emancipate();
+}
@@ -173,3 +173,22 @@ TEST(StructureOfArraysTest, Simple) {
     soa.push_back(0.0f, 1.0, std::move(destroyedFloat4));
 }
 
+
+TEST(StructureOfArraysTest, Permute) {
+    SoA soa(8);
+    for (size_t i = 0; i < 8; i++) {
+        soa.push_back(float(i), double(i * 2), TestFloat4{ float(i * 4) });
+    }
+    float const* const data = soa.data<0>();
+
+    // the first and last elements stay in place
+    const uint32_t order[8] = { 0, 5, 1, 6, 2, 3, 4, 7 };
+    soa.permute(order);
+
+    EXPECT_EQ(data, soa.data<0>());
+    for (size_t i = 0; i < 8; i++) {
+        EXPECT_EQ(order[i], soa.elementAt<0>(i));
+        EXPECT_EQ(order[i] * 2, soa.elementAt<1>(i));
+        EXPECT_EQ(TestFloat4{ float(order[i] * 4) }, soa.elementAt<2>(i));
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/Systrace.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#if !defined(ANDROID)
+
+static std::string readFile(std::string const& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static size_t count(std::string const& s, std::string const& what) {
+    size_t n = 0;
+    for (size_t pos = s.find(what); pos != std::string::npos; pos = s.find(what, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+TEST(SystraceTest, NotRecording) {
+    const std::string path = testing::TempDir() + "systrace_not_recording.json";
+
+    SYSTRACE_START_RECORDING();
+    SYSTRACE_STOP_RECORDING();
+    {
+        SYSTRACE_NAME("ignored");
+    }
+    EXPECT_TRUE(SYSTRACE_EXPORT(path.c_str()));
+
+    std::string trace = readFile(path);
+    EXPECT_EQ(0, count(trace, "ignored"));
+}
+
+TEST(SystraceTest, Export) {
+    const std::string path = testing::TempDir() + "systrace_export.json";
+
+    SYSTRACE_START_RECORDING();
+    {
+        SYSTRACE_NAME("main \"scope\"");
+        SYSTRACE_VALUE32("counter", 42);
+        std::thread thread([]() {
+            SYSTRACE_NAME("thread scope");
+        });
+        thread.join();
+    }
+    SYSTRACE_STOP_RECORDING();
+    EXPECT_TRUE(SYSTRACE_EXPORT(path.c_str()));
+
+    std::string trace = readFile(path);
+    EXPECT_EQ(0, trace.find("{\"traceEvents\":["));
+    EXPECT_EQ(1, count(trace, "\"main \\\"scope\\\"\""));
+    EXPECT_EQ(1, count(trace, "\"thread scope\""));
+    EXPECT_EQ(1, count(trace, "\"args\":{\"value\":42}"));
+    EXPECT_EQ(2, count(trace, "\"ph\":\"B\""));
+    EXPECT_EQ(2, count(trace, "\"ph\":\"E\""));
+    EXPECT_EQ(2, count(trace, "\"thread_name\""));
+}
+
+#endif
@@ -19,6 +19,10 @@
 
 #include <viewer/AutomationSpec.h>
 
+#include <string>
+#include <utility>
+#include <vector>
+
 namespace filament {
 
 class MaterialInstance;
@@ -44,6 +48,11 @@ namespace viewer {
  * the first test case until the client unblocks it via signalBatchMode(). This is useful when
  * waiting for a large model file to become fully loaded. Batch mode also offers a query
  * (shouldClose) that is triggered after the last screenshot has been written to disk.
+ *
+ * In benchmark mode (see Options::measuredFrameCount), each test renders a number of warm-up
+ * frames and then a number of measured frames, whose CPU frame times, GPU pass timings and
+ * backend counters are averaged. The results of all tests are written to benchmark.json and
+ * benchmark.csv after the last test.
  */
 class AutomationEngine {
 public:
@@ -91,6 +100,32 @@ public:
 
         // If true, test progress is dumped to the utils Log (info priority).
         bool verbose = true;
+
+        // If non-zero, each test is benchmarked over this many frames, rendered after the
+        // warm-up frames. This adds to the minimum frame count.
+        int measuredFrameCount = 0;
+
+        // Frames rendered with the settings of a test before it is measured in benchmark mode.
+        int warmupFrameCount = 30;
+    };
+
+    // Measurements of a test in benchmark mode. Times are in milliseconds, the GPU timings and the
+    // backend counters are 0 when the backend doesn't report them.
+    struct BenchmarkResult {
+        std::string name;
+        int frameCount = 0;
+        float minFrameTime = 0;
+        float meanFrameTime = 0;
+        float maxFrameTime = 0;
+        float meanGpuTime = 0;
+        float meanCullingTime = 0;
+        float meanCommandGenerationTime = 0;
+        float meanCommandSortingTime = 0;
+        std::vector<std::pair<std::string, float>> meanPassGpuTimes;
+        float meanDrawCount = 0;
+        float meanPipelineChangeCount = 0;
+        float meanProgramChangeCount = 0;
+        float meanRenderPassCount = 0;
     };
 
     Options getOptions() const { return mOptions; }
@@ -102,8 +137,18 @@ public:
     bool shouldClose() const { return mShouldClose; }
     bool isBatchModeEnabled() const { return mBatchModeEnabled; }
     const char* getStatusMessage() const;
+    const std::vector<BenchmarkResult>& getBenchmarkResults() const { return mBenchmarkResults; }
+
+    // Convenience functions that write out benchmark results to disk.
+    static void exportBenchmarkJson(const std::vector<BenchmarkResult>& results,
+            const char* filename);
+    static void exportBenchmarkCsv(const std::vector<BenchmarkResult>& results,
+            const char* filename);
 
 private:
+    void measureFrame(Renderer* renderer, float deltaTime);
+    void finishBenchmark(std::string name);
+
     AutomationSpec const * const mSpec;
     Settings * const mSettings;
     Options mOptions;
@@ -117,6 +162,13 @@ private:
     bool mBatchModeAllowed = false;
     bool mTerminated = false;
 
+    // Sums of the measurements of the current test in benchmark mode.
+    BenchmarkResult mBenchmark;
+    int mTimingCount = 0;
+    int mStatisticsCount = 0;
+    uint32_t mLastFrameId = 0;
+    std::vector<BenchmarkResult> mBenchmarkResults;
+
 public:
     // For internal use from a screenshot callback.
     void requestClose() { mShouldClose = true; }
@@ -20,14 +20,17 @@
 
 #include <image/ColorTransform.h>
 
+#include <filament/Engine.h>
 #include <filament/Renderer.h>
 #include <filament/Viewport.h>
 
+#include <backend/DriverEnums.h>
 #include <backend/PixelBufferDescriptor.h>
 
 #include <utils/Log.h>
 #include <utils/Path.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
@@ -109,11 +112,169 @@ void AutomationEngine::exportSettings(const Settings& settings, const char* file
     gStatus = "Exported to '" + std::string(filename) + "' in the current folder.";
 }
 
+void AutomationEngine::exportBenchmarkJson(const std::vector<BenchmarkResult>& results,
+        const char* filename) {
+    std::ofstream out(filename);
+    if (!out) {
+        gStatus = "Failed to export benchmark file.";
+        return;
+    }
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        out << "    {\n"
+            << "        \"name\": \"" << result.name << "\",\n"
+            << "        \"frameCount\": " << result.frameCount << ",\n"
+            << "        \"minFrameTime\": " << result.minFrameTime << ",\n"
+            << "        \"meanFrameTime\": " << result.meanFrameTime << ",\n"
+            << "        \"maxFrameTime\": " << result.maxFrameTime << ",\n"
+            << "        \"meanGpuTime\": " << result.meanGpuTime << ",\n"
+            << "        \"meanCullingTime\": " << result.meanCullingTime << ",\n"
+            << "        \"meanCommandGenerationTime\": " << result.meanCommandGenerationTime
+            << ",\n"
+            << "        \"meanCommandSortingTime\": " << result.meanCommandSortingTime << ",\n"
+            << "        \"meanPassGpuTimes\": {";
+        for (size_t j = 0; j < result.meanPassGpuTimes.size(); j++) {
+            out << (j ? ", " : "") << "\"" << result.meanPassGpuTimes[j].first << "\": "
+                << result.meanPassGpuTimes[j].second;
+        }
+        out << "},\n"
+            << "        \"meanDrawCount\": " << result.meanDrawCount << ",\n"
+            << "        \"meanPipelineChangeCount\": " << result.meanPipelineChangeCount << ",\n"
+            << "        \"meanProgramChangeCount\": " << result.meanProgramChangeCount << ",\n"
+            << "        \"meanRenderPassCount\": " << result.meanRenderPassCount << "\n"
+            << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]" << std::endl;
+    gStatus = "Exported to '" + std::string(filename) + "' in the current folder.";
+}
+
+void AutomationEngine::exportBenchmarkCsv(const std::vector<BenchmarkResult>& results,
+        const char* filename) {
+    std::ofstream out(filename);
+    if (!out) {
+        gStatus = "Failed to export benchmark file.";
+        return;
+    }
+
+    // The passes get a column each, in order of first appearance.
+    std::vector<std::string> passes;
+    for (const BenchmarkResult& result : results) {
+        for (const auto& pass : result.meanPassGpuTimes) {
+            if (std::find(passes.begin(), passes.end(), pass.first) == passes.end()) {
+                passes.push_back(pass.first);
+            }
+        }
+    }
+
+    out << "name,frameCount,minFrameTime,meanFrameTime,maxFrameTime,meanGpuTime,"
+            "meanCullingTime,meanCommandGenerationTime,meanCommandSortingTime,"
+            "meanDrawCount,meanPipelineChangeCount,meanProgramChangeCount,meanRenderPassCount";
+    for (const std::string& pass : passes) {
+        out << "," << pass;
+    }
+    out << "\n";
+
+    for (const BenchmarkResult& result : results) {
+        out << result.name << "," << result.frameCount << ","
+            << result.minFrameTime << "," << result.meanFrameTime << ","
+            << result.maxFrameTime << "," << result.meanGpuTime << ","
+            << result.meanCullingTime << "," << result.meanCommandGenerationTime << ","
+            << result.meanCommandSortingTime << "," << result.meanDrawCount << ","
+            << result.meanPipelineChangeCount << "," << result.meanProgramChangeCount << ","
+            << result.meanRenderPassCount;
+        for (const std::string& pass : passes) {
+            auto iter = std::find_if(result.meanPassGpuTimes.begin(),
+                    result.meanPassGpuTimes.end(),
+                    [&pass](const auto& entry) { return entry.first == pass; });
+            out << ",";
+            if (iter != result.meanPassGpuTimes.end()) {
+                out << iter->second;
+            }
+        }
+        out << "\n";
+    }
+    out.flush();
+    gStatus = "Exported to '" + std::string(filename) + "' in the current folder.";
+}
+
+void AutomationEngine::measureFrame(Renderer* renderer, float deltaTime) {
+    BenchmarkResult& result = mBenchmark;
+    const float frameTime = deltaTime * 1000.0f;
+    result.minFrameTime = result.frameCount ? std::min(result.minFrameTime, frameTime) : frameTime;
+    result.maxFrameTime = std::max(result.maxFrameTime, frameTime);
+    result.meanFrameTime += frameTime;
+    result.frameCount++;
+
+    // GPU timings lag a few frames behind, only count each frame once.
+    const Renderer::FrameTimings timings = renderer->getFrameTimings();
+    if (timings.frameId != 0 && timings.frameId != mLastFrameId) {
+        mLastFrameId = timings.frameId;
+        result.meanGpuTime += timings.gpuTime * 1000.0f;
+        result.meanCullingTime += timings.cullingTime * 1000.0f;
+        result.meanCommandGenerationTime += timings.commandGenerationTime * 1000.0f;
+        result.meanCommandSortingTime += timings.commandSortingTime * 1000.0f;
+        for (size_t i = 0; i < timings.passCount; i++) {
+            const char* name = timings.passes[i].name;
+            auto iter = std::find_if(result.meanPassGpuTimes.begin(),
+                    result.meanPassGpuTimes.end(),
+                    [name](const auto& entry) { return entry.first == name; });
+            if (iter == result.meanPassGpuTimes.end()) {
+                result.meanPassGpuTimes.emplace_back(name, 0.0f);
+                iter = result.meanPassGpuTimes.end() - 1;
+            }
+            iter->second += timings.passes[i].gpuTime * 1000.0f;
+        }
+        mTimingCount++;
+    }
+
+    backend::FrameStatistics statistics;
+    if (renderer->getEngine()->getBackendFrameStatistics(&statistics)) {
+        result.meanDrawCount += float(statistics.drawCount);
+        result.meanPipelineChangeCount += float(statistics.pipelineChangeCount);
+        result.meanProgramChangeCount += float(statistics.programChangeCount);
+        result.meanRenderPassCount += float(statistics.renderPassCount);
+        mStatisticsCount++;
+    }
+}
+
+void AutomationEngine::finishBenchmark(std::string name) {
+    BenchmarkResult& result = mBenchmark;
+    result.name = std::move(name);
+    if (result.frameCount) {
+        result.meanFrameTime /= float(result.frameCount);
+    }
+    if (mTimingCount) {
+        const float scale = 1.0f / float(mTimingCount);
+        result.meanGpuTime *= scale;
+        result.meanCullingTime *= scale;
+        result.meanCommandGenerationTime *= scale;
+        result.meanCommandSortingTime *= scale;
+        for (auto& pass : result.meanPassGpuTimes) {
+            pass.second *= scale;
+        }
+    }
+    if (mStatisticsCount) {
+        const float scale = 1.0f / float(mStatisticsCount);
+        result.meanDrawCount *= scale;
+        result.meanPipelineChangeCount *= scale;
+        result.meanProgramChangeCount *= scale;
+        result.meanRenderPassCount *= scale;
+    }
+    mBenchmarkResults.push_back(std::move(result));
+}
+
 void AutomationEngine::tick(View* view, MaterialInstance* const* materials, size_t materialCount,
         Renderer* renderer, float deltaTime) {
+    const bool benchmarking = mOptions.measuredFrameCount > 0;
+
     const auto activateTest = [this, view, materials, materialCount]() {
         mElapsedTime = 0;
         mElapsedFrames = 0;
+        mBenchmark = {};
+        mTimingCount = 0;
+        mStatisticsCount = 0;
+        mLastFrameId = 0;
         mSpec->get(mCurrentTest, mSettings);
         applySettings(mSettings->view, view);
         for (size_t i = 0; i < materialCount; i++) {
@@ -130,6 +291,10 @@ void AutomationEngine::tick(View* view, MaterialInstance* const* materials, size
                 mIsRunning = true;
                 mRequestStart = false;
                 mCurrentTest = 0;
+                mBenchmarkResults.clear();
+                if (benchmarking) {
+                    renderer->setPassTimingsEnabled(true);
+                }
                 activateTest();
             }
         }
@@ -139,10 +304,18 @@ void AutomationEngine::tick(View* view, MaterialInstance* const* materials, size
     mElapsedTime += deltaTime;
     mElapsedFrames++;
 
+    if (benchmarking && mElapsedFrames > mOptions.warmupFrameCount) {
+        measureFrame(renderer, deltaTime);
+    }
+
     if (mElapsedTime < mOptions.sleepDuration || mElapsedFrames < mOptions.minFrameCount) {
         return;
     }
 
+    if (benchmarking && mBenchmark.frameCount < mOptions.measuredFrameCount) {
+        return;
+    }
+
     const bool isLastTest = mCurrentTest == mSpec->size() - 1;
 
     const int digits = (int) log10 ((double) mSpec->size()) + 1;
@@ -151,6 +324,15 @@ void AutomationEngine::tick(View* view, MaterialInstance* const* materials, size
             << std::setfill('0') << std::setw(digits) << mCurrentTest;
     std::string prefix = stringStream.str();
 
+    if (benchmarking) {
+        finishBenchmark(prefix);
+        if (mOptions.verbose) {
+            utils::slog.i << "Test " << mCurrentTest << ": "
+                    << mBenchmarkResults.back().meanFrameTime << " ms per frame"
+                    << utils::io::endl;
+        }
+    }
+
     if (mOptions.exportSettings) {
         std::string filename = prefix + ".json";
         exportSettings(*mSettings, filename.c_str());
@@ -162,6 +344,11 @@ void AutomationEngine::tick(View* view, MaterialInstance* const* materials, size
 
     if (isLastTest) {
         mIsRunning = false;
+        if (benchmarking) {
+            renderer->setPassTimingsEnabled(false);
+            exportBenchmarkJson(mBenchmarkResults, "benchmark.json");
+            exportBenchmarkCsv(mBenchmarkResults, "benchmark.csv");
+        }
         if (mBatchModeEnabled && !mOptions.exportScreenshots) {
             mShouldClose = true;
         }
@@ -225,6 +225,8 @@ static int parse(jsmntok_t const* tokens, int i, const char* jsonChunk,
             i = parse(tokens, i + 1, jsonChunk, &out->feedback);
         } else if (compare(tok, jsonChunk, "enabled") == 0) {
             i = parse(tokens, i + 1, jsonChunk, &out->enabled);
+        } else if (compare(tok, jsonChunk, "upscaling") == 0) {
+            i = parse(tokens, i + 1, jsonChunk, &out->upscaling);
         } else {
             slog.w << "Invalid taa key: '" << STR(tok, jsonChunk) << "'" << io::endl;
             i = parse(tokens, i + 1);
@@ -361,6 +363,10 @@ static int parse(jsmntok_t const* tokens, int i, const char* jsonChunk,
             i = parse(tokens, i + 1, jsonChunk, &out->enabled);
         } else if (compare(tok, jsonChunk, "minHorizonAngleRad") == 0) {
             i = parse(tokens, i + 1, jsonChunk, &out->minHorizonAngleRad);
+        } else if (compare(tok, jsonChunk, "temporalFiltering") == 0) {
+            i = parse(tokens, i + 1, jsonChunk, &out->temporalFiltering);
+        } else if (compare(tok, jsonChunk, "temporalFeedback") == 0) {
+            i = parse(tokens, i + 1, jsonChunk, &out->temporalFeedback);
         } else if (compare(tok, jsonChunk, "ssct") == 0) {
             i = parse(tokens, i + 1, jsonChunk, &out->ssct);
         } else {
@@ -852,7 +858,8 @@ std::string writeJson(const TemporalAntiAliasingOptions& in) {
     oss << "{\n"
         << "\"filterWidth\": " << writeJson(in.filterWidth) << ",\n"
         << "\"feedback\": " << writeJson(in.feedback) << ",\n"
-        << "\"enabled\": " << writeJson(in.enabled) << "\n"
+        << "\"enabled\": " << writeJson(in.enabled) << ",\n"
+        << "\"upscaling\": " << writeJson(in.upscaling) << "\n"
         << "}";
     return oss.str();
 }
@@ -914,6 +921,8 @@ std::string writeJson(const AmbientOcclusionOptions& in) {
         << "\"upsampling\": " << writeJson(in.upsampling) << ",\n"
         << "\"enabled\": " << writeJson(in.enabled) << ",\n"
         << "\"minHorizonAngleRad\": " << writeJson(in.minHorizonAngleRad) << ",\n"
+        << "\"temporalFiltering\": " << writeJson(in.temporalFiltering) << ",\n"
+        << "\"temporalFeedback\": " << writeJson(in.temporalFeedback) << ",\n"
         << "\"ssct\": " << writeJson(in.ssct) << "\n"
         << "}";
     return oss.str();
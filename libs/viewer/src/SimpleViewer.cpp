@@ -281,6 +281,9 @@ void SimpleViewer::updateUserInterface() {
         enableMsaa(msaa);
 
         ImGui::Checkbox("TAA", &mSettings.view.taa.enabled);
+        ImGui::Indent();
+        ImGui::Checkbox("Upscaling", &mSettings.view.taa.upscaling);
+        ImGui::Unindent();
 
         // this clutters the UI and isn't that useful (except when working on TAA)
         //ImGui::Indent();
@@ -306,6 +309,8 @@ void SimpleViewer::updateUserInterface() {
             ImGui::SliderInt("Low Pass", &lowpass, 0, 2);
             ImGui::Checkbox("High quality upsampling", &upsampling);
             ImGui::SliderFloat("Min Horizon angle", &ssao.minHorizonAngleRad, 0.0f, (float)M_PI_4);
+            ImGui::Checkbox("Temporal filtering", &ssao.temporalFiltering);
+            ImGui::SliderFloat("Temporal feedback", &ssao.temporalFeedback, 0.0f, 1.0f);
 
             ssao.upsampling = upsampling ? View::QualityLevel::HIGH : View::QualityLevel::LOW;
             ssao.lowPassFilter = (View::QualityLevel) lowpass;
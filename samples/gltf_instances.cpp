@@ -198,7 +198,7 @@ int main(int argc, char** argv) {
     auto loadResources = [&app] (utils::Path filename) {
         // Load external textures and buffers.
         std::string gltfPath = filename.getAbsolutePath();
-        ResourceConfiguration configuration;
+        ResourceConfiguration configuration = {};
         configuration.engine = app.engine;
         configuration.gltfPath = gltfPath.c_str();
         configuration.normalizeSkinningWeights = true;
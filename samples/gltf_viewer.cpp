@@ -52,6 +52,7 @@
 #include <imgui.h>
 #include <filagui/ImGuiExtensions.h>
 
+#include <cstdio>
 #include <fstream>
 #include <iostream>
 #include <string>
@@ -114,6 +115,8 @@ struct App {
     std::string messageBoxText;
     std::string settingsFile;
     std::string batchFile;
+    int benchmarkFrameCount = 0;
+    int benchmarkWarmupFrameCount = 30;
 
     AutomationSpec* automationSpec = nullptr;
     AutomationEngine* automationEngine = nullptr;
@@ -134,6 +137,9 @@ static void printUsage(char* name) {
         "       Specify the backend API: opengl (default), vulkan, or metal\n\n"
         "   --batch=<path to JSON file or 'default'>, -b\n"
         "       Start automation using the given JSON spec, then quit the app\n\n"
+        "   --benchmark=<frames>[,<warm-up frames>], -k <frames>[,<warm-up frames>]\n"
+        "       Measure each automation test over the given number of frames, after 30 warm-up\n"
+        "       frames by default, and write benchmark.json and benchmark.csv\n\n"
         "   --headless, -e\n"
         "       Use a headless swapchain; ignored if --batch is not present\n\n"
         "   --ibl=<path to cmgen IBL>, -i <path>\n"
@@ -168,12 +174,13 @@ static std::ifstream::pos_type getFileSize(const char* filename) {
 }
 
 static int handleCommandLineArguments(int argc, char* argv[], App* app) {
-    static constexpr const char* OPTSTR = "ha:i:usc:rt:b:e";
+    static constexpr const char* OPTSTR = "ha:i:usc:rt:b:ek:";
     static const struct option OPTIONS[] = {
         { "help",         no_argument,       nullptr, 'h' },
         { "api",          required_argument, nullptr, 'a' },
         { "batch",        required_argument, nullptr, 'b' },
         { "headless",     no_argument,       nullptr, 'e' },
+        { "benchmark",    required_argument, nullptr, 'k' },
         { "ibl",          required_argument, nullptr, 'i' },
         { "ubershader",   no_argument,       nullptr, 'u' },
         { "actual-size",  no_argument,       nullptr, 's' },
@@ -233,6 +240,18 @@ static int handleCommandLineArguments(int argc, char* argv[], App* app) {
                 app->batchFile = arg;
                 break;
             }
+            case 'k': {
+                int frames = 0;
+                int warmup = app->benchmarkWarmupFrameCount;
+                if (sscanf(arg.c_str(), "%d,%d", &frames, &warmup) < 1 || frames <= 0 ||
+                        warmup < 0) {
+                    std::cerr << "Unrecognized benchmark frame counts: " << arg << std::endl;
+                    break;
+                }
+                app->benchmarkFrameCount = frames;
+                app->benchmarkWarmupFrameCount = warmup;
+                break;
+            }
         }
     }
     if (app->config.headless && app->batchFile.empty()) {
@@ -720,6 +739,13 @@ int main(int argc, char** argv) {
             app.viewer->stopAnimation();
         }
 
+        if (app.benchmarkFrameCount > 0) {
+            auto options = app.automationEngine->getOptions();
+            options.measuredFrameCount = app.benchmarkFrameCount;
+            options.warmupFrameCount = app.benchmarkWarmupFrameCount;
+            app.automationEngine->setOptions(options);
+        }
+
         if (app.settingsFile.size() > 0) {
             bool success = loadSettings(app.settingsFile.c_str(), &app.viewer->getSettings());
             if (success) {
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <backend/Platform.h>
+
+#include "private/backend/CommandBufferQueue.h"
+#include "private/backend/CommandStream.h"
+#include "private/backend/CommandStreamCapture.h"
+#include "private/backend/Driver.h"
+
+#include <getopt/getopt.h>
+
+#include <utils/Path.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace filament::backend;
+
+static constexpr size_t MIN_COMMAND_BUFFER_SIZE = 16u * 1024u * 1024u;
+static constexpr size_t COMMAND_BUFFER_SIZE = 3u * MIN_COMMAND_BUFFER_SIZE;
+
+static Backend g_backend = Backend::DEFAULT;
+static uint32_t g_width = 1920;
+static uint32_t g_height = 1080;
+
+static void printUsage(const char* name) {
+    std::string execName(utils::Path(name).getName());
+    std::string usage(
+            "CMDREPLAY replays the commands captured by Engine::Config::commandCapturePath as fast\n"
+            "as possible and prints the CPU time of the backend and the GPU time of each frame\n"
+            "Usage:\n"
+            "    CMDREPLAY [options] <capture file>\n"
+            "\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Print this message\n\n"
+            "   --license\n"
+            "       Print copyright and license information\n\n"
+            "   --api, -a\n"
+            "       Backend to replay with: opengl, vulkan or metal, the default of the platform\n"
+            "       if omitted\n\n"
+            "   --size=WIDTHxHEIGHT, -s WIDTHxHEIGHT\n"
+            "       Size of the swap chains, 1920x1080 by default\n\n"
+    );
+
+    const std::string from("CMDREPLAY");
+    for (size_t pos = usage.find(from); pos != std::string::npos; pos = usage.find(from, pos)) {
+        usage.replace(pos, from.length(), execName);
+    }
+    printf("%s", usage.c_str());
+}
+
+static void license() {
+    static const char *license[] = {
+        #include "licenses/licenses.inc"
+        nullptr
+    };
+
+    const char **p = &license[0];
+    while (*p)
+        std::cout << *p++ << std::endl;
+}
+
+static int handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hla:s:";
+    static const struct option OPTIONS[] = {
+            { "help",         no_argument, nullptr, 'h' },
+            { "license",      no_argument, nullptr, 'l' },
+            { "api",    required_argument, nullptr, 'a' },
+            { "size",   required_argument, nullptr, 's' },
+            { nullptr, 0, nullptr, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+            case 'l':
+                license();
+                exit(0);
+            case 'a':
+                if (arg == "opengl") {
+                    g_backend = Backend::OPENGL;
+                } else if (arg == "vulkan") {
+                    g_backend = Backend::VULKAN;
+                } else if (arg == "metal") {
+                    g_backend = Backend::METAL;
+                } else {
+                    std::cerr << "Unrecognized backend. Must be 'opengl'|'vulkan'|'metal'."
+                              << std::endl;
+                    exit(1);
+                }
+                break;
+            case 's':
+                if (sscanf(arg.c_str(), "%ux%u", &g_width, &g_height) != 2 ||
+                        !g_width || !g_height) {
+                    std::cerr << "Invalid size " << arg << std::endl;
+                    exit(1);
+                }
+                break;
+        }
+    }
+
+    return optind;
+}
+
+// executes the commands recorded so far, returns the time it took
+static std::chrono::duration<double, std::milli> execute(Driver& driver,
+        CommandBufferQueue& queue, CommandStream& stream) {
+    const auto start = std::chrono::steady_clock::now();
+    queue.flush();
+    for (auto& item : queue.waitForCommands()) {
+        if (item.begin) {
+            stream.execute(item.begin);
+            queue.releaseBuffer(item);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+    // frees the buffers of the commands
+    driver.purge();
+    return end - start;
+}
+
+static double median(std::vector<double> values) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+
+    int numArgs = argc - optionIndex;
+    if (numArgs < 1) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    CommandStreamReplayer replayer(argv[optionIndex]);
+    if (!replayer.isOpen()) {
+        return 1;
+    }
+    replayer.setSwapChainSize(g_width, g_height);
+
+    DefaultPlatform* platform = DefaultPlatform::create(&g_backend);
+    Driver* const driver = platform ? platform->createDriver(nullptr) : nullptr;
+    if (!driver) {
+        std::cerr << "The backend couldn't be created" << std::endl;
+        DefaultPlatform::destroy(&platform);
+        return 1;
+    }
+
+    CommandBufferQueue queue(MIN_COMMAND_BUFFER_SIZE, COMMAND_BUFFER_SIZE);
+    CommandStream stream(*driver, queue.getCircularBuffer());
+
+    // The GPU time of each frame is measured with a timer query around its commands. The
+    // replayer begins and ends the query within the frame, while its swap chain is current.
+    std::vector<TimerQueryHandle> queries;
+    std::vector<double> cpuTimes;
+    std::vector<bool> timed;
+    while (true) {
+        TimerQueryHandle query = stream.createTimerQuery();
+        bool frameTimed = false;
+        const bool replayed = replayer.replayFrame(stream, query, &frameTimed);
+        cpuTimes.push_back(execute(*driver, queue, stream).count());
+        queries.push_back(query);
+        timed.push_back(frameTimed);
+        if (!replayed) {
+            break;
+        }
+    }
+    // the last query only measures the end of the capture
+    cpuTimes.pop_back();
+    timed.pop_back();
+
+    // wait for the results of the timer queries, which may not be ready right after finish()
+    std::vector<double> gpuTimes(cpuTimes.size(), 0.0);
+    std::vector<bool> ready(cpuTimes.size(), false);
+    size_t pending = std::count(timed.begin(), timed.end(), true);
+    for (size_t attempt = 0; pending && attempt < 100; attempt++) {
+        stream.finish();
+        execute(*driver, queue, stream);
+        for (size_t i = 0; i < gpuTimes.size(); i++) {
+            uint64_t elapsed = 0;
+            if (timed[i] && !ready[i] && stream.getTimerQueryValue(queries[i], &elapsed)) {
+                gpuTimes[i] = double(elapsed) * 1e-6;
+                ready[i] = true;
+                pending--;
+            }
+        }
+        if (pending) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+
+    printf("frame, cpu (ms), gpu (ms)\n");
+    for (size_t i = 0; i < cpuTimes.size(); i++) {
+        if (ready[i]) {
+            printf("%zu, %.3f, %.3f\n", i, cpuTimes[i], gpuTimes[i]);
+        } else {
+            printf("%zu, %.3f, n/a\n", i, cpuTimes[i]);
+        }
+    }
+    // The first frame also creates most of the driver objects, it's left out of the medians.
+    // So are the frames whose query didn't return a value.
+    if (cpuTimes.size() > 1) {
+        std::vector<double> readyGpuTimes;
+        for (size_t i = 1; i < gpuTimes.size(); i++) {
+            if (ready[i]) {
+                readyGpuTimes.push_back(gpuTimes[i]);
+            }
+        }
+        if (readyGpuTimes.empty()) {
+            printf("median of frames 1-%zu: cpu %.3f ms, gpu n/a\n", cpuTimes.size() - 1,
+                    median({ cpuTimes.begin() + 1, cpuTimes.end() }));
+        } else {
+            printf("median of frames 1-%zu: cpu %.3f ms, gpu %.3f ms (%zu frames)\n",
+                    cpuTimes.size() - 1, median({ cpuTimes.begin() + 1, cpuTimes.end() }),
+                    median(readyGpuTimes), readyGpuTimes.size());
+        }
+    }
+
+    for (TimerQueryHandle query : queries) {
+        stream.destroyTimerQuery(query);
+    }
+    stream.finish();
+    execute(*driver, queue, stream);
+    driver->terminate();
+    delete driver;
+    DefaultPlatform::destroy(&platform);
+    return 0;
+}
@@ -107,6 +107,7 @@ static bool g_deploy = false;
 static utils::Path g_deploy_dir;
 
 static size_t g_num_samples = 1024;
+static bool g_adaptive_samples = false;
 
 static bool g_mirror = false;
 
@@ -173,7 +174,7 @@ static void printUsage(char* name) {
 #ifdef IMAGEIO_SUPPORTS_BLOCK_COMPRESSION
             "           KTX:\n"
             "             astc_[fast|thorough]_[ldr|hdr]_WxH, where WxH is a valid block size\n"
-            "             s3tc_rgba_dxt5\n"
+            "             s3tc_rgba_dxt5, or s3tc_rgba_dxt5_hq for a higher quality\n"
             "             etc_FORMAT_METRIC_EFFORT\n"
             "               FORMAT is rgb8_alpha, srgb8_alpha, rgba8, or srgb8_alpha8\n"
             "               METRIC is rgba, rgbx, rec709, numeric, or normalxyz\n"
@@ -200,6 +201,9 @@ static void printUsage(char* name) {
             "       Skip mirroring of generated cubemaps (for assets with mirroring already backed in)\n\n"
             "   --ibl-samples=numSamples\n"
             "       Number of samples to use for IBL integrations (default 1024)\n\n"
+            "   --ibl-adaptive-samples\n"
+            "       Use fewer samples for the roughness levels that don't need them, --ibl-samples\n"
+            "       becomes the maximum (and the count still doubles for each level)\n\n"
             "   --ibl-ld=dir\n"
             "       Roughness pre-filter into <dir>\n\n"
             "   --sh-shader\n"
@@ -276,6 +280,7 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             { "ibl-no-prefilter",           no_argument, nullptr, 'n' },
             { "ibl-min-lod-size",     required_argument, nullptr, 'S' },
             { "ibl-samples",          required_argument, nullptr, 'k' },
+            { "ibl-adaptive-samples",       no_argument, nullptr, 'A' },
             { "deploy",               required_argument, nullptr, 'x' },
             { "no-mirror",                  no_argument, nullptr, 'm' },
             { "debug",                      no_argument, nullptr, 'd' },
@@ -446,6 +451,9 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             case 'k':
                 g_num_samples = (size_t)std::stoi(arg);
                 break;
+            case 'A':
+                g_adaptive_samples = true;
+                break;
             case 'x':
                 g_deploy = true;
                 g_deploy_dir = arg;
@@ -536,22 +544,34 @@ int main(int argc, char* argv[]) {
         if (!g_quiet) {
             std::cout << "Decoding image..." << std::endl;
         }
+        // Decode straight into the deprecated Image object which is used throughout cmgen, without
+        // an intermediate LinearImage. OpenEXR blocks are converted in parallel.
         std::ifstream input_stream(iname.getPath(), std::ios::binary);
-        LinearImage linputImage = ImageDecoder::decode(input_stream, iname.getPath());
-        if (!linputImage.isValid()) {
+        Image inputImage;
+        bool decoded = ImageDecoder::decode(input_stream, iname.getPath(),
+                ImageDecoder::ColorSpace::SRGB,
+                [&inputImage](ImageDecoder::ImageInfo const& info) {
+                    if (info.channels != 3) {
+                        std::cerr << "Input image must be RGB (3 channels)! This image has "
+                                  << info.channels << " channels." << std::endl;
+                        exit(1);
+                    }
+                    inputImage = Image(info.width, info.height);
+                    return true;
+                },
+                [&inputImage](ImageDecoder::Block const& block) {
+                    for (uint32_t y = 0; y < block.height; y++) {
+                        memcpy(inputImage.getPixelRef(block.x, block.y + y),
+                                block.data + y * block.stride * 3,
+                                block.width * inputImage.getBytesPerPixel());
+                    }
+                }, &js);
+        if (!decoded) {
             std::cerr << "Unable to open image: " << iname.getPath() << std::endl;
             exit(1);
         }
-        if (linputImage.getChannels() != 3) {
-            std::cerr << "Input image must be RGB (3 channels)! This image has "
-                      << linputImage.getChannels() << " channels." << std::endl;
-            exit(1);
-        }
 
-        // Convert from LinearImage to the deprecated Image object which is used throughout cmgen.
-        const size_t width = linputImage.getWidth(), height = linputImage.getHeight();
-        Image inputImage(width, height);
-        memcpy(inputImage.getData(), linputImage.getPixelRef(), height * inputImage.getBytesPerRow());
+        const size_t width = inputImage.getWidth(), height = inputImage.getHeight();
 
         if (!g_noclamp) {
             CubemapUtils::clamp(inputImage);
@@ -963,10 +983,13 @@ void iblRoughnessPrefilter(
         // map the lod to a perceptualRoughness
         const float perceptualRoughness = lodToPerceptualRoughness(lod);
         const float roughness = perceptualRoughness * perceptualRoughness;
+        const size_t levelSamples = g_adaptive_samples ?
+                CubemapIBL::getAdaptiveSampleCount(dim, roughness, numSamples) : numSamples;
         if (!g_quiet) {
             std::cout << "Level " << level << std::setprecision(3)
                       << ", roughness = " << roughness
                       << ", roughness (perceptual) = " << perceptualRoughness
+                      << ", samples = " << levelSamples
                     << std::endl;
         }
         Image image;
@@ -976,7 +999,7 @@ void iblRoughnessPrefilter(
         if (!g_quiet) {
             updater.start();
         }
-        CubemapIBL::roughnessFilter(js, dst, levels, roughness, numSamples,
+        CubemapIBL::roughnessFilter(js, dst, levels, roughness, levelSamples,
                 float3{ 1, 1, 1 }, prefilter,
                 [&updater, quiet = g_quiet](size_t index, float v) {
                     if (!quiet) {
@@ -26,6 +26,8 @@
 #include <sstream>
 #include <string>
 
+#include <stdlib.h>
+
 using namespace utils;
 
 namespace matc {
@@ -55,16 +57,30 @@ static void usage(char* name) {
             "       Specify the target API: opengl (default), vulkan, metal, or all\n"
             "       This flag can be repeated to individually select APIs for inclusion:\n"
             "           MATC --api opengl --api metal ...\n\n"
+            "   --cache=<directory>, -c <directory>\n"
+            "       Cache the compiled shaders in the specified directory, created if needed.\n"
+            "       Only the shaders whose code or compilation options changed are compiled again,\n"
+            "       the directory can be shared by several instances of MATC running at once\n\n"
+            "   --compress, -z\n"
+            "       Compress the shaders of the package with deflate, the package is smaller and\n"
+            "       the shaders are decompressed when the material is loaded or first used\n\n"
             "   --define, -D\n"
             "       Add a preprocessor define macro via <macro>=<value>. <value> defaults to 1 if omitted.\n"
             "       Can be repeated to specify multiple definitions:\n"
             "           MATC -Dfoo=1 -Dbar -Dbuzz=100 ...\n\n"
             "   --reflect, -r\n"
             "       Reflect the specified metadata as JSON: parameters\n\n"
+            "   --threads=<count>, -j <count>\n"
+            "       Number of threads compiling the shaders of the variants, one per CPU core by\n"
+            "       default. The output doesn't depend on the number of threads\n\n"
             "   --variant-filter=<filter>, -V <filter>\n"
             "       Filter out specified comma-separated variants:\n"
             "           directionalLighting, dynamicLighting, shadowReceiver, skinning, vsm\n"
             "       This variant filter is merged with the filter from the material, if any\n\n"
+            "   --variant-profile=<file>, -P <file>\n"
+            "       Only generate the variants listed in the specified profile for this material.\n"
+            "       The profile is recorded at runtime by Engine::getVariantProfile(), the other\n"
+            "       variants can't be rendered with the material\n\n"
             "   --version, -v\n"
             "       Print the material version number\n\n"
             "Internal use and debugging only:\n"
@@ -149,7 +165,7 @@ static void parseDefine(std::string defineString,
 }
 
 bool CommandlineConfig::parse() {
-    static constexpr const char* OPTSTR = "hlxo:f:dm:a:p:D:OSEr:vV:gt";
+    static constexpr const char* OPTSTR = "hlxo:f:dm:a:p:D:OSEr:vV:gtj:c:zP:";
     static const struct option OPTIONS[] = {
             { "help",                    no_argument, nullptr, 'h' },
             { "license",                 no_argument, nullptr, 'l' },
@@ -167,6 +183,10 @@ bool CommandlineConfig::parse() {
             { "define",            required_argument, nullptr, 'D' },
             { "reflect",           required_argument, nullptr, 'r' },
             { "print",                   no_argument, nullptr, 't' },
+            { "threads",           required_argument, nullptr, 'j' },
+            { "cache",             required_argument, nullptr, 'c' },
+            { "compress",                no_argument, nullptr, 'z' },
+            { "variant-profile",   required_argument, nullptr, 'P' },
             { "version",                 no_argument, nullptr, 'v' },
             { nullptr, 0, nullptr, 0 }  // termination of the option list
     };
@@ -263,6 +283,18 @@ bool CommandlineConfig::parse() {
             case 't':
                 mPrintShaders = true;
                 break;
+            case 'j':
+                mThreadCount = uint32_t(strtoul(arg.c_str(), nullptr, 10));
+                break;
+            case 'c':
+                mShaderCacheDirectory = arg;
+                break;
+            case 'z':
+                mCompressShaders = true;
+                break;
+            case 'P':
+                mVariantProfile = arg;
+                break;
         }
     }
 
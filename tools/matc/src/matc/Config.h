@@ -110,6 +110,25 @@ public:
         return mVariantFilter;
     }
 
+    // number of threads compiling shaders, 0 for one per CPU core
+    uint32_t getThreadCount() const noexcept {
+        return mThreadCount;
+    }
+
+    bool compressShaders() const noexcept {
+        return mCompressShaders;
+    }
+
+    // directory of the compiled shaders cache, empty if there's none
+    const std::string& getShaderCacheDirectory() const noexcept {
+        return mShaderCacheDirectory;
+    }
+
+    // file of the variants profile, empty if all the variants are generated
+    const std::string& getVariantProfile() const noexcept {
+        return mVariantProfile;
+    }
+
     const std::unordered_map<std::string, std::string>& getDefines() const noexcept {
         return mDefines;
     }
@@ -118,6 +137,10 @@ protected:
     bool mDebug = false;
     bool mIsValid = true;
     bool mPrintShaders = false;
+    bool mCompressShaders = false;
+    uint32_t mThreadCount = 0;
+    std::string mShaderCacheDirectory;
+    std::string mVariantProfile;
     Optimization mOptimizationLevel = Optimization::PERFORMANCE;
     Metadata mReflectionTarget = Metadata::NONE;
     Platform mPlatform = Platform::ALL;
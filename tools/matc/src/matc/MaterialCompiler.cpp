@@ -16,6 +16,7 @@
 
 #include "MaterialCompiler.h"
 
+#include <fstream>
 #include <functional>
 #include <memory>
 #include <iostream>
@@ -24,6 +25,8 @@
 
 #include <filamat/Enums.h>
 
+#include <utils/JobSystem.h>
+
 #include "DirIncluder.h"
 #include "MaterialLexeme.h"
 #include "MaterialLexer.h"
@@ -217,6 +220,29 @@ static bool reflectParameters(const MaterialBuilder& builder) {
     return true;
 }
 
+// Reads the variants of a material from a profile recorded by Engine::getVariantProfile(), each
+// line of which holds a variant key followed by a space and a material name.
+static bool readVariantProfile(const std::string& path, const char* materialName,
+        std::vector<uint8_t>* variants) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        const size_t separator = line.find(' ');
+        if (separator == std::string::npos || line.compare(separator + 1, std::string::npos,
+                materialName) != 0) {
+            continue;
+        }
+        variants->push_back(uint8_t(strtoul(line.c_str(), nullptr, 0)));
+    }
+    return true;
+}
+
 bool MaterialCompiler::isValidJsonStart(const char* buffer, size_t size) const noexcept {
     // Skip all whitespace characters.
     const char* end = buffer + size;
@@ -293,14 +319,47 @@ bool MaterialCompiler::run(const Config& config) {
         .optimization(config.getOptimizationLevel())
         .printShaders(config.printShaders())
         .generateDebugInfo(config.isDebug())
+        .compressShaders(config.compressShaders())
         .variantFilter(config.getVariantFilter() | builder.getVariantFilter());
 
+    if (!config.getShaderCacheDirectory().empty()) {
+        builder.shaderCacheDirectory(config.getShaderCacheDirectory().c_str());
+    }
+
     for (const auto& define : config.getDefines()) {
         builder.shaderDefine(define.first.c_str(), define.second.c_str());
     }
 
-    // Write builder.build() to output.
-    Package package = builder.build();
+    if (!config.getVariantProfile().empty()) {
+        const char* name = builder.getMaterialName().c_str_safe();
+        std::vector<uint8_t> variants;
+        if (!readVariantProfile(config.getVariantProfile(), name, &variants)) {
+            std::cerr << "Could not read the variant profile " << config.getVariantProfile()
+                    << std::endl;
+            MaterialBuilder::shutdown();
+            return false;
+        }
+        // a material missing from the profile may simply not have been rendered while profiling
+        if (variants.empty()) {
+            std::cerr << "Warning: material " << name << " is not in the variant profile, "
+                    "all its variants are generated" << std::endl;
+        }
+        builder.variants(variants.data(), variants.size());
+    }
+
+    // Write builder.build() to output. The shaders are compiled by the calling thread and
+    // threadCount - 1 workers.
+    const uint32_t threadCount = config.getThreadCount();
+    Package package = [&builder, threadCount]() {
+        if (threadCount == 1) {
+            return builder.build();
+        }
+        utils::JobSystem jobSystem(threadCount ? threadCount - 1 : 0);
+        jobSystem.adopt();
+        Package package = builder.build(jobSystem);
+        jobSystem.emancipate();
+        return package;
+    }();
     MaterialBuilder::shutdown();
     if (!package.isValid()) {
         std::cerr << "Could not compile material " << input->getName() << std::endl;
@@ -264,6 +264,29 @@ static bool processVariables(MaterialBuilder& builder, const JsonishValue& value
     for (size_t i = 0; i < elements.size(); i++) {
         auto elementValue = elements[i];
         MaterialBuilder::Variable v = intToVariable(i);
+        if (elementValue->getType() == JsonishValue::Type::OBJECT) {
+            // { name: ..., precision: ... }
+            const JsonishObject& jsonObject = *elementValue->toJsonObject();
+            const JsonishValue* nameValue = jsonObject.getValue("name");
+            if (!nameValue || nameValue->getType() != JsonishValue::STRING) {
+                std::cerr << "variables: array index " << i << " must have a STRING 'name'."
+                        << std::endl;
+                return false;
+            }
+            const JsonishValue* precisionValue = jsonObject.getValue("precision");
+            if (!precisionValue || precisionValue->getType() != JsonishValue::STRING) {
+                std::cerr << "variables: array index " << i << " must have a STRING 'precision'."
+                        << std::endl;
+                return false;
+            }
+            auto precisionString = precisionValue->toJsonString();
+            if (!Enums::isValid<SamplerPrecision>(precisionString->getString())) {
+                return logEnumIssue("variables", *precisionString, Enums::map<SamplerPrecision>());
+            }
+            builder.variable(v, nameValue->toJsonString()->getString().c_str(),
+                    Enums::toEnum<SamplerPrecision>(precisionString->getString()));
+            continue;
+        }
         if (elementValue->getType() != JsonishValue::Type::STRING) {
             std::cerr << "variables: array index " << i << " is not a STRING. found:" <<
                     JsonishValue::typeToString(elementValue->getType()) << std::endl;
@@ -552,6 +575,11 @@ static bool processFlipUV(MaterialBuilder& builder, const JsonishValue& value) {
     return true;
 }
 
+static bool processFragmentMediumPrecision(MaterialBuilder& builder, const JsonishValue& value) {
+    builder.fragmentMediumPrecision(value.toJsonBool()->getBool());
+    return true;
+}
+
 static bool processMultiBounceAO(MaterialBuilder& builder, const JsonishValue& value) {
     builder.multiBounceAmbientOcclusion(value.toJsonBool()->getBool());
     return true;
@@ -705,6 +733,7 @@ ParametersProcessor::ParametersProcessor() {
     mParameters["specularAntiAliasingThreshold"] = { &processSpecularAntiAliasingThreshold, Type::NUMBER };
     mParameters["clearCoatIorChange"]            = { &processClearCoatIorChange, Type::BOOL };
     mParameters["flipUV"]                        = { &processFlipUV, Type::BOOL };
+    mParameters["fragmentMediumPrecision"]       = { &processFragmentMediumPrecision, Type::BOOL };
     mParameters["multiBounceAmbientOcclusion"]   = { &processMultiBounceAO, Type::BOOL };
     mParameters["specularAmbientOcclusion"]      = { &processSpecularAmbientOcclusion, Type::STRING };
     mParameters["domain"]                        = { &processDomain, Type::STRING };
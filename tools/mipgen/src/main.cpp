@@ -27,12 +27,18 @@
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
 
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <sstream>
 #include <string>
 
 using namespace image;
@@ -51,6 +57,7 @@ static bool g_ktxContainer = false;
 static bool g_linearized = false;
 static bool g_quietMode = false;
 static uint32_t g_mipLevelCount = 0;
+static std::string g_batchManifest;
 
 static const char* USAGE = R"TXT(
 MIPGEN generates mipmaps for an image down to the 1x1 level.
@@ -64,6 +71,7 @@ If the output format is a container format like KTX, then
 
 Usage:
     MIPGEN [options] <input_file> <output_pattern>
+    MIPGEN [options] --batch=<manifest>
 
 Options:
    --help, -h
@@ -90,6 +98,11 @@ Options:
    --mip-levels=N, -m N
        specifies the number of mip levels to generate
        if 0 (default), all levels are generated
+   --batch=MANIFEST, -b MANIFEST
+       process every image listed in MANIFEST, one "<input_file> <output_pattern>" pair
+       per line, using the same options for all of them; images are processed concurrently,
+       and an output is skipped when a hash of its input and options, stored in a
+       "<output_pattern>.hash" file next to it, is unchanged; --page is ignored
    --compression=COMPRESSION, -c COMPRESSION
        format specific compression:
 )TXT"
@@ -97,7 +110,8 @@ Options:
 R"TXT(
            KTX:
              astc_[fast|thorough]_[ldr|hdr]_WxH, where WxH is a valid block size
-             s3tc_rgb_dxt1, s3tc_rgba_dxt5
+             s3tc_rgb_dxt1, s3tc_rgba_dxt5, s3tc_r_bc4, s3tc_rg_bc5
+               append _hq for a slower but higher quality encoding, e.g. s3tc_rgba_dxt5_hq
              etc_FORMAT_METRIC_EFFORT
                FORMAT is r11, signed_r11, rg11, signed_rg11, rgb8, srgb8, rgb8_alpha
                          srgb8_alpha, rgba8, or srgb8_alpha8
@@ -116,6 +130,7 @@ Examples:
     MIPGEN -g --kernel=hermite grassland.png mip_%03d.png
     MIPGEN -f ktx --compression=astc_fast_ldr_4x4 grassland.png mips.ktx
     MIPGEN -f ktx --compression=etc_rgb_rgba_40 grassland.png mips.ktx
+    MIPGEN -q --compression=s3tc_rgba_dxt5 --batch=textures.txt
 )TXT";
 
 static const char* HTML_PREFIX = R"HTML(<!DOCTYPE html>
@@ -159,7 +174,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hLlgpf:c:k:saqm:";
+    static constexpr const char* OPTSTR = "hLlgpf:c:k:saqm:b:";
     static const struct option OPTIONS[] = {
             { "help",                 no_argument, 0, 'h' },
             { "license",              no_argument, 0, 'L' },
@@ -173,6 +188,7 @@ static int handleArguments(int argc, char* argv[]) {
             { "add-alpha",            no_argument, 0, 'a' },
             { "quiet",                no_argument, 0, 'q' },
             { "mip-levels",     required_argument, 0, 'm' },
+            { "batch",          required_argument, 0, 'b' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -254,33 +270,33 @@ static int handleArguments(int argc, char* argv[]) {
                     // keep default value
                 }
                 break;
+            case 'b':
+                g_batchManifest = arg;
+                break;
         }
     }
 
     return optind;
 }
 
-int main(int argc, char* argv[]) {
-    int optionIndex = handleArguments(argc, argv);
-    int numArgs = argc - optionIndex;
-    if (numArgs < 2) {
-        printUsage(argv[0]);
-        return 1;
-    }
-    Path inputPath(argv[optionIndex++]);
-    std::string outputPattern(argv[optionIndex]);
+// Decodes one image, generates its miplevels on the given job system and writes them out. This
+// only reads the option globals, so several images can be processed concurrently in batch mode,
+// where the step-by-step progress messages and the HTML page are skipped.
+static int processImage(Path const& inputPath, istream& inputStream,
+        std::string const& outputPattern, JobSystem& js, bool batch) {
+    const bool verbose = !g_quietMode && !batch;
+    bool ktxContainer = g_ktxContainer;
+    ImageEncoder::Format format = g_format;
     if (Path(outputPattern).getExtension() == "ktx") {
-        g_ktxContainer = true;
-        g_formatSpecified = true;
+        ktxContainer = true;
     } else if (!g_formatSpecified) {
-        g_format = ImageEncoder::chooseFormat(outputPattern, g_linearized);
+        format = ImageEncoder::chooseFormat(outputPattern, g_linearized);
     }
 
-    if (!g_quietMode) {
+    if (verbose) {
         puts("Reading image...");
     }
 
-    ifstream inputStream(inputPath.getPath(), ios::binary);
     LinearImage sourceImage = ImageDecoder::decode(inputStream, inputPath.getPath(),
             g_linearized ? ImageDecoder::ColorSpace::LINEAR : ImageDecoder::ColorSpace::SRGB);
     if (!sourceImage.isValid()) {
@@ -309,17 +325,17 @@ int main(int argc, char* argv[]) {
         sourceImage = colorsToVectors(sourceImage);
     }
 
-    if (!g_quietMode) {
+    if (verbose) {
         puts("Generating miplevels...");
     }
 
     uint32_t count = getMipmapCount(sourceImage);
     count = g_mipLevelCount == 0 ? count : min(g_mipLevelCount - 1, count);
     vector<LinearImage> miplevels(count);
-    generateMipmaps(sourceImage, g_filter, miplevels.data(), count);
+    generateMipmaps(sourceImage, g_filter, miplevels.data(), count, &js);
 
-    if (g_ktxContainer) {
-        if (!g_quietMode) {
+    if (ktxContainer) {
+        if (verbose) {
             puts("Writing KTX file to disk...");
         }
 
@@ -417,13 +433,13 @@ int main(int argc, char* argv[]) {
         ofstream outputStream(outputPattern, ios::out | ios::binary);
         outputStream.write((const char*) fileContents.data(), fileContents.size());
         outputStream.close();
-        if (!g_quietMode) {
+        if (verbose) {
             puts("Done.");
         }
         return 0;
     }
 
-    if (!g_quietMode) {
+    if (verbose) {
         puts("Writing image files to disk...");
     }
 
@@ -440,7 +456,7 @@ int main(int argc, char* argv[]) {
         if (!outputStream) {
             cerr << "The output file cannot be opened: " << path << endl;
         } else {
-            if (!ImageEncoder::encode(outputStream, g_format, image, g_compression, path)) {
+            if (!ImageEncoder::encode(outputStream, format, image, g_compression, path)) {
                 cerr << "An error occurred while encoding the image." << endl;
                 return 1;
             }
@@ -452,8 +468,8 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    if (g_createGallery) {
-        if (!g_quietMode) {
+    if (g_createGallery && !batch) {
+        if (verbose) {
             puts("Generating mipmaps.html...");
         }
 
@@ -482,7 +498,153 @@ int main(int argc, char* argv[]) {
         html << HTML_SUFFIX;
     }
 
-    if (!g_quietMode) {
+    if (verbose) {
         puts("Done.");
     }
+    return 0;
+}
+
+// Returns a hash of everything that determines the output of one batch entry: the input file
+// contents, the output pattern and the options. Bump the version when the output changes for the
+// same inputs so that stale outputs are regenerated.
+static uint64_t computeBatchHash(std::string const& inputBytes, std::string const& outputPattern) {
+    static constexpr uint32_t BATCH_HASH_VERSION = 1;
+    std::string options = std::to_string(BATCH_HASH_VERSION) + '|' + outputPattern + '|' +
+            std::to_string((int) g_format) + (g_formatSpecified ? "F" : "") +
+            (g_ktxContainer ? "K" : "") + '|' + g_compression + '|' +
+            std::to_string((int) g_filter) + '|' + std::to_string(g_mipLevelCount) + '|' +
+            (g_addAlpha ? "a" : "") + (g_stripAlpha ? "s" : "") + (g_grayscale ? "g" : "") +
+            (g_linearized ? "l" : "");
+    uint64_t hash = utils::hash::fnv1a64(options.data(), options.size());
+    return utils::hash::fnv1a64(inputBytes.data(), inputBytes.size(), hash);
+}
+
+// The hash of the inputs of a batch entry is stored next to its output. The entry is up to date
+// if the stored hash matches and, for KTX files, the output still exists.
+static std::string getHashPath(std::string const& outputPattern) {
+    return outputPattern + ".hash";
+}
+
+static bool isUpToDate(std::string const& outputPattern, uint64_t hash) {
+    if (Path(outputPattern).getExtension() == "ktx" && !Path(outputPattern).exists()) {
+        return false;
+    }
+    ifstream hashStream(getHashPath(outputPattern));
+    uint64_t storedHash = 0;
+    return bool(hashStream >> std::hex >> storedHash) && storedHash == hash;
+}
+
+struct BatchEntry {
+    Path input;
+    std::string outputPattern;
+};
+
+// Each non-empty line of a manifest has an input file and an output pattern, separated by
+// whitespace. Lines starting with # are ignored.
+static bool readManifest(Path const& manifestPath, vector<BatchEntry>* entries) {
+    ifstream manifest(manifestPath.getPath());
+    if (!manifest) {
+        cerr << "Unable to open manifest: " << manifestPath.getPath() << endl;
+        return false;
+    }
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(manifest, line); lineNumber++) {
+        std::istringstream fields(line);
+        std::string input, output, extra;
+        if (!(fields >> input) || input[0] == '#') {
+            continue;
+        }
+        if (!(fields >> output) || (fields >> extra)) {
+            cerr << manifestPath.getPath() << ":" << lineNumber
+                 << ": expected an input file and an output pattern" << endl;
+            return false;
+        }
+        entries->push_back({ Path(input), output });
+    }
+    return true;
+}
+
+// Processes all the entries of a manifest on one job system. One job per worker thread pulls
+// entries off the list, so decoding, mip generation, compression and writing of different images
+// overlap, while the number of images held in memory stays bounded. The mip generation of each
+// image also splits its work across the same job system.
+static int processBatch(Path const& manifestPath) {
+    vector<BatchEntry> entries;
+    if (!readManifest(manifestPath, &entries)) {
+        return 1;
+    }
+
+    JobSystem js;
+    js.adopt();
+
+    std::atomic<size_t> nextEntry{ 0 };
+    std::atomic<uint32_t> skippedCount{ 0 };
+    std::atomic<uint32_t> failedCount{ 0 };
+    auto processEntries = [&]() {
+        for (size_t i = nextEntry++; i < entries.size(); i = nextEntry++) {
+            BatchEntry const& entry = entries[i];
+            ifstream inputFile(entry.input.getPath(), ios::binary);
+            if (!inputFile) {
+                cerr << "Unable to open image: " << entry.input.getPath() << endl;
+                failedCount++;
+                continue;
+            }
+            std::string inputBytes{ std::istreambuf_iterator<char>(inputFile),
+                    std::istreambuf_iterator<char>() };
+            const uint64_t hash = computeBatchHash(inputBytes, entry.outputPattern);
+            if (isUpToDate(entry.outputPattern, hash)) {
+                skippedCount++;
+                continue;
+            }
+            if (!g_quietMode) {
+                printf("Processing %s\n", entry.input.c_str());
+            }
+            std::istringstream inputStream(std::move(inputBytes));
+            if (processImage(entry.input, inputStream, entry.outputPattern, js, true) != 0) {
+                failedCount++;
+                continue;
+            }
+            ofstream hashStream(getHashPath(entry.outputPattern), ios::trunc);
+            hashStream << std::hex << hash << endl;
+        }
+    };
+
+    JobSystem::Job* root = js.createJob();
+    const size_t workerCount = std::min(entries.size(), js.getThreadCount() + 1);
+    for (size_t i = 0; i < workerCount; i++) {
+        js.run(jobs::createJob(js, root, std::cref(processEntries)));
+    }
+    js.runAndWait(root);
+    js.emancipate();
+
+    if (!g_quietMode) {
+        printf("Processed %zu images, %u up to date, %u failed.\n", entries.size(),
+                skippedCount.load(), failedCount.load());
+    }
+    return failedCount ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+    int numArgs = argc - optionIndex;
+    if (!g_batchManifest.empty()) {
+        if (numArgs != 0) {
+            printUsage(argv[0]);
+            return 1;
+        }
+        return processBatch(Path(g_batchManifest));
+    }
+    if (numArgs < 2) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    Path inputPath(argv[optionIndex++]);
+    std::string outputPattern(argv[optionIndex]);
+
+    ifstream inputStream(inputPath.getPath(), ios::binary);
+    JobSystem js;
+    js.adopt();
+    int result = processImage(inputPath, inputStream, outputPattern, js, false);
+    js.emancipate();
+    return result;
 }
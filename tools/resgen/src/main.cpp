@@ -18,6 +18,8 @@
 
 #include <getopt/getopt.h>
 
+#include <zlib.h>
+
 #include <algorithm>
 #include <fstream>
 #include <iomanip>
@@ -35,6 +37,11 @@ static bool g_keepExtension = false;
 static bool g_appendNull = false;
 static bool g_generateC = false;
 static bool g_quietMode = false;
+static bool g_compress = false;
+
+// Resources that do not shrink below this ratio are left uncompressed, so they can still be
+// accessed in place.
+static constexpr float MAX_COMPRESSION_RATIO = 0.9f;
 
 static const char* USAGE = R"TXT(
 RESGEN aggregates a sequence of binary blobs, each of which becomes a "resource" whose id
@@ -64,6 +71,10 @@ Options:
        Append a null terminator to each data blob
    --cfile, -c
        Generate xxd-style C file (useful for WebAssembly)
+   --compress, -z
+       Compress each resource with zlib. Compressed resources are inflated into a cache the
+       first time their _DATA symbol is evaluated, which requires linking against zlib.
+       Resources that do not compress well are left in place.
     --quiet, -q
         Suppress console output
 
@@ -74,6 +85,19 @@ Examples:
                          TEXTURES_BEACH_DATA, TEXTURES_BEACH_SIZE
 )TXT";
 
+// Inline accessors decompress each resource on first access. Function-local statics make the
+// initialization thread-safe, and the decompressed data lives until the program exits.
+static const char* DECOMPRESS_TEMPLATE = R"CPP(
+inline const uint8_t* {RESOURCES}DECOMPRESS(const uint8_t* src, int srcSize, int size) {
+    uint8_t* dst = (uint8_t*) malloc(size);
+    uLongf dstSize = (uLongf) size;
+    if (uncompress(dst, &dstSize, src, (uLong) srcSize) != Z_OK) {
+        abort();
+    }
+    return dst;
+}
+)CPP";
+
 static const char* APPLE_ASM_TEMPLATE = R"ASM(
     .global _{RESOURCES}PACKAGE
     .section __TEXT,__const
@@ -110,7 +134,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hLp:x:ktcq";
+    static constexpr const char* OPTSTR = "hLp:x:ktcqz";
     static const struct option OPTIONS[] = {
             { "help",                 no_argument, 0, 'h' },
             { "license",              no_argument, 0, 'L' },
@@ -120,6 +144,7 @@ static int handleArguments(int argc, char* argv[]) {
             { "text",                 no_argument, 0, 't' },
             { "cfile",                no_argument, 0, 'c' },
             { "quiet",                no_argument, 0, 'q' },
+            { "compress",             no_argument, 0, 'z' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -154,6 +179,9 @@ static int handleArguments(int argc, char* argv[]) {
             case 'q':
                 g_quietMode = true;
                 break;
+            case 'z':
+                g_compress = true;
+                break;
         }
     }
 
@@ -230,11 +258,17 @@ int main(int argc, char* argv[]) {
     ostringstream headerStream;
     headerStream << "#ifndef " << packagePrefix << "H_" << endl
             << "#define " << packagePrefix << "H_" << endl << endl
-            << "#include <stdint.h>" << endl << endl
+            << "#include <stdint.h>" << endl;
+    if (g_compress) {
+        headerStream << "#include <stdlib.h>" << endl << endl
+                << "#include <zlib.h>" << endl;
+    }
+    headerStream << endl
             << "extern \"C\" {" << endl
             << "    extern const uint8_t " << package << "[];" << endl;
 
     ostringstream headerMacros;
+    ostringstream headerAccessors;
     ostringstream xxdDefinitions;
     ostringstream appleDataAsmStream;
     ostringstream dataAsmStream;
@@ -269,12 +303,38 @@ int main(int argc, char* argv[]) {
         transform(rname.begin(), rname.end(), rname.begin(), ::toupper);
         const std::string prname = packagePrefix + rname;
 
+        // Compress the blob if requested and worthwhile. _SIZE is always the uncompressed size.
+        const size_t size = content.size();
+        bool compressed = false;
+        if (g_compress && size > 0) {
+            uLongf compressedSize = compressBound(size);
+            vector<uint8_t> compressedContent(compressedSize);
+            if (compress2(compressedContent.data(), &compressedSize, content.data(), size,
+                    Z_BEST_COMPRESSION) == Z_OK &&
+                    compressedSize < size * MAX_COMPRESSION_RATIO) {
+                compressedContent.resize(compressedSize);
+                content.swap(compressedContent);
+                compressed = true;
+            }
+        }
+
         // Write the binary blob into the bin file.
         binStream.write((const char*) content.data(), content.size());
 
         // Write the offsets and sizes.
-        headerMacros
-                << "#define " << prname << "_DATA (" << package << " + " << prname << "_OFFSET)\n";
+        if (compressed) {
+            headerMacros << "#define " << prname << "_DATA (" << prname << "_GET_DATA())\n";
+            headerAccessors
+                    << "inline const uint8_t* " << prname << "_GET_DATA() {\n"
+                    << "    static const uint8_t* data = " << packagePrefix << "DECOMPRESS(\n"
+                    << "            " << package << " + " << prname << "_OFFSET, "
+                    << prname << "_COMPRESSED_SIZE, " << prname << "_SIZE);\n"
+                    << "    return data;\n"
+                    << "}\n";
+        } else {
+            headerMacros << "#define " << prname << "_DATA (" << package << " + " << prname
+                    << "_OFFSET)\n";
+        }
 
         headerStream
                 << "    extern int " << prname << "_OFFSET;\n"
@@ -284,7 +344,7 @@ int main(int argc, char* argv[]) {
                 << prname << "_OFFSET:\n"
                 << "    .int " << offset << "\n"
                 << prname << "_SIZE:\n"
-                << "    .int " << content.size() << "\n";
+                << "    .int " << size << "\n";
 
         asmStream
                 << "    .global " << prname << "_OFFSET;\n"
@@ -294,17 +354,33 @@ int main(int argc, char* argv[]) {
                 << "_" << prname << "_OFFSET:\n"
                 << "    .int " << offset << "\n"
                 << "_" << prname << "_SIZE:\n"
-                << "    .int " << content.size() << "\n";
+                << "    .int " << size << "\n";
 
         appleAsmStream
                 << "    .global _" << prname << "_OFFSET;\n"
                 << "    .global _" << prname << "_SIZE;\n";
 
+        if (compressed) {
+            headerStream << "    extern int " << prname << "_COMPRESSED_SIZE;\n";
+            dataAsmStream
+                    << prname << "_COMPRESSED_SIZE:\n"
+                    << "    .int " << content.size() << "\n";
+            asmStream << "    .global " << prname << "_COMPRESSED_SIZE;\n";
+            appleDataAsmStream
+                    << "_" << prname << "_COMPRESSED_SIZE:\n"
+                    << "    .int " << content.size() << "\n";
+            appleAsmStream << "    .global _" << prname << "_COMPRESSED_SIZE;\n";
+        }
+
         // Write the xxd-style ASCII array, followed by a blank line.
         if (g_generateC) {
             xxdDefinitions
                     << "int " << prname << "_OFFSET = " << offset << ";\n"
-                    << "int " << prname << "_SIZE = " << content.size() << ";\n";
+                    << "int " << prname << "_SIZE = " << size << ";\n";
+            if (compressed) {
+                xxdDefinitions
+                        << "int " << prname << "_COMPRESSED_SIZE = " << content.size() << ";\n";
+            }
 
             xxdStream << "// " << rname << "\n";
             xxdStream << setfill('0') << hex;
@@ -323,6 +399,12 @@ int main(int argc, char* argv[]) {
     }
 
     headerStream << "}\n" << headerMacros.str();
+    const std::string accessors = headerAccessors.str();
+    if (!accessors.empty()) {
+        std::string decompress(DECOMPRESS_TEMPLATE);
+        decompress.replace(decompress.find(k1), k1.length(), packagePrefix);
+        headerStream << decompress << "\n" << accessors;
+    }
     headerStream << "\n#endif\n";
 
     // To optimize builds, avoid overwriting the header file if nothing has changed.
@@ -26,6 +26,49 @@ function getBufferDescriptor(buffer) {
     return buffer;
 }
 
+// Private utility that streams the response to a request into the WASM heap as it arrives, rather
+// than gathering it in the JavaScript heap first. Returns a promise that resolves to a low-level
+// buffer descriptor, which must be manually deleted.
+function fetchBufferDescriptor(url) {
+    return fetch(url).then(response => {
+        if (!response.ok) {
+            throw new Error(url);
+        }
+        if (!response.body) {
+            return response.arrayBuffer().then(data => Filament.Buffer(new Uint8Array(data)));
+        }
+
+        // The length of compressed responses is their compressed length, so the buffer might need
+        // to grow. Note that allocations can grow the WASM heap, which detaches its views.
+        const length = parseInt(response.headers.get('Content-Length')) || 0;
+        let buffer = new Filament.driver$BufferDescriptor(length || 1024 * 1024);
+        let capacity = buffer.getBytes().byteLength;
+        let size = 0;
+        const reader = response.body.getReader();
+        const read = () => reader.read().then(({done, value}) => {
+            if (done) {
+                if (size === capacity) {
+                    return buffer;
+                }
+                const result = Filament.Buffer(buffer.getBytes().subarray(0, size));
+                buffer.delete();
+                return result;
+            }
+            if (size + value.byteLength > capacity) {
+                capacity = Math.max(capacity * 2, size + value.byteLength);
+                const grown = new Filament.driver$BufferDescriptor(capacity);
+                grown.getBytes().set(buffer.getBytes().subarray(0, size));
+                buffer.delete();
+                buffer = grown;
+            }
+            buffer.getBytes().set(value, size);
+            size += value.byteLength;
+            return read();
+        });
+        return read();
+    });
+}
+
 Filament.vectorToArray = function(vector) {
     const result = [];
     for (let i = 0; i < vector.size(); i++) {
@@ -472,6 +515,9 @@ Filament.loadClassExtensions = function() {
     // - onDone is called after all resources have been downloaded and decoded.
     // - onFetched is called after each resource has finished downloading.
     //
+    // The resources are streamed into the WASM heap as they download. The renderables appear once
+    // the buffers are downloaded, and their textures once their images are.
+    //
     // Takes an optional base path for resolving the URI strings in the glTF file, which is
     // typically the path to the parent glTF file. The given base path cannot itself be a relative
     // URL, but clients can do the following to resolve a relative URL:
@@ -511,22 +557,28 @@ Filament.loadClassExtensions = function() {
             }
         }
 
-        // Construct a resource loader and start decoding after all textures are fetched.
+        // Construct a resource loader and start loading as soon as all buffers are fetched. The
+        // textures are decoded and uploaded as their images arrive.
         const resourceLoader = new Filament.gltfio$ResourceLoader(engine,
                 config.normalizeSkinningWeights,
                 config.recomputeBoundingBoxes);
-        const onComplete = () => {
+        let remainingResources = urlset.size;
+        let loading = false;
+        const beginLoad = () => {
+            if (loading || !resourceLoader.hasBufferData(asset)) {
+                return;
+            }
+            loading = true;
             resourceLoader.asyncBeginLoad(asset);
 
             // NOTE: This decodes in the wasm layer instead of using Canvas2D, which allows Filament
             // to have more control (handling of alpha, srgb, etc) and improves parity with native
-            // platforms. In the future we may wish to offload this to web workers.
-
-            // Decode a single PNG or JPG every 30 milliseconds, or at the specified interval.
+            // platforms. The multithreaded module decodes in web workers, the others decode a
+            // single PNG or JPG every 30 milliseconds, or at the specified interval.
             const timer = setInterval(() => {
                 resourceLoader.asyncUpdateLoad();
                 const progress = resourceLoader.asyncGetLoadProgress();
-                if (progress >= 1) {
+                if (progress >= 1 && remainingResources == 0) {
                     clearInterval(timer);
                     resourceLoader.delete();
                     onDone();
@@ -534,19 +586,26 @@ Filament.loadClassExtensions = function() {
             }, interval);
         };
 
-        if (urlset.size == 0) {
-            onComplete();
-            return;
-        }
-
-        // Begin downloading all external resources.
-        Filament.fetch(Array.from(urlset), onComplete, function(url) {
-            const buffer = getBufferDescriptor(url);
+        const addResource = (url, buffer) => {
             const name = urlToName[url];
             resourceLoader.addResourceData(name, buffer);
             buffer.delete();
+            remainingResources--;
             onFetched(name);
+            beginLoad();
+        };
+
+        // Stream all external resources into the WASM heap, unless the client already provided
+        // them in Filament.assets.
+        urlset.forEach(url => {
+            if (Filament.assets[url]) {
+                addResource(url, getBufferDescriptor(url));
+                return;
+            }
+            fetchBufferDescriptor(url).then(buffer => addResource(url, buffer));
         });
+
+        beginLoad();
     };
 
     Filament.gltfio$FilamentAsset.prototype.getEntities = function() {
@@ -29,6 +29,9 @@ export function getSupportedFormatSuffix(desired: string): void;
 export function init(assets: string[], onready?: (() => void) | null): void;
 export function fetch(assets: string[], onDone?: (() => void) | null, onFetched?: ((name: string) => void) | null): void;
 export function clearAssetCache(): void;
+export function selectVariant(): string;
+
+export var variant: string | undefined;
 
 export const assets: {[url: string]: Uint8Array};
 
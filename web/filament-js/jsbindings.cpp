@@ -1808,6 +1808,10 @@ class_<ResourceLoader>("gltfio$ResourceLoader")
         return self->hasResourceData(url.c_str());
     }), allow_raw_pointers())
 
+    .function("hasBufferData", EMBIND_LAMBDA(bool, (ResourceLoader* self, FilamentAsset* asset), {
+        return self->hasBufferData(asset);
+    }), allow_raw_pointers())
+
     .function("loadResources", EMBIND_LAMBDA(bool, (ResourceLoader* self, FilamentAsset* asset), {
         return self->loadResources(asset);
     }), allow_raw_pointers())
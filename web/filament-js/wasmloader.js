@@ -50,8 +50,14 @@ Filament.init = (assets, onready) => {
 
     // Emscripten creates a global function called "Filament" that returns a promise that
     // resolves to a module. Here we replace the function with the module. Note that our
-    // TypeScript bindings assume that Filament is a namespace, not a function.
-    Filament().then(module => {
+    // TypeScript bindings assume that Filament is a namespace, not a function. The module can
+    // come from a faster variant of this script, we fall back to this one if it can't be loaded.
+    const variant = Filament.variant || Filament.selectVariant();
+    const loadFactory = variant === 'filament' || !Filament.scriptDirectory ?
+            Promise.resolve(Filament) :
+            Filament.loadVariant(variant).catch(() => Filament);
+
+    loadFactory.then(factory => factory()).then(module => {
         Filament = Object.assign(module, Filament);
 
         // At this point, emscripten has finished compiling and instancing the WebAssembly module.
@@ -63,6 +69,49 @@ Filament.init = (assets, onready) => {
     });
 };
 
+// The directory this script was loaded from, which is where its variants live. This is only known
+// while the script runs for the first time, and it's undefined in workers.
+Filament.scriptDirectory = typeof document !== 'undefined' && document.currentScript ?
+        document.currentScript.src.substring(0, document.currentScript.src.lastIndexOf('/') + 1) :
+        undefined;
+
+/// selectVariant ::function:: Returns the name of the fastest variant of the module this browser \
+/// supports.
+///
+/// `filament-mt-simd` runs the JobSystem in web workers, which requires `SharedArrayBuffer`, so
+/// it's only selected when the page is cross-origin isolated. `filament-simd` requires
+/// WebAssembly SIMD, and `filament` is the baseline. Clients can set `Filament.variant` before
+/// calling `Filament.init` to pick a variant themselves.
+Filament.selectVariant = () => {
+    // A module with a single function that uses a v128 instruction.
+    const simd = WebAssembly.validate(new Uint8Array([0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96,
+            0, 1, 123, 3, 2, 1, 0, 10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11]));
+    const threads = typeof crossOriginIsolated !== 'undefined' && crossOriginIsolated &&
+            typeof SharedArrayBuffer !== 'undefined';
+    if (simd && threads) {
+        return 'filament-mt-simd';
+    }
+    return simd ? 'filament-simd' : 'filament';
+};
+
+// Loads the script of a variant, and returns a promise that resolves to its module factory. The
+// script replaces the global Filament function, so we put ours back once it's loaded.
+Filament.loadVariant = (variant) => new Promise((resolve, reject) => {
+    const namespace = Filament;
+    const script = document.createElement('script');
+    script.src = Filament.scriptDirectory + variant + '.js';
+    script.onload = () => {
+        const factory = Filament;
+        Filament = namespace;
+        resolve(factory);
+    };
+    script.onerror = () => {
+        Filament = namespace;
+        reject(new Error(`Unable to load ${script.src}`));
+    };
+    document.head.appendChild(script);
+});
+
 Filament.clearAssetCache = () => {
     for (const key in Filament.assets) delete Filament.assets[key];
 };